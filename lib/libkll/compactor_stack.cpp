@@ -19,6 +19,7 @@
 
 #include <log/log.h>
 
+#include <algorithm>
 #include <vector>
 
 #include "random_generator.h"
@@ -51,6 +52,12 @@ CompactorStack::~CompactorStack() {
 // Initialize or reset the compactor stack and all counters and thresholds.
 void CompactorStack::Reset() {
     overall_capacity_ = 0;
+    for (std::vector<int64_t>& compactor : compactors_) {
+        if (compactor.capacity() > 0) {
+            compactor.clear();
+            spare_compactors_.push_back(std::move(compactor));
+        }
+    }
     ClearCompactors();
     sampler_ = nullptr;
     AddLevel();
@@ -66,6 +73,34 @@ void CompactorStack::Add(const int64_t value) {
     }
 }
 
+void CompactorStack::AddBatch(const int64_t* values, size_t count) {
+    if (sampler_ != nullptr) {
+        for (size_t i = 0; i < count; i++) {
+            sampler_->Add(values[i]);
+        }
+        return;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    std::vector<int64_t>& compactor = compactors_[0];
+    const size_t prev_size = compactor.size();
+    compactor.insert(compactor.end(), values, values + count);
+    // Keep the compactor sorted, so that Halve() does not have to sort it, as
+    // long as merging the run costs no more than sorting it. Small batches into
+    // a large compactor are left for Halve() to sort. std::is_sorted() stops at
+    // the first inversion, so it is cheap when the compactor is unsorted.
+    if (count * 16 >= prev_size &&
+        std::is_sorted(compactor.begin(), compactor.begin() + prev_size)) {
+        const auto run = compactor.begin() + prev_size;
+        std::sort(run, compactor.end());
+        std::inplace_merge(compactor.begin(), run, compactor.end());
+    }
+    num_items_in_compactors_ += count;
+    CompactStack();
+}
+
 // Adds an item to the compactor stack with weight >= 1.
 // Does nothing if weight <= 0.
 void CompactorStack::AddWithWeight(int64_t value, int weight) {
@@ -92,6 +127,42 @@ void CompactorStack::AddWithWeight(int64_t value, int weight) {
     }
 }
 
+void CompactorStack::Merge(const CompactorStack& other) {
+    // Copy when merging with itself, since the compactors are modified below.
+    std::vector<std::vector<int64_t>> self_compactors;
+    if (&other == this) {
+        self_compactors = compactors_;
+    }
+    const std::vector<std::vector<int64_t>>& other_compactors =
+            &other == this ? self_compactors : other.compactors_;
+    const auto other_sampled_item_and_weight = other.sampled_item_and_weight();
+
+    while (compactors_.size() < other_compactors.size()) {
+        AddLevel();
+    }
+    for (size_t h = 0; h < other_compactors.size(); h++) {
+        const std::vector<int64_t>& items = other_compactors[h];
+        if (items.empty()) {
+            continue;
+        }
+        // Items of a level replaced by the sampler carry a weight of 2^h.
+        // lowest_active_level() may grow while adding them.
+        if (static_cast<int>(h) < lowest_active_level()) {
+            for (const int64_t item : items) {
+                AddWithWeight(item, 1 << h);
+            }
+        } else {
+            compactors_[h].insert(compactors_[h].end(), items.begin(), items.end());
+            num_items_in_compactors_ += items.size();
+        }
+    }
+    if (other_sampled_item_and_weight.has_value()) {
+        AddWithWeight(other_sampled_item_and_weight->first,
+                      static_cast<int>(other_sampled_item_and_weight->second));
+    }
+    CompactStack();
+}
+
 void CompactorStack::SortCompactorContents() {
     for (std::vector<int64_t>& compactor : compactors_) {
         std::sort(compactor.begin(), compactor.end());
@@ -104,7 +175,12 @@ void CompactorStack::ClearCompactors() {
 }
 
 void CompactorStack::AddLevel() {
-    compactors_.resize(compactors_.size() + 1);
+    if (spare_compactors_.empty()) {
+        compactors_.emplace_back();
+    } else {
+        compactors_.push_back(std::move(spare_compactors_.back()));
+        spare_compactors_.pop_back();
+    }
 
     int cap_at_lowest_active_level = TargetCapacityAtLevel(lowest_active_level());
     // All levels i get capacity that previously level i-1 had, except the
@@ -159,13 +235,18 @@ void CompactorStack::CompactLevel(int level) {
 // to the up_compactor.
 void CompactorStack::Halve(std::vector<int64_t>* down_compactor,
                            std::vector<int64_t>* up_compactor) {
-    std::sort(down_compactor->begin(), down_compactor->end());
+    // Compactors are often already sorted, see AddBatch() and below.
+    if (!std::is_sorted(down_compactor->begin(), down_compactor->end())) {
+        std::sort(down_compactor->begin(), down_compactor->end());
+    }
     double half_of_items = down_compactor->size() / static_cast<double>(2);
     bool keep_even_items = (random_->UnbiasedUniform(2) == 0);
     num_items_in_compactors_ -= static_cast<int>(keep_even_items ? std::floor(half_of_items)
                                                                  : std::ceil(half_of_items));
 
     bool even = true;
+    const size_t prev_up_size = up_compactor->size();
+    const bool up_was_sorted = std::is_sorted(up_compactor->begin(), up_compactor->end());
 
     for (size_t i = 0; i < down_compactor->size(); i++) {
         if (even == keep_even_items) {
@@ -174,6 +255,13 @@ void CompactorStack::Halve(std::vector<int64_t>* down_compactor,
         even = !even;
     }
     down_compactor->clear();
+
+    // The added items are a sorted run, merging it keeps a sorted up_compactor
+    // sorted in linear time, which saves its sort when it is halved in turn.
+    if (up_was_sorted) {
+        std::inplace_merge(up_compactor->begin(), up_compactor->begin() + prev_up_size,
+                           up_compactor->end());
+    }
 }
 
 int CompactorStack::TargetCapacityAtLevel(int h) const {
@@ -62,6 +62,24 @@ void Encoder::SerializeToPackedStringAll(std::vector<int64_t>::const_iterator be
     }
 }
 
+void Encoder::SerializeToDiffEncodedPackedStringAll(std::vector<int64_t>::const_iterator begin,
+                                                    std::vector<int64_t>::const_iterator end,
+                                                    std::string* dst) {
+    dst->clear();
+    if (begin == end) {
+        return;
+    }
+    int64_t prev = *begin;
+    Encoder::AppendToString(prev, dst);
+    for (++begin; begin != end; ++begin) {
+        assert(prev <= *begin);
+        // The delta may not fit in an int64_t, but always fits in a uint64_t.
+        const uint64_t delta = static_cast<uint64_t>(*begin) - static_cast<uint64_t>(prev);
+        Encoder::AppendToString(static_cast<int64_t>(delta), dst);
+        prev = *begin;
+    }
+}
+
 }  // namespace encoding
 }  // namespace aggregation
 }  // namespace dist_proc
\ No newline at end of file
@@ -35,6 +35,13 @@ public:
                                            std::vector<int64_t>::const_iterator end,
                                            std::string* dst);
 
+    // Same as SerializeToPackedStringAll, but for values sorted in ascending
+    // order: encodes the first value and then the deltas to the next values,
+    // which are small for the values of a compactor and take fewer bytes.
+    static void SerializeToDiffEncodedPackedStringAll(
+            std::vector<int64_t>::const_iterator begin,
+            std::vector<int64_t>::const_iterator end, std::string* dst);
+
 private:
     // Max number of bytes needed to encode 64 bits as a varint (= ceil(64 / 7)).
     static const int8_t kMaxLength = 10;
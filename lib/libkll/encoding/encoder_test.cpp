@@ -136,6 +136,45 @@ TEST(EncoderTest, SerializeToPackedStringAllClearsPrepopulatedString) {
     EXPECT_EQ(empty, prepopulated);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// -------------- Tests for SerializeToDiffEncodedPackedStringAll ----------- //
+
+class DiffEncodedSerializationTest : public ::testing::TestWithParam<PackedEncodingTupleParam> {};
+
+TEST_P(DiffEncodedSerializationTest, CorrectDiffEncoding) {
+    PackedEncodingTupleParam params = GetParam();
+    std::string packed;
+
+    Encoder::SerializeToDiffEncodedPackedStringAll(params.values.begin(), params.values.end(),
+                                                   &packed);
+    std::string_view expected(params.encoding, params.encoding_length);
+    EXPECT_EQ(packed, expected);
+    EXPECT_EQ(packed.length(), params.encoding_length);
+}
+
+const PackedEncodingTupleParam diffEncodedCases[] = {
+        {{}, "", 0},
+        // Encoding one item should be identical to AppendToString.
+        {{0x80LL}, "\x80\x01", 2},
+        {{-0x01LL}, "\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x01", 10},
+        // The deltas of close values take one byte each.
+        {{0x200000LL, 0x200001LL, 0x200001LL, 0x200010LL}, "\x80\x80\x80\x01\x01\x00\x0F", 7},
+        {{-0x02LL, -0x01LL, 0x1LL}, "\xFE\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x01\x01\x02", 12},
+        // The delta does not fit in an int64_t.
+        {{std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()},
+         "\x80\x80\x80\x80\x80\x80\x80\x80\x80\x1\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x1",
+         20}};
+
+INSTANTIATE_TEST_SUITE_P(DiffEncodedSerializationTestCases, DiffEncodedSerializationTest,
+                         ::testing::ValuesIn(diffEncodedCases));
+
+TEST(EncoderTest, SerializeToDiffEncodedPackedStringAllClearsPrepopulatedString) {
+    std::string prepopulated = "some leftovers";
+    std::vector<int64_t> v = {1, 2, 3, 4, 5, 6, 7, 8, 9, 0xA, 0xB};
+    Encoder::SerializeToDiffEncodedPackedStringAll(v.begin(), v.end(), &prepopulated);
+    EXPECT_EQ(prepopulated, "\x1\x1\x1\x1\x1\x1\x1\x1\x1\x1\x1");
+}
+
 }  // namespace
 
 }  // namespace encoding
@@ -42,14 +42,26 @@ public:
     ~CompactorStack();
 
     // Initialize or reset the compactor stack and all counters and thresholds.
+    // The storage of the compactors is kept for the levels added afterwards, so
+    // that a stack recycled with Reset() does not allocate its levels again.
     void Reset();
 
     void Add(const int64_t value);
 
+    // Adds 'count' items with weight 1. The items are inserted into the lowest
+    // compactor as a single sorted run, followed by at most one CompactStack()
+    // call instead of one capacity check per item.
+    void AddBatch(const int64_t* values, size_t count);
+
     // Adds an item to the compactor stack with weight >= 1.
     // Does nothing if weight <= 0.
     void AddWithWeight(int64_t value, int weight);
 
+    // Adds the items stored in 'other' with their respective weights, as if all
+    // items added to 'other' had been added to this stack. Both stacks must
+    // have the same k.
+    void Merge(const CompactorStack& other);
+
     // Ensures that the contents of each compactor are sorted.
     void SortCompactorContents();
 
@@ -108,6 +120,9 @@ private:
     void Halve(std::vector<int64_t>* down_compactor, std::vector<int64_t>* up_compactor);
 
     std::vector<std::vector<int64_t>> compactors_;
+    // Empty compactors with the storage of the levels removed by Reset(),
+    // reused by AddLevel().
+    std::vector<std::vector<int64_t>> spare_compactors_;
     int k_;
     const double c_ = 2.0 / 3.0;
     int overall_capacity_;
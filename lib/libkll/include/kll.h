@@ -52,6 +52,12 @@ public:
     void Reset();
     void Add(int64_t value);
 
+    // Adds 'count' values, same as calling Add() for each of them but cheaper
+    // for large batches, e.g. values of pulled atoms: the values are sorted and
+    // inserted into the compactor stack as a single run, with at most one
+    // compaction pass.
+    void AddBatch(const int64_t* values, size_t count);
+
     // Adds a value to the aggregator with multiplicity 'weight' (same as adding
     // the value with Add(value) 'weight' times). Does nothing if weight <= 0.
     //
@@ -65,6 +71,12 @@ public:
     // downscaling and randomized rounding is negligible.
     void AddWeighted(int64_t value, int weight);
 
+    // Merges the values aggregated by 'other' into this aggregator, e.g. to
+    // roll up the sketches of several dimensions or buckets. Both aggregators
+    // must have been created with the same k and inv_eps. Returns false and
+    // leaves this aggregator unchanged otherwise.
+    bool Merge(const KllQuantile& other);
+
     // Not safe to be called concurrently.
     zetasketch::android::AggregatorStateProto SerializeToProto();
 
@@ -74,8 +86,10 @@ public:
 
 private:
     // Constructor.
-    KllQuantile(int64_t inv_eps, int64_t inv_delta, int k, RandomGenerator* random)
+    KllQuantile(int64_t inv_eps, int64_t inv_delta, int k, RandomGenerator* random,
+                bool diff_encode_compactors)
         : inv_eps_(inv_eps),
+          diff_encode_compactors_(diff_encode_compactors),
           owned_random_(random != nullptr ? nullptr : std::make_unique<MTRandomGenerator>()),
           compactor_stack_(inv_eps_, inv_delta, k,
                            random != nullptr ? random : owned_random_.get()) {
@@ -84,6 +98,8 @@ private:
     void UpdateMin(const int64_t value);
     void UpdateMax(const int64_t value);
     int64_t inv_eps_;
+    // Whether SerializeToProto writes diff_encoded_packed_values.
+    bool diff_encode_compactors_;
     // The (exact) minimum item encountered among all items.
     int64_t min_{};
     // The (exact) maximum item encountered among all items.
@@ -129,6 +145,12 @@ public:
     void set_random(RandomGenerator* random) {
         random_ = random;
     }
+    // Serialize the compactors as diff_encoded_packed_values instead of
+    // packed_values, which is smaller since the compactors are sorted. Default
+    // value: false
+    void set_diff_encode_compactors(bool diff_encode_compactors) {
+        diff_encode_compactors_ = diff_encode_compactors;
+    }
     int64_t inv_eps() const {
         return inv_eps_;
     }
@@ -141,12 +163,16 @@ public:
     RandomGenerator* random() const {
         return random_;
     }
+    bool diff_encode_compactors() const {
+        return diff_encode_compactors_;
+    }
 
 private:
     int64_t inv_eps_ = 1000;
     int64_t inv_delta_ = 100000;
     int k_ = 0;
     RandomGenerator* random_ = nullptr;
+    bool diff_encode_compactors_ = false;
 };
 
 }  // namespace aggregation
@@ -16,6 +16,7 @@
 
 #include "kll.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 
@@ -28,6 +29,7 @@ namespace dist_proc {
 namespace aggregation {
 
 using zetasketch::android::AggregatorStateProto;
+using zetasketch::android::KllQuantilesStateProto;
 
 std::unique_ptr<KllQuantile> KllQuantile::Create(std::string* error) {
     return Create(KllQuantileOptions(), error);
@@ -42,7 +44,8 @@ std::unique_ptr<KllQuantile> KllQuantile::Create(const KllQuantileOptions& optio
         return nullptr;
     }
     return std::unique_ptr<KllQuantile>(
-            new KllQuantile(options.inv_eps(), options.inv_delta(), options.k(), options.random()));
+            new KllQuantile(options.inv_eps(), options.inv_delta(), options.k(), options.random(),
+                            options.diff_encode_compactors()));
 }
 
 void KllQuantile::Add(const int64_t value) {
@@ -52,6 +55,17 @@ void KllQuantile::Add(const int64_t value) {
     num_values_++;
 }
 
+void KllQuantile::AddBatch(const int64_t* values, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    compactor_stack_.AddBatch(values, count);
+    const auto [min_it, max_it] = std::minmax_element(values, values + count);
+    UpdateMin(*min_it);
+    UpdateMax(*max_it);
+    num_values_ += count;
+}
+
 void KllQuantile::AddWeighted(int64_t value, int weight) {
     if (weight > 0) {
         compactor_stack_.AddWithWeight(value, weight);
@@ -61,6 +75,20 @@ void KllQuantile::AddWeighted(int64_t value, int weight) {
     }
 }
 
+bool KllQuantile::Merge(const KllQuantile& other) {
+    if (other.k() != k() || other.inv_eps_ != inv_eps_) {
+        return false;
+    }
+    if (other.num_values_ == 0) {
+        return true;
+    }
+    compactor_stack_.Merge(other.compactor_stack_);
+    UpdateMin(other.min_);
+    UpdateMax(other.max_);
+    num_values_ += other.num_values_;
+    return true;
+}
+
 AggregatorStateProto KllQuantile::SerializeToProto() {
     AggregatorStateProto aggregator_state;
 
@@ -92,11 +120,16 @@ AggregatorStateProto KllQuantile::SerializeToProto() {
     quantile_state->mutable_compactors()->Reserve(compactors.size());
 
     for (const auto& compactor : compactors) {
-        encoding::Encoder::SerializeToPackedStringAll(
-                compactor.begin(), compactor.end(),
-                quantile_state
-                        ->add_compactors()  // Adds one compactor to the compactors field.
-                        ->mutable_packed_values());
+        // Adds one compactor to the compactors field.
+        KllQuantilesStateProto::Compactor* compactor_state = quantile_state->add_compactors();
+        if (diff_encode_compactors_) {
+            encoding::Encoder::SerializeToDiffEncodedPackedStringAll(
+                    compactor.begin(), compactor.end(),
+                    compactor_state->mutable_diff_encoded_packed_values());
+        } else {
+            encoding::Encoder::SerializeToPackedStringAll(
+                    compactor.begin(), compactor.end(), compactor_state->mutable_packed_values());
+        }
     }
 
     // Encode sampler.
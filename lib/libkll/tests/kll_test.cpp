@@ -17,6 +17,8 @@
 
 #include <gtest/gtest.h>
 
+#include <vector>
+
 #include "kll-quantiles.pb.h"
 
 namespace dist_proc {
@@ -145,6 +147,25 @@ TEST(KllQuantileSerializationTest, QuantilesProtoFieldsAreCorrectlyPopulatedNonD
     EXPECT_EQ(quantiles_state.compactors_size(), 1);
 }
 
+TEST(KllQuantileSerializationTest, DiffEncodedCompactors) {
+    KllQuantileOptions options;
+    options.set_diff_encode_compactors(true);
+    std::unique_ptr<KllQuantile> aggregator = KllQuantile::Create(options);
+    for (int i = 10; i >= 1; i--) {
+        aggregator->Add(i * 1000);
+    }
+
+    AggregatorStateProto aggregator_state = aggregator->SerializeToProto();
+    const KllQuantilesStateProto& quantiles_state =
+            aggregator_state.GetExtension(kll_quantiles_state);
+    EXPECT_EQ(quantiles_state.compactors_size(), 1);
+    const KllQuantilesStateProto::Compactor& compactor = quantiles_state.compactors(0);
+    ASSERT_TRUE(compactor.has_diff_encoded_packed_values());
+    // 1000, then nine deltas of 1000, two bytes each instead of up to three.
+    EXPECT_EQ(compactor.diff_encoded_packed_values(),
+              "\xE8\a\xE8\a\xE8\a\xE8\a\xE8\a\xE8\a\xE8\a\xE8\a\xE8\a\xE8\a");
+}
+
 TEST(KllQuantileSerializationTest, EmptyQuantilesProto) {
     std::unique_ptr<KllQuantile> aggregator = KllQuantile::Create();
 
@@ -171,6 +192,86 @@ TEST(KllQuantileSerializationTest, EmptyQuantilesProto) {
     EXPECT_EQ(quantiles_state.compactors_size(), 0);
     ASSERT_FALSE(quantiles_state.has_sampler());
 }
+
+////////////////////////////////////////////////////////////////////////////////
+// ------------------------- Tests for AddBatch ----------------------------- //
+
+TEST(KllQuantileAddBatchTest, SameStateAsAdd) {
+    std::unique_ptr<KllQuantile> batch_aggregator = KllQuantile::Create();
+    std::unique_ptr<KllQuantile> single_aggregator = KllQuantile::Create();
+    const std::vector<int64_t> values = {7, -3, 12, 0, 7, 5};
+    batch_aggregator->AddBatch(values.data(), values.size());
+    for (int64_t value : values) {
+        single_aggregator->Add(value);
+    }
+    EXPECT_EQ(batch_aggregator->num_values(), 6);
+
+    EXPECT_EQ(batch_aggregator->SerializeToProto().SerializeAsString(),
+              single_aggregator->SerializeToProto().SerializeAsString());
+}
+
+TEST(KllQuantileAddBatchTest, EmptyBatch) {
+    std::unique_ptr<KllQuantile> aggregator = KllQuantile::Create();
+    aggregator->AddBatch(nullptr, 0);
+    EXPECT_EQ(aggregator->num_values(), 0);
+
+    const std::vector<int64_t> values = {4, 2};
+    aggregator->AddBatch(values.data(), values.size());
+    aggregator->AddBatch(values.data(), 0);
+    AggregatorStateProto aggregator_state = aggregator->SerializeToProto();
+    const KllQuantilesStateProto& quantiles_state =
+            aggregator_state.GetExtension(kll_quantiles_state);
+    EXPECT_EQ(aggregator->num_values(), 2);
+    EXPECT_EQ(quantiles_state.min(), "\x2");
+    EXPECT_EQ(quantiles_state.max(), "\x4");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// --------------------------- Tests for Merge ------------------------------ //
+
+TEST(KllQuantileMergeTest, SameStateAsAddingAllValues) {
+    std::unique_ptr<KllQuantile> aggregator = KllQuantile::Create();
+    std::unique_ptr<KllQuantile> other = KllQuantile::Create();
+    std::unique_ptr<KllQuantile> expected = KllQuantile::Create();
+    for (int i = 1; i <= 10; i++) {
+        (i % 3 == 0 ? other : aggregator)->Add(i);
+        expected->Add(i);
+    }
+
+    EXPECT_TRUE(aggregator->Merge(*other));
+    EXPECT_EQ(aggregator->num_values(), 10);
+    EXPECT_EQ(other->num_values(), 3);
+    EXPECT_EQ(aggregator->SerializeToProto().SerializeAsString(),
+              expected->SerializeToProto().SerializeAsString());
+}
+
+TEST(KllQuantileMergeTest, MergeIntoEmpty) {
+    std::unique_ptr<KllQuantile> aggregator = KllQuantile::Create();
+    std::unique_ptr<KllQuantile> other = KllQuantile::Create();
+    other->Add(-5);
+    other->Add(20);
+
+    EXPECT_TRUE(aggregator->Merge(*other));
+    EXPECT_EQ(aggregator->num_values(), 2);
+    EXPECT_EQ(aggregator->SerializeToProto().SerializeAsString(),
+              other->SerializeToProto().SerializeAsString());
+
+    // Merging an empty aggregator is a no-op.
+    EXPECT_TRUE(aggregator->Merge(*KllQuantile::Create()));
+    EXPECT_EQ(aggregator->num_values(), 2);
+}
+
+TEST(KllQuantileMergeTest, DifferentParametersNotMerged) {
+    KllQuantileOptions options;
+    options.set_k(256);
+    std::unique_ptr<KllQuantile> aggregator = KllQuantile::Create();
+    std::unique_ptr<KllQuantile> other = KllQuantile::Create(options);
+    other->Add(1);
+
+    EXPECT_FALSE(aggregator->Merge(*other));
+    EXPECT_EQ(aggregator->num_values(), 0);
+}
+
 }  // namespace
 
 }  // namespace aggregation
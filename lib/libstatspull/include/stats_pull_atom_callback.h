@@ -19,6 +19,11 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/cdefs.h>
+
+#ifndef __STATSD_PULL_THREADS_MIN_API__
+#define __STATSD_PULL_THREADS_MIN_API__ 36
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -165,6 +170,24 @@ void AStatsManager_setPullAtomCallback(int32_t atom_tag, AStatsManager_PullAtomM
  */
 void AStatsManager_clearPullAtomCallback(int32_t atom_tag);
 
+/**
+ * Sets the maximum number of threads used to run the pull callbacks of this process.
+ *
+ * By default (and when thread_count is 0) each callback runs on the binder thread that received
+ * the pull request, and pulls may wait for each other. With a positive thread_count, callbacks
+ * for different atom tags can run concurrently on up to thread_count threads, which are created
+ * on demand. Callbacks for the same atom tag are never run concurrently. Values above 8 are
+ * clamped to 8.
+ *
+ * Should be called before registering pull atom callbacks.
+ *
+ * \param thread_count      The maximum number of concurrent pull callbacks.
+ *
+ * Introduced in API 36.
+ */
+void AStatsManager_setPullAtomCallbackThreadCount(int32_t thread_count)
+        __INTRODUCED_IN(__STATSD_PULL_THREADS_MIN_API__);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+
+// Upper bound for AStatsManager_setPullAtomCallbackThreadCount.
+constexpr int32_t MAX_PULL_THREAD_COUNT = 8;
+
+/**
+ * Bounded pool of threads that run the pull callbacks of this process, so that a slow callback
+ * does not hold up the pulls of other atom tags. Pulls of the same atom tag are still run one at a
+ * time, in the order they were requested. Threads are started on demand and never exit, and the
+ * executor is intentionally leaked so that they do not need to be joined at process exit.
+ */
+class PullCallbackExecutor {
+public:
+    // Instances are not destroyed either, see the note above.
+    PullCallbackExecutor() {
+    }
+
+    static PullCallbackExecutor& getInstance() {
+        static PullCallbackExecutor* executor = new PullCallbackExecutor();
+        return *executor;
+    }
+
+    void setThreadCount(int32_t threadCount) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mMaxThreads = std::clamp(threadCount, 0, MAX_PULL_THREAD_COUNT);
+    }
+
+    // Returns false if pulls should run on the calling binder thread.
+    bool submit(int32_t atomTag, std::function<void()> pull) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mMaxThreads == 0) {
+            return false;
+        }
+        mPendingPulls.push_back({atomTag, std::move(pull)});
+        if (mIdleThreads == 0 && mNumThreads < mMaxThreads) {
+            mNumThreads++;
+            std::thread(&PullCallbackExecutor::processPulls, this).detach();
+        } else {
+            mCondition.notify_one();
+        }
+        return true;
+    }
+
+private:
+    struct PendingPull {
+        int32_t atomTag;
+        std::function<void()> pull;
+    };
+
+    // Returns the first pending pull whose atom tag is not being pulled by another thread.
+    std::deque<PendingPull>::iterator findRunnablePullLocked() {
+        return std::find_if(mPendingPulls.begin(), mPendingPulls.end(),
+                            [this](const PendingPull& pending) {
+                                return mActiveAtomTags.count(pending.atomTag) == 0;
+                            });
+    }
+
+    void processPulls() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mIdleThreads++;
+            mCondition.wait(lock,
+                            [this] { return findRunnablePullLocked() != mPendingPulls.end(); });
+            mIdleThreads--;
+
+            auto it = findRunnablePullLocked();
+            PendingPull pending = std::move(*it);
+            mPendingPulls.erase(it);
+            mActiveAtomTags.insert(pending.atomTag);
+
+            lock.unlock();
+            pending.pull();
+            lock.lock();
+
+            mActiveAtomTags.erase(pending.atomTag);
+            // A pull of the same atom tag may have been queued behind this one.
+            if (!mPendingPulls.empty()) {
+                mCondition.notify_one();
+            }
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<PendingPull> mPendingPulls;
+    std::set<int32_t> mActiveAtomTags;
+    int32_t mMaxThreads = 0;
+    int32_t mNumThreads = 0;
+    int32_t mIdleThreads = 0;
+};
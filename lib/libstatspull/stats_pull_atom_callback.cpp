@@ -21,19 +21,27 @@
 #include <android/binder_auto_utils.h>
 #include <android/binder_ibinder.h>
 #include <android/binder_manager.h>
+#include <fcntl.h>
 #include <stats_event.h>
 #include <stats_pull_atom_callback.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <map>
 #include <queue>
 #include <thread>
 #include <vector>
 
+#include "pull_callback_executor.h"
+
 using Status = ::ndk::ScopedAStatus;
 using aidl::android::os::BnPullAtomCallback;
 using aidl::android::os::IPullAtomResultReceiver;
 using aidl::android::os::IStatsd;
 using aidl::android::util::StatsEventParcel;
+using ::ndk::ScopedFileDescriptor;
 using ::ndk::SharedRefBase;
 
 struct AStatsEventList {
@@ -101,6 +109,46 @@ void AStatsManager_PullAtomMetadata_getAdditiveFields(AStatsManager_PullAtomMeta
     std::copy(metadata->additive_fields.begin(), metadata->additive_fields.end(), fields);
 }
 
+// Pulls at least this large are sent to statsd in a single shared memory blob instead of one
+// parcel per event.
+constexpr size_t MIN_SHARED_MEMORY_PULL_SIZE = 16 * 1024;  // 16 KB
+
+// Writes the events as |uint32_t size|bytes| records into a sealed memfd that statsd can parse in
+// place. Returns false if the shared memory could not be set up.
+static bool packEventsToSharedMemory(const AStatsEventList& statsEventList, size_t totalSize,
+                                     ScopedFileDescriptor* outFd) {
+    ScopedFileDescriptor fd(memfd_create("statsd_pull", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (fd.get() < 0 || ftruncate(fd.get(), totalSize) != 0) {
+        return false;
+    }
+    void* mapped = mmap(nullptr, totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    uint8_t* pos = (uint8_t*)mapped;
+    for (AStatsEvent* event : statsEventList.data) {
+        size_t size;
+        uint8_t* buffer = AStatsEvent_getBuffer(event, &size);
+        const uint32_t eventSize = size;
+        memcpy(pos, &eventSize, sizeof(eventSize));
+        memcpy(pos + sizeof(eventSize), buffer, size);
+        pos += sizeof(eventSize) + size;
+    }
+    munmap(mapped, totalSize);
+
+    // F_SEAL_WRITE can only be added once there are no writable mappings left.
+    if (fcntl(fd.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) !=
+        0) {
+        return false;
+    }
+    *outFd = std::move(fd);
+    return true;
+}
+
+void AStatsManager_setPullAtomCallbackThreadCount(int32_t thread_count) {
+    PullCallbackExecutor::getInstance().setThreadCount(thread_count);
+}
+
 class StatsPullAtomCallbackInternal : public BnPullAtomCallback {
   public:
     StatsPullAtomCallbackInternal(const AStatsManager_PullAtomCallback callback, void* cookie,
@@ -114,43 +162,75 @@ class StatsPullAtomCallbackInternal : public BnPullAtomCallback {
 
     Status onPullAtom(int32_t atomTag,
                       const std::shared_ptr<IPullAtomResultReceiver>& resultReceiver) override {
+        std::shared_ptr<StatsPullAtomCallbackInternal> self =
+                ref<StatsPullAtomCallbackInternal>();
+        const bool submitted = PullCallbackExecutor::getInstance().submit(
+                atomTag, [self, atomTag, resultReceiver] { self->pull(atomTag, resultReceiver); });
+        if (!submitted) {
+            pull(atomTag, resultReceiver);
+        }
+        return Status::ok();
+    }
+
+    int64_t getCoolDownMillis() const { return mCoolDownMillis; }
+    int64_t getTimeoutMillis() const { return mTimeoutMillis; }
+    const std::vector<int32_t>& getAdditiveFields() const { return mAdditiveFields; }
+
+  private:
+    void pull(int32_t atomTag, const std::shared_ptr<IPullAtomResultReceiver>& resultReceiver) {
         AStatsEventList statsEventList;
         int successInt = mCallback(atomTag, &statsEventList, mCookie);
         bool success = successInt == AStatsManager_PULL_SUCCESS;
 
-        // Convert stats_events into StatsEventParcels.
-        std::vector<StatsEventParcel> parcels;
+        bool sent = false;
 
         // Resolves fuzz build failure in b/161575591.
 #if defined(__ANDROID_APEX__) || defined(LIB_STATS_PULL_TESTS_FLAG)
-        for (int i = 0; i < statsEventList.data.size(); i++) {
+        size_t totalSize = 0;
+        for (AStatsEvent* event : statsEventList.data) {
             size_t size;
-            uint8_t* buffer = AStatsEvent_getBuffer(statsEventList.data[i], &size);
+            AStatsEvent_getBuffer(event, &size);
+            totalSize += sizeof(uint32_t) + size;
+        }
 
-            StatsEventParcel p;
-            // vector.assign() creates a copy, but this is inevitable unless
-            // stats_event.h/c uses a vector as opposed to a buffer.
-            p.buffer.assign(buffer, buffer + size);
-            parcels.push_back(std::move(p));
+        // Large pulls skip the per event parcels and copies.
+        ScopedFileDescriptor fd;
+        if (totalSize >= MIN_SHARED_MEMORY_PULL_SIZE && totalSize <= INT32_MAX &&
+            packEventsToSharedMemory(statsEventList, totalSize, &fd)) {
+            Status status = resultReceiver->pullFinishedShared(atomTag, success, fd, totalSize);
+            sent = status.isOk();
         }
 #endif
 
-        Status status = resultReceiver->pullFinished(atomTag, success, parcels);
-        if (!status.isOk()) {
-            std::vector<StatsEventParcel> emptyParcels;
-            resultReceiver->pullFinished(atomTag, /*success=*/false, emptyParcels);
+        if (!sent) {
+            // Convert stats_events into StatsEventParcels.
+            std::vector<StatsEventParcel> parcels;
+
+#if defined(__ANDROID_APEX__) || defined(LIB_STATS_PULL_TESTS_FLAG)
+            parcels.reserve(statsEventList.data.size());
+            for (int i = 0; i < statsEventList.data.size(); i++) {
+                size_t size;
+                uint8_t* buffer = AStatsEvent_getBuffer(statsEventList.data[i], &size);
+
+                StatsEventParcel p;
+                // vector.assign() creates a copy, but this is inevitable unless
+                // stats_event.h/c uses a vector as opposed to a buffer.
+                p.buffer.assign(buffer, buffer + size);
+                parcels.push_back(std::move(p));
+            }
+#endif
+
+            Status status = resultReceiver->pullFinished(atomTag, success, parcels);
+            if (!status.isOk()) {
+                std::vector<StatsEventParcel> emptyParcels;
+                resultReceiver->pullFinished(atomTag, /*success=*/false, emptyParcels);
+            }
         }
         for (int i = 0; i < statsEventList.data.size(); i++) {
             AStatsEvent_release(statsEventList.data[i]);
         }
-        return Status::ok();
     }
 
-    int64_t getCoolDownMillis() const { return mCoolDownMillis; }
-    int64_t getTimeoutMillis() const { return mTimeoutMillis; }
-    const std::vector<int32_t>& getAdditiveFields() const { return mAdditiveFields; }
-
-  private:
     const AStatsManager_PullAtomCallback mCallback;
     void* mCookie;
     const int64_t mCoolDownMillis;
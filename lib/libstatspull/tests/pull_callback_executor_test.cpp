@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pull_callback_executor.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+using testing::ElementsAre;
+
+constexpr auto kWaitTimeout = 5s;
+
+// The executor threads never exit, so the executors are leaked like the singleton.
+PullCallbackExecutor* createExecutor(int32_t threadCount) {
+    PullCallbackExecutor* executor = new PullCallbackExecutor();
+    executor->setThreadCount(threadCount);
+    return executor;
+}
+
+// Counts down the pulls run by an executor.
+class PullsDone {
+public:
+    explicit PullsDone(int count) : mRemaining(count) {
+    }
+
+    void countDown() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRemaining--;
+        mCondition.notify_all();
+    }
+
+    bool wait() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        return mCondition.wait_for(lock, kWaitTimeout, [this] { return mRemaining == 0; });
+    }
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    int mRemaining;
+};
+
+}  // anonymous namespace
+
+TEST(PullCallbackExecutorTest, TestSameAtomTagRunsInOrder) {
+    PullCallbackExecutor* executor = createExecutor(/*threadCount=*/4);
+    constexpr int kPullCount = 5;
+    PullsDone done(kPullCount);
+
+    std::mutex mutex;
+    std::vector<int> order;
+    int running = 0;
+    int maxRunning = 0;
+    for (int i = 0; i < kPullCount; i++) {
+        ASSERT_TRUE(executor->submit(/*atomTag=*/1, [&, i] {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running++;
+                maxRunning = std::max(maxRunning, running);
+                order.push_back(i);
+            }
+            // leaves room for another thread to pick up the next pull of the tag
+            std::this_thread::sleep_for(10ms);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running--;
+            }
+            done.countDown();
+        }));
+    }
+
+    ASSERT_TRUE(done.wait());
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(maxRunning, 1);
+    EXPECT_THAT(order, ElementsAre(0, 1, 2, 3, 4));
+}
+
+TEST(PullCallbackExecutorTest, TestDifferentAtomTagsRunConcurrently) {
+    PullCallbackExecutor* executor = createExecutor(/*threadCount=*/2);
+    PullsDone done(2);
+
+    // each pull waits for the other one to start, which only happens if they run concurrently
+    std::mutex mutex;
+    std::condition_variable condition;
+    int started = 0;
+    int overlapping = 0;
+    for (int32_t atomTag : {1, 2}) {
+        ASSERT_TRUE(executor->submit(atomTag, [&] {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                started++;
+                condition.notify_all();
+                if (condition.wait_for(lock, kWaitTimeout, [&] { return started == 2; })) {
+                    overlapping++;
+                }
+            }
+            done.countDown();
+        }));
+    }
+
+    ASSERT_TRUE(done.wait());
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(overlapping, 2);
+}
+
+TEST(PullCallbackExecutorTest, TestZeroThreadsRunsInline) {
+    bool pulled = false;
+
+    // the default thread count is 0
+    PullCallbackExecutor* executor = new PullCallbackExecutor();
+    EXPECT_FALSE(executor->submit(/*atomTag=*/1, [&] { pulled = true; }));
+
+    executor->setThreadCount(2);
+    executor->setThreadCount(0);
+    EXPECT_FALSE(executor->submit(/*atomTag=*/1, [&] { pulled = true; }));
+
+    // negative values are clamped to 0
+    executor->setThreadCount(-1);
+    EXPECT_FALSE(executor->submit(/*atomTag=*/1, [&] { pulled = true; }));
+
+    // the caller runs the pull on its own thread, the executor does not
+    std::this_thread::sleep_for(10ms);
+    EXPECT_FALSE(pulled);
+}
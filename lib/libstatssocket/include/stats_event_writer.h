@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats_buffer_writer.h"
+
+/**
+ * Header only alternative to the AStatsEvent builder for atoms whose schema is known at compile
+ * time, such as the atoms generated by stats-log-api-gen.
+ *
+ * The schema fixes the type, order and annotations of every field, so the max encoded size is a
+ * compile time constant and the event is encoded into a stack buffer without the per field
+ * overflow, type and annotation checks of the builder. The resulting buffer is identical to the
+ * one built by AStatsEvent for the same values.
+ *
+ * Example:
+ *   using ScreenStateChanged = StatsAtomSchema<StatsAtomId<29>,
+ *           StatsInt32Field<StatsBoolAnnotation<ASTATSLOG_ANNOTATION_ID_EXCLUSIVE_STATE, true>>>;
+ *   StatsEventWriter<ScreenStateChanged>::write(state);
+ *
+ * Only push atoms made of scalar and bounded length string fields are supported. Events are
+ * written with write_buffer_to_statsd(), which is not exported from the libstatssocket APEX
+ * library, so this is meant for code built along with it.
+ * (*ENCODING MUST BE IN SYNC WITH stats_event.c*)
+ */
+
+namespace stats_event_encoding {
+
+constexpr uint8_t kInt32Type = 0x00;
+constexpr uint8_t kInt64Type = 0x01;
+constexpr uint8_t kStringType = 0x02;
+constexpr uint8_t kFloatType = 0x04;
+constexpr uint8_t kBoolType = 0x05;
+constexpr uint8_t kObjectType = 0x07;
+
+constexpr size_t kMaxPushEventPayload = 4068 - 4;
+constexpr size_t kMaxAnnotationCount = 15;
+constexpr size_t kMaxByteValue = 127;
+
+template <class T>
+inline uint8_t* appendValue(uint8_t* pos, T value) {
+    memcpy(pos, &value, sizeof(value));
+    return pos + sizeof(value);
+}
+
+template <class... Annotations>
+struct AnnotationList {
+    static_assert(sizeof...(Annotations) <= kMaxAnnotationCount, "Too many annotations");
+
+    static constexpr size_t kEncodedSize = (0 + ... + Annotations::kEncodedSize);
+
+    static constexpr uint8_t typeByte(uint8_t typeId) {
+        return (uint8_t)(sizeof...(Annotations) << 4) | typeId;
+    }
+
+    static inline uint8_t* encode(uint8_t* pos) {
+        ((pos = Annotations::encode(pos)), ...);
+        return pos;
+    }
+};
+
+template <class T, uint8_t TypeId, class... Annotations>
+struct ScalarField {
+    typedef T value_type;
+
+    static constexpr size_t kMaxEncodedSize =
+            sizeof(uint8_t) + sizeof(T) + AnnotationList<Annotations...>::kEncodedSize;
+
+    static inline uint8_t* encode(uint8_t* pos, T value) {
+        *pos++ = AnnotationList<Annotations...>::typeByte(TypeId);
+        pos = appendValue(pos, value);
+        return AnnotationList<Annotations...>::encode(pos);
+    }
+};
+
+}  // namespace stats_event_encoding
+
+template <uint8_t AnnotationId, bool Value>
+struct StatsBoolAnnotation {
+    static_assert(AnnotationId <= stats_event_encoding::kMaxByteValue, "Annotation id too large");
+
+    static constexpr size_t kEncodedSize = 3 * sizeof(uint8_t);
+
+    static inline uint8_t* encode(uint8_t* pos) {
+        *pos++ = AnnotationId;
+        *pos++ = stats_event_encoding::kBoolType;
+        *pos++ = Value;
+        return pos;
+    }
+};
+
+template <uint8_t AnnotationId, int32_t Value>
+struct StatsInt32Annotation {
+    static_assert(AnnotationId <= stats_event_encoding::kMaxByteValue, "Annotation id too large");
+
+    static constexpr size_t kEncodedSize = 2 * sizeof(uint8_t) + sizeof(int32_t);
+
+    static inline uint8_t* encode(uint8_t* pos) {
+        *pos++ = AnnotationId;
+        *pos++ = stats_event_encoding::kInt32Type;
+        return stats_event_encoding::appendValue(pos, Value);
+    }
+};
+
+template <class... Annotations>
+using StatsInt32Field =
+        stats_event_encoding::ScalarField<int32_t, stats_event_encoding::kInt32Type,
+                                          Annotations...>;
+
+template <class... Annotations>
+using StatsInt64Field =
+        stats_event_encoding::ScalarField<int64_t, stats_event_encoding::kInt64Type,
+                                          Annotations...>;
+
+template <class... Annotations>
+using StatsFloatField =
+        stats_event_encoding::ScalarField<float, stats_event_encoding::kFloatType,
+                                          Annotations...>;
+
+template <class... Annotations>
+using StatsBoolField =
+        stats_event_encoding::ScalarField<bool, stats_event_encoding::kBoolType, Annotations...>;
+
+/**
+ * UTF8 string field, values longer than MaxLength bytes are truncated. A null value is written
+ * as an empty string.
+ */
+template <size_t MaxLength, class... Annotations>
+struct StatsStringField {
+    typedef const char* value_type;
+
+    static constexpr size_t kMaxEncodedSize =
+            sizeof(uint8_t) + sizeof(int32_t) + MaxLength +
+            stats_event_encoding::AnnotationList<Annotations...>::kEncodedSize;
+
+    static inline uint8_t* encode(uint8_t* pos, const char* value) {
+        using namespace stats_event_encoding;
+        const int32_t size = value == nullptr ? 0 : strnlen(value, MaxLength);
+        *pos++ = AnnotationList<Annotations...>::typeByte(kStringType);
+        pos = appendValue(pos, size);
+        if (size > 0) {
+            memcpy(pos, value, size);
+        }
+        return AnnotationList<Annotations...>::encode(pos + size);
+    }
+};
+
+/**
+ * Atom id of a schema, along with the atom level annotations
+ */
+template <uint32_t AtomId, class... Annotations>
+struct StatsAtomId {
+    static constexpr uint32_t kAtomId = AtomId;
+
+    typedef stats_event_encoding::ScalarField<int32_t, stats_event_encoding::kInt32Type,
+                                              Annotations...>
+            Field;
+};
+
+template <class AtomIdField, class... Fields>
+struct StatsAtomSchema {
+    static constexpr uint32_t kAtomId = AtomIdField::kAtomId;
+
+    // timestamp & atom id are elements of the event as well
+    static constexpr size_t kElementsCount = 2 + sizeof...(Fields);
+
+    static constexpr size_t kMaxEncodedSize =
+            2 * sizeof(uint8_t) +
+            stats_event_encoding::ScalarField<int64_t, stats_event_encoding::kInt64Type>::
+                    kMaxEncodedSize +
+            AtomIdField::Field::kMaxEncodedSize + (0 + ... + Fields::kMaxEncodedSize);
+
+    static_assert(kAtomId != 0, "Atom id must be set");
+    static_assert(kElementsCount <= stats_event_encoding::kMaxByteValue, "Too many fields");
+    static_assert(kMaxEncodedSize <= stats_event_encoding::kMaxPushEventPayload,
+                  "Atom does not fit in a push event");
+};
+
+template <class Schema>
+class StatsEventWriter;
+
+template <class AtomIdField, class... Fields>
+class StatsEventWriter<StatsAtomSchema<AtomIdField, Fields...>> {
+public:
+    typedef StatsAtomSchema<AtomIdField, Fields...> Schema;
+
+    /**
+     * @brief Encodes the event into the buffer
+     *
+     * @param buffer output buffer, at least Schema::kMaxEncodedSize bytes
+     * @param timestampNs elapsed realtime timestamp of the event
+     * @return size of the encoded event in bytes
+     */
+    static inline size_t encode(uint8_t* buffer, int64_t timestampNs,
+                                typename Fields::value_type... values) {
+        using namespace stats_event_encoding;
+        uint8_t* pos = buffer;
+        *pos++ = kObjectType;
+        *pos++ = (uint8_t)Schema::kElementsCount;
+        pos = ScalarField<int64_t, kInt64Type>::encode(pos, timestampNs);
+        pos = AtomIdField::Field::encode(pos, (int32_t)Schema::kAtomId);
+        ((pos = Fields::encode(pos, values)), ...);
+        return pos - buffer;
+    }
+
+    /**
+     * @brief Encodes the event timestamped now and writes it to statsd
+     *
+     * @return same as write_buffer_to_statsd()
+     */
+    static inline int write(typename Fields::value_type... values) {
+        uint8_t buffer[Schema::kMaxEncodedSize];
+        const size_t size = encode(buffer, getElapsedRealtimeNs(), values...);
+        return write_buffer_to_statsd(buffer, size, Schema::kAtomId);
+    }
+
+private:
+    static inline int64_t getElapsedRealtimeNs() {
+        struct timespec t = {0, 0};
+        clock_gettime(CLOCK_BOOTTIME, &t);
+        return (int64_t)t.tv_sec * 1000000000LL + t.tv_nsec;
+    }
+};
+
+#endif  // __cplusplus
@@ -22,9 +22,15 @@
 
 #include "stats_buffer_writer_impl.h"
 #include "stats_buffer_writer_queue.h"
+#include "stats_socket_throttler.h"
 #include "statsd_writer.h"
 
 static const uint32_t kStatsEventTag = 1937006964;
+// Tag of datagrams packing several atoms (*MUST BE IN SYNC WITH statsd StatsSocketListener*)
+static const uint32_t kStatsEventListTag = 1937006965;
+// Tag of datagrams registering a shared memory ring (*MUST BE IN SYNC WITH statsd
+// StatsSocketListener*)
+static const uint32_t kStatsRingRegistrationTag = 1937006966;
 
 extern struct android_log_transport_write statsdLoggerWrite;
 
@@ -54,13 +60,33 @@ int stats_log_is_closed() {
     return statsdLoggerWrite.isClosed && (*statsdLoggerWrite.isClosed)();
 }
 
+/**
+ * @brief Feeds the write outcome into the adaptive throttling. Only EAGAIN means that statsd can
+ * not keep up, other errors are not related to the load
+ */
+static void note_write_result(int ret) {
+    if (ret > 0) {
+        note_socket_congestion(false);
+    } else if (ret == -EAGAIN) {
+        note_socket_congestion(true);
+    }
+}
+
 int write_buffer_to_statsd(void* buffer, size_t size, uint32_t atomId) {
     const int kQueueOverflowErrorCode = 1;
+    // Keep in sync with StatsSocketLossReporter::kAtomSampledErrorCode
+    const int kAtomSampledErrorCode = 3;
+    if (should_throttle_atom(atomId)) {
+        // reported as a loss so that statsd can account for the sampled out atoms
+        note_log_drop(kAtomSampledErrorCode, atomId);
+        return 0;
+    }
     if (should_write_via_queue(atomId)) {
         const bool ret = write_buffer_to_statsd_queue(buffer, size, atomId);
         if (!ret) {
             // to account on the loss, note atom drop with predefined internal error code
             note_log_drop(kQueueOverflowErrorCode, atomId);
+            note_socket_congestion(true);
         }
         return ret;
     }
@@ -77,6 +103,7 @@ int write_buffer_to_statsd_impl(void* buffer, size_t size, uint32_t atomId, bool
     vecs[1].iov_len = size;
 
     ret = __write_to_statsd(vecs, 2);
+    note_write_result(ret);
 
     if (ret < 0 && doNoteDrop) {
         note_log_drop(ret, atomId);
@@ -85,6 +112,27 @@ int write_buffer_to_statsd_impl(void* buffer, size_t size, uint32_t atomId, bool
     return ret;
 }
 
+int write_atom_list_to_statsd_impl(void* buffer, size_t size) {
+    struct iovec vecs[2];
+    vecs[0].iov_base = (void*)&kStatsEventListTag;
+    vecs[0].iov_len = sizeof(kStatsEventListTag);
+    vecs[1].iov_base = buffer;
+    vecs[1].iov_len = size;
+
+    const int ret = __write_to_statsd(vecs, 2);
+    note_write_result(ret);
+    return ret;
+}
+
+int write_ring_registration_to_statsd(int memFd, int eventFd) {
+    struct iovec vec;
+    vec.iov_base = (void*)&kStatsRingRegistrationTag;
+    vec.iov_len = sizeof(kStatsRingRegistrationTag);
+
+    const int fds[2] = {memFd, eventFd};
+    return statsd_writer_write_with_fds(&vec, 1, fds, 2);
+}
+
 static int __write_to_stats_daemon(struct iovec* vec, size_t nr) {
     int save_errno;
     struct timespec ts;
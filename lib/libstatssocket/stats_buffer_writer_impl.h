@@ -25,4 +25,16 @@ __BEGIN_DECLS
 
 int write_buffer_to_statsd_impl(void* buffer, size_t size, uint32_t atomId, bool doNoteDrop);
 
+/**
+ * Writes several atoms in a single datagram. |buffer| is a sequence of |uint32_t size|atom buffer|
+ * records which is unpacked by statsd StatsSocketListener. Atom drops are not noted.
+ */
+int write_atom_list_to_statsd_impl(void* buffer, size_t size);
+
+/**
+ * Registers a shared memory ring and its eventfd with statsd, see StatsRingWriter. Fails with
+ * -EBADF if the socket has not been connected yet.
+ */
+int write_ring_registration_to_statsd(int memFd, int eventFd);
+
 __END_DECLS
@@ -17,17 +17,27 @@
 #include "stats_buffer_writer_queue.h"
 
 #include <private/android_filesystem_config.h>
+#include <string.h>
 #include <unistd.h>
 
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif
+
 #include <chrono>
 #include <queue>
 #include <thread>
 
 #include "stats_buffer_writer_impl.h"
 #include "stats_buffer_writer_queue_impl.h"
+#include "stats_socket_loss_reporter.h"
 #include "utils.h"
 
-BufferWriterQueue::BufferWriterQueue() : mWorkThread(&BufferWriterQueue::processCommands, this) {
+BufferWriterQueue::BufferWriterQueue(bool coalesceAtoms,
+                                     std::unique_ptr<StatsRingWriter> ringWriter)
+    : mCoalesceAtoms(coalesceAtoms),
+      mRingWriter(std::move(ringWriter)),
+      mWorkThread(&BufferWriterQueue::processCommands, this) {
 }
 
 BufferWriterQueue::~BufferWriterQueue() {
@@ -38,11 +48,26 @@ BufferWriterQueue::~BufferWriterQueue() {
 }
 
 bool BufferWriterQueue::write(const uint8_t* buffer, size_t size, uint32_t atomId) {
-    Cmd cmd = createWriteBufferCmd(buffer, size, atomId);
-    if (cmd.buffer == NULL) {
-        return false;
+    size_t queueSize = 0;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mCmdQueue.size() >= kQueueMaxSizeLimit) {
+            return false;
+        }
+        Cmd cmd = createWriteBufferCmdLocked(buffer, size, atomId);
+        if (cmd.buffer == NULL) {
+            return false;
+        }
+        mCmdQueue.push_back(cmd);
+        queueSize = mCmdQueue.size();
+        if (queueSize > mQueueHighWaterMark) {
+            mQueueHighWaterMark = queueSize;
+        }
     }
-    return pushToQueue(cmd);
+    mCondition.notify_one();
+    // the reporter keeps its own max which is reset on every report
+    StatsSocketLossReporter::getInstance().noteQueueHighWaterMark(queueSize);
+    return true;
 }
 
 size_t BufferWriterQueue::getQueueSize() const {
@@ -50,6 +75,11 @@ size_t BufferWriterQueue::getQueueSize() const {
     return mCmdQueue.size();
 }
 
+size_t BufferWriterQueue::getQueueHighWaterMark() const {
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mQueueHighWaterMark;
+}
+
 bool BufferWriterQueue::pushToQueue(const Cmd& cmd) {
     {
         std::unique_lock<std::mutex> lock(mMutex);
@@ -58,25 +88,50 @@ bool BufferWriterQueue::pushToQueue(const Cmd& cmd) {
             // error code
             return false;
         }
-        mCmdQueue.push(cmd);
+        mCmdQueue.push_back(cmd);
     }
     mCondition.notify_one();
     return true;
 }
 
-BufferWriterQueue::Cmd BufferWriterQueue::createWriteBufferCmd(const uint8_t* buffer, size_t size,
-                                                               uint32_t atomId) {
+BufferWriterQueue::Cmd BufferWriterQueue::createWriteBufferCmdLocked(const uint8_t* buffer,
+                                                                     size_t size,
+                                                                     uint32_t atomId) {
     BufferWriterQueue::Cmd writeCmd;
     writeCmd.atomId = atomId;
-    writeCmd.buffer = (uint8_t*)malloc(size);
-    if (writeCmd.buffer == NULL) {
-        return writeCmd;
+    if (size <= kSlabSize) {
+        if (mSlabs == nullptr) {
+            // not value-initialized, the pages are only touched once the slabs are used
+            mSlabs.reset(new uint8_t[kQueueMaxSizeLimit * kSlabSize]);
+            mFreeSlabs.reserve(kQueueMaxSizeLimit);
+            for (int i = kQueueMaxSizeLimit - 1; i >= 0; i--) {
+                mFreeSlabs.push_back(mSlabs.get() + i * kSlabSize);
+            }
+        }
+        // the queue size is checked before, so a slab is always available
+        writeCmd.buffer = mFreeSlabs.back();
+        mFreeSlabs.pop_back();
+        writeCmd.isSlab = true;
+    } else {
+        writeCmd.buffer = (uint8_t*)malloc(size);
+        if (writeCmd.buffer == NULL) {
+            return writeCmd;
+        }
     }
     memcpy(writeCmd.buffer, buffer, size);
     writeCmd.size = size;
     return writeCmd;
 }
 
+void BufferWriterQueue::releaseCmdBufferLocked(Cmd& cmd) {
+    if (cmd.isSlab) {
+        mFreeSlabs.push_back(cmd.buffer);
+    } else {
+        free(cmd.buffer);
+    }
+    cmd.buffer = NULL;
+}
+
 void BufferWriterQueue::terminate() {
     if (mWorkThread.joinable()) {
         mDoTerminate = true;
@@ -90,40 +145,51 @@ void BufferWriterQueue::terminate() {
 void BufferWriterQueue::drainQueue() {
     std::unique_lock<std::mutex> lock(mMutex);
     while (!mCmdQueue.empty()) {
-        free(mCmdQueue.front().buffer);
-        mCmdQueue.pop();
+        releaseCmdBufferLocked(mCmdQueue.front());
+        mCmdQueue.pop_front();
     }
 }
 
 void BufferWriterQueue::processCommands() {
+    // temporary local thread copy
+    std::vector<Cmd> cmds;
     while (true) {
-        // temporary local thread copy
-        Cmd cmd;
+        cmds.clear();
         {
             std::unique_lock<std::mutex> lock(mMutex);
             if (mCmdQueue.empty()) {
                 mCondition.wait(lock, [this] { return !this->mCmdQueue.empty(); });
             }
-            cmd = mCmdQueue.front();
+            if (mCoalesceAtoms) {
+                collectCommandsLocked(cmds);
+            } else {
+                cmds.push_back(mCmdQueue.front());
+            }
         }
 
-        if (cmd.buffer == NULL) {
+        if (cmds[0].buffer == NULL) {
             // null buffer ptr used as a marker of the termination request
             return;
         }
 
-        const bool writeSuccess = handleCommand(cmd);
+        const bool writeSuccess = cmds.size() == 1 ? handleCommand(cmds[0])
+                                                   : handleCommandList(cmds.data(), cmds.size());
         if (writeSuccess) {
-            // no event drop is observed otherwise command remains in the queue
+            // no event drop is observed otherwise commands remain in the queue
             // and worker thread will try to log later on
 
-            // call free() explicitly here to free memory before the mutex lock
-            free(cmd.buffer);
+            bool queueDrained = false;
             {
                 std::unique_lock<std::mutex> lock(mMutex);
-                // this will lead to Cmd destructor call which will be no-op since now the
-                // buffer is NULL
-                mCmdQueue.pop();
+                for (size_t i = 0; i < cmds.size(); i++) {
+                    releaseCmdBufferLocked(mCmdQueue.front());
+                    mCmdQueue.pop_front();
+                }
+                queueDrained = mCmdQueue.empty();
+            }
+            if (queueDrained) {
+                // the backlog is cleared, report its high-water mark even if nothing was lost
+                StatsSocketLossReporter::getInstance().dumpAtomsLossStats();
             }
         }
         // TODO (b/258003151): add logging info about retry count
@@ -141,13 +207,82 @@ void BufferWriterQueue::processCommands() {
     }
 }
 
+void BufferWriterQueue::collectCommandsLocked(std::vector<Cmd>& cmds) const {
+    // the first command is always picked, even if it is the termination marker
+    cmds.push_back(mCmdQueue.front());
+    size_t listSize = sizeof(uint32_t) + cmds[0].size;
+    for (auto it = mCmdQueue.begin() + 1; it != mCmdQueue.end(); ++it) {
+        listSize += sizeof(uint32_t) + it->size;
+        if (it->buffer == NULL || listSize > kMaxAtomListSize) {
+            break;
+        }
+        cmds.push_back(*it);
+    }
+}
+
 bool BufferWriterQueue::handleCommand(const Cmd& cmd) const {
+    if (mRingWriter != nullptr) {
+        const struct iovec atom = {cmd.buffer, (size_t)cmd.size};
+        if (mRingWriter->write(&atom, 1)) {
+            return true;
+        }
+    }
     // skip log drop if occurs, since the atom remains in the queue and write will be retried
     return write_buffer_to_statsd_impl(cmd.buffer, cmd.size, cmd.atomId, /*doNoteDrop*/ false) > 0;
 }
 
+bool BufferWriterQueue::handleCommandList(const Cmd* cmds, size_t count) const {
+    if (mRingWriter != nullptr) {
+        struct iovec atoms[count];
+        for (size_t i = 0; i < count; i++) {
+            atoms[i] = {cmds[i].buffer, (size_t)cmds[i].size};
+        }
+        if (mRingWriter->write(atoms, count)) {
+            return true;
+        }
+    }
+    // format: |uint32_t size|atom buffer| for each atom
+    uint8_t buffer[kMaxAtomListSize];
+    size_t size = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t atomSize = cmds[i].size;
+        memcpy(buffer + size, &atomSize, sizeof(atomSize));
+        size += sizeof(atomSize);
+        memcpy(buffer + size, cmds[i].buffer, atomSize);
+        size += atomSize;
+    }
+    return write_atom_list_to_statsd_impl(buffer, size) > 0;
+}
+
+// Opt-in with the statsd_native_boot socket_atom_coalescing flag, read once per process
+static bool is_atom_coalescing_enabled() {
+#ifdef __ANDROID__
+    char value[PROP_VALUE_MAX] = "";
+    __system_property_get("persist.device_config.statsd_native_boot.socket_atom_coalescing",
+                          value);
+    return strcmp(value, "true") == 0;
+#else
+    return false;
+#endif
+}
+
+// Opt-in with the statsd_native_boot socket_shared_memory_ring flag, read once per process.
+// statsd reads the same boot flag to accept the ring registrations
+static bool is_shared_memory_ring_enabled() {
+#ifdef __ANDROID__
+    char value[PROP_VALUE_MAX] = "";
+    __system_property_get("persist.device_config.statsd_native_boot.socket_shared_memory_ring",
+                          value);
+    return strcmp(value, "true") == 0;
+#else
+    return false;
+#endif
+}
+
 bool write_buffer_to_statsd_queue(const uint8_t* buffer, size_t size, uint32_t atomId) {
-    static BufferWriterQueue queue;
+    static BufferWriterQueue queue(
+            is_atom_coalescing_enabled(),
+            is_shared_memory_ring_enabled() ? std::make_unique<StatsRingWriter>() : nullptr);
     return queue.write(buffer, size, atomId);
 }
 
@@ -19,43 +19,86 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#include <queue>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
+
+#include "stats_ring_writer.h"
 
 class BufferWriterQueue {
 public:
     constexpr static int kDelayOnFailedWriteMs = 5;
     constexpr static int kQueueMaxSizeLimit = 4800;  // 2X max_dgram_qlen
 
-    BufferWriterQueue();
+    // Max size of the atoms packed into a single datagram with their size prefixes,
+    // LOGGER_ENTRY_MAX_PAYLOAD minus the 4-byte list tag
+    constexpr static size_t kMaxAtomListSize = 4068 - sizeof(uint32_t);
+
+    // Atoms up to this size are copied into preallocated slabs instead of malloc'd buffers.
+    // There is one slab per queue entry, so the pool never runs out for small atoms
+    constexpr static size_t kSlabSize = 512;
+
+    /**
+     * @param coalesceAtoms when set, the worker thread packs consecutive queued atoms into a
+     * single datagram of up to kMaxAtomListSize bytes
+     * @param ringWriter optional shared memory transport, tried before the socket
+     */
+    explicit BufferWriterQueue(bool coalesceAtoms = false,
+                               std::unique_ptr<StatsRingWriter> ringWriter = nullptr);
     virtual ~BufferWriterQueue();
 
     bool write(const uint8_t* buffer, size_t size, uint32_t atomId);
 
     size_t getQueueSize() const;
 
+    // Returns the max number of commands observed in the queue
+    size_t getQueueHighWaterMark() const;
+
     void drainQueue();
 
     struct Cmd {
         uint8_t* buffer = NULL;
         int atomId = 0;
         int size = 0;
+        // buffer points to a slab owned by the queue
+        bool isSlab = false;
     };
 
     virtual bool handleCommand(const Cmd& cmd) const;
 
+    // Writes several atoms in a single datagram, only used when coalescing atoms
+    virtual bool handleCommandList(const Cmd* cmds, size_t count) const;
+
 private:
+    const bool mCoalesceAtoms;
+    // only used from the worker thread
+    const std::unique_ptr<StatsRingWriter> mRingWriter;
     std::condition_variable mCondition;
     mutable std::mutex mMutex;
-    std::queue<Cmd> mCmdQueue;
+    std::deque<Cmd> mCmdQueue;
+    size_t mQueueHighWaterMark = 0;
+
+    // Backing storage of the slabs, allocated on first use. Guarded by mMutex
+    std::unique_ptr<uint8_t[]> mSlabs;
+    std::vector<uint8_t*> mFreeSlabs;
+
     std::atomic_bool mDoTerminate = false;
     std::thread mWorkThread;
 
-    static Cmd createWriteBufferCmd(const uint8_t* buffer, size_t size, uint32_t atomId);
+    Cmd createWriteBufferCmdLocked(const uint8_t* buffer, size_t size, uint32_t atomId);
+
+    void releaseCmdBufferLocked(Cmd& cmd);
 
     bool pushToQueue(const Cmd& cmd);
 
     void terminate();
 
     void processCommands();
+
+    // Picks the commands from the queue head to be written in a single datagram
+    void collectCommandsLocked(std::vector<Cmd>& cmds) const;
 };
@@ -16,6 +16,7 @@
 
 #include "include/stats_event.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -83,26 +84,68 @@ struct AStatsEvent {
     size_t bufSize;
 };
 
+// Each thread keeps the last released event with a push-sized buffer and hands it out again on
+// the next AStatsEvent_obtain, so logging from a loop does not allocate for every atom. Events
+// whose buffer grew past MAX_PUSH_EVENT_PAYLOAD (pulled atoms) are freed instead, to avoid
+// pinning up to MAX_PULL_EVENT_PAYLOAD per thread.
+static pthread_key_t cached_event_key;
+static pthread_once_t cached_event_key_once = PTHREAD_ONCE_INIT;
+static bool cached_event_key_created = false;
+
+static void free_event(void* event) {
+    free(((AStatsEvent*)event)->buf);
+    free(event);
+}
+
+static void create_cached_event_key() {
+    cached_event_key_created = pthread_key_create(&cached_event_key, free_event) == 0;
+}
+
+static AStatsEvent* take_cached_event() {
+    pthread_once(&cached_event_key_once, create_cached_event_key);
+    if (!cached_event_key_created) return NULL;
+    AStatsEvent* event = (AStatsEvent*)pthread_getspecific(cached_event_key);
+    if (event != NULL) {
+        pthread_setspecific(cached_event_key, NULL);
+    }
+    return event;
+}
+
+// Returns true if the event was kept for reuse by the calling thread.
+static bool cache_event(AStatsEvent* event) {
+    if (!cached_event_key_created || event->bufSize != MAX_PUSH_EVENT_PAYLOAD ||
+        pthread_getspecific(cached_event_key) != NULL) {
+        return false;
+    }
+    return pthread_setspecific(cached_event_key, event) == 0;
+}
+
 AStatsEvent* AStatsEvent_obtain() {
-    AStatsEvent* event = malloc(sizeof(AStatsEvent));
+    AStatsEvent* event = take_cached_event();
+    if (event == NULL) {
+        event = malloc(sizeof(AStatsEvent));
+        event->bufSize = MAX_PUSH_EVENT_PAYLOAD;
+        event->buf = (uint8_t*)malloc(event->bufSize);
+    }
     event->lastFieldPos = 0;
     event->numBytesWritten = 2;  // reserve first 2 bytes for root event type and number of elements
     event->numElements = 0;
     event->atomId = 0;
     event->errors = 0;
     event->built = false;
-    event->bufSize = MAX_PUSH_EVENT_PAYLOAD;
-    event->buf = (uint8_t*)calloc(event->bufSize, 1);
 
+    // Only the bytes below numBytesWritten are ever read, so a reused buffer needs no clearing.
     event->buf[0] = OBJECT_TYPE;
+    event->buf[POS_NUM_ELEMENTS] = 0;
     AStatsEvent_writeInt64(event, get_elapsed_realtime_ns());  // write the timestamp
 
     return event;
 }
 
 void AStatsEvent_release(AStatsEvent* event) {
-    free(event->buf);
-    free(event);
+    if (!cache_event(event)) {
+        free_event(event);
+    }
 }
 
 void AStatsEvent_setAtomId(AStatsEvent* event, uint32_t atomId) {
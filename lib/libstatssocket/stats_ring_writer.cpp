@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stats_ring_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "stats_buffer_writer_impl.h"
+#include "stats_socket_loss_reporter.h"
+#include "utils.h"
+
+namespace {
+
+constexpr size_t kRingSize = sizeof(StatsRingHeader) + StatsRingWriter::kRingCapacity;
+
+inline uint32_t alignRecordSize(size_t size) {
+    return (sizeof(uint32_t) + size + 3) & ~3u;
+}
+
+}  // namespace
+
+StatsRingWriter::StatsRingWriter() {
+}
+
+StatsRingWriter::~StatsRingWriter() {
+    tearDown();
+}
+
+bool StatsRingWriter::write(const struct iovec* atoms, size_t count) {
+    const int64_t nowNs = getElapsedRealtimeNs();
+    if (!mRegistered) {
+        if (mLastRegistrationNs != 0 && nowNs - mLastRegistrationNs < kRegistrationRetryNs) {
+            return false;
+        }
+        mLastRegistrationNs = nowNs;
+        if (!setUp()) {
+            tearDown();
+            return false;
+        }
+        mLastConsumerProgressNs = nowNs;
+    } else if (!isConsumerAlive(nowNs)) {
+        // statsd likely restarted, the atoms left in the ring are lost. Register a new ring on
+        // the next write so the socket is used in between
+        StatsSocketLossReporter::getInstance().noteDrop(
+                StatsSocketLossReporter::kStaleRingErrorCode, /*atomId=*/0);
+        tearDown();
+        return false;
+    }
+
+    // space check for all atoms upfront, so that the write is all or nothing
+    const uint32_t readPos = mHeader->readPos.load(std::memory_order_acquire);
+    uint32_t writePos = mWritePos;
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t recordSize = alignRecordSize(atoms[i].iov_len);
+        const uint32_t contiguous = kRingCapacity - writePos % kRingCapacity;
+        const uint32_t needed = recordSize <= contiguous ? recordSize : contiguous + recordSize;
+        if (recordSize > kRingCapacity / 2 || (writePos - readPos) + needed > kRingCapacity) {
+            return false;
+        }
+        writePos += needed;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t size = atoms[i].iov_len;
+        const uint32_t recordSize = alignRecordSize(size);
+        uint32_t offset = mWritePos % kRingCapacity;
+        if (recordSize > kRingCapacity - offset) {
+            memcpy(mData + offset, &kWrapMarker, sizeof(kWrapMarker));
+            mWritePos += kRingCapacity - offset;
+            offset = 0;
+        }
+        memcpy(mData + offset, &size, sizeof(size));
+        memcpy(mData + offset + sizeof(size), atoms[i].iov_base, size);
+        mWritePos += recordSize;
+    }
+    mHeader->writePos.store(mWritePos, std::memory_order_release);
+
+    // the consumer sets the flag and then checks writePos again before it waits, so either it
+    // sees the new records or the eventfd gets signaled
+    if (mHeader->consumerWaiting.exchange(0, std::memory_order_seq_cst) != 0) {
+        eventfd_write(mEventFd, 1);
+    }
+    return true;
+}
+
+bool StatsRingWriter::isConsumerAlive(int64_t nowNs) {
+    const uint32_t readPos = mHeader->readPos.load(std::memory_order_relaxed);
+    if (readPos != mLastReadPos || readPos == mWritePos) {
+        mLastReadPos = readPos;
+        mLastConsumerProgressNs = nowNs;
+        return true;
+    }
+    return nowNs - mLastConsumerProgressNs < kStaleConsumerNs;
+}
+
+bool StatsRingWriter::setUp() {
+    mMemFd = memfd_create("statsd_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (mMemFd < 0 || ftruncate(mMemFd, kRingSize) != 0) {
+        return false;
+    }
+    // statsd maps the ring, it must not be able to shrink under it
+    if (fcntl(mMemFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        return false;
+    }
+    void* mapped = mmap(nullptr, kRingSize, PROT_READ | PROT_WRITE, MAP_SHARED, mMemFd, 0);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    mHeader = new (mapped) StatsRingHeader();
+    mHeader->magic = kRingMagic;
+    mHeader->capacity = kRingCapacity;
+    mData = (uint8_t*)mapped + sizeof(StatsRingHeader);
+    mWritePos = 0;
+    mLastReadPos = 0;
+
+    mEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (mEventFd < 0) {
+        return false;
+    }
+    mRegistered = registerRing(mMemFd, mEventFd);
+    return mRegistered;
+}
+
+void StatsRingWriter::tearDown() {
+    if (mHeader != nullptr) {
+        munmap(mHeader, kRingSize);
+        mHeader = nullptr;
+        mData = nullptr;
+    }
+    if (mMemFd >= 0) {
+        close(mMemFd);
+        mMemFd = -1;
+    }
+    if (mEventFd >= 0) {
+        close(mEventFd);
+        mEventFd = -1;
+    }
+    mRegistered = false;
+}
+
+bool StatsRingWriter::registerRing(int memFd, int eventFd) {
+    return write_ring_registration_to_statsd(memFd, eventFd) > 0;
+}
+
+int64_t StatsRingWriter::getElapsedRealtimeNs() const {
+    return get_elapsed_realtime_ns();
+}
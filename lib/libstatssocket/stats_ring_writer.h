@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <atomic>
+
+/**
+ * Header at the start of the shared memory ring, followed by the data area of kRingCapacity
+ * bytes. (*LAYOUT MUST BE IN SYNC WITH statsd StatsRingListener*)
+ *
+ * Positions are free running byte counters, the offset in the data area is pos % capacity.
+ * Each record is |uint32_t size|atom buffer| padded to 4 bytes. A kWrapMarker size means that
+ * the rest of the data area is unused and the next record starts at offset 0.
+ */
+struct StatsRingHeader {
+    uint32_t magic;
+    uint32_t capacity;
+    // written by the producer only
+    alignas(64) std::atomic_uint32_t writePos;
+    // written by the consumer only
+    alignas(64) std::atomic_uint32_t readPos;
+    // set by the consumer before it waits for the eventfd, cleared by the producer
+    std::atomic_uint32_t consumerWaiting;
+};
+
+/**
+ * Single producer side of a shared memory ring transport to statsd. The ring is a sealed memfd
+ * that is registered with statsd along with an eventfd, through a datagram with SCM_RIGHTS on
+ * the statsdw socket, so that the sender credentials are checked once at registration instead of
+ * once per atom.
+ *
+ * Only to be used from a single thread (the BufferWriterQueue worker thread). A write fails when
+ * the ring is full or not registered, in which case the caller falls back to the socket.
+ */
+class StatsRingWriter {
+public:
+    constexpr static uint32_t kRingMagic = 0x53524e47;  // "SRNG"
+    constexpr static uint32_t kRingCapacity = 256 * 1024;
+    constexpr static uint32_t kWrapMarker = 0xffffffff;
+    // Registrations are retried no more often than this
+    constexpr static int64_t kRegistrationRetryNs = 1000 * 1000 * 1000;  // 1s
+    // Unread data with no consumer progress for this long means statsd is gone
+    constexpr static int64_t kStaleConsumerNs = 1000 * 1000 * 1000;  // 1s
+
+    StatsRingWriter();
+    virtual ~StatsRingWriter();
+
+    /**
+     * @brief Writes all atoms into the ring, or none of them
+     *
+     * @param atoms one iovec per atom
+     * @param count number of atoms
+     * @return true if the atoms have been published to statsd
+     */
+    bool write(const struct iovec* atoms, size_t count);
+
+protected:
+    // Sends the ring to statsd, returns true if the registration has been written
+    virtual bool registerRing(int memFd, int eventFd);
+
+    virtual int64_t getElapsedRealtimeNs() const;
+
+private:
+    bool setUp();
+    void tearDown();
+
+    // Returns false if the consumer did not make progress for kStaleConsumerNs
+    bool isConsumerAlive(int64_t nowNs);
+
+    int mMemFd = -1;
+    int mEventFd = -1;
+    StatsRingHeader* mHeader = nullptr;
+    uint8_t* mData = nullptr;
+
+    uint32_t mWritePos = 0;
+    // consumer position seen on the previous write, to detect a stale ring
+    uint32_t mLastReadPos = 0;
+    int64_t mLastConsumerProgressNs = 0;
+    int64_t mLastRegistrationNs = 0;
+    bool mRegistered = false;
+};
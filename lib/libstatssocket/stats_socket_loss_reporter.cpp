@@ -75,6 +75,14 @@ void StatsSocketLossReporter::noteDrop(int32_t error, int32_t atomId) {
     }
 }
 
+void StatsSocketLossReporter::noteQueueHighWaterMark(size_t queueSize) {
+    int32_t highWaterMark = mQueueHighWaterMark.load(std::memory_order_relaxed);
+    while ((int32_t)queueSize > highWaterMark &&
+           !mQueueHighWaterMark.compare_exchange_weak(highWaterMark, queueSize,
+                                                      std::memory_order_relaxed)) {
+    }
+}
+
 void StatsSocketLossReporter::dumpAtomsLossStats(bool forceDump) {
     using namespace android::os::statsdsocket;
 
@@ -90,8 +98,15 @@ void StatsSocketLossReporter::dumpAtomsLossStats(bool forceDump) {
 
     // intention to hold mutex here during the stats_write() to avoid data copy overhead
     std::unique_lock<std::mutex> lock(mMutex);
+    // queue high-water mark helps to tell a too small queue from a continuous overload
+    int32_t queueHighWaterMark = mQueueHighWaterMark.load(std::memory_order_relaxed);
     if (mLossInfo.size() == 0) {
-        return;
+        // without losses the high-water mark alone is reported at a lower rate, a single queued
+        // atom is not a backlog
+        if (queueHighWaterMark <= 1 ||
+            mNextQueueHighWaterMarkReportNanos > currentRealtimeTsNanos) {
+            return;
+        }
     }
 
     // populate temp vectors to be written into the socket
@@ -107,6 +122,13 @@ void StatsSocketLossReporter::dumpAtomsLossStats(bool forceDump) {
         counts[i] = lossInfoIt->second;
     }
 
+    // statsd takes this entry out of the loss counters, see toSocketLossInfo()
+    if (queueHighWaterMark > 0) {
+        errors.push_back(kQueueHighWaterMarkErrorCode);
+        tags.push_back(0);
+        counts.push_back(queueHighWaterMark);
+    }
+
     // below call might lead to socket loss event - intention is to avoid self counting
     const int ret = stats_write(STATS_SOCKET_LOSS_REPORTED, mUid, mFirstTsNanos, mLastTsNanos,
                                 mOverflowCounter, errors, tags, counts);
@@ -119,6 +141,12 @@ void StatsSocketLossReporter::dumpAtomsLossStats(bool forceDump) {
 
         mFirstTsNanos.store(0, std::memory_order_relaxed);
         mLastTsNanos.store(0, std::memory_order_relaxed);
+
+        // the high-water mark is tracked per report, a bigger value noted meanwhile is kept
+        mQueueHighWaterMark.compare_exchange_strong(queueHighWaterMark, 0,
+                                                    std::memory_order_relaxed);
+        mNextQueueHighWaterMarkReportNanos =
+                currentRealtimeTsNanos + kQueueHighWaterMarkReportIntervalNanos;
     }
     // since the delay before next attempt is significantly larger than this API call
     // duration it is ok to have correctness of timestamp in a range of 10us
@@ -29,6 +29,20 @@ public:
 
     void noteDrop(int32_t error, int32_t atomId);
 
+    /**
+     * @brief Notes the number of atoms in the BufferWriterQueue. The max since the last report
+     * is sent as a kQueueHighWaterMarkErrorCode entry with the size as count, which statsd
+     * does not count as a loss. It is reset once the report is written
+     */
+    void noteQueueHighWaterMark(size_t queueSize);
+
+    // libstatssocket internal error codes are positive, see note_log_drop()
+    static constexpr int32_t kQueueHighWaterMarkErrorCode = 2;
+    // Atoms dropped at the source by the adaptive throttling, counted per atom id
+    static constexpr int32_t kAtomSampledErrorCode = 3;
+    // A shared memory ring was abandoned with unread atoms, noted once per ring
+    static constexpr int32_t kStaleRingErrorCode = 4;
+
     /**
      * @brief Dump loss info into statsd as a STATS_SOCKET_LOSS_REPORTED atom instance
      *
@@ -50,6 +64,7 @@ private:
     std::atomic_int64_t mFirstTsNanos = 0;
     std::atomic_int64_t mLastTsNanos = 0;
     std::atomic_int64_t mCooldownTimerFinishAtNanos = 0;
+    std::atomic_int32_t mQueueHighWaterMark = 0;
 
     // Loss info data will be logged to statsd as a regular AStatsEvent
     // which means it needs to obey event size limitations (4kB)
@@ -60,6 +75,9 @@ private:
 
     const int64_t kCoolDownTimerDurationNanos = 10 * 1000 * 1000;  // 10ms
 
+    // min delay between reports carrying only the queue high-water mark
+    const int64_t kQueueHighWaterMarkReportIntervalNanos = 60LL * 1000 * 1000 * 1000;  // 1min
+
     struct HashPair final {
         template <class TFirst, class TSecond>
         size_t operator()(const std::pair<TFirst, TSecond>& p) const noexcept {
@@ -80,4 +98,7 @@ private:
 
     // tracks guardrail kMaxAtomTagsCount hit count
     int32_t mOverflowCounter = 0;
+
+    // earliest time to report the queue high-water mark without any loss
+    int64_t mNextQueueHighWaterMarkReportNanos = 0;
 };
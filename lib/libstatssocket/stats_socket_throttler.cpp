@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stats_socket_throttler.h"
+
+#include <string.h>
+
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif
+
+#include "stats_socket_throttler_impl.h"
+#include "stats_statsdsocketlog.h"
+#include "utils.h"
+
+StatsSocketThrottler::StatsSocketThrottler(bool enabled) : mEnabled(enabled) {
+}
+
+bool StatsSocketThrottler::shouldThrottle(uint32_t atomId, int64_t elapsedRealtimeNanos) {
+    using namespace android::os::statsdsocket;
+
+    const int samplingShift = mSamplingShift.load(std::memory_order_relaxed);
+    if (samplingShift == 0 || atomId == STATS_SOCKET_LOSS_REPORTED) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (elapsedRealtimeNanos - mIntervalStartNanos >= kRecoveryIntervalNs) {
+        mAtomCounts.clear();
+        mIntervalStartNanos = elapsedRealtimeNanos;
+    }
+
+    auto countIt = mAtomCounts.find(atomId);
+    if (countIt == mAtomCounts.end()) {
+        if (mAtomCounts.size() >= kMaxTrackedAtomsCount) {
+            // not sampling untracked atoms, the tracked ones are the first to get noisy
+            return false;
+        }
+        countIt = mAtomCounts.emplace(atomId, 0).first;
+    }
+    const int32_t count = countIt->second++;
+    if (count < kUnsampledAtomsPerInterval) {
+        return false;
+    }
+    const int32_t sampleMask = (1 << samplingShift) - 1;
+    return ((count - kUnsampledAtomsPerInterval) & sampleMask) != 0;
+}
+
+void StatsSocketThrottler::noteCongestion(bool congested, int64_t elapsedRealtimeNanos) {
+    if (!mEnabled) {
+        return;
+    }
+
+    if (congested) {
+        mLastCongestionNanos.store(elapsedRealtimeNanos, std::memory_order_relaxed);
+        if (mConsecutiveCongestionCount.fetch_add(1, std::memory_order_relaxed) + 1 <
+            kCongestionThreshold) {
+            return;
+        }
+        mConsecutiveCongestionCount.store(0, std::memory_order_relaxed);
+
+        // rate limit the adjustments, otherwise a single burst would go straight to the max shift
+        int64_t lastAdjustmentNanos = mLastAdjustmentNanos.load(std::memory_order_relaxed);
+        if (elapsedRealtimeNanos - lastAdjustmentNanos < kMinAdjustmentIntervalNs ||
+            !mLastAdjustmentNanos.compare_exchange_strong(lastAdjustmentNanos,
+                                                          elapsedRealtimeNanos)) {
+            return;
+        }
+        int samplingShift = mSamplingShift.load(std::memory_order_relaxed);
+        if (samplingShift < kMaxSamplingShift) {
+            mSamplingShift.store(samplingShift + 1, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    // avoid writing shared counters on the common uncongested path
+    if (mConsecutiveCongestionCount.load(std::memory_order_relaxed) != 0) {
+        mConsecutiveCongestionCount.store(0, std::memory_order_relaxed);
+    }
+    const int samplingShift = mSamplingShift.load(std::memory_order_relaxed);
+    if (samplingShift == 0 ||
+        elapsedRealtimeNanos - mLastCongestionNanos.load(std::memory_order_relaxed) <
+                kRecoveryIntervalNs) {
+        return;
+    }
+    int64_t lastAdjustmentNanos = mLastAdjustmentNanos.load(std::memory_order_relaxed);
+    if (elapsedRealtimeNanos - lastAdjustmentNanos >= kRecoveryIntervalNs &&
+        mLastAdjustmentNanos.compare_exchange_strong(lastAdjustmentNanos, elapsedRealtimeNanos)) {
+        mSamplingShift.store(samplingShift - 1, std::memory_order_relaxed);
+    }
+}
+
+int StatsSocketThrottler::getSamplingShift() const {
+    return mSamplingShift.load(std::memory_order_relaxed);
+}
+
+// Opt-in with the statsd_native_boot socket_adaptive_throttling flag, read once per process
+static bool is_adaptive_throttling_enabled() {
+#ifdef __ANDROID__
+    char value[PROP_VALUE_MAX] = "";
+    __system_property_get("persist.device_config.statsd_native_boot.socket_adaptive_throttling",
+                          value);
+    return strcmp(value, "true") == 0;
+#else
+    return false;
+#endif
+}
+
+static StatsSocketThrottler& get_throttler() {
+    static StatsSocketThrottler throttler(is_adaptive_throttling_enabled());
+    return throttler;
+}
+
+bool should_throttle_atom(uint32_t atomId) {
+    StatsSocketThrottler& throttler = get_throttler();
+    // skip reading the clock unless sampling
+    if (throttler.getSamplingShift() == 0) {
+        return false;
+    }
+    return throttler.shouldThrottle(atomId, get_elapsed_realtime_ns());
+}
+
+void note_socket_congestion(bool congested) {
+    StatsSocketThrottler& throttler = get_throttler();
+    if (throttler.isEnabled()) {
+        throttler.noteCongestion(congested, get_elapsed_realtime_ns());
+    }
+}
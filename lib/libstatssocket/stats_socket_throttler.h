@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/**
+ * Returns true if the atom should be dropped before being written, because the socket has been
+ * congested and the atom is being sampled.
+ */
+bool should_throttle_atom(uint32_t atomId);
+
+/**
+ * Feeds the outcome of a write into the throttler. congested is true when the write failed with
+ * EAGAIN or the BufferWriterQueue was full.
+ */
+void note_socket_congestion(bool congested);
+
+__END_DECLS
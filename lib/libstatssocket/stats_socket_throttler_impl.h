@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * Client side adaptive rate limiting of atoms.
+ *
+ * Repeated congestion (EAGAIN on the socket or a full BufferWriterQueue) raises the sampling
+ * shift, disabling it lowers it by one step per kRecoveryIntervalNs. While the shift is S > 0,
+ * every atom id may still write kUnsampledAtomsPerInterval atoms per interval, after which only
+ * 1 in 2^S of its atoms are written. This keeps rare atoms intact and takes the socket capacity
+ * from the noisy ones. Sampled out atoms are counted by StatsSocketLossReporter.
+ */
+class StatsSocketThrottler {
+public:
+    constexpr static int kMaxSamplingShift = 4;  // keep at least 1 in 16 atoms
+    constexpr static int kCongestionThreshold = 16;
+    constexpr static int64_t kMinAdjustmentIntervalNs = 10 * 1000 * 1000;  // 10ms
+    constexpr static int64_t kRecoveryIntervalNs = 1000 * 1000 * 1000;     // 1s
+    constexpr static int32_t kUnsampledAtomsPerInterval = 50;
+    constexpr static size_t kMaxTrackedAtomsCount = 100;
+
+    explicit StatsSocketThrottler(bool enabled);
+
+    bool shouldThrottle(uint32_t atomId, int64_t elapsedRealtimeNanos);
+
+    void noteCongestion(bool congested, int64_t elapsedRealtimeNanos);
+
+    int getSamplingShift() const;
+
+    bool isEnabled() const {
+        return mEnabled;
+    }
+
+private:
+    const bool mEnabled;
+    std::atomic_int mSamplingShift = 0;
+    std::atomic_int mConsecutiveCongestionCount = 0;
+    std::atomic_int64_t mLastCongestionNanos = 0;
+    std::atomic_int64_t mLastAdjustmentNanos = 0;
+
+    // guards access to below members
+    std::mutex mMutex;
+
+    // number of atoms written per atom id since mIntervalStartNanos, only tracked while sampling
+    std::unordered_map<uint32_t, int32_t> mAtomCounts;
+    int64_t mIntervalStartNanos = 0;
+};
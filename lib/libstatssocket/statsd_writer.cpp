@@ -20,6 +20,7 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <poll.h>
+#include <private/android_filesystem_config.h>
 #include <private/android_logger.h>
 #include <stdarg.h>
 #include <stdatomic.h>
@@ -51,6 +52,8 @@
 
 #endif  // __BIONIC__
 
+static const char kDefaultSocketPath[] = "/dev/socket/statsdw";
+
 static pthread_mutex_t log_init_lock = PTHREAD_MUTEX_INITIALIZER;
 static atomic_int dropped = 0;
 static atomic_int log_error = 0;
@@ -90,6 +93,37 @@ struct android_log_transport_write statsdLoggerWrite = {
         .isClosed = statsdIsClosed,
 };
 
+/*
+ * Each process class writes to its own socket, drained by a dedicated statsd listener thread.
+ * (*MUST BE IN SYNC WITH statsd StatsSocketListener::kSocketNames*)
+ */
+static const char* getClassSocketPath(uid_t uid) {
+    if (uid == AID_SYSTEM) {
+        return "/dev/socket/statsdw_system";
+    }
+    if (uid < AID_APP_START) {
+        return "/dev/socket/statsdw_native";
+    }
+    return kDefaultSocketPath;
+}
+
+/* Falls back to statsdw when the socket of the process class is not provided by statsd. */
+const char* statsd_writer_get_socket_path(uid_t uid, int (*isWritable)(const char* path)) {
+    const char* path = getClassSocketPath(uid);
+    if (path != kDefaultSocketPath && !isWritable(path)) {
+        return kDefaultSocketPath;
+    }
+    return path;
+}
+
+static int isSocketWritable(const char* path) {
+    return access(path, W_OK) == 0;
+}
+
+static const char* getSocketPath() {
+    return statsd_writer_get_socket_path(getuid(), isSocketWritable);
+}
+
 /* log_init_lock assumed */
 static int statsdOpen() {
     int i, ret = 0;
@@ -115,7 +149,7 @@ static int statsdOpen() {
             struct sockaddr_un un;
             memset(&un, 0, sizeof(struct sockaddr_un));
             un.sun_family = AF_UNIX;
-            strcpy(un.sun_path, "/dev/socket/statsdw");
+            strcpy(un.sun_path, getSocketPath());
 
             if (TEMP_FAILURE_RETRY(
                         connect(sock, (struct sockaddr*)&un, sizeof(struct sockaddr_un))) < 0) {
@@ -156,7 +190,7 @@ static void statsdClose() {
 
 static int statsdAvailable() {
     if (atomic_load(&statsdLoggerWrite.sock) < 0) {
-        if (access("/dev/socket/statsdw", W_OK) == 0) {
+        if (access(getSocketPath(), W_OK) == 0) {
             return 0;
         }
         return -EBADF;
@@ -313,3 +347,51 @@ static int statsdWrite(struct timespec* ts, struct iovec* vec, size_t nr) {
 
     return ret;
 }
+
+int statsd_writer_write_with_fds(struct iovec* vec, size_t nr, const int* fds, size_t numFds) {
+    const size_t kMaxFds = 2;
+    const int sock = atomic_load(&statsdLoggerWrite.sock);
+    if (sock < 0) {
+        return -EBADF;
+    }
+    if (numFds == 0 || numFds > kMaxFds) {
+        return -EINVAL;
+    }
+
+    android_log_header_t header;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    header.id = LOG_ID_STATS;
+    header.tid = android::base::GetThreadId();
+    header.realtime.tv_sec = ts.tv_sec;
+    header.realtime.tv_nsec = ts.tv_nsec;
+
+    struct iovec newVec[nr + 1];
+    newVec[0].iov_base = &header;
+    newVec[0].iov_len = sizeof(header);
+    for (size_t i = 0; i < nr; i++) {
+        newVec[i + 1] = vec[i];
+    }
+
+    alignas(struct cmsghdr) char control[CMSG_SPACE(kMaxFds * sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = newVec;
+    msg.msg_iovlen = nr + 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(numFds * sizeof(int));
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(numFds * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, numFds * sizeof(int));
+
+    ssize_t ret = TEMP_FAILURE_RETRY(sendmsg(sock, &msg, 0));
+    if (ret < 0) {
+        return -errno;
+    }
+    if (ret > (ssize_t)sizeof(header)) {
+        ret -= sizeof(header);
+    }
+    return ret;
+}
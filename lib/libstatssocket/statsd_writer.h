@@ -20,6 +20,7 @@
 #include <pthread.h>
 #include <stdatomic.h>
 #include <sys/socket.h>
+#include <sys/types.h>
 
 __BEGIN_DECLS
 
@@ -46,6 +47,21 @@ struct android_log_transport_write {
     int (*isClosed)();
 };
 
+/**
+ * Writes a single datagram passing the file descriptors to statsd with SCM_RIGHTS. Unlike the
+ * transport write, the socket is not reconnected and drops are not noted.
+ * Returns the number of payload bytes written, or -errno.
+ */
+int statsd_writer_write_with_fds(struct iovec* vec, size_t nr, const int* fds, size_t numFds);
+
+/**
+ * Returns the path of the statsd socket written to by the processes of the uid, each process
+ * class has its own socket. Falls back to statsdw when isWritable() returns 0 for the socket
+ * of the class.
+ * (*MUST BE IN SYNC WITH statsd StatsSocketListener::kSocketNames*)
+ */
+const char* statsd_writer_get_socket_path(uid_t uid, int (*isWritable)(const char* path));
+
 __END_DECLS
 
 #endif  // ANDROID_STATS_LOG_STATS_WRITER_H
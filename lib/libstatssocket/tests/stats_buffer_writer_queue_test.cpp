@@ -18,6 +18,9 @@
 #include <gtest/gtest.h>
 
 #include <chrono>
+#include <future>
+#include <mutex>
+#include <vector>
 
 #include "stats_buffer_writer_queue_impl.h"
 #include "stats_event.h"
@@ -46,6 +49,17 @@ public:
 
 typedef StrictMock<BasicBufferWriterQueueMock> BufferWriterQueueMock;
 
+class CoalescingBufferWriterQueueMock : public BufferWriterQueue {
+public:
+    CoalescingBufferWriterQueueMock() : BufferWriterQueue(/*coalesceAtoms=*/true) {
+    }
+    MOCK_METHOD(bool, handleCommand, (const CoalescingBufferWriterQueueMock::Cmd& cmd),
+                (const override));
+    MOCK_METHOD(bool, handleCommandList,
+                (const CoalescingBufferWriterQueueMock::Cmd* cmds, size_t count),
+                (const override));
+};
+
 TEST(StatsBufferWriterQueueTest, TestWriteSuccess) {
     AStatsEvent* event = generateTestEvent();
 
@@ -89,6 +103,43 @@ TEST(StatsBufferWriterQueueTest, TestWriteOverflow) {
     EXPECT_FALSE(addedToQueue);
 
     EXPECT_EQ(queue.getQueueSize(), BufferWriterQueueMock::kQueueMaxSizeLimit);
+    EXPECT_EQ(queue.getQueueHighWaterMark(), BufferWriterQueueMock::kQueueMaxSizeLimit);
+}
+
+TEST(StatsBufferWriterQueueTest, TestSlabAndLargeBuffers) {
+    const std::vector<uint8_t> smallBuffer(BufferWriterQueueMock::kSlabSize, 1);
+    const std::vector<uint8_t> largeBuffer(BufferWriterQueueMock::kSlabSize + 1, 2);
+
+    std::mutex mutex;
+    std::vector<std::vector<uint8_t>> writtenBuffers;
+    std::vector<bool> writtenFromSlab;
+
+    BufferWriterQueueMock queue;
+    EXPECT_CALL(queue, handleCommand(_))
+            .WillRepeatedly([&](const BufferWriterQueueMock::Cmd& cmd) {
+                std::unique_lock<std::mutex> lock(mutex);
+                writtenBuffers.emplace_back(cmd.buffer, cmd.buffer + cmd.size);
+                writtenFromSlab.push_back(cmd.isSlab);
+                return true;
+            });
+
+    // slabs are returned to the pool, so writing more atoms than the pool size keeps working
+    constexpr int kWriteCount = BufferWriterQueueMock::kQueueMaxSizeLimit * 2;
+    for (int i = 0; i < kWriteCount; i++) {
+        const std::vector<uint8_t>& buffer = i % 2 == 0 ? smallBuffer : largeBuffer;
+        while (!queue.write(buffer.data(), buffer.size(), /*atomId=*/100)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(WAIT_MS));
+    EXPECT_EQ(queue.getQueueSize(), 0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    ASSERT_EQ(writtenBuffers.size(), kWriteCount);
+    for (int i = 0; i < kWriteCount; i++) {
+        EXPECT_EQ(writtenBuffers[i], i % 2 == 0 ? smallBuffer : largeBuffer);
+        EXPECT_EQ(writtenFromSlab[i], i % 2 == 0);
+    }
 }
 
 TEST(StatsBufferWriterQueueTest, TestSleepOnOverflow) {
@@ -150,3 +201,80 @@ TEST(StatsBufferWriterQueueTest, TestTerminateNonEmptyQueue) {
     queue.drainQueue();
     EXPECT_EQ(queue.getQueueSize(), 0);
 }
+
+TEST(StatsBufferWriterQueueTest, TestCoalesceAtoms) {
+    AStatsEvent* event = generateTestEvent();
+
+    size_t eventBufferSize = 0;
+    const uint8_t* buffer = AStatsEvent_getBuffer(event, &eventBufferSize);
+    EXPECT_TRUE(buffer != nullptr);
+
+    const uint32_t atomId = AStatsEvent_getAtomId(event);
+
+    // the first write fails once all the atoms are queued, so the following ones are coalesced
+    std::promise<void> allQueued;
+    std::shared_future<void> allQueuedFuture = allQueued.get_future().share();
+    std::mutex mutex;
+    bool isFirstWrite = true;
+    std::vector<size_t> listCounts;
+    std::vector<size_t> listSizes;
+
+    StrictMock<CoalescingBufferWriterQueueMock> queue;
+    EXPECT_CALL(queue, handleCommand(_))
+            .WillRepeatedly([&](const CoalescingBufferWriterQueueMock::Cmd&) {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (isFirstWrite) {
+                    isFirstWrite = false;
+                    lock.unlock();
+                    allQueuedFuture.wait();
+                    return false;
+                }
+                listCounts.push_back(1);
+                return true;
+            });
+    EXPECT_CALL(queue, handleCommandList(_, _))
+            .WillRepeatedly([&](const CoalescingBufferWriterQueueMock::Cmd* cmds, size_t count) {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (isFirstWrite) {
+                    isFirstWrite = false;
+                    lock.unlock();
+                    allQueuedFuture.wait();
+                    return false;
+                }
+                size_t listSize = 0;
+                for (size_t i = 0; i < count; i++) {
+                    listSize += sizeof(uint32_t) + cmds[i].size;
+                }
+                listCounts.push_back(count);
+                listSizes.push_back(listSize);
+                return true;
+            });
+
+    constexpr size_t kAtomCount = 400;
+    for (size_t i = 0; i < kAtomCount; i++) {
+        EXPECT_TRUE(queue.write(buffer, eventBufferSize, atomId));
+    }
+    AStatsEvent_release(event);
+    allQueued.set_value();
+
+    // to yeld to the queue worker thread
+    std::this_thread::sleep_for(std::chrono::milliseconds(WAIT_MS));
+    EXPECT_EQ(queue.getQueueSize(), 0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    // atoms do not fit in a single datagram
+    EXPECT_GE(listCounts.size(), 2);
+    size_t totalCount = 0;
+    for (const size_t count : listCounts) {
+        totalCount += count;
+    }
+    EXPECT_EQ(totalCount, kAtomCount);
+    for (size_t i = 0; i < listSizes.size(); i++) {
+        EXPECT_LE(listSizes[i], CoalescingBufferWriterQueueMock::kMaxAtomListSize);
+        if (i + 1 < listSizes.size()) {
+            // the datagram is filled up before the next atom goes to a new one
+            EXPECT_GT(listSizes[i] + sizeof(uint32_t) + eventBufferSize,
+                      CoalescingBufferWriterQueueMock::kMaxAtomListSize);
+        }
+    }
+}
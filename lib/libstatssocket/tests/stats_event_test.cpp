@@ -638,6 +638,63 @@ TEST(StatsEventTest, TestLargePull) {
     AStatsEvent_release(event);
 }
 
+TEST(StatsEventTest, TestReusedEventIsReset) {
+    // Leave errors, annotations and fields behind in a released event.
+    AStatsEvent* event = AStatsEvent_obtain();
+    AStatsEvent_writeInt32(event, 7);
+    AStatsEvent_setAtomId(event, 200);
+    AStatsEvent_writeString(event, "leftover");
+    AStatsEvent_addBoolAnnotation(event, 1, true);
+    AStatsEvent_build(event);
+    EXPECT_NE(AStatsEvent_getErrors(event), 0);
+    AStatsEvent_release(event);
+
+    const uint32_t atomId = 100;
+    const int32_t int32Value = -5;
+    const int64_t startTime = android::elapsedRealtimeNano();
+    event = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(event, atomId);
+    AStatsEvent_writeInt32(event, int32Value);
+    AStatsEvent_build(event);
+    const int64_t endTime = android::elapsedRealtimeNano();
+
+    size_t bufferSize;
+    uint8_t* buffer = AStatsEvent_getBuffer(event, &bufferSize);
+    uint8_t* bufferEnd = buffer + bufferSize;
+
+    checkMetadata(&buffer, /*numElements=*/1, startTime, endTime, atomId);
+    checkTypeHeader(&buffer, INT32_TYPE);
+    checkScalar(&buffer, int32Value);
+
+    EXPECT_EQ(buffer, bufferEnd);  // Ensure that we have read the entire buffer.
+    EXPECT_EQ(AStatsEvent_getErrors(event), 0);
+    AStatsEvent_release(event);
+}
+
+TEST(StatsEventTest, TestPushAfterLargePull) {
+    const char* str = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    const int writeCount = 120;  // Grows the buffer past the push payload limit.
+
+    AStatsEvent* event = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(event, 100);
+    for (int i = 0; i < writeCount; i++) {
+        AStatsEvent_writeString(event, str);
+    }
+    AStatsEvent_build(event);
+    EXPECT_EQ(AStatsEvent_getErrors(event), 0);
+    AStatsEvent_release(event);
+
+    // A push obtained after a large pull is still limited to the push payload size.
+    event = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(event, 100);
+    for (int i = 0; i < writeCount; i++) {
+        AStatsEvent_writeString(event, str);
+    }
+    AStatsEvent_write(event);
+    EXPECT_EQ(AStatsEvent_getErrors(event) & ERROR_OVERFLOW, ERROR_OVERFLOW);
+    AStatsEvent_release(event);
+}
+
 TEST(StatsEventTest, TestAtomIdInvalidPositionError) {
     AStatsEvent* event = AStatsEvent_obtain();
     AStatsEvent_writeInt32(event, 0);
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stats_event_writer.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "stats_annotations.h"
+#include "stats_event.h"
+
+namespace {
+
+constexpr uint32_t kAtomId = 100;
+constexpr int64_t kTimestampNs = 1234567890;
+
+std::vector<uint8_t> buildWithAStatsEvent(int32_t uid, int64_t value, float ratio, bool flag,
+                                          const char* tag) {
+    AStatsEvent* event = AStatsEvent_obtain();
+    AStatsEvent_overwriteTimestamp(event, kTimestampNs);
+    AStatsEvent_setAtomId(event, kAtomId);
+    AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_TRUNCATE_TIMESTAMP, true);
+    AStatsEvent_writeInt32(event, uid);
+    AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_IS_UID, true);
+    AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_PRIMARY_FIELD, true);
+    AStatsEvent_writeInt64(event, value);
+    AStatsEvent_writeFloat(event, ratio);
+    AStatsEvent_writeBool(event, flag);
+    AStatsEvent_addInt32Annotation(event, ASTATSLOG_ANNOTATION_ID_DEFAULT_STATE, 2);
+    AStatsEvent_writeString(event, tag);
+    AStatsEvent_build(event);
+    EXPECT_EQ(0, AStatsEvent_getErrors(event));
+
+    size_t size;
+    uint8_t* buffer = AStatsEvent_getBuffer(event, &size);
+    std::vector<uint8_t> result(buffer, buffer + size);
+    AStatsEvent_release(event);
+    return result;
+}
+
+using TestAtom = StatsAtomSchema<
+        StatsAtomId<kAtomId,
+                    StatsBoolAnnotation<ASTATSLOG_ANNOTATION_ID_TRUNCATE_TIMESTAMP, true>>,
+        StatsInt32Field<StatsBoolAnnotation<ASTATSLOG_ANNOTATION_ID_IS_UID, true>,
+                        StatsBoolAnnotation<ASTATSLOG_ANNOTATION_ID_PRIMARY_FIELD, true>>,
+        StatsInt64Field<>, StatsFloatField<>,
+        StatsBoolField<StatsInt32Annotation<ASTATSLOG_ANNOTATION_ID_DEFAULT_STATE, 2>>,
+        StatsStringField<16>>;
+
+std::vector<uint8_t> encodeWithWriter(int32_t uid, int64_t value, float ratio, bool flag,
+                                      const char* tag) {
+    uint8_t buffer[TestAtom::kMaxEncodedSize];
+    const size_t size =
+            StatsEventWriter<TestAtom>::encode(buffer, kTimestampNs, uid, value, ratio, flag, tag);
+    EXPECT_LE(size, TestAtom::kMaxEncodedSize);
+    return std::vector<uint8_t>(buffer, buffer + size);
+}
+
+}  // namespace
+
+TEST(StatsEventWriterTest, TestSameEncodingAsBuilder) {
+    EXPECT_EQ(buildWithAStatsEvent(1000, -5, 0.5f, true, "tag"),
+              encodeWithWriter(1000, -5, 0.5f, true, "tag"));
+    EXPECT_EQ(buildWithAStatsEvent(0, INT64_MAX, -1.0f, false, ""),
+              encodeWithWriter(0, INT64_MAX, -1.0f, false, ""));
+}
+
+TEST(StatsEventWriterTest, TestNullString) {
+    EXPECT_EQ(buildWithAStatsEvent(1000, 1, 0, true, nullptr),
+              encodeWithWriter(1000, 1, 0, true, nullptr));
+}
+
+TEST(StatsEventWriterTest, TestStringTruncated) {
+    const std::string longTag(64, 'a');
+    const std::string truncatedTag(16, 'a');
+    EXPECT_EQ(buildWithAStatsEvent(1000, 1, 0, true, truncatedTag.c_str()),
+              encodeWithWriter(1000, 1, 0, true, longTag.c_str()));
+}
+
+TEST(StatsEventWriterTest, TestMaxEncodedSize) {
+    using ScalarAtom = StatsAtomSchema<StatsAtomId<kAtomId>, StatsInt32Field<>, StatsBoolField<>>;
+    // object type & elements count, timestamp, atom id and fields type ids + values
+    static_assert(ScalarAtom::kMaxEncodedSize == 2 + 9 + 5 + 5 + 2);
+    static_assert(ScalarAtom::kElementsCount == 4);
+
+    uint8_t buffer[ScalarAtom::kMaxEncodedSize];
+    EXPECT_EQ(ScalarAtom::kMaxEncodedSize,
+              StatsEventWriter<ScalarAtom>::encode(buffer, kTimestampNs, 1, true));
+}
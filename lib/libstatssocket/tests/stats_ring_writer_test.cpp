@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <string.h>
+
+#include <vector>
+
+#include "stats_ring_writer.h"
+
+namespace {
+
+constexpr size_t kRingSize = sizeof(StatsRingHeader) + StatsRingWriter::kRingCapacity;
+
+class TestRingWriter : public StatsRingWriter {
+public:
+    ~TestRingWriter() {
+        if (mMapped != nullptr) {
+            munmap(mMapped, kRingSize);
+        }
+        if (mEventFd >= 0) {
+            close(mEventFd);
+        }
+    }
+
+    bool mRegistrationSucceeds = true;
+    int mRegistrationCount = 0;
+    int64_t mNowNs = 1000;
+
+    StatsRingHeader* header() const {
+        return (StatsRingHeader*)mMapped;
+    }
+
+    const uint8_t* data() const {
+        return (const uint8_t*)mMapped + sizeof(StatsRingHeader);
+    }
+
+    int eventFd() const {
+        return mEventFd;
+    }
+
+    // Consumes the ring like statsd does, returns the atom sizes
+    std::vector<uint32_t> consume() {
+        std::vector<uint32_t> sizes;
+        uint32_t readPos = header()->readPos.load();
+        const uint32_t writePos = header()->writePos.load();
+        while (readPos != writePos) {
+            const uint32_t offset = readPos % StatsRingWriter::kRingCapacity;
+            uint32_t size;
+            memcpy(&size, data() + offset, sizeof(size));
+            if (size == StatsRingWriter::kWrapMarker) {
+                readPos += StatsRingWriter::kRingCapacity - offset;
+                continue;
+            }
+            sizes.push_back(size);
+            readPos += (sizeof(uint32_t) + size + 3) & ~3u;
+        }
+        header()->readPos.store(readPos);
+        return sizes;
+    }
+
+protected:
+    bool registerRing(int memFd, int eventFd) override {
+        mRegistrationCount++;
+        if (!mRegistrationSucceeds) {
+            return false;
+        }
+        if (mMapped != nullptr) {
+            munmap(mMapped, kRingSize);
+            close(mEventFd);
+        }
+        // map separately, the way statsd does
+        mMapped = mmap(nullptr, kRingSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+        mEventFd = dup(eventFd);
+        return mMapped != MAP_FAILED;
+    }
+
+    int64_t getElapsedRealtimeNs() const override {
+        return mNowNs;
+    }
+
+private:
+    void* mMapped = nullptr;
+    int mEventFd = -1;
+};
+
+bool writeAtom(StatsRingWriter& writer, size_t size) {
+    std::vector<uint8_t> atom(size, (uint8_t)size);
+    const struct iovec vec = {atom.data(), atom.size()};
+    return writer.write(&vec, 1);
+}
+
+}  // namespace
+
+TEST(StatsRingWriterTest, TestWriteAndConsume) {
+    TestRingWriter writer;
+    ASSERT_TRUE(writeAtom(writer, 10));
+    ASSERT_EQ(writer.mRegistrationCount, 1);
+    EXPECT_EQ(writer.header()->magic, StatsRingWriter::kRingMagic);
+    EXPECT_EQ(writer.header()->capacity, StatsRingWriter::kRingCapacity);
+
+    std::vector<uint8_t> first(7, 1);
+    std::vector<uint8_t> second(100, 2);
+    const struct iovec atoms[] = {{first.data(), first.size()}, {second.data(), second.size()}};
+    ASSERT_TRUE(writer.write(atoms, 2));
+
+    EXPECT_EQ(writer.consume(), std::vector<uint32_t>({10, 7, 100}));
+    EXPECT_EQ(writer.mRegistrationCount, 1);
+}
+
+TEST(StatsRingWriterTest, TestWakeUpWaitingConsumer) {
+    TestRingWriter writer;
+    ASSERT_TRUE(writeAtom(writer, 10));
+    eventfd_t value = 0;
+    EXPECT_NE(eventfd_read(writer.eventFd(), &value), 0);
+
+    writer.header()->consumerWaiting.store(1);
+    ASSERT_TRUE(writeAtom(writer, 10));
+    EXPECT_EQ(writer.header()->consumerWaiting.load(), 0);
+    ASSERT_EQ(eventfd_read(writer.eventFd(), &value), 0);
+    EXPECT_EQ(value, 1);
+}
+
+TEST(StatsRingWriterTest, TestFullRingAndWrap) {
+    TestRingWriter writer;
+    const size_t atomSize = 4000;
+    const size_t recordSize = sizeof(uint32_t) + atomSize;
+    const size_t atomsPerRing = StatsRingWriter::kRingCapacity / recordSize;
+    for (size_t i = 0; i < atomsPerRing; i++) {
+        ASSERT_TRUE(writeAtom(writer, atomSize));
+    }
+    EXPECT_FALSE(writeAtom(writer, atomSize));
+
+    // all or nothing
+    std::vector<uint8_t> small(4, 0);
+    std::vector<uint8_t> large(atomSize, 0);
+    EXPECT_EQ(writer.consume().size(), atomsPerRing);
+    std::vector<struct iovec> atoms(atomsPerRing + 1, {large.data(), large.size()});
+    EXPECT_FALSE(writer.write(atoms.data(), atoms.size()));
+
+    // wraps to the data area start
+    for (size_t i = 0; i < atomsPerRing; i++) {
+        ASSERT_TRUE(writeAtom(writer, atomSize));
+    }
+    const std::vector<uint32_t> sizes = writer.consume();
+    ASSERT_EQ(sizes.size(), atomsPerRing);
+    for (uint32_t size : sizes) {
+        EXPECT_EQ(size, atomSize);
+    }
+    const struct iovec atom = {small.data(), small.size()};
+    EXPECT_TRUE(writer.write(&atom, 1));
+}
+
+TEST(StatsRingWriterTest, TestRegistrationRetry) {
+    TestRingWriter writer;
+    writer.mRegistrationSucceeds = false;
+    EXPECT_FALSE(writeAtom(writer, 10));
+    EXPECT_EQ(writer.mRegistrationCount, 1);
+
+    writer.mRegistrationSucceeds = true;
+    writer.mNowNs += StatsRingWriter::kRegistrationRetryNs - 1;
+    EXPECT_FALSE(writeAtom(writer, 10));
+    EXPECT_EQ(writer.mRegistrationCount, 1);
+
+    writer.mNowNs += 1;
+    EXPECT_TRUE(writeAtom(writer, 10));
+    EXPECT_EQ(writer.mRegistrationCount, 2);
+}
+
+TEST(StatsRingWriterTest, TestStaleConsumer) {
+    TestRingWriter writer;
+    ASSERT_TRUE(writeAtom(writer, 10));
+
+    // no progress on unread data for less than kStaleConsumerNs is fine
+    writer.mNowNs += StatsRingWriter::kStaleConsumerNs - 1;
+    EXPECT_TRUE(writeAtom(writer, 10));
+
+    // consumer progress resets the staleness timer
+    writer.consume();
+    writer.mNowNs += StatsRingWriter::kStaleConsumerNs - 1;
+    EXPECT_TRUE(writeAtom(writer, 10));
+    writer.mNowNs += StatsRingWriter::kStaleConsumerNs - 1;
+    EXPECT_TRUE(writeAtom(writer, 10));
+
+    // the ring is abandoned and a new one is registered after the retry delay
+    writer.mNowNs += StatsRingWriter::kStaleConsumerNs;
+    EXPECT_FALSE(writeAtom(writer, 10));
+    EXPECT_EQ(writer.mRegistrationCount, 1);
+    writer.mNowNs += StatsRingWriter::kRegistrationRetryNs;
+    EXPECT_TRUE(writeAtom(writer, 10));
+    EXPECT_EQ(writer.mRegistrationCount, 2);
+    EXPECT_EQ(writer.consume(), std::vector<uint32_t>({10}));
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "stats_socket_throttler_impl.h"
+#include "stats_statsdsocketlog.h"
+
+namespace {
+
+constexpr uint32_t kNoisyAtomId = 100;
+constexpr uint32_t kRareAtomId = 101;
+constexpr int64_t kStartNs = 1000 * 1000 * 1000;
+
+void congest(StatsSocketThrottler& throttler, int64_t elapsedRealtimeNanos) {
+    for (int i = 0; i < StatsSocketThrottler::kCongestionThreshold; i++) {
+        throttler.noteCongestion(/*congested=*/true, elapsedRealtimeNanos);
+    }
+}
+
+}  // namespace
+
+TEST(StatsSocketThrottlerTest, TestDisabled) {
+    StatsSocketThrottler throttler(/*enabled=*/false);
+    congest(throttler, kStartNs);
+    EXPECT_EQ(throttler.getSamplingShift(), 0);
+    EXPECT_FALSE(throttler.shouldThrottle(kNoisyAtomId, kStartNs));
+}
+
+TEST(StatsSocketThrottlerTest, TestCongestionRaisesSamplingShift) {
+    StatsSocketThrottler throttler(/*enabled=*/true);
+    for (int i = 0; i < StatsSocketThrottler::kCongestionThreshold - 1; i++) {
+        throttler.noteCongestion(/*congested=*/true, kStartNs);
+    }
+    // a successful write resets the consecutive congestion count
+    throttler.noteCongestion(/*congested=*/false, kStartNs);
+    throttler.noteCongestion(/*congested=*/true, kStartNs);
+    EXPECT_EQ(throttler.getSamplingShift(), 0);
+
+    congest(throttler, kStartNs);
+    EXPECT_EQ(throttler.getSamplingShift(), 1);
+
+    // adjustments are rate limited
+    congest(throttler, kStartNs + 1);
+    EXPECT_EQ(throttler.getSamplingShift(), 1);
+
+    int64_t timestampNs = kStartNs;
+    for (int i = 0; i < 2 * StatsSocketThrottler::kMaxSamplingShift; i++) {
+        timestampNs += StatsSocketThrottler::kMinAdjustmentIntervalNs;
+        congest(throttler, timestampNs);
+    }
+    EXPECT_EQ(throttler.getSamplingShift(), StatsSocketThrottler::kMaxSamplingShift);
+}
+
+TEST(StatsSocketThrottlerTest, TestRecovery) {
+    StatsSocketThrottler throttler(/*enabled=*/true);
+    congest(throttler, kStartNs);
+    congest(throttler, kStartNs + StatsSocketThrottler::kMinAdjustmentIntervalNs);
+    ASSERT_EQ(throttler.getSamplingShift(), 2);
+
+    const int64_t lastCongestionNs = kStartNs + StatsSocketThrottler::kMinAdjustmentIntervalNs;
+    throttler.noteCongestion(/*congested=*/false,
+                             lastCongestionNs + StatsSocketThrottler::kRecoveryIntervalNs - 1);
+    EXPECT_EQ(throttler.getSamplingShift(), 2);
+
+    throttler.noteCongestion(/*congested=*/false,
+                             lastCongestionNs + StatsSocketThrottler::kRecoveryIntervalNs);
+    EXPECT_EQ(throttler.getSamplingShift(), 1);
+
+    // one step per recovery interval
+    throttler.noteCongestion(/*congested=*/false,
+                             lastCongestionNs + StatsSocketThrottler::kRecoveryIntervalNs + 1);
+    EXPECT_EQ(throttler.getSamplingShift(), 1);
+
+    throttler.noteCongestion(/*congested=*/false,
+                             lastCongestionNs + 2 * StatsSocketThrottler::kRecoveryIntervalNs);
+    EXPECT_EQ(throttler.getSamplingShift(), 0);
+}
+
+TEST(StatsSocketThrottlerTest, TestSamplingNoisyAtoms) {
+    StatsSocketThrottler throttler(/*enabled=*/true);
+    congest(throttler, kStartNs);
+    congest(throttler, kStartNs + StatsSocketThrottler::kMinAdjustmentIntervalNs);
+    ASSERT_EQ(throttler.getSamplingShift(), 2);
+
+    const int64_t timestampNs = kStartNs + StatsSocketThrottler::kMinAdjustmentIntervalNs;
+    int written = 0;
+    for (int i = 0; i < StatsSocketThrottler::kUnsampledAtomsPerInterval + 100; i++) {
+        if (!throttler.shouldThrottle(kNoisyAtomId, timestampNs)) {
+            written++;
+        }
+    }
+    // all atoms below the budget, then 1 in 4
+    EXPECT_EQ(written, StatsSocketThrottler::kUnsampledAtomsPerInterval + 25);
+
+    // rare atoms and the loss report itself are not sampled
+    EXPECT_FALSE(throttler.shouldThrottle(kRareAtomId, timestampNs));
+    for (int i = 0; i < StatsSocketThrottler::kUnsampledAtomsPerInterval + 100; i++) {
+        EXPECT_FALSE(throttler.shouldThrottle(
+                android::os::statsdsocket::STATS_SOCKET_LOSS_REPORTED, timestampNs));
+    }
+
+    // the budget is renewed every interval
+    const int64_t nextIntervalNs = timestampNs + StatsSocketThrottler::kRecoveryIntervalNs;
+    for (int i = 0; i < StatsSocketThrottler::kUnsampledAtomsPerInterval; i++) {
+        EXPECT_FALSE(throttler.shouldThrottle(kNoisyAtomId, nextIntervalNs));
+    }
+    EXPECT_FALSE(throttler.shouldThrottle(kNoisyAtomId, nextIntervalNs));
+    EXPECT_TRUE(throttler.shouldThrottle(kNoisyAtomId, nextIntervalNs));
+}
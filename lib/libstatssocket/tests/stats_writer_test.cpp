@@ -15,9 +15,23 @@
  */
 
 #include <gtest/gtest.h>
+#include <private/android_filesystem_config.h>
 #include "stats_buffer_writer.h"
 #include "stats_event.h"
 #include "stats_socket.h"
+#include "statsd_writer.h"
+
+namespace {
+
+int allWritable(const char* /*path*/) {
+    return 1;
+}
+
+int noneWritable(const char* /*path*/) {
+    return 0;
+}
+
+}  // anonymous namespace
 
 TEST(StatsWriterTest, TestSocketClose) {
     AStatsEvent* event = AStatsEvent_obtain();
@@ -34,3 +48,20 @@ TEST(StatsWriterTest, TestSocketClose) {
 
     EXPECT_TRUE(stats_log_is_closed());
 }
+
+TEST(StatsWriterTest, TestClassSocketPath) {
+    EXPECT_STREQ("/dev/socket/statsdw_system",
+                 statsd_writer_get_socket_path(AID_SYSTEM, allWritable));
+    EXPECT_STREQ("/dev/socket/statsdw_native", statsd_writer_get_socket_path(AID_ROOT, allWritable));
+    EXPECT_STREQ("/dev/socket/statsdw_native",
+                 statsd_writer_get_socket_path(AID_APP_START - 1, allWritable));
+    EXPECT_STREQ("/dev/socket/statsdw", statsd_writer_get_socket_path(AID_APP_START, allWritable));
+}
+
+TEST(StatsWriterTest, TestClassSocketPathFallback) {
+    // the class sockets are optional, the writers fall back to statsdw when they are missing
+    EXPECT_STREQ("/dev/socket/statsdw", statsd_writer_get_socket_path(AID_SYSTEM, noneWritable));
+    EXPECT_STREQ("/dev/socket/statsdw", statsd_writer_get_socket_path(AID_ROOT, noneWritable));
+    EXPECT_STREQ("/dev/socket/statsdw",
+                 statsd_writer_get_socket_path(AID_APP_START, noneWritable));
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark/benchmark.h"
+#include "tests/statsd_test_util.h"
+
+using namespace std;
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+constexpr int kConditionAtomId = 1000;
+constexpr int kCountedAtomId = 2000;
+constexpr int64_t kTimeBaseNs = 10 * NS_PER_SEC;
+
+// Matches the atom whose second field is the given state, used as predicate start and stop.
+AtomMatcher createStateMatcher(const string& name, int atomId, int state) {
+    AtomMatcher matcher = CreateSimpleAtomMatcher(name, atomId);
+    auto fieldValueMatcher = matcher.mutable_simple_atom_matcher()->add_field_value_matcher();
+    fieldValueMatcher->set_field(2);
+    fieldValueMatcher->set_eq_int(state);
+    return matcher;
+}
+
+Predicate createStatePredicate(StatsdConfig* config, int atomId, bool sliced) {
+    const AtomMatcher startMatcher = createStateMatcher("Start" + to_string(atomId), atomId, 1);
+    const AtomMatcher stopMatcher = createStateMatcher("Stop" + to_string(atomId), atomId, 0);
+    *config->add_atom_matcher() = startMatcher;
+    *config->add_atom_matcher() = stopMatcher;
+    Predicate predicate;
+    predicate.set_id(StringToId("Predicate" + to_string(atomId)));
+    predicate.mutable_simple_predicate()->set_start(startMatcher.id());
+    predicate.mutable_simple_predicate()->set_stop(stopMatcher.id());
+    if (sliced) {
+        *predicate.mutable_simple_predicate()->mutable_dimensions() =
+                CreateDimensions(atomId, {1});
+    }
+    *config->add_predicate() = predicate;
+    return predicate;
+}
+
+void processEvents(benchmark::State& state, const sp<StatsLogProcessor>& processor,
+                   const vector<shared_ptr<LogEvent>>& events) {
+    for (auto _ : state) {
+        for (const shared_ptr<LogEvent>& event : events) {
+            processor->OnLogEvent(event.get());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * events.size());
+}
+
+}  // namespace
+
+// SimpleConditionTracker sliced by range(0) dimensions, each started and stopped once. A count
+// metric is conditioned on the predicate so that the condition changes are delivered.
+static void BM_SimpleConditionSliced(benchmark::State& state) {
+    const int dimensions = state.range(0);
+    StatsdConfig config;
+    const Predicate predicate = createStatePredicate(&config, kConditionAtomId, /*sliced=*/true);
+    const AtomMatcher countedMatcher = CreateSimpleAtomMatcher("Counted", kCountedAtomId);
+    *config.add_atom_matcher() = countedMatcher;
+    *config.add_count_metric() =
+            createCountMetric("Count", countedMatcher.id(), predicate.id(), /* states */ {});
+
+    vector<shared_ptr<LogEvent>> events;
+    for (int dimension = 0; dimension < dimensions; dimension++) {
+        events.push_back(CreateTwoValueLogEvent(kConditionAtomId, kTimeBaseNs + dimension + 1,
+                                                dimension, /*state*/ 1));
+    }
+    for (int dimension = 0; dimension < dimensions; dimension++) {
+        events.push_back(CreateTwoValueLogEvent(
+                kConditionAtomId, kTimeBaseNs + dimensions + dimension + 1, dimension, 0));
+    }
+
+    const ConfigKey cfgKey(0, 12345);
+    sp<StatsLogProcessor> processor =
+            CreateStatsLogProcessor(kTimeBaseNs, kTimeBaseNs, config, cfgKey);
+    processEvents(state, processor, events);
+}
+BENCHMARK(BM_SimpleConditionSliced)->Arg(10)->Arg(100)->Arg(1000);
+
+// CombinationConditionTracker with the AND of range(0) unsliced children, each turned on and off
+// once, with a count metric conditioned on the combination.
+static void BM_CombinationCondition(benchmark::State& state) {
+    const int children = state.range(0);
+    StatsdConfig config;
+    Predicate combination;
+    combination.set_id(StringToId("Combination"));
+    combination.mutable_combination()->set_operation(LogicalOperation::AND);
+    for (int i = 0; i < children; i++) {
+        const Predicate child =
+                createStatePredicate(&config, kConditionAtomId + i, /*sliced=*/false);
+        combination.mutable_combination()->add_predicate(child.id());
+    }
+    *config.add_predicate() = combination;
+    const AtomMatcher countedMatcher = CreateSimpleAtomMatcher("Counted", kCountedAtomId);
+    *config.add_atom_matcher() = countedMatcher;
+    *config.add_count_metric() =
+            createCountMetric("Count", countedMatcher.id(), combination.id(), /* states */ {});
+
+    vector<shared_ptr<LogEvent>> events;
+    for (int i = 0; i < children; i++) {
+        events.push_back(
+                CreateTwoValueLogEvent(kConditionAtomId + i, kTimeBaseNs + i + 1, 0, /*state*/ 1));
+    }
+    events.push_back(CreateTwoValueLogEvent(kCountedAtomId, kTimeBaseNs + children + 1, 0, 0));
+    for (int i = 0; i < children; i++) {
+        events.push_back(CreateTwoValueLogEvent(kConditionAtomId + i,
+                                                kTimeBaseNs + children + i + 2, 0, /*state*/ 0));
+    }
+
+    const ConfigKey cfgKey(0, 12345);
+    sp<StatsLogProcessor> processor =
+            CreateStatsLogProcessor(kTimeBaseNs, kTimeBaseNs, config, cfgKey);
+    processEvents(state, processor, events);
+}
+BENCHMARK(BM_CombinationCondition)->Arg(2)->Arg(10)->Arg(50);
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
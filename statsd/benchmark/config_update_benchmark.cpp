@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark/benchmark.h"
+#include "tests/statsd_test_util.h"
+
+using namespace std;
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+constexpr int kAtomId = 1000;
+constexpr int64_t kTimeBaseNs = 10 * NS_PER_SEC;
+
+// Config of sliced count metrics, each on its own matcher. The last metric is
+// conditioned on a predicate when withCondition is set, so that two configs differ by one metric.
+StatsdConfig createConfig(int metrics, bool withCondition) {
+    StatsdConfig config;
+    const Predicate predicate = CreateScreenIsOnPredicate();
+    *config.add_atom_matcher() = CreateScreenTurnedOnAtomMatcher();
+    *config.add_atom_matcher() = CreateScreenTurnedOffAtomMatcher();
+    *config.add_predicate() = predicate;
+    for (int i = 0; i < metrics; i++) {
+        const AtomMatcher matcher = CreateSimpleAtomMatcher("Atom" + to_string(i), kAtomId + i);
+        *config.add_atom_matcher() = matcher;
+        const bool conditioned = withCondition && i == metrics - 1;
+        CountMetric metric =
+                createCountMetric("Count" + to_string(i), matcher.id(),
+                                  conditioned ? optional<int64_t>(predicate.id()) : nullopt, {});
+        *metric.mutable_dimensions_in_what() = CreateDimensions(kAtomId + i, {1});
+        *config.add_count_metric() = metric;
+    }
+    return config;
+}
+
+}  // namespace
+
+// Alternates between two configs of range(0) metrics that differ by one metric. A modular update
+// keeps the other metrics and their data, a full update rebuilds all of them.
+static void BM_ConfigUpdate(benchmark::State& state, bool modularUpdate) {
+    const int metrics = state.range(0);
+    const StatsdConfig configs[] = {createConfig(metrics, /*withCondition=*/false),
+                                    createConfig(metrics, /*withCondition=*/true)};
+    const ConfigKey cfgKey(0, 12345);
+    sp<StatsLogProcessor> processor =
+            CreateStatsLogProcessor(kTimeBaseNs, kTimeBaseNs, configs[0], cfgKey);
+    // one dimension in each metric, kept through modular updates
+    for (int i = 0; i < metrics; i++) {
+        shared_ptr<LogEvent> event =
+                CreateTwoValueLogEvent(kAtomId + i, kTimeBaseNs + i + 1, /*value1=*/1, 1);
+        processor->OnLogEvent(event.get());
+    }
+
+    int64_t updateTimeNs = kTimeBaseNs + metrics + 1;
+    int update = 0;
+    for (auto _ : state) {
+        update++;
+        processor->OnConfigUpdated(updateTimeNs++, cfgKey, configs[update % 2], modularUpdate);
+    }
+}
+BENCHMARK_CAPTURE(BM_ConfigUpdate, Modular, /*modularUpdate=*/true)
+        ->Arg(10)
+        ->Arg(100)
+        ->Arg(1000)
+        ->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_ConfigUpdate, Full, /*modularUpdate=*/false)
+        ->Arg(10)
+        ->Arg(100)
+        ->Arg(1000)
+        ->Unit(benchmark::kMicrosecond);
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
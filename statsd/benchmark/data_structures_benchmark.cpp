@@ -13,11 +13,16 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
 #include <cstdlib>
 #include <ctime>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
+#include "HashableDimensionKey.h"
 #include "benchmark/benchmark.h"
+#include "utils/FlatHashMap.h"
 
 namespace android {
 namespace os {
@@ -56,8 +61,258 @@ void benchmarkStdFillForVector(std::vector<ContainerType>& vec, int capacity) {
     benchmark::DoNotOptimize(resultInt);
 }
 
+// What key with a uid, a tag & an int value, and a state key with one value.
+MetricDimensionKey createMetricDimensionKey(int i) {
+    int pos[] = {1, 0, 0};
+    HashableDimensionKey whatKey;
+    whatKey.addValue(FieldValue(Field(10, pos, 0), Value((int32_t)(10000 + i))));
+    pos[0] = 2;
+    whatKey.addValue(FieldValue(Field(10, pos, 0), Value("wakelock_tag_" + std::to_string(i))));
+    pos[0] = 3;
+    whatKey.addValue(FieldValue(Field(10, pos, 0), Value((int64_t)i)));
+
+    HashableDimensionKey stateKey;
+    pos[0] = 1;
+    stateKey.addValue(FieldValue(Field(27, pos, 0), Value((int32_t)(i % 3))));
+    return MetricDimensionKey(whatKey, stateKey);
+}
+
+std::unordered_map<MetricDimensionKey, int> createDimensionKeyMap(int size) {
+    std::unordered_map<MetricDimensionKey, int> map;
+    for (int i = 0; i < size; i++) {
+        map[createMetricDimensionKey(i)] = i;
+    }
+    return map;
+}
+
+// Allocator counting the bytes allocated by a std::unordered_map, nodes and buckets.
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    explicit CountingAllocator(size_t* allocatedBytes) : allocatedBytes(allocatedBytes) {
+    }
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& that) : allocatedBytes(that.allocatedBytes) {
+    }
+
+    T* allocate(size_t n) {
+        *allocatedBytes += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        *allocatedBytes -= n * sizeof(T);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U>& that) const {
+        return allocatedBytes == that.allocatedBytes;
+    }
+
+    template <typename U>
+    bool operator!=(const CountingAllocator<U>& that) const {
+        return allocatedBytes != that.allocatedBytes;
+    }
+
+    size_t* allocatedBytes;
+};
+
+using CountingDimensionKeyMap =
+        std::unordered_map<MetricDimensionKey, int64_t, std::hash<MetricDimensionKey>,
+                           std::equal_to<MetricDimensionKey>,
+                           CountingAllocator<std::pair<const MetricDimensionKey, int64_t>>>;
+
+std::vector<MetricDimensionKey> createMetricDimensionKeys(int size) {
+    std::vector<MetricDimensionKey> keys;
+    for (int i = 0; i < size; i++) {
+        keys.push_back(createMetricDimensionKey(i));
+        // Hashes are cached in the keys of a map, compute them now like the map would.
+        std::hash<MetricDimensionKey>()(keys.back());
+    }
+    return keys;
+}
+
+// Bytes allocated by the map itself, not counting the values held by the dimension keys which are
+// the same for both maps.
+size_t getAllocatedBytes(const FlatHashMap<MetricDimensionKey, int64_t>& map) {
+    return map.getAllocatedBytes();
+}
+
+size_t getAllocatedBytes(const CountingDimensionKeyMap& map) {
+    return *map.get_allocator().allocatedBytes;
+}
+
+template <typename MapType>
+MapType createMap(size_t* allocatedBytes);
+
+template <>
+FlatHashMap<MetricDimensionKey, int64_t> createMap(size_t* /*allocatedBytes*/) {
+    return FlatHashMap<MetricDimensionKey, int64_t>();
+}
+
+template <>
+CountingDimensionKeyMap createMap(size_t* allocatedBytes) {
+    return CountingDimensionKeyMap(CountingAllocator<int>(allocatedBytes));
+}
+
+// Adds to each dimension of the map, like a metric producer would while processing events, then
+// clears the map at the end of the bucket.
+template <typename MapType>
+void benchmarkDimensionMapBucket(benchmark::State& state) {
+    const std::vector<MetricDimensionKey> keys = createMetricDimensionKeys(state.range(0));
+    size_t allocatedBytes = 0;
+    size_t maxAllocatedBytes = 0;
+    for (auto _ : state) {
+        MapType map = createMap<MapType>(&allocatedBytes);
+        for (int event = 0; event < 4; event++) {
+            for (const MetricDimensionKey& key : keys) {
+                map[key] += event;
+            }
+        }
+        maxAllocatedBytes = std::max(maxAllocatedBytes, getAllocatedBytes(map));
+        benchmark::DoNotOptimize(map);
+    }
+    state.counters["bytes"] = maxAllocatedBytes;
+    state.counters["bytes_per_dimension"] = (double)maxAllocatedBytes / keys.size();
+    state.SetItemsProcessed(state.iterations() * keys.size() * 4);
+}
+
+// Looks up each dimension of the map and iterates over all of them, like dumping a report.
+template <typename MapType>
+void benchmarkDimensionMapLookup(benchmark::State& state) {
+    const std::vector<MetricDimensionKey> keys = createMetricDimensionKeys(state.range(0));
+    size_t allocatedBytes = 0;
+    MapType map = createMap<MapType>(&allocatedBytes);
+    for (const MetricDimensionKey& key : keys) {
+        map[key] = 1;
+    }
+    for (auto _ : state) {
+        int64_t sum = 0;
+        for (const MetricDimensionKey& key : keys) {
+            sum += map.find(key)->second;
+        }
+        for (const auto& [key, value] : map) {
+            sum += value;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// The hash of the keys before the values were mixed as 64-bit words, to compare against.
+android::hash_t jenkinsHashDimension(const HashableDimensionKey& key) {
+    android::hash_t hash = 0;
+    for (const auto& fieldValue : key.getValues()) {
+        hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mField.getField()));
+        hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mField.getTag()));
+        hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mValue.getType()));
+        switch (fieldValue.mValue.getType()) {
+            case INT:
+                hash = android::JenkinsHashMix(hash,
+                                               android::hash_type(fieldValue.mValue.int_value));
+                break;
+            case LONG:
+                hash = android::JenkinsHashMix(hash,
+                                               android::hash_type(fieldValue.mValue.long_value));
+                break;
+            case STRING:
+                hash = android::JenkinsHashMix(
+                        hash, static_cast<uint32_t>(fieldValue.mValue.str_value.hash()));
+                break;
+            default:
+                break;
+        }
+    }
+    return JenkinsHashWhiten(hash);
+}
+
+std::vector<HashableDimensionKey> createWhatKeys(int size) {
+    std::vector<HashableDimensionKey> keys;
+    for (int i = 0; i < size; i++) {
+        keys.push_back(createMetricDimensionKey(i).getDimensionKeyInWhat());
+    }
+    return keys;
+}
+
 }  //  namespace
 
+static void BM_MetricDimensionKeyLookup(benchmark::State& state) {
+    const std::unordered_map<MetricDimensionKey, int> map = createDimensionKeyMap(state.range(0));
+    const MetricDimensionKey key = createMetricDimensionKey(state.range(0) / 2);
+
+    // The hash of the key is computed once and reused by each lookup, like the lookups of a key
+    // in mCurrentSlicedBucket, the condition & anomaly tracker maps while processing an event.
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(map.find(key));
+    }
+}
+BENCHMARK(BM_MetricDimensionKeyLookup)->Args({10})->Args({100})->Args({1000});
+
+static void BM_MetricDimensionKeyLookupNewKey(benchmark::State& state) {
+    const std::unordered_map<MetricDimensionKey, int> map = createDimensionKeyMap(state.range(0));
+    const MetricDimensionKey key = createMetricDimensionKey(state.range(0) / 2);
+
+    // Copies of the values, without the cached hashes.
+    for (auto _ : state) {
+        const MetricDimensionKey newKey(
+                HashableDimensionKey(key.getDimensionKeyInWhat().getValues()),
+                HashableDimensionKey(key.getStateValuesKey().getValues()));
+        benchmark::DoNotOptimize(map.find(newKey));
+    }
+}
+BENCHMARK(BM_MetricDimensionKeyLookupNewKey)->Args({10})->Args({100})->Args({1000});
+
+static void BM_HashDimension(benchmark::State& state) {
+    std::vector<HashableDimensionKey> keys = createWhatKeys(1000);
+    for (auto _ : state) {
+        android::hash_t hash = 0;
+        for (HashableDimensionKey& key : keys) {
+            // Clears the cached hash.
+            key.mutableValue(0);
+            hash ^= hashDimension(key);
+        }
+        benchmark::DoNotOptimize(hash);
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_HashDimension);
+
+static void BM_HashDimensionJenkins(benchmark::State& state) {
+    const std::vector<HashableDimensionKey> keys = createWhatKeys(1000);
+    for (auto _ : state) {
+        android::hash_t hash = 0;
+        for (const HashableDimensionKey& key : keys) {
+            hash ^= jenkinsHashDimension(key);
+        }
+        benchmark::DoNotOptimize(hash);
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_HashDimensionJenkins);
+
+static void BM_UnorderedMapDimensionBucket(benchmark::State& state) {
+    benchmarkDimensionMapBucket<CountingDimensionKeyMap>(state);
+}
+BENCHMARK(BM_UnorderedMapDimensionBucket)->Args({100})->Args({1000})->Args({5000})->Args({20000});
+
+static void BM_FlatHashMapDimensionBucket(benchmark::State& state) {
+    benchmarkDimensionMapBucket<FlatHashMap<MetricDimensionKey, int64_t>>(state);
+}
+BENCHMARK(BM_FlatHashMapDimensionBucket)->Args({100})->Args({1000})->Args({5000})->Args({20000});
+
+static void BM_UnorderedMapDimensionLookup(benchmark::State& state) {
+    benchmarkDimensionMapLookup<CountingDimensionKeyMap>(state);
+}
+BENCHMARK(BM_UnorderedMapDimensionLookup)->Args({100})->Args({1000})->Args({5000})->Args({20000});
+
+static void BM_FlatHashMapDimensionLookup(benchmark::State& state) {
+    benchmarkDimensionMapLookup<FlatHashMap<MetricDimensionKey, int64_t>>(state);
+}
+BENCHMARK(BM_FlatHashMapDimensionLookup)->Args({100})->Args({1000})->Args({5000})->Args({20000});
+
 static void BM_BasicVectorBoolUsage(benchmark::State& state) {
     const int capacity = state.range(0);
     std::vector<bool> vec(capacity);
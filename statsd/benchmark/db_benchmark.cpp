@@ -111,6 +111,37 @@ static void BM_createDbTables(benchmark::State& state) {
 }
 
 BENCHMARK(BM_createDbTables);
+
+static void BM_flushTtl(benchmark::State& state) {
+    ConfigKey key = ConfigKey(111, 222);
+    int64_t metricId = 0;
+    int64_t bucketStartTimeNs = 10000000000;
+    int64_t wallClockNs = 1000 * NS_PER_SEC;
+
+    unique_ptr<LogEvent> event =
+            CreateScreenStateChangedEvent(bucketStartTimeNs, android::view::DISPLAY_STATE_OFF);
+    // One event per second of wall clock time, the TTL removes the oldest 1% of them.
+    vector<LogEvent> logEvents;
+    for (int j = 0; j < state.range(0); ++j) {
+        event->setLogdWallClockTimestampNs(wallClockNs + j * NS_PER_SEC);
+        logEvents.push_back(*event.get());
+    }
+    const int64_t ttlWallClockNs = wallClockNs + state.range(0) / 100 * NS_PER_SEC;
+    sqlite3* dbHandle = getDb(key);
+    string err;
+    for (auto s : state) {
+        state.PauseTiming();
+        deleteTable(key, metricId);
+        createTableIfNeeded(key, metricId, *event.get());
+        insert(key, metricId, logEvents, err);
+        state.ResumeTiming();
+        flushTtl(dbHandle, metricId, ttlWallClockNs);
+    }
+    closeDb(dbHandle);
+    deleteDb(key);
+}
+
+BENCHMARK(BM_flushTtl)->Arg(1000)->Arg(10000)->Arg(100000);
 }  // namespace dbutils
 }  // namespace statsd
 }  // namespace os
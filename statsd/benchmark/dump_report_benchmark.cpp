@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark/benchmark.h"
+#include "stats_log_util.h"
+#include "tests/statsd_test_util.h"
+
+using namespace std;
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+constexpr int kAtomId = 1000;
+constexpr int64_t kTimeBaseNs = 10 * NS_PER_SEC;
+
+}  // namespace
+
+// Serializes a report of range(0) count and value metrics, each sliced by range(1) dimensions
+// over range(2) buckets. The data is not erased, so every dump writes the same report.
+static void BM_DumpReport(benchmark::State& state) {
+    const int metrics = state.range(0);
+    const int dimensions = state.range(1);
+    const int buckets = state.range(2);
+
+    StatsdConfig config;
+    const AtomMatcher matcher = CreateSimpleAtomMatcher("Atom", kAtomId);
+    *config.add_atom_matcher() = matcher;
+    for (int i = 0; i < metrics; i++) {
+        CountMetric countMetric =
+                createCountMetric("Count" + to_string(i), matcher.id(), nullopt, {});
+        *countMetric.mutable_dimensions_in_what() = CreateDimensions(kAtomId, {1});
+        *config.add_count_metric() = countMetric;
+        ValueMetric valueMetric =
+                createValueMetric("Value" + to_string(i), matcher, 2, nullopt, {});
+        *valueMetric.mutable_dimensions_in_what() = CreateDimensions(kAtomId, {1});
+        *config.add_value_metric() = valueMetric;
+    }
+
+    const ConfigKey cfgKey(0, 12345);
+    sp<StatsLogProcessor> processor =
+            CreateStatsLogProcessor(kTimeBaseNs, kTimeBaseNs, config, cfgKey);
+    const int64_t bucketSizeNs = TimeUnitToBucketSizeInMillis(TEN_MINUTES) * 1000000LL;
+    for (int bucket = 0; bucket < buckets; bucket++) {
+        const int64_t bucketStartNs = kTimeBaseNs + bucket * bucketSizeNs;
+        for (int dimension = 0; dimension < dimensions; dimension++) {
+            shared_ptr<LogEvent> event = CreateTwoValueLogEvent(
+                    kAtomId, bucketStartNs + dimension + 1, dimension, dimension);
+            processor->OnLogEvent(event.get());
+        }
+    }
+
+    const int64_t dumpTimeNs = kTimeBaseNs + buckets * bucketSizeNs + 1;
+    int64_t reportBytes = 0;
+    for (auto _ : state) {
+        vector<uint8_t> buffer;
+        processor->onDumpReport(cfgKey, dumpTimeNs, /*include_current_partial_bucket=*/true,
+                                /*erase_data=*/false, ADB_DUMP, FAST, &buffer);
+        reportBytes = buffer.size();
+        benchmark::DoNotOptimize(buffer);
+    }
+    state.counters["report_bytes"] = reportBytes;
+    state.SetBytesProcessed(state.iterations() * reportBytes);
+}
+BENCHMARK(BM_DumpReport)
+        ->Args({1, 1000, 1})
+        ->Args({1, 1000, 10})
+        ->Args({10, 100, 5})
+        ->Args({50, 100, 5})
+        ->Unit(benchmark::kMillisecond);
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * End to end benchmark of the ingestion of pushed atoms: the messages received on the statsd
+ * socket are parsed by StatsSocketListener::processMessage into the LogEventQueue, drained and
+ * processed by StatsLogProcessor like in StatsService::readLogs, then the report is dumped.
+ *
+ * The config mixes the common shapes of metrics: wakelock durations and app start counts sliced
+ * by uid, and a value metric of a per uid pulled atom pulled on each screen state change.
+ *
+ * The replayed trace is generated, or read from the file named by the STATSD_BENCHMARK_TRACE
+ * environment variable, see readSocketMessageTrace for its format.
+ *
+ * The latency of an event is from when its message is parsed until the processor is done with
+ * it, and is reported as the p50_latency_ns and p99_latency_ns counters.
+ */
+
+#include <aidl/android/os/BnPullAtomCallback.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "logd/LogEventQueue.h"
+#include "socket/StatsSocketListener.h"
+#include "stats_log_util.h"
+#include "tests/statsd_test_util.h"
+
+using namespace std;
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+constexpr int kTraceSize = 10000;
+constexpr int kNumUids = 50;
+constexpr int64_t kTraceStartNs = 10 * NS_PER_SEC;
+constexpr int64_t kEventIntervalNs = 1'000'000;
+// A screen state change, and so a pull, every kScreenStateInterval events.
+constexpr int kScreenStateInterval = 1000;
+
+// Same as StatsService::readLogs.
+constexpr size_t kMaxLogEventBatchSize = 64;
+
+SocketMessage buildMessage(AStatsEvent* statsEvent, int uid) {
+    AStatsEvent_build(statsEvent);
+    size_t size;
+    uint8_t* buffer = AStatsEvent_getBuffer(statsEvent, &size);
+    SocketMessage message{.uid = (uint32_t)uid, .pid = 0, .buffer = {buffer, buffer + size}};
+    AStatsEvent_release(statsEvent);
+    return message;
+}
+
+SocketMessage makeWakelockMessage(int64_t timestampNs, int uid, const string& tag,
+                                 WakelockStateChanged::State state) {
+    AStatsEvent* statsEvent = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(statsEvent, util::WAKELOCK_STATE_CHANGED);
+    AStatsEvent_overwriteTimestamp(statsEvent, timestampNs);
+    writeAttribution(statsEvent, {uid}, {"App" + to_string(uid)});
+    AStatsEvent_addBoolAnnotation(statsEvent, ASTATSLOG_ANNOTATION_ID_PRIMARY_FIELD_FIRST_UID,
+                                  true);
+    AStatsEvent_writeInt32(statsEvent, android::os::WakeLockLevelEnum::PARTIAL_WAKE_LOCK);
+    AStatsEvent_addBoolAnnotation(statsEvent, ASTATSLOG_ANNOTATION_ID_PRIMARY_FIELD, true);
+    AStatsEvent_writeString(statsEvent, tag.c_str());
+    AStatsEvent_addBoolAnnotation(statsEvent, ASTATSLOG_ANNOTATION_ID_PRIMARY_FIELD, true);
+    AStatsEvent_writeInt32(statsEvent, state);
+    AStatsEvent_addBoolAnnotation(statsEvent, ASTATSLOG_ANNOTATION_ID_EXCLUSIVE_STATE, true);
+    AStatsEvent_addBoolAnnotation(statsEvent, ASTATSLOG_ANNOTATION_ID_STATE_NESTED, true);
+    return buildMessage(statsEvent, uid);
+}
+
+SocketMessage makeAppStartMessage(int64_t timestampNs, int uid) {
+    AStatsEvent* statsEvent = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(statsEvent, util::APP_START_OCCURRED);
+    AStatsEvent_overwriteTimestamp(statsEvent, timestampNs);
+    AStatsEvent_writeInt32(statsEvent, uid);
+    AStatsEvent_addBoolAnnotation(statsEvent, ASTATSLOG_ANNOTATION_ID_IS_UID, true);
+    AStatsEvent_writeString(statsEvent, ("com.example.app" + to_string(uid)).c_str());
+    AStatsEvent_writeInt32(statsEvent, AppStartOccurred::WARM);
+    AStatsEvent_writeString(statsEvent, "MainActivity");
+    AStatsEvent_writeString(statsEvent, "com.android.launcher");
+    AStatsEvent_writeInt32(statsEvent, false);
+    AStatsEvent_writeInt32(statsEvent, 100);
+    return buildMessage(statsEvent, uid);
+}
+
+SocketMessage makeScreenStateMessage(int64_t timestampNs, android::view::DisplayStateEnum state) {
+    AStatsEvent* statsEvent = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(statsEvent, util::SCREEN_STATE_CHANGED);
+    AStatsEvent_overwriteTimestamp(statsEvent, timestampNs);
+    AStatsEvent_writeInt32(statsEvent, state);
+    AStatsEvent_addBoolAnnotation(statsEvent, ASTATSLOG_ANNOTATION_ID_EXCLUSIVE_STATE, true);
+    AStatsEvent_addBoolAnnotation(statsEvent, ASTATSLOG_ANNOTATION_ID_STATE_NESTED, false);
+    return buildMessage(statsEvent, /*uid=*/1000);
+}
+
+// Atoms no metric of the config uses, which still go through the parsing and the matchers.
+SocketMessage makeUnusedAtomMessage(int64_t timestampNs, int uid) {
+    AStatsEvent* statsEvent = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(statsEvent, util::BATTERY_LEVEL_CHANGED);
+    AStatsEvent_overwriteTimestamp(statsEvent, timestampNs);
+    AStatsEvent_writeInt32(statsEvent, uid % 100);
+    return buildMessage(statsEvent, uid);
+}
+
+// Generates a trace where every uid holds wakelocks and starts its app, with a screen state
+// change every kScreenStateInterval events.
+vector<SocketMessage> generateTrace() {
+    vector<SocketMessage> trace;
+    trace.reserve(kTraceSize);
+    bool screenOn = false;
+    for (int i = 0; i < kTraceSize; i++) {
+        const int64_t timestampNs = kTraceStartNs + i * kEventIntervalNs;
+        const int uid = 10000 + (i / 2) % kNumUids;
+        if (i % kScreenStateInterval == 0) {
+            screenOn = !screenOn;
+            trace.push_back(makeScreenStateMessage(
+                    timestampNs, screenOn ? android::view::DisplayStateEnum::DISPLAY_STATE_ON
+                                          : android::view::DisplayStateEnum::DISPLAY_STATE_OFF));
+            continue;
+        }
+        switch (i % 10) {
+            case 0:
+            case 2:
+            case 4:
+                trace.push_back(makeWakelockMessage(timestampNs, uid, "wl" + to_string(i % 4),
+                                                    WakelockStateChanged::ACQUIRE));
+                break;
+            case 1:
+            case 3:
+            case 5:
+                trace.push_back(makeWakelockMessage(timestampNs, uid, "wl" + to_string(i % 4 - 1),
+                                                    WakelockStateChanged::RELEASE));
+                break;
+            case 6:
+            case 7:
+                trace.push_back(makeAppStartMessage(timestampNs, uid));
+                break;
+            default:
+                trace.push_back(makeUnusedAtomMessage(timestampNs, uid));
+                break;
+        }
+    }
+    return trace;
+}
+
+const vector<SocketMessage>& getTrace() {
+    static const vector<SocketMessage> trace = [] {
+        const char* path = getenv("STATSD_BENCHMARK_TRACE");
+        return path != nullptr ? readSocketMessageTrace(path) : generateTrace();
+    }();
+    return trace;
+}
+
+// Pulls CpuTimePerUid for all the uids of the trace.
+class CpuTimePerUidCallback : public BnPullAtomCallback {
+public:
+    Status onPullAtom(int atomTag,
+                      const shared_ptr<IPullAtomResultReceiver>& resultReceiver) override {
+        std::vector<StatsEventParcel> parcels;
+        for (int uid = 10000; uid < 10000 + kNumUids; uid++) {
+            AStatsEvent* statsEvent = AStatsEvent_obtain();
+            AStatsEvent_setAtomId(statsEvent, atomTag);
+            AStatsEvent_writeInt32(statsEvent, uid);
+            AStatsEvent_addBoolAnnotation(statsEvent, ASTATSLOG_ANNOTATION_ID_IS_UID, true);
+            AStatsEvent_writeInt64(statsEvent, mPullNum * 1000 + uid);
+            AStatsEvent_writeInt64(statsEvent, mPullNum * 100 + uid);
+            AStatsEvent_build(statsEvent);
+            size_t size;
+            uint8_t* buffer = AStatsEvent_getBuffer(statsEvent, &size);
+            StatsEventParcel parcel;
+            parcel.buffer.assign(buffer, buffer + size);
+            parcels.push_back(std::move(parcel));
+            AStatsEvent_release(statsEvent);
+        }
+        mPullNum++;
+        resultReceiver->pullFinished(atomTag, /*success=*/true, parcels);
+        return Status::ok();
+    }
+
+private:
+    int64_t mPullNum = 1;
+};
+
+StatsdConfig createIngestionConfig() {
+    StatsdConfig config;
+    config.add_default_pull_packages("AID_ROOT");  // Fake puller is registered with root.
+
+    auto acquireMatcher = CreateAcquireWakelockAtomMatcher();
+    auto releaseMatcher = CreateReleaseWakelockAtomMatcher();
+    auto screenOnMatcher = CreateScreenTurnedOnAtomMatcher();
+    auto screenOffMatcher = CreateScreenTurnedOffAtomMatcher();
+    auto appStartMatcher = CreateAppStartOccurredAtomMatcher();
+    auto cpuTimeMatcher = CreateSimpleAtomMatcher("CpuTimePerUid", util::CPU_TIME_PER_UID);
+    *config.add_atom_matcher() = acquireMatcher;
+    *config.add_atom_matcher() = releaseMatcher;
+    *config.add_atom_matcher() = screenOnMatcher;
+    *config.add_atom_matcher() = screenOffMatcher;
+    *config.add_atom_matcher() = appStartMatcher;
+    *config.add_atom_matcher() = cpuTimeMatcher;
+
+    auto screenIsOnPredicate = CreateScreenIsOnPredicate();
+    *config.add_predicate() = screenIsOnPredicate;
+    auto holdingWakelockPredicate = CreateHoldingWakelockPredicate();
+    *holdingWakelockPredicate.mutable_simple_predicate()->mutable_dimensions() =
+            CreateAttributionUidDimensions(util::WAKELOCK_STATE_CHANGED, {Position::FIRST});
+    *config.add_predicate() = holdingWakelockPredicate;
+
+    DurationMetric* durationMetric = config.add_duration_metric();
+    *durationMetric = createDurationMetric("WakelockDuration", holdingWakelockPredicate.id(),
+                                           /* condition */ nullopt, /* states */ {});
+    *durationMetric->mutable_dimensions_in_what() =
+            CreateAttributionUidDimensions(util::WAKELOCK_STATE_CHANGED, {Position::FIRST});
+
+    CountMetric* countMetric = config.add_count_metric();
+    *countMetric = createCountMetric("AppStarts", appStartMatcher.id(), /* condition */ nullopt,
+                                     /* states */ {});
+    *countMetric->mutable_dimensions_in_what() =
+            CreateDimensions(util::APP_START_OCCURRED, {1 /* uid */});
+
+    ValueMetric* valueMetric = config.add_value_metric();
+    *valueMetric = createValueMetric("CpuTimePerUid", cpuTimeMatcher, 2 /* user_time_micros */,
+                                     screenIsOnPredicate.id(), /* states */ {});
+    *valueMetric->mutable_dimensions_in_what() =
+            CreateDimensions(util::CPU_TIME_PER_UID, {1 /* uid */});
+    valueMetric->set_max_pull_delay_sec(INT_MAX);
+    return config;
+}
+
+int64_t getPercentile(vector<int64_t>& values, int percentile) {
+    if (values.empty()) {
+        return 0;
+    }
+    auto it = values.begin() + (values.size() - 1) * percentile / 100;
+    std::nth_element(values.begin(), it, values.end());
+    return *it;
+}
+
+}  // namespace
+
+// Gives the benchmark access to the parsing of the socket messages.
+class SocketMessageReplayer {
+public:
+    static void replay(const SocketMessage& message, const shared_ptr<LogEventQueue>& queue,
+                       const shared_ptr<LogEventFilter>& filter) {
+        StatsSocketListener::processMessage(message.buffer.data(), message.buffer.size(),
+                                            message.uid, message.pid, queue, filter);
+    }
+};
+
+static void BM_EndToEndIngestion(benchmark::State& state) {
+    const vector<SocketMessage>& trace = getTrace();
+    const StatsdConfig config = createIngestionConfig();
+    const ConfigKey cfgKey(0, 12345);
+    // Every message is queued, so the events are popped in the order of the trace.
+    auto logEventFilter = std::make_shared<LogEventFilter>();
+    logEventFilter->setFilteringEnabled(false);
+
+    vector<int64_t> submitTimesNs(trace.size());
+    vector<int64_t> latenciesNs;
+    int64_t totalDumpTimeNs = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        sp<StatsLogProcessor> processor = CreateStatsLogProcessor(
+                1, 1, config, cfgKey, SharedRefBase::make<CpuTimePerUidCallback>(),
+                util::CPU_TIME_PER_UID);
+        auto queue = std::make_shared<LogEventQueue>(trace.size());
+        state.ResumeTiming();
+
+        std::thread consumer([&] {
+            vector<unique_ptr<LogEvent>> events;
+            events.reserve(kMaxLogEventBatchSize);
+            size_t processed = 0;
+            while (processed < trace.size()) {
+                queue->waitPopBatch(kMaxLogEventBatchSize, std::chrono::nanoseconds(0), events);
+                processor->OnLogEventBatch(events);
+                const int64_t processedNs = getElapsedRealtimeNs();
+                for (auto& event : events) {
+                    latenciesNs.push_back(processedNs - submitTimesNs[processed++]);
+                    queue->recycleEvent(std::move(event));
+                }
+            }
+        });
+        for (size_t i = 0; i < trace.size(); i++) {
+            submitTimesNs[i] = getElapsedRealtimeNs();
+            SocketMessageReplayer::replay(trace[i], queue, logEventFilter);
+        }
+        consumer.join();
+
+        const int64_t dumpStartNs = getElapsedRealtimeNs();
+        vector<uint8_t> output;
+        processor->onDumpReport(cfgKey, kTraceStartNs + trace.size() * kEventIntervalNs,
+                                /*include_current_partial_bucket=*/true, /*erase_data=*/true,
+                                ADB_DUMP, FAST, &output);
+        totalDumpTimeNs += getElapsedRealtimeNs() - dumpStartNs;
+        benchmark::DoNotOptimize(output);
+    }
+    state.SetItemsProcessed(state.iterations() * trace.size());
+    state.counters["p50_latency_ns"] = getPercentile(latenciesNs, 50);
+    state.counters["p99_latency_ns"] = getPercentile(latenciesNs, 99);
+    state.counters["dump_ns"] = totalDumpTimeNs / std::max<int64_t>(state.iterations(), 1);
+}
+BENCHMARK(BM_EndToEndIngestion)->Unit(benchmark::kMillisecond);
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
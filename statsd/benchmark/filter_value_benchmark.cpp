@@ -67,6 +67,86 @@ static void BM_FilterValue(benchmark::State& state) {
 
 BENCHMARK(BM_FilterValue);
 
+static void BM_FilterValueFieldIds(benchmark::State& state) {
+    LogEvent event(/*uid=*/0, /*pid=*/0);
+    FieldMatcher field_matcher;
+    createLogEventAndMatcher(&event, &field_matcher);
+
+    std::vector<Matcher> matchers;
+    translateFieldMatcher(field_matcher, &matchers);
+
+    while (state.KeepRunning()) {
+        HashableDimensionKey output;
+        filterValues(matchers, event, &output);
+    }
+}
+
+BENCHMARK(BM_FilterValueFieldIds);
+
+// Event with numFields string fields, sliced by 3 of them.
+static void createWideLogEventAndMatcher(int numFields, LogEvent* event,
+                                         FieldMatcher* field_matcher) {
+    AStatsEvent* statsEvent = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(statsEvent, 1);
+    AStatsEvent_overwriteTimestamp(statsEvent, 100000);
+    for (int i = 0; i < numFields; i++) {
+        AStatsEvent_writeString(statsEvent, "value");
+    }
+    parseStatsEventToLogEvent(statsEvent, event);
+
+    field_matcher->set_field(1);
+    field_matcher->add_child()->set_field(1);
+    field_matcher->add_child()->set_field(numFields / 2);
+    field_matcher->add_child()->set_field(numFields);
+}
+
+static void BM_FilterValueWideEvent(benchmark::State& state) {
+    LogEvent event(/*uid=*/0, /*pid=*/0);
+    FieldMatcher field_matcher;
+    createWideLogEventAndMatcher(state.range(0), &event, &field_matcher);
+
+    std::vector<Matcher> matchers;
+    translateFieldMatcher(field_matcher, &matchers);
+
+    while (state.KeepRunning()) {
+        HashableDimensionKey output;
+        filterValues(matchers, event.getValues(), &output);
+    }
+}
+
+BENCHMARK(BM_FilterValueWideEvent)->Arg(8)->Arg(32)->Arg(100);
+
+static void BM_FilterValueWideEventFieldIds(benchmark::State& state) {
+    LogEvent event(/*uid=*/0, /*pid=*/0);
+    FieldMatcher field_matcher;
+    createWideLogEventAndMatcher(state.range(0), &event, &field_matcher);
+
+    std::vector<Matcher> matchers;
+    translateFieldMatcher(field_matcher, &matchers);
+
+    while (state.KeepRunning()) {
+        HashableDimensionKey output;
+        filterValues(matchers, event, &output);
+    }
+}
+
+BENCHMARK(BM_FilterValueWideEventFieldIds)->Arg(8)->Arg(32)->Arg(100);
+
+static void BM_HashDimensionKeyWithStrings(benchmark::State& state) {
+    HashableDimensionKey key;
+    for (int i = 0; i < state.range(0); i++) {
+        int pos[] = {i + 1, 0, 0};
+        key.addValue(FieldValue(Field(1, pos, 0), Value("com.google.android.package" +
+                                                        std::to_string(i))));
+    }
+
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(std::hash<HashableDimensionKey>()(key));
+    }
+}
+
+BENCHMARK(BM_HashDimensionKeyWithStrings)->Arg(1)->Arg(4)->Arg(16);
+
 }  //  namespace statsd
 }  //  namespace os
 }  //  namespace android
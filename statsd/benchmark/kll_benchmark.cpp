@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <kll.h>
+
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+using dist_proc::aggregation::KllQuantile;
+
+std::vector<int64_t> generateValues(size_t count) {
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<int64_t> dis(0, 1000000);
+    std::vector<int64_t> values(count);
+    for (int64_t& value : values) {
+        value = dis(gen);
+    }
+    return values;
+}
+
+}  // namespace
+
+// Args: number of values added per pull, number of pulls per aggregator
+static void BM_KllQuantileAdd(benchmark::State& state) {
+    const std::vector<int64_t> values = generateValues(state.range(0));
+    for (auto _ : state) {
+        std::unique_ptr<KllQuantile> kll = KllQuantile::Create();
+        for (int64_t pull = 0; pull < state.range(1); pull++) {
+            for (int64_t value : values) {
+                kll->Add(value);
+            }
+        }
+        benchmark::DoNotOptimize(kll->num_stored_values());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(1));
+}
+BENCHMARK(BM_KllQuantileAdd)->Args({100, 100})->Args({1000, 100})->Args({5000, 20});
+
+static void BM_KllQuantileAddBatch(benchmark::State& state) {
+    const std::vector<int64_t> values = generateValues(state.range(0));
+    for (auto _ : state) {
+        std::unique_ptr<KllQuantile> kll = KllQuantile::Create();
+        for (int64_t pull = 0; pull < state.range(1); pull++) {
+            kll->AddBatch(values.data(), values.size());
+        }
+        benchmark::DoNotOptimize(kll->num_stored_values());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(1));
+}
+BENCHMARK(BM_KllQuantileAddBatch)->Args({100, 100})->Args({1000, 100})->Args({5000, 20});
+
+}  //  namespace statsd
+}  //  namespace os
+}  //  namespace android
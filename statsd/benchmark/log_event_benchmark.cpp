@@ -16,7 +16,9 @@
 #include <vector>
 #include "benchmark/benchmark.h"
 #include "logd/LogEvent.h"
+#include "stats_annotations.h"
 #include "stats_event.h"
+#include "stats_log_util.h"
 
 namespace android {
 namespace os {
@@ -206,6 +208,63 @@ static void BM_LogEventCreationExtraLargeWithPrefetchOnly(benchmark::State& stat
 }
 BENCHMARK(BM_LogEventCreationExtraLargeWithPrefetchOnly);
 
+// Per-uid pulled atoms only have primitive fields, with a uid annotation on the first one.
+static size_t createPrimitiveStatsEvent(uint8_t* msg) {
+    AStatsEvent* event = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(event, 100);
+    AStatsEvent_writeInt32(event, 10001);
+    AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_IS_UID, true);
+    for (int i = 0; i < 20; i++) {
+        AStatsEvent_writeInt64(event, 3L);
+        AStatsEvent_writeInt32(event, 2);
+        AStatsEvent_writeBool(event, true);
+    }
+    AStatsEvent_build(event);
+
+    size_t size;
+    uint8_t* buf = AStatsEvent_getBuffer(event, &size);
+    memcpy(msg, buf, size);
+    AStatsEvent_release(event);
+    return size;
+}
+
+static void BM_LogEventCreationPrimitives(benchmark::State& state) {
+    uint8_t msg[LOGGER_ENTRY_MAX_PAYLOAD];
+    const size_t size = createPrimitiveStatsEvent(msg);
+    while (state.KeepRunning()) {
+        LogEvent event(/*uid=*/1000, /*pid=*/1001);
+
+        benchmark::DoNotOptimize(event.parseBuffer(msg, size));
+    }
+}
+BENCHMARK(BM_LogEventCreationPrimitives);
+
+static void BM_LogEventToProtoFromRawBody(benchmark::State& state) {
+    uint8_t msg[LOGGER_ENTRY_MAX_PAYLOAD];
+    const size_t size = createStatsEventLarge(msg);
+    LogEvent event(/*uid=*/1000, /*pid=*/1001);
+    event.parseBuffer(msg, size);
+    while (state.KeepRunning()) {
+        android::util::ProtoOutputStream proto;
+        event.ToProto(proto);
+        benchmark::DoNotOptimize(proto.size());
+    }
+}
+BENCHMARK(BM_LogEventToProtoFromRawBody);
+
+static void BM_LogEventToProtoFromValues(benchmark::State& state) {
+    uint8_t msg[LOGGER_ENTRY_MAX_PAYLOAD];
+    const size_t size = createStatsEventLarge(msg);
+    LogEvent event(/*uid=*/1000, /*pid=*/1001);
+    event.parseBuffer(msg, size);
+    while (state.KeepRunning()) {
+        android::util::ProtoOutputStream proto;
+        writeFieldValueTreeToStream(event.GetTagId(), event.getValues(), &proto);
+        benchmark::DoNotOptimize(proto.size());
+    }
+}
+BENCHMARK(BM_LogEventToProtoFromValues);
+
 }  //  namespace statsd
 }  //  namespace os
 }  //  namespace android
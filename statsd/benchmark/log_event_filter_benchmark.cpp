@@ -72,6 +72,11 @@ const std::unordered_set<int> kAtomIdsUnorderedSet3 = generateAtomIds<std::unord
 const std::set<int> kAtomIdsSet4 = generateAtomIds<std::set<int>>();
 const std::unordered_set<int> kAtomIdsUnorderedSet4 = generateAtomIds<std::unordered_set<int>>();
 
+const AtomIdBitmapSet kAtomIdsBitmapSet = generateAtomIds<AtomIdBitmapSet>();
+const AtomIdBitmapSet kAtomIdsBitmapSet2 = generateAtomIds<AtomIdBitmapSet>();
+const AtomIdBitmapSet kAtomIdsBitmapSet3 = generateAtomIds<AtomIdBitmapSet>();
+const AtomIdBitmapSet kAtomIdsBitmapSet4 = generateAtomIds<AtomIdBitmapSet>();
+
 // Used to perform sample quieries
 const std::vector<int> kSampleIdsList = generateSampleAtomIdsList();
 
@@ -79,7 +84,7 @@ const std::vector<int> kSampleIdsList = generateSampleAtomIdsList();
 
 static void BM_LogEventFilterUnorderedSet(benchmark::State& state) {
     while (state.KeepRunning()) {
-        LogEventFilter eventFilter;
+        LogEventFilterGeneric<std::unordered_set<int>> eventFilter;
         // populate
         eventFilter.setAtomIds(kAtomIdsUnorderedSet, nullptr);
         // many fetches
@@ -92,7 +97,7 @@ BENCHMARK(BM_LogEventFilterUnorderedSet);
 
 static void BM_LogEventFilterUnorderedSet2Consumers(benchmark::State& state) {
     while (state.KeepRunning()) {
-        LogEventFilter eventFilter;
+        LogEventFilterGeneric<std::unordered_set<int>> eventFilter;
         // populate
         eventFilter.setAtomIds(kAtomIdsUnorderedSet, &kAtomIdsUnorderedSet);
         eventFilter.setAtomIds(kAtomIdsUnorderedSet2, &kAtomIdsUnorderedSet2);
@@ -135,6 +140,54 @@ static void BM_LogEventFilterSet2Consumers(benchmark::State& state) {
 }
 BENCHMARK(BM_LogEventFilterSet2Consumers);
 
+static void BM_LogEventFilterAtomIdBitmapSet(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        LogEventFilterGeneric<AtomIdBitmapSet> eventFilter;
+        // populate
+        eventFilter.setAtomIds(kAtomIdsBitmapSet, nullptr);
+        // many fetches
+        for (const auto& atomId : kSampleIdsList) {
+            benchmark::DoNotOptimize(eventFilter.isAtomInUse(atomId));
+        }
+    }
+}
+BENCHMARK(BM_LogEventFilterAtomIdBitmapSet);
+
+static void BM_LogEventFilterAtomIdBitmapSet2Consumers(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        LogEventFilterGeneric<AtomIdBitmapSet> eventFilter;
+        // populate
+        eventFilter.setAtomIds(kAtomIdsBitmapSet, &kAtomIdsBitmapSet);
+        eventFilter.setAtomIds(kAtomIdsBitmapSet2, &kAtomIdsBitmapSet2);
+        eventFilter.setAtomIds(kAtomIdsBitmapSet3, &kAtomIdsBitmapSet);
+        eventFilter.setAtomIds(kAtomIdsBitmapSet4, &kAtomIdsBitmapSet2);
+        // many fetches
+        for (const auto& atomId : kSampleIdsList) {
+            benchmark::DoNotOptimize(eventFilter.isAtomInUse(atomId));
+        }
+    }
+}
+BENCHMARK(BM_LogEventFilterAtomIdBitmapSet2Consumers);
+
+// Vendor atoms are outside of the dense range of AtomIdBitmapSet
+static void BM_LogEventFilterAtomIdBitmapSetVendorAtoms(benchmark::State& state) {
+    constexpr int kVendorAtomIdStart = 100000;
+    AtomIdBitmapSet atomIds;
+    for (const auto& atomId : kAtomIdsBitmapSet) {
+        atomIds.insert(kVendorAtomIdStart + atomId);
+    }
+    while (state.KeepRunning()) {
+        LogEventFilterGeneric<AtomIdBitmapSet> eventFilter;
+        // populate
+        eventFilter.setAtomIds(atomIds, nullptr);
+        // many fetches
+        for (const auto& atomId : kSampleIdsList) {
+            benchmark::DoNotOptimize(eventFilter.isAtomInUse(kVendorAtomIdStart + atomId));
+        }
+    }
+}
+BENCHMARK(BM_LogEventFilterAtomIdBitmapSetVendorAtoms);
+
 }  //  namespace statsd
 }  //  namespace os
 }  //  namespace android
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <thread>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "logd/LockFreeLogEventQueue.h"
+#include "logd/LogEventQueue.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+constexpr int kQueueSize = 50000;
+constexpr int kEventsPerProducer = 10000;
+
+}  // namespace
+
+template <typename Queue>
+static void BM_QueuePushPop(benchmark::State& state) {
+    Queue queue(kQueueSize);
+    std::unique_ptr<LogEvent> event = std::make_unique<LogEvent>(/*uid=*/0, /*pid=*/0);
+    while (state.KeepRunning()) {
+        queue.push(std::move(event));
+        event = queue.waitPop();
+    }
+}
+BENCHMARK_TEMPLATE(BM_QueuePushPop, LogEventQueue);
+BENCHMARK_TEMPLATE(BM_QueuePushPop, LockFreeLogEventQueue);
+
+// Measures time for state.range(0) producer threads to push kEventsPerProducer events each
+// while a single consumer drains the queue, simulating socket listener and binder threads
+// writing into the queue concurrently with the StatsLogProcessor worker.
+template <typename Queue>
+static void BM_QueueProducersConsumer(benchmark::State& state) {
+    const int producersCount = state.range(0);
+    const int totalEvents = producersCount * kEventsPerProducer;
+    while (state.KeepRunning()) {
+        Queue queue(kQueueSize);
+        std::thread consumer([&queue, totalEvents] {
+            for (int i = 0; i < totalEvents; i++) {
+                benchmark::DoNotOptimize(queue.waitPop());
+            }
+        });
+
+        std::vector<std::thread> producers;
+        for (int p = 0; p < producersCount; p++) {
+            producers.emplace_back([&queue] {
+                for (int i = 0; i < kEventsPerProducer; i++) {
+                    queue.push(std::make_unique<LogEvent>(/*uid=*/0, /*pid=*/0));
+                }
+            });
+        }
+
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        consumer.join();
+    }
+    state.SetItemsProcessed(state.iterations() * totalEvents);
+}
+BENCHMARK_TEMPLATE(BM_QueueProducersConsumer, LogEventQueue)->Arg(1)->Arg(2)->Arg(4);
+BENCHMARK_TEMPLATE(BM_QueueProducersConsumer, LockFreeLogEventQueue)->Arg(1)->Arg(2)->Arg(4);
+
+}  //  namespace statsd
+}  //  namespace os
+}  //  namespace android
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "matchers/MatcherProgram.h"
+#include "matchers/matcher_util.h"
+#include "tests/statsd_test_util.h"
+
+using namespace std;
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+// WakelockStateChanged fields
+constexpr int kAttributionField = 1;
+constexpr int kTagField = 3;
+constexpr int kStateField = 4;
+
+vector<SimpleAtomMatcher> createMatchers() {
+    vector<SimpleAtomMatcher> matchers;
+
+    // Single int field
+    matchers.push_back(CreateAcquireWakelockAtomMatcher().simple_atom_matcher());
+
+    // Attribution node with uid & tag, in any position of the chain
+    SimpleAtomMatcher attributionMatcher;
+    attributionMatcher.set_atom_id(util::WAKELOCK_STATE_CHANGED);
+    FieldValueMatcher* fvm = attributionMatcher.add_field_value_matcher();
+    fvm->set_field(kAttributionField);
+    fvm->set_position(Position::ANY);
+    FieldValueMatcher* uidMatcher = fvm->mutable_matches_tuple()->add_field_value_matcher();
+    uidMatcher->set_field(1);
+    uidMatcher->set_eq_int(10003);
+    FieldValueMatcher* tagMatcher = fvm->mutable_matches_tuple()->add_field_value_matcher();
+    tagMatcher->set_field(2);
+    tagMatcher->set_eq_string("tag3");
+    matchers.push_back(attributionMatcher);
+
+    // Several fields with a list of strings
+    SimpleAtomMatcher listMatcher;
+    listMatcher.set_atom_id(util::WAKELOCK_STATE_CHANGED);
+    fvm = listMatcher.add_field_value_matcher();
+    fvm->set_field(kStateField);
+    fvm->set_eq_int(WakelockStateChanged::ACQUIRE);
+    fvm = listMatcher.add_field_value_matcher();
+    fvm->set_field(kTagField);
+    for (int i = 0; i < 8; i++) {
+        fvm->mutable_eq_any_string()->add_str_value("wl" + to_string(i));
+    }
+    matchers.push_back(listMatcher);
+
+    // Package names of the attribution uids
+    SimpleAtomMatcher packageMatcher;
+    packageMatcher.set_atom_id(util::WAKELOCK_STATE_CHANGED);
+    fvm = packageMatcher.add_field_value_matcher();
+    fvm->set_field(kAttributionField);
+    fvm->set_position(Position::ANY);
+    uidMatcher = fvm->mutable_matches_tuple()->add_field_value_matcher();
+    uidMatcher->set_field(1);
+    uidMatcher->set_eq_string("com.app3");
+    matchers.push_back(packageMatcher);
+
+    uidMatcher->set_eq_wildcard_string("*.app3");
+    matchers.push_back(packageMatcher);
+
+    return matchers;
+}
+
+sp<UidMap> createUidMap() {
+    sp<UidMap> uidMap = new UidMap();
+    UidData uidData;
+    for (int i = 0; i < 500; i++) {
+        *uidData.add_app_info() = createApplicationInfo(/*uid*/ 10000 + i, /*version*/ 1, "v1",
+                                                        "com.app" + to_string(i));
+    }
+    uidMap->updateMap(1, uidData);
+    return uidMap;
+}
+
+unique_ptr<LogEvent> createEvent() {
+    const vector<int> attributionUids = {10001, 10002, 10003};
+    const vector<string> attributionTags = {"tag1", "tag2", "tag3"};
+    return CreateAcquireWakelockEvent(1, attributionUids, attributionTags, "wl7");
+}
+
+}  // namespace
+
+static void BM_MatchesSimple(benchmark::State& state) {
+    const sp<UidMap> uidMap = createUidMap();
+    const SimpleAtomMatcher matcher = createMatchers()[state.range(0)];
+    const unique_ptr<LogEvent> event = createEvent();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(matchesSimple(uidMap, matcher, *event).matched);
+    }
+}
+BENCHMARK(BM_MatchesSimple)->DenseRange(0, 4);
+
+static void BM_MatcherProgram(benchmark::State& state) {
+    const sp<UidMap> uidMap = createUidMap();
+    const optional<MatcherProgram> program =
+            MatcherProgram::compile(createMatchers()[state.range(0)]);
+    const unique_ptr<LogEvent> event = createEvent();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(program->matches(uidMap, *event));
+    }
+}
+BENCHMARK(BM_MatcherProgram)->DenseRange(0, 4);
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
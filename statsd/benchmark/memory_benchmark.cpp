@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Memory footprint of the statsd data structures.
+ *
+ * The global operator new and delete of statsd_benchmark are replaced to count the allocations
+ * made on the calling thread while an AllocationScope is alive. The benchmarks report:
+ *   bytes          net bytes allocated in the scope, from malloc_usable_size()
+ *   allocations    number of allocations made in the scope
+ * The bytes freed in the scope are subtracted even if they were allocated before it, and the
+ * allocations of other threads are not counted.
+ */
+
+#include <malloc.h>
+#include <stdlib.h>
+
+#include <new>
+
+#include "benchmark/benchmark.h"
+#include "guardrail/StatsdStats.h"
+#include "packages/UidMap.h"
+#include "stats_log_util.h"
+#include "tests/statsd_test_util.h"
+
+namespace {
+
+thread_local bool gCountAllocations = false;
+thread_local int64_t gAllocatedBytes = 0;
+thread_local int64_t gAllocationCount = 0;
+
+}  // namespace
+
+// The array, nothrow and sized variants call these ones.
+void* operator new(size_t size) {
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        abort();
+    }
+    if (gCountAllocations) {
+        gAllocatedBytes += malloc_usable_size(ptr);
+        gAllocationCount++;
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr != nullptr && gCountAllocations) {
+        gAllocatedBytes -= malloc_usable_size(ptr);
+    }
+    free(ptr);
+}
+
+using namespace std;
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+constexpr int kAtomId = 1000;
+constexpr int64_t kTimeBaseNs = 10 * NS_PER_SEC;
+
+class AllocationScope {
+public:
+    AllocationScope() {
+        gAllocatedBytes = 0;
+        gAllocationCount = 0;
+        gCountAllocations = true;
+    }
+
+    ~AllocationScope() {
+        gCountAllocations = false;
+    }
+
+    int64_t getBytes() const {
+        return gAllocatedBytes;
+    }
+
+    int64_t getAllocations() const {
+        return gAllocationCount;
+    }
+};
+
+void setAllocationCounters(benchmark::State& state, const AllocationScope& scope, int64_t units,
+                           const char* unitName) {
+    state.counters["bytes"] = scope.getBytes();
+    state.counters["allocations"] = scope.getAllocations();
+    state.counters[string("bytes_per_") + unitName] = (double)scope.getBytes() / units;
+}
+
+enum class MetricType { kCount, kDuration, kEvent, kGauge, kValue, kKll };
+
+// Matches the two value atom whose second field is the given value, used as duration start and
+// stop.
+AtomMatcher createStateMatcher(const string& name, int state) {
+    AtomMatcher matcher = CreateSimpleAtomMatcher(name, kAtomId);
+    auto fieldValueMatcher = matcher.mutable_simple_atom_matcher()->add_field_value_matcher();
+    fieldValueMatcher->set_field(2);
+    fieldValueMatcher->set_eq_int(state);
+    return matcher;
+}
+
+// Config with a single metric of the type, sliced by the first field of the two value atom.
+StatsdConfig createMetricConfig(MetricType type) {
+    StatsdConfig config;
+    const AtomMatcher matcher = CreateSimpleAtomMatcher("Atom", kAtomId);
+    *config.add_atom_matcher() = matcher;
+    const FieldMatcher dimensions = CreateDimensions(kAtomId, {1});
+
+    switch (type) {
+        case MetricType::kCount: {
+            CountMetric metric = createCountMetric("Count", matcher.id(), nullopt, {});
+            *metric.mutable_dimensions_in_what() = dimensions;
+            *config.add_count_metric() = metric;
+            break;
+        }
+        case MetricType::kDuration: {
+            const AtomMatcher startMatcher = createStateMatcher("Start", 1);
+            const AtomMatcher stopMatcher = createStateMatcher("Stop", 0);
+            *config.add_atom_matcher() = startMatcher;
+            *config.add_atom_matcher() = stopMatcher;
+            Predicate predicate;
+            predicate.set_id(StringToId("Predicate"));
+            predicate.mutable_simple_predicate()->set_start(startMatcher.id());
+            predicate.mutable_simple_predicate()->set_stop(stopMatcher.id());
+            *predicate.mutable_simple_predicate()->mutable_dimensions() = dimensions;
+            *config.add_predicate() = predicate;
+            DurationMetric metric = createDurationMetric("Duration", predicate.id(), nullopt, {});
+            *metric.mutable_dimensions_in_what() = dimensions;
+            *config.add_duration_metric() = metric;
+            break;
+        }
+        case MetricType::kEvent:
+            *config.add_event_metric() = createEventMetric("Event", matcher.id(), nullopt);
+            break;
+        case MetricType::kGauge: {
+            GaugeMetric metric = createGaugeMetric("Gauge", matcher.id(),
+                                                   GaugeMetric::FIRST_N_SAMPLES, nullopt, nullopt);
+            *metric.mutable_dimensions_in_what() = dimensions;
+            *config.add_gauge_metric() = metric;
+            break;
+        }
+        case MetricType::kValue: {
+            ValueMetric metric = createValueMetric("Value", matcher, 2, nullopt, {});
+            *metric.mutable_dimensions_in_what() = dimensions;
+            *config.add_value_metric() = metric;
+            break;
+        }
+        case MetricType::kKll: {
+            KllMetric metric = createKllMetric("Kll", matcher, 2, nullopt);
+            *metric.mutable_dimensions_in_what() = dimensions;
+            *config.add_kll_metric() = metric;
+            break;
+        }
+    }
+    return config;
+}
+
+// Logs each dimension once per bucket, the duration metric starts and stops each dimension.
+vector<shared_ptr<LogEvent>> createMetricEvents(MetricType type, int dimensions, int buckets) {
+    const int64_t bucketSizeNs = TimeUnitToBucketSizeInMillis(TEN_MINUTES) * 1000000LL;
+    vector<shared_ptr<LogEvent>> events;
+    for (int bucket = 0; bucket < buckets; bucket++) {
+        const int64_t bucketStartNs = kTimeBaseNs + bucket * bucketSizeNs;
+        for (int dimension = 0; dimension < dimensions; dimension++) {
+            const int32_t value = type == MetricType::kDuration ? 1 : dimension;
+            events.push_back(CreateTwoValueLogEvent(kAtomId, bucketStartNs + dimension + 1,
+                                                    dimension, value));
+        }
+        if (type == MetricType::kDuration) {
+            for (int dimension = 0; dimension < dimensions; dimension++) {
+                events.push_back(CreateTwoValueLogEvent(
+                        kAtomId, bucketStartNs + dimensions + dimension + 1, dimension, 0));
+            }
+        }
+    }
+    return events;
+}
+
+// Bytes held by the metric of the type after logging to range(0) dimensions in range(1) buckets,
+// not counting the config which is built beforehand.
+void BM_MetricMemory(benchmark::State& state, MetricType type) {
+    const int dimensions = state.range(0);
+    const int buckets = state.range(1);
+    const StatsdConfig config = createMetricConfig(type);
+    const vector<shared_ptr<LogEvent>> events = createMetricEvents(type, dimensions, buckets);
+    const ConfigKey cfgKey(0, 12345);
+
+    for (auto _ : state) {
+        sp<StatsLogProcessor> processor =
+                CreateStatsLogProcessor(kTimeBaseNs, kTimeBaseNs, config, cfgKey);
+        AllocationScope scope;
+        for (const shared_ptr<LogEvent>& event : events) {
+            processor->OnLogEvent(event.get());
+        }
+        setAllocationCounters(state, scope, (int64_t)dimensions * buckets, "dimension_bucket");
+        benchmark::DoNotOptimize(processor);
+    }
+}
+
+void metricMemoryArgs(benchmark::internal::Benchmark* benchmark) {
+    for (const int dimensions : {10, 100, 1000}) {
+        for (const int buckets : {1, 5}) {
+            benchmark->Args({dimensions, buckets});
+        }
+    }
+    benchmark->Iterations(1);
+}
+
+BENCHMARK_CAPTURE(BM_MetricMemory, Count, MetricType::kCount)->Apply(metricMemoryArgs);
+BENCHMARK_CAPTURE(BM_MetricMemory, Duration, MetricType::kDuration)->Apply(metricMemoryArgs);
+BENCHMARK_CAPTURE(BM_MetricMemory, Event, MetricType::kEvent)->Apply(metricMemoryArgs);
+BENCHMARK_CAPTURE(BM_MetricMemory, Gauge, MetricType::kGauge)->Apply(metricMemoryArgs);
+BENCHMARK_CAPTURE(BM_MetricMemory, Value, MetricType::kValue)->Apply(metricMemoryArgs);
+BENCHMARK_CAPTURE(BM_MetricMemory, Kll, MetricType::kKll)->Apply(metricMemoryArgs);
+
+// Bytes held by the MetricsManager of a config with range(0) sliced count metrics, each on its
+// own atom, before any event is logged.
+void BM_MetricsManagerMemory(benchmark::State& state) {
+    const int metrics = state.range(0);
+    StatsdConfig config;
+    for (int i = 0; i < metrics; i++) {
+        const AtomMatcher matcher = CreateSimpleAtomMatcher("Atom" + to_string(i), kAtomId + i);
+        *config.add_atom_matcher() = matcher;
+        CountMetric metric = createCountMetric("Count" + to_string(i), matcher.id(), nullopt, {});
+        *metric.mutable_dimensions_in_what() = CreateDimensions(kAtomId + i, {1});
+        *config.add_count_metric() = metric;
+    }
+    const ConfigKey cfgKey(0, 12345);
+
+    for (auto _ : state) {
+        AllocationScope scope;
+        sp<StatsLogProcessor> processor =
+                CreateStatsLogProcessor(kTimeBaseNs, kTimeBaseNs, config, cfgKey);
+        setAllocationCounters(state, scope, metrics, "metric");
+        benchmark::DoNotOptimize(processor);
+    }
+}
+BENCHMARK(BM_MetricsManagerMemory)->Arg(10)->Arg(100)->Arg(1000)->Iterations(1);
+
+// Bytes held by a UidMap of range(0) apps.
+void BM_UidMapMemory(benchmark::State& state) {
+    const int apps = state.range(0);
+    UidData uidData;
+    for (int i = 0; i < apps; i++) {
+        *uidData.add_app_info() = createApplicationInfo(/*uid*/ 10000 + i, /*version*/ 1, "v1",
+                                                        "com.android.app" + to_string(i));
+    }
+
+    for (auto _ : state) {
+        AllocationScope scope;
+        sp<UidMap> uidMap = new UidMap();
+        uidMap->updateMap(/*timestamp*/ 1, uidData);
+        setAllocationCounters(state, scope, apps, "app");
+        benchmark::DoNotOptimize(uidMap);
+    }
+}
+BENCHMARK(BM_UidMapMemory)->Arg(100)->Arg(1000)->Arg(5000)->Iterations(1);
+
+// Bytes added to StatsdStats by range(0) configs of 10 metrics each, and as many non platform
+// atoms logged.
+void BM_StatsdStatsMemory(benchmark::State& state) {
+    const int configs = state.range(0);
+    constexpr int kMetricsPerConfig = 10;
+    StatsdStats& stats = StatsdStats::getInstance();
+
+    for (auto _ : state) {
+        stats.reset();
+        AllocationScope scope;
+        for (int i = 0; i < configs; i++) {
+            const ConfigKey key(i, 12345);
+            stats.noteConfigReceived(key, kMetricsPerConfig, /*conditionsCount=*/0,
+                                     /*matchersCount=*/kMetricsPerConfig, /*alertCount=*/0,
+                                     /*annotations=*/{}, /*reason=*/nullopt);
+            for (int metric = 0; metric < kMetricsPerConfig; metric++) {
+                stats.noteMetricDimensionSize(key, metric, /*size=*/10);
+                stats.noteMatcherMatched(key, metric);
+                stats.noteBucketCount(metric);
+            }
+            stats.noteAtomLogged(StatsdStats::kMaxPushedAtomId + 1 + i, /*timeSec=*/1,
+                                 /*isSkipped=*/false);
+        }
+        setAllocationCounters(state, scope, configs, "config");
+        state.PauseTiming();
+        for (int i = 0; i < configs; i++) {
+            stats.noteConfigRemoved(ConfigKey(i, 12345));
+        }
+        stats.reset();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_StatsdStatsMemory)->Arg(10)->Arg(100)->Iterations(1);
+
+}  // namespace
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
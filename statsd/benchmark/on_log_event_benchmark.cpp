@@ -56,6 +56,61 @@ static void BM_OnLogEvent(benchmark::State& state) {
 }
 BENCHMARK(BM_OnLogEvent);
 
+static void BM_OnLogEventWithConditions(benchmark::State& state) {
+    StatsdConfig config;
+    auto wakelockAcquireMatcher = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = wakelockAcquireMatcher;
+    auto screenOnMatcher = CreateScreenTurnedOnAtomMatcher();
+    *config.add_atom_matcher() = screenOnMatcher;
+    auto screenOffMatcher = CreateScreenTurnedOffAtomMatcher();
+    *config.add_atom_matcher() = screenOffMatcher;
+    auto screenOnPredicate = CreateScreenIsOnPredicate();
+    *config.add_predicate() = screenOnPredicate;
+
+    *config.add_count_metric() = createCountMetric("Count", wakelockAcquireMatcher.id(),
+                                                   screenOnPredicate.id(), /* states */ {});
+
+    // Conditions on atoms that are never logged, each with a start and a stop matcher.
+    for (int atomId = 1000; atomId < 1500; atomId++) {
+        auto startMatcher = CreateSimpleAtomMatcher("start" + to_string(atomId), atomId);
+        auto stopMatcher = CreateSimpleAtomMatcher("stop" + to_string(atomId), atomId + 1000);
+        *config.add_atom_matcher() = startMatcher;
+        *config.add_atom_matcher() = stopMatcher;
+
+        Predicate predicate;
+        predicate.set_id(StringToId("predicate" + to_string(atomId)));
+        predicate.mutable_simple_predicate()->set_start(startMatcher.id());
+        predicate.mutable_simple_predicate()->set_stop(stopMatcher.id());
+        *config.add_predicate() = predicate;
+
+        *config.add_count_metric() =
+                createCountMetric("Count" + to_string(atomId), wakelockAcquireMatcher.id(),
+                                  predicate.id(), /* states */ {});
+    }
+
+    ConfigKey cfgKey;
+    std::vector<std::unique_ptr<LogEvent>> events;
+    vector<int> attributionUids = {111};
+    vector<string> attributionTags = {"App1"};
+    for (int i = 1; i <= 10; i++) {
+        events.push_back(CreateAcquireWakelockEvent(2 + i, attributionUids, attributionTags,
+                                                    "wl" + to_string(i)));
+    }
+    events.push_back(CreateScreenStateChangedEvent(
+            20, android::view::DisplayStateEnum::DISPLAY_STATE_ON));
+    events.push_back(CreateScreenStateChangedEvent(
+            30, android::view::DisplayStateEnum::DISPLAY_STATE_OFF));
+
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey);
+
+    for (auto _ : state) {
+        for (const auto& event : events) {
+            processor->OnLogEvent(event.get());
+        }
+    }
+}
+BENCHMARK(BM_OnLogEventWithConditions);
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
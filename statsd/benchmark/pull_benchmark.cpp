@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <aidl/android/util/StatsEventParcel.h>
+
+#include "benchmark/benchmark.h"
+#include "src/external/StatsPullerManager.h"
+#include "tests/statsd_test_util.h"
+
+using aidl::android::util::StatsEventParcel;
+using namespace std;
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+constexpr int kPullAtomId = 10000;
+constexpr int32_t kPullerUid = 1000;
+constexpr int64_t kPullIntervalNs = 60 * NS_PER_SEC;
+
+// Returns the same rows of its atom on every pull, without delay.
+class FakePullAtomCallback : public BnPullAtomCallback {
+public:
+    FakePullAtomCallback(int atomId, int rows) {
+        for (int row = 0; row < rows; row++) {
+            AStatsEvent* event = AStatsEvent_obtain();
+            AStatsEvent_setAtomId(event, atomId);
+            AStatsEvent_writeInt32(event, row);
+            AStatsEvent_writeInt64(event, row * 100);
+            AStatsEvent_build(event);
+            size_t size;
+            uint8_t* buffer = AStatsEvent_getBuffer(event, &size);
+            StatsEventParcel parcel;
+            parcel.buffer.assign(buffer, buffer + size);
+            mParcels.push_back(std::move(parcel));
+            AStatsEvent_release(event);
+        }
+    }
+
+    Status onPullAtom(int atomTag,
+                      const shared_ptr<IPullAtomResultReceiver>& resultReceiver) override {
+        resultReceiver->pullFinished(atomTag, /*success=*/true, mParcels);
+        return Status::ok();
+    }
+
+private:
+    vector<StatsEventParcel> mParcels;
+};
+
+class FakePullUidProvider : public PullUidProvider {
+public:
+    vector<int32_t> getPullAtomUids(int /*atomId*/) override {
+        return {kPullerUid};
+    }
+};
+
+class FakePullDataReceiver : public PullDataReceiver {
+public:
+    void onDataPulled(const vector<shared_ptr<LogEvent>>& data, PullResult /*pullResult*/,
+                      int64_t /*originalPullTimeNs*/) override {
+        mRows += data.size();
+    }
+
+    bool isPullNeeded() const override {
+        return true;
+    }
+
+    int64_t mRows = 0;
+};
+
+}  // namespace
+
+// Fans an alarm out to range(0) pulled atoms of range(1) rows, each delivered to range(2)
+// receivers of different configs.
+static void BM_PullAlarmFanOut(benchmark::State& state) {
+    const int atoms = state.range(0);
+    const int rows = state.range(1);
+    const int configs = state.range(2);
+
+    sp<StatsPullerManager> pullerManager = new StatsPullerManager();
+    sp<FakePullUidProvider> uidProvider = new FakePullUidProvider();
+    vector<sp<FakePullDataReceiver>> receivers;
+    for (int atom = 0; atom < atoms; atom++) {
+        pullerManager->RegisterPullAtomCallback(
+                kPullerUid, kPullAtomId + atom, /*coolDownNs=*/NS_PER_SEC,
+                /*timeoutNs=*/NS_PER_SEC, /*additiveFields=*/{},
+                SharedRefBase::make<FakePullAtomCallback>(kPullAtomId + atom, rows));
+    }
+    for (int config = 0; config < configs; config++) {
+        const ConfigKey configKey(0, config);
+        pullerManager->RegisterPullUidProvider(configKey, uidProvider);
+        for (int atom = 0; atom < atoms; atom++) {
+            receivers.push_back(new FakePullDataReceiver());
+            pullerManager->RegisterReceiver(kPullAtomId + atom, configKey, receivers.back(),
+                                            /*nextPullTimeNs=*/kPullIntervalNs, kPullIntervalNs);
+        }
+    }
+
+    int64_t alarmTimeNs = kPullIntervalNs;
+    for (auto _ : state) {
+        // the pulled data is cached for the cool down, every alarm pulls again
+        pullerManager->ForceClearPullerCache();
+        pullerManager->OnAlarmFired(alarmTimeNs);
+        alarmTimeNs += kPullIntervalNs;
+    }
+
+    int64_t deliveredRows = 0;
+    for (const sp<FakePullDataReceiver>& receiver : receivers) {
+        deliveredRows += receiver->mRows;
+    }
+    state.SetItemsProcessed(deliveredRows);
+}
+BENCHMARK(BM_PullAlarmFanOut)
+        ->Args({1, 10, 1})
+        ->Args({1, 1000, 1})
+        ->Args({10, 100, 1})
+        ->Args({10, 100, 10})
+        ->Args({50, 100, 5});
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
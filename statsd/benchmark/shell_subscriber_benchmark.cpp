@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark/benchmark.h"
+#include "shell/ShellSubscriber.h"
+#include "tests/statsd_test_util.h"
+
+using namespace std;
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+// Pushed matchers of each subscription for atoms which are not logged by the benchmarks.
+constexpr int kNumOtherMatchers = 10;
+constexpr int kOtherAtomIdBase = 100'000;
+
+class NoOpSubscriptionCallback : public BnStatsSubscriptionCallback {
+public:
+    Status onSubscriptionData(StatsSubscriptionCallbackReason reason,
+                              const vector<uint8_t>& subscriptionPayload) override {
+        return Status::ok();
+    }
+};
+
+}  // namespace
+
+// Arguments are the number of subscriptions and how many of them subscribe to the logged atom.
+static void BM_ShellSubscriberOnLogEvent(benchmark::State& state) {
+    const int numSubscriptions = state.range(0);
+    const int numMatchingSubscriptions = state.range(1);
+    ShellSubscriber shellSubscriber(new UidMap(), new StatsPullerManager(),
+                                    std::make_shared<LogEventFilter>());
+
+    vector<shared_ptr<NoOpSubscriptionCallback>> callbacks;
+    for (int i = 0; i < numSubscriptions; i++) {
+        ShellSubscription config;
+        for (int j = 0; j < kNumOtherMatchers; j++) {
+            config.add_pushed()->set_atom_id(kOtherAtomIdBase + i * kNumOtherMatchers + j);
+        }
+        if (i < numMatchingSubscriptions) {
+            config.add_pushed()->set_atom_id(util::SCREEN_STATE_CHANGED);
+        }
+        callbacks.push_back(SharedRefBase::make<NoOpSubscriptionCallback>());
+        shellSubscriber.startNewSubscription(protoToBytes(config), callbacks.back());
+    }
+
+    unique_ptr<LogEvent> event = CreateScreenStateChangedEvent(
+            1000, ::android::view::DisplayStateEnum::DISPLAY_STATE_ON);
+    for (auto _ : state) {
+        shellSubscriber.onLogEvent(*event);
+    }
+
+    for (const auto& callback : callbacks) {
+        shellSubscriber.unsubscribe(callback);
+    }
+}
+BENCHMARK(BM_ShellSubscriberOnLogEvent)
+        ->Args({1, 1})
+        ->Args({20, 0})
+        ->Args({20, 1})
+        ->Args({20, 20});
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
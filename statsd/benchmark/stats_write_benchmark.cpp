@@ -13,7 +13,9 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <stats_event_writer.h>
 #include <statslog_statsdtest.h>
+#include <utils/SystemClock.h>
 
 #include "benchmark/benchmark.h"
 
@@ -52,6 +54,68 @@ static void BM_StatsWriteViaQueue(benchmark::State& state) {
 }
 BENCHMARK(BM_StatsWriteViaQueue);
 
+// Same atom & values as BM_StatsWrite, without the annotations of the generated code, to compare
+// the AStatsEvent builder with the compile time specialized StatsEventWriter
+static void BM_StatsEventBuilderWrite(benchmark::State& state) {
+    int32_t parent_uid = 0;
+    int32_t isolated_uid = 100;
+    int32_t event = 1;
+    while (state.KeepRunning()) {
+        AStatsEvent* statsEvent = AStatsEvent_obtain();
+        AStatsEvent_setAtomId(statsEvent, util::ISOLATED_UID_CHANGED);
+        AStatsEvent_writeInt32(statsEvent, parent_uid);
+        AStatsEvent_writeInt32(statsEvent, isolated_uid);
+        AStatsEvent_writeInt32(statsEvent, event++);
+        benchmark::DoNotOptimize(AStatsEvent_write(statsEvent));
+        AStatsEvent_release(statsEvent);
+    }
+}
+BENCHMARK(BM_StatsEventBuilderWrite);
+
+static void BM_StatsEventWriterWrite(benchmark::State& state) {
+    using IsolatedUidChanged =
+            StatsAtomSchema<StatsAtomId<util::ISOLATED_UID_CHANGED>, StatsInt32Field<>,
+                            StatsInt32Field<>, StatsInt32Field<>>;
+    int32_t parent_uid = 0;
+    int32_t isolated_uid = 100;
+    int32_t event = 1;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(
+                StatsEventWriter<IsolatedUidChanged>::write(parent_uid, isolated_uid, event++));
+    }
+}
+BENCHMARK(BM_StatsEventWriterWrite);
+
+// Encoding cost only, the socket write dominates the benchmarks above
+static void BM_StatsEventBuilderEncode(benchmark::State& state) {
+    int32_t event = 1;
+    while (state.KeepRunning()) {
+        AStatsEvent* statsEvent = AStatsEvent_obtain();
+        AStatsEvent_setAtomId(statsEvent, util::ISOLATED_UID_CHANGED);
+        AStatsEvent_writeInt32(statsEvent, 0);
+        AStatsEvent_writeInt32(statsEvent, 100);
+        AStatsEvent_writeInt32(statsEvent, event++);
+        AStatsEvent_build(statsEvent);
+        benchmark::DoNotOptimize(AStatsEvent_getBuffer(statsEvent, nullptr));
+        AStatsEvent_release(statsEvent);
+    }
+}
+BENCHMARK(BM_StatsEventBuilderEncode);
+
+static void BM_StatsEventWriterEncode(benchmark::State& state) {
+    using IsolatedUidChanged =
+            StatsAtomSchema<StatsAtomId<util::ISOLATED_UID_CHANGED>, StatsInt32Field<>,
+                            StatsInt32Field<>, StatsInt32Field<>>;
+    uint8_t buffer[IsolatedUidChanged::kMaxEncodedSize];
+    int32_t event = 1;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(StatsEventWriter<IsolatedUidChanged>::encode(
+                buffer, elapsedRealtimeNano(), 0, 100, event++));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_StatsEventWriterEncode);
+
 }  //  namespace statsd
 }  //  namespace os
 }  //  namespace android
@@ -20,6 +20,8 @@
 
 #include "benchmark/benchmark.h"
 // #include "re2/re2.h"
+#include "matchers/matcher_util.h"
+#include "tests/statsd_test_util.h"
 #include "utils/Regex.h"
 
 using android::os::statsd::Regex;
@@ -105,3 +107,49 @@ BENCHMARK(BM_RemoveTrailingNumbersCRegex)->RangeMultiplier(2)->RangePair(0, 20,
 //     }
 // }
 // BENCHMARK(BM_RemoveTrailingNumbersRe2)->RangeMultiplier(2)->RangePair(0, 20, 0, 20);
+
+namespace android {
+namespace os {
+namespace statsd {
+
+// Matcher on WakelockStateChanged removing the trailing digits of the wakelock tag.
+static SimpleAtomMatcher createTagReplaceMatcher() {
+    SimpleAtomMatcher matcher;
+    matcher.set_atom_id(util::WAKELOCK_STATE_CHANGED);
+    FieldValueMatcher* fvm = matcher.add_field_value_matcher();
+    fvm->set_field(3);  // tag
+    fvm->mutable_replace_string()->set_regex(R"([0-9]+$)");
+    fvm->mutable_replace_string()->set_replacement("");
+    return matcher;
+}
+
+static unique_ptr<LogEvent> createWakelockEvent(bool hasTrailingDigits) {
+    return CreateAcquireWakelockEvent(1, {1001, 1002}, {"tag1", "tag2"},
+                                      hasTrailingDigits ? "wakelock123" : "wakelock");
+}
+
+// Arg is 1 if the wakelock tag has trailing digits to remove, 0 if the event is not transformed.
+static void BM_MatchesSimpleStringReplace(benchmark::State& state) {
+    const sp<UidMap> uidMap = new UidMap();
+    const SimpleAtomMatcher matcher = createTagReplaceMatcher();
+    const unique_ptr<LogEvent> event = createWakelockEvent(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(matchesSimple(uidMap, matcher, *event));
+    }
+}
+BENCHMARK(BM_MatchesSimpleStringReplace)->Arg(0)->Arg(1);
+
+static void BM_MatchesSimpleStringReplaceRegexCache(benchmark::State& state) {
+    const sp<UidMap> uidMap = new UidMap();
+    const SimpleAtomMatcher matcher = createTagReplaceMatcher();
+    const RegexCache regexCache = compileRegexes(matcher);
+    const unique_ptr<LogEvent> event = createWakelockEvent(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(matchesSimple(uidMap, matcher, *event, &regexCache));
+    }
+}
+BENCHMARK(BM_MatchesSimpleStringReplaceRegexCache)->Arg(0)->Arg(1);
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -170,6 +170,32 @@ Value::Value(const Value& from) {
     }
 }
 
+Value::Value(Value&& from) noexcept {
+    type = from.getType();
+    switch (type) {
+        case INT:
+            int_value = from.int_value;
+            break;
+        case LONG:
+            long_value = from.long_value;
+            break;
+        case FLOAT:
+            float_value = from.float_value;
+            break;
+        case DOUBLE:
+            double_value = from.double_value;
+            break;
+        case STRING:
+            str_value = std::move(from.str_value);
+            break;
+        case STORAGE:
+            storage_value = std::move(from.storage_value);
+            break;
+        default:
+            break;
+    }
+}
+
 std::string Value::toString() const {
     switch (type) {
         case INT:
@@ -181,7 +207,7 @@ std::string Value::toString() const {
         case DOUBLE:
             return std::to_string(double_value) + "[D]";
         case STRING:
-            return str_value + "[S]";
+            return str_value.str() + "[S]";
         case STORAGE:
             return "bytes of size " + std::to_string(storage_value.size()) + "[ST]";
         default:
@@ -200,7 +226,7 @@ bool Value::isZero() const {
         case DOUBLE:
             return fabs(double_value) <= std::numeric_limits<double>::epsilon();
         case STRING:
-            return str_value.size() == 0;
+            return str_value.empty();
         case STORAGE:
             return storage_value.size() == 0;
         default:
@@ -376,6 +402,35 @@ Value& Value::operator=(const Value& that) {
     return *this;
 }
 
+Value& Value::operator=(Value&& that) noexcept {
+    if (this != &that) {
+        type = that.type;
+        switch (type) {
+            case INT:
+                int_value = that.int_value;
+                break;
+            case LONG:
+                long_value = that.long_value;
+                break;
+            case FLOAT:
+                float_value = that.float_value;
+                break;
+            case DOUBLE:
+                double_value = that.double_value;
+                break;
+            case STRING:
+                str_value = std::move(that.str_value);
+                break;
+            case STORAGE:
+                storage_value = std::move(that.storage_value);
+                break;
+            default:
+                break;
+        }
+    }
+    return *this;
+}
+
 Value& Value::operator+=(const Value& that) {
     if (type != that.type) {
         ALOGE("Can't operate on different value types, %d, %d", type, that.type);
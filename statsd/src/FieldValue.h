@@ -15,7 +15,10 @@
  */
 #pragma once
 
+#include <type_traits>
+
 #include "src/statsd_config.pb.h"
+#include "utils/InternedString.h"
 
 namespace android {
 namespace os {
@@ -89,8 +92,7 @@ public:
         mField = getEncodedField(pos, depth, true);
     }
 
-    Field(const Field& from) : mTag(from.getTag()), mField(from.getField()) {
-    }
+    Field(const Field& from) = default;
 
     Field(int32_t tag, int32_t field) : mTag(tag), mField(field){};
 
@@ -312,6 +314,12 @@ struct Value {
         type = STORAGE;
     }
 
+    Value(std::string&& v) : str_value(std::move(v)), type(STRING) {
+    }
+
+    Value(std::vector<uint8_t>&& v) : storage_value(std::move(v)), type(STORAGE) {
+    }
+
     void setInt(int32_t v) {
         int_value = v;
         type = INT;
@@ -338,7 +346,9 @@ struct Value {
         float float_value;
         double double_value;
     };
-    std::string str_value;
+    // Interned so that string values of events and dimension keys share their contents and
+    // compare & hash without reading them.
+    InternedString str_value;
     std::vector<uint8_t> storage_value;
 
     Type type;
@@ -357,6 +367,10 @@ struct Value {
 
     Value(const Value& from);
 
+    // Moves only the member of the current type, so that moving a string or storage value doesn't
+    // allocate. noexcept lets vectors of FieldValue move instead of copy when they grow.
+    Value(Value&& from) noexcept;
+
     bool operator==(const Value& that) const;
     bool operator!=(const Value& that) const;
 
@@ -366,6 +380,7 @@ struct Value {
     Value operator-(const Value& that) const;
     Value& operator+=(const Value& that);
     Value& operator=(const Value& that);
+    Value& operator=(Value&& that) noexcept;
 };
 
 class Annotations {
@@ -427,6 +442,8 @@ struct FieldValue {
     FieldValue() {}
     FieldValue(const Field& field, const Value& value) : mField(field), mValue(value) {
     }
+    FieldValue(const Field& field, Value&& value) : mField(field), mValue(std::move(value)) {
+    }
     bool operator==(const FieldValue& that) const {
         return mField == that.mField && mValue == that.mValue;
     }
@@ -454,6 +471,10 @@ struct FieldValue {
     Annotations mAnnotations;
 };
 
+static_assert(std::is_nothrow_move_constructible<FieldValue>::value &&
+                      std::is_nothrow_move_assignable<FieldValue>::value,
+              "FieldValue vectors must move their elements when reallocating");
+
 bool HasPositionANY(const FieldMatcher& matcher);
 bool HasPositionALL(const FieldMatcher& matcher);
 bool HasPrimitiveRepeatedField(const FieldMatcher& matcher);
@@ -17,7 +17,13 @@
 #include "Log.h"
 
 #include "HashableDimensionKey.h"
+
+#include <algorithm>
+#include <cstring>
+
 #include "FieldValue.h"
+#include "hash.h"
+#include "utils/FieldIdScan.h"
 
 namespace android {
 namespace os {
@@ -70,7 +76,7 @@ static void populateStatsDimensionsValueParcelChildren(StatsDimensionsValueParce
                     break;
                 case STRING:
                     child.valueType = STATS_DIMENSIONS_VALUE_STRING_TYPE;
-                    child.stringValue = dim.mValue.str_value;
+                    child.stringValue = dim.mValue.str_value.str();
                     break;
                 default:
                     ALOGE("Encountered FieldValue with unsupported value type.");
@@ -112,44 +118,100 @@ StatsDimensionsValueParcel HashableDimensionKey::toStatsDimensionsValueParcel()
 }
 
 android::hash_t hashDimension(const HashableDimensionKey& value) {
-    android::hash_t hash = 0;
-    for (const auto& fieldValue : value.getValues()) {
-        hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mField.getField()));
-        hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mField.getTag()));
-        hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mValue.getType()));
-        switch (fieldValue.mValue.getType()) {
-            case INT:
-                hash = android::JenkinsHashMix(hash,
-                                               android::hash_type(fieldValue.mValue.int_value));
-                break;
-            case LONG:
-                hash = android::JenkinsHashMix(hash,
-                                               android::hash_type(fieldValue.mValue.long_value));
-                break;
-            case STRING:
-                hash = android::JenkinsHashMix(hash, static_cast<uint32_t>(std::hash<std::string>()(
-                                                             fieldValue.mValue.str_value)));
-                break;
-            case FLOAT: {
-                hash = android::JenkinsHashMix(hash,
-                                               android::hash_type(fieldValue.mValue.float_value));
-                break;
-            }
-            case DOUBLE: {
-                hash = android::JenkinsHashMix(hash,
-                                               android::hash_type(fieldValue.mValue.double_value));
-                break;
-            }
-            case STORAGE: {
-                hash = android::JenkinsHashMixBytes(hash, fieldValue.mValue.storage_value.data(),
-                                                    fieldValue.mValue.storage_value.size());
-                break;
-            }
-            default:
-                break;
+    return value.getHash();
+}
+
+namespace {
+
+// Mixes a 64-bit word into the hash with the multiply-xorshift steps of the murmur3 finalizer.
+inline uint64_t mixHash(uint64_t hash, uint64_t word) {
+    word *= 0xff51afd7ed558ccdULL;
+    word ^= word >> 33;
+    hash = (hash ^ word) * 0xc4ceb9fe1a85ec53ULL;
+    return hash ^ (hash >> 29);
+}
+
+template <typename T>
+inline uint64_t getBits(T value) {
+    static_assert(sizeof(T) <= sizeof(uint64_t));
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(T));
+    return bits;
+}
+
+// Mixes a value of a dimension, whose field may be masked, into the hash.
+uint64_t mixFieldValue(uint64_t hash, int32_t field, int32_t tag, const Value& value) {
+    // The field, the tag and the type are mixed as one word.
+    const Type type = value.getType();
+    const uint64_t fieldWord =
+            ((uint64_t)(uint32_t)field << 32) | (((uint32_t)tag << 4) ^ (uint32_t)type);
+    hash = mixHash(hash, fieldWord);
+    switch (type) {
+        case INT:
+            return mixHash(hash, (uint32_t)value.int_value);
+        case LONG:
+            return mixHash(hash, (uint64_t)value.long_value);
+        case STRING:
+            // Interned strings cache their hash.
+            return mixHash(hash, value.str_value.hash());
+        case FLOAT:
+            return mixHash(hash, getBits(value.float_value));
+        case DOUBLE:
+            return mixHash(hash, getBits(value.double_value));
+        case STORAGE: {
+            const vector<uint8_t>& storage = value.storage_value;
+            return mixHash(hash,
+                           Hash64(reinterpret_cast<const char*>(storage.data()), storage.size()));
         }
+        default:
+            return hash;
     }
-    return JenkinsHashWhiten(hash);
+}
+
+inline android::hash_t finishHash(uint64_t hash) {
+    return static_cast<android::hash_t>(hash ^ (hash >> 32));
+}
+
+}  // namespace
+
+android::hash_t HashableDimensionKey::computeHash() const {
+    uint64_t hash = 0;
+    for (const auto& fieldValue : mValues) {
+        hash = mixFieldValue(hash, fieldValue.mField.getField(), fieldValue.mField.getTag(),
+                             fieldValue.mValue);
+    }
+    const android::hash_t result = finishHash(hash);
+    // Stored unsigned so that no hash collides with kHashInvalid.
+    mHash.store(static_cast<uint32_t>(result), std::memory_order_relaxed);
+    return result;
+}
+
+size_t MetricDimensionKeyView::getHash() const {
+    uint64_t hash = 0;
+    for (size_t i = 0; i < mNumValues; i++) {
+        const BorrowedValue& borrowed = mValues[i];
+        hash = mixFieldValue(hash, borrowed.field, borrowed.value->mField.getTag(),
+                             borrowed.value->mValue);
+    }
+    // Same as std::hash<MetricDimensionKey>.
+    android::hash_t result = JenkinsHashMix(finishHash(hash), hashDimension(mStateValuesKey));
+    return JenkinsHashWhiten(result);
+}
+
+bool MetricDimensionKeyView::operator==(const MetricDimensionKey& key) const {
+    const vector<FieldValue>& values = key.getDimensionKeyInWhat().getValues();
+    if (values.size() != mNumValues) {
+        return false;
+    }
+    for (size_t i = 0; i < mNumValues; i++) {
+        const BorrowedValue& borrowed = mValues[i];
+        if (values[i].mField.getField() != borrowed.field ||
+            values[i].mField.getTag() != borrowed.value->mField.getTag() ||
+            values[i].mValue != borrowed.value->mValue) {
+            return false;
+        }
+    }
+    return key.getStateValuesKey() == mStateValuesKey;
 }
 
 bool filterValues(const Matcher& matcherField, const vector<FieldValue>& values,
@@ -166,9 +228,133 @@ bool filterValues(const Matcher& matcherField, const vector<FieldValue>& values,
     return false;
 }
 
+namespace {
+
+// Matchers of a filterValues() call scanned together over each block of field ids.
+constexpr size_t kMaxScannedMatchers = 16;
+
+uint64_t matchMatcherFields(const int32_t* fieldIds, size_t count, const Matcher& matcher) {
+    uint64_t matches = matchFieldIds(fieldIds, count, matcher.mMask, matcher.mMatcher.getField());
+    if (matcher.hasAllPositionMatcher()) {
+        matches |= matchFieldIds(fieldIds, count, matcher.mMask & kClearAllPositionMatcherMask,
+                                 matcher.mMatcher.getField());
+    }
+    return matches;
+}
+
+inline bool hasFieldIds(const LogEvent& event) {
+    return event.getFieldIds().size() == event.getValues().size();
+}
+
+}  // namespace
+
+bool filterValues(const Matcher& matcherField, const LogEvent& event, FieldValue* output) {
+    if (!hasFieldIds(event)) {
+        return filterValues(matcherField, event.getValues(), output);
+    }
+    if (matcherField.hasAllPositionMatcher() ||
+        matcherField.mMatcher.getTag() != event.GetTagId()) {
+        return false;
+    }
+    const vector<FieldValue>& values = event.getValues();
+    const int32_t* const fieldIds = event.getFieldIds().data();
+    for (size_t start = 0; start < values.size(); start += kFieldIdScanBlockSize) {
+        const size_t count = std::min(values.size() - start, kFieldIdScanBlockSize);
+        const uint64_t matches = matchMatcherFields(fieldIds + start, count, matcherField);
+        if (matches != 0) {
+            (*output) = values[start + __builtin_ctzll(matches)];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool filterValues(const vector<Matcher>& matcherFields, const LogEvent& event,
+                  HashableDimensionKey* output) {
+    if (!hasFieldIds(event) || matcherFields.size() > kMaxScannedMatchers) {
+        return filterValues(matcherFields, event.getValues(), output);
+    }
+    const vector<FieldValue>& values = event.getValues();
+    const int32_t* const fieldIds = event.getFieldIds().data();
+    size_t num_matches = 0;
+    uint64_t matcherMatches[kMaxScannedMatchers];
+    // Each matcher usually matches one value.
+    output->reserveValues(output->getValues().size() + matcherFields.size());
+    for (size_t start = 0; start < values.size(); start += kFieldIdScanBlockSize) {
+        const size_t count = std::min(values.size() - start, kFieldIdScanBlockSize);
+        uint64_t matches = 0;
+        for (size_t i = 0; i < matcherFields.size(); ++i) {
+            matcherMatches[i] = matcherFields[i].mMatcher.getTag() == event.GetTagId()
+                                        ? matchMatcherFields(fieldIds + start, count,
+                                                             matcherFields[i])
+                                        : 0;
+            matches |= matcherMatches[i];
+        }
+        // Same order as the scalar version: by value, then by matcher.
+        while (matches != 0) {
+            const int index = __builtin_ctzll(matches);
+            matches &= matches - 1;
+            const FieldValue& value = values[start + index];
+            for (size_t i = 0; i < matcherFields.size(); ++i) {
+                if ((matcherMatches[i] >> index) & 1) {
+                    output->addValue(value);
+                    output->mutableValue(num_matches)
+                            ->mField.setField(value.mField.getField() & matcherFields[i].mMask);
+                    num_matches++;
+                }
+            }
+        }
+    }
+    return num_matches > 0;
+}
+
+bool filterValues(const vector<Matcher>& matcherFields, const LogEvent& event,
+                  MetricDimensionKeyView* output) {
+    const vector<FieldValue>& values = event.getValues();
+    if (!hasFieldIds(event) || matcherFields.size() > kMaxScannedMatchers) {
+        for (const FieldValue& value : values) {
+            for (const Matcher& matcher : matcherFields) {
+                if (value.mField.matches(matcher) &&
+                    !output->addValue(value, value.mField.getField() & matcher.mMask)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    const int32_t* const fieldIds = event.getFieldIds().data();
+    uint64_t matcherMatches[kMaxScannedMatchers];
+    for (size_t start = 0; start < values.size(); start += kFieldIdScanBlockSize) {
+        const size_t count = std::min(values.size() - start, kFieldIdScanBlockSize);
+        uint64_t matches = 0;
+        for (size_t i = 0; i < matcherFields.size(); ++i) {
+            matcherMatches[i] = matcherFields[i].mMatcher.getTag() == event.GetTagId()
+                                        ? matchMatcherFields(fieldIds + start, count,
+                                                             matcherFields[i])
+                                        : 0;
+            matches |= matcherMatches[i];
+        }
+        // Same order as the key built by the filterValues() above.
+        while (matches != 0) {
+            const int index = __builtin_ctzll(matches);
+            matches &= matches - 1;
+            const FieldValue& value = values[start + index];
+            for (size_t i = 0; i < matcherFields.size(); ++i) {
+                if (((matcherMatches[i] >> index) & 1) &&
+                    !output->addValue(value, value.mField.getField() & matcherFields[i].mMask)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
 bool filterValues(const vector<Matcher>& matcherFields, const vector<FieldValue>& values,
                   HashableDimensionKey* output) {
     size_t num_matches = 0;
+    // Each matcher usually matches one value.
+    output->reserveValues(output->getValues().size() + matcherFields.size());
     for (const auto& value : values) {
         for (size_t i = 0; i < matcherFields.size(); ++i) {
             const auto& matcher = matcherFields[i];
@@ -238,12 +424,69 @@ void filterGaugeValues(const std::vector<Matcher>& matcherFields,
     }
 }
 
-void getDimensionForCondition(const std::vector<FieldValue>& eventValues,
-                              const Metric2Condition& links,
-                              HashableDimensionKey* conditionDimension) {
-    // Get the dimension first by using dimension from what.
-    filterValues(links.metricFields, eventValues, conditionDimension);
+// Whether the matcher matches at most one value of an event, i.e. it has no position ALL or ANY.
+static bool matchesSingleValue(const Matcher& matcher) {
+    if (matcher.hasAllPositionMatcher()) {
+        return false;
+    }
+    for (int32_t depth = 0; depth <= matcher.getMatcher().getDepth(); depth++) {
+        if (matcher.getRawMaskAtDepth(depth) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Same output as filterValues(), from the recorded value indices of the link if they still match
+// the event. Records them otherwise.
+static void filterLinkValues(const vector<Matcher>& metricFields, const LogEvent& event,
+                             LinkValueIndices& indices, HashableDimensionKey* output) {
+    const vector<FieldValue>& values = event.getValues();
+    if (!indices.matches.empty()) {
+        const bool matched = std::all_of(
+                indices.matches.begin(), indices.matches.end(), [&](const auto& match) {
+                    return match.first < values.size() &&
+                           values[match.first].mField.matches(metricFields[match.second]);
+                });
+        if (!matched) {
+            indices.matches.clear();
+            indices.misses++;
+        }
+    }
+    if (indices.matches.empty()) {
+        if (indices.disabled || indices.misses >= LinkValueIndices::kMaxMisses ||
+            !std::all_of(metricFields.begin(), metricFields.end(), matchesSingleValue)) {
+            indices.disabled = true;
+            filterValues(metricFields, event, output);
+            return;
+        }
+        // Same order as filterValues(): by value, then by metric field.
+        for (size_t i = 0; i < values.size(); i++) {
+            for (size_t j = 0; j < metricFields.size(); j++) {
+                if (values[i].mField.matches(metricFields[j])) {
+                    indices.matches.emplace_back(i, j);
+                }
+            }
+        }
+    }
+
+    output->reserveValues(output->getValues().size() + indices.matches.size());
+    for (size_t i = 0; i < indices.matches.size(); i++) {
+        const auto [valueIndex, fieldIndex] = indices.matches[i];
+        output->addValue(values[valueIndex]);
+        output->mutableValue(i)->mField.setField(values[valueIndex].mField.getField() &
+                                                 metricFields[fieldIndex].mMask);
+    }
+
+    // No field matches several values, so all of them must have matched once.
+    if (indices.matches.size() != metricFields.size()) {
+        indices.matches.clear();
+        indices.misses++;
+    }
+}
 
+static void setConditionFields(const Metric2Condition& links,
+                               HashableDimensionKey* conditionDimension) {
     size_t count = conditionDimension->getValues().size();
     if (count != links.conditionFields.size()) {
         return;
@@ -257,13 +500,23 @@ void getDimensionForCondition(const std::vector<FieldValue>& eventValues,
     }
 }
 
-void getDimensionForState(const std::vector<FieldValue>& eventValues, const Metric2State& link,
-                          HashableDimensionKey* statePrimaryKey) {
-    // First, get the dimension from the event using the "what" fields from the
-    // MetricStateLinks.
-    filterValues(link.metricFields, eventValues, statePrimaryKey);
+void getDimensionForCondition(const std::vector<FieldValue>& eventValues,
+                              const Metric2Condition& links,
+                              HashableDimensionKey* conditionDimension) {
+    // Get the dimension first by using dimension from what.
+    filterValues(links.metricFields, eventValues, conditionDimension);
+    setConditionFields(links, conditionDimension);
+}
+
+void getDimensionForCondition(const LogEvent& event, const Metric2Condition& links,
+                              HashableDimensionKey* conditionDimension) {
+    // Get the dimension first by using dimension from what.
+    filterLinkValues(links.metricFields, event, links.valueIndices, conditionDimension);
+    setConditionFields(links, conditionDimension);
+}
 
-    // Then check that the statePrimaryKey size equals the number of state fields
+static void setStateFields(const Metric2State& link, HashableDimensionKey* statePrimaryKey) {
+    // Check that the statePrimaryKey size equals the number of state fields
     size_t count = statePrimaryKey->getValues().size();
     if (count != link.stateFields.size()) {
         return;
@@ -277,6 +530,20 @@ void getDimensionForState(const std::vector<FieldValue>& eventValues, const Metr
     }
 }
 
+void getDimensionForState(const std::vector<FieldValue>& eventValues, const Metric2State& link,
+                          HashableDimensionKey* statePrimaryKey) {
+    // First, get the dimension from the event using the "what" fields from the
+    // MetricStateLinks.
+    filterValues(link.metricFields, eventValues, statePrimaryKey);
+    setStateFields(link, statePrimaryKey);
+}
+
+void getDimensionForState(const LogEvent& event, const Metric2State& link,
+                          HashableDimensionKey* statePrimaryKey) {
+    filterLinkValues(link.metricFields, event, link.valueIndices, statePrimaryKey);
+    setStateFields(link, statePrimaryKey);
+}
+
 bool containsLinkedStateValues(const HashableDimensionKey& whatKey,
                                const HashableDimensionKey& primaryKey,
                                const vector<Metric2State>& stateLinks, const int32_t stateAtomId) {
@@ -301,6 +568,15 @@ bool containsLinkedStateValues(const HashableDimensionKey& whatKey,
     return true;
 }
 
+bool containsUid(const HashableDimensionKey& key, const int32_t uid) {
+    for (const FieldValue& value : key.getValues()) {
+        if (getUidIfExists(value) == uid) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool linked(const vector<Metric2State>& stateLinks, const int32_t stateAtomId,
             const Field& stateField, const Field& metricField) {
     for (auto stateLink : stateLinks) {
@@ -337,6 +613,13 @@ bool HashableDimensionKey::operator!=(const HashableDimensionKey& that) const {
 }
 
 bool HashableDimensionKey::operator==(const HashableDimensionKey& that) const {
+    // Keys of maps and the keys looked up in them are hashed, keys in the same bucket with
+    // different hashes are told apart without comparing their values.
+    const uint64_t hash = mHash.load(std::memory_order_relaxed);
+    const uint64_t thatHash = that.mHash.load(std::memory_order_relaxed);
+    if (hash != kHashInvalid && thatHash != kHashInvalid && hash != thatHash) {
+        return false;
+    }
     // according to http://go/cppref/cpp/container/vector/operator_cmp
     return mValues == that.mValues;
 };
@@ -399,7 +682,8 @@ bool MetricDimensionKey::operator<(const MetricDimensionKey& that) const {
 }
 
 bool AtomDimensionKey::operator==(const AtomDimensionKey& that) const {
-    return mAtomTag == that.getAtomTag() && mAtomFieldValues == that.getAtomFieldValues();
+    return mAtomTag == that.getAtomTag() && (mAtomFieldValues == that.mAtomFieldValues ||
+                                             *mAtomFieldValues == that.getAtomFieldValues());
 };
 
 }  // namespace statsd
@@ -18,6 +18,11 @@
 
 #include <aidl/android/os/StatsDimensionsValueParcel.h>
 #include <utils/JenkinsHash.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <utility>
 #include <vector>
 #include "android-base/stringprintf.h"
 #include "FieldValue.h"
@@ -38,16 +43,47 @@ inline constexpr int STATS_DIMENSIONS_VALUE_LONG_TYPE = 4;
 inline constexpr int STATS_DIMENSIONS_VALUE_FLOAT_TYPE = 6;
 inline constexpr int STATS_DIMENSIONS_VALUE_TUPLE_TYPE = 7;
 
+/**
+ * Indices of the event values matched by the metric fields of a link, in the order of the
+ * dimension built from them. The events of an atom nearly always have the same layout, so once
+ * recorded, the dimension is built from the indices as long as they still match the event.
+ *
+ * Only recorded when each metric field matches one value, and no field can match several values
+ * (position ALL or ANY). The recording stops after kMaxMisses events that don't match them, as the
+ * layout of the events then changes too often.
+ */
+struct LinkValueIndices {
+    static constexpr int kMaxMisses = 4;
+
+    // Pairs of value index and metric field index. Empty if not recorded.
+    std::vector<std::pair<uint32_t, uint32_t>> matches;
+
+    int misses = 0;
+
+    bool disabled = false;
+};
+
 struct Metric2Condition {
     int64_t conditionId;
     std::vector<Matcher> metricFields;
     std::vector<Matcher> conditionFields;
+
+    // Not part of the link, only used by getDimensionForCondition() for the events.
+    mutable LinkValueIndices valueIndices;
+
+    inline bool operator==(const Metric2Condition& that) const {
+        return conditionId == that.conditionId && metricFields == that.metricFields &&
+               conditionFields == that.conditionFields;
+    }
 };
 
 struct Metric2State {
     int32_t stateAtomId;
     std::vector<Matcher> metricFields;
     std::vector<Matcher> stateFields;
+
+    // Only used by getDimensionForState() for the events.
+    mutable LinkValueIndices valueIndices;
 };
 
 class HashableDimensionKey {
@@ -58,27 +94,74 @@ public:
 
     HashableDimensionKey() {};
 
-    HashableDimensionKey(const HashableDimensionKey& that) : mValues(that.getValues()){};
+    HashableDimensionKey(const HashableDimensionKey& that)
+        : mValues(that.getValues()), mHash(that.mHash.load(std::memory_order_relaxed)){};
+
+    HashableDimensionKey(HashableDimensionKey&& that) noexcept
+        : mValues(std::move(that.mValues)),
+          mHash(that.mHash.exchange(kHashInvalid, std::memory_order_relaxed)){};
+
+    HashableDimensionKey& operator=(const HashableDimensionKey& that) {
+        if (this != &that) {
+            mValues = that.mValues;
+            mHash.store(that.mHash.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    HashableDimensionKey& operator=(HashableDimensionKey&& that) noexcept {
+        if (this != &that) {
+            mValues = std::move(that.mValues);
+            mHash.store(that.mHash.exchange(kHashInvalid, std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    // Reserves room for the values of a key that is being built, so that it is allocated once.
+    inline void reserveValues(size_t numValues) {
+        mValues.reserve(numValues);
+    }
+
+    inline void addValue(FieldValue&& value) {
+        mValues.push_back(std::move(value));
+        invalidateHash();
+    }
 
     inline void addValue(const FieldValue& value) {
         mValues.push_back(value);
+        invalidateHash();
     }
 
     inline const std::vector<FieldValue>& getValues() const {
         return mValues;
     }
 
+    // The cached hash is invalidated, the values must not be modified through the returned
+    // pointer once the key is hashed.
     inline std::vector<FieldValue>* mutableValues() {
+        invalidateHash();
         return &mValues;
     }
 
+    // Same as above.
     inline FieldValue* mutableValue(size_t i) {
         if (i >= 0 && i < mValues.size()) {
+            invalidateHash();
             return &(mValues[i]);
         }
         return nullptr;
     }
 
+    // Hash of the values, computed on the first call after the key is built or modified.
+    inline android::hash_t getHash() const {
+        const uint64_t hash = mHash.load(std::memory_order_relaxed);
+        if (hash != kHashInvalid) {
+            return static_cast<android::hash_t>(hash);
+        }
+        return computeHash();
+    }
+
     StatsDimensionsValueParcel toStatsDimensionsValueParcel() const;
 
     std::string toString() const;
@@ -92,7 +175,19 @@ public:
     bool contains(const HashableDimensionKey& that) const;
 
 private:
+    // Outside of the range of android::hash_t.
+    static constexpr uint64_t kHashInvalid = UINT64_MAX;
+
+    inline void invalidateHash() {
+        mHash.store(kHashInvalid, std::memory_order_relaxed);
+    }
+
+    android::hash_t computeHash() const;
+
     std::vector<FieldValue> mValues;
+
+    // Atomic since keys, such as DEFAULT_DIMENSION_KEY, may be hashed from several threads.
+    mutable std::atomic<uint64_t> mHash{kHashInvalid};
 };
 
 class MetricDimensionKey {
@@ -101,14 +196,23 @@ public:
                                 const HashableDimensionKey& stateValuesKey)
         : mDimensionKeyInWhat(dimensionKeyInWhat), mStateValuesKey(stateValuesKey){};
 
+    explicit MetricDimensionKey(HashableDimensionKey&& dimensionKeyInWhat,
+                                HashableDimensionKey&& stateValuesKey)
+        : mDimensionKeyInWhat(std::move(dimensionKeyInWhat)),
+          mStateValuesKey(std::move(stateValuesKey)){};
+
     MetricDimensionKey(){};
 
     MetricDimensionKey(const MetricDimensionKey& that)
         : mDimensionKeyInWhat(that.getDimensionKeyInWhat()),
           mStateValuesKey(that.getStateValuesKey()){};
 
+    MetricDimensionKey(MetricDimensionKey&& that) noexcept = default;
+
     MetricDimensionKey& operator=(const MetricDimensionKey& from) = default;
 
+    MetricDimensionKey& operator=(MetricDimensionKey&& from) noexcept = default;
+
     std::string toString() const;
 
     inline const HashableDimensionKey& getDimensionKeyInWhat() const {
@@ -140,26 +244,73 @@ private:
     HashableDimensionKey mStateValuesKey;
 };
 
+/**
+ * Key of a dimension of a metric that borrows the values of an event instead of copying them. It
+ * is used to look up the dimensions of the current bucket without building their
+ * MetricDimensionKey, which is then only built for a new dimension. The dimension in what is made
+ * of the event values matched by the dimension fields, with their field masked like filterValues()
+ * does. The view must not outlive the event and the state values key.
+ */
+class MetricDimensionKeyView {
+public:
+    // Number of values in the dimension in what that a view holds at most.
+    static constexpr size_t kMaxValues = 8;
+
+    explicit MetricDimensionKeyView(const HashableDimensionKey& stateValuesKey)
+        : mStateValuesKey(stateValuesKey) {
+    }
+
+    // Adds the event value with its masked field to the dimension in what. Returns false if the
+    // view is full.
+    inline bool addValue(const FieldValue& value, int32_t field) {
+        if (mNumValues == kMaxValues) {
+            return false;
+        }
+        mValues[mNumValues++] = {&value, field};
+        return true;
+    }
+
+    // Same hash as std::hash<MetricDimensionKey> of the key with the same values.
+    size_t getHash() const;
+
+    bool operator==(const MetricDimensionKey& key) const;
+
+private:
+    struct BorrowedValue {
+        const FieldValue* value;
+        int32_t field;
+    };
+
+    std::array<BorrowedValue, kMaxValues> mValues;
+    size_t mNumValues = 0;
+    const HashableDimensionKey& mStateValuesKey;
+};
+
 class AtomDimensionKey {
 public:
-    explicit AtomDimensionKey(int32_t atomTag, const HashableDimensionKey& atomFieldValues)
+    explicit AtomDimensionKey(int32_t atomTag, HashableDimensionKey&& atomFieldValues)
+        : mAtomTag(atomTag),
+          mAtomFieldValues(
+                  std::make_shared<const HashableDimensionKey>(std::move(atomFieldValues))){};
+
+    // The values are shared with the other keys holding them, copying the key doesn't copy them.
+    explicit AtomDimensionKey(int32_t atomTag,
+                              const std::shared_ptr<const HashableDimensionKey>& atomFieldValues)
         : mAtomTag(atomTag), mAtomFieldValues(atomFieldValues){};
 
-    AtomDimensionKey(){};
-
     inline int32_t getAtomTag() const {
         return mAtomTag;
     }
 
     inline const HashableDimensionKey& getAtomFieldValues() const {
-        return mAtomFieldValues;
+        return *mAtomFieldValues;
     }
 
     bool operator==(const AtomDimensionKey& that) const;
 
 private:
     int32_t mAtomTag;
-    HashableDimensionKey mAtomFieldValues;
+    std::shared_ptr<const HashableDimensionKey> mAtomFieldValues;
 };
 
 android::hash_t hashDimension(const HashableDimensionKey& key);
@@ -172,6 +323,11 @@ android::hash_t hashDimension(const HashableDimensionKey& key);
 bool filterValues(const Matcher& matcherField, const std::vector<FieldValue>& values,
                   FieldValue* output);
 
+/**
+ * Same as above, using the field ids of the event to find the matching value.
+ */
+bool filterValues(const Matcher& matcherField, const LogEvent& event, FieldValue* output);
+
 /**
  * Creating HashableDimensionKeys from FieldValues using matcher.
  *
@@ -185,6 +341,19 @@ bool filterValues(const Matcher& matcherField, const std::vector<FieldValue>& va
 bool filterValues(const std::vector<Matcher>& matcherFields, const std::vector<FieldValue>& values,
                   HashableDimensionKey* output);
 
+/**
+ * Same as above, finding the matching values with a vectorized scan of the event field ids.
+ */
+bool filterValues(const std::vector<Matcher>& matcherFields, const LogEvent& event,
+                  HashableDimensionKey* output);
+
+/**
+ * Same as above, borrowing the matched values into the view. Returns false if the view can't hold
+ * all of them.
+ */
+bool filterValues(const std::vector<Matcher>& matcherFields, const LogEvent& event,
+                  MetricDimensionKeyView* output);
+
 /**
  * Filters FieldValues to create HashableDimensionKey using dimensions matcher fields and create
  *  vector of value indices using values matcher fields.
@@ -232,6 +401,10 @@ void getDimensionForCondition(const std::vector<FieldValue>& eventValues,
                               const Metric2Condition& links,
                               HashableDimensionKey* conditionDimension);
 
+// Same as above, building the dimension from the value indices of the link when recorded.
+void getDimensionForCondition(const LogEvent& event, const Metric2Condition& links,
+                              HashableDimensionKey* conditionDimension);
+
 /**
  * Get dimension values using metric's "what" fields and fill statePrimaryKey's
  * mField information using "state" fields.
@@ -239,6 +412,10 @@ void getDimensionForCondition(const std::vector<FieldValue>& eventValues,
 void getDimensionForState(const std::vector<FieldValue>& eventValues, const Metric2State& link,
                           HashableDimensionKey* statePrimaryKey);
 
+// Same as above, building the dimension from the value indices of the link when recorded.
+void getDimensionForState(const LogEvent& event, const Metric2State& link,
+                          HashableDimensionKey* statePrimaryKey);
+
 /**
  * Returns true if the primaryKey values are a subset of the whatKey values.
  * The values from the primaryKey come from the state atom, so we need to
@@ -259,6 +436,11 @@ bool containsLinkedStateValues(const HashableDimensionKey& whatKey,
                                const std::vector<Metric2State>& stateLinks,
                                const int32_t stateAtomId);
 
+/**
+ * Returns true if one of the uid fields of the key, including the attribution uids, is uid.
+ */
+bool containsUid(const HashableDimensionKey& key, const int32_t uid);
+
 /**
  * Returns true if there is a Metric2State link that links the stateField and
  * the metricField (they are equal fields from different atoms).
@@ -283,6 +465,10 @@ struct std::hash<android::os::statsd::MetricDimensionKey> {
         hash = android::JenkinsHashMix(hash, hashDimension(key.getStateValuesKey()));
         return android::JenkinsHashWhiten(hash);
     }
+
+    std::size_t operator()(const android::os::statsd::MetricDimensionKeyView& key) const {
+        return key.getHash();
+    }
 };
 
 template <>
@@ -21,21 +21,30 @@
 
 #include <android-base/file.h>
 #include <cutils/multiuser.h>
+#include <malloc.h>
 #include <src/active_config_list.pb.h>
 #include <src/experiment_ids.pb.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 #include "StatsService.h"
 #include "android-base/stringprintf.h"
 #include "external/StatsPullerManager.h"
 #include "flags/FlagProvider.h"
 #include "guardrail/StatsdStats.h"
 #include "logd/LogEvent.h"
+#include "matchers/EventMatcherCache.h"
 #include "metrics/CountMetricProducer.h"
+#include "packages/AidMapping.h"
 #include "state/StateManager.h"
 #include "stats_log_util.h"
 #include "stats_util.h"
 #include "statslog_statsd.h"
 #include "storage/StorageManager.h"
+#include "utils/InternedString.h"
+#include "utils/StatsdTrace.h"
 
 using namespace android;
 using android::base::StringPrintf;
@@ -63,6 +72,7 @@ const int FIELD_ID_UID = 1;
 const int FIELD_ID_ID = 2;
 const int FIELD_ID_REPORT_NUMBER = 3;
 const int FIELD_ID_STATSD_STATS_ID = 4;
+const int FIELD_ID_NEXT_PAGE_CURSOR = 5;
 // for ConfigMetricsReport
 // const int FIELD_ID_METRICS = 1; // written in MetricsManager.cpp
 const int FIELD_ID_UID_MAP = 2;
@@ -120,6 +130,24 @@ StatsLogProcessor::StatsLogProcessor(
 StatsLogProcessor::~StatsLogProcessor() {
 }
 
+// Processes the event with the metrics manager. If sampleLatency, the time it took is noted to
+// StatsdStats and returned.
+static int64_t processLogEvent(const ConfigKey& key, MetricsManager& metricsManager,
+                               const LogEvent& event, bool sampleLatency) {
+    if (!sampleLatency) {
+        metricsManager.onLogEvent(event);
+        return 0;
+    }
+    const int64_t startNs = getElapsedRealtimeNs();
+    const int64_t startCpuNs = getThreadCpuTimeNs();
+    metricsManager.onSampledLogEvent(event);
+    const int64_t cpuTimeNs = getThreadCpuTimeNs() - startCpuNs;
+    const int64_t processingTimeNs = getElapsedRealtimeNs() - startNs;
+    StatsdStats::getInstance().noteConfigLogEventProcessed(key, processingTimeNs, cpuTimeNs,
+                                                           metricsManager.getMemoryUsage());
+    return processingTimeNs;
+}
+
 static void flushProtoToBuffer(ProtoOutputStream& proto, vector<uint8_t>* outData) {
     outData->clear();
     outData->resize(proto.size());
@@ -150,6 +178,9 @@ void StatsLogProcessor::onPeriodicAlarmFired(
 }
 
 void StatsLogProcessor::mapIsolatedUidToHostUidIfNecessaryLocked(LogEvent* event) const {
+    if (!mUidMap->hasIsolatedUids()) {
+        return;
+    }
     if (std::pair<size_t, size_t> indexRange; event->hasAttributionChain(&indexRange)) {
         vector<FieldValue>* const fieldValues = event->getMutableValues();
         for (size_t i = indexRange.first; i <= indexRange.second; i++) {
@@ -392,8 +423,330 @@ void StatsLogProcessor::OnLogEvent(LogEvent* event) {
 }
 
 void StatsLogProcessor::OnLogEvent(LogEvent* event, int64_t elapsedRealtimeNs) {
+    std::unique_lock<std::mutex> lock(mMetricsMutex);
+    waitForLogEventLocked(lock, event->GetElapsedTimestampNs());
+    AlarmMonitor::Batch anomalyAlarmBatch(mAnomalyAlarmMonitor);
+    ClockSnapshot clock;
+    bool housekeepingDone = false;
+    OnLogEventLocked(event, elapsedRealtimeNs, &clock, &housekeepingDone);
+}
+
+void StatsLogProcessor::OnLogEventBatch(const std::vector<std::unique_ptr<LogEvent>>& events) {
+    OnLogEventBatch(events, getElapsedRealtimeNs());
+}
+
+void StatsLogProcessor::OnLogEventBatch(const std::vector<std::unique_ptr<LogEvent>>& events,
+                                        int64_t elapsedRealtimeNs) {
+    STATSD_TRACE_SCOPE_FMT("StatsLogProcessor::OnLogEventBatch %zu events", events.size());
+    std::unique_lock<std::mutex> lock(mMetricsMutex);
+    int64_t lastEventTimeNs = INT64_MIN;
+    for (const auto& event : events) {
+        lastEventTimeNs = std::max(lastEventTimeNs, event->GetElapsedTimestampNs());
+    }
+    waitForLogEventLocked(lock, lastEventTimeNs);
+    // The anomaly alarms set and cancelled by the events of the batch only cause one update of
+    // the registered alarm.
+    AlarmMonitor::Batch anomalyAlarmBatch(mAnomalyAlarmMonitor);
+    // The events of the batch share the clocks read for their processing.
+    ClockSnapshot clock;
+    bool housekeepingDone = false;
+    if (mShardWorkerPool == nullptr || mMetricsManagers.size() < 2) {
+        for (const auto& event : events) {
+            OnLogEventLocked(event.get(), elapsedRealtimeNs, &clock, &housekeepingDone);
+        }
+        return;
+    }
+
+    // Consecutive events are dispatched to the shards together. Events which affect all the
+    // configs outside of MetricsManager::onLogEvent() end the segment and are processed alone.
+    std::vector<LogEvent*> segment;
+    std::vector<int64_t> segmentSampleStartNs;
+    segment.reserve(events.size());
+    segmentSampleStartNs.reserve(events.size());
+    for (const auto& event : events) {
+        if (requiresSerialProcessingLocked(*event)) {
+            dispatchToShardsLocked(segment, segmentSampleStartNs, elapsedRealtimeNs, &clock);
+            segment.clear();
+            segmentSampleStartNs.clear();
+            OnLogEventLocked(event.get(), elapsedRealtimeNs, &clock, &housekeepingDone);
+            continue;
+        }
+        const int64_t sampleStartNs = startLogEventLatencySampleLocked();
+        if (prepareLogEventLocked(event.get(), elapsedRealtimeNs, &clock, &housekeepingDone)) {
+            segment.push_back(event.get());
+            segmentSampleStartNs.push_back(sampleStartNs);
+        }
+    }
+    dispatchToShardsLocked(segment, segmentSampleStartNs, elapsedRealtimeNs, &clock);
+}
+
+void StatsLogProcessor::setEventProcessingShards(size_t numShards) {
+    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    if (numShards < 2) {
+        mShardWorkerPool = nullptr;
+        return;
+    }
+    mShardWorkerPool = std::make_unique<ShardWorkerPool>(numShards);
+}
+
+void StatsLogProcessor::setProfilingEventCapacity(size_t capacity) {
     std::lock_guard<std::mutex> lock(mMetricsMutex);
+    mProfilingEventCapacity = capacity;
+    while (mProfilingEvents.size() > capacity) {
+        mProfilingEvents.pop_front();
+    }
+}
 
+StatsLogProcessor::ConfigProfile StatsLogProcessor::profileConfig(const ConfigKey& key,
+                                                                  const StatsdConfig& config) {
+    // The events are replayed without holding mMetricsMutex.
+    vector<LogEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(mMetricsMutex);
+        events.assign(mProfilingEvents.begin(), mProfilingEvents.end());
+    }
+    const int64_t startTimeNs =
+            events.empty() ? getElapsedRealtimeNs() : events.front().GetElapsedTimestampNs();
+
+    // The alarms and pulls of the profiled config never reach StatsCompanionService.
+    const sp<AlarmMonitor> alarmMonitor = new AlarmMonitor(
+            /*minDiffToUpdateRegisteredAlarmTimeSec=*/0,
+            [](const std::shared_ptr<IStatsCompanionService>&, int64_t) {},
+            [](const std::shared_ptr<IStatsCompanionService>&) {});
+    const sp<StatsPullerManager> pullerManager = new StatsPullerManager();
+    const sp<MetricsManager> metricsManager =
+            new MetricsManager(key, config, startTimeNs, startTimeNs, mUidMap, pullerManager,
+                               alarmMonitor, alarmMonitor);
+
+    ConfigProfile profile;
+    profile.isConfigValid = metricsManager->isConfigValid();
+    if (profile.isConfigValid) {
+        const int64_t startNs = getElapsedRealtimeNs();
+        const int64_t startCpuNs = getThreadCpuTimeNs();
+        for (const LogEvent& event : events) {
+            if (event.isRestricted() && !metricsManager->hasRestrictedMetricsDelegate()) {
+                continue;
+            }
+            metricsManager->onProfiledLogEvent(event);
+            profile.eventCount++;
+        }
+        profile.cpuTimeNs = getThreadCpuTimeNs() - startCpuNs;
+        profile.processingTimeNs = getElapsedRealtimeNs() - startNs;
+        profile.memoryUsage = metricsManager->getMemoryUsage();
+        profile.metrics = metricsManager->getMetricProfiles();
+    }
+    StatsdStats::getInstance().noteConfigRemoved(key);
+    return profile;
+}
+
+void StatsLogProcessor::setQueryThreads(size_t numThreads) {
+    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    if (numThreads == 0) {
+        mQueryWorkerPool = nullptr;
+        return;
+    }
+    mQueryWorkerPool = std::make_unique<ShardWorkerPool>(numThreads);
+}
+
+void StatsLogProcessor::setOffLockConfigBuilds(bool enabled) {
+    mOffLockConfigBuilds = enabled;
+}
+
+void StatsLogProcessor::setDeferredHousekeeping(bool enabled) {
+    mDeferredHousekeeping = enabled;
+}
+
+void StatsLogProcessor::setSharedConditions(bool enabled) {
+    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    if (!enabled) {
+        mSharedConditionStates = nullptr;
+    } else if (mSharedConditionStates == nullptr) {
+        mSharedConditionStates = new SharedConditionStates();
+    }
+}
+
+void StatsLogProcessor::runDeferredHousekeeping() {
+    runDeferredHousekeeping(getElapsedRealtimeNs());
+}
+
+void StatsLogProcessor::runDeferredHousekeeping(int64_t elapsedRealtimeNs) {
+    if (!mDeferredHousekeeping) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mMetricsMutex);
+    waitForLogEventLocked(lock, elapsedRealtimeNs);
+    if (mMetricsManagers.empty()) {
+        return;
+    }
+    AlarmMonitor::Batch anomalyAlarmBatch(mAnomalyAlarmMonitor);
+    // The next event would otherwise pay for the reset of the configs.
+    resetIfConfigTtlExpiredLocked(elapsedRealtimeNs);
+    runHousekeepingLocked(elapsedRealtimeNs, getWallClockNs());
+}
+
+void StatsLogProcessor::setAsyncDiskWrites(size_t maxPendingWrites) {
+    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    if (maxPendingWrites == 0) {
+        mDiskWriter = nullptr;
+        return;
+    }
+    mDiskWriter = std::make_unique<AsyncFileWriter>(maxPendingWrites);
+}
+
+bool StatsLogProcessor::requiresSerialProcessingLocked(const LogEvent& event) const {
+    // State changes are delivered to the metric producers synchronously by StateManager.
+    if (StateManager::getInstance().getListenersCount(event.GetTagId()) >= 0) {
+        return true;
+    }
+    // Configs reset due to TTL should not see the events preceding the reset afterwards.
+    for (const auto& [_, metricsManager] : mMetricsManagers) {
+        if (!metricsManager->isInTtl(event.GetElapsedTimestampNs())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void StatsLogProcessor::dispatchToShardsLocked(const std::vector<LogEvent*>& events,
+                                               const std::vector<int64_t>& sampleStartNs,
+                                               int64_t elapsedRealtimeNs, ClockSnapshot* clock) {
+    if (events.empty()) {
+        return;
+    }
+
+    // Total time the configs of all the shards spent on each sampled event.
+    std::vector<std::atomic<int64_t>> processingTimesNs(events.size());
+
+    struct ShardedConfig {
+        const ConfigKey* key;
+        MetricsManager* metricsManager;
+        bool isPrevActive;
+    };
+    std::vector<ShardedConfig> configs;
+    configs.reserve(mMetricsManagers.size());
+    for (const auto& [key, metricsManager] : mMetricsManagers) {
+        configs.push_back({&key, metricsManager.get(), metricsManager->isActive()});
+    }
+
+    // Each config is pinned to a shard by its key, so its events are always processed in order.
+    // The configs sharing condition states are pinned by owner, so the states are only updated
+    // on one thread and the configs of a shard share the results within the event's Scope.
+    const size_t numShards = mShardWorkerPool->getNumShards();
+    std::vector<std::vector<ShardedConfig*>> shardConfigs(numShards);
+    for (ShardedConfig& config : configs) {
+        const size_t hash = mSharedConditionStates != nullptr
+                                    ? std::hash<int>()(config.key->GetUid())
+                                    : std::hash<ConfigKey>()(*config.key);
+        shardConfigs[hash % numShards].push_back(&config);
+    }
+    for (size_t shard = 0; shard < numShards; shard++) {
+        if (shardConfigs[shard].empty()) {
+            continue;
+        }
+        mShardWorkerPool->post(shard, [&events, &sampleStartNs, &processingTimesNs,
+                                       &configs = shardConfigs[shard]] {
+            // Event by event, so the configs of the shard share the simple matcher results.
+            for (size_t i = 0; i < events.size(); i++) {
+                const LogEvent& event = *events[i];
+                const bool sampleLatency = sampleStartNs[i] != 0;
+                EventMatcherCache::Scope matcherCacheScope(event);
+                for (const ShardedConfig* config : configs) {
+                    if (event.isRestricted() &&
+                        !config->metricsManager->hasRestrictedMetricsDelegate()) {
+                        continue;
+                    }
+                    const int64_t processingTimeNs = processLogEvent(
+                            *config->key, *config->metricsManager, event, sampleLatency);
+                    if (sampleLatency) {
+                        processingTimesNs[i].fetch_add(processingTimeNs,
+                                                       std::memory_order_relaxed);
+                    }
+                }
+            }
+        });
+    }
+    // Holding mMetricsMutex while waiting keeps dump, config update and report paths
+    // synchronized with all the shards.
+    mShardWorkerPool->waitForIdle();
+
+    for (size_t i = 0; i < events.size(); i++) {
+        if (sampleStartNs[i] != 0) {
+            StatsdStats::getInstance().noteLogEventLatency(
+                    events[i]->GetTagId(), sampleStartNs[i] - events[i]->GetElapsedTimestampNs(),
+                    processingTimesNs[i].load(std::memory_order_relaxed));
+        }
+    }
+
+    std::unordered_set<int> uidsWithActiveConfigsChanged;
+    std::unordered_map<int, std::vector<int64_t>> activeConfigsPerUid;
+    for (const ShardedConfig& config : configs) {
+        const int uid = config.key->GetUid();
+        const bool isCurActive = config.metricsManager->isActive();
+        if (isCurActive) {
+            activeConfigsPerUid[uid].push_back(config.key->GetId());
+        }
+        if (config.isPrevActive != isCurActive) {
+            VLOG("Active status changed for uid  %d", uid);
+            uidsWithActiveConfigsChanged.insert(uid);
+            StatsdStats::getInstance().noteActiveStatusChanged(*config.key, isCurActive);
+        }
+        flushIfNecessaryLocked(*config.key, *config.metricsManager, clock);
+    }
+    sendActivationBroadcastsLocked(uidsWithActiveConfigsChanged, activeConfigsPerUid,
+                                   elapsedRealtimeNs);
+}
+
+void StatsLogProcessor::runHousekeepingLocked(int64_t elapsedRealtimeNs, int64_t wallClockNs) {
+    mLastHousekeepingTimeNs = elapsedRealtimeNs;
+    bool fireAlarm = false;
+    {
+        std::lock_guard<std::mutex> anomalyLock(mAnomalyAlarmMutex);
+        if (mNextAnomalyAlarmTime != 0 &&
+            MillisToNano(mNextAnomalyAlarmTime) <= elapsedRealtimeNs) {
+            mNextAnomalyAlarmTime = 0;
+            VLOG("informing anomaly alarm at time %lld", (long long)elapsedRealtimeNs);
+            fireAlarm = true;
+        }
+    }
+    if (fireAlarm) {
+        informAnomalyAlarmFiredLocked(NanoToMillis(elapsedRealtimeNs));
+    }
+
+    const int64_t curTimeSec = NanoToSeconds(elapsedRealtimeNs);
+    if (curTimeSec - mLastPullerCacheClearTimeSec > StatsdStats::kPullerCacheClearIntervalSec) {
+        mPullerManager->ClearPullerCacheIfNecessary(curTimeSec * NS_PER_SEC);
+        mLastPullerCacheClearTimeSec = curTimeSec;
+    }
+
+    flushRestrictedDataIfNecessaryLocked(elapsedRealtimeNs);
+    enforceDataTtlsIfNecessaryLocked(wallClockNs, elapsedRealtimeNs);
+    enforceDbGuardrailsIfNecessaryLocked(wallClockNs, elapsedRealtimeNs);
+}
+
+void StatsLogProcessor::OnLogEventLocked(LogEvent* event, int64_t elapsedRealtimeNs,
+                                         ClockSnapshot* clock, bool* housekeepingDone) {
+    const int64_t sampleStartNs = startLogEventLatencySampleLocked();
+    if (!prepareLogEventLocked(event, elapsedRealtimeNs, clock, housekeepingDone)) {
+        return;
+    }
+    const int64_t processingTimeNs =
+            dispatchLogEventLocked(*event, elapsedRealtimeNs, clock, sampleStartNs != 0);
+    if (sampleStartNs != 0) {
+        StatsdStats::getInstance().noteLogEventLatency(
+                event->GetTagId(), sampleStartNs - event->GetElapsedTimestampNs(),
+                processingTimeNs);
+    }
+}
+
+int64_t StatsLogProcessor::startLogEventLatencySampleLocked() {
+    if (mNumLogEventsForLatencySampling++ % StatsdStats::kLogEventLatencySampleRate != 0) {
+        return 0;
+    }
+    return getElapsedRealtimeNs();
+}
+
+bool StatsLogProcessor::prepareLogEventLocked(LogEvent* event, int64_t elapsedRealtimeNs,
+                                              ClockSnapshot* clock, bool* housekeepingDone) {
     // Tell StatsdStats about new event
     const int64_t eventElapsedTimeNs = event->GetElapsedTimestampNs();
     const int atomId = event->GetTagId();
@@ -401,7 +754,7 @@ void StatsLogProcessor::OnLogEvent(LogEvent* event, int64_t elapsedRealtimeNs) {
                                               event->isParsedHeaderOnly());
     if (!event->isValid()) {
         StatsdStats::getInstance().noteAtomError(atomId);
-        return;
+        return false;
     }
 
     // Hard-coded logic to update train info on disk and fill in any information
@@ -432,50 +785,44 @@ void StatsLogProcessor::OnLogEvent(LogEvent* event, int64_t elapsedRealtimeNs) {
 
     StateManager::getInstance().onLogEvent(*event);
 
-    if (mMetricsManagers.empty()) {
-        return;
-    }
-
-    bool fireAlarm = false;
-    {
-        std::lock_guard<std::mutex> anomalyLock(mAnomalyAlarmMutex);
-        if (mNextAnomalyAlarmTime != 0 &&
-            MillisToNano(mNextAnomalyAlarmTime) <= elapsedRealtimeNs) {
-            mNextAnomalyAlarmTime = 0;
-            VLOG("informing anomaly alarm at time %lld", (long long)elapsedRealtimeNs);
-            fireAlarm = true;
+    if (mProfilingEventCapacity > 0 && !event->isParsedHeaderOnly()) {
+        if (mProfilingEvents.size() >= mProfilingEventCapacity) {
+            mProfilingEvents.pop_front();
         }
-    }
-    if (fireAlarm) {
-        informAnomalyAlarmFiredLocked(NanoToMillis(elapsedRealtimeNs));
+        mProfilingEvents.push_back(*event);
     }
 
-    const int64_t curTimeSec = NanoToSeconds(elapsedRealtimeNs);
-    if (curTimeSec - mLastPullerCacheClearTimeSec > StatsdStats::kPullerCacheClearIntervalSec) {
-        mPullerManager->ClearPullerCacheIfNecessary(curTimeSec * NS_PER_SEC);
-        mLastPullerCacheClearTimeSec = curTimeSec;
+    if (mMetricsManagers.empty()) {
+        return false;
     }
 
-    flushRestrictedDataIfNecessaryLocked(elapsedRealtimeNs);
-    enforceDataTtlsIfNecessaryLocked(getWallClockNs(), elapsedRealtimeNs);
-    enforceDbGuardrailsIfNecessaryLocked(getWallClockNs(), elapsedRealtimeNs);
-
-    if (!validateAppBreadcrumbEvent(*event)) {
-        return;
+    if (!*housekeepingDone) {
+        if (!mDeferredHousekeeping ||
+            elapsedRealtimeNs - mLastHousekeepingTimeNs >= kMaxHousekeepingDelayNs) {
+            runHousekeepingLocked(elapsedRealtimeNs, clock->getWallClockNs());
+        }
+        *housekeepingDone = true;
     }
 
+    return validateAppBreadcrumbEvent(*event);
+}
+
+int64_t StatsLogProcessor::dispatchLogEventLocked(const LogEvent& event, int64_t elapsedRealtimeNs,
+                                                  ClockSnapshot* clock, bool sampleLatency) {
+    int64_t processingTimeNs = 0;
     std::unordered_set<int> uidsWithActiveConfigsChanged;
     std::unordered_map<int, std::vector<int64_t>> activeConfigsPerUid;
 
     // pass the event to metrics managers.
+    EventMatcherCache::Scope matcherCacheScope(event);
     for (auto& pair : mMetricsManagers) {
-        if (event->isRestricted() && !pair.second->hasRestrictedMetricsDelegate()) {
+        if (event.isRestricted() && !pair.second->hasRestrictedMetricsDelegate()) {
             continue;
         }
         int uid = pair.first.GetUid();
         int64_t configId = pair.first.GetId();
         bool isPrevActive = pair.second->isActive();
-        pair.second->onLogEvent(*event);
+        processingTimeNs += processLogEvent(pair.first, *pair.second, event, sampleLatency);
         bool isCurActive = pair.second->isActive();
         // Map all active configs by uid.
         if (isCurActive) {
@@ -494,9 +841,18 @@ void StatsLogProcessor::OnLogEvent(LogEvent* event, int64_t elapsedRealtimeNs) {
             uidsWithActiveConfigsChanged.insert(uid);
             StatsdStats::getInstance().noteActiveStatusChanged(pair.first, isCurActive);
         }
-        flushIfNecessaryLocked(pair.first, *(pair.second));
+        flushIfNecessaryLocked(pair.first, *(pair.second), clock);
     }
 
+    sendActivationBroadcastsLocked(uidsWithActiveConfigsChanged, activeConfigsPerUid,
+                                   elapsedRealtimeNs);
+    return processingTimeNs;
+}
+
+void StatsLogProcessor::sendActivationBroadcastsLocked(
+        const std::unordered_set<int>& uidsWithActiveConfigsChanged,
+        const std::unordered_map<int, std::vector<int64_t>>& activeConfigsPerUid,
+        int64_t elapsedRealtimeNs) {
     // Don't use the event timestamp for the guardrail.
     for (int uid : uidsWithActiveConfigsChanged) {
         // Send broadcast so that receivers can pull data.
@@ -542,9 +898,38 @@ void StatsLogProcessor::GetActiveConfigsLocked(const int uid, vector<int64_t>& o
 void StatsLogProcessor::OnConfigUpdated(const int64_t timestampNs, const int64_t wallClockNs,
                                         const ConfigKey& key, const StatsdConfig& config,
                                         bool modularUpdate) {
+    std::lock_guard<std::mutex> updateLock(mConfigUpdateMutex);
+    sp<MetricsManager> builtMetricsManager;
+    if (mOffLockConfigBuilds && canBuildConfigOffLock(key, config, modularUpdate)) {
+        STATSD_TRACE_SCOPE("StatsLogProcessor::OnConfigUpdated build");
+        builtMetricsManager =
+                new MetricsManager(key, config, mTimeBaseNs, timestampNs, mUidMap, mPullerManager,
+                                   mAnomalyAlarmMonitor, mPeriodicAlarmMonitor);
+    }
     std::lock_guard<std::mutex> lock(mMetricsMutex);
     WriteDataToDiskLocked(key, timestampNs, wallClockNs, CONFIG_UPDATED, NO_TIME_CONSTRAINTS);
-    OnConfigUpdatedLocked(timestampNs, key, config, modularUpdate);
+    OnConfigUpdatedLocked(timestampNs, key, config, modularUpdate, builtMetricsManager);
+}
+
+bool StatsLogProcessor::canBuildConfigOffLock(const ConfigKey& key, const StatsdConfig& config,
+                                              bool modularUpdate) const {
+    // The metrics sliced by state register to StateManager while they are built.
+    const auto isSlicedByState = [](const auto& metric) {
+        return metric.slice_by_state_size() > 0;
+    };
+    if (std::any_of(config.count_metric().begin(), config.count_metric().end(), isSlicedByState) ||
+        std::any_of(config.duration_metric().begin(), config.duration_metric().end(),
+                    isSlicedByState) ||
+        std::any_of(config.value_metric().begin(), config.value_metric().end(), isSlicedByState) ||
+        std::any_of(config.kll_metric().begin(), config.kll_metric().end(), isSlicedByState) ||
+        std::any_of(config.hll_metric().begin(), config.hll_metric().end(), isSlicedByState)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    if (mSharedConditionStates != nullptr) {
+        return false;
+    }
+    return !modularUpdate || mMetricsManagers.find(key) == mMetricsManagers.end();
 }
 
 void StatsLogProcessor::OnConfigUpdated(const int64_t timestampNs, const ConfigKey& key,
@@ -553,8 +938,13 @@ void StatsLogProcessor::OnConfigUpdated(const int64_t timestampNs, const ConfigK
 }
 
 void StatsLogProcessor::OnConfigUpdatedLocked(const int64_t timestampNs, const ConfigKey& key,
-                                              const StatsdConfig& config, bool modularUpdate) {
+                                              const StatsdConfig& config, bool modularUpdate,
+                                              const sp<MetricsManager>& builtMetricsManager) {
     VLOG("Updated configuration for key %s", key.ToString().c_str());
+    // The metrics of the config may change, so its paged dump can't be continued.
+    mPagedDumps.erase(key);
+    mConfigGeneration++;
+    mConfigGenerations[key]++;
     const auto& it = mMetricsManagers.find(key);
     bool configValid = false;
     if (isAtLeastU() && it != mMetricsManagers.end()) {
@@ -567,14 +957,17 @@ void StatsLogProcessor::OnConfigUpdatedLocked(const int64_t timestampNs, const C
             StatsdStats::getInstance().noteDbDeletionConfigUpdated(key);
             // Always delete the old db if restricted metrics config is not a
             // modular update.
-            dbutils::deleteDb(key);
+            dbutils::runDbWrite([key] { dbutils::deleteDb(key); });
         }
     }
     // Create new config if this is not a modular update or if this is a new config.
-    if (!modularUpdate || it == mMetricsManagers.end()) {
+    if (!modularUpdate || it == mMetricsManagers.end() || builtMetricsManager != nullptr) {
         sp<MetricsManager> newMetricsManager =
-                new MetricsManager(key, config, mTimeBaseNs, timestampNs, mUidMap, mPullerManager,
-                                   mAnomalyAlarmMonitor, mPeriodicAlarmMonitor);
+                builtMetricsManager != nullptr
+                        ? builtMetricsManager
+                        : new MetricsManager(key, config, mTimeBaseNs, timestampNs, mUidMap,
+                                             mPullerManager, mAnomalyAlarmMonitor,
+                                             mPeriodicAlarmMonitor, mSharedConditionStates);
         configValid = newMetricsManager->isConfigValid();
         if (configValid) {
             newMetricsManager->init();
@@ -585,12 +978,14 @@ void StatsLogProcessor::OnConfigUpdatedLocked(const int64_t timestampNs, const C
                 mSendRestrictedMetricsBroadcast(key,
                                                 newMetricsManager->getRestrictedMetricsDelegate(),
                                                 newMetricsManager->getAllMetricIds());
-                string err;
-                if (!dbutils::updateDeviceInfoTable(key, err)) {
-                    ALOGE("Failed to create device_info table for configKey %s, err: %s",
-                          key.ToString().c_str(), err.c_str());
-                    StatsdStats::getInstance().noteDeviceInfoTableCreationFailed(key);
-                }
+                dbutils::runDbWrite([key] {
+                    string err;
+                    if (!dbutils::updateDeviceInfoTable(key, err)) {
+                        ALOGE("Failed to create device_info table for configKey %s, err: %s",
+                              key.ToString().c_str(), err.c_str());
+                        StatsdStats::getInstance().noteDeviceInfoTableCreationFailed(key);
+                    }
+                });
             } else if (it != mMetricsManagers.end() && it->second->hasRestrictedMetricsDelegate()) {
                 mSendRestrictedMetricsBroadcast(key, it->second->getRestrictedMetricsDelegate(),
                                                 {});
@@ -624,7 +1019,7 @@ void StatsLogProcessor::OnConfigUpdatedLocked(const int64_t timestampNs, const C
             it->second->hasRestrictedMetricsDelegate()) {
             mSendRestrictedMetricsBroadcast(key, it->second->getRestrictedMetricsDelegate(), {});
             StatsdStats::getInstance().noteDbConfigInvalid(key);
-            dbutils::deleteDb(key);
+            dbutils::runDbWrite([key] { dbutils::deleteDb(key); });
         }
         mMetricsManagers.erase(key);
         mUidMap->OnConfigRemoved(key);
@@ -651,6 +1046,13 @@ void StatsLogProcessor::dumpStates(int out, bool verbose) const {
     }
 }
 
+static void writeConfigKey(const ConfigKey& key, ProtoOutputStream* proto) {
+    uint64_t configKeyToken = proto->start(FIELD_TYPE_MESSAGE | FIELD_ID_CONFIG_KEY);
+    proto->write(FIELD_TYPE_INT32 | FIELD_ID_UID, key.GetUid());
+    proto->write(FIELD_TYPE_INT64 | FIELD_ID_ID, (long long)key.GetId());
+    proto->end(configKeyToken);
+}
+
 /*
  * onDumpReport dumps serialized ConfigMetricsReportList into proto.
  */
@@ -659,26 +1061,190 @@ void StatsLogProcessor::onDumpReport(const ConfigKey& key, const int64_t dumpTim
                                      const bool include_current_partial_bucket,
                                      const bool erase_data, const DumpReportReason dumpReportReason,
                                      const DumpLatency dumpLatency, ProtoOutputStream* proto) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    std::unique_lock<std::mutex> lock(mMetricsMutex);
+    // The dumps of a config are serialized, so that each one reports the data of all the metrics
+    // since the previous one.
+    waitForYieldingDumpLocked(lock, key);
+    auto it = mMetricsManagers.find(key);
+    // The current partial bucket is flushed by each metric as it is dumped, and the reports saved
+    // to the history are built whole, so these are dumped while holding the lock throughout.
+    if (include_current_partial_bucket || it == mMetricsManagers.end() ||
+        it->second->hasRestrictedMetricsDelegate() || it->second->shouldPersistLocalHistory()) {
+        onDumpReportLocked(key, dumpTimeStampNs, wallClockNs, include_current_partial_bucket,
+                           erase_data, dumpReportReason, dumpLatency, proto);
+        return;
+    }
+    onDumpReportYieldingLocked(key, it->second, dumpTimeStampNs, wallClockNs, erase_data,
+                               dumpReportReason, dumpLatency, lock, proto);
+}
+
+void StatsLogProcessor::onDumpReportYieldingLocked(
+        const ConfigKey& key, const sp<MetricsManager> metricsManager,
+        const int64_t dumpTimeStampNs, const int64_t wallClockNs, const bool erase_data,
+        const DumpReportReason dumpReportReason, const DumpLatency dumpLatency,
+        std::unique_lock<std::mutex>& lock, ProtoOutputStream* proto) {
+    STATSD_TRACE_SCOPE_FMT("StatsLogProcessor::onDumpReport %d_%lld", key.GetUid(),
+                           (long long)key.GetId());
+    const int64_t dumpStartCpuNs = getThreadCpuTimeNs();
+
+    writeConfigKey(key, proto);
+
+    // The reports still queued to be written would be missing from the stats-data directory.
+    if (mDiskWriter != nullptr) {
+        mDiskWriter->waitForIdle();
+    }
+    StorageManager::appendConfigMetricsReport(key, proto, erase_data,
+                                              dumpReportReason == ADB_DUMP /*if caller is adb*/);
+    mLastBroadcastTimes.erase(key);
+
+    const int64_t lastReportTimeNs = metricsManager->getLastReportTimeNs();
+    const int64_t lastReportWallClockNs = metricsManager->getLastReportWallClockNs();
+
+    // Cut the buckets of all the metrics at the dump time before letting any event through, the
+    // events of the current buckets are then left out of the report.
+    metricsManager->flushIfNeeded(dumpTimeStampNs);
+    // The events from the end of the current bucket of a metric on would close it, so they are
+    // held back until the metric is dumped. cutEndsNs[i] is the earliest end of the metrics from
+    // i on.
+    const size_t numMetrics = metricsManager->getNumMetrics();
+    vector<int64_t> cutEndsNs(numMetrics + 1, INT64_MAX);
+    for (size_t i = numMetrics; i > 0; i--) {
+        cutEndsNs[i - 1] = std::min(cutEndsNs[i],
+                                    metricsManager->getDumpCutEndNs(i - 1, dumpTimeStampNs));
+    }
+    const int64_t configGeneration = mConfigGenerations[key];
+
+    ReportStringTable str_set;
+    uint64_t reportToken =
+            proto->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_REPORTS);
+    bool allMetricsDumped = true;
+    for (size_t i = 0; i < numMetrics; i++) {
+        if (i > 0) {
+            // Let the events queued meanwhile be processed between two metrics, so that they are
+            // held back by the dump of one metric at most.
+            mYieldingDumps[key] = cutEndsNs[i];
+            mYieldingDumpCondition.notify_all();
+            lock.unlock();
+            if (mOnDumpYieldForTest) {
+                mOnDumpYieldForTest();
+            }
+            std::this_thread::yield();
+            lock.lock();
+            // A modular update changes the metrics of the same MetricsManager in place, so the
+            // generation of the config is checked as well as the MetricsManager.
+            const auto it = mMetricsManagers.find(key);
+            if (it == mMetricsManagers.end() || it->second != metricsManager ||
+                mConfigGenerations[key] != configGeneration) {
+                // The data of the metrics left is reported with the next dump, or was written to
+                // disk with the removed config.
+                ALOGW("Config %s changed during its dump, %zu of %zu metrics dumped",
+                      key.ToString().c_str(), i, numMetrics);
+                allMetricsDumped = false;
+                break;
+            }
+        }
+        metricsManager->onDumpMetricReport(i, dumpTimeStampNs,
+                                           false /* include_current_partial_bucket */, erase_data,
+                                           dumpLatency, &str_set, proto);
+    }
+    if (allMetricsDumped) {
+        metricsManager->onDumpReportEnd(dumpTimeStampNs, wallClockNs, erase_data, proto);
+    }
+    writeConfigMetricsReportFieldsLocked(key, metricsManager, dumpTimeStampNs, wallClockNs,
+                                         lastReportTimeNs, lastReportWallClockNs, dumpReportReason,
+                                         true /* withUidMap */, &str_set, proto);
+    if (!allMetricsDumped) {
+        proto->write(FIELD_TYPE_INT32 | FIELD_COUNT_REPEATED | FIELD_ID_DATA_CORRUPTED_REASON,
+                     DATA_CORRUPTED_DUMP_INCOMPLETE);
+    }
+    proto->end(reportToken);
+
+    if (erase_data) {
+        ++mDumpReportNumbers[key];
+    }
+    proto->write(FIELD_TYPE_INT32 | FIELD_ID_REPORT_NUMBER, mDumpReportNumbers[key]);
+
+    proto->write(FIELD_TYPE_INT32 | FIELD_ID_STATSD_STATS_ID,
+                 StatsdStats::getInstance().getStatsdStatsId());
+    if (erase_data) {
+        StatsdStats::getInstance().noteMetricsReportSent(key, proto->size(),
+                                                         mDumpReportNumbers[key]);
+    }
+    StatsdStats::getInstance().noteConfigDumpReportCpuTime(key,
+                                                           getThreadCpuTimeNs() - dumpStartCpuNs);
 
+    mYieldingDumps.erase(key);
+    mYieldingDumpCondition.notify_all();
+}
+
+void StatsLogProcessor::waitForYieldingDumpLocked(std::unique_lock<std::mutex>& lock,
+                                                  const ConfigKey& key) {
+    mYieldingDumpCondition.wait(
+            lock, [this, &key] { return mYieldingDumps.find(key) == mYieldingDumps.end(); });
+}
+
+bool StatsLogProcessor::isHeldByDumpCutLocked(const int64_t timestampNs) const {
+    for (const auto& [key, cutEndNs] : mYieldingDumps) {
+        if (timestampNs >= cutEndNs) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void StatsLogProcessor::waitForDumpCutLocked(std::unique_lock<std::mutex>& lock,
+                                             const int64_t timestampNs) {
+    mYieldingDumpCondition.wait(
+            lock, [this, timestampNs] { return !isHeldByDumpCutLocked(timestampNs); });
+}
+
+void StatsLogProcessor::waitForLogEventLocked(std::unique_lock<std::mutex>& lock,
+                                              const int64_t timestampNs) {
+    mYieldingDumpCondition.wait(lock, [this, timestampNs] {
+        if (mYieldingDumps.empty()) {
+            return true;
+        }
+        if (isHeldByDumpCutLocked(timestampNs)) {
+            return false;
+        }
+        // The reset of a config whose TTL expired writes all the configs to disk.
+        for (const auto& [key, metricsManager] : mMetricsManagers) {
+            if (metricsManager != nullptr && !metricsManager->isInTtl(timestampNs)) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+void StatsLogProcessor::onDumpReportLocked(const ConfigKey& key, const int64_t dumpTimeStampNs,
+                                           const int64_t wallClockNs,
+                                           const bool include_current_partial_bucket,
+                                           const bool erase_data,
+                                           const DumpReportReason dumpReportReason,
+                                           const DumpLatency dumpLatency,
+                                           ProtoOutputStream* proto) {
+    STATSD_TRACE_SCOPE_FMT("StatsLogProcessor::onDumpReport %d_%lld", key.GetUid(),
+                           (long long)key.GetId());
     auto it = mMetricsManagers.find(key);
     if (it != mMetricsManagers.end() && it->second->hasRestrictedMetricsDelegate()) {
         VLOG("Unexpected call to StatsLogProcessor::onDumpReport for restricted metrics.");
         return;
     }
+    const int64_t dumpStartCpuNs = getThreadCpuTimeNs();
 
-    // Start of ConfigKey.
-    uint64_t configKeyToken = proto->start(FIELD_TYPE_MESSAGE | FIELD_ID_CONFIG_KEY);
-    proto->write(FIELD_TYPE_INT32 | FIELD_ID_UID, key.GetUid());
-    proto->write(FIELD_TYPE_INT64 | FIELD_ID_ID, (long long)key.GetId());
-    proto->end(configKeyToken);
-    // End of ConfigKey.
+    writeConfigKey(key, proto);
 
     bool keepFile = false;
     if (it != mMetricsManagers.end() && it->second->shouldPersistLocalHistory()) {
         keepFile = true;
     }
 
+    // The reports still queued to be written would be missing from the stats-data directory.
+    if (mDiskWriter != nullptr) {
+        mDiskWriter->waitForIdle();
+    }
+
     // Then, check stats-data directory to see there's any file containing
     // ConfigMetricsReport from previous shutdowns to concatenate to reports.
     StorageManager::appendConfigMetricsReport(
@@ -690,13 +1256,29 @@ void StatsLogProcessor::onDumpReport(const ConfigKey& key, const int64_t dumpTim
         // filling the buffer again soon.
         mLastBroadcastTimes.erase(key);
 
-        vector<uint8_t> buffer;
-        onConfigMetricsReportLocked(key, dumpTimeStampNs, wallClockNs,
-                                    include_current_partial_bucket, erase_data, dumpReportReason,
-                                    dumpLatency, false /* is this data going to be saved on disk */,
-                                    &buffer);
-        proto->write(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_REPORTS,
-                     reinterpret_cast<char*>(buffer.data()), buffer.size());
+        if (erase_data && it->second->shouldPersistLocalHistory()) {
+            // The report is also saved to the history, so it is built on its own first.
+            ProtoOutputStream reportProto;
+            onConfigMetricsReportLocked(key, dumpTimeStampNs, wallClockNs,
+                                        include_current_partial_bucket, erase_data,
+                                        dumpReportReason, dumpLatency, &reportProto);
+            VLOG("save history to disk");
+            string file_name = StorageManager::getDataHistoryFileName((long)getWallClockSec(),
+                                                                      key.GetUid(), key.GetId());
+            StorageManager::writeFile(file_name.c_str(), reportProto);
+            vector<uint8_t> buffer;
+            flushProtoToBuffer(reportProto, &buffer);
+            proto->write(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_REPORTS,
+                         reinterpret_cast<char*>(buffer.data()), buffer.size());
+        } else {
+            // Otherwise it is written in place, without an intermediate copy.
+            uint64_t reportToken =
+                    proto->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_REPORTS);
+            onConfigMetricsReportLocked(key, dumpTimeStampNs, wallClockNs,
+                                        include_current_partial_bucket, erase_data,
+                                        dumpReportReason, dumpLatency, proto);
+            proto->end(reportToken);
+        }
     } else {
         ALOGW("Config source %s does not exist", key.ToString().c_str());
     }
@@ -712,6 +1294,8 @@ void StatsLogProcessor::onDumpReport(const ConfigKey& key, const int64_t dumpTim
         StatsdStats::getInstance().noteMetricsReportSent(key, proto->size(),
                                                          mDumpReportNumbers[key]);
     }
+    StatsdStats::getInstance().noteConfigDumpReportCpuTime(key,
+                                                           getThreadCpuTimeNs() - dumpStartCpuNs);
 }
 
 /*
@@ -744,14 +1328,92 @@ void StatsLogProcessor::onDumpReport(const ConfigKey& key, const int64_t dumpTim
                  dumpReportReason, dumpLatency, outData);
 }
 
+bool StatsLogProcessor::onDumpReportPage(const ConfigKey& key, const int64_t cursor,
+                                         const int64_t dumpTimeNs, const int64_t wallClockNs,
+                                         const DumpReportReason dumpReportReason,
+                                         vector<uint8_t>* outData) {
+    std::unique_lock<std::mutex> lock(mMetricsMutex);
+    waitForYieldingDumpLocked(lock, key);
+    ProtoOutputStream proto;
+    auto it = mMetricsManagers.find(key);
+    if (cursor == 0) {
+        mPagedDumps.erase(key);
+        if (it == mMetricsManagers.end() || it->second->shouldPersistLocalHistory() ||
+            it->second->hasRestrictedMetricsDelegate()) {
+            onDumpReportLocked(key, dumpTimeNs, wallClockNs, false /* include_current_bucket */,
+                               true /* erase_data */, dumpReportReason, FAST, &proto);
+            flushProtoToBuffer(proto, outData);
+            return true;
+        }
+        mPagedDumps.emplace(key, PagedDump{dumpTimeNs, wallClockNs, 0, 0});
+        // All the pages have the same report number.
+        ++mDumpReportNumbers[key];
+    } else {
+        auto pagedDumpIt = mPagedDumps.find(key);
+        if (pagedDumpIt == mPagedDumps.end() ||
+            cursor != (int64_t)pagedDumpIt->second.nextMetricIndex) {
+            ALOGW("Invalid data page cursor %lld for %s", (long long)cursor,
+                  key.ToString().c_str());
+            return false;
+        }
+    }
+    PagedDump& pagedDump = mPagedDumps[key];
+    const sp<MetricsManager>& metricsManager = it->second;
+
+    writeConfigKey(key, &proto);
+    if (cursor == 0) {
+        // The reports still queued to be written would be missing from the stats-data directory.
+        if (mDiskWriter != nullptr) {
+            mDiskWriter->waitForIdle();
+        }
+        StorageManager::appendConfigMetricsReport(key, &proto, true /* erase_data */,
+                                                  dumpReportReason == ADB_DUMP);
+        mLastBroadcastTimes.erase(key);
+    }
+
+    // The report timestamps are updated with the last page.
+    const int64_t lastReportTimeNs = metricsManager->getLastReportTimeNs();
+    const int64_t lastReportWallClockNs = metricsManager->getLastReportWallClockNs();
+    ReportStringTable str_set;
+    uint64_t reportToken =
+            proto.start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_REPORTS);
+    metricsManager->onDumpReportPage(pagedDump.dumpTimeNs, pagedDump.wallClockNs,
+                                     false /* include_current_bucket */, true /* erase_data */,
+                                     FAST, mMaxDataPageBytes, &pagedDump.nextMetricIndex,
+                                     &str_set, &proto);
+    const bool lastPage = pagedDump.nextMetricIndex == metricsManager->getNumMetrics();
+    writeConfigMetricsReportFieldsLocked(key, metricsManager, pagedDump.dumpTimeNs,
+                                         pagedDump.wallClockNs, lastReportTimeNs,
+                                         lastReportWallClockNs, dumpReportReason,
+                                         lastPage /* withUidMap */, &str_set, &proto);
+    proto.end(reportToken);
+
+    if (!lastPage) {
+        proto.write(FIELD_TYPE_INT64 | FIELD_ID_NEXT_PAGE_CURSOR,
+                    (long long)pagedDump.nextMetricIndex);
+    }
+    proto.write(FIELD_TYPE_INT32 | FIELD_ID_REPORT_NUMBER, mDumpReportNumbers[key]);
+    proto.write(FIELD_TYPE_INT32 | FIELD_ID_STATSD_STATS_ID,
+                StatsdStats::getInstance().getStatsdStatsId());
+    flushProtoToBuffer(proto, outData);
+
+    pagedDump.totalBytes += outData->size();
+    if (lastPage) {
+        StatsdStats::getInstance().noteMetricsReportSent(key, pagedDump.totalBytes,
+                                                         mDumpReportNumbers[key]);
+        mPagedDumps.erase(key);
+    }
+    return true;
+}
+
 /*
- * onConfigMetricsReportLocked dumps serialized ConfigMetricsReport into outData.
+ * onConfigMetricsReportLocked writes the fields of ConfigMetricsReport into proto.
  */
 void StatsLogProcessor::onConfigMetricsReportLocked(
         const ConfigKey& key, const int64_t dumpTimeStampNs, const int64_t wallClockNs,
         const bool include_current_partial_bucket, const bool erase_data,
         const DumpReportReason dumpReportReason, const DumpLatency dumpLatency,
-        const bool dataSavedOnDisk, vector<uint8_t>* buffer) {
+        ProtoOutputStream* proto) {
     // We already checked whether key exists in mMetricsManagers in
     // WriteDataToDisk.
     auto it = mMetricsManagers.find(key);
@@ -767,53 +1429,53 @@ void StatsLogProcessor::onConfigMetricsReportLocked(
     int64_t lastReportTimeNs = it->second->getLastReportTimeNs();
     int64_t lastReportWallClockNs = it->second->getLastReportWallClockNs();
 
-    std::set<string> str_set;
+    ReportStringTable str_set;
 
-    ProtoOutputStream tempProto;
     // First, fill in ConfigMetricsReport using current data on memory, which
     // starts from filling in StatsLogReport's.
     it->second->onDumpReport(dumpTimeStampNs, wallClockNs, include_current_partial_bucket,
-                             erase_data, dumpLatency, &str_set, &tempProto);
+                             erase_data, dumpLatency, &str_set, proto);
+
+    writeConfigMetricsReportFieldsLocked(key, it->second, dumpTimeStampNs, wallClockNs,
+                                         lastReportTimeNs, lastReportWallClockNs, dumpReportReason,
+                                         true /* withUidMap */, &str_set, proto);
+}
 
+void StatsLogProcessor::writeConfigMetricsReportFieldsLocked(
+        const ConfigKey& key, const sp<MetricsManager>& metricsManager,
+        const int64_t dumpTimeStampNs, const int64_t wallClockNs, const int64_t lastReportTimeNs,
+        const int64_t lastReportWallClockNs, const DumpReportReason dumpReportReason,
+        bool withUidMap, ReportStringTable* str_set, ProtoOutputStream* proto) {
     // Fill in UidMap if there is at least one metric to report.
     // This skips the uid map if it's an empty config.
-    if (it->second->getNumMetrics() > 0) {
-        uint64_t uidMapToken = tempProto.start(FIELD_TYPE_MESSAGE | FIELD_ID_UID_MAP);
-        mUidMap->appendUidMap(dumpTimeStampNs, key, it->second->versionStringsInReport(),
-                              it->second->installerInReport(),
-                              it->second->packageCertificateHashSizeBytes(),
-                              it->second->hashStringInReport() ? &str_set : nullptr, &tempProto);
-        tempProto.end(uidMapToken);
+    if (withUidMap && metricsManager->getNumMetrics() > 0) {
+        std::set<string> uidMapStrings;
+        uint64_t uidMapToken = proto->start(FIELD_TYPE_MESSAGE | FIELD_ID_UID_MAP);
+        mUidMap->appendUidMap(dumpTimeStampNs, key, metricsManager->versionStringsInReport(),
+                              metricsManager->installerInReport(),
+                              metricsManager->packageCertificateHashSizeBytes(),
+                              metricsManager->hashStringInReport() ? &uidMapStrings : nullptr,
+                              proto, metricsManager->uidMapFullSnapshotPeriod());
+        proto->end(uidMapToken);
+        str_set->add(uidMapStrings);
     }
 
     // Fill in the timestamps.
-    tempProto.write(FIELD_TYPE_INT64 | FIELD_ID_LAST_REPORT_ELAPSED_NANOS,
-                    (long long)lastReportTimeNs);
-    tempProto.write(FIELD_TYPE_INT64 | FIELD_ID_CURRENT_REPORT_ELAPSED_NANOS,
-                    (long long)dumpTimeStampNs);
-    tempProto.write(FIELD_TYPE_INT64 | FIELD_ID_LAST_REPORT_WALL_CLOCK_NANOS,
-                    (long long)lastReportWallClockNs);
-    tempProto.write(FIELD_TYPE_INT64 | FIELD_ID_CURRENT_REPORT_WALL_CLOCK_NANOS,
-                    (long long)wallClockNs);
+    proto->write(FIELD_TYPE_INT64 | FIELD_ID_LAST_REPORT_ELAPSED_NANOS,
+                 (long long)lastReportTimeNs);
+    proto->write(FIELD_TYPE_INT64 | FIELD_ID_CURRENT_REPORT_ELAPSED_NANOS,
+                 (long long)dumpTimeStampNs);
+    proto->write(FIELD_TYPE_INT64 | FIELD_ID_LAST_REPORT_WALL_CLOCK_NANOS,
+                 (long long)lastReportWallClockNs);
+    proto->write(FIELD_TYPE_INT64 | FIELD_ID_CURRENT_REPORT_WALL_CLOCK_NANOS,
+                 (long long)wallClockNs);
     // Dump report reason
-    tempProto.write(FIELD_TYPE_INT32 | FIELD_ID_DUMP_REPORT_REASON, dumpReportReason);
+    proto->write(FIELD_TYPE_INT32 | FIELD_ID_DUMP_REPORT_REASON, dumpReportReason);
 
-    for (const auto& str : str_set) {
-        tempProto.write(FIELD_TYPE_STRING | FIELD_COUNT_REPEATED | FIELD_ID_STRINGS, str);
-    }
+    str_set->writeToProto(FIELD_ID_STRINGS, proto);
 
     // Data corrupted reason
-    writeDataCorruptedReasons(tempProto);
-
-    flushProtoToBuffer(tempProto, buffer);
-
-    // save buffer to disk if needed
-    if (erase_data && !dataSavedOnDisk && it->second->shouldPersistLocalHistory()) {
-        VLOG("save history to disk");
-        string file_name = StorageManager::getDataHistoryFileName((long)getWallClockSec(),
-                                                                  key.GetUid(), key.GetId());
-        StorageManager::writeFile(file_name.c_str(), buffer->data(), buffer->size());
-    }
+    writeDataCorruptedReasons(*proto);
 }
 
 void StatsLogProcessor::resetConfigsLocked(const int64_t timestampNs,
@@ -842,21 +1504,42 @@ void StatsLogProcessor::resetIfConfigTtlExpiredLocked(const int64_t eventTimeNs)
         }
     }
     if (configKeysTtlExpired.size() > 0) {
-        WriteDataToDiskLocked(CONFIG_RESET, NO_TIME_CONSTRAINTS, getElapsedRealtimeNs(),
-                              getWallClockNs());
-        resetConfigsLocked(eventTimeNs, configKeysTtlExpired);
+        // The reports are cut at the time the metrics are reset, so that the buckets restarted
+        // take over from the ones written and the event triggering the reset falls in them.
+        WriteDataToDiskLocked(CONFIG_RESET, NO_TIME_CONSTRAINTS, eventTimeNs, getWallClockNs());
+        // The config is unchanged, so its metrics are reset in place instead of being built
+        // again from the config on disk. Restricted metrics write to their db, so their configs
+        // are still rebuilt.
+        std::vector<ConfigKey> configKeysToRebuild;
+        for (const ConfigKey& key : configKeysTtlExpired) {
+            const sp<MetricsManager>& metricsManager = mMetricsManagers[key];
+            if (metricsManager->hasRestrictedMetricsDelegate()) {
+                configKeysToRebuild.push_back(key);
+                continue;
+            }
+            mPagedDumps.erase(key);
+            mConfigGeneration++;
+            mConfigGenerations[key]++;
+            metricsManager->resetOnTtlExpired(eventTimeNs);
+            StatsdStats::getInstance().noteConfigReset(key);
+        }
+        if (!configKeysToRebuild.empty()) {
+            resetConfigsLocked(eventTimeNs, configKeysToRebuild);
+        }
     }
 }
 
 void StatsLogProcessor::OnConfigRemoved(const ConfigKey& key) {
+    std::lock_guard<std::mutex> updateLock(mConfigUpdateMutex);
     std::lock_guard<std::mutex> lock(mMetricsMutex);
     auto it = mMetricsManagers.find(key);
     if (it != mMetricsManagers.end()) {
+        mConfigGeneration++;
         WriteDataToDiskLocked(key, getElapsedRealtimeNs(), getWallClockNs(), CONFIG_REMOVED,
                               NO_TIME_CONSTRAINTS);
         if (isAtLeastU() && it->second->hasRestrictedMetricsDelegate()) {
             StatsdStats::getInstance().noteDbDeletionConfigRemoved(key);
-            dbutils::deleteDb(key);
+            dbutils::runDbWrite([key] { dbutils::deleteDb(key); });
             mSendRestrictedMetricsBroadcast(key, it->second->getRestrictedMetricsDelegate(), {});
         }
         mMetricsManagers.erase(it);
@@ -865,8 +1548,9 @@ void StatsLogProcessor::OnConfigRemoved(const ConfigKey& key) {
     StatsdStats::getInstance().noteConfigRemoved(key);
 
     mLastBroadcastTimes.erase(key);
-    mLastByteSizeTimes.erase(key);
     mDumpReportNumbers.erase(key);
+    mPagedDumps.erase(key);
+    mConfigGenerations.erase(key);
 
     int uid = key.GetUid();
     bool lastConfigForUid = true;
@@ -940,9 +1624,9 @@ void StatsLogProcessor::querySql(const string& sqlQuery, const int32_t minSqlCli
     }
 
     set<int32_t> configPackageUids;
-    const auto& uidMapItr = UidMap::sAidToUidMapping.find(configPackage);
-    if (uidMapItr != UidMap::sAidToUidMapping.end()) {
-        configPackageUids.insert(uidMapItr->second);
+    const optional<int32_t> aidUid = AidMapping::getUid(configPackage);
+    if (aidUid) {
+        configPackageUids.insert(*aidUid);
     } else {
         configPackageUids = mUidMap->getAppUid(configPackage);
     }
@@ -971,41 +1655,50 @@ void StatsLogProcessor::querySql(const string& sqlQuery, const int32_t minSqlCli
     flushRestrictedDataLocked(elapsedRealtimeNs);
     enforceDataTtlsLocked(getWallClockNs(), elapsedRealtimeNs);
 
-    std::vector<std::vector<std::string>> rows;
+    const ConfigKey key = *(keysToQuery.begin());
+    if (mQueryWorkerPool == nullptr) {
+        runQuery(key, sqlQuery, callback, configId, configPackage, callingUid, elapsedRealtimeNs);
+        return;
+    }
+    mQueryWorkerPool->post(std::hash<ConfigKey>()(key) % mQueryWorkerPool->getNumShards(),
+                           [key, sqlQuery, callback, configId, configPackage, callingUid,
+                            elapsedRealtimeNs] {
+                               runQuery(key, sqlQuery, callback, configId, configPackage,
+                                        callingUid, elapsedRealtimeNs);
+                           });
+}
+
+void StatsLogProcessor::runQuery(const ConfigKey& key, const string& sqlQuery,
+                                 const shared_ptr<IStatsQueryCallback>& callback,
+                                 const int64_t configId, const string& configPackage,
+                                 const int32_t callingUid, const int64_t queryStartNs) {
+    // The query must see the data flushed before.
+    dbutils::waitForDbWrites();
+
+    string err;
+    vector<string> queryData;
+    int32_t rowCount;
     std::vector<int32_t> columnTypes;
     std::vector<string> columnNames;
-    if (!dbutils::query(*(keysToQuery.begin()), sqlQuery, rows, columnTypes, columnNames, err)) {
+    if (!dbutils::query(key, sqlQuery, queryData, rowCount, columnTypes, columnNames, err)) {
         callback->sendFailure(StringPrintf("failed to query db %s:", err.c_str()));
         StatsdStats::getInstance().noteQueryRestrictedMetricFailed(
-                configId, configPackage, keysToQuery.begin()->GetUid(), callingUid,
+                configId, configPackage, key.GetUid(), callingUid,
                 InvalidQueryReason(QUERY_FAILURE), err.c_str());
         return;
     }
-
-    vector<string> queryData;
-    queryData.reserve(rows.size() * columnNames.size());
-    // TODO(b/268415904): avoid this vector transformation.
-    if (columnNames.size() != columnTypes.size()) {
+    if (columnNames.size() != columnTypes.size() ||
+        queryData.size() != rowCount * columnNames.size()) {
         callback->sendFailure("Inconsistent row sizes");
         StatsdStats::getInstance().noteQueryRestrictedMetricFailed(
-                configId, configPackage, keysToQuery.begin()->GetUid(), callingUid,
+                configId, configPackage, key.GetUid(), callingUid,
                 InvalidQueryReason(INCONSISTENT_ROW_SIZE));
+        return;
     }
-    for (size_t i = 0; i < rows.size(); ++i) {
-        if (rows[i].size() != columnNames.size()) {
-            callback->sendFailure("Inconsistent row sizes");
-            StatsdStats::getInstance().noteQueryRestrictedMetricFailed(
-                    configId, configPackage, keysToQuery.begin()->GetUid(), callingUid,
-                    InvalidQueryReason(INCONSISTENT_ROW_SIZE));
-            return;
-        }
-        queryData.insert(std::end(queryData), std::make_move_iterator(std::begin(rows[i])),
-                         std::make_move_iterator(std::end(rows[i])));
-    }
-    callback->sendResults(queryData, columnNames, columnTypes, rows.size());
+    callback->sendResults(queryData, columnNames, columnTypes, rowCount);
     StatsdStats::getInstance().noteQueryRestrictedMetricSucceed(
-            configId, configPackage, keysToQuery.begin()->GetUid(), callingUid,
-            /*queryLatencyNs=*/getElapsedRealtimeNs() - elapsedRealtimeNs);
+            configId, configPackage, key.GetUid(), callingUid,
+            /*queryLatencyNs=*/getElapsedRealtimeNs() - queryStartNs);
 }
 
 set<ConfigKey> StatsLogProcessor::getRestrictedConfigKeysToQueryLocked(
@@ -1064,8 +1757,10 @@ void StatsLogProcessor::enforceDbGuardrailsIfNecessaryLocked(const int64_t wallC
         StatsdStats::kMinDbGuardrailEnforcementPeriodNs) {
         return;
     }
-    StorageManager::enforceDbGuardrails(STATS_RESTRICTED_DATA_DIR, wallClockNs / NS_PER_SEC,
-                                        StatsdStats::kMaxFileSize);
+    dbutils::runDbWrite([wallClockNs] {
+        StorageManager::enforceDbGuardrails(STATS_RESTRICTED_DATA_DIR, wallClockNs / NS_PER_SEC,
+                                            StatsdStats::kMaxFileSize);
+    });
     mLastDbGuardrailEnforcementTime = elapsedRealtimeNs;
 }
 
@@ -1074,9 +1769,9 @@ void StatsLogProcessor::fillRestrictedMetrics(const int64_t configId, const stri
     std::lock_guard<std::mutex> lock(mMetricsMutex);
 
     set<int32_t> configPackageUids;
-    const auto& uidMapItr = UidMap::sAidToUidMapping.find(configPackage);
-    if (uidMapItr != UidMap::sAidToUidMapping.end()) {
-        configPackageUids.insert(uidMapItr->second);
+    const optional<int32_t> aidUid = AidMapping::getUid(configPackage);
+    if (aidUid) {
+        configPackageUids.insert(*aidUid);
     } else {
         configPackageUids = mUidMap->getAppUid(configPackage);
     }
@@ -1102,25 +1797,24 @@ void StatsLogProcessor::flushRestrictedDataLocked(const int64_t elapsedRealtimeN
 
 void StatsLogProcessor::flushIfNecessaryLocked(const ConfigKey& key,
                                                MetricsManager& metricsManager) {
-    int64_t elapsedRealtimeNs = getElapsedRealtimeNs();
-    auto lastCheckTime = mLastByteSizeTimes.find(key);
-    if (lastCheckTime != mLastByteSizeTimes.end()) {
-        if (elapsedRealtimeNs - lastCheckTime->second < StatsdStats::kMinByteSizeCheckPeriodNs) {
-            return;
-        }
-    }
+    ClockSnapshot clock;
+    flushIfNecessaryLocked(key, metricsManager, &clock);
+}
 
-    // We suspect that the byteSize() computation is expensive, so we set a rate limit.
+void StatsLogProcessor::flushIfNecessaryLocked(const ConfigKey& key, MetricsManager& metricsManager,
+                                               ClockSnapshot* clock) {
+    collectWrittenConfigsLocked();
+    // The metric producers keep their byte size up to date as buckets are flushed, so it is
+    // cheap enough to check on every event.
     size_t totalBytes = metricsManager.byteSize();
 
-    mLastByteSizeTimes[key] = elapsedRealtimeNs;
     const size_t kBytesPerConfig = metricsManager.hasRestrictedMetricsDelegate()
                                            ? StatsdStats::kBytesPerRestrictedConfigTriggerFlush
                                            : metricsManager.getTriggerGetDataBytes();
     bool requestDump = false;
     if (totalBytes > metricsManager.getMaxMetricsBytes()) {
         // Too late. We need to start clearing data.
-        metricsManager.dropData(elapsedRealtimeNs);
+        metricsManager.dropData(clock->getElapsedRealtimeNs());
         StatsdStats::getInstance().noteDataDropped(key, totalBytes);
         VLOG("StatsD had to toss out metrics for %s", key.ToString().c_str());
     } else if ((totalBytes > kBytesPerConfig) ||
@@ -1140,7 +1834,7 @@ void StatsLogProcessor::flushIfNecessaryLocked(const ConfigKey& key,
         // Send broadcast so that receivers can pull data.
         auto lastBroadcastTime = mLastBroadcastTimes.find(key);
         if (lastBroadcastTime != mLastBroadcastTimes.end()) {
-            if (elapsedRealtimeNs - lastBroadcastTime->second <
+            if (clock->getElapsedRealtimeNs() - lastBroadcastTime->second <
                     StatsdStats::kMinBroadcastPeriodNs) {
                 VLOG("StatsD would've sent a broadcast but the rate limit stopped us.");
                 return;
@@ -1149,7 +1843,7 @@ void StatsLogProcessor::flushIfNecessaryLocked(const ConfigKey& key,
         if (mSendBroadcast(key)) {
             mOnDiskDataConfigs.erase(key);
             VLOG("StatsD triggered data fetch for %s", key.ToString().c_str());
-            mLastBroadcastTimes[key] = elapsedRealtimeNs;
+            mLastBroadcastTimes[key] = clock->getElapsedRealtimeNs();
             StatsdStats::getInstance().noteBroadcastSent(key);
         }
     }
@@ -1163,22 +1857,50 @@ void StatsLogProcessor::WriteDataToDiskLocked(const ConfigKey& key, const int64_
         !mMetricsManagers.find(key)->second->shouldWriteToDisk()) {
         return;
     }
+    STATSD_TRACE_SCOPE_FMT("StatsLogProcessor::WriteDataToDisk %d_%lld", key.GetUid(),
+                           (long long)key.GetId());
     if (mMetricsManagers.find(key)->second->hasRestrictedMetricsDelegate()) {
         mMetricsManagers.find(key)->second->flushRestrictedData();
         return;
     }
-    vector<uint8_t> buffer;
+    auto proto = std::make_unique<ProtoOutputStream>();
     onConfigMetricsReportLocked(key, timestampNs, wallClockNs,
                                 true /* include_current_partial_bucket*/, true /* erase_data */,
-                                dumpReportReason, dumpLatency, true, &buffer);
+                                dumpReportReason, dumpLatency, proto.get());
+    writeReportToDiskLocked(key, std::move(proto));
+}
+
+void StatsLogProcessor::writeReportToDiskLocked(const ConfigKey& key,
+                                                std::unique_ptr<ProtoOutputStream> proto) {
     string file_name =
             StorageManager::getDataFileName((long)getWallClockSec(), key.GetUid(), key.GetId());
-    StorageManager::writeFile(file_name.c_str(), buffer.data(), buffer.size());
+    if (mDiskWriter != nullptr) {
+        mDiskWriter->write(file_name, std::move(proto), [this, key](bool written) {
+            if (!written) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mWrittenConfigsMutex);
+            mWrittenConfigs.insert(key);
+            mHasWrittenConfigs = true;
+        });
+        return;
+    }
+    StorageManager::writeFile(file_name.c_str(), *proto);
 
     // We were able to write the ConfigMetricsReport to disk, so we should trigger collection ASAP.
     mOnDiskDataConfigs.insert(key);
 }
 
+void StatsLogProcessor::collectWrittenConfigsLocked() {
+    if (!mHasWrittenConfigs) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mWrittenConfigsMutex);
+    mOnDiskDataConfigs.insert(mWrittenConfigs.begin(), mWrittenConfigs.end());
+    mWrittenConfigs.clear();
+    mHasWrittenConfigs = false;
+}
+
 void StatsLogProcessor::SaveActiveConfigsToDisk(int64_t currentTimeNs) {
     std::lock_guard<std::mutex> lock(mMetricsMutex);
     const int64_t timeNs = getElapsedRealtimeNs();
@@ -1191,11 +1913,23 @@ void StatsLogProcessor::SaveActiveConfigsToDisk(int64_t currentTimeNs) {
     }
     mLastActiveMetricsWriteNs = timeNs;
 
-    ProtoOutputStream proto;
-    WriteActiveConfigsToProtoOutputStreamLocked(currentTimeNs, DEVICE_SHUTDOWN, &proto);
-
     string file_name = StringPrintf("%s/active_metrics", STATS_ACTIVE_METRIC_DIR);
     StorageManager::deleteFile(file_name.c_str());
+    // Without any activation the file would only list the configs, and loading it would not
+    // change their state. Most configs have no activation, so the write is skipped.
+    bool hasActivationToPersist = false;
+    for (const auto& [_, metricsManager] : mMetricsManagers) {
+        if (metricsManager->hasActivationToPersist(currentTimeNs)) {
+            hasActivationToPersist = true;
+            break;
+        }
+    }
+    if (!hasActivationToPersist) {
+        return;
+    }
+
+    ProtoOutputStream proto;
+    WriteActiveConfigsToProtoOutputStreamLocked(currentTimeNs, DEVICE_SHUTDOWN, &proto);
     android::base::unique_fd fd(
             open(file_name.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR));
     if (fd == -1) {
@@ -1217,6 +1951,15 @@ void StatsLogProcessor::SaveMetadataToDisk(int64_t currentWallClockTimeNs,
     }
     mLastMetadataWriteNs = systemElapsedTimeNs;
 
+    // The refractory periods on disk are in wall clock time, so they are still current if none
+    // started since they were written.
+    const std::pair<int64_t, int64_t> metadataVersion = getMetadataVersionLocked();
+    if (mMetadataOnDiskVersion == metadataVersion) {
+        VLOG("Statsd skipping writing metadata to disk. Metadata unchanged since the last write");
+        return;
+    }
+    mMetadataOnDiskVersion = metadataVersion;
+
     metadata::StatsMetadataList metadataList;
     WriteMetadataToProtoLocked(
             currentWallClockTimeNs, systemElapsedTimeNs, &metadataList);
@@ -1234,6 +1977,14 @@ void StatsLogProcessor::SaveMetadataToDisk(int64_t currentWallClockTimeNs,
     StorageManager::writeFile(file_name.c_str(), data.c_str(), data.size());
 }
 
+std::pair<int64_t, int64_t> StatsLogProcessor::getMetadataVersionLocked() const {
+    int64_t metadataUpdates = 0;
+    for (const auto& [_, metricsManager] : mMetricsManagers) {
+        metadataUpdates += metricsManager->getMetadataUpdates();
+    }
+    return {mConfigGeneration, metadataUpdates};
+}
+
 void StatsLogProcessor::WriteMetadataToProto(int64_t currentWallClockTimeNs,
                                              int64_t systemElapsedTimeNs,
                                              metadata::StatsMetadataList* metadataList) {
@@ -1259,30 +2010,14 @@ void StatsLogProcessor::LoadMetadataFromDisk(int64_t currentWallClockTimeNs,
                                              int64_t systemElapsedTimeNs) {
     std::lock_guard<std::mutex> lock(mMetricsMutex);
     string file_name = StringPrintf("%s/metadata", STATS_METADATA_DIR);
-    int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
-    if (-1 == fd) {
-        VLOG("Attempt to read %s but failed", file_name.c_str());
-        StorageManager::deleteFile(file_name.c_str());
-        return;
-    }
-    string content;
-    if (!android::base::ReadFdToString(fd, &content)) {
-        ALOGE("Attempt to read %s but failed", file_name.c_str());
-        close(fd);
-        StorageManager::deleteFile(file_name.c_str());
-        return;
-    }
-
-    close(fd);
-
     metadata::StatsMetadataList statsMetadataList;
-    if (!statsMetadataList.ParseFromString(content)) {
-        ALOGE("Attempt to read %s but failed; failed to metadata", file_name.c_str());
+    if (!StorageManager::readProtoFromFile(file_name.c_str(), &statsMetadataList)) {
         StorageManager::deleteFile(file_name.c_str());
         return;
     }
     SetMetadataStateLocked(statsMetadataList, currentWallClockTimeNs, systemElapsedTimeNs);
     StorageManager::deleteFile(file_name.c_str());
+    mMetadataOnDiskVersion.reset();
 }
 
 void StatsLogProcessor::SetMetadataState(const metadata::StatsMetadataList& statsMetadataList,
@@ -1328,25 +2063,8 @@ void StatsLogProcessor::WriteActiveConfigsToProtoOutputStreamLocked(
 void StatsLogProcessor::LoadActiveConfigsFromDisk() {
     std::lock_guard<std::mutex> lock(mMetricsMutex);
     string file_name = StringPrintf("%s/active_metrics", STATS_ACTIVE_METRIC_DIR);
-    int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
-    if (-1 == fd) {
-        VLOG("Attempt to read %s but failed", file_name.c_str());
-        StorageManager::deleteFile(file_name.c_str());
-        return;
-    }
-    string content;
-    if (!android::base::ReadFdToString(fd, &content)) {
-        ALOGE("Attempt to read %s but failed", file_name.c_str());
-        close(fd);
-        StorageManager::deleteFile(file_name.c_str());
-        return;
-    }
-
-    close(fd);
-
     ActiveConfigList activeConfigList;
-    if (!activeConfigList.ParseFromString(content)) {
-        ALOGE("Attempt to read %s but failed; failed to load active configs", file_name.c_str());
+    if (!StorageManager::readProtoFromFile(file_name.c_str(), &activeConfigList)) {
         StorageManager::deleteFile(file_name.c_str());
         return;
     }
@@ -1391,22 +2109,97 @@ void StatsLogProcessor::WriteDataToDiskLocked(const DumpReportReason dumpReportR
         return;
     }
     mLastWriteTimeNs = elapsedRealtimeNs;
+    if (mShardWorkerPool != nullptr && mMetricsManagers.size() >= 2) {
+        writeDataToDiskOnShardsLocked(dumpReportReason, dumpLatency, elapsedRealtimeNs,
+                                      wallClockNs);
+        return;
+    }
     for (auto& pair : mMetricsManagers) {
         WriteDataToDiskLocked(pair.first, elapsedRealtimeNs, wallClockNs, dumpReportReason,
                               dumpLatency);
     }
 }
 
+void StatsLogProcessor::writeDataToDiskOnShardsLocked(const DumpReportReason dumpReportReason,
+                                                      const DumpLatency dumpLatency,
+                                                      const int64_t elapsedRealtimeNs,
+                                                      const int64_t wallClockNs) {
+    struct ShardedReport {
+        const ConfigKey* key;
+        std::unique_ptr<ProtoOutputStream> proto;
+    };
+    std::vector<ShardedReport> reports;
+    reports.reserve(mMetricsManagers.size());
+    for (const auto& [key, metricsManager] : mMetricsManagers) {
+        if (!metricsManager->shouldWriteToDisk()) {
+            continue;
+        }
+        if (metricsManager->hasRestrictedMetricsDelegate()) {
+            metricsManager->flushRestrictedData();
+            continue;
+        }
+        reports.push_back({&key, std::make_unique<ProtoOutputStream>()});
+    }
+
+    // The reports are generated on the shards the configs are pinned to, each into its own
+    // buffer. The shards only touch their configs, like when processing events.
+    const size_t numShards = mShardWorkerPool->getNumShards();
+    for (ShardedReport& report : reports) {
+        mShardWorkerPool->post(std::hash<ConfigKey>()(*report.key) % numShards, [&] {
+            onConfigMetricsReportLocked(*report.key, elapsedRealtimeNs, wallClockNs,
+                                        true /* include_current_partial_bucket*/,
+                                        true /* erase_data */, dumpReportReason, dumpLatency,
+                                        report.proto.get());
+        });
+    }
+    mShardWorkerPool->waitForIdle();
+
+    for (ShardedReport& report : reports) {
+        writeReportToDiskLocked(*report.key, std::move(report.proto));
+    }
+}
+
 void StatsLogProcessor::WriteDataToDisk(const DumpReportReason dumpReportReason,
                                         const DumpLatency dumpLatency,
                                         const int64_t elapsedRealtimeNs,
                                         const int64_t wallClockNs) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
-    WriteDataToDiskLocked(dumpReportReason, dumpLatency, elapsedRealtimeNs, wallClockNs);
+    STATSD_TRACE_SCOPE("StatsLogProcessor::WriteDataToDisk");
+    AsyncFileWriter* diskWriter;
+    {
+        std::unique_lock<std::mutex> lock(mMetricsMutex);
+        // The reports written erase the data of the metrics a yielding dump has yet to report.
+        mYieldingDumpCondition.wait(lock, [this] { return mYieldingDumps.empty(); });
+        WriteDataToDiskLocked(dumpReportReason, dumpLatency, elapsedRealtimeNs, wallClockNs);
+        diskWriter = mDiskWriter.get();
+    }
+    // The callers expect the reports on disk on return, e.g. before shutting down. The events
+    // are still processed meanwhile.
+    if (diskWriter != nullptr) {
+        diskWriter->waitForIdle();
+    }
+    // Same for the restricted metric data flushed to the dbs.
+    dbutils::waitForDbWrites();
+}
+
+void StatsLogProcessor::onMemoryPressure(const int64_t elapsedRealtimeNs,
+                                         const int64_t wallClockNs) {
+    STATSD_TRACE_SCOPE("StatsLogProcessor::onMemoryPressure");
+    // Skipped if the data was written to disk in the last WRITE_DATA_COOL_DOWN_SEC.
+    WriteDataToDisk(MEMORY_PRESSURE, FAST, elapsedRealtimeNs, wallClockNs);
+    const int numPullsCleared = mPullerManager->ForceClearPullerCache();
+    const size_t numStringsFreed = InternedString::sweepPool();
+#if defined(__BIONIC__)
+    // Returns the pages freed above to the kernel.
+    mallopt(M_PURGE, 0);
+#endif
+    ALOGI("Memory pressure: cleared %d pull caches, freed %zu strings", numPullsCleared,
+          numStringsFreed);
 }
 
 void StatsLogProcessor::informPullAlarmFired(const int64_t timestampNs) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    std::unique_lock<std::mutex> lock(mMetricsMutex);
+    // The pulled data closes the buckets like the events.
+    waitForDumpCutLocked(lock, timestampNs);
     mPullerManager->OnAlarmFired(timestampNs);
 }
 
@@ -1421,7 +2214,9 @@ int64_t StatsLogProcessor::getLastReportTimeNs(const ConfigKey& key) {
 
 void StatsLogProcessor::notifyAppUpgrade(const int64_t eventTimeNs, const string& apk,
                                          const int uid, const int64_t version) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    std::unique_lock<std::mutex> lock(mMetricsMutex);
+    // The partial buckets split by the upgrade would end after the cut of a dump in progress.
+    waitForDumpCutLocked(lock, INT64_MAX);
     VLOG("Received app upgrade");
     StateManager::getInstance().notifyAppChanged(apk, mUidMap);
     for (const auto& it : mMetricsManagers) {
@@ -1431,7 +2226,9 @@ void StatsLogProcessor::notifyAppUpgrade(const int64_t eventTimeNs, const string
 
 void StatsLogProcessor::notifyAppRemoved(const int64_t eventTimeNs, const string& apk,
                                          const int uid) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    std::unique_lock<std::mutex> lock(mMetricsMutex);
+    // The partial buckets split by the removal would end after the cut of a dump in progress.
+    waitForDumpCutLocked(lock, INT64_MAX);
     VLOG("Received app removed");
     StateManager::getInstance().notifyAppChanged(apk, mUidMap);
     for (const auto& it : mMetricsManagers) {
@@ -1449,7 +2246,9 @@ void StatsLogProcessor::onUidMapReceived(const int64_t eventTimeNs) {
 }
 
 void StatsLogProcessor::onStatsdInitCompleted(const int64_t elapsedTimeNs) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    std::unique_lock<std::mutex> lock(mMetricsMutex);
+    // The partial buckets split on init completed would end after the cut of a dump in progress.
+    waitForDumpCutLocked(lock, INT64_MAX);
     VLOG("Received boot completed signal");
     for (const auto& it : mMetricsManagers) {
         it.second->onStatsdInitCompleted(elapsedTimeNs);
@@ -1497,12 +2296,35 @@ LogEventFilter::AtomIdSet StatsLogProcessor::getDefaultAtomIdSet() {
 void StatsLogProcessor::updateLogEventFilterLocked() const {
     VLOG("StatsLogProcessor: Updating allAtomIds");
     LogEventFilter::AtomIdSet allAtomIds = getDefaultAtomIdSet();
+    // Atoms handled by StatsLogProcessor itself and state atoms are decoded entirely
+    AtomFieldMaskMap allFieldMasks;
+    std::set<int> fullAtomIds;
+    mergeAtomFieldMasks(allAtomIds, /*fieldMasks=*/{}, allFieldMasks, fullAtomIds);
     for (const auto& metricsManager : mMetricsManagers) {
-        metricsManager.second->addAllAtomIds(allAtomIds);
-    }
-    StateManager::getInstance().addAllAtomIds(allAtomIds);
-    VLOG("StatsLogProcessor: Updating allAtomIds done. Total atoms %d", (int)allAtomIds.size());
+        LogEventFilter::AtomIdSet configAtomIds;
+        metricsManager.second->addAllAtomIds(configAtomIds);
+        mergeAtomFieldMasks(configAtomIds, metricsManager.second->getAtomFieldMasks(),
+                            allFieldMasks, fullAtomIds);
+        allAtomIds.insert(configAtomIds.begin(), configAtomIds.end());
+    }
+    LogEventFilter::AtomIdSet stateAtomIds;
+    StateManager::getInstance().addAllAtomIds(stateAtomIds);
+    mergeAtomFieldMasks(stateAtomIds, /*fieldMasks=*/{}, allFieldMasks, fullAtomIds);
+    allAtomIds.insert(stateAtomIds.begin(), stateAtomIds.end());
+    VLOG("StatsLogProcessor: Updating allAtomIds done. Total atoms %d, partially decoded %d",
+         (int)allAtomIds.size(), (int)allFieldMasks.size());
+    mLogEventFilter->setAtomFieldMasks(std::move(allFieldMasks), this);
     mLogEventFilter->setAtomIds(std::move(allAtomIds), this);
+
+    // Train info and isolated uid atoms are always critical, as well as atoms feeding alerts
+    LogEventFilter::AtomIdSet priorityAtomIds{util::BINARY_PUSH_STATE_CHANGED,
+                                              util::WATCHDOG_ROLLBACK_OCCURRED,
+                                              util::ISOLATED_UID_CHANGED};
+    for (const auto& metricsManager : mMetricsManagers) {
+        const std::set<int>& configPriorityAtomIds = metricsManager.second->getPriorityAtomIds();
+        priorityAtomIds.insert(configPriorityAtomIds.begin(), configPriorityAtomIds.end());
+    }
+    mLogEventFilter->setPriorityAtomIds(std::move(priorityAtomIds), this);
 }
 
 void StatsLogProcessor::writeDataCorruptedReasons(ProtoOutputStream& proto) {
@@ -20,7 +20,14 @@
 #include <gtest/gtest_prod.h>
 #include <stdio.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <optional>
+
 #include <unordered_map>
+#include <unordered_set>
 
 #include "config/ConfigListener.h"
 #include "external/StatsPullerManager.h"
@@ -30,6 +37,9 @@
 #include "socket/LogEventFilter.h"
 #include "src/statsd_config.pb.h"
 #include "src/statsd_metadata.pb.h"
+#include "storage/AsyncFileWriter.h"
+#include "utils/ClockSnapshot.h"
+#include "utils/ShardWorkerPool.h"
 
 namespace android {
 namespace os {
@@ -51,6 +61,69 @@ public:
 
     void OnLogEvent(LogEvent* event);
 
+    /**
+     * Processes a batch of events in order under a single mMetricsMutex acquisition. The time
+     * based housekeeping (anomaly alarm, puller cache, restricted data flush, TTLs and DB
+     * guardrails) is done once per batch instead of once per event.
+     */
+    void OnLogEventBatch(const std::vector<std::unique_ptr<LogEvent>>& events);
+
+    /**
+     * Enables processing of event batches by numShards worker threads. Each config is pinned to
+     * one shard, so the events are processed in order per config. Events affecting all the
+     * configs (state changes, config TTL resets) are still processed on the calling thread.
+     * A value lower than 2 disables sharding.
+     */
+    void setEventProcessingShards(size_t numShards);
+
+    /**
+     * Enables writing the reports saved to disk on a dedicated thread, with up to
+     * maxPendingWrites queued writes. The reports are still generated under mMetricsMutex, but
+     * the processing of the events doesn't wait for the disk. A config is noted as having data on
+     * disk once its write completes. A value of 0 writes the reports synchronously. Should be
+     * called before any report is written.
+     */
+    void setAsyncDiskWrites(size_t maxPendingWrites);
+
+    /**
+     * Enables running the restricted metric queries on numThreads worker threads instead of the
+     * binder thread, without holding mMetricsMutex. The queries of a config run in order on the
+     * same thread. The results are still sent to the callbacks of the queries. A value of 0 runs
+     * the queries synchronously.
+     */
+    void setQueryThreads(size_t numThreads);
+
+    /**
+     * Enables building the MetricsManager of a new or fully replaced config without holding
+     * mMetricsMutex, so that the events are still processed during the build. Only the swap to
+     * the new MetricsManager is done under the lock. The events processed meanwhile go to the
+     * previous MetricsManager and are part of its last report. Modular updates and configs
+     * slicing by state, whose StateManager registration needs the lock, are still done under it.
+     */
+    void setOffLockConfigBuilds(bool enabled);
+
+    /**
+     * Enables running the time based housekeeping from runDeferredHousekeeping(), called when the
+     * event queue is drained, instead of on the first event after each interval. An event still
+     * runs it if it was deferred for more than kMaxHousekeepingDelayNs, e.g. under a sustained
+     * load that never drains the queue.
+     */
+    void setDeferredHousekeeping(bool enabled);
+
+    /**
+     * Enables sharing the states of the identical simple conditions of the configs of the same
+     * owner, see SharedConditionStates. Only applies to the configs created afterwards. The
+     * sharded event processing then pins the configs to the shards by owner, and the configs are
+     * built under mMetricsMutex since they read the shared states.
+     */
+    void setSharedConditions(bool enabled);
+
+    /**
+     * Runs the housekeeping and resets the configs whose TTL expired, if the housekeeping is
+     * deferred. Does nothing otherwise.
+     */
+    void runDeferredHousekeeping();
+
     void OnConfigUpdated(const int64_t timestampNs, int64_t wallClockNs, const ConfigKey& key,
                          const StatsdConfig& config, bool modularUpdate = true);
     // For testing only.
@@ -76,6 +149,20 @@ public:
                       const DumpReportReason dumpReportReason, const DumpLatency dumpLatency,
                       vector<uint8_t>* outData);
 
+    // Dumps a page of the ConfigMetricsReportList of the config into outData, erasing the data
+    // but without the current bucket. A paged dump is started with a cursor of 0 at
+    // dumpTimeNs, then continued with the next_page_cursor of each page until a page has none.
+    // The report of a page holds the metrics from the cursor on until they reach
+    // kMaxDataPageBytes, so the report of the whole config is never buffered. The reports stored
+    // on disk are returned on the first page, and configs persisting their history are dumped
+    // whole on it since their report is saved whole. Returns false if the cursor doesn't continue
+    // the paged dump of the config, which is abandoned when the config is updated or removed.
+    bool onDumpReportPage(const ConfigKey& key, int64_t cursor, int64_t dumpTimeNs,
+                          int64_t wallClockNs, const DumpReportReason dumpReportReason,
+                          vector<uint8_t>* outData);
+
+    static constexpr size_t kMaxDataPageBytes = 256 * 1024;
+
     /* Tells MetricsManager that the alarms in alarmSet have fired. Modifies periodic alarmSet. */
     void onPeriodicAlarmFired(
             int64_t timestampNs,
@@ -85,6 +172,10 @@ public:
     void WriteDataToDisk(const DumpReportReason dumpReportReason, const DumpLatency dumpLatency,
                          const int64_t elapsedRealtimeNs, int64_t wallClockNs);
 
+    /* Gives memory back under system memory pressure: the data of the configs is written to disk,
+     * to be added back to their next reports, and the pull and string caches are dropped. */
+    void onMemoryPressure(const int64_t elapsedRealtimeNs, const int64_t wallClockNs);
+
     /* Persist configs containing metrics with active activations to disk. */
     void SaveActiveConfigsToDisk(int64_t currentTimeNs);
 
@@ -172,6 +263,25 @@ public:
     /* Returns pre-defined list of atoms to parse by LogEventFilter */
     static LogEventFilter::AtomIdSet getDefaultAtomIdSet();
 
+    // Cost of a config measured by profileConfig().
+    struct ConfigProfile {
+        bool isConfigValid = false;
+        size_t eventCount = 0;
+        int64_t processingTimeNs = 0;
+        int64_t cpuTimeNs = 0;
+        ConfigMemoryUsage memoryUsage;
+        std::vector<MetricsManager::MetricProfile> metrics;
+    };
+
+    // Keeps copies of the last capacity events processed, to be replayed by profileConfig(). A
+    // capacity of 0, the default, stops the recording and drops the recorded events.
+    void setProfilingEventCapacity(size_t capacity);
+
+    // Loads the config into a MetricsManager that is not added to the configs and replays the
+    // recorded events on it. Nothing is persisted, the pulls and alarms of the config are not
+    // registered. Only the atoms parsed for the current configs are recorded.
+    ConfigProfile profileConfig(const ConfigKey& key, const StatsdConfig& config);
+
 private:
     // For testing only.
     inline sp<AlarmMonitor> getAnomalyAlarmMonitor() const {
@@ -196,12 +306,37 @@ private:
     // Last time we sent a broadcast to this uid that the active configs had changed.
     std::unordered_map<int, int64_t> mLastActivationBroadcastTimes;
 
-    // Tracks when we last checked the bytes consumed for each config key.
-    std::unordered_map<ConfigKey, int64_t> mLastByteSizeTimes;
-
     // Tracks the number of times a config with a specified config key has been dumped.
     std::unordered_map<ConfigKey, int32_t> mDumpReportNumbers;
 
+    // State of a paged dump, see onDumpReportPage.
+    struct PagedDump {
+        // Times of the first page, that all the pages are dumped at.
+        int64_t dumpTimeNs;
+        int64_t wallClockNs;
+        // Index of the next metric to dump, the cursor of the next page.
+        size_t nextMetricIndex;
+        // Sizes of the pages returned so far.
+        size_t totalBytes;
+    };
+
+    // The paged dumps in progress.
+    std::unordered_map<ConfigKey, PagedDump> mPagedDumps;
+
+    // Size the metrics of a page are bounded by, only changed by tests.
+    size_t mMaxDataPageBytes = kMaxDataPageBytes;
+
+    // The yielding dumps in progress, with the time from which the events are held back until
+    // the dump ends or moves to a later metric, see onDumpReportYieldingLocked.
+    std::unordered_map<ConfigKey, int64_t> mYieldingDumps;
+
+    // Notified when a yielding dump ends or moves to the next metric.
+    std::condition_variable mYieldingDumpCondition;
+
+    // Called with mMetricsMutex released between two metrics of a yielding dump, only set by
+    // tests.
+    std::function<void()> mOnDumpYieldForTest;
+
     // Tracks when we last checked the ttl for restricted metrics.
     int64_t mLastTtlTime;
 
@@ -224,12 +359,108 @@ private:
 
     std::shared_ptr<LogEventFilter> mLogEventFilter;
 
+    // Set when event processing is sharded across worker threads, see setEventProcessingShards.
+    std::unique_ptr<ShardWorkerPool> mShardWorkerPool;
+
+    // Number of events whose latencies could have been sampled, see
+    // startLogEventLatencySampleLocked.
+    uint64_t mNumLogEventsForLatencySampling = 0;
+
+    // Guards mWrittenConfigs, which is updated on the thread of mDiskWriter.
+    std::mutex mWrittenConfigsMutex;
+
+    // Configs whose reports were written by mDiskWriter since they were last moved to
+    // mOnDiskDataConfigs.
+    std::set<ConfigKey> mWrittenConfigs;
+
+    std::atomic<bool> mHasWrittenConfigs = false;
+
+    // Set when the queries run on worker threads, see setQueryThreads.
+    std::unique_ptr<ShardWorkerPool> mQueryWorkerPool;
+
+    // Set when the MetricsManagers are built without mMetricsMutex, see setOffLockConfigBuilds.
+    std::atomic<bool> mOffLockConfigBuilds = false;
+
+    // Set when the housekeeping is run when the event queue is drained, see
+    // setDeferredHousekeeping.
+    std::atomic<bool> mDeferredHousekeeping = false;
+
+    // Set when the configs created share their condition states, see setSharedConditions.
+    sp<SharedConditionStates> mSharedConditionStates;
+
+    // Last time runHousekeepingLocked() ran.
+    int64_t mLastHousekeepingTimeNs = 0;
+
+    // Max time an event leaves the housekeeping to runDeferredHousekeeping().
+    static constexpr int64_t kMaxHousekeepingDelayNs = 5 * NS_PER_SEC;
+
+    // Serializes the config updates and removals, so that a MetricsManager built without
+    // mMetricsMutex is never installed after a later change of its config. Acquired before
+    // mMetricsMutex.
+    std::mutex mConfigUpdateMutex;
+
+    // Set when the reports are written to disk asynchronously, see setAsyncDiskWrites. Declared
+    // after the members updated by its callbacks, so that it is destroyed first.
+    std::unique_ptr<AsyncFileWriter> mDiskWriter;
+
+    // Moves mWrittenConfigs to mOnDiskDataConfigs.
+    void collectWrittenConfigsLocked();
+
     void OnLogEvent(LogEvent* event, int64_t elapsedRealtimeNs);
 
+    void runDeferredHousekeeping(int64_t elapsedRealtimeNs);
+
+    void OnLogEventBatch(const std::vector<std::unique_ptr<LogEvent>>& events,
+                         int64_t elapsedRealtimeNs);
+
+    // Processes a single event. The time based housekeeping is run before dispatching the event
+    // to the metrics managers unless housekeepingDone is already set, which it then sets.
+    // The clock is shared by the events of a batch.
+    void OnLogEventLocked(LogEvent* event, int64_t elapsedRealtimeNs, ClockSnapshot* clock,
+                          bool* housekeepingDone);
+
+    // Does the processing of the event common for all configs.
+    // Returns true if the event should be dispatched to the metrics managers.
+    bool prepareLogEventLocked(LogEvent* event, int64_t elapsedRealtimeNs, ClockSnapshot* clock,
+                               bool* housekeepingDone);
+
+    // Returns the total time the metrics managers spent on the event if sampleLatency, 0
+    // otherwise.
+    int64_t dispatchLogEventLocked(const LogEvent& event, int64_t elapsedRealtimeNs,
+                                   ClockSnapshot* clock, bool sampleLatency = false);
+
+    // Returns when the processing of the next event started if its latencies are sampled, see
+    // StatsdStats::kLogEventLatencySampleRate, 0 otherwise.
+    int64_t startLogEventLatencySampleLocked();
+
+    // Returns true if the event can not be dispatched to the shards along with its neighbours.
+    bool requiresSerialProcessingLocked(const LogEvent& event) const;
+
+    // Dispatches the prepared events to the metrics managers on the shard workers and waits
+    // for completion. The events with a non zero sampleStartNs have their latencies noted.
+    void dispatchToShardsLocked(const std::vector<LogEvent*>& events,
+                                const std::vector<int64_t>& sampleStartNs,
+                                int64_t elapsedRealtimeNs, ClockSnapshot* clock);
+
+    void sendActivationBroadcastsLocked(
+            const std::unordered_set<int>& uidsWithActiveConfigsChanged,
+            const std::unordered_map<int, std::vector<int64_t>>& activeConfigsPerUid,
+            int64_t elapsedRealtimeNs);
+
+    void runHousekeepingLocked(int64_t elapsedRealtimeNs, int64_t wallClockNs);
+
     void resetIfConfigTtlExpiredLocked(const int64_t eventTimeNs);
 
+    // Installs builtMetricsManager if it is set, instead of building or updating the
+    // MetricsManager of the config.
     void OnConfigUpdatedLocked(const int64_t currentTimestampNs, const ConfigKey& key,
-                               const StatsdConfig& config, bool modularUpdate);
+                               const StatsdConfig& config, bool modularUpdate,
+                               const sp<MetricsManager>& builtMetricsManager = nullptr);
+
+    // Returns true if the MetricsManager for the config update can be built without holding
+    // mMetricsMutex, i.e. if the update isn't modular and no metric is sliced by state.
+    bool canBuildConfigOffLock(const ConfigKey& key, const StatsdConfig& config,
+                               bool modularUpdate) const;
 
     void GetActiveConfigsLocked(const int uid, vector<int64_t>& outActiveConfigs);
 
@@ -255,13 +486,61 @@ private:
                                const DumpReportReason dumpReportReason,
                                const DumpLatency dumpLatency);
 
+    // Same as WriteDataToDiskLocked for all the configs, but generates their reports in parallel
+    // on the shard workers. The reports are written once they are all generated.
+    void writeDataToDiskOnShardsLocked(const DumpReportReason dumpReportReason,
+                                       const DumpLatency dumpLatency, int64_t elapsedRealtimeNs,
+                                       const int64_t wallClockNs);
+
+    // Writes the report of the config to a new data file, on mDiskWriter if set.
+    void writeReportToDiskLocked(const ConfigKey& key, std::unique_ptr<ProtoOutputStream> proto);
+
+    void onDumpReportLocked(const ConfigKey& key, int64_t dumpTimeNs, int64_t wallClockNs,
+                            const bool include_current_partial_bucket, const bool erase_data,
+                            const DumpReportReason dumpReportReason,
+                            const DumpLatency dumpLatency, ProtoOutputStream* proto);
+
+    // Same as onDumpReportLocked without the current bucket, but releases mMetricsMutex through
+    // lock between the metrics so that the ingestion of events waits for one metric at most. The
+    // buckets of all the metrics are cut at dumpTimeNs first, and the events that would close the
+    // current bucket of a metric not dumped yet are held back. The dump stops early if the config
+    // is updated or removed meanwhile, and the report is marked incomplete.
+    void onDumpReportYieldingLocked(const ConfigKey& key, const sp<MetricsManager> metricsManager,
+                                    int64_t dumpTimeNs, int64_t wallClockNs, const bool erase_data,
+                                    const DumpReportReason dumpReportReason,
+                                    const DumpLatency dumpLatency,
+                                    std::unique_lock<std::mutex>& lock, ProtoOutputStream* proto);
+
+    // Waits through lock until no yielding dump of the config is in progress.
+    void waitForYieldingDumpLocked(std::unique_lock<std::mutex>& lock, const ConfigKey& key);
+
+    // Waits through lock until the yielding dumps in progress let the events at timestampNs be
+    // processed, see mYieldingDumps.
+    void waitForDumpCutLocked(std::unique_lock<std::mutex>& lock, int64_t timestampNs);
+
+    // Same as waitForDumpCutLocked, and also waits until no yielding dump is in progress if the
+    // TTL of a config expired at timestampNs, as its reset writes all the configs to disk.
+    void waitForLogEventLocked(std::unique_lock<std::mutex>& lock, int64_t timestampNs);
+
+    // Whether a yielding dump in progress holds back the events at timestampNs.
+    bool isHeldByDumpCutLocked(int64_t timestampNs) const;
+
     void onConfigMetricsReportLocked(
             const ConfigKey& key, int64_t dumpTimeStampNs, int64_t wallClockNs,
             const bool include_current_partial_bucket, const bool erase_data,
             const DumpReportReason dumpReportReason, const DumpLatency dumpLatency,
-            /*if dataSavedToDisk is true, it indicates the caller will write the data to disk
-             (e.g., before reboot). So no need to further persist local history.*/
-            const bool dataSavedToDisk, vector<uint8_t>* proto);
+            ProtoOutputStream* proto);
+
+    // Writes the fields of ConfigMetricsReport that follow its metrics. The uid map is only written
+    // if withUidMap, the strings of str_set are hashed strings used by the report.
+    void writeConfigMetricsReportFieldsLocked(const ConfigKey& key,
+                                              const sp<MetricsManager>& metricsManager,
+                                              int64_t dumpTimeStampNs, int64_t wallClockNs,
+                                              int64_t lastReportTimeNs,
+                                              int64_t lastReportWallClockNs,
+                                              const DumpReportReason dumpReportReason,
+                                              bool withUidMap, ReportStringTable* str_set,
+                                              ProtoOutputStream* proto);
 
     /* Check if it is time enforce data ttls for restricted metrics, and if it is, enforce ttls
      * on all restricted metrics. */
@@ -278,12 +557,21 @@ private:
     /* Check if we should send a broadcast if approaching memory limits and if we're over, we
      * actually delete the data. */
     void flushIfNecessaryLocked(const ConfigKey& key, MetricsManager& metricsManager);
+    void flushIfNecessaryLocked(const ConfigKey& key, MetricsManager& metricsManager,
+                                ClockSnapshot* clock);
 
     set<ConfigKey> getRestrictedConfigKeysToQueryLocked(int32_t callingUid, const int64_t configId,
                                                         const set<int32_t>& configPackageUids,
                                                         string& err,
                                                         InvalidQueryReason& invalidQueryReason);
 
+    // Runs the query on the db of the config and sends the results to the callback. Doesn't
+    // access the processor, so that it can run on mQueryWorkerPool.
+    static void runQuery(const ConfigKey& key, const string& sqlQuery,
+                         const shared_ptr<aidl::android::os::IStatsQueryCallback>& callback,
+                         int64_t configId, const string& configPackage, int32_t callingUid,
+                         int64_t queryStartNs);
+
     // Maps the isolated uid in the log event to host uid if the log event contains uid fields.
     void mapIsolatedUidToHostUidIfNecessaryLocked(LogEvent* event) const;
 
@@ -363,18 +651,39 @@ private:
     //Last time we wrote metadata to disk.
     int64_t mLastMetadataWriteNs = 0;
 
+    // Increases when a config is added, updated, reset or removed.
+    int64_t mConfigGeneration = 0;
+
+    // Increases when the config is updated or reset, so that its yielding dumps stop. Changes to
+    // the other configs don't affect them.
+    std::unordered_map<ConfigKey, int64_t> mConfigGenerations;
+
+    // Config generation and metadata updates of the configs when the metadata on disk was
+    // written, unset if the metadata on disk is not known to be current.
+    std::optional<std::pair<int64_t, int64_t>> mMetadataOnDiskVersion;
+
+    // Returns the config generation and the sum of the metadata updates of the configs.
+    std::pair<int64_t, int64_t> getMetadataVersionLocked() const;
+
     // The time for the next anomaly alarm for alerts.
     int64_t mNextAnomalyAlarmTime = 0;
 
     bool mPrintAllLogs = false;
 
+    // Copies of the last processed events for profileConfig(), oldest first.
+    std::deque<LogEvent> mProfilingEvents;
+
+    size_t mProfilingEventCapacity = 0;
+
     friend class StatsLogProcessorTestRestricted;
     FRIEND_TEST(StatsLogProcessorTest, TestOutOfOrderLogs);
-    FRIEND_TEST(StatsLogProcessorTest, TestRateLimitByteSize);
+    FRIEND_TEST(StatsLogProcessorTest, TestProfileConfig);
+    FRIEND_TEST(StatsLogProcessorTest, TestByteSizeCheckedOnEveryFlush);
     FRIEND_TEST(StatsLogProcessorTest, TestRateLimitBroadcast);
     FRIEND_TEST(StatsLogProcessorTest, TestDropWhenByteSizeTooLarge);
     FRIEND_TEST(StatsLogProcessorTest, InvalidConfigRemoved);
     FRIEND_TEST(StatsLogProcessorTest, TestActiveConfigMetricDiskWriteRead);
+    FRIEND_TEST(StatsLogProcessorTest, TestActiveConfigsNotWrittenWithoutActivation);
     FRIEND_TEST(StatsLogProcessorTest, TestActivationOnBoot);
     FRIEND_TEST(StatsLogProcessorTest, TestActivationOnBootMultipleActivations);
     FRIEND_TEST(StatsLogProcessorTest,
@@ -385,6 +694,16 @@ private:
     FRIEND_TEST(StatsLogProcessorTest, TestEmptyConfigHasNoUidMap);
     FRIEND_TEST(StatsLogProcessorTest, TestReportIncludesSubConfig);
     FRIEND_TEST(StatsLogProcessorTest, TestPullUidProviderSetOnConfigUpdate);
+    FRIEND_TEST(StatsLogProcessorTest, TestWriteDataToDiskSharded);
+    FRIEND_TEST(StatsLogProcessorTest, TestOnDumpReportPage);
+    FRIEND_TEST(StatsLogProcessorTest, TestYieldingDumpLetsEventsThrough);
+    FRIEND_TEST(StatsLogProcessorTest, TestYieldingDumpHoldsEventsAfterCut);
+    FRIEND_TEST(StatsLogProcessorTest, TestYieldingDumpStopsOnModularUpdate);
+    FRIEND_TEST(StatsLogProcessorTest, TestYieldingDumpStopsOnConfigRemoved);
+    FRIEND_TEST(StatsLogProcessorTest, TestYieldingDumpIgnoresOtherConfigUpdate);
+    FRIEND_TEST(StatsLogProcessorTest, TestYieldingDumpHoldsDiskWrite);
+    FRIEND_TEST(StatsLogProcessorTest, TestOffLockConfigBuilds);
+    FRIEND_TEST(StatsLogProcessorTest, TestDeferredHousekeeping);
     FRIEND_TEST(StatsLogProcessorTestRestricted, TestInconsistentRestrictedMetricsConfigUpdate);
     FRIEND_TEST(StatsLogProcessorTestRestricted, TestRestrictedLogEventPassed);
     FRIEND_TEST(StatsLogProcessorTestRestricted, TestRestrictedLogEventNotPassed);
@@ -417,6 +736,7 @@ private:
     FRIEND_TEST(GaugeMetricE2ePulledTest, TestConditionChangeToTrueSamplePulledEvents);
     FRIEND_TEST(RestrictedEventMetricE2eTest, TestEnforceTtlRemovesOldEvents);
     FRIEND_TEST(RestrictedEventMetricE2eTest, TestFlagDisabled);
+    FRIEND_TEST(RestrictedEventMetricE2eTest, TestQueryOnWorkerThreads);
     FRIEND_TEST(RestrictedEventMetricE2eTest, TestLogEventsEnforceTtls);
     FRIEND_TEST(RestrictedEventMetricE2eTest, TestQueryEnforceTtls);
     FRIEND_TEST(RestrictedEventMetricE2eTest, TestLogEventsDoesNotEnforceTtls);
@@ -435,6 +755,7 @@ private:
                 TestCountMetric_save_refractory_to_disk_no_data_written);
     FRIEND_TEST(AnomalyCountDetectionE2eTest, TestCountMetric_save_refractory_to_disk);
     FRIEND_TEST(AnomalyCountDetectionE2eTest, TestCountMetric_load_refractory_from_disk);
+    FRIEND_TEST(AnomalyCountDetectionE2eTest, TestCountMetric_skip_unchanged_refractory_write);
     FRIEND_TEST(AnomalyDurationDetectionE2eTest, TestDurationMetric_SUM_single_bucket);
     FRIEND_TEST(AnomalyDurationDetectionE2eTest, TestDurationMetric_SUM_partial_bucket);
     FRIEND_TEST(AnomalyDurationDetectionE2eTest, TestDurationMetric_SUM_multiple_buckets);
@@ -442,6 +763,8 @@ private:
 
     FRIEND_TEST(AlarmE2eTest, TestMultipleAlarms);
     FRIEND_TEST(ConfigTtlE2eTest, TestCountMetric);
+    FRIEND_TEST(ConfigTtlE2eTest, TestResetInPlace);
+    FRIEND_TEST(ConfigTtlE2eTest, TestResetInPlaceKeepsStartedDuration);
     FRIEND_TEST(MetricActivationE2eTest, TestCountMetric);
     FRIEND_TEST(MetricActivationE2eTest, TestCountMetricWithOneDeactivation);
     FRIEND_TEST(MetricActivationE2eTest, TestCountMetricWithTwoDeactivations);
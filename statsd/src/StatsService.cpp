@@ -35,14 +35,19 @@
 #include <utils/String16.h>
 
 #include "android-base/stringprintf.h"
+#include "anomaly/subscriber_util.h"
 #include "config/ConfigKey.h"
 #include "config/ConfigManager.h"
+#include "external/StatsCallbackPuller.h"
 #include "flags/FlagProvider.h"
 #include "guardrail/StatsdStats.h"
+#include "metrics/MetricsManager.h"
+#include "packages/AidMapping.h"
 #include "stats_log_util.h"
 #include "storage/StorageManager.h"
 #include "subscriber/SubscriberReporter.h"
 #include "utils/DbUtils.h"
+#include "utils/ThreadScheduling.h"
 
 using namespace android;
 
@@ -136,7 +141,8 @@ StatsService::StatsService(const sp<UidMap>& uidMap, shared_ptr<LogEventQueue> q
               [this](const shared_ptr<IStatsCompanionService>& /*sc*/) {
                   mProcessor->cancelAnomalyAlarm();
                   StatsdStats::getInstance().noteRegisteredAnomalyAlarmChanged();
-              })),
+              },
+              MIN_INTERVAL_TO_DELAY_REGISTERED_ALARM_SECS)),
       mPeriodicAlarmMonitor(new AlarmMonitor(
               MIN_DIFF_TO_UPDATE_REGISTERED_ALARM_SECS,
               [](const shared_ptr<IStatsCompanionService>& sc, int64_t timeMillis) {
@@ -150,7 +156,8 @@ StatsService::StatsService(const sp<UidMap>& uidMap, shared_ptr<LogEventQueue> q
                       sc->cancelAlarmForSubscriberTriggering();
                       StatsdStats::getInstance().noteRegisteredPeriodicAlarmChanged();
                   }
-              })),
+              },
+              MIN_INTERVAL_TO_DELAY_REGISTERED_ALARM_SECS)),
       mEventQueue(std::move(queue)),
       mLogEventFilter(logEventFilter),
       mBootCompleteTrigger({kBootCompleteTag, kUidMapReceivedTag, kAllPullersRegisteredTag},
@@ -204,13 +211,13 @@ StatsService::StatsService(const sp<UidMap>& uidMap, shared_ptr<LogEventQueue> q
                    const vector<int64_t>& restrictedMetrics) {
                 set<string> configPackages;
                 set<int32_t> delegateUids;
-                for (const auto& kv : UidMap::sAidToUidMapping) {
-                    if (kv.second == static_cast<uint32_t>(key.GetUid())) {
-                        configPackages.insert(kv.first);
-                    }
-                    if (kv.first == delegatePackage) {
-                        delegateUids.insert(kv.second);
-                    }
+                const string_view aidName = AidMapping::getName(key.GetUid());
+                if (!aidName.empty()) {
+                    configPackages.emplace(aidName);
+                }
+                const optional<int32_t> delegateAidUid = AidMapping::getUid(delegatePackage);
+                if (delegateAidUid) {
+                    delegateUids.insert(*delegateAidUid);
                 }
                 if (configPackages.empty()) {
                     configPackages = mUidMap->getAppNamesFromUid(key.GetUid(), true);
@@ -223,6 +230,76 @@ StatsService::StatsService(const sp<UidMap>& uidMap, shared_ptr<LogEventQueue> q
             },
             logEventFilter);
 
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_SHARDED_EVENT_PROCESSING_FLAG,
+                                                    FLAG_FALSE)) {
+        mProcessor->setEventProcessingShards(kEventProcessingShards);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_PARALLEL_PULL_PROCESSING_FLAG,
+                                                    FLAG_FALSE)) {
+        mPullerManager->setPullDataProcessingThreads(kPullDataProcessingThreads);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_CONCURRENT_PULLS_FLAG, FLAG_FALSE)) {
+        mPullerManager->setConcurrentPullThreads(kConcurrentPullThreads);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_EARLY_SCHEDULED_PULLS_FLAG,
+                                                    FLAG_FALSE)) {
+        mPullerManager->setEarlyScheduledPulls(true);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_PULL_RATE_LIMITING_FLAG, FLAG_FALSE)) {
+        StatsPuller::SetPullRateLimiting(true);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_PULL_RESULT_PRIORITY_FLAG,
+                                                    FLAG_FALSE)) {
+        StatsCallbackPuller::SetPullResultPriority(true);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_NATIVE_PULLERS_FLAG, FLAG_FALSE)) {
+        mPullerManager->setNativePullers(true);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_PULL_ALARM_ALIGNMENT_FLAG,
+                                                    FLAG_FALSE)) {
+        mPullerManager->setPullAlarmGrid(kPullAlarmGridNs);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_ASYNC_DISK_WRITES_FLAG, FLAG_FALSE)) {
+        mProcessor->setAsyncDiskWrites(kMaxPendingDiskWrites);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_COMPRESSED_REPORTS_FLAG, FLAG_FALSE)) {
+        StorageManager::setCompressReports(true);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_DATA_DIR_INDEX_FLAG, FLAG_FALSE)) {
+        StorageManager::setDataDirIndex(true);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_REPORT_LOGS_FLAG, FLAG_FALSE)) {
+        StorageManager::setReportLogs(true);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_PERSISTENT_DB_CONNECTIONS_FLAG,
+                                                    FLAG_FALSE)) {
+        dbutils::setPersistentDbConnections(true);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_ASYNC_DB_WRITES_FLAG, FLAG_FALSE)) {
+        dbutils::setAsyncDbWrites(true);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_ASYNC_QUERIES_FLAG, FLAG_FALSE)) {
+        mProcessor->setQueryThreads(kQueryThreads);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_PARALLEL_MATCHING_FLAG, FLAG_FALSE)) {
+        MetricsManager::setParallelMatching(kParallelMatchingThreads,
+                                            kMinMatchersForParallelMatching);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_OFF_LOCK_CONFIG_BUILDS_FLAG,
+                                                    FLAG_FALSE)) {
+        mProcessor->setOffLockConfigBuilds(true);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_DEFERRED_HOUSEKEEPING_FLAG,
+                                                    FLAG_FALSE)) {
+        mProcessor->setDeferredHousekeeping(true);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_ASYNC_SUBSCRIBERS_FLAG, FLAG_FALSE)) {
+        setAsyncSubscribers(true);
+    }
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_SHARED_CONDITIONS_FLAG, FLAG_FALSE)) {
+        mProcessor->setSharedConditions(true);
+    }
+
     mUidMap->setListener(mProcessor);
     mConfigManager->AddListener(mProcessor);
 
@@ -242,13 +319,17 @@ StatsService::~StatsService() {
 
 /* Runs on a dedicated thread to process pushed events. */
 void StatsService::readLogs() {
+    applyThreadScheduling(StatsdThread::kLogsReader);
+    std::vector<std::unique_ptr<LogEvent>> events;
+    events.reserve(kMaxLogEventBatchSize);
     // Read forever..... long live statsd
     while (1) {
-        // Block until an event is available.
-        auto event = mEventQueue->waitPop();
+        // Block until an event is available. Drain what is already queued at that point so that
+        // bursts are processed under a single StatsLogProcessor lock acquisition.
+        mEventQueue->waitPopBatch(kMaxLogEventBatchSize, kLogEventBatchMaxLatency, events);
 
         // Below flag will be set when statsd is exiting and log event will be pushed to break
-        // out of waitPop.
+        // out of waitPopBatch.
         if (mIsStopRequested) {
             break;
         }
@@ -256,10 +337,23 @@ void StatsService::readLogs() {
         // Pass it to StatsLogProcess to all configs/metrics
         // At this point, the LogEventQueue is not blocked, so that the socketListener
         // can read events from the socket and write to buffer to avoid data drop.
-        mProcessor->OnLogEvent(event.get());
+        mProcessor->OnLogEventBatch(events);
         // The ShellSubscriber is only used by shell for local debugging.
         if (mShellSubscriber != nullptr) {
-            mShellSubscriber->onLogEvent(*event);
+            for (const auto& event : events) {
+                mShellSubscriber->onLogEvent(*event);
+            }
+        }
+
+        // Nobody holds the events past this point, hand them back for reuse by the socket
+        // listener.
+        for (auto& event : events) {
+            mEventQueue->recycleEvent(std::move(event));
+        }
+
+        // Idle until the next event, no event waits for the housekeeping.
+        if (mEventQueue->isEmpty()) {
+            mProcessor->runDeferredHousekeeping();
         }
     }
 }
@@ -332,6 +426,7 @@ void StatsService::dumpStatsdStats(int out, bool verbose, bool proto) {
     } else {
         StatsdStats::getInstance().dumpStats(out);
         mProcessor->dumpStates(out, verbose);
+        dumpThreadScheduling(out);
     }
 }
 
@@ -377,6 +472,10 @@ status_t StatsService::handleShellCommand(int in, int out, int err, const char**
             return cmd_config(in, out, err, utf8Args);
         }
 
+        if (!utf8Args[0].compare(String8("config-profile"))) {
+            return cmd_config_profile(in, out, err, utf8Args);
+        }
+
         if (!utf8Args[0].compare(String8("print-uid-map"))) {
             return cmd_print_uid_map(out, utf8Args);
         }
@@ -516,6 +615,21 @@ void StatsService::print_cmd_help(int out) {
     dprintf(out, "\n              *Note: If both UID and NAME are omitted then all configs will\n");
     dprintf(out, "\n                     be removed from memory and disk!\n");
     dprintf(out, "\n");
+    dprintf(out, "usage: adb shell cmd stats config-profile record SIZE\n");
+    dprintf(out, "usage: adb shell cmd stats config-profile [UID] NAME\n");
+    dprintf(out, "\n");
+    dprintf(out, "  Prints the cost of a configuration without adding it. The proto should be\n");
+    dprintf(out, "  in wire-encoded protobuf format and passed via stdin. It is loaded apart\n");
+    dprintf(out, "  from the other configurations and the recorded events are replayed on it.\n");
+    dprintf(out, "  Only the atoms used by the current configurations are recorded.\n");
+    dprintf(out, "\n");
+    dprintf(out, "  record SIZE   Records the last SIZE events processed, 0 stops recording.\n");
+    dprintf(out, "  UID           The uid to use. It is only possible to pass the UID\n");
+    dprintf(out, "                parameter on eng builds. If UID is omitted the calling\n");
+    dprintf(out, "                uid is used.\n");
+    dprintf(out, "  NAME          The per-uid name to use\n");
+    dprintf(out, "\n");
+    dprintf(out, "\n");
     dprintf(out,
             "usage: adb shell cmd stats dump-report [UID] NAME [--keep_data] "
             "[--include_current_bucket] [--proto]\n");
@@ -651,6 +765,80 @@ status_t StatsService::cmd_trigger_active_config_broadcast(int out, Vector<Strin
     return NO_ERROR;
 }
 
+status_t StatsService::cmd_config_profile(int in, int out, int err, Vector<String8>& args) {
+    const int argCount = args.size();
+    if (argCount == 3 && args[1] == "record") {
+        char* endp;
+        const long long capacity = strtoll(args[2].c_str(), &endp, 10);
+        if (endp == args[2].c_str() || *endp != '\0' || capacity < 0) {
+            dprintf(err, "Error parsing the number of events.\n");
+            return UNKNOWN_ERROR;
+        }
+        mProcessor->setProfilingEventCapacity(capacity);
+        dprintf(out, "Recording the last %lld events.\n", capacity);
+        return NO_ERROR;
+    }
+
+    int uid = -1;
+    string name;
+    if (argCount == 2) {
+        // Automatically pick the UID
+        uid = AIBinder_getCallingUid();
+        name.assign(args[1].c_str(), args[1].size());
+    } else if (argCount == 3) {
+        if (!getUidFromArgs(args, 1, uid)) {
+            dprintf(err, "Invalid UID. Note that the config can only be set for "
+                         "other UIDs on eng or userdebug builds.\n");
+            return UNKNOWN_ERROR;
+        }
+        name.assign(args[2].c_str(), args[2].size());
+    } else {
+        print_cmd_help(out);
+        return UNKNOWN_ERROR;
+    }
+
+    char* endp;
+    const int64_t configId = strtoll(name.c_str(), &endp, 10);
+    if (endp == name.c_str() || *endp != '\0') {
+        dprintf(err, "Error parsing config ID.\n");
+        return UNKNOWN_ERROR;
+    }
+    string buffer;
+    if (!android::base::ReadFdToString(in, &buffer)) {
+        dprintf(err, "Error reading stream for StatsConfig.\n");
+        return UNKNOWN_ERROR;
+    }
+    StatsdConfig config;
+    if (!config.ParseFromString(buffer)) {
+        dprintf(err, "Error parsing proto stream for StatsConfig.\n");
+        return UNKNOWN_ERROR;
+    }
+
+    const StatsLogProcessor::ConfigProfile profile =
+            mProcessor->profileConfig(ConfigKey(uid, configId), config);
+    if (!profile.isConfigValid) {
+        dprintf(err, "Invalid config, see print-stats for the reason.\n");
+        return UNKNOWN_ERROR;
+    }
+    dprintf(out, "%zu events replayed in %lld ns, %lld ns of CPU time\n", profile.eventCount,
+            (long long)profile.processingTimeNs, (long long)profile.cpuTimeNs);
+    dprintf(out, "%lld bucket bytes, %lld dimensions, %lld gauge atoms\n",
+            (long long)profile.memoryUsage.bucketBytes,
+            (long long)profile.memoryUsage.dimensionCount,
+            (long long)profile.memoryUsage.gaugeAtomCount);
+    for (const MetricsManager::MetricProfile& metric : profile.metrics) {
+        const long long nsPerEvent = metric.matchedEventCount == 0
+                                             ? 0
+                                             : metric.processingTimeNs / metric.matchedEventCount;
+        dprintf(out,
+                "metric %lld: %lld matched events, %lld ns per event, %lld dimensions, "
+                "%lld bytes\n",
+                (long long)metric.metricId, (long long)metric.matchedEventCount, nsPerEvent,
+                (long long)metric.dimensionCount, (long long)metric.byteSize);
+    }
+    return NO_ERROR;
+}
+
 status_t StatsService::cmd_config(int in, int out, int err, Vector<String8>& args) {
     const int argCount = args.size();
     if (argCount >= 2) {
@@ -896,9 +1084,9 @@ status_t StatsService::cmd_print_pulled_metrics(int out, const Vector<String8>&
     vector<int32_t> uids;
     if (args.size() > 2) {
         string package = string(args[2].c_str());
-        auto it = UidMap::sAidToUidMapping.find(package);
-        if (it != UidMap::sAidToUidMapping.end()) {
-            uids.push_back(it->second);
+        const optional<int32_t> aidUid = AidMapping::getUid(package);
+        if (aidUid) {
+            uids.push_back(*aidUid);
         } else {
             set<int32_t> uids_set = mUidMap->getAppUid(package);
             uids.insert(uids.end(), uids_set.begin(), uids_set.end());
@@ -1128,10 +1316,22 @@ void StatsService::Startup() {
     mProcessor->LoadActiveConfigsFromDisk();
     mProcessor->LoadMetadataFromDisk(wallClockNs, elapsedRealtimeNs);
     mProcessor->EnforceDataTtls(wallClockNs, elapsedRealtimeNs);
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_MEMORY_PRESSURE_MONITOR_FLAG,
+                                                    FLAG_FALSE)) {
+        mMemoryPressureMonitor = std::make_unique<MemoryPressureMonitor>([this] {
+            mProcessor->onMemoryPressure(getElapsedRealtimeNs(), getWallClockNs());
+        });
+        if (!mMemoryPressureMonitor->start()) {
+            mMemoryPressureMonitor = nullptr;
+        }
+    }
 }
 
 void StatsService::Terminate() {
     ALOGI("StatsService::Terminating");
+    if (mMemoryPressureMonitor != nullptr) {
+        mMemoryPressureMonitor->stop();
+    }
     if (mProcessor != nullptr) {
         int64_t elapsedRealtimeNs = getElapsedRealtimeNs();
         int64_t wallClockNs = getWallClockNs();
@@ -1159,15 +1359,16 @@ Status StatsService::getData(int64_t key, const int32_t callingUid, vector<uint8
 Status StatsService::getDataFd(int64_t key, const int32_t callingUid,
                                const ScopedFileDescriptor& fd) {
     ENFORCE_UID(AID_SYSTEM);
-    vector<uint8_t> reportData;
-    getDataChecked(key, callingUid, &reportData);
+    // The report is written from the buffers of the proto, without flattening it into a vector.
+    ProtoOutputStream reportProto;
+    getDataChecked(key, callingUid, &reportProto);
 
-    if (reportData.size() >= std::numeric_limits<int32_t>::max()) {
+    if (reportProto.size() >= std::numeric_limits<int32_t>::max()) {
         ALOGE("Report size is infeasible big and can not be returned");
         return exception(EX_ILLEGAL_STATE, "Report size is infeasible big.");
     }
 
-    const uint32_t bytesToWrite = static_cast<uint32_t>(reportData.size());
+    const uint32_t bytesToWrite = static_cast<uint32_t>(reportProto.size());
     VLOG("StatsService::getDataFd report size %d", bytesToWrite);
 
     // write 4 bytes of report size for correct buffer allocation
@@ -1175,7 +1376,7 @@ Status StatsService::getDataFd(int64_t key, const int32_t callingUid,
     if (!android::base::WriteFully(fd.get(), &bytesToWriteBE, sizeof(uint32_t))) {
         return exception(EX_ILLEGAL_STATE, "Failed to write report data size to file descriptor");
     }
-    if (!android::base::WriteFully(fd.get(), reportData.data(), reportData.size())) {
+    if (!writeProtoToFd(reportProto, fd.get())) {
         return exception(EX_ILLEGAL_STATE, "Failed to write report data to file descriptor");
     }
 
@@ -1183,6 +1384,18 @@ Status StatsService::getDataFd(int64_t key, const int32_t callingUid,
     return Status::ok();
 }
 
+Status StatsService::getDataPage(int64_t key, const int32_t callingUid, int64_t cursor,
+                                 vector<uint8_t>* output) {
+    ENFORCE_UID(AID_SYSTEM);
+    VLOG("StatsService::getDataPage with Uid %i, cursor %lld", callingUid, (long long)cursor);
+    ConfigKey configKey(callingUid, key);
+    if (!mProcessor->onDumpReportPage(configKey, cursor, getElapsedRealtimeNs(), getWallClockNs(),
+                                      GET_DATA_CALLED, output)) {
+        return exception(EX_ILLEGAL_ARGUMENT, "Invalid data page cursor.");
+    }
+    return Status::ok();
+}
+
 void StatsService::getDataChecked(int64_t key, const int32_t callingUid, vector<uint8_t>* output) {
     VLOG("StatsService::getData with Uid %i", callingUid);
     ConfigKey configKey(callingUid, key);
@@ -1193,6 +1406,15 @@ void StatsService::getDataChecked(int64_t key, const int32_t callingUid, vector<
                              GET_DATA_CALLED, FAST, output);
 }
 
+void StatsService::getDataChecked(int64_t key, const int32_t callingUid,
+                                  ProtoOutputStream* proto) {
+    VLOG("StatsService::getData with Uid %i", callingUid);
+    ConfigKey configKey(callingUid, key);
+    mProcessor->onDumpReport(configKey, getElapsedRealtimeNs(), getWallClockNs(),
+                             false /* include_current_bucket*/, true /* erase_data */,
+                             GET_DATA_CALLED, FAST, proto);
+}
+
 Status StatsService::getMetadata(vector<uint8_t>* output) {
     ENFORCE_UID(AID_SYSTEM);
 
@@ -1215,9 +1437,12 @@ bool StatsService::addConfigurationChecked(int uid, int64_t key, const vector<ui
     ConfigKey configKey(uid, key);
     StatsdConfig cfg;
     if (config.size() > 0) {  // If the config is empty, skip parsing.
+        const int64_t parseStartNs = getElapsedRealtimeNs();
         if (!cfg.ParseFromArray(&config[0], config.size())) {
             return false;
         }
+        StatsdStats::getInstance().noteConfigParsed(configKey,
+                                                    getElapsedRealtimeNs() - parseStartNs);
     }
     mConfigManager->UpdateConfig(configKey, cfg);
     return true;
@@ -35,6 +35,7 @@
 #include "packages/UidMap.h"
 #include "shell/ShellSubscriber.h"
 #include "statscompanion_util.h"
+#include "utils/MemoryPressureMonitor.h"
 #include "utils/MultiConditionTrigger.h"
 
 using namespace android;
@@ -66,6 +67,12 @@ public:
     /** The anomaly alarm registered with AlarmManager won't be updated by less than this. */
     const uint32_t MIN_DIFF_TO_UPDATE_REGISTERED_ALARM_SECS = 5;
 
+    /**
+     * The registered alarms won't be moved later, when alarms are removed, more often than this.
+     * Until then they fire early and are registered again.
+     */
+    const uint32_t MIN_INTERVAL_TO_DELAY_REGISTERED_ALARM_SECS = 60;
+
     virtual status_t dump(int fd, const char** args, uint32_t numArgs) override;
     virtual status_t handleShellCommand(int in, int out, int err, const char** argv,
                                         uint32_t argc) override;
@@ -109,6 +116,12 @@ public:
     virtual Status getDataFd(int64_t key, const int32_t callingUid,
                              const ScopedFileDescriptor& fd) override;
 
+    /**
+     * Binder call for clients to request a page of the data for this configuration key.
+     */
+    virtual Status getDataPage(int64_t key, const int32_t callingUid, int64_t cursor,
+                               vector<uint8_t>* output) override;
+
     /**
      * Binder call for clients to get metadata across all configs in statsd.
      */
@@ -259,6 +272,38 @@ public:
 
     const static int kStatsdInitDelaySecs = 90;
 
+    // Max number of events handed to StatsLogProcessor at once by readLogs().
+    static constexpr size_t kMaxLogEventBatchSize = 64;
+
+    // readLogs() does not wait for a batch to fill up, queued events are processed right away.
+    static constexpr std::chrono::nanoseconds kLogEventBatchMaxLatency{0};
+
+    // Number of worker threads used by StatsLogProcessor when sharded processing is enabled.
+    static constexpr size_t kEventProcessingShards = 2;
+
+    // Number of worker threads used by StatsPullerManager when parallel pull processing is
+    // enabled.
+    static constexpr size_t kPullDataProcessingThreads = 2;
+
+    // Number of scheduled pulls done at the same time when concurrent pulls are enabled.
+    static constexpr size_t kConcurrentPullThreads = 4;
+
+    // Period of the grid the pull alarms are aligned to when pull alarm alignment is enabled. It
+    // divides the 1 minute granularity of the pull intervals, so all the receivers are aligned.
+    static constexpr int64_t kPullAlarmGridNs = 10 * NS_PER_SEC;
+
+    // Max number of reports queued to be written to disk when async disk writes are enabled.
+    static constexpr size_t kMaxPendingDiskWrites = 8;
+
+    // Number of threads running the restricted metric queries, see setQueryThreads.
+    static constexpr size_t kQueryThreads = 2;
+
+    // Number of worker threads matching the events when parallel matching is enabled, and the
+    // number of SimpleAtomMatchers an atom needs to be matched on them, see
+    // MetricsManager::setParallelMatching.
+    static constexpr size_t kParallelMatchingThreads = 2;
+    static constexpr size_t kMinMatchersForParallelMatching = 64;
+
 private:
     /**
      * Load system properties at init.
@@ -305,6 +350,11 @@ private:
      */
     status_t cmd_config(int inFd, int outFd, int err, Vector<String8>& args);
 
+    /**
+     * Records the events to replay or prints the cost of a config replaying them.
+     */
+    status_t cmd_config_profile(int inFd, int outFd, int err, Vector<String8>& args);
+
     /**
      * Prints some basic stats to std out.
      */
@@ -366,6 +416,8 @@ private:
      */
     void getDataChecked(int64_t key, const int32_t callingUid, vector<uint8_t>* output);
 
+    void getDataChecked(int64_t key, const int32_t callingUid, ProtoOutputStream* proto);
+
     /**
      * Writes the value of args[uidArgIndex] into uid.
      * Returns whether the uid is reasonable (type uid_t) and whether
@@ -468,6 +520,9 @@ private:
 
     std::unique_ptr<std::thread> mLogsReaderThread;
 
+    // Set in Startup() if the statsd_memory_pressure_monitor flag is on and PSI is available.
+    std::unique_ptr<MemoryPressureMonitor> mMemoryPressureMonitor;
+
     MultiConditionTrigger mBootCompleteTrigger;
     static const inline string kBootCompleteTag = "BOOT_COMPLETE";
     static const inline string kUidMapReceivedTag = "UID_MAP";
@@ -19,6 +19,7 @@
 
 #include "anomaly/AlarmMonitor.h"
 #include "guardrail/StatsdStats.h"
+#include "stats_log_util.h"
 
 namespace android {
 namespace os {
@@ -27,11 +28,19 @@ namespace statsd {
 AlarmMonitor::AlarmMonitor(
         uint32_t minDiffToUpdateRegisteredAlarmTimeSec,
         const std::function<void(const shared_ptr<IStatsCompanionService>&, int64_t)>& updateAlarm,
-        const std::function<void(const shared_ptr<IStatsCompanionService>&)>& cancelAlarm)
+        const std::function<void(const shared_ptr<IStatsCompanionService>&)>& cancelAlarm,
+        uint32_t minIntervalToDelayRegisteredAlarmSec,
+        const std::function<uint32_t()>& getCurrentTimeSec)
     : mRegisteredAlarmTimeSec(0),
       mMinUpdateTimeSec(minDiffToUpdateRegisteredAlarmTimeSec),
+      mMinDelayIntervalSec(minIntervalToDelayRegisteredAlarmSec),
       mUpdateAlarm(updateAlarm),
-      mCancelAlarm(cancelAlarm) {}
+      mCancelAlarm(cancelAlarm),
+      mGetCurrentTimeSec(getCurrentTimeSec) {
+    if (mGetCurrentTimeSec == nullptr) {
+        mGetCurrentTimeSec = []() { return static_cast<uint32_t>(getElapsedRealtimeSec()); };
+    }
+}
 
 AlarmMonitor::~AlarmMonitor() {}
 
@@ -46,7 +55,7 @@ void AlarmMonitor::setStatsCompanionService(
     }
     VLOG("Creating link to statsCompanionService");
     const sp<const InternalAlarm> top = mPq.top();
-    if (top != nullptr) {
+    if (top != nullptr && !deferRegisteredAlarmUpdate_l(/*mustUpdate=*/true)) {
         updateRegisteredAlarmTime_l(top->timestampSec);
     }
 }
@@ -67,7 +76,9 @@ void AlarmMonitor::add(const sp<const InternalAlarm>& alarm) {
     mPq.push(alarm);
     if (mRegisteredAlarmTimeSec < 1 ||
         alarm->timestampSec + mMinUpdateTimeSec < mRegisteredAlarmTimeSec) {
-        updateRegisteredAlarmTime_l(alarm->timestampSec);
+        if (!deferRegisteredAlarmUpdate_l(/*mustUpdate=*/false)) {
+            updateRegisteredAlarmTime_l(alarm->timestampSec);
+        }
     }
 }
 
@@ -80,6 +91,13 @@ void AlarmMonitor::remove(const sp<const InternalAlarm>& alarm) {
     VLOG("Removing alarm with time %u", alarm->timestampSec);
     bool wasPresent = mPq.remove(alarm);
     if (!wasPresent) return;
+    if (deferRegisteredAlarmUpdate_l(/*mustUpdate=*/false)) {
+        return;
+    }
+    // Removing an alarm can only make the soonest alarm later, which can wait.
+    if (!canDelayRegisteredAlarm_l()) {
+        return;
+    }
     if (mPq.empty()) {
         VLOG("Queue is empty. Cancel any alarm.");
         cancelRegisteredAlarmTime_l();
@@ -105,8 +123,12 @@ unordered_set<sp<const InternalAlarm>, SpHash<InternalAlarm>> AlarmMonitor::popS
         oldAlarms.insert(t);
         mPq.pop();  // remove t
     }
-    // Always update registered alarm time (if anything has changed).
-    if (!oldAlarms.empty()) {
+    // Always update registered alarm time (if anything has changed, or if the registered alarm,
+    // left sooner than the soonest alarm, fired).
+    const bool registeredAlarmFired =
+            mRegisteredAlarmTimeSec > 0 && mRegisteredAlarmTimeSec <= timestampSec;
+    if ((!oldAlarms.empty() || registeredAlarmFired) &&
+        !deferRegisteredAlarmUpdate_l(/*mustUpdate=*/true)) {
         if (mPq.empty()) {
             VLOG("Queue is empty. Cancel any alarm.");
             cancelRegisteredAlarmTime_l();
@@ -118,15 +140,65 @@ unordered_set<sp<const InternalAlarm>, SpHash<InternalAlarm>> AlarmMonitor::popS
     return oldAlarms;
 }
 
+void AlarmMonitor::beginBatch() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mBatchDepth++;
+}
+
+void AlarmMonitor::endBatch() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (--mBatchDepth > 0 || !mHasDeferredUpdate) {
+        return;
+    }
+    const bool mustUpdate = mMustUpdate;
+    mHasDeferredUpdate = false;
+    mMustUpdate = false;
+    if (mPq.empty()) {
+        if (mustUpdate || (mRegisteredAlarmTimeSec > 0 && canDelayRegisteredAlarm_l())) {
+            VLOG("Queue is empty. Cancel any alarm.");
+            cancelRegisteredAlarmTime_l();
+        }
+        return;
+    }
+    // Same conditions as in add() and remove(), applied once to the soonest remaining alarm.
+    const uint32_t soonestAlarmTimeSec = mPq.top()->timestampSec;
+    if (mustUpdate || mRegisteredAlarmTimeSec < 1 ||
+        soonestAlarmTimeSec + mMinUpdateTimeSec < mRegisteredAlarmTimeSec ||
+        (soonestAlarmTimeSec > mRegisteredAlarmTimeSec + mMinUpdateTimeSec &&
+         canDelayRegisteredAlarm_l())) {
+        updateRegisteredAlarmTime_l(soonestAlarmTimeSec);
+    }
+}
+
+bool AlarmMonitor::deferRegisteredAlarmUpdate_l(bool mustUpdate) {
+    if (mBatchDepth == 0) {
+        return false;
+    }
+    mHasDeferredUpdate = true;
+    mMustUpdate |= mustUpdate;
+    return true;
+}
+
+bool AlarmMonitor::canDelayRegisteredAlarm_l() {
+    return mMinDelayIntervalSec == 0 ||
+           mGetCurrentTimeSec() >= mLastUpdateTimeSec + mMinDelayIntervalSec;
+}
+
 void AlarmMonitor::updateRegisteredAlarmTime_l(uint32_t timestampSec) {
     VLOG("Updating reg alarm time to %u", timestampSec);
     mRegisteredAlarmTimeSec = timestampSec;
+    if (mMinDelayIntervalSec > 0) {
+        mLastUpdateTimeSec = mGetCurrentTimeSec();
+    }
     mUpdateAlarm(mStatsCompanionService, secToMs(mRegisteredAlarmTimeSec));
 }
 
 void AlarmMonitor::cancelRegisteredAlarmTime_l() {
     VLOG("Cancelling reg alarm.");
     mRegisteredAlarmTimeSec = 0;
+    if (mMinDelayIntervalSec > 0) {
+        mLastUpdateTimeSec = mGetCurrentTimeSec();
+    }
     mCancelAlarm(mStatsCompanionService);
 }
 
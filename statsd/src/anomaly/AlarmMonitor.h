@@ -60,15 +60,24 @@ struct InternalAlarm : public RefBase {
  */
 class AlarmMonitor : public RefBase {
 public:
+    class Batch;
+
     /**
      * @param minDiffToUpdateRegisteredAlarmTimeSec If the soonest alarm differs
      * from the registered alarm by more than this amount, update the registered
      * alarm.
+     * @param minIntervalToDelayRegisteredAlarmSec Minimum time since the last update of the
+     * registered alarm before it is moved later again. Until then, the registered alarm is left
+     * sooner than the soonest alarm; if it fires, popSoonerThan() registers the soonest one.
+     * Updates to a sooner time are never delayed. 0 disables the limit.
+     * @param getCurrentTimeSec Returns the current time, in the clock of the alarm timestamps.
      */
     AlarmMonitor(uint32_t minDiffToUpdateRegisteredAlarmTimeSec,
                  const function<void(const shared_ptr<IStatsCompanionService>&, int64_t)>&
                          updateAlarm,
-                 const function<void(const shared_ptr<IStatsCompanionService>&)>& cancelAlarm);
+                 const function<void(const shared_ptr<IStatsCompanionService>&)>& cancelAlarm,
+                 uint32_t minIntervalToDelayRegisteredAlarmSec = 0,
+                 const function<uint32_t()>& getCurrentTimeSec = nullptr);
     ~AlarmMonitor();
 
     /**
@@ -93,7 +102,8 @@ public:
 
     /**
      * Returns and removes all alarms whose timestamp <= the given timestampSec.
-     * Always updates the registered alarm if return is non-empty.
+     * Always updates the registered alarm if return is non-empty, or if the registered alarm
+     * is <= timestampSec, i.e. it was registered sooner than the soonest alarm and fired.
      */
     unordered_set<sp<const InternalAlarm>, SpHash<InternalAlarm>> popSoonerThan(
             uint32_t timestampSec);
@@ -108,6 +118,17 @@ public:
     }
 
 private:
+    /**
+     * Defers the updates of the registered alarm until endBatch() is called as many times.
+     */
+    void beginBatch();
+
+    /**
+     * Registers the soonest alarm if the alarms changed enough since beginBatch() was first
+     * called, and the batch isn't nested.
+     */
+    void endBatch();
+
     std::mutex mLock;
 
     /**
@@ -134,6 +155,29 @@ private:
      */
     uint32_t mMinUpdateTimeSec;
 
+    /**
+     * Minimum time since mLastUpdateTimeSec before the registered alarm is moved later.
+     */
+    uint32_t mMinDelayIntervalSec;
+
+    /**
+     * Time at which the registered alarm was last updated or cancelled.
+     */
+    uint32_t mLastUpdateTimeSec = 0;
+
+    /**
+     * Number of beginBatch() calls not yet matched by endBatch(). While positive, the updates of
+     * the registered alarm are deferred.
+     */
+    int mBatchDepth = 0;
+
+    /**
+     * Whether an update of the registered alarm was deferred, and whether it has to be done even
+     * if the soonest alarm is within mMinUpdateTimeSec of mRegisteredAlarmTimeSec.
+     */
+    bool mHasDeferredUpdate = false;
+    bool mMustUpdate = false;
+
     /**
      * Updates the alarm registered with StatsCompanionService to the given time.
      * Also correspondingly updates mRegisteredAlarmTimeSec.
@@ -146,6 +190,19 @@ private:
      */
     void cancelRegisteredAlarmTime_l();
 
+    /**
+     * Returns true, and records the update, if updates of the registered alarm are deferred.
+     * @param mustUpdate whether the soonest alarm must be registered when the batch ends, even if
+     * it is close to mRegisteredAlarmTimeSec.
+     */
+    bool deferRegisteredAlarmUpdate_l(bool mustUpdate);
+
+    /**
+     * Returns whether the registered alarm can be moved later, or cancelled, now. Returns false
+     * if it was updated less than mMinDelayIntervalSec ago.
+     */
+    bool canDelayRegisteredAlarm_l();
+
     /** Converts uint32 timestamp in seconds to a Java long in msec. */
     int64_t secToMs(uint32_t timeSec);
 
@@ -155,6 +212,34 @@ private:
     // Callback function to cancel the alarm via StatsCompanionService.
     std::function<void(const shared_ptr<IStatsCompanionService>)> mCancelAlarm;
 
+    // Returns the current time, in the clock of the alarm timestamps.
+    std::function<uint32_t()> mGetCurrentTimeSec;
+};
+
+/**
+ * Coalesces the updates of the alarm registered by the AlarmMonitor while it exists, so that
+ * alarms added and removed in the meantime only cause the soonest remaining one to be registered,
+ * if it changed by more than minDiffToUpdateRegisteredAlarmTimeSec.
+ */
+class AlarmMonitor::Batch {
+public:
+    explicit Batch(const sp<AlarmMonitor>& alarmMonitor) : mAlarmMonitor(alarmMonitor) {
+        if (mAlarmMonitor != nullptr) {
+            mAlarmMonitor->beginBatch();
+        }
+    }
+
+    ~Batch() {
+        if (mAlarmMonitor != nullptr) {
+            mAlarmMonitor->endBatch();
+        }
+    }
+
+    Batch(const Batch&) = delete;
+    Batch& operator=(const Batch&) = delete;
+
+private:
+    const sp<AlarmMonitor> mAlarmMonitor;
 };
 
 }  // namespace statsd
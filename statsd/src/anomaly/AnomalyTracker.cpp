@@ -51,9 +51,6 @@ void AnomalyTracker::onConfigUpdated() {
 void AnomalyTracker::resetStorage() {
     VLOG("resetStorage() called.");
     mPastBuckets.clear();
-    // Excludes the current bucket.
-    mPastBuckets.resize(mNumOfPastBuckets);
-    mSumOverPastBuckets.clear();
 }
 
 size_t AnomalyTracker::index(int64_t bucketNum) const {
@@ -80,11 +77,19 @@ void AnomalyTracker::advanceMostRecentBucketTo(const int64_t bucketNum) {
         return;
     }
 
-    // Clear out space by emptying out old mPastBuckets[i] values and update mSumOverPastBuckets.
-    for (int64_t i = mMostRecentBucketNum + 1; i <= bucketNum; i++) {
-        const int idx = index(i);
-        subtractBucketFromSum(mPastBuckets[idx]);
-        mPastBuckets[idx] = nullptr;  // release (but not clear) the old bucket.
+    // Clear out space by emptying out the old values of each dimension.
+    for (auto it = mPastBuckets.begin(); it != mPastBuckets.end();) {
+        PastBucketValues& pastBucketValues = it->second;
+        for (int64_t i = mMostRecentBucketNum + 1; i <= bucketNum; i++) {
+            int64_t& value = pastBucketValues.values[index(i)];
+            pastBucketValues.sum -= value;
+            value = 0;
+        }
+        if (pastBucketValues.sum == 0) {
+            it = mPastBuckets.erase(it);
+        } else {
+            it++;
+        }
     }
     mMostRecentBucketNum = bucketNum;
 }
@@ -97,25 +102,11 @@ void AnomalyTracker::addPastBucket(const MetricDimensionKey& key, const int64_t
         return;
     }
 
-    const int bucketIndex = index(bucketNum);
-    if (bucketNum <= mMostRecentBucketNum && (mPastBuckets[bucketIndex] != nullptr)) {
-        // We need to insert into an already existing past bucket.
-        std::shared_ptr<DimToValMap>& bucket = mPastBuckets[bucketIndex];
-        auto itr = bucket->find(key);
-        if (itr != bucket->end()) {
-            // Old entry already exists; update it.
-            subtractValueFromSum(key, itr->second);
-            itr->second = bucketValue;
-        } else {
-            bucket->insert({key, bucketValue});
-        }
-        mSumOverPastBuckets[key] += bucketValue;
-    } else {
-        // Bucket does not exist yet (in future or was never made), so we must make it.
-        std::shared_ptr<DimToValMap> bucket = std::make_shared<DimToValMap>();
-        bucket->insert({key, bucketValue});
-        addPastBucket(bucket, bucketNum);
+    if (bucketNum > mMostRecentBucketNum) {
+        // Clear space for the new bucket to be at bucketNum.
+        advanceMostRecentBucketTo(bucketNum);
     }
+    setPastBucketValue(key, bucketNum, bucketValue);
 }
 
 void AnomalyTracker::addPastBucket(const std::shared_ptr<DimToValMap>& bucket,
@@ -127,44 +118,50 @@ void AnomalyTracker::addPastBucket(const std::shared_ptr<DimToValMap>& bucket,
     }
 
     if (bucketNum <= mMostRecentBucketNum) {
-        // We are updating an old bucket, not adding a new one.
-        subtractBucketFromSum(mPastBuckets[index(bucketNum)]);
+        // We are replacing an old bucket, not adding a new one.
+        clearPastBucket(bucketNum);
     } else {
         // Clear space for the new bucket to be at bucketNum.
         advanceMostRecentBucketTo(bucketNum);
     }
-    mPastBuckets[index(bucketNum)] = bucket;
-    addBucketToSum(bucket);
-}
-
-void AnomalyTracker::subtractBucketFromSum(const shared_ptr<DimToValMap>& bucket) {
     if (bucket == nullptr) {
         return;
     }
-    for (const auto& keyValuePair : *bucket) {
-        subtractValueFromSum(keyValuePair.first, keyValuePair.second);
+    for (const auto& [key, bucketValue] : *bucket) {
+        setPastBucketValue(key, bucketNum, bucketValue);
     }
 }
 
-void AnomalyTracker::subtractValueFromSum(const MetricDimensionKey& key,
-                                          const int64_t bucketValue) {
-    auto itr = mSumOverPastBuckets.find(key);
-    if (itr == mSumOverPastBuckets.end()) {
-        return;
+void AnomalyTracker::setPastBucketValue(const MetricDimensionKey& key, const int64_t bucketNum,
+                                        const int64_t bucketValue) {
+    auto it = mPastBuckets.find(key);
+    if (it == mPastBuckets.end()) {
+        if (bucketValue == 0) {
+            return;
+        }
+        it = mPastBuckets.try_emplace(key).first;
+        it->second.values.resize(mNumOfPastBuckets);
     }
-    itr->second -= bucketValue;
-    if (itr->second == 0) {
-        mSumOverPastBuckets.erase(itr);
+    PastBucketValues& pastBucketValues = it->second;
+    int64_t& value = pastBucketValues.values[index(bucketNum)];
+    pastBucketValues.sum += bucketValue - value;
+    value = bucketValue;
+    if (pastBucketValues.sum == 0) {
+        mPastBuckets.erase(it);
     }
 }
 
-void AnomalyTracker::addBucketToSum(const shared_ptr<DimToValMap>& bucket) {
-    if (bucket == nullptr) {
-        return;
-    }
-    // For each dimension present in the bucket, add its value to its corresponding sum.
-    for (const auto& keyValuePair : *bucket) {
-        mSumOverPastBuckets[keyValuePair.first] += keyValuePair.second;
+void AnomalyTracker::clearPastBucket(const int64_t bucketNum) {
+    const size_t bucketIndex = index(bucketNum);
+    for (auto it = mPastBuckets.begin(); it != mPastBuckets.end();) {
+        PastBucketValues& pastBucketValues = it->second;
+        pastBucketValues.sum -= pastBucketValues.values[bucketIndex];
+        pastBucketValues.values[bucketIndex] = 0;
+        if (pastBucketValues.sum == 0) {
+            it = mPastBuckets.erase(it);
+        } else {
+            it++;
+        }
     }
 }
 
@@ -176,18 +173,14 @@ int64_t AnomalyTracker::getPastBucketValue(const MetricDimensionKey& key,
         return 0;
     }
 
-    const auto& bucket = mPastBuckets[index(bucketNum)];
-    if (bucket == nullptr) {
-        return 0;
-    }
-    const auto& itr = bucket->find(key);
-    return itr == bucket->end() ? 0 : itr->second;
+    const auto& itr = mPastBuckets.find(key);
+    return itr == mPastBuckets.end() ? 0 : itr->second.values[index(bucketNum)];
 }
 
 int64_t AnomalyTracker::getSumOverPastBuckets(const MetricDimensionKey& key) const {
-    const auto& itr = mSumOverPastBuckets.find(key);
-    if (itr != mSumOverPastBuckets.end()) {
-        return itr->second;
+    const auto& itr = mPastBuckets.find(key);
+    if (itr != mPastBuckets.end()) {
+        return itr->second.sum;
     }
     return 0;
 }
@@ -226,6 +219,7 @@ void AnomalyTracker::declareAnomaly(const int64_t timestampNs, int64_t metricId,
     if (mAlert.has_refractory_period_secs()) {
         mRefractoryPeriodEndsSec[key] = ((timestampNs + NS_PER_SEC - 1) / NS_PER_SEC) // round up
                                         + mAlert.refractory_period_secs();
+        mRefractoryPeriodUpdates++;
         // TODO(b/110563466): If we had access to the bucket_size_millis, consider
         // calling resetStorage()
         // if (mAlert.refractory_period_secs() > mNumOfPastBuckets * bucketSizeNs) {resetStorage();}
@@ -324,6 +318,7 @@ void AnomalyTracker::loadAlertMetadata(
         int32_t refractoryPeriodEndsSec = (int32_t) keyedData.last_refractory_ends_sec() -
                 currentWallClockTimeNs / NS_PER_SEC + systemElapsedTimeNs / NS_PER_SEC;
         mRefractoryPeriodEndsSec[metricKey] = refractoryPeriodEndsSec;
+        mRefractoryPeriodUpdates++;
     }
 }
 
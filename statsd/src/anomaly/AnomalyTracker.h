@@ -104,6 +104,12 @@ public:
         return it != mRefractoryPeriodEndsSec.end() ? it->second : 0;
     }
 
+    // Number of times a refractory period was started or loaded, so that the metadata written
+    // by writeAlertMetadataToProto() is only written again when it changed.
+    inline int64_t getRefractoryPeriodUpdates() const {
+        return mRefractoryPeriodUpdates;
+    }
+
     // Returns the (constant) number of past buckets this anomaly tracker can store.
     inline int getNumOfPastBuckets() const {
         return mNumOfPastBuckets;
@@ -169,13 +175,19 @@ protected:
     // for the anomaly detection (since the current bucket is not in the past).
     const int mNumOfPastBuckets;
 
-    // Values for each of the past mNumOfPastBuckets buckets. Always of size mNumOfPastBuckets.
-    // mPastBuckets[i] can be null, meaning that no data is present in that bucket.
-    std::vector<shared_ptr<DimToValMap>> mPastBuckets;
+    // Values of a dimension in the past mNumOfPastBuckets buckets.
+    struct PastBucketValues {
+        // Indexed by index(bucketNum), of size mNumOfPastBuckets. 0 if the dimension has no data
+        // in that bucket.
+        std::vector<int64_t> values;
+
+        // Cached sum of values.
+        int64_t sum = 0;
+    };
 
-    // Cached sum over all existing buckets in mPastBuckets.
-    // Its buckets never contain entries of 0.
-    DimToValMap mSumOverPastBuckets;
+    // Past bucket values of each dimension. Only holds the dimensions with a non-zero sum, so
+    // advancing to the next bucket only goes over the dimensions with recent data.
+    FlatHashMap<MetricDimensionKey, PastBucketValues> mPastBuckets;
 
     // The bucket number of the last added bucket.
     int64_t mMostRecentBucketNum = -1;
@@ -184,22 +196,21 @@ protected:
     // declared for that dimension) ends, in seconds. From this moment and onwards, anomalies
     // can be declared again.
     // Entries may be, but are not guaranteed to be, removed after the period is finished.
-    unordered_map<MetricDimensionKey, uint32_t> mRefractoryPeriodEndsSec;
+    FlatHashMap<MetricDimensionKey, uint32_t> mRefractoryPeriodEndsSec;
+
+    int64_t mRefractoryPeriodUpdates = 0;
 
     // Advances mMostRecentBucketNum to bucketNum, deleting any data that is now too old.
     // Specifically, since it is now too old, removes the data for
     //   [mMostRecentBucketNum - mNumOfPastBuckets + 1, bucketNum - mNumOfPastBuckets].
     void advanceMostRecentBucketTo(int64_t bucketNum);
 
-    // Add the information in the given bucket to mSumOverPastBuckets.
-    void addBucketToSum(const shared_ptr<DimToValMap>& bucket);
-
-    // Subtract the information in the given bucket from mSumOverPastBuckets
-    // and remove any items with value 0.
-    void subtractBucketFromSum(const shared_ptr<DimToValMap>& bucket);
+    // Sets the value of the dimension in the past bucket at bucketNum, which must be held in
+    // mPastBuckets. Erases the dimension if its sum is now 0.
+    void setPastBucketValue(const MetricDimensionKey& key, int64_t bucketNum, int64_t bucketValue);
 
-    // From mSumOverPastBuckets[key], subtracts bucketValue, removing it if it is now 0.
-    void subtractValueFromSum(const MetricDimensionKey& key, int64_t bucketValue);
+    // Sets the values of all dimensions in the past bucket at bucketNum to 0.
+    void clearPastBucket(int64_t bucketNum);
 
     // Returns true if in the refractory period, else false.
     bool isInRefractoryPeriod(int64_t timestampNs, const MetricDimensionKey& key) const;
@@ -45,6 +45,11 @@ void DurationAnomalyTracker::startAlarm(const MetricDimensionKey& dimensionKey,
     }
 
     auto itr = mAlarms.find(dimensionKey);
+    if (itr != mAlarms.end() && itr->second != nullptr &&
+        itr->second->timestampSec == timestampSec) {
+        // The alarm is already set for that second.
+        return;
+    }
     if (itr != mAlarms.end() && mAlarmMonitor != nullptr) {
         mAlarmMonitor->remove(itr->second);
     }
@@ -19,14 +19,110 @@
 
 #include "subscriber_util.h"
 
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+
 #include "external/Perfetto.h"
 #include "subscriber/IncidentdReporter.h"
 #include "subscriber/SubscriberReporter.h"
+#include "utils/ShardWorkerPool.h"
 
 namespace android {
 namespace os {
 namespace statsd {
 
+namespace {
+
+// Guards the subscriber thread and the pending subscribers, see setAsyncSubscribers.
+std::mutex gSubscriberMutex;
+std::shared_ptr<ShardWorkerPool> gSubscriberExecutor;
+// <ConfigKey, subscription id> of the subscribers with an action posted but not completed.
+std::set<std::pair<ConfigKey, int64_t>> gPendingSubscribers;
+
+void informSubscriber(const Subscription& subscription, int64_t ruleId, int64_t metricId,
+                      const MetricDimensionKey& dimensionKey, int64_t metricValue,
+                      const ConfigKey& configKey) {
+    switch (subscription.subscriber_information_case()) {
+        case Subscription::SubscriberInformationCase::kIncidentdDetails:
+            if (!GenerateIncidentReport(subscription.incidentd_details(), ruleId, metricId,
+                                        dimensionKey, metricValue, configKey)) {
+                ALOGW("Failed to generate incident report.");
+            }
+            break;
+        case Subscription::SubscriberInformationCase::kPerfettoDetails:
+            if (!CollectPerfettoTraceAndUploadToDropbox(subscription.perfetto_details(),
+                                                        subscription.id(), ruleId, configKey)) {
+                ALOGW("Failed to generate perfetto traces.");
+            }
+            break;
+        case Subscription::SubscriberInformationCase::kBroadcastSubscriberDetails:
+            SubscriberReporter::getInstance().alertBroadcastSubscriber(configKey, subscription,
+                                                                       dimensionKey);
+            break;
+        default:
+            break;
+    }
+}
+
+// Returns false if the subscriber thread is disabled. Otherwise posts the action, unless the
+// subscriber already has one pending, and returns true.
+bool postSubscriberAction(const Subscription& subscription, int64_t ruleId, int64_t metricId,
+                          const MetricDimensionKey& dimensionKey, int64_t metricValue,
+                          const ConfigKey& configKey) {
+    std::lock_guard<std::mutex> lock(gSubscriberMutex);
+    if (gSubscriberExecutor == nullptr) {
+        return false;
+    }
+    std::pair<ConfigKey, int64_t> subscriber(configKey, subscription.id());
+    if (!gPendingSubscribers.insert(subscriber).second) {
+        ALOGW("Subscriber %lld of config %s is busy, dropping alert %lld",
+              (long long)subscription.id(), configKey.ToString().c_str(), (long long)ruleId);
+        return true;
+    }
+    // The subscription is copied since its tracker may be destroyed by a config update before the
+    // action runs.
+    gSubscriberExecutor->post(0, [subscription, ruleId, metricId, dimensionKey, metricValue,
+                                  subscriber = std::move(subscriber)] {
+        informSubscriber(subscription, ruleId, metricId, dimensionKey, metricValue,
+                         subscriber.first);
+        std::lock_guard<std::mutex> lock(gSubscriberMutex);
+        gPendingSubscribers.erase(subscriber);
+    });
+    return true;
+}
+
+}  // namespace
+
+void setAsyncSubscribers(bool asyncSubscribers) {
+    std::shared_ptr<ShardWorkerPool> oldExecutor;
+    {
+        std::lock_guard<std::mutex> lock(gSubscriberMutex);
+        if (asyncSubscribers == (gSubscriberExecutor != nullptr)) {
+            return;
+        }
+        oldExecutor = std::move(gSubscriberExecutor);
+        if (asyncSubscribers) {
+            gSubscriberExecutor = std::make_shared<ShardWorkerPool>(1);
+        }
+    }
+    // The pending actions are run when the old executor is destroyed, outside of the lock since
+    // they take it when they complete.
+    oldExecutor = nullptr;
+}
+
+void waitForSubscribers() {
+    std::shared_ptr<ShardWorkerPool> executor;
+    {
+        std::lock_guard<std::mutex> lock(gSubscriberMutex);
+        executor = gSubscriberExecutor;
+    }
+    if (executor != nullptr) {
+        executor->waitForIdle();
+    }
+}
+
 void triggerSubscribers(const int64_t ruleId, const int64_t metricId,
                         const MetricDimensionKey& dimensionKey, int64_t metricValue,
                         const ConfigKey& configKey,
@@ -45,25 +141,9 @@ void triggerSubscribers(const int64_t ruleId, const int64_t metricId,
             ALOGI("Fate decided that a subscriber would not be informed.");
             continue;
         }
-        switch (subscription.subscriber_information_case()) {
-            case Subscription::SubscriberInformationCase::kIncidentdDetails:
-                if (!GenerateIncidentReport(subscription.incidentd_details(), ruleId, metricId,
-                                            dimensionKey, metricValue, configKey)) {
-                    ALOGW("Failed to generate incident report.");
-                }
-                break;
-            case Subscription::SubscriberInformationCase::kPerfettoDetails:
-                if (!CollectPerfettoTraceAndUploadToDropbox(subscription.perfetto_details(),
-                                                            subscription.id(), ruleId, configKey)) {
-                    ALOGW("Failed to generate perfetto traces.");
-                }
-                break;
-            case Subscription::SubscriberInformationCase::kBroadcastSubscriberDetails:
-                SubscriberReporter::getInstance().alertBroadcastSubscriber(configKey, subscription,
-                                                                           dimensionKey);
-                break;
-            default:
-                break;
+        if (!postSubscriberAction(subscription, ruleId, metricId, dimensionKey, metricValue,
+                                  configKey)) {
+            informSubscriber(subscription, ruleId, metricId, dimensionKey, metricValue, configKey);
         }
     }
 }
@@ -24,10 +24,25 @@ namespace android {
 namespace os {
 namespace statsd {
 
+/**
+ * Informs the subscriptions that the alert fired, e.g. through incidentd, perfetto or a broadcast.
+ * The actions run on the subscriber thread if enabled, see setAsyncSubscribers, or on the calling
+ * thread otherwise.
+ */
 void triggerSubscribers(const int64_t ruleId, int64_t metricId,
                         const MetricDimensionKey& dimensionKey, int64_t metricValue,
                         const ConfigKey& configKey, const std::vector<Subscription>& subscriptions);
 
+/**
+ * Enables running the subscriber actions on a dedicated thread, so that a burst of alerts does not
+ * stall the event processing. A subscriber with an action still pending drops the alerts that
+ * fire meanwhile. Disabling runs the pending actions and stops the thread.
+ */
+void setAsyncSubscribers(bool asyncSubscribers);
+
+/* Blocks until the subscriber actions posted before the call are completed. */
+void waitForSubscribers();
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
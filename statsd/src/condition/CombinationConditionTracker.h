@@ -54,7 +54,7 @@ public:
                         std::vector<ConditionState>& conditionCache) const override;
 
     // Only one child predicate can have dimension.
-    const std::set<HashableDimensionKey>* getChangedToTrueDimensions(
+    const std::unordered_set<HashableDimensionKey>* getChangedToTrueDimensions(
             const std::vector<sp<ConditionTracker>>& allConditions) const override {
         for (const auto& child : mChildren) {
             auto result = allConditions[child]->getChangedToTrueDimensions(allConditions);
@@ -66,7 +66,7 @@ public:
     }
 
     // Only one child predicate can have dimension.
-    const std::set<HashableDimensionKey>* getChangedToFalseDimensions(
+    const std::unordered_set<HashableDimensionKey>* getChangedToFalseDimensions(
             const std::vector<sp<ConditionTracker>>& allConditions) const override {
         for (const auto& child : mChildren) {
             auto result = allConditions[child]->getChangedToFalseDimensions(allConditions);
@@ -79,6 +79,10 @@ public:
 
     bool IsSimpleCondition() const  override { return false; }
 
+    const std::vector<int>& getChildren() const override {
+        return mChildren;
+    }
+
     bool IsChangedDimensionTrackable() const  override {
         return mLogicalOperation == LogicalOperation::AND && mSlicedChildren.size() == 1;
     }
@@ -87,7 +91,7 @@ public:
         const std::vector<sp<ConditionTracker>>& allConditions,
         const vector<Matcher>& dimensions) const override;
 
-    const std::map<HashableDimensionKey, int>* getSlicedDimensionMap(
+    const std::unordered_map<HashableDimensionKey, int>* getSlicedDimensionMap(
             const std::vector<sp<ConditionTracker>>& allConditions) const override {
         if (mSlicedChildren.size() == 1) {
             return allConditions[mSlicedChildren.front()]->getSlicedDimensionMap(allConditions);
@@ -24,6 +24,7 @@
 #include <utils/RefBase.h>
 
 #include <unordered_map>
+#include <unordered_set>
 
 namespace android {
 namespace os {
@@ -124,9 +125,9 @@ public:
         return mSliced;
     }
 
-    virtual const std::set<HashableDimensionKey>* getChangedToTrueDimensions(
+    virtual const std::unordered_set<HashableDimensionKey>* getChangedToTrueDimensions(
             const std::vector<sp<ConditionTracker>>& allConditions) const = 0;
-    virtual const std::set<HashableDimensionKey>* getChangedToFalseDimensions(
+    virtual const std::unordered_set<HashableDimensionKey>* getChangedToFalseDimensions(
             const std::vector<sp<ConditionTracker>>& allConditions) const = 0;
 
     inline int64_t getConditionId() const {
@@ -137,13 +138,16 @@ public:
         return mProtoHash;
     }
 
-    virtual const std::map<HashableDimensionKey, int>* getSlicedDimensionMap(
+    virtual const std::unordered_map<HashableDimensionKey, int>* getSlicedDimensionMap(
             const std::vector<sp<ConditionTracker>>& allConditions) const = 0;
 
     virtual bool IsChangedDimensionTrackable() const = 0;
 
     virtual bool IsSimpleCondition() const = 0;
 
+    // Indices of the conditions this condition is combined from, empty for simple conditions.
+    virtual const std::vector<int>& getChildren() const = 0;
+
     virtual bool equalOutputDimensions(
         const std::vector<sp<ConditionTracker>>& allConditions,
         const vector<Matcher>& dimensions) const = 0;
@@ -31,12 +31,12 @@ ConditionState ConditionWizard::query(const int index, const ConditionKey& param
     return cache[index];
 }
 
-const set<HashableDimensionKey>* ConditionWizard::getChangedToTrueDimensions(
+const std::unordered_set<HashableDimensionKey>* ConditionWizard::getChangedToTrueDimensions(
         const int index) const {
     return mAllConditions[index]->getChangedToTrueDimensions(mAllConditions);
 }
 
-const set<HashableDimensionKey>* ConditionWizard::getChangedToFalseDimensions(
+const std::unordered_set<HashableDimensionKey>* ConditionWizard::getChangedToFalseDimensions(
         const int index) const {
     return mAllConditions[index]->getChangedToFalseDimensions(mAllConditions);
 }
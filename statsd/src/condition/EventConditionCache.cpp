@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "condition/EventConditionCache.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+thread_local EventConditionCache* sCurrentCache = nullptr;
+
+}  // namespace
+
+EventConditionCache::Scope::Scope(const bool enabled) : mPrevious(sCurrentCache) {
+    sCurrentCache = enabled ? &mCache : nullptr;
+}
+
+EventConditionCache::Scope::~Scope() {
+    sCurrentCache = mPrevious;
+}
+
+EventConditionCache* EventConditionCache::get() {
+    return sCurrentCache;
+}
+
+const EventConditionCache::Entry* EventConditionCache::find(
+        const LogEvent& event, const int conditionIndex, const bool isPartialLink,
+        const std::vector<Metric2Condition>& links) const {
+    for (const Entry& entry : mEntries) {
+        if (entry.event == &event && entry.conditionIndex == conditionIndex &&
+            entry.isPartialLink == isPartialLink &&
+            (entry.links == &links || *entry.links == links)) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+const EventConditionCache::Entry& EventConditionCache::insert(
+        const LogEvent& event, const int conditionIndex, const bool isPartialLink,
+        const std::vector<Metric2Condition>& links, ConditionKey&& conditionKey,
+        const ConditionState conditionState) {
+    return mEntries.emplace_back(Entry{&event, conditionIndex, isPartialLink, &links,
+                                       std::move(conditionKey), conditionState});
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "HashableDimensionKey.h"
+#include "condition/condition_util.h"
+#include "logd/LogEvent.h"
+#include "stats_util.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Sliced condition query results of the metrics for the event being dispatched to them.
+ *
+ * Metrics linking the same condition with the same links build the same condition key from an
+ * event and get the same result from the ConditionWizard. The first of these metrics stores the
+ * key and result here, and the others reuse them instead of building the key and querying the
+ * condition again.
+ *
+ * The cache is only available on the thread dispatching an event to the metrics, while a Scope
+ * exists. Condition states don't change while the metrics process the event. Metrics processing
+ * pulled data on other threads find no cache and query the condition as usual. Pulled events are
+ * matched from local copies whose addresses get reused, so pulls disable the cache with a Scope
+ * of their own.
+ */
+class EventConditionCache {
+public:
+    class Scope;
+
+    struct Entry {
+        const LogEvent* event;
+        int conditionIndex;
+        bool isPartialLink;
+        const std::vector<Metric2Condition>* links;
+        ConditionKey conditionKey;
+        ConditionState conditionState;
+    };
+
+    // Cache of the Scope on the current thread, nullptr if there is none.
+    static EventConditionCache* get();
+
+    const Entry* find(const LogEvent& event, const int conditionIndex, const bool isPartialLink,
+                      const std::vector<Metric2Condition>& links) const;
+
+    // Entries stay valid until the Scope is destroyed.
+    const Entry& insert(const LogEvent& event, const int conditionIndex, const bool isPartialLink,
+                        const std::vector<Metric2Condition>& links, ConditionKey&& conditionKey,
+                        const ConditionState conditionState);
+
+private:
+    // Few metrics with sliced conditions process each event, a linear scan is enough.
+    std::deque<Entry> mEntries;
+};
+
+// Makes a cache available to the current thread while it exists.
+class EventConditionCache::Scope {
+public:
+    // A disabled Scope hides the cache of the enclosing Scope until it is destroyed.
+    explicit Scope(const bool enabled = true);
+
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    EventConditionCache* mPrevious;
+    EventConditionCache mCache;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "condition/SharedConditionStates.h"
+
+#include <algorithm>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using std::shared_ptr;
+using std::string;
+
+shared_ptr<SimpleConditionState> SharedConditionStates::join(
+        const ConfigKey& key, const string& sharingKey,
+        const shared_ptr<SimpleConditionState>& state) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Group& group = mGroups[key.GetUid()][sharingKey];
+    if (std::find(group.configIds.begin(), group.configIds.end(), key.GetId()) !=
+        group.configIds.end()) {
+        return nullptr;
+    }
+    if (group.state == nullptr) {
+        group.state = state;
+    }
+    group.configIds.push_back(key.GetId());
+    VLOG("Config %s joined a condition group of %zu configs", key.ToString().c_str(),
+         group.configIds.size());
+    return group.state;
+}
+
+void SharedConditionStates::leave(const ConfigKey& key, const string& sharingKey) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto uidIt = mGroups.find(key.GetUid());
+    if (uidIt == mGroups.end()) {
+        return;
+    }
+    auto groupIt = uidIt->second.find(sharingKey);
+    if (groupIt == uidIt->second.end()) {
+        return;
+    }
+    std::vector<int64_t>& configIds = groupIt->second.configIds;
+    auto it = std::find(configIds.begin(), configIds.end(), key.GetId());
+    if (it != configIds.end()) {
+        configIds.erase(it);
+    }
+    if (configIds.empty()) {
+        uidIt->second.erase(groupIt);
+        if (uidIt->second.empty()) {
+            mGroups.erase(uidIt);
+        }
+    }
+}
+
+size_t SharedConditionStates::getGroupCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    size_t count = 0;
+    for (const auto& [uid, groups] : mGroups) {
+        count += groups.size();
+    }
+    return count;
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <utils/RefBase.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "HashableDimensionKey.h"
+#include "condition/condition_util.h"
+#include "config/ConfigKey.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+// State of a SimpleConditionTracker, which may be shared with the trackers of other configs.
+struct SimpleConditionState {
+    ConditionState initialValue;
+
+    std::unordered_map<HashableDimensionKey, int> slicedConditionState;
+
+    std::unordered_set<HashableDimensionKey> lastChangedToTrueDimensions;
+    std::unordered_set<HashableDimensionKey> lastChangedToFalseDimensions;
+
+    // Result of the last evaluation of the state, and the EventMatcherCache dispatch id of the
+    // event evaluated. 0 if the event wasn't dispatched within a Scope.
+    uint64_t evaluatedDispatchId = 0;
+    ConditionState evaluatedCondition = ConditionState::kNotEvaluated;
+    bool evaluatedChanged = false;
+};
+
+/**
+ * States of the SimpleConditionTrackers shared between the configs of the same owner.
+ *
+ * Owners often split their metrics into several configs for access control, and the configs carry
+ * the same predicates. The trackers of identical predicates of these configs share one state: the
+ * first tracker to receive an event evaluates it, and the trackers of the other configs reuse the
+ * result instead of evaluating the event again. The metrics of each config still get the result
+ * from the trackers of their own config.
+ *
+ * The sharing key identifies the predicate, the matchers it uses, and all that decides which
+ * events the configs receive. A tracker joining a group takes its current state over. Only one
+ * tracker per config is in a group, so a config replacing itself starts from a new state.
+ */
+class SharedConditionStates : public virtual RefBase {
+public:
+    // Returns the state shared with the group of the sharing key, which is the given state if the
+    // group is new. Returns nullptr if the config already has a tracker in the group.
+    std::shared_ptr<SimpleConditionState> join(const ConfigKey& key, const std::string& sharingKey,
+                                               const std::shared_ptr<SimpleConditionState>& state);
+
+    void leave(const ConfigKey& key, const std::string& sharingKey);
+
+    size_t getGroupCount() const;
+
+private:
+    struct Group {
+        std::shared_ptr<SimpleConditionState> state;
+        std::vector<int64_t> configIds;
+    };
+
+    mutable std::mutex mMutex;
+
+    // Groups by owner uid, then by sharing key.
+    std::unordered_map<int, std::unordered_map<std::string, Group>> mGroups;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -19,6 +19,7 @@
 
 #include "SimpleConditionTracker.h"
 #include "guardrail/StatsdStats.h"
+#include "matchers/EventMatcherCache.h"
 
 namespace android {
 namespace os {
@@ -32,7 +33,8 @@ SimpleConditionTracker::SimpleConditionTracker(
         const unordered_map<int64_t, int>& atomMatchingTrackerMap)
     : ConditionTracker(id, index, protoHash),
       mConfigKey(key),
-      mContainANYPositionInInternalDimensions(false) {
+      mContainANYPositionInInternalDimensions(false),
+      mState(std::make_shared<SimpleConditionState>()) {
     VLOG("creating SimpleConditionTracker %lld", (long long)mConditionId);
     mCountNesting = simplePredicate.count_nesting();
 
@@ -46,14 +48,39 @@ SimpleConditionTracker::SimpleConditionTracker(
         mContainANYPositionInInternalDimensions = HasPositionANY(simplePredicate.dimensions());
     }
     // If an initial value isn't specified, default to false if sliced and unknown if not sliced.
-    mInitialValue = simplePredicate.has_initial_value()
-                            ? convertInitialValue(simplePredicate.initial_value())
-                            : mSliced ? ConditionState::kFalse : ConditionState::kUnknown;
+    mState->initialValue = simplePredicate.has_initial_value()
+                                   ? convertInitialValue(simplePredicate.initial_value())
+                                   : mSliced ? ConditionState::kFalse : ConditionState::kUnknown;
     mInitialized = true;
 }
 
 SimpleConditionTracker::~SimpleConditionTracker() {
     VLOG("~SimpleConditionTracker()");
+    if (mSharedStates != nullptr) {
+        mSharedStates->leave(mConfigKey, mSharingKey);
+    }
+}
+
+void SimpleConditionTracker::shareState(const sp<SharedConditionStates>& sharedStates,
+                                        const std::string& sharingKey) {
+    std::shared_ptr<SimpleConditionState> state =
+            sharedStates->join(mConfigKey, sharingKey, mState);
+    if (state == nullptr) {
+        return;
+    }
+    mState = std::move(state);
+    mSharedStates = sharedStates;
+    mSharingKey = sharingKey;
+}
+
+void SimpleConditionTracker::stopSharing() {
+    if (mSharedStates == nullptr) {
+        return;
+    }
+    mState = std::make_shared<SimpleConditionState>(*mState);
+    mSharedStates->leave(mConfigKey, mSharingKey);
+    mSharedStates = nullptr;
+    mSharingKey.clear();
 }
 
 optional<InvalidConfigReason> SimpleConditionTracker::init(
@@ -82,6 +109,8 @@ optional<InvalidConfigReason> SimpleConditionTracker::onConfigUpdated(
         const unordered_map<int64_t, int>& conditionTrackerMap) {
     ConditionTracker::onConfigUpdated(allConditionProtos, index, allConditionTrackers,
                                       atomMatchingTrackerMap, conditionTrackerMap);
+    // The update may change the events the config receives.
+    stopSharing();
     setMatcherIndices(allConditionProtos[index].simple_predicate(), atomMatchingTrackerMap);
     return nullopt;
 }
@@ -130,16 +159,16 @@ void SimpleConditionTracker::setMatcherIndices(
 
 void SimpleConditionTracker::dumpState() {
     VLOG("%lld DUMP:", (long long)mConditionId);
-    for (const auto& pair : mSlicedConditionState) {
+    for (const auto& pair : mState->slicedConditionState) {
         VLOG("\t%s : %d", pair.first.toString().c_str(), pair.second);
     }
 
     VLOG("Changed to true keys: \n");
-    for (const auto& key : mLastChangedToTrueDimensions) {
+    for (const auto& key : mState->lastChangedToTrueDimensions) {
         VLOG("%s", key.toString().c_str());
     }
     VLOG("Changed to false keys: \n");
-    for (const auto& key : mLastChangedToFalseDimensions) {
+    for (const auto& key : mState->lastChangedToFalseDimensions) {
         VLOG("%s", key.toString().c_str());
     }
 }
@@ -148,30 +177,29 @@ void SimpleConditionTracker::handleStopAll(std::vector<ConditionState>& conditio
                                            std::vector<uint8_t>& conditionChangedCache) {
     // Unless the default condition is false, and there was nothing started, otherwise we have
     // triggered a condition change.
-    conditionChangedCache[mIndex] =
-            (mInitialValue == ConditionState::kFalse && mSlicedConditionState.empty()) ? false
-                                                                                           : true;
+    conditionChangedCache[mIndex] = !(mState->initialValue == ConditionState::kFalse &&
+                                      mState->slicedConditionState.empty());
 
-    for (const auto& cond : mSlicedConditionState) {
+    for (const auto& cond : mState->slicedConditionState) {
         if (cond.second > 0) {
-            mLastChangedToFalseDimensions.insert(cond.first);
+            mState->lastChangedToFalseDimensions.insert(cond.first);
         }
     }
 
     // After StopAll, we know everything has stopped. From now on, default condition is false.
-    mInitialValue = ConditionState::kFalse;
-    mSlicedConditionState.clear();
+    mState->initialValue = ConditionState::kFalse;
+    mState->slicedConditionState.clear();
     conditionCache[mIndex] = ConditionState::kFalse;
 }
 
 bool SimpleConditionTracker::hitGuardRail(const HashableDimensionKey& newKey) const {
-    if (!mSliced || mSlicedConditionState.find(newKey) != mSlicedConditionState.end()) {
+    if (!mSliced || mState->slicedConditionState.count(newKey) > 0) {
         // if the condition is not sliced or the key is not new, we are good!
         return false;
     }
     // 1. Report the tuple count if the tuple count > soft limit
-    if (mSlicedConditionState.size() >= StatsdStats::kDimensionKeySizeSoftLimit) {
-        size_t newTupleCount = mSlicedConditionState.size() + 1;
+    if (mState->slicedConditionState.size() >= StatsdStats::kDimensionKeySizeSoftLimit) {
+        size_t newTupleCount = mState->slicedConditionState.size() + 1;
         StatsdStats::getInstance().noteConditionDimensionSize(mConfigKey, mConditionId, newTupleCount);
         // 2. Don't add more tuples, we are above the allowed threshold. Drop the data.
         if (newTupleCount > StatsdStats::kDimensionKeySizeHardLimit) {
@@ -187,7 +215,7 @@ void SimpleConditionTracker::handleConditionEvent(const HashableDimensionKey& ou
                                                   bool matchStart, ConditionState* conditionCache,
                                                   bool* conditionChangedCache) {
     bool changed = false;
-    auto outputIt = mSlicedConditionState.find(outputKey);
+    auto outputIt = mState->slicedConditionState.find(outputKey);
     ConditionState newCondition;
     if (hitGuardRail(outputKey)) {
         (*conditionChangedCache) = false;
@@ -195,18 +223,18 @@ void SimpleConditionTracker::handleConditionEvent(const HashableDimensionKey& ou
         (*conditionCache) = ConditionState::kUnknown;
         return;
     }
-    if (outputIt == mSlicedConditionState.end()) {
+    if (outputIt == mState->slicedConditionState.end()) {
         // We get a new output key.
         newCondition = matchStart ? ConditionState::kTrue : ConditionState::kFalse;
-        if (matchStart && mInitialValue != ConditionState::kTrue) {
-            mSlicedConditionState[outputKey] = 1;
+        if (matchStart && mState->initialValue != ConditionState::kTrue) {
+            mState->slicedConditionState[outputKey] = 1;
             changed = true;
-            mLastChangedToTrueDimensions.insert(outputKey);
-        } else if (mInitialValue != ConditionState::kFalse) {
+            mState->lastChangedToTrueDimensions.insert(outputKey);
+        } else if (mState->initialValue != ConditionState::kFalse) {
             // it's a stop and we don't have history about it.
             // If the default condition is not false, it means this stop is valuable to us.
-            mSlicedConditionState[outputKey] = 0;
-            mLastChangedToFalseDimensions.insert(outputKey);
+            mState->slicedConditionState[outputKey] = 0;
+            mState->lastChangedToFalseDimensions.insert(outputKey);
             changed = true;
         }
     } else {
@@ -216,7 +244,7 @@ void SimpleConditionTracker::handleConditionEvent(const HashableDimensionKey& ou
         newCondition = startedCount > 0 ? ConditionState::kTrue : ConditionState::kFalse;
         if (matchStart) {
             if (startedCount == 0) {
-                mLastChangedToTrueDimensions.insert(outputKey);
+                mState->lastChangedToTrueDimensions.insert(outputKey);
                 // This condition for this output key will change from false -> true
                 changed = true;
             }
@@ -240,14 +268,14 @@ void SimpleConditionTracker::handleConditionEvent(const HashableDimensionKey& ou
                 }
                 // if everything has stopped for this output key, condition true -> false;
                 if (startedCount == 0) {
-                    mLastChangedToFalseDimensions.insert(outputKey);
+                    mState->lastChangedToFalseDimensions.insert(outputKey);
                     changed = true;
                 }
             }
 
             // if default condition is false, it means we don't need to keep the false values.
-            if (mInitialValue == ConditionState::kFalse && startedCount == 0) {
-                mSlicedConditionState.erase(outputIt);
+            if (mState->initialValue == ConditionState::kFalse && startedCount == 0) {
+                mState->slicedConditionState.erase(outputIt);
                 VLOG("erase key %s", outputKey.toString().c_str());
             }
         }
@@ -276,8 +304,33 @@ void SimpleConditionTracker::evaluateCondition(const LogEvent& event,
             (long long)mConditionId, conditionCache[mIndex]);
         return;
     }
-    mLastChangedToTrueDimensions.clear();
-    mLastChangedToFalseDimensions.clear();
+    uint64_t dispatchId = 0;
+    if (mSharedStates != nullptr) {
+        dispatchId = EventMatcherCache::getDispatchId(event);
+        if (dispatchId == 0) {
+            // The trackers of the other configs can't tell whether the event was evaluated.
+            stopSharing();
+        } else if (mState->evaluatedDispatchId == dispatchId) {
+            // The tracker of another config already evaluated the event.
+            conditionCache[mIndex] = mState->evaluatedCondition;
+            conditionChangedCache[mIndex] = mState->evaluatedChanged;
+            VLOG("SimplePredicate %lld evaluated %d (shared)", (long long)mConditionId,
+                 conditionCache[mIndex]);
+            return;
+        }
+    }
+    evaluateConditionState(event, eventMatcherValues, conditionCache, conditionChangedCache);
+    mState->evaluatedDispatchId = dispatchId;
+    mState->evaluatedCondition = conditionCache[mIndex];
+    mState->evaluatedChanged = conditionChangedCache[mIndex];
+}
+
+void SimpleConditionTracker::evaluateConditionState(const LogEvent& event,
+                                                    const vector<MatchingState>& eventMatcherValues,
+                                                    vector<ConditionState>& conditionCache,
+                                                    vector<uint8_t>& conditionChangedCache) {
+    mState->lastChangedToTrueDimensions.clear();
+    mState->lastChangedToFalseDimensions.clear();
 
     if (mStopAllLogMatcherIndex >= 0 && mStopAllLogMatcherIndex < int(eventMatcherValues.size()) &&
         eventMatcherValues[mStopAllLogMatcherIndex] == MatchingState::kMatched) {
@@ -304,19 +357,19 @@ void SimpleConditionTracker::evaluateCondition(const LogEvent& event,
         if (mSliced) {
             // if the condition result is sliced. The overall condition is true if any of the sliced
             // condition is true
-            conditionCache[mIndex] = mInitialValue;
-            for (const auto& slicedCondition : mSlicedConditionState) {
+            conditionCache[mIndex] = mState->initialValue;
+            for (const auto& slicedCondition : mState->slicedConditionState) {
                 if (slicedCondition.second > 0) {
                     conditionCache[mIndex] = ConditionState::kTrue;
                     break;
                 }
             }
         } else {
-            const auto& itr = mSlicedConditionState.find(DEFAULT_DIMENSION_KEY);
-            if (itr == mSlicedConditionState.end()) {
+            const auto& itr = mState->slicedConditionState.find(DEFAULT_DIMENSION_KEY);
+            if (itr == mState->slicedConditionState.end()) {
                 // condition not sliced, but we haven't seen the matched start or stop yet. so
                 // return initial value.
-                conditionCache[mIndex] = mInitialValue;
+                conditionCache[mIndex] = mState->initialValue;
             } else {
                 // return the cached condition.
                 conditionCache[mIndex] =
@@ -326,7 +379,7 @@ void SimpleConditionTracker::evaluateCondition(const LogEvent& event,
         return;
     }
 
-    ConditionState overallState = mInitialValue;
+    ConditionState overallState = mState->initialValue;
     bool overallChanged = false;
 
     if (mOutputDimensions.size() == 0) {
@@ -334,7 +387,7 @@ void SimpleConditionTracker::evaluateCondition(const LogEvent& event,
                              &overallChanged);
     } else if (!mContainANYPositionInInternalDimensions) {
         HashableDimensionKey outputValue;
-        filterValues(mOutputDimensions, event.getValues(), &outputValue);
+        filterValues(mOutputDimensions, event, &outputValue);
 
         // If this event has multiple nodes in the attribution chain,  this log event probably will
         // generate multiple dimensions. If so, we will find if the condition changes for any
@@ -365,10 +418,10 @@ void SimpleConditionTracker::isConditionMet(
 
     if (pair == conditionParameters.end()) {
         ConditionState conditionState = ConditionState::kNotEvaluated;
-        conditionState = conditionState | mInitialValue;
+        conditionState = conditionState | mState->initialValue;
         if (!mSliced) {
-            const auto& itr = mSlicedConditionState.find(DEFAULT_DIMENSION_KEY);
-            if (itr != mSlicedConditionState.end()) {
+            const auto& itr = mState->slicedConditionState.find(DEFAULT_DIMENSION_KEY);
+            if (itr != mState->slicedConditionState.end()) {
                 ConditionState sliceState =
                     itr->second > 0 ? ConditionState::kTrue : ConditionState::kFalse;
                 conditionState = conditionState | sliceState;
@@ -383,8 +436,8 @@ void SimpleConditionTracker::isConditionMet(
     if (isPartialLink) {
         // For unseen key, check whether the require dimensions are subset of sliced condition
         // output.
-        conditionState = conditionState | mInitialValue;
-        for (const auto& slice : mSlicedConditionState) {
+        conditionState = conditionState | mState->initialValue;
+        for (const auto& slice : mState->slicedConditionState) {
             ConditionState sliceState =
                 slice.second > 0 ? ConditionState::kTrue : ConditionState::kFalse;
             if (slice.first.contains(key)) {
@@ -392,9 +445,9 @@ void SimpleConditionTracker::isConditionMet(
             }
         }
     } else {
-        auto startedCountIt = mSlicedConditionState.find(key);
-        conditionState = conditionState | mInitialValue;
-        if (startedCountIt != mSlicedConditionState.end()) {
+        auto startedCountIt = mState->slicedConditionState.find(key);
+        conditionState = conditionState | mState->initialValue;
+        if (startedCountIt != mState->slicedConditionState.end()) {
             ConditionState sliceState =
                 startedCountIt->second > 0 ? ConditionState::kTrue : ConditionState::kFalse;
             conditionState = conditionState | sliceState;
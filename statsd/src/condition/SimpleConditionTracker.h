@@ -18,7 +18,12 @@
 #define SIMPLE_CONDITION_TRACKER_H
 
 #include <gtest/gtest_prod.h>
+
+#include <memory>
+#include <string>
+
 #include "ConditionTracker.h"
+#include "condition/SharedConditionStates.h"
 #include "config/ConfigKey.h"
 #include "src/statsd_config.pb.h"
 #include "stats_util.h"
@@ -35,6 +40,10 @@ public:
 
     ~SimpleConditionTracker();
 
+    // Shares the state with the identical trackers of the other configs of the owner, see
+    // SharedConditionStates. Must be called before init().
+    void shareState(const sp<SharedConditionStates>& sharedStates, const std::string& sharingKey);
+
     optional<InvalidConfigReason> init(
             const std::vector<Predicate>& allConditionConfig,
             const std::vector<sp<ConditionTracker>>& allConditionTrackers,
@@ -58,33 +67,38 @@ public:
                         const bool isPartialLink,
                         std::vector<ConditionState>& conditionCache) const override;
 
-    virtual const std::set<HashableDimensionKey>* getChangedToTrueDimensions(
+    virtual const std::unordered_set<HashableDimensionKey>* getChangedToTrueDimensions(
             const std::vector<sp<ConditionTracker>>& allConditions) const {
         if (mSliced) {
-            return &mLastChangedToTrueDimensions;
+            return &mState->lastChangedToTrueDimensions;
         } else {
             return nullptr;
         }
     }
 
-    virtual const std::set<HashableDimensionKey>* getChangedToFalseDimensions(
+    virtual const std::unordered_set<HashableDimensionKey>* getChangedToFalseDimensions(
             const std::vector<sp<ConditionTracker>>& allConditions) const {
         if (mSliced) {
-            return &mLastChangedToFalseDimensions;
+            return &mState->lastChangedToFalseDimensions;
         } else {
             return nullptr;
         }
     }
 
-    const std::map<HashableDimensionKey, int>* getSlicedDimensionMap(
+    const std::unordered_map<HashableDimensionKey, int>* getSlicedDimensionMap(
             const std::vector<sp<ConditionTracker>>& allConditions) const override {
-        return &mSlicedConditionState;
+        return &mState->slicedConditionState;
     }
 
     bool IsChangedDimensionTrackable() const  override { return true; }
 
     bool IsSimpleCondition() const  override { return true; }
 
+    const std::vector<int>& getChildren() const override {
+        static const std::vector<int> kNoChildren;
+        return kNoChildren;
+    }
+
     bool equalOutputDimensions(
         const std::vector<sp<ConditionTracker>>& allConditions,
         const vector<Matcher>& dimensions) const override {
@@ -105,16 +119,24 @@ private:
     // The index of the LogEventMatcher which defines the stop all.
     int mStopAllLogMatcherIndex;
 
-    ConditionState mInitialValue;
-
     std::vector<Matcher> mOutputDimensions;
 
     bool mContainANYPositionInInternalDimensions;
 
-    std::set<HashableDimensionKey> mLastChangedToTrueDimensions;
-    std::set<HashableDimensionKey> mLastChangedToFalseDimensions;
+    // Shared with the trackers of the group of mSharingKey while mSharedStates is set.
+    std::shared_ptr<SimpleConditionState> mState;
+
+    sp<SharedConditionStates> mSharedStates;
+
+    std::string mSharingKey;
+
+    // Takes a copy of the shared state and leaves its group.
+    void stopSharing();
 
-    std::map<HashableDimensionKey, int> mSlicedConditionState;
+    void evaluateConditionState(const LogEvent& event,
+                                const std::vector<MatchingState>& eventMatcherValues,
+                                std::vector<ConditionState>& conditionCache,
+                                std::vector<uint8_t>& changedCache);
 
     void setMatcherIndices(const SimplePredicate& predicate,
                            const std::unordered_map<int64_t, int>& logTrackerMap);
@@ -134,6 +156,8 @@ private:
     FRIEND_TEST(SimpleConditionTrackerTest, TestStopAll);
     FRIEND_TEST(SimpleConditionTrackerTest, TestGuardrailNotHitWhenDefaultFalse);
     FRIEND_TEST(SimpleConditionTrackerTest, TestGuardrailHitWhenDefaultUnknown);
+    FRIEND_TEST(SimpleConditionTrackerTest, TestSharedState);
+    FRIEND_TEST(SimpleConditionTrackerTest, TestSharedStateWithoutDispatchScope);
     FRIEND_TEST(ConfigUpdateTest, TestUpdateConditions);
 };
 
@@ -17,6 +17,7 @@
 #ifndef CONDITION_UTIL_H
 #define CONDITION_UTIL_H
 
+#include <cstdint>
 #include <vector>
 #include "../matchers/matcher_util.h"
 #include "src/statsd_config.pb.h"
@@ -25,7 +26,8 @@ namespace android {
 namespace os {
 namespace statsd {
 
-enum ConditionState {
+// One byte per state keeps the condition cache of a config in a few cache lines.
+enum ConditionState : int8_t {
     kNotEvaluated = -2,
     kUnknown = -1,
     kFalse = 0,
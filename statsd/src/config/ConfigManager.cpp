@@ -21,6 +21,7 @@
 #include "storage/StorageManager.h"
 
 #include "guardrail/StatsdStats.h"
+#include "hash.h"
 #include "stats_log_util.h"
 #include "stats_util.h"
 #include "stats_log_util.h"
@@ -73,6 +74,8 @@ void ConfigManager::UpdateConfig(const ConfigKey& key, const StatsdConfig& confi
         const int numBytes = config.ByteSize();
         vector<uint8_t> buffer(numBytes);
         config.SerializeToArray(buffer.data(), numBytes);
+        const uint64_t configHash =
+                Hash64(reinterpret_cast<const char*>(buffer.data()), buffer.size());
 
         auto uidIt = mConfigs.find(key.GetUid());
         // GuardRail: Limit the number of configs per uid.
@@ -86,8 +89,8 @@ void ConfigManager::UpdateConfig(const ConfigKey& key, const StatsdConfig& confi
         }
 
         // Check if it's a duplicate config.
-        if (uidIt != mConfigs.end() && uidIt->second.find(key) != uidIt->second.end() &&
-            StorageManager::hasIdenticalConfig(key, buffer)) {
+        const auto hashIt = mConfigHashes.find(key);
+        if (hashIt != mConfigHashes.end() && hashIt->second == configHash) {
             // This is a duplicate config.
             ALOGI("ConfigManager This is a duplicate config %s", key.ToString().c_str());
             // Update saved file on disk. We still update timestamp of file when
@@ -101,6 +104,7 @@ void ConfigManager::UpdateConfig(const ConfigKey& key, const StatsdConfig& confi
 
         // Add to set.
         mConfigs[key.GetUid()].insert(key);
+        mConfigHashes[key] = configHash;
 
         broadcastList = mListeners;
     }
@@ -239,6 +243,7 @@ void ConfigManager::RemoveConfig(const ConfigKey& key) {
         if (uidIt != mConfigs.end() && uidIt->second.find(key) != uidIt->second.end()) {
             // Remove from map
             uidIt->second.erase(key);
+            mConfigHashes.erase(key);
 
             broadcastList = mListeners;
         }
@@ -274,6 +279,7 @@ void ConfigManager::RemoveConfigs(int uid) {
             // Remove from map
                 remove_saved_configs(*it);
                 removed.push_back(*it);
+                mConfigHashes.erase(*it);
         }
 
         mConfigs.erase(uidIt);
@@ -304,6 +310,7 @@ void ConfigManager::RemoveAllConfigs() {
             }
             uidIt = mConfigs.erase(uidIt);
         }
+        mConfigHashes.clear();
 
         broadcastList = mListeners;
     }
@@ -176,6 +176,12 @@ private:
      */
     std::map<int, std::set<ConfigKey>> mConfigs;
 
+    /**
+     * Hash64 of the serialized config of each config key in mConfigs, used to detect duplicate
+     * configs without reading the saved config back from disk.
+     */
+    std::map<ConfigKey, uint64_t> mConfigHashes;
+
     /**
      * Each config key can be subscribed by up to one receiver, specified as IPendingIntentRef.
      */
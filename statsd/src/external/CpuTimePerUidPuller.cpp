@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "CpuTimePerUidPuller.h"
+
+#include <stats_annotations.h>
+#include <stdio.h>
+
+#include <memory>
+
+#include "statslog_statsd.h"
+
+using std::shared_ptr;
+using std::unique_ptr;
+using std::vector;
+
+namespace android {
+namespace os {
+namespace statsd {
+
+CpuTimePerUidPuller::CpuTimePerUidPuller(const std::string& path)
+    : NativePuller(util::CPU_TIME_PER_UID), mPath(path) {
+}
+
+PullErrorCode CpuTimePerUidPuller::PullInternal(vector<shared_ptr<LogEvent>>* data) {
+    unique_ptr<FILE, decltype(&fclose)> file(fopen(mPath.c_str(), "re"), fclose);
+    if (file == nullptr) {
+        ALOGW("Failed to open %s", mPath.c_str());
+        return PULL_FAIL;
+    }
+    // Each line is "<uid>: <user time micros> <system time micros>".
+    int32_t uid;
+    unsigned long long userTimeMicros;
+    unsigned long long sysTimeMicros;
+    while (fscanf(file.get(), "%d: %llu %llu", &uid, &userTimeMicros, &sysTimeMicros) == 3) {
+        AStatsEvent* statsEvent = AStatsEvent_obtain();
+        AStatsEvent_setAtomId(statsEvent, util::CPU_TIME_PER_UID);
+        AStatsEvent_writeInt32(statsEvent, uid);
+        AStatsEvent_addBoolAnnotation(statsEvent, ASTATSLOG_ANNOTATION_ID_IS_UID, true);
+        AStatsEvent_writeInt64(statsEvent, userTimeMicros);
+        AStatsEvent_writeInt64(statsEvent, sysTimeMicros);
+        if (!addEvent(statsEvent, data)) {
+            return PULL_FAIL;
+        }
+    }
+    return PULL_SUCCESS;
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
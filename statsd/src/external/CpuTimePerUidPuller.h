@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "NativePuller.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Reads the user and system CPU time of each uid from the uid_cputime kernel driver.
+ */
+class CpuTimePerUidPuller : public NativePuller {
+public:
+    explicit CpuTimePerUidPuller(const std::string& path = "/proc/uid_cputime/show_uid_stat");
+
+private:
+    const std::string mPath;
+
+    PullErrorCode PullInternal(std::vector<std::shared_ptr<LogEvent>>* data) override;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
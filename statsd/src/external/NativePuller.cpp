@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "NativePuller.h"
+
+#include "CpuTimePerUidPuller.h"
+#include "SysfsValuePuller.h"
+#include "statslog_statsd.h"
+
+using std::make_shared;
+using std::shared_ptr;
+using std::vector;
+
+namespace android {
+namespace os {
+namespace statsd {
+
+NativePuller::NativePuller(const int tagId, const int64_t coolDownNs)
+    : StatsPuller(tagId, coolDownNs) {
+}
+
+bool NativePuller::addEvent(AStatsEvent* statsEvent, vector<shared_ptr<LogEvent>>* data) {
+    AStatsEvent_build(statsEvent);
+    size_t size;
+    const uint8_t* buffer = AStatsEvent_getBuffer(statsEvent, &size);
+    shared_ptr<LogEvent> event = make_shared<LogEvent>(/*uid=*/-1, /*pid=*/-1);
+    const bool valid = event->parseBuffer(buffer, size);
+    AStatsEvent_release(statsEvent);
+    if (!valid) {
+        StatsdStats::getInstance().noteAtomError(event->GetTagId(), /*pull=*/true);
+        return false;
+    }
+    data->push_back(event);
+    return true;
+}
+
+vector<sp<NativePuller>> createNativePullers() {
+    return {
+            new CpuTimePerUidPuller(),
+            // The charge is in microampere-hours.
+            new SysfsValuePuller(util::REMAINING_BATTERY_CAPACITY,
+                                 "/sys/class/power_supply/battery/charge_counter"),
+            new SysfsValuePuller(util::FULL_BATTERY_CAPACITY,
+                                 "/sys/class/power_supply/battery/charge_full"),
+            new SysfsValuePuller(util::BATTERY_LEVEL, "/sys/class/power_supply/battery/capacity"),
+            // The voltage is in microvolts, the atom reports millivolts.
+            new SysfsValuePuller(util::BATTERY_VOLTAGE,
+                                 "/sys/class/power_supply/battery/voltage_now",
+                                 /*divisor=*/1000),
+            // The size is in kilobytes, the atom reports bytes.
+            new SysfsValuePuller(util::SYSTEM_ION_HEAP_SIZE, "/sys/kernel/ion/total_heaps_kb",
+                                 /*divisor=*/1, /*multiplier=*/1024, /*int64Value=*/true),
+    };
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
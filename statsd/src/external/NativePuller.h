@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stats_event.h>
+
+#include <string>
+#include <vector>
+
+#include "StatsPuller.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Base of the pullers that read their atom in the statsd process, e.g. from /proc or /sys,
+ * instead of calling the puller registered over binder by the process that owns the atom.
+ */
+class NativePuller : public StatsPuller {
+public:
+    explicit NativePuller(const int tagId, const int64_t coolDownNs = NS_PER_SEC);
+
+protected:
+    // Builds statsEvent, releases it and appends the event it encodes to data. Returns false if
+    // the event is not valid.
+    static bool addEvent(AStatsEvent* statsEvent, std::vector<std::shared_ptr<LogEvent>>* data);
+};
+
+// Creates the native pullers that statsd can use instead of the binder pullers of their atoms.
+// New native pullers are added here.
+std::vector<sp<NativePuller>> createNativePullers();
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -38,6 +38,11 @@ class PullDataReceiver : virtual public RefBase{
   virtual void onDataPulled(const std::vector<std::shared_ptr<LogEvent>>& data,
                             PullResult pullResult, int64_t originalPullTimeNs) = 0;
 
+  /**
+   * Whether the scheduled pull at the bucket boundary is needed. When it is not, e.g. the condition
+   * of the metric is false so its data would be dropped, the pull is skipped and onDataPulled is
+   * called with PULL_NOT_NEEDED instead.
+   */
   virtual bool isPullNeeded() const = 0;
 };
 
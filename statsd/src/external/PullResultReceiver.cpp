@@ -14,23 +14,117 @@
  * limitations under the License.
  */
 
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
 #include "PullResultReceiver.h"
 
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 namespace android {
 namespace os {
 namespace statsd {
 
 PullResultReceiver::PullResultReceiver(
-        std::function<void(int32_t, bool, const vector<StatsEventParcel>&)> pullFinishCb)
-    : pullFinishCallback(std::move(pullFinishCb)) {
+        std::function<void(int32_t, const vector<PulledEventBuffer>&)> pulledEventsCb,
+        std::function<void(int32_t, bool)> pullFinishCb)
+    : pulledEventsCallback(std::move(pulledEventsCb)), pullFinishCallback(std::move(pullFinishCb)) {
 }
 
 Status PullResultReceiver::pullFinished(int32_t atomTag, bool success,
                                         const vector<StatsEventParcel>& output) {
-    pullFinishCallback(atomTag, success, output);
+    // The parcels are only read by this receiver, which is the last user of the binder call
+    // arguments, so their buffers are released as soon as their events are handled.
+    vector<StatsEventParcel>& parcels = const_cast<vector<StatsEventParcel>&>(output);
+    vector<PulledEventBuffer> events;
+    events.reserve(min(parcels.size(), kPulledEventsChunkSize));
+    for (size_t begin = 0; begin < parcels.size(); begin += kPulledEventsChunkSize) {
+        const size_t end = min(parcels.size(), begin + kPulledEventsChunkSize);
+        events.clear();
+        for (size_t i = begin; i < end; i++) {
+            events.push_back({(const uint8_t*)parcels[i].buffer.data(), parcels[i].buffer.size()});
+        }
+        pulledEventsCallback(atomTag, events);
+        for (size_t i = begin; i < end; i++) {
+            vector<uint8_t>().swap(parcels[i].buffer);
+        }
+    }
+    pullFinishCallback(atomTag, success);
+    return Status::ok();
+}
+
+Status PullResultReceiver::pullFinishedShared(int32_t atomTag, bool success,
+                                              const ScopedFileDescriptor& events,
+                                              int32_t size) {
+    if (size <= 0) {
+        pullFinishCallback(atomTag, success && size == 0);
+        return Status::ok();
+    }
+
+    // The events are parsed in place, so the sender must not be able to shrink or modify the
+    // file while it is mapped.
+    const int fd = events.get();
+    const int seals = fcntl(fd, F_GET_SEALS);
+    struct stat fileStat;
+    if (seals < 0 || (seals & (F_SEAL_SHRINK | F_SEAL_WRITE)) != (F_SEAL_SHRINK | F_SEAL_WRITE) ||
+        fstat(fd, &fileStat) != 0 || fileStat.st_size < size) {
+        ALOGW("Invalid shared memory pull result for atom %d", atomTag);
+        pullFinishCallback(atomTag, /*success=*/false);
+        return Status::ok();
+    }
+
+    void* buffer = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (buffer == MAP_FAILED) {
+        ALOGW("Failed to map shared memory pull result for atom %d", atomTag);
+        pullFinishCallback(atomTag, /*success=*/false);
+        return Status::ok();
+    }
+
+    // The whole buffer is validated before any event is handled, so a malformed result doesn't
+    // deliver part of its events.
+    vector<PulledEventBuffer> unpacked;
+    const bool valid = unpackEvents((const uint8_t*)buffer, size, &unpacked);
+    if (!valid) {
+        ALOGW("Malformed shared memory pull result for atom %d", atomTag);
+    } else {
+        onPulledEvents(atomTag, unpacked);
+    }
+    pullFinishCallback(atomTag, success && valid);
+    munmap(buffer, size);
     return Status::ok();
 }
 
+void PullResultReceiver::onPulledEvents(int32_t atomTag, const vector<PulledEventBuffer>& events) {
+    vector<PulledEventBuffer> chunk;
+    for (size_t begin = 0; begin < events.size(); begin += kPulledEventsChunkSize) {
+        const size_t end = min(events.size(), begin + kPulledEventsChunkSize);
+        chunk.assign(events.begin() + begin, events.begin() + end);
+        pulledEventsCallback(atomTag, chunk);
+    }
+}
+
+bool PullResultReceiver::unpackEvents(const uint8_t* buffer, size_t size,
+                                      vector<PulledEventBuffer>* events) {
+    size_t pos = 0;
+    while (pos < size) {
+        uint32_t eventSize;
+        if (size - pos < sizeof(eventSize)) {
+            return false;
+        }
+        memcpy(&eventSize, buffer + pos, sizeof(eventSize));
+        pos += sizeof(eventSize);
+        if (size - pos < eventSize) {
+            return false;
+        }
+        events->push_back({buffer + pos, eventSize});
+        pos += eventSize;
+    }
+    return true;
+}
+
 PullResultReceiver::~PullResultReceiver() {
 }
 
@@ -16,31 +16,66 @@
 
 #include <aidl/android/os/BnPullAtomResultReceiver.h>
 #include <aidl/android/util/StatsEventParcel.h>
+#include <android/binder_auto_utils.h>
 
 using namespace std;
 
 using Status = ::ndk::ScopedAStatus;
 using aidl::android::os::BnPullAtomResultReceiver;
 using aidl::android::util::StatsEventParcel;
+using ::ndk::ScopedFileDescriptor;
 
 namespace android {
 namespace os {
 namespace statsd {
 
+/**
+ * Serialized pulled event, pointing into the buffer it was received in.
+ * Only valid for the duration of the pulled events callback.
+ */
+struct PulledEventBuffer {
+    const uint8_t* data;
+    size_t size;
+};
+
+/**
+ * Receives the result of a pull. The events are passed to pulledEventsCallback in chunks of at
+ * most kPulledEventsChunkSize as they are unpacked, then pullFinishCallback is called with whether
+ * the pull succeeded. Events received in parcels are released once their chunk is handled, so the
+ * pulled parcels and the events parsed from them are not all held at the same time.
+ */
 class PullResultReceiver : public BnPullAtomResultReceiver {
 public:
-    PullResultReceiver(
-            function<void(int32_t, bool, const vector<StatsEventParcel>&)> pullFinishCallback);
+    PullResultReceiver(function<void(int32_t, const vector<PulledEventBuffer>&)> pulledEventsCb,
+                       function<void(int32_t, bool)> pullFinishCb);
     ~PullResultReceiver();
 
+    static constexpr size_t kPulledEventsChunkSize = 100;
+
     /**
      * Binder call for finishing a pull.
      */
     Status pullFinished(int32_t atomTag, bool success,
                         const vector<StatsEventParcel>& output) override;
 
+    /**
+     * Binder call for finishing a pull with the events packed in shared memory.
+     */
+    Status pullFinishedShared(int32_t atomTag, bool success, const ScopedFileDescriptor& events,
+                              int32_t size) override;
+
 private:
-    function<void(int32_t, bool, const vector<StatsEventParcel>&)> pullFinishCallback;
+    // Splits a buffer of |uint32_t size|bytes| records into events. Returns false if the
+    // buffer is malformed.
+    static bool unpackEvents(const uint8_t* buffer, size_t size,
+                             vector<PulledEventBuffer>* events);
+
+    // Passes the events to pulledEventsCallback in chunks.
+    void onPulledEvents(int32_t atomTag, const vector<PulledEventBuffer>& events);
+
+    function<void(int32_t, const vector<PulledEventBuffer>&)> pulledEventsCallback;
+
+    function<void(int32_t, bool)> pullFinishCallback;
 };
 
 }  // namespace statsd
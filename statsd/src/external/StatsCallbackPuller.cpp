@@ -24,6 +24,8 @@
 #include "stats_log_util.h"
 
 #include <aidl/android/util/StatsEventParcel.h>
+#include <android/binder_ibinder_platform.h>
+#include <sched.h>
 
 using namespace std;
 
@@ -35,6 +37,11 @@ namespace android {
 namespace os {
 namespace statsd {
 
+std::atomic<bool> StatsCallbackPuller::mPullResultPriority(false);
+void StatsCallbackPuller::SetPullResultPriority(bool pullResultPriority) {
+    mPullResultPriority = pullResultPriority;
+}
+
 StatsCallbackPuller::StatsCallbackPuller(int tagId, const shared_ptr<IPullAtomCallback>& callback,
                                          const int64_t coolDownNs, int64_t timeoutNs,
                                          const vector<int>& additiveFields)
@@ -57,31 +64,40 @@ PullErrorCode StatsCallbackPuller::PullInternal(vector<shared_ptr<LogEvent>>* da
     shared_ptr<vector<shared_ptr<LogEvent>>> sharedData =
             make_shared<vector<shared_ptr<LogEvent>>>();
 
+    // The events are parsed as they are received, in a statsd binder thread. The pull could
+    // have taken a long time, and we should only modify data (the output param) if the pointer
+    // is in scope and the pull did not time out.
     shared_ptr<PullResultReceiver> resultReceiver = SharedRefBase::make<PullResultReceiver>(
-            [cv_mutex, cv, pullFinish, pullSuccess, sharedData](
-                    int32_t atomTag, bool success, const vector<StatsEventParcel>& output) {
+            [cv_mutex, sharedData](int32_t atomTag, const vector<PulledEventBuffer>& events) {
+                lock_guard<mutex> lk(*cv_mutex);
+                for (const PulledEventBuffer& buffer : events) {
+                    shared_ptr<LogEvent> event = make_shared<LogEvent>(/*uid=*/-1, /*pid=*/-1);
+                    bool valid = event->parseBuffer(buffer.data, buffer.size);
+                    if (valid) {
+                        sharedData->push_back(event);
+                    } else {
+                        StatsdStats::getInstance().noteAtomError(event->GetTagId(),
+                                                                 /*pull=*/true);
+                    }
+                }
+            },
+            [cv_mutex, cv, pullFinish, pullSuccess](int32_t atomTag, bool success) {
                 // This is the result of the pull, executing in a statsd binder thread.
-                // The pull could have taken a long time, and we should only modify
-                // data (the output param) if the pointer is in scope and the pull did not time out.
                 {
                     lock_guard<mutex> lk(*cv_mutex);
-                    for (const StatsEventParcel& parcel: output) {
-                        shared_ptr<LogEvent> event = make_shared<LogEvent>(/*uid=*/-1, /*pid=*/-1);
-                        bool valid = event->parseBuffer((uint8_t*)parcel.buffer.data(),
-                                                        parcel.buffer.size());
-                        if (valid) {
-                            sharedData->push_back(event);
-                        } else {
-                            StatsdStats::getInstance().noteAtomError(event->GetTagId(),
-                                                                     /*pull=*/true);
-                        }
-                    }
                     *pullSuccess = success;
                     *pullFinish = true;
                 }
                 cv->notify_one();
             });
 
+    if (mPullResultPriority) {
+        if (__builtin_available(android __ANDROID_API_S__, *)) {
+            AIBinder_setMinSchedulerPolicy(resultReceiver->asBinder().get(), SCHED_NORMAL,
+                                           kPullResultNice);
+        }
+    }
+
     // Initiate the pull. This is a oneway call to a different process, except
     // in unit tests. In process calls are not oneway.
     Status status = mCallback->onPullAtom(mTagId, resultReceiver);
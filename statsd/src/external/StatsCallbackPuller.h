@@ -32,7 +32,16 @@ public:
                                  const int64_t coolDownNs, int64_t timeoutNs,
                                  const std::vector<int>& additiveFields);
 
+    // Whether the pull results are handled at an elevated priority, so that they are not delayed
+    // by the binder calls running at normal priority, such as getData, until the pull times out.
+    static void SetPullResultPriority(bool pullResultPriority);
+
 private:
+    // Minimum nice value of the binder threads handling a pull result, see SetPullResultPriority.
+    static constexpr int kPullResultNice = -10;
+
+    static std::atomic<bool> mPullResultPriority;
+
     PullErrorCode PullInternal(vector<std::shared_ptr<LogEvent>>* data) override;
     const shared_ptr<IPullAtomCallback> mCallback;
 
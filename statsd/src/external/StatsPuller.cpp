@@ -18,20 +18,31 @@
 #include "Log.h"
 
 #include "StatsPuller.h"
+
+#include <algorithm>
+
 #include "StatsPullerManager.h"
 #include "guardrail/StatsdStats.h"
 #include "puller_util.h"
 #include "stats_log_util.h"
+#include "utils/StatsdTrace.h"
 
 namespace android {
 namespace os {
 namespace statsd {
 
 using std::lock_guard;
+using std::max;
+using std::min;
 
 sp<UidMap> StatsPuller::mUidMap = nullptr;
 void StatsPuller::SetUidMap(const sp<UidMap>& uidMap) { mUidMap = uidMap; }
 
+std::atomic<bool> StatsPuller::mPullRateLimiting(false);
+void StatsPuller::SetPullRateLimiting(bool pullRateLimiting) {
+    mPullRateLimiting = pullRateLimiting;
+}
+
 StatsPuller::StatsPuller(const int tagId, const int64_t coolDownNs, const int64_t pullTimeoutNs,
                          const std::vector<int>& additiveFields)
     : mTagId(tagId),
@@ -44,6 +55,15 @@ StatsPuller::StatsPuller(const int tagId, const int64_t coolDownNs, const int64_
 
 PullErrorCode StatsPuller::Pull(const int64_t eventTimeNs,
                                 std::vector<std::shared_ptr<LogEvent>>* data) {
+    PullSnapshot snapshot;
+    const PullErrorCode status = Pull(eventTimeNs, &snapshot);
+    if (status == PULL_SUCCESS) {
+        (*data) = *snapshot;
+    }
+    return status;
+}
+
+PullErrorCode StatsPuller::Pull(const int64_t eventTimeNs, PullSnapshot* data) {
     lock_guard<std::mutex> lock(mLock);
     const int64_t elapsedTimeNs = getElapsedRealtimeNs();
     const int64_t systemUptimeMillis = getSystemUptimeMillis();
@@ -51,33 +71,43 @@ PullErrorCode StatsPuller::Pull(const int64_t eventTimeNs,
     const bool shouldUseCache =
             (mLastEventTimeNs == eventTimeNs) || (elapsedTimeNs - mLastPullTimeNs < mCoolDownNs);
     if (shouldUseCache) {
-        if (mHasGoodData) {
+        if (mCachedData != nullptr) {
             (*data) = mCachedData;
             StatsdStats::getInstance().notePullFromCache(mTagId);
-
         }
-        return mHasGoodData ? PULL_SUCCESS : PULL_FAIL;
+        return mCachedData != nullptr ? PULL_SUCCESS : PULL_FAIL;
+    }
+    // Without a token, the previous pull is folded into this one. A pull is still needed if
+    // there is nothing cached.
+    if (mPullRateLimiting && !takePullTokenLocked(elapsedTimeNs) && mCachedData != nullptr) {
+        (*data) = mCachedData;
+        StatsdStats::getInstance().notePullRateLimited(mTagId);
+        return PULL_SUCCESS;
     }
     if (mLastPullTimeNs > 0) {
         StatsdStats::getInstance().updateMinPullIntervalSec(
                 mTagId, (elapsedTimeNs - mLastPullTimeNs) / NS_PER_SEC);
     }
-    mCachedData.clear();
+    mCachedData = nullptr;
     mLastPullTimeNs = elapsedTimeNs;
     mLastEventTimeNs = eventTimeNs;
-    PullErrorCode status = PullInternal(&mCachedData);
-    mHasGoodData = (status == PULL_SUCCESS);
-    if (!mHasGoodData) {
+    // The events are only modified before they are shared in the snapshot.
+    auto pulledData = std::make_shared<std::vector<std::shared_ptr<LogEvent>>>();
+    PullErrorCode status;
+    {
+        STATSD_TRACE_SCOPE_FMT("StatsPuller::Pull atom %d", mTagId);
+        status = PullInternal(pulledData.get());
+    }
+    if (status != PULL_SUCCESS) {
         return status;
     }
     const int64_t pullElapsedDurationNs = getElapsedRealtimeNs() - elapsedTimeNs;
     const int64_t pullSystemUptimeDurationMillis = getSystemUptimeMillis() - systemUptimeMillis;
     StatsdStats::getInstance().notePullTime(mTagId, pullElapsedDurationNs);
+    mPullLatenciesNs[mNumPullLatencies++ % kNumPullLatencies] = pullElapsedDurationNs;
     const bool pullTimeOut = pullElapsedDurationNs > mPullTimeoutNs;
     if (pullTimeOut) {
         // Something went wrong. Discard the data.
-        mCachedData.clear();
-        mHasGoodData = false;
         StatsdStats::getInstance().notePullTimeout(
                 mTagId, pullSystemUptimeDurationMillis, NanoToMillis(pullElapsedDurationNs));
         ALOGW("Pull for atom %d exceeds timeout %lld nano seconds.", mTagId,
@@ -85,19 +115,65 @@ PullErrorCode StatsPuller::Pull(const int64_t eventTimeNs,
         return PULL_FAIL;
     }
 
-    if (mCachedData.size() > 0) {
-        mapAndMergeIsolatedUidsToHostUid(mCachedData, mUidMap, mTagId, mAdditiveFields);
+    if (pulledData->size() > 0) {
+        mapAndMergeIsolatedUidsToHostUid(*pulledData, mUidMap, mTagId, mAdditiveFields);
     }
 
-    if (mCachedData.empty()) {
+    if (pulledData->empty()) {
         VLOG("Data pulled is empty");
         StatsdStats::getInstance().noteEmptyData(mTagId);
     }
+    StatsdStats::getInstance().notePullDataSize(mTagId, pulledData->size());
 
+    mCachedData = std::move(pulledData);
     (*data) = mCachedData;
     return PULL_SUCCESS;
 }
 
+int64_t StatsPuller::getPullLatencyNs(int percentile) const {
+    lock_guard<std::mutex> lock(mLock);
+    return getPullLatencyNsLocked(percentile);
+}
+
+int64_t StatsPuller::getPullLatencyNsLocked(int percentile) const {
+    const size_t numLatencies = min(mNumPullLatencies, kNumPullLatencies);
+    if (numLatencies == 0) {
+        return 0;
+    }
+    std::array<int64_t, kNumPullLatencies> latenciesNs = mPullLatenciesNs;
+    auto percentileIt = latenciesNs.begin() + (numLatencies - 1) * percentile / 100;
+    std::nth_element(latenciesNs.begin(), percentileIt, latenciesNs.begin() + numLatencies);
+    return *percentileIt;
+}
+
+int64_t StatsPuller::getAdaptiveCoolDownNsLocked() const {
+    const int64_t pullCostNs = getPullLatencyNsLocked(50) * kPullCostFactor;
+    return max(mCoolDownNs, min(pullCostNs, kMaxAdaptiveCoolDownNs));
+}
+
+bool StatsPuller::takePullTokenLocked(int64_t elapsedTimeNs) {
+    if (mPullTokens < kMaxPullTokens) {
+        const int64_t coolDownNs = getAdaptiveCoolDownNsLocked();
+        const int64_t refilledTokens =
+                coolDownNs > 0 ? (elapsedTimeNs - mLastPullTokenRefillNs) / coolDownNs
+                               : kMaxPullTokens;
+        if (mPullTokens + refilledTokens >= kMaxPullTokens) {
+            mPullTokens = kMaxPullTokens;
+        } else {
+            mPullTokens += refilledTokens;
+            mLastPullTokenRefillNs += refilledTokens * coolDownNs;
+        }
+    }
+    if (mPullTokens == 0) {
+        return false;
+    }
+    if (mPullTokens == kMaxPullTokens) {
+        mLastPullTokenRefillNs = elapsedTimeNs;
+    }
+    mPullTokens--;
+    return true;
+}
+
 int StatsPuller::ForceClearCache() {
     return clearCache();
 }
@@ -108,16 +184,18 @@ int StatsPuller::clearCache() {
 }
 
 int StatsPuller::clearCacheLocked() {
-    int ret = mCachedData.size();
-    mCachedData.clear();
+    int ret = mCachedData != nullptr ? mCachedData->size() : 0;
+    mCachedData = nullptr;
     mLastPullTimeNs = 0;
     mLastEventTimeNs = 0;
     return ret;
 }
 
 int StatsPuller::ClearCacheIfNecessary(int64_t timestampNs) {
-    if (timestampNs - mLastPullTimeNs > mCoolDownNs) {
-        return clearCache();
+    lock_guard<std::mutex> lock(mLock);
+    const int64_t coolDownNs = mPullRateLimiting ? getAdaptiveCoolDownNsLocked() : mCoolDownNs;
+    if (timestampNs - mLastPullTimeNs > coolDownNs) {
+        return clearCacheLocked();
     } else {
         return 0;
     }
@@ -18,6 +18,8 @@
 
 #include <aidl/android/os/IStatsCompanionService.h>
 #include <utils/RefBase.h>
+#include <array>
+#include <atomic>
 #include <mutex>
 #include <vector>
 #include "packages/UidMap.h"
@@ -39,6 +41,10 @@ enum PullErrorCode {
     PULL_DEAD_OBJECT = 2,
 };
 
+// Events of a pull, shared by all the callers served from the cache of the puller. The vector is
+// never modified once shared.
+typedef std::shared_ptr<const std::vector<std::shared_ptr<LogEvent>>> PullSnapshot;
+
 class StatsPuller : public virtual RefBase {
 public:
     explicit StatsPuller(const int tagId, int64_t coolDownNs = NS_PER_SEC,
@@ -59,14 +65,32 @@ public:
     // should make a copy as this data may be shared with multiple metrics.
     PullErrorCode Pull(const int64_t eventTimeNs, std::vector<std::shared_ptr<LogEvent>>* data);
 
+    // Same as above, but returns the cached snapshot instead of a copy of its events.
+    PullErrorCode Pull(const int64_t eventTimeNs, PullSnapshot* data);
+
     // Clear cache immediately
     int ForceClearCache();
 
-    // Clear cache if elapsed time is more than cooldown time
+    // Clear cache if elapsed time is more than cooldown time, or the adaptive cooldown when pull
+    // rate limiting is enabled.
     int ClearCacheIfNecessary(int64_t timestampNs);
 
+    // Returns the duration within which the percentile of the last kNumPullLatencies pulls that
+    // weren't served from cache completed, or 0 if there was no such pull.
+    int64_t getPullLatencyNs(int percentile) const;
+
+    inline int getTagId() const {
+        return mTagId;
+    }
+
     static void SetUidMap(const sp<UidMap>& uidMap);
 
+    // Enables limiting the rate of the pulls of each atom with a token bucket. Up to
+    // kMaxPullTokens pulls can be done in a burst, then one more each adaptive cooldown: the
+    // median of the recent pull latencies times kPullCostFactor, within mCoolDownNs and
+    // kMaxAdaptiveCoolDownNs. Pulls requested without a token are served from the cache.
+    static void SetPullRateLimiting(bool pullRateLimiting);
+
     virtual void SetStatsCompanionService(
             const shared_ptr<IStatsCompanionService>& statsCompanionService){};
 
@@ -75,8 +99,8 @@ protected:
 
     // Max time allowed to pull this atom.
     // We cannot reliably kill a pull thread. So we don't terminate the puller.
-    // The data is discarded if the pull takes longer than this and mHasGoodData
-    // marked as false.
+    // The data is discarded if the pull takes longer than this and the cache is
+    // cleared.
     const int64_t mPullTimeoutNs = StatsdStats::kPullMaxDelayNs;
 
 private:
@@ -85,8 +109,6 @@ private:
     // Real puller impl.
     virtual PullErrorCode PullInternal(std::vector<std::shared_ptr<LogEvent>>* data) = 0;
 
-    bool mHasGoodData = false;
-
     // Minimum time before this puller does actual pull again.
     // Pullers can cause significant impact to system health and battery.
     // So that we don't pull too frequently.
@@ -106,18 +128,50 @@ private:
     int64_t mLastEventTimeNs;
 
     // Cache of data from last pull. If next request comes before cool down finishes,
-    // cached data will be returned.
+    // cached data will be returned. Null if the last pull failed.
     // Cached data is cleared when
     //   1) A pull fails
     //   2) A new pull request comes after cooldown time.
     //   3) clearCache is called.
-    std::vector<std::shared_ptr<LogEvent>> mCachedData;
+    PullSnapshot mCachedData;
+
+    static const size_t kNumPullLatencies = 20;
+
+    // Durations of the last pulls that weren't served from cache, the oldest one is overwritten
+    // once kNumPullLatencies are stored.
+    std::array<int64_t, kNumPullLatencies> mPullLatenciesNs;
+
+    size_t mNumPullLatencies = 0;
+
+    static constexpr int64_t kMaxPullTokens = 5;
+
+    static constexpr int64_t kPullCostFactor = 100;
+
+    static constexpr int64_t kMaxAdaptiveCoolDownNs = 60 * NS_PER_SEC;
+
+    // Pulls that can still be done before the pull rate is limited, see SetPullRateLimiting.
+    int64_t mPullTokens = kMaxPullTokens;
+
+    // When the last token was added to mPullTokens.
+    int64_t mLastPullTokenRefillNs = 0;
+
+    int64_t getPullLatencyNsLocked(int percentile) const;
+
+    // Returns how long it takes to refill a pull token.
+    int64_t getAdaptiveCoolDownNsLocked() const;
+
+    // Refills the pull tokens up to elapsedTimeNs and takes one. Returns false if none is left.
+    bool takePullTokenLocked(int64_t elapsedTimeNs);
 
     int clearCache();
 
     int clearCacheLocked();
 
     static sp<UidMap> mUidMap;
+
+    static std::atomic<bool> mPullRateLimiting;
+
+    FRIEND_TEST(StatsPullerTest, PullRateLimitedToCache);
 };
 
 }  // namespace statsd
@@ -30,6 +30,8 @@
 #include "../logd/LogEvent.h"
 #include "../stats_log_util.h"
 #include "../statscompanion_util.h"
+#include "../utils/StatsdTrace.h"
+#include "NativePuller.h"
 #include "StatsCallbackPuller.h"
 #include "TrainInfoPuller.h"
 #include "statslog_statsd.h"
@@ -55,18 +57,75 @@ StatsPullerManager::StatsPullerManager()
 bool StatsPullerManager::Pull(int tagId, const ConfigKey& configKey, const int64_t eventTimeNs,
                               vector<shared_ptr<LogEvent>>* data) {
     std::lock_guard<std::mutex> _l(mLock);
-    return PullLocked(tagId, configKey, eventTimeNs, data);
+    PullSnapshot snapshot;
+    if (!PullLocked(tagId, configKey, eventTimeNs, &snapshot)) {
+        return false;
+    }
+    (*data) = *snapshot;
+    return true;
 }
 
 bool StatsPullerManager::Pull(int tagId, const vector<int32_t>& uids, const int64_t eventTimeNs,
                               vector<std::shared_ptr<LogEvent>>* data) {
     std::lock_guard<std::mutex> _l(mLock);
-    return PullLocked(tagId, uids, eventTimeNs, data);
+    PullSnapshot snapshot;
+    if (!PullLocked(tagId, uids, eventTimeNs, &snapshot)) {
+        return false;
+    }
+    (*data) = *snapshot;
+    return true;
 }
 
 bool StatsPullerManager::PullLocked(int tagId, const ConfigKey& configKey,
-                                    const int64_t eventTimeNs, vector<shared_ptr<LogEvent>>* data) {
+                                    const int64_t eventTimeNs, PullSnapshot* data) {
     vector<int32_t> uids;
+    if (!getPullAtomUidsLocked(tagId, configKey, &uids)) {
+        return false;
+    }
+    return PullLocked(tagId, uids, eventTimeNs, data);
+}
+
+void StatsPullerManager::prefetchPulls(const vector<int>& tagIds, const ConfigKey& configKey,
+                                       const int64_t eventTimeNs) {
+    std::lock_guard<std::mutex> _l(mLock);
+    if (mPullWorkerPool == nullptr || tagIds.size() < 2) {
+        return;
+    }
+    struct Prefetch {
+        sp<StatsPuller> puller;
+        PullErrorCode status = PULL_FAIL;
+    };
+    std::map<PullerKey, Prefetch> prefetches;
+    for (const int tagId : tagIds) {
+        vector<int32_t> uids;
+        if (!getPullAtomUidsLocked(tagId, configKey, &uids)) {
+            continue;
+        }
+        const auto pullerIt = findPullerLocked(tagId, uids);
+        if (pullerIt != kAllPullAtomInfo.end()) {
+            prefetches[pullerIt->first].puller = pullerIt->second;
+        }
+    }
+    // A single pull is left to Pull().
+    if (prefetches.size() < 2) {
+        return;
+    }
+    size_t pullShard = 0;
+    for (auto& [_, prefetch] : prefetches) {
+        mPullWorkerPool->post(pullShard, [&prefetch = prefetch, eventTimeNs] {
+            PullSnapshot data;
+            prefetch.status = prefetch.puller->Pull(eventTimeNs, &data);
+        });
+        pullShard = (pullShard + 1) % mPullWorkerPool->getNumShards();
+    }
+    mPullWorkerPool->waitForIdle();
+    for (const auto& [pullerKey, prefetch] : prefetches) {
+        onPullFinishedLocked(pullerKey, prefetch.status);
+    }
+}
+
+bool StatsPullerManager::getPullAtomUidsLocked(int tagId, const ConfigKey& configKey,
+                                               vector<int32_t>* uids) const {
     const auto& uidProviderIt = mPullUidProviders.find(configKey);
     if (uidProviderIt == mPullUidProviders.end()) {
         ALOGE("Error pulling tag %d. No pull uid provider for config key %s", tagId,
@@ -81,36 +140,48 @@ bool StatsPullerManager::PullLocked(int tagId, const ConfigKey& configKey,
         StatsdStats::getInstance().notePullUidProviderNotFound(tagId);
         return false;
     }
-    uids = pullUidProvider->getPullAtomUids(tagId);
-    return PullLocked(tagId, uids, eventTimeNs, data);
+    *uids = pullUidProvider->getPullAtomUids(tagId);
+    return true;
 }
 
 bool StatsPullerManager::PullLocked(int tagId, const vector<int32_t>& uids,
-                                    const int64_t eventTimeNs, vector<shared_ptr<LogEvent>>* data) {
+                                    const int64_t eventTimeNs, PullSnapshot* data) {
     VLOG("Initiating pulling %d", tagId);
+    const auto pullerIt = findPullerLocked(tagId, uids);
+    if (pullerIt == kAllPullAtomInfo.end()) {
+        StatsdStats::getInstance().notePullerNotFound(tagId);
+        ALOGW("StatsPullerManager: Unknown tagId %d", tagId);
+        return false;  // Return early since we don't know what to pull.
+    }
+    PullErrorCode status = pullerIt->second->Pull(eventTimeNs, data);
+    VLOG("pulled %zu items", *data != nullptr ? (*data)->size() : 0);
+    return onPullFinishedLocked(pullerIt->first, status);
+}
+
+std::map<const PullerKey, sp<StatsPuller>>::iterator StatsPullerManager::findPullerLocked(
+        int tagId, const vector<int32_t>& uids) {
     for (int32_t uid : uids) {
-        PullerKey key = {.uid = uid, .atomTag = tagId};
-        auto pullerIt = kAllPullAtomInfo.find(key);
+        auto pullerIt = kAllPullAtomInfo.find({.uid = uid, .atomTag = tagId});
         if (pullerIt != kAllPullAtomInfo.end()) {
-            PullErrorCode status = pullerIt->second->Pull(eventTimeNs, data);
-            VLOG("pulled %zu items", data->size());
-            if (status != PULL_SUCCESS) {
-                StatsdStats::getInstance().notePullFailed(tagId);
-            }
-            // If we received a dead object exception, it means the client process has died.
-            // We can remove the puller from the map.
-            if (status == PULL_DEAD_OBJECT) {
-                StatsdStats::getInstance().notePullerCallbackRegistrationChanged(
-                        tagId,
-                        /*registered=*/false);
-                kAllPullAtomInfo.erase(pullerIt);
-            }
-            return status == PULL_SUCCESS;
+            return pullerIt;
         }
     }
-    StatsdStats::getInstance().notePullerNotFound(tagId);
-    ALOGW("StatsPullerManager: Unknown tagId %d", tagId);
-    return false;  // Return early since we don't know what to pull.
+    return kAllPullAtomInfo.end();
+}
+
+bool StatsPullerManager::onPullFinishedLocked(const PullerKey& pullerKey, PullErrorCode status) {
+    if (status != PULL_SUCCESS) {
+        StatsdStats::getInstance().notePullFailed(pullerKey.atomTag);
+    }
+    // If we received a dead object exception, it means the client process has died.
+    // We can remove the puller from the map.
+    if (status == PULL_DEAD_OBJECT) {
+        StatsdStats::getInstance().notePullerCallbackRegistrationChanged(
+                pullerKey.atomTag,
+                /*registered=*/false);
+        kAllPullAtomInfo.erase(pullerKey);
+    }
+    return status == PULL_SUCCESS;
 }
 
 bool StatsPullerManager::PullerForMatcherExists(int tagId) const {
@@ -175,9 +246,10 @@ void StatsPullerManager::RegisterReceiver(int tagId, const ConfigKey& configKey,
     receivers.push_back(receiverInfo);
 
     // There is only one alarm for all pulled events. So only set it to the smallest denom.
-    if (nextPullTimeNs < mNextPullTimeNs) {
+    const int64_t pullAlarmTimeNs = getPullAlarmTimeNsLocked(receiverInfo);
+    if (pullAlarmTimeNs < mNextPullTimeNs) {
         VLOG("Updating next pull time %lld", (long long)mNextPullTimeNs);
-        mNextPullTimeNs = nextPullTimeNs;
+        mNextPullTimeNs = pullAlarmTimeNs;
         updateAlarmLocked();
     }
     VLOG("Puller for tagId %d registered of %d", tagId, (int)receivers.size());
@@ -217,49 +289,146 @@ void StatsPullerManager::UnregisterPullUidProvider(const ConfigKey& configKey,
 }
 
 void StatsPullerManager::OnAlarmFired(int64_t elapsedTimeNs) {
+    STATSD_TRACE_SCOPE("StatsPullerManager::OnAlarmFired");
     std::lock_guard<std::mutex> _l(mLock);
     int64_t wallClockNs = getWallClockNs();
 
     int64_t minNextPullTimeNs = NO_ALARM_UPDATE;
 
-    vector<pair<const ReceiverKey*, vector<ReceiverInfo*>>> needToPull;
+    // Receivers pulled ahead of their next pull time are given that time, so the pulls are
+    // grouped by the time their data is attributed to.
+    std::map<int64_t, vector<pair<const ReceiverKey*, vector<ReceiverInfo*>>>> needToPull;
     for (auto& pair : mReceivers) {
-        vector<ReceiverInfo*> receivers;
+        std::map<int64_t, vector<ReceiverInfo*>> receivers;
         if (pair.second.size() != 0) {
+            const int64_t pullLeadNs = getPullLeadNsLocked(pair.first);
             for (ReceiverInfo& receiverInfo : pair.second) {
                 // If pullNecessary and enough time has passed for the next bucket, then add
                 // receiver to the list that will pull on this alarm.
                 // If pullNecessary is false, check if next pull time needs to be updated.
                 sp<PullDataReceiver> receiverPtr = receiverInfo.receiver.promote();
                 const bool pullNecessary = receiverPtr != nullptr && receiverPtr->isPullNeeded();
-                if (receiverInfo.nextPullTimeNs <= elapsedTimeNs && pullNecessary) {
-                    receivers.push_back(&receiverInfo);
+                const bool pullDue = getPullAlarmTimeNsLocked(receiverInfo) <= elapsedTimeNs;
+                const int64_t pullTimeNs = max(receiverInfo.nextPullTimeNs, elapsedTimeNs);
+                if (pullDue && pullNecessary) {
+                    receiverInfo.pullLeadNs = pullLeadNs;
+                    receivers[pullTimeNs].push_back(&receiverInfo);
                 } else {
-                    if (receiverInfo.nextPullTimeNs <= elapsedTimeNs) {
-                        receiverPtr->onDataPulled({}, PullResult::PULL_NOT_NEEDED, elapsedTimeNs);
-                        int numBucketsAhead = (elapsedTimeNs - receiverInfo.nextPullTimeNs) /
+                    if (pullDue) {
+                        if (receiverPtr != nullptr) {
+                            receiverPtr->onDataPulled({}, PullResult::PULL_NOT_NEEDED, pullTimeNs);
+                            StatsdStats::getInstance().notePullNotNeeded(pair.first.atomTag);
+                        }
+                        int numBucketsAhead = (pullTimeNs - receiverInfo.nextPullTimeNs) /
                                               receiverInfo.intervalNs;
                         receiverInfo.nextPullTimeNs +=
                                 (numBucketsAhead + 1) * receiverInfo.intervalNs;
+                        receiverInfo.pullLeadNs = pullLeadNs;
                     }
-                    minNextPullTimeNs = min(receiverInfo.nextPullTimeNs, minNextPullTimeNs);
+                    minNextPullTimeNs =
+                            min(getPullAlarmTimeNsLocked(receiverInfo), minNextPullTimeNs);
                 }
             }
-            if (receivers.size() > 0) {
-                needToPull.push_back(make_pair(&pair.first, receivers));
+            for (auto& [pullTimeNs, pullTimeReceivers] : receivers) {
+                needToPull[pullTimeNs].push_back(
+                        make_pair(&pair.first, std::move(pullTimeReceivers)));
             }
         }
     }
-    for (const auto& pullInfo : needToPull) {
-        vector<shared_ptr<LogEvent>> data;
-        PullResult pullResult =
-                PullLocked(pullInfo.first->atomTag, pullInfo.first->configKey, elapsedTimeNs, &data)
-                        ? PullResult::PULL_RESULT_SUCCESS
-                        : PullResult::PULL_RESULT_FAIL;
-        if (pullResult == PullResult::PULL_RESULT_FAIL) {
-            VLOG("pull failed at %lld, will try again later", (long long)elapsedTimeNs);
+    for (const auto& [pullTimeNs, pulls] : needToPull) {
+        minNextPullTimeNs =
+                min(pullAndNotifyReceiversLocked(pulls, pullTimeNs,
+                                                 wallClockNs + pullTimeNs - elapsedTimeNs),
+                    minNextPullTimeNs);
+    }
+
+    VLOG("mNextPullTimeNs: %lld updated to %lld", (long long)mNextPullTimeNs,
+         (long long)minNextPullTimeNs);
+    mNextPullTimeNs = minNextPullTimeNs;
+    updateAlarmLocked();
+}
+
+int64_t StatsPullerManager::getPullLeadNsLocked(const ReceiverKey& receiverKey) {
+    if (!mEarlyScheduledPulls) {
+        return 0;
+    }
+    vector<int32_t> uids;
+    if (!getPullAtomUidsLocked(receiverKey.atomTag, receiverKey.configKey, &uids)) {
+        return 0;
+    }
+    const auto pullerIt = findPullerLocked(receiverKey.atomTag, uids);
+    if (pullerIt == kAllPullAtomInfo.end()) {
+        return 0;
+    }
+    const int64_t pullLatencyNs = pullerIt->second->getPullLatencyNs(kPullLeadPercentile);
+    return pullLatencyNs > kMaxPullLeadNs ? kMaxPullLeadNs : pullLatencyNs;
+}
+
+int64_t StatsPullerManager::getPullAlarmTimeNsLocked(const ReceiverInfo& receiverInfo) const {
+    const int64_t pullStartNs = receiverInfo.nextPullTimeNs - receiverInfo.pullLeadNs;
+    if (mPullAlarmGridNs <= 0 || receiverInfo.intervalNs % mPullAlarmGridNs != 0) {
+        return pullStartNs;
+    }
+    // Receivers of different configs have different bucket phases. Rounding their pulls up
+    // bounds their delay by the grid period while the receivers due in it share the alarm.
+    return (pullStartNs + mPullAlarmGridNs - 1) / mPullAlarmGridNs * mPullAlarmGridNs;
+}
+
+int64_t StatsPullerManager::pullAndNotifyReceiversLocked(
+        const vector<pair<const ReceiverKey*, vector<ReceiverInfo*>>>& needToPull,
+        int64_t elapsedTimeNs, int64_t wallClockNs) {
+    // Receivers of one entry of needToPull.
+    struct ReceiversToNotify {
+        int atomTag;
+        const ConfigKey* configKey;
+        const vector<sp<PullDataReceiver>>* receivers;
+    };
+    // Configs pulling the same atom usually resolve to the same puller, which is pulled once
+    // for all of them. This also keeps the events shared by its receivers from being modified
+    // by another pull.
+    struct ScheduledPull {
+        sp<StatsPuller> puller;
+        PullErrorCode status = PULL_FAIL;
+        PullSnapshot data;
+        vector<ReceiversToNotify> receivers;
+    };
+
+    vector<vector<sp<PullDataReceiver>>> receivers(needToPull.size());
+    std::map<PullerKey, ScheduledPull> scheduledPulls;
+    // Receivers of the atoms without puller, notified of the failure after the pulls.
+    vector<ReceiversToNotify> failedReceivers;
+    for (size_t i = 0; i < needToPull.size(); i++) {
+        const ReceiverKey& receiverKey = *needToPull[i].first;
+        for (const ReceiverInfo* receiverInfo : needToPull[i].second) {
+            receivers[i].push_back(receiverInfo->receiver.promote());
+        }
+        const ReceiversToNotify receiversToNotify = {.atomTag = receiverKey.atomTag,
+                                                     .configKey = &receiverKey.configKey,
+                                                     .receivers = &receivers[i]};
+
+        vector<int32_t> uids;
+        auto pullerIt = kAllPullAtomInfo.end();
+        if (getPullAtomUidsLocked(receiverKey.atomTag, receiverKey.configKey, &uids)) {
+            pullerIt = findPullerLocked(receiverKey.atomTag, uids);
+            if (pullerIt == kAllPullAtomInfo.end()) {
+                StatsdStats::getInstance().notePullerNotFound(receiverKey.atomTag);
+                ALOGW("StatsPullerManager: Unknown tagId %d", receiverKey.atomTag);
+            }
+        }
+        if (pullerIt == kAllPullAtomInfo.end()) {
+            failedReceivers.push_back(receiversToNotify);
+            continue;
         }
+        ScheduledPull& scheduledPull = scheduledPulls[pullerIt->first];
+        scheduledPull.puller = pullerIt->second;
+        scheduledPull.receivers.push_back(receiversToNotify);
+    }
 
+    const auto pull = [elapsedTimeNs, wallClockNs](ScheduledPull& scheduledPull) {
+        scheduledPull.status = scheduledPull.puller->Pull(elapsedTimeNs, &scheduledPull.data);
+        if (scheduledPull.status != PULL_SUCCESS) {
+            scheduledPull.data = std::make_shared<const vector<shared_ptr<LogEvent>>>();
+        }
         // Convention is to mark pull atom timestamp at request time.
         // If we pull at t0, puller starts at t1, finishes at t2, and send back
         // at t3, we mark t0 as its timestamp, which should correspond to its
@@ -267,30 +436,154 @@ void StatsPullerManager::OnAlarmFired(int64_t elapsedTimeNs) {
         // Here the triggering event is alarm fired from AlarmManager.
         // In ValueMetricProducer and GaugeMetricProducer we do same thing
         // when pull on condition change, etc.
-        for (auto& event : data) {
+        // The events are shared with the other users of the cache of the puller, which don't
+        // keep them past their pull, so their timestamps are set in place.
+        for (auto& event : *scheduledPull.data) {
             event->setElapsedTimestampNs(elapsedTimeNs);
             event->setLogdWallClockTimestampNs(wallClockNs);
         }
+    };
+    const auto notifyReceivers = [elapsedTimeNs](const ReceiversToNotify& receiversToNotify,
+                                                 const vector<shared_ptr<LogEvent>>& data,
+                                                 PullResult pullResult) {
+        for (const sp<PullDataReceiver>& receiver : *receiversToNotify.receivers) {
+            if (receiver != nullptr) {
+                const int64_t receiverStartNs = getElapsedRealtimeNs();
+                const int64_t receiverStartCpuNs = getThreadCpuTimeNs();
+                receiver->onDataPulled(data, pullResult, elapsedTimeNs);
+                StatsdStats::getInstance().notePullReceiverTime(
+                        receiversToNotify.atomTag, getElapsedRealtimeNs() - receiverStartNs);
+                StatsdStats::getInstance().noteConfigPullCpuTime(
+                        *receiversToNotify.configKey, getThreadCpuTimeNs() - receiverStartCpuNs);
+            }
+        }
+    };
+    const auto getPullResult = [](const ScheduledPull& scheduledPull) {
+        return scheduledPull.status == PULL_SUCCESS ? PullResult::PULL_RESULT_SUCCESS
+                                                    : PullResult::PULL_RESULT_FAIL;
+    };
+
+    // The receivers of a config share its matchers and condition trackers, so each config is
+    // pinned to a shard. Receivers of different configs share no state besides thread safe
+    // singletons such as StatsdStats.
+    ShardWorkerPool* receiverWorkerPool =
+            needToPull.size() > 1 ? mReceiverWorkerPool.get() : nullptr;
+    const auto postNotifications = [receiverWorkerPool, &notifyReceivers,
+                                    &getPullResult](const ScheduledPull& scheduledPull) {
+        const PullResult pullResult = getPullResult(scheduledPull);
+        for (const ReceiversToNotify& receiversToNotify : scheduledPull.receivers) {
+            const size_t shard = std::hash<ConfigKey>()(*receiversToNotify.configKey) %
+                                 receiverWorkerPool->getNumShards();
+            receiverWorkerPool->post(shard, [&receiversToNotify, &scheduledPull, pullResult,
+                                             &notifyReceivers] {
+                notifyReceivers(receiversToNotify, *scheduledPull.data, pullResult);
+            });
+        }
+    };
+
+    // The receivers of a puller are notified as soon as it is pulled when they have worker
+    // threads, after all the pulls otherwise.
+    if (mPullWorkerPool != nullptr && scheduledPulls.size() > 1) {
+        size_t pullShard = 0;
+        for (auto& [_, scheduledPull] : scheduledPulls) {
+            mPullWorkerPool->post(pullShard, [&scheduledPull = scheduledPull, receiverWorkerPool,
+                                              &pull, &postNotifications] {
+                pull(scheduledPull);
+                if (receiverWorkerPool != nullptr) {
+                    postNotifications(scheduledPull);
+                }
+            });
+            pullShard = (pullShard + 1) % mPullWorkerPool->getNumShards();
+        }
+        // The pull tasks post all the notifications before they complete.
+        mPullWorkerPool->waitForIdle();
+    } else {
+        for (auto& [_, scheduledPull] : scheduledPulls) {
+            pull(scheduledPull);
+            if (receiverWorkerPool != nullptr) {
+                postNotifications(scheduledPull);
+            }
+        }
+    }
+    if (receiverWorkerPool != nullptr) {
+        receiverWorkerPool->waitForIdle();
+    }
+
+    for (const auto& [pullerKey, scheduledPull] : scheduledPulls) {
+        if (!onPullFinishedLocked(pullerKey, scheduledPull.status)) {
+            VLOG("pull failed at %lld, will try again later", (long long)elapsedTimeNs);
+        }
+        if (receiverWorkerPool == nullptr) {
+            for (const ReceiversToNotify& receiversToNotify : scheduledPull.receivers) {
+                notifyReceivers(receiversToNotify, *scheduledPull.data,
+                                getPullResult(scheduledPull));
+            }
+        }
+    }
+    for (const ReceiversToNotify& receiversToNotify : failedReceivers) {
+        notifyReceivers(receiversToNotify, {}, PullResult::PULL_RESULT_FAIL);
+    }
 
-        for (const auto& receiverInfo : pullInfo.second) {
-            sp<PullDataReceiver> receiverPtr = receiverInfo->receiver.promote();
-            if (receiverPtr != nullptr) {
-                receiverPtr->onDataPulled(data, pullResult, elapsedTimeNs);
-                // We may have just come out of a coma, compute next pull time.
-                int numBucketsAhead =
-                        (elapsedTimeNs - receiverInfo->nextPullTimeNs) / receiverInfo->intervalNs;
-                receiverInfo->nextPullTimeNs += (numBucketsAhead + 1) * receiverInfo->intervalNs;
-                minNextPullTimeNs = min(receiverInfo->nextPullTimeNs, minNextPullTimeNs);
-            } else {
+    int64_t minNextPullTimeNs = NO_ALARM_UPDATE;
+    for (size_t i = 0; i < needToPull.size(); i++) {
+        for (size_t j = 0; j < needToPull[i].second.size(); j++) {
+            if (receivers[i][j] == nullptr) {
                 VLOG("receiver already gone.");
+                continue;
             }
+            ReceiverInfo* receiverInfo = needToPull[i].second[j];
+            // We may have just come out of a coma, compute next pull time.
+            int numBucketsAhead =
+                    (elapsedTimeNs - receiverInfo->nextPullTimeNs) / receiverInfo->intervalNs;
+            receiverInfo->nextPullTimeNs += (numBucketsAhead + 1) * receiverInfo->intervalNs;
+            minNextPullTimeNs = min(getPullAlarmTimeNsLocked(*receiverInfo), minNextPullTimeNs);
         }
     }
+    return minNextPullTimeNs;
+}
 
-    VLOG("mNextPullTimeNs: %lld updated to %lld", (long long)mNextPullTimeNs,
-         (long long)minNextPullTimeNs);
-    mNextPullTimeNs = minNextPullTimeNs;
-    updateAlarmLocked();
+void StatsPullerManager::setConcurrentPullThreads(size_t numThreads) {
+    std::lock_guard<std::mutex> _l(mLock);
+    if (numThreads < 2) {
+        mPullWorkerPool = nullptr;
+        return;
+    }
+    mPullWorkerPool = std::make_unique<ShardWorkerPool>(numThreads);
+}
+
+void StatsPullerManager::setEarlyScheduledPulls(bool earlyScheduledPulls) {
+    std::lock_guard<std::mutex> _l(mLock);
+    mEarlyScheduledPulls = earlyScheduledPulls;
+}
+
+void StatsPullerManager::setPullAlarmGrid(int64_t gridNs) {
+    std::lock_guard<std::mutex> _l(mLock);
+    mPullAlarmGridNs = gridNs;
+}
+
+void StatsPullerManager::setNativePullers(bool nativePullers) {
+    std::lock_guard<std::mutex> _l(mLock);
+    if (!nativePullers) {
+        for (const PullerKey& key : mNativePullerKeys) {
+            kAllPullAtomInfo.erase(key);
+        }
+        mNativePullerKeys.clear();
+        return;
+    }
+    for (const sp<NativePuller>& puller : createNativePullers()) {
+        const PullerKey key = {.uid = AID_SYSTEM, .atomTag = puller->getTagId()};
+        kAllPullAtomInfo[key] = puller;
+        mNativePullerKeys.insert(key);
+    }
+}
+
+void StatsPullerManager::setPullDataProcessingThreads(size_t numThreads) {
+    std::lock_guard<std::mutex> _l(mLock);
+    if (numThreads < 2) {
+        mReceiverWorkerPool = nullptr;
+        return;
+    }
+    mReceiverWorkerPool = std::make_unique<ShardWorkerPool>(numThreads);
 }
 
 int StatsPullerManager::ForceClearPullerCache() {
@@ -329,6 +622,10 @@ void StatsPullerManager::RegisterPullAtomCallback(const int uid, const int32_t a
     sp<StatsCallbackPuller> puller = new StatsCallbackPuller(atomTag, callback, actualCoolDownNs,
                                                              actualTimeoutNs, additiveFields);
     PullerKey key = {.uid = uid, .atomTag = atomTag};
+    if (mNativePullerKeys.find(key) != mNativePullerKeys.end()) {
+        VLOG("RegisterPullerCallback: atom %d is pulled natively", atomTag);
+        return;
+    }
     auto it = kAllPullAtomInfo.find(key);
     if (it != kAllPullAtomInfo.end()) {
         StatsdStats::getInstance().notePullerCallbackRegistrationChanged(atomTag,
@@ -341,6 +638,9 @@ void StatsPullerManager::RegisterPullAtomCallback(const int uid, const int32_t a
 void StatsPullerManager::UnregisterPullAtomCallback(const int uid, const int32_t atomTag) {
     std::lock_guard<std::mutex> _l(mLock);
     PullerKey key = {.uid = uid, .atomTag = atomTag};
+    if (mNativePullerKeys.find(key) != mNativePullerKeys.end()) {
+        return;
+    }
     if (kAllPullAtomInfo.find(key) != kAllPullAtomInfo.end()) {
         StatsdStats::getInstance().notePullerCallbackRegistrationChanged(atomTag,
                                                                          /*registered=*/false);
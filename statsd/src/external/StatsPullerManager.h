@@ -21,6 +21,8 @@
 #include <utils/RefBase.h>
 
 #include <list>
+#include <memory>
+#include <set>
 #include <vector>
 
 #include "PullDataReceiver.h"
@@ -29,6 +31,7 @@
 #include "guardrail/StatsdStats.h"
 #include "logd/LogEvent.h"
 #include "packages/UidMap.h"
+#include "utils/ShardWorkerPool.h"
 
 using aidl::android::os::IPullAtomCallback;
 using aidl::android::os::IStatsCompanionService;
@@ -91,6 +94,33 @@ public:
 
     void OnAlarmFired(int64_t elapsedTimeNs);
 
+    // Enables delivery of the data pulled on an alarm to the receivers of different configs on
+    // numThreads worker threads. The receivers of a config are called in order on the same
+    // thread, since they share its matchers and conditions. The pulls themselves are still done
+    // on the calling thread. A value lower than 2 disables the worker threads.
+    void setPullDataProcessingThreads(size_t numThreads);
+
+    // Enables pulling the atoms due on an alarm concurrently on numThreads worker threads. The
+    // receivers of an atom are notified as soon as its pull completes if they have worker
+    // threads (see setPullDataProcessingThreads), after all the pulls otherwise. A value lower
+    // than 2 disables the worker threads.
+    void setConcurrentPullThreads(size_t numThreads);
+
+    // Enables starting the scheduled pulls of an atom ahead of their bucket boundary by the 90th
+    // percentile of its recent pull latencies, so they complete around the boundary. The pulled
+    // data is still attributed to the boundary.
+    void setEarlyScheduledPulls(bool earlyScheduledPulls);
+
+    // Enables the native pullers, see createNativePullers. They replace the pullers registered
+    // by AID_SYSTEM for their atoms, whose callbacks are then ignored.
+    void setNativePullers(bool nativePullers);
+
+    // Enables aligning the scheduled pulls of the receivers whose interval is a multiple of
+    // gridNs to a common grid of that period: their pulls are delayed to the next multiple of
+    // gridNs, so the receivers due within the same period share an alarm and their pulls are
+    // batched. A value of 0 disables the alignment.
+    void setPullAlarmGrid(int64_t gridNs);
+
     // Pulls the most recent data.
     // The data may be served from cache if consecutive pulls come within
     // mCoolDownNs.
@@ -109,6 +139,10 @@ public:
     virtual bool Pull(int tagId, const vector<int32_t>& uids, int64_t eventTimeNs,
                       vector<std::shared_ptr<LogEvent>>* data);
 
+    // Pulls the atoms of the config concurrently when concurrent pulls are enabled, so that their
+    // Pull() for eventTimeNs is served from the cache of their pullers. Each puller is pulled once.
+    void prefetchPulls(const vector<int>& tagIds, const ConfigKey& configKey, int64_t eventTimeNs);
+
     // Clear pull data cache immediately.
     int ForceClearPullerCache();
 
@@ -128,6 +162,9 @@ public:
 private:
     const static int64_t kMinCoolDownNs = NS_PER_SEC;
     const static int64_t kMaxTimeoutNs = 10 * NS_PER_SEC;
+    // Percentile of the pull latencies of an atom that its scheduled pulls are started ahead by.
+    const static int kPullLeadPercentile = 90;
+    const static int64_t kMaxPullLeadNs = 5 * NS_PER_SEC;
     shared_ptr<IStatsCompanionService> mStatsCompanionService = nullptr;
 
     // A struct containing an atom id and a Config Key
@@ -144,6 +181,8 @@ private:
         int64_t nextPullTimeNs;
         int64_t intervalNs;
         wp<PullDataReceiver> receiver;
+        // How long before nextPullTimeNs the pull is started, see setEarlyScheduledPulls.
+        int64_t pullLeadNs = 0;
     } ReceiverInfo;
 
     // mapping from Receiver Key to receivers
@@ -152,11 +191,41 @@ private:
     // mapping from Config Key to the PullUidProvider for that config
     std::map<ConfigKey, wp<PullUidProvider>> mPullUidProviders;
 
+    // Same as Pull, but returns the snapshot cached by the puller instead of a copy of its
+    // events. The snapshot is set if the pull succeeded.
     bool PullLocked(int tagId, const ConfigKey& configKey, int64_t eventTimeNs,
-                    vector<std::shared_ptr<LogEvent>>* data);
+                    PullSnapshot* data);
 
     bool PullLocked(int tagId, const vector<int32_t>& uids, int64_t eventTimeNs,
-                    vector<std::shared_ptr<LogEvent>>* data);
+                    PullSnapshot* data);
+
+    // Gets the uids whose pullers are used for the atom of the config. Returns false if the
+    // config has no PullUidProvider.
+    bool getPullAtomUidsLocked(int tagId, const ConfigKey& configKey,
+                               vector<int32_t>* uids) const;
+
+    // Returns the puller of the atom registered by the first of the uids that has one, or the
+    // end of kAllPullAtomInfo.
+    std::map<const PullerKey, sp<StatsPuller>>::iterator findPullerLocked(
+            int tagId, const vector<int32_t>& uids);
+
+    // Notes the result of a pull of the puller and removes it if its process died. Returns
+    // true if the pull succeeded.
+    bool onPullFinishedLocked(const PullerKey& pullerKey, PullErrorCode status);
+
+    // Returns how long ahead of their next pull time the receivers are pulled.
+    int64_t getPullLeadNsLocked(const ReceiverKey& receiverKey);
+
+    // Returns when the alarm is needed for the next pull of the receiver, see setPullAlarmGrid.
+    int64_t getPullAlarmTimeNsLocked(const ReceiverInfo& receiverInfo) const;
+
+    // Pulls the atoms of the receivers, attributes the data to elapsedTimeNs and returns the
+    // earliest time the alarm is needed for their next pulls. Receivers whose atoms resolve to the
+    // same puller share a single pull. The pulls are done on mPullWorkerPool and the receivers of
+    // different configs are notified on mReceiverWorkerPool when they are set.
+    int64_t pullAndNotifyReceiversLocked(
+            const vector<std::pair<const ReceiverKey*, vector<ReceiverInfo*>>>& needToPull,
+            int64_t elapsedTimeNs, int64_t wallClockNs);
 
     // locks for data receiver and StatsCompanionService changes
     std::mutex mLock;
@@ -165,6 +234,19 @@ private:
 
     int64_t mNextPullTimeNs;
 
+    // Set when pulled data is delivered on worker threads, see setPullDataProcessingThreads.
+    std::unique_ptr<ShardWorkerPool> mReceiverWorkerPool;
+
+    // Set when the scheduled pulls are done concurrently, see setConcurrentPullThreads.
+    std::unique_ptr<ShardWorkerPool> mPullWorkerPool;
+
+    bool mEarlyScheduledPulls = false;
+
+    int64_t mPullAlarmGridNs = 0;
+
+    // Keys in kAllPullAtomInfo of the native pullers, see setNativePullers.
+    std::set<PullerKey> mNativePullerKeys;
+
     FRIEND_TEST(GaugeMetricE2ePulledTest, TestFirstNSamplesPulledNoTrigger);
     FRIEND_TEST(GaugeMetricE2ePulledTest, TestFirstNSamplesPulledNoTriggerWithActivation);
     FRIEND_TEST(GaugeMetricE2ePulledTest, TestRandomSamplePulledEvents);
@@ -176,6 +258,11 @@ private:
     FRIEND_TEST(ValueMetricE2eTest, TestPulledEvents_WithActivation);
 
     FRIEND_TEST(StatsLogProcessorTest, TestPullUidProviderSetOnConfigUpdate);
+    FRIEND_TEST(StatsPullerManagerTest, TestPullDataProcessingThreads);
+    FRIEND_TEST(StatsPullerManagerTest, TestConcurrentPullThreads);
+    FRIEND_TEST(StatsPullerManagerTest, TestEarlyScheduledPulls);
+    FRIEND_TEST(StatsPullerManagerTest, TestPullAlarmGrid);
+    FRIEND_TEST(StatsPullerManagerTest, TestPullNotNeeded);
 
     FRIEND_TEST(ConfigUpdateE2eTest, TestGaugeMetric);
     FRIEND_TEST(ConfigUpdateE2eTest, TestValueMetric);
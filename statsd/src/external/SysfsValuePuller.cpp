@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "SysfsValuePuller.h"
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+using android::base::ParseInt;
+using android::base::ReadFileToString;
+using android::base::Trim;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace android {
+namespace os {
+namespace statsd {
+
+SysfsValuePuller::SysfsValuePuller(const int tagId, const string& path, const int64_t divisor,
+                                   const int64_t multiplier, const bool int64Value)
+    : NativePuller(tagId),
+      mPath(path),
+      mDivisor(divisor),
+      mMultiplier(multiplier),
+      mInt64Value(int64Value) {
+}
+
+PullErrorCode SysfsValuePuller::PullInternal(vector<shared_ptr<LogEvent>>* data) {
+    string content;
+    if (!ReadFileToString(mPath, &content)) {
+        ALOGW("Failed to read %s", mPath.c_str());
+        return PULL_FAIL;
+    }
+    int64_t value;
+    if (!ParseInt(Trim(content), &value)) {
+        ALOGW("Failed to parse %s for atom %d", mPath.c_str(), mTagId);
+        return PULL_FAIL;
+    }
+    value = value * mMultiplier / mDivisor;
+    AStatsEvent* statsEvent = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(statsEvent, mTagId);
+    if (mInt64Value) {
+        AStatsEvent_writeInt64(statsEvent, value);
+    } else {
+        AStatsEvent_writeInt32(statsEvent, value);
+    }
+    return addEvent(statsEvent, data) ? PULL_SUCCESS : PULL_FAIL;
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
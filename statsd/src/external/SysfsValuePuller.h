@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "NativePuller.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Reads an atom with a single value from a file holding one integer, like the sysfs attributes
+ * of the battery. The value is converted to the unit of the atom as value * multiplier / divisor.
+ */
+class SysfsValuePuller : public NativePuller {
+public:
+    SysfsValuePuller(const int tagId, const std::string& path, const int64_t divisor = 1,
+                     const int64_t multiplier = 1, const bool int64Value = false);
+
+private:
+    const std::string mPath;
+
+    const int64_t mDivisor;
+
+    const int64_t mMultiplier;
+
+    // Whether the atom field is an int64 rather than an int32.
+    const bool mInt64Value;
+
+    PullErrorCode PullInternal(std::vector<std::shared_ptr<LogEvent>>* data) override;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -18,6 +18,9 @@
 #include "Log.h"
 
 #include "puller_util.h"
+
+#include <unordered_map>
+
 #include "stats_log_util.h"
 
 namespace android {
@@ -26,6 +29,106 @@ namespace statsd {
 
 using namespace std;
 
+namespace {
+
+// Below this number of pulled events, sorting them all is cheap and the events are merged in
+// sorted order. Above it, only the events with isolated uids are merged into their host events.
+const size_t kMinEventsForIncrementalMerge = 100;
+
+// Returns whether the events only differ on their additive fields. Repeated additive fields are
+// treated as non-additive fields.
+bool canMerge(const vector<FieldValue>& lhsValues, const vector<FieldValue>& rhsValues,
+              const set<int>& additiveFields) {
+    // Size different, must be different chains or repeated fields.
+    if (lhsValues.size() != rhsValues.size()) {
+        return false;
+    }
+    for (size_t p = 0; p < lhsValues.size(); p++) {
+        if (lhsValues[p].mField != rhsValues[p].mField) {
+            return false;
+        }
+        if (lhsValues[p].mValue != rhsValues[p].mValue) {
+            int pos = lhsValues[p].mField.getPosAtDepth(0);
+            // Differ on non-additive field, abort.
+            if (isPrimitiveRepeatedField(lhsValues[p].mField) ||
+                (additiveFields.find(pos) == additiveFields.end())) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Adds the additive fields of an event to those of an event it can be merged with.
+void mergeAdditiveFields(const vector<FieldValue>& fromValues, vector<FieldValue>* toValues,
+                         const set<int>& additiveFields) {
+    for (size_t p = 0; p < fromValues.size(); p++) {
+        int pos = fromValues[p].mField.getPosAtDepth(0);
+        // Don't merge repeated fields.
+        if (!isPrimitiveRepeatedField(fromValues[p].mField) &&
+            (additiveFields.find(pos) != additiveFields.end())) {
+            (*toValues)[p].mValue += fromValues[p].mValue;
+        }
+    }
+}
+
+// Merges each event that had an isolated uid into the first event that it can be merged with,
+// either an event of the host uid or a previous event with an isolated uid of the same host.
+// Events that can be merged have the same uids, so the events are indexed by their first uid and
+// only the events of the hosts of the isolated uids are compared. The order of the events is
+// kept.
+void mergeIsolatedUidEvents(vector<shared_ptr<LogEvent>>& data, const vector<int>& firstUids,
+                            const vector<size_t>& isolatedEvents,
+                            const set<int>& additiveFields) {
+    unordered_map<int, vector<size_t>> eventsByUid;
+    for (size_t i : isolatedEvents) {
+        eventsByUid[firstUids[i]];
+    }
+    vector<bool> isIsolated(data.size(), false);
+    for (size_t i : isolatedEvents) {
+        isIsolated[i] = true;
+    }
+    for (size_t i = 0; i < data.size(); i++) {
+        if (isIsolated[i]) {
+            continue;
+        }
+        auto it = eventsByUid.find(firstUids[i]);
+        if (it != eventsByUid.end()) {
+            it->second.push_back(i);
+        }
+    }
+
+    vector<bool> isMerged(data.size(), false);
+    for (size_t i : isolatedEvents) {
+        vector<size_t>& hostEvents = eventsByUid[firstUids[i]];
+        const vector<FieldValue>& values = data[i]->getValues();
+        bool merged = false;
+        for (size_t j : hostEvents) {
+            vector<FieldValue>* hostValues = data[j]->getMutableValues();
+            if (canMerge(*hostValues, values, additiveFields)) {
+                mergeAdditiveFields(values, hostValues, additiveFields);
+                merged = true;
+                break;
+            }
+        }
+        if (merged) {
+            isMerged[i] = true;
+        } else {
+            hostEvents.push_back(i);
+        }
+    }
+
+    size_t numEvents = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        if (!isMerged[i]) {
+            data[numEvents++] = std::move(data[i]);
+        }
+    }
+    data.resize(numEvents);
+}
+
+}  // namespace
+
 /**
  * Process all data and merge isolated with host if necessary.
  * For example:
@@ -46,6 +149,9 @@ using namespace std;
  * [uid1, bg, 100, 200]
  *
  * All atoms should be of the same tagId. All fields should be present.
+ *
+ * Small pulls are sorted and merged. Large pulls, such as per-uid atoms with thousands of events,
+ * only merge their few events with isolated uids and are not sorted.
  */
 void mapAndMergeIsolatedUidsToHostUid(vector<shared_ptr<LogEvent>>& data, const sp<UidMap>& uidMap,
                                       int tagId, const vector<int>& additiveFieldsVec) {
@@ -60,24 +166,59 @@ void mapAndMergeIsolatedUidsToHostUid(vector<shared_ptr<LogEvent>>& data, const
         return;
     }
 
+    const bool incrementalMerge = data.size() >= kMinEventsForIncrementalMerge;
+    // Only kept for the incremental merge, indexed like data.
+    vector<int> firstUids;
+    vector<size_t> isolatedEvents;
+    if (incrementalMerge) {
+        firstUids.resize(data.size());
+    }
+
     // 1. Map all isolated uid in-place to host uid
-    for (shared_ptr<LogEvent>& event : data) {
-        if (event->GetTagId() != tagId) {
-            ALOGE("Wrong atom. Expecting %d, got %d", tagId, event->GetTagId());
+    for (size_t e = 0; e < data.size(); e++) {
+        LogEvent& event = *data[e];
+        if (event.GetTagId() != tagId) {
+            ALOGE("Wrong atom. Expecting %d, got %d", tagId, event.GetTagId());
             return;
         }
+        vector<FieldValue>* const fieldValues = event.getMutableValues();
+        bool hasIsolatedUid = false;
+        bool hasFirstUid = false;
+        const auto mapUid = [&](FieldValue& fieldValue) {
+            const int uid = fieldValue.mValue.int_value;
+            const int hostUid = uidMap->getHostUidOrSelf(uid);
+            if (hostUid != uid) {
+                fieldValue.mValue.setInt(hostUid);
+                hasIsolatedUid = true;
+            }
+            if (incrementalMerge && !hasFirstUid) {
+                firstUids[e] = hostUid;
+                hasFirstUid = true;
+            }
+        };
         if (hasAttributionChain) {
-            vector<FieldValue>* const fieldValues = event->getMutableValues();
             for (size_t i = attrIndexRange.first; i <= attrIndexRange.second; i++) {
                 FieldValue& fieldValue = fieldValues->at(i);
                 if (isAttributionUidField(fieldValue)) {
-                    const int hostUid = uidMap->getHostUidOrSelf(fieldValue.mValue.int_value);
-                    fieldValue.mValue.setInt(hostUid);
+                    mapUid(fieldValue);
                 }
             }
         } else {
-            mapIsolatedUidsToHostUidInLogEvent(uidMap, *event);
+            for (const size_t index : event.getUidFieldIndices()) {
+                mapUid((*fieldValues)[index]);
+            }
+        }
+        if (incrementalMerge && hasIsolatedUid) {
+            isolatedEvents.push_back(e);
+        }
+    }
+
+    const set<int> additiveFields(additiveFieldsVec.begin(), additiveFieldsVec.end());
+    if (incrementalMerge) {
+        if (!isolatedEvents.empty()) {
+            mergeIsolatedUidEvents(data, firstUids, isolatedEvents, additiveFields);
         }
+        return;
     }
 
     // 2. sort the data, bit-wise
@@ -97,8 +238,6 @@ void mapAndMergeIsolatedUidsToHostUid(vector<shared_ptr<LogEvent>>& data, const
          });
 
     vector<shared_ptr<LogEvent>> mergedData;
-    const set<int> additiveFields(additiveFieldsVec.begin(), additiveFieldsVec.end());
-    bool needMerge = true;
 
     // 3. do the merge.
     // The loop invariant is this: for every event,
@@ -109,43 +248,14 @@ void mapAndMergeIsolatedUidsToHostUid(vector<shared_ptr<LogEvent>>& data, const
     // If any are true, no need to merge, add itself to the result. Otherwise, merge the
     // value onto the one immediately next to it.
     for (int i = 0; i < (int)data.size() - 1; i++) {
-        // Size different, must be different chains or repeated fields.
-        if (data[i]->size() != data[i + 1]->size()) {
-            mergedData.push_back(data[i]);
-            continue;
-        }
-        vector<FieldValue>* lhsValues = data[i]->getMutableValues();
+        const vector<FieldValue>& lhsValues = data[i]->getValues();
         vector<FieldValue>* rhsValues = data[i + 1]->getMutableValues();
-        needMerge = true;
-        for (int p = 0; p < (int)lhsValues->size(); p++) {
-            if ((*lhsValues)[p].mField != (*rhsValues)[p].mField) {
-                needMerge = false;
-                break;
-            }
-            if ((*lhsValues)[p].mValue != (*rhsValues)[p].mValue) {
-                int pos = (*lhsValues)[p].mField.getPosAtDepth(0);
-                // Differ on non-additive field, abort.
-                // Repeated additive fields are treated as non-additive fields.
-                if (isPrimitiveRepeatedField((*lhsValues)[p].mField) ||
-                    (additiveFields.find(pos) == additiveFields.end())) {
-                    needMerge = false;
-                    break;
-                }
-            }
-        }
-        if (!needMerge) {
+        if (!canMerge(lhsValues, *rhsValues, additiveFields)) {
             mergedData.push_back(data[i]);
             continue;
         }
         // This should be infrequent operation.
-        for (int p = 0; p < (int)lhsValues->size(); p++) {
-            int pos = (*lhsValues)[p].mField.getPosAtDepth(0);
-            // Don't merge repeated fields.
-            if (!isPrimitiveRepeatedField((*lhsValues)[p].mField) &&
-                (additiveFields.find(pos) != additiveFields.end())) {
-                (*rhsValues)[p].mValue += (*lhsValues)[p].mValue;
-            }
-        }
+        mergeAdditiveFields(lhsValues, rhsValues, additiveFields);
     }
     mergedData.push_back(data.back());
 
@@ -40,6 +40,62 @@ const std::string STATSD_NATIVE_BOOT_NAMESPACE = "statsd_native_boot";
 
 const std::string STATSD_INIT_COMPLETED_NO_DELAY_FLAG = "statsd_init_completed_no_delay";
 
+const std::string STATSD_SHARDED_EVENT_PROCESSING_FLAG = "statsd_sharded_event_processing";
+
+const std::string STATSD_PARALLEL_PULL_PROCESSING_FLAG = "statsd_parallel_pull_processing";
+
+const std::string STATSD_CONCURRENT_PULLS_FLAG = "statsd_concurrent_pulls";
+
+const std::string STATSD_EARLY_SCHEDULED_PULLS_FLAG = "statsd_early_scheduled_pulls";
+
+const std::string STATSD_PULL_RATE_LIMITING_FLAG = "statsd_pull_rate_limiting";
+
+const std::string STATSD_NATIVE_PULLERS_FLAG = "statsd_native_pullers";
+
+const std::string STATSD_PULL_ALARM_ALIGNMENT_FLAG = "statsd_pull_alarm_alignment";
+
+const std::string STATSD_ASYNC_DISK_WRITES_FLAG = "statsd_async_disk_writes";
+
+const std::string STATSD_COMPRESSED_REPORTS_FLAG = "statsd_compressed_reports";
+
+const std::string STATSD_DATA_DIR_INDEX_FLAG = "statsd_data_dir_index";
+
+const std::string STATSD_REPORT_LOGS_FLAG = "statsd_report_logs";
+
+const std::string STATSD_PERSISTENT_DB_CONNECTIONS_FLAG = "statsd_persistent_db_connections";
+
+const std::string STATSD_ASYNC_DB_WRITES_FLAG = "statsd_async_db_writes";
+
+const std::string STATSD_ASYNC_QUERIES_FLAG = "statsd_async_queries";
+
+const std::string STATSD_PARALLEL_MATCHING_FLAG = "statsd_parallel_matching";
+
+const std::string STATSD_OFF_LOCK_CONFIG_BUILDS_FLAG = "statsd_off_lock_config_builds";
+
+const std::string STATSD_DEFERRED_HOUSEKEEPING_FLAG = "statsd_deferred_housekeeping";
+
+const std::string STATSD_ASYNC_SUBSCRIBERS_FLAG = "statsd_async_subscribers";
+
+const std::string STATSD_MEMORY_PRESSURE_MONITOR_FLAG = "statsd_memory_pressure_monitor";
+
+const std::string STATSD_SHARED_CONDITIONS_FLAG = "statsd_shared_conditions";
+
+// Scheduling of the ingestion threads, see ThreadScheduling.
+const std::string STATSD_LOGS_READER_SCHEDULING_FLAG = "statsd_logs_reader_scheduling";
+
+const std::string STATSD_SOCKET_LISTENER_SCHEDULING_FLAG = "statsd_socket_listener_scheduling";
+
+// Maximum number of binder threads, see main().
+const std::string STATSD_BINDER_THREAD_POOL_SIZE_FLAG = "statsd_binder_thread_pool_size";
+
+const std::string STATSD_PULL_RESULT_PRIORITY_FLAG = "statsd_pull_result_priority";
+
+// Atoms whose identical repeats are collapsed by the socket listeners, see parseDedupeWindows().
+const std::string STATSD_SOCKET_DEDUPE_WINDOWS_FLAG = "statsd_socket_dedupe_windows";
+
+// (*MUST BE IN SYNC WITH libstatssocket BufferWriterQueue*)
+const std::string STATSD_SOCKET_SHARED_MEMORY_RING_FLAG = "socket_shared_memory_ring";
+
 const std::string FLAG_TRUE = "true";
 const std::string FLAG_FALSE = "false";
 const std::string FLAG_EMPTY = "";
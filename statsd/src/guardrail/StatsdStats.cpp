@@ -63,6 +63,7 @@ const int FIELD_ID_STATSD_STATS_ID = 22;
 const int FIELD_ID_SUBSCRIPTION_STATS = 23;
 const int FIELD_ID_SOCKET_LOSS_STATS = 24;
 const int FIELD_ID_QUEUE_STATS = 25;
+const int FIELD_ID_ATOM_LATENCY_STATS = 26;
 
 const int FIELD_ID_RESTRICTED_METRIC_QUERY_STATS_CALLING_UID = 1;
 const int FIELD_ID_RESTRICTED_METRIC_QUERY_STATS_CONFIG_ID = 2;
@@ -79,6 +80,7 @@ const int FIELD_ID_ATOM_STATS_COUNT = 2;
 const int FIELD_ID_ATOM_STATS_ERROR_COUNT = 3;
 const int FIELD_ID_ATOM_STATS_DROPS_COUNT = 4;
 const int FIELD_ID_ATOM_STATS_SKIP_COUNT = 5;
+const int FIELD_ID_ATOM_STATS_DEDUPE_COUNT = 6;
 
 const int FIELD_ID_ANOMALY_ALARMS_REGISTERED = 1;
 const int FIELD_ID_PERIODIC_ALARMS_REGISTERED = 1;
@@ -96,6 +98,9 @@ const int FIELD_ID_OVERFLOW_MIN_HISTORY = 3;
 
 const int FIELD_ID_QUEUE_MAX_SIZE_OBSERVED = 1;
 const int FIELD_ID_QUEUE_MAX_SIZE_OBSERVED_ELAPSED_NANOS = 2;
+const int FIELD_ID_QUEUE_SOCKET_MAX_DEPTH_OBSERVED = 3;
+const int FIELD_ID_QUEUE_SOCKET_MAX_DEPTH_OBSERVED_ELAPSED_NANOS = 4;
+const int FIELD_ID_QUEUE_SOCKET_FULL_DRAIN_COUNT = 5;
 
 const int FIELD_ID_CONFIG_STATS_UID = 1;
 const int FIELD_ID_CONFIG_STATS_ID = 2;
@@ -136,6 +141,23 @@ const int FIELD_ID_DB_DELETION_CONFIG_INVALID = 34;
 const int FIELD_ID_DB_DELETION_TOO_OLD = 35;
 const int FIELD_ID_DB_DELETION_CONFIG_REMOVED = 36;
 const int FIELD_ID_DB_DELETION_CONFIG_UPDATED = 37;
+const int FIELD_ID_INIT_PARSE_LATENCY_NS = 38;
+const int FIELD_ID_INIT_MATCHERS_LATENCY_NS = 39;
+const int FIELD_ID_INIT_CONDITIONS_LATENCY_NS = 40;
+const int FIELD_ID_INIT_STATES_LATENCY_NS = 41;
+const int FIELD_ID_INIT_METRICS_LATENCY_NS = 42;
+const int FIELD_ID_INIT_ALERTS_LATENCY_NS = 43;
+const int FIELD_ID_CONFIG_STATS_PROCESSING_TIME_NANOS_HISTOGRAM = 44;
+const int FIELD_ID_CONFIG_STATS_LOG_EVENT_CPU_TIME_NS = 45;
+const int FIELD_ID_CONFIG_STATS_PULL_CPU_TIME_NS = 46;
+const int FIELD_ID_CONFIG_STATS_DUMP_REPORT_CPU_TIME_NS = 47;
+const int FIELD_ID_CONFIG_STATS_BUCKET_BYTES = 48;
+const int FIELD_ID_CONFIG_STATS_DIMENSION_COUNT = 49;
+const int FIELD_ID_CONFIG_STATS_GAUGE_ATOM_COUNT = 50;
+
+const int FIELD_ID_ATOM_LATENCY_STATS_TAG = 1;
+const int FIELD_ID_ATOM_LATENCY_STATS_QUEUE_TIME_NANOS_HISTOGRAM = 2;
+const int FIELD_ID_ATOM_LATENCY_STATS_PROCESSING_TIME_NANOS_HISTOGRAM = 3;
 
 const int FIELD_ID_INVALID_CONFIG_REASON_ENUM = 1;
 const int FIELD_ID_INVALID_CONFIG_REASON_METRIC_ID = 2;
@@ -171,6 +193,11 @@ const int FIELD_ID_SOCKET_LOSS_STATS_OVERFLOW_COUNTERS = 2;
 const int FIELD_ID_SOCKET_LOSS_STATS_OVERFLOW_COUNTERS_UID = 1;
 const int FIELD_ID_SOCKET_LOSS_STATS_OVERFLOW_COUNTERS_COUNT = 2;
 
+// SocketLossStats.QueueHighWaterMark
+const int FIELD_ID_SOCKET_LOSS_STATS_QUEUE_HIGH_WATER_MARKS = 3;
+const int FIELD_ID_SOCKET_LOSS_STATS_QUEUE_HIGH_WATER_MARKS_UID = 1;
+const int FIELD_ID_SOCKET_LOSS_STATS_QUEUE_HIGH_WATER_MARKS_MAX_SIZE = 2;
+
 // for LossStatsPerUid proto
 const int FIELD_ID_SOCKET_LOSS_STATS_UID = 1;
 const int FIELD_ID_SOCKET_LOSS_STATS_FIRST_TIMESTAMP_NANOS = 2;
@@ -207,7 +234,6 @@ const std::map<int, std::pair<size_t, size_t>> StatsdStats::kAtomDimensionKeySiz
 };
 
 StatsdStats::StatsdStats() : mStatsdStatsId(rand()) {
-    mPushedAtomStats.resize(kMaxPushedAtomId + 1);
     mStartTimeSec = getWallClockSec();
 }
 
@@ -227,7 +253,7 @@ void StatsdStats::addToIceBoxLocked(shared_ptr<ConfigStats>& stats) {
 void StatsdStats::noteConfigReceived(
         const ConfigKey& key, int metricsCount, int conditionsCount, int matchersCount,
         int alertsCount, const std::list<std::pair<const int64_t, const int32_t>>& annotations,
-        const optional<InvalidConfigReason>& reason) {
+        const optional<InvalidConfigReason>& reason, const ConfigInitLatencies& initLatencies) {
     lock_guard<std::mutex> lock(mLock);
     int32_t nowTimeSec = getWallClockSec();
 
@@ -244,6 +270,13 @@ void StatsdStats::noteConfigReceived(
     configStats->alert_count = alertsCount;
     configStats->is_valid = !reason.has_value();
     configStats->reason = reason;
+    configStats->init_latencies = initLatencies;
+    configStats->init_latencies.parseNs = 0;
+    auto parseLatencyIt = mPendingConfigParseLatenciesNs.find(key);
+    if (parseLatencyIt != mPendingConfigParseLatenciesNs.end()) {
+        configStats->init_latencies.parseNs = parseLatencyIt->second;
+        mPendingConfigParseLatenciesNs.erase(parseLatencyIt);
+    }
     for (auto& v : annotations) {
         configStats->annotations.emplace_back(v);
     }
@@ -256,6 +289,15 @@ void StatsdStats::noteConfigReceived(
     }
 }
 
+void StatsdStats::noteConfigParsed(const ConfigKey& key, int64_t latencyNs) {
+    lock_guard<std::mutex> lock(mLock);
+    if (mPendingConfigParseLatenciesNs.size() >= kMaxPendingConfigParseLatencies &&
+        mPendingConfigParseLatenciesNs.find(key) == mPendingConfigParseLatenciesNs.end()) {
+        return;
+    }
+    mPendingConfigParseLatenciesNs[key] = latencyNs;
+}
+
 void StatsdStats::noteConfigRemovedInternalLocked(const ConfigKey& key) {
     auto it = mConfigStats.find(key);
     if (it != mConfigStats.end()) {
@@ -264,6 +306,7 @@ void StatsdStats::noteConfigRemovedInternalLocked(const ConfigKey& key) {
         addToIceBoxLocked(it->second);
         mConfigStats.erase(it);
     }
+    mConfigProcessingTimeNsHistograms.erase(key);
 }
 
 void StatsdStats::noteConfigRemoved(const ConfigKey& key) {
@@ -366,11 +409,33 @@ void StatsdStats::noteEventQueueOverflow(int64_t oldestEventTimestampNs, int32_t
 }
 
 void StatsdStats::noteEventQueueSize(int32_t size, int64_t eventTimestampNs) {
-    lock_guard<std::mutex> lock(mLock);
+    // Called for every event, so the max is updated without mLock. The timestamp may be briefly
+    // out of sync with the size when two threads race to set a new max.
+    int32_t maxSize = mEventQueueMaxSizeObserved.load(std::memory_order_relaxed);
+    while (maxSize < size) {
+        if (mEventQueueMaxSizeObserved.compare_exchange_weak(maxSize, size,
+                                                             std::memory_order_relaxed)) {
+            mEventQueueMaxSizeObservedElapsedNanos.store(eventTimestampNs,
+                                                         std::memory_order_relaxed);
+            break;
+        }
+    }
+}
 
-    if (mEventQueueMaxSizeObserved < size) {
-        mEventQueueMaxSizeObserved = size;
-        mEventQueueMaxSizeObservedElapsedNanos = eventTimestampNs;
+void StatsdStats::noteSocketDrain(int32_t datagramCount, int32_t batchSize,
+                                  int64_t timestampNs) {
+    // Called for every drain of the sockets, updated without mLock like noteEventQueueSize.
+    if (datagramCount >= batchSize) {
+        mSocketFullDrainCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    int32_t maxDepth = mSocketQueueMaxDepthObserved.load(std::memory_order_relaxed);
+    while (maxDepth < datagramCount) {
+        if (mSocketQueueMaxDepthObserved.compare_exchange_weak(maxDepth, datagramCount,
+                                                               std::memory_order_relaxed)) {
+            mSocketQueueMaxDepthObservedElapsedNanos.store(timestampNs,
+                                                           std::memory_order_relaxed);
+            break;
+        }
     }
 }
 
@@ -382,10 +447,38 @@ void StatsdStats::noteAtomDroppedLocked(int32_t atomId) {
     }
 }
 
+void StatsdStats::noteAtomDeduped(int32_t atomId, int32_t count) {
+    if (count <= 0) {
+        return;
+    }
+    lock_guard<std::mutex> lock(mLock);
+    constexpr int kMaxPushedAtomDedupeStatsSize = kMaxPushedAtomId + kMaxNonPlatformPushedAtoms;
+    if (mPushedAtomDedupeStats.size() < kMaxPushedAtomDedupeStatsSize ||
+        mPushedAtomDedupeStats.find(atomId) != mPushedAtomDedupeStats.end()) {
+        mPushedAtomDedupeStats[atomId] += count;
+    }
+}
+
 void StatsdStats::noteAtomSocketLoss(const SocketLossInfo& lossInfo) {
+    lock_guard<std::mutex> lock(mLock);
+
+    if (lossInfo.queueHighWaterMark > 0) {
+        auto highWaterMarkPerUid = mSocketQueueHighWaterMarks.find(lossInfo.uid);
+        if (highWaterMarkPerUid != mSocketQueueHighWaterMarks.end()) {
+            highWaterMarkPerUid->second =
+                    std::max(highWaterMarkPerUid->second, lossInfo.queueHighWaterMark);
+        } else if (mSocketQueueHighWaterMarks.size() < kMaxSocketLossStatsSize) {
+            mSocketQueueHighWaterMarks[lossInfo.uid] = lossInfo.queueHighWaterMark;
+        }
+    }
+
+    if (lossInfo.atomIds.empty() && lossInfo.overflowCounter == 0) {
+        // only the queue high-water mark was reported, nothing was lost
+        return;
+    }
+
     ALOGW("SocketLossEvent detected: %lld (firstLossTsNanos), %lld (lastLossTsNanos)",
           (long long)lossInfo.firstLossTsNanos, (long long)lossInfo.lastLossTsNanos);
-    lock_guard<std::mutex> lock(mLock);
 
     if (mSocketLossStats.size() == kMaxSocketLossStatsSize) {
         // erase the oldest record
@@ -631,9 +724,68 @@ void StatsdStats::notePullFromCache(int pullAtomId) {
     mPulledAtomStats[pullAtomId].totalPullFromCache++;
 }
 
+void StatsdStats::Histogram::add(int64_t value) {
+    const int bin = getBin(value);
+    if (mBinCounts.empty()) {
+        mFirstBin = bin;
+        mBinCounts.push_back(0);
+    } else if (bin < mFirstBin) {
+        mBinCounts.insert(mBinCounts.begin(), mFirstBin - bin, 0);
+        mFirstBin = bin;
+    } else if (bin - mFirstBin >= (int)mBinCounts.size()) {
+        mBinCounts.resize(bin - mFirstBin + 1);
+    }
+    mBinCounts[bin - mFirstBin]++;
+    mCount++;
+}
+
+int64_t StatsdStats::Histogram::getPercentile(int percentile) const {
+    if (mCount == 0) {
+        return 0;
+    }
+    const int64_t rank = std::max((mCount * percentile + 99) / 100, (int64_t)1);
+    int64_t count = 0;
+    for (size_t i = 0; i < mBinCounts.size(); i++) {
+        count += mBinCounts[i];
+        if (count >= rank) {
+            return getBinUpperBound(mFirstBin + i);
+        }
+    }
+    return getBinUpperBound(mFirstBin + mBinCounts.size() - 1);
+}
+
+void StatsdStats::Histogram::reset() {
+    mFirstBin = 0;
+    mBinCounts.clear();
+    mCount = 0;
+}
+
+int StatsdStats::Histogram::getBin(int64_t value) {
+    // The values below 2^(kSubBinBits + 1) have a bin each.
+    if (value < (1 << (kSubBinBits + 1))) {
+        return value < 0 ? 0 : value;
+    }
+    // Otherwise the bits after the most significant one select the sub bin of its power of 2.
+    const int exponent = 63 - __builtin_clzll(value);
+    const int shift = exponent - kSubBinBits;
+    const int subBin = (value >> shift) & ((1 << kSubBinBits) - 1);
+    return ((shift + 1) << kSubBinBits) + subBin;
+}
+
+int64_t StatsdStats::Histogram::getBinUpperBound(int bin) {
+    if (bin < (1 << (kSubBinBits + 1))) {
+        return bin;
+    }
+    const int shift = (bin >> kSubBinBits) - 1;
+    const int64_t subBin = bin & ((1 << kSubBinBits) - 1);
+    const int64_t lowerBound = ((int64_t)(1 << kSubBinBits) + subBin) << shift;
+    return lowerBound + (((int64_t)1 << shift) - 1);
+}
+
 void StatsdStats::notePullTime(int pullAtomId, int64_t pullTimeNs) {
     lock_guard<std::mutex> lock(mLock);
     auto& pullStats = mPulledAtomStats[pullAtomId];
+    pullStats.pullTimeNsHistogram.add(pullTimeNs);
     pullStats.maxPullTimeNs = std::max(pullStats.maxPullTimeNs, pullTimeNs);
     pullStats.avgPullTimeNs = (pullStats.avgPullTimeNs * pullStats.numPullTime + pullTimeNs) /
                               (pullStats.numPullTime + 1);
@@ -674,16 +826,76 @@ void StatsdStats::notePullExceedMaxDelay(int pullAtomId) {
     mPulledAtomStats[pullAtomId].pullExceedMaxDelay++;
 }
 
+void StatsdStats::noteLogEventLatency(int atomId, int64_t queueTimeNs, int64_t processingTimeNs) {
+    lock_guard<std::mutex> lock(mLock);
+    auto it = mAtomLatencyStats.find(atomId);
+    if (it == mAtomLatencyStats.end()) {
+        if (mAtomLatencyStats.size() >= (size_t)kMaxAtomLatencyStatsSize) {
+            return;
+        }
+        it = mAtomLatencyStats.emplace(atomId, AtomLatencyStats()).first;
+    }
+    it->second.queueTimeNsHistogram.add(queueTimeNs);
+    it->second.processingTimeNsHistogram.add(processingTimeNs);
+}
+
+void StatsdStats::noteConfigLogEventProcessed(const ConfigKey& key, int64_t processingTimeNs,
+                                              int64_t cpuTimeNs,
+                                              const ConfigMemoryUsage& memoryUsage) {
+    lock_guard<std::mutex> lock(mLock);
+    // Only the active configs are tracked.
+    auto it = mConfigStats.find(key);
+    if (it == mConfigStats.end()) {
+        return;
+    }
+    mConfigProcessingTimeNsHistograms[key].add(processingTimeNs);
+    it->second->log_event_cpu_time_ns += cpuTimeNs * kLogEventLatencySampleRate;
+    it->second->memory_usage = memoryUsage;
+}
+
+void StatsdStats::noteConfigPullCpuTime(const ConfigKey& key, int64_t cpuTimeNs) {
+    lock_guard<std::mutex> lock(mLock);
+    auto it = mConfigStats.find(key);
+    if (it != mConfigStats.end()) {
+        it->second->pull_cpu_time_ns += cpuTimeNs;
+    }
+}
+
+void StatsdStats::noteConfigDumpReportCpuTime(const ConfigKey& key, int64_t cpuTimeNs) {
+    lock_guard<std::mutex> lock(mLock);
+    auto it = mConfigStats.find(key);
+    if (it != mConfigStats.end()) {
+        it->second->dump_report_cpu_time_ns += cpuTimeNs;
+    }
+}
+
+void StatsdStats::noteMetricLogEventProcessed(int64_t metricId, int64_t processingTimeNs) {
+    lock_guard<std::mutex> lock(mLock);
+    getAtomMetricStats(metricId).processingTimeNsHistogram.add(processingTimeNs);
+}
+
 void StatsdStats::noteAtomLogged(int atomId, int32_t /*timeSec*/, bool isSkipped) {
+    // Called for every event. The platform atoms have preallocated atomic counters, only the
+    // other atoms need mLock for their map.
+    if (atomId >= 0 && atomId <= kMaxPushedAtomId) {
+        notePlatformAtomLogged(atomId, isSkipped);
+        return;
+    }
     lock_guard<std::mutex> lock(mLock);
 
     noteAtomLoggedLocked(atomId, isSkipped);
 }
 
+void StatsdStats::notePlatformAtomLogged(int atomId, bool isSkipped) {
+    mPushedAtomStats[atomId].logCount.fetch_add(1, std::memory_order_relaxed);
+    if (isSkipped) {
+        mPushedAtomStats[atomId].skipCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
 void StatsdStats::noteAtomLoggedLocked(int atomId, bool isSkipped) {
     if (atomId >= 0 && atomId <= kMaxPushedAtomId) {
-        mPushedAtomStats[atomId].logCount++;
-        mPushedAtomStats[atomId].skipCount += isSkipped;
+        notePlatformAtomLogged(atomId, isSkipped);
     } else {
         if (atomId < 0) {
             android_errorWriteLog(0x534e4554, "187957589");
@@ -720,6 +932,26 @@ void StatsdStats::notePullerNotFound(int atomId) {
     mPulledAtomStats[atomId].pullerNotFound++;
 }
 
+void StatsdStats::notePullRateLimited(int atomId) {
+    lock_guard<std::mutex> lock(mLock);
+    mPulledAtomStats[atomId].pullRateLimited++;
+}
+
+void StatsdStats::notePullNotNeeded(int atomId) {
+    lock_guard<std::mutex> lock(mLock);
+    mPulledAtomStats[atomId].pullNotNeeded++;
+}
+
+void StatsdStats::notePullDataSize(int atomId, int64_t numEvents) {
+    lock_guard<std::mutex> lock(mLock);
+    mPulledAtomStats[atomId].pullDataSizeHistogram.add(numEvents);
+}
+
+void StatsdStats::notePullReceiverTime(int atomId, int64_t receiverTimeNs) {
+    lock_guard<std::mutex> lock(mLock);
+    mPulledAtomStats[atomId].receiverTimeNsHistogram.add(receiverTimeNs);
+}
+
 void StatsdStats::notePullBinderCallFailed(int atomId) {
     lock_guard<std::mutex> lock(mLock);
     mPulledAtomStats[atomId].binderCallFailCount++;
@@ -769,6 +1001,13 @@ void StatsdStats::noteBucketUnknownCondition(int64_t metricId) {
     getAtomMetricStats(metricId).bucketUnknownCondition++;
 }
 
+void StatsdStats::noteHotDimensionLookups(int64_t metricId, int64_t hits, int64_t misses) {
+    lock_guard<std::mutex> lock(mLock);
+    AtomMetricStats& metricStats = getAtomMetricStats(metricId);
+    metricStats.hotDimensionHits += hits;
+    metricStats.hotDimensionMisses += misses;
+}
+
 void StatsdStats::noteConditionChangeInNextBucket(int64_t metricId) {
     lock_guard<std::mutex> lock(mLock);
     getAtomMetricStats(metricId).conditionChangeInNextBucket++;
@@ -1033,7 +1272,10 @@ void StatsdStats::resetInternalLocked() {
     // Reset the historical data, but keep the active ConfigStats
     mStartTimeSec = getWallClockSec();
     mIceBox.clear();
-    std::fill(mPushedAtomStats.begin(), mPushedAtomStats.end(), PushedAtomStats());
+    for (AtomicPushedAtomStats& atomStats : mPushedAtomStats) {
+        atomStats.logCount = 0;
+        atomStats.skipCount = 0;
+    }
     mNonPlatformPushedAtomStats.clear();
     mAnomalyAlarmRegisteredStats = 0;
     mPeriodicAlarmRegisteredStats = 0;
@@ -1044,6 +1286,9 @@ void StatsdStats::resetInternalLocked() {
     mMaxQueueHistoryNs = 0;
     mEventQueueMaxSizeObserved = 0;
     mEventQueueMaxSizeObservedElapsedNanos = 0;
+    mSocketQueueMaxDepthObserved = 0;
+    mSocketQueueMaxDepthObservedElapsedNanos = 0;
+    mSocketFullDrainCount = 0;
     for (auto& config : mConfigStats) {
         config.second->broadcast_sent_time_sec.clear();
         config.second->activation_time_sec.clear();
@@ -1051,6 +1296,9 @@ void StatsdStats::resetInternalLocked() {
         config.second->data_drop_time_sec.clear();
         config.second->data_drop_bytes.clear();
         config.second->dump_report_stats.clear();
+        config.second->log_event_cpu_time_ns = 0;
+        config.second->pull_cpu_time_ns = 0;
+        config.second->dump_report_cpu_time_ns = 0;
         config.second->annotations.clear();
         config.second->matcher_stats.clear();
         config.second->condition_stats.clear();
@@ -1091,13 +1339,22 @@ void StatsdStats::resetInternalLocked() {
         pullStats.second.binderCallFailCount = 0;
         pullStats.second.pullTimeoutMetadata.clear();
         pullStats.second.subscriptionPullCount = 0;
+        pullStats.second.pullRateLimited = 0;
+        pullStats.second.pullNotNeeded = 0;
+        pullStats.second.pullTimeNsHistogram.reset();
+        pullStats.second.pullDataSizeHistogram.reset();
+        pullStats.second.receiverTimeNsHistogram.reset();
     }
     mAtomMetricStats.clear();
     mActivationBroadcastGuardrailStats.clear();
     mPushedAtomErrorStats.clear();
     mSocketLossStats.clear();
     mSocketLossStatsOverflowCounters.clear();
+    mSocketQueueHighWaterMarks.clear();
     mPushedAtomDropsStats.clear();
+    mPushedAtomDedupeStats.clear();
+    mAtomLatencyStats.clear();
+    mConfigProcessingTimeNsHistograms.clear();
     mRestrictedMetricQueryStats.clear();
     mSubscriptionPullThreadWakeupCount = 0;
 
@@ -1139,6 +1396,15 @@ int StatsdStats::getPushedAtomDropsLocked(int atomId) const {
     }
 }
 
+int StatsdStats::getPushedAtomDedupesLocked(int atomId) const {
+    const auto& it = mPushedAtomDedupeStats.find(atomId);
+    if (it != mPushedAtomDedupeStats.end()) {
+        return it->second;
+    } else {
+        return 0;
+    }
+}
+
 bool StatsdStats::hasRestrictedConfigErrors(const std::shared_ptr<ConfigStats>& configStats) const {
     return configStats->device_info_table_creation_failed || configStats->db_corrupted_count ||
            configStats->db_deletion_size_exceeded_limit || configStats->db_deletion_stat_failed ||
@@ -1185,6 +1451,13 @@ void StatsdStats::dumpStats(int out) const {
                     configStats->db_deletion_config_updated);
         }
         dprintf(out, "\n");
+        const ConfigInitLatencies& initLatencies = configStats->init_latencies;
+        dprintf(out,
+                "\tinit latency (ns): parse=%lld, matchers=%lld, conditions=%lld, states=%lld, "
+                "metrics=%lld, alerts=%lld\n",
+                (long long)initLatencies.parseNs, (long long)initLatencies.matchersNs,
+                (long long)initLatencies.conditionsNs, (long long)initLatencies.statesNs,
+                (long long)initLatencies.metricsNs, (long long)initLatencies.alertsNs);
         if (!configStats->is_valid) {
             dprintf(out, "\tinvalid config reason: %s\n",
                     InvalidConfigReasonEnum_Name(configStats->reason->reason).c_str());
@@ -1262,6 +1535,16 @@ void StatsdStats::dumpStats(int out) const {
                     InvalidConfigReasonEnum_Name(configStats->reason->reason).c_str());
         }
 
+        const ConfigMemoryUsage& memoryUsage = configStats->memory_usage;
+        dprintf(out,
+                "\tcpu time (ns): log events~%lld, pulls=%lld, dump reports=%lld; memory: "
+                "bucket bytes=%lld, dimensions=%lld, gauge atoms=%lld\n",
+                (long long)configStats->log_event_cpu_time_ns,
+                (long long)configStats->pull_cpu_time_ns,
+                (long long)configStats->dump_report_cpu_time_ns,
+                (long long)memoryUsage.bucketBytes, (long long)memoryUsage.dimensionCount,
+                (long long)memoryUsage.gaugeAtomCount);
+
         for (const auto& annotation : configStats->annotations) {
             dprintf(out, "\tannotation: %lld, %d\n", (long long)annotation.first,
                     annotation.second);
@@ -1343,20 +1626,34 @@ void StatsdStats::dumpStats(int out) const {
     dprintf(out, "********Pushed Atom stats***********\n");
     const size_t atomCounts = mPushedAtomStats.size();
     for (size_t i = 2; i < atomCounts; i++) {
-        if (mPushedAtomStats[i].logCount > 0) {
+        const int logCount = mPushedAtomStats[i].logCount.load(std::memory_order_relaxed);
+        if (logCount > 0) {
             dprintf(out,
-                    "Atom %zu->(total count)%d, (error count)%d, (drop count)%d, (skip count)%d\n",
-                    i, mPushedAtomStats[i].logCount, getPushedAtomErrorsLocked((int)i),
-                    getPushedAtomDropsLocked((int)i), mPushedAtomStats[i].skipCount);
+                    "Atom %zu->(total count)%d, (error count)%d, (drop count)%d, (skip count)%d, "
+                    "(dedupe count)%d\n",
+                    i, logCount, getPushedAtomErrorsLocked((int)i),
+                    getPushedAtomDropsLocked((int)i),
+                    mPushedAtomStats[i].skipCount.load(std::memory_order_relaxed),
+                    getPushedAtomDedupesLocked((int)i));
         }
     }
     for (const auto& pair : mNonPlatformPushedAtomStats) {
-        dprintf(out, "Atom %d->(total count)%d, (error count)%d, (drop count)%d, (skip count)%d\n",
+        dprintf(out,
+                "Atom %d->(total count)%d, (error count)%d, (drop count)%d, (skip count)%d, "
+                "(dedupe count)%d\n",
                 pair.first, pair.second.logCount, getPushedAtomErrorsLocked(pair.first),
-                getPushedAtomDropsLocked((int)pair.first), pair.second.skipCount);
+                getPushedAtomDropsLocked((int)pair.first), pair.second.skipCount,
+                getPushedAtomDedupesLocked(pair.first));
     }
 
     dprintf(out, "********Pulled Atom stats***********\n");
+    const auto dumpHistogram = [out](const char* name, const Histogram& histogram) {
+        if (histogram.getCount() > 0) {
+            dprintf(out, "  (%s) count %lld, p50 %lld, p95 %lld, p99 %lld\n", name,
+                    (long long)histogram.getCount(), (long long)histogram.getPercentile(50),
+                    (long long)histogram.getPercentile(95), (long long)histogram.getPercentile(99));
+        }
+    };
     for (const auto& pair : mPulledAtomStats) {
         dprintf(out,
                 "Atom %d->(total pull)%ld, (pull from cache)%ld, "
@@ -1367,7 +1664,8 @@ void StatsdStats::dumpStats(int out) const {
                 "  (pull timeout)%ld, (pull exceed max delay)%ld"
                 "  (no uid provider count)%ld, (no puller found count)%ld\n"
                 "  (registered count) %ld, (unregistered count) %ld"
-                "  (atom error count) %d, (subscription pull count) %d, (binder call failed) %ld\n",
+                "  (atom error count) %d, (subscription pull count) %d, (binder call failed) %ld\n"
+                "  (pull rate limited) %ld, (pull not needed) %ld\n",
                 (int)pair.first, (long)pair.second.totalPull, (long)pair.second.totalPullFromCache,
                 (long)pair.second.pullFailed, (long)pair.second.minPullIntervalSec,
                 (long long)pair.second.avgPullTimeNs, (long long)pair.second.maxPullTimeNs,
@@ -1376,7 +1674,8 @@ void StatsdStats::dumpStats(int out) const {
                 pair.second.pullUidProviderNotFound, pair.second.pullerNotFound,
                 pair.second.registeredCount, pair.second.unregisteredCount,
                 pair.second.atomErrorCount, pair.second.subscriptionPullCount,
-                pair.second.binderCallFailCount);
+                pair.second.binderCallFailCount, pair.second.pullRateLimited,
+                pair.second.pullNotNeeded);
         if (pair.second.pullTimeoutMetadata.size() > 0) {
             string uptimeMillis = "(pull timeout system uptime millis) ";
             string pullTimeoutMillis = "(pull timeout elapsed time millis) ";
@@ -1391,6 +1690,26 @@ void StatsdStats::dumpStats(int out) const {
             dprintf(out, "%s", uptimeMillis.c_str());
             dprintf(out, "%s", pullTimeoutMillis.c_str());
         }
+        dumpHistogram("pull time nanos", pair.second.pullTimeNsHistogram);
+        dumpHistogram("pull data size", pair.second.pullDataSizeHistogram);
+        dumpHistogram("receiver time nanos", pair.second.receiverTimeNsHistogram);
+    }
+
+    dprintf(out, "********Log Event Latency stats***********\n");
+    for (const auto& [atomId, latencyStats] : mAtomLatencyStats) {
+        dprintf(out, "Atom %d\n", atomId);
+        dumpHistogram("queue time nanos", latencyStats.queueTimeNsHistogram);
+        dumpHistogram("processing time nanos", latencyStats.processingTimeNsHistogram);
+    }
+    for (const auto& [key, histogram] : mConfigProcessingTimeNsHistograms) {
+        dprintf(out, "Config {%d-%lld}\n", key.GetUid(), (long long)key.GetId());
+        dumpHistogram("processing time nanos", histogram);
+    }
+    for (const auto& [metricId, metricStats] : mAtomMetricStats) {
+        if (metricStats.processingTimeNsHistogram.getCount() > 0) {
+            dprintf(out, "Metric %lld\n", (long long)metricId);
+            dumpHistogram("processing time nanos", metricStats.processingTimeNsHistogram);
+        }
     }
 
     if (mAnomalyAlarmRegisteredStats > 0) {
@@ -1440,11 +1759,24 @@ void StatsdStats::dumpStats(int out) const {
         }
     }
 
+    if (mSocketQueueHighWaterMarks.size()) {
+        dprintf(out, "********SocketQueueHighWaterMarks stats***********\n");
+        for (const auto& highWaterMark : mSocketQueueHighWaterMarks) {
+            dprintf(out, "Socket writer queue max size for %d uid is %d\n", highWaterMark.first,
+                    highWaterMark.second);
+        }
+    }
+
     dprintf(out, "********EventQueueOverflow stats***********\n");
     dprintf(out, "Event queue overflow: %d; MaxHistoryNs: %lld; MinHistoryNs: %lld\n",
             mOverflowCount, (long long)mMaxQueueHistoryNs, (long long)mMinQueueHistoryNs);
-    dprintf(out, "Event queue max size: %d; Observed at : %lld\n", mEventQueueMaxSizeObserved,
-            (long long)mEventQueueMaxSizeObservedElapsedNanos);
+    dprintf(out, "Event queue max size: %d; Observed at : %lld\n",
+            mEventQueueMaxSizeObserved.load(std::memory_order_relaxed),
+            (long long)mEventQueueMaxSizeObservedElapsedNanos.load(std::memory_order_relaxed));
+    dprintf(out, "Socket queue max depth: %d; Observed at : %lld; Full drains: %d\n",
+            mSocketQueueMaxDepthObserved.load(std::memory_order_relaxed),
+            (long long)mSocketQueueMaxDepthObservedElapsedNanos.load(std::memory_order_relaxed),
+            mSocketFullDrainCount.load(std::memory_order_relaxed));
 
     if (mActivationBroadcastGuardrailStats.size() > 0) {
         dprintf(out, "********mActivationBroadcastGuardrail stats***********\n");
@@ -1493,7 +1825,9 @@ void StatsdStats::dumpStats(int out) const {
     dprintf(out, "Shard Offset: %u\n", ShardOffsetProvider::getInstance().getShardOffset());
 }
 
-void addConfigStatsToProto(const ConfigStats& configStats, ProtoOutputStream* proto) {
+void addConfigStatsToProto(const ConfigStats& configStats,
+                           const StatsdStats::Histogram* processingTimeNsHistogram,
+                           ProtoOutputStream* proto) {
     uint64_t token =
             proto->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_CONFIG_STATS);
     proto->write(FIELD_TYPE_INT32 | FIELD_ID_CONFIG_STATS_UID, configStats.uid);
@@ -1682,6 +2016,19 @@ void addConfigStatsToProto(const ConfigStats& configStats, ProtoOutputStream* pr
                              configStats.db_deletion_config_removed, proto);
     writeNonZeroStatToStream(FIELD_TYPE_INT32 | FIELD_ID_DB_DELETION_CONFIG_UPDATED,
                              configStats.db_deletion_config_updated, proto);
+    const ConfigInitLatencies& initLatencies = configStats.init_latencies;
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_INIT_PARSE_LATENCY_NS,
+                             initLatencies.parseNs, proto);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_INIT_MATCHERS_LATENCY_NS,
+                             initLatencies.matchersNs, proto);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_INIT_CONDITIONS_LATENCY_NS,
+                             initLatencies.conditionsNs, proto);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_INIT_STATES_LATENCY_NS,
+                             initLatencies.statesNs, proto);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_INIT_METRICS_LATENCY_NS,
+                             initLatencies.metricsNs, proto);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_INIT_ALERTS_LATENCY_NS,
+                             initLatencies.alertsNs, proto);
     for (int64_t latency : configStats.total_flush_latency_ns) {
         proto->write(FIELD_TYPE_INT64 | FIELD_ID_CONFIG_STATS_RESTRICTED_CONFIG_FLUSH_LATENCY |
                              FIELD_COUNT_REPEATED,
@@ -1697,88 +2044,180 @@ void addConfigStatsToProto(const ConfigStats& configStats, ProtoOutputStream* pr
                              FIELD_COUNT_REPEATED,
                      dbSize);
     }
+    if (processingTimeNsHistogram != nullptr) {
+        writeHistogramToStream(FIELD_ID_CONFIG_STATS_PROCESSING_TIME_NANOS_HISTOGRAM,
+                               *processingTimeNsHistogram, proto);
+    }
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_CONFIG_STATS_LOG_EVENT_CPU_TIME_NS,
+                             configStats.log_event_cpu_time_ns, proto);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_CONFIG_STATS_PULL_CPU_TIME_NS,
+                             configStats.pull_cpu_time_ns, proto);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_CONFIG_STATS_DUMP_REPORT_CPU_TIME_NS,
+                             configStats.dump_report_cpu_time_ns, proto);
+    const ConfigMemoryUsage& memoryUsage = configStats.memory_usage;
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_CONFIG_STATS_BUCKET_BYTES,
+                             memoryUsage.bucketBytes, proto);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_CONFIG_STATS_DIMENSION_COUNT,
+                             memoryUsage.dimensionCount, proto);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_CONFIG_STATS_GAUGE_ATOM_COUNT,
+                             memoryUsage.gaugeAtomCount, proto);
     proto->end(token);
 }
 
-void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
-    lock_guard<std::mutex> lock(mLock);
+void StatsdStats::takeReportSnapshotLocked(bool reset, ReportSnapshot* snapshot) {
+    snapshot->startTimeSec = mStartTimeSec;
 
-    ProtoOutputStream proto;
-    proto.write(FIELD_TYPE_INT32 | FIELD_ID_BEGIN_TIME, mStartTimeSec);
-    proto.write(FIELD_TYPE_INT32 | FIELD_ID_END_TIME, (int32_t)getWallClockSec());
+    // The ice boxed configs are no longer updated, they can be shared.
+    snapshot->iceBox = mIceBox;
+    for (const auto& [key, configStats] : mConfigStats) {
+        std::optional<Histogram> histogram;
+        const auto histogramIt = mConfigProcessingTimeNsHistograms.find(key);
+        if (histogramIt != mConfigProcessingTimeNsHistograms.end()) {
+            histogram = histogramIt->second;
+        }
+        snapshot->configStats.emplace_back(std::make_shared<ConfigStats>(*configStats),
+                                           std::move(histogram));
+    }
 
-    for (const auto& configStats : mIceBox) {
-        addConfigStatsToProto(*configStats, &proto);
+    const size_t atomCounts = mPushedAtomStats.size();
+    for (size_t i = 2; i < atomCounts; i++) {
+        const int logCount = mPushedAtomStats[i].logCount.load(std::memory_order_relaxed);
+        if (logCount > 0) {
+            snapshot->pushedAtomStats.push_back(
+                    {(int)i, logCount, mPushedAtomStats[i].skipCount.load(std::memory_order_relaxed),
+                     getPushedAtomErrorsLocked(i), getPushedAtomDropsLocked(i),
+                     getPushedAtomDedupesLocked(i)});
+        }
     }
+    for (const auto& [atomId, atomStats] : mNonPlatformPushedAtomStats) {
+        snapshot->pushedAtomStats.push_back(
+                {atomId, atomStats.logCount, atomStats.skipCount, getPushedAtomErrorsLocked(atomId),
+                 getPushedAtomDropsLocked(atomId), getPushedAtomDedupesLocked(atomId)});
+    }
+
+    snapshot->pulledAtomStats = mPulledAtomStats;
+    snapshot->anomalyAlarmRegisteredStats = mAnomalyAlarmRegisteredStats;
+    snapshot->periodicAlarmRegisteredStats = mPeriodicAlarmRegisteredStats;
+    snapshot->uidMapStats = mUidMapStats;
+    snapshot->overflowCount = mOverflowCount;
+    snapshot->maxQueueHistoryNs = mMaxQueueHistoryNs;
+    snapshot->minQueueHistoryNs = mMinQueueHistoryNs;
+    snapshot->eventQueueMaxSizeObserved =
+            mEventQueueMaxSizeObserved.load(std::memory_order_relaxed);
+    snapshot->eventQueueMaxSizeObservedElapsedNanos =
+            mEventQueueMaxSizeObservedElapsedNanos.load(std::memory_order_relaxed);
+    snapshot->socketQueueMaxDepthObserved =
+            mSocketQueueMaxDepthObserved.load(std::memory_order_relaxed);
+    snapshot->socketQueueMaxDepthObservedElapsedNanos =
+            mSocketQueueMaxDepthObservedElapsedNanos.load(std::memory_order_relaxed);
+    snapshot->socketFullDrainCount = mSocketFullDrainCount.load(std::memory_order_relaxed);
+    snapshot->restrictedMetricQueryStats = mRestrictedMetricQueryStats;
+    snapshot->subscriptionStats = mSubscriptionStats;
+    snapshot->subscriptionPullThreadWakeupCount = mSubscriptionPullThreadWakeupCount;
 
-    for (auto& pair : mConfigStats) {
-        addConfigStatsToProto(*(pair.second), &proto);
+    if (reset) {
+        snapshot->atomMetricStats = std::move(mAtomMetricStats);
+        snapshot->atomLatencyStats = std::move(mAtomLatencyStats);
+        snapshot->logLossStats = std::move(mLogLossStats);
+        snapshot->systemServerRestartSec = std::move(mSystemServerRestartSec);
+        snapshot->activationBroadcastGuardrailStats =
+                std::move(mActivationBroadcastGuardrailStats);
+        snapshot->socketLossStats = std::move(mSocketLossStats);
+        snapshot->socketLossStatsOverflowCounters = std::move(mSocketLossStatsOverflowCounters);
+        snapshot->socketQueueHighWaterMarks = std::move(mSocketQueueHighWaterMarks);
+    } else {
+        snapshot->atomMetricStats = mAtomMetricStats;
+        snapshot->atomLatencyStats = mAtomLatencyStats;
+        snapshot->logLossStats = mLogLossStats;
+        snapshot->systemServerRestartSec = mSystemServerRestartSec;
+        snapshot->activationBroadcastGuardrailStats = mActivationBroadcastGuardrailStats;
+        snapshot->socketLossStats = mSocketLossStats;
+        snapshot->socketLossStatsOverflowCounters = mSocketLossStatsOverflowCounters;
+        snapshot->socketQueueHighWaterMarks = mSocketQueueHighWaterMarks;
     }
+}
 
-    const size_t atomCounts = mPushedAtomStats.size();
-    for (size_t i = 2; i < atomCounts; i++) {
-        if (mPushedAtomStats[i].logCount > 0) {
-            uint64_t token =
-                    proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_ATOM_STATS | FIELD_COUNT_REPEATED);
-            proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_TAG, (int32_t)i);
-            proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_COUNT, mPushedAtomStats[i].logCount);
-            const int errors = getPushedAtomErrorsLocked(i);
-            writeNonZeroStatToStream(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_ERROR_COUNT, errors,
-                                     &proto);
-            const int drops = getPushedAtomDropsLocked(i);
-            writeNonZeroStatToStream(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_DROPS_COUNT, drops,
-                                     &proto);
-            writeNonZeroStatToStream(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_SKIP_COUNT,
-                                     mPushedAtomStats[i].skipCount, &proto);
-            proto.end(token);
+void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
+    // Only the copy is made under the lock, the loggers are not blocked by the encoding.
+    ReportSnapshot snapshot;
+    {
+        lock_guard<std::mutex> lock(mLock);
+        takeReportSnapshotLocked(reset, &snapshot);
+        if (reset) {
+            resetInternalLocked();
         }
     }
 
-    for (const auto& pair : mNonPlatformPushedAtomStats) {
+    ProtoOutputStream proto;
+    proto.write(FIELD_TYPE_INT32 | FIELD_ID_BEGIN_TIME, snapshot.startTimeSec);
+    proto.write(FIELD_TYPE_INT32 | FIELD_ID_END_TIME, (int32_t)getWallClockSec());
+
+    for (const auto& configStats : snapshot.iceBox) {
+        addConfigStatsToProto(*configStats, /*processingTimeNsHistogram=*/nullptr, &proto);
+    }
+
+    for (const auto& [configStats, histogram] : snapshot.configStats) {
+        addConfigStatsToProto(*configStats, histogram.has_value() ? &histogram.value() : nullptr,
+                              &proto);
+    }
+
+    for (const PushedAtomReport& atomStats : snapshot.pushedAtomStats) {
         uint64_t token =
                 proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_ATOM_STATS | FIELD_COUNT_REPEATED);
-        proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_TAG, pair.first);
-        proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_COUNT, pair.second.logCount);
-        const int errors = getPushedAtomErrorsLocked(pair.first);
-        writeNonZeroStatToStream(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_ERROR_COUNT, errors,
-                                 &proto);
-        const int drops = getPushedAtomDropsLocked(pair.first);
-        writeNonZeroStatToStream(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_DROPS_COUNT, drops, &proto);
+        proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_TAG, atomStats.atomId);
+        proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_COUNT, atomStats.logCount);
+        writeNonZeroStatToStream(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_ERROR_COUNT,
+                                 atomStats.errorCount, &proto);
+        writeNonZeroStatToStream(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_DROPS_COUNT,
+                                 atomStats.dropCount, &proto);
         writeNonZeroStatToStream(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_SKIP_COUNT,
-                                 pair.second.skipCount, &proto);
+                                 atomStats.skipCount, &proto);
+        writeNonZeroStatToStream(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_DEDUPE_COUNT,
+                                 atomStats.dedupeCount, &proto);
         proto.end(token);
     }
 
-    for (const auto& pair : mPulledAtomStats) {
+    for (const auto& pair : snapshot.pulledAtomStats) {
         writePullerStatsToStream(pair, &proto);
     }
 
-    for (const auto& pair : mAtomMetricStats) {
+    for (const auto& pair : snapshot.atomMetricStats) {
         writeAtomMetricStatsToStream(pair, &proto);
     }
 
-    if (mAnomalyAlarmRegisteredStats > 0) {
+    for (const auto& [atomId, latencyStats] : snapshot.atomLatencyStats) {
+        uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_ATOM_LATENCY_STATS |
+                                     FIELD_COUNT_REPEATED);
+        proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_LATENCY_STATS_TAG, atomId);
+        writeHistogramToStream(FIELD_ID_ATOM_LATENCY_STATS_QUEUE_TIME_NANOS_HISTOGRAM,
+                               latencyStats.queueTimeNsHistogram, &proto);
+        writeHistogramToStream(FIELD_ID_ATOM_LATENCY_STATS_PROCESSING_TIME_NANOS_HISTOGRAM,
+                               latencyStats.processingTimeNsHistogram, &proto);
+        proto.end(token);
+    }
+
+    if (snapshot.anomalyAlarmRegisteredStats > 0) {
         uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_ANOMALY_ALARM_STATS);
         proto.write(FIELD_TYPE_INT32 | FIELD_ID_ANOMALY_ALARMS_REGISTERED,
-                    mAnomalyAlarmRegisteredStats);
+                    snapshot.anomalyAlarmRegisteredStats);
         proto.end(token);
     }
 
-    if (mPeriodicAlarmRegisteredStats > 0) {
+    if (snapshot.periodicAlarmRegisteredStats > 0) {
         uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_PERIODIC_ALARM_STATS);
         proto.write(FIELD_TYPE_INT32 | FIELD_ID_PERIODIC_ALARMS_REGISTERED,
-                    mPeriodicAlarmRegisteredStats);
+                    snapshot.periodicAlarmRegisteredStats);
         proto.end(token);
     }
 
     uint64_t uidMapToken = proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_UIDMAP_STATS);
-    proto.write(FIELD_TYPE_INT32 | FIELD_ID_UID_MAP_CHANGES, mUidMapStats.changes);
-    proto.write(FIELD_TYPE_INT32 | FIELD_ID_UID_MAP_BYTES_USED, mUidMapStats.bytes_used);
-    proto.write(FIELD_TYPE_INT32 | FIELD_ID_UID_MAP_DROPPED_CHANGES, mUidMapStats.dropped_changes);
-    proto.write(FIELD_TYPE_INT32 | FIELD_ID_UID_MAP_DELETED_APPS, mUidMapStats.deleted_apps);
+    proto.write(FIELD_TYPE_INT32 | FIELD_ID_UID_MAP_CHANGES, snapshot.uidMapStats.changes);
+    proto.write(FIELD_TYPE_INT32 | FIELD_ID_UID_MAP_BYTES_USED, snapshot.uidMapStats.bytes_used);
+    proto.write(FIELD_TYPE_INT32 | FIELD_ID_UID_MAP_DROPPED_CHANGES, snapshot.uidMapStats.dropped_changes);
+    proto.write(FIELD_TYPE_INT32 | FIELD_ID_UID_MAP_DELETED_APPS, snapshot.uidMapStats.deleted_apps);
     proto.end(uidMapToken);
 
-    for (const auto& error : mLogLossStats) {
+    for (const auto& error : snapshot.logLossStats) {
         uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_LOGGER_ERROR_STATS |
                                       FIELD_COUNT_REPEATED);
         proto.write(FIELD_TYPE_INT32 | FIELD_ID_LOG_LOSS_STATS_TIME, error.mWallClockSec);
@@ -1790,29 +2229,35 @@ void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
         proto.end(token);
     }
 
-    if (mOverflowCount > 0) {
+    if (snapshot.overflowCount > 0) {
         uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_OVERFLOW);
-        proto.write(FIELD_TYPE_INT32 | FIELD_ID_OVERFLOW_COUNT, (int32_t)mOverflowCount);
+        proto.write(FIELD_TYPE_INT32 | FIELD_ID_OVERFLOW_COUNT, (int32_t)snapshot.overflowCount);
         proto.write(FIELD_TYPE_INT64 | FIELD_ID_OVERFLOW_MAX_HISTORY,
-                    (long long)mMaxQueueHistoryNs);
+                    (long long)snapshot.maxQueueHistoryNs);
         proto.write(FIELD_TYPE_INT64 | FIELD_ID_OVERFLOW_MIN_HISTORY,
-                    (long long)mMinQueueHistoryNs);
+                    (long long)snapshot.minQueueHistoryNs);
         proto.end(token);
     }
 
     uint64_t queueStatsToken = proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_QUEUE_STATS);
     proto.write(FIELD_TYPE_INT32 | FIELD_ID_QUEUE_MAX_SIZE_OBSERVED,
-                (int32_t)mEventQueueMaxSizeObserved);
+                snapshot.eventQueueMaxSizeObserved);
     proto.write(FIELD_TYPE_INT64 | FIELD_ID_QUEUE_MAX_SIZE_OBSERVED_ELAPSED_NANOS,
-                (long long)mEventQueueMaxSizeObservedElapsedNanos);
+                (long long)snapshot.eventQueueMaxSizeObservedElapsedNanos);
+    proto.write(FIELD_TYPE_INT32 | FIELD_ID_QUEUE_SOCKET_MAX_DEPTH_OBSERVED,
+                snapshot.socketQueueMaxDepthObserved);
+    proto.write(FIELD_TYPE_INT64 | FIELD_ID_QUEUE_SOCKET_MAX_DEPTH_OBSERVED_ELAPSED_NANOS,
+                (long long)snapshot.socketQueueMaxDepthObservedElapsedNanos);
+    proto.write(FIELD_TYPE_INT32 | FIELD_ID_QUEUE_SOCKET_FULL_DRAIN_COUNT,
+                snapshot.socketFullDrainCount);
     proto.end(queueStatsToken);
 
-    for (const auto& restart : mSystemServerRestartSec) {
+    for (const auto& restart : snapshot.systemServerRestartSec) {
         proto.write(FIELD_TYPE_INT32 | FIELD_ID_SYSTEM_SERVER_RESTART | FIELD_COUNT_REPEATED,
                     restart);
     }
 
-    for (const auto& pair: mActivationBroadcastGuardrailStats) {
+    for (const auto& pair: snapshot.activationBroadcastGuardrailStats) {
         uint64_t token = proto.start(FIELD_TYPE_MESSAGE |
                                      FIELD_ID_ACTIVATION_BROADCAST_GUARDRAIL |
                                      FIELD_COUNT_REPEATED);
@@ -1826,7 +2271,7 @@ void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
         proto.end(token);
     }
 
-    for (const auto& stat : mRestrictedMetricQueryStats) {
+    for (const auto& stat : snapshot.restrictedMetricQueryStats) {
         uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_RESTRICTED_METRIC_QUERY_STATS |
                                      FIELD_COUNT_REPEATED);
         proto.write(FIELD_TYPE_INT32 | FIELD_ID_RESTRICTED_METRIC_QUERY_STATS_CALLING_UID,
@@ -1866,7 +2311,7 @@ void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
 
     // Write subscription stats
     const uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_SUBSCRIPTION_STATS);
-    for (const auto& [id, subStats] : mSubscriptionStats) {
+    for (const auto& [id, subStats] : snapshot.subscriptionStats) {
         const uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
                                            FIELD_ID_SUBSCRIPTION_STATS_PER_SUBSCRIPTION_STATS);
         proto.write(FIELD_TYPE_INT32 | FIELD_ID_PER_SUBSCRIPTION_STATS_ID, id);
@@ -1886,7 +2331,7 @@ void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
     }
     writeNonZeroStatToStream(
             FIELD_TYPE_INT32 | FIELD_ID_SUBSCRIPTION_STATS_PULL_THREAD_WAKEUP_COUNT,
-            mSubscriptionPullThreadWakeupCount, &proto);
+            snapshot.subscriptionPullThreadWakeupCount, &proto);
     proto.end(token);
 
     // libstatssocket specific stats
@@ -1895,7 +2340,7 @@ void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
             proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_SOCKET_LOSS_STATS);
 
     // socket loss stats info per uid/error/atom id counter
-    for (const auto& perUidLossInfo : mSocketLossStats) {
+    for (const auto& perUidLossInfo : snapshot.socketLossStats) {
         uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_SOCKET_LOSS_STATS_PER_UID |
                                      FIELD_COUNT_REPEATED);
         proto.write(FIELD_TYPE_INT32 | FIELD_ID_SOCKET_LOSS_STATS_UID, perUidLossInfo.mUid);
@@ -1917,7 +2362,7 @@ void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
     }
 
     // socket loss stats overflow counters
-    for (const auto& overflowInfo : mSocketLossStatsOverflowCounters) {
+    for (const auto& overflowInfo : snapshot.socketLossStatsOverflowCounters) {
         uint64_t token =
                 proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_SOCKET_LOSS_STATS_OVERFLOW_COUNTERS |
                             FIELD_COUNT_REPEATED);
@@ -1928,15 +2373,23 @@ void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
         proto.end(token);
     }
 
+    // libstatssocket writer queue high-water marks
+    for (const auto& highWaterMarkInfo : snapshot.socketQueueHighWaterMarks) {
+        uint64_t token =
+                proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_SOCKET_LOSS_STATS_QUEUE_HIGH_WATER_MARKS |
+                            FIELD_COUNT_REPEATED);
+        proto.write(FIELD_TYPE_INT32 | FIELD_ID_SOCKET_LOSS_STATS_QUEUE_HIGH_WATER_MARKS_UID,
+                    highWaterMarkInfo.first);
+        proto.write(FIELD_TYPE_INT32 | FIELD_ID_SOCKET_LOSS_STATS_QUEUE_HIGH_WATER_MARKS_MAX_SIZE,
+                    highWaterMarkInfo.second);
+        proto.end(token);
+    }
+
     proto.end(socketLossStatsToken);
 
     output->clear();
     proto.serializeToVector(output);
 
-    if (reset) {
-        resetInternalLocked();
-    }
-
     VLOG("reset=%d, returned proto size %lu", reset, (unsigned long)output->size());
 }
 
@@ -19,6 +19,8 @@
 #include <log/log_time.h>
 #include <src/guardrail/stats_log_enums.pb.h>
 
+#include <array>
+#include <atomic>
 #include <list>
 #include <mutex>
 #include <string>
@@ -72,6 +74,26 @@ struct DumpReportStats {
     int32_t mDumpReportNumber = 0;
 };
 
+// Time spent in each phase of the creation of a config, see initStatsdConfig.
+struct ConfigInitLatencies {
+    int64_t parseNs = 0;
+    int64_t matchersNs = 0;
+    int64_t conditionsNs = 0;
+    int64_t statesNs = 0;
+    int64_t metricsNs = 0;
+    int64_t alertsNs = 0;
+};
+
+// Memory held by the metrics of a config, see MetricsManager::getMemoryUsage.
+struct ConfigMemoryUsage {
+    // Bytes of the past buckets.
+    int64_t bucketBytes = 0;
+    // Dimensions of the current buckets.
+    int64_t dimensionCount = 0;
+    // Atoms held by the current buckets of the gauge metrics.
+    int64_t gaugeAtomCount = 0;
+};
+
 struct ConfigStats {
     int32_t uid;
     int64_t id;
@@ -92,6 +114,17 @@ struct ConfigStats {
     int32_t db_deletion_config_removed = 0;
     int32_t db_deletion_config_updated = 0;
 
+    ConfigInitLatencies init_latencies;
+
+    // CPU time spent on the config since the last reset. The log event one is estimated from the
+    // events sampled for latency tracking.
+    int64_t log_event_cpu_time_ns = 0;
+    int64_t pull_cpu_time_ns = 0;
+    int64_t dump_report_cpu_time_ns = 0;
+
+    // Memory usage of the config when the last event sampled for latency tracking was processed.
+    ConfigMemoryUsage memory_usage;
+
     // Stores reasons for why config is valid or not
     std::optional<InvalidConfigReason> reason;
 
@@ -178,6 +211,8 @@ public:
     static const std::map<int, std::pair<size_t, size_t>> kAtomDimensionKeySizeLimitMap;
 
     const static int kMaxConfigCountPerUid = 20;
+
+    const static int kMaxPendingConfigParseLatencies = 20;
     const static int kMaxAlertCountPerConfig = 200;
     const static int kMaxConditionCountPerConfig = 500;
     const static int kMaxMetricCountPerConfig = 2000;
@@ -233,9 +268,6 @@ public:
     /* Minimum period between two broadcasts in nanoseconds. */
     static const int64_t kMinBroadcastPeriodNs = 60 * NS_PER_SEC;
 
-    /* Min period between two checks of byte size per config key in nanoseconds. */
-    static const int64_t kMinByteSizeCheckPeriodNs = 60 * NS_PER_SEC;
-
     /* Min period between two checks of restricted metrics TTLs. */
     static const int64_t kMinTtlCheckPeriodNs = 60 * 60 * NS_PER_SEC;
 
@@ -275,6 +307,13 @@ public:
     // Maximum number of socket loss stats to track.
     static const int kMaxSocketLossStatsSize = 50;
 
+    // One in this many events dispatched to the configs has its latencies noted, see
+    // noteLogEventLatency.
+    static const int kLogEventLatencySampleRate = 100;
+
+    // Maximum number of atoms whose event latencies statsd stats will track.
+    static const int kMaxAtomLatencyStatsSize = 300;
+
     // Maximum atom id value that we consider a platform pushed atom.
     // This should be updated once highest pushed atom id in atoms.proto approaches this value.
     static const int kMaxPushedAtomId = 900;
@@ -306,11 +345,19 @@ public:
      *
      * The static stats include: the count of metrics, conditions, matchers, and alerts.
      * If the config is not valid, this config stats will be put into icebox immediately.
+     * The parse latency of initLatencies is ignored, see noteConfigParsed.
      */
     void noteConfigReceived(const ConfigKey& key, int metricsCount, int conditionsCount,
                             int matchersCount, int alertCount,
                             const std::list<std::pair<const int64_t, const int32_t>>& annotations,
-                            const std::optional<InvalidConfigReason>& reason);
+                            const std::optional<InvalidConfigReason>& reason,
+                            const ConfigInitLatencies& initLatencies = ConfigInitLatencies());
+
+    /**
+     * Report how long it took to parse a config. It is attributed to the next config received
+     * for the key.
+     */
+    void noteConfigParsed(const ConfigKey& key, int64_t latencyNs);
     /**
      * Report a config has been removed.
      */
@@ -542,6 +589,27 @@ public:
      */
     void notePullerNotFound(int atomId);
 
+    /**
+     * Records that a pull of an atom was served from the cache because its pull rate was limited.
+     */
+    void notePullRateLimited(int atomId);
+
+    /**
+     * Records that a scheduled pull of an atom was skipped because its receiver did not need the
+     * data of the bucket, e.g. when the condition of the metric is false.
+     */
+    void notePullNotNeeded(int atomId);
+
+    /**
+     * Records the number of events pulled for an atom.
+     */
+    void notePullDataSize(int atomId, int64_t numEvents);
+
+    /**
+     * Records the time a receiver of a scheduled pull of an atom spent processing its data.
+     */
+    void notePullReceiverTime(int atomId, int64_t receiverTimeNs);
+
     /**
      * Records that the pull has failed due to the outgoing binder call failing.
      */
@@ -610,6 +678,12 @@ public:
      */
     void noteBucketUnknownCondition(int64_t metricId);
 
+    /**
+     * Number of events of a bucket whose dimension was found in the hot dimensions of the metric,
+     * and number of events whose dimension was looked up in the maps of the metric.
+     */
+    void noteHotDimensionLookups(int64_t metricId, int64_t hits, int64_t misses);
+
     /* Reports one event id has been dropped due to queue overflow, and the oldest event timestamp
      * in the queue */
     void noteEventQueueOverflow(int64_t oldestEventTimestampNs, int32_t atomId, bool isSkipped);
@@ -617,6 +691,42 @@ public:
     /* Notes queue max size seen so far and associated timestamp */
     void noteEventQueueSize(int32_t size, int64_t eventTimestampNs);
 
+    /**
+     * Notes the number of datagrams read from a statsd socket by one batched drain, which is the
+     * depth of the socket receive queue when the drain is not full. A full drain means the queue
+     * held at least batchSize datagrams.
+     */
+    void noteSocketDrain(int32_t datagramCount, int32_t batchSize, int64_t timestampNs);
+
+    /**
+     * Reports the latencies of an event sampled for latency tracking, see
+     * kLogEventLatencySampleRate. The queue time is from when the event was logged until statsd
+     * started processing it, the processing time is the total time the configs spent on it.
+     */
+    void noteLogEventLatency(int atomId, int64_t queueTimeNs, int64_t processingTimeNs);
+
+    /**
+     * Reports how long the config took to process an event sampled for latency tracking, and
+     * its memory usage after that.
+     */
+    void noteConfigLogEventProcessed(const ConfigKey& key, int64_t processingTimeNs,
+                                     int64_t cpuTimeNs, const ConfigMemoryUsage& memoryUsage);
+
+    /**
+     * Reports the CPU time the config spent processing the data of a pull.
+     */
+    void noteConfigPullCpuTime(const ConfigKey& key, int64_t cpuTimeNs);
+
+    /**
+     * Reports the CPU time spent creating a report of the config.
+     */
+    void noteConfigDumpReportCpuTime(const ConfigKey& key, int64_t cpuTimeNs);
+
+    /**
+     * Reports how long the metric took to process a matched event sampled for latency tracking.
+     */
+    void noteMetricLogEventProcessed(int64_t metricId, int64_t processingTimeNs);
+
     /**
      * Reports that the activation broadcast guardrail was hit for this uid. Namely, the broadcast
      * should have been sent, but instead was skipped due to hitting the guardrail.
@@ -673,6 +783,12 @@ public:
     void noteRestrictedConfigDbSize(const ConfigKey& configKey, int64_t elapsedTimeNs,
                                     const int64_t dbSize);
 
+    /**
+     * Records identical atoms collapsed by the socket listener into a held event, see
+     * AtomDeduper. count is the number of atoms suppressed, not counting the held event.
+     */
+    void noteAtomDeduped(int32_t atomId, int32_t count);
+
     /**
      * Records libstatssocket was not able to write into socket.
      */
@@ -758,6 +874,40 @@ public:
      */
     bool hasSocketLoss() const;
 
+    /**
+     * Counts of non-negative values in bins that are a quarter of a power of 2 wide, so that its
+     * percentiles are within 25% of the values added. Only the bins between the lowest and the
+     * highest value added are stored.
+     */
+    class Histogram {
+    public:
+        void add(int64_t value);
+
+        // Returns the upper bound of the bin holding the percentile of the values added, or 0
+        // if there is none.
+        int64_t getPercentile(int percentile) const;
+
+        inline int64_t getCount() const {
+            return mCount;
+        }
+
+        void reset();
+
+    private:
+        static const int kSubBinBits = 2;
+
+        static int getBin(int64_t value);
+
+        static int64_t getBinUpperBound(int bin);
+
+        // Bin of mBinCounts[0].
+        int mFirstBin = 0;
+
+        std::vector<int32_t> mBinCounts;
+
+        int64_t mCount = 0;
+    };
+
     typedef struct PullTimeoutMetadata {
         int64_t pullTimeoutUptimeMillis;
         int64_t pullTimeoutElapsedMillis;
@@ -790,6 +940,13 @@ public:
         long binderCallFailCount = 0;
         std::list<PullTimeoutMetadata> pullTimeoutMetadata;
         int32_t subscriptionPullCount = 0;
+        long pullRateLimited = 0;
+        long pullNotNeeded = 0;
+        Histogram pullTimeNsHistogram;
+        // Number of events of each successful pull.
+        Histogram pullDataSizeHistogram;
+        // Time spent in each PullDataReceiver::onDataPulled of a scheduled pull.
+        Histogram receiverTimeNsHistogram;
     } PulledAtomStats;
 
     typedef struct {
@@ -804,8 +961,19 @@ public:
         int64_t maxBucketBoundaryDelayNs = 0;
         long bucketUnknownCondition = 0;
         long bucketCount = 0;
+        int64_t hotDimensionHits = 0;
+        int64_t hotDimensionMisses = 0;
+        // Time spent in onMatchedLogEvent for the events sampled for latency tracking.
+        Histogram processingTimeNsHistogram;
     } AtomMetricStats;
 
+    typedef struct {
+        // Time from when the event was logged until statsd started processing it.
+        Histogram queueTimeNsHistogram;
+        // Total time spent by the configs on the event.
+        Histogram processingTimeNsHistogram;
+    } AtomLatencyStats;
+
 private:
     StatsdStats();
 
@@ -825,6 +993,10 @@ private:
     // The map size is capped by kMaxConfigCount.
     std::map<const ConfigKey, std::shared_ptr<ConfigStats>> mConfigStats;
 
+    // The parse latencies of the configs that weren't received yet, see noteConfigParsed.
+    // The map size is capped by kMaxPendingConfigParseLatencies.
+    std::map<const ConfigKey, int64_t> mPendingConfigParseLatenciesNs;
+
     // Stores the stats for the configs that are no longer in use.
     // The size of the vector is capped by kMaxIceBoxSize.
     std::list<std::shared_ptr<ConfigStats>> mIceBox;
@@ -832,13 +1004,19 @@ private:
     // Stores the number of times a pushed atom is logged and skipped (if skipped).
     // The size of the vector is the largest pushed atom id in atoms.proto + 1. Atoms
     // out of that range will be put in mNonPlatformPushedAtomStats.
-    // This is a vector, not a map because it will be accessed A LOT -- for each stats log.
+    // This is an array, not a map because it will be accessed A LOT -- for each stats log. The
+    // counters are relaxed atomics updated without mLock, see noteAtomLogged.
     struct PushedAtomStats {
         int logCount = 0;
         int skipCount = 0;
     };
 
-    std::vector<PushedAtomStats> mPushedAtomStats;
+    struct AtomicPushedAtomStats {
+        std::atomic<int> logCount = 0;
+        std::atomic<int> skipCount = 0;
+    };
+
+    std::array<AtomicPushedAtomStats, kMaxPushedAtomId + 1> mPushedAtomStats;
 
     // Stores the number of times a pushed atom is logged and skipped for atom ids above
     // kMaxPushedAtomId. The max size of the map is kMaxNonPlatformPushedAtoms.
@@ -849,6 +1027,10 @@ private:
     // The max size of the map is kMaxPushedAtomId + kMaxNonPlatformPushedAtoms.
     std::unordered_map<int, int> mPushedAtomDropsStats;
 
+    // Stores the number of identical pushed atoms suppressed by the socket listener dedupe.
+    // The max size of the map is kMaxPushedAtomId + kMaxNonPlatformPushedAtoms.
+    std::unordered_map<int, int> mPushedAtomDedupeStats;
+
     // Maps PullAtomId to its stats. The size is capped by the puller atom counts.
     std::map<int, PulledAtomStats> mPulledAtomStats;
 
@@ -888,9 +1070,20 @@ private:
     // The max size of this map is kMaxSocketLossStatsSize.
     std::map<int32_t, int32_t> mSocketLossStatsOverflowCounters;
 
+    // Stores the max size of the libstatssocket writer queue reported per uid.
+    // The max size of this map is kMaxSocketLossStatsSize.
+    std::map<int32_t, int32_t> mSocketQueueHighWaterMarks;
+
     // Maps metric ID to its stats. The size is capped by the number of metrics.
     std::map<int64_t, AtomMetricStats> mAtomMetricStats;
 
+    // Latencies of the events sampled for latency tracking per atom. The max size of the map is
+    // kMaxAtomLatencyStatsSize.
+    std::map<int, AtomLatencyStats> mAtomLatencyStats;
+
+    // Time spent by each active config on the events sampled for latency tracking.
+    std::map<const ConfigKey, Histogram> mConfigProcessingTimeNsHistograms;
+
     // Maps uids to times when the activation changed broadcast not sent due to hitting the
     // guardrail. The size is capped by the number of configs, and up to 20 times per uid.
     std::map<int, std::list<int32_t>> mActivationBroadcastGuardrailStats;
@@ -925,11 +1118,20 @@ private:
     // Total number of events that are lost due to queue overflow.
     int32_t mOverflowCount = 0;
 
-    // Max number of events stored into the queue seen so far.
-    int32_t mEventQueueMaxSizeObserved = 0;
+    // Max number of events stored into the queue seen so far. Updated without mLock, see
+    // noteEventQueueSize.
+    std::atomic<int32_t> mEventQueueMaxSizeObserved = 0;
 
     // Event timestamp for associated max size hit.
-    int64_t mEventQueueMaxSizeObservedElapsedNanos = 0;
+    std::atomic<int64_t> mEventQueueMaxSizeObservedElapsedNanos = 0;
+
+    // Max number of datagrams read by a drain of the statsd sockets seen so far, and when. Updated
+    // without mLock, see noteSocketDrain.
+    std::atomic<int32_t> mSocketQueueMaxDepthObserved = 0;
+    std::atomic<int64_t> mSocketQueueMaxDepthObservedElapsedNanos = 0;
+
+    // Number of drains of the statsd sockets that read a full batch of datagrams.
+    std::atomic<int32_t> mSocketFullDrainCount = 0;
 
     // Timestamps when we detect log loss, and the number of logs lost.
     std::list<LogLossStats> mLogLossStats;
@@ -983,6 +1185,53 @@ private:
     // Stores the number of times statsd registers the periodic alarm changes
     int mPeriodicAlarmRegisteredStats = 0;
 
+    // Counters of a pushed atom as written in the report.
+    struct PushedAtomReport {
+        int atomId;
+        int logCount;
+        int skipCount;
+        int errorCount;
+        int dropCount;
+        int dedupeCount;
+    };
+
+    // Copy of the stats written by dumpStats, taken under mLock so that the report can be
+    // encoded without holding it. The config stats are copies as well since the live ones keep
+    // being updated.
+    struct ReportSnapshot {
+        int32_t startTimeSec = 0;
+        std::list<std::shared_ptr<ConfigStats>> iceBox;
+        std::list<std::pair<std::shared_ptr<ConfigStats>, std::optional<Histogram>>> configStats;
+        std::vector<PushedAtomReport> pushedAtomStats;
+        std::map<int, PulledAtomStats> pulledAtomStats;
+        std::map<int64_t, AtomMetricStats> atomMetricStats;
+        std::map<int, AtomLatencyStats> atomLatencyStats;
+        int anomalyAlarmRegisteredStats = 0;
+        int periodicAlarmRegisteredStats = 0;
+        UidMapStats uidMapStats;
+        std::list<LogLossStats> logLossStats;
+        int32_t overflowCount = 0;
+        int64_t maxQueueHistoryNs = 0;
+        int64_t minQueueHistoryNs = 0;
+        int32_t eventQueueMaxSizeObserved = 0;
+        int64_t eventQueueMaxSizeObservedElapsedNanos = 0;
+        int32_t socketQueueMaxDepthObserved = 0;
+        int64_t socketQueueMaxDepthObservedElapsedNanos = 0;
+        int32_t socketFullDrainCount = 0;
+        std::list<int32_t> systemServerRestartSec;
+        std::map<int, std::list<int32_t>> activationBroadcastGuardrailStats;
+        std::list<RestrictedMetricQueryStats> restrictedMetricQueryStats;
+        std::map<int32_t, SubscriptionStats> subscriptionStats;
+        int32_t subscriptionPullThreadWakeupCount = 0;
+        std::list<SocketLossStats> socketLossStats;
+        std::map<int32_t, int32_t> socketLossStatsOverflowCounters;
+        std::map<int32_t, int32_t> socketQueueHighWaterMarks;
+    };
+
+    // Fills the snapshot used by dumpStats. Containers that are cleared by the reset are moved
+    // out rather than copied when reset is true; resetInternalLocked must be called afterwards.
+    void takeReportSnapshotLocked(bool reset, ReportSnapshot* snapshot);
+
     void noteConfigResetInternalLocked(const ConfigKey& key);
 
     void noteConfigRemovedInternalLocked(const ConfigKey& key);
@@ -991,6 +1240,9 @@ private:
 
     void noteAtomLoggedLocked(int atomId, bool isSkipped);
 
+    // Doesn't need mLock, atomId must be at most kMaxPushedAtomId.
+    void notePlatformAtomLogged(int atomId, bool isSkipped);
+
     void noteAtomDroppedLocked(int atomId);
 
     void noteDataDropped(const ConfigKey& key, const size_t totalBytes, int32_t timeSec);
@@ -1010,6 +1262,8 @@ private:
 
     int getPushedAtomDropsLocked(int atomId) const;
 
+    int getPushedAtomDedupesLocked(int atomId) const;
+
     bool hasRestrictedConfigErrors(const std::shared_ptr<ConfigStats>& configStats) const;
 
     /**
@@ -1020,7 +1274,12 @@ private:
 
     FRIEND_TEST(LogEventQueue_test, TestQueueMaxSize);
     FRIEND_TEST(SocketParseMessageTest, TestProcessMessage);
+    FRIEND_TEST(SocketParseMessageTest, TestProcessMessageBatchDedupe);
     FRIEND_TEST(StatsLogProcessorTest, InvalidConfigRemoved);
+    FRIEND_TEST(StatsPullerManagerTest, TestPrefetchPulls);
+    FRIEND_TEST(StatsPullerManagerTest, TestPullersSharedByConfigs);
+    FRIEND_TEST(StatsPullerManagerTest, TestPullNotNeeded);
+    FRIEND_TEST(StatsPullerTest, PullRateLimitedToCache);
     FRIEND_TEST(StatsdStatsTest, TestActivationBroadcastGuardrailHit);
     FRIEND_TEST(StatsdStatsTest, TestAnomalyMonitor);
     FRIEND_TEST(StatsdStatsTest, TestAtomDroppedStats);
@@ -1043,6 +1302,7 @@ private:
     FRIEND_TEST(StatsdStatsTest, TestShardOffsetProvider);
     FRIEND_TEST(StatsdStatsTest, TestSocketLossStats);
     FRIEND_TEST(StatsdStatsTest, TestSocketLossStatsOverflowCounter);
+    FRIEND_TEST(StatsdStatsTest, TestSocketQueueHighWaterMark);
     FRIEND_TEST(StatsdStatsTest, TestSubStats);
     FRIEND_TEST(StatsdStatsTest, TestSubscriptionAtomPulled);
     FRIEND_TEST(StatsdStatsTest, TestSubscriptionEnded);
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <bitset>
+#include <set>
+#include <unordered_map>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+// The number of elements of an atom is limited by INT8_MAX, so are the top-level field positions.
+constexpr int kMaxAtomFieldMaskSize = 128;
+
+/**
+ * Top-level field positions of an atom which have to be decoded, bit N stands for field N.
+ * Nested fields (attribution chains, repeated fields) are decoded along with their top-level
+ * field.
+ */
+typedef std::bitset<kMaxAtomFieldMaskSize> AtomFieldMask;
+
+/**
+ * Atom id to the fields of this atom a consumer needs. Atoms used by the consumer without an
+ * entry in the map are decoded entirely.
+ */
+typedef std::unordered_map<int, AtomFieldMask> AtomFieldMaskMap;
+
+/**
+ * Merges the field masks of one consumer using |atomIds| into the field masks of all consumers.
+ * An atom is partially decoded only if every consumer using it provides a mask for it, atoms
+ * which have to be decoded entirely are tracked in |fullAtomIds|.
+ */
+template <typename AtomIdSet>
+void mergeAtomFieldMasks(const AtomIdSet& atomIds, const AtomFieldMaskMap& fieldMasks,
+                         AtomFieldMaskMap& mergedFieldMasks, std::set<int>& fullAtomIds) {
+    for (const int atomId : atomIds) {
+        if (fullAtomIds.find(atomId) != fullAtomIds.end()) {
+            continue;
+        }
+        const auto it = fieldMasks.find(atomId);
+        if (it == fieldMasks.end()) {
+            fullAtomIds.insert(atomId);
+            mergedFieldMasks.erase(atomId);
+        } else {
+            mergedFieldMasks[atomId] |= it->second;
+        }
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "LockFreeLogEventQueue.h"
+
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using std::unique_ptr;
+
+namespace {
+
+size_t roundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}  // namespace
+
+LockFreeLogEventQueue::LockFreeLogEventQueue(size_t maxSize)
+    : mMask(roundUpToPowerOfTwo(std::max<size_t>(maxSize, 2)) - 1),
+      mCells(std::make_unique<Cell[]>(mMask + 1)),
+      mEnqueuePos(0),
+      mDequeuePos(0),
+      mConsumerIdle(false),
+      mEventFd(eventfd(0, EFD_CLOEXEC)) {
+    for (size_t i = 0; i <= mMask; i++) {
+        mCells[i].sequence.store(i, std::memory_order_relaxed);
+        mCells[i].timestampNs.store(0, std::memory_order_relaxed);
+    }
+    if (mEventFd < 0) {
+        ALOGE("Failed to create eventfd for LockFreeLogEventQueue: %d", errno);
+    }
+}
+
+LockFreeLogEventQueue::~LockFreeLogEventQueue() {
+    if (mEventFd >= 0) {
+        close(mEventFd);
+    }
+}
+
+LockFreeLogEventQueue::Result LockFreeLogEventQueue::push(unique_ptr<LogEvent> item) {
+    Result result;
+    Cell* cell;
+    size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        cell = &mCells[pos & mMask];
+        const size_t seq = cell->sequence.load(std::memory_order_acquire);
+        const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The queue is full, the cell at the dequeue position holds the oldest event.
+            const size_t dequeuePos = mDequeuePos.load(std::memory_order_relaxed);
+            result.oldestTimestampNs =
+                    mCells[dequeuePos & mMask].timestampNs.load(std::memory_order_relaxed);
+            result.success = false;
+            result.size = pos - dequeuePos;
+            return result;
+        } else {
+            pos = mEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->timestampNs.store(item->GetElapsedTimestampNs(), std::memory_order_relaxed);
+    cell->event = std::move(item);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    result.success = true;
+    result.size = pos + 1 - mDequeuePos.load(std::memory_order_relaxed);
+
+    // Pairs with the fence in waitPop(): either the consumer sees the published cell or this
+    // producer sees the consumer idle flag.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mConsumerIdle.load(std::memory_order_relaxed)) {
+        wakeUpConsumer();
+    }
+    return result;
+}
+
+bool LockFreeLogEventQueue::tryPop(unique_ptr<LogEvent>* event) {
+    const size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+    Cell& cell = mCells[pos & mMask];
+    const size_t seq = cell.sequence.load(std::memory_order_acquire);
+    if ((intptr_t)seq - (intptr_t)(pos + 1) != 0) {
+        // Empty, or the producer which claimed this cell has not published it yet.
+        return false;
+    }
+    *event = std::move(cell.event);
+    mDequeuePos.store(pos + 1, std::memory_order_relaxed);
+    cell.sequence.store(pos + mMask + 1, std::memory_order_release);
+    return true;
+}
+
+unique_ptr<LogEvent> LockFreeLogEventQueue::waitPop() {
+    unique_ptr<LogEvent> item;
+    while (true) {
+        if (tryPop(&item)) {
+            return item;
+        }
+
+        mConsumerIdle.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (tryPop(&item)) {
+            mConsumerIdle.store(false, std::memory_order_relaxed);
+            return item;
+        }
+
+        uint64_t counter;
+        if (mEventFd < 0 || TEMP_FAILURE_RETRY(read(mEventFd, &counter, sizeof(counter))) < 0) {
+            // no way to sleep, degrade to polling
+            std::this_thread::yield();
+        }
+        mConsumerIdle.store(false, std::memory_order_relaxed);
+    }
+}
+
+void LockFreeLogEventQueue::wakeUpConsumer() {
+    // Only the first producer observing the idle consumer pays for the syscall.
+    if (!mConsumerIdle.exchange(false, std::memory_order_relaxed)) {
+        return;
+    }
+    const uint64_t one = 1;
+    if (mEventFd >= 0 && TEMP_FAILURE_RETRY(write(mEventFd, &one, sizeof(one))) < 0) {
+        ALOGE("Failed to signal LockFreeLogEventQueue eventfd: %d", errno);
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
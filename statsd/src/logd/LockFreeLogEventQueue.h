@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "LogEvent.h"
+#include "LogEventQueue.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * A bounded lock-free multi producer single consumer queue for LogEvent, with the same
+ * push()/waitPop() contract as LogEventQueue.
+ *
+ * Producers claim slots of a preallocated ring with a CAS on the enqueue position, the single
+ * consumer never blocks producers. The consumer sleeps on an eventfd which producers only signal
+ * when the consumer declared itself idle, so under load no syscall is made on either side.
+ *
+ * The ring capacity is the queue limit rounded up to the next power of two.
+ */
+class LockFreeLogEventQueue {
+public:
+    explicit LockFreeLogEventQueue(size_t maxSize);
+
+    ~LockFreeLogEventQueue();
+
+    LockFreeLogEventQueue(const LockFreeLogEventQueue&) = delete;
+    LockFreeLogEventQueue& operator=(const LockFreeLogEventQueue&) = delete;
+
+    /**
+     * Blocking read one event from the queue. Must be called from a single consumer thread.
+     */
+    std::unique_ptr<LogEvent> waitPop();
+
+    using Result = LogEventQueue::Result;
+
+    /**
+     * Puts a LogEvent ptr to the end of the queue. Safe to call from multiple threads.
+     * Returns false on failure when the queue is full, and output the oldest event timestamp
+     * in the queue. Returns true on success and new queue size.
+     * Queue size and oldest timestamp are snapshots which can be stale under concurrent access.
+     */
+    Result push(std::unique_ptr<LogEvent> event);
+
+    size_t capacity() const {
+        return mMask + 1;
+    }
+
+private:
+    struct Cell {
+        // Lap counter of the Vyukov bounded queue: equals the position when the cell is free
+        // for a producer and position + 1 when the cell holds an event for the consumer.
+        std::atomic<size_t> sequence;
+        // Elapsed timestamp of the stored event, readable by producers without touching the
+        // event itself which may be concurrently consumed.
+        std::atomic<int64_t> timestampNs;
+        std::unique_ptr<LogEvent> event;
+    };
+
+    bool tryPop(std::unique_ptr<LogEvent>* event);
+
+    void wakeUpConsumer();
+
+    const size_t mMask;
+    std::unique_ptr<Cell[]> mCells;
+
+    alignas(64) std::atomic<size_t> mEnqueuePos;
+    // Written by the consumer only, read by producers to estimate the queue size.
+    alignas(64) std::atomic<size_t> mDequeuePos;
+    std::atomic_bool mConsumerIdle;
+
+    const int mEventFd;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
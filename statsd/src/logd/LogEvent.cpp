@@ -27,6 +27,7 @@
 #include "stats_annotations.h"
 #include "stats_log_util.h"
 #include "statslog_statsd.h"
+#include "utils/ProtoBufferWriter.h"
 
 namespace android {
 namespace os {
@@ -51,12 +52,179 @@ uint8_t getNumAnnotations(uint8_t typeInfo) {
     return (typeInfo >> 4) & 0x0F;  // num annotations in upper 4 bytes
 }
 
+// Reads the body of a buffer that was already validated by LogEvent::parseBody().
+class RawBodyReader {
+public:
+    RawBodyReader(const uint8_t* buf, size_t len) : mBuf(buf), mRemainingLen(len) {
+    }
+
+    bool isValid() const {
+        return mValid;
+    }
+
+    template <class T>
+    T read() {
+        T value = 0;
+        if (sizeof(T) > mRemainingLen) {
+            mValid = false;
+            return value;
+        }
+        memcpy(&value, mBuf, sizeof(T));
+        mBuf += sizeof(T);
+        mRemainingLen -= sizeof(T);
+        return value;
+    }
+
+    // Returns the bytes of a string or byte array and sets numBytes to their length.
+    const char* readBytes(int32_t* numBytes) {
+        *numBytes = read<int32_t>();
+        if (*numBytes < 0 || (size_t)*numBytes > mRemainingLen) {
+            mValid = false;
+            *numBytes = 0;
+            return nullptr;
+        }
+        const char* bytes = reinterpret_cast<const char*>(mBuf);
+        mBuf += *numBytes;
+        mRemainingLen -= *numBytes;
+        return bytes;
+    }
+
+    void skipAnnotations(uint8_t numAnnotations) {
+        for (uint8_t i = 0; i < numAnnotations && mValid; i++) {
+            /* annotationId =*/read<uint8_t>();
+            const uint8_t annotationType = read<uint8_t>();
+            skip(annotationType == BOOL_TYPE ? sizeof(uint8_t) : sizeof(int32_t));
+        }
+    }
+
+private:
+    void skip(size_t numBytes) {
+        if (numBytes > mRemainingLen) {
+            mValid = false;
+            return;
+        }
+        mBuf += numBytes;
+        mRemainingLen -= numBytes;
+    }
+
+    const uint8_t* mBuf;
+    size_t mRemainingLen;
+    bool mValid = true;
+};
+
+// Encodes one primitive value of the body like writeFieldValueTreeToStream(): bools are written
+// as int32 and byte arrays as messages.
+void encodeRawValue(RawBodyReader* reader, uint8_t typeId, int fieldNum,
+                    ProtoBufferWriter* writer) {
+    switch (typeId) {
+        case BOOL_TYPE:
+            writer->writeInt32(fieldNum, reader->read<uint8_t>());
+            break;
+        case INT32_TYPE:
+            writer->writeInt32(fieldNum, reader->read<int32_t>());
+            break;
+        case INT64_TYPE:
+            writer->writeInt64(fieldNum, reader->read<int64_t>());
+            break;
+        case FLOAT_TYPE:
+            writer->writeFloat(fieldNum, reader->read<float>());
+            break;
+        case STRING_TYPE:
+        case BYTE_ARRAY_TYPE: {
+            int32_t numBytes;
+            const char* bytes = reader->readBytes(&numBytes);
+            writer->writeBytes(fieldNum, bytes, numBytes);
+            break;
+        }
+        default:
+            ALOGE("Unexpected type %d in a kept LogEvent body", typeId);
+            break;
+    }
+}
+
+// Transcodes the body of a socket buffer into the fields of an Atom message, without going through
+// the FieldValues. Key value pairs are not supported, the body is not kept for them. Returns false
+// if the body is truncated.
+bool encodeRawBody(const vector<uint8_t>& body, uint8_t numElements, ProtoBufferWriter* writer) {
+    RawBodyReader reader(body.data(), body.size());
+    for (int32_t pos = 1; pos <= numElements && reader.isValid(); pos++) {
+        const uint8_t typeInfo = reader.read<uint8_t>();
+        switch (getTypeId(typeInfo)) {
+            case ATTRIBUTION_CHAIN_TYPE: {
+                const uint8_t numNodes = reader.read<uint8_t>();
+                for (uint8_t i = 0; i < numNodes && reader.isValid(); i++) {
+                    const int32_t uid = reader.read<int32_t>();
+                    int32_t tagSize;
+                    const char* tag = reader.readBytes(&tagSize);
+                    const size_t nodeSize = ProtoBufferWriter::sizeOfInt32Field(1, uid) +
+                                            ProtoBufferWriter::sizeOfBytesField(2, tagSize);
+                    writer->writeMessageHeader(pos, nodeSize);
+                    writer->writeInt32(1, uid);
+                    writer->writeBytes(2, tag, tagSize);
+                }
+                break;
+            }
+            case LIST_TYPE: {
+                const uint8_t numListElements = reader.read<uint8_t>();
+                const uint8_t elementTypeId = getTypeId(reader.read<uint8_t>());
+                for (uint8_t i = 0; i < numListElements && reader.isValid(); i++) {
+                    encodeRawValue(&reader, elementTypeId, pos, writer);
+                }
+                break;
+            }
+            default:
+                encodeRawValue(&reader, getTypeId(typeInfo), pos, writer);
+                break;
+        }
+        reader.skipAnnotations(getNumAnnotations(typeInfo));
+    }
+    return reader.isValid();
+}
+
+// Same as writeFieldValueTreeToStream(), from the kept body.
+void writeRawBodyToProto(int32_t tagId, const vector<uint8_t>& body, uint8_t numElements,
+                         ProtoOutputStream* protoOutput) {
+    bool valid = true;
+    writeEncodedAtomToStream(
+            tagId,
+            [&](ProtoBufferWriter* writer) {
+                valid = encodeRawBody(body, numElements, writer);
+            },
+            protoOutput);
+    if (!valid) {
+        ALOGE("Failed to transcode the kept body of atom %d", tagId);
+    }
+}
+
 }  // namespace
 
 LogEvent::LogEvent(int32_t uid, int32_t pid)
     : mLogdTimestampNs(getWallClockNs()), mLogUid(uid), mLogPid(pid) {
 }
 
+void LogEvent::reset(int32_t uid, int32_t pid) {
+    mValues.clear();
+    mFieldIds.clear();
+    mHasRawBody = false;
+    mBuf = nullptr;
+    mRemainingLen = 0;
+    mValid = true;
+    mParsedHeaderOnly = false;
+    mLogdTimestampNs = getWallClockNs();
+    mElapsedTimestampNs = 0;
+    mTagId = 0;
+    mLogUid = uid;
+    mLogPid = pid;
+    mTruncateTimestamp = false;
+    mResetState = -1;
+    mRepeatCount = 1;
+    mRestrictionCategory = CATEGORY_NO_RESTRICTION;
+    mUidFieldIndices.clear();
+    mAttributionChainStartIndex.reset();
+    mAttributionChainEndIndex.reset();
+    mExclusiveStateFieldIndex.reset();
+}
+
 LogEvent::LogEvent(const string& trainName, int64_t trainVersionCode, bool requiresStaging,
                    bool rollbackEnabled, bool requiresLowLatencyMonitor, int32_t state,
                    const std::vector<uint8_t>& experimentIds, int32_t userId) {
@@ -75,6 +243,7 @@ LogEvent::LogEvent(const string& trainName, int64_t trainVersionCode, bool requi
     mValues.push_back(FieldValue(Field(mTagId, getSimpleField(6)), Value(state)));
     mValues.push_back(FieldValue(Field(mTagId, getSimpleField(7)), Value(experimentIds)));
     mValues.push_back(FieldValue(Field(mTagId, getSimpleField(8)), Value(userId)));
+    updateFieldIds();
 }
 
 LogEvent::LogEvent(int64_t wallClockTimestampNs, int64_t elapsedTimestampNs,
@@ -90,6 +259,14 @@ LogEvent::LogEvent(int64_t wallClockTimestampNs, int64_t elapsedTimestampNs,
     mValues.push_back(FieldValue(Field(mTagId, getSimpleField(2)), Value(experimentIdsProto)));
     mValues.push_back(FieldValue(Field(mTagId, getSimpleField(3)), Value(trainInfo.trainName)));
     mValues.push_back(FieldValue(Field(mTagId, getSimpleField(4)), Value(trainInfo.status)));
+    updateFieldIds();
+}
+
+void LogEvent::updateFieldIds() {
+    mFieldIds.resize(mValues.size());
+    for (size_t i = 0; i < mValues.size(); i++) {
+        mFieldIds[i] = mValues[i].mField.getField();
+    }
 }
 
 void LogEvent::parseInt32(int32_t* pos, int32_t depth, bool* last, uint8_t numAnnotations) {
@@ -292,7 +469,9 @@ void LogEvent::parseIsUidAnnotation(uint8_t annotationType, std::optional<uint8_
 
     bool isUid = readNextValue<uint8_t>();
     if (isUid) {
-        mNumUidFields += numElements.value();
+        for (size_t i = mValues.size() - numElements.value(); i < mValues.size(); i++) {
+            mUidFieldIndices.push_back(i);
+        }
     }
 
     for (int i = 1; i <= numElements; i++) {
@@ -483,6 +662,108 @@ void LogEvent::parseAnnotations(uint8_t numAnnotations, std::optional<uint8_t> n
     }
 }
 
+void LogEvent::skipBytes(uint32_t numBytes) {
+    if (numBytes > mRemainingLen) {
+        mValid = false;
+        return;
+    }
+    mBuf += numBytes;
+    mRemainingLen -= numBytes;
+}
+
+void LogEvent::skipValue(uint8_t typeId) {
+    switch (typeId) {
+        case BOOL_TYPE:
+            skipBytes(sizeof(uint8_t));
+            break;
+        case INT32_TYPE:
+            skipBytes(sizeof(int32_t));
+            break;
+        case INT64_TYPE:
+            skipBytes(sizeof(int64_t));
+            break;
+        case FLOAT_TYPE:
+            skipBytes(sizeof(float));
+            break;
+        case STRING_TYPE:
+        case BYTE_ARRAY_TYPE:
+            skipBytes((uint32_t)readNextValue<int32_t>());
+            break;
+        default:
+            mValid = false;
+            break;
+    }
+}
+
+// Mirrors the parse*() methods, but does not create FieldValues nor validates the semantics of
+// annotations since skipped fields are not used by any metric.
+void LogEvent::skipField(uint8_t typeId, uint8_t numAnnotations) {
+    switch (typeId) {
+        case KEY_VALUE_PAIRS_TYPE: {
+            const uint8_t numPairs = readNextValue<uint8_t>();
+            for (uint8_t i = 0; i < numPairs && mValid; i++) {
+                skipValue(INT32_TYPE);  // key
+                const uint8_t valueTypeId = getTypeId(readNextValue<uint8_t>());
+                if (valueTypeId == BOOL_TYPE || valueTypeId == BYTE_ARRAY_TYPE) {
+                    mValid = false;
+                    break;
+                }
+                skipValue(valueTypeId);
+            }
+            break;
+        }
+        case ATTRIBUTION_CHAIN_TYPE: {
+            const uint8_t numNodes = readNextValue<uint8_t>();
+            if (numNodes == 0 || numNodes > INT8_MAX) {
+                mValid = false;
+                break;
+            }
+            for (uint8_t i = 0; i < numNodes && mValid; i++) {
+                skipValue(INT32_TYPE);   // uid
+                skipValue(STRING_TYPE);  // tag
+            }
+            break;
+        }
+        case LIST_TYPE: {
+            const uint8_t numElements = readNextValue<uint8_t>();
+            const uint8_t elementTypeId = getTypeId(readNextValue<uint8_t>());
+            if (numElements > INT8_MAX || elementTypeId == BYTE_ARRAY_TYPE) {
+                mValid = false;
+                break;
+            }
+            for (uint8_t i = 0; i < numElements && mValid; i++) {
+                skipValue(elementTypeId);
+            }
+            break;
+        }
+        default:
+            skipValue(typeId);
+            break;
+    }
+
+    if (mValid) {
+        skipAnnotations(numAnnotations);
+    }
+}
+
+void LogEvent::skipAnnotations(uint8_t numAnnotations) {
+    for (uint8_t i = 0; i < numAnnotations && mValid; i++) {
+        /* annotationId =*/readNextValue<uint8_t>();
+        const uint8_t annotationType = readNextValue<uint8_t>();
+        switch (annotationType) {
+            case BOOL_TYPE:
+                skipBytes(sizeof(uint8_t));
+                break;
+            case INT32_TYPE:
+                skipBytes(sizeof(int32_t));
+                break;
+            default:
+                mValid = false;
+                break;
+        }
+    }
+}
+
 LogEvent::BodyBufferInfo LogEvent::parseHeader(const uint8_t* buf, size_t len) {
     BodyBufferInfo bodyInfo;
 
@@ -534,11 +815,14 @@ LogEvent::BodyBufferInfo LogEvent::parseHeader(const uint8_t* buf, size_t len) {
     return bodyInfo;
 }
 
-bool LogEvent::parseBody(const BodyBufferInfo& bodyInfo) {
+bool LogEvent::parseBody(const BodyBufferInfo& bodyInfo, const AtomFieldMask* fieldMask) {
     mParsedHeaderOnly = false;
 
     mBuf = bodyInfo.buffer;
     mRemainingLen = (uint32_t)bodyInfo.bufferSize;
+    mHasRawBody = false;
+    // The body is only kept when the values describe all of its fields.
+    bool keepRawBody = fieldMask == nullptr;
 
     int32_t pos[] = {1, 1, 1};
     bool last[] = {false, false, false};
@@ -548,12 +832,20 @@ bool LogEvent::parseBody(const BodyBufferInfo& bodyInfo) {
     // of vector buffer reallocations.
     mValues.reserve(bodyInfo.numElements);
 
-    for (pos[0] = 1; pos[0] <= bodyInfo.numElements && mValid; pos[0]++) {
+    if (fieldMask == nullptr) {
+        pos[0] = parseFlatFields(bodyInfo.numElements);
+    }
+    for (; pos[0] <= bodyInfo.numElements && mValid; pos[0]++) {
         last[0] = (pos[0] == bodyInfo.numElements);
 
         uint8_t typeInfo = readNextValue<uint8_t>();
         uint8_t typeId = getTypeId(typeInfo);
 
+        if (fieldMask != nullptr && !fieldMask->test(pos[0]) && typeId != ERROR_TYPE) {
+            skipField(typeId, getNumAnnotations(typeInfo));
+            continue;
+        }
+
         switch (typeId) {
             case BOOL_TYPE:
                 parseBool(pos, /*depth=*/0, last, getNumAnnotations(typeInfo));
@@ -574,6 +866,7 @@ bool LogEvent::parseBody(const BodyBufferInfo& bodyInfo) {
                 parseString(pos, /*depth=*/0, last, getNumAnnotations(typeInfo));
                 break;
             case KEY_VALUE_PAIRS_TYPE:
+                keepRawBody = false;
                 parseKeyValuePairs(pos, /*depth=*/0, last, getNumAnnotations(typeInfo));
                 break;
             case ATTRIBUTION_CHAIN_TYPE:
@@ -594,9 +887,68 @@ bool LogEvent::parseBody(const BodyBufferInfo& bodyInfo) {
 
     if (mRemainingLen != 0) mValid = false;
     mBuf = nullptr;
+    updateFieldIds();
+    if (mValid && keepRawBody) {
+        mRawBody.assign(bodyInfo.buffer, bodyInfo.buffer + bodyInfo.bufferSize);
+        mRawBodyNumElements = bodyInfo.numElements;
+        mHasRawBody = true;
+    }
     return mValid;
 }
 
+int32_t LogEvent::parseFlatFields(uint8_t numElements) {
+    int32_t pos[] = {1, 1, 1};
+    for (; pos[0] <= numElements && mValid; pos[0]++) {
+        if (mRemainingLen == 0) {
+            mValid = false;
+            break;
+        }
+        // Each value is read once and checked against mRemainingLen, the buffer might be
+        // written to while it is parsed.
+        const uint8_t typeInfo = *mBuf;
+        const uint8_t typeId = getTypeId(typeInfo);
+        if (typeId != BOOL_TYPE && typeId != INT32_TYPE && typeId != INT64_TYPE &&
+            typeId != FLOAT_TYPE && typeId != STRING_TYPE) {
+            // left to the generic parsing, along with the following fields
+            break;
+        }
+        readNextValue<uint8_t>();
+        const Field field(mTagId, pos, /*depth=*/0);
+        switch (typeId) {
+            case BOOL_TYPE:
+                // cast to int32_t because FieldValue does not support bools
+                mValues.emplace_back(field, Value((int32_t)readNextValue<uint8_t>()));
+                break;
+            case INT32_TYPE:
+                mValues.emplace_back(field, Value(readNextValue<int32_t>()));
+                break;
+            case INT64_TYPE:
+                mValues.emplace_back(field, Value(readNextValue<int64_t>()));
+                break;
+            case FLOAT_TYPE:
+                mValues.emplace_back(field, Value(readNextValue<float>()));
+                break;
+            case STRING_TYPE: {
+                const int32_t numBytes = readNextValue<int32_t>();
+                if ((uint32_t)numBytes > mRemainingLen) {
+                    mValid = false;
+                    break;
+                }
+                mValues.emplace_back(field, Value(string((const char*)mBuf, numBytes)));
+                mBuf += numBytes;
+                mRemainingLen -= numBytes;
+                break;
+            }
+        }
+        // Annotations are rare, they go through the generic path.
+        const uint8_t numAnnotations = getNumAnnotations(typeInfo);
+        if (numAnnotations > 0 && mValid) {
+            parseAnnotations(numAnnotations);
+        }
+    }
+    return pos[0];
+}
+
 // This parsing logic is tied to the encoding scheme used in StatsEvent.java and
 // stats_event.c
 bool LogEvent::parseBuffer(const uint8_t* buf, size_t len) {
@@ -769,6 +1121,10 @@ string LogEvent::ToString() const {
 }
 
 void LogEvent::ToProto(ProtoOutputStream& protoOutput) const {
+    if (mHasRawBody) {
+        writeRawBodyToProto(mTagId, mRawBody, mRawBodyNumElements, &protoOutput);
+        return;
+    }
     writeFieldValueTreeToStream(mTagId, getValues(), &protoOutput);
 }
 
@@ -24,6 +24,7 @@
 #include <vector>
 
 #include "FieldValue.h"
+#include "logd/AtomFieldMask.h"
 #include "utils/RestrictedPolicyManager.h"
 
 namespace android {
@@ -94,6 +95,19 @@ public:
      */
     bool parseBuffer(const uint8_t* buf, size_t len);
 
+    /**
+     * Resets the event to the state of a newly constructed LogEvent(uid, pid) so that it can be
+     * reused for parsing another atom. The values storage capacity is kept.
+     */
+    void reset(int32_t uid, int32_t pid);
+
+    /**
+     * Returns the number of FieldValues the event can hold without reallocation.
+     */
+    inline size_t valuesCapacity() const {
+        return mValues.capacity();
+    }
+
     struct BodyBufferInfo {
         const uint8_t* buffer = nullptr;
         size_t bufferSize = 0;
@@ -111,9 +125,11 @@ public:
     /**
      * @brief Parses atom body which consists of header.numElements elements
      * Should be called only with BodyBufferInfo if when logEvent.isValid() == true
+     * @param fieldMask optional top-level fields to decode, the remaining fields are skipped
+     *        together with their annotations. All fields are decoded if nullptr
      * \return success of the parsing
      */
-    bool parseBody(const BodyBufferInfo& bodyInfo);
+    bool parseBody(const BodyBufferInfo& bodyInfo, const AtomFieldMask* fieldMask = nullptr);
 
     // Constructs a BinaryPushStateChanged LogEvent from API call.
     explicit LogEvent(const std::string& trainName, int64_t trainVersionCode, bool requiresStaging,
@@ -167,10 +183,17 @@ public:
     std::string ToString() const;
 
     /**
-     * Write this object to a ProtoOutputStream.
+     * Write this object to a ProtoOutputStream. The fields are transcoded from the parsed buffer
+     * when it was kept, see hasRawBody(), and encoded from the values otherwise.
      */
     void ToProto(android::util::ProtoOutputStream& out) const;
 
+    // Whether the body of the parsed buffer is kept for ToProto(). It is kept when all the fields
+    // were parsed and is dropped once the values are modified.
+    inline bool hasRawBody() const {
+        return mHasRawBody;
+    }
+
     /**
      * Set elapsed timestamp if the original timestamp is missing.
      */
@@ -193,17 +216,31 @@ public:
         return mValues;
     }
 
+    // The values can be modified, but not their fields or their number since getFieldIds() would
+    // no longer match them.
     std::vector<FieldValue>* getMutableValues() {
+        mHasRawBody = false;
         return &mValues;
     }
 
+    // Encoded fields of getValues() in the same order, or empty if the values were not parsed by
+    // this LogEvent.
+    inline const std::vector<int32_t>& getFieldIds() const {
+        return mFieldIds;
+    }
+
     // Default value = false
     inline bool shouldTruncateTimestamp() const {
         return mTruncateTimestamp;
     }
 
     inline uint8_t getNumUidFields() const {
-        return mNumUidFields;
+        return mUidFieldIndices.size();
+    }
+
+    // Indices within getValues() of the uid annotated fields, in increasing order.
+    inline const std::vector<size_t>& getUidFieldIndices() const {
+        return mUidFieldIndices;
     }
 
     // Returns whether this LogEvent has an AttributionChain.
@@ -238,6 +275,7 @@ public:
             if (fieldValue.mField.getField() == field) {
                 if (fieldValue.mValue.getType() == type) {
                     fieldValue.mValue = Value(value);
+                    mHasRawBody = false;
                    return OK;
                } else {
                    return BAD_TYPE;
@@ -247,6 +285,16 @@ public:
         return BAD_INDEX;
     }
 
+    // Number of identical events logged in a row that this event stands for, see
+    // StatsSocketListener::setDedupeWindows(). Only count metrics count the repeats.
+    inline int32_t getRepeatCount() const {
+        return mRepeatCount;
+    }
+
+    inline void addRepeat() {
+        mRepeatCount++;
+    }
+
     bool isValid() const {
         return mValid;
     }
@@ -263,6 +311,11 @@ public:
      */
     LogEvent(const LogEvent&) = default;
 
+    /**
+     * Copies the event into an existing one, reusing its storage.
+     */
+    LogEvent& operator=(const LogEvent&) = default;
+
     inline StatsdRestrictionCategory getRestrictionCategory() const {
         return mRestrictionCategory;
     }
@@ -281,6 +334,9 @@ private:
     void parseKeyValuePairs(int32_t* pos, int32_t depth, bool* last, uint8_t numAnnotations);
     void parseAttributionChain(int32_t* pos, int32_t depth, bool* last, uint8_t numAnnotations);
     void parseArray(int32_t* pos, int32_t depth, bool* last, uint8_t numAnnotations);
+    // Decodes the leading primitive and string fields of the body without the per type parse
+    // calls. Returns the position of the first field left to the generic parsing.
+    int32_t parseFlatFields(uint8_t numElements);
 
     void parseAnnotations(uint8_t numAnnotations, std::optional<uint8_t> numElements = std::nullopt,
                           std::optional<size_t> firstUidInChainIndex = std::nullopt);
@@ -299,6 +355,12 @@ private:
     bool checkPreviousValueType(Type expected);
     bool getRestrictedMetricsFlag();
 
+    // Advance the buffer past a value without storing it, used for fields outside of field mask.
+    void skipField(uint8_t typeId, uint8_t numAnnotations);
+    void skipValue(uint8_t typeId);
+    void skipAnnotations(uint8_t numAnnotations);
+    void skipBytes(uint32_t numBytes);
+
     /**
      * The below two variables are only valid during the execution of
      * parseBuffer. There are no guarantees about the state of these variables
@@ -341,20 +403,31 @@ private:
         return value;
     }
 
+    void updateFieldIds();
+
     template <class T>
     void addToValues(int32_t* pos, int32_t depth, T& value, bool* last) {
         Field f = Field(mTagId, pos, depth);
         // only decorate last position for depths with repeated fields (depth 1)
         if (depth > 0 && last[1]) f.decorateLastPos(1);
 
-        Value v = Value(value);
-        mValues.push_back(FieldValue(f, v));
+        mValues.emplace_back(f, Value(std::move(value)));
     }
 
     // The items are naturally sorted in DFS order as we read them. this allows us to do fast
     // matching.
     std::vector<FieldValue> mValues;
 
+    // Field of each value in mValues. Kept apart from mValues so that scanning for the values
+    // matching a field doesn't touch the values.
+    std::vector<int32_t> mFieldIds;
+
+    // Body of the parsed buffer after the atom id, kept while it matches mValues so that
+    // ToProto() does not re-encode the values. Its storage is reused across reset().
+    std::vector<uint8_t> mRawBody;
+    uint8_t mRawBodyNumElements = 0;
+    bool mHasRawBody = false;
+
     // The timestamp set by the logd.
     int64_t mLogdTimestampNs;
 
@@ -374,9 +447,12 @@ private:
     // Annotations
     bool mTruncateTimestamp = false;
     int mResetState = -1;
+    int32_t mRepeatCount = 1;
     StatsdRestrictionCategory mRestrictionCategory = CATEGORY_NO_RESTRICTION;
 
-    size_t mNumUidFields = 0;
+    // Recorded while parsing the uid annotations, so that the isolated uids can be remapped
+    // without scanning mValues.
+    std::vector<size_t> mUidFieldIndices;
 
     std::optional<size_t> mAttributionChainStartIndex;
     std::optional<size_t> mAttributionChainEndIndex;
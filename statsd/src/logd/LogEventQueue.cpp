@@ -19,6 +19,8 @@
 
 #include "LogEventQueue.h"
 
+#include "utils/StatsdTrace.h"
+
 namespace android {
 namespace os {
 namespace statsd {
@@ -26,38 +28,121 @@ namespace statsd {
 using std::unique_lock;
 using std::unique_ptr;
 
+[[maybe_unused]] constexpr char kQueueSizeTraceCounter[] = "statsd_event_queue_size";
+
 unique_ptr<LogEvent> LogEventQueue::waitPop() {
     std::unique_lock<std::mutex> lock(mMutex);
 
-    if (mQueue.empty()) {
-        mCondition.wait(lock, [this] { return !this->mQueue.empty(); });
+    if (sizeLocked() == 0) {
+        mCondition.wait(lock, [this] { return this->sizeLocked() != 0; });
     }
 
+    return popLocked();
+}
+
+void LogEventQueue::waitPopBatch(size_t maxEvents, std::chrono::nanoseconds maxLatency,
+                                 std::vector<unique_ptr<LogEvent>>& events) {
+    events.clear();
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    if (sizeLocked() == 0) {
+        mCondition.wait(lock, [this] { return this->sizeLocked() != 0; });
+    }
+
+    if (maxLatency.count() > 0 && sizeLocked() < maxEvents) {
+        mCondition.wait_for(lock, maxLatency,
+                            [this, maxEvents] { return this->sizeLocked() >= maxEvents; });
+    }
+
+    while (sizeLocked() != 0 && events.size() < maxEvents) {
+        events.push_back(popLocked());
+    }
+    STATSD_TRACE_COUNTER(kQueueSizeTraceCounter, sizeLocked());
+}
+
+unique_ptr<LogEvent> LogEventQueue::popLocked() {
     unique_ptr<LogEvent> item = std::move(mQueue.front());
     mQueue.pop();
-
     return item;
 }
 
-LogEventQueue::Result LogEventQueue::push(unique_ptr<LogEvent> item) {
+void LogEventQueue::pushLocked(unique_ptr<LogEvent>& item, bool isPriority, Result& result) {
+    // The priority only affects the admission of the event, the events stay in order since
+    // processing an event can depend on the earlier ones, such as the isolated uid changes.
+    const size_t limit = isPriority ? mQueueLimit + mPriorityQueueLimit : mQueueLimit;
+    if (mQueue.size() < limit) {
+        mQueue.push(std::move(item));
+        result.success = true;
+    } else {
+        // safe operation as queue must not be empty.
+        result.oldestTimestampNs = mQueue.front()->GetElapsedTimestampNs();
+        result.success = false;
+    }
+    result.size = sizeLocked();
+}
+
+LogEventQueue::Result LogEventQueue::push(unique_ptr<LogEvent> item, bool isPriority) {
     Result result;
     {
         std::unique_lock<std::mutex> lock(mMutex);
-        if (mQueue.size() < mQueueLimit) {
-            mQueue.push(std::move(item));
-            result.success = true;
-        } else {
-            // safe operation as queue must not be empty.
-            result.oldestTimestampNs = mQueue.front()->GetElapsedTimestampNs();
-            result.success = false;
-        }
-        result.size = mQueue.size();
+        pushLocked(item, isPriority, result);
     }
+    STATSD_TRACE_COUNTER(kQueueSizeTraceCounter, result.size);
 
     mCondition.notify_one();
     return result;
 }
 
+std::vector<LogEventQueue::Result> LogEventQueue::pushBatch(
+        std::vector<unique_ptr<LogEvent>>& events, const std::vector<bool>& isPriority) {
+    std::vector<Result> results(events.size());
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        for (size_t i = 0; i < events.size(); i++) {
+            pushLocked(events[i], !isPriority.empty() && isPriority[i], results[i]);
+        }
+    }
+    if (!results.empty()) {
+        STATSD_TRACE_COUNTER(kQueueSizeTraceCounter, results.back().size);
+    }
+
+    mCondition.notify_one();
+    return results;
+}
+
+bool LogEventQueue::isEmpty() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return sizeLocked() == 0;
+}
+
+unique_ptr<LogEvent> LogEventQueue::obtainEvent(int32_t uid, int32_t pid) {
+    unique_ptr<LogEvent> event;
+    {
+        std::lock_guard<std::mutex> lock(mPoolMutex);
+        if (!mEventPool.empty()) {
+            event = std::move(mEventPool.back());
+            mEventPool.pop_back();
+        }
+    }
+
+    if (event == nullptr) {
+        return std::make_unique<LogEvent>(uid, pid);
+    }
+    event->reset(uid, pid);
+    return event;
+}
+
+void LogEventQueue::recycleEvent(unique_ptr<LogEvent> event) {
+    if (event == nullptr || event->valuesCapacity() > kMaxPooledValuesCapacity) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mPoolMutex);
+    if (mEventPool.size() < kMaxPooledEvents) {
+        mEventPool.push_back(std::move(event));
+    }
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -18,9 +18,11 @@
 
 #include <gtest/gtest_prod.h>
 
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 #include "LogEvent.h"
 
@@ -30,16 +32,31 @@ namespace statsd {
 
 /**
  * A zero copy thread safe queue buffer for producing and consuming LogEvent.
+ *
+ * The events are read in the order they were pushed. Headroom past the size limit of the queue
+ * is reserved for the events of critical atoms, so queue overflow under load sheds the low
+ * priority traffic first without reordering the events.
  */
 class LogEventQueue {
 public:
-    explicit LogEventQueue(size_t maxSize) : mQueueLimit(maxSize){};
+    explicit LogEventQueue(size_t maxSize,
+                           size_t maxPrioritySize = kDefaultPriorityQueueLimit)
+        : mQueueLimit(maxSize), mPriorityQueueLimit(maxPrioritySize){};
 
     /**
      * Blocking read one event from the queue.
      */
     std::unique_ptr<LogEvent> waitPop();
 
+    /**
+     * Blocking read of up to maxEvents events from the queue, in the order they were pushed.
+     * Blocks until at least one event is available, then waits up to maxLatency for the batch to
+     * fill up. A zero maxLatency returns right away with the events queued at that point.
+     * The events are appended to |events| which is cleared first.
+     */
+    void waitPopBatch(size_t maxEvents, std::chrono::nanoseconds maxLatency,
+                      std::vector<std::unique_ptr<LogEvent>>& events);
+
     struct Result {
         bool success = false;
         int64_t oldestTimestampNs = 0;
@@ -48,17 +65,65 @@ public:
 
     /**
      * Puts a LogEvent ptr to the end of the queue.
+     * A priority event may also use the headroom reserved past the size limit of the queue.
      * Returns false on failure when the queue is full, and output the oldest event timestamp
      * in the queue. Returns true on success and new queue size.
      */
-    Result push(std::unique_ptr<LogEvent> event);
+    Result push(std::unique_ptr<LogEvent> event, bool isPriority = false);
+
+    /**
+     * Puts a batch of LogEvent ptrs to the end of the queue under a single lock acquisition.
+     * Events which do not fit in the queue are left in |events|. |isPriority| is either empty
+     * or has one entry per event. Returns one Result per event with the same semantics as push().
+     */
+    std::vector<Result> pushBatch(std::vector<std::unique_ptr<LogEvent>>& events,
+                                  const std::vector<bool>& isPriority = {});
+
+    /**
+     * Returns true if no event is waiting to be read.
+     */
+    bool isEmpty();
+
+    /**
+     * Returns a LogEvent ready to be parsed. A previously consumed event is reused when
+     * available, so neither the event nor its values storage are reallocated for every atom.
+     */
+    std::unique_ptr<LogEvent> obtainEvent(int32_t uid, int32_t pid);
+
+    /**
+     * Returns a consumed LogEvent to the pool of events used by obtainEvent(). The event is
+     * released instead if the pool is full or if its values storage is unusually large.
+     */
+    void recycleEvent(std::unique_ptr<LogEvent> event);
+
+    // Max number of consumed events kept for reuse.
+    static constexpr size_t kMaxPooledEvents = 256;
+
+    // Events grown above this number of values are not pooled to bound the pool memory.
+    static constexpr size_t kMaxPooledValuesCapacity = 128;
+
+    // Default number of events reserved for the priority events past the size limit.
+    static constexpr size_t kDefaultPriorityQueueLimit = 1000;
 
 private:
+    void pushLocked(std::unique_ptr<LogEvent>& event, bool isPriority, Result& result);
+
+    std::unique_ptr<LogEvent> popLocked();
+
+    size_t sizeLocked() const {
+        return mQueue.size();
+    }
+
     const size_t mQueueLimit;
+    const size_t mPriorityQueueLimit;
     std::condition_variable mCondition;
     std::mutex mMutex;
     std::queue<std::unique_ptr<LogEvent>> mQueue;
 
+    // Guarded by its own lock to not contend with push()/waitPop().
+    std::mutex mPoolMutex;
+    std::vector<std::unique_ptr<LogEvent>> mEventPool;
+
     friend class SocketParseMessageTest;
 
     FRIEND_TEST(SocketParseMessageTest, TestProcessMessage);
@@ -66,6 +131,8 @@ private:
     FRIEND_TEST(SocketParseMessageTest, TestProcessMessageFilterCompleteSet);
     FRIEND_TEST(SocketParseMessageTest, TestProcessMessageFilterPartialSet);
     FRIEND_TEST(SocketParseMessageTest, TestProcessMessageFilterToggle);
+    FRIEND_TEST(SocketParseMessageTest, TestProcessMessageBatch);
+    FRIEND_TEST(SocketParseMessageTest, TestProcessMessageBatchDedupe);
 };
 
 }  // namespace statsd
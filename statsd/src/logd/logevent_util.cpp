@@ -16,6 +16,8 @@
 
 #include "logd/logevent_util.h"
 
+#include <algorithm>
+
 namespace android {
 namespace os {
 namespace statsd {
@@ -105,6 +107,18 @@ std::optional<SocketLossInfo> toSocketLossInfo(const LogEvent& event) {
         return std::nullopt;
     }
 
+    // the queue high-water mark entry is not a loss, keep it out of the loss entries
+    for (size_t i = 0; i < result.errors.size();) {
+        if (result.errors[i] == kSocketLossQueueHighWaterMarkError) {
+            result.queueHighWaterMark = std::max(result.queueHighWaterMark, result.counts[i]);
+            result.errors.erase(result.errors.begin() + i);
+            result.atomIds.erase(result.atomIds.begin() + i);
+            result.counts.erase(result.counts.begin() + i);
+        } else {
+            i++;
+        }
+    }
+
     return result;
 }
 
@@ -24,11 +24,17 @@ namespace android {
 namespace os {
 namespace statsd {
 
+// libstatssocket reports its writer queue high-water mark as an entry with this error code and
+// the queue size as count. It is not a loss, see StatsSocketLossReporter in libstatssocket
+constexpr int32_t kSocketLossQueueHighWaterMarkError = 2;
+
 struct SocketLossInfo {
     int32_t uid;
     int64_t firstLossTsNanos;
     int64_t lastLossTsNanos;
     int32_t overflowCounter;
+    // max size of the libstatssocket writer queue since the previous report, 0 when not reported
+    int32_t queueHighWaterMark = 0;
 
     std::vector<int32_t> errors;
     std::vector<int32_t> atomIds;
@@ -17,6 +17,7 @@
 #define STATSD_DEBUG false  // STOPSHIP if true
 #include "Log.h"
 
+#include <android-base/parseint.h>
 #include <android/binder_ibinder.h>
 #include <android/binder_ibinder_platform.h>
 #include <android/binder_interface_utils.h>
@@ -29,19 +30,32 @@
 #include <unistd.h>
 #include <utils/Looper.h>
 
+#include <optional>
+#include <vector>
+
 #include "StatsService.h"
 #include "flags/FlagProvider.h"
 #include "packages/UidMap.h"
+#include "socket/StatsRingListener.h"
 #include "socket/StatsSocketListener.h"
+#include "utils/ThreadScheduling.h"
 
 using namespace android;
 using namespace android::os::statsd;
+using android::base::ParseInt;
 using ::ndk::SharedRefBase;
 using std::shared_ptr;
 using std::make_shared;
 
+// Binder threads used unless set by STATSD_BINDER_THREAD_POOL_SIZE_FLAG, which can only raise
+// it up to kMaxBinderThreads.
+constexpr int kDefaultBinderThreads = 9;
+constexpr int kMaxBinderThreads = 32;
+
 shared_ptr<StatsService> gStatsService = nullptr;
-sp<StatsSocketListener> gSocketListener = nullptr;
+// One listener thread per socket of the writers, see StatsSocketListener::kSocketNames.
+std::vector<sp<StatsSocketListener>> gSocketListeners;
+sp<StatsRingListener> gRingListener = nullptr;
 int gCtrlPipe[2];
 
 void signalHandler(int sig) {
@@ -83,12 +97,44 @@ int main(int /*argc*/, char** /*argv*/) {
     // Set up the looper
     sp<Looper> looper(Looper::prepare(0 /* opts */));
 
-    // Set up the binder
-    ABinderProcess_setThreadPoolMaxThreadCount(9);
+    // Initialize boot flags
+    FlagProvider::getInstance().initBootFlags(
+            {STATSD_INIT_COMPLETED_NO_DELAY_FLAG, STATSD_SHARDED_EVENT_PROCESSING_FLAG,
+             STATSD_PARALLEL_PULL_PROCESSING_FLAG, STATSD_CONCURRENT_PULLS_FLAG,
+             STATSD_EARLY_SCHEDULED_PULLS_FLAG, STATSD_PULL_RATE_LIMITING_FLAG,
+             STATSD_NATIVE_PULLERS_FLAG, STATSD_PULL_ALARM_ALIGNMENT_FLAG,
+             STATSD_ASYNC_DISK_WRITES_FLAG, STATSD_COMPRESSED_REPORTS_FLAG,
+             STATSD_DATA_DIR_INDEX_FLAG, STATSD_REPORT_LOGS_FLAG,
+             STATSD_PERSISTENT_DB_CONNECTIONS_FLAG, STATSD_ASYNC_DB_WRITES_FLAG,
+             STATSD_ASYNC_QUERIES_FLAG, STATSD_PARALLEL_MATCHING_FLAG,
+             STATSD_OFF_LOCK_CONFIG_BUILDS_FLAG, STATSD_SOCKET_SHARED_MEMORY_RING_FLAG,
+             STATSD_LOGS_READER_SCHEDULING_FLAG, STATSD_SOCKET_LISTENER_SCHEDULING_FLAG,
+             STATSD_DEFERRED_HOUSEKEEPING_FLAG, STATSD_ASYNC_SUBSCRIBERS_FLAG,
+             STATSD_MEMORY_PRESSURE_MONITOR_FLAG, STATSD_SHARED_CONDITIONS_FLAG,
+             STATSD_SOCKET_DEDUPE_WINDOWS_FLAG, STATSD_BINDER_THREAD_POOL_SIZE_FLAG,
+             STATSD_PULL_RESULT_PRIORITY_FLAG});
+
+    // Set up the binder. The pull results are received on the same threads as the bulk data
+    // calls such as getData, a larger pool keeps them from waiting for a free thread.
+    int binderThreads = kDefaultBinderThreads;
+    const string binderThreadsValue = FlagProvider::getInstance().getBootFlagString(
+            STATSD_BINDER_THREAD_POOL_SIZE_FLAG, FLAG_EMPTY);
+    if (!binderThreadsValue.empty() &&
+        !ParseInt(binderThreadsValue, &binderThreads, kDefaultBinderThreads, kMaxBinderThreads)) {
+        ALOGE("Invalid binder thread pool size: %s", binderThreadsValue.c_str());
+        binderThreads = kDefaultBinderThreads;
+    }
+    ABinderProcess_setThreadPoolMaxThreadCount(binderThreads);
     ABinderProcess_startThreadPool();
 
-    // Initialize boot flags
-    FlagProvider::getInstance().initBootFlags({STATSD_INIT_COMPLETED_NO_DELAY_FLAG});
+    // The socket and the ring listeners both read the events from the clients.
+    const string socketListenerScheduling = FlagProvider::getInstance().getBootFlagString(
+            STATSD_SOCKET_LISTENER_SCHEDULING_FLAG, FLAG_EMPTY);
+    setThreadScheduling(StatsdThread::kSocketListener, socketListenerScheduling);
+    setThreadScheduling(StatsdThread::kRingListener, socketListenerScheduling);
+    setThreadScheduling(StatsdThread::kLogsReader,
+                        FlagProvider::getInstance().getBootFlagString(
+                                STATSD_LOGS_READER_SCHEDULING_FLAG, FLAG_EMPTY));
 
     std::shared_ptr<LogEventQueue> eventQueue =
             std::make_shared<LogEventQueue>(50000); /*buffer limit. Buffer is NOT pre-allocated*/
@@ -124,13 +170,49 @@ int main(int /*argc*/, char** /*argv*/) {
 
     gStatsService->Startup();
 
-    gSocketListener = new StatsSocketListener(eventQueue, logEventFilter);
+    const string dedupeWindowsValue = FlagProvider::getInstance().getBootFlagString(
+            STATSD_SOCKET_DEDUPE_WINDOWS_FLAG, FLAG_EMPTY);
+    const std::optional<AtomDeduper::Windows> dedupeWindows =
+            parseDedupeWindows(dedupeWindowsValue);
+    if (!dedupeWindows) {
+        ALOGE("Invalid socket dedupe windows: %s", dedupeWindowsValue.c_str());
+    }
+    for (const char* socketName : StatsSocketListener::kSocketNames) {
+        gSocketListeners.push_back(new StatsSocketListener(
+                eventQueue, logEventFilter, StatsSocketListener::kDefaultMaxBatchSize,
+                socketName));
+        if (dedupeWindows) {
+            gSocketListeners.back()->setDedupeWindows(*dedupeWindows);
+        }
+    }
 
-    ALOGI("Statsd starts to listen to socket.");
+    if (FlagProvider::getInstance().getBootFlagBool(STATSD_SOCKET_SHARED_MEMORY_RING_FLAG,
+                                                    FLAG_FALSE)) {
+        gRingListener = new StatsRingListener(eventQueue, logEventFilter);
+        gRingListener->startListener();
+        for (const sp<StatsSocketListener>& socketListener : gSocketListeners) {
+            socketListener->setRingListener(gRingListener);
+        }
+    }
+
+    ALOGI("Statsd starts to listen to sockets.");
     // Backlog and /proc/sys/net/unix/max_dgram_qlen set to large value
-    if (gSocketListener->startListener(600)) {
-        exit(1);
+    std::vector<sp<StatsSocketListener>> startedListeners;
+    for (size_t i = 0; i < gSocketListeners.size(); i++) {
+        if (gSocketListeners[i]->startListener(600) == 0) {
+            startedListeners.push_back(gSocketListeners[i]);
+            continue;
+        }
+        const char* socketName = StatsSocketListener::kSocketNames[i];
+        if (i == 0) {
+            // statsdw is the socket of the apps and the fallback of all the other writers
+            ALOGE("Failed to listen to %s", socketName);
+            exit(1);
+        }
+        // libstatssocket falls back to statsdw when the socket of the process class is missing
+        ALOGW("Failed to listen to %s, its writers fall back to statsdw", socketName);
     }
+    gSocketListeners = std::move(startedListeners);
 
     // Use self-pipe to notify this thread to gracefully quit
     // when receiving SIGTERM
@@ -142,7 +224,12 @@ int main(int /*argc*/, char** /*argv*/) {
             if (i < 0) {
                 if (errno == EINTR) continue;
             }
-            gSocketListener->stopListener();
+            for (const sp<StatsSocketListener>& socketListener : gSocketListeners) {
+                socketListener->stopListener();
+            }
+            if (gRingListener != nullptr) {
+                gRingListener->stopListener();
+            }
             gStatsService->Terminate();
             // return the signal handler to its default disposition, then raise the signal again
             signal(SIGTERM, SIG_DFL);
@@ -88,6 +88,14 @@ public:
         return mAtomIds;
     }
 
+    // Indices of the matchers this matcher is combined from, empty for simple matchers.
+    virtual const std::vector<int>& getChildren() const = 0;
+
+    // Makes the matcher reuse the result of an equivalent matcher instead of computing its own,
+    // see computeEquivalentMatchers(). -1 resets it. Only used by combination matchers.
+    virtual void setEquivalentMatcher(int /*equivalentMatcherIndex*/) {
+    }
+
     int64_t getId() const {
         return mId;
     }
@@ -153,6 +153,16 @@ void CombinationAtomMatchingTracker::onLogEvent(
         return;
     }
 
+    if (mEquivalentMatcherIndex >= 0) {
+        if (matcherResults[mEquivalentMatcherIndex] == MatchingState::kNotComputed) {
+            allAtomMatchingTrackers[mEquivalentMatcherIndex]->onLogEvent(
+                    event, mEquivalentMatcherIndex, allAtomMatchingTrackers, matcherResults,
+                    matcherTransformations);
+        }
+        matcherResults[matcherIndex] = matcherResults[mEquivalentMatcherIndex];
+        return;
+    }
+
     // evaluate children matchers if they haven't been evaluated.
     for (const int childIndex : mChildren) {
         if (matcherResults[childIndex] == MatchingState::kNotComputed) {
@@ -47,12 +47,24 @@ public:
                     std::vector<MatchingState>& matcherResults,
                     std::vector<std::shared_ptr<LogEvent>>& matcherTransformations) override;
 
+    const std::vector<int>& getChildren() const override {
+        return mChildren;
+    }
+
+    void setEquivalentMatcher(int equivalentMatcherIndex) override {
+        mEquivalentMatcherIndex = equivalentMatcherIndex;
+    }
+
 private:
     LogicalOperation mLogicalOperation;
 
     std::vector<int> mChildren;
 
+    // Index of the equivalent matcher whose result is reused, or -1 if the children are combined.
+    int mEquivalentMatcherIndex = -1;
+
     FRIEND_TEST(ConfigUpdateTest, TestUpdateMatchers);
+    FRIEND_TEST(MetricsManagerUtilTest, TestComputeEquivalentMatchers);
 };
 
 }  // namespace statsd
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "matchers/EventMatcherCache.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using std::map;
+using std::pair;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Serialized matchers are compared along with the UidMap. Trackers hold a reference to their
+// UidMap, so it can't be replaced by another one at the same address while they are registered.
+typedef pair<const UidMap*, string> MatcherKey;
+
+struct MatcherRegistry {
+    std::mutex mutex;
+    map<MatcherKey, int> sharedIds;
+    // Indexed by shared id.
+    vector<map<MatcherKey, int>::iterator> keys;
+    vector<int> refCounts;
+    vector<int> freeIds;
+};
+
+MatcherRegistry& getRegistry() {
+    static MatcherRegistry* registry = new MatcherRegistry();
+    return *registry;
+}
+
+thread_local EventMatcherCache sThreadCache;
+
+// Shared by the threads, so the ids of the Scopes of all threads differ.
+std::atomic<uint64_t> sLastDispatchId(0);
+
+}  // namespace
+
+int EventMatcherCache::registerMatcher(const sp<UidMap>& uidMap,
+                                       const SimpleAtomMatcher& matcher) {
+    MatcherRegistry& registry = getRegistry();
+    MatcherKey key(uidMap.get(), matcher.SerializeAsString());
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto [it, inserted] = registry.sharedIds.emplace(std::move(key), 0);
+    if (!inserted) {
+        registry.refCounts[it->second]++;
+        return it->second;
+    }
+    if (registry.freeIds.empty()) {
+        it->second = registry.keys.size();
+        registry.keys.push_back(it);
+        registry.refCounts.push_back(1);
+    } else {
+        it->second = registry.freeIds.back();
+        registry.freeIds.pop_back();
+        registry.keys[it->second] = it;
+        registry.refCounts[it->second] = 1;
+    }
+    return it->second;
+}
+
+void EventMatcherCache::unregisterMatcher(const int sharedId) {
+    MatcherRegistry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (--registry.refCounts[sharedId] > 0) {
+        return;
+    }
+    registry.sharedIds.erase(registry.keys[sharedId]);
+    registry.freeIds.push_back(sharedId);
+}
+
+EventMatcherCache* EventMatcherCache::get(const LogEvent& event) {
+    return sThreadCache.mEvent == &event ? &sThreadCache : nullptr;
+}
+
+uint64_t EventMatcherCache::getDispatchId(const LogEvent& event) {
+    return sThreadCache.mEvent == &event ? sThreadCache.mDispatchId : 0;
+}
+
+const EventMatcherCache::Entry* EventMatcherCache::find(const int sharedId) const {
+    if (sharedId >= (int)mEntries.size() ||
+        mEntries[sharedId].state == MatchingState::kNotComputed) {
+        return nullptr;
+    }
+    return &mEntries[sharedId];
+}
+
+void EventMatcherCache::insert(const int sharedId, const MatchingState state,
+                               const shared_ptr<LogEvent>& transformation) {
+    if (sharedId >= (int)mEntries.size()) {
+        mEntries.resize(sharedId + 1);
+    }
+    mEntries[sharedId] = {state, transformation};
+    mInsertedIds.push_back(sharedId);
+}
+
+EventMatcherCache::Scope::Scope(const LogEvent& event)
+    : mCache(sThreadCache.mEvent == nullptr ? &sThreadCache : nullptr) {
+    if (mCache != nullptr) {
+        mCache->mEvent = &event;
+        mCache->mDispatchId = sLastDispatchId.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+}
+
+EventMatcherCache::Scope::~Scope() {
+    if (mCache == nullptr) {
+        return;
+    }
+    for (const int sharedId : mCache->mInsertedIds) {
+        mCache->mEntries[sharedId] = Entry();
+    }
+    mCache->mInsertedIds.clear();
+    mCache->mEvent = nullptr;
+    mCache->mDispatchId = 0;
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "logd/LogEvent.h"
+#include "matchers/matcher_util.h"
+#include "packages/UidMap.h"
+#include "src/statsd_config.pb.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Results of the SimpleAtomMatchers of all configs for the event being dispatched to them.
+ *
+ * Configs often carry identical SimpleAtomMatchers. Each distinct matcher, together with the
+ * UidMap it resolves package names with, is registered once under a shared id. The first
+ * SimpleAtomMatchingTracker to match an event stores its result under the shared id, and the
+ * trackers of the other configs reuse it instead of matching the event again.
+ *
+ * Each thread has its own cache, which is only used for the event of the Scope that exists on the
+ * thread. Other events matched meanwhile, such as pulled atoms, don't use the cache.
+ */
+class EventMatcherCache {
+public:
+    class Scope;
+
+    struct Entry {
+        MatchingState state = MatchingState::kNotComputed;
+        std::shared_ptr<LogEvent> transformation;
+    };
+
+    // Returns the shared id of the matcher, the same for all identical matchers with the same
+    // UidMap. Each call must be balanced by a call to unregisterMatcher().
+    static int registerMatcher(const sp<UidMap>& uidMap, const SimpleAtomMatcher& matcher);
+
+    static void unregisterMatcher(const int sharedId);
+
+    // Cache of the current thread if its Scope is for the event, nullptr otherwise.
+    static EventMatcherCache* get(const LogEvent& event);
+
+    // Id of the Scope of the current thread if it is for the event, 0 otherwise. Each Scope gets
+    // a new id, so an id identifies the dispatch of an event to the configs.
+    static uint64_t getDispatchId(const LogEvent& event);
+
+    // Returns nullptr if no result was stored for the matcher.
+    const Entry* find(const int sharedId) const;
+
+    void insert(const int sharedId, const MatchingState state,
+                const std::shared_ptr<LogEvent>& transformation);
+
+private:
+    const LogEvent* mEvent = nullptr;
+
+    uint64_t mDispatchId = 0;
+
+    // Indexed by shared id.
+    std::vector<Entry> mEntries;
+
+    // Shared ids with a result for mEvent, reset when the Scope ends.
+    std::vector<int> mInsertedIds;
+};
+
+// Makes the cache of the current thread available for the event while it exists. A Scope created
+// while another one exists on the thread does nothing.
+class EventMatcherCache::Scope {
+public:
+    explicit Scope(const LogEvent& event);
+
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    EventMatcherCache* mCache;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
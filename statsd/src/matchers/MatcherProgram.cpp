@@ -0,0 +1,563 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "matchers/MatcherProgram.h"
+
+#include <fnmatch.h>
+
+#include <algorithm>
+
+#include "matchers/matcher_util.h"
+#include "packages/AidMapping.h"
+
+using std::nullopt;
+using std::optional;
+using std::string;
+using std::vector;
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+// INT and LONG values are both matched by the int matchers.
+inline bool getIntegerValue(const Value& value, int64_t* out) {
+    switch (value.getType()) {
+        case INT:
+            *out = value.int_value;
+            return true;
+        case LONG:
+            *out = value.long_value;
+            return true;
+        default:
+            return false;
+    }
+}
+
+inline int32_t getSegmentShift(int depth) {
+    return 8 * (kMaxLogDepth - depth);
+}
+
+}  // namespace
+
+optional<MatcherProgram> MatcherProgram::compile(const SimpleAtomMatcher& matcher) {
+    MatcherProgram program;
+    program.mAtomId = matcher.atom_id();
+    for (const FieldValueMatcher& fvm : matcher.field_value_matcher()) {
+        if (!program.compileFieldValueMatcher(fvm, 0 /* depth */)) {
+            return nullopt;
+        }
+    }
+    return program;
+}
+
+uint32_t MatcherProgram::internString(const string& str) {
+    for (uint32_t i = 0; i < mStrings.size(); i++) {
+        if (mStrings[i] == str) {
+            return i;
+        }
+    }
+    mStrings.push_back(str);
+    return mStrings.size() - 1;
+}
+
+void MatcherProgram::addStringOperand(const string& str, bool isWildcard) {
+    mStringRefs.push_back(internString(str));
+    UidMatchSet uidMatchSet;
+    uidMatchSet.isWildcard = isWildcard;
+    mUidMatchSets.push_back(std::move(uidMatchSet));
+}
+
+bool MatcherProgram::compileFieldValueMatcher(const FieldValueMatcher& matcher, int depth) {
+    if (matcher.has_replace_string()) {
+        return false;
+    }
+
+    const uint32_t pc = mInstructions.size();
+    mInstructions.emplace_back();
+
+    Instruction inst = {};
+    inst.opcode = kAlwaysFalse;
+    inst.position = kNoPosition;
+
+    // Positions are 7 bits at each depth, so a field outside of that range is never found. The
+    // proto path does not match anything below kMaxLogDepth either.
+    const int32_t field = matcher.field();
+    bool reachable = depth <= kMaxLogDepth && field >= 0 && field <= kClearLastBitDeco;
+    int childDepth = depth + 1;
+    if (reachable) {
+        inst.fieldMask = kClearLastBitDeco << getSegmentShift(depth);
+        inst.fieldValue = field << getSegmentShift(depth);
+    }
+    if (reachable && matcher.has_position()) {
+        // Repeated fields position is stored as a node in the path.
+        childDepth++;
+        reachable = depth + 1 <= kMaxLogDepth;
+        const int32_t shift = reachable ? getSegmentShift(depth + 1) : 0;
+        switch (matcher.position()) {
+            case Position::FIRST:
+                inst.position = kFirst;
+                inst.positionMask = kClearLastBitDeco << shift;
+                inst.firstPosition = 1 << shift;
+                break;
+            case Position::LAST:
+                inst.position = kLast;
+                inst.positionMask = kLastBitMask << shift;
+                break;
+            case Position::ALL:
+            case Position::ANY:
+                inst.position = kAny;
+                inst.positionMask = kClearLastBitDeco << shift;
+                break;
+            default:
+                reachable = false;
+                break;
+        }
+    }
+
+    if (reachable) {
+        switch (matcher.value_matcher_case()) {
+            case FieldValueMatcher::kMatchesTuple:
+                inst.opcode = kMatchesTuple;
+                for (const FieldValueMatcher& child :
+                     matcher.matches_tuple().field_value_matcher()) {
+                    if (!compileFieldValueMatcher(child, childDepth)) {
+                        return false;
+                    }
+                }
+                break;
+            case FieldValueMatcher::kEqBool:
+                inst.opcode = kEqBool;
+                inst.operand = mInts.size();
+                inst.operandCount = 1;
+                mInts.push_back(matcher.eq_bool());
+                break;
+            case FieldValueMatcher::kEqString:
+                inst.opcode = kEqString;
+                inst.operand = mStringRefs.size();
+                inst.operandCount = 1;
+                addStringOperand(matcher.eq_string(), false /* isWildcard */);
+                break;
+            case FieldValueMatcher::kEqWildcardString:
+                inst.opcode = kEqWildcardString;
+                inst.operand = mStringRefs.size();
+                inst.operandCount = 1;
+                addStringOperand(matcher.eq_wildcard_string(), true /* isWildcard */);
+                break;
+            case FieldValueMatcher::kEqAnyString:
+            case FieldValueMatcher::kNeqAnyString:
+            case FieldValueMatcher::kEqAnyWildcardString:
+            case FieldValueMatcher::kNeqAnyWildcardString: {
+                const StringListMatcher* strList;
+                switch (matcher.value_matcher_case()) {
+                    case FieldValueMatcher::kEqAnyString:
+                        inst.opcode = kEqAnyString;
+                        strList = &matcher.eq_any_string();
+                        break;
+                    case FieldValueMatcher::kNeqAnyString:
+                        inst.opcode = kNeqAnyString;
+                        strList = &matcher.neq_any_string();
+                        break;
+                    case FieldValueMatcher::kEqAnyWildcardString:
+                        inst.opcode = kEqAnyWildcardString;
+                        strList = &matcher.eq_any_wildcard_string();
+                        break;
+                    default:
+                        inst.opcode = kNeqAnyWildcardString;
+                        strList = &matcher.neq_any_wildcard_string();
+                        break;
+                }
+                inst.operand = mStringRefs.size();
+                inst.operandCount = strList->str_value_size();
+                const bool isWildcard = inst.opcode == kEqAnyWildcardString ||
+                                        inst.opcode == kNeqAnyWildcardString;
+                for (const string& str : strList->str_value()) {
+                    addStringOperand(str, isWildcard);
+                }
+                break;
+            }
+            case FieldValueMatcher::kEqAnyInt:
+            case FieldValueMatcher::kNeqAnyInt: {
+                const IntListMatcher& intList =
+                        matcher.value_matcher_case() == FieldValueMatcher::kEqAnyInt
+                                ? matcher.eq_any_int()
+                                : matcher.neq_any_int();
+                inst.opcode = matcher.value_matcher_case() == FieldValueMatcher::kEqAnyInt
+                                      ? kEqAnyInt
+                                      : kNeqAnyInt;
+                inst.operand = mInts.size();
+                inst.operandCount = intList.int_value_size();
+                for (const int64_t value : intList.int_value()) {
+                    // matchesSimple() compares the list values as int.
+                    mInts.push_back((int)value);
+                }
+                break;
+            }
+            case FieldValueMatcher::kEqInt:
+            case FieldValueMatcher::kLtInt:
+            case FieldValueMatcher::kGtInt:
+            case FieldValueMatcher::kLteInt:
+            case FieldValueMatcher::kGteInt:
+                inst.operand = mInts.size();
+                inst.operandCount = 1;
+                switch (matcher.value_matcher_case()) {
+                    case FieldValueMatcher::kEqInt:
+                        inst.opcode = kEqInt;
+                        mInts.push_back(matcher.eq_int());
+                        break;
+                    case FieldValueMatcher::kLtInt:
+                        inst.opcode = kLtInt;
+                        mInts.push_back(matcher.lt_int());
+                        break;
+                    case FieldValueMatcher::kGtInt:
+                        inst.opcode = kGtInt;
+                        mInts.push_back(matcher.gt_int());
+                        break;
+                    case FieldValueMatcher::kLteInt:
+                        inst.opcode = kLteInt;
+                        mInts.push_back(matcher.lte_int());
+                        break;
+                    default:
+                        inst.opcode = kGteInt;
+                        mInts.push_back(matcher.gte_int());
+                        break;
+                }
+                break;
+            case FieldValueMatcher::kLtFloat:
+                inst.opcode = kLtFloat;
+                inst.operand = mFloats.size();
+                inst.operandCount = 1;
+                mFloats.push_back(matcher.lt_float());
+                break;
+            case FieldValueMatcher::kGtFloat:
+                inst.opcode = kGtFloat;
+                inst.operand = mFloats.size();
+                inst.operandCount = 1;
+                mFloats.push_back(matcher.gt_float());
+                break;
+            default:
+                inst.opcode = kNoValueMatcher;
+                break;
+        }
+    }
+
+    inst.next = mInstructions.size();
+    mInstructions[pc] = inst;
+    return true;
+}
+
+const vector<int32_t>& MatcherProgram::getUidMatchSet(const UidMap& uidMap,
+                                                      uint32_t stringRef) const {
+    // Read the generation before looking up the apps, so that an update racing with the rebuild
+    // triggers another rebuild on the next lookup.
+    const uint64_t appsGeneration = uidMap.getAppsGeneration();
+    if (&uidMap != mUidMatchSetsUidMap || appsGeneration != mUidMatchSetsGeneration) {
+        for (UidMatchSet& uidMatchSet : mUidMatchSets) {
+            uidMatchSet.valid = false;
+        }
+        mUidMatchSetsUidMap = &uidMap;
+        mUidMatchSetsGeneration = appsGeneration;
+    }
+
+    UidMatchSet& uidMatchSet = mUidMatchSets[stringRef];
+    if (uidMatchSet.valid) {
+        return uidMatchSet.uids;
+    }
+
+    const string& str = mStrings[mStringRefs[stringRef]];
+    vector<int32_t>& uids = uidMatchSet.uids;
+    if (!uidMatchSet.isWildcard) {
+        const optional<int32_t> aidUid = AidMapping::getUid(str);
+        if (aidUid) {
+            uids = {*aidUid};
+        } else {
+            uids = uidMap.getUidsWithApp(str, false /* isWildcard */);
+        }
+    } else {
+        // Same as tryMatchWildcardString(): AIDs are only matched by their name, all other uids
+        // by the names of their apps.
+        uids.clear();
+        for (const int32_t uid : uidMap.getUidsWithApp(str, true /* isWildcard */)) {
+            if (AidMapping::getName(uid).empty()) {
+                uids.push_back(uid);
+            }
+        }
+        for (const AidEntry& aid : AidMapping::getAids()) {
+            if (fnmatch(str.c_str(), aid.name.data(), 0) == 0) {
+                uids.push_back(aid.uid);
+            }
+        }
+        std::sort(uids.begin(), uids.end());
+    }
+    uidMatchSet.valid = true;
+    return uids;
+}
+
+bool MatcherProgram::matchString(const UidMap& uidMap, const Instruction& inst, uint32_t index,
+                                 const FieldValue& fieldValue) const {
+    const uint32_t stringRef = inst.operand + index;
+    if (isAttributionUidField(fieldValue) || isUidField(fieldValue)) {
+        const vector<int32_t>& uids = getUidMatchSet(uidMap, stringRef);
+        return std::binary_search(uids.begin(), uids.end(), fieldValue.mValue.int_value);
+    } else if (fieldValue.mValue.getType() == STRING) {
+        const string& str = mStrings[mStringRefs[stringRef]];
+        if (mUidMatchSets[stringRef].isWildcard) {
+            return fnmatch(str.c_str(), fieldValue.mValue.str_value.c_str(), 0) == 0;
+        }
+        return fieldValue.mValue.str_value == str;
+    }
+    return false;
+}
+
+bool MatcherProgram::matches(const sp<UidMap>& uidMap, const LogEvent& event) const {
+    if (event.GetTagId() != mAtomId) {
+        return false;
+    }
+
+    const vector<FieldValue>& values = event.getValues();
+    for (uint32_t pc = 0; pc < mInstructions.size(); pc = mInstructions[pc].next) {
+        if (!run(uidMap, pc, values, 0, values.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MatcherProgram::runChildren(const sp<UidMap>& uidMap, uint32_t pc,
+                                 const vector<FieldValue>& values, int start, int end) const {
+    for (uint32_t child = pc + 1; child < mInstructions[pc].next;
+         child = mInstructions[child].next) {
+        if (!run(uidMap, child, values, start, end)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MatcherProgram::run(const sp<UidMap>& uidMap, uint32_t pc, const vector<FieldValue>& values,
+                         int start, int end) const {
+    const Instruction& inst = mInstructions[pc];
+    if (start >= end || inst.opcode == kAlwaysFalse) {
+        return false;
+    }
+
+    // Values are sorted in the DFS order, so the selected values are contiguous and we can stop at
+    // the first value past the matcher field.
+    int newStart = -1;
+    int newEnd = end;
+    for (int i = start; i < end; i++) {
+        const int32_t pos = values[i].mField.getField() & inst.fieldMask;
+        if (pos == inst.fieldValue) {
+            if (newStart == -1) {
+                newStart = i;
+            }
+            newEnd = i + 1;
+        } else if (pos > inst.fieldValue) {
+            break;
+        }
+    }
+    if (newStart == -1) {
+        return false;
+    }
+    start = newStart;
+    end = newEnd;
+
+    switch (inst.position) {
+        case kFirst:
+            for (int i = start; i < end; i++) {
+                if ((values[i].mField.getField() & inst.positionMask) != inst.firstPosition) {
+                    end = i;
+                    break;
+                }
+            }
+            break;
+        case kLast:
+            for (int i = start; i < end; i++) {
+                if ((values[i].mField.getField() & inst.positionMask) != 0) {
+                    start = i;
+                    break;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (inst.opcode != kMatchesTuple) {
+        return matchValues(uidMap, inst, values, start, end);
+    }
+    if (inst.position != kAny) {
+        return runChildren(uidMap, pc, values, start, end);
+    }
+
+    // For ANY with matches_tuple, if all the children match in any of the sub trees, it's a match.
+    int rangeStart = start;
+    int32_t currentPos = values[start].mField.getField() & inst.positionMask;
+    for (int i = start; i < end; i++) {
+        const int32_t pos = values[i].mField.getField() & inst.positionMask;
+        if (pos != currentPos) {
+            if (runChildren(uidMap, pc, values, rangeStart, i)) {
+                return true;
+            }
+            rangeStart = i;
+            currentPos = pos;
+        }
+    }
+    return runChildren(uidMap, pc, values, rangeStart, end);
+}
+
+bool MatcherProgram::matchValues(const sp<UidMap>& uidMap, const Instruction& inst,
+                                 const vector<FieldValue>& values, int start, int end) const {
+    int64_t intValue;
+
+    // If the field matcher ends with ANY, then we have [start, end) range > 1.
+    // In the following, we should return true, when ANY of the values matches.
+    switch (inst.opcode) {
+        case kEqBool:
+            for (int i = start; i < end; i++) {
+                if (getIntegerValue(values[i].mValue, &intValue) &&
+                    (intValue != 0) == (mInts[inst.operand] != 0)) {
+                    return true;
+                }
+            }
+            return false;
+        case kEqInt:
+            for (int i = start; i < end; i++) {
+                if (getIntegerValue(values[i].mValue, &intValue) &&
+                    intValue == mInts[inst.operand]) {
+                    return true;
+                }
+            }
+            return false;
+        case kLtInt:
+            for (int i = start; i < end; i++) {
+                if (getIntegerValue(values[i].mValue, &intValue) &&
+                    intValue < mInts[inst.operand]) {
+                    return true;
+                }
+            }
+            return false;
+        case kGtInt:
+            for (int i = start; i < end; i++) {
+                if (getIntegerValue(values[i].mValue, &intValue) &&
+                    intValue > mInts[inst.operand]) {
+                    return true;
+                }
+            }
+            return false;
+        case kLteInt:
+            for (int i = start; i < end; i++) {
+                if (getIntegerValue(values[i].mValue, &intValue) &&
+                    intValue <= mInts[inst.operand]) {
+                    return true;
+                }
+            }
+            return false;
+        case kGteInt:
+            for (int i = start; i < end; i++) {
+                if (getIntegerValue(values[i].mValue, &intValue) &&
+                    intValue >= mInts[inst.operand]) {
+                    return true;
+                }
+            }
+            return false;
+        case kEqAnyInt:
+            for (int i = start; i < end; i++) {
+                if (!getIntegerValue(values[i].mValue, &intValue)) {
+                    continue;
+                }
+                for (uint32_t j = 0; j < inst.operandCount; j++) {
+                    if (intValue == mInts[inst.operand + j]) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        case kNeqAnyInt:
+            for (int i = start; i < end; i++) {
+                if (!getIntegerValue(values[i].mValue, &intValue)) {
+                    // Values that are not integers are not equal to any of the list.
+                    return true;
+                }
+                bool notEqAll = true;
+                for (uint32_t j = 0; j < inst.operandCount; j++) {
+                    if (intValue == mInts[inst.operand + j]) {
+                        notEqAll = false;
+                        break;
+                    }
+                }
+                if (notEqAll) {
+                    return true;
+                }
+            }
+            return false;
+        case kLtFloat:
+            for (int i = start; i < end; i++) {
+                if (values[i].mValue.getType() == FLOAT &&
+                    values[i].mValue.float_value < mFloats[inst.operand]) {
+                    return true;
+                }
+            }
+            return false;
+        case kGtFloat:
+            for (int i = start; i < end; i++) {
+                if (values[i].mValue.getType() == FLOAT &&
+                    values[i].mValue.float_value > mFloats[inst.operand]) {
+                    return true;
+                }
+            }
+            return false;
+        case kEqString:
+        case kEqAnyString:
+        case kEqWildcardString:
+        case kEqAnyWildcardString:
+            for (int i = start; i < end; i++) {
+                for (uint32_t j = 0; j < inst.operandCount; j++) {
+                    if (matchString(*uidMap, inst, j, values[i])) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        case kNeqAnyString:
+        case kNeqAnyWildcardString:
+            for (int i = start; i < end; i++) {
+                bool notEqAll = true;
+                for (uint32_t j = 0; j < inst.operandCount; j++) {
+                    if (matchString(*uidMap, inst, j, values[i])) {
+                        notEqAll = false;
+                        break;
+                    }
+                }
+                if (notEqAll) {
+                    return true;
+                }
+            }
+            return false;
+        case kNoValueMatcher:
+            // Same as matchesSimple(), a matcher without value_matcher matches.
+            return true;
+        default:
+            return false;
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "FieldValue.h"
+#include "logd/LogEvent.h"
+#include "packages/UidMap.h"
+#include "src/statsd_config.pb.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * SimpleAtomMatcher compiled into a flat program.
+ *
+ * Every FieldValueMatcher of the config becomes one Instruction, laid out in pre-order so that the
+ * children of a matches_tuple directly follow their parent and each instruction knows where its
+ * subtree ends. The field selection at each depth is precomputed into a mask/value pair applied to
+ * the encoded Field, and all constants live in flat pools referenced by index. Evaluating the
+ * program gives the same result as matchesSimple() on the proto without walking the proto tree or
+ * allocating.
+ *
+ * String matchers applied to uid fields are evaluated against the set of uids whose apps (or aid
+ * names) match each string. The sets are built on first use and rebuilt lazily after the UidMap
+ * apps change, so matching a uid is a binary search that doesn't take the UidMap lock. This cache
+ * makes matches() not thread safe, it must be called with the owning tracker's lock held.
+ *
+ * String transformations are not supported: compile() returns nullopt for matchers that have a
+ * replace_string anywhere, and those keep using matchesSimple().
+ */
+class MatcherProgram {
+public:
+    static std::optional<MatcherProgram> compile(const SimpleAtomMatcher& matcher);
+
+    bool matches(const sp<UidMap>& uidMap, const LogEvent& event) const;
+
+    inline size_t getInstructionsCount() const {
+        return mInstructions.size();
+    }
+
+private:
+    enum Opcode : uint8_t {
+        kAlwaysFalse,
+        kMatchesTuple,
+        kEqBool,
+        kEqString,
+        kEqAnyString,
+        kNeqAnyString,
+        kEqWildcardString,
+        kEqAnyWildcardString,
+        kNeqAnyWildcardString,
+        kEqInt,
+        kEqAnyInt,
+        kNeqAnyInt,
+        kLtInt,
+        kGtInt,
+        kLteInt,
+        kGteInt,
+        kLtFloat,
+        kGtFloat,
+        kNoValueMatcher,
+    };
+
+    enum PositionOp : uint8_t {
+        kNoPosition,
+        kFirst,
+        kLast,
+        // Position::ANY and Position::ALL
+        kAny,
+    };
+
+    struct Instruction {
+        Opcode opcode;
+        PositionOp position;
+        // Selects the values whose position at the matcher depth equals the matcher field.
+        int32_t fieldMask;
+        int32_t fieldValue;
+        // Position segment one level below the matcher depth, used when position is set.
+        int32_t positionMask;
+        int32_t firstPosition;
+        // Index of the first constant in the pool for the opcode & number of constants.
+        uint32_t operand;
+        uint32_t operandCount;
+        // Index of the instruction following this instruction's subtree.
+        uint32_t next;
+    };
+
+    // Sorted uids matched by a string operand, valid for mUidMatchSetsGeneration.
+    struct UidMatchSet {
+        bool isWildcard = false;
+        bool valid = false;
+        std::vector<int32_t> uids;
+    };
+
+    MatcherProgram() = default;
+
+    bool compileFieldValueMatcher(const FieldValueMatcher& matcher, int depth);
+
+    uint32_t internString(const std::string& str);
+
+    void addStringOperand(const std::string& str, bool isWildcard);
+
+    const std::vector<int32_t>& getUidMatchSet(const UidMap& uidMap, uint32_t stringRef) const;
+
+    bool matchString(const UidMap& uidMap, const Instruction& inst, uint32_t index,
+                     const FieldValue& fieldValue) const;
+
+    bool run(const sp<UidMap>& uidMap, uint32_t pc, const std::vector<FieldValue>& values,
+             int start, int end) const;
+
+    bool runChildren(const sp<UidMap>& uidMap, uint32_t pc, const std::vector<FieldValue>& values,
+                     int start, int end) const;
+
+    bool matchValues(const sp<UidMap>& uidMap, const Instruction& inst,
+                     const std::vector<FieldValue>& values, int start, int end) const;
+
+    int32_t mAtomId = 0;
+
+    std::vector<Instruction> mInstructions;
+
+    std::vector<int64_t> mInts;
+
+    std::vector<float> mFloats;
+
+    // Interned strings. Lists of strings are stored as runs of indices in mStringRefs.
+    std::vector<std::string> mStrings;
+
+    std::vector<uint32_t> mStringRefs;
+
+    // Parallel to mStringRefs.
+    mutable std::vector<UidMatchSet> mUidMatchSets;
+
+    // UidMap & apps generation the valid entries of mUidMatchSets were built from.
+    mutable const UidMap* mUidMatchSetsUidMap = nullptr;
+
+    mutable uint64_t mUidMatchSetsGeneration = 0;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -19,6 +19,8 @@
 
 #include "SimpleAtomMatchingTracker.h"
 
+#include "EventMatcherCache.h"
+
 namespace android {
 namespace os {
 namespace statsd {
@@ -30,7 +32,12 @@ using std::vector;
 SimpleAtomMatchingTracker::SimpleAtomMatchingTracker(const int64_t id, const uint64_t protoHash,
                                                      const SimpleAtomMatcher& matcher,
                                                      const sp<UidMap>& uidMap)
-    : AtomMatchingTracker(id, protoHash), mMatcher(matcher), mUidMap(uidMap) {
+    : AtomMatchingTracker(id, protoHash),
+      mMatcher(matcher),
+      mUidMap(uidMap),
+      mProgram(MatcherProgram::compile(matcher)),
+      mRegexCache(compileRegexes(mMatcher)),
+      mSharedMatcherId(EventMatcherCache::registerMatcher(uidMap, matcher)) {
     if (!matcher.has_atom_id()) {
         mInitialized = false;
     } else {
@@ -40,6 +47,7 @@ SimpleAtomMatchingTracker::SimpleAtomMatchingTracker(const int64_t id, const uin
 }
 
 SimpleAtomMatchingTracker::~SimpleAtomMatchingTracker() {
+    EventMatcherCache::unregisterMatcher(mSharedMatcherId);
 }
 
 MatcherInitResult SimpleAtomMatchingTracker::init(
@@ -90,13 +98,40 @@ void SimpleAtomMatchingTracker::onLogEvent(
         return;
     }
 
-    auto [matched, transformedEvent] = matchesSimple(mUidMap, mMatcher, event);
+    // Another config may already have matched the event against an identical matcher.
+    EventMatcherCache* cache = EventMatcherCache::get(event);
+    if (cache != nullptr) {
+        if (const EventMatcherCache::Entry* entry = cache->find(mSharedMatcherId)) {
+            matcherResults[matcherIndex] = entry->state;
+            matcherTransformations[matcherIndex] = entry->transformation;
+            VLOG("Stats SimpleAtomMatcher %lld matched? %d (shared)", (long long)mId,
+                 entry->state == MatchingState::kMatched);
+            return;
+        }
+    }
+
+    if (mProgram) {
+        const bool matched = mProgram->matches(mUidMap, event);
+        matcherResults[matcherIndex] =
+                matched ? MatchingState::kMatched : MatchingState::kNotMatched;
+        VLOG("Stats SimpleAtomMatcher %lld matched? %d", (long long)mId, matched);
+        if (cache != nullptr) {
+            cache->insert(mSharedMatcherId, matcherResults[matcherIndex], nullptr);
+        }
+        return;
+    }
+
+    auto [matched, transformedEvent] = matchesSimple(mUidMap, mMatcher, event, &mRegexCache);
     matcherResults[matcherIndex] = matched ? MatchingState::kMatched : MatchingState::kNotMatched;
     VLOG("Stats SimpleAtomMatcher %lld matched? %d", (long long)mId, matched);
 
     if (matched && transformedEvent != nullptr) {
         matcherTransformations[matcherIndex] = std::move(transformedEvent);
     }
+    if (cache != nullptr) {
+        cache->insert(mSharedMatcherId, matcherResults[matcherIndex],
+                      matcherTransformations[matcherIndex]);
+    }
 }
 
 }  // namespace statsd
@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "AtomMatchingTracker.h"
+#include "MatcherProgram.h"
 #include "src/statsd_config.pb.h"
 #include "packages/UidMap.h"
 
@@ -49,9 +50,24 @@ public:
                     std::vector<MatchingState>& matcherResults,
                     std::vector<std::shared_ptr<LogEvent>>& matcherTransformations) override;
 
+    const std::vector<int>& getChildren() const override {
+        static const std::vector<int> kNoChildren;
+        return kNoChildren;
+    }
+
 private:
     const SimpleAtomMatcher mMatcher;
     const sp<UidMap> mUidMap;
+
+    // mMatcher compiled at config load. Not set if mMatcher has string transformations, in which
+    // case the events are matched against the proto.
+    const std::optional<MatcherProgram> mProgram;
+
+    // Compiled regexes of the string transformations in mMatcher.
+    const RegexCache mRegexCache;
+
+    // Id of mMatcher in the EventMatcherCache, shared with the identical matchers of other configs.
+    const int mSharedMatcherId;
 };
 
 }  // namespace statsd
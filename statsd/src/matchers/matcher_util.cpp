@@ -21,12 +21,15 @@
 #include <fnmatch.h>
 
 #include "matchers/AtomMatchingTracker.h"
+#include "packages/AidMapping.h"
 #include "src/statsd_config.pb.h"
 #include "stats_util.h"
 #include "utils/Regex.h"
 
+using std::optional;
 using std::set;
 using std::string;
+using std::string_view;
 using std::unique_ptr;
 using std::vector;
 
@@ -86,13 +89,13 @@ bool combinationMatch(const vector<int>& children, const LogicalOperation& opera
     return matched;
 }
 
-static bool tryMatchString(const sp<UidMap>& uidMap, const FieldValue& fieldValue,
-                           const string& str_match) {
+bool tryMatchString(const sp<UidMap>& uidMap, const FieldValue& fieldValue,
+                    const string& str_match) {
     if (isAttributionUidField(fieldValue) || isUidField(fieldValue)) {
         int uid = fieldValue.mValue.int_value;
-        auto aidIt = UidMap::sAidToUidMapping.find(str_match);
-        if (aidIt != UidMap::sAidToUidMapping.end()) {
-            return ((int)aidIt->second) == uid;
+        const optional<int32_t> aidUid = AidMapping::getUid(str_match);
+        if (aidUid) {
+            return *aidUid == uid;
         }
         return uidMap->hasApp(uid, str_match);
     } else if (fieldValue.mValue.getType() == STRING) {
@@ -101,55 +104,86 @@ static bool tryMatchString(const sp<UidMap>& uidMap, const FieldValue& fieldValu
     return false;
 }
 
-static bool tryMatchWildcardString(const sp<UidMap>& uidMap, const FieldValue& fieldValue,
-                                   const string& wildcardPattern) {
+bool tryMatchWildcardString(const sp<UidMap>& uidMap, const FieldValue& fieldValue,
+                            const string& wildcardPattern) {
     if (isAttributionUidField(fieldValue) || isUidField(fieldValue)) {
         int uid = fieldValue.mValue.int_value;
-        // TODO(b/236886985): replace aid/uid mapping with efficient bidirectional container
-        // AidToUidMapping will never have uids above 10000
-        if (uid < 10000) {
-            for (auto aidIt = UidMap::sAidToUidMapping.begin();
-                 aidIt != UidMap::sAidToUidMapping.end(); ++aidIt) {
-                if ((int)aidIt->second == uid) {
-                    // Assumes there is only one aid mapping for each uid
-                    return fnmatch(wildcardPattern.c_str(), aidIt->first.c_str(), 0) == 0;
-                }
-            }
-        }
-        std::set<string> packageNames = uidMap->getAppNamesFromUid(uid, false /* normalize*/);
-        for (const auto& packageName : packageNames) {
-            if (fnmatch(wildcardPattern.c_str(), packageName.c_str(), 0) == 0) {
-                return true;
-            }
+        const string_view aidName = AidMapping::getName(uid);
+        if (!aidName.empty()) {
+            // The AID names are string literals, so they are null terminated.
+            return fnmatch(wildcardPattern.c_str(), aidName.data(), 0) == 0;
         }
+        return uidMap->hasAppMatching(uid, wildcardPattern);
     } else if (fieldValue.mValue.getType() == STRING) {
         return fnmatch(wildcardPattern.c_str(), fieldValue.mValue.str_value.c_str(), 0) == 0;
     }
     return false;
 }
 
+static void compileRegexes(const FieldValueMatcher& matcher, RegexCache& regexCache) {
+    if (matcher.has_replace_string()) {
+        regexCache[&matcher] = Regex::create(matcher.replace_string().regex());
+    }
+    if (matcher.value_matcher_case() == FieldValueMatcher::kMatchesTuple) {
+        for (const auto& subMatcher : matcher.matches_tuple().field_value_matcher()) {
+            compileRegexes(subMatcher, regexCache);
+        }
+    }
+}
+
+RegexCache compileRegexes(const SimpleAtomMatcher& simpleMatcher) {
+    RegexCache regexCache;
+    for (const auto& matcher : simpleMatcher.field_value_matcher()) {
+        compileRegexes(matcher, regexCache);
+    }
+    return regexCache;
+}
+
+// Applies the string replacement of the matcher to transformedEvent, or to a copy of event if no
+// matcher transformed it yet. Earlier transformations are kept, and the event is copied at most
+// once per simple matcher.
 static unique_ptr<LogEvent> getTransformedEvent(const FieldValueMatcher& matcher,
-                                                const LogEvent& event, int start, int end) {
+                                                const RegexCache* regexCache,
+                                                const LogEvent& event,
+                                                unique_ptr<LogEvent> transformedEvent, int start,
+                                                int end) {
     if (!matcher.has_replace_string()) {
-        return nullptr;
+        return transformedEvent;
     }
 
-    unique_ptr<Regex> re = Regex::create(matcher.replace_string().regex());
+    const Regex* re = nullptr;
+    bool cached = false;
+    if (regexCache != nullptr) {
+        const auto it = regexCache->find(&matcher);
+        if (it != regexCache->end()) {
+            re = it->second.get();
+            cached = true;
+        }
+    }
+    unique_ptr<Regex> ownedRe;
+    if (!cached) {
+        ownedRe = Regex::create(matcher.replace_string().regex());
+        re = ownedRe.get();
+    }
 
     if (re == nullptr) {
-        return nullptr;
+        return transformedEvent;
     }
 
     const string& replacement = matcher.replace_string().replacement();
-    unique_ptr<LogEvent> transformedEvent = nullptr;
     for (int i = start; i < end; i++) {
-        const LogEvent& eventRef = transformedEvent == nullptr ? event : *transformedEvent;
-        const FieldValue& fieldValue = eventRef.getValues()[i];
+        const FieldValue& fieldValue = transformedEvent == nullptr
+                                               ? event.getValues()[i]
+                                               : transformedEvent->getValues()[i];
         if (fieldValue.mValue.getType() != STRING) {
             continue;
         }
-        string str = fieldValue.mValue.str_value;
-        if (!re->replace(str, replacement) || str == fieldValue.mValue.str_value) {
+        const string& str = fieldValue.mValue.str_value;
+        size_t matchStart;
+        size_t matchEnd;
+        if (!re->search(str, &matchStart, &matchEnd) ||
+            str.compare(matchStart, matchEnd - matchStart, replacement) == 0) {
+            // No string transformation, no need to copy the string nor the event.
             continue;
         }
 
@@ -157,7 +191,9 @@ static unique_ptr<LogEvent> getTransformedEvent(const FieldValueMatcher& matcher
         if (transformedEvent == nullptr) {
             transformedEvent = std::make_unique<LogEvent>(event);
         }
-        (*transformedEvent->getMutableValues())[i].mValue.str_value = str;
+        string transformedStr = str;
+        transformedStr.replace(matchStart, matchEnd - matchStart, replacement);
+        (*transformedEvent->getMutableValues())[i].mValue.str_value = std::move(transformedStr);
     }
     return transformedEvent;
 }
@@ -283,30 +319,36 @@ static vector<pair<int, int>> computeRanges(const FieldValueMatcher& matcher,
     return ranges;
 }
 
+// Matches the values of transformedEvent, or of event if it was not transformed yet. The returned
+// transformedEvent includes the transformations of this matcher and of the previous ones.
 static MatchResult matchesSimple(const sp<UidMap>& uidMap, const FieldValueMatcher& matcher,
-                                 const LogEvent& event, int start, int end, int depth) {
+                                 const RegexCache* regexCache, const LogEvent& event,
+                                 unique_ptr<LogEvent> transformedEvent, int start, int end,
+                                 int depth) {
     if (depth > 2) {
         ALOGE("Depth >= 3 not supported");
-        return {false, nullptr};
+        return {false, std::move(transformedEvent)};
     }
 
     if (start >= end) {
-        return {false, nullptr};
+        return {false, std::move(transformedEvent)};
     }
 
-    const vector<pair<int, int>> ranges =
-            computeRanges(matcher, event.getValues(), start, end, depth);
+    const vector<FieldValue>& inputValues =
+            transformedEvent == nullptr ? event.getValues() : transformedEvent->getValues();
+    const vector<pair<int, int>> ranges = computeRanges(matcher, inputValues, start, end, depth);
 
     if (ranges.empty()) {
         // No such field found.
-        return {false, nullptr};
+        return {false, std::move(transformedEvent)};
     }
 
     // ranges should have exactly one start/end pair at this point unless position is ANY and
     // value_matcher is matches_tuple.
     std::tie(start, end) = ranges[0];
 
-    unique_ptr<LogEvent> transformedEvent = getTransformedEvent(matcher, event, start, end);
+    transformedEvent = getTransformedEvent(matcher, regexCache, event, std::move(transformedEvent),
+                                           start, end);
 
     const vector<FieldValue>& values =
             transformedEvent == nullptr ? event.getValues() : transformedEvent->getValues();
@@ -319,13 +361,10 @@ static MatchResult matchesSimple(const sp<UidMap>& uidMap, const FieldValueMatch
             for (const auto& [rangeStart, rangeEnd] : ranges) {
                 bool matched = true;
                 for (const auto& subMatcher : matcher.matches_tuple().field_value_matcher()) {
-                    const LogEvent& eventRef =
-                            transformedEvent == nullptr ? event : *transformedEvent;
-                    auto [hasMatched, newTransformedEvent] = matchesSimple(
-                            uidMap, subMatcher, eventRef, rangeStart, rangeEnd, depth);
-                    if (newTransformedEvent != nullptr) {
-                        transformedEvent = std::move(newTransformedEvent);
-                    }
+                    auto [hasMatched, newTransformedEvent] =
+                            matchesSimple(uidMap, subMatcher, regexCache, event,
+                                          std::move(transformedEvent), rangeStart, rangeEnd, depth);
+                    transformedEvent = std::move(newTransformedEvent);
                     if (!hasMatched) {
                         matched = false;
                     }
@@ -556,19 +595,17 @@ static MatchResult matchesSimple(const sp<UidMap>& uidMap, const FieldValueMatch
 }
 
 MatchResult matchesSimple(const sp<UidMap>& uidMap, const SimpleAtomMatcher& simpleMatcher,
-                          const LogEvent& event) {
+                          const LogEvent& event, const RegexCache* regexCache) {
     if (event.GetTagId() != simpleMatcher.atom_id()) {
         return {false, nullptr};
     }
 
     unique_ptr<LogEvent> transformedEvent = nullptr;
     for (const auto& matcher : simpleMatcher.field_value_matcher()) {
-        const LogEvent& inputEvent = transformedEvent == nullptr ? event : *transformedEvent;
         auto [hasMatched, newTransformedEvent] =
-                matchesSimple(uidMap, matcher, inputEvent, 0, inputEvent.getValues().size(), 0);
-        if (newTransformedEvent != nullptr) {
-            transformedEvent = std::move(newTransformedEvent);
-        }
+                matchesSimple(uidMap, matcher, regexCache, event, std::move(transformedEvent), 0,
+                              event.getValues().size(), 0);
+        transformedEvent = std::move(newTransformedEvent);
         if (!hasMatched) {
             return {false, std::move(transformedEvent)};
         }
@@ -18,16 +18,21 @@
 
 #include "logd/LogEvent.h"
 
+#include <cstdint>
+#include <unordered_map>
 #include <vector>
 #include "src/statsd_config.pb.h"
 #include "packages/UidMap.h"
 #include "stats_util.h"
+#include "utils/Regex.h"
 
 namespace android {
 namespace os {
 namespace statsd {
 
-enum MatchingState {
+// One byte per state keeps the matcher cache of a config in a few cache lines. The worker threads
+// matching an atom write to distinct entries, which stay separate memory locations.
+enum MatchingState : int8_t {
     kNotComputed = -1,
     kNotMatched = 0,
     kMatched = 1,
@@ -41,8 +46,26 @@ struct MatchResult {
 bool combinationMatch(const std::vector<int>& children, const LogicalOperation& operation,
                       const std::vector<MatchingState>& matcherResults);
 
+// Matches a string value, or the package names & AID name of a uid value, against str_match.
+bool tryMatchString(const sp<UidMap>& uidMap, const FieldValue& fieldValue,
+                    const std::string& str_match);
+
+// Same as tryMatchString() with a fnmatch() pattern.
+bool tryMatchWildcardString(const sp<UidMap>& uidMap, const FieldValue& fieldValue,
+                            const std::string& wildcardPattern);
+
+// Compiled replace_string regexes of a SimpleAtomMatcher, keyed by their FieldValueMatcher.
+// The value is nullptr if the regex is invalid.
+typedef std::unordered_map<const FieldValueMatcher*, std::unique_ptr<Regex>> RegexCache;
+
+// Compiles the regexes of all the FieldValueMatchers of simpleMatcher with a replace_string. The
+// returned cache is only valid for this simpleMatcher object.
+RegexCache compileRegexes(const SimpleAtomMatcher& simpleMatcher);
+
+// regexCache, if set, must be created by compileRegexes() from simpleMatcher. Otherwise the
+// regexes of the string transformations are compiled for each call.
 MatchResult matchesSimple(const sp<UidMap>& uidMap, const SimpleAtomMatcher& simpleMatcher,
-                          const LogEvent& wrapper);
+                          const LogEvent& wrapper, const RegexCache* regexCache = nullptr);
 
 }  // namespace statsd
 }  // namespace os
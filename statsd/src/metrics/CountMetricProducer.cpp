@@ -23,6 +23,10 @@
 #include <limits.h>
 #include <stdlib.h>
 
+#include <algorithm>
+
+#include <utils/JenkinsHash.h>
+
 #include "guardrail/StatsdStats.h"
 #include "metrics/parsing_utils/metrics_manager_util.h"
 #include "stats_log_util.h"
@@ -57,6 +61,7 @@ const int FIELD_ID_DIMENSION_GUARDRAIL_HIT = 17;
 
 // for CountMetricDataWrapper
 const int FIELD_ID_DATA = 1;
+const int FIELD_ID_OTHER_DIMENSIONS = 2;
 // for CountMetricData
 const int FIELD_ID_DIMENSION_IN_WHAT = 1;
 const int FIELD_ID_SLICE_BY_STATE = 6;
@@ -80,9 +85,13 @@ CountMetricProducer::CountMetricProducer(
     : MetricProducer(metric.id(), key, timeBaseNs, conditionIndex, initialConditionCache, wizard,
                      protoHash, eventActivationMap, eventDeactivationMap, slicedStateAtoms,
                      stateGroupMap, getAppUpgradeBucketSplit(metric)),
+      mEncodePastBuckets(metric.encode_past_buckets()),
+      mIsDimensionless(!metric.has_dimensions_in_what() && metric.links_size() == 0 &&
+                       slicedStateAtoms.empty()),
       mDimensionGuardrailHit(false),
       mDimensionHardLimit(
-              StatsdStats::clampDimensionKeySizeLimit(metric.max_dimensions_per_bucket())) {
+              StatsdStats::clampDimensionKeySizeLimit(metric.max_dimensions_per_bucket())),
+      mHeavyHitters(metric.dimension_guardrail_heavy_hitters()) {
     if (metric.has_bucket()) {
         mBucketSizeNs =
                 TimeUnitToBucketSizeInMillisGuardrailed(key.GetUid(), metric.bucket()) * 1000000;
@@ -214,12 +223,15 @@ void CountMetricProducer::onSlicedConditionMayChangeLocked(bool overallCondition
 
 void CountMetricProducer::clearPastBucketsLocked(const int64_t dumpTimeNs) {
     mPastBuckets.clear();
+    mEncodedPastBuckets.clear();
+    mPastOtherBuckets.clear();
+    mPastBucketsByteSize = 0;
 }
 
 void CountMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
                                              const bool include_current_partial_bucket,
                                              const bool erase_data, const DumpLatency dumpLatency,
-                                             std::set<string>* str_set,
+                                             ReportStringTable* str_set,
                                              ProtoOutputStream* protoOutput) {
     if (include_current_partial_bucket) {
         flushLocked(dumpTimeNs);
@@ -230,7 +242,7 @@ void CountMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
     protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_ID, (long long)mMetricId);
     protoOutput->write(FIELD_TYPE_BOOL | FIELD_ID_IS_ACTIVE, isActiveLocked());
 
-    if (mPastBuckets.empty()) {
+    if (mPastBuckets.empty() && mEncodedPastBuckets.empty() && mPastOtherBuckets.empty()) {
         return;
     }
 
@@ -254,8 +266,8 @@ void CountMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
 
     uint64_t protoToken = protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_ID_COUNT_METRICS);
 
-    for (const auto& counter : mPastBuckets) {
-        const MetricDimensionKey& dimensionKey = counter.first;
+    // Starts the CountMetricData of the dimension with its dimension and state values.
+    const auto startMetricData = [&](const MetricDimensionKey& dimensionKey) {
         VLOG("  dimension key %s", dimensionKey.toString().c_str());
 
         uint64_t wrapperToken =
@@ -278,30 +290,16 @@ void CountMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
             writeStateToProto(state, protoOutput);
             protoOutput->end(stateToken);
         }
+        return wrapperToken;
+    };
+
+    for (const auto& counter : mPastBuckets) {
+        uint64_t wrapperToken = startMetricData(counter.first);
         // Then fill bucket_info (CountBucketInfo).
         for (const auto& bucket : counter.second) {
             uint64_t bucketInfoToken = protoOutput->start(
                     FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_BUCKET_INFO);
-            // Partial bucket.
-            if (bucket.mBucketEndNs - bucket.mBucketStartNs != mBucketSizeNs) {
-                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_START_BUCKET_ELAPSED_MILLIS,
-                                   (long long)NanoToMillis(bucket.mBucketStartNs));
-                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_END_BUCKET_ELAPSED_MILLIS,
-                                   (long long)NanoToMillis(bucket.mBucketEndNs));
-            } else {
-                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_NUM,
-                                   (long long)(getBucketNumFromEndTimeNs(bucket.mBucketEndNs)));
-            }
-            protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_COUNT, (long long)bucket.mCount);
-
-            // We only write the condition timer value if the metric has a
-            // condition and isn't sliced by state or condition.
-            // TODO(b/268531179): Slice the condition timer by state and condition
-            if (mConditionTrackerIndex >= 0 && mSlicedStateAtoms.empty() && !mConditionSliced) {
-                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_CONDITION_TRUE_NS,
-                                   (long long)bucket.mConditionTrueNs);
-            }
-
+            writeBucketInfoToProto(bucket, protoOutput);
             protoOutput->end(bucketInfoToken);
             VLOG("\t bucket [%lld - %lld] count: %lld", (long long)bucket.mBucketStartNs,
                  (long long)bucket.mBucketEndNs, (long long)bucket.mCount);
@@ -309,18 +307,72 @@ void CountMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
         protoOutput->end(wrapperToken);
     }
 
+    for (const auto& [dimensionKey, dimension] : mEncodedPastBuckets.getDimensions()) {
+        uint64_t wrapperToken = startMetricData(dimensionKey);
+        mEncodedPastBuckets.forEachBucket(
+                dimension, /*numValues=*/2,
+                [&](int64_t bucketStartNs, int64_t bucketEndNs, const int64_t* values) {
+                    CountBucket bucket;
+                    bucket.mBucketStartNs = bucketStartNs;
+                    bucket.mBucketEndNs = bucketEndNs;
+                    bucket.mCount = values[0];
+                    bucket.mConditionTrueNs = values[1];
+                    uint64_t bucketInfoToken = protoOutput->start(
+                            FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_BUCKET_INFO);
+                    writeBucketInfoToProto(bucket, protoOutput);
+                    protoOutput->end(bucketInfoToken);
+                });
+        protoOutput->end(wrapperToken);
+    }
+
+    for (const auto& bucket : mPastOtherBuckets) {
+        uint64_t bucketInfoToken = protoOutput->start(
+                FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_OTHER_DIMENSIONS);
+        writeBucketInfoToProto(bucket, protoOutput);
+        protoOutput->end(bucketInfoToken);
+    }
+
     protoOutput->end(protoToken);
 
     if (erase_data) {
         mPastBuckets.clear();
+        mEncodedPastBuckets.clear();
+        mPastOtherBuckets.clear();
+        mPastBucketsByteSize = 0;
         mDimensionGuardrailHit = false;
     }
 }
 
+void CountMetricProducer::writeBucketInfoToProto(const CountBucket& bucket,
+                                                 ProtoOutputStream* protoOutput) const {
+    // Partial bucket.
+    if (bucket.mBucketEndNs - bucket.mBucketStartNs != mBucketSizeNs) {
+        protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_START_BUCKET_ELAPSED_MILLIS,
+                           (long long)NanoToMillis(bucket.mBucketStartNs));
+        protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_END_BUCKET_ELAPSED_MILLIS,
+                           (long long)NanoToMillis(bucket.mBucketEndNs));
+    } else {
+        protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_NUM,
+                           (long long)(getBucketNumFromEndTimeNs(bucket.mBucketEndNs)));
+    }
+    protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_COUNT, (long long)bucket.mCount);
+
+    // We only write the condition timer value if the metric has a
+    // condition and isn't sliced by state or condition.
+    // TODO(b/268531179): Slice the condition timer by state and condition
+    if (mConditionTrackerIndex >= 0 && mSlicedStateAtoms.empty() && !mConditionSliced) {
+        protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_CONDITION_TRUE_NS,
+                           (long long)bucket.mConditionTrueNs);
+    }
+}
+
 void CountMetricProducer::dropDataLocked(const int64_t dropTimeNs) {
     flushIfNeededLocked(dropTimeNs);
     StatsdStats::getInstance().noteBucketDropped(mMetricId);
     mPastBuckets.clear();
+    mEncodedPastBuckets.clear();
+    mPastOtherBuckets.clear();
+    mPastBucketsByteSize = 0;
 }
 
 void CountMetricProducer::onConditionChangedLocked(const bool conditionMet,
@@ -360,6 +412,114 @@ bool CountMetricProducer::hitGuardRailLocked(const MetricDimensionKey& newKey) {
     return false;
 }
 
+int64_t CountMetricProducer::addToTailSketchLocked(const MetricDimensionKey& key,
+                                                   const int64_t count) {
+    const android::hash_t hash = std::hash<MetricDimensionKey>()(key);
+    uint32_t* cells[kTailSketchDepth];
+    int64_t estimate = INT64_MAX;
+    for (size_t row = 0; row < kTailSketchDepth; row++) {
+        const size_t column = android::JenkinsHashWhiten(android::JenkinsHashMix(hash, row)) %
+                              kTailSketchWidth;
+        cells[row] = &mTailSketch[row * kTailSketchWidth + column];
+        estimate = std::min(estimate, (int64_t)*cells[row]);
+    }
+    // Conservative update: only the cells below the new estimate are raised, which keeps the
+    // overestimate from collisions lower than adding to every cell.
+    estimate = std::min(estimate + count, (int64_t)UINT32_MAX);
+    for (uint32_t* cell : cells) {
+        *cell = std::max(*cell, (uint32_t)estimate);
+    }
+    return estimate;
+}
+
+bool CountMetricProducer::countHeavyHitterLocked(const MetricDimensionKey& newKey) {
+    if (mTailSketch.empty()) {
+        mTailSketch.resize(kTailSketchDepth * kTailSketchWidth);
+    }
+    mOtherCount++;
+    const int64_t estimate = addToTailSketchLocked(newKey, 1);
+    if (estimate <= mMinCountLowerBound || mCurrentSlicedCounter->empty()) {
+        return false;
+    }
+    auto minIt = mCurrentSlicedCounter->begin();
+    for (auto it = mCurrentSlicedCounter->begin(); it != mCurrentSlicedCounter->end(); ++it) {
+        if (it->second < minIt->second) {
+            minIt = it;
+        }
+    }
+    mMinCountLowerBound = minIt->second;
+    if (estimate <= mMinCountLowerBound) {
+        return false;
+    }
+    // The smallest dimension moves to the tail with its count, and the new dimension takes its
+    // estimate out of the tail. The total of the bucket is unchanged.
+    VLOG("CountMetric %lld dimension key %s replaces %s", (long long)mMetricId,
+         newKey.toString().c_str(), minIt->first.toString().c_str());
+    addToTailSketchLocked(minIt->first, minIt->second);
+    const int64_t newCount = std::min(estimate, mOtherCount);
+    mOtherCount += minIt->second - newCount;
+    mCurrentSlicedCounter->erase(minIt);
+    (*mCurrentSlicedCounter)[newKey] = newCount;
+    return true;
+}
+
+void CountMetricProducer::onMatchedLogEventLocked(const size_t matcherIndex,
+                                                  const LogEvent& event) {
+    // The anomaly trackers and the sampling go through the general path.
+    if (!mIsDimensionless || !mAnomalyTrackers.empty() || !mSampledWhatFields.empty()) {
+        MetricProducer::onMatchedLogEventLocked(matcherIndex, event);
+        return;
+    }
+    if (!mIsActive) {
+        return;
+    }
+    const int64_t eventTimeNs = event.GetElapsedTimestampNs();
+    if (eventTimeNs < mTimeBaseNs) {
+        return;
+    }
+    flushIfNeededLocked(eventTimeNs);
+    if (mCondition != ConditionState::kTrue) {
+        return;
+    }
+    if (mDimensionlessCount == nullptr) {
+        mDimensionlessCount = &(*mCurrentSlicedCounter)[DEFAULT_METRIC_DIMENSION_KEY];
+    }
+    (*mDimensionlessCount) += event.getRepeatCount();
+}
+
+bool CountMetricProducer::onMatchedLogEventOfExistingDimensionLocked(
+        const HashableDimensionKey& stateValuesKey, bool condition, const LogEvent& event) {
+    MetricDimensionKeyView eventKeyView(stateValuesKey);
+    if (!filterValues(mDimensionsInWhat, event, &eventKeyView)) {
+        return false;
+    }
+    const int64_t eventTimeNs = event.GetElapsedTimestampNs();
+    flushIfNeededLocked(eventTimeNs);
+    if (!condition) {
+        return true;
+    }
+    auto it = mCurrentSlicedCounter->findBorrowed(eventKeyView);
+    if (it == mCurrentSlicedCounter->end()) {
+        return false;
+    }
+    it->second += event.getRepeatCount();
+    if (!mAnomalyTrackers.empty()) {
+        detectAnomaliesLocked(eventTimeNs, it->first, it->second);
+    }
+    return true;
+}
+
+void CountMetricProducer::detectAnomaliesLocked(const int64_t eventTimeNs,
+                                                const MetricDimensionKey& key, int64_t count) {
+    auto prev = mCurrentFullCounters->find(key);
+    if (prev != mCurrentFullCounters->end()) {
+        count += prev->second;
+    }
+    for (auto& tracker : mAnomalyTrackers) {
+        tracker->detectAndDeclareAnomaly(eventTimeNs, mCurrentBucketNum, mMetricId, key, count);
+    }
+}
+
 void CountMetricProducer::onMatchedLogEventInternalLocked(
         const size_t matcherIndex, const MetricDimensionKey& eventKey,
         const ConditionKey& conditionKey, bool condition, const LogEvent& event,
@@ -375,23 +535,20 @@ void CountMetricProducer::onMatchedLogEventInternalLocked(
     if (it == mCurrentSlicedCounter->end()) {
         // ===========GuardRail==============
         if (hitGuardRailLocked(eventKey)) {
-            return;
+            if (!mHeavyHitters || !countHeavyHitterLocked(eventKey)) {
+                return;
+            }
+        } else {
+            // create a counter for the new key
+            (*mCurrentSlicedCounter)[eventKey] = event.getRepeatCount();
         }
-        // create a counter for the new key
-        (*mCurrentSlicedCounter)[eventKey] = 1;
     } else {
         // increment the existing value
         auto& count = it->second;
-        count++;
+        count += event.getRepeatCount();
     }
-    for (auto& tracker : mAnomalyTrackers) {
-        int64_t countWholeBucket = mCurrentSlicedCounter->find(eventKey)->second;
-        auto prev = mCurrentFullCounters->find(eventKey);
-        if (prev != mCurrentFullCounters->end()) {
-            countWholeBucket += prev->second;
-        }
-        tracker->detectAndDeclareAnomaly(eventTimeNs, mCurrentBucketNum, mMetricId, eventKey,
-                                         countWholeBucket);
+    if (!mAnomalyTrackers.empty()) {
+        detectAnomaliesLocked(eventTimeNs, eventKey, mCurrentSlicedCounter->find(eventKey)->second);
     }
 
     VLOG("metric %lld %s->%lld", (long long)mMetricId, eventKey.toString().c_str(),
@@ -454,12 +611,23 @@ void CountMetricProducer::flushCurrentBucketLocked(const int64_t eventTimeNs,
     for (const auto& counter : *mCurrentSlicedCounter) {
         if (countPassesThreshold(counter.second)) {
             info.mCount = counter.second;
-            auto& bucketList = mPastBuckets[counter.first];
-            bucketList.push_back(info);
+            if (mEncodePastBuckets) {
+                mPastBucketsByteSize += mEncodedPastBuckets.add(
+                        counter.first, info.mBucketStartNs, info.mBucketEndNs,
+                        {info.mCount, info.mConditionTrueNs});
+            } else {
+                mPastBuckets[counter.first].push_back(info);
+                mPastBucketsByteSize += kBucketSize;
+            }
             VLOG("metric %lld, dump key value: %s -> %lld", (long long)mMetricId,
                  counter.first.toString().c_str(), (long long)counter.second);
         }
     }
+    if (mOtherCount > 0) {
+        info.mCount = mOtherCount;
+        mPastOtherBuckets.push_back(info);
+        mPastBucketsByteSize += kBucketSize;
+    }
 
     // Only update mCurrentFullCounters if any anomaly tackers are present.
     if (mAnomalyTrackers.size() > 0) {
@@ -490,8 +658,17 @@ void CountMetricProducer::flushCurrentBucketLocked(const int64_t eventTimeNs,
 
     StatsdStats::getInstance().noteBucketCount(mMetricId);
     // Only resets the counters, but doesn't setup the times nor numbers.
-    // (Do not clear since the old one is still referenced in mAnomalyTrackers).
-    mCurrentSlicedCounter = std::make_shared<DimToValMap>();
+    // (Do not clear if the old one is still referenced in mAnomalyTrackers). Clearing keeps the
+    // storage of the map for the dimensions of the next bucket.
+    if (mCurrentSlicedCounter.use_count() == 1) {
+        mCurrentSlicedCounter->clear();
+    } else {
+        mCurrentSlicedCounter = std::make_shared<DimToValMap>();
+    }
+    mDimensionlessCount = nullptr;
+    mOtherCount = 0;
+    mMinCountLowerBound = 0;
+    std::fill(mTailSketch.begin(), mTailSketch.end(), 0);
     mCurrentBucketStartTimeNs = nextBucketStartTimeNs;
     // Reset mHasHitGuardrail boolean since bucket was reset
     mHasHitGuardrail = false;
@@ -501,11 +678,16 @@ void CountMetricProducer::flushCurrentBucketLocked(const int64_t eventTimeNs,
 // greater than actual data size as it contains each dimension of
 // CountMetricData is  duplicated.
 size_t CountMetricProducer::byteSizeLocked() const {
-    size_t totalSize = 0;
-    for (const auto& pair : mPastBuckets) {
-        totalSize += pair.second.size() * kBucketSize;
+    return mPastBucketsByteSize;
+}
+
+bool CountMetricProducer::hasUidInCurrentDimensionsLocked(const int32_t uid) const {
+    for (const auto& [dimensionKey, _] : *mCurrentSlicedCounter) {
+        if (containsUid(dimensionKey.getDimensionKeyInWhat(), uid)) {
+            return true;
+        }
     }
-    return totalSize;
+    return false;
 }
 
 void CountMetricProducer::onActiveStateChangedLocked(const int64_t eventTimeNs,
@@ -22,6 +22,7 @@
 
 #include <unordered_map>
 
+#include "EncodedPastBuckets.h"
 #include "MetricProducer.h"
 #include "anomaly/AnomalyTracker.h"
 #include "condition/ConditionTimer.h"
@@ -29,6 +30,7 @@
 #include "matchers/matcher_util.h"
 #include "src/statsd_config.pb.h"
 #include "stats_util.h"
+#include "utils/FlatHashMap.h"
 
 namespace android {
 namespace os {
@@ -64,6 +66,15 @@ public:
     }
 
 protected:
+    // Counts the events of the dimensionless metrics without computing the condition key, the
+    // state key and the dimension key of the event.
+    void onMatchedLogEventLocked(const size_t matcherIndex, const LogEvent& event) override;
+
+    // Counts the events of the dimensions of the current bucket without building their key.
+    bool onMatchedLogEventOfExistingDimensionLocked(const HashableDimensionKey& stateValuesKey,
+                                                    bool condition,
+                                                    const LogEvent& event) override;
+
     void onMatchedLogEventInternalLocked(
             const size_t matcherIndex, const MetricDimensionKey& eventKey,
             const ConditionKey& conditionKey, bool condition, const LogEvent& event,
@@ -75,7 +86,7 @@ private:
                             const bool include_current_partial_bucket,
                             const bool erase_data,
                             const DumpLatency dumpLatency,
-                            std::set<string> *str_set,
+                            ReportStringTable* str_set,
                             android::util::ProtoOutputStream* protoOutput) override;
 
     void clearPastBucketsLocked(const int64_t dumpTimeNs) override;
@@ -89,6 +100,12 @@ private:
     // Internal function to calculate the current used bytes.
     size_t byteSizeLocked() const override;
 
+    size_t getCurrentDimensionCountLocked() const override {
+        return mCurrentSlicedCounter->size();
+    }
+
+    bool hasUidInCurrentDimensionsLocked(const int32_t uid) const override;
+
     void dumpStatesLocked(int out, bool verbose) const override;
 
     void dropDataLocked(const int64_t dropTimeNs) override;
@@ -116,11 +133,30 @@ private:
             std::unordered_map<int, std::vector<int>>& deactivationAtomTrackerToMetricMap,
             std::vector<int>& metricsWithActivation) override;
 
-    std::unordered_map<MetricDimensionKey, std::vector<CountBucket>> mPastBuckets;
+    FlatHashMap<MetricDimensionKey, std::vector<CountBucket>> mPastBuckets;
+
+    // Whether the finished buckets are kept in mEncodedPastBuckets instead of mPastBuckets.
+    const bool mEncodePastBuckets;
+
+    // Finished buckets with their count and condition true duration.
+    EncodedPastBuckets mEncodedPastBuckets;
+
+    // Writes the fields of the CountBucketInfo message of the bucket.
+    void writeBucketInfoToProto(const CountBucket& bucket,
+                                android::util::ProtoOutputStream* protoOutput) const;
 
     // The current bucket (may be a partial bucket).
     std::shared_ptr<DimToValMap> mCurrentSlicedCounter = std::make_shared<DimToValMap>();
 
+    // Whether the metric has no dimensions in what, no condition links and no sliced state, so
+    // that all the events are counted in DEFAULT_METRIC_DIMENSION_KEY.
+    const bool mIsDimensionless;
+
+    // Count of DEFAULT_METRIC_DIMENSION_KEY in mCurrentSlicedCounter, or nullptr until the first
+    // event of the bucket. It is the only key of the dimensionless metrics, so the pointer stays
+    // valid until mCurrentSlicedCounter is cleared.
+    int64_t* mDimensionlessCount = nullptr;
+
     // The sum of previous partial buckets in the current full bucket (excluding the current
     // partial bucket). This is only updated while flushing the current bucket.
     std::shared_ptr<DimToValMap> mCurrentFullCounters = std::make_shared<DimToValMap>();
@@ -129,6 +165,9 @@ private:
 
     bool hitGuardRailLocked(const MetricDimensionKey& newKey);
 
+    // Informs the anomaly trackers of the count of the dimension in the current partial bucket.
+    void detectAnomaliesLocked(int64_t eventTimeNs, const MetricDimensionKey& key, int64_t count);
+
     bool countPassesThreshold(int64_t count);
 
     // Tracks if the dimension guardrail has been hit in the current report.
@@ -136,13 +175,47 @@ private:
 
     const size_t mDimensionHardLimit;
 
+    // Whether the dimensions with the most events are kept once mDimensionHardLimit is reached,
+    // instead of the first dimensions of the bucket.
+    const bool mHeavyHitters;
+
+    static const size_t kTailSketchDepth = 4;
+    static const size_t kTailSketchWidth = 256;
+
+    // Count-Min sketch of the events of the current bucket not counted in mCurrentSlicedCounter,
+    // by dimension. Allocated when the guardrail is first hit in heavy hitters mode.
+    std::vector<uint32_t> mTailSketch;
+
+    // Events of the current bucket not counted in mCurrentSlicedCounter.
+    int64_t mOtherCount = 0;
+
+    // Lower bound of the smallest count in mCurrentSlicedCounter. Counts only grow and only a
+    // larger count replaces the smallest one, so it stays a lower bound until the bucket ends.
+    int64_t mMinCountLowerBound = 0;
+
+    // Finished buckets of mOtherCount.
+    std::vector<CountBucket> mPastOtherBuckets;
+
+    // Adds the events of the dimension to mTailSketch and returns the estimate of its events.
+    int64_t addToTailSketchLocked(const MetricDimensionKey& key, int64_t count);
+
+    // Counts an event of a new dimension once mDimensionHardLimit is reached. Returns true if the
+    // dimension replaced the dimension with the smallest count in mCurrentSlicedCounter.
+    bool countHeavyHitterLocked(const MetricDimensionKey& newKey);
+
     FRIEND_TEST(CountMetricProducerTest, TestNonDimensionalEvents);
+    FRIEND_TEST(CountMetricProducerTest, TestEncodePastBuckets);
+    FRIEND_TEST(CountMetricProducerTest, TestCurrentSlicedCounterReusedAcrossBuckets);
     FRIEND_TEST(CountMetricProducerTest, TestEventsWithNonSlicedCondition);
     FRIEND_TEST(CountMetricProducerTest, TestEventsWithSlicedCondition);
+    FRIEND_TEST(CountMetricProducerTest, TestSlicedConditionQuerySharedForEvent);
     FRIEND_TEST(CountMetricProducerTest, TestAnomalyDetectionUnSliced);
     FRIEND_TEST(CountMetricProducerTest, TestFirstBucket);
     FRIEND_TEST(CountMetricProducerTest, TestOneWeekTimeUnit);
     FRIEND_TEST(CountMetricProducerTest, TestSplitOnAppUpgradeDisabled);
+    FRIEND_TEST(CountMetricProducerTest, TestDimensionGuardrailHeavyHitters);
+    FRIEND_TEST(CountMetricProducerTest, TestSplitOnUnrelatedAppUpgrade);
+    FRIEND_TEST(CountMetricProducerTest, TestDimensionlessFastPath);
 
     FRIEND_TEST(CountMetricProducerTest_PartialBucket, TestSplitInCurrentBucket);
     FRIEND_TEST(CountMetricProducerTest_PartialBucket, TestSplitInNextBucket);
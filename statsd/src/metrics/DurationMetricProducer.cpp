@@ -86,6 +86,7 @@ DurationMetricProducer::DurationMetricProducer(
       mStopAllIndex(stopAllIndex),
       mNested(nesting),
       mContainANYPositionInInternalDimensions(false),
+      mEncodePastBuckets(metric.encode_past_buckets()),
       mDimensionHardLimit(
               StatsdStats::clampDimensionKeySizeLimit(metric.max_dimensions_per_bucket())) {
     if (metric.has_bucket()) {
@@ -270,7 +271,8 @@ void DurationMetricProducer::initTrueDimensions(const int whatIndex, const int64
     if (whatIndex == -1) {
         return;
     }
-    const map<HashableDimensionKey, int>* slicedWhatMap = mWizard->getSlicedDimensionMap(whatIndex);
+    const unordered_map<HashableDimensionKey, int>* slicedWhatMap =
+            mWizard->getSlicedDimensionMap(whatIndex);
     for (const auto& [internalDimKey, count] : *slicedWhatMap) {
         for (int i = 0; i < count; i++) {
             // Fake start events.
@@ -343,6 +345,29 @@ void DurationMetricProducer::onStateChanged(const int64_t eventTimeNs, const int
     }
 }
 
+void DurationMetricProducer::onStatesChanged(const int64_t eventTimeNs, const int32_t atomId,
+                                             std::span<const StateChange> changes) {
+    vector<FieldValue> newStates;
+    newStates.reserve(changes.size());
+    for (const StateChange& change : changes) {
+        newStates.push_back(change.newState);
+        mapStateValue(atomId, &newStates.back());
+    }
+
+    flushIfNeededLocked(eventTimeNs);
+
+    // Same as onStateChanged, each tracker gets the changes of the primary keys it's linked to in
+    // order.
+    for (auto& whatIt : mCurrentSlicedDurationTrackerMap) {
+        for (size_t i = 0; i < changes.size(); i++) {
+            if (containsLinkedStateValues(whatIt.first, changes[i].primaryKey, mMetric2StateLinks,
+                                          atomId)) {
+                whatIt.second->onStateChanged(eventTimeNs, atomId, newStates[i]);
+            }
+        }
+    }
+}
+
 unique_ptr<DurationTracker> DurationMetricProducer::createDurationTracker(
         const MetricDimensionKey& eventKey) const {
     switch (mAggregationType) {
@@ -389,33 +414,38 @@ void DurationMetricProducer::onSlicedConditionMayChangeLocked_opt1(const int64_t
     // state based on the new unsliced condition state.
     if (dimensionsChangedToTrue == nullptr || dimensionsChangedToFalse == nullptr ||
         (dimensionsChangedToTrue->empty() && dimensionsChangedToFalse->empty())) {
-        const map<HashableDimensionKey, int>* slicedConditionMap =
+        const unordered_map<HashableDimensionKey, int>* slicedConditionMap =
                 mWizard->getSlicedDimensionMap(mConditionTrackerIndex);
-        for (auto& whatIt : mCurrentSlicedDurationTrackerMap) {
-            HashableDimensionKey linkedConditionDimensionKey;
-            getDimensionForCondition(whatIt.first.getValues(), mMetric2ConditionLinks[0],
-                                     &linkedConditionDimensionKey);
+        for (const auto& [linkedConditionDimensionKey, whatKeys] : mWhatKeysByLinkedConditionKey) {
             const auto& slicedConditionIt = slicedConditionMap->find(linkedConditionDimensionKey);
-            if (slicedConditionIt != slicedConditionMap->end() && slicedConditionIt->second > 0) {
-                whatIt.second->onConditionChanged(currentUnSlicedPartCondition, eventTime);
+            if (slicedConditionIt == slicedConditionMap->end() || slicedConditionIt->second <= 0) {
+                continue;
+            }
+            for (const HashableDimensionKey& whatKey : whatKeys) {
+                mCurrentSlicedDurationTrackerMap.at(whatKey)->onConditionChanged(
+                        currentUnSlicedPartCondition, eventTime);
             }
         }
     } else {
         // Handle the condition change from the sliced predicate.
         if (currentUnSlicedPartCondition) {
-            for (auto& whatIt : mCurrentSlicedDurationTrackerMap) {
-                HashableDimensionKey linkedConditionDimensionKey;
-                getDimensionForCondition(whatIt.first.getValues(), mMetric2ConditionLinks[0],
-                                         &linkedConditionDimensionKey);
-                if (dimensionsChangedToTrue->find(linkedConditionDimensionKey) !=
-                        dimensionsChangedToTrue->end()) {
-                    whatIt.second->onConditionChanged(true, eventTime);
-                }
-                if (dimensionsChangedToFalse->find(linkedConditionDimensionKey) !=
-                        dimensionsChangedToFalse->end()) {
-                    whatIt.second->onConditionChanged(false, eventTime);
+            auto notifyLinkedTrackers = [this, eventTime](
+                                                const unordered_set<HashableDimensionKey>& dims,
+                                                const bool condition) {
+                for (const HashableDimensionKey& linkedConditionDimensionKey : dims) {
+                    const auto& linkedIt =
+                            mWhatKeysByLinkedConditionKey.find(linkedConditionDimensionKey);
+                    if (linkedIt == mWhatKeysByLinkedConditionKey.end()) {
+                        continue;
+                    }
+                    for (const HashableDimensionKey& whatKey : linkedIt->second) {
+                        mCurrentSlicedDurationTrackerMap.at(whatKey)->onConditionChanged(
+                                condition, eventTime);
+                    }
                 }
-            }
+            };
+            notifyLinkedTrackers(*dimensionsChangedToTrue, true);
+            notifyLinkedTrackers(*dimensionsChangedToFalse, false);
         }
     }
 }
@@ -498,16 +528,20 @@ void DurationMetricProducer::dropDataLocked(const int64_t dropTimeNs) {
     flushIfNeededLocked(dropTimeNs);
     StatsdStats::getInstance().noteBucketDropped(mMetricId);
     mPastBuckets.clear();
+    mEncodedPastBuckets.clear();
+    mPastBucketsByteSize = 0;
 }
 
 void DurationMetricProducer::clearPastBucketsLocked(const int64_t dumpTimeNs) {
     flushIfNeededLocked(dumpTimeNs);
     mPastBuckets.clear();
+    mEncodedPastBuckets.clear();
+    mPastBucketsByteSize = 0;
 }
 
 void DurationMetricProducer::onDumpReportLocked(
         const int64_t dumpTimeNs, const bool include_current_partial_bucket, const bool erase_data,
-        const DumpLatency dumpLatency, std::set<string>* str_set, ProtoOutputStream* protoOutput) {
+        const DumpLatency dumpLatency, ReportStringTable* str_set, ProtoOutputStream* protoOutput) {
     if (include_current_partial_bucket) {
         flushLocked(dumpTimeNs);
     } else {
@@ -517,7 +551,7 @@ void DurationMetricProducer::onDumpReportLocked(
     protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_ID, (long long)mMetricId);
     protoOutput->write(FIELD_TYPE_BOOL | FIELD_ID_IS_ACTIVE, isActiveLocked());
 
-    if (mPastBuckets.empty()) {
+    if (mPastBuckets.empty() && mEncodedPastBuckets.empty()) {
         VLOG(" Duration metric, empty return");
         return;
     }
@@ -542,8 +576,8 @@ void DurationMetricProducer::onDumpReportLocked(
 
     VLOG("Duration metric %lld dump report now...", (long long)mMetricId);
 
-    for (const auto& pair : mPastBuckets) {
-        const MetricDimensionKey& dimensionKey = pair.first;
+    // Starts the DurationMetricData of the dimension with its dimension and state values.
+    const auto startMetricData = [&](const MetricDimensionKey& dimensionKey) {
         VLOG("  dimension key %s", dimensionKey.toString().c_str());
 
         uint64_t wrapperToken =
@@ -566,43 +600,68 @@ void DurationMetricProducer::onDumpReportLocked(
             writeStateToProto(state, protoOutput);
             protoOutput->end(stateToken);
         }
+        return wrapperToken;
+    };
+
+    for (const auto& pair : mPastBuckets) {
+        uint64_t wrapperToken = startMetricData(pair.first);
         // Then fill bucket_info (DurationBucketInfo).
         for (const auto& bucket : pair.second) {
-            uint64_t bucketInfoToken = protoOutput->start(
-                    FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_BUCKET_INFO);
-            if (bucket.mBucketEndNs - bucket.mBucketStartNs != mBucketSizeNs) {
-                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_START_BUCKET_ELAPSED_MILLIS,
-                                   (long long)NanoToMillis(bucket.mBucketStartNs));
-                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_END_BUCKET_ELAPSED_MILLIS,
-                                   (long long)NanoToMillis(bucket.mBucketEndNs));
-            } else {
-                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_NUM,
-                                   (long long)(getBucketNumFromEndTimeNs(bucket.mBucketEndNs)));
-            }
-            protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_DURATION, (long long)bucket.mDuration);
-
-            // We only write the condition timer value if the metric has a
-            // condition and isn't sliced by state or condition.
-            // TODO(b/268531762): Slice the condition timer by state and condition
-            if (mConditionTrackerIndex >= 0 && mSlicedStateAtoms.empty() && !mConditionSliced) {
-                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_CONDITION_TRUE_NS,
-                                   (long long)bucket.mConditionTrueNs);
-            }
-
-            protoOutput->end(bucketInfoToken);
+            writeBucketInfoToProto(bucket, protoOutput);
             VLOG("\t bucket [%lld - %lld] duration: %lld", (long long)bucket.mBucketStartNs,
                  (long long)bucket.mBucketEndNs, (long long)bucket.mDuration);
         }
+        protoOutput->end(wrapperToken);
+    }
 
+    for (const auto& [dimensionKey, dimension] : mEncodedPastBuckets.getDimensions()) {
+        uint64_t wrapperToken = startMetricData(dimensionKey);
+        mEncodedPastBuckets.forEachBucket(
+                dimension, /*numValues=*/2,
+                [&](int64_t bucketStartNs, int64_t bucketEndNs, const int64_t* values) {
+                    DurationBucket bucket;
+                    bucket.mBucketStartNs = bucketStartNs;
+                    bucket.mBucketEndNs = bucketEndNs;
+                    bucket.mDuration = values[0];
+                    bucket.mConditionTrueNs = values[1];
+                    writeBucketInfoToProto(bucket, protoOutput);
+                });
         protoOutput->end(wrapperToken);
     }
 
     protoOutput->end(protoToken);
     if (erase_data) {
         mPastBuckets.clear();
+        mEncodedPastBuckets.clear();
+        mPastBucketsByteSize = 0;
     }
 }
 
+void DurationMetricProducer::writeBucketInfoToProto(const DurationBucket& bucket,
+                                                    ProtoOutputStream* protoOutput) const {
+    uint64_t bucketInfoToken =
+            protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_BUCKET_INFO);
+    if (bucket.mBucketEndNs - bucket.mBucketStartNs != mBucketSizeNs) {
+        protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_START_BUCKET_ELAPSED_MILLIS,
+                           (long long)NanoToMillis(bucket.mBucketStartNs));
+        protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_END_BUCKET_ELAPSED_MILLIS,
+                           (long long)NanoToMillis(bucket.mBucketEndNs));
+    } else {
+        protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_NUM,
+                           (long long)(getBucketNumFromEndTimeNs(bucket.mBucketEndNs)));
+    }
+    protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_DURATION, (long long)bucket.mDuration);
+
+    // We only write the condition timer value if the metric has a
+    // condition and isn't sliced by state or condition.
+    // TODO(b/268531762): Slice the condition timer by state and condition
+    if (mConditionTrackerIndex >= 0 && mSlicedStateAtoms.empty() && !mConditionSliced) {
+        protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_CONDITION_TRUE_NS,
+                           (long long)bucket.mConditionTrueNs);
+    }
+    protoOutput->end(bucketInfoToken);
+}
+
 void DurationMetricProducer::flushIfNeededLocked(const int64_t eventTimeNs) {
     int64_t currentBucketEndTimeNs = getCurrentBucketEndTimeNs();
 
@@ -622,23 +681,63 @@ void DurationMetricProducer::flushCurrentBucketLocked(const int64_t eventTimeNs,
     const auto [globalConditionTrueNs, globalConditionCorrectionNs] =
             mConditionTimer.newBucketStart(eventTimeNs, nextBucketStartTimeNs);
 
+    // Most trackers add a bucket, rehash once for all the dimensions new to mPastBuckets instead of
+    // several times while flushing.
+    mPastBuckets.reserve(mPastBuckets.size() + mCurrentSlicedDurationTrackerMap.size());
     for (auto whatIt = mCurrentSlicedDurationTrackerMap.begin();
             whatIt != mCurrentSlicedDurationTrackerMap.end();) {
         if (whatIt->second->flushCurrentBucket(eventTimeNs, mUploadThreshold, globalConditionTrueNs,
                                                &mPastBuckets)) {
             VLOG("erase bucket for key %s", whatIt->first.toString().c_str());
-            whatIt = mCurrentSlicedDurationTrackerMap.erase(whatIt);
+            whatIt = eraseDurationTrackerLocked(whatIt);
         } else {
             ++whatIt;
         }
     }
 
+    if (mEncodePastBuckets) {
+        // The trackers add their buckets to mPastBuckets, which only holds this flush.
+        for (const auto& [dimensionKey, buckets] : mPastBuckets) {
+            for (const DurationBucket& bucket : buckets) {
+                mPastBucketsByteSize += mEncodedPastBuckets.add(
+                        dimensionKey, bucket.mBucketStartNs, bucket.mBucketEndNs,
+                        {bucket.mDuration, bucket.mConditionTrueNs});
+            }
+        }
+        mPastBuckets.clear();
+    } else {
+        // The trackers may add buckets to several dimensions, so they are counted once per flush
+        // rather than on each byteSize check.
+        mPastBucketsByteSize = 0;
+        for (const auto& [_, buckets] : mPastBuckets) {
+            mPastBucketsByteSize += buckets.size() * kBucketSize;
+        }
+    }
+
     StatsdStats::getInstance().noteBucketCount(mMetricId);
     mCurrentBucketStartTimeNs = nextBucketStartTimeNs;
     // Reset mHasHitGuardrail boolean since bucket was reset
     mHasHitGuardrail = false;
 }
 
+unordered_map<HashableDimensionKey, unique_ptr<DurationTracker>>::iterator
+DurationMetricProducer::eraseDurationTrackerLocked(
+        unordered_map<HashableDimensionKey, unique_ptr<DurationTracker>>::iterator whatIt) {
+    if (indexesLinkedConditionKeys()) {
+        HashableDimensionKey linkedConditionDimensionKey;
+        getDimensionForCondition(whatIt->first.getValues(), mMetric2ConditionLinks[0],
+                                 &linkedConditionDimensionKey);
+        const auto linkedIt = mWhatKeysByLinkedConditionKey.find(linkedConditionDimensionKey);
+        if (linkedIt != mWhatKeysByLinkedConditionKey.end()) {
+            linkedIt->second.erase(whatIt->first);
+            if (linkedIt->second.empty()) {
+                mWhatKeysByLinkedConditionKey.erase(linkedIt);
+            }
+        }
+    }
+    return mCurrentSlicedDurationTrackerMap.erase(whatIt);
+}
+
 void DurationMetricProducer::dumpStatesLocked(int out, bool verbose) const {
     if (mCurrentSlicedDurationTrackerMap.size() == 0) {
         return;
@@ -688,6 +787,12 @@ void DurationMetricProducer::handleStartEvent(const MetricDimensionKey& eventKey
             return;
         }
         mCurrentSlicedDurationTrackerMap[whatKey] = createDurationTracker(eventKey);
+        if (indexesLinkedConditionKeys()) {
+            HashableDimensionKey linkedConditionDimensionKey;
+            getDimensionForCondition(whatKey.getValues(), mMetric2ConditionLinks[0],
+                                     &linkedConditionDimensionKey);
+            mWhatKeysByLinkedConditionKey[linkedConditionDimensionKey].insert(whatKey);
+        }
     }
 
     auto it = mCurrentSlicedDurationTrackerMap.find(whatKey);
@@ -738,7 +843,7 @@ void DurationMetricProducer::handleMatchedLogEventValuesLocked(const size_t matc
             whatIt->second->noteStopAll(eventTimeNs);
             if (!whatIt->second->hasAccumulatedDuration()) {
                 VLOG("erase bucket for key %s", whatIt->first.toString().c_str());
-                whatIt = mCurrentSlicedDurationTrackerMap.erase(whatIt);
+                whatIt = eraseDurationTrackerLocked(whatIt);
             } else {
                 whatIt++;
             }
@@ -797,7 +902,7 @@ void DurationMetricProducer::handleMatchedLogEventValuesLocked(const size_t matc
                 whatIt->second->noteStop(dimensionInWhat, eventTimeNs, false);
                 if (!whatIt->second->hasAccumulatedDuration()) {
                     VLOG("erase bucket for key %s", whatIt->first.toString().c_str());
-                    mCurrentSlicedDurationTrackerMap.erase(whatIt);
+                    eraseDurationTrackerLocked(whatIt);
                 }
             }
             return;
@@ -813,7 +918,7 @@ void DurationMetricProducer::handleMatchedLogEventValuesLocked(const size_t matc
             whatIt->second->noteStop(internalDimensionKey, eventTimeNs, false);
             if (!whatIt->second->hasAccumulatedDuration()) {
                 VLOG("erase bucket for key %s", whatIt->first.toString().c_str());
-                mCurrentSlicedDurationTrackerMap.erase(whatIt);
+                eraseDurationTrackerLocked(whatIt);
             }
         }
         return;
@@ -842,11 +947,16 @@ void DurationMetricProducer::handleMatchedLogEventValuesLocked(const size_t matc
 }
 
 size_t DurationMetricProducer::byteSizeLocked() const {
-    size_t totalSize = 0;
-    for (const auto& pair : mPastBuckets) {
-        totalSize += pair.second.size() * kBucketSize;
+    return mPastBucketsByteSize;
+}
+
+bool DurationMetricProducer::hasUidInCurrentDimensionsLocked(const int32_t uid) const {
+    for (const auto& [whatKey, _] : mCurrentSlicedDurationTrackerMap) {
+        if (containsUid(whatKey, uid)) {
+            return true;
+        }
     }
-    return totalSize;
+    return false;
 }
 
 }  // namespace statsd
@@ -19,10 +19,12 @@
 #include <android/util/ProtoOutputStream.h>
 
 #include <unordered_map>
+#include <unordered_set>
 
 #include "../anomaly/DurationAnomalyTracker.h"
 #include "../condition/ConditionTracker.h"
 #include "../matchers/matcher_util.h"
+#include "EncodedPastBuckets.h"
 #include "MetricProducer.h"
 #include "duration_helper/DurationTracker.h"
 #include "duration_helper/MaxDurationTracker.h"
@@ -62,6 +64,10 @@ public:
                         const HashableDimensionKey& primaryKey, const FieldValue& oldState,
                         const FieldValue& newState) override;
 
+    // Flushes once and visits the duration trackers once for all the changes.
+    void onStatesChanged(const int64_t eventTimeNs, const int32_t atomId,
+                         std::span<const StateChange> changes) override;
+
     MetricType getMetricType() const override {
         return METRIC_TYPE_DURATION;
     }
@@ -89,7 +95,7 @@ private:
                             const bool include_current_partial_bucket,
                             const bool erase_data,
                             const DumpLatency dumpLatency,
-                            std::set<string> *str_set,
+                            ReportStringTable* str_set,
                             android::util::ProtoOutputStream* protoOutput) override;
 
     void clearPastBucketsLocked(const int64_t dumpTimeNs) override;
@@ -107,9 +113,28 @@ private:
 
     void onSlicedConditionMayChangeLocked_opt1(const int64_t eventTime);
 
+    // True if the what keys of the duration trackers are indexed by their linked condition key
+    // in mWhatKeysByLinkedConditionKey, which is what onSlicedConditionMayChangeLocked_opt1 needs.
+    bool indexesLinkedConditionKeys() const {
+        return mMetric2ConditionLinks.size() == 1 && mHasLinksToAllConditionDimensionsInTracker;
+    }
+
+    // Removes the duration tracker from mCurrentSlicedDurationTrackerMap and its what key from
+    // mWhatKeysByLinkedConditionKey. Returns the iterator following the removed tracker.
+    std::unordered_map<HashableDimensionKey, std::unique_ptr<DurationTracker>>::iterator
+    eraseDurationTrackerLocked(
+            std::unordered_map<HashableDimensionKey,
+                               std::unique_ptr<DurationTracker>>::iterator whatIt);
+
     // Internal function to calculate the current used bytes.
     size_t byteSizeLocked() const override;
 
+    bool hasUidInCurrentDimensionsLocked(const int32_t uid) const override;
+
+    size_t getCurrentDimensionCountLocked() const override {
+        return mCurrentSlicedDurationTrackerMap.size();
+    }
+
     void dumpStatesLocked(int out, bool verbose) const override;
 
     void dropDataLocked(const int64_t dropTimeNs) override;
@@ -166,10 +191,26 @@ private:
     // Save the past buckets and we can clear when the StatsLogReport is dumped.
     std::unordered_map<MetricDimensionKey, std::vector<DurationBucket>> mPastBuckets;
 
+    // Whether the finished buckets are kept in mEncodedPastBuckets instead of mPastBuckets.
+    const bool mEncodePastBuckets;
+
+    // Finished buckets with their duration and condition true duration.
+    EncodedPastBuckets mEncodedPastBuckets;
+
+    // Writes the DurationBucketInfo message of the bucket.
+    void writeBucketInfoToProto(const DurationBucket& bucket,
+                                android::util::ProtoOutputStream* protoOutput) const;
+
     // The duration trackers in the current bucket.
     std::unordered_map<HashableDimensionKey, std::unique_ptr<DurationTracker>>
             mCurrentSlicedDurationTrackerMap;
 
+    // What keys of mCurrentSlicedDurationTrackerMap by the condition dimensions they are linked
+    // to, so that a sliced condition change only visits the trackers of the changed dimensions.
+    // Only maintained if indexesLinkedConditionKeys().
+    std::unordered_map<HashableDimensionKey, std::unordered_set<HashableDimensionKey>>
+            mWhatKeysByLinkedConditionKey;
+
     const size_t mDimensionHardLimit;
 
     // Helper function to create a duration tracker given the metric aggregation type.
@@ -188,6 +229,8 @@ private:
 
     FRIEND_TEST(DurationMetricProducerTest, TestSumDurationAppUpgradeSplitDisabled);
     FRIEND_TEST(DurationMetricProducerTest, TestClearCurrentSlicedTrackerMapWhenStop);
+    FRIEND_TEST(DurationMetricProducerTest, TestLinkedConditionKeyIndex);
+    FRIEND_TEST(DurationMetricProducerTest, TestEncodePastBuckets);
     FRIEND_TEST(DurationMetricProducerTest_PartialBucket, TestSumDuration);
     FRIEND_TEST(DurationMetricProducerTest_PartialBucket,
                 TestSumDurationWithSplitInFollowingBucket);
@@ -200,6 +243,7 @@ private:
     FRIEND_TEST(MetricsManagerUtilDimLimitTest, TestDimLimit);
 
     FRIEND_TEST(ConfigUpdateDimLimitTest, TestDimLimit);
+    FRIEND_TEST(DurationMetricE2eTest, TestWithSlicedState);
 };
 
 }  // namespace statsd
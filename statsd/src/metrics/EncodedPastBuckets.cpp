@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "EncodedPastBuckets.h"
+
+#include <varint.h>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+size_t EncodedPastBuckets::add(const MetricDimensionKey& dimensionKey, int64_t bucketStartNs,
+                               int64_t bucketEndNs, std::initializer_list<int64_t> values) {
+    size_t bytes = 0;
+    // All the dimensions flushed together share the window of the bucket.
+    const std::pair<int64_t, int64_t> bucketWindow(bucketStartNs, bucketEndNs);
+    if (mWindows.empty() || mWindows.back() != bucketWindow) {
+        mWindows.push_back(bucketWindow);
+        bytes += sizeof(bucketWindow);
+    }
+    const size_t windowIndex = mWindows.size() - 1;
+
+    Dimension& dimension = mDimensions[dimensionKey];
+    char buffer[Varint::kMax64];
+    char* end = Varint::Encode64(buffer, windowIndex - dimension.numWindows);
+    dimension.data.insert(dimension.data.end(), buffer, end);
+    bytes += end - buffer;
+    for (const int64_t value : values) {
+        end = Varint::Encode64(buffer, static_cast<uint64_t>(value));
+        dimension.data.insert(dimension.data.end(), buffer, end);
+        bytes += end - buffer;
+    }
+    dimension.numWindows = windowIndex + 1;
+    return bytes;
+}
+
+void EncodedPastBuckets::clear() {
+    mDimensions.clear();
+    mWindows.clear();
+}
+
+uint64_t EncodedPastBuckets::decodeVarint64(const char** ptr) {
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t byte = static_cast<uint8_t>(*(*ptr)++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include "HashableDimensionKey.h"
+#include "utils/FlatHashMap.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Finished buckets of a metric encoded as varints, for the metrics that hold many buckets
+ * between two reports. The start and end times of the buckets are shared by all the dimensions
+ * flushed together. Each bucket of a dimension is written as the number of bucket windows
+ * skipped since the previous bucket of the dimension, followed by its values.
+ *
+ * The values are encoded as unsigned varints, negative values are valid but take 10 bytes.
+ * Not thread safe.
+ */
+class EncodedPastBuckets {
+public:
+    // Buckets of a dimension.
+    struct Dimension {
+        std::vector<char> data;
+        // Number of bucket windows up to and including the last bucket of the dimension.
+        size_t numWindows = 0;
+    };
+
+    // Encodes a bucket of the dimension. Returns the number of bytes used by the bucket.
+    size_t add(const MetricDimensionKey& dimensionKey, int64_t bucketStartNs, int64_t bucketEndNs,
+               std::initializer_list<int64_t> values);
+
+    // Calls fn(bucketStartNs, bucketEndNs, values) for each bucket of the dimension, where values
+    // points to the numValues values of the bucket as passed to add().
+    template <typename Fn>
+    void forEachBucket(const Dimension& dimension, size_t numValues, Fn fn) const {
+        std::vector<int64_t> values(numValues);
+        const char* ptr = dimension.data.data();
+        const char* const end = ptr + dimension.data.size();
+        size_t window = 0;
+        while (ptr < end) {
+            window += decodeVarint64(&ptr);
+            for (int64_t& value : values) {
+                value = static_cast<int64_t>(decodeVarint64(&ptr));
+            }
+            fn(mWindows[window].first, mWindows[window].second, values.data());
+            window++;
+        }
+    }
+
+    const FlatHashMap<MetricDimensionKey, Dimension>& getDimensions() const {
+        return mDimensions;
+    }
+
+    size_t getNumWindows() const {
+        return mWindows.size();
+    }
+
+    bool empty() const {
+        return mDimensions.empty();
+    }
+
+    void clear();
+
+private:
+    // Decodes a varint written by Varint::Encode64() and moves ptr past it.
+    static uint64_t decodeVarint64(const char** ptr);
+
+    FlatHashMap<MetricDimensionKey, Dimension> mDimensions;
+
+    // Start and end times of the buckets, shared by all the dimensions.
+    std::vector<std::pair<int64_t, int64_t>> mWindows;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -50,6 +50,7 @@ const int FIELD_ID_EVENT_METRICS = 4;
 const int FIELD_ID_IS_ACTIVE = 14;
 // for EventMetricDataWrapper
 const int FIELD_ID_DATA = 1;
+const int FIELD_ID_EVICTED_ATOM_COUNT = 2;
 // for EventMetricData
 const int FIELD_ID_AGGREGATED_ATOM = 4;
 // for AggregatedAtomInfo
@@ -67,7 +68,9 @@ EventMetricProducer::EventMetricProducer(
     : MetricProducer(metric.id(), key, startTimeNs, conditionIndex, initialConditionCache, wizard,
                      protoHash, eventActivationMap, eventDeactivationMap, slicedStateAtoms,
                      stateGroupMap, /*splitBucketForAppUpgrade=*/nullopt),
-      mSamplingPercentage(metric.sampling_percentage()) {
+      mSamplingPercentage(metric.sampling_percentage()),
+      mMaxBytes(metric.has_max_bytes() ? std::make_optional<size_t>(metric.max_bytes())
+                                       : std::nullopt) {
     if (metric.links().size() > 0) {
         for (const auto& link : metric.links()) {
             Metric2Condition mc;
@@ -135,6 +138,7 @@ optional<InvalidConfigReason> EventMetricProducer::onConfigUpdatedLocked(
 
 void EventMetricProducer::dropDataLocked(const int64_t dropTimeNs) {
     mAggregatedAtoms.clear();
+    mAtomsInArrivalOrder.clear();
     mTotalSize = 0;
     StatsdStats::getInstance().noteBucketDropped(mMetricId);
 }
@@ -162,6 +166,8 @@ std::unique_ptr<std::vector<uint8_t>> serializeProtoLocked(ProtoOutputStream& pr
 
 void EventMetricProducer::clearPastBucketsLocked(const int64_t dumpTimeNs) {
     mAggregatedAtoms.clear();
+    mAtomsInArrivalOrder.clear();
+    mNumEvictedAtoms = 0;
     mTotalSize = 0;
 }
 
@@ -169,7 +175,7 @@ void EventMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
                                              const bool include_current_partial_bucket,
                                              const bool erase_data,
                                              const DumpLatency dumpLatency,
-                                             std::set<string> *str_set,
+                                             ReportStringTable* str_set,
                                              ProtoOutputStream* protoOutput) {
     protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_ID, (long long)mMetricId);
     protoOutput->write(FIELD_TYPE_BOOL | FIELD_ID_IS_ACTIVE, isActiveLocked());
@@ -192,9 +198,15 @@ void EventMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
         protoOutput->end(aggregatedToken);
         protoOutput->end(wrapperToken);
     }
+    if (mNumEvictedAtoms > 0) {
+        protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_EVICTED_ATOM_COUNT,
+                           (long long)mNumEvictedAtoms);
+    }
     protoOutput->end(protoToken);
     if (erase_data) {
         mAggregatedAtoms.clear();
+        mAtomsInArrivalOrder.clear();
+        mNumEvictedAtoms = 0;
         mTotalSize = 0;
     }
 }
@@ -220,12 +232,35 @@ void EventMetricProducer::onMatchedLogEventInternalLocked(
     const int64_t elapsedTimeNs = truncateTimestampIfNecessary(event);
     AtomDimensionKey key(event.GetTagId(), HashableDimensionKey(event.getValues()));
 
-    std::vector<int64_t>& aggregatedTimestampsNs = mAggregatedAtoms[key];
-    if (aggregatedTimestampsNs.empty()) {
-        mTotalSize += getSize(key.getAtomFieldValues().getValues());
+    const auto [it, inserted] = mAggregatedAtoms.try_emplace(std::move(key));
+    if (inserted) {
+        mTotalSize += getSize(it->first.getAtomFieldValues().getValues());
     }
-    aggregatedTimestampsNs.push_back(elapsedTimeNs);
+    it->second.push_back(elapsedTimeNs);
     mTotalSize += sizeof(int64_t); // Add the size of the event timestamp
+
+    if (mMaxBytes) {
+        // Pointers to the keys of an unordered_map stay valid until the keys are erased.
+        mAtomsInArrivalOrder.push_back(&it->first);
+        mTotalSize += sizeof(const AtomDimensionKey*);
+        evictOldestAtomsLocked();
+    }
+}
+
+void EventMetricProducer::evictOldestAtomsLocked() {
+    while (mTotalSize > *mMaxBytes && !mAtomsInArrivalOrder.empty()) {
+        auto it = mAggregatedAtoms.find(*mAtomsInArrivalOrder.front());
+        mAtomsInArrivalOrder.pop_front();
+        mTotalSize -= sizeof(int64_t) + sizeof(const AtomDimensionKey*);
+        // The timestamps of an atom are in arrival order too.
+        std::vector<int64_t>& timestampsNs = it->second;
+        timestampsNs.erase(timestampsNs.begin());
+        if (timestampsNs.empty()) {
+            mTotalSize -= getSize(it->first.getAtomFieldValues().getValues());
+            mAggregatedAtoms.erase(it);
+        }
+        mNumEvictedAtoms++;
+    }
 }
 
 size_t EventMetricProducer::byteSizeLocked() const {
@@ -17,6 +17,7 @@
 #ifndef EVENT_METRIC_PRODUCER_H
 #define EVENT_METRIC_PRODUCER_H
 
+#include <deque>
 #include <unordered_map>
 
 #include <android/util/ProtoOutputStream.h>
@@ -50,6 +51,11 @@ public:
         return METRIC_TYPE_EVENT;
     }
 
+    // The events are reported as they are logged, so any event after the dump is held back.
+    int64_t getDumpCutEndNs(int64_t dumpTimeNs) const override {
+        return dumpTimeNs + 1;
+    }
+
 protected:
     size_t mTotalSize;
 
@@ -63,7 +69,7 @@ private:
                             const bool include_current_partial_bucket,
                             const bool erase_data,
                             const DumpLatency dumpLatency,
-                            std::set<string> *str_set,
+                            ReportStringTable* str_set,
                             android::util::ProtoOutputStream* protoOutput) override;
     void clearPastBucketsLocked(const int64_t dumpTimeNs) override;
 
@@ -96,10 +102,23 @@ private:
 
     void dumpStatesLocked(int out, bool verbose) const override{};
 
+    // Evicts the oldest atoms until the metric fits in mMaxBytes.
+    void evictOldestAtomsLocked();
+
     // Maps the field/value pairs of an atom to a list of timestamps used to deduplicate atoms.
     std::unordered_map<AtomDimensionKey, std::vector<int64_t>> mAggregatedAtoms;
 
     const int mSamplingPercentage;
+
+    // EventMetric.max_bytes, if set.
+    const std::optional<size_t> mMaxBytes;
+
+    // Keys of mAggregatedAtoms for each of their timestamps, oldest first. Only used with
+    // mMaxBytes to evict the oldest atoms. The keys are owned by mAggregatedAtoms.
+    std::deque<const AtomDimensionKey*> mAtomsInArrivalOrder;
+
+    // Atoms evicted since the last report.
+    int64_t mNumEvictedAtoms = 0;
 };
 
 }  // namespace statsd
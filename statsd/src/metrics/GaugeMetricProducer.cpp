@@ -19,6 +19,7 @@
 
 #include "GaugeMetricProducer.h"
 
+#include "condition/EventConditionCache.h"
 #include "guardrail/StatsdStats.h"
 #include "metrics/parsing_utils/metrics_manager_util.h"
 #include "stats_log_util.h"
@@ -69,6 +70,8 @@ const int FIELD_ID_BUCKET_NUM = 6;
 const int FIELD_ID_START_BUCKET_ELAPSED_MILLIS = 7;
 const int FIELD_ID_END_BUCKET_ELAPSED_MILLIS = 8;
 const int FIELD_ID_AGGREGATED_ATOM = 9;
+const int FIELD_ID_SAMPLED_ATOM_COUNT = 10;
+const int FIELD_ID_CONDITION_TRUE_NS = 11;
 // for AggregatedAtomInfo
 const int FIELD_ID_ATOM_VALUE = 1;
 const int FIELD_ID_ATOM_TIMESTAMPS = 2;
@@ -100,6 +103,7 @@ GaugeMetricProducer::GaugeMetricProducer(
       mDimensionSoftLimit(dimensionSoftLimit),
       mDimensionHardLimit(dimensionHardLimit),
       mGaugeAtomsPerDimensionLimit(metric.max_num_gauge_atoms_per_bucket()),
+      mUseReservoirSampling(metric.use_reservoir_sampling()),
       mDimensionGuardrailHit(false),
       mSamplingPercentage(metric.sampling_percentage()) {
     mCurrentSlicedBucket = std::make_shared<DimToGaugeAtomsMap>();
@@ -142,6 +146,9 @@ GaugeMetricProducer::GaugeMetricProducer(
 
     // Adjust start for partial first bucket and then pull if needed
     mCurrentBucketStartTimeNs = startTimeNs;
+    mConditionTimer.newBucketStart(mCurrentBucketStartTimeNs, mCurrentBucketStartTimeNs);
+    mConditionTimer.onConditionChanged(mIsActive && mCondition == ConditionState::kTrue,
+                                       mCurrentBucketStartTimeNs);
 
     VLOG("Gauge metric %lld created. bucket size %lld start_time: %lld sliced %d",
          (long long)mMetricId, (long long)mBucketSizeNs, (long long)mTimeBaseNs, mConditionSliced);
@@ -239,6 +246,8 @@ void GaugeMetricProducer::dumpStatesLocked(int out, bool verbose) const {
 void GaugeMetricProducer::clearPastBucketsLocked(const int64_t dumpTimeNs) {
     flushIfNeededLocked(dumpTimeNs);
     mPastBuckets.clear();
+    mInternedAtomValues.clear();
+    mPastBucketsByteSize = 0;
     mSkippedBuckets.clear();
 }
 
@@ -246,7 +255,7 @@ void GaugeMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
                                              const bool include_current_partial_bucket,
                                              const bool erase_data,
                                              const DumpLatency dumpLatency,
-                                             std::set<string> *str_set,
+                                             ReportStringTable* str_set,
                                              ProtoOutputStream* protoOutput) {
     VLOG("Gauge metric %lld report now...", (long long)mMetricId);
     if (include_current_partial_bucket) {
@@ -352,6 +361,15 @@ void GaugeMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
                     protoOutput->end(aggregatedAtomToken);
                 }
             }
+            if (bucket.mSampledAtomCount > 0) {
+                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_SAMPLED_ATOM_COUNT,
+                                   (long long)bucket.mSampledAtomCount);
+            }
+            // Same as CountMetricProducer, the condition timer is not sliced by condition.
+            if (mConditionTrackerIndex >= 0 && !mConditionSliced) {
+                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_CONDITION_TRUE_NS,
+                                   (long long)bucket.mConditionTrueNs);
+            }
 
             protoOutput->end(bucketInfoToken);
             VLOG("Gauge \t bucket [%lld - %lld] includes %d atoms.",
@@ -365,6 +383,8 @@ void GaugeMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
 
     if (erase_data) {
         mPastBuckets.clear();
+        mInternedAtomValues.clear();
+        mPastBucketsByteSize = 0;
         mSkippedBuckets.clear();
         mDimensionGuardrailHit = false;
     }
@@ -409,6 +429,8 @@ void GaugeMetricProducer::pullAndMatchEventsLocked(const int64_t timestampNs) {
         StatsdStats::getInstance().notePullExceedMaxDelay(mPullTagId);
         return;
     }
+    // The local copies don't outlive the loop, so their condition queries can't be cached.
+    EventConditionCache::Scope noConditionCache(/*enabled=*/false);
     for (const auto& data : allData) {
         const auto [matchResult, transformedEvent] =
                 mEventMatcherWizard->matchLogEvent(*data, mWhatMatcherIndex);
@@ -420,6 +442,22 @@ void GaugeMetricProducer::pullAndMatchEventsLocked(const int64_t timestampNs) {
     }
 }
 
+optional<int> GaugeMetricProducer::getTriggeredPullAtomIdLocked(const LogEvent& event) const {
+    // Same checks as onMatchedLogEventLocked() and pullAndMatchEventsLocked().
+    const int64_t eventTimeNs = event.GetElapsedTimestampNs();
+    if (!mIsPulled || mTriggerAtomId != event.GetTagId() || !mIsActive || mConditionSliced ||
+        mCondition != ConditionState::kTrue || eventTimeNs < mCurrentBucketStartTimeNs ||
+        !passesSampleCheckLocked(event.getValues())) {
+        return nullopt;
+    }
+    // A random sample is pulled once per bucket.
+    if (mSamplingType == GaugeMetric::RANDOM_ONE_SAMPLE && !mCurrentSlicedBucket->empty() &&
+        eventTimeNs < getCurrentBucketEndTimeNs()) {
+        return nullopt;
+    }
+    return mPullTagId;
+}
+
 void GaugeMetricProducer::onActiveStateChangedLocked(const int64_t eventTimeNs,
                                                      const bool isActive) {
     MetricProducer::onActiveStateChangedLocked(eventTimeNs, isActive);
@@ -428,6 +466,7 @@ void GaugeMetricProducer::onActiveStateChangedLocked(const int64_t eventTimeNs,
         return;
     }
 
+    mConditionTimer.onConditionChanged(isActive, eventTimeNs);
     if (isActive && mIsPulled && isRandomNSamples()) {
         pullAndMatchEventsLocked(eventTimeNs);
     }
@@ -443,6 +482,7 @@ void GaugeMetricProducer::onConditionChangedLocked(const bool conditionMet,
     }
 
     flushIfNeededLocked(eventTimeNs);
+    mConditionTimer.onConditionChanged(conditionMet, eventTimeNs);
     if (conditionMet && mIsPulled &&
         (isRandomNSamples() || mSamplingType == GaugeMetric::CONDITION_CHANGE_TO_TRUE)) {
         pullAndMatchEventsLocked(eventTimeNs);
@@ -459,6 +499,7 @@ void GaugeMetricProducer::onSlicedConditionMayChangeLocked(bool overallCondition
     }
 
     flushIfNeededLocked(eventTimeNs);
+    mConditionTimer.onConditionChanged(overallCondition, eventTimeNs);
     // If the condition is sliced, mCondition is true if any of the dimensions is true. And we will
     // pull for every dimension.
     if (overallCondition && mIsPulled && mTriggerAtomId == -1) {
@@ -574,13 +615,27 @@ void GaugeMetricProducer::onMatchedLogEventInternalLocked(
     if (hitGuardRailLocked(eventKey)) {
         return;
     }
-    if ((*mCurrentSlicedBucket)[eventKey].size() >= mGaugeAtomsPerDimensionLimit) {
+    std::vector<GaugeAtom>& gaugeAtoms = (*mCurrentSlicedBucket)[eventKey];
+    size_t atomIndex = gaugeAtoms.size();
+    if (mUseReservoirSampling) {
+        // Algorithm R: once the dimension is full, its n-th atom replaces a random stored atom
+        // with probability mGaugeAtomsPerDimensionLimit / n.
+        const int64_t sampledAtomCount = ++mCurrentSampledAtomCounts[eventKey];
+        if (gaugeAtoms.size() >= mGaugeAtomsPerDimensionLimit) {
+            atomIndex = rand() % sampledAtomCount;
+        }
+    }
+    if (atomIndex >= mGaugeAtomsPerDimensionLimit) {
         return;
     }
 
     const int64_t truncatedElapsedTimestampNs = truncateTimestampIfNecessary(event);
     GaugeAtom gaugeAtom(getGaugeFields(event), truncatedElapsedTimestampNs);
-    (*mCurrentSlicedBucket)[eventKey].push_back(gaugeAtom);
+    if (atomIndex < gaugeAtoms.size()) {
+        gaugeAtoms[atomIndex] = gaugeAtom;
+    } else {
+        gaugeAtoms.push_back(gaugeAtom);
+    }
     // Anomaly detection on gauge metric only works when there is one numeric
     // field specified.
     if (mAnomalyTrackers.size() > 0) {
@@ -620,6 +675,25 @@ void GaugeMetricProducer::dropDataLocked(const int64_t dropTimeNs) {
     flushIfNeededLocked(dropTimeNs);
     StatsdStats::getInstance().noteBucketDropped(mMetricId);
     mPastBuckets.clear();
+    mInternedAtomValues.clear();
+    mPastBucketsByteSize = 0;
+}
+
+shared_ptr<const HashableDimensionKey> GaugeMetricProducer::internAtomValuesLocked(
+        const vector<FieldValue>& fields) {
+    HashableDimensionKey atomValues(fields);
+    const size_t hash = std::hash<HashableDimensionKey>()(atomValues);
+    const auto [begin, end] = mInternedAtomValues.equal_range(hash);
+    for (auto it = begin; it != end; it++) {
+        if (*it->second == atomValues) {
+            return it->second;
+        }
+    }
+    // The values of identical atoms are only stored once.
+    mPastBucketsByteSize += sizeof(FieldValue) * atomValues.getValues().size();
+    return mInternedAtomValues
+            .emplace(hash, std::make_shared<const HashableDimensionKey>(std::move(atomValues)))
+            ->second;
 }
 
 // When a new matched event comes in, we check if event falls into the current
@@ -654,6 +728,8 @@ void GaugeMetricProducer::flushCurrentBucketLocked(const int64_t eventTimeNs,
     GaugeBucket info;
     info.mBucketStartNs = mCurrentBucketStartTimeNs;
     info.mBucketEndNs = bucketEndTime;
+    info.mConditionTrueNs =
+            mConditionTimer.newBucketStart(eventTimeNs, nextBucketStartTimeNs).mDurationNs;
 
     // Add bucket to mPastBuckets if bucket is large enough.
     // Otherwise, drop the bucket data and add bucket metadata to mSkippedBuckets.
@@ -662,10 +738,16 @@ void GaugeMetricProducer::flushCurrentBucketLocked(const int64_t eventTimeNs,
         for (const auto& slice : *mCurrentSlicedBucket) {
             info.mAggregatedAtoms.clear();
             for (const GaugeAtom& atom : slice.second) {
-                AtomDimensionKey key(mAtomId, HashableDimensionKey(*atom.mFields));
+                AtomDimensionKey key(mAtomId, internAtomValuesLocked(*atom.mFields));
                 vector<int64_t>& elapsedTimestampsNs = info.mAggregatedAtoms[key];
                 elapsedTimestampsNs.push_back(atom.mElapsedTimestampNs);
             }
+            mPastBucketsByteSize += sizeof(int64_t) * slice.second.size();
+            if (mUseReservoirSampling) {
+                const auto countIt = mCurrentSampledAtomCounts.find(slice.first);
+                info.mSampledAtomCount =
+                        countIt == mCurrentSampledAtomCounts.end() ? 0 : countIt->second;
+            }
             auto& bucketList = mPastBuckets[slice.first];
             bucketList.push_back(info);
             VLOG("Gauge gauge metric %lld, dump key value: %s", (long long)mMetricId,
@@ -696,6 +778,7 @@ void GaugeMetricProducer::flushCurrentBucketLocked(const int64_t eventTimeNs,
 
     StatsdStats::getInstance().noteBucketCount(mMetricId);
     mCurrentSlicedBucket = std::make_shared<DimToGaugeAtomsMap>();
+    mCurrentSampledAtomCounts.clear();
     mCurrentBucketStartTimeNs = nextBucketStartTimeNs;
     mCurrentSkippedBucket.reset();
     // Reset mHasHitGuardrail boolean since bucket was reset
@@ -703,17 +786,24 @@ void GaugeMetricProducer::flushCurrentBucketLocked(const int64_t eventTimeNs,
 }
 
 size_t GaugeMetricProducer::byteSizeLocked() const {
-    size_t totalSize = 0;
-    for (const auto& pair : mPastBuckets) {
-        for (const auto& bucket : pair.second) {
-            for (const auto& [atomDimensionKey, elapsedTimestampsNs] : bucket.mAggregatedAtoms) {
-                totalSize += sizeof(FieldValue) *
-                             atomDimensionKey.getAtomFieldValues().getValues().size();
-                totalSize += sizeof(int64_t) * elapsedTimestampsNs.size();
-            }
+    return mPastBucketsByteSize;
+}
+
+bool GaugeMetricProducer::hasUidInCurrentDimensionsLocked(const int32_t uid) const {
+    for (const auto& [dimensionKey, _] : *mCurrentSlicedBucket) {
+        if (containsUid(dimensionKey.getDimensionKeyInWhat(), uid)) {
+            return true;
         }
     }
-    return totalSize;
+    return false;
+}
+
+size_t GaugeMetricProducer::getCurrentAtomCountLocked() const {
+    size_t atomCount = 0;
+    for (const auto& [dimensionKey, gaugeAtoms] : *mCurrentSlicedBucket) {
+        atomCount += gaugeAtoms.size();
+    }
+    return atomCount;
 }
 
 }  // namespace statsd
@@ -28,6 +28,7 @@
 #include "MetricProducer.h"
 #include "src/statsd_config.pb.h"
 #include "../stats_util.h"
+#include "../utils/FlatHashMap.h"
 
 namespace android {
 namespace os {
@@ -48,10 +49,14 @@ struct GaugeBucket {
 
     // Maps the field/value pairs of an atom to a list of timestamps used to deduplicate atoms.
     std::unordered_map<AtomDimensionKey, std::vector<int64_t>> mAggregatedAtoms;
+
+    // Number of atoms seen for the dimension when the atoms are sampled with a reservoir.
+    int64_t mSampledAtomCount = 0;
+
+    int64_t mConditionTrueNs = 0;
 };
 
-typedef std::unordered_map<MetricDimensionKey, std::vector<GaugeAtom>>
-    DimToGaugeAtomsMap;
+typedef FlatHashMap<MetricDimensionKey, std::vector<GaugeAtom>> DimToGaugeAtomsMap;
 
 // This gauge metric producer first register the puller to automatically pull the gauge at the
 // beginning of each bucket. If the condition is met, insert it to the bucket info. Otherwise
@@ -117,7 +122,7 @@ private:
                             const bool include_current_partial_bucket,
                             const bool erase_data,
                             const DumpLatency dumpLatency,
-                            std::set<string> *str_set,
+                            ReportStringTable* str_set,
                             android::util::ProtoOutputStream* protoOutput) override;
     void clearPastBucketsLocked(const int64_t dumpTimeNs) override;
 
@@ -133,6 +138,14 @@ private:
     // Internal function to calculate the current used bytes.
     size_t byteSizeLocked() const override;
 
+    bool hasUidInCurrentDimensionsLocked(const int32_t uid) const override;
+
+    size_t getCurrentDimensionCountLocked() const override {
+        return mCurrentSlicedBucket->size();
+    }
+
+    size_t getCurrentAtomCountLocked() const override;
+
     void dumpStatesLocked(int out, bool verbose) const override;
 
     void dropDataLocked(const int64_t dropTimeNs) override;
@@ -147,6 +160,9 @@ private:
     // Only call if mCondition == ConditionState::kTrue && metric is active.
     void pullAndMatchEventsLocked(const int64_t timestampNs);
 
+    // Returns the pulled atom if the event triggers a pull, an unsliced condition is assumed.
+    std::optional<int> getTriggeredPullAtomIdLocked(const LogEvent& event) const override;
+
     optional<InvalidConfigReason> onConfigUpdatedLocked(
             const StatsdConfig& config, int configIndex, int metricIndex,
             const std::vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
@@ -186,7 +202,7 @@ private:
     const bool mIsPulled;
 
     // Save the past buckets and we can clear when the StatsLogReport is dumped.
-    std::unordered_map<MetricDimensionKey, std::vector<GaugeBucket>> mPastBuckets;
+    FlatHashMap<MetricDimensionKey, std::vector<GaugeBucket>> mPastBuckets;
 
     // The current partial bucket.
     std::shared_ptr<DimToGaugeAtomsMap> mCurrentSlicedBucket;
@@ -211,6 +227,16 @@ private:
     // apply an allowlist on the original input
     std::shared_ptr<vector<FieldValue>> getGaugeFields(const LogEvent& event);
 
+    // Returns the values shared by the identical atoms of mPastBuckets.
+    std::shared_ptr<const HashableDimensionKey> internAtomValuesLocked(
+            const vector<FieldValue>& fields);
+
+    // Values of the atoms in mPastBuckets by hash. Identical atoms of all the dimensions and
+    // buckets share their values, so repeated snapshots only cost a pointer and timestamps.
+    // Cleared along with mPastBuckets, which is the only other holder of the values.
+    std::unordered_multimap<size_t, std::shared_ptr<const HashableDimensionKey>>
+            mInternedAtomValues;
+
     // Util function to check whether the specified dimension hits the guardrail.
     bool hitGuardRailLocked(const MetricDimensionKey& newKey);
 
@@ -222,6 +248,13 @@ private:
 
     const size_t mGaugeAtomsPerDimensionLimit;
 
+    // Whether atoms beyond mGaugeAtomsPerDimensionLimit replace random stored atoms.
+    const bool mUseReservoirSampling;
+
+    // Number of atoms seen by each dimension of the current bucket. Only used with reservoir
+    // sampling.
+    FlatHashMap<MetricDimensionKey, int64_t> mCurrentSampledAtomCounts;
+
     // Tracks if the dimension guardrail has been hit in the current report.
     bool mDimensionGuardrailHit;
 
@@ -237,6 +270,9 @@ private:
     FRIEND_TEST(GaugeMetricProducerTest, TestPullNWithoutTrigger);
     FRIEND_TEST(GaugeMetricProducerTest, TestRemoveDimensionInOutput);
     FRIEND_TEST(GaugeMetricProducerTest, TestPullDimensionalSampling);
+    FRIEND_TEST(GaugeMetricProducerTest, TestReservoirSampling);
+    FRIEND_TEST(GaugeMetricProducerTest, TestAtomValuesSharedAcrossDimensions);
+    FRIEND_TEST(GaugeMetricProducerTest, TestConditionTrueNs);
 
     FRIEND_TEST(GaugeMetricProducerTest_PartialBucket, TestPushedEvents);
     FRIEND_TEST(GaugeMetricProducerTest_PartialBucket, TestPulled);
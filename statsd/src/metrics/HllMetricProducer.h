@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/util/ProtoOutputStream.h>
+#include <gtest/gtest_prod.h>
+
+#include <optional>
+
+#include "MetricProducer.h"
+#include "ValueMetricProducer.h"
+#include "condition/ConditionTimer.h"
+#include "condition/ConditionTracker.h"
+#include "matchers/EventMatcherWizard.h"
+#include "src/statsd_config.pb.h"
+#include "stats_log_util.h"
+#include "utils/HyperLogLog.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+// Uses HyperLogLog to count the distinct values of a field within buckets, in a fixed size per
+// bucket and dimension instead of one dimension per value.
+//
+// There are different events that might complete a bucket
+// - a condition change
+// - an app upgrade
+// - an alarm set to the end of the bucket
+class HllMetricProducer : public ValueMetricProducer<std::unique_ptr<HyperLogLog>, Empty> {
+public:
+    HllMetricProducer(const ConfigKey& key, const HllMetric& hllMetric, const uint64_t protoHash,
+                      const PullOptions& pullOptions, const BucketOptions& bucketOptions,
+                      const WhatOptions& whatOptions, const ConditionOptions& conditionOptions,
+                      const StateOptions& stateOptions, const ActivationOptions& activationOptions,
+                      const GuardrailOptions& guardrailOptions);
+
+    inline MetricType getMetricType() const override {
+        return METRIC_TYPE_HLL;
+    }
+
+protected:
+private:
+    inline optional<int64_t> getConditionIdForMetric(const StatsdConfig& config,
+                                                     const int configIndex) const override {
+        const HllMetric& metric = config.hll_metric(configIndex);
+        return metric.has_condition() ? make_optional(metric.condition()) : nullopt;
+    }
+
+    inline int64_t getWhatAtomMatcherIdForMetric(const StatsdConfig& config,
+                                                 const int configIndex) const override {
+        return config.hll_metric(configIndex).what();
+    }
+
+    inline ConditionLinks getConditionLinksForMetric(const StatsdConfig& config,
+                                                     const int configIndex) const override {
+        return config.hll_metric(configIndex).links();
+    }
+
+    // Determine whether or not a LogEvent can be skipped.
+    inline bool canSkipLogEventLocked(
+            const MetricDimensionKey& eventKey, bool condition, int64_t eventTimeNs,
+            const std::map<int, HashableDimensionKey>& statePrimaryKeys) const override {
+        // Can only skip if the condition is false.
+        // We assume metric is pushed since HllMetric doesn't support pulled metrics.
+        return !condition;
+    }
+
+    DumpProtoFields getDumpProtoFields() const override;
+
+    inline std::string aggregatedValueToString(
+            const std::unique_ptr<HyperLogLog>& aggregate) const override {
+        return std::to_string(aggregate->estimate()) + " distinct values";
+    }
+
+    inline bool multipleBucketsSkipped(const int64_t numBucketsForward) const override {
+        // Always false because we assume HllMetric is pushed only for now.
+        return false;
+    }
+
+    // The HyperLogLog ptr ownership is transferred to newly created PastBuckets from Intervals.
+    PastBucket<std::unique_ptr<HyperLogLog>> buildPartialBucket(
+            int64_t bucketEndTime, std::vector<Interval>& intervals) override;
+
+    void writePastBucketAggregateToProto(const int aggIndex,
+                                         const std::unique_ptr<HyperLogLog>& hll,
+                                         const int sampleSize,
+                                         ProtoOutputStream* const protoOutput) const override;
+
+    bool aggregateFields(const int64_t eventTimeNs, const MetricDimensionKey& eventKey,
+                         const LogEvent& event, std::vector<Interval>& intervals,
+                         Empty& empty) override;
+
+    size_t getPastBucketByteSize(
+            const PastBucket<std::unique_ptr<HyperLogLog>>& bucket) const override;
+
+    // Internal function to calculate the current used bytes.
+    size_t byteSizeLocked() const override;
+
+    const int mPrecision;
+
+    FRIEND_TEST(HllMetricProducerTest, TestPushedEventsWithoutCondition);
+    FRIEND_TEST(HllMetricProducerTest, TestByteSize);
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -29,11 +29,15 @@
 using android::util::FIELD_COUNT_REPEATED;
 using android::util::FIELD_TYPE_BYTES;
 using android::util::FIELD_TYPE_INT32;
+using android::util::FIELD_TYPE_INT64;
 using android::util::FIELD_TYPE_MESSAGE;
 using android::util::ProtoOutputStream;
+using std::map;
 using std::nullopt;
 using std::optional;
+using std::pair;
 using std::string;
+using dist_proc::aggregation::KllQuantileOptions;
 using zetasketch::android::AggregatorStateProto;
 
 namespace android {
@@ -42,6 +46,8 @@ namespace statsd {
 
 // for StatsLogReport
 const int FIELD_ID_KLL_METRICS = 16;
+// for KllMetricDataWrapper
+const int FIELD_ID_DIMENSIONS_ROLLUP = 3;
 // for KllBucketInfo
 const int FIELD_ID_SKETCH_INDEX = 1;
 const int FIELD_ID_KLL_SKETCH = 2;
@@ -60,7 +66,8 @@ KllMetricProducer::KllMetricProducer(const ConfigKey& key, const KllMetric& metr
                                      const ActivationOptions& activationOptions,
                                      const GuardrailOptions& guardrailOptions)
     : ValueMetricProducer(metric.id(), key, protoHash, pullOptions, bucketOptions, whatOptions,
-                          conditionOptions, stateOptions, activationOptions, guardrailOptions) {
+                          conditionOptions, stateOptions, activationOptions, guardrailOptions),
+      mEmitDimensionsRollup(metric.emit_dimensions_rollup()) {
 }
 
 KllMetricProducer::DumpProtoFields KllMetricProducer::getDumpProtoFields() const {
@@ -90,6 +97,53 @@ void KllMetricProducer::writePastBucketAggregateToProto(
     protoOutput->end(sketchesToken);
 }
 
+void KllMetricProducer::writePastBucketsExtrasToProto(ProtoOutputStream* const protoOutput) {
+    if (!mEmitDimensionsRollup) {
+        return;
+    }
+
+    // Buckets are split at the same times for all dimensions.
+    map<pair<int64_t, int64_t>, map<int, unique_ptr<KllQuantile>>> rollups;
+    for (const auto& [_, buckets] : mPastBuckets) {
+        for (const auto& bucket : buckets) {
+            auto& bucketRollup = rollups[{bucket.mBucketStartNs, bucket.mBucketEndNs}];
+            for (size_t i = 0; i < bucket.aggIndex.size(); i++) {
+                unique_ptr<KllQuantile>& rollup = bucketRollup[bucket.aggIndex[i]];
+                if (rollup == nullptr) {
+                    rollup = obtainSketchLocked();
+                }
+                // All sketches are created with the default options, so merging cannot fail.
+                rollup->Merge(*bucket.aggregates[i]);
+            }
+        }
+    }
+
+    for (const auto& [bucketTimes, bucketRollup] : rollups) {
+        const auto& [bucketStartNs, bucketEndNs] = bucketTimes;
+        uint64_t bucketInfoToken = protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
+                                                      FIELD_ID_DIMENSIONS_ROLLUP);
+        if (bucketEndNs - bucketStartNs != mBucketSizeNs) {
+            protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_START_BUCKET_ELAPSED_MILLIS,
+                               (long long)NanoToMillis(bucketStartNs));
+            protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_END_BUCKET_ELAPSED_MILLIS,
+                               (long long)NanoToMillis(bucketEndNs));
+        } else {
+            protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_NUM,
+                               (long long)(getBucketNumFromEndTimeNs(bucketEndNs)));
+        }
+        for (const auto& [aggIndex, rollup] : bucketRollup) {
+            writePastBucketAggregateToProto(aggIndex, rollup, /*sampleSize=*/0, protoOutput);
+        }
+        protoOutput->end(bucketInfoToken);
+    }
+
+    for (auto& [_, bucketRollup] : rollups) {
+        for (auto& [_, rollup] : bucketRollup) {
+            recycleSketchLocked(std::move(rollup));
+        }
+    }
+}
+
 optional<int64_t> getInt64ValueFromEvent(const LogEvent& event, const Matcher& matcher) {
     for (const FieldValue& value : event.getValues()) {
         if (value.mField.matches(matcher)) {
@@ -126,7 +180,7 @@ bool KllMetricProducer::aggregateFields(const int64_t eventTimeNs,
         // 2. Ownership of the unique_ptr<KllQuantile> at interval.aggregate being transferred to
         // PastBucket after flushing.
         if (!interval.aggregate) {
-            interval.aggregate = KllQuantile::Create();
+            interval.aggregate = obtainSketchLocked();
         }
         seenNewData = true;
         interval.aggregate->Add(valueOpt.value());
@@ -151,22 +205,54 @@ PastBucket<unique_ptr<KllQuantile>> KllMetricProducer::buildPartialBucket(
     return bucket;
 }
 
+size_t KllMetricProducer::getPastBucketByteSize(
+        const PastBucket<unique_ptr<KllQuantile>>& bucket) const {
+    size_t totalSize = kBucketSize;
+    static const size_t kIntSize = sizeof(int);
+    totalSize += bucket.aggIndex.size() * kIntSize;
+    if (!bucket.aggregates.empty()) {
+        static const size_t kInt64Size = sizeof(int64_t);
+        // Assume sketch size is the same for all aggregations in a bucket.
+        totalSize += bucket.aggregates.size() * kInt64Size *
+                     bucket.aggregates[0]->num_stored_values();
+    }
+    return totalSize;
+}
+
 size_t KllMetricProducer::byteSizeLocked() const {
-    size_t totalSize = 0;
-    for (const auto& [_, buckets] : mPastBuckets) {
-        totalSize += buckets.size() * kBucketSize;
-        for (const auto& bucket : buckets) {
-            static const size_t kIntSize = sizeof(int);
-            totalSize += bucket.aggIndex.size() * kIntSize;
-            if (!bucket.aggregates.empty()) {
-                static const size_t kInt64Size = sizeof(int64_t);
-                // Assume sketch size is the same for all aggregations in a bucket.
-                totalSize += bucket.aggregates.size() * kInt64Size *
-                             bucket.aggregates[0]->num_stored_values();
+    return mPastBucketsByteSize;
+}
+
+void KllMetricProducer::clearPastBucketsLocked(const int64_t dumpTimeNs) {
+    for (auto& [_, buckets] : mPastBuckets) {
+        for (auto& bucket : buckets) {
+            for (unique_ptr<KllQuantile>& sketch : bucket.aggregates) {
+                recycleSketchLocked(std::move(sketch));
             }
         }
     }
-    return totalSize;
+    ValueMetricProducer::clearPastBucketsLocked(dumpTimeNs);
+}
+
+unique_ptr<KllQuantile> KllMetricProducer::obtainSketchLocked() {
+    if (!mFreeSketches.empty()) {
+        unique_ptr<KllQuantile> sketch = std::move(mFreeSketches.back());
+        mFreeSketches.pop_back();
+        return sketch;
+    }
+    KllQuantileOptions options;
+    options.set_random(&mRandom);
+    // The compactors are sorted when serialized, their deltas are much smaller than the values.
+    options.set_diff_encode_compactors(true);
+    return KllQuantile::Create(options);
+}
+
+void KllMetricProducer::recycleSketchLocked(unique_ptr<KllQuantile> sketch) {
+    if (sketch == nullptr || mFreeSketches.size() >= kMaxFreeSketches) {
+        return;
+    }
+    sketch->Reset();
+    mFreeSketches.push_back(std::move(sketch));
 }
 
 }  // namespace statsd
@@ -19,6 +19,7 @@
 #include <android/util/ProtoOutputStream.h>
 #include <gtest/gtest_prod.h>
 #include <kll.h>
+#include <random_generator.h>
 
 #include <optional>
 
@@ -31,6 +32,7 @@
 #include "stats_log_util.h"
 
 using dist_proc::aggregation::KllQuantile;
+using dist_proc::aggregation::MTRandomGenerator;
 
 namespace android {
 namespace os {
@@ -102,14 +104,43 @@ private:
                                          const int sampleSize,
                                          ProtoOutputStream* const protoOutput) const override;
 
+    // Writes the sketches of all dimensions merged per bucket, if mEmitDimensionsRollup is set.
+    void writePastBucketsExtrasToProto(ProtoOutputStream* const protoOutput) override;
+
     bool aggregateFields(const int64_t eventTimeNs, const MetricDimensionKey& eventKey,
                          const LogEvent& event, std::vector<Interval>& intervals,
                          Empty& empty) override;
 
+    size_t getPastBucketByteSize(
+            const PastBucket<std::unique_ptr<KllQuantile>>& bucket) const override;
+
     // Internal function to calculate the current used bytes.
     size_t byteSizeLocked() const override;
 
+    // Recycles the sketches of the past buckets before clearing them.
+    void clearPastBucketsLocked(const int64_t dumpTimeNs) override;
+
+    // Returns a sketch from mFreeSketches, or a new one using mRandom.
+    std::unique_ptr<KllQuantile> obtainSketchLocked();
+
+    // Resets the sketch and keeps it in mFreeSketches, unless it is full.
+    void recycleSketchLocked(std::unique_ptr<KllQuantile> sketch);
+
+    const bool mEmitDimensionsRollup;
+
+    // Shared by the sketches of the metric, instead of a Mersenne Twister state in each sketch. The
+    // sketches only use it while values are added or merged, not when they are destroyed.
+    MTRandomGenerator mRandom;
+
+    // Most free sketches kept. They keep the storage of their compactors, so the pool is small.
+    static const size_t kMaxFreeSketches = 32;
+
+    // Sketches of the dumped buckets, reset and reused for the next buckets.
+    std::vector<std::unique_ptr<KllQuantile>> mFreeSketches;
+
     FRIEND_TEST(KllMetricProducerTest, TestByteSize);
+    FRIEND_TEST(KllMetricProducerTest, TestDimensionsRollup);
+    FRIEND_TEST(KllMetricProducerTest, TestSketchesRecycled);
     FRIEND_TEST(KllMetricProducerTest, TestPushedEventsWithoutCondition);
     FRIEND_TEST(KllMetricProducerTest, TestPushedEventsWithCondition);
     FRIEND_TEST(KllMetricProducerTest, TestForcedBucketSplitWhenConditionUnknownSkipsBucket);
@@ -19,7 +19,10 @@
 
 #include "MetricProducer.h"
 
+#include <algorithm>
+
 #include "../guardrail/StatsdStats.h"
+#include "condition/EventConditionCache.h"
 #include "metrics/parsing_utils/metrics_manager_util.h"
 #include "state/StateTracker.h"
 
@@ -130,14 +133,33 @@ void MetricProducer::onMatchedLogEventLocked(const size_t matcherIndex, const Lo
 
     bool condition;
     ConditionKey conditionKey;
+    const ConditionKey* linkedConditionKey = &conditionKey;
     if (mConditionSliced) {
-        for (const auto& link : mMetric2ConditionLinks) {
-            getDimensionForCondition(event.getValues(), link, &conditionKey[link.conditionId]);
+        const bool isPartialLink = !mHasLinksToAllConditionDimensionsInTracker;
+        EventConditionCache* conditionCache = EventConditionCache::get();
+        const EventConditionCache::Entry* cached =
+                conditionCache == nullptr
+                        ? nullptr
+                        : conditionCache->find(event, mConditionTrackerIndex, isPartialLink,
+                                               mMetric2ConditionLinks);
+        if (cached == nullptr) {
+            for (const auto& link : mMetric2ConditionLinks) {
+                getDimensionForCondition(event, link, &conditionKey[link.conditionId]);
+            }
+            auto conditionState = mWizard->query(mConditionTrackerIndex, conditionKey,
+                                                 isPartialLink);
+            if (conditionCache != nullptr) {
+                cached = &conditionCache->insert(event, mConditionTrackerIndex, isPartialLink,
+                                                 mMetric2ConditionLinks, std::move(conditionKey),
+                                                 conditionState);
+            }
+            condition = (conditionState == ConditionState::kTrue);
+        } else {
+            condition = (cached->conditionState == ConditionState::kTrue);
+        }
+        if (cached != nullptr) {
+            linkedConditionKey = &cached->conditionKey;
         }
-        auto conditionState =
-            mWizard->query(mConditionTrackerIndex, conditionKey,
-                           !mHasLinksToAllConditionDimensionsInTracker);
-        condition = (conditionState == ConditionState::kTrue);
     } else {
         // TODO: The unknown condition state is not handled here, we should fix it.
         condition = mCondition == ConditionState::kTrue;
@@ -146,13 +168,32 @@ void MetricProducer::onMatchedLogEventLocked(const size_t matcherIndex, const Lo
     // Stores atom id to primary key pairs for each state atom that the metric is
     // sliced by.
     std::map<int32_t, HashableDimensionKey> statePrimaryKeys;
+    HashableDimensionKey stateValuesKey;
+    // Metrics that are not sliced by state skip the state queries. State links are only valid
+    // with slice_by_state, so there are none to resolve either.
+    if (!mSlicedStateAtoms.empty()) {
+        queryStateValuesLocked(event, &statePrimaryKeys, &stateValuesKey);
+    }
+
+    if (onMatchedLogEventOfExistingDimensionLocked(stateValuesKey, condition, event)) {
+        return;
+    }
+
+    HashableDimensionKey dimensionInWhat;
+    filterValues(mDimensionsInWhat, event, &dimensionInWhat);
+    MetricDimensionKey metricKey(std::move(dimensionInWhat), std::move(stateValuesKey));
+    onMatchedLogEventInternalLocked(matcherIndex, metricKey, *linkedConditionKey, condition, event,
+                                    statePrimaryKeys);
+}
 
+void MetricProducer::queryStateValuesLocked(
+        const LogEvent& event, std::map<int32_t, HashableDimensionKey>* statePrimaryKeys,
+        HashableDimensionKey* stateValuesKey) {
     // For states with primary fields, use MetricStateLinks to get the primary
     // field values from the log event. These values will form a primary key
     // that will be used to query StateTracker for the correct state value.
     for (const auto& stateLink : mMetric2StateLinks) {
-        getDimensionForState(event.getValues(), stateLink,
-                             &statePrimaryKeys[stateLink.stateAtomId]);
+        getDimensionForState(event, stateLink, &(*statePrimaryKeys)[stateLink.stateAtomId]);
     }
 
     // For each sliced state, query StateTracker for the state value using
@@ -163,26 +204,20 @@ void MetricProducer::onMatchedLogEventLocked(const size_t matcherIndex, const Lo
     // links are provided for a state with primary fields, links are provided
     // in the wrong order, etc.), StateTracker will simply return kStateUnknown
     // when queried using an incorrect key.
-    HashableDimensionKey stateValuesKey;
     for (auto atomId : mSlicedStateAtoms) {
         FieldValue value;
-        if (statePrimaryKeys.find(atomId) != statePrimaryKeys.end()) {
+        const auto it = statePrimaryKeys->find(atomId);
+        if (it != statePrimaryKeys->end()) {
             // found a primary key for this state, query using the key
-            queryStateValue(atomId, statePrimaryKeys[atomId], &value);
+            queryStateValue(atomId, it->second, &value);
         } else {
             // if no MetricStateLinks exist for this state atom,
             // query using the default dimension key (empty HashableDimensionKey)
             queryStateValue(atomId, DEFAULT_DIMENSION_KEY, &value);
         }
         mapStateValue(atomId, &value);
-        stateValuesKey.addValue(value);
+        stateValuesKey->addValue(value);
     }
-
-    HashableDimensionKey dimensionInWhat;
-    filterValues(mDimensionsInWhat, event.getValues(), &dimensionInWhat);
-    MetricDimensionKey metricKey(dimensionInWhat, stateValuesKey);
-    onMatchedLogEventInternalLocked(matcherIndex, metricKey, conditionKey, condition, event,
-                                    statePrimaryKeys);
 }
 
 bool MetricProducer::evaluateActiveStateLocked(int64_t elapsedTimestampNs) {
@@ -199,6 +234,13 @@ bool MetricProducer::evaluateActiveStateLocked(int64_t elapsedTimestampNs) {
     return isActive;
 }
 
+void MetricProducer::resetDataLocked(const int64_t resetTimeNs) {
+    // Splits the current bucket at resetTimeNs so that the data before it is dropped below.
+    flushLocked(resetTimeNs);
+    clearPastBucketsLocked(resetTimeNs);
+    mSkippedBuckets.clear();
+}
+
 void MetricProducer::flushIfExpire(int64_t elapsedTimestampNs) {
     std::lock_guard<std::mutex> lock(mMutex);
     if (!mIsActive) {
@@ -214,6 +256,17 @@ void MetricProducer::flushIfExpire(int64_t elapsedTimestampNs) {
     }
 }
 
+int64_t MetricProducer::getActivationExpiryNs() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    int64_t expiryNs = INT64_MIN;
+    for (const auto& [_, activation] : mEventActivationMap) {
+        if (activation->state == ActivationState::kActive) {
+            expiryNs = std::max(expiryNs, activation->start_ns + activation->ttl_ns);
+        }
+    }
+    return expiryNs;
+}
+
 void MetricProducer::activateLocked(int activationTrackerIndex, int64_t elapsedTimestampNs) {
     auto it = mEventActivationMap.find(activationTrackerIndex);
     if (it == mEventActivationMap.end()) {
@@ -248,6 +301,20 @@ void MetricProducer::cancelEventActivationLocked(int deactivationTrackerIndex) {
     }
 }
 
+void MetricProducer::cancelActivations(const vector<int>& activationTrackerIndexes,
+                                       int64_t elapsedTimestampNs) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const int activationTrackerIndex : activationTrackerIndexes) {
+            auto it = mEventActivationMap.find(activationTrackerIndex);
+            if (it != mEventActivationMap.end()) {
+                it->second->state = ActivationState::kNotActive;
+            }
+        }
+    }
+    flushIfExpire(elapsedTimestampNs);
+}
+
 void MetricProducer::loadActiveMetricLocked(const ActiveMetric& activeMetric,
                                             int64_t currentTimeNs) {
     if (mEventActivationMap.size() == 0) {
@@ -276,6 +343,17 @@ void MetricProducer::loadActiveMetricLocked(const ActiveMetric& activeMetric,
     }
 }
 
+bool MetricProducer::hasActivationToPersist(int64_t currentTimeNs) const {
+    for (const auto& [_, activation] : mEventActivationMap) {
+        if (ActivationState::kActiveOnBoot == activation->state ||
+            (ActivationState::kActive == activation->state &&
+             activation->start_ns + activation->ttl_ns >= currentTimeNs)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void MetricProducer::writeActiveMetricToProtoOutputStream(
         int64_t currentTimeNs, const DumpReportReason reason, ProtoOutputStream* proto) {
     proto->write(FIELD_TYPE_INT64 | FIELD_ID_ACTIVE_METRIC_ID, (long long)mMetricId);
@@ -371,18 +449,23 @@ bool MetricProducer::maxDropEventsReached() const {
 }
 
 bool MetricProducer::passesSampleCheckLocked(const vector<FieldValue>& values) const {
+    return passesSampleCheck(mSampledWhatFields, mShardCount, values);
+}
+
+bool MetricProducer::passesSampleCheck(const vector<Matcher>& sampledWhatFields, int shardCount,
+                                       const vector<FieldValue>& values) {
     // Only perform sampling if shard count is correct and there is a sampled what field.
-    if (mShardCount <= 1 || mSampledWhatFields.size() == 0) {
+    if (shardCount <= 1 || sampledWhatFields.size() == 0) {
         return true;
     }
     // If filtering fails, don't perform sampling. Event could be a gauge trigger event or stop all
     // event.
     FieldValue sampleFieldValue;
-    if (!filterValues(mSampledWhatFields[0], values, &sampleFieldValue)) {
+    if (!filterValues(sampledWhatFields[0], values, &sampleFieldValue)) {
         return true;
     }
     return shouldKeepSample(sampleFieldValue, ShardOffsetProvider::getInstance().getShardOffset(),
-                            mShardCount);
+                            shardCount);
 }
 
 }  // namespace statsd
@@ -20,6 +20,7 @@
 #include <src/active_config_list.pb.h>
 #include <utils/RefBase.h>
 
+#include <climits>
 #include <unordered_map>
 
 #include "HashableDimensionKey.h"
@@ -35,6 +36,7 @@
 #include "state/StateListener.h"
 #include "state/StateManager.h"
 #include "utils/DbUtils.h"
+#include "utils/ReportStringTable.h"
 #include "utils/ShardOffsetProvider.h"
 
 namespace android {
@@ -70,6 +72,7 @@ enum MetricType {
     METRIC_TYPE_GAUGE = 4,
     METRIC_TYPE_VALUE = 5,
     METRIC_TYPE_KLL = 6,
+    METRIC_TYPE_HLL = 7,
 };
 
 struct Activation {
@@ -191,6 +194,17 @@ public:
         notifyAppUpgrade(eventTimeNs);
     };
 
+    // Same as notifyAppUpgrade for an app which can't log to the config, so the bucket is only
+    // split if the uid of the app is in the dimensions of the current bucket.
+    void notifyUnrelatedAppUpgrade(int64_t eventTimeNs, int32_t uid) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mSplitBucketForAppUpgrade.value_or(false) ||
+            !hasUidInCurrentDimensionsLocked(uid)) {
+            return;
+        }
+        notifyAppUpgradeInternalLocked(eventTimeNs);
+    }
+
     /**
      * Force a partial bucket split on boot complete.
      */
@@ -219,6 +233,13 @@ public:
         return mConditionSliced;
     };
 
+    // Returns the atom that the metric pulls when it is given the matched event, so that the
+    // pulls triggered by an event can be done together before it is dispatched.
+    std::optional<int> getTriggeredPullAtomId(const LogEvent& event) const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return getTriggeredPullAtomIdLocked(event);
+    }
+
     void onStateChanged(const int64_t eventTimeNs, const int32_t atomId,
                         const HashableDimensionKey& primaryKey, const FieldValue& oldState,
                         const FieldValue& newState){};
@@ -229,7 +250,7 @@ public:
                       const bool include_current_partial_bucket,
                       const bool erase_data,
                       const DumpLatency dumpLatency,
-                      std::set<string> *str_set,
+                      ReportStringTable* str_set,
                       android::util::ProtoOutputStream* protoOutput) {
         std::lock_guard<std::mutex> lock(mMutex);
         return onDumpReportLocked(dumpTimeNs, include_current_partial_bucket, erase_data,
@@ -269,6 +290,18 @@ public:
         return byteSizeLocked();
     }
 
+    // Returns the number of dimensions in the current bucket. Does not change state.
+    size_t getCurrentDimensionCount() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return getCurrentDimensionCountLocked();
+    }
+
+    // Returns the number of atoms held by the current bucket. Only gauge metrics hold atoms.
+    size_t getCurrentAtomCount() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return getCurrentAtomCountLocked();
+    }
+
     void dumpStates(int out, bool verbose) const {
         std::lock_guard<std::mutex> lock(mMutex);
         dumpStatesLocked(out, verbose);
@@ -283,6 +316,14 @@ public:
         dropDataLocked(dropTimeNs);
     }
 
+    // Drops all the data of the metric and starts a new bucket at resetTimeNs, when the TTL of the
+    // config expires. What the current bucket tracks beyond its data, such as started durations
+    // and diff bases, is kept along with the condition, the activations and the anomaly trackers.
+    void resetData(const int64_t resetTimeNs) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        resetDataLocked(resetTimeNs);
+    }
+
     void loadActiveMetric(const ActiveMetric& activeMetric, int64_t currentTimeNs) {
         std::lock_guard<std::mutex> lock(mMutex);
         loadActiveMetricLocked(activeMetric, currentTimeNs);
@@ -298,6 +339,11 @@ public:
         cancelEventActivationLocked(deactivationTrackerIndex);
     }
 
+    // Cancels the activations by the given matchers, e.g. when they are replaced in a config
+    // update, and deactivates the metric if no other activation is active.
+    void cancelActivations(const std::vector<int>& activationTrackerIndexes,
+                           int64_t elapsedTimestampNs);
+
     bool isActive() const {
         std::lock_guard<std::mutex> lock(mMutex);
         return isActiveLocked();
@@ -305,6 +351,26 @@ public:
 
     void flushIfExpire(int64_t elapsedTimestampNs);
 
+    // Flushes the current bucket if it ended by eventTimeNs.
+    void flushIfNeeded(int64_t eventTimeNs) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        flushIfNeededLocked(eventTimeNs);
+    }
+
+    // Once flushed at dumpTimeNs, returns the time from which the events would add data to the
+    // report of the metric without the current bucket: the end of the current bucket.
+    virtual int64_t getDumpCutEndNs(int64_t dumpTimeNs) const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mBucketSizeNs == LLONG_MAX ? LLONG_MAX : getCurrentBucketEndTimeNs();
+    }
+
+    // Returns the time after which all active activations of the metric have expired, or INT64_MIN
+    // if none of them is active. flushIfExpire() deactivates the metric after this time.
+    int64_t getActivationExpiryNs() const;
+
+    // Returns true if writeActiveMetricToProtoOutputStream() writes at least one activation.
+    bool hasActivationToPersist(int64_t currentTimeNs) const;
+
     void writeActiveMetricToProtoOutputStream(
             int64_t currentTimeNs, const DumpReportReason reason, ProtoOutputStream* proto);
 
@@ -375,6 +441,16 @@ public:
         mSampledWhatFields.swap(samplingInfo.sampledWhatFields);
         mShardCount = samplingInfo.shardCount;
     }
+
+    SamplingInfo getSamplingInfo() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return {mSampledWhatFields, mShardCount};
+    }
+
+    // Whether the values are in a shard kept by the sampling. Values without the sampled field
+    // are kept.
+    static bool passesSampleCheck(const std::vector<Matcher>& sampledWhatFields, int shardCount,
+                                  const vector<FieldValue>& values);
     // End: getters/setters
 protected:
     /**
@@ -406,6 +482,12 @@ protected:
         flushLocked(eventTimeNs);
     }
 
+    // Returns true if the uid is in one of the dimensions of the current bucket. True by default
+    // for the metrics which don't keep the dimensions of their current bucket.
+    virtual bool hasUidInCurrentDimensionsLocked(const int32_t uid) const {
+        return true;
+    }
+
     /*
      * Individual metrics can implement their own business logic here. All pre-processing is done.
      *
@@ -428,6 +510,14 @@ protected:
 
     // Consume the parsed stats log entry that already matched the "what" of the metric.
     virtual void onMatchedLogEventLocked(const size_t matcherIndex, const LogEvent& event);
+
+    // Called by onMatchedLogEventLocked() before the dimension key of the event is built. Returns
+    // true if the metric already holds the dimension of the event and consumed the event without
+    // the key, otherwise the key is built for onMatchedLogEventInternalLocked().
+    virtual bool onMatchedLogEventOfExistingDimensionLocked(
+            const HashableDimensionKey& stateValuesKey, bool condition, const LogEvent& event) {
+        return false;
+    }
     virtual void onConditionChangedLocked(const bool condition, int64_t eventTime) = 0;
     virtual void onSlicedConditionMayChangeLocked(bool overallCondition,
                                                   const int64_t eventTime) = 0;
@@ -435,13 +525,20 @@ protected:
                                     const bool include_current_partial_bucket,
                                     const bool erase_data,
                                     const DumpLatency dumpLatency,
-                                    std::set<string> *str_set,
+                                    ReportStringTable* str_set,
                                     android::util::ProtoOutputStream* protoOutput) = 0;
     virtual void clearPastBucketsLocked(const int64_t dumpTimeNs) = 0;
     virtual void prepareFirstBucketLocked(){};
     virtual size_t byteSizeLocked() const = 0;
+    virtual size_t getCurrentDimensionCountLocked() const {
+        return 0;
+    }
+    virtual size_t getCurrentAtomCountLocked() const {
+        return 0;
+    }
     virtual void dumpStatesLocked(int out, bool verbose) const = 0;
     virtual void dropDataLocked(const int64_t dropTimeNs) = 0;
+    void resetDataLocked(const int64_t resetTimeNs);
     void loadActiveMetricLocked(const ActiveMetric& activeMetric, int64_t currentTimeNs);
     void activateLocked(int activationTrackerIndex, int64_t elapsedTimestampNs);
     void cancelEventActivationLocked(int deactivationTrackerIndex);
@@ -464,10 +561,16 @@ protected:
         return mTimeBaseNs + (mCurrentBucketNum + 1) * mBucketSizeNs;
     }
 
-    int64_t getBucketNumFromEndTimeNs(const int64_t endNs) {
+    int64_t getBucketNumFromEndTimeNs(const int64_t endNs) const {
         return (endNs - mTimeBaseNs) / mBucketSizeNs - 1;
     }
 
+    // Resolves the primary keys of the state links from the event and queries the value of each
+    // sliced state, in the order of mSlicedStateAtoms. Only called for metrics sliced by state.
+    void queryStateValuesLocked(const LogEvent& event,
+                                std::map<int32_t, HashableDimensionKey>* statePrimaryKeys,
+                                HashableDimensionKey* stateValuesKey);
+
     // Query StateManager for original state value using the queryKey.
     // The field and value are output.
     void queryStateValue(int32_t atomId, const HashableDimensionKey& queryKey, FieldValue* value);
@@ -489,6 +592,10 @@ protected:
 
     bool passesSampleCheckLocked(const vector<FieldValue>& values) const;
 
+    virtual std::optional<int> getTriggeredPullAtomIdLocked(const LogEvent& event) const {
+        return std::nullopt;
+    }
+
     const int64_t mMetricId;
 
     // Hash of the Metric's proto bytes from StatsdConfig, including any activations.
@@ -569,6 +676,10 @@ protected:
     // Buckets that were invalidated and had their data dropped.
     std::vector<SkippedBucket> mSkippedBuckets;
 
+    // Bytes used to store the finished buckets. Updated by the subclasses as buckets are added
+    // and cleared, so that byteSizeLocked doesn't walk them.
+    size_t mPastBucketsByteSize = 0;
+
     // If hard dimension guardrail is hit, do not spam logcat. This is a per bucket tracker.
     mutable bool mHasHitGuardrail;
 
@@ -618,6 +729,7 @@ protected:
     FRIEND_TEST(MetricsManagerUtilTest, TestSampledMetrics);
 
     FRIEND_TEST(ConfigUpdateTest, TestUpdateMetricActivations);
+    FRIEND_TEST(ConfigUpdateTest, TestUpdateMetricActivationMatcherReplaced);
     FRIEND_TEST(ConfigUpdateTest, TestUpdateCountMetrics);
     FRIEND_TEST(ConfigUpdateTest, TestUpdateEventMetrics);
     FRIEND_TEST(ConfigUpdateTest, TestUpdateGaugeMetrics);
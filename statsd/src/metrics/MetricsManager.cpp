@@ -20,13 +20,19 @@
 
 #include <private/android_filesystem_config.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
 #include "CountMetricProducer.h"
 #include "condition/CombinationConditionTracker.h"
+#include "condition/EventConditionCache.h"
 #include "condition/SimpleConditionTracker.h"
 #include "flags/FlagProvider.h"
 #include "guardrail/StatsdStats.h"
 #include "matchers/CombinationAtomMatchingTracker.h"
 #include "matchers/SimpleAtomMatchingTracker.h"
+#include "packages/AidMapping.h"
 #include "parsing_utils/config_update_utils.h"
 #include "parsing_utils/metrics_manager_util.h"
 #include "state/StateManager.h"
@@ -34,6 +40,8 @@
 #include "stats_util.h"
 #include "statslog_statsd.h"
 #include "utils/DbUtils.h"
+#include "utils/ShardWorkerPool.h"
+#include "utils/StatsdTrace.h"
 
 using android::util::FIELD_COUNT_REPEATED;
 using android::util::FIELD_TYPE_INT32;
@@ -42,6 +50,7 @@ using android::util::FIELD_TYPE_MESSAGE;
 using android::util::FIELD_TYPE_STRING;
 using android::util::ProtoOutputStream;
 
+using std::optional;
 using std::set;
 using std::string;
 using std::unique_ptr;
@@ -61,12 +70,17 @@ const int FIELD_ID_ACTIVE_CONFIG_ID = 1;
 const int FIELD_ID_ACTIVE_CONFIG_UID = 2;
 const int FIELD_ID_ACTIVE_CONFIG_METRIC = 3;
 
+// Workers and threshold of the parallel matching, see setParallelMatching.
+static std::unique_ptr<ShardWorkerPool> sMatchingWorkerPool;
+static size_t sMinMatchersForParallelMatching = 0;
+
 MetricsManager::MetricsManager(const ConfigKey& key, const StatsdConfig& config,
                                const int64_t timeBaseNs, const int64_t currentTimeNs,
                                const sp<UidMap>& uidMap,
                                const sp<StatsPullerManager>& pullerManager,
                                const sp<AlarmMonitor>& anomalyAlarmMonitor,
-                               const sp<AlarmMonitor>& periodicAlarmMonitor)
+                               const sp<AlarmMonitor>& periodicAlarmMonitor,
+                               const sp<SharedConditionStates>& sharedConditionStates)
     : mConfigKey(key),
       mUidMap(uidMap),
       mPackageCertificateHashSizeBytes(
@@ -96,11 +110,28 @@ MetricsManager::MetricsManager(const ConfigKey& key, const StatsdConfig& config,
             mAllMetricProducers, mMetricProducerMap, mAllAnomalyTrackers, mAllPeriodicAlarmTrackers,
             mConditionToMetricMap, mTrackerToMetricMap, mTrackerToConditionMap,
             mActivationAtomTrackerToMetricMap, mDeactivationAtomTrackerToMetricMap,
-            mAlertTrackerMap, mMetricIndexesWithActivation, mStateProtoHashes, mNoReportMetricIds);
+            mAlertTrackerMap, mMetricIndexesWithActivation, mStateProtoHashes, mNoReportMetricIds,
+            &mInitLatencies, sharedConditionStates);
+    computeAtomFieldMasks(config, mAtomMatchingTrackerMap, mAllAtomMatchingTrackers,
+                          mAtomFieldMasks);
+    computePriorityAtomIds(config, mAtomMatchingTrackerMap, mAllAtomMatchingTrackers,
+                           mPriorityAtomIds);
+    computePullTriggerAtomIds(config, mAtomMatchingTrackerMap, mAllAtomMatchingTrackers,
+                              mPullTriggerAtomIds);
+    computeEquivalentMatchers(config, mAllAtomMatchingTrackers);
+    computeConditionEvaluationOrder(mAllConditionTrackers, mConditionEvaluationOrder);
+    computeAtomDispatchPlans(mTagIdsToMatchersMap, mAllAtomMatchingTrackers, mAllConditionTrackers,
+                             mConditionEvaluationOrder, mTrackerToConditionMap,
+                             mActivationAtomTrackerToMetricMap, mDeactivationAtomTrackerToMetricMap,
+                             mAtomDispatchPlans);
+    computeMetricSamplingGroups(mAllMetricProducers, mMetricSamplingGroups, mSamplingGroups);
+    initLogEventScratchBuffers();
 
     mHashStringsInReport = config.hash_strings_in_metric_report();
     mVersionStringsInReport = config.version_strings_in_metric_report();
     mInstallerInReport = config.installer_in_metric_report();
+    mUidMapFullSnapshotPeriod = config.uid_map_full_snapshot_period();
+    mSplitBucketForRelatedAppUpgradeOnly = config.split_bucket_for_related_app_upgrade_only();
 
     createAllLogSourcesFromConfig(config);
     setMaxMetricsBytesFromConfig(config);
@@ -179,6 +210,20 @@ bool MetricsManager::updateConfig(const StatsdConfig& config, const int64_t time
     mAllAnomalyTrackers = newAnomalyTrackers;
     mAlertTrackerMap = newAlertTrackerMap;
     mAllPeriodicAlarmTrackers = newPeriodicAlarmTrackers;
+    computeAtomFieldMasks(config, mAtomMatchingTrackerMap, mAllAtomMatchingTrackers,
+                          mAtomFieldMasks);
+    computePriorityAtomIds(config, mAtomMatchingTrackerMap, mAllAtomMatchingTrackers,
+                           mPriorityAtomIds);
+    computePullTriggerAtomIds(config, mAtomMatchingTrackerMap, mAllAtomMatchingTrackers,
+                              mPullTriggerAtomIds);
+    computeEquivalentMatchers(config, mAllAtomMatchingTrackers);
+    computeConditionEvaluationOrder(mAllConditionTrackers, mConditionEvaluationOrder);
+    computeAtomDispatchPlans(mTagIdsToMatchersMap, mAllAtomMatchingTrackers, mAllConditionTrackers,
+                             mConditionEvaluationOrder, mTrackerToConditionMap,
+                             mActivationAtomTrackerToMetricMap, mDeactivationAtomTrackerToMetricMap,
+                             mAtomDispatchPlans);
+    computeMetricSamplingGroups(mAllMetricProducers, mMetricSamplingGroups, mSamplingGroups);
+    initLogEventScratchBuffers();
 
     mTtlNs = config.has_ttl_in_seconds() ? config.ttl_in_seconds() * NS_PER_SEC : -1;
     refreshTtl(currentTimeNs);
@@ -186,6 +231,8 @@ bool MetricsManager::updateConfig(const StatsdConfig& config, const int64_t time
     mHashStringsInReport = config.hash_strings_in_metric_report();
     mVersionStringsInReport = config.version_strings_in_metric_report();
     mInstallerInReport = config.installer_in_metric_report();
+    mUidMapFullSnapshotPeriod = config.uid_map_full_snapshot_period();
+    mSplitBucketForRelatedAppUpgradeOnly = config.split_bucket_for_related_app_upgrade_only();
     mWhitelistedAtomIds.clear();
     mWhitelistedAtomIds.insert(config.whitelisted_atom_ids().begin(),
                                config.whitelisted_atom_ids().end());
@@ -207,6 +254,8 @@ bool MetricsManager::updateConfig(const StatsdConfig& config, const int64_t time
     setMaxMetricsBytesFromConfig(config);
     setTriggerGetDataBytesFromConfig(config);
 
+    // The phases of config updates aren't timed.
+    mInitLatencies = ConfigInitLatencies();
     verifyGuardrailsAndUpdateStatsdStats();
     initializeConfigActiveStatus();
     return !mInvalidConfigReason.has_value();
@@ -215,9 +264,9 @@ bool MetricsManager::updateConfig(const StatsdConfig& config, const int64_t time
 void MetricsManager::createAllLogSourcesFromConfig(const StatsdConfig& config) {
     // Init allowed pushed atom uids.
     for (const auto& source : config.allowed_log_source()) {
-        auto it = UidMap::sAidToUidMapping.find(source);
-        if (it != UidMap::sAidToUidMapping.end()) {
-            mAllowedUid.push_back(it->second);
+        const optional<int32_t> aidUid = AidMapping::getUid(source);
+        if (aidUid) {
+            mAllowedUid.push_back(*aidUid);
         } else {
             mAllowedPkg.push_back(source);
         }
@@ -233,12 +282,12 @@ void MetricsManager::createAllLogSourcesFromConfig(const StatsdConfig& config) {
     // Init default allowed pull atom uids.
     int numPullPackages = 0;
     for (const string& pullSource : config.default_pull_packages()) {
-        auto it = UidMap::sAidToUidMapping.find(pullSource);
-        if (it != UidMap::sAidToUidMapping.end()) {
+        const optional<int32_t> aidUid = AidMapping::getUid(pullSource);
+        if (aidUid) {
             numPullPackages++;
-            mDefaultPullUids.insert(it->second);
+            mDefaultPullUids.insert(*aidUid);
         } else {
-            ALOGE("Default pull atom packages must be in sAidToUidMapping");
+            ALOGE("Default pull atom packages must be AIDs");
             mInvalidConfigReason =
                     InvalidConfigReason(INVALID_CONFIG_REASON_DEFAULT_PULL_PACKAGES_NOT_IN_MAP);
         }
@@ -248,9 +297,9 @@ void MetricsManager::createAllLogSourcesFromConfig(const StatsdConfig& config) {
         int32_t atomId = pullAtomPackages.atom_id();
         for (const string& pullPackage : pullAtomPackages.packages()) {
             numPullPackages++;
-            auto it = UidMap::sAidToUidMapping.find(pullPackage);
-            if (it != UidMap::sAidToUidMapping.end()) {
-                mPullAtomUids[atomId].insert(it->second);
+            const optional<int32_t> aidUid = AidMapping::getUid(pullPackage);
+            if (aidUid) {
+                mPullAtomUids[atomId].insert(*aidUid);
             } else {
                 mPullAtomPackages[atomId].insert(pullPackage);
             }
@@ -318,21 +367,34 @@ void MetricsManager::verifyGuardrailsAndUpdateStatsdStats() {
     StatsdStats::getInstance().noteConfigReceived(
             mConfigKey, mAllMetricProducers.size(), mAllConditionTrackers.size(),
             mAllAtomMatchingTrackers.size(), mAllAnomalyTrackers.size(), mAnnotations,
-            mInvalidConfigReason);
+            mInvalidConfigReason, mInitLatencies);
 }
 
 void MetricsManager::initializeConfigActiveStatus() {
     mIsAlwaysActive = (mMetricIndexesWithActivation.size() != mAllMetricProducers.size()) ||
                       (mAllMetricProducers.size() == 0);
     mIsActive = mIsAlwaysActive;
+    mActivationExpiryQueue.clear();
+    mActivationExpiries.assign(mAllMetricProducers.size(), nullptr);
     for (int metric : mMetricIndexesWithActivation) {
         mIsActive |= mAllMetricProducers[metric]->isActive();
+        updateActivationExpiry(metric);
     }
     VLOG("mIsActive is initialized to %d", mIsActive);
 }
 
+void MetricsManager::updateActivationExpiry(const int metricIndex) {
+    sp<const ActivationExpiry>& expiry = mActivationExpiries[metricIndex];
+    mActivationExpiryQueue.remove(expiry);
+    expiry = nullptr;
+    const sp<MetricProducer>& metric = mAllMetricProducers[metricIndex];
+    if (metric->isActive()) {
+        expiry = new ActivationExpiry(metricIndex, metric->getActivationExpiryNs());
+        mActivationExpiryQueue.push(expiry);
+    }
+}
+
 void MetricsManager::initAllowedLogSources() {
-    std::lock_guard<std::mutex> lock(mAllowedLogSourcesMutex);
     mAllowedLogSources.clear();
     mAllowedLogSources.insert(mAllowedUid.begin(), mAllowedUid.end());
 
@@ -365,12 +427,38 @@ bool MetricsManager::isConfigValid() const {
     return !mInvalidConfigReason.has_value();
 }
 
-void MetricsManager::notifyAppUpgrade(const int64_t eventTimeNs, const string& apk, const int uid,
-                                      const int64_t version) {
-    // Inform all metric producers.
+bool MetricsManager::isLogOrPullSource(const int32_t uid) const {
+    // Whitelisted atoms can be logged by any app.
+    if (!mWhitelistedAtomIds.empty() ||
+        mAllowedLogSources.find(uid) != mAllowedLogSources.end()) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(mAllowedLogSourcesMutex);
+    for (const auto& [_, uids] : mCombinedPullAtomUids) {
+        if (uids.find(uid) != uids.end()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MetricsManager::notifyMetricsOfAppChange(const int64_t eventTimeNs, const int32_t uid) {
+    if (!mSplitBucketForRelatedAppUpgradeOnly || isLogOrPullSource(uid)) {
+        // Inform all metric producers.
+        for (const auto& it : mAllMetricProducers) {
+            it->notifyAppUpgrade(eventTimeNs);
+        }
+        return;
+    }
+    // The app can only appear in the dimensions of the metrics.
     for (const auto& it : mAllMetricProducers) {
-        it->notifyAppUpgrade(eventTimeNs);
+        it->notifyUnrelatedAppUpgrade(eventTimeNs, uid);
     }
+}
+
+void MetricsManager::notifyAppUpgrade(const int64_t eventTimeNs, const string& apk, const int uid,
+                                      const int64_t version) {
+    notifyMetricsOfAppChange(eventTimeNs, uid);
     // check if we care this package
     if (std::find(mAllowedPkg.begin(), mAllowedPkg.end(), apk) != mAllowedPkg.end()) {
         // We will re-initialize the whole list because we don't want to keep the multi mapping of
@@ -387,10 +475,7 @@ void MetricsManager::notifyAppUpgrade(const int64_t eventTimeNs, const string& a
 }
 
 void MetricsManager::notifyAppRemoved(const int64_t eventTimeNs, const string& apk, const int uid) {
-    // Inform all metric producers.
-    for (const auto& it : mAllMetricProducers) {
-        it->notifyAppRemoved(eventTimeNs);
-    }
+    notifyMetricsOfAppChange(eventTimeNs, uid);
     // check if we care this package
     if (std::find(mAllowedPkg.begin(), mAllowedPkg.end(), apk) != mAllowedPkg.end()) {
         // We will re-initialize the whole list because we don't want to keep the multi mapping of
@@ -431,6 +516,13 @@ void MetricsManager::init() {
     }
 }
 
+void MetricsManager::resetOnTtlExpired(const int64_t timestampNs) {
+    for (const auto& producer : mAllMetricProducers) {
+        producer->resetData(timestampNs);
+    }
+    refreshTtl(timestampNs);
+}
+
 vector<int32_t> MetricsManager::getPullAtomUids(int32_t atomId) {
     std::lock_guard<std::mutex> lock(mAllowedLogSourcesMutex);
     vector<int32_t> uids;
@@ -444,11 +536,8 @@ vector<int32_t> MetricsManager::getPullAtomUids(int32_t atomId) {
 
 void MetricsManager::dumpStates(int out, bool verbose) {
     dprintf(out, "ConfigKey %s, allowed source:", mConfigKey.ToString().c_str());
-    {
-        std::lock_guard<std::mutex> lock(mAllowedLogSourcesMutex);
-        for (const auto& source : mAllowedLogSources) {
-            dprintf(out, "%d ", source);
-        }
+    for (const auto& source : mAllowedLogSources) {
+        dprintf(out, "%d ", source);
     }
     dprintf(out, "\n");
     for (const auto& producer : mAllMetricProducers) {
@@ -464,7 +553,7 @@ void MetricsManager::dropData(const int64_t dropTimeNs) {
 
 void MetricsManager::onDumpReport(const int64_t dumpTimeStampNs, const int64_t wallClockNs,
                                   const bool include_current_partial_bucket, const bool erase_data,
-                                  const DumpLatency dumpLatency, std::set<string>* str_set,
+                                  const DumpLatency dumpLatency, ReportStringTable* str_set,
                                   ProtoOutputStream* protoOutput) {
     if (hasRestrictedMetricsDelegate()) {
         // TODO(b/268150038): report error to statsdstats
@@ -473,22 +562,72 @@ void MetricsManager::onDumpReport(const int64_t dumpTimeStampNs, const int64_t w
     }
     VLOG("=========================Metric Reports Start==========================");
     // one StatsLogReport per MetricProduer
+    for (size_t i = 0; i < mAllMetricProducers.size(); i++) {
+        onDumpMetricReport(i, dumpTimeStampNs, include_current_partial_bucket, erase_data,
+                           dumpLatency, str_set, protoOutput);
+    }
+    onDumpReportEnd(dumpTimeStampNs, wallClockNs, erase_data, protoOutput);
+    VLOG("=========================Metric Reports End==========================");
+}
+
+void MetricsManager::onDumpMetricReport(size_t metricIndex, const int64_t dumpTimeStampNs,
+                                        const bool include_current_partial_bucket,
+                                        const bool erase_data, const DumpLatency dumpLatency,
+                                        ReportStringTable* str_set,
+                                        ProtoOutputStream* protoOutput) {
+    const sp<MetricProducer>& producer = mAllMetricProducers[metricIndex];
+    if (mNoReportMetricIds.find(producer->getMetricId()) != mNoReportMetricIds.end()) {
+        producer->clearPastBuckets(dumpTimeStampNs);
+        return;
+    }
+    uint64_t token =
+            protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_METRICS);
+    producer->onDumpReport(dumpTimeStampNs, include_current_partial_bucket, erase_data,
+                           dumpLatency, mHashStringsInReport ? str_set : nullptr, protoOutput);
+    protoOutput->end(token);
+}
+
+void MetricsManager::flushIfNeeded(int64_t timestampNs) {
     for (const auto& producer : mAllMetricProducers) {
-        if (mNoReportMetricIds.find(producer->getMetricId()) == mNoReportMetricIds.end()) {
-            uint64_t token = protoOutput->start(
-                    FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_METRICS);
-            if (mHashStringsInReport) {
-                producer->onDumpReport(dumpTimeStampNs, include_current_partial_bucket, erase_data,
-                                       dumpLatency, str_set, protoOutput);
-            } else {
-                producer->onDumpReport(dumpTimeStampNs, include_current_partial_bucket, erase_data,
-                                       dumpLatency, nullptr, protoOutput);
-            }
-            protoOutput->end(token);
-        } else {
+        producer->flushIfNeeded(timestampNs);
+    }
+}
+
+void MetricsManager::onDumpReportPage(const int64_t dumpTimeStampNs, const int64_t wallClockNs,
+                                      const bool include_current_partial_bucket,
+                                      const bool erase_data, const DumpLatency dumpLatency,
+                                      size_t maxBytes, size_t* metricIndex,
+                                      ReportStringTable* str_set, ProtoOutputStream* protoOutput) {
+    if (hasRestrictedMetricsDelegate()) {
+        VLOG("Unexpected call to onDumpReportPage in restricted metricsmanager.");
+        *metricIndex = mAllMetricProducers.size();
+        return;
+    }
+    size_t pageBytes = 0;
+    vector<uint8_t> metricReport;
+    while (*metricIndex < mAllMetricProducers.size() && (pageBytes == 0 || pageBytes < maxBytes)) {
+        const sp<MetricProducer>& producer = mAllMetricProducers[(*metricIndex)++];
+        if (mNoReportMetricIds.find(producer->getMetricId()) != mNoReportMetricIds.end()) {
             producer->clearPastBuckets(dumpTimeStampNs);
+            continue;
         }
+        ProtoOutputStream metricProto;
+        producer->onDumpReport(dumpTimeStampNs, include_current_partial_bucket, erase_data,
+                               dumpLatency, mHashStringsInReport ? str_set : nullptr,
+                               &metricProto);
+        metricProto.serializeToVector(&metricReport);
+        protoOutput->write(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_METRICS,
+                           reinterpret_cast<const char*>(metricReport.data()),
+                           metricReport.size());
+        pageBytes += metricReport.size();
+    }
+    if (*metricIndex == mAllMetricProducers.size()) {
+        onDumpReportEnd(dumpTimeStampNs, wallClockNs, erase_data, protoOutput);
     }
+}
+
+void MetricsManager::onDumpReportEnd(const int64_t dumpTimeStampNs, const int64_t wallClockNs,
+                                     const bool erase_data, ProtoOutputStream* protoOutput) {
     for (const auto& annotation : mAnnotations) {
         uint64_t token = protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
                                             FIELD_ID_ANNOTATIONS);
@@ -504,7 +643,6 @@ void MetricsManager::onDumpReport(const int64_t dumpTimeStampNs, const int64_t w
         mLastReportTimeNs = dumpTimeStampNs;
         mLastReportWallClockNs = wallClockNs;
     }
-    VLOG("=========================Metric Reports End==========================");
 }
 
 bool MetricsManager::checkLogCredentials(const LogEvent& event) {
@@ -518,7 +656,6 @@ bool MetricsManager::checkLogCredentials(const LogEvent& event) {
         return true;
     }
 
-    std::lock_guard<std::mutex> lock(mAllowedLogSourcesMutex);
     if (mAllowedLogSources.find(event.GetUid()) == mAllowedLogSources.end()) {
         VLOG("log source %d not on the whitelist", event.GetUid());
         return false;
@@ -527,6 +664,30 @@ bool MetricsManager::checkLogCredentials(const LogEvent& event) {
 }
 
 // Consume the stats log if it's interesting to this metric.
+void MetricsManager::prefetchTriggeredPulls(const LogEvent& event, const vector<int>& matchers) {
+    vector<int> pullAtomIds;
+    for (const int i : matchers) {
+        if (mMatcherCache[i] != MatchingState::kMatched) {
+            continue;
+        }
+        auto it = mTrackerToMetricMap.find(i);
+        if (it == mTrackerToMetricMap.end()) {
+            continue;
+        }
+        const LogEvent& metricEvent =
+                mMatcherTransformations[i] == nullptr ? event : *mMatcherTransformations[i];
+        for (const int metricIndex : it->second) {
+            const optional<int> pullAtomId =
+                    mAllMetricProducers[metricIndex]->getTriggeredPullAtomId(metricEvent);
+            if (pullAtomId && std::find(pullAtomIds.begin(), pullAtomIds.end(), *pullAtomId) ==
+                                      pullAtomIds.end()) {
+                pullAtomIds.push_back(*pullAtomId);
+            }
+        }
+    }
+    mPullerManager->prefetchPulls(pullAtomIds, mConfigKey, event.GetElapsedTimestampNs());
+}
+
 void MetricsManager::onLogEvent(const LogEvent& event) {
     if (!isConfigValid()) {
         return;
@@ -541,79 +702,78 @@ void MetricsManager::onLogEvent(const LogEvent& event) {
 
     bool isActive = mIsAlwaysActive;
 
-    // Set of metrics that are still active after flushing.
-    unordered_set<int> activeMetricsIndices;
-
-    // Update state of all metrics w/ activation conditions as of eventTimeNs.
-    for (int metricIndex : mMetricIndexesWithActivation) {
-        const sp<MetricProducer>& metric = mAllMetricProducers[metricIndex];
-        metric->flushIfExpire(eventTimeNs);
-        if (metric->isActive()) {
-            // If this metric w/ activation condition is still active after
-            // flushing, remember it.
-            activeMetricsIndices.insert(metricIndex);
-        }
+    // Update state of the metrics w/ activation conditions that expired as of eventTimeNs. The
+    // others stay active.
+    while (!mActivationExpiryQueue.empty() &&
+           mActivationExpiryQueue.top()->expiryNs < eventTimeNs) {
+        const int metricIndex = mActivationExpiryQueue.top()->metricIndex;
+        mAllMetricProducers[metricIndex]->flushIfExpire(eventTimeNs);
+        updateActivationExpiry(metricIndex);
     }
 
-    mIsActive = isActive || !activeMetricsIndices.empty();
+    mIsActive = isActive || !mActivationExpiryQueue.empty();
 
-    const auto matchersIt = mTagIdsToMatchersMap.find(tagId);
+    const auto planIt = mAtomDispatchPlans.find(tagId);
 
-    if (matchersIt == mTagIdsToMatchersMap.end()) {
+    if (planIt == mAtomDispatchPlans.end()) {
         // Not interesting...
         return;
     }
+    const AtomDispatchPlan& plan = planIt->second;
+    STATSD_TRACE_SCOPE_FMT("MetricsManager::onLogEvent %d_%lld atom %d", mConfigKey.GetUid(),
+                           (long long)mConfigKey.GetId(), tagId);
 
     if (event.isParsedHeaderOnly()) {
         // This should not happen if metric config is defined for certain atom id
-        const int64_t firstMatcherId =
-                mAllAtomMatchingTrackers[*matchersIt->second.begin()]->getId();
+        const int64_t firstMatcherId = mAllAtomMatchingTrackers[plan.matchers.front()]->getId();
         ALOGW("Atom %d is mistakenly skipped - there is a matcher %lld for it", tagId,
               (long long)firstMatcherId);
         return;
     }
 
-    vector<MatchingState> matcherCache(mAllAtomMatchingTrackers.size(),
-                                       MatchingState::kNotComputed);
-    vector<shared_ptr<LogEvent>> matcherTransformations(matcherCache.size(), nullptr);
+    vector<MatchingState>& matcherCache = mMatcherCache;
+    vector<shared_ptr<LogEvent>>& matcherTransformations = mMatcherTransformations;
 
-    for (const auto& matcherIndex : matchersIt->second) {
+    if (sMatchingWorkerPool != nullptr &&
+        plan.simpleMatchers.size() >= sMinMatchersForParallelMatching) {
+        // The simple matchers are already matched when the combinations below reach them.
+        matchInParallel(event, plan.simpleMatchers);
+    }
+    for (const int matcherIndex : plan.matchers) {
         mAllAtomMatchingTrackers[matcherIndex]->onLogEvent(event, matcherIndex,
                                                            mAllAtomMatchingTrackers, matcherCache,
                                                            matcherTransformations);
     }
 
-    // Set of metrics that received an activation cancellation.
-    unordered_set<int> metricIndicesWithCanceledActivations;
+    // Metrics that received an activation cancellation.
+    mMetricIndicesWithCanceledActivations.clear();
 
     // Determine which metric activations received a cancellation and cancel them.
-    for (const auto& it : mDeactivationAtomTrackerToMetricMap) {
-        if (matcherCache[it.first] == MatchingState::kMatched) {
-            for (int metricIndex : it.second) {
-                mAllMetricProducers[metricIndex]->cancelEventActivation(it.first);
-                metricIndicesWithCanceledActivations.insert(metricIndex);
+    for (const int matcherIndex : plan.deactivationMatchers) {
+        if (matcherCache[matcherIndex] == MatchingState::kMatched) {
+            for (int metricIndex : mDeactivationAtomTrackerToMetricMap.at(matcherIndex)) {
+                mAllMetricProducers[metricIndex]->cancelEventActivation(matcherIndex);
+                mMetricIndicesWithCanceledActivations.push_back(metricIndex);
             }
         }
     }
 
     // Determine whether any metrics are no longer active after cancelling metric activations.
-    for (const int metricIndex : metricIndicesWithCanceledActivations) {
-        const sp<MetricProducer>& metric = mAllMetricProducers[metricIndex];
-        metric->flushIfExpire(eventTimeNs);
-        if (!metric->isActive()) {
-            activeMetricsIndices.erase(metricIndex);
-        }
+    for (const int metricIndex : mMetricIndicesWithCanceledActivations) {
+        mAllMetricProducers[metricIndex]->flushIfExpire(eventTimeNs);
+        updateActivationExpiry(metricIndex);
     }
 
-    isActive |= !activeMetricsIndices.empty();
+    isActive |= !mActivationExpiryQueue.empty();
 
 
     // Determine which metric activations should be turned on and turn them on
-    for (const auto& it : mActivationAtomTrackerToMetricMap) {
-        if (matcherCache[it.first] == MatchingState::kMatched) {
-            for (int metricIndex : it.second) {
-                mAllMetricProducers[metricIndex]->activate(it.first, eventTimeNs);
+    for (const int matcherIndex : plan.activationMatchers) {
+        if (matcherCache[matcherIndex] == MatchingState::kMatched) {
+            for (int metricIndex : mActivationAtomTrackerToMetricMap.at(matcherIndex)) {
+                mAllMetricProducers[metricIndex]->activate(matcherIndex, eventTimeNs);
                 isActive |= mAllMetricProducers[metricIndex]->isActive();
+                updateActivationExpiry(metricIndex);
             }
         }
     }
@@ -621,29 +781,39 @@ void MetricsManager::onLogEvent(const LogEvent& event) {
     mIsActive = isActive;
 
     // A bitmap to see which ConditionTracker needs to be re-evaluated.
-    vector<uint8_t> conditionToBeEvaluated(mAllConditionTrackers.size(), false);
-    vector<shared_ptr<LogEvent>> conditionToTransformedLogEvents(mAllConditionTrackers.size(),
-                                                                 nullptr);
+    vector<uint8_t>& conditionToBeEvaluated = mConditionToBeEvaluated;
+    vector<shared_ptr<LogEvent>>& conditionToTransformedLogEvents =
+            mConditionToTransformedLogEvents;
 
-    for (const auto& [matcherIndex, conditionList] : mTrackerToConditionMap) {
+    for (const int matcherIndex : plan.conditionMatchers) {
         if (matcherCache[matcherIndex] == MatchingState::kMatched) {
-            for (const int conditionIndex : conditionList) {
-                conditionToBeEvaluated[conditionIndex] = true;
+            for (const int conditionIndex : mTrackerToConditionMap.at(matcherIndex)) {
+                if (!conditionToBeEvaluated[conditionIndex]) {
+                    conditionToBeEvaluated[conditionIndex] = true;
+                    mConditionsToBeEvaluated.push_back(conditionIndex);
+                }
                 conditionToTransformedLogEvents[conditionIndex] =
                         matcherTransformations[matcherIndex];
             }
         }
     }
 
-    vector<ConditionState> conditionCache(mAllConditionTrackers.size(),
-                                          ConditionState::kNotEvaluated);
+    vector<ConditionState>& conditionCache = mConditionCache;
     // A bitmap to track if a condition has changed value.
-    vector<uint8_t> changedCache(mAllConditionTrackers.size(), false);
-    for (size_t i = 0; i < mAllConditionTrackers.size(); i++) {
+    vector<uint8_t>& changedCache = mChangedCache;
+    for (const int i : plan.conditions) {
         if (!conditionToBeEvaluated[i]) {
             continue;
         }
         sp<ConditionTracker>& condition = mAllConditionTrackers[i];
+        // Children are evaluated first. A combination can't change if none of its children changed,
+        // so the evaluation stops there instead of going through all of its children again.
+        const vector<int>& children = condition->getChildren();
+        if (!condition->IsSimpleCondition() &&
+            std::none_of(children.begin(), children.end(),
+                         [&changedCache](const int child) { return changedCache[child]; })) {
+            continue;
+        }
         const LogEvent& conditionEvent = conditionToTransformedLogEvents[i] == nullptr
                                                  ? event
                                                  : *conditionToTransformedLogEvents[i];
@@ -651,7 +821,7 @@ void MetricsManager::onLogEvent(const LogEvent& event) {
                                      conditionCache, changedCache);
     }
 
-    for (size_t i = 0; i < mAllConditionTrackers.size(); i++) {
+    for (const int i : plan.conditions) {
         if (!changedCache[i]) {
             continue;
         }
@@ -675,8 +845,14 @@ void MetricsManager::onLogEvent(const LogEvent& event) {
             }
         }
     }
+    if (mPullTriggerAtomIds.count(tagId) != 0) {
+        prefetchTriggeredPulls(event, plan.matchers);
+    }
+
     // For matched AtomMatchers, tell relevant metrics that a matched event has come.
-    for (size_t i = 0; i < mAllAtomMatchingTrackers.size(); i++) {
+    // Metrics with the same condition links share the sliced condition queries for the event.
+    EventConditionCache::Scope conditionCacheScope;
+    for (const int i : plan.matchers) {
         if (matcherCache[i] == MatchingState::kMatched) {
             StatsdStats::getInstance().noteMatcherMatched(mConfigKey,
                                                           mAllAtomMatchingTrackers[i]->getId());
@@ -688,13 +864,166 @@ void MetricsManager::onLogEvent(const LogEvent& event) {
             const LogEvent& metricEvent =
                     matcherTransformations[i] == nullptr ? event : *matcherTransformations[i];
             for (const int metricIndex : metricList) {
-                // pushed metrics are never scheduled pulls
-                mAllMetricProducers[metricIndex]->onMatchedLogEvent(i, metricEvent);
+                const int samplingGroup = mMetricSamplingGroups[metricIndex];
+                if (samplingGroup >= 0 && !passesSamplingGroupCheck(samplingGroup, metricEvent)) {
+                    continue;
+                }
+                const sp<MetricProducer>& producer = mAllMetricProducers[metricIndex];
+                if (!mIsLatencySampled) {
+                    // pushed metrics are never scheduled pulls
+                    producer->onMatchedLogEvent(i, metricEvent);
+                    continue;
+                }
+                const int64_t startNs = getElapsedRealtimeNs();
+                producer->onMatchedLogEvent(i, metricEvent);
+                const int64_t processingTimeNs = getElapsedRealtimeNs() - startNs;
+                if (mIsProfiled) {
+                    MetricProfile& profile = mMetricProfiles[metricIndex];
+                    profile.matchedEventCount++;
+                    profile.processingTimeNs += processingTimeNs;
+                    continue;
+                }
+                StatsdStats::getInstance().noteMetricLogEventProcessed(producer->getMetricId(),
+                                                                       processingTimeNs);
             }
         }
     }
+
+    // Leave the scratch buffers as they were for the next event.
+    for (const int matcherIndex : plan.matchers) {
+        resetMatcherResults(matcherIndex);
+    }
+    for (const int conditionIndex : mConditionsToBeEvaluated) {
+        conditionToBeEvaluated[conditionIndex] = false;
+        conditionToTransformedLogEvents[conditionIndex] = nullptr;
+        resetConditionResults(conditionIndex);
+    }
+    mConditionsToBeEvaluated.clear();
+    for (const int samplingGroup : mCheckedSamplingGroups) {
+        mSamplingGroupEvents[samplingGroup] = nullptr;
+    }
+    mCheckedSamplingGroups.clear();
 }
 
+bool MetricsManager::passesSamplingGroupCheck(const int samplingGroup, const LogEvent& event) {
+    if (mSamplingGroupEvents[samplingGroup] != &event) {
+        if (mSamplingGroupEvents[samplingGroup] == nullptr) {
+            mCheckedSamplingGroups.push_back(samplingGroup);
+        }
+        mSamplingGroupEvents[samplingGroup] = &event;
+        const SamplingInfo& samplingInfo = mSamplingGroups[samplingGroup];
+        mSamplingGroupResults[samplingGroup] = MetricProducer::passesSampleCheck(
+                samplingInfo.sampledWhatFields, samplingInfo.shardCount, event.getValues());
+    }
+    return mSamplingGroupResults[samplingGroup];
+}
+
+void MetricsManager::setParallelMatching(size_t numThreads, size_t minMatchers) {
+    sMatchingWorkerPool = numThreads > 0 ? std::make_unique<ShardWorkerPool>(numThreads) : nullptr;
+    sMinMatchersForParallelMatching = minMatchers;
+}
+
+void MetricsManager::matchInParallel(const LogEvent& event, const vector<int>& matchers) {
+    // The matchers only write their own entries of the caches, so the chunks don't share any
+    // state. The workers have no EventMatcherCache::Scope, their matchers don't share results
+    // with the other configs.
+    const auto matchChunk = [this, &event, &matchers](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            mAllAtomMatchingTrackers[matchers[i]]->onLogEvent(
+                    event, matchers[i], mAllAtomMatchingTrackers, mMatcherCache,
+                    mMatcherTransformations);
+        }
+    };
+    const size_t numChunks = sMatchingWorkerPool->getNumShards() + 1;
+    const size_t chunkSize = (matchers.size() + numChunks - 1) / numChunks;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t pendingChunks = 0;
+    for (size_t chunk = 1; chunk < numChunks && chunk * chunkSize < matchers.size(); chunk++) {
+        const size_t begin = chunk * chunkSize;
+        const size_t end = std::min(begin + chunkSize, matchers.size());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingChunks++;
+        }
+        sMatchingWorkerPool->post(chunk - 1, [&, begin, end] {
+            matchChunk(begin, end);
+            // Notified under the lock, the waiter may destroy cv as soon as it is released.
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingChunks--;
+            cv.notify_one();
+        });
+    }
+    matchChunk(0, std::min(chunkSize, matchers.size()));
+
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&pendingChunks] { return pendingChunks == 0; });
+}
+
+void MetricsManager::onSampledLogEvent(const LogEvent& event) {
+    mIsLatencySampled = true;
+    onLogEvent(event);
+    mIsLatencySampled = false;
+}
+
+void MetricsManager::onProfiledLogEvent(const LogEvent& event) {
+    mMetricProfiles.resize(mAllMetricProducers.size());
+    mIsProfiled = true;
+    onSampledLogEvent(event);
+    mIsProfiled = false;
+}
+
+vector<MetricsManager::MetricProfile> MetricsManager::getMetricProfiles() const {
+    vector<MetricProfile> profiles(mMetricProfiles);
+    profiles.resize(mAllMetricProducers.size());
+    for (size_t i = 0; i < mAllMetricProducers.size(); i++) {
+        const sp<MetricProducer>& producer = mAllMetricProducers[i];
+        profiles[i].metricId = producer->getMetricId();
+        profiles[i].dimensionCount = producer->getCurrentDimensionCount();
+        profiles[i].byteSize = producer->byteSize();
+    }
+    return profiles;
+}
+
+void MetricsManager::initLogEventScratchBuffers() {
+    mMatcherCache.assign(mAllAtomMatchingTrackers.size(), MatchingState::kNotComputed);
+    mMatcherTransformations.assign(mAllAtomMatchingTrackers.size(), nullptr);
+    mConditionToBeEvaluated.assign(mAllConditionTrackers.size(), false);
+    mConditionToTransformedLogEvents.assign(mAllConditionTrackers.size(), nullptr);
+    mConditionCache.assign(mAllConditionTrackers.size(), ConditionState::kNotEvaluated);
+    mChangedCache.assign(mAllConditionTrackers.size(), false);
+    mConditionsToBeEvaluated.clear();
+    mSamplingGroupEvents.assign(mSamplingGroups.size(), nullptr);
+    mSamplingGroupResults.assign(mSamplingGroups.size(), false);
+    mCheckedSamplingGroups.clear();
+}
+
+void MetricsManager::resetMatcherResults(const int matcherIndex) {
+    // Matchers only reach their children after computing themselves, so the children of a matcher
+    // that wasn't computed don't need to be reset through it.
+    if (mMatcherCache[matcherIndex] == MatchingState::kNotComputed) {
+        return;
+    }
+    mMatcherCache[matcherIndex] = MatchingState::kNotComputed;
+    mMatcherTransformations[matcherIndex] = nullptr;
+    for (const int child : mAllAtomMatchingTrackers[matcherIndex]->getChildren()) {
+        resetMatcherResults(child);
+    }
+}
+
+void MetricsManager::resetConditionResults(const int conditionIndex) {
+    mChangedCache[conditionIndex] = false;
+    if (mConditionCache[conditionIndex] == ConditionState::kNotEvaluated) {
+        return;
+    }
+    mConditionCache[conditionIndex] = ConditionState::kNotEvaluated;
+    for (const int child : mAllConditionTrackers[conditionIndex]->getChildren()) {
+        resetConditionResults(child);
+    }
+}
+
+
 void MetricsManager::onAnomalyAlarmFired(
         const int64_t timestampNs,
         unordered_set<sp<const InternalAlarm>, SpHash<InternalAlarm>>& alarmSet) {
@@ -720,6 +1049,16 @@ size_t MetricsManager::byteSize() {
     return totalSize;
 }
 
+ConfigMemoryUsage MetricsManager::getMemoryUsage() const {
+    ConfigMemoryUsage usage;
+    for (const auto& metricProducer : mAllMetricProducers) {
+        usage.bucketBytes += metricProducer->byteSize();
+        usage.dimensionCount += metricProducer->getCurrentDimensionCount();
+        usage.gaugeAtomCount += metricProducer->getCurrentAtomCount();
+    }
+    return usage;
+}
+
 void MetricsManager::loadActiveConfig(const ActiveConfig& config, int64_t currentTimeNs) {
     if (config.metric_size() == 0) {
         ALOGW("No active metric for config %s", mConfigKey.ToString().c_str());
@@ -738,11 +1077,21 @@ void MetricsManager::loadActiveConfig(const ActiveConfig& config, int64_t curren
                                                                        /*activate=*/ true);
                 }
                 mIsActive |= metric->isActive();
+                updateActivationExpiry(metricIndex);
             }
         }
     }
 }
 
+bool MetricsManager::hasActivationToPersist(int64_t currentTimeNs) const {
+    for (int metricIndex : mMetricIndexesWithActivation) {
+        if (mAllMetricProducers[metricIndex]->hasActivationToPersist(currentTimeNs)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void MetricsManager::writeActiveConfigToProtoOutputStream(
         int64_t currentTimeNs, const DumpReportReason reason, ProtoOutputStream* proto) {
     proto->write(FIELD_TYPE_INT64 | FIELD_ID_ACTIVE_CONFIG_ID, (long long)mConfigKey.GetId());
@@ -756,6 +1105,14 @@ void MetricsManager::writeActiveConfigToProtoOutputStream(
     }
 }
 
+int64_t MetricsManager::getMetadataUpdates() const {
+    int64_t updates = 0;
+    for (const auto& anomalyTracker : mAllAnomalyTrackers) {
+        updates += anomalyTracker->getRefractoryPeriodUpdates();
+    }
+    return updates;
+}
+
 bool MetricsManager::writeMetadataToProto(int64_t currentWallClockTimeNs,
                                           int64_t systemElapsedTimeNs,
                                           metadata::StatsMetadata* statsMetadata) {
@@ -812,16 +1169,21 @@ void MetricsManager::enforceRestrictedDataTtls(const int64_t wallClockNs) {
     if (!hasRestrictedMetricsDelegate()) {
         return;
     }
-    sqlite3* db = dbutils::getDb(mConfigKey);
-    if (db == nullptr) {
-        ALOGE("Failed to open sqlite db");
+    // Ordered after the pending inserts, see dbutils::runDbWrite.
+    const ConfigKey key = mConfigKey;
+    const vector<sp<MetricProducer>> producers = mAllMetricProducers;
+    dbutils::runDbWrite([key, producers, wallClockNs] {
+        sqlite3* db = dbutils::getDb(key);
+        if (db == nullptr) {
+            ALOGE("Failed to open sqlite db");
+            dbutils::closeDb(db);
+            return;
+        }
+        for (const auto& producer : producers) {
+            producer->enforceRestrictedDataTtl(db, wallClockNs);
+        }
         dbutils::closeDb(db);
-        return;
-    }
-    for (const auto& producer : mAllMetricProducers) {
-        producer->enforceRestrictedDataTtl(db, wallClockNs);
-    }
-    dbutils::closeDb(db);
+    });
 }
 
 bool MetricsManager::validateRestrictedMetricsDelegate(const int32_t callingUid) {
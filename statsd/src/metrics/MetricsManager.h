@@ -21,13 +21,16 @@
 #include "anomaly/AlarmMonitor.h"
 #include "anomaly/AlarmTracker.h"
 #include "anomaly/AnomalyTracker.h"
+#include "anomaly/indexed_priority_queue.h"
 #include "condition/ConditionTracker.h"
+#include "condition/SharedConditionStates.h"
 #include "config/ConfigKey.h"
 #include "external/StatsPullerManager.h"
 #include "guardrail/StatsdStats.h"
 #include "logd/LogEvent.h"
 #include "matchers/AtomMatchingTracker.h"
 #include "metrics/MetricProducer.h"
+#include "metrics/parsing_utils/metrics_manager_util.h"
 #include "packages/UidMap.h"
 #include "src/statsd_config.pb.h"
 #include "src/statsd_metadata.pb.h"
@@ -43,7 +46,8 @@ public:
                    const int64_t currentTimeNs, const sp<UidMap>& uidMap,
                    const sp<StatsPullerManager>& pullerManager,
                    const sp<AlarmMonitor>& anomalyAlarmMonitor,
-                   const sp<AlarmMonitor>& periodicAlarmMonitor);
+                   const sp<AlarmMonitor>& periodicAlarmMonitor,
+                   const sp<SharedConditionStates>& sharedConditionStates = nullptr);
 
     virtual ~MetricsManager();
 
@@ -58,6 +62,35 @@ public:
 
     virtual void onLogEvent(const LogEvent& event);
 
+    // Same as onLogEvent, but also notes to StatsdStats how long each metric took to process the
+    // event, for the events sampled for latency tracking.
+    void onSampledLogEvent(const LogEvent& event);
+
+    // Cost of a metric measured while replaying events with onProfiledLogEvent.
+    struct MetricProfile {
+        int64_t metricId = 0;
+        int64_t matchedEventCount = 0;
+        int64_t processingTimeNs = 0;
+        int64_t dimensionCount = 0;
+        int64_t byteSize = 0;
+    };
+
+    // Same as onSampledLogEvent, but adds the time each metric took to process the event to its
+    // profile instead of noting it to StatsdStats. Used for configs that are profiled and never
+    // added to statsd.
+    void onProfiledLogEvent(const LogEvent& event);
+
+    // Returns the profiles accumulated by onProfiledLogEvent, with the current dimension count and
+    // byte size of each metric.
+    std::vector<MetricProfile> getMetricProfiles() const;
+
+    // Enables matching the events of the atoms with at least minMatchers SimpleAtomMatchers in a
+    // config on numThreads worker threads shared by all the configs, as well as on the thread
+    // processing the event. The combination matchers are matched afterwards on the processing
+    // thread from the results of the simple ones. A numThreads of 0 disables it. Should not be
+    // called while events are processed.
+    static void setParallelMatching(size_t numThreads, size_t minMatchers);
+
     void onAnomalyAlarmFired(
             int64_t timestampNs,
             unordered_set<sp<const InternalAlarm>, SpHash<InternalAlarm>>& alarmSet);
@@ -76,6 +109,10 @@ public:
 
     void init();
 
+    // Drops the data of all the metrics and restarts their buckets at timestampNs when the TTL of
+    // the config expires, without building the matchers, conditions and metrics again.
+    void resetOnTtlExpired(int64_t timestampNs);
+
     vector<int32_t> getPullAtomUids(int32_t atomId) override;
 
     bool shouldWriteToDisk() const {
@@ -108,6 +145,10 @@ public:
         return mPackageCertificateHashSizeBytes;
     }
 
+    inline int32_t uidMapFullSnapshotPeriod() const {
+        return mUidMapFullSnapshotPeriod;
+    }
+
     void refreshTtl(const int64_t currentTimestampNs) {
         if (mTtlNs > 0) {
             mTtlEndNs = currentTimestampNs + mTtlNs;
@@ -132,13 +173,46 @@ public:
 
     virtual void onDumpReport(const int64_t dumpTimeNs, int64_t wallClockNs,
                               const bool include_current_partial_bucket, const bool erase_data,
-                              const DumpLatency dumpLatency, std::set<string>* str_set,
+                              const DumpLatency dumpLatency, ReportStringTable* str_set,
                               android::util::ProtoOutputStream* protoOutput);
 
+    // Same as onDumpReport, but only dumps the metrics from *metricIndex on, until their reports
+    // reach maxBytes. At least one metric is dumped. Each metric is dumped on its own before being
+    // added to protoOutput, so that only one of them is buffered at a time. *metricIndex is set to
+    // the index of the next metric to dump, or to getNumMetrics() once they are all dumped. The
+    // annotations and the report timestamps are only written or updated with the last metric.
+    void onDumpReportPage(const int64_t dumpTimeNs, int64_t wallClockNs,
+                          const bool include_current_partial_bucket, const bool erase_data,
+                          const DumpLatency dumpLatency, size_t maxBytes, size_t* metricIndex,
+                          ReportStringTable* str_set,
+                          android::util::ProtoOutputStream* protoOutput);
+
+    // Dumps the report of the metric at metricIndex in place into protoOutput, or clears its past
+    // buckets if the metric is not reported. onDumpReport() calls it for each metric.
+    void onDumpMetricReport(size_t metricIndex, const int64_t dumpTimeNs,
+                            const bool include_current_partial_bucket, const bool erase_data,
+                            const DumpLatency dumpLatency, ReportStringTable* str_set,
+                            android::util::ProtoOutputStream* protoOutput);
+
+    // Writes the annotations of the report and updates the report timestamps if erase_data.
+    void onDumpReportEnd(const int64_t dumpTimeNs, int64_t wallClockNs, const bool erase_data,
+                         android::util::ProtoOutputStream* protoOutput);
+
+    // Flushes the buckets of all the metrics that ended by timestampNs.
+    void flushIfNeeded(int64_t timestampNs);
+
+    // See MetricProducer::getDumpCutEndNs, for the metric at metricIndex.
+    int64_t getDumpCutEndNs(size_t metricIndex, int64_t dumpTimeNs) const {
+        return mAllMetricProducers[metricIndex]->getDumpCutEndNs(dumpTimeNs);
+    }
+
     // Computes the total byte size of all metrics managed by a single config source.
     // Does not change the state.
     virtual size_t byteSize();
 
+    // Computes the memory used by the metrics of the config. Does not change the state.
+    ConfigMemoryUsage getMemoryUsage() const;
+
     // Returns whether or not this config is active.
     // The config is active if any metric in the config is active.
     inline bool isActive() const {
@@ -147,9 +221,16 @@ public:
 
     void loadActiveConfig(const ActiveConfig& config, int64_t currentTimeNs);
 
+    // Returns true if a metric of the config has an activation to restore after a restart.
+    bool hasActivationToPersist(int64_t currentTimeNs) const;
+
     void writeActiveConfigToProtoOutputStream(
             int64_t currentTimeNs, const DumpReportReason reason, ProtoOutputStream* proto);
 
+    // Increases when the metadata written by writeMetadataToProto() changes. The metadata of the
+    // metrics only changes with the config.
+    int64_t getMetadataUpdates() const;
+
     // Returns true if at least one piece of metadata is written.
     bool writeMetadataToProto(int64_t currentWallClockTimeNs,
                               int64_t systemElapsedTimeNs,
@@ -183,6 +264,17 @@ public:
     // Adds all atom ids referenced by matchers in the MetricsManager's config
     void addAllAtomIds(LogEventFilter::AtomIdSet& allIds) const;
 
+    // Gets the fields of atoms used by the MetricsManager's config. Atoms which are used by
+    // matchers but absent in the map are used entirely.
+    inline const AtomFieldMaskMap& getAtomFieldMasks() const {
+        return mAtomFieldMasks;
+    }
+
+    // Gets the atoms feeding the alerts of the MetricsManager's config.
+    inline const std::set<int>& getPriorityAtomIds() const {
+        return mPriorityAtomIds;
+    }
+
     // Gets the memory limit for the MetricsManager's config
     inline size_t getMaxMetricsBytes() const {
         return mMaxMetricsBytes;
@@ -202,6 +294,11 @@ private:
 
     bool mHashStringsInReport = false;
     bool mVersionStringsInReport = false;
+
+    int32_t mUidMapFullSnapshotPeriod = 0;
+
+    // Whether app upgrades and removals only split the buckets of the metrics related to the app.
+    bool mSplitBucketForRelatedAppUpgradeOnly = false;
     bool mInstallerInReport = false;
     uint8_t mPackageCertificateHashSizeBytes;
 
@@ -213,6 +310,9 @@ private:
 
     optional<InvalidConfigReason> mInvalidConfigReason;
 
+    // Time spent in each phase of initStatsdConfig, reported to StatsdStats.
+    ConfigInitLatencies mInitLatencies;
+
     sp<StatsPullerManager> mPullerManager;
 
     // The uid log sources from StatsdConfig.
@@ -223,9 +323,13 @@ private:
 
     // The combined uid sources (after translating pkg name to uid).
     // Logs from uids that are not in the list will be ignored to avoid spamming.
+    // Only rebuilt by initAllowedLogSources from the config and uid map updates. StatsLogProcessor
+    // makes those wait for the processing of the events, including on the shards, so the events
+    // read it without a lock.
     std::set<int32_t> mAllowedLogSources;
 
-    // To guard access to mAllowedLogSources
+    // To guard access to mCombinedPullAtomUids, which the pullers read outside of the event
+    // processing.
     mutable std::mutex mAllowedLogSourcesMutex;
 
     std::set<int32_t> mWhitelistedAtomIds;
@@ -251,6 +355,15 @@ private:
     // All event tags that are interesting to config metrics matchers.
     std::unordered_map<int, std::vector<int>> mTagIdsToMatchersMap;
 
+    // Top-level fields of atoms used by the config, see computeAtomFieldMasks().
+    AtomFieldMaskMap mAtomFieldMasks;
+
+    // Atoms queued with priority by the socket listener, see computePriorityAtomIds().
+    std::set<int> mPriorityAtomIds;
+
+    // Atoms that trigger the pulls of gauge metrics, see computePullTriggerAtomIds().
+    std::set<int> mPullTriggerAtomIds;
+
     // We only store the sp of AtomMatchingTracker, MetricProducer, and ConditionTracker in
     // MetricsManager. There are relationships between them, and the relationships are denoted by
     // index instead of pointers. The reasons for this are: (1) the relationship between them are
@@ -304,6 +417,19 @@ private:
     // Maps from AtomMatchingTracker to ConditionTracker
     std::unordered_map<int, std::vector<int>> mTrackerToConditionMap;
 
+    // Indices of the ConditionTrackers, children before the combinations using them, see
+    // computeConditionEvaluationOrder().
+    std::vector<int> mConditionEvaluationOrder;
+
+    // Maps from atom id to the trackers and metrics its events can reach, see
+    // computeAtomDispatchPlans().
+    std::unordered_map<int, AtomDispatchPlan> mAtomDispatchPlans;
+
+    // Index in mSamplingGroups of the sampling of each metric, or -1 if the events it doesn't
+    // sample are dropped by the metric itself, see computeMetricSamplingGroups().
+    std::vector<int> mMetricSamplingGroups;
+    std::vector<SamplingInfo> mSamplingGroups;
+
     // Maps from ConditionTracker to MetricProducer
     std::unordered_map<int, std::vector<int>> mConditionToMetricMap;
 
@@ -319,8 +445,93 @@ private:
 
     std::vector<int> mMetricIndexesWithActivation;
 
+    // Active metric of mMetricIndexesWithActivation, queued until its activations expire.
+    struct ActivationExpiry : public RefBase {
+        ActivationExpiry(const int metricIndex, const int64_t expiryNs)
+            : metricIndex(metricIndex), expiryNs(expiryNs) {
+        }
+
+        const int metricIndex;
+        const int64_t expiryNs;
+
+        struct SoonerExpiry {
+            bool operator()(const sp<const ActivationExpiry>& a,
+                            const sp<const ActivationExpiry>& b) const {
+                return a->expiryNs < b->expiryNs;
+            }
+        };
+    };
+
+    // The active metrics with activations, soonest expiry first. Only the metrics at the top need
+    // to be flushed when an event comes.
+    indexed_priority_queue<ActivationExpiry, ActivationExpiry::SoonerExpiry> mActivationExpiryQueue;
+
+    // Entry of each metric in mActivationExpiryQueue by metric index, nullptr if not queued.
+    std::vector<sp<const ActivationExpiry>> mActivationExpiries;
+
+    // Queues the metric with its current activation expiry if it is active, removes it from
+    // mActivationExpiryQueue otherwise. Called whenever the activations of the metric change.
+    void updateActivationExpiry(const int metricIndex);
+
+    // Matches the event against the matchers, which must be simple ones, by chunks on the workers
+    // of setParallelMatching and on the calling thread. Returns once they are all matched.
+    void matchInParallel(const LogEvent& event, const std::vector<int>& matchers);
+
+    // Pulls the atoms of the gauge metrics triggered by the event together, after its matchers
+    // and conditions are evaluated. The metrics then get them from the caches of the pullers
+    // instead of pulling them one after the other.
+    void prefetchTriggeredPulls(const LogEvent& event, const std::vector<int>& matchers);
+
+    // Scratch buffers of onLogEvent, kept across events so that they aren't allocated for each
+    // event. The matcher and condition results are sized to the trackers and are back to their
+    // initial values when onLogEvent returns. Only the entries of the trackers an event reached
+    // are reset.
+    std::vector<MatchingState> mMatcherCache;
+    std::vector<std::shared_ptr<LogEvent>> mMatcherTransformations;
+    std::vector<uint8_t> mConditionToBeEvaluated;
+    std::vector<std::shared_ptr<LogEvent>> mConditionToTransformedLogEvents;
+    std::vector<ConditionState> mConditionCache;
+    std::vector<uint8_t> mChangedCache;
+    // Indices of the conditions set in mConditionToBeEvaluated for the current event.
+    std::vector<int> mConditionsToBeEvaluated;
+    std::vector<int> mMetricIndicesWithCanceledActivations;
+    // Event each sampling group was checked on for the current event, and the result. The metrics
+    // of different matchers may get different transformations of the event.
+    std::vector<const LogEvent*> mSamplingGroupEvents;
+    std::vector<uint8_t> mSamplingGroupResults;
+    // Indices of the sampling groups set in mSamplingGroupEvents for the current event.
+    std::vector<int> mCheckedSamplingGroups;
+
+    // Set while the event being processed is sampled for latency tracking, see onSampledLogEvent.
+    bool mIsLatencySampled = false;
+
+    // Set while the event being processed is profiled, see onProfiledLogEvent.
+    bool mIsProfiled = false;
+
+    // Indexed like mAllMetricProducers once an event was profiled.
+    std::vector<MetricProfile> mMetricProfiles;
+
+    // Only called on config creation/update. Sizes the scratch buffers to the trackers.
+    void initLogEventScratchBuffers();
+
+    // Whether the event passes the sampling of the group, checked once per event and group.
+    bool passesSamplingGroupCheck(const int samplingGroup, const LogEvent& event);
+
+    // Resets the results of the matcher and of its children to kNotComputed.
+    void resetMatcherResults(const int matcherIndex);
+
+    // Resets the results of the condition and of its children to kNotEvaluated.
+    void resetConditionResults(const int conditionIndex);
+
     void initAllowedLogSources();
 
+    // Returns true if the app can log or pull atoms for the config, so all the metrics may be
+    // related to it.
+    bool isLogOrPullSource(const int32_t uid) const;
+
+    // Notifies the metrics of the upgrade or removal of the app with this uid.
+    void notifyMetricsOfAppChange(const int64_t eventTimeNs, const int32_t uid);
+
     void initPullAtomSources();
 
     // Only called on config creation/update to initialize log sources from the config.
@@ -332,7 +543,7 @@ private:
     // Sets up mInvalidConfigReason on error. Should be called on config creation/update
     void verifyGuardrailsAndUpdateStatsdStats();
 
-    // Initializes mIsAlwaysActive and mIsActive.
+    // Initializes mIsAlwaysActive, mIsActive and mActivationExpiryQueue.
     // Should be called on config creation/update.
     void initializeConfigActiveStatus();
 
@@ -383,6 +594,7 @@ private:
                 TestCountMetric_save_refractory_to_disk_no_data_written);
     FRIEND_TEST(AnomalyCountDetectionE2eTest, TestCountMetric_save_refractory_to_disk);
     FRIEND_TEST(AnomalyCountDetectionE2eTest, TestCountMetric_load_refractory_from_disk);
+    FRIEND_TEST(AnomalyCountDetectionE2eTest, TestCountMetric_skip_unchanged_refractory_write);
     FRIEND_TEST(AnomalyDurationDetectionE2eTest, TestDurationMetric_SUM_single_bucket);
     FRIEND_TEST(AnomalyDurationDetectionE2eTest, TestDurationMetric_SUM_partial_bucket);
     FRIEND_TEST(AnomalyDurationDetectionE2eTest, TestDurationMetric_SUM_multiple_buckets);
@@ -399,6 +611,8 @@ private:
 
     FRIEND_TEST(MetricsManagerTest, TestLogSources);
     FRIEND_TEST(MetricsManagerTest, TestLogSourcesOnConfigUpdate);
+    FRIEND_TEST(MetricsManagerTest, TestActivationExpiryQueue);
+    FRIEND_TEST(MetricsManagerTest, TestLogEventScratchBuffersReset);
     FRIEND_TEST(MetricsManagerTest_SPlus, TestRestrictedMetricsConfig);
     FRIEND_TEST(MetricsManagerTest_SPlus, TestRestrictedMetricsConfigUpdate);
     FRIEND_TEST(MetricsManagerUtilTest, TestSampledMetrics);
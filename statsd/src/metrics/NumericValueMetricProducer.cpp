@@ -22,6 +22,9 @@
 #include <limits.h>
 #include <stdlib.h>
 
+#include <algorithm>
+
+#include "condition/EventConditionCache.h"
 #include "guardrail/StatsdStats.h"
 #include "metrics/parsing_utils/metrics_manager_util.h"
 #include "stats_log_util.h"
@@ -60,6 +63,19 @@ const int FIELD_ID_CONDITION_CORRECTION_NS = 11;
 const Value ZERO_LONG((int64_t)0);
 const Value ZERO_DOUBLE(0.0);
 
+namespace {
+
+// Sums of the values of the pulled events with the same dimensions in what.
+struct PulledDimensionValues {
+    // First event with the dimensions, which is reported with the sums as its values.
+    const LogEvent* event;
+    // Index in the values of event of each field in mFieldMatchers, -1 if missing.
+    vector<int> valueIndices;
+    vector<Value> sums;
+};
+
+}  // namespace
+
 // ValueMetric has a minimum bucket size of 10min so that we don't pull too frequently
 NumericValueMetricProducer::NumericValueMetricProducer(
         const ConfigKey& key, const ValueMetric& metric, const uint64_t protoHash,
@@ -107,7 +123,7 @@ void NumericValueMetricProducer::invalidateCurrentBucket(const int64_t dropTimeN
 
 void NumericValueMetricProducer::resetBase() {
     for (auto& [_, dimInfo] : mDimInfos) {
-        for (optional<Value>& base : dimInfo.dimExtras) {
+        for (DiffBase& base : dimInfo.dimExtras) {
             base.reset();
         }
     }
@@ -218,23 +234,6 @@ void NumericValueMetricProducer::onDataPulled(const std::vector<std::shared_ptr<
     flushIfNeededLocked(originalPullTimeNs);
 }
 
-void NumericValueMetricProducer::combineValueFields(pair<LogEvent, vector<int>>& eventValues,
-                                                    const LogEvent& newEvent,
-                                                    const vector<int>& newValueIndices) const {
-    if (eventValues.second.size() != newValueIndices.size()) {
-        ALOGE("NumericValueMetricProducer value indices sizes don't match");
-        return;
-    }
-    vector<FieldValue>* const aggregateFieldValues = eventValues.first.getMutableValues();
-    const vector<FieldValue>& newFieldValues = newEvent.getValues();
-    for (size_t i = 0; i < eventValues.second.size(); ++i) {
-        if (newValueIndices[i] != -1 && eventValues.second[i] != -1) {
-            (*aggregateFieldValues)[eventValues.second[i]].mValue +=
-                    newFieldValues[newValueIndices[i]].mValue;
-        }
-    }
-}
-
 // Process events retrieved from a pull.
 void NumericValueMetricProducer::accumulateEvents(const vector<shared_ptr<LogEvent>>& allData,
                                                   int64_t originalPullTimeNs,
@@ -247,6 +246,10 @@ void NumericValueMetricProducer::accumulateEvents(const vector<shared_ptr<LogEve
         return;
     }
 
+    // The matched events are local copies that don't outlive this function, so their condition
+    // queries can't be cached.
+    EventConditionCache::Scope noConditionCache(/*enabled=*/false);
+
     const int64_t elapsedRealtimeNs = getElapsedRealtimeNs();
     const int64_t pullDelayNs = elapsedRealtimeNs - originalPullTimeNs;
     StatsdStats::getInstance().notePullDelay(mPullAtomId, pullDelayNs);
@@ -261,12 +264,20 @@ void NumericValueMetricProducer::accumulateEvents(const vector<shared_ptr<LogEve
     }
 
     mMatchedMetricDimensionKeys.clear();
+    // The events are copied into a single LogEvent to set their timestamp, so pulls with many
+    // rows reuse its storage.
+    LogEvent localCopy(/*uid=*/0, /*pid=*/0);
     if (mUseDiff) {
         // An extra aggregation step is needed to sum values with matching dimensions
-        // before calculating the diff between sums of consecutive pulls.
-        std::unordered_map<HashableDimensionKey, pair<LogEvent, vector<int>>> aggregateEvents;
+        // before calculating the diff between sums of consecutive pulls. The values are summed
+        // apart from the events, which are only copied once per dimension.
+        vector<shared_ptr<LogEvent>> transformedEvents;
+        vector<PulledDimensionValues> aggregates;
+        unordered_map<HashableDimensionKey, size_t> aggregateIndices;
+        aggregateIndices.reserve(allData.size());
+        vector<int> valueIndices(mFieldMatchers.size(), -1);
         for (const auto& data : allData) {
-            const auto [matchResult, transformedEvent] =
+            auto [matchResult, transformedEvent] =
                     mEventMatcherWizard->matchLogEvent(*data, mWhatMatcherIndex);
             if (matchResult != MatchingState::kMatched) {
                 continue;
@@ -274,34 +285,57 @@ void NumericValueMetricProducer::accumulateEvents(const vector<shared_ptr<LogEve
 
             // Get dimensions_in_what key and value indices.
             HashableDimensionKey dimensionsInWhat;
-            vector<int> valueIndices(mFieldMatchers.size(), -1);
+            std::fill(valueIndices.begin(), valueIndices.end(), -1);
             const LogEvent& eventRef = transformedEvent == nullptr ? *data : *transformedEvent;
             if (!filterValues(mDimensionsInWhat, mFieldMatchers, eventRef.getValues(),
                               dimensionsInWhat, valueIndices)) {
                 StatsdStats::getInstance().noteBadValueType(mMetricId);
             }
 
-            // Store new event in map or combine values in existing event.
-            auto it = aggregateEvents.find(dimensionsInWhat);
-            if (it == aggregateEvents.end()) {
-                aggregateEvents.emplace(std::piecewise_construct,
-                                        std::forward_as_tuple(dimensionsInWhat),
-                                        std::forward_as_tuple(eventRef, valueIndices));
-            } else {
-                combineValueFields(it->second, eventRef, valueIndices);
+            // Start the sums of a new dimension or add the values to the existing ones.
+            const auto [it, inserted] =
+                    aggregateIndices.emplace(std::move(dimensionsInWhat), aggregates.size());
+            const vector<FieldValue>& values = eventRef.getValues();
+            if (inserted) {
+                PulledDimensionValues& aggregate = aggregates.emplace_back();
+                aggregate.event = &eventRef;
+                aggregate.valueIndices = valueIndices;
+                aggregate.sums.resize(valueIndices.size());
+                for (size_t i = 0; i < valueIndices.size(); ++i) {
+                    if (valueIndices[i] != -1) {
+                        aggregate.sums[i] = values[valueIndices[i]].mValue;
+                    }
+                }
+                if (transformedEvent != nullptr) {
+                    transformedEvents.push_back(std::move(transformedEvent));
+                }
+                continue;
+            }
+            PulledDimensionValues& aggregate = aggregates[it->second];
+            for (size_t i = 0; i < valueIndices.size(); ++i) {
+                if (valueIndices[i] != -1 && aggregate.valueIndices[i] != -1) {
+                    aggregate.sums[i] += values[valueIndices[i]].mValue;
+                }
             }
         }
 
-        for (auto& [dimKey, eventInfo] : aggregateEvents) {
-            eventInfo.first.setElapsedTimestampNs(eventElapsedTimeNs);
-            onMatchedLogEventLocked(mWhatMatcherIndex, eventInfo.first);
+        for (const PulledDimensionValues& aggregate : aggregates) {
+            localCopy = *aggregate.event;
+            vector<FieldValue>* const aggregateFieldValues = localCopy.getMutableValues();
+            for (size_t i = 0; i < aggregate.valueIndices.size(); ++i) {
+                if (aggregate.valueIndices[i] != -1) {
+                    (*aggregateFieldValues)[aggregate.valueIndices[i]].mValue = aggregate.sums[i];
+                }
+            }
+            localCopy.setElapsedTimestampNs(eventElapsedTimeNs);
+            onMatchedLogEventLocked(mWhatMatcherIndex, localCopy);
         }
     } else {
         for (const auto& data : allData) {
             const auto [matchResult, transformedEvent] =
                     mEventMatcherWizard->matchLogEvent(*data, mWhatMatcherIndex);
             if (matchResult == MatchingState::kMatched) {
-                LogEvent localCopy = transformedEvent == nullptr ? *data : *transformedEvent;
+                localCopy = transformedEvent == nullptr ? *data : *transformedEvent;
                 localCopy.setElapsedTimestampNs(eventElapsedTimeNs);
                 onMatchedLogEventLocked(mWhatMatcherIndex, localCopy);
             }
@@ -323,6 +357,7 @@ void NumericValueMetricProducer::accumulateEvents(const vector<shared_ptr<LogEve
             auto it = mDimInfos.find(whatKey);
             if (it != mDimInfos.end()) {
                 mDimInfos.erase(it);
+                invalidateHotDimensions();
             }
             // Turn OFF condition timer for keys not present in pulled data.
             currentValueBucket.conditionTimer.onConditionChanged(false, eventElapsedTimeNs);
@@ -340,6 +375,7 @@ void NumericValueMetricProducer::accumulateEvents(const vector<shared_ptr<LogEve
     if (hasReachedGuardRailLimit()) {
         invalidateCurrentBucket(eventElapsedTimeNs, BucketDropReason::DIMENSION_GUARDRAIL_REACHED);
         mCurrentSlicedBucket.clear();
+        invalidateHotDimensions();
     }
 }
 
@@ -412,7 +448,7 @@ bool NumericValueMetricProducer::aggregateFields(const int64_t eventTimeNs,
         const Matcher& matcher = mFieldMatchers[i];
         Interval& interval = intervals[i];
         interval.aggIndex = i;
-        optional<Value>& base = bases[i];
+        DiffBase& base = bases[i];
         Value value;
         if (!getDoubleOrLong(event, matcher, value)) {
             VLOG("Failed to get value %zu from event %s", i, event.ToString().c_str());
@@ -627,12 +663,7 @@ void NumericValueMetricProducer::appendToFullBucket(const bool isFullBucketReach
 }
 
 size_t NumericValueMetricProducer::byteSizeLocked() const {
-    size_t totalSize = 0;
-    for (const auto& [_, buckets] : mPastBuckets) {
-        totalSize += buckets.size() * kBucketSize;
-        // TODO(b/189283526): Add bytes used to store PastBucket.aggIndex vector
-    }
-    return totalSize;
+    return mPastBucketsByteSize;
 }
 
 bool NumericValueMetricProducer::valuePassesThreshold(const Interval& interval) const {
@@ -26,8 +26,68 @@ namespace android {
 namespace os {
 namespace statsd {
 
-// TODO(b/185796344): don't use Value from FieldValue.
-using ValueBases = std::vector<std::optional<Value>>;
+// Diff base of a value field. The values of a ValueMetric are always read as LONG or DOUBLE, so
+// the base only stores the number instead of a whole Value with its string and storage members.
+// There is one base per dimension and value field, which adds up for pulled atoms with thousands
+// of dimensions. Keeps the interface of the std::optional<Value> it replaces.
+class DiffBase {
+public:
+    inline bool has_value() const {
+        return mType != UNKNOWN;
+    }
+
+    inline Value value() const {
+        return mType == LONG ? Value(mLongValue) : Value(mDoubleValue);
+    }
+
+    inline void reset() {
+        mType = UNKNOWN;
+    }
+
+    inline DiffBase& operator=(const Value& value) {
+        if (value.type == LONG) {
+            mLongValue = value.long_value;
+            mType = LONG;
+        } else {
+            mDoubleValue = value.getDouble();
+            mType = DOUBLE;
+        }
+        return *this;
+    }
+
+    inline operator std::optional<Value>() const {
+        return has_value() ? std::optional<Value>(value()) : std::nullopt;
+    }
+
+    inline bool operator==(const DiffBase& that) const {
+        if (mType != that.mType) {
+            return false;
+        }
+        switch (mType) {
+            case LONG:
+                return mLongValue == that.mLongValue;
+            case DOUBLE:
+                return mDoubleValue == that.mDoubleValue;
+            default:
+                return true;
+        }
+    }
+
+    inline bool operator!=(const DiffBase& that) const {
+        return !(*this == that);
+    }
+
+private:
+    union {
+        int64_t mLongValue;
+        double mDoubleValue = 0;
+    };
+
+    // UNKNOWN if there's no base, LONG or DOUBLE otherwise.
+    Type mType = UNKNOWN;
+};
+
+using ValueBases = std::vector<DiffBase>;
 class NumericValueMetricProducer : public ValueMetricProducer<Value, ValueBases> {
 public:
     NumericValueMetricProducer(const ConfigKey& key, const ValueMetric& valueMetric,
@@ -142,9 +202,6 @@ private:
     // Internal function to calculate the current used bytes.
     size_t byteSizeLocked() const override;
 
-    void combineValueFields(pair<LogEvent, vector<int>>& eventValues, const LogEvent& newEvent,
-                            const vector<int>& newValueIndices) const;
-
     const bool mUseAbsoluteValueOnReset;
 
     const ValueMetric::AggregationType mAggregationType;
@@ -172,7 +229,7 @@ private:
     const int64_t mMaxPullDelayNs;
 
     // For anomaly detection.
-    std::unordered_map<MetricDimensionKey, int64_t> mCurrentFullBucket;
+    FlatHashMap<MetricDimensionKey, int64_t> mCurrentFullBucket;
 
     FRIEND_TEST(NumericValueMetricProducerTest, TestAnomalyDetection);
     FRIEND_TEST(NumericValueMetricProducerTest, TestBaseSetOnConditionChange);
@@ -188,6 +245,8 @@ private:
     FRIEND_TEST(NumericValueMetricProducerTest, TestEmptyDataResetsBase_onDataPulled);
     FRIEND_TEST(NumericValueMetricProducerTest, TestEventsWithNonSlicedCondition);
     FRIEND_TEST(NumericValueMetricProducerTest, TestFirstBucket);
+    FRIEND_TEST(NumericValueMetricProducerTest, TestIntervalsRecycledAcrossBuckets);
+    FRIEND_TEST(NumericValueMetricProducerTest, TestHotDimensions);
     FRIEND_TEST(NumericValueMetricProducerTest, TestLateOnDataPulledWithDiff);
     FRIEND_TEST(NumericValueMetricProducerTest, TestLateOnDataPulledWithoutDiff);
     FRIEND_TEST(NumericValueMetricProducerTest, TestPartialResetOnBucketBoundaries);
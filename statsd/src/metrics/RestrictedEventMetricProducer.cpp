@@ -31,6 +31,45 @@ namespace statsd {
 
 #define NS_PER_DAY (24 * 3600 * NS_PER_SEC)
 
+// The db writes below only use the state they are passed, since they may run on the db writer
+// thread after the producer is destroyed (see dbutils::setAsyncDbWrites).
+static void deleteTable(const ConfigKey& key, const int64_t metricId, bool* isMetricTableCreated) {
+    if (!dbutils::deleteTable(key, metricId)) {
+        StatsdStats::getInstance().noteRestrictedMetricTableDeletionError(key, metricId);
+        VLOG("Failed to delete table for metric %lld", (long long)metricId);
+    }
+    *isMetricTableCreated = false;
+}
+
+static void insertEvents(const ConfigKey& key, const int64_t metricId,
+                         const RestrictedEventBuffer& events, bool* isMetricTableCreated) {
+    int64_t flushStartNs = getElapsedRealtimeNs();
+    if (!*isMetricTableCreated) {
+        if (!dbutils::isEventCompatible(key, metricId, events)) {
+            // Delete old data if schema changes
+            // TODO(b/268150038): report error to statsdstats
+            ALOGD("Detected schema change for metric %lld", (long long)metricId);
+            deleteTable(key, metricId, isMetricTableCreated);
+        }
+        // TODO(b/271481944): add retry.
+        if (!dbutils::createTableIfNeeded(key, metricId, events)) {
+            ALOGE("Failed to create table for metric %lld", (long long)metricId);
+            StatsdStats::getInstance().noteRestrictedMetricTableCreationError(key, metricId);
+            return;
+        }
+        *isMetricTableCreated = true;
+    }
+    string err;
+    if (!dbutils::insert(key, metricId, events, err)) {
+        ALOGE("Failed to insert logEvent to table for metric %lld. err=%s", (long long)metricId,
+              err.c_str());
+        StatsdStats::getInstance().noteRestrictedMetricInsertError(key, metricId);
+    } else {
+        StatsdStats::getInstance().noteRestrictedMetricFlushLatency(
+                key, metricId, getElapsedRealtimeNs() - flushStartNs);
+    }
+}
+
 RestrictedEventMetricProducer::RestrictedEventMetricProducer(
         const ConfigKey& key, const EventMetric& metric, const int conditionIndex,
         const vector<ConditionState>& initialConditionCache, const sp<ConditionWizard>& wizard,
@@ -42,6 +81,7 @@ RestrictedEventMetricProducer::RestrictedEventMetricProducer(
     : EventMetricProducer(key, metric, conditionIndex, initialConditionCache, wizard, protoHash,
                           startTimeNs, eventActivationMap, eventDeactivationMap, slicedStateAtoms,
                           stateGroupMap),
+      mIsMetricTableCreated(std::make_shared<bool>(false)),
       mRestrictedDataCategory(CATEGORY_UNKNOWN) {
 }
 
@@ -56,33 +96,40 @@ void RestrictedEventMetricProducer::onMatchedLogEventInternalLocked(
         mRestrictedDataCategory != event.getRestrictionCategory()) {
         StatsdStats::getInstance().noteRestrictedMetricCategoryChanged(mConfigKey, mMetricId);
         deleteMetricTable();
-        mLogEvents.clear();
-        mTotalSize = 0;
+        mEventBuffer.clear();
     }
     mRestrictedDataCategory = event.getRestrictionCategory();
-    mLogEvents.push_back(event);
-    mTotalSize += getSize(event.getValues()) + sizeof(event);
+    if (!mEventBuffer.append(event)) {
+        // The fields of the atom changed, the events buffered so far are inserted first.
+        flushRestrictedDataLocked();
+        mEventBuffer.append(event);
+    }
+    mTotalSize = mEventBuffer.getByteSize();
 }
 
 void RestrictedEventMetricProducer::onDumpReportLocked(
         const int64_t dumpTimeNs, const bool include_current_partial_bucket, const bool erase_data,
-        const DumpLatency dumpLatency, std::set<string>* str_set,
+        const DumpLatency dumpLatency, ReportStringTable* str_set,
         android::util::ProtoOutputStream* protoOutput) {
     VLOG("Unexpected call to onDumpReportLocked() in RestrictedEventMetricProducer");
 }
 
 void RestrictedEventMetricProducer::onMetricRemove() {
     std::lock_guard<std::mutex> lock(mMutex);
-    if (!mIsMetricTableCreated) {
-        return;
-    }
-    deleteMetricTable();
+    const ConfigKey key = mConfigKey;
+    const int64_t metricId = mMetricId;
+    shared_ptr<bool> isMetricTableCreated = mIsMetricTableCreated;
+    dbutils::runDbWrite([key, metricId, isMetricTableCreated] {
+        if (*isMetricTableCreated) {
+            deleteTable(key, metricId, isMetricTableCreated.get());
+        }
+    });
 }
 
 void RestrictedEventMetricProducer::enforceRestrictedDataTtl(sqlite3* db,
                                                              const int64_t wallClockNs) {
     int32_t ttlInDays = RestrictedPolicyManager::getInstance().getRestrictedCategoryTtl(
-            mRestrictedDataCategory);
+            getRestrictionCategory());
     int64_t ttlTime = wallClockNs - ttlInDays * NS_PER_DAY;
     dbutils::flushTtl(db, mMetricId, ttlTime);
 }
@@ -92,44 +139,31 @@ void RestrictedEventMetricProducer::clearPastBucketsLocked(const int64_t dumpTim
 }
 
 void RestrictedEventMetricProducer::dropDataLocked(const int64_t dropTimeNs) {
-    mLogEvents.clear();
+    mEventBuffer.clear();
     mTotalSize = 0;
     StatsdStats::getInstance().noteBucketDropped(mMetricId);
 }
 
 void RestrictedEventMetricProducer::flushRestrictedData() {
     std::lock_guard<std::mutex> lock(mMutex);
-    if (mLogEvents.empty()) {
+    flushRestrictedDataLocked();
+}
+
+void RestrictedEventMetricProducer::flushRestrictedDataLocked() {
+    if (mEventBuffer.empty()) {
         return;
     }
-    int64_t flushStartNs = getElapsedRealtimeNs();
-    if (!mIsMetricTableCreated) {
-        if (!dbutils::isEventCompatible(mConfigKey, mMetricId, mLogEvents[0])) {
-            // Delete old data if schema changes
-            // TODO(b/268150038): report error to statsdstats
-            ALOGD("Detected schema change for metric %lld", (long long)mMetricId);
-            deleteMetricTable();
-        }
-        // TODO(b/271481944): add retry.
-        if (!dbutils::createTableIfNeeded(mConfigKey, mMetricId, mLogEvents[0])) {
-            ALOGE("Failed to create table for metric %lld", (long long)mMetricId);
-            StatsdStats::getInstance().noteRestrictedMetricTableCreationError(mConfigKey,
-                                                                              mMetricId);
-            return;
-        }
-        mIsMetricTableCreated = true;
-    }
-    string err;
-    if (!dbutils::insert(mConfigKey, mMetricId, mLogEvents, err)) {
-        ALOGE("Failed to insert logEvent to table for metric %lld. err=%s", (long long)mMetricId,
-              err.c_str());
-        StatsdStats::getInstance().noteRestrictedMetricInsertError(mConfigKey, mMetricId);
-    } else {
-        StatsdStats::getInstance().noteRestrictedMetricFlushLatency(
-                mConfigKey, mMetricId, getElapsedRealtimeNs() - flushStartNs);
-    }
-    mLogEvents.clear();
+    // The events are handed over to the db writer, which may insert them after the next ones are
+    // matched.
+    auto events = std::make_shared<RestrictedEventBuffer>(std::move(mEventBuffer));
+    mEventBuffer.clear();
     mTotalSize = 0;
+    const ConfigKey key = mConfigKey;
+    const int64_t metricId = mMetricId;
+    shared_ptr<bool> isMetricTableCreated = mIsMetricTableCreated;
+    dbutils::runDbWrite([key, metricId, events, isMetricTableCreated] {
+        insertEvents(key, metricId, *events, isMetricTableCreated.get());
+    });
 }
 
 bool RestrictedEventMetricProducer::writeMetricMetadataToProto(
@@ -146,11 +180,13 @@ void RestrictedEventMetricProducer::loadMetricMetadataFromProto(
 }
 
 void RestrictedEventMetricProducer::deleteMetricTable() {
-    if (!dbutils::deleteTable(mConfigKey, mMetricId)) {
-        StatsdStats::getInstance().noteRestrictedMetricTableDeletionError(mConfigKey, mMetricId);
-        VLOG("Failed to delete table for metric %lld", (long long)mMetricId);
-    }
-    mIsMetricTableCreated = false;
+    // Ordered after the inserts of the events flushed before.
+    const ConfigKey key = mConfigKey;
+    const int64_t metricId = mMetricId;
+    shared_ptr<bool> isMetricTableCreated = mIsMetricTableCreated;
+    dbutils::runDbWrite([key, metricId, isMetricTableCreated] {
+        deleteTable(key, metricId, isMetricTableCreated.get());
+    });
 }
 
 }  // namespace statsd
@@ -4,6 +4,7 @@
 #include <gtest/gtest_prod.h>
 
 #include "EventMetricProducer.h"
+#include "utils/RestrictedEventBuffer.h"
 #include "utils/RestrictedPolicyManager.h"
 
 namespace android {
@@ -45,20 +46,27 @@ private:
 
     void onDumpReportLocked(const int64_t dumpTimeNs, const bool include_current_partial_bucket,
                             const bool erase_data, const DumpLatency dumpLatency,
-                            std::set<string>* str_set,
+                            ReportStringTable* str_set,
                             android::util::ProtoOutputStream* protoOutput) override;
 
     void clearPastBucketsLocked(const int64_t dumpTimeNs) override;
 
     void dropDataLocked(const int64_t dropTimeNs) override;
 
+    // Hands the buffered events over to the db writer.
+    void flushRestrictedDataLocked();
+
+    // Deletes the table once the pending db writes are done.
     void deleteMetricTable();
 
-    bool mIsMetricTableCreated = false;
+    // Shared with the pending db writes, which are the only ones accessing it (see
+    // dbutils::runDbWrite).
+    std::shared_ptr<bool> mIsMetricTableCreated;
 
     StatsdRestrictionCategory mRestrictedDataCategory;
 
-    vector<LogEvent> mLogEvents;
+    // Events matched since the last flush, holding only the columns of the table.
+    RestrictedEventBuffer mEventBuffer;
 };
 
 }  // namespace statsd
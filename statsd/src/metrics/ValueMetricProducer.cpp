@@ -29,6 +29,7 @@
 #include "metrics/parsing_utils/metrics_manager_util.h"
 #include "stats_log_util.h"
 #include "stats_util.h"
+#include "utils/HyperLogLog.h"
 
 using android::util::FIELD_COUNT_REPEATED;
 using android::util::FIELD_TYPE_BOOL;
@@ -172,6 +173,17 @@ void ValueMetricProducer<AggregatedValue, DimExtras>::notifyAppUpgradeInternalLo
     flushCurrentBucketLocked(eventTimeNs, eventTimeNs);
 }
 
+template <typename AggregatedValue, typename DimExtras>
+bool ValueMetricProducer<AggregatedValue, DimExtras>::hasUidInCurrentDimensionsLocked(
+        const int32_t uid) const {
+    for (const auto& [dimensionKey, _] : mCurrentSlicedBucket) {
+        if (containsUid(dimensionKey.getDimensionKeyInWhat(), uid)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 template <typename AggregatedValue, typename DimExtras>
 optional<InvalidConfigReason>
 ValueMetricProducer<AggregatedValue, DimExtras>::onConfigUpdatedLocked(
@@ -266,6 +278,16 @@ void ValueMetricProducer<AggregatedValue, DimExtras>::onStateChanged(
     flushIfNeededLocked(eventTimeNs);
 }
 
+template <typename AggregatedValue, typename DimExtras>
+std::optional<std::unordered_map<int, int64_t>>
+ValueMetricProducer<AggregatedValue, DimExtras>::getIgnoredStateGroups(int32_t atomId) const {
+    const auto it = mStateGroupMap.find(atomId);
+    if (it == mStateGroupMap.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
 template <typename AggregatedValue, typename DimExtras>
 void ValueMetricProducer<AggregatedValue, DimExtras>::onSlicedConditionMayChangeLocked(
         bool overallCondition, const int64_t eventTime) {
@@ -287,12 +309,13 @@ void ValueMetricProducer<AggregatedValue, DimExtras>::clearPastBucketsLocked(
         const int64_t dumpTimeNs) {
     mPastBuckets.clear();
     mSkippedBuckets.clear();
+    mPastBucketsByteSize = 0;
 }
 
 template <typename AggregatedValue, typename DimExtras>
 void ValueMetricProducer<AggregatedValue, DimExtras>::onDumpReportLocked(
         const int64_t dumpTimeNs, const bool includeCurrentPartialBucket, const bool eraseData,
-        const DumpLatency dumpLatency, set<string>* strSet, ProtoOutputStream* protoOutput) {
+        const DumpLatency dumpLatency, ReportStringTable* strSet, ProtoOutputStream* protoOutput) {
     VLOG("metric %lld dump report now...", (long long)mMetricId);
 
     // Pulled metrics need to pull before flushing, which is why they do not call flushIfNeeded.
@@ -435,12 +458,12 @@ void ValueMetricProducer<AggregatedValue, DimExtras>::onDumpReportLocked(
         }
         protoOutput->end(wrapperToken);
     }
+    writePastBucketsExtrasToProto(protoOutput);
     protoOutput->end(protoToken);
 
     VLOG("metric %lld done with dump report...", (long long)mMetricId);
     if (eraseData) {
-        mPastBuckets.clear();
-        mSkippedBuckets.clear();
+        clearPastBucketsLocked(dumpTimeNs);
     }
 }
 
@@ -586,6 +609,7 @@ void ValueMetricProducer<AggregatedValue, DimExtras>::updateCurrentSlicedBucketC
                 .conditionTimer.onConditionChanged(
                         newCondition && dimensionInWhatInfo.hasCurrentState, eventTimeNs);
     }
+    invalidateHotDimensions();
 }
 
 template <typename AggregatedValue, typename DimExtras>
@@ -662,36 +686,67 @@ void ValueMetricProducer<AggregatedValue, DimExtras>::onMatchedLogEventInternalL
         return;
     }
 
-    const auto whatKey = eventKey.getDimensionKeyInWhat();
-    mMatchedMetricDimensionKeys.insert(whatKey);
-
     if (!isPulled()) {
         // Only flushing for pushed because for pulled metrics, we need to do a pull first.
         flushIfNeededLocked(eventTimeNs);
     }
 
+    HotDimension* hotDimension = nullptr;
+    if (!isPulled()) {
+        // mMatchedMetricDimensionKeys is only used for pulled metrics, so the keys of the hot
+        // dimensions don't need to be inserted again.
+        hotDimension = findHotDimension(eventKey);
+        if (hotDimension == nullptr) {
+            mHotDimensionMisses++;
+        } else {
+            mHotDimensionHits++;
+        }
+    }
+    const HashableDimensionKey& whatKey = eventKey.getDimensionKeyInWhat();
+    if (hotDimension == nullptr) {
+        mMatchedMetricDimensionKeys.insert(whatKey);
+    }
+
     if (canSkipLogEventLocked(eventKey, condition, eventTimeNs, statePrimaryKeys)) {
         return;
     }
 
+    if (hotDimension != nullptr) {
+        // The dimension is in mCurrentSlicedBucket, so it can't hit the guardrail, and its state
+        // is the state of the event.
+        DimensionsInWhatInfo& dimInfo = *hotDimension->dimInfo;
+        dimInfo.seenNewData |= aggregateFields(eventTimeNs, eventKey, event,
+                                               hotDimension->currentBucket->intervals,
+                                               dimInfo.dimExtras);
+        return;
+    }
+
     if (hitGuardRailLocked(eventKey)) {
         return;
     }
 
+    const size_t numDimInfos = mDimInfos.size();
+    const size_t numCurrentBuckets = mCurrentSlicedBucket.size();
     const auto& returnVal = mDimInfos.emplace(whatKey, DimensionsInWhatInfo(getUnknownStateKey()));
     DimensionsInWhatInfo& dimensionsInWhatInfo = returnVal.first->second;
     const HashableDimensionKey& oldStateKey = dimensionsInWhatInfo.currentState;
-    CurrentBucket& currentBucket = mCurrentSlicedBucket[MetricDimensionKey(whatKey, oldStateKey)];
+    auto currentBucketIt =
+            mCurrentSlicedBucket.try_emplace(MetricDimensionKey(whatKey, oldStateKey)).first;
+    CurrentBucket& currentBucket = currentBucketIt->second;
 
     // Ensure we turn on the condition timer in the case where dimensions
     // were missing on a previous pull due to a state change.
-    const auto stateKey = eventKey.getStateValuesKey();
+    const HashableDimensionKey& stateKey = eventKey.getStateValuesKey();
     const bool stateChange = oldStateKey != stateKey || !dimensionsInWhatInfo.hasCurrentState;
 
     // We need to get the intervals stored with the previous state key so we can
     // close these value intervals.
     vector<Interval>& intervals = currentBucket.intervals;
     if (intervals.size() < mFieldMatchers.size()) {
+        if (intervals.empty() && !mRecycledIntervals.empty()) {
+            intervals = std::move(mRecycledIntervals.back());
+            mRecycledIntervals.pop_back();
+        }
         VLOG("Resizing number of intervals to %d", (int)mFieldMatchers.size());
         intervals.resize(mFieldMatchers.size());
     }
@@ -702,6 +757,15 @@ void ValueMetricProducer<AggregatedValue, DimExtras>::onMatchedLogEventInternalL
     dimensionsInWhatInfo.seenNewData |= aggregateFields(eventTimeNs, eventKey, event, intervals,
                                                         dimensionsInWhatInfo.dimExtras);
 
+    if (stateChange || numDimInfos != mDimInfos.size() ||
+        numCurrentBuckets != mCurrentSlicedBucket.size()) {
+        // The entries of the hot dimensions may have moved, or have another current state.
+        invalidateHotDimensions();
+    }
+    if (!isPulled() && !stateChange) {
+        addHotDimension(&currentBucketIt->first, &currentBucket, &dimensionsInWhatInfo);
+    }
+
     // State change.
     if (!mSlicedStateAtoms.empty() && stateChange) {
         // Turn OFF the condition timer for the previous state key.
@@ -713,6 +777,30 @@ void ValueMetricProducer<AggregatedValue, DimExtras>::onMatchedLogEventInternalL
     }
 }
 
+template <typename AggregatedValue, typename DimExtras>
+typename ValueMetricProducer<AggregatedValue, DimExtras>::HotDimension*
+ValueMetricProducer<AggregatedValue, DimExtras>::findHotDimension(
+        const MetricDimensionKey& eventKey) {
+    for (size_t i = 0; i < mNumHotDimensions; i++) {
+        if (*mHotDimensions[i].key == eventKey) {
+            return &mHotDimensions[i];
+        }
+    }
+    return nullptr;
+}
+
+template <typename AggregatedValue, typename DimExtras>
+void ValueMetricProducer<AggregatedValue, DimExtras>::addHotDimension(
+        const MetricDimensionKey* key, CurrentBucket* currentBucket,
+        DimensionsInWhatInfo* dimInfo) {
+    if (mNumHotDimensions < kMaxHotDimensions) {
+        mHotDimensions[mNumHotDimensions++] = {key, currentBucket, dimInfo};
+        return;
+    }
+    mHotDimensions[mNextHotDimension] = {key, currentBucket, dimInfo};
+    mNextHotDimension = (mNextHotDimension + 1) % kMaxHotDimensions;
+}
+
 // For pulled metrics, we always need to make sure we do a pull before flushing the bucket
 // if mCondition and mIsActive are true!
 template <typename AggregatedValue, typename DimExtras>
@@ -815,6 +903,7 @@ void ValueMetricProducer<AggregatedValue, DimExtras>::closeCurrentBucket(
                 bucket.mConditionCorrectionNs = globalConditionCorrectionNs;
             }
 
+            mPastBucketsByteSize += getPastBucketByteSize(bucket);
             auto& bucketList = mPastBuckets[metricDimensionKey];
             bucketList.push_back(std::move(bucket));
         }
@@ -846,7 +935,21 @@ template <typename AggregatedValue, typename DimExtras>
 void ValueMetricProducer<AggregatedValue, DimExtras>::initNextSlicedBucket(
         int64_t nextBucketStartTimeNs) {
     StatsdStats::getInstance().noteBucketCount(mMetricId);
+    if (mHotDimensionHits > 0 || mHotDimensionMisses > 0) {
+        StatsdStats::getInstance().noteHotDimensionLookups(mMetricId, mHotDimensionHits,
+                                                           mHotDimensionMisses);
+        mHotDimensionHits = 0;
+        mHotDimensionMisses = 0;
+    }
+    invalidateHotDimensions();
+    // Intervals of the erased dimensions are recycled for the dimensions of the next bucket instead
+    // of all being freed and allocated again at the bucket boundary. The leftovers of the previous
+    // bucket are freed so that the pool doesn't outgrow the number of dimensions.
+    mRecycledIntervals.clear();
     if (mSlicedStateAtoms.empty()) {
+        for (auto& [metricDimensionKey, currentBucket] : mCurrentSlicedBucket) {
+            recycleIntervals(currentBucket.intervals);
+        }
         mCurrentSlicedBucket.clear();
     } else {
         for (auto it = mCurrentSlicedBucket.begin(); it != mCurrentSlicedBucket.end();) {
@@ -865,6 +968,7 @@ void ValueMetricProducer<AggregatedValue, DimExtras>::initNextSlicedBucket(
                 obsolete = false;
             }
             if (obsolete) {
+                recycleIntervals(it->second.intervals);
                 it = mCurrentSlicedBucket.erase(it);
             } else {
                 it++;
@@ -893,6 +997,7 @@ void ValueMetricProducer<AggregatedValue, DimExtras>::initNextSlicedBucket(
 // Explicit template instantiations
 template class ValueMetricProducer<Value, vector<optional<Value>>>;
 template class ValueMetricProducer<unique_ptr<KllQuantile>, Empty>;
+template class ValueMetricProducer<unique_ptr<HyperLogLog>, Empty>;
 
 }  // namespace statsd
 }  // namespace os
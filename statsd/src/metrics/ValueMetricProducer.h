@@ -18,6 +18,7 @@
 
 #include <gtest/gtest_prod.h>
 
+#include <array>
 #include <optional>
 
 #include "FieldValue.h"
@@ -31,6 +32,7 @@
 #include "src/statsd_config.pb.h"
 #include "stats_log_util.h"
 #include "stats_util.h"
+#include "utils/FlatHashMap.h"
 
 namespace android {
 namespace os {
@@ -132,6 +134,10 @@ public:
     void onStateChanged(int64_t eventTimeNs, int32_t atomId, const HashableDimensionKey& primaryKey,
                         const FieldValue& oldState, const FieldValue& newState) override;
 
+    // The changes within a state group don't need a pull, see onStateChanged.
+    std::optional<std::unordered_map<int, int64_t>> getIgnoredStateGroups(
+            int32_t atomId) const override;
+
 protected:
     ValueMetricProducer(int64_t metricId, const ConfigKey& key, uint64_t protoHash,
                         const PullOptions& pullOptions, const BucketOptions& bucketOptions,
@@ -152,9 +158,11 @@ protected:
 
     void notifyAppUpgradeInternalLocked(const int64_t eventTimeNs) override;
 
+    bool hasUidInCurrentDimensionsLocked(const int32_t uid) const override;
+
     void onDumpReportLocked(const int64_t dumpTimeNs, const bool includeCurrentPartialBucket,
                             const bool eraseData, const DumpLatency dumpLatency,
-                            std::set<string>* strSet,
+                            ReportStringTable* strSet,
                             android::util::ProtoOutputStream* protoOutput) override;
 
     struct DumpProtoFields {
@@ -189,6 +197,10 @@ protected:
     // Internal interface to handle sliced condition change.
     void onSlicedConditionMayChangeLocked(bool overallCondition, int64_t eventTime) override;
 
+    size_t getCurrentDimensionCountLocked() const override {
+        return mCurrentSlicedBucket.size();
+    }
+
     void dumpStatesLocked(int out, bool verbose) const override;
 
     virtual std::string aggregatedValueToString(const AggregatedValue& aggregate) const = 0;
@@ -290,7 +302,11 @@ protected:
 
     // Tracks the internal state in the ongoing aggregation bucket for each DimensionsInWhat
     // key and StateValuesKey pair.
-    std::unordered_map<MetricDimensionKey, CurrentBucket> mCurrentSlicedBucket;
+    FlatHashMap<MetricDimensionKey, CurrentBucket> mCurrentSlicedBucket;
+
+    // Emptied intervals of the dimensions erased from mCurrentSlicedBucket at the last bucket
+    // boundary, whose storage is reused by the dimensions created in the current bucket.
+    std::vector<std::vector<Interval>> mRecycledIntervals;
 
     // State key and any extra information for a specific DimensionsInWhat key.
     struct DimensionsInWhatInfo {
@@ -311,10 +327,44 @@ protected:
     };
 
     // Tracks current state key and other information for each DimensionsInWhat key.
-    std::unordered_map<HashableDimensionKey, DimensionsInWhatInfo> mDimInfos;
+    FlatHashMap<HashableDimensionKey, DimensionsInWhatInfo> mDimInfos;
+
+    // Entries of mCurrentSlicedBucket and mDimInfos of a dimension that recently got an event of
+    // a pushed metric without changing its state, so that the next events of the dimension are
+    // aggregated without looking it up in both maps. The pointers are only valid until an entry
+    // is inserted in or erased from either map, which must call invalidateHotDimensions().
+    struct HotDimension {
+        const MetricDimensionKey* key;
+        CurrentBucket* currentBucket;
+        DimensionsInWhatInfo* dimInfo;
+    };
+
+    static const size_t kMaxHotDimensions = 4;
+
+    std::array<HotDimension, kMaxHotDimensions> mHotDimensions;
+
+    size_t mNumHotDimensions = 0;
+
+    // Entry of mHotDimensions replaced by the next dimension added when all are in use.
+    size_t mNextHotDimension = 0;
+
+    // Events of pushed metrics aggregated with and without mHotDimensions in the current bucket.
+    int64_t mHotDimensionHits = 0;
+    int64_t mHotDimensionMisses = 0;
+
+    // Returns nullptr if the dimension has no valid entry in mHotDimensions.
+    HotDimension* findHotDimension(const MetricDimensionKey& eventKey);
+
+    void addHotDimension(const MetricDimensionKey* key, CurrentBucket* currentBucket,
+                         DimensionsInWhatInfo* dimInfo);
+
+    inline void invalidateHotDimensions() {
+        mNumHotDimensions = 0;
+        mNextHotDimension = 0;
+    }
 
     // Save the past buckets and we can clear when the StatsLogReport is dumped.
-    std::unordered_map<MetricDimensionKey, std::vector<PastBucket<AggregatedValue>>> mPastBuckets;
+    FlatHashMap<MetricDimensionKey, std::vector<PastBucket<AggregatedValue>>> mPastBuckets;
 
     const int64_t mMinBucketSizeNs;
 
@@ -335,6 +385,13 @@ protected:
 
     virtual void initNextSlicedBucket(int64_t nextBucketStartTimeNs);
 
+    inline void recycleIntervals(std::vector<Interval>& intervals) {
+        if (intervals.capacity() > 0) {
+            intervals.clear();
+            mRecycledIntervals.push_back(std::move(intervals));
+        }
+    }
+
     // Updates the condition timers in the current sliced bucket when there is a
     // condition change or an active state change.
     void updateCurrentSlicedBucketConditionTimers(bool newCondition, int64_t eventTimeNs);
@@ -344,8 +401,20 @@ protected:
                                                  const int sampleSize,
                                                  ProtoOutputStream* const protoOutput) const = 0;
 
+    // Writes additional data in the metric type specific wrapper, after the per dimension data
+    // of the past buckets. Nothing by default.
+    virtual void writePastBucketsExtrasToProto(ProtoOutputStream* const protoOutput) {
+    }
+
     static const size_t kBucketSize = sizeof(PastBucket<AggregatedValue>{});
 
+    // Returns the bytes used to store the finished bucket, added to mPastBucketsByteSize when
+    // it is flushed.
+    virtual size_t getPastBucketByteSize(const PastBucket<AggregatedValue>& bucket) const {
+        // TODO(b/189283526): Add bytes used to store PastBucket.aggIndex vector
+        return kBucketSize;
+    }
+
     const size_t mDimensionSoftLimit;
 
     const size_t mDimensionHardLimit;
@@ -259,8 +259,10 @@ protected:
 
     int64_t mCurrentBucketStartTimeNs;
 
-    // Recorded duration results for each state key in the current partial bucket.
-    std::unordered_map<HashableDimensionKey, DurationValues> mStateKeyDurationMap;
+    // Recorded duration results for each state key in the current partial bucket. A state change
+    // only moves the accumulation to the entry of the new state. The map keeps its storage when it
+    // is cleared at the end of the buckets.
+    FlatHashMap<HashableDimensionKey, DurationValues> mStateKeyDurationMap;
 
     int64_t mCurrentBucketNum;
 
@@ -81,8 +81,11 @@ void OringDurationTracker::noteStart(const HashableDimensionKey& key, bool condi
         mPaused[key]++;
     }
 
-    if (mConditionSliced && mConditionKeyMap.find(key) == mConditionKeyMap.end()) {
-        mConditionKeyMap[key] = conditionKey;
+    if (mConditionSliced) {
+        if (mConditionKeyMap.find(key) == mConditionKeyMap.end()) {
+            mConditionKeyMap[key] = conditionKey;
+        }
+        indexKey(key);
     }
     VLOG("Oring: %s start, condition %d", key.toString().c_str(), condition);
 }
@@ -95,7 +98,7 @@ void OringDurationTracker::noteStop(const HashableDimensionKey& key, const int64
         (it->second)--;
         if (stopAll || !mNested || it->second <= 0) {
             mStarted.erase(it);
-            mConditionKeyMap.erase(key);
+            eraseConditionKey(key);
         }
         if (mStarted.empty()) {
             mStateKeyDurationMap[mEventKey.getStateValuesKey()].mDuration +=
@@ -114,7 +117,7 @@ void OringDurationTracker::noteStop(const HashableDimensionKey& key, const int64
         (pausedIt->second)--;
         if (stopAll || !mNested || pausedIt->second <= 0) {
             mPaused.erase(pausedIt);
-            mConditionKeyMap.erase(key);
+            eraseConditionKey(key);
         }
     }
     if (mStarted.empty()) {
@@ -138,6 +141,33 @@ void OringDurationTracker::noteStopAll(const int64_t timestamp) {
     mStarted.clear();
     mPaused.clear();
     mConditionKeyMap.clear();
+    mKeysByConditionKey.clear();
+}
+
+void OringDurationTracker::indexKey(const HashableDimensionKey& key) {
+    StartedAndPausedKeys& keys = mKeysByConditionKey[mConditionKeyMap.at(key)];
+    if (mStarted.find(key) != mStarted.end()) {
+        keys.started.insert(key);
+    }
+    if (mPaused.find(key) != mPaused.end()) {
+        keys.paused.insert(key);
+    }
+}
+
+void OringDurationTracker::eraseConditionKey(const HashableDimensionKey& key) {
+    const auto condIt = mConditionKeyMap.find(key);
+    if (condIt == mConditionKeyMap.end()) {
+        return;
+    }
+    const auto keysIt = mKeysByConditionKey.find(condIt->second);
+    if (keysIt != mKeysByConditionKey.end()) {
+        keysIt->second.started.erase(key);
+        keysIt->second.paused.erase(key);
+        if (keysIt->second.started.empty() && keysIt->second.paused.empty()) {
+            mKeysByConditionKey.erase(keysIt);
+        }
+    }
+    mConditionKeyMap.erase(condIt);
 }
 
 bool OringDurationTracker::flushCurrentBucket(
@@ -175,26 +205,39 @@ bool OringDurationTracker::flushCurrentBucket(
     // DurationBucket for each stateKey.
     for (auto& durationIt : mStateKeyDurationMap) {
         durationIt.second.mDurationFullBucket += durationIt.second.mDuration;
-        if (durationPassesThreshold(uploadThreshold, durationIt.second.mDuration)) {
-            DurationBucket current_info;
-            current_info.mBucketStartNs = mCurrentBucketStartTimeNs;
-            current_info.mBucketEndNs = currentBucketEndTimeNs;
-            current_info.mDuration = durationIt.second.mDuration;
-            current_info.mConditionTrueNs = globalConditionTrueNs;
-            (*output)[MetricDimensionKey(mEventKey.getDimensionKeyInWhat(), durationIt.first)]
-                    .push_back(current_info);
-            VLOG("  duration: %lld", (long long)current_info.mDuration);
+        const bool passesThreshold =
+                durationPassesThreshold(uploadThreshold, durationIt.second.mDuration);
+        if (passesThreshold || isFullBucket) {
+            // Without state slicing, the only stateKey is the one of mEventKey, so the key is only
+            // built (copying the dimension values) for the other stateKeys.
+            optional<MetricDimensionKey> otherStateKey;
+            if (!(durationIt.first == mEventKey.getStateValuesKey())) {
+                otherStateKey.emplace(mEventKey.getDimensionKeyInWhat(), durationIt.first);
+            }
+            const MetricDimensionKey& dimensionKey = otherStateKey ? *otherStateKey : mEventKey;
+            if (passesThreshold) {
+                DurationBucket current_info;
+                current_info.mBucketStartNs = mCurrentBucketStartTimeNs;
+                current_info.mBucketEndNs = currentBucketEndTimeNs;
+                current_info.mDuration = durationIt.second.mDuration;
+                current_info.mConditionTrueNs = globalConditionTrueNs;
+                (*output)[dimensionKey].push_back(current_info);
+                VLOG("  duration: %lld", (long long)current_info.mDuration);
+            } else {
+                VLOG("  duration: %lld does not pass set threshold",
+                     (long long)durationIt.second.mDuration);
+            }
+
+            if (isFullBucket) {
+                // End of full bucket, can send to anomaly tracker now.
+                addPastBucketToAnomalyTrackers(dimensionKey,
+                                               getCurrentStateKeyFullBucketDuration(),
+                                               mCurrentBucketNum);
+            }
         } else {
             VLOG("  duration: %lld does not pass set threshold",
                  (long long)durationIt.second.mDuration);
         }
-
-        if (isFullBucket) {
-            // End of full bucket, can send to anomaly tracker now.
-            addPastBucketToAnomalyTrackers(
-                    MetricDimensionKey(mEventKey.getDimensionKeyInWhat(), durationIt.first),
-                    getCurrentStateKeyFullBucketDuration(), mCurrentBucketNum);
-        }
         durationIt.second.mDuration = 0;
     }
     // Full bucket is only needed when we have anomaly trackers.
@@ -202,20 +245,22 @@ bool OringDurationTracker::flushCurrentBucket(
         mStateKeyDurationMap.clear();
     }
 
-    if (mStarted.size() > 0) {
+    if (mStarted.size() > 0 && numBucketsForward > 1) {
+        // Full duration buckets are attributed to the current stateKey.
+        vector<DurationBucket>& currentStateKeyBuckets = (*output)[mEventKey];
+        currentStateKeyBuckets.reserve(currentStateKeyBuckets.size() + numBucketsForward - 1);
         for (int i = 1; i < numBucketsForward; i++) {
             DurationBucket info;
             info.mBucketStartNs = fullBucketEnd + mBucketSizeNs * (i - 1);
             info.mBucketEndNs = info.mBucketStartNs + mBucketSizeNs;
             info.mDuration = mBucketSizeNs;
-            // Full duration buckets are attributed to the current stateKey.
-            (*output)[mEventKey].push_back(info);
+            currentStateKeyBuckets.push_back(info);
             // Safe to send these buckets to anomaly tracker since they must be full buckets.
             // If it's a partial bucket, numBucketsForward would be 0.
             addPastBucketToAnomalyTrackers(mEventKey, info.mDuration, mCurrentBucketNum + i);
             VLOG("  add filling bucket with duration %lld", (long long)info.mDuration);
         }
-    } else {
+    } else if (mStarted.size() == 0) {
         if (numBucketsForward >= 2) {
             addPastBucketToAnomalyTrackers(mEventKey, 0, mCurrentBucketNum + numBucketsForward - 1);
         }
@@ -249,27 +294,32 @@ bool OringDurationTracker::flushIfNeeded(
 }
 
 void OringDurationTracker::onSlicedConditionMayChange(const int64_t timestamp) {
+    // Keys without a condition key are not in mKeysByConditionKey and keep their state.
     vector<pair<HashableDimensionKey, int>> startedToPaused;
     vector<pair<HashableDimensionKey, int>> pausedToStarted;
-    if (!mStarted.empty()) {
-        for (auto it = mStarted.begin(); it != mStarted.end();) {
-            const auto& key = it->first;
-            const auto& condIt = mConditionKeyMap.find(key);
-            if (condIt == mConditionKeyMap.end()) {
-                VLOG("Key %s dont have condition key", key.toString().c_str());
-                ++it;
-                continue;
+    for (auto& [conditionKey, keys] : mKeysByConditionKey) {
+        const ConditionState conditionState = mWizard->query(
+                mConditionTrackerIndex, conditionKey, !mHasLinksToAllConditionDimensionsInTracker);
+        if (conditionState == ConditionState::kTrue) {
+            for (const HashableDimensionKey& key : keys.paused) {
+                pausedToStarted.emplace_back(key, mPaused[key]);
+                VLOG("Key %s paused -> started", key.toString().c_str());
             }
-            ConditionState conditionState =
-                mWizard->query(mConditionTrackerIndex, condIt->second,
-                               !mHasLinksToAllConditionDimensionsInTracker);
-            if (conditionState != ConditionState::kTrue) {
-                startedToPaused.push_back(*it);
-                it = mStarted.erase(it);
+            keys.started.insert(keys.paused.begin(), keys.paused.end());
+            keys.paused.clear();
+        } else {
+            for (const HashableDimensionKey& key : keys.started) {
+                startedToPaused.emplace_back(key, mStarted[key]);
                 VLOG("Key %s started -> paused", key.toString().c_str());
-            } else {
-                ++it;
             }
+            keys.paused.insert(keys.started.begin(), keys.started.end());
+            keys.started.clear();
+        }
+    }
+
+    if (!startedToPaused.empty()) {
+        for (const auto& [key, count] : startedToPaused) {
+            mStarted.erase(key);
         }
 
         if (mStarted.empty()) {
@@ -284,32 +334,12 @@ void OringDurationTracker::onSlicedConditionMayChange(const int64_t timestamp) {
         }
     }
 
-    if (!mPaused.empty()) {
-        for (auto it = mPaused.begin(); it != mPaused.end();) {
-            const auto& key = it->first;
-            if (mConditionKeyMap.find(key) == mConditionKeyMap.end()) {
-                VLOG("Key %s dont have condition key", key.toString().c_str());
-                ++it;
-                continue;
-            }
-            ConditionState conditionState =
-                mWizard->query(mConditionTrackerIndex, mConditionKeyMap[key],
-                               !mHasLinksToAllConditionDimensionsInTracker);
-            if (conditionState == ConditionState::kTrue) {
-                pausedToStarted.push_back(*it);
-                it = mPaused.erase(it);
-                VLOG("Key %s paused -> started", key.toString().c_str());
-            } else {
-                ++it;
-            }
-        }
-
-        if (mStarted.empty() && pausedToStarted.size() > 0) {
-            mLastStartTime = timestamp;
-        }
+    for (const auto& [key, count] : pausedToStarted) {
+        mPaused.erase(key);
     }
 
     if (mStarted.empty() && !pausedToStarted.empty()) {
+        mLastStartTime = timestamp;
         startAnomalyAlarm(timestamp);
     }
     mStarted.insert(pausedToStarted.begin(), pausedToStarted.end());
@@ -332,6 +362,10 @@ void OringDurationTracker::onConditionChanged(bool condition, const int64_t time
             }
             mStarted.insert(mPaused.begin(), mPaused.end());
             mPaused.clear();
+            for (auto& [_, keys] : mKeysByConditionKey) {
+                keys.started.insert(keys.paused.begin(), keys.paused.end());
+                keys.paused.clear();
+            }
         }
     } else {
         if (!mStarted.empty()) {
@@ -340,6 +374,10 @@ void OringDurationTracker::onConditionChanged(bool condition, const int64_t time
                     (timestamp - mLastStartTime);
             mPaused.insert(mStarted.begin(), mStarted.end());
             mStarted.clear();
+            for (auto& [_, keys] : mKeysByConditionKey) {
+                keys.paused.insert(keys.started.begin(), keys.started.end());
+                keys.started.clear();
+            }
             detectAndDeclareAnomaly(
                     timestamp, mCurrentBucketNum,
                     getCurrentStateKeyDuration() + getCurrentStateKeyFullBucketDuration());
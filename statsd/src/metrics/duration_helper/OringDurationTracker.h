@@ -17,6 +17,9 @@
 #ifndef ORING_DURATION_TRACKER_H
 #define ORING_DURATION_TRACKER_H
 
+#include <map>
+#include <unordered_set>
+
 #include "DurationTracker.h"
 
 namespace android {
@@ -80,6 +83,22 @@ private:
     int64_t mLastStartTime;
     std::unordered_map<HashableDimensionKey, ConditionKey> mConditionKeyMap;
 
+    struct StartedAndPausedKeys {
+        std::unordered_set<HashableDimensionKey> started;
+        std::unordered_set<HashableDimensionKey> paused;
+    };
+
+    // The keys of mConditionKeyMap grouped by condition key, according to whether they are in
+    // mStarted and mPaused. A sliced condition change queries each condition key once and only
+    // moves the keys whose condition changed.
+    std::map<ConditionKey, StartedAndPausedKeys> mKeysByConditionKey;
+
+    // Adds the key to the group of its condition key in mKeysByConditionKey.
+    void indexKey(const HashableDimensionKey& key);
+
+    // Removes the key from mConditionKeyMap and mKeysByConditionKey.
+    void eraseConditionKey(const HashableDimensionKey& key);
+
     // return true if we should not allow newKey to be tracked because we are above the threshold
     bool hitGuardRail(const HashableDimensionKey& newKey, size_t dimensionHardLimit) const;
 
@@ -92,6 +111,7 @@ private:
     FRIEND_TEST(OringDurationTrackerTest, TestUploadThreshold);
     FRIEND_TEST(OringDurationTrackerTest, TestClearStateKeyMapWhenBucketFull);
     FRIEND_TEST(OringDurationTrackerTest, TestClearStateKeyMapWhenNoTrackers);
+    FRIEND_TEST(OringDurationTrackerTest, TestSlicedConditionChangeByConditionKey);
 };
 
 }  // namespace statsd
@@ -471,28 +471,28 @@ optional<InvalidConfigReason> updateStates(
     }
     return nullopt;
 }
-// Returns true if any matchers in the metric activation were replaced.
-bool metricActivationDepsChange(const StatsdConfig& config,
-                                const unordered_map<int64_t, int>& metricToActivationMap,
-                                const int64_t metricId, const set<int64_t>& replacedMatchers) {
+// Returns the indexes in the new config of the replaced matchers that activate the metric.
+vector<int> getReplacedActivationMatcherIndexes(
+        const StatsdConfig& config, const unordered_map<int64_t, int>& metricToActivationMap,
+        const int64_t metricId, const unordered_map<int64_t, int>& newAtomMatchingTrackerMap,
+        const set<int64_t>& replacedMatchers) {
+    vector<int> replacedActivationMatcherIndexes;
     const auto& metricActivationIt = metricToActivationMap.find(metricId);
     if (metricActivationIt == metricToActivationMap.end()) {
-        return false;
+        return replacedActivationMatcherIndexes;
     }
     const MetricActivation& metricActivation = config.metric_activation(metricActivationIt->second);
     for (int i = 0; i < metricActivation.event_activation_size(); i++) {
-        const EventActivation& activation = metricActivation.event_activation(i);
-        if (replacedMatchers.find(activation.atom_matcher_id()) != replacedMatchers.end()) {
-            return true;
+        const int64_t activationMatcherId = metricActivation.event_activation(i).atom_matcher_id();
+        if (replacedMatchers.find(activationMatcherId) == replacedMatchers.end()) {
+            continue;
         }
-        if (activation.has_deactivation_atom_matcher_id()) {
-            if (replacedMatchers.find(activation.deactivation_atom_matcher_id()) !=
-                replacedMatchers.end()) {
-                return true;
-            }
+        const auto& matcherIt = newAtomMatchingTrackerMap.find(activationMatcherId);
+        if (matcherIt != newAtomMatchingTrackerMap.end()) {
+            replacedActivationMatcherIndexes.push_back(matcherIt->second);
         }
     }
-    return false;
+    return replacedActivationMatcherIndexes;
 }
 
 optional<InvalidConfigReason> determineMetricUpdateStatus(
@@ -559,11 +559,9 @@ optional<InvalidConfigReason> determineMetricUpdateStatus(
         }
     }
 
-    if (metricActivationDepsChange(config, metricToActivationMap, metricId, replacedMatchers)) {
-        updateStatus = UPDATE_REPLACE;
-        return nullopt;
-    }
-
+    // Replaced activation or deactivation matchers don't change the data of the metric, only
+    // whether it is collected. The metric is preserved and the activations by replaced matchers
+    // are cancelled in updateMetrics.
     updateStatus = UPDATE_PRESERVE;
     return nullopt;
 }
@@ -672,6 +670,22 @@ optional<InvalidConfigReason> determineAllMetricUpdateStatuses(
         }
     }
 
+    for (int i = 0; i < config.hll_metric_size(); i++, metricIndex++) {
+        const HllMetric& metric = config.hll_metric(i);
+        set<int64_t> conditionDependencies;
+        if (metric.has_condition()) {
+            conditionDependencies.insert(metric.condition());
+        }
+        invalidConfigReason = determineMetricUpdateStatus(
+                config, metric, metric.id(), METRIC_TYPE_HLL, {metric.what()},
+                conditionDependencies, metric.slice_by_state(), metric.links(),
+                oldMetricProducerMap, oldMetricProducers, metricToActivationMap, replacedMatchers,
+                replacedConditions, replacedStates, metricsToUpdate[metricIndex]);
+        if (invalidConfigReason.has_value()) {
+            return invalidConfigReason;
+        }
+    }
+
     return nullopt;
 }
 
@@ -741,7 +755,8 @@ optional<InvalidConfigReason> updateMetrics(
     sp<EventMatcherWizard> matcherWizard = new EventMatcherWizard(allAtomMatchingTrackers);
     const int allMetricsCount = config.count_metric_size() + config.duration_metric_size() +
                                 config.event_metric_size() + config.gauge_metric_size() +
-                                config.value_metric_size() + config.kll_metric_size();
+                                config.value_metric_size() + config.kll_metric_size() +
+                                config.hll_metric_size();
     newMetricProducers.reserve(allMetricsCount);
     optional<InvalidConfigReason> invalidConfigReason;
 
@@ -1030,6 +1045,50 @@ optional<InvalidConfigReason> updateMetrics(
         newMetricProducers.push_back(producer.value());
     }
 
+    for (int i = 0; i < config.hll_metric_size(); i++, metricIndex++) {
+        const HllMetric& metric = config.hll_metric(i);
+        newMetricProducerMap[metric.id()] = metricIndex;
+        optional<sp<MetricProducer>> producer;
+        switch (metricsToUpdate[metricIndex]) {
+            case UPDATE_PRESERVE: {
+                producer = updateMetric(
+                        config, i, metricIndex, metric.id(), allAtomMatchingTrackers,
+                        oldAtomMatchingTrackerMap, newAtomMatchingTrackerMap, matcherWizard,
+                        allConditionTrackers, conditionTrackerMap, wizard, oldMetricProducerMap,
+                        oldMetricProducers, metricToActivationMap, trackerToMetricMap,
+                        conditionToMetricMap, activationAtomTrackerToMetricMap,
+                        deactivationAtomTrackerToMetricMap, metricsWithActivation,
+                        invalidConfigReason);
+                break;
+            }
+            case UPDATE_REPLACE:
+                replacedMetrics.insert(metric.id());
+                [[fallthrough]];  // Intentionally fallthrough to create the new metric
+                                  // producer.
+            case UPDATE_NEW: {
+                producer = createHllMetricProducerAndUpdateMetadata(
+                        key, config, timeBaseNs, currentTimeNs, pullerManager, metric, metricIndex,
+                        allAtomMatchingTrackers, newAtomMatchingTrackerMap, allConditionTrackers,
+                        conditionTrackerMap, initialConditionCache, wizard, matcherWizard,
+                        stateAtomIdMap, allStateGroupMaps, metricToActivationMap,
+                        trackerToMetricMap, conditionToMetricMap, activationAtomTrackerToMetricMap,
+                        deactivationAtomTrackerToMetricMap, metricsWithActivation,
+                        invalidConfigReason);
+                break;
+            }
+            default: {
+                ALOGE("Metric \"%lld\" update state is unknown. This should never happen",
+                      (long long)metric.id());
+                return InvalidConfigReason(INVALID_CONFIG_REASON_METRIC_UPDATE_STATUS_UNKNOWN,
+                                           metric.id());
+            }
+        }
+        if (!producer) {
+            return invalidConfigReason;
+        }
+        newMetricProducers.push_back(producer.value());
+    }
+
     for (int i = 0; i < config.no_report_metric_size(); ++i) {
         const int64_t noReportMetric = config.no_report_metric(i);
         if (newMetricProducerMap.find(noReportMetric) == newMetricProducerMap.end()) {
@@ -1059,10 +1118,20 @@ optional<InvalidConfigReason> updateMetrics(
         }
     }
 
-    // Init new/replaced metrics.
+    // Init new/replaced metrics. Preserved metrics keep their state, except for the activations
+    // by replaced matchers which a new metric would not have either.
     for (size_t i = 0; i < newMetricProducers.size(); i++) {
         if (metricsToUpdate[i] == UPDATE_REPLACE || metricsToUpdate[i] == UPDATE_NEW) {
             newMetricProducers[i]->prepareFirstBucket();
+        } else if (metricsToUpdate[i] == UPDATE_PRESERVE) {
+            const vector<int> replacedActivationMatcherIndexes =
+                    getReplacedActivationMatcherIndexes(
+                            config, metricToActivationMap, newMetricProducers[i]->getMetricId(),
+                            newAtomMatchingTrackerMap, replacedMatchers);
+            if (!replacedActivationMatcherIndexes.empty()) {
+                newMetricProducers[i]->cancelActivations(replacedActivationMatcherIndexes,
+                                                         currentTimeNs);
+            }
         }
     }
 
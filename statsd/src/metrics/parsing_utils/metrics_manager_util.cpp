@@ -19,6 +19,7 @@
 
 #include "metrics_manager_util.h"
 
+#include <algorithm>
 #include <inttypes.h>
 
 #include "FieldValue.h"
@@ -34,16 +35,19 @@
 #include "metrics/DurationMetricProducer.h"
 #include "metrics/EventMetricProducer.h"
 #include "metrics/GaugeMetricProducer.h"
+#include "metrics/HllMetricProducer.h"
 #include "metrics/KllMetricProducer.h"
 #include "metrics/MetricProducer.h"
 #include "metrics/NumericValueMetricProducer.h"
 #include "metrics/RestrictedEventMetricProducer.h"
 #include "state/StateManager.h"
+#include "stats_log_util.h"
 #include "stats_util.h"
 
 using google::protobuf::MessageLite;
 using std::set;
 using std::unordered_map;
+using std::unordered_set;
 using std::vector;
 
 namespace android {
@@ -129,6 +133,65 @@ optional<InvalidConfigReason> validateSimpleAtomMatcher(int64_t matcherId,
     return nullopt;
 }
 
+// Key of the state of the predicate shared with the configs of the same owner, or nullopt if the
+// predicate uses a matcher which isn't a simple matcher or transforms the events. The key holds
+// the predicate and its matchers without their ids, and the fields of the config which decide the
+// events the config receives.
+optional<string> getConditionSharingKey(const StatsdConfig& config,
+                                        const SimplePredicate& predicate,
+                                        const unordered_map<int64_t, int>& atomMatchingTrackerMap) {
+    StatsdConfig sharedConfig;
+    *sharedConfig.mutable_allowed_log_source() = config.allowed_log_source();
+    *sharedConfig.mutable_whitelisted_atom_ids() = config.whitelisted_atom_ids();
+    if (config.has_restricted_metrics_delegate_package_name()) {
+        sharedConfig.set_restricted_metrics_delegate_package_name(
+                config.restricted_metrics_delegate_package_name());
+    }
+    SimplePredicate* sharedPredicate = sharedConfig.add_predicate()->mutable_simple_predicate();
+    *sharedPredicate = predicate;
+    sharedPredicate->clear_start();
+    sharedPredicate->clear_stop();
+    sharedPredicate->clear_stop_all();
+
+    // The matchers are stored in the order of start, stop and stop all, with their role as id.
+    const auto addMatcher = [&](const int64_t matcherId, const int64_t role) {
+        const auto it = atomMatchingTrackerMap.find(matcherId);
+        if (it == atomMatchingTrackerMap.end()) {
+            return false;
+        }
+        const AtomMatcher& matcher = config.atom_matcher(it->second);
+        if (!matcher.has_simple_atom_matcher()) {
+            return false;
+        }
+        for (const FieldValueMatcher& fvm : matcher.simple_atom_matcher().field_value_matcher()) {
+            if (fvm.has_replace_string()) {
+                return false;
+            }
+        }
+        AtomMatcher* sharedMatcher = sharedConfig.add_atom_matcher();
+        sharedMatcher->set_id(role);
+        *sharedMatcher->mutable_simple_atom_matcher() = matcher.simple_atom_matcher();
+        return true;
+    };
+    if ((predicate.has_start() && !addMatcher(predicate.start(), /*role=*/1)) ||
+        (predicate.has_stop() && !addMatcher(predicate.stop(), /*role=*/2)) ||
+        (predicate.has_stop_all() && !addMatcher(predicate.stop_all(), /*role=*/3))) {
+        return nullopt;
+    }
+    return sharedConfig.SerializeAsString();
+}
+
+// The dimensions in what of a metric, translated only when its state links or its dimensional
+// sampling need them to be validated. The producer translates its own copy.
+template <typename T>
+vector<Matcher> translateDimensionsInWhatToValidate(const T& metric) {
+    vector<Matcher> dimensionsInWhat;
+    if (metric.state_link_size() > 0 || metric.has_dimensional_sampling_info()) {
+        translateFieldMatcher(metric.dimensions_in_what(), &dimensionsInWhat);
+    }
+    return dimensionsInWhat;
+}
+
 }  // namespace
 
 sp<AtomMatchingTracker> createAtomMatchingTracker(
@@ -560,8 +623,7 @@ optional<sp<MetricProducer>> createCountMetricProducerAndUpdateMetadata(
     }
 
     // Check that all metric state links are a subset of dimensions_in_what fields.
-    std::vector<Matcher> dimensionsInWhat;
-    translateFieldMatcher(metric.dimensions_in_what(), &dimensionsInWhat);
+    const vector<Matcher> dimensionsInWhat = translateDimensionsInWhatToValidate(metric);
     for (const auto& stateLink : metric.state_link()) {
         invalidConfigReason = handleMetricWithStateLink(metric.id(), stateLink.fields_in_what(),
                                                         dimensionsInWhat);
@@ -732,8 +794,7 @@ optional<sp<MetricProducer>> createDurationMetricProducerAndUpdateMetadata(
     }
 
     // Check that all metric state links are a subset of dimensions_in_what fields.
-    std::vector<Matcher> dimensionsInWhat;
-    translateFieldMatcher(metric.dimensions_in_what(), &dimensionsInWhat);
+    const vector<Matcher> dimensionsInWhat = translateDimensionsInWhatToValidate(metric);
     for (const auto& stateLink : metric.state_link()) {
         invalidConfigReason = handleMetricWithStateLink(metric.id(), stateLink.fields_in_what(),
                                                         dimensionsInWhat);
@@ -851,6 +912,12 @@ optional<sp<MetricProducer>> createEventMetricProducerAndUpdateMetadata(
         return nullopt;
     }
 
+    if (metric.has_max_bytes() && metric.max_bytes() <= 0) {
+        invalidConfigReason =
+                InvalidConfigReason(INVALID_CONFIG_REASON_METRIC_INCORRECT_MAX_BYTES, metric.id());
+        return nullopt;
+    }
+
     unordered_map<int, shared_ptr<Activation>> eventActivationMap;
     unordered_map<int, vector<shared_ptr<Activation>>> eventDeactivationMap;
     invalidConfigReason = handleMetricActivation(
@@ -967,8 +1034,7 @@ optional<sp<MetricProducer>> createNumericValueMetricProducerAndUpdateMetadata(
     }
 
     // Check that all metric state links are a subset of dimensions_in_what fields.
-    std::vector<Matcher> dimensionsInWhat;
-    translateFieldMatcher(metric.dimensions_in_what(), &dimensionsInWhat);
+    const vector<Matcher> dimensionsInWhat = translateDimensionsInWhatToValidate(metric);
     for (const auto& stateLink : metric.state_link()) {
         invalidConfigReason = handleMetricWithStateLink(metric.id(), stateLink.fields_in_what(),
                                                         dimensionsInWhat);
@@ -1124,8 +1190,7 @@ optional<sp<MetricProducer>> createKllMetricProducerAndUpdateMetadata(
     }
 
     // Check that all metric state links are a subset of dimensions_in_what fields.
-    std::vector<Matcher> dimensionsInWhat;
-    translateFieldMatcher(metric.dimensions_in_what(), &dimensionsInWhat);
+    const vector<Matcher> dimensionsInWhat = translateDimensionsInWhatToValidate(metric);
     for (const auto& stateLink : metric.state_link()) {
         invalidConfigReason = handleMetricWithStateLink(metric.id(), stateLink.fields_in_what(),
                                                         dimensionsInWhat);
@@ -1190,6 +1255,158 @@ optional<sp<MetricProducer>> createKllMetricProducerAndUpdateMetadata(
     return metricProducer;
 }
 
+optional<sp<MetricProducer>> createHllMetricProducerAndUpdateMetadata(
+        const ConfigKey& key, const StatsdConfig& config, const int64_t timeBaseNs,
+        const int64_t currentTimeNs, const sp<StatsPullerManager>& pullerManager,
+        const HllMetric& metric, const int metricIndex,
+        const vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
+        const unordered_map<int64_t, int>& atomMatchingTrackerMap,
+        vector<sp<ConditionTracker>>& allConditionTrackers,
+        const unordered_map<int64_t, int>& conditionTrackerMap,
+        const vector<ConditionState>& initialConditionCache, const sp<ConditionWizard>& wizard,
+        const sp<EventMatcherWizard>& matcherWizard,
+        const unordered_map<int64_t, int>& stateAtomIdMap,
+        const unordered_map<int64_t, unordered_map<int, int64_t>>& allStateGroupMaps,
+        const unordered_map<int64_t, int>& metricToActivationMap,
+        unordered_map<int, vector<int>>& trackerToMetricMap,
+        unordered_map<int, vector<int>>& conditionToMetricMap,
+        unordered_map<int, vector<int>>& activationAtomTrackerToMetricMap,
+        unordered_map<int, vector<int>>& deactivationAtomTrackerToMetricMap,
+        vector<int>& metricsWithActivation, optional<InvalidConfigReason>& invalidConfigReason) {
+    if (!metric.has_id() || !metric.has_what()) {
+        ALOGE("cannot find metric id or \"what\" in HllMetric \"%lld\"", (long long)metric.id());
+        invalidConfigReason =
+                InvalidConfigReason(INVALID_CONFIG_REASON_METRIC_MISSING_ID_OR_WHAT, metric.id());
+        return nullopt;
+    }
+    if (!metric.has_hll_field()) {
+        ALOGE("cannot find \"hll_field\" in HllMetric \"%lld\"", (long long)metric.id());
+        invalidConfigReason = InvalidConfigReason(
+                INVALID_CONFIG_REASON_HLL_METRIC_MISSING_HLL_FIELD, metric.id());
+        return nullopt;
+    }
+    if (HasPositionALL(metric.hll_field())) {
+        ALOGE("hll field with position ALL is not supported. HllMetric \"%lld\"",
+              (long long)metric.id());
+        invalidConfigReason = InvalidConfigReason(
+                INVALID_CONFIG_REASON_HLL_METRIC_HLL_FIELD_HAS_POSITION_ALL, metric.id());
+        return nullopt;
+    }
+    std::vector<Matcher> fieldMatchers;
+    translateFieldMatcher(metric.hll_field(), &fieldMatchers);
+    if (fieldMatchers.empty()) {
+        ALOGE("incorrect \"hll_field\" in HllMetric \"%lld\"", (long long)metric.id());
+        invalidConfigReason = InvalidConfigReason(
+                INVALID_CONFIG_REASON_HLL_METRIC_HAS_INCORRECT_HLL_FIELD, metric.id());
+        return nullopt;
+    }
+
+    int trackerIndex;
+    invalidConfigReason = handleMetricWithAtomMatchingTrackers(
+            metric.what(), metric.id(), metricIndex,
+            /*enforceOneAtom=*/true, allAtomMatchingTrackers, atomMatchingTrackerMap,
+            trackerToMetricMap, trackerIndex);
+    if (invalidConfigReason.has_value()) {
+        return nullopt;
+    }
+
+    int conditionIndex = -1;
+    if (metric.has_condition()) {
+        invalidConfigReason = handleMetricWithConditions(
+                metric.condition(), metric.id(), metricIndex, conditionTrackerMap, metric.links(),
+                allConditionTrackers, conditionIndex, conditionToMetricMap);
+        if (invalidConfigReason.has_value()) {
+            return nullopt;
+        }
+    } else if (metric.links_size() > 0) {
+        ALOGE("metrics has a MetricConditionLink but doesn't have a condition");
+        invalidConfigReason = InvalidConfigReason(
+                INVALID_CONFIG_REASON_METRIC_CONDITIONLINK_NO_CONDITION, metric.id());
+        return nullopt;
+    }
+
+    std::vector<int> slicedStateAtoms;
+    unordered_map<int, unordered_map<int, int64_t>> stateGroupMap;
+    if (metric.slice_by_state_size() > 0) {
+        invalidConfigReason =
+                handleMetricWithStates(config, metric.id(), metric.slice_by_state(), stateAtomIdMap,
+                                       allStateGroupMaps, slicedStateAtoms, stateGroupMap);
+        if (invalidConfigReason.has_value()) {
+            return nullopt;
+        }
+    } else if (metric.state_link_size() > 0) {
+        ALOGE("HllMetric has a MetricStateLink but doesn't have a sliced state");
+        invalidConfigReason =
+                InvalidConfigReason(INVALID_CONFIG_REASON_METRIC_STATELINK_NO_STATE, metric.id());
+        return nullopt;
+    }
+
+    // Check that all metric state links are a subset of dimensions_in_what fields.
+    const vector<Matcher> dimensionsInWhat = translateDimensionsInWhatToValidate(metric);
+    for (const auto& stateLink : metric.state_link()) {
+        invalidConfigReason = handleMetricWithStateLink(metric.id(), stateLink.fields_in_what(),
+                                                        dimensionsInWhat);
+        if (invalidConfigReason.has_value()) {
+            ALOGW("HllMetric's MetricStateLinks must be a subset of the dimensions in what");
+            return nullopt;
+        }
+    }
+
+    unordered_map<int, shared_ptr<Activation>> eventActivationMap;
+    unordered_map<int, vector<shared_ptr<Activation>>> eventDeactivationMap;
+    invalidConfigReason = handleMetricActivation(
+            config, metric.id(), metricIndex, metricToActivationMap, atomMatchingTrackerMap,
+            activationAtomTrackerToMetricMap, deactivationAtomTrackerToMetricMap,
+            metricsWithActivation, eventActivationMap, eventDeactivationMap);
+    if (invalidConfigReason.has_value()) {
+        return nullopt;
+    }
+
+    uint64_t metricHash;
+    invalidConfigReason =
+            getMetricProtoHash(config, metric, metric.id(), metricToActivationMap, metricHash);
+    if (invalidConfigReason.has_value()) {
+        return nullopt;
+    }
+
+    const TimeUnit bucketSizeTimeUnit =
+            metric.bucket() == TIME_UNIT_UNSPECIFIED ? ONE_HOUR : metric.bucket();
+    const int64_t bucketSizeNs =
+            MillisToNano(TimeUnitToBucketSizeInMillisGuardrailed(key.GetUid(), bucketSizeTimeUnit));
+
+    const bool containsAnyPositionInDimensionsInWhat = HasPositionANY(metric.dimensions_in_what());
+    const bool shouldUseNestedDimensions = ShouldUseNestedDimensions(metric.dimensions_in_what());
+
+    const sp<AtomMatchingTracker>& atomMatcher = allAtomMatchingTrackers.at(trackerIndex);
+    const int atomTagId = *(atomMatcher->getAtomIds().begin());
+    const auto [dimensionSoftLimit, dimensionHardLimit] =
+            StatsdStats::getAtomDimensionKeySizeLimits(
+                    atomTagId,
+                    StatsdStats::clampDimensionKeySizeLimit(metric.max_dimensions_per_bucket()));
+
+    sp<MetricProducer> metricProducer = new HllMetricProducer(
+            key, metric, metricHash, {/*pullTagId=*/-1, pullerManager},
+            {timeBaseNs, currentTimeNs, bucketSizeNs, metric.min_bucket_size_nanos(),
+             /*conditionCorrectionThresholdNs=*/nullopt, getAppUpgradeBucketSplit(metric)},
+            {containsAnyPositionInDimensionsInWhat, shouldUseNestedDimensions, trackerIndex,
+             matcherWizard, metric.dimensions_in_what(), fieldMatchers},
+            {conditionIndex, metric.links(), initialConditionCache, wizard},
+            {metric.state_link(), slicedStateAtoms, stateGroupMap},
+            {eventActivationMap, eventDeactivationMap}, {dimensionSoftLimit, dimensionHardLimit});
+
+    SamplingInfo samplingInfo;
+    if (metric.has_dimensional_sampling_info()) {
+        invalidConfigReason = handleMetricWithDimensionalSampling(
+                metric.id(), metric.dimensional_sampling_info(), dimensionsInWhat, samplingInfo);
+        if (invalidConfigReason.has_value()) {
+            return nullopt;
+        }
+        metricProducer->setSamplingInfo(samplingInfo);
+    }
+
+    return metricProducer;
+}
+
 optional<sp<MetricProducer>> createGaugeMetricProducerAndUpdateMetadata(
         const ConfigKey& key, const StatsdConfig& config, const int64_t timeBaseNs,
         const int64_t currentTimeNs, const sp<StatsPullerManager>& pullerManager,
@@ -1327,10 +1544,10 @@ optional<sp<MetricProducer>> createGaugeMetricProducerAndUpdateMetadata(
             pullerManager, eventActivationMap, eventDeactivationMap, dimensionSoftLimit,
             dimensionHardLimit);
 
-    SamplingInfo samplingInfo;
-    std::vector<Matcher> dimensionsInWhat;
-    translateFieldMatcher(metric.dimensions_in_what(), &dimensionsInWhat);
     if (metric.has_dimensional_sampling_info()) {
+        SamplingInfo samplingInfo;
+        std::vector<Matcher> dimensionsInWhat;
+        translateFieldMatcher(metric.dimensions_in_what(), &dimensionsInWhat);
         invalidConfigReason = handleMetricWithDimensionalSampling(
                 metric.id(), metric.dimensional_sampling_info(), dimensionsInWhat, samplingInfo);
         if (invalidConfigReason.has_value()) {
@@ -1447,7 +1664,8 @@ optional<InvalidConfigReason> initConditions(
         unordered_map<int64_t, int>& conditionTrackerMap,
         vector<sp<ConditionTracker>>& allConditionTrackers,
         unordered_map<int, std::vector<int>>& trackerToConditionMap,
-        vector<ConditionState>& initialConditionCache) {
+        vector<ConditionState>& initialConditionCache,
+        const sp<SharedConditionStates>& sharedConditionStates) {
     vector<Predicate> conditionConfigs;
     const int conditionTrackerCount = config.predicate_size();
     conditionConfigs.reserve(conditionTrackerCount);
@@ -1462,6 +1680,14 @@ optional<InvalidConfigReason> initConditions(
         if (tracker == nullptr) {
             return invalidConfigReason;
         }
+        if (sharedConditionStates != nullptr && condition.has_simple_predicate()) {
+            const optional<string> sharingKey = getConditionSharingKey(
+                    config, condition.simple_predicate(), atomMatchingTrackerMap);
+            if (sharingKey) {
+                static_cast<SimpleConditionTracker*>(tracker.get())
+                        ->shareState(sharedConditionStates, *sharingKey);
+            }
+        }
         allConditionTrackers.push_back(tracker);
         if (conditionTrackerMap.find(condition.id()) != conditionTrackerMap.end()) {
             ALOGE("Duplicate Predicate found!");
@@ -1538,7 +1764,8 @@ optional<InvalidConfigReason> initMetrics(
     sp<EventMatcherWizard> matcherWizard = new EventMatcherWizard(allAtomMatchingTrackers);
     const int allMetricsCount = config.count_metric_size() + config.duration_metric_size() +
                                 config.event_metric_size() + config.gauge_metric_size() +
-                                config.value_metric_size() + config.kll_metric_size();
+                                config.value_metric_size() + config.kll_metric_size() +
+                                config.hll_metric_size();
     allMetricProducers.reserve(allMetricsCount);
     optional<InvalidConfigReason> invalidConfigReason;
 
@@ -1653,6 +1880,24 @@ optional<InvalidConfigReason> initMetrics(
         allMetricProducers.push_back(producer.value());
     }
 
+    // build HllMetricProducer
+    for (int i = 0; i < config.hll_metric_size(); i++) {
+        int metricIndex = allMetricProducers.size();
+        const HllMetric& metric = config.hll_metric(i);
+        metricMap.insert({metric.id(), metricIndex});
+        optional<sp<MetricProducer>> producer = createHllMetricProducerAndUpdateMetadata(
+                key, config, timeBaseTimeNs, currentTimeNs, pullerManager, metric, metricIndex,
+                allAtomMatchingTrackers, atomMatchingTrackerMap, allConditionTrackers,
+                conditionTrackerMap, initialConditionCache, wizard, matcherWizard, stateAtomIdMap,
+                allStateGroupMaps, metricToActivationMap, trackerToMetricMap, conditionToMetricMap,
+                activationAtomTrackerToMetricMap, deactivationAtomTrackerToMetricMap,
+                metricsWithActivation, invalidConfigReason);
+        if (!producer) {
+            return invalidConfigReason;
+        }
+        allMetricProducers.push_back(producer.value());
+    }
+
     // Gauge metrics.
     for (int i = 0; i < config.gauge_metric_size(); i++) {
         int metricIndex = allMetricProducers.size();
@@ -1768,7 +2013,9 @@ optional<InvalidConfigReason> initStatsdConfig(
         unordered_map<int, std::vector<int>>& activationAtomTrackerToMetricMap,
         unordered_map<int, std::vector<int>>& deactivationAtomTrackerToMetricMap,
         unordered_map<int64_t, int>& alertTrackerMap, vector<int>& metricsWithActivation,
-        map<int64_t, uint64_t>& stateProtoHashes, set<int64_t>& noReportMetricIds) {
+        map<int64_t, uint64_t>& stateProtoHashes, set<int64_t>& noReportMetricIds,
+        ConfigInitLatencies* initLatencies,
+        const sp<SharedConditionStates>& sharedConditionStates) {
     vector<ConditionState> initialConditionCache;
     unordered_map<int64_t, int> stateAtomIdMap;
     unordered_map<int64_t, unordered_map<int, int64_t>> allStateGroupMaps;
@@ -1779,9 +2026,22 @@ optional<InvalidConfigReason> initStatsdConfig(
         return InvalidConfigReason(INVALID_CONFIG_REASON_PACKAGE_CERT_HASH_SIZE_TOO_LARGE);
     }
 
+    ConfigInitLatencies latencies;
+    int64_t phaseStartNs = getElapsedRealtimeNs();
+    // Sets the latency of the phase to the time since phaseStartNs and starts the next one.
+    auto endPhase = [&phaseStartNs](int64_t* latencyNs) {
+        const int64_t nowNs = getElapsedRealtimeNs();
+        *latencyNs = nowNs - phaseStartNs;
+        phaseStartNs = nowNs;
+    };
+    if (initLatencies == nullptr) {
+        initLatencies = &latencies;
+    }
+
     optional<InvalidConfigReason> invalidConfigReason =
             initAtomMatchingTrackers(config, uidMap, atomMatchingTrackerMap,
                                      allAtomMatchingTrackers, allTagIdsToMatchersMap);
+    endPhase(&initLatencies->matchersNs);
     if (invalidConfigReason.has_value()) {
         ALOGE("initAtomMatchingTrackers failed");
         return invalidConfigReason;
@@ -1790,13 +2050,16 @@ optional<InvalidConfigReason> initStatsdConfig(
 
     invalidConfigReason =
             initConditions(key, config, atomMatchingTrackerMap, conditionTrackerMap,
-                           allConditionTrackers, trackerToConditionMap, initialConditionCache);
+                           allConditionTrackers, trackerToConditionMap, initialConditionCache,
+                           sharedConditionStates);
+    endPhase(&initLatencies->conditionsNs);
     if (invalidConfigReason.has_value()) {
         ALOGE("initConditionTrackers failed");
         return invalidConfigReason;
     }
 
     invalidConfigReason = initStates(config, stateAtomIdMap, allStateGroupMaps, stateProtoHashes);
+    endPhase(&initLatencies->statesNs);
     if (invalidConfigReason.has_value()) {
         ALOGE("initStates failed");
         return invalidConfigReason;
@@ -1809,6 +2072,7 @@ optional<InvalidConfigReason> initStatsdConfig(
             trackerToMetricMap, metricProducerMap, noReportMetricIds,
             activationAtomTrackerToMetricMap, deactivationAtomTrackerToMetricMap,
             metricsWithActivation);
+    endPhase(&initLatencies->metricsNs);
     if (invalidConfigReason.has_value()) {
         ALOGE("initMetricProducers failed");
         return invalidConfigReason;
@@ -1817,12 +2081,15 @@ optional<InvalidConfigReason> initStatsdConfig(
     invalidConfigReason = initAlerts(config, currentTimeNs, metricProducerMap, alertTrackerMap,
                                      anomalyAlarmMonitor, allMetricProducers, allAnomalyTrackers);
     if (invalidConfigReason.has_value()) {
+        endPhase(&initLatencies->alertsNs);
         ALOGE("initAlerts failed");
         return invalidConfigReason;
     }
 
     invalidConfigReason = initAlarms(config, key, periodicAlarmMonitor, timeBaseNs, currentTimeNs,
                                      allPeriodicAlarmTrackers);
+    // Alarms are counted with the alerts, since they are both anomaly detection.
+    endPhase(&initLatencies->alertsNs);
     if (invalidConfigReason.has_value()) {
         ALOGE("initAlarms failed");
         return invalidConfigReason;
@@ -1831,6 +2098,394 @@ optional<InvalidConfigReason> initStatsdConfig(
     return nullopt;
 }
 
+namespace {
+
+bool isValidFieldMaskPosition(int32_t field) {
+    return field > 0 && field < kMaxAtomFieldMaskSize;
+}
+
+// The field of the top-level FieldMatcher is the atom id, children are the fields of the atom.
+void addFieldMatcherToMasks(const FieldMatcher& matcher, AtomFieldMaskMap& atomFieldMasks,
+                            set<int>& fullAtomIds) {
+    if (!matcher.has_field()) {
+        return;
+    }
+    const int atomId = matcher.field();
+    if (matcher.child_size() == 0) {
+        fullAtomIds.insert(atomId);
+        return;
+    }
+    for (const FieldMatcher& child : matcher.child()) {
+        if (!isValidFieldMaskPosition(child.field())) {
+            fullAtomIds.insert(atomId);
+            return;
+        }
+        atomFieldMasks[atomId].set(child.field());
+    }
+}
+
+void addLinksToMasks(const google::protobuf::RepeatedPtrField<MetricConditionLink>& links,
+                     AtomFieldMaskMap& atomFieldMasks, set<int>& fullAtomIds) {
+    for (const MetricConditionLink& link : links) {
+        addFieldMatcherToMasks(link.fields_in_what(), atomFieldMasks, fullAtomIds);
+        addFieldMatcherToMasks(link.fields_in_condition(), atomFieldMasks, fullAtomIds);
+    }
+}
+
+void addStateLinksToMasks(const google::protobuf::RepeatedPtrField<MetricStateLink>& stateLinks,
+                          AtomFieldMaskMap& atomFieldMasks, set<int>& fullAtomIds) {
+    for (const MetricStateLink& stateLink : stateLinks) {
+        addFieldMatcherToMasks(stateLink.fields_in_what(), atomFieldMasks, fullAtomIds);
+        addFieldMatcherToMasks(stateLink.fields_in_state(), atomFieldMasks, fullAtomIds);
+    }
+}
+
+void addMatcherAtomIds(const int64_t matcherId,
+                       const unordered_map<int64_t, int>& atomMatchingTrackerMap,
+                       const vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
+                       set<int>& atomIds) {
+    const auto it = atomMatchingTrackerMap.find(matcherId);
+    if (it == atomMatchingTrackerMap.end()) {
+        return;
+    }
+    const set<int>& matcherAtomIds = allAtomMatchingTrackers[it->second]->getAtomIds();
+    atomIds.insert(matcherAtomIds.begin(), matcherAtomIds.end());
+}
+
+}  // namespace
+
+void computeAtomFieldMasks(const StatsdConfig& config,
+                           const unordered_map<int64_t, int>& atomMatchingTrackerMap,
+                           const vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
+                           AtomFieldMaskMap& atomFieldMasks) {
+    atomFieldMasks.clear();
+    if (config.has_restricted_metrics_delegate_package_name()) {
+        // Restricted metrics store the atoms entirely.
+        return;
+    }
+
+    // Every atom used by the config gets a mask, even if none of its fields is used.
+    for (const sp<AtomMatchingTracker>& matcher : allAtomMatchingTrackers) {
+        for (const int atomId : matcher->getAtomIds()) {
+            atomFieldMasks[atomId];
+        }
+    }
+
+    set<int> fullAtomIds;
+    for (const AtomMatcher& matcher : config.atom_matcher()) {
+        if (!matcher.has_simple_atom_matcher()) {
+            continue;
+        }
+        const SimpleAtomMatcher& simpleMatcher = matcher.simple_atom_matcher();
+        for (const FieldValueMatcher& fvm : simpleMatcher.field_value_matcher()) {
+            if (!isValidFieldMaskPosition(fvm.field())) {
+                fullAtomIds.insert(simpleMatcher.atom_id());
+                break;
+            }
+            atomFieldMasks[simpleMatcher.atom_id()].set(fvm.field());
+        }
+    }
+
+    for (const Predicate& predicate : config.predicate()) {
+        if (predicate.has_simple_predicate()) {
+            addFieldMatcherToMasks(predicate.simple_predicate().dimensions(), atomFieldMasks,
+                                   fullAtomIds);
+        }
+    }
+
+    for (const State& state : config.state()) {
+        fullAtomIds.insert(state.atom_id());
+    }
+
+    for (const EventMetric& metric : config.event_metric()) {
+        addMatcherAtomIds(metric.what(), atomMatchingTrackerMap, allAtomMatchingTrackers,
+                          fullAtomIds);
+        addLinksToMasks(metric.links(), atomFieldMasks, fullAtomIds);
+    }
+
+    for (const CountMetric& metric : config.count_metric()) {
+        addFieldMatcherToMasks(metric.dimensions_in_what(), atomFieldMasks, fullAtomIds);
+        addLinksToMasks(metric.links(), atomFieldMasks, fullAtomIds);
+        addStateLinksToMasks(metric.state_link(), atomFieldMasks, fullAtomIds);
+        addFieldMatcherToMasks(metric.dimensional_sampling_info().sampled_what_field(),
+                               atomFieldMasks, fullAtomIds);
+    }
+
+    for (const DurationMetric& metric : config.duration_metric()) {
+        addFieldMatcherToMasks(metric.dimensions_in_what(), atomFieldMasks, fullAtomIds);
+        addLinksToMasks(metric.links(), atomFieldMasks, fullAtomIds);
+        addStateLinksToMasks(metric.state_link(), atomFieldMasks, fullAtomIds);
+        addFieldMatcherToMasks(metric.dimensional_sampling_info().sampled_what_field(),
+                               atomFieldMasks, fullAtomIds);
+    }
+
+    for (const GaugeMetric& metric : config.gauge_metric()) {
+        if (!metric.gauge_fields_filter().has_fields() ||
+            metric.gauge_fields_filter().include_all()) {
+            addMatcherAtomIds(metric.what(), atomMatchingTrackerMap, allAtomMatchingTrackers,
+                              fullAtomIds);
+        } else {
+            addFieldMatcherToMasks(metric.gauge_fields_filter().fields(), atomFieldMasks,
+                                   fullAtomIds);
+        }
+        addFieldMatcherToMasks(metric.dimensions_in_what(), atomFieldMasks, fullAtomIds);
+        addLinksToMasks(metric.links(), atomFieldMasks, fullAtomIds);
+        addFieldMatcherToMasks(metric.dimensional_sampling_info().sampled_what_field(),
+                               atomFieldMasks, fullAtomIds);
+    }
+
+    for (const ValueMetric& metric : config.value_metric()) {
+        addFieldMatcherToMasks(metric.value_field(), atomFieldMasks, fullAtomIds);
+        addFieldMatcherToMasks(metric.dimensions_in_what(), atomFieldMasks, fullAtomIds);
+        addLinksToMasks(metric.links(), atomFieldMasks, fullAtomIds);
+        addStateLinksToMasks(metric.state_link(), atomFieldMasks, fullAtomIds);
+        addFieldMatcherToMasks(metric.dimensional_sampling_info().sampled_what_field(),
+                               atomFieldMasks, fullAtomIds);
+    }
+
+    for (const KllMetric& metric : config.kll_metric()) {
+        addFieldMatcherToMasks(metric.kll_field(), atomFieldMasks, fullAtomIds);
+        addFieldMatcherToMasks(metric.dimensions_in_what(), atomFieldMasks, fullAtomIds);
+        addLinksToMasks(metric.links(), atomFieldMasks, fullAtomIds);
+        addStateLinksToMasks(metric.state_link(), atomFieldMasks, fullAtomIds);
+        addFieldMatcherToMasks(metric.dimensional_sampling_info().sampled_what_field(),
+                               atomFieldMasks, fullAtomIds);
+    }
+    for (const HllMetric& metric : config.hll_metric()) {
+        addFieldMatcherToMasks(metric.hll_field(), atomFieldMasks, fullAtomIds);
+        addFieldMatcherToMasks(metric.dimensions_in_what(), atomFieldMasks, fullAtomIds);
+        addLinksToMasks(metric.links(), atomFieldMasks, fullAtomIds);
+        addStateLinksToMasks(metric.state_link(), atomFieldMasks, fullAtomIds);
+        addFieldMatcherToMasks(metric.dimensional_sampling_info().sampled_what_field(),
+                               atomFieldMasks, fullAtomIds);
+    }
+
+    for (const int atomId : fullAtomIds) {
+        atomFieldMasks.erase(atomId);
+    }
+}
+
+void computePriorityAtomIds(const StatsdConfig& config,
+                            const unordered_map<int64_t, int>& atomMatchingTrackerMap,
+                            const vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
+                            set<int>& priorityAtomIds) {
+    priorityAtomIds.clear();
+    unordered_set<int64_t> metricsWithAlerts;
+    for (const Alert& alert : config.alert()) {
+        metricsWithAlerts.insert(alert.metric_id());
+    }
+    if (metricsWithAlerts.empty()) {
+        return;
+    }
+
+    const auto addMetricWhat = [&](const auto& metrics) {
+        for (const auto& metric : metrics) {
+            if (metricsWithAlerts.count(metric.id()) != 0) {
+                addMatcherAtomIds(metric.what(), atomMatchingTrackerMap, allAtomMatchingTrackers,
+                                  priorityAtomIds);
+            }
+        }
+    };
+    addMetricWhat(config.count_metric());
+    addMetricWhat(config.value_metric());
+    addMetricWhat(config.gauge_metric());
+    addMetricWhat(config.kll_metric());
+    addMetricWhat(config.hll_metric());
+
+    // The what of a duration metric is a predicate.
+    unordered_set<int64_t> predicatesWithAlerts;
+    for (const DurationMetric& metric : config.duration_metric()) {
+        if (metricsWithAlerts.count(metric.id()) != 0) {
+            predicatesWithAlerts.insert(metric.what());
+        }
+    }
+    for (const Predicate& predicate : config.predicate()) {
+        if (!predicate.has_simple_predicate() || predicatesWithAlerts.count(predicate.id()) == 0) {
+            continue;
+        }
+        const SimplePredicate& simplePredicate = predicate.simple_predicate();
+        for (const int64_t matcherId :
+             {simplePredicate.start(), simplePredicate.stop(), simplePredicate.stop_all()}) {
+            addMatcherAtomIds(matcherId, atomMatchingTrackerMap, allAtomMatchingTrackers,
+                              priorityAtomIds);
+        }
+    }
+}
+
+void computePullTriggerAtomIds(const StatsdConfig& config,
+                               const unordered_map<int64_t, int>& atomMatchingTrackerMap,
+                               const vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
+                               set<int>& pullTriggerAtomIds) {
+    pullTriggerAtomIds.clear();
+    for (const GaugeMetric& metric : config.gauge_metric()) {
+        if (metric.has_trigger_event()) {
+            addMatcherAtomIds(metric.trigger_event(), atomMatchingTrackerMap,
+                              allAtomMatchingTrackers, pullTriggerAtomIds);
+        }
+    }
+}
+
+namespace {
+
+// Returns the index of the matcher that the matcher at matcherIndex is equivalent to, which is
+// matcherIndex itself for the first matcher of each group of equivalent matchers.
+int findEquivalentMatcher(const StatsdConfig& config, const int matcherIndex,
+                          const vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
+                          std::map<string, int>& simpleMatcherIndexes,
+                          std::map<std::pair<int, vector<int>>, int>& combinationMatcherIndexes,
+                          vector<int>& equivalentMatcherIndexes) {
+    if (equivalentMatcherIndexes[matcherIndex] >= 0) {
+        return equivalentMatcherIndexes[matcherIndex];
+    }
+    const AtomMatcher& matcher = config.atom_matcher(matcherIndex);
+    int equivalentMatcherIndex = matcherIndex;
+    if (matcher.has_simple_atom_matcher()) {
+        equivalentMatcherIndex =
+                simpleMatcherIndexes
+                        .try_emplace(matcher.simple_atom_matcher().SerializeAsString(),
+                                     matcherIndex)
+                        .first->second;
+    } else if (matcher.has_combination()) {
+        vector<int> children;
+        for (const int childIndex : allAtomMatchingTrackers[matcherIndex]->getChildren()) {
+            children.push_back(findEquivalentMatcher(config, childIndex, allAtomMatchingTrackers,
+                                                     simpleMatcherIndexes,
+                                                     combinationMatcherIndexes,
+                                                     equivalentMatcherIndexes));
+        }
+        const LogicalOperation operation = matcher.combination().operation();
+        if (operation != LogicalOperation::NOT) {
+            std::sort(children.begin(), children.end());
+            children.erase(std::unique(children.begin(), children.end()), children.end());
+        }
+        std::pair<int, vector<int>> key(operation, std::move(children));
+        equivalentMatcherIndex =
+                combinationMatcherIndexes.try_emplace(std::move(key), matcherIndex).first->second;
+    }
+    equivalentMatcherIndexes[matcherIndex] = equivalentMatcherIndex;
+    return equivalentMatcherIndex;
+}
+
+void addConditionAfterChildren(const vector<sp<ConditionTracker>>& allConditionTrackers,
+                               const int conditionIndex, vector<uint8_t>& added,
+                               vector<int>& conditionEvaluationOrder) {
+    if (added[conditionIndex]) {
+        return;
+    }
+    added[conditionIndex] = true;
+    for (const int childIndex : allConditionTrackers[conditionIndex]->getChildren()) {
+        addConditionAfterChildren(allConditionTrackers, childIndex, added,
+                                  conditionEvaluationOrder);
+    }
+    conditionEvaluationOrder.push_back(conditionIndex);
+}
+
+void addConditionAndChildren(const vector<sp<ConditionTracker>>& allConditionTrackers,
+                             const int conditionIndex, vector<uint8_t>& conditions) {
+    if (conditions[conditionIndex]) {
+        return;
+    }
+    conditions[conditionIndex] = true;
+    for (const int childIndex : allConditionTrackers[conditionIndex]->getChildren()) {
+        addConditionAndChildren(allConditionTrackers, childIndex, conditions);
+    }
+}
+
+}  // namespace
+
+void computeEquivalentMatchers(const StatsdConfig& config,
+                               const vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers) {
+    std::map<string, int> simpleMatcherIndexes;
+    std::map<std::pair<int, vector<int>>, int> combinationMatcherIndexes;
+    vector<int> equivalentMatcherIndexes(allAtomMatchingTrackers.size(), -1);
+    for (size_t i = 0; i < allAtomMatchingTrackers.size(); i++) {
+        const int equivalentMatcherIndex =
+                findEquivalentMatcher(config, i, allAtomMatchingTrackers, simpleMatcherIndexes,
+                                      combinationMatcherIndexes, equivalentMatcherIndexes);
+        allAtomMatchingTrackers[i]->setEquivalentMatcher(
+                equivalentMatcherIndex != (int)i ? equivalentMatcherIndex : -1);
+    }
+}
+
+void computeConditionEvaluationOrder(const vector<sp<ConditionTracker>>& allConditionTrackers,
+                                     vector<int>& conditionEvaluationOrder) {
+    conditionEvaluationOrder.clear();
+    conditionEvaluationOrder.reserve(allConditionTrackers.size());
+    vector<uint8_t> added(allConditionTrackers.size(), false);
+    for (size_t i = 0; i < allConditionTrackers.size(); i++) {
+        addConditionAfterChildren(allConditionTrackers, i, added, conditionEvaluationOrder);
+    }
+}
+
+void computeAtomDispatchPlans(
+        const unordered_map<int, vector<int>>& tagIdsToMatchersMap,
+        const vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
+        const vector<sp<ConditionTracker>>& allConditionTrackers,
+        const vector<int>& conditionEvaluationOrder,
+        const unordered_map<int, vector<int>>& trackerToConditionMap,
+        const unordered_map<int, vector<int>>& activationAtomTrackerToMetricMap,
+        const unordered_map<int, vector<int>>& deactivationAtomTrackerToMetricMap,
+        unordered_map<int, AtomDispatchPlan>& atomDispatchPlans) {
+    atomDispatchPlans.clear();
+    for (const auto& [tagId, matchers] : tagIdsToMatchersMap) {
+        AtomDispatchPlan& plan = atomDispatchPlans[tagId];
+        plan.matchers = matchers;
+        std::sort(plan.matchers.begin(), plan.matchers.end());
+        vector<uint8_t> conditions(allConditionTrackers.size(), false);
+        for (const int matcherIndex : plan.matchers) {
+            if (allAtomMatchingTrackers[matcherIndex]->getChildren().empty()) {
+                plan.simpleMatchers.push_back(matcherIndex);
+            }
+            if (activationAtomTrackerToMetricMap.find(matcherIndex) !=
+                activationAtomTrackerToMetricMap.end()) {
+                plan.activationMatchers.push_back(matcherIndex);
+            }
+            if (deactivationAtomTrackerToMetricMap.find(matcherIndex) !=
+                deactivationAtomTrackerToMetricMap.end()) {
+                plan.deactivationMatchers.push_back(matcherIndex);
+            }
+            const auto conditionsIt = trackerToConditionMap.find(matcherIndex);
+            if (conditionsIt != trackerToConditionMap.end()) {
+                plan.conditionMatchers.push_back(matcherIndex);
+                for (const int conditionIndex : conditionsIt->second) {
+                    addConditionAndChildren(allConditionTrackers, conditionIndex, conditions);
+                }
+            }
+        }
+        for (const int conditionIndex : conditionEvaluationOrder) {
+            if (conditions[conditionIndex]) {
+                plan.conditions.push_back(conditionIndex);
+            }
+        }
+    }
+}
+
+void computeMetricSamplingGroups(const vector<sp<MetricProducer>>& allMetricProducers,
+                                 vector<int>& metricSamplingGroups,
+                                 vector<SamplingInfo>& samplingGroups) {
+    metricSamplingGroups.assign(allMetricProducers.size(), -1);
+    samplingGroups.clear();
+    for (size_t metricIndex = 0; metricIndex < allMetricProducers.size(); metricIndex++) {
+        const sp<MetricProducer>& producer = allMetricProducers[metricIndex];
+        if (producer->getMetricType() == METRIC_TYPE_DURATION) {
+            continue;
+        }
+        SamplingInfo samplingInfo = producer->getSamplingInfo();
+        if (samplingInfo.shardCount <= 1 || samplingInfo.sampledWhatFields.empty()) {
+            continue;
+        }
+        const auto it = std::find_if(
+                samplingGroups.begin(), samplingGroups.end(), [&samplingInfo](const auto& group) {
+                    return group.shardCount == samplingInfo.shardCount &&
+                           group.sampledWhatFields == samplingInfo.sampledWhatFields;
+                });
+        metricSamplingGroups[metricIndex] = it - samplingGroups.begin();
+        if (it == samplingGroups.end()) {
+            samplingGroups.push_back(std::move(samplingInfo));
+        }
+    }
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -22,7 +22,10 @@
 
 #include "anomaly/AlarmTracker.h"
 #include "condition/ConditionTracker.h"
+#include "condition/SharedConditionStates.h"
 #include "external/StatsPullerManager.h"
+#include "guardrail/StatsdStats.h"
+#include "logd/AtomFieldMask.h"
 #include "matchers/AtomMatchingTracker.h"
 #include "metrics/MetricProducer.h"
 
@@ -215,6 +218,27 @@ optional<sp<MetricProducer>> createKllMetricProducerAndUpdateMetadata(
         unordered_map<int, vector<int>>& deactivationAtomTrackerToMetricMap,
         vector<int>& metricsWithActivation, optional<InvalidConfigReason>& invalidConfigReason);
 
+// Creates an HllMetricProducer and updates the vectors/maps used by MetricsManager with
+// the appropriate indices. Returns an sp to the producer, or nullopt if there was an error.
+optional<sp<MetricProducer>> createHllMetricProducerAndUpdateMetadata(
+        const ConfigKey& key, const StatsdConfig& config, int64_t timeBaseNs,
+        const int64_t currentTimeNs, const sp<StatsPullerManager>& pullerManager,
+        const HllMetric& metric, int metricIndex,
+        const vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
+        const unordered_map<int64_t, int>& atomMatchingTrackerMap,
+        vector<sp<ConditionTracker>>& allConditionTrackers,
+        const unordered_map<int64_t, int>& conditionTrackerMap,
+        const vector<ConditionState>& initialConditionCache, const sp<ConditionWizard>& wizard,
+        const sp<EventMatcherWizard>& matcherWizard,
+        const unordered_map<int64_t, int>& stateAtomIdMap,
+        const unordered_map<int64_t, unordered_map<int, int64_t>>& allStateGroupMaps,
+        const unordered_map<int64_t, int>& metricToActivationMap,
+        unordered_map<int, vector<int>>& trackerToMetricMap,
+        unordered_map<int, vector<int>>& conditionToMetricMap,
+        unordered_map<int, vector<int>>& activationAtomTrackerToMetricMap,
+        unordered_map<int, vector<int>>& deactivationAtomTrackerToMetricMap,
+        vector<int>& metricsWithActivation, optional<InvalidConfigReason>& invalidConfigReason);
+
 // Creates an AnomalyTracker and adds it to the appropriate metric.
 // Returns an sp to the AnomalyTracker, or nullopt if there was an error.
 optional<sp<AnomalyTracker>> createAnomalyTracker(
@@ -297,6 +321,8 @@ optional<InvalidConfigReason> initAtomMatchingTrackers(
 // [trackerToConditionMap]: contain the mapping from index of
 //                        log tracker to condition trackers that use the log tracker
 // [initialConditionCache]: stores the initial conditions for each ConditionTracker
+// [sharedConditionStates]: if set, the simple conditions share their state with the identical
+//                          conditions of the other configs of the owner
 // Returns nullopt if successful and InvalidConfigReason if not.
 optional<InvalidConfigReason> initConditions(
         const ConfigKey& key, const StatsdConfig& config,
@@ -304,7 +330,8 @@ optional<InvalidConfigReason> initConditions(
         std::unordered_map<int64_t, int>& conditionTrackerMap,
         std::vector<sp<ConditionTracker>>& allConditionTrackers,
         std::unordered_map<int, std::vector<int>>& trackerToConditionMap,
-        std::vector<ConditionState>& initialConditionCache);
+        std::vector<ConditionState>& initialConditionCache,
+        const sp<SharedConditionStates>& sharedConditionStates = nullptr);
 
 // Initialize State maps using State protos in the config. These maps will
 // eventually be passed to MetricProducers to initialize their state info.
@@ -364,6 +391,8 @@ optional<InvalidConfigReason> initAlarms(const StatsdConfig& config, const Confi
 
 // Initialize MetricsManager from StatsdConfig.
 // Parameters are the members of MetricsManager. See MetricsManager for declaration.
+// [initLatencies]: if set, receives the time spent in each phase of the initialization.
+// [sharedConditionStates]: see initConditions().
 optional<InvalidConfigReason> initStatsdConfig(
         const ConfigKey& key, const StatsdConfig& config, const sp<UidMap>& uidMap,
         const sp<StatsPullerManager>& pullerManager, const sp<AlarmMonitor>& anomalyAlarmMonitor,
@@ -384,7 +413,128 @@ optional<InvalidConfigReason> initStatsdConfig(
         std::unordered_map<int, std::vector<int>>& activationAtomTrackerToMetricMap,
         std::unordered_map<int, std::vector<int>>& deactivationAtomTrackerToMetricMap,
         std::unordered_map<int64_t, int>& alertTrackerMap, std::vector<int>& metricsWithActivation,
-        std::map<int64_t, uint64_t>& stateProtoHashes, std::set<int64_t>& noReportMetricIds);
+        std::map<int64_t, uint64_t>& stateProtoHashes, std::set<int64_t>& noReportMetricIds,
+        ConfigInitLatencies* initLatencies = nullptr,
+        const sp<SharedConditionStates>& sharedConditionStates = nullptr);
+
+// Computes the top-level fields of the atoms used by the config to be decoded from the socket.
+// Atoms which are used entirely (e.g. by event metrics) are not present in atomFieldMasks.
+// input:
+// [config]: the input config
+// [atomMatchingTrackerMap]: this map should contain matcher name to index mapping
+// [allAtomMatchingTrackers]: should contain the atom matchers of the config
+// output:
+// [atomFieldMasks]: atom id to the fields of the atom used by the config
+void computeAtomFieldMasks(const StatsdConfig& config,
+                           const std::unordered_map<int64_t, int>& atomMatchingTrackerMap,
+                           const std::vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
+                           AtomFieldMaskMap& atomFieldMasks);
+
+// Computes the atoms feeding the alerts of the config, which should be preserved on event queue
+// overflow to not miss anomalies.
+// input:
+// [config]: the input config
+// [atomMatchingTrackerMap]: this map should contain matcher name to index mapping
+// [allAtomMatchingTrackers]: should contain the atom matchers of the config
+// output:
+// [priorityAtomIds]: ids of the atoms used by the what of metrics with alerts
+void computePriorityAtomIds(const StatsdConfig& config,
+                            const std::unordered_map<int64_t, int>& atomMatchingTrackerMap,
+                            const std::vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
+                            std::set<int>& priorityAtomIds);
+
+// Computes the atoms whose events trigger the pulls of gauge metrics.
+// input:
+// [config]: the input config
+// [atomMatchingTrackerMap]: this map should contain matcher name to index mapping
+// [allAtomMatchingTrackers]: should contain the atom matchers of the config
+// output:
+// [pullTriggerAtomIds]: ids of the atoms used by the trigger events of gauge metrics
+void computePullTriggerAtomIds(const StatsdConfig& config,
+                               const std::unordered_map<int64_t, int>& atomMatchingTrackerMap,
+                               const std::vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
+                               std::set<int>& pullTriggerAtomIds);
+
+// Finds the combination matchers of the config that are equivalent to another one, and makes them
+// reuse its result when matching an event instead of combining their children again. Simple
+// matchers are equivalent if their contents are identical. Combination matchers are equivalent if
+// they have the same operation over equivalent children, where the order and the repetitions of
+// the children of AND, OR, NAND and NOR don't matter.
+// input:
+// [config]: the input config
+// [allAtomMatchingTrackers]: should contain the initialized matchers of the config, in the order
+//                            of the config
+void computeEquivalentMatchers(const StatsdConfig& config,
+                               const std::vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers);
+
+// Computes the order in which the conditions are evaluated when processing an event, where the
+// children of a combination condition come before it.
+// input:
+// [allConditionTrackers]: should contain the initialized condition trackers of the config
+// output:
+// [conditionEvaluationOrder]: indices of all the condition trackers, children first
+void computeConditionEvaluationOrder(const std::vector<sp<ConditionTracker>>& allConditionTrackers,
+                                     std::vector<int>& conditionEvaluationOrder);
+
+// The trackers that the events of an atom can reach. Only the matchers listed here can match the
+// events of the atom, so only their metric activations, conditions and metrics need to be looked
+// at for the events.
+struct AtomDispatchPlan {
+    // Matchers the events are matched against, the ones whose atom ids contain the atom, in
+    // ascending order.
+    std::vector<int> matchers;
+
+    // The matchers above that are not combinations. They only depend on the event, so they can be
+    // matched concurrently.
+    std::vector<int> simpleMatchers;
+
+    // The matchers above that activate metrics.
+    std::vector<int> activationMatchers;
+
+    // The matchers above that cancel metric activations.
+    std::vector<int> deactivationMatchers;
+
+    // The matchers above that conditions are evaluated on.
+    std::vector<int> conditionMatchers;
+
+    // Conditions that can be evaluated on the events, including the children of combinations, in
+    // evaluation order.
+    std::vector<int> conditions;
+};
+
+// Computes the dispatch plans of the atoms of the config.
+// input:
+// [tagIdsToMatchersMap]: atom id to the indices of the matchers using the atom
+// [allAtomMatchingTrackers]: should contain the initialized matchers of the config
+// [allConditionTrackers]: should contain the initialized condition trackers of the config
+// [conditionEvaluationOrder]: see computeConditionEvaluationOrder()
+// [trackerToConditionMap]: matcher index to the indices of the conditions using it
+// [activationAtomTrackerToMetricMap]: matcher index to the metrics it activates
+// [deactivationAtomTrackerToMetricMap]: matcher index to the metrics it cancels activations of
+// output:
+// [atomDispatchPlans]: atom id to the dispatch plan of its events
+void computeAtomDispatchPlans(
+        const std::unordered_map<int, std::vector<int>>& tagIdsToMatchersMap,
+        const std::vector<sp<AtomMatchingTracker>>& allAtomMatchingTrackers,
+        const std::vector<sp<ConditionTracker>>& allConditionTrackers,
+        const std::vector<int>& conditionEvaluationOrder,
+        const std::unordered_map<int, std::vector<int>>& trackerToConditionMap,
+        const std::unordered_map<int, std::vector<int>>& activationAtomTrackerToMetricMap,
+        const std::unordered_map<int, std::vector<int>>& deactivationAtomTrackerToMetricMap,
+        std::unordered_map<int, AtomDispatchPlan>& atomDispatchPlans);
+
+// Groups the metrics that are sampled on the same field with the same shard count, so that the
+// sampling of an event is checked once per group and the events in dropped shards don't reach the
+// metrics at all. Duration metrics are not grouped: they flush their buckets and handle stop all
+// events before sampling.
+// input:
+// [allMetricProducers]: the metrics of the config
+// output:
+// [metricSamplingGroups]: index in samplingGroups of each metric, or -1 if it is not grouped
+// [samplingGroups]: the sampled field and shard count of each group
+void computeMetricSamplingGroups(const std::vector<sp<MetricProducer>>& allMetricProducers,
+                                 std::vector<int>& metricSamplingGroups,
+                                 std::vector<SamplingInfo>& samplingGroups);
 
 }  // namespace statsd
 }  // namespace os
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "packages/AidMapping.h"
+
+#include <algorithm>
+#include <array>
+
+using std::optional;
+using std::span;
+using std::string_view;
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+// Note not all the following AIDs are used as uids. Some are used only for gids.
+// It's ok to leave them in the table, but we won't ever see them in the log's uid field.
+constexpr AidEntry kAids[] = {
+    {"AID_ROOT", 0},
+    {"AID_SYSTEM", 1000},
+    {"AID_RADIO", 1001},
+    {"AID_BLUETOOTH", 1002},
+    {"AID_GRAPHICS", 1003},
+    {"AID_INPUT", 1004},
+    {"AID_AUDIO", 1005},
+    {"AID_CAMERA", 1006},
+    {"AID_LOG", 1007},
+    {"AID_COMPASS", 1008},
+    {"AID_MOUNT", 1009},
+    {"AID_WIFI", 1010},
+    {"AID_ADB", 1011},
+    {"AID_INSTALL", 1012},
+    {"AID_MEDIA", 1013},
+    {"AID_DHCP", 1014},
+    {"AID_SDCARD_RW", 1015},
+    {"AID_VPN", 1016},
+    {"AID_KEYSTORE", 1017},
+    {"AID_USB", 1018},
+    {"AID_DRM", 1019},
+    {"AID_MDNSR", 1020},
+    {"AID_GPS", 1021},
+    // {"AID_UNUSED1", 1022},
+    {"AID_MEDIA_RW", 1023},
+    {"AID_MTP", 1024},
+    // {"AID_UNUSED2", 1025},
+    {"AID_DRMRPC", 1026},
+    {"AID_NFC", 1027},
+    {"AID_SDCARD_R", 1028},
+    {"AID_CLAT", 1029},
+    {"AID_LOOP_RADIO", 1030},
+    {"AID_MEDIA_DRM", 1031},
+    {"AID_PACKAGE_INFO", 1032},
+    {"AID_SDCARD_PICS", 1033},
+    {"AID_SDCARD_AV", 1034},
+    {"AID_SDCARD_ALL", 1035},
+    {"AID_LOGD", 1036},
+    {"AID_SHARED_RELRO", 1037},
+    {"AID_DBUS", 1038},
+    {"AID_TLSDATE", 1039},
+    {"AID_MEDIA_EX", 1040},
+    {"AID_AUDIOSERVER", 1041},
+    {"AID_METRICS_COLL", 1042},
+    {"AID_METRICSD", 1043},
+    {"AID_WEBSERV", 1044},
+    {"AID_DEBUGGERD", 1045},
+    {"AID_MEDIA_CODEC", 1046},
+    {"AID_CAMERASERVER", 1047},
+    {"AID_FIREWALL", 1048},
+    {"AID_TRUNKS", 1049},
+    {"AID_NVRAM", 1050},
+    {"AID_DNS", 1051},
+    {"AID_DNS_TETHER", 1052},
+    {"AID_WEBVIEW_ZYGOTE", 1053},
+    {"AID_VEHICLE_NETWORK", 1054},
+    {"AID_MEDIA_AUDIO", 1055},
+    {"AID_MEDIA_VIDEO", 1056},
+    {"AID_MEDIA_IMAGE", 1057},
+    {"AID_TOMBSTONED", 1058},
+    {"AID_MEDIA_OBB", 1059},
+    {"AID_ESE", 1060},
+    {"AID_OTA_UPDATE", 1061},
+    {"AID_AUTOMOTIVE_EVS", 1062},
+    {"AID_LOWPAN", 1063},
+    {"AID_HSM", 1064},
+    {"AID_RESERVED_DISK", 1065},
+    {"AID_STATSD", 1066},
+    {"AID_INCIDENTD", 1067},
+    {"AID_SECURE_ELEMENT", 1068},
+    {"AID_LMKD", 1069},
+    {"AID_LLKD", 1070},
+    {"AID_IORAPD", 1071},
+    {"AID_GPU_SERVICE", 1072},
+    {"AID_NETWORK_STACK", 1073},
+    {"AID_GSID", 1074},
+    {"AID_FSVERITY_CERT", 1075},
+    {"AID_CREDSTORE", 1076},
+    {"AID_EXTERNAL_STORAGE", 1077},
+    {"AID_EXT_DATA_RW", 1078},
+    {"AID_EXT_OBB_RW", 1079},
+    {"AID_CONTEXT_HUB", 1080},
+    {"AID_VIRTUALIZATIONSERVICE", 1081},
+    {"AID_ARTD", 1082},
+    {"AID_UWB", 1083},
+    {"AID_THREAD_NETWORK", 1084},
+    {"AID_DICED", 1085},
+    {"AID_DMESGD", 1086},
+    {"AID_JC_WEAVER", 1087},
+    {"AID_JC_STRONGBOX", 1088},
+    {"AID_JC_IDENTITYCRED", 1089},
+    {"AID_SDK_SANDBOX", 1090},
+    {"AID_SECURITY_LOG_WRITER", 1091},
+    {"AID_PRNG_SEEDER", 1092},
+    {"AID_SHELL", 2000},
+    {"AID_CACHE", 2001},
+    {"AID_DIAG", 2002},
+    {"AID_NOBODY", 9999},
+};
+
+constexpr size_t kAidsCount = std::size(kAids);
+
+// Index value of the uids that aren't AIDs.
+constexpr uint8_t kNoAid = UINT8_MAX;
+static_assert(kAidsCount < kNoAid);
+
+constexpr bool isSortedByUid() {
+    for (size_t i = 1; i < kAidsCount; i++) {
+        if (kAids[i - 1].uid >= kAids[i].uid) {
+            return false;
+        }
+    }
+    return kAids[0].uid >= 0 && kAids[kAidsCount - 1].uid <= AidMapping::kMaxAidUid;
+}
+static_assert(isSortedByUid(), "AIDs must be sorted by unique uids below 10000");
+
+constexpr std::array<AidEntry, kAidsCount> sortByName() {
+    std::array<AidEntry, kAidsCount> aids{};
+    for (size_t i = 0; i < kAidsCount; i++) {
+        size_t j = i;
+        for (; j > 0 && kAids[i].name < aids[j - 1].name; j--) {
+            aids[j] = aids[j - 1];
+        }
+        aids[j] = kAids[i];
+    }
+    return aids;
+}
+
+constexpr std::array<AidEntry, kAidsCount> kAidsByName = sortByName();
+
+constexpr bool hasUniqueNames() {
+    for (size_t i = 1; i < kAidsCount; i++) {
+        if (kAidsByName[i - 1].name == kAidsByName[i].name) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(hasUniqueNames(), "AID names must be unique");
+
+// Maps each uid up to kMaxAidUid to its index in kAids.
+constexpr std::array<uint8_t, AidMapping::kMaxAidUid + 1> buildUidIndex() {
+    std::array<uint8_t, AidMapping::kMaxAidUid + 1> index{};
+    for (uint8_t& i : index) {
+        i = kNoAid;
+    }
+    for (size_t i = 0; i < kAidsCount; i++) {
+        index[kAids[i].uid] = i;
+    }
+    return index;
+}
+
+constexpr std::array<uint8_t, AidMapping::kMaxAidUid + 1> kUidIndex = buildUidIndex();
+
+}  // namespace
+
+optional<int32_t> AidMapping::getUid(string_view name) {
+    const auto it = std::lower_bound(
+            kAidsByName.begin(), kAidsByName.end(), name,
+            [](const AidEntry& aid, string_view value) { return aid.name < value; });
+    if (it == kAidsByName.end() || it->name != name) {
+        return std::nullopt;
+    }
+    return it->uid;
+}
+
+string_view AidMapping::getName(int32_t uid) {
+    if (uid < 0 || uid > kMaxAidUid || kUidIndex[uid] == kNoAid) {
+        return string_view();
+    }
+    return kAids[kUidIndex[uid]].name;
+}
+
+span<const AidEntry> AidMapping::getAids() {
+    return span<const AidEntry>(kAids, kAidsCount);
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <optional>
+#include <span>
+#include <string_view>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+struct AidEntry {
+    std::string_view name;
+    int32_t uid;
+};
+
+/**
+ * Bidirectional mapping between the AID_* names allowed in configs and their uids.
+ *
+ * Both directions are tables built at compile time: names are looked up with a binary search in
+ * the entries sorted by name, and uids, which are all below kMaxAidUid, index a direct array.
+ * Each name and each uid appear at most once.
+ */
+class AidMapping {
+public:
+    // App's uid starts from 10000, and will not overlap with the AIDs.
+    static constexpr int32_t kMaxAidUid = 9999;
+
+    // Returns the uid of the AID name, or nullopt if name is not an AID name.
+    static std::optional<int32_t> getUid(std::string_view name);
+
+    // Returns the AID name of the uid, or an empty string if uid is not an AID.
+    static std::string_view getName(int32_t uid);
+
+    // Returns all the AIDs, sorted by uid.
+    static std::span<const AidEntry> getAids();
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
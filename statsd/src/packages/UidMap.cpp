@@ -21,8 +21,11 @@
 #include "guardrail/StatsdStats.h"
 #include "packages/UidMap.h"
 
+#include <fnmatch.h>
 #include <inttypes.h>
 
+#include <unordered_set>
+
 using namespace android;
 
 using android::util::FIELD_COUNT_REPEATED;
@@ -70,7 +73,12 @@ const int FIELD_ID_CHANGE_PREV_VERSION_STRING = 9;
 const int FIELD_ID_CHANGE_NEW_VERSION_STRING_HASH = 10;
 const int FIELD_ID_CHANGE_PREV_VERSION_STRING_HASH = 11;
 
-UidMap::UidMap() : mBytesUsed(0) {
+UidMap::UidMap()
+    : mAppsSnapshot(std::make_shared<AppsSnapshot>()),
+      mIsolatedUidMap(std::make_shared<IsolatedUidMap>()),
+      mStrings(1),
+      mBytesUsed(0) {
+    mStringIds[""] = kEmptyStringId;
 }
 
 UidMap::~UidMap() {}
@@ -81,10 +89,9 @@ sp<UidMap> UidMap::getInstance() {
 }
 
 bool UidMap::hasApp(int uid, const string& packageName) const {
-    lock_guard<mutex> lock(mMutex);
-
-    auto it = mMap.find(std::make_pair(uid, packageName));
-    return it != mMap.end() && !it->second.deleted;
+    const std::shared_ptr<const AppsSnapshot> apps = std::atomic_load(&mAppsSnapshot);
+    auto it = apps->find(uid);
+    return it != apps->end() && it->second.versions.find(packageName) != it->second.versions.end();
 }
 
 string UidMap::normalizeAppName(const string& appName) const {
@@ -94,28 +101,128 @@ string UidMap::normalizeAppName(const string& appName) const {
 }
 
 std::set<string> UidMap::getAppNamesFromUid(const int32_t uid, bool returnNormalized) const {
-    lock_guard<mutex> lock(mMutex);
-    return getAppNamesFromUidLocked(uid,returnNormalized);
-}
-
-std::set<string> UidMap::getAppNamesFromUidLocked(const int32_t uid, bool returnNormalized) const {
+    const std::shared_ptr<const AppsSnapshot> apps = std::atomic_load(&mAppsSnapshot);
     std::set<string> names;
-    for (const auto& kv : mMap) {
-        if (kv.first.first == uid && !kv.second.deleted) {
-            names.insert(returnNormalized ? normalizeAppName(kv.first.second) : kv.first.second);
+    auto it = apps->find(uid);
+    if (it != apps->end()) {
+        if (returnNormalized) {
+            names.insert(it->second.normalizedNames.begin(), it->second.normalizedNames.end());
+        } else {
+            for (const auto& [packageName, versionCode] : it->second.versions) {
+                names.insert(names.end(), packageName);
+            }
         }
     }
     return names;
 }
 
-int64_t UidMap::getAppVersion(int uid, const string& packageName) const {
-    lock_guard<mutex> lock(mMutex);
+bool UidMap::hasAppMatching(int32_t uid, const string& wildcardPattern) const {
+    const std::shared_ptr<const AppsSnapshot> apps = std::atomic_load(&mAppsSnapshot);
+    auto it = apps->find(uid);
+    if (it == apps->end()) {
+        return false;
+    }
+    for (const auto& [packageName, versionCode] : it->second.versions) {
+        if (fnmatch(wildcardPattern.c_str(), packageName.c_str(), 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    auto it = mMap.find(std::make_pair(uid, packageName));
-    if (it == mMap.end() || it->second.deleted) {
+vector<int32_t> UidMap::getUidsWithApp(const string& packageName, bool isWildcard) const {
+    vector<int32_t> uids;
+    {
+        lock_guard<mutex> lock(mMutex);
+        for (const auto& kv : mMap) {
+            if (kv.second.deleted) {
+                continue;
+            }
+            const string& appName = getStringLocked(kv.first.second);
+            if (isWildcard ? fnmatch(packageName.c_str(), appName.c_str(), 0) == 0
+                           : appName == packageName) {
+                uids.push_back(kv.first.first);
+            }
+        }
+    }
+    std::sort(uids.begin(), uids.end());
+    uids.erase(std::unique(uids.begin(), uids.end()), uids.end());
+    return uids;
+}
+
+int64_t UidMap::getAppVersion(int uid, const string& packageName) const {
+    const std::shared_ptr<const AppsSnapshot> apps = std::atomic_load(&mAppsSnapshot);
+    auto it = apps->find(uid);
+    if (it == apps->end()) {
         return 0;
     }
-    return it->second.versionCode;
+    auto appIt = it->second.versions.find(packageName);
+    return appIt != it->second.versions.end() ? appIt->second : 0;
+}
+
+StringId UidMap::internLocked(const string& str) {
+    auto [it, inserted] = mStringIds.emplace(str, (StringId)mStrings.size());
+    if (inserted) {
+        mStrings.push_back(str);
+    }
+    return it->second;
+}
+
+StringId UidMap::findStringIdLocked(const string& str) const {
+    auto it = mStringIds.find(str);
+    return it != mStringIds.end() ? it->second : -1;
+}
+
+void UidMap::compactStringsLocked() {
+    if (mStrings.size() < mNumStringsAtLastCompaction + kMinStringsToCompact) {
+        return;
+    }
+    std::vector<string> strings = std::move(mStrings);
+    mStrings.assign(1, "");
+    mStringIds.clear();
+    mStringIds[""] = kEmptyStringId;
+    auto reintern = [this, &strings](StringId id) { return internLocked(strings[id]); };
+
+    std::unordered_map<AppKey, AppData, AppKeyHash> apps;
+    for (auto& [key, appData] : mMap) {
+        appData.versionString = reintern(appData.versionString);
+        appData.installer = reintern(appData.installer);
+        appData.certificateHash = reintern(appData.certificateHash);
+        apps.emplace(std::make_pair(key.first, reintern(key.second)), appData);
+    }
+    mMap = std::move(apps);
+    for (AppKey& key : mDeletedApps) {
+        key.second = reintern(key.second);
+    }
+    for (ChangeRecord& record : mChanges) {
+        record.package = reintern(record.package);
+        record.versionString = reintern(record.versionString);
+        record.prevVersionString = reintern(record.prevVersionString);
+    }
+    mNumStringsAtLastCompaction = mStrings.size();
+}
+
+void UidMap::onAppsChangedLocked() {
+    auto apps = std::make_shared<AppsSnapshot>();
+    for (const auto& [keyPair, appData] : mMap) {
+        if (!appData.deleted) {
+            (*apps)[keyPair.first].versions.emplace(getStringLocked(keyPair.second),
+                                                    appData.versionCode);
+        }
+    }
+    for (auto& [uid, uidApps] : *apps) {
+        uidApps.normalizedNames.reserve(uidApps.versions.size());
+        for (const auto& [packageName, versionCode] : uidApps.versions) {
+            uidApps.normalizedNames.push_back(normalizeAppName(packageName));
+        }
+    }
+    std::atomic_store(&mAppsSnapshot, std::shared_ptr<const AppsSnapshot>(std::move(apps)));
+    mAppsGeneration.fetch_add(1, std::memory_order_release);
+}
+
+static bool isSameAppData(const AppData& appData, const AppData& that) {
+    return appData.versionCode == that.versionCode && appData.versionString == that.versionString &&
+           appData.installer == that.installer && appData.certificateHash == that.certificateHash;
 }
 
 void UidMap::updateMap(const int64_t timestamp, const UidData& uidData) {
@@ -123,31 +230,44 @@ void UidMap::updateMap(const int64_t timestamp, const UidData& uidData) {
     {
         lock_guard<mutex> lock(mMutex);  // Exclusively lock for updates.
 
-        std::unordered_map<std::pair<int, string>, AppData, PairHash> deletedApps;
-
-        // Copy all the deleted apps.
-        for (const auto& kv : mMap) {
-            if (kv.second.deleted) {
-                deletedApps[kv.first] = kv.second;
+        // Only the apps that differ from the current map are updated. The apps that are deleted
+        // in the current map stay deleted, and the apps that aren't in uidData are removed.
+        bool changed = false;
+        std::unordered_set<AppKey, AppKeyHash> receivedApps;
+        for (const auto& appInfo : uidData.app_info()) {
+            const AppKey key = std::make_pair(appInfo.uid(), internLocked(appInfo.package_name()));
+            receivedApps.insert(key);
+            const AppData appData(appInfo.version(), internLocked(appInfo.version_string()),
+                                  internLocked(appInfo.installer()),
+                                  internLocked(appInfo.certificate_hash()));
+            auto [it, inserted] = mMap.emplace(key, appData);
+            if (inserted) {
+                changed = true;
+            } else if (!it->second.deleted && !isSameAppData(it->second, appData)) {
+                it->second = appData;
+                changed = true;
             }
         }
-
-        mMap.clear();
-        for (const auto& appInfo : uidData.app_info()) {
-            mMap[std::make_pair(appInfo.uid(), appInfo.package_name())] =
-                    AppData(appInfo.version(), appInfo.version_string(), appInfo.installer(),
-                            appInfo.certificate_hash());
+        for (auto it = mMap.begin(); it != mMap.end();) {
+            if (receivedApps.find(it->first) == receivedApps.end()) {
+                it = mMap.erase(it);
+                changed = true;
+            } else {
+                it++;
+            }
         }
 
-        for (const auto& kv : deletedApps) {
-            auto mMapIt = mMap.find(kv.first);
-            if (mMapIt != mMap.end()) {
-                // Insert this deleted app back into the current map.
-                mMap[kv.first] = kv.second;
-            }
+        if (!changed) {
+            VLOG("Uid map received without changes");
+            return;
         }
 
+        // The apps are replaced without change records.
+        mLastUntrackedChangeNs = std::max(mLastUntrackedChangeNs, timestamp);
+        onAppsChangedLocked();
+
         ensureBytesUsedBelowLimit();
+        compactStringsLocked();
         StatsdStats::getInstance().setCurrentUidMapMemory(mBytesUsed);
         broadcast = mSubscriber;
     }
@@ -170,17 +290,18 @@ void UidMap::updateApp(const int64_t timestamp, const string& appName, const int
     {
         lock_guard<mutex> lock(mMutex);
         int32_t prevVersion = 0;
-        string prevVersionString = "";
-        auto key = std::make_pair(uid, appName);
+        StringId prevVersionString = kEmptyStringId;
+        const StringId versionStringId = internLocked(versionString);
+        auto key = std::make_pair(uid, internLocked(appName));
         auto it = mMap.find(key);
         if (it != mMap.end()) {
             prevVersion = it->second.versionCode;
             prevVersionString = it->second.versionString;
             it->second.versionCode = versionCode;
-            it->second.versionString = versionString;
-            it->second.installer = installer;
+            it->second.versionString = versionStringId;
+            it->second.installer = internLocked(installer);
             it->second.deleted = false;
-            it->second.certificateHash = certificateHashString;
+            it->second.certificateHash = internLocked(certificateHashString);
 
             // Only notify the listeners if this is an app upgrade. If this app is being installed
             // for the first time, then we don't notify the listeners.
@@ -189,13 +310,16 @@ void UidMap::updateApp(const int64_t timestamp, const string& appName, const int
             broadcast = mSubscriber;
         } else {
             // Otherwise, we need to add an app at this uid.
-            mMap[key] = AppData(versionCode, versionString, installer, certificateHashString);
+            mMap[key] = AppData(versionCode, versionStringId, internLocked(installer),
+                                internLocked(certificateHashString));
         }
+        onAppsChangedLocked();
 
-        mChanges.emplace_back(false, timestamp, appName, uid, versionCode, versionString,
+        mChanges.emplace_back(false, timestamp, key.second, uid, versionCode, versionStringId,
                               prevVersion, prevVersionString);
         mBytesUsed += kBytesChangeRecord;
         ensureBytesUsedBelowLimit();
+        compactStringsLocked();
         StatsdStats::getInstance().setCurrentUidMapMemory(mBytesUsed);
         StatsdStats::getInstance().setUidMapChanges(mChanges.size());
     }
@@ -217,6 +341,7 @@ void UidMap::ensureBytesUsedBelowLimit() {
         ALOGI("Bytes used %zu is above limit %zu, need to delete something", mBytesUsed, limit);
         if (mChanges.size() > 0) {
             mBytesUsed -= kBytesChangeRecord;
+            mLastUntrackedChangeNs = std::max(mLastUntrackedChangeNs, mChanges.front().timestampNs);
             mChanges.pop_front();
             StatsdStats::getInstance().noteUidMapDropped(1);
         }
@@ -229,8 +354,8 @@ void UidMap::removeApp(const int64_t timestamp, const string& app, const int32_t
         lock_guard<mutex> lock(mMutex);
 
         int64_t prevVersion = 0;
-        string prevVersionString = "";
-        auto key = std::make_pair(uid, app);
+        StringId prevVersionString = kEmptyStringId;
+        auto key = std::make_pair(uid, internLocked(app));
         auto it = mMap.find(key);
         if (it != mMap.end() && !it->second.deleted) {
             prevVersion = it->second.versionCode;
@@ -245,9 +370,12 @@ void UidMap::removeApp(const int64_t timestamp, const string& app, const int32_t
             mMap.erase(oldest);
             StatsdStats::getInstance().noteUidMapAppDeletionDropped();
         }
-        mChanges.emplace_back(true, timestamp, app, uid, 0, "", prevVersion, prevVersionString);
+        onAppsChangedLocked();
+        mChanges.emplace_back(true, timestamp, key.second, uid, 0, kEmptyStringId, prevVersion,
+                              prevVersionString);
         mBytesUsed += kBytesChangeRecord;
         ensureBytesUsedBelowLimit();
+        compactStringsLocked();
         StatsdStats::getInstance().setCurrentUidMapMemory(mBytesUsed);
         StatsdStats::getInstance().setUidMapChanges(mChanges.size());
         broadcast = mSubscriber;
@@ -267,23 +395,33 @@ void UidMap::setListener(const wp<PackageInfoListener>& listener) {
 void UidMap::assignIsolatedUid(int isolatedUid, int parentUid) {
     lock_guard<mutex> lock(mIsolatedMutex);
 
-    mIsolatedUidMap[isolatedUid] = parentUid;
+    auto isolatedUidMap = std::make_shared<IsolatedUidMap>(*mIsolatedUidMap);
+    (*isolatedUidMap)[isolatedUid] = parentUid;
+    const size_t numIsolatedUids = isolatedUidMap->size();
+    std::atomic_store(&mIsolatedUidMap,
+                      std::shared_ptr<const IsolatedUidMap>(std::move(isolatedUidMap)));
+    mNumIsolatedUids.store(numIsolatedUids, std::memory_order_release);
 }
 
 void UidMap::removeIsolatedUid(int isolatedUid) {
     lock_guard<mutex> lock(mIsolatedMutex);
 
-    auto it = mIsolatedUidMap.find(isolatedUid);
-    if (it != mIsolatedUidMap.end()) {
-        mIsolatedUidMap.erase(it);
+    if (mIsolatedUidMap->find(isolatedUid) == mIsolatedUidMap->end()) {
+        return;
     }
+    auto isolatedUidMap = std::make_shared<IsolatedUidMap>(*mIsolatedUidMap);
+    isolatedUidMap->erase(isolatedUid);
+    const size_t numIsolatedUids = isolatedUidMap->size();
+    std::atomic_store(&mIsolatedUidMap,
+                      std::shared_ptr<const IsolatedUidMap>(std::move(isolatedUidMap)));
+    mNumIsolatedUids.store(numIsolatedUids, std::memory_order_release);
 }
 
 int UidMap::getHostUidOrSelf(int uid) const {
-    lock_guard<mutex> lock(mIsolatedMutex);
-
-    auto it = mIsolatedUidMap.find(uid);
-    if (it != mIsolatedUidMap.end()) {
+    const std::shared_ptr<const IsolatedUidMap> isolatedUidMap =
+            std::atomic_load(&mIsolatedUidMap);
+    auto it = isolatedUidMap->find(uid);
+    if (it != isolatedUidMap->end()) {
         return it->second;
     }
     return uid;
@@ -291,6 +429,10 @@ int UidMap::getHostUidOrSelf(int uid) const {
 
 void UidMap::clearOutput() {
     mChanges.clear();
+    // The next reports need a full snapshot since the changes are lost.
+    for (auto& [key, lastUpdateNs] : mLastUpdatePerConfigKey) {
+        lastUpdateNs = -1;
+    }
     // Also update the guardrail trackers.
     StatsdStats::getInstance().setUidMapChanges(0);
     mBytesUsed = 0;
@@ -335,7 +477,11 @@ void UidMap::writeUidMapSnapshotLocked(const int64_t timestamp, const bool inclu
 
     proto->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_TIMESTAMP, (long long)timestamp);
     for (const auto& [keyPair, appData] : mMap) {
-        const auto& [uid, packageName] = keyPair;
+        const int32_t uid = keyPair.first;
+        const string& packageName = getStringLocked(keyPair.second);
+        const string& versionString = getStringLocked(appData.versionString);
+        const string& installer = getStringLocked(appData.installer);
+        const string& certificateHash = getStringLocked(appData.certificateHash);
         if (!interestingUids.empty() && interestingUids.find(uid) == interestingUids.end()) {
             continue;
         }
@@ -344,10 +490,10 @@ void UidMap::writeUidMapSnapshotLocked(const int64_t timestamp, const bool inclu
         // Get installer index.
         int installerIndex = -1;
         if (includeInstaller && installerIndices != nullptr) {
-            const auto& it = installerIndices->find(appData.installer);
+            const auto& it = installerIndices->find(installer);
             if (it == installerIndices->end()) {
                 // We have not encountered this installer yet; add it to installerIndices.
-                (*installerIndices)[appData.installer] = curInstallerIndex;
+                (*installerIndices)[installer] = curInstallerIndex;
                 installerIndex = curInstallerIndex;
                 curInstallerIndex++;
             } else {
@@ -360,26 +506,26 @@ void UidMap::writeUidMapSnapshotLocked(const int64_t timestamp, const bool inclu
             proto->write(FIELD_TYPE_UINT64 | FIELD_ID_SNAPSHOT_PACKAGE_NAME_HASH,
                          (long long)Hash64(packageName));
             if (includeVersionStrings) {
-                str_set->insert(appData.versionString);
+                str_set->insert(versionString);
                 proto->write(FIELD_TYPE_UINT64 | FIELD_ID_SNAPSHOT_PACKAGE_VERSION_STRING_HASH,
-                             (long long)Hash64(appData.versionString));
+                             (long long)Hash64(versionString));
             }
             if (includeInstaller) {
-                str_set->insert(appData.installer);
+                str_set->insert(installer);
                 if (installerIndex != -1) {
                     // Write installer index.
                     proto->write(FIELD_TYPE_UINT32 | FIELD_ID_SNAPSHOT_PACKAGE_INSTALLER_INDEX,
                                  installerIndex);
                 } else {
                     proto->write(FIELD_TYPE_UINT64 | FIELD_ID_SNAPSHOT_PACKAGE_INSTALLER_HASH,
-                                 (long long)Hash64(appData.installer));
+                                 (long long)Hash64(installer));
                 }
             }
         } else {  // Strings not hashed in report
             proto->write(FIELD_TYPE_STRING | FIELD_ID_SNAPSHOT_PACKAGE_NAME, packageName);
             if (includeVersionStrings) {
                 proto->write(FIELD_TYPE_STRING | FIELD_ID_SNAPSHOT_PACKAGE_VERSION_STRING,
-                             appData.versionString);
+                             versionString);
             }
             if (includeInstaller) {
                 if (installerIndex != -1) {
@@ -387,17 +533,17 @@ void UidMap::writeUidMapSnapshotLocked(const int64_t timestamp, const bool inclu
                                  installerIndex);
                 } else {
                     proto->write(FIELD_TYPE_STRING | FIELD_ID_SNAPSHOT_PACKAGE_INSTALLER,
-                                 appData.installer);
+                                 installer);
                 }
             }
         }
 
-        const size_t dumpHashSize = truncatedCertificateHashSize <= appData.certificateHash.size()
+        const size_t dumpHashSize = truncatedCertificateHashSize <= certificateHash.size()
                                             ? truncatedCertificateHashSize
-                                            : appData.certificateHash.size();
+                                            : certificateHash.size();
         if (dumpHashSize > 0) {
             proto->write(FIELD_TYPE_BYTES | FIELD_ID_SNAPSHOT_PACKAGE_TRUNCATED_CERTIFICATE_HASH,
-                         appData.certificateHash.c_str(), dumpHashSize);
+                         certificateHash.c_str(), dumpHashSize);
         }
 
         proto->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_PACKAGE_VERSION,
@@ -411,35 +557,46 @@ void UidMap::writeUidMapSnapshotLocked(const int64_t timestamp, const bool inclu
 void UidMap::appendUidMap(const int64_t timestamp, const ConfigKey& key,
                           const bool includeVersionStrings, const bool includeInstaller,
                           const uint8_t truncatedCertificateHashSize, std::set<string>* str_set,
-                          ProtoOutputStream* proto) {
+                          ProtoOutputStream* proto, const int32_t fullSnapshotPeriod) {
     lock_guard<mutex> lock(mMutex);  // Lock for updates
 
+    // The changes since the last report replace the snapshot if they are all in mChanges.
+    const int64_t lastUpdateNs = mLastUpdatePerConfigKey[key];
+    int32_t& deltaReports = mDeltaReportsPerConfigKey[key];
+    const bool writeSnapshot = fullSnapshotPeriod <= 1 || lastUpdateNs < 0 ||
+                               mLastUntrackedChangeNs >= lastUpdateNs ||
+                               deltaReports + 1 >= fullSnapshotPeriod;
+    deltaReports = writeSnapshot ? 0 : deltaReports + 1;
+
     for (const ChangeRecord& record : mChanges) {
         if (record.timestampNs > mLastUpdatePerConfigKey[key]) {
             uint64_t changesToken =
                     proto->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_CHANGES);
+            const string& package = getStringLocked(record.package);
+            const string& versionString = getStringLocked(record.versionString);
+            const string& prevVersionString = getStringLocked(record.prevVersionString);
             proto->write(FIELD_TYPE_BOOL | FIELD_ID_CHANGE_DELETION, (bool)record.deletion);
             proto->write(FIELD_TYPE_INT64 | FIELD_ID_CHANGE_TIMESTAMP,
                          (long long)record.timestampNs);
             if (str_set != nullptr) {
-                str_set->insert(record.package);
+                str_set->insert(package);
                 proto->write(FIELD_TYPE_UINT64 | FIELD_ID_CHANGE_PACKAGE_HASH,
-                             (long long)Hash64(record.package));
+                             (long long)Hash64(package));
                 if (includeVersionStrings) {
-                    str_set->insert(record.versionString);
+                    str_set->insert(versionString);
                     proto->write(FIELD_TYPE_UINT64 | FIELD_ID_CHANGE_NEW_VERSION_STRING_HASH,
-                                 (long long)Hash64(record.versionString));
-                    str_set->insert(record.prevVersionString);
+                                 (long long)Hash64(versionString));
+                    str_set->insert(prevVersionString);
                     proto->write(FIELD_TYPE_UINT64 | FIELD_ID_CHANGE_PREV_VERSION_STRING_HASH,
-                                 (long long)Hash64(record.prevVersionString));
+                                 (long long)Hash64(prevVersionString));
                 }
             } else {
-                proto->write(FIELD_TYPE_STRING | FIELD_ID_CHANGE_PACKAGE, record.package);
+                proto->write(FIELD_TYPE_STRING | FIELD_ID_CHANGE_PACKAGE, package);
                 if (includeVersionStrings) {
                     proto->write(FIELD_TYPE_STRING | FIELD_ID_CHANGE_NEW_VERSION_STRING,
-                                 record.versionString);
+                                 versionString);
                     proto->write(FIELD_TYPE_STRING | FIELD_ID_CHANGE_PREV_VERSION_STRING,
-                                 record.prevVersionString);
+                                 prevVersionString);
                 }
             }
 
@@ -454,13 +611,15 @@ void UidMap::appendUidMap(const int64_t timestamp, const ConfigKey& key,
     map<string, int> installerIndices;
 
     // Write snapshot from current uid map state.
-    uint64_t snapshotsToken =
-            proto->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_SNAPSHOTS);
-    writeUidMapSnapshotLocked(timestamp, includeVersionStrings, includeInstaller,
-                              truncatedCertificateHashSize,
-                              std::set<int32_t>() /*empty uid set means including every uid*/,
-                              &installerIndices, str_set, proto);
-    proto->end(snapshotsToken);
+    if (writeSnapshot) {
+        uint64_t snapshotsToken =
+                proto->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_SNAPSHOTS);
+        writeUidMapSnapshotLocked(timestamp, includeVersionStrings, includeInstaller,
+                                  truncatedCertificateHashSize,
+                                  std::set<int32_t>() /*empty uid set means including every uid*/,
+                                  &installerIndices, str_set, proto);
+        proto->end(snapshotsToken);
+    }
 
     vector<string> installers(installerIndices.size(), "");
     for (const auto& [installer, index] : installerIndices) {
@@ -505,17 +664,20 @@ void UidMap::printUidMap(int out, bool includeCertificateHash) const {
     lock_guard<mutex> lock(mMutex);
 
     for (const auto& [keyPair, appData] : mMap) {
-        const auto& [uid, packageName] = keyPair;
+        const int32_t uid = keyPair.first;
+        const char* packageName = getStringLocked(keyPair.second).c_str();
+        const char* versionString = getStringLocked(appData.versionString).c_str();
+        const char* installer = getStringLocked(appData.installer).c_str();
         if (!appData.deleted) {
             if (includeCertificateHash) {
-                const string& certificateHashHexString = toHexString(appData.certificateHash);
-                dprintf(out, "%s, v%" PRId64 ", %s, %s (%i), %s\n", packageName.c_str(),
-                        appData.versionCode, appData.versionString.c_str(),
-                        appData.installer.c_str(), uid, certificateHashHexString.c_str());
+                const string& certificateHashHexString =
+                        toHexString(getStringLocked(appData.certificateHash));
+                dprintf(out, "%s, v%" PRId64 ", %s, %s (%i), %s\n", packageName,
+                        appData.versionCode, versionString, installer, uid,
+                        certificateHashHexString.c_str());
             } else {
-                dprintf(out, "%s, v%" PRId64 ", %s, %s (%i)\n", packageName.c_str(),
-                        appData.versionCode, appData.versionString.c_str(),
-                        appData.installer.c_str(), uid);
+                dprintf(out, "%s, v%" PRId64 ", %s, %s (%i)\n", packageName,
+                        appData.versionCode, versionString, installer, uid);
             }
         }
     }
@@ -523,126 +685,30 @@ void UidMap::printUidMap(int out, bool includeCertificateHash) const {
 
 void UidMap::OnConfigUpdated(const ConfigKey& key) {
     mLastUpdatePerConfigKey[key] = -1;
+    mDeltaReportsPerConfigKey[key] = 0;
 }
 
 void UidMap::OnConfigRemoved(const ConfigKey& key) {
     mLastUpdatePerConfigKey.erase(key);
+    mDeltaReportsPerConfigKey.erase(key);
 }
 
 set<int32_t> UidMap::getAppUid(const string& package) const {
     lock_guard<mutex> lock(mMutex);
 
     set<int32_t> results;
+    const StringId packageId = findStringIdLocked(package);
+    if (packageId < 0) {
+        return results;
+    }
     for (const auto& kv : mMap) {
-        if (kv.first.second == package && !kv.second.deleted) {
+        if (kv.first.second == packageId && !kv.second.deleted) {
             results.insert(kv.first.first);
         }
     }
     return results;
 }
 
-// Note not all the following AIDs are used as uids. Some are used only for gids.
-// It's ok to leave them in the map, but we won't ever see them in the log's uid field.
-// App's uid starts from 10000, and will not overlap with the following AIDs.
-const std::map<string, uint32_t> UidMap::sAidToUidMapping = {{"AID_ROOT", 0},
-                                                             {"AID_SYSTEM", 1000},
-                                                             {"AID_RADIO", 1001},
-                                                             {"AID_BLUETOOTH", 1002},
-                                                             {"AID_GRAPHICS", 1003},
-                                                             {"AID_INPUT", 1004},
-                                                             {"AID_AUDIO", 1005},
-                                                             {"AID_CAMERA", 1006},
-                                                             {"AID_LOG", 1007},
-                                                             {"AID_COMPASS", 1008},
-                                                             {"AID_MOUNT", 1009},
-                                                             {"AID_WIFI", 1010},
-                                                             {"AID_ADB", 1011},
-                                                             {"AID_INSTALL", 1012},
-                                                             {"AID_MEDIA", 1013},
-                                                             {"AID_DHCP", 1014},
-                                                             {"AID_SDCARD_RW", 1015},
-                                                             {"AID_VPN", 1016},
-                                                             {"AID_KEYSTORE", 1017},
-                                                             {"AID_USB", 1018},
-                                                             {"AID_DRM", 1019},
-                                                             {"AID_MDNSR", 1020},
-                                                             {"AID_GPS", 1021},
-                                                             // {"AID_UNUSED1", 1022},
-                                                             {"AID_MEDIA_RW", 1023},
-                                                             {"AID_MTP", 1024},
-                                                             // {"AID_UNUSED2", 1025},
-                                                             {"AID_DRMRPC", 1026},
-                                                             {"AID_NFC", 1027},
-                                                             {"AID_SDCARD_R", 1028},
-                                                             {"AID_CLAT", 1029},
-                                                             {"AID_LOOP_RADIO", 1030},
-                                                             {"AID_MEDIA_DRM", 1031},
-                                                             {"AID_PACKAGE_INFO", 1032},
-                                                             {"AID_SDCARD_PICS", 1033},
-                                                             {"AID_SDCARD_AV", 1034},
-                                                             {"AID_SDCARD_ALL", 1035},
-                                                             {"AID_LOGD", 1036},
-                                                             {"AID_SHARED_RELRO", 1037},
-                                                             {"AID_DBUS", 1038},
-                                                             {"AID_TLSDATE", 1039},
-                                                             {"AID_MEDIA_EX", 1040},
-                                                             {"AID_AUDIOSERVER", 1041},
-                                                             {"AID_METRICS_COLL", 1042},
-                                                             {"AID_METRICSD", 1043},
-                                                             {"AID_WEBSERV", 1044},
-                                                             {"AID_DEBUGGERD", 1045},
-                                                             {"AID_MEDIA_CODEC", 1046},
-                                                             {"AID_CAMERASERVER", 1047},
-                                                             {"AID_FIREWALL", 1048},
-                                                             {"AID_TRUNKS", 1049},
-                                                             {"AID_NVRAM", 1050},
-                                                             {"AID_DNS", 1051},
-                                                             {"AID_DNS_TETHER", 1052},
-                                                             {"AID_WEBVIEW_ZYGOTE", 1053},
-                                                             {"AID_VEHICLE_NETWORK", 1054},
-                                                             {"AID_MEDIA_AUDIO", 1055},
-                                                             {"AID_MEDIA_VIDEO", 1056},
-                                                             {"AID_MEDIA_IMAGE", 1057},
-                                                             {"AID_TOMBSTONED", 1058},
-                                                             {"AID_MEDIA_OBB", 1059},
-                                                             {"AID_ESE", 1060},
-                                                             {"AID_OTA_UPDATE", 1061},
-                                                             {"AID_AUTOMOTIVE_EVS", 1062},
-                                                             {"AID_LOWPAN", 1063},
-                                                             {"AID_HSM", 1064},
-                                                             {"AID_RESERVED_DISK", 1065},
-                                                             {"AID_STATSD", 1066},
-                                                             {"AID_INCIDENTD", 1067},
-                                                             {"AID_SECURE_ELEMENT", 1068},
-                                                             {"AID_LMKD", 1069},
-                                                             {"AID_LLKD", 1070},
-                                                             {"AID_IORAPD", 1071},
-                                                             {"AID_GPU_SERVICE", 1072},
-                                                             {"AID_NETWORK_STACK", 1073},
-                                                             {"AID_GSID", 1074},
-                                                             {"AID_FSVERITY_CERT", 1075},
-                                                             {"AID_CREDSTORE", 1076},
-                                                             {"AID_EXTERNAL_STORAGE", 1077},
-                                                             {"AID_EXT_DATA_RW", 1078},
-                                                             {"AID_EXT_OBB_RW", 1079},
-                                                             {"AID_CONTEXT_HUB", 1080},
-                                                             {"AID_VIRTUALIZATIONSERVICE", 1081},
-                                                             {"AID_ARTD", 1082},
-                                                             {"AID_UWB", 1083},
-                                                             {"AID_THREAD_NETWORK", 1084},
-                                                             {"AID_DICED", 1085},
-                                                             {"AID_DMESGD", 1086},
-                                                             {"AID_JC_WEAVER", 1087},
-                                                             {"AID_JC_STRONGBOX", 1088},
-                                                             {"AID_JC_IDENTITYCRED", 1089},
-                                                             {"AID_SDK_SANDBOX", 1090},
-                                                             {"AID_SECURITY_LOG_WRITER", 1091},
-                                                             {"AID_PRNG_SEEDER", 1092},
-                                                             {"AID_SHELL", 2000},
-                                                             {"AID_CACHE", 2001},
-                                                             {"AID_DIAG", 2002},
-                                                             {"AID_NOBODY", 9999}};
-
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
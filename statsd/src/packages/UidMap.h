@@ -22,11 +22,15 @@
 #include <utils/RefBase.h>
 #include <utils/String16.h>
 
+#include <atomic>
 #include <list>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "config/ConfigKey.h"
 #include "packages/PackageInfoListener.h"
@@ -41,19 +45,23 @@ namespace android {
 namespace os {
 namespace statsd {
 
+// Index of a string interned in UidMap, see UidMap::internLocked. The package names, version
+// strings, installers and certificate hashes repeat across apps and change records.
+typedef int32_t StringId;
+
 struct AppData {
     int64_t versionCode;
-    string versionString;
-    string installer;
+    StringId versionString;
+    StringId installer;
     bool deleted;
-    string certificateHash;
+    StringId certificateHash;
 
     // Empty constructor needed for unordered map.
     AppData() {
     }
 
-    AppData(const int64_t v, const string& versionString, const string& installer,
-            const string& certificateHash)
+    AppData(const int64_t v, const StringId versionString, const StringId installer,
+            const StringId certificateHash)
         : versionCode(v),
           versionString(versionString),
           installer(installer),
@@ -64,18 +72,18 @@ struct AppData {
 // When calling appendUidMap, we retrieve all the ChangeRecords since the last
 // timestamp we called appendUidMap for this configuration key.
 struct ChangeRecord {
-    const bool deletion;
-    const int64_t timestampNs;
-    const string package;
-    const int32_t uid;
-    const int64_t version;
-    const int64_t prevVersion;
-    const string versionString;
-    const string prevVersionString;
-
-    ChangeRecord(const bool isDeletion, int64_t timestampNs, const string& package,
-                 const int32_t uid, int64_t version, const string& versionString,
-                 const int64_t prevVersion, const string& prevVersionString)
+    bool deletion;
+    int64_t timestampNs;
+    StringId package;
+    int32_t uid;
+    int64_t version;
+    int64_t prevVersion;
+    StringId versionString;
+    StringId prevVersionString;
+
+    ChangeRecord(const bool isDeletion, int64_t timestampNs, const StringId package,
+                 const int32_t uid, int64_t version, const StringId versionString,
+                 const int64_t prevVersion, const StringId prevVersionString)
         : deletion(isDeletion),
           timestampNs(timestampNs),
           package(package),
@@ -95,10 +103,11 @@ class UidMap : public virtual RefBase {
 public:
     UidMap();
     ~UidMap();
-    static const std::map<std::string, uint32_t> sAidToUidMapping;
 
     static sp<UidMap> getInstance();
 
+    // Replaces the apps with the ones in uidData. Only the apps that changed are updated, and the
+    // listener isn't notified if none did.
     void updateMap(const int64_t timestamp, const UidData& uidData);
 
     void updateApp(const int64_t timestamp, const string& appName, const int32_t uid,
@@ -106,12 +115,30 @@ public:
                    const vector<uint8_t>& certificateHash);
     void removeApp(const int64_t timestamp, const string& app, const int32_t uid);
 
+    // The app lookups below (hasApp, getAppNamesFromUid, getAppVersion) and getHostUidOrSelf read
+    // an immutable snapshot of the maps, replaced on every update. They are called on the event
+    // path and never wait for the updates.
+
     // Returns true if the given uid contains the specified app (eg. com.google.android.gms).
     bool hasApp(int uid, const string& packageName) const;
 
     // Returns the app names from uid.
     std::set<string> getAppNamesFromUid(int32_t uid, bool returnNormalized) const;
 
+    // Returns true if the given uid contains an app matching the fnmatch() pattern. Unlike
+    // matching the names returned by getAppNamesFromUid, this doesn't copy them.
+    bool hasAppMatching(int32_t uid, const string& wildcardPattern) const;
+
+    // Returns the sorted uids that contain the specified app, or an app matching the fnmatch()
+    // pattern packageName if isWildcard is true.
+    std::vector<int32_t> getUidsWithApp(const string& packageName, bool isWildcard) const;
+
+    // Returns a value that changes every time apps are added, updated or removed. Lets callers
+    // caching the result of the app lookups above know when to refresh them without locking.
+    inline uint64_t getAppsGeneration() const {
+        return mAppsGeneration.load(std::memory_order_acquire);
+    }
+
     int64_t getAppVersion(int uid, const string& packageName) const;
 
     // Helper for debugging contents of this uid map. Can be triggered with:
@@ -135,12 +162,23 @@ public:
     // Returns the host uid if it exists. Otherwise, returns the same uid that was passed-in.
     virtual int getHostUidOrSelf(int uid) const;
 
+    // Returns whether any isolated uid is assigned, without taking a lock. The events don't need
+    // to be remapped with getHostUidOrSelf otherwise.
+    virtual bool hasIsolatedUids() const {
+        return mNumIsolatedUids.load(std::memory_order_acquire) > 0;
+    }
+
     // Gets all snapshots and changes that have occurred since the last output.
     // If every config key has received a change or snapshot record, then this
     // record is deleted.
+    // If fullSnapshotPeriod is greater than 1, the snapshot is only written every
+    // fullSnapshotPeriod outputs of the config, the others only have the changes since the
+    // previous output. The snapshot is still written if some of these changes are missing from
+    // the change records, i.e. they were dropped or the whole map was updated.
     void appendUidMap(int64_t timestamp, const ConfigKey& key, const bool includeVersionStrings,
                       const bool includeInstaller, const uint8_t truncatedCertificateHashSize,
-                      std::set<string>* str_set, ProtoOutputStream* proto);
+                      std::set<string>* str_set, ProtoOutputStream* proto,
+                      int32_t fullSnapshotPeriod = 0);
 
     // Forces the output to be cleared. We still generate a snapshot based on the current state.
     // This results in extra data uploaded but helps us reconstruct the uid mapping on the server
@@ -164,7 +202,6 @@ public:
                              ProtoOutputStream* proto) const;
 
 private:
-    std::set<string> getAppNamesFromUidLocked(int32_t uid, bool returnNormalized) const;
     string normalizeAppName(const string& appName) const;
 
     void writeUidMapSnapshotLocked(const int64_t timestamp, const bool includeVersionStrings,
@@ -174,27 +211,81 @@ private:
                                    std::map<string, int>* installerIndices,
                                    std::set<string>* str_set, ProtoOutputStream* proto) const;
 
+    // Rebuilds mAppsSnapshot and increments mAppsGeneration after a change to mMap.
+    void onAppsChangedLocked();
+
     mutable mutex mMutex;
+    // Serializes the updates of mIsolatedUidMap, it isn't held by the readers.
     mutable mutex mIsolatedMutex;
 
-    struct PairHash {
-        size_t operator()(const std::pair<int, string>& p) const noexcept {
-            std::hash<std::string> hash_fn;
-            return hash_fn(std::to_string(p.first) + p.second);
+    // Uid and interned package name of an app.
+    typedef std::pair<int32_t, StringId> AppKey;
+
+    struct AppKeyHash {
+        size_t operator()(const AppKey& p) const noexcept {
+            return std::hash<uint64_t>()((uint64_t)(uint32_t)p.first << 32 | (uint32_t)p.second);
         }
     };
     // Maps uid and package name to application data.
-    std::unordered_map<std::pair<int, string>, AppData, PairHash> mMap;
+    std::unordered_map<AppKey, AppData, AppKeyHash> mMap;
+
+    // Interned strings, indexed by their StringId. The empty string is always kEmptyStringId.
+    std::vector<string> mStrings;
+
+    // Maps the interned strings to their StringId.
+    std::unordered_map<string, StringId> mStringIds;
+
+    // Size of mStrings after the last compactStringsLocked.
+    size_t mNumStringsAtLastCompaction = 1;
+
+    static constexpr StringId kEmptyStringId = 0;
+
+    // Number of strings that can be interned after a compaction before the strings that are no
+    // longer used are released.
+    static constexpr size_t kMinStringsToCompact = 256;
+
+    // Returns the StringId of str, interning it if needed.
+    StringId internLocked(const string& str);
+
+    // Returns the StringId of str, or -1 if it isn't interned.
+    StringId findStringIdLocked(const string& str) const;
+
+    inline const string& getStringLocked(StringId id) const {
+        return mStrings[id];
+    }
+
+    // Releases the interned strings that aren't used by mMap and mChanges once enough strings
+    // were interned since the last compaction. This changes the StringIds.
+    void compactStringsLocked();
+
+    // Maps uid to the package names and version codes of its apps that aren't deleted, with their
+    // normalized names precomputed for the lookups.
+    struct UidApps {
+        std::map<string, int64_t> versions;
+        // Lowercase package names, in the order of versions.
+        std::vector<string> normalizedNames;
+    };
+    typedef std::unordered_map<int32_t, UidApps> AppsSnapshot;
+
+    // Snapshot of the apps in mMap, replaced with mMutex held and read with std::atomic_load.
+    std::shared_ptr<const AppsSnapshot> mAppsSnapshot;
+
+    // Incremented with mMutex held after every change to mMap.
+    std::atomic<uint64_t> mAppsGeneration = 0;
 
     // Maps isolated uid to the parent uid. Any metrics for an isolated uid will instead contribute
-    // to the parent uid.
-    std::unordered_map<int, int> mIsolatedUidMap;
+    // to the parent uid. Replaced with mIsolatedMutex held and read with std::atomic_load.
+    typedef std::unordered_map<int, int> IsolatedUidMap;
+    std::shared_ptr<const IsolatedUidMap> mIsolatedUidMap;
+
+    // Size of mIsolatedUidMap, updated with mIsolatedMutex held after it is replaced.
+    std::atomic<size_t> mNumIsolatedUids = 0;
 
     // Record the changes that can be provided with the uploads.
     std::list<ChangeRecord> mChanges;
 
     // Store which uid and apps represent deleted ones.
-    std::list<std::pair<int, string>> mDeletedApps;
+    std::list<AppKey> mDeletedApps;
 
     // Notify StatsLogProcessor if there's an upgrade/removal in any app.
     wp<PackageInfoListener> mSubscriber;
@@ -204,6 +295,14 @@ private:
     // Value of -1 denotes this config key has never received an upload.
     std::unordered_map<ConfigKey, int64_t> mLastUpdatePerConfigKey;
 
+    // Number of outputs without a snapshot of each config since its last snapshot, see
+    // appendUidMap.
+    std::unordered_map<ConfigKey, int32_t> mDeltaReportsPerConfigKey;
+
+    // Latest time of a change that has no change record, because the record was dropped or the
+    // whole map was updated. The configs whose last output is older need a snapshot.
+    int64_t mLastUntrackedChangeNs = 0;
+
     // Returns the minimum value from mConfigKeys.
     int64_t getMinimumTimestampNs();
 
@@ -224,6 +323,7 @@ private:
     FRIEND_TEST(RestrictedEventMetricE2eTest,
                 TestRestrictedConfigUpdateAddsDelegateRemovesUidMapEntry);
     FRIEND_TEST(UidMapTest, TestClearingOutput);
+    FRIEND_TEST(UidMapTest, TestInternedStringsCompacted);
     FRIEND_TEST(UidMapTest, TestRemovedAppRetained);
     FRIEND_TEST(UidMapTest, TestRemovedAppOverGuardrail);
     FRIEND_TEST(UidMapTest, TestOutputIncludesAtLeastOneSnapshot);
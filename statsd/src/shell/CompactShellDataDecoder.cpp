@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CompactShellDataDecoder.h"
+
+#include "src/shell/compact_shell_data.pb.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+static void appendVarint(std::string* bytes, uint64_t value) {
+    while (value >= 0x80) {
+        bytes->push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    bytes->push_back(static_cast<char>(value));
+}
+
+std::string CompactShellEvent::toAtomBytes() const {
+    // The atom id is the field number of the atom message in Atom.
+    static constexpr uint32_t kWireTypeLengthDelimited = 2;
+    std::string atomBytes;
+    appendVarint(&atomBytes, (static_cast<uint64_t>(atomId) << 3) | kWireTypeLengthDelimited);
+    appendVarint(&atomBytes, atomFields.size());
+    atomBytes.append(atomFields);
+    return atomBytes;
+}
+
+bool decodeCompactShellData(const uint8_t* payload, size_t size,
+                            std::vector<CompactShellEvent>* events) {
+    CompactShellData data;
+    if (!data.ParseFromArray(payload, size)) {
+        return false;
+    }
+    const int numEvents = data.atom_fields_size();
+    if (data.atom_id_indices_size() != numEvents ||
+        data.elapsed_timestamp_deltas_nanos_size() != numEvents) {
+        return false;
+    }
+    events->reserve(events->size() + numEvents);
+    int64_t elapsedTimestampNs = 0;
+    for (int i = 0; i < numEvents; i++) {
+        const uint32_t atomIdIndex = data.atom_id_indices(i);
+        if (atomIdIndex >= static_cast<uint32_t>(data.atom_ids_size())) {
+            return false;
+        }
+        elapsedTimestampNs += data.elapsed_timestamp_deltas_nanos(i);
+        events->push_back({.atomId = data.atom_ids(atomIdIndex),
+                           .elapsedTimestampNs = elapsedTimestampNs,
+                           .atomFields = data.atom_fields(i)});
+    }
+    return true;
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+// An event of a shell subscription with compact encoding.
+struct CompactShellEvent {
+    int32_t atomId;
+    int64_t elapsedTimestampNs;
+
+    // The serialized message of the atom in Atom, e.g. a ScreenStateChanged for
+    // SCREEN_STATE_CHANGED.
+    std::string atomFields;
+
+    // Returns the event as a serialized Atom, e.g. to merge it into a ShellData.
+    std::string toAtomBytes() const;
+};
+
+// Decodes a payload of a subscription with ShellSubscription.compact_encoding, i.e. a serialized
+// CompactShellData, appending its events to events. Returns false if the payload is malformed.
+bool decodeCompactShellData(const uint8_t* payload, size_t size,
+                            std::vector<CompactShellEvent>* events);
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -98,30 +98,44 @@ void ShellSubscriber::pullAndSendHeartbeats() {
     std::unique_lock<std::mutex> lock(mMutex);
     while (true) {
         StatsdStats::getInstance().noteSubscriptionPullThreadWakeup();
+        mDeliveryPending = false;
         int64_t sleepTimeMs = 24 * 60 * 60 * 1000;  // 24 hours.
         const int64_t nowNanos = getElapsedRealtimeNs();
         const int64_t nowMillis = nanoseconds_to_milliseconds(nowNanos);
         const int64_t nowSecs = nanoseconds_to_seconds(nowNanos);
-        for (auto clientIt = mClientSet.begin(); clientIt != mClientSet.end();) {
-            int64_t subscriptionSleepMs =
-                    (*clientIt)->pullAndSendHeartbeatsIfNeeded(nowSecs, nowMillis, nowNanos);
+        // The clients pulling the same atoms in this wakeup share the pulled data.
+        SharedPulls sharedPulls;
+        for (const auto& client : mClientSet) {
+            int64_t subscriptionSleepMs = client->pullAndSendHeartbeatsIfNeeded(
+                    nowSecs, nowMillis, nowNanos, &sharedPulls);
             sleepTimeMs = std::min(sleepTimeMs, subscriptionSleepMs);
-            if ((*clientIt)->isAlive()) {
-                ++clientIt;
-            } else {
-                VLOG("ShellSubscriber: removing client!");
-                (*clientIt)->onUnsubscribe();
-                clientIt = mClientSet.erase(clientIt);
-                updateLogEventFilterLocked();
+        }
+
+        // The data is delivered without holding mMutex, so that a slow subscriber doesn't hold up
+        // the log events.
+        const vector<shared_ptr<ShellSubscriberClient>> clients(mClientSet.begin(),
+                                                                mClientSet.end());
+        lock.unlock();
+        bool deliveryIncomplete = false;
+        for (const auto& client : clients) {
+            if (client->deliverPayloads()) {
+                deliveryIncomplete = true;
             }
         }
+        lock.lock();
+        if (deliveryIncomplete) {
+            sleepTimeMs = std::min(sleepTimeMs, ShellSubscriberClient::kMsBetweenFdWrites);
+        }
+
+        removeDeadClientsLocked();
         if (mClientSet.empty()) {
             mThreadAlive = false;
             VLOG("ShellSubscriber: helper thread done!");
             return;
         }
         VLOG("ShellSubscriber: helper thread sleeping for %" PRId64 "ms", sleepTimeMs);
-        mThreadSleepCV.wait_for(lock, sleepTimeMs * 1ms, [this] { return mClientSet.empty(); });
+        mThreadSleepCV.wait_for(lock, sleepTimeMs * 1ms,
+                                [this] { return mClientSet.empty() || mDeliveryPending; });
     }
 }
 
@@ -135,29 +149,55 @@ void ShellSubscriber::onLogEvent(const LogEvent& event) {
         return;
     }
     std::unique_lock<std::mutex> lock(mMutex);
-    for (auto clientIt = mClientSet.begin(); clientIt != mClientSet.end();) {
-        (*clientIt)->onLogEvent(event);
-        if ((*clientIt)->isAlive()) {
-            ++clientIt;
-        } else {
-            VLOG("ShellSubscriber: removing client!");
-
-            (*clientIt)->onUnsubscribe();
-            clientIt = mClientSet.erase(clientIt);
-            updateLogEventFilterLocked();
+    const auto clientsIt = mClientsByAtomId.find(event.GetTagId());
+    if (clientsIt == mClientsByAtomId.end()) {
+        return;
+    }
+    // Clients matching the event share its encoding instead of each serializing it again.
+    const EncodedLogEvent encodedEvent(event);
+    const bool shareEncoding = clientsIt->second.size() > 1;
+    bool payloadQueued = false;
+    bool clientDied = false;
+    for (ShellSubscriberClient* client : clientsIt->second) {
+        if (shareEncoding ? client->onLogEvent(encodedEvent) : client->onLogEvent(event)) {
+            payloadQueued = true;
         }
+        if (!client->isAlive()) {
+            clientDied = true;
+        }
+    }
+    if (clientDied) {
+        // Invalidates clientsIt.
+        removeDeadClientsLocked();
+    }
+    // The payloads are delivered by mThread.
+    if (payloadQueued && !mDeliveryPending) {
+        mDeliveryPending = true;
+        mThreadSleepCV.notify_one();
     }
 }
 
 void ShellSubscriber::flushSubscription(const shared_ptr<IStatsSubscriptionCallback>& callback) {
-    std::unique_lock<std::mutex> lock(mMutex);
+    shared_ptr<ShellSubscriberClient> flushedClient;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        flushedClient = flushSubscriptionLocked(callback);
+    }
+    // The callback is invoked on this binder thread, without holding mMutex.
+    if (flushedClient != nullptr) {
+        flushedClient->deliverPayloads();
+    }
+}
 
+shared_ptr<ShellSubscriberClient> ShellSubscriber::flushSubscriptionLocked(
+        const shared_ptr<IStatsSubscriptionCallback>& callback) {
     // TODO(b/268822860): Consider storing callback clients in a map keyed by
     // IStatsSubscriptionCallback to avoid this linear search.
     for (auto clientIt = mClientSet.begin(); clientIt != mClientSet.end(); ++clientIt) {
         if ((*clientIt)->hasCallback(callback)) {
             if ((*clientIt)->isAlive()) {
                 (*clientIt)->flush();
+                return *clientIt;
             } else {
                 VLOG("ShellSubscriber: removing client!");
 
@@ -169,37 +209,67 @@ void ShellSubscriber::flushSubscription(const shared_ptr<IStatsSubscriptionCallb
                 clientIt = mClientSet.erase(clientIt);
                 updateLogEventFilterLocked();
             }
-            return;
+            return nullptr;
         }
     }
+    return nullptr;
 }
 
 void ShellSubscriber::unsubscribe(const shared_ptr<IStatsSubscriptionCallback>& callback) {
-    std::unique_lock<std::mutex> lock(mMutex);
+    shared_ptr<ShellSubscriberClient> removedClient;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        removedClient = removeSubscriptionLocked(callback);
+    }
+    // The last data and the end of the subscription are sent without holding mMutex.
+    if (removedClient != nullptr) {
+        removedClient->onUnsubscribe();
+    }
+}
 
+shared_ptr<ShellSubscriberClient> ShellSubscriber::removeSubscriptionLocked(
+        const shared_ptr<IStatsSubscriptionCallback>& callback) {
     // TODO(b/268822860): Consider storing callback clients in a map keyed by
     // IStatsSubscriptionCallback to avoid this linear search.
     for (auto clientIt = mClientSet.begin(); clientIt != mClientSet.end(); ++clientIt) {
         if ((*clientIt)->hasCallback(callback)) {
             VLOG("ShellSubscriber: removing client!");
 
-            (*clientIt)->onUnsubscribe();
+            shared_ptr<ShellSubscriberClient> client = *clientIt;
+            mClientSet.erase(clientIt);
+            updateLogEventFilterLocked();
+            return client;
+        }
+    }
+    return nullptr;
+}
 
-            // Erasing a value moves the iterator to the next value. The update expression also
-            // moves the iterator, skipping a value. This is fine because we do an early return
-            // before next iteration of the loop.
+void ShellSubscriber::removeDeadClientsLocked() {
+    bool clientRemoved = false;
+    for (auto clientIt = mClientSet.begin(); clientIt != mClientSet.end();) {
+        if ((*clientIt)->isAlive()) {
+            ++clientIt;
+        } else {
+            VLOG("ShellSubscriber: removing client!");
+            (*clientIt)->onUnsubscribe();
             clientIt = mClientSet.erase(clientIt);
-            updateLogEventFilterLocked();
-            return;
+            clientRemoved = true;
         }
     }
+    if (clientRemoved) {
+        updateLogEventFilterLocked();
+    }
 }
 
-void ShellSubscriber::updateLogEventFilterLocked() const {
+void ShellSubscriber::updateLogEventFilterLocked() {
     VLOG("ShellSubscriber: Updating allAtomIds");
     LogEventFilter::AtomIdSet allAtomIds;
+    mClientsByAtomId.clear();
     for (const auto& client : mClientSet) {
         client->addAllAtomIds(allAtomIds);
+        for (const int32_t atomId : client->getPushedAtomIds()) {
+            mClientsByAtomId[atomId].push_back(client.get());
+        }
     }
     VLOG("ShellSubscriber: Updating allAtomIds done. Total atoms %d", (int)allAtomIds.size());
     mLogEventFilter->setAtomIds(std::move(allAtomIds), this);
@@ -21,6 +21,8 @@
 #include <condition_variable>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "external/StatsPullerManager.h"
 #include "packages/UidMap.h"
@@ -53,6 +55,9 @@ namespace statsd {
  * The stream would be in the following format:
  * |size_t|shellData proto|size_t|shellData proto|....
  *
+ * The log events are only serialized on the thread calling onLogEvent. The data is written to the
+ * file descriptors and sent to the callbacks on the thread pulling atoms and sending heartbeats,
+ * or on the binder thread flushing or ending a callback subscription.
  */
 class ShellSubscriber : public virtual RefBase {
 public:
@@ -90,8 +95,19 @@ private:
 
     void pullAndSendHeartbeats();
 
-    /* Tells LogEventFilter about atom ids to parse */
-    void updateLogEventFilterLocked() const;
+    // Queues the cached data of the subscription, returns the client to deliver it.
+    shared_ptr<ShellSubscriberClient> flushSubscriptionLocked(
+            const shared_ptr<aidl::android::os::IStatsSubscriptionCallback>& callback);
+
+    // Removes the subscription, returns the client to call onUnsubscribe() on without mMutex.
+    shared_ptr<ShellSubscriberClient> removeSubscriptionLocked(
+            const shared_ptr<aidl::android::os::IStatsSubscriptionCallback>& callback);
+
+    // Removes the clients which are no longer alive.
+    void removeDeadClientsLocked();
+
+    /* Tells LogEventFilter about atom ids to parse and updates mClientsByAtomId */
+    void updateLogEventFilterLocked();
 
     sp<UidMap> mUidMap;
 
@@ -99,18 +115,27 @@ private:
 
     std::shared_ptr<LogEventFilter> mLogEventFilter;
 
-    // Protects mClientSet, mThreadAlive, and ShellSubscriberClient
+    // Protects mClientSet, mThreadAlive, mDeliveryPending, and ShellSubscriberClient
     mutable std::mutex mMutex;
 
-    std::set<unique_ptr<ShellSubscriberClient>> mClientSet;
+    // Shared with the threads delivering the data of a client outside of mMutex.
+    std::set<shared_ptr<ShellSubscriberClient>> mClientSet;
+
+    // The clients of mClientSet subscribed to each pushed atom id.
+    std::unordered_map<int32_t, std::vector<ShellSubscriberClient*>> mClientsByAtomId;
 
     bool mThreadAlive = false;
 
+    // Whether onLogEvent queued payloads for mThread to deliver.
+    bool mDeliveryPending = false;
+
     std::condition_variable mThreadSleepCV;
 
     std::thread mThread;
 
-    static constexpr size_t kMaxSubscriptions = 20;
+    // Pulls are shared by the subscriptions, see SharedPulls, so they don't make each subscription
+    // more expensive.
+    static constexpr size_t kMaxSubscriptions = 40;
 };
 
 }  // namespace statsd
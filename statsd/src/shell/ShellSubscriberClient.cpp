@@ -18,9 +18,13 @@
 
 #include "ShellSubscriberClient.h"
 
+#include <fcntl.h>
+
 #include "FieldValue.h"
+#include "HashableDimensionKey.h"
 #include "guardrail/StatsdStats.h"
 #include "matchers/matcher_util.h"
+#include "packages/AidMapping.h"
 #include "stats_log_util.h"
 
 using android::base::unique_fd;
@@ -33,15 +37,85 @@ namespace statsd {
 const static int FIELD_ID_SHELL_DATA__ATOM = 1;
 const static int FIELD_ID_SHELL_DATA__ELAPSED_TIMESTAMP_NANOS = 2;
 
+const static int FIELD_ID_COMPACT_SHELL_DATA__ATOM_IDS = 1;
+const static int FIELD_ID_COMPACT_SHELL_DATA__ATOM_ID_INDICES = 2;
+const static int FIELD_ID_COMPACT_SHELL_DATA__ELAPSED_TIMESTAMP_DELTAS_NANOS = 3;
+const static int FIELD_ID_COMPACT_SHELL_DATA__ATOM_FIELDS = 4;
+
+// Appends a varint to the bytes of a packed repeated field.
+static void appendVarint(vector<uint8_t>* packed, uint64_t value) {
+    while (value >= 0x80) {
+        packed->push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    packed->push_back(static_cast<uint8_t>(value));
+}
+
+static uint64_t zigZagEncode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+const std::vector<uint8_t>& EncodedLogEvent::getAtomBytes() const {
+    if (!mEncoded) {
+        ProtoOutputStream atomProto;
+        mEvent.ToProto(atomProto);
+        atomProto.serializeToVector(&mAtomBytes);
+        mEncoded = true;
+    }
+    return mAtomBytes;
+}
+
+static unordered_map<int32_t, vector<size_t>> indexMatchersByAtomId(
+        const vector<SimpleAtomMatcher>& matchers) {
+    unordered_map<int32_t, vector<size_t>> matcherIndices;
+    for (size_t i = 0; i < matchers.size(); i++) {
+        matcherIndices[matchers[i].atom_id()].push_back(i);
+    }
+    return matcherIndices;
+}
+
+// Pulls are scheduled at multiples of their interval, so that the clients pulling an atom at the
+// same or at multiple intervals pull it together.
+static int64_t alignToInterval(int64_t timeMs, int64_t intervalMs) {
+    return intervalMs > 0 ? timeMs - timeMs % intervalMs : timeMs;
+}
+
+const vector<shared_ptr<LogEvent>>& SharedPulls::pull(const sp<StatsPullerManager>& pullerMgr,
+                                                      int32_t atomId, const vector<int32_t>& uids,
+                                                      int64_t nowNanos) {
+    auto [it, inserted] = mPulledData.try_emplace({atomId, uids});
+    if (inserted) {
+        // A failed pull is not retried either, the data stays empty.
+        pullerMgr->Pull(atomId, uids, nowNanos, &it->second);
+    }
+    return it->second;
+}
+
 // Store next subscription ID for StatsdStats.
 // Not thread-safe; should only be accessed while holding ShellSubscriber::mMutex lock.
 static int nextSubId = 0;
 
 struct ReadConfigResult {
     vector<SimpleAtomMatcher> pushedMatchers;
+    vector<vector<Matcher>> pushedFields;
     vector<ShellSubscriberClient::PullInfo> pullInfo;
+    bool compactEncoding = false;
 };
 
+// Translates the fields to send of the atoms with atomId. Returns false if they are specified for
+// another atom.
+static bool translateFields(const FieldMatcher& fields, int32_t atomId, vector<Matcher>* output) {
+    if (fields.child_size() == 0) {
+        return true;  // The whole atom is sent.
+    }
+    if (fields.field() != atomId) {
+        ALOGE("ShellSubscriberClient: fields of atom %d given for atom %d", fields.field(), atomId);
+        return false;
+    }
+    translateFieldMatcher(fields, output);
+    return true;
+}
+
 // Read and parse single config. There should only one config in the input.
 static optional<ReadConfigResult> readConfig(const vector<uint8_t>& configBytes,
                                              int64_t startTimeMs, int64_t minPullIntervalMs) {
@@ -55,22 +129,40 @@ static optional<ReadConfigResult> readConfig(const vector<uint8_t>& configBytes,
     ReadConfigResult result;
 
     result.pushedMatchers.assign(config.pushed().begin(), config.pushed().end());
+    result.compactEncoding = config.compact_encoding();
+    if (config.pushed_fields_size() > config.pushed_size()) {
+        ALOGE("ShellSubscriberClient: more pushed fields than pushed matchers");
+        return nullopt;
+    }
+    result.pushedFields.resize(config.pushed_size());
+    for (int i = 0; i < config.pushed_fields_size(); i++) {
+        if (!translateFields(config.pushed_fields(i), config.pushed(i).atom_id(),
+                             &result.pushedFields[i])) {
+            return nullopt;
+        }
+    }
 
     vector<ShellSubscriberClient::PullInfo> pullInfo;
     for (const auto& pulled : config.pulled()) {
         vector<string> packages;
         vector<int32_t> uids;
         for (const string& pkg : pulled.packages()) {
-            auto it = UidMap::sAidToUidMapping.find(pkg);
-            if (it != UidMap::sAidToUidMapping.end()) {
-                uids.push_back(it->second);
+            const optional<int32_t> aidUid = AidMapping::getUid(pkg);
+            if (aidUid) {
+                uids.push_back(*aidUid);
             } else {
                 packages.push_back(pkg);
             }
         }
 
+        vector<Matcher> fields;
+        if (!translateFields(pulled.fields(), pulled.matcher().atom_id(), &fields)) {
+            return nullopt;
+        }
+
         const int64_t pullIntervalMs = max(pulled.freq_millis(), minPullIntervalMs);
-        result.pullInfo.emplace_back(pulled.matcher(), startTimeMs, pullIntervalMs, packages, uids);
+        result.pullInfo.emplace_back(pulled.matcher(), startTimeMs, pullIntervalMs, packages, uids,
+                                     fields);
         ALOGD("ShellSubscriberClient: adding matcher for pulled atom %d",
               pulled.matcher().atom_id());
     }
@@ -81,30 +173,49 @@ static optional<ReadConfigResult> readConfig(const vector<uint8_t>& configBytes,
 ShellSubscriberClient::PullInfo::PullInfo(const SimpleAtomMatcher& matcher, int64_t startTimeMs,
                                           int64_t intervalMs,
                                           const std::vector<std::string>& packages,
-                                          const std::vector<int32_t>& uids)
+                                          const std::vector<int32_t>& uids,
+                                          const std::vector<Matcher>& fields)
     : mPullerMatcher(matcher),
       mIntervalMs(intervalMs),
-      mPrevPullElapsedRealtimeMs(startTimeMs),
+      mPrevPullElapsedRealtimeMs(alignToInterval(startTimeMs, intervalMs)),
       mPullPackages(packages),
-      mPullUids(uids) {
+      mPullUids(uids),
+      mFields(fields) {
 }
 
 ShellSubscriberClient::ShellSubscriberClient(
         int id, int out, const std::shared_ptr<IStatsSubscriptionCallback>& callback,
         const std::vector<SimpleAtomMatcher>& pushedMatchers,
-        const std::vector<PullInfo>& pulledInfo, int64_t timeoutSec, int64_t startTimeSec,
-        const sp<UidMap>& uidMap, const sp<StatsPullerManager>& pullerMgr)
+        const std::vector<std::vector<Matcher>>& pushedFields,
+        const std::vector<PullInfo>& pulledInfo, bool compactEncoding, int64_t timeoutSec,
+        int64_t startTimeSec, const sp<UidMap>& uidMap, const sp<StatsPullerManager>& pullerMgr)
     : mId(id),
       mUidMap(uidMap),
       mPullerMgr(pullerMgr),
       mDupOut(fcntl(out, F_DUPFD_CLOEXEC, 0)),
       mPushedMatchers(pushedMatchers),
+      mPushedFields(pushedFields),
+      mPushedMatcherIndices(indexMatchersByAtomId(pushedMatchers)),
       mPulledInfo(pulledInfo),
       mCallback(callback),
+      mCompactEncoding(compactEncoding),
       mTimeoutSec(timeoutSec),
       mStartTimeSec(startTimeSec),
       mLastWriteMs(startTimeSec * 1000),
-      mCacheSize(0){};
+      mCacheSize(0) {
+    // Writes to the pipe must never block the log event processing on a slow reader, what the
+    // pipe doesn't accept is kept in mPendingOut.
+    if (mDupOut.ok()) {
+        fcntl(mDupOut.get(), F_SETFL, fcntl(mDupOut.get(), F_GETFL) | O_NONBLOCK);
+    }
+}
+
+ShellSubscriberClient::~ShellSubscriberClient() {
+    if (mNumDroppedWrites > 0) {
+        ALOGW("ShellSubscriberClient: dropped %lld payloads for a slow subscriber",
+              (long long)mNumDroppedWrites);
+    }
+}
 
 unique_ptr<ShellSubscriberClient> ShellSubscriberClient::create(
         int in, int out, int64_t timeoutSec, int64_t startTimeSec, const sp<UidMap>& uidMap,
@@ -138,7 +249,8 @@ unique_ptr<ShellSubscriberClient> ShellSubscriberClient::create(
 
     return make_unique<ShellSubscriberClient>(
             nextSubId++, out, /*callback=*/nullptr, readConfigResult->pushedMatchers,
-            readConfigResult->pullInfo, timeoutSec, startTimeSec, uidMap, pullerMgr);
+            readConfigResult->pushedFields, readConfigResult->pullInfo,
+            readConfigResult->compactEncoding, timeoutSec, startTimeSec, uidMap, pullerMgr);
 }
 
 unique_ptr<ShellSubscriberClient> ShellSubscriberClient::create(
@@ -169,64 +281,153 @@ unique_ptr<ShellSubscriberClient> ShellSubscriberClient::create(
     StatsdStats::getInstance().noteSubscriptionStarted(id, readConfigResult->pushedMatchers.size(),
                                                        readConfigResult->pullInfo.size());
     return make_unique<ShellSubscriberClient>(
-            id, /*out=*/-1, callback, readConfigResult->pushedMatchers, readConfigResult->pullInfo,
-            /*timeoutSec=*/-1, startTimeSec, uidMap, pullerMgr);
+            id, /*out=*/-1, callback, readConfigResult->pushedMatchers,
+            readConfigResult->pushedFields, readConfigResult->pullInfo,
+            readConfigResult->compactEncoding, /*timeoutSec=*/-1, startTimeSec, uidMap, pullerMgr);
 }
 
 bool ShellSubscriberClient::writeEventToProtoIfMatched(const LogEvent& event,
                                                        const SimpleAtomMatcher& matcher,
-                                                       const sp<UidMap>& uidMap) {
+                                                       const vector<Matcher>& fields,
+                                                       const sp<UidMap>& uidMap,
+                                                       const EncodedLogEvent* encodedEvent) {
     auto [matched, transformedEvent] = matchesSimple(mUidMap, matcher, event);
     if (!matched) {
         return false;
     }
     const LogEvent& eventRef = transformedEvent == nullptr ? event : *transformedEvent;
 
-    // Cache atom event in mProtoOut.
-    uint64_t atomToken = mProtoOut.start(util::FIELD_TYPE_MESSAGE | util::FIELD_COUNT_REPEATED |
-                                         FIELD_ID_SHELL_DATA__ATOM);
-    eventRef.ToProto(mProtoOut);
-    mProtoOut.end(atomToken);
-
+    // Only the subscribed fields are encoded.
+    vector<FieldValue> projectedValues;
+    if (!fields.empty()) {
+        filterGaugeValues(fields, eventRef.getValues(), &projectedValues);
+    }
+    const vector<FieldValue>& values = fields.empty() ? eventRef.getValues() : projectedValues;
     const int64_t timestampNs = truncateTimestampIfNecessary(eventRef);
-    mProtoOut.write(util::FIELD_TYPE_INT64 | util::FIELD_COUNT_REPEATED |
-                            FIELD_ID_SHELL_DATA__ELAPSED_TIMESTAMP_NANOS,
-                    static_cast<long long>(timestampNs));
+
+    // Cache atom event in mProtoOut.
+    if (mCompactEncoding) {
+        writeCompactEvent(eventRef.GetTagId(), timestampNs, values);
+    } else if (encodedEvent != nullptr && transformedEvent == nullptr && fields.empty()) {
+        // The untransformed encoding is shared with the other clients receiving this event.
+        const std::vector<uint8_t>& atomBytes = encodedEvent->getAtomBytes();
+        mProtoOut.write(util::FIELD_TYPE_MESSAGE | util::FIELD_COUNT_REPEATED |
+                                FIELD_ID_SHELL_DATA__ATOM,
+                        reinterpret_cast<const char*>(atomBytes.data()), atomBytes.size());
+    } else {
+        uint64_t atomToken = mProtoOut.start(util::FIELD_TYPE_MESSAGE |
+                                             util::FIELD_COUNT_REPEATED | FIELD_ID_SHELL_DATA__ATOM);
+        if (fields.empty()) {
+            // Transcoded from the parsed buffer when the event still has it.
+            eventRef.ToProto(mProtoOut);
+        } else {
+            writeFieldValueTreeToStream(eventRef.GetTagId(), values, &mProtoOut);
+        }
+        mProtoOut.end(atomToken);
+    }
+    if (!mCompactEncoding) {
+        mProtoOut.write(util::FIELD_TYPE_INT64 | util::FIELD_COUNT_REPEATED |
+                                FIELD_ID_SHELL_DATA__ELAPSED_TIMESTAMP_NANOS,
+                        static_cast<long long>(timestampNs));
+    }
 
     // Update byte size of cached data.
-    mCacheSize += getSize(eventRef.getValues()) + sizeof(timestampNs);
+    mCacheSize += getSize(values) + sizeof(timestampNs);
 
     return true;
 }
 
+void ShellSubscriberClient::writeCompactEvent(int32_t atomId, int64_t timestampNs,
+                                              const vector<FieldValue>& values) {
+    auto [atomIdIt, inserted] =
+            mCompactEvents.atomIdIndices.try_emplace(atomId, mCompactEvents.atomIdIndices.size());
+    if (inserted) {
+        appendVarint(&mCompactEvents.packedAtomIds, static_cast<uint64_t>(atomId));
+    }
+    appendVarint(&mCompactEvents.packedAtomIdIndices, atomIdIt->second);
+    appendVarint(&mCompactEvents.packedTimestampDeltas,
+                 zigZagEncode(timestampNs - mCompactEvents.lastTimestampNs));
+    mCompactEvents.lastTimestampNs = timestampNs;
+
+    // Only the atom fields are kept in mProtoOut, the rest is written by queuePayload.
+    const uint64_t fieldId = util::FIELD_COUNT_REPEATED | FIELD_ID_COMPACT_SHELL_DATA__ATOM_FIELDS;
+    if (values.empty()) {
+        // Empty messages are left out by ProtoOutputStream, each event needs its atom fields.
+        mProtoOut.write(util::FIELD_TYPE_BYTES | fieldId, "", 0);
+        return;
+    }
+    uint64_t fieldsToken = mProtoOut.start(util::FIELD_TYPE_MESSAGE | fieldId);
+    writeFieldValueTreeFieldsToStream(atomId, values, &mProtoOut);
+    mProtoOut.end(fieldsToken);
+}
+
+void ShellSubscriberClient::writeCompactEventsToProto() {
+    const auto writePacked = [this](int fieldId, const vector<uint8_t>& packed) {
+        if (!packed.empty()) {
+            mProtoOut.write(util::FIELD_TYPE_BYTES | fieldId,
+                            reinterpret_cast<const char*>(packed.data()), packed.size());
+        }
+    };
+    writePacked(FIELD_ID_COMPACT_SHELL_DATA__ATOM_IDS, mCompactEvents.packedAtomIds);
+    writePacked(FIELD_ID_COMPACT_SHELL_DATA__ATOM_ID_INDICES, mCompactEvents.packedAtomIdIndices);
+    writePacked(FIELD_ID_COMPACT_SHELL_DATA__ELAPSED_TIMESTAMP_DELTAS_NANOS,
+                mCompactEvents.packedTimestampDeltas);
+}
+
 // Called by ShellSubscriber when a pushed event occurs
-void ShellSubscriberClient::onLogEvent(const LogEvent& event) {
-    for (const auto& matcher : mPushedMatchers) {
-        if (writeEventToProtoIfMatched(event, matcher, mUidMap)) {
-            flushProtoIfNeeded();
-            break;
+bool ShellSubscriberClient::onLogEvent(const LogEvent& event) {
+    return onLogEventInternal(event, /*encodedEvent=*/nullptr);
+}
+
+bool ShellSubscriberClient::onLogEvent(const EncodedLogEvent& event) {
+    return onLogEventInternal(event.getEvent(), &event);
+}
+
+bool ShellSubscriberClient::onLogEventInternal(const LogEvent& event,
+                                               const EncodedLogEvent* encodedEvent) {
+    const auto matcherIndicesIt = mPushedMatcherIndices.find(event.GetTagId());
+    if (matcherIndicesIt == mPushedMatcherIndices.end()) {
+        return false;
+    }
+    for (const size_t matcherIndex : matcherIndicesIt->second) {
+        if (writeEventToProtoIfMatched(event, mPushedMatchers[matcherIndex],
+                                       mPushedFields[matcherIndex], mUidMap, encodedEvent)) {
+            return flushProtoIfNeeded();
         }
     }
+    return false;
 }
 
-void ShellSubscriberClient::flushProtoIfNeeded() {
+bool ShellSubscriberClient::flushProtoIfNeeded() {
     if (mCallback == nullptr) {  // Using file descriptor.
-        triggerFdFlush();
+        // Events coming in a burst are coalesced, the heartbeats write what is left.
+        if (mCacheSize >= kMaxFdCacheSizeBytes ||
+            getElapsedRealtimeMillis() - mLastWriteMs >= kMsBetweenFdWrites) {
+            queuePayload(StatsSubscriptionCallbackReason::STATSD_INITIATED);
+            return true;
+        }
     } else if (mCacheSize >= kMaxCacheSizeBytes) {  // Using callback.
         // Flush data if cache is full.
-        triggerCallback(StatsSubscriptionCallbackReason::STATSD_INITIATED);
+        queuePayload(StatsSubscriptionCallbackReason::STATSD_INITIATED);
+        return true;
     }
+    return false;
 }
 
-int64_t ShellSubscriberClient::pullIfNeeded(int64_t nowSecs, int64_t nowMillis, int64_t nowNanos) {
+int64_t ShellSubscriberClient::pullIfNeeded(int64_t nowSecs, int64_t nowMillis, int64_t nowNanos,
+                                            SharedPulls* sharedPulls) {
+    SharedPulls ownPulls;
+    if (sharedPulls == nullptr) {
+        sharedPulls = &ownPulls;
+    }
     int64_t sleepTimeMs = 24 * 60 * 60 * 1000;  // 24 hours.
     for (PullInfo& pullInfo : mPulledInfo) {
         if (pullInfo.mPrevPullElapsedRealtimeMs + pullInfo.mIntervalMs <= nowMillis) {
             vector<int32_t> uids;
             getUidsForPullAtom(&uids, pullInfo);
 
-            vector<shared_ptr<LogEvent>> data;
-            mPullerMgr->Pull(pullInfo.mPullerMatcher.atom_id(), uids, nowNanos, &data);
+            const vector<shared_ptr<LogEvent>>& data = sharedPulls->pull(
+                    mPullerMgr, pullInfo.mPullerMatcher.atom_id(), uids, nowNanos);
             VLOG("ShellSubscriberClient: pulled %zu atoms with id %d", data.size(),
                  pullInfo.mPullerMatcher.atom_id());
             if (mCallback != nullptr) {  // Callback subscription
@@ -234,8 +435,8 @@ int64_t ShellSubscriberClient::pullIfNeeded(int64_t nowSecs, int64_t nowMillis,
                         pullInfo.mPullerMatcher.atom_id());
             }
 
-            writePulledAtomsLocked(data, pullInfo.mPullerMatcher);
-            pullInfo.mPrevPullElapsedRealtimeMs = nowMillis;
+            writePulledAtomsLocked(data, pullInfo);
+            pullInfo.mPrevPullElapsedRealtimeMs = alignToInterval(nowMillis, pullInfo.mIntervalMs);
         }
 
         // Determine how long to sleep before doing more work.
@@ -251,7 +452,8 @@ int64_t ShellSubscriberClient::pullIfNeeded(int64_t nowSecs, int64_t nowMillis,
 // The pullAndHeartbeat threads sleep for the minimum time
 // among all clients' input
 int64_t ShellSubscriberClient::pullAndSendHeartbeatsIfNeeded(int64_t nowSecs, int64_t nowMillis,
-                                                             int64_t nowNanos) {
+                                                             int64_t nowNanos,
+                                                             SharedPulls* sharedPulls) {
     int64_t sleepTimeMs;
     if (mCallback == nullptr) {  // File descriptor subscription
         if ((nowSecs - mStartTimeSec >= mTimeoutSec) && (mTimeoutSec > 0)) {
@@ -259,24 +461,29 @@ int64_t ShellSubscriberClient::pullAndSendHeartbeatsIfNeeded(int64_t nowSecs, in
             return kMsBetweenHeartbeats;
         }
 
-        sleepTimeMs = min(kMsBetweenHeartbeats, pullIfNeeded(nowSecs, nowMillis, nowNanos));
+        sleepTimeMs =
+                min(kMsBetweenHeartbeats, pullIfNeeded(nowSecs, nowMillis, nowNanos, sharedPulls));
 
         // Send a heartbeat consisting of data size of 0, if
         // the user hasn't recently received data from statsd. When it receives the data size of 0,
         // the user will not expect any atoms and recheck whether the subscription should end.
-        if (nowMillis - mLastWriteMs >= kMsBetweenHeartbeats) {
-            triggerFdFlush();
-            if (!mClientAlive) return kMsBetweenHeartbeats;
+        if (nowMillis - mLastWriteMs >= kMsBetweenHeartbeats ||
+            (mCacheSize > 0 && nowMillis - mLastWriteMs >= kMsBetweenFdWrites)) {
+            queuePayload(StatsSubscriptionCallbackReason::STATSD_INITIATED);
         }
 
         int64_t timeBeforeHeartbeat = mLastWriteMs + kMsBetweenHeartbeats - nowMillis;
         sleepTimeMs = min(sleepTimeMs, timeBeforeHeartbeat);
+        if (mCacheSize > 0) {
+            sleepTimeMs = min(sleepTimeMs, kMsBetweenFdWrites);
+        }
     } else {  // Callback subscription.
-        sleepTimeMs = min(kMsBetweenCallbacks, pullIfNeeded(nowSecs, nowMillis, nowNanos));
+        sleepTimeMs =
+                min(kMsBetweenCallbacks, pullIfNeeded(nowSecs, nowMillis, nowNanos, sharedPulls));
 
         if (mCacheSize > 0 && nowMillis - mLastWriteMs >= kMsBetweenCallbacks) {
             // Flush data if cache has kept data for longer than kMsBetweenCallbacks.
-            triggerCallback(StatsSubscriptionCallbackReason::STATSD_INITIATED);
+            queuePayload(StatsSubscriptionCallbackReason::STATSD_INITIATED);
         }
 
         // Cache should be flushed kMsBetweenCallbacks after mLastWrite.
@@ -294,10 +501,11 @@ int64_t ShellSubscriberClient::pullAndSendHeartbeatsIfNeeded(int64_t nowSecs, in
 }
 
 void ShellSubscriberClient::writePulledAtomsLocked(const vector<shared_ptr<LogEvent>>& data,
-                                                   const SimpleAtomMatcher& matcher) {
+                                                   const PullInfo& pullInfo) {
     bool hasData = false;
     for (const shared_ptr<LogEvent>& event : data) {
-        if (writeEventToProtoIfMatched(*event, matcher, mUidMap)) {
+        if (writeEventToProtoIfMatched(*event, pullInfo.mPullerMatcher, pullInfo.mFields,
+                                       mUidMap)) {
             hasData = true;
         }
     }
@@ -307,22 +515,49 @@ void ShellSubscriberClient::writePulledAtomsLocked(const vector<shared_ptr<LogEv
     }
 }
 
-// Tries to write the atom encoded in mProtoOut to the pipe. If the write fails
-// because the read end of the pipe has closed, change the client status so
-// the manager knows the subscription is no longer active
-void ShellSubscriberClient::attemptWriteToPipeLocked() {
-    const size_t dataSize = mProtoOut.size();
-    // First, write the payload size.
-    if (!android::base::WriteFully(mDupOut, &dataSize, sizeof(dataSize))) {
-        mClientAlive = false;
+// Appends the payload to the pipe output. The payload is dropped if the reader lags too far
+// behind.
+void ShellSubscriberClient::appendToPendingOut(const vector<uint8_t>& payloadBytes) {
+    const size_t dataSize = payloadBytes.size();
+    if (mPendingOut.size() + sizeof(dataSize) + dataSize > kMaxPendingOutBytes) {
+        // The payloads already pending are still written whole, so the reader stays in sync.
+        if (mNumDroppedWrites++ == 0) {
+            ALOGW("ShellSubscriberClient: reader too slow, dropping data");
+        }
         return;
     }
-    // Then, write the payload if this is not just a heartbeat.
-    if (dataSize > 0 && !mProtoOut.flush(mDupOut.get())) {
+    // First the payload size, then the payload if this is not just a heartbeat.
+    const uint8_t* dataSizeBytes = reinterpret_cast<const uint8_t*>(&dataSize);
+    mPendingOut.insert(mPendingOut.end(), dataSizeBytes, dataSizeBytes + sizeof(dataSize));
+    mPendingOut.insert(mPendingOut.end(), payloadBytes.begin(), payloadBytes.end());
+}
+
+// If the write fails because the read end of the pipe has closed, change the client status so the
+// manager knows the subscription is no longer active
+void ShellSubscriberClient::writePendingOut() {
+    size_t written = 0;
+    while (written < mPendingOut.size()) {
+        const ssize_t result = TEMP_FAILURE_RETRY(
+                write(mDupOut.get(), mPendingOut.data() + written, mPendingOut.size() - written));
+        if (result < 0) {
+            if (errno != EAGAIN) {
+                mClientAlive = false;
+            }
+            break;
+        }
+        written += result;
+    }
+    mPendingOut.erase(mPendingOut.begin(), mPendingOut.begin() + written);
+}
+
+void ShellSubscriberClient::sendCallback(const Payload& payload) {
+    // Invoke Binder callback with cached event data.
+    StatsdStats::getInstance().noteSubscriptionFlushed(mId);
+    const Status status = mCallback->onSubscriptionData(payload.reason, payload.bytes);
+    if (status.getStatus() == STATUS_DEAD_OBJECT &&
+        status.getExceptionCode() == EX_TRANSACTION_FAILED) {
         mClientAlive = false;
-        return;
     }
-    mLastWriteMs = getElapsedRealtimeMillis();
 }
 
 void ShellSubscriberClient::getUidsForPullAtom(vector<int32_t>* uids, const PullInfo& pullInfo) {
@@ -338,37 +573,64 @@ void ShellSubscriberClient::getUidsForPullAtom(vector<int32_t>* uids, const Pull
 void ShellSubscriberClient::clearCache() {
     mProtoOut.clear();
     mCacheSize = 0;
+    mCompactEvents = CompactEvents();
 }
 
-void ShellSubscriberClient::triggerFdFlush() {
-    attemptWriteToPipeLocked();
+void ShellSubscriberClient::queuePayload(StatsSubscriptionCallbackReason reason) {
+    Payload payload{.reason = reason};
+    if (mCompactEncoding) {
+        writeCompactEventsToProto();
+    }
+    mProtoOut.serializeToVector(&payload.bytes);
+    {
+        std::lock_guard<std::mutex> lock(mPayloadQueueMutex);
+        if (mQueuedPayloadBytes + payload.bytes.size() > kMaxQueuedPayloadBytes) {
+            if (mNumDroppedWrites++ == 0) {
+                ALOGW("ShellSubscriberClient: delivery too slow, dropping data");
+            }
+        } else {
+            mQueuedPayloadBytes += payload.bytes.size();
+            mPayloadQueue.push_back(std::move(payload));
+        }
+    }
+    mLastWriteMs = getElapsedRealtimeMillis();
     clearCache();
 }
 
-void ShellSubscriberClient::triggerCallback(StatsSubscriptionCallbackReason reason) {
-    // Invoke Binder callback with cached event data.
-    vector<uint8_t> payloadBytes;
-    mProtoOut.serializeToVector(&payloadBytes);
-    StatsdStats::getInstance().noteSubscriptionFlushed(mId);
-    const Status status = mCallback->onSubscriptionData(reason, payloadBytes);
-    if (status.getStatus() == STATUS_DEAD_OBJECT &&
-        status.getExceptionCode() == EX_TRANSACTION_FAILED) {
-        mClientAlive = false;
-        return;
+bool ShellSubscriberClient::deliverPayloads() {
+    std::lock_guard<std::mutex> deliveryLock(mDeliveryMutex);
+    std::deque<Payload> payloads;
+    {
+        std::lock_guard<std::mutex> lock(mPayloadQueueMutex);
+        payloads.swap(mPayloadQueue);
+        mQueuedPayloadBytes = 0;
     }
-
-    mLastWriteMs = getElapsedRealtimeMillis();
-    clearCache();
+    for (const Payload& payload : payloads) {
+        if (!mClientAlive) {
+            return false;
+        }
+        if (mCallback != nullptr) {
+            sendCallback(payload);
+        } else {
+            appendToPendingOut(payload.bytes);
+        }
+    }
+    if (mCallback != nullptr || !mClientAlive) {
+        return false;
+    }
+    writePendingOut();
+    return mClientAlive && !mPendingOut.empty();
 }
 
 void ShellSubscriberClient::flush() {
-    triggerCallback(StatsSubscriptionCallbackReason::FLUSH_REQUESTED);
+    queuePayload(StatsSubscriptionCallbackReason::FLUSH_REQUESTED);
 }
 
 void ShellSubscriberClient::onUnsubscribe() {
     StatsdStats::getInstance().noteSubscriptionEnded(mId);
     if (mClientAlive) {
-        triggerCallback(StatsSubscriptionCallbackReason::SUBSCRIPTION_ENDED);
+        queuePayload(StatsSubscriptionCallbackReason::SUBSCRIPTION_ENDED);
+        deliverPayloads();
     }
 }
 
@@ -378,6 +640,15 @@ void ShellSubscriberClient::addAllAtomIds(LogEventFilter::AtomIdSet& allAtomIds)
     }
 }
 
+vector<int32_t> ShellSubscriberClient::getPushedAtomIds() const {
+    vector<int32_t> atomIds;
+    atomIds.reserve(mPushedMatcherIndices.size());
+    for (const auto& [atomId, _] : mPushedMatcherIndices) {
+        atomIds.push_back(atomId);
+    }
+    return atomIds;
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -20,9 +20,17 @@
 #include <aidl/android/os/StatsSubscriptionCallbackReason.h>
 #include <android-base/file.h>
 #include <android/util/ProtoOutputStream.h>
+#include <gtest/gtest_prod.h>
 #include <private/android_filesystem_config.h>
 
+#include <atomic>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "external/StatsPullerManager.h"
 #include "logd/LogEvent.h"
@@ -38,19 +46,64 @@ namespace android {
 namespace os {
 namespace statsd {
 
-// ShellSubscriberClient is not thread-safe. All calls must be
-// guarded by the mutex in ShellSubscriber.h
+// Wraps a LogEvent delivered to several ShellSubscriberClients so that the Atom proto encoding
+// of the event is computed at most once and then shared by all clients writing it unchanged.
+// Not thread-safe; only used while holding ShellSubscriber::mMutex.
+class EncodedLogEvent {
+public:
+    explicit EncodedLogEvent(const LogEvent& event) : mEvent(event) {
+    }
+
+    const LogEvent& getEvent() const {
+        return mEvent;
+    }
+
+    // Returns the serialized Atom message for the event, encoding it on first use.
+    const std::vector<uint8_t>& getAtomBytes() const;
+
+private:
+    const LogEvent& mEvent;
+
+    mutable bool mEncoded = false;
+
+    mutable std::vector<uint8_t> mAtomBytes;
+};
+
+// Pulled atoms shared by the ShellSubscriberClients pulling the same atom for the same uids during
+// one wakeup of the ShellSubscriber thread, so the atom is pulled and parsed once for all of them.
+// Not thread-safe; only used while holding ShellSubscriber::mMutex.
+class SharedPulls {
+public:
+    // Returns the atoms pulled for the uids, pulling them on the first call for the atom and uids.
+    const std::vector<std::shared_ptr<LogEvent>>& pull(const sp<StatsPullerManager>& pullerMgr,
+                                                       int32_t atomId,
+                                                       const std::vector<int32_t>& uids,
+                                                       int64_t nowNanos);
+
+private:
+    std::map<std::pair<int32_t, std::vector<int32_t>>, std::vector<std::shared_ptr<LogEvent>>>
+            mPulledData;
+};
+
+// ShellSubscriberClient is not thread-safe. All calls must be guarded by the mutex in
+// ShellSubscriber.h, except for deliverPayloads() and isAlive(). The log events and the pulled
+// atoms are only serialized into payloads under that mutex, deliverPayloads() writes them to the
+// pipe or sends them to the callback without it, so a slow subscriber never holds up the log
+// events.
 class ShellSubscriberClient {
 public:
     struct PullInfo {
         PullInfo(const SimpleAtomMatcher& matcher, int64_t startTimeMs, int64_t interval,
-                 const std::vector<std::string>& packages, const std::vector<int32_t>& uids);
+                 const std::vector<std::string>& packages, const std::vector<int32_t>& uids,
+                 const std::vector<Matcher>& fields);
 
         const SimpleAtomMatcher mPullerMatcher;
         const int64_t mIntervalMs;
         int64_t mPrevPullElapsedRealtimeMs;
         const std::vector<std::string> mPullPackages;
         const std::vector<int32_t> mPullUids;
+        // Fields of the pulled atoms to send, all of them if empty.
+        const std::vector<Matcher> mFields;
     };
 
     static std::unique_ptr<ShellSubscriberClient> create(int in, int out, int64_t timeoutSec,
@@ -67,20 +120,38 @@ public:
     explicit ShellSubscriberClient(int id, int out,
                                    const std::shared_ptr<IStatsSubscriptionCallback>& callback,
                                    const std::vector<SimpleAtomMatcher>& pushedMatchers,
-                                   const std::vector<PullInfo>& pulledInfo, int64_t timeoutSec,
-                                   int64_t startTimeSec, const sp<UidMap>& uidMap,
+                                   const std::vector<std::vector<Matcher>>& pushedFields,
+                                   const std::vector<PullInfo>& pulledInfo, bool compactEncoding,
+                                   int64_t timeoutSec, int64_t startTimeSec,
+                                   const sp<UidMap>& uidMap,
                                    const sp<StatsPullerManager>& pullerMgr);
 
-    void onLogEvent(const LogEvent& event);
+    ~ShellSubscriberClient();
+
+    // Returns true if a payload was queued for deliverPayloads().
+    bool onLogEvent(const LogEvent& event);
 
-    int64_t pullAndSendHeartbeatsIfNeeded(int64_t nowSecs, int64_t nowMillis, int64_t nowNanos);
+    // Same as above, reusing the Atom encoding shared with the other clients.
+    bool onLogEvent(const EncodedLogEvent& event);
 
-    // Should only be called when mCallback is not nullptr.
+    // The pulls are shared with the other clients through sharedPulls, when set.
+    int64_t pullAndSendHeartbeatsIfNeeded(int64_t nowSecs, int64_t nowMillis, int64_t nowNanos,
+                                          SharedPulls* sharedPulls = nullptr);
+
+    // Queues the cached data for deliverPayloads(). Should only be called when mCallback is not
+    // nullptr.
     void flush();
 
-    // Should only be called when mCallback is not nullptr.
+    // Delivers the queued payloads and the end of the subscription. Should only be called when
+    // mCallback is not nullptr, once the client was removed from ShellSubscriber. The mutex in
+    // ShellSubscriber.h need not be held then.
     void onUnsubscribe();
 
+    // Writes the queued payloads to the pipe, or sends them to the callback, in order. Returns true
+    // if bytes are left that the pipe didn't accept, deliverPayloads() should then be called again
+    // within kMsBetweenFdWrites.
+    bool deliverPayloads();
+
     bool isAlive() const {
         return mClientAlive;
     }
@@ -96,31 +167,62 @@ public:
 
     void addAllAtomIds(LogEventFilter::AtomIdSet& allAtomIds) const;
 
+    // Returns the ids of the pushed atoms the client subscribed to, without duplicates.
+    std::vector<int32_t> getPushedAtomIds() const;
+
     // Minimum pull interval for callback subscriptions.
     static constexpr int64_t kMinCallbackPullIntervalMs = 60'000;  // 60 seconds.
 
     // Minimum sleep for the pull thread for callback subscriptions.
     static constexpr int64_t kMinCallbackSleepIntervalMs = 2000;  // 2 seconds.
+
+    // The events of an fd subscription are written together when they come within
+    // kMsBetweenFdWrites of the previous write, unless they exceed kMaxFdCacheSizeBytes.
+    static constexpr int64_t kMsBetweenFdWrites = 100;
 private:
-    int64_t pullIfNeeded(int64_t nowSecs, int64_t nowMillis, int64_t nowNanos);
+    // Data serialized by the threads holding the mutex in ShellSubscriber.h for deliverPayloads().
+    struct Payload {
+        StatsSubscriptionCallbackReason reason;
+        std::vector<uint8_t> bytes;
+    };
+
+    int64_t pullIfNeeded(int64_t nowSecs, int64_t nowMillis, int64_t nowNanos,
+                         SharedPulls* sharedPulls);
 
     void writePulledAtomsLocked(const vector<std::shared_ptr<LogEvent>>& data,
-                                const SimpleAtomMatcher& matcher);
+                                const PullInfo& pullInfo);
+
+    // Appends the payload and its size to mPendingOut, unless the reader lags too far behind.
+    void appendToPendingOut(const std::vector<uint8_t>& payloadBytes);
+
+    // Writes as much of mPendingOut as the pipe accepts without blocking.
+    void writePendingOut();
 
-    void attemptWriteToPipeLocked();
+    void sendCallback(const Payload& payload);
 
     void getUidsForPullAtom(vector<int32_t>* uids, const PullInfo& pullInfo);
 
-    void flushProtoIfNeeded();
+    bool flushProtoIfNeeded();
 
+    bool onLogEventInternal(const LogEvent& event, const EncodedLogEvent* encodedEvent);
+
+    // Only the fields are written, or the whole atom if fields is empty. encodedEvent, when set,
+    // provides the shared Atom encoding of event.
     bool writeEventToProtoIfMatched(const LogEvent& event, const SimpleAtomMatcher& matcher,
-                                    const sp<UidMap>& uidMap);
+                                    const std::vector<Matcher>& fields, const sp<UidMap>& uidMap,
+                                    const EncodedLogEvent* encodedEvent = nullptr);
 
-    void clearCache();
+    // Caches the event for a subscription with compact encoding.
+    void writeCompactEvent(int32_t atomId, int64_t timestampNs,
+                           const std::vector<FieldValue>& values);
 
-    void triggerFdFlush();
+    // Writes the rest of the CompactShellData of the cached events to mProtoOut.
+    void writeCompactEventsToProto();
 
-    void triggerCallback(StatsSubscriptionCallbackReason reason);
+    void clearCache();
+
+    // Moves the cached data to mPayloadQueue. The reason is ignored for fd subscriptions.
+    void queuePayload(StatsSubscriptionCallbackReason reason);
 
     const int32_t DEFAULT_PULL_UID = AID_SYSTEM;
 
@@ -135,18 +237,59 @@ private:
 
     const std::vector<SimpleAtomMatcher> mPushedMatchers;
 
+    // Fields to send of the atoms matched by mPushedMatchers at the same index, all of them if
+    // empty.
+    const std::vector<std::vector<Matcher>> mPushedFields;
+
+    // Indices in mPushedMatchers of the matchers of each atom id, in order.
+    const std::unordered_map<int32_t, std::vector<size_t>> mPushedMatcherIndices;
+
     std::vector<PullInfo> mPulledInfo;
 
     std::shared_ptr<IStatsSubscriptionCallback> mCallback;
 
+    // Whether the output is CompactShellData.
+    const bool mCompactEncoding;
+
+    // The events cached for a subscription with compact encoding, as packed repeated fields of
+    // CompactShellData. Each payload has its own atom ids, so that it can still be decoded when
+    // payloads before it were dropped.
+    struct CompactEvents {
+        std::unordered_map<int32_t, uint32_t> atomIdIndices;
+        std::vector<uint8_t> packedAtomIds;
+        std::vector<uint8_t> packedAtomIdIndices;
+        std::vector<uint8_t> packedTimestampDeltas;
+        int64_t lastTimestampNs = 0;
+    };
+
+    CompactEvents mCompactEvents;
+
     const int64_t mTimeoutSec;
 
     const int64_t mStartTimeSec;
 
-    bool mClientAlive = true;
+    // Cleared by the delivery when the subscriber has gone away.
+    std::atomic<bool> mClientAlive = true;
 
+    // When the cached data was last queued.
     int64_t mLastWriteMs;
 
+    // Protects mPayloadQueue and mQueuedPayloadBytes.
+    std::mutex mPayloadQueueMutex;
+
+    std::deque<Payload> mPayloadQueue;
+
+    size_t mQueuedPayloadBytes = 0;
+
+    // Serializes deliverPayloads() and protects mPendingOut.
+    std::mutex mDeliveryMutex;
+
+    // Bytes of the fd subscription, payload sizes and payloads, not accepted by the pipe yet.
+    std::vector<uint8_t> mPendingOut;
+
+    // Number of payloads dropped because mPayloadQueue or mPendingOut was full.
+    std::atomic<int64_t> mNumDroppedWrites = 0;
+
     // Stores Atom proto messages for events along with their respective timestamps.
     ProtoOutputStream mProtoOut;
 
@@ -161,7 +304,18 @@ private:
 
     static constexpr size_t kMaxCacheSizeBytes = 2 * 1024;  // 2 KB
 
+    static constexpr size_t kMaxFdCacheSizeBytes = 16 * 1024;  // 16 KB
+
+    // What the reader of an fd subscription may lag behind the pipe buffer before payloads are
+    // dropped.
+    static constexpr size_t kMaxPendingOutBytes = 256 * 1024;  // 256 KB
+
+    // What the delivery may lag behind the log events before payloads are dropped.
+    static constexpr size_t kMaxQueuedPayloadBytes = 256 * 1024;  // 256 KB
+
     static constexpr int64_t kMsBetweenCallbacks = 70'000;  // 70 seconds.
+
+    FRIEND_TEST(ShellSubscriberTest, testSlowReaderDoesNotBlock);
 };
 
 }  // namespace statsd
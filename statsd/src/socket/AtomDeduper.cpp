@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "AtomDeduper.h"
+
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+#include <algorithm>
+
+#include "guardrail/StatsdStats.h"
+#include "hash.h"
+#include "stats_log_util.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using android::base::ParseInt;
+using android::base::Split;
+using std::optional;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+// Size of OBJECT_TYPE | NUM_FIELDS | TIMESTAMP at the start of the atom buffer, each preceded by
+// its type byte except NUM_FIELDS. The atom id, the annotations and the fields follow.
+// (*MUST BE IN SYNC WITH LogEvent::parseHeader()*)
+constexpr uint32_t kTimestampEnd = 3 * sizeof(uint8_t) + sizeof(int64_t);
+
+}  // namespace
+
+AtomDeduper::AtomDeduper(Windows windowsNs) : mWindowsNs(std::move(windowsNs)) {
+}
+
+bool AtomDeduper::dedupe(unique_ptr<LogEvent>& event, const uint8_t* msg, uint32_t len,
+                         vector<unique_ptr<LogEvent>>* released) {
+    const int32_t atomId = event->GetTagId();
+    const auto windowIt = mWindowsNs.find(atomId);
+    if (windowIt == mWindowsNs.end() || !event->isValid() || event->isParsedHeaderOnly() ||
+        len <= kTimestampEnd) {
+        return false;
+    }
+
+    const uint64_t hash = Hash64(reinterpret_cast<const char*>(msg) + kTimestampEnd,
+                                 len - kTimestampEnd);
+    const int64_t timestampNs = event->GetElapsedTimestampNs();
+    const uint64_t key = ((uint64_t)(uint32_t)atomId << 32) | (uint32_t)event->GetUid();
+
+    auto it = mEntries.find(key);
+    if (it == mEntries.end()) {
+        if (mEntries.size() < kMaxTrackedAtoms) {
+            Entry& entry = mEntries[key];
+            entry.hash = hash;
+            entry.windowEndNs = timestampNs + windowIt->second;
+            mNextWindowEndNs = std::min(mNextWindowEndNs, entry.windowEndNs);
+        }
+        return false;
+    }
+
+    Entry& entry = it->second;
+    if (entry.hash == hash && timestampNs < entry.windowEndNs) {
+        if (entry.held == nullptr) {
+            entry.held = std::move(event);
+        } else {
+            entry.held->addRepeat();
+        }
+        return true;
+    }
+
+    // the atom changed or the window is closed, the held repeats go first to keep the order
+    release(entry, released);
+    entry.hash = hash;
+    entry.windowEndNs = timestampNs + windowIt->second;
+    mNextWindowEndNs = std::min(mNextWindowEndNs, entry.windowEndNs);
+    return false;
+}
+
+void AtomDeduper::releaseExpired(int64_t nowNs, vector<unique_ptr<LogEvent>>* released) {
+    if (nowNs < mNextWindowEndNs) {
+        return;
+    }
+    mNextWindowEndNs = INT64_MAX;
+    for (auto it = mEntries.begin(); it != mEntries.end();) {
+        Entry& entry = it->second;
+        if (entry.windowEndNs > nowNs) {
+            mNextWindowEndNs = std::min(mNextWindowEndNs, entry.windowEndNs);
+            ++it;
+            continue;
+        }
+        release(entry, released);
+        it = mEntries.erase(it);
+    }
+}
+
+void AtomDeduper::release(Entry& entry, vector<unique_ptr<LogEvent>>* released) {
+    if (entry.held == nullptr) {
+        return;
+    }
+    // the held event itself is submitted, only the other repeats are suppressed
+    StatsdStats::getInstance().noteAtomDeduped(entry.held->GetTagId(),
+                                               entry.held->getRepeatCount() - 1);
+    released->push_back(std::move(entry.held));
+}
+
+optional<AtomDeduper::Windows> parseDedupeWindows(const string& value) {
+    AtomDeduper::Windows windowsNs;
+    for (const string& entry : Split(value, ";")) {
+        if (entry.empty()) {
+            continue;
+        }
+        const vector<string> parts = Split(entry, "=");
+        int32_t atomId;
+        int64_t windowMs;
+        // windows are meant to collapse bursts, longer ones would hold the events for too long
+        if (parts.size() != 2 || !ParseInt(parts[0], &atomId, 2) ||
+            !ParseInt(parts[1], &windowMs, (int64_t)1, (int64_t)60 * 1000)) {
+            return std::nullopt;
+        }
+        windowsNs[atomId] = MillisToNano(windowMs);
+    }
+    return windowsNs;
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
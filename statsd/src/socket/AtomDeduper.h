@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <gtest/gtest_prod.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "logd/LogEvent.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Collapses the identical atoms logged in a row by a uid, for the atoms with a dedupe window set
+ * through STATSD_SOCKET_DEDUPE_WINDOWS_FLAG.
+ *
+ * The first atom passes through and opens the window. The identical atoms logged within the
+ * window are held back as a single event whose LogEvent::getRepeatCount() counts them. The held
+ * event is released when the uid logs a different atom of the same id, or by releaseExpired()
+ * once the window is closed, which the owner schedules at getNextWindowEndNs(). Atoms are
+ * compared on the bytes following their timestamp.
+ *
+ * Not thread safe, each StatsSocketListener owns its deduper and guards it.
+ */
+class AtomDeduper {
+public:
+    // Atom id to the dedupe window of the atom.
+    using Windows = std::unordered_map<int32_t, int64_t>;
+
+    // Max number of atom id & uid pairs tracked, the atoms of further pairs are not deduped.
+    static constexpr size_t kMaxTrackedAtoms = 1000;
+
+    explicit AtomDeduper(Windows windowsNs);
+
+    /**
+     * @brief Dedupes an event parsed from a socket message
+     *
+     * @param event event parsed from msg. Moved into the deduper if it is the first repeat of the
+     * window, otherwise left to the caller to be recycled when it is a repeat
+     * @param msg atom buffer the event was parsed from
+     * @param len size of the atom buffer in bytes
+     * @param released output, held events to be submitted before the event
+     * @return true if the event repeats the last atom of the uid within the window and should not
+     * be submitted
+     */
+    bool dedupe(std::unique_ptr<LogEvent>& event, const uint8_t* msg, uint32_t len,
+                std::vector<std::unique_ptr<LogEvent>>* released);
+
+    // Releases the held events whose window is closed at nowNs, and stops tracking the atoms
+    // which did not repeat.
+    void releaseExpired(int64_t nowNs, std::vector<std::unique_ptr<LogEvent>>* released);
+
+    // Earliest time at which releaseExpired() has something to do, INT64_MAX if nothing is
+    // tracked.
+    int64_t getNextWindowEndNs() const {
+        return mNextWindowEndNs;
+    }
+
+private:
+    struct Entry {
+        uint64_t hash = 0;
+        int64_t windowEndNs = 0;
+        std::unique_ptr<LogEvent> held;
+    };
+
+    // Notes the repeats of the held event in StatsdStats and moves it to released.
+    static void release(Entry& entry, std::vector<std::unique_ptr<LogEvent>>* released);
+
+    const Windows mWindowsNs;
+
+    // Keyed by atom id in the upper 32 bits and uid in the lower ones.
+    std::unordered_map<uint64_t, Entry> mEntries;
+
+    // Earliest window end of mEntries, releaseExpired() is a no-op until then.
+    int64_t mNextWindowEndNs = INT64_MAX;
+
+    FRIEND_TEST(AtomDeduperTest, TestTrackedAtomsLimit);
+};
+
+/**
+ * Parses the dedupe windows from entries separated by ';' of the form
+ *   <atom id>=<window in milliseconds>
+ * Returns nullopt if the value is malformed.
+ */
+std::optional<AtomDeduper::Windows> parseDedupeWindows(const std::string& value);
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
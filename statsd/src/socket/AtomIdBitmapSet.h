@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <initializer_list>
+#include <vector>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Set of atom ids optimized for lookups of pushed atoms
+ *
+ * Platform pushed atom ids are dense and below kMaxDenseAtomId, so the lookup for them is a
+ * single bit test. Ids outside of the dense range (pulled, vendor & non-platform atoms) are
+ * looked up with a binary search in the sorted list of all ids, which is also used for iteration.
+ * Insertions are expected to be rare compared to lookups.
+ */
+class AtomIdBitmapSet {
+public:
+    typedef int value_type;
+    typedef std::vector<int>::const_iterator const_iterator;
+    typedef const_iterator iterator;
+
+    // Pulled atom ids start at 10000
+    static constexpr int kMaxDenseAtomId = 9999;
+
+    AtomIdBitmapSet() = default;
+
+    AtomIdBitmapSet(std::initializer_list<int> atomIds) {
+        insert(atomIds.begin(), atomIds.end());
+    }
+
+    void insert(int atomId) {
+        const auto it = std::lower_bound(mAtomIds.begin(), mAtomIds.end(), atomId);
+        if (it != mAtomIds.end() && *it == atomId) {
+            return;
+        }
+        mAtomIds.insert(it, atomId);
+        if (isDense(atomId)) {
+            mDenseAtomIds.set(atomId);
+        }
+    }
+
+    template <class InputIt>
+    void insert(InputIt first, InputIt last) {
+        const size_t prevSize = mAtomIds.size();
+        mAtomIds.insert(mAtomIds.end(), first, last);
+        if (mAtomIds.size() == prevSize) {
+            return;
+        }
+        for (auto it = mAtomIds.begin() + prevSize; it != mAtomIds.end(); ++it) {
+            if (isDense(*it)) {
+                mDenseAtomIds.set(*it);
+            }
+        }
+        std::sort(mAtomIds.begin(), mAtomIds.end());
+        mAtomIds.erase(std::unique(mAtomIds.begin(), mAtomIds.end()), mAtomIds.end());
+    }
+
+    void erase(int atomId) {
+        const auto it = std::lower_bound(mAtomIds.begin(), mAtomIds.end(), atomId);
+        if (it == mAtomIds.end() || *it != atomId) {
+            return;
+        }
+        mAtomIds.erase(it);
+        if (isDense(atomId)) {
+            mDenseAtomIds.reset(atomId);
+        }
+    }
+
+    inline size_t count(int atomId) const {
+        if (isDense(atomId)) {
+            return mDenseAtomIds.test(atomId) ? 1 : 0;
+        }
+        return std::binary_search(mAtomIds.begin(), mAtomIds.end(), atomId) ? 1 : 0;
+    }
+
+    inline size_t size() const {
+        return mAtomIds.size();
+    }
+
+    inline bool empty() const {
+        return mAtomIds.empty();
+    }
+
+    void clear() {
+        mAtomIds.clear();
+        mDenseAtomIds.reset();
+    }
+
+    void swap(AtomIdBitmapSet& other) {
+        mAtomIds.swap(other.mAtomIds);
+        std::swap(mDenseAtomIds, other.mDenseAtomIds);
+    }
+
+    inline const_iterator begin() const {
+        return mAtomIds.begin();
+    }
+
+    inline const_iterator end() const {
+        return mAtomIds.end();
+    }
+
+    inline bool operator==(const AtomIdBitmapSet& that) const {
+        return mAtomIds == that.mAtomIds;
+    }
+
+    inline bool operator!=(const AtomIdBitmapSet& that) const {
+        return !(*this == that);
+    }
+
+private:
+    static inline bool isDense(int atomId) {
+        return atomId >= 0 && atomId <= kMaxDenseAtomId;
+    }
+
+    // Sorted list of all atom ids in the set
+    std::vector<int> mAtomIds;
+
+    std::bitset<kMaxDenseAtomId + 1> mDenseAtomIds;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
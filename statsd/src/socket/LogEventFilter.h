@@ -19,10 +19,15 @@
 #include <gtest/gtest_prod.h>
 
 #include <atomic>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "logd/AtomFieldMask.h"
+#include "socket/AtomIdBitmapSet.h"
+
 namespace android {
 namespace os {
 namespace statsd {
@@ -37,6 +42,9 @@ namespace statsd {
  * #BM_LogEventFilterSet                                613362 ns     611259 ns         1146
  * #BM_LogEventFilterSet2Consumers                     1859397 ns    1854193 ns          378
  *
+ * AtomIdBitmapSet replaces the hash lookup with a bit test for the dense range of platform
+ * atom ids, see BM_LogEventFilterAtomIdBitmapSet
+ *
  * See @LogEventFilter definition below
  */
 template <typename T>
@@ -55,8 +63,8 @@ public:
     /**
      * @brief Tests atom id with list of interesting atoms
      *        If Logs filtering is disabled - assume all atoms in use
-     *        Most of the time should be non-blocking call - only in case when setAtomIds() was
-     *        called the call will be blocking due to atom list needs to be synced up
+     *        Never blocks - when setAtomIds() was called the latest published snapshot of atom
+     *        ids is picked up. Should be called from a single (socket listener) thread
      * @param atomId
      * @return true if atom is used by any of consumer or filtering is disabled
      */
@@ -65,13 +73,34 @@ public:
             return true;
         }
 
-        // check if there is an updated set of interesting atom ids
-        if (mLocalSetUpdateCounter != mSetUpdateCounter.load(std::memory_order_relaxed)) {
-            std::lock_guard<std::mutex> guard(mTagIdsMutex);
-            mLocalSetUpdateCounter = mSetUpdateCounter.load(std::memory_order_relaxed);
-            mLocalTagIds.swap(mTagIds);
+        return getLocalSnapshot().tagIds.count(atomId) != 0;
+    }
+
+    /**
+     * @brief Tests atom id with list of atoms to be queued with priority
+     *        Does not depend on logs filtering being enabled. Never blocks, should be called
+     *        from the same thread as isAtomInUse()
+     * @param atomId
+     * @return true if atom is marked as critical by any of consumer
+     */
+    bool isPriorityAtom(int atomId) const {
+        return getLocalSnapshot().priorityTagIds.count(atomId) != 0;
+    }
+
+    /**
+     * @brief Returns the fields of the atom used by the consumers
+     *        Should be called after isAtomInUse() on the same thread, the returned mask is valid
+     *        until the next isAtomInUse() call
+     * @param atomId
+     * @return nullptr if the atom should be decoded entirely or filtering is disabled
+     */
+    const AtomFieldMask* getAtomFieldMask(int atomId) const {
+        if (!mLogsFilteringEnabled) {
+            return nullptr;
         }
-        return mLocalTagIds.find(atomId) != mLocalTagIds.end();
+        const AtomFieldMaskMap& fieldMasks = mLocalSnapshot->fieldMasks;
+        const auto it = fieldMasks.find(atomId);
+        return it != fieldMasks.end() ? &it->second : nullptr;
     }
 
     typedef const void* ConsumerId;
@@ -91,23 +120,98 @@ public:
         } else {
             mTagIdsPerConsumer[consumer].swap(tagIds);
         }
-        // populate the superset incorporating list of distinct atom ids from all consumers
-        mTagIds.clear();
-        for (const auto& [_, atomIds] : mTagIdsPerConsumer) {
-            mTagIds.insert(atomIds.begin(), atomIds.end());
+        publishSnapshotLocked();
+    }
+
+    /**
+     * @brief Set the fields of atoms used by the consumer
+     *        Atoms from consumer atom ids without field mask are decoded entirely. The masks
+     *        take effect only for atoms set by setAtomIds() for the same consumer
+     *
+     * @param fieldMasks atom id to the fields used by the consumer
+     * @param consumer used to differentiate the consumers to form proper superset of fields
+     */
+    virtual void setAtomFieldMasks(AtomFieldMaskMap fieldMasks, ConsumerId consumer) {
+        std::lock_guard lock(mTagIdsMutex);
+        if (fieldMasks.empty()) {
+            mFieldMasksPerConsumer.erase(consumer);
+        } else {
+            mFieldMasksPerConsumer[consumer].swap(fieldMasks);
         }
-        mSetUpdateCounter.fetch_add(1, std::memory_order_relaxed);
+        publishSnapshotLocked();
+    }
+
+    /**
+     * @brief Set the atoms the consumer can't afford to lose on event queue overflow
+     *
+     * @param tagIds set of atoms ids
+     * @param consumer used to differentiate the consumers to form proper superset of ids
+     */
+    virtual void setPriorityAtomIds(AtomIdSet tagIds, ConsumerId consumer) {
+        std::lock_guard lock(mTagIdsMutex);
+        if (tagIds.size() == 0) {
+            mPriorityTagIdsPerConsumer.erase(consumer);
+        } else {
+            mPriorityTagIdsPerConsumer[consumer].swap(tagIds);
+        }
+        publishSnapshotLocked();
     }
 
 private:
+    // Immutable once published, so the reader never observes a partially updated filter
+    struct Snapshot {
+        AtomIdSet tagIds;
+        AtomFieldMaskMap fieldMasks;
+        AtomIdSet priorityTagIds;
+    };
+
+    const Snapshot& getLocalSnapshot() const {
+        // check if there is an updated snapshot of interesting atom ids
+        const int updateCounter = mSnapshotUpdateCounter.load(std::memory_order_acquire);
+        if (mLocalSnapshotUpdateCounter != updateCounter) {
+            mLocalSnapshotUpdateCounter = updateCounter;
+            mLocalSnapshot = std::atomic_load_explicit(&mSnapshot, std::memory_order_acquire);
+        }
+        return *mLocalSnapshot;
+    }
+
+    // Builds the superset of all consumers into a new snapshot and publishes it for the reader.
+    // The previous snapshot is released by whichever side drops the last reference to it.
+    void publishSnapshotLocked() {
+        static const AtomFieldMaskMap kNoFieldMasks;
+        auto snapshot = std::make_shared<Snapshot>();
+        // populate the superset incorporating list of distinct atom ids from all consumers
+        std::set<int> fullAtomIds;
+        for (const auto& [consumer, atomIds] : mTagIdsPerConsumer) {
+            snapshot->tagIds.insert(atomIds.begin(), atomIds.end());
+            // atom is partially decoded only if all consumers using the atom provided the mask
+            const auto it = mFieldMasksPerConsumer.find(consumer);
+            mergeAtomFieldMasks(atomIds,
+                                it != mFieldMasksPerConsumer.end() ? it->second : kNoFieldMasks,
+                                snapshot->fieldMasks, fullAtomIds);
+        }
+        for (const auto& [_, atomIds] : mPriorityTagIdsPerConsumer) {
+            snapshot->priorityTagIds.insert(atomIds.begin(), atomIds.end());
+        }
+        std::atomic_store_explicit(&mSnapshot, std::shared_ptr<const Snapshot>(std::move(snapshot)),
+                                   std::memory_order_release);
+        mSnapshotUpdateCounter.fetch_add(1, std::memory_order_release);
+    }
+
     std::atomic_bool mLogsFilteringEnabled = true;
-    std::atomic_int mSetUpdateCounter;
-    mutable int mLocalSetUpdateCounter;
 
     mutable std::mutex mTagIdsMutex;
     std::unordered_map<ConsumerId, AtomIdSet> mTagIdsPerConsumer;
-    mutable AtomIdSet mTagIds;
-    mutable AtomIdSet mLocalTagIds;
+    std::unordered_map<ConsumerId, AtomFieldMaskMap> mFieldMasksPerConsumer;
+    std::unordered_map<ConsumerId, AtomIdSet> mPriorityTagIdsPerConsumer;
+
+    // Latest published snapshot, accessed only with std::atomic_load/std::atomic_store
+    std::shared_ptr<const Snapshot> mSnapshot = std::make_shared<const Snapshot>();
+    std::atomic_int mSnapshotUpdateCounter = 0;
+
+    // Snapshot used by the reader thread
+    mutable std::shared_ptr<const Snapshot> mLocalSnapshot = mSnapshot;
+    mutable int mLocalSnapshotUpdateCounter = 0;
 
     friend class LogEventFilterTest;
 
@@ -121,9 +225,13 @@ private:
     FRIEND_TEST(LogEventFilterTest, TestMultipleConsumerOverlapIds);
     FRIEND_TEST(LogEventFilterTest, TestMultipleConsumerOverlapIdsRemoved);
     FRIEND_TEST(LogEventFilterTest, TestMultipleConsumerEmptyFilter);
+    FRIEND_TEST(LogEventFilterTest, TestFieldMasks);
+    FRIEND_TEST(LogEventFilterTest, TestMultipleConsumerFieldMasks);
+    FRIEND_TEST(LogEventFilterTest, TestConcurrentUpdatesPublishWholeSnapshot);
+    FRIEND_TEST(LogEventFilterTest, TestPriorityAtomIds);
 };
 
-typedef LogEventFilterGeneric<std::unordered_set<int>> LogEventFilter;
+typedef LogEventFilterGeneric<AtomIdBitmapSet> LogEventFilter;
 
 }  // namespace statsd
 }  // namespace os
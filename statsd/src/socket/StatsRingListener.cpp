@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "StatsRingListener.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "StatsSocketListener.h"
+#include "utils/ThreadScheduling.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using android::base::unique_fd;
+
+struct StatsRingListener::Ring {
+    unique_fd memFd;
+    unique_fd eventFd;
+    uint32_t uid = 0;
+    uint32_t pid = 0;
+    RingHeader* header = nullptr;
+    const uint8_t* data = nullptr;
+    uint32_t capacity = 0;
+    size_t mappedSize = 0;
+    // consumer position, the shared readPos is only written from it
+    uint32_t readPos = 0;
+
+    ~Ring() {
+        if (header != nullptr) {
+            munmap(header, mappedSize);
+        }
+    }
+};
+
+StatsRingListener::StatsRingListener(const std::shared_ptr<LogEventQueue>& queue,
+                                     const std::shared_ptr<LogEventFilter>& logEventFilter)
+    : mQueue(queue),
+      mLogEventFilter(logEventFilter),
+      mControlFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+    if (mControlFd < 0) {
+        ALOGE("Failed to create eventfd for StatsRingListener: %d", errno);
+    }
+}
+
+StatsRingListener::~StatsRingListener() {
+    stopListener();
+}
+
+bool StatsRingListener::registerRing(unique_fd memFd, unique_fd eventFd, uint32_t uid,
+                                     uint32_t pid) {
+    // the ring stays mapped, so the producer must not be able to shrink it under us. The producer
+    // keeps writing to it, the records are copied out before they are parsed, see drainRing()
+    const int seals = fcntl(memFd.get(), F_GET_SEALS);
+    struct stat fileStat;
+    if (seals < 0 || (seals & F_SEAL_SHRINK) == 0 || fstat(memFd.get(), &fileStat) != 0 ||
+        fileStat.st_size <= (off_t)sizeof(RingHeader) ||
+        fileStat.st_size > (off_t)(sizeof(RingHeader) + kMaxRingCapacity)) {
+        ALOGW("Rejected ring registration from uid %d: invalid memfd", uid);
+        return false;
+    }
+    // eventfd_read() fails on any other kind of fd
+    struct stat eventFdStat;
+    if (fstat(eventFd.get(), &eventFdStat) != 0) {
+        return false;
+    }
+
+    auto ring = std::make_unique<Ring>();
+    ring->mappedSize = fileStat.st_size;
+    void* mapped = mmap(nullptr, ring->mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        memFd.get(), 0);
+    if (mapped == MAP_FAILED) {
+        ALOGW("Failed to map ring from uid %d: %d", uid, errno);
+        return false;
+    }
+    ring->header = (RingHeader*)mapped;
+    ring->data = (const uint8_t*)mapped + sizeof(RingHeader);
+    ring->capacity = ring->header->capacity;
+    if (ring->header->magic != kRingMagic || ring->capacity % sizeof(uint32_t) != 0 ||
+        ring->capacity != ring->mappedSize - sizeof(RingHeader)) {
+        ALOGW("Rejected ring registration from uid %d: invalid header", uid);
+        return false;
+    }
+    ring->memFd = std::move(memFd);
+    ring->eventFd = std::move(eventFd);
+    ring->uid = uid;
+    ring->pid = pid;
+    ring->readPos = ring->header->readPos.load(std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPendingRings.push_back(std::move(ring));
+    }
+    const uint64_t one = 1;
+    if (TEMP_FAILURE_RETRY(write(mControlFd.get(), &one, sizeof(one))) < 0) {
+        ALOGE("Failed to signal StatsRingListener eventfd: %d", errno);
+    }
+    VLOG("Registered ring from uid %d pid %d", uid, pid);
+    return true;
+}
+
+void StatsRingListener::startListener() {
+    if (!mThread.joinable()) {
+        mStopped = false;
+        mThread = std::thread(&StatsRingListener::threadLoop, this);
+    }
+}
+
+void StatsRingListener::stopListener() {
+    if (mThread.joinable()) {
+        mStopped = true;
+        const uint64_t one = 1;
+        TEMP_FAILURE_RETRY(write(mControlFd.get(), &one, sizeof(one)));
+        mThread.join();
+    }
+}
+
+size_t StatsRingListener::getRingsCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mRingsCount;
+}
+
+void StatsRingListener::adoptPendingRings() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto& pending : mPendingRings) {
+        // a process registers a new ring when it considers the previous one stale
+        mRings.erase(std::remove_if(mRings.begin(), mRings.end(),
+                                    [&pending](const std::unique_ptr<Ring>& ring) {
+                                        return ring->pid == pending->pid;
+                                    }),
+                     mRings.end());
+        if (mRings.size() >= kMaxRingsCount) {
+            mRings.erase(mRings.begin());
+        }
+        mRings.push_back(std::move(pending));
+    }
+    mPendingRings.clear();
+    mRingsCount = mRings.size();
+}
+
+bool StatsRingListener::drainRing(Ring& ring, bool* drained) {
+    std::vector<StatsSocketListener::Message> messages;
+    messages.reserve(kMaxBatchSize);
+    const uint32_t writePos = ring.header->writePos.load(std::memory_order_acquire);
+    if (writePos - ring.readPos > ring.capacity) {
+        return false;
+    }
+
+    if (mRecordsCopy == nullptr) {
+        mRecordsCopy = std::make_unique<uint8_t[]>(kMaxBatchSize * LOGGER_ENTRY_MAX_PAYLOAD);
+    }
+    size_t copyOffset = 0;
+
+    // records are only released to the producer once the events are parsed
+    const uint32_t startPos = ring.readPos;
+    uint32_t readPos = startPos;
+    while (readPos != writePos) {
+        const uint32_t offset = readPos % ring.capacity;
+        const uint32_t available = writePos - readPos;
+        uint32_t size;
+        if (available < sizeof(size)) {
+            return false;
+        }
+        memcpy(&size, ring.data + offset, sizeof(size));
+        if (size == kWrapMarker) {
+            if (available < ring.capacity - offset) {
+                return false;
+            }
+            readPos += ring.capacity - offset;
+            continue;
+        }
+        const uint32_t recordSize = (sizeof(uint32_t) + size + 3) & ~3u;
+        if (size == 0 || size > LOGGER_ENTRY_MAX_PAYLOAD || recordSize > available ||
+            recordSize > ring.capacity - offset) {
+            return false;
+        }
+
+        // The producer can still write to the ring, a record parsed in place could change between
+        // the checks of the parsing and its reads. The size was read once and checked above.
+        uint8_t* record = mRecordsCopy.get() + copyOffset;
+        memcpy(record, ring.data + offset + sizeof(uint32_t), size);
+        copyOffset += size;
+
+        StatsSocketListener::Message message;
+        message.msg = record;
+        message.len = size;
+        message.uid = ring.uid;
+        message.pid = ring.pid;
+        messages.push_back(message);
+        readPos += recordSize;
+
+        if (messages.size() == kMaxBatchSize || readPos == writePos) {
+            StatsSocketListener::processMessageBatch(messages.data(), messages.size(), mQueue,
+                                                     mLogEventFilter);
+            messages.clear();
+            copyOffset = 0;
+            ring.readPos = readPos;
+            ring.header->readPos.store(readPos, std::memory_order_release);
+        }
+    }
+    // a trailing wrap marker
+    if (ring.readPos != readPos) {
+        ring.readPos = readPos;
+        ring.header->readPos.store(readPos, std::memory_order_release);
+    }
+    *drained = readPos != startPos;
+    return true;
+}
+
+bool StatsRingListener::prepareToWait() {
+    // pairs with the producer which publishes writePos before it checks consumerWaiting
+    for (const auto& ring : mRings) {
+        ring->header->consumerWaiting.store(1, std::memory_order_seq_cst);
+    }
+    for (const auto& ring : mRings) {
+        if (ring->header->writePos.load(std::memory_order_seq_cst) != ring->readPos) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StatsRingListener::waitForData() {
+    std::vector<struct pollfd> fds;
+    fds.reserve(mRings.size() + 1);
+    fds.push_back({mControlFd.get(), POLLIN, 0});
+    for (const auto& ring : mRings) {
+        fds.push_back({ring->eventFd.get(), POLLIN, 0});
+    }
+    if (TEMP_FAILURE_RETRY(poll(fds.data(), fds.size(), -1)) < 0) {
+        ALOGE("StatsRingListener poll failed: %d", errno);
+        return;
+    }
+    for (const struct pollfd& fd : fds) {
+        if (fd.revents & POLLIN) {
+            uint64_t counter;
+            TEMP_FAILURE_RETRY(read(fd.fd, &counter, sizeof(counter)));
+        }
+    }
+}
+
+void StatsRingListener::threadLoop() {
+    prctl(PR_SET_NAME, "statsd.ring");
+    applyThreadScheduling(StatsdThread::kRingListener);
+    while (!mStopped) {
+        adoptPendingRings();
+
+        bool anyDrained = false;
+        for (auto it = mRings.begin(); it != mRings.end();) {
+            bool drained = false;
+            if (!drainRing(**it, &drained)) {
+                ALOGW("Dropping malformed ring from uid %d pid %d", (*it)->uid, (*it)->pid);
+                it = mRings.erase(it);
+                std::lock_guard<std::mutex> lock(mMutex);
+                mRingsCount = mRings.size();
+                continue;
+            }
+            anyDrained |= drained;
+            ++it;
+        }
+        if (anyDrained || !prepareToWait()) {
+            continue;
+        }
+        waitForData();
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+#include <gtest/gtest_prod.h>
+#include <utils/RefBase.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "LogEventFilter.h"
+#include "logd/LogEventQueue.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Consumer side of the shared memory ring transport of libstatssocket StatsRingWriter.
+ *
+ * Rings are registered through the statsdw socket (see StatsSocketListener) along with an
+ * eventfd. The sender credentials are checked once at registration and used for all the atoms
+ * of the ring. A single thread drains all rings into the LogEventQueue, and sleeps on the
+ * eventfds once the rings are empty.
+ */
+class StatsRingListener : public virtual RefBase {
+public:
+    /**
+     * Header at the start of the shared memory ring, followed by the data area.
+     * (*LAYOUT MUST BE IN SYNC WITH libstatssocket StatsRingWriter*)
+     */
+    struct RingHeader {
+        uint32_t magic;
+        uint32_t capacity;
+        alignas(64) std::atomic_uint32_t writePos;
+        alignas(64) std::atomic_uint32_t readPos;
+        std::atomic_uint32_t consumerWaiting;
+    };
+
+    static constexpr uint32_t kRingMagic = 0x53524e47;  // "SRNG"
+    static constexpr uint32_t kWrapMarker = 0xffffffff;
+    static constexpr uint32_t kMaxRingCapacity = 1024 * 1024;
+    // One ring per process is expected, the oldest ring is dropped above this
+    static constexpr size_t kMaxRingsCount = 4;
+    // Max number of atoms submitted to the queue in a single batch
+    static constexpr size_t kMaxBatchSize = 32;
+
+    StatsRingListener(const std::shared_ptr<LogEventQueue>& queue,
+                      const std::shared_ptr<LogEventFilter>& logEventFilter);
+
+    virtual ~StatsRingListener();
+
+    /**
+     * @brief Validates and maps a ring. Safe to call from any thread
+     *
+     * @param memFd sealed memfd holding the ring, ownership is taken in all cases
+     * @param eventFd eventfd signaled by the producer, ownership is taken in all cases
+     * @param uid credentials of the process registering the ring
+     * @param pid credentials of the process registering the ring
+     * @return true if the ring has been accepted
+     */
+    bool registerRing(android::base::unique_fd memFd, android::base::unique_fd eventFd,
+                      uint32_t uid, uint32_t pid);
+
+    void startListener();
+
+    void stopListener();
+
+    size_t getRingsCount() const;
+
+private:
+    struct Ring;
+
+    void threadLoop();
+
+    // Moves the newly registered rings to mRings, only called from the listener thread
+    void adoptPendingRings();
+
+    /**
+     * @brief Submits the atoms available in the ring into the queue
+     *
+     * @param ring ring to drain
+     * @param drained set to true if at least one record has been consumed
+     * @return false if the ring content is malformed
+     */
+    bool drainRing(Ring& ring, bool* drained);
+
+    // Declares the consumer idle to the producers, returns false if data arrived meanwhile
+    bool prepareToWait();
+
+    void waitForData();
+
+    std::shared_ptr<LogEventQueue> mQueue;
+
+    std::shared_ptr<LogEventFilter> mLogEventFilter;
+
+    // wakes up the listener thread on new registrations and on stop
+    android::base::unique_fd mControlFd;
+
+    // guards below mPendingRings & mRingsCount
+    mutable std::mutex mMutex;
+    std::vector<std::unique_ptr<Ring>> mPendingRings;
+    size_t mRingsCount = 0;
+
+    // only accessed from the listener thread
+    std::vector<std::unique_ptr<Ring>> mRings;
+
+    // Copies of the records of a batch, parsed instead of the shared memory. Only accessed from
+    // the listener thread.
+    std::unique_ptr<uint8_t[]> mRecordsCopy;
+
+    std::atomic_bool mStopped = false;
+    std::thread mThread;
+
+    FRIEND_TEST(StatsRingListenerTest, TestDrainRing);
+    FRIEND_TEST(StatsRingListenerTest, TestMalformedRing);
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
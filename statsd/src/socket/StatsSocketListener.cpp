@@ -21,68 +21,275 @@
 #include <ctype.h>
 #include <cutils/sockets.h>
 #include <limits.h>
+#include <poll.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/cdefs.h>
+#include <sys/eventfd.h>
 #include <sys/prctl.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <private/android_filesystem_config.h>
+
+#include <algorithm>
+
 #include "guardrail/StatsdStats.h"
 #include "logd/logevent_util.h"
 #include "stats_log_util.h"
 #include "statslog_statsd.h"
+#include "utils/ThreadScheduling.h"
 
 namespace android {
 namespace os {
 namespace statsd {
 
+using android::base::unique_fd;
+
+struct StatsSocketListener::RecvSlot {
+    // + 1 to ensure null terminator if MAX_PAYLOAD buffer is received
+    char buffer[sizeof(android_log_header_t) + LOGGER_ENTRY_MAX_PAYLOAD + 1];
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct ucred)) +
+                                         CMSG_SPACE(2 * sizeof(int))];
+    struct iovec iov;
+};
+
 StatsSocketListener::StatsSocketListener(const std::shared_ptr<LogEventQueue>& queue,
-                                         const std::shared_ptr<LogEventFilter>& logEventFilter)
-    : SocketListener(getLogSocket(), false /*start listen*/),
+                                         const std::shared_ptr<LogEventFilter>& logEventFilter,
+                                         size_t maxBatchSize, const char* socketName)
+    : SocketListener(getLogSocket(socketName), false /*start listen*/),
       mQueue(queue),
-      mLogEventFilter(logEventFilter) {
+      mLogEventFilter(logEventFilter),
+      mMaxBatchSize(std::max<size_t>(maxBatchSize, 1)),
+      mRecvSlots(std::make_unique<RecvSlot[]>(mMaxBatchSize)),
+      mMsgHdrs(mMaxBatchSize) {
+    mMessages.reserve(mMaxBatchSize);
+    for (size_t i = 0; i < mMaxBatchSize; i++) {
+        RecvSlot& slot = mRecvSlots[i];
+        slot.iov = {slot.buffer, sizeof(slot.buffer) - 1};
+        struct msghdr& hdr = mMsgHdrs[i].msg_hdr;
+        hdr.msg_name = nullptr;
+        hdr.msg_namelen = 0;
+        hdr.msg_iov = &slot.iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = slot.control;
+        hdr.msg_controllen = sizeof(slot.control);
+        hdr.msg_flags = 0;
+    }
+}
+
+StatsSocketListener::~StatsSocketListener() {
+    if (mDedupeThread.joinable()) {
+        mDedupeStopped = true;
+        const uint64_t one = 1;
+        TEMP_FAILURE_RETRY(write(mDedupeControlFd.get(), &one, sizeof(one)));
+        mDedupeThread.join();
+    }
+}
+
+void StatsSocketListener::setRingListener(const sp<StatsRingListener>& ringListener) {
+    mRingListener = ringListener;
+}
+
+void StatsSocketListener::setDedupeWindows(const AtomDeduper::Windows& windowsNs) {
+    if (windowsNs.empty()) {
+        return;
+    }
+    mDedupeTimerFd.reset(timerfd_create(CLOCK_BOOTTIME, TFD_CLOEXEC));
+    mDedupeControlFd.reset(eventfd(0, EFD_CLOEXEC));
+    if (mDedupeTimerFd.get() < 0 || mDedupeControlFd.get() < 0) {
+        // without the timer a held repeat could wait for the next atom indefinitely
+        ALOGE("Failed to create the dedupe timer: %d, atoms are not deduped", errno);
+        return;
+    }
+    mDeduper = std::make_unique<AtomDeduper>(windowsNs);
+    mDedupeThread = std::thread([this] { dedupeTimerLoop(); });
+}
+
+void StatsSocketListener::processDedupedMessages(const Message* messages, size_t count) {
+    std::lock_guard<std::mutex> lock(mDedupeMutex);
+    processMessageBatch(messages, count, mQueue, mLogEventFilter, mDeduper.get());
+    armDedupeTimerLocked();
+}
+
+void StatsSocketListener::armDedupeTimerLocked() {
+    const int64_t nextWindowEndNs = mDeduper->getNextWindowEndNs();
+    if (nextWindowEndNs == mDedupeTimerArmedNs) {
+        return;
+    }
+    // a zero it_value disarms the timer
+    struct itimerspec spec = {};
+    if (nextWindowEndNs != INT64_MAX) {
+        spec.it_value.tv_sec = nextWindowEndNs / NS_PER_SEC;
+        spec.it_value.tv_nsec = nextWindowEndNs % NS_PER_SEC;
+    }
+    if (timerfd_settime(mDedupeTimerFd.get(), TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+        ALOGE("Failed to arm the dedupe timer: %d", errno);
+        return;
+    }
+    mDedupeTimerArmedNs = nextWindowEndNs;
+}
+
+void StatsSocketListener::dedupeTimerLoop() {
+    prctl(PR_SET_NAME, "statsd.dedupe");
+    struct pollfd fds[] = {{mDedupeControlFd.get(), POLLIN, 0}, {mDedupeTimerFd.get(), POLLIN, 0}};
+    while (!mDedupeStopped) {
+        if (TEMP_FAILURE_RETRY(poll(fds, 2, -1)) < 0) {
+            ALOGE("StatsSocketListener dedupe timer poll failed: %d", errno);
+            return;
+        }
+        if (!(fds[1].revents & POLLIN)) {
+            continue;
+        }
+        uint64_t expirations;
+        TEMP_FAILURE_RETRY(read(mDedupeTimerFd.get(), &expirations, sizeof(expirations)));
+
+        std::lock_guard<std::mutex> lock(mDedupeMutex);
+        // the timer is one-shot, it is re-armed below for the remaining windows
+        mDedupeTimerArmedNs = INT64_MAX;
+        processMessageBatch(nullptr, 0, mQueue, mLogEventFilter, mDeduper.get());
+        armDedupeTimerLocked();
+    }
+}
+
+void StatsSocketListener::registerRing(const Message& message) {
+    unique_fd memFd(message.fds[0]);
+    unique_fd eventFd(message.fds[1]);
+    if (mRingListener == nullptr) {
+        return;
+    }
+    mRingListener->registerRing(std::move(memFd), std::move(eventFd), message.uid, message.pid);
 }
 
 bool StatsSocketListener::onDataAvailable(SocketClient* cli) {
-    static bool name_set;
-    if (!name_set) {
+    if (!mThreadSetUp) {
         prctl(PR_SET_NAME, "statsd.writer");
-        name_set = true;
+        applyThreadScheduling(StatsdThread::kSocketListener);
+        mThreadSetUp = true;
     }
 
-    // + 1 to ensure null terminator if MAX_PAYLOAD buffer is received
-    char buffer[sizeof(android_log_header_t) + LOGGER_ENTRY_MAX_PAYLOAD + 1];
-    struct iovec iov = {buffer, sizeof(buffer) - 1};
+    int socket = cli->getSocket();
 
-    alignas(4) char control[CMSG_SPACE(sizeof(struct ucred))];
-    struct msghdr hdr = {
-            NULL, 0, &iov, 1, control, sizeof(control), 0,
-    };
+    if (mMaxBatchSize == 1) {
+        return drainSingle(socket);
+    }
+    return drainBatch(socket);
+}
 
-    int socket = cli->getSocket();
+bool StatsSocketListener::drainSingle(int socket) {
+    RecvSlot* slot = &mRecvSlots[0];
+    struct msghdr* hdr = &mMsgHdrs[0].msg_hdr;
+    hdr->msg_controllen = sizeof(slot->control);
+    hdr->msg_flags = 0;
 
     // To clear the entire buffer is secure/safe, but this contributes to 1.68%
     // overhead under logging load. We are safe because we check counts, but
     // still need to clear null terminator
     // memset(buffer, 0, sizeof(buffer));
-    ssize_t n = recvmsg(socket, &hdr, 0);
+    ssize_t n = recvmsg(socket, hdr, MSG_CMSG_CLOEXEC);
     if (n <= (ssize_t)(sizeof(android_log_header_t))) {
         return false;
     }
 
+    Message message;
+    if (!extractMessage(slot, n, hdr, &message)) {
+        return true;
+    }
+    if (message.isRingRegistration) {
+        registerRing(message);
+    } else if (message.isAtomList) {
+        mMessages.clear();
+        unpackAtomList(message, mMessages);
+        if (mMessages.empty()) {
+            return true;
+        }
+        if (mDeduper != nullptr) {
+            processDedupedMessages(mMessages.data(), mMessages.size());
+        } else {
+            processMessageBatch(mMessages.data(), mMessages.size(), mQueue, mLogEventFilter);
+        }
+    } else if (mDeduper != nullptr) {
+        processDedupedMessages(&message, 1);
+    } else {
+        processMessage(message.msg, message.len, message.uid, message.pid, mQueue,
+                       mLogEventFilter);
+    }
+    return true;
+}
+
+bool StatsSocketListener::drainBatch(int socket) {
+    for (size_t i = 0; i < mMaxBatchSize; i++) {
+        // the kernel updates these on every receive
+        mMsgHdrs[i].msg_hdr.msg_controllen = sizeof(mRecvSlots[i].control);
+        mMsgHdrs[i].msg_hdr.msg_flags = 0;
+        mMsgHdrs[i].msg_len = 0;
+    }
+
+    // The socket is readable, so at least one datagram is available. MSG_DONTWAIT makes
+    // recvmmsg() return as soon as the socket is drained instead of waiting for a full batch.
+    const int count = recvmmsg(socket, mMsgHdrs.data(), mMaxBatchSize,
+                                 MSG_DONTWAIT | MSG_CMSG_CLOEXEC, nullptr);
+    if (count <= 0) {
+        return false;
+    }
+    StatsdStats::getInstance().noteSocketDrain(count, static_cast<int32_t>(mMaxBatchSize),
+                                               getElapsedRealtimeNs());
+
+    mMessages.clear();
+    for (int i = 0; i < count; i++) {
+        const ssize_t n = mMsgHdrs[i].msg_len;
+        if (n <= (ssize_t)(sizeof(android_log_header_t))) {
+            continue;
+        }
+        Message message;
+        if (!extractMessage(&mRecvSlots[i], n, &mMsgHdrs[i].msg_hdr, &message)) {
+            continue;
+        }
+        if (message.isRingRegistration) {
+            registerRing(message);
+        } else if (message.isAtomList) {
+            unpackAtomList(message, mMessages);
+        } else {
+            mMessages.push_back(message);
+        }
+    }
+
+    if (mMessages.empty()) {
+        return true;
+    }
+    if (mDeduper != nullptr) {
+        processDedupedMessages(mMessages.data(), mMessages.size());
+    } else {
+        processMessageBatch(mMessages.data(), mMessages.size(), mQueue, mLogEventFilter);
+    }
+    return true;
+}
+
+bool StatsSocketListener::extractMessage(RecvSlot* slot, ssize_t n, struct msghdr* hdr,
+                                         Message* message) {
+    char* buffer = slot->buffer;
     buffer[n] = 0;
 
     struct ucred* cred = NULL;
+    // fds are only expected along with ring registrations, owned until handed to the message
+    std::vector<unique_fd> fds;
 
-    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr);
     while (cmsg != NULL) {
         if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS) {
             cred = (struct ucred*)CMSG_DATA(cmsg);
-            break;
+        } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; i++) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+                fds.emplace_back(fd);
+            }
         }
-        cmsg = CMSG_NXTHDR(&hdr, cmsg);
+        cmsg = CMSG_NXTHDR(hdr, cmsg);
     }
 
     struct ucred fake_cred;
@@ -117,41 +324,79 @@ bool StatsSocketListener::onDataAvailable(SocketClient* cli) {
             StatsdStats::getInstance().noteLogLost((int32_t)getWallClockSec(), dropped_count,
                                                    long_event->header.tag, last_atom_tag, cred->uid,
                                                    cred->pid);
-            return true;
+            return false;
         }
     }
 
-    // move past the 4-byte StatsEventTag
-    const uint8_t* msg = ptr + sizeof(uint32_t);
-    const uint32_t len = n - sizeof(uint32_t);
-    const uint32_t uid = cred->uid;
-    const uint32_t pid = cred->pid;
+    if (n < (ssize_t)sizeof(uint32_t)) {
+        return false;
+    }
+    uint32_t tag;
+    memcpy(&tag, ptr, sizeof(tag));
 
-    processMessage(msg, len, uid, pid, mQueue, mLogEventFilter);
+    // move past the 4-byte StatsEventTag
+    message->msg = ptr + sizeof(uint32_t);
+    message->len = n - sizeof(uint32_t);
+    message->uid = cred->uid;
+    message->pid = cred->pid;
+    message->isAtomList = tag == kStatsEventListTag;
+    message->isRingRegistration = tag == kStatsRingRegistrationTag;
+    if (message->isRingRegistration) {
+        // rings are only supported for system_server, see libstatssocket BufferWriterQueue
+        if (cred->uid != AID_SYSTEM || fds.size() != 2 || (hdr->msg_flags & MSG_CTRUNC)) {
+            ALOGW("Rejected ring registration from uid %d with %zu fds", cred->uid, fds.size());
+            return false;
+        }
+        message->fds[0] = fds[0].release();
+        message->fds[1] = fds[1].release();
+    }
+    return true;
+}
 
+bool StatsSocketListener::unpackAtomList(const Message& list, std::vector<Message>& messages) {
+    const uint8_t* ptr = list.msg;
+    uint32_t remaining = list.len;
+    while (remaining > 0) {
+        uint32_t size;
+        if (remaining < sizeof(size)) {
+            ALOGW("Truncated atom list from uid %d", list.uid);
+            return false;
+        }
+        memcpy(&size, ptr, sizeof(size));
+        ptr += sizeof(size);
+        remaining -= sizeof(size);
+        if (size == 0 || size > remaining) {
+            ALOGW("Invalid atom size %u in atom list from uid %d", size, list.uid);
+            return false;
+        }
+        Message message = list;
+        message.msg = ptr;
+        message.len = size;
+        message.isAtomList = false;
+        messages.push_back(message);
+        ptr += size;
+        remaining -= size;
+    }
     return true;
 }
 
-void StatsSocketListener::processMessage(const uint8_t* msg, uint32_t len, uint32_t uid,
-                                         uint32_t pid, const std::shared_ptr<LogEventQueue>& queue,
-                                         const std::shared_ptr<LogEventFilter>& filter) {
-    std::unique_ptr<LogEvent> logEvent = std::make_unique<LogEvent>(uid, pid);
+std::unique_ptr<LogEvent> StatsSocketListener::parseMessage(
+        const uint8_t* msg, uint32_t len, uint32_t uid, uint32_t pid,
+        const std::shared_ptr<LogEventQueue>& queue,
+        const std::shared_ptr<LogEventFilter>& filter) {
+    std::unique_ptr<LogEvent> logEvent = queue->obtainEvent(uid, pid);
 
     if (filter->getFilteringEnabled()) {
         const LogEvent::BodyBufferInfo bodyInfo = logEvent->parseHeader(msg, len);
         if (filter->isAtomInUse(logEvent->GetTagId())) {
-            logEvent->parseBody(bodyInfo);
+            logEvent->parseBody(bodyInfo, filter->getAtomFieldMask(logEvent->GetTagId()));
         }
     } else {
         logEvent->parseBuffer(msg, len);
     }
 
-    const int32_t atomId = logEvent->GetTagId();
-    const bool isAtomSkipped = logEvent->isParsedHeaderOnly();
-    const int64_t atomTimestamp = logEvent->GetElapsedTimestampNs();
-
-    if (atomId == util::STATS_SOCKET_LOSS_REPORTED) {
-        if (isAtomSkipped) {
+    if (logEvent->GetTagId() == util::STATS_SOCKET_LOSS_REPORTED) {
+        if (logEvent->isParsedHeaderOnly()) {
             ALOGW("Atom STATS_SOCKET_LOSS_REPORTED should not be skipped");
         }
 
@@ -165,7 +410,21 @@ void StatsSocketListener::processMessage(const uint8_t* msg, uint32_t len, uint3
         }
     }
 
-    const auto [success, oldestTimestamp, queueSize] = queue->push(std::move(logEvent));
+    return logEvent;
+}
+
+void StatsSocketListener::processMessage(const uint8_t* msg, uint32_t len, uint32_t uid,
+                                         uint32_t pid, const std::shared_ptr<LogEventQueue>& queue,
+                                         const std::shared_ptr<LogEventFilter>& filter) {
+    std::unique_ptr<LogEvent> logEvent = parseMessage(msg, len, uid, pid, queue, filter);
+
+    const int32_t atomId = logEvent->GetTagId();
+    const bool isAtomSkipped = logEvent->isParsedHeaderOnly();
+    const int64_t atomTimestamp = logEvent->GetElapsedTimestampNs();
+    const bool isPriority = filter->isPriorityAtom(atomId);
+
+    const auto [success, oldestTimestamp, queueSize] =
+            queue->push(std::move(logEvent), isPriority);
     if (success) {
         StatsdStats::getInstance().noteEventQueueSize(queueSize, atomTimestamp);
     } else {
@@ -173,8 +432,74 @@ void StatsSocketListener::processMessage(const uint8_t* msg, uint32_t len, uint3
     }
 }
 
-int StatsSocketListener::getLogSocket() {
-    static const char socketName[] = "statsdw";
+void StatsSocketListener::processMessageBatch(const Message* messages, size_t count,
+                                              const std::shared_ptr<LogEventQueue>& queue,
+                                              const std::shared_ptr<LogEventFilter>& filter,
+                                              AtomDeduper* deduper) {
+    struct AtomInfo {
+        int32_t atomId;
+        bool isAtomSkipped;
+        int64_t atomTimestamp;
+    };
+
+    std::vector<std::unique_ptr<LogEvent>> logEvents;
+    std::vector<AtomInfo> atomInfos;
+    std::vector<bool> isPriority;
+    logEvents.reserve(count);
+    atomInfos.reserve(count);
+    isPriority.reserve(count);
+    const auto addEvent = [&](std::unique_ptr<LogEvent> logEvent) {
+        atomInfos.push_back({logEvent->GetTagId(), logEvent->isParsedHeaderOnly(),
+                             logEvent->GetElapsedTimestampNs()});
+        isPriority.push_back(filter->isPriorityAtom(logEvent->GetTagId()));
+        logEvents.push_back(std::move(logEvent));
+    };
+
+    // held repeats to be submitted ahead of the next event
+    std::vector<std::unique_ptr<LogEvent>> released;
+    if (deduper != nullptr) {
+        deduper->releaseExpired(getElapsedRealtimeNs(), &released);
+    }
+    for (size_t i = 0; i < count; i++) {
+        const Message& message = messages[i];
+        std::unique_ptr<LogEvent> logEvent = parseMessage(message.msg, message.len, message.uid,
+                                                          message.pid, queue, filter);
+        if (deduper != nullptr &&
+            deduper->dedupe(logEvent, message.msg, message.len, &released)) {
+            if (logEvent != nullptr) {
+                // counted on the held event
+                queue->recycleEvent(std::move(logEvent));
+            }
+            continue;
+        }
+        for (std::unique_ptr<LogEvent>& releasedEvent : released) {
+            addEvent(std::move(releasedEvent));
+        }
+        released.clear();
+        addEvent(std::move(logEvent));
+    }
+    for (std::unique_ptr<LogEvent>& releasedEvent : released) {
+        addEvent(std::move(releasedEvent));
+    }
+    if (logEvents.empty()) {
+        return;
+    }
+
+    const std::vector<LogEventQueue::Result> results = queue->pushBatch(logEvents, isPriority);
+    for (size_t i = 0; i < results.size(); i++) {
+        const AtomInfo& info = atomInfos[i];
+        if (results[i].success) {
+            StatsdStats::getInstance().noteEventQueueSize(results[i].size, info.atomTimestamp);
+        } else {
+            StatsdStats::getInstance().noteEventQueueOverflow(results[i].oldestTimestampNs,
+                                                              info.atomId, info.isAtomSkipped);
+            // dropped event is left in the batch, reuse it for the next messages
+            queue->recycleEvent(std::move(logEvents[i]));
+        }
+    }
+}
+
+int StatsSocketListener::getLogSocket(const char* socketName) {
     int sock = android_get_control_socket(socketName);
 
     if (sock < 0) {  // statsd started up in init.sh
@@ -15,12 +15,22 @@
  */
 #pragma once
 
+#include <android-base/unique_fd.h>
 #include <gtest/gtest_prod.h>
+#include <sys/socket.h>
 #include <sysutils/SocketListener.h>
 #include <utils/RefBase.h>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "LogEventFilter.h"
 #include "logd/LogEventQueue.h"
+#include "socket/AtomDeduper.h"
+#include "socket/StatsRingListener.h"
 
 // DEFAULT_OVERFLOWUID is defined in linux/highuid.h, which is not part of
 // the uapi headers for userspace to use.  This value is filled in on the
@@ -38,16 +48,112 @@ namespace statsd {
 
 class StatsSocketListener : public SocketListener, public virtual RefBase {
 public:
+    // Default upper bound of datagrams drained from the socket by a single recvmmsg() call.
+    static constexpr size_t kDefaultMaxBatchSize = 32;
+
+    // Sockets of the writers, each drained by its own listener thread. libstatssocket writes to
+    // statsdw_system from AID_SYSTEM, to statsdw_native from the other uids below
+    // AID_APP_START and to statsdw from the apps.
+    // (*MUST BE IN SYNC WITH libstatssocket and statsd.rc*)
+    static constexpr const char* kSocketNames[] = {"statsdw", "statsdw_system",
+                                                   "statsdw_native"};
+
+    /**
+     * @param maxBatchSize max number of datagrams read per onDataAvailable() call. A value of 1
+     * disables batched drain and reads a single datagram with recvmsg().
+     * @param socketName name of the socket to listen to, one of kSocketNames
+     */
     explicit StatsSocketListener(const std::shared_ptr<LogEventQueue>& queue,
-                                 const std::shared_ptr<LogEventFilter>& logEventFilter);
+                                 const std::shared_ptr<LogEventFilter>& logEventFilter,
+                                 size_t maxBatchSize = kDefaultMaxBatchSize,
+                                 const char* socketName = kSocketNames[0]);
+
+    virtual ~StatsSocketListener();
 
-    virtual ~StatsSocketListener() = default;
+    /**
+     * @brief Sets the listener adopting the shared memory rings registered through the socket.
+     * Must be called before the listener is started. Registrations are rejected when unset.
+     */
+    void setRingListener(const sp<StatsRingListener>& ringListener);
+
+    /**
+     * @brief Sets the atoms whose identical repeats from a uid are collapsed, see AtomDeduper.
+     * Must be called before the listener is started. Nothing is deduped when unset.
+     * The held repeats are released by a timer once their window is closed, also when the
+     * socket goes quiet.
+     */
+    void setDedupeWindows(const AtomDeduper::Windows& windowsNs);
 
 protected:
     bool onDataAvailable(SocketClient* cli) override;
 
 private:
-    static int getLogSocket();
+    struct RecvSlot;
+
+    /**
+     * Atom payload of a single datagram along with the socket credentials of its sender.
+     */
+    struct Message {
+        const uint8_t* msg = nullptr;
+        uint32_t len = 0;
+        uint32_t uid = 0;
+        uint32_t pid = 0;
+        // set when the datagram packs several atoms, see unpackAtomList()
+        bool isAtomList = false;
+        // set when the datagram carries the memfd & eventfd of a StatsRingWriter ring
+        bool isRingRegistration = false;
+        int fds[2] = {-1, -1};
+    };
+
+    // Tag of datagrams packing several atoms coalesced by libstatssocket BufferWriterQueue.
+    // (*MUST BE IN SYNC WITH libstatssocket*)
+    static constexpr uint32_t kStatsEventListTag = 1937006965;
+
+    // Tag of datagrams registering a shared memory ring of libstatssocket StatsRingWriter.
+    // (*MUST BE IN SYNC WITH libstatssocket*)
+    static constexpr uint32_t kStatsRingRegistrationTag = 1937006966;
+
+    static int getLogSocket(const char* socketName);
+
+    /**
+     * @brief Extracts the atom payload and the SCM_CREDENTIALS from a received datagram.
+     * Dropped events notifications are accounted in StatsdStats and do not produce a message.
+     * Received SCM_RIGHTS fds are closed unless the datagram is a ring registration from
+     * AID_SYSTEM, in which case they are returned in message->fds.
+     *
+     * @param slot receive slot holding the datagram
+     * @param n size of the datagram in bytes
+     * @param hdr message header used to receive the datagram
+     * @param message output message
+     * @return true if the datagram carries an atom to be processed
+     */
+    static bool extractMessage(RecvSlot* slot, ssize_t n, struct msghdr* hdr, Message* message);
+
+    /**
+     * @brief Splits a datagram packing several atoms into one message per atom. The payload
+     * is a sequence of |uint32_t size|atom buffer| records
+     *
+     * @param list message with isAtomList set
+     * @param messages output messages, new ones are appended
+     * @return false if the payload is malformed, messages preceding the error are still appended
+     */
+    static bool unpackAtomList(const Message& list, std::vector<Message>& messages);
+
+    // Hands the ring fds over to mRingListener, closes them if there is no ring listener
+    void registerRing(const Message& message);
+
+    bool drainSingle(int socket);
+
+    bool drainBatch(int socket);
+
+    // Processes the messages through mDeduper and re-arms the dedupe timer
+    void processDedupedMessages(const Message* messages, size_t count);
+
+    // Arms mDedupeTimerFd to the next window end of mDeduper, mDedupeMutex must be held
+    void armDedupeTimerLocked();
+
+    // Releases the held repeats whose window is closed each time mDedupeTimerFd fires
+    void dedupeTimerLoop();
 
     /**
      * @brief Helper API to parse buffer, make the LogEvent & submit it into the queue
@@ -64,6 +170,32 @@ private:
                                const std::shared_ptr<LogEventQueue>& queue,
                                const std::shared_ptr<LogEventFilter>& filter);
 
+    /**
+     * @brief Same as processMessage() for a group of messages. Events are submitted into the
+     * queue with a single LogEventQueue::pushBatch() call, preserving the messages order
+     *
+     * @param messages messages to parse
+     * @param count number of messages
+     * @param queue queue to submit the events
+     * @param filter to be used for event evaluation
+     * @param deduper optional, collapses the repeated atoms. The held events whose window is
+     * closed are submitted ahead of the messages
+     */
+    static void processMessageBatch(const Message* messages, size_t count,
+                                    const std::shared_ptr<LogEventQueue>& queue,
+                                    const std::shared_ptr<LogEventFilter>& filter,
+                                    AtomDeduper* deduper = nullptr);
+
+    /**
+     * @brief Parses the buffer into a LogEvent obtained from the queue events pool.
+     * STATS_SOCKET_LOSS_REPORTED atoms are accounted in StatsdStats right away to not lose the
+     * info due to queue overflow
+     */
+    static std::unique_ptr<LogEvent> parseMessage(const uint8_t* msg, uint32_t len, uint32_t uid,
+                                                  uint32_t pid,
+                                                  const std::shared_ptr<LogEventQueue>& queue,
+                                                  const std::shared_ptr<LogEventFilter>& filter);
+
     /**
      * Who is going to get the events when they're read.
      */
@@ -71,7 +203,33 @@ private:
 
     std::shared_ptr<LogEventFilter> mLogEventFilter;
 
+    const size_t mMaxBatchSize;
+
+    // Whether the name and the scheduling of the listener thread are set.
+    bool mThreadSetUp = false;
+
+    // Receive buffers, allocated once and reused for every drain. Only accessed from the
+    // listener thread.
+    std::unique_ptr<RecvSlot[]> mRecvSlots;
+    std::vector<struct mmsghdr> mMsgHdrs;
+    std::vector<Message> mMessages;
+
+    sp<StatsRingListener> mRingListener;
+
+    // guards below mDeduper & mDedupeTimerArmedNs, shared by the listener & the timer threads
+    std::mutex mDedupeMutex;
+    std::unique_ptr<AtomDeduper> mDeduper;
+    int64_t mDedupeTimerArmedNs = INT64_MAX;
+
+    // CLOCK_BOOTTIME timerfd, same clock as the event timestamps
+    android::base::unique_fd mDedupeTimerFd;
+    // wakes up the timer thread on stop
+    android::base::unique_fd mDedupeControlFd;
+    std::atomic_bool mDedupeStopped = false;
+    std::thread mDedupeThread;
+
     friend class SocketParseMessageTest;
+    friend class SocketMessageReplayer;
     friend void generateAtomLogging(const std::shared_ptr<LogEventQueue>& queue,
                                     const std::shared_ptr<LogEventFilter>& filter, int eventCount,
                                     int startAtomId);
@@ -81,6 +239,10 @@ private:
     FRIEND_TEST(SocketParseMessageTest, TestProcessMessageFilterCompleteSet);
     FRIEND_TEST(SocketParseMessageTest, TestProcessMessageFilterPartialSet);
     FRIEND_TEST(SocketParseMessageTest, TestProcessMessageFilterToggle);
+    FRIEND_TEST(SocketParseMessageTest, TestProcessMessageBatch);
+    FRIEND_TEST(SocketParseMessageTest, TestUnpackAtomList);
+    FRIEND_TEST(SocketParseMessageTest, TestProcessMessageBatchDedupe);
+    FRIEND_TEST(SocketParseMessageTest, TestDedupeReleasedWhenSocketQuiet);
     FRIEND_TEST(LogEventQueue_test, TestQueueMaxSize);
 };
 
@@ -17,12 +17,23 @@
 
 #include <utils/RefBase.h>
 
+#include <optional>
+#include <span>
+#include <unordered_map>
+
 #include "HashableDimensionKey.h"
 
 namespace android {
 namespace os {
 namespace statsd {
 
+// A state change of a primary key, see StateListener::onStateChanged.
+struct StateChange {
+    HashableDimensionKey primaryKey;
+    FieldValue oldState;
+    FieldValue newState;
+};
+
 class StateListener : public virtual RefBase {
 public:
     StateListener(){};
@@ -47,6 +58,29 @@ public:
     virtual void onStateChanged(const int64_t eventTimeNs, const int32_t atomId,
                                 const HashableDimensionKey& primaryKey, const FieldValue& oldState,
                                 const FieldValue& newState) = 0;
+
+    /**
+     * Interface for handling the state changes of several primary keys at the same time, e.g.
+     * when the states of all the primary keys are reset. The default implementation handles
+     * them one at a time.
+     */
+    virtual void onStatesChanged(const int64_t eventTimeNs, const int32_t atomId,
+                                 std::span<const StateChange> changes) {
+        for (const StateChange& change : changes) {
+            onStateChanged(eventTimeNs, atomId, change.primaryKey, change.oldState,
+                           change.newState);
+        }
+    }
+
+    /**
+     * Returns the state groups that the values of the state atom are mapped to if the listener
+     * ignores the changes between values of the same group. StateTrackers then don't notify the
+     * listener of these changes. Called when the listener is registered.
+     */
+    virtual std::optional<std::unordered_map<int, int64_t>> getIgnoredStateGroups(
+            const int32_t atomId) const {
+        return std::nullopt;
+    }
 };
 
 }  // namespace statsd
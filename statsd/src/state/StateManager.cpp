@@ -21,6 +21,8 @@
 
 #include <private/android_filesystem_config.h>
 
+#include <algorithm>
+
 namespace android {
 namespace os {
 namespace statsd {
@@ -38,17 +40,21 @@ StateManager& StateManager::getInstance() {
 
 void StateManager::clear() {
     mStateTrackers.clear();
+    mStateAtomIds.clear();
 }
 
 void StateManager::onLogEvent(const LogEvent& event) {
+    if (!mStateAtomIds.count(event.GetTagId())) {
+        return;
+    }
     // Only process state events from uids in AID_* and packages that are whitelisted in
     // mAllowedPkg.
     // Allowlisted AIDs are AID_ROOT and all AIDs in [1000, 2000) which is [AID_SYSTEM, AID_SHELL)
-    if (event.GetUid() == AID_ROOT ||
-        (event.GetUid() >= AID_SYSTEM && event.GetUid() < AID_SHELL) ||
-        mAllowedLogSources.find(event.GetUid()) != mAllowedLogSources.end()) {
-        if (mStateTrackers.find(event.GetTagId()) != mStateTrackers.end()) {
-            mStateTrackers[event.GetTagId()]->onLogEvent(event);
+    const int32_t uid = event.GetUid();
+    if (uid == AID_ROOT || (uid >= AID_SYSTEM && uid < AID_SHELL) ||
+        std::binary_search(mAllowedLogSources.begin(), mAllowedLogSources.end(), uid)) {
+        if (auto it = mStateTrackers.find(event.GetTagId()); it != mStateTrackers.end()) {
+            it->second->onLogEvent(event);
         }
     }
 }
@@ -57,6 +63,7 @@ void StateManager::registerListener(const int32_t atomId, const wp<StateListener
     // Check if state tracker already exists.
     if (mStateTrackers.find(atomId) == mStateTrackers.end()) {
         mStateTrackers[atomId] = new StateTracker(atomId);
+        mStateAtomIds.insert(atomId);
     }
     mStateTrackers[atomId]->registerListener(listener);
 }
@@ -77,6 +84,7 @@ void StateManager::unregisterListener(const int32_t atomId, const wp<StateListen
         if (it->second->getListenersCount() == 0) {
             toRemove = it->second;
             mStateTrackers.erase(it);
+            mStateAtomIds.erase(atomId);
         }
     } else {
         ALOGE("StateManager cannot unregister listener, StateTracker for atom %d does not exist",
@@ -99,8 +107,11 @@ void StateManager::updateLogSources(const sp<UidMap>& uidMap) {
     mAllowedLogSources.clear();
     for (const auto& pkg : mAllowedPkg) {
         auto uids = uidMap->getAppUid(pkg);
-        mAllowedLogSources.insert(uids.begin(), uids.end());
+        mAllowedLogSources.insert(mAllowedLogSources.end(), uids.begin(), uids.end());
     }
+    std::sort(mAllowedLogSources.begin(), mAllowedLogSources.end());
+    mAllowedLogSources.erase(std::unique(mAllowedLogSources.begin(), mAllowedLogSources.end()),
+                             mAllowedLogSources.end());
 }
 
 void StateManager::notifyAppChanged(const string& apk, const sp<UidMap>& uidMap) {
@@ -24,6 +24,7 @@
 
 #include "HashableDimensionKey.h"
 #include "packages/UidMap.h"
+#include "socket/AtomIdBitmapSet.h"
 #include "socket/LogEventFilter.h"
 #include "state/StateListener.h"
 #include "state/StateTracker.h"
@@ -93,12 +94,15 @@ private:
     // Maps state atom ids to StateTrackers
     std::unordered_map<int32_t, sp<StateTracker>> mStateTrackers;
 
+    // The keys of mStateTrackers, checked first since most events aren't for state atoms.
+    AtomIdBitmapSet mStateAtomIds;
+
     // The package names that can log state events.
     const std::set<std::string> mAllowedPkg;
 
-    // The combined uid sources (after translating pkg name to uid).
+    // The combined uid sources (after translating pkg name to uid), sorted.
     // State events from uids that are not in the list will be ignored to avoid state pollution.
-    std::set<int32_t> mAllowedLogSources;
+    std::vector<int32_t> mAllowedLogSources;
 };
 
 }  // namespace statsd
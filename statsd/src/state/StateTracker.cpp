@@ -21,6 +21,8 @@
 
 #include "StateTracker.h"
 
+#include <algorithm>
+
 namespace android {
 namespace os {
 namespace statsd {
@@ -34,6 +36,14 @@ void StateTracker::onLogEvent(const LogEvent& event) {
     // Parse event for primary field values i.e. primary key.
     HashableDimensionKey primaryKey;
     filterPrimaryKey(event.getValues(), &primaryKey);
+    if (!mHasUidPrimaryKey) {
+        const std::vector<FieldValue>& values = primaryKey.getValues();
+        mHasUidPrimaryKey = values.size() == 1 && values[0].mValue.getType() == INT &&
+                            (isUidField(values[0]) || isAttributionUidField(values[0]));
+        if (*mHasUidPrimaryKey) {
+            mUidPrimaryField = values[0].mField;
+        }
+    }
 
     FieldValue newState;
     if (!getStateFieldValueFromLogEvent(event, &newState)) {
@@ -59,22 +69,103 @@ void StateTracker::onLogEvent(const LogEvent& event) {
     }
 
     const bool nested = newState.mAnnotations.isNested();
-    updateStateForPrimaryKey(eventTimeNs, primaryKey, newState, nested, mStateMap[primaryKey]);
+    updateStateForPrimaryKey(eventTimeNs, primaryKey, newState, nested,
+                             getOrCreateState(primaryKey));
+}
+
+int32_t StateTracker::getDenseUid(const HashableDimensionKey& primaryKey) const {
+    if (!mHasUidPrimaryKey.value_or(false)) {
+        return -1;
+    }
+    const std::vector<FieldValue>& values = primaryKey.getValues();
+    if (values.size() != 1 || values[0].mValue.getType() != INT ||
+        !(values[0].mField == mUidPrimaryField)) {
+        return -1;
+    }
+    const int32_t uid = values[0].mValue.int_value;
+    return uid >= 0 && uid % kUidsPerUser < kMaxDenseAppId ? uid : -1;
+}
+
+StateTracker::StateValueInfo& StateTracker::getOrCreateState(
+        const HashableDimensionKey& primaryKey) {
+    const int32_t uid = getDenseUid(primaryKey);
+    if (uid < 0) {
+        return mStateMap[primaryKey];
+    }
+    std::vector<StateValueInfo>& userStates = mUidStates[uid / kUidsPerUser];
+    const size_t appId = uid % kUidsPerUser;
+    if (appId >= userStates.size()) {
+        userStates.resize(appId + 1);
+    }
+    return userStates[appId];
+}
+
+const StateTracker::StateValueInfo* StateTracker::findState(
+        const HashableDimensionKey& primaryKey) const {
+    const int32_t uid = getDenseUid(primaryKey);
+    if (uid < 0) {
+        const auto it = mStateMap.find(primaryKey);
+        return it != mStateMap.end() ? &it->second : nullptr;
+    }
+    const auto it = mUidStates.find(uid / kUidsPerUser);
+    const size_t appId = uid % kUidsPerUser;
+    if (it == mUidStates.end() || appId >= it->second.size() ||
+        it->second[appId].state == kStateUnknown) {
+        return nullptr;
+    }
+    return &it->second[appId];
+}
+
+void StateTracker::eraseState(const HashableDimensionKey& primaryKey) {
+    const int32_t uid = getDenseUid(primaryKey);
+    if (uid < 0) {
+        mStateMap.erase(primaryKey);
+        return;
+    }
+    const auto it = mUidStates.find(uid / kUidsPerUser);
+    const size_t appId = uid % kUidsPerUser;
+    if (it != mUidStates.end() && appId < it->second.size()) {
+        it->second[appId] = StateValueInfo();
+    }
 }
 
 void StateTracker::registerListener(const wp<StateListener>& listener) {
-    mListeners.insert(listener);
+    for (const ListenerInfo& info : mListeners) {
+        if (info.listener == listener) {
+            return;
+        }
+    }
+    ListenerInfo info{listener, std::nullopt};
+    if (sp<StateListener> sl = listener.promote(); sl != nullptr) {
+        info.ignoredStateGroups = sl->getIgnoredStateGroups(mField.getTag());
+    }
+    mListeners.push_back(std::move(info));
 }
 
 void StateTracker::unregisterListener(const wp<StateListener>& listener) {
-    mListeners.erase(listener);
+    mListeners.erase(std::remove_if(mListeners.begin(), mListeners.end(),
+                                    [&listener](const ListenerInfo& info) {
+                                        return info.listener == listener;
+                                    }),
+                     mListeners.end());
+}
+
+// Returns whether the state values are in the same state group, or both in none.
+static bool isSameStateGroup(const std::unordered_map<int, int64_t>& stateGroups,
+                             const int32_t oldState, const int32_t newState) {
+    const auto oldIt = stateGroups.find(oldState);
+    const auto newIt = stateGroups.find(newState);
+    if (oldIt == stateGroups.end() || newIt == stateGroups.end()) {
+        return oldIt == newIt;
+    }
+    return oldIt->second == newIt->second;
 }
 
 bool StateTracker::getStateValue(const HashableDimensionKey& queryKey, FieldValue* output) const {
     output->mField = mField;
 
-    if (const auto it = mStateMap.find(queryKey); it != mStateMap.end()) {
-        output->mValue = it->second.state;
+    if (const StateValueInfo* stateValueInfo = findState(queryKey); stateValueInfo != nullptr) {
+        output->mValue = stateValueInfo->state;
         return true;
     }
 
@@ -86,33 +177,48 @@ bool StateTracker::getStateValue(const HashableDimensionKey& queryKey, FieldValu
 
 void StateTracker::handleReset(const int64_t eventTimeNs, const FieldValue& newState) {
     VLOG("StateTracker handle reset");
+    std::vector<StateChange> changes;
+    changes.reserve(mStateMap.size());
     for (auto& [primaryKey, stateValueInfo] : mStateMap) {
         updateStateForPrimaryKey(eventTimeNs, primaryKey, newState,
                                  false /* nested; treat this state change as not nested */,
-                                 stateValueInfo);
+                                 stateValueInfo, &changes);
+    }
+    for (auto& [userId, userStates] : mUidStates) {
+        for (size_t appId = 0; appId < userStates.size(); appId++) {
+            if (userStates[appId].state == kStateUnknown) {
+                continue;
+            }
+            HashableDimensionKey primaryKey;
+            primaryKey.addValue(
+                    FieldValue(mUidPrimaryField, Value((int32_t)(userId * kUidsPerUser + appId))));
+            updateStateForPrimaryKey(eventTimeNs, primaryKey, newState,
+                                     false /* nested; treat this state change as not nested */,
+                                     userStates[appId], &changes);
+        }
+    }
+    if (!changes.empty()) {
+        notifyListeners(eventTimeNs, changes);
     }
 }
 
 void StateTracker::clearStateForPrimaryKey(const int64_t eventTimeNs,
                                            const HashableDimensionKey& primaryKey) {
     VLOG("StateTracker clear state for primary key");
-    const std::unordered_map<HashableDimensionKey, StateValueInfo>::iterator it =
-            mStateMap.find(primaryKey);
-
-    // If there is no entry for the primaryKey in mStateMap, then the state is already
-    // kStateUnknown.
+    // If there is no entry for the primaryKey, then the state is already kStateUnknown.
     const FieldValue state(mField, Value(kStateUnknown));
-    if (it != mStateMap.end()) {
+    if (findState(primaryKey) != nullptr) {
         updateStateForPrimaryKey(eventTimeNs, primaryKey, state,
                                  false /* nested; treat this state change as not nested */,
-                                 it->second);
+                                 getOrCreateState(primaryKey));
     }
 }
 
 void StateTracker::updateStateForPrimaryKey(const int64_t eventTimeNs,
                                             const HashableDimensionKey& primaryKey,
                                             const FieldValue& newState, const bool nested,
-                                            StateValueInfo& stateValueInfo) {
+                                            StateValueInfo& stateValueInfo,
+                                            std::vector<StateChange>* changes) {
     FieldValue oldState;
     oldState.mField = mField;
     oldState.mValue.setInt(stateValueInfo.state);
@@ -125,7 +231,11 @@ void StateTracker::updateStateForPrimaryKey(const int64_t eventTimeNs,
         if (newStateValue != oldStateValue) {
             stateValueInfo.state = newStateValue;
             stateValueInfo.count = 1;
-            notifyListeners(eventTimeNs, primaryKey, oldState, newState);
+            if (changes != nullptr) {
+                changes->push_back({primaryKey, oldState, newState});
+            } else {
+                notifyListeners(eventTimeNs, primaryKey, oldState, newState);
+            }
         }
 
     // Update state map for nested counting case.
@@ -158,21 +268,51 @@ void StateTracker::updateStateForPrimaryKey(const int64_t eventTimeNs,
     // stateValueInfo points to a value in mStateMap and should not be accessed after erasing the
     // entry
     if (newStateValue == kStateUnknown) {
-        mStateMap.erase(primaryKey);
+        eraseState(primaryKey);
     }
 }
 
 void StateTracker::notifyListeners(const int64_t eventTimeNs,
                                    const HashableDimensionKey& primaryKey,
                                    const FieldValue& oldState, const FieldValue& newState) {
-    for (const auto& l : mListeners) {
-        auto sl = l.promote();
+    for (const ListenerInfo& info : mListeners) {
+        if (info.ignoredStateGroups &&
+            isSameStateGroup(*info.ignoredStateGroups, oldState.mValue.int_value,
+                             newState.mValue.int_value)) {
+            continue;
+        }
+        auto sl = info.listener.promote();
         if (sl != nullptr) {
             sl->onStateChanged(eventTimeNs, mField.getTag(), primaryKey, oldState, newState);
         }
     }
 }
 
+void StateTracker::notifyListeners(const int64_t eventTimeNs,
+                                   const std::vector<StateChange>& changes) {
+    std::vector<StateChange> groupChanges;
+    for (const ListenerInfo& info : mListeners) {
+        std::span<const StateChange> listenerChanges(changes);
+        if (info.ignoredStateGroups) {
+            groupChanges.clear();
+            for (const StateChange& change : changes) {
+                if (!isSameStateGroup(*info.ignoredStateGroups, change.oldState.mValue.int_value,
+                                      change.newState.mValue.int_value)) {
+                    groupChanges.push_back(change);
+                }
+            }
+            listenerChanges = groupChanges;
+        }
+        if (listenerChanges.empty()) {
+            continue;
+        }
+        auto sl = info.listener.promote();
+        if (sl != nullptr) {
+            sl->onStatesChanged(eventTimeNs, mField.getTag(), listenerChanges);
+        }
+    }
+}
+
 bool getStateFieldValueFromLogEvent(const LogEvent& event, FieldValue* output) {
     const std::optional<size_t>& exclusiveStateFieldIndex = event.getExclusiveStateFieldIndex();
     if (!exclusiveStateFieldIndex) {
@@ -15,13 +15,16 @@
  */
 #pragma once
 
+#include <gtest/gtest_prod.h>
 #include <utils/RefBase.h>
 #include "HashableDimensionKey.h"
 #include "logd/LogEvent.h"
 
 #include "state/StateListener.h"
 
+#include <optional>
 #include <unordered_map>
+#include <vector>
 
 namespace android {
 namespace os {
@@ -65,11 +68,45 @@ private:
 
     Field mField;
 
-    // Maps primary key to state value info
+    // Maps primary key to state value info, except for the uid keys stored in mUidStates.
     std::unordered_map<HashableDimensionKey, StateValueInfo> mStateMap;
 
-    // Set of all StateListeners (objects listening for state changes)
-    std::set<wp<StateListener>> mListeners;
+    // Uids are split by user, see multiuser.h.
+    static constexpr int32_t kUidsPerUser = 100000;
+
+    // Apps ids below this are stored in mUidStates: it covers the system and application uids,
+    // which are allocated compactly from 0 and 10000.
+    static constexpr int32_t kMaxDenseAppId = 20000;
+
+    // Whether the primary key of the atom is a single uid, set on the first event.
+    std::optional<bool> mHasUidPrimaryKey;
+
+    // The field of the primary key if mHasUidPrimaryKey is true.
+    Field mUidPrimaryField;
+
+    // States of the uid primary keys, indexed by the app id (uid % kUidsPerUser) of each user
+    // and grown as needed. An unknown state means that there is no state for the uid.
+    std::unordered_map<int32_t, std::vector<StateValueInfo>> mUidStates;
+
+    // Returns the index of the uid of the key in mUidStates, or -1 if the key isn't stored there.
+    int32_t getDenseUid(const HashableDimensionKey& primaryKey) const;
+
+    // Returns the state value info of the primary key, creating it if it doesn't exist.
+    StateValueInfo& getOrCreateState(const HashableDimensionKey& primaryKey);
+
+    // Returns the state value info of the primary key, or null if it doesn't exist.
+    const StateValueInfo* findState(const HashableDimensionKey& primaryKey) const;
+
+    void eraseState(const HashableDimensionKey& primaryKey);
+
+    struct ListenerInfo {
+        wp<StateListener> listener;
+        // See StateListener::getIgnoredStateGroups.
+        std::optional<std::unordered_map<int, int64_t>> ignoredStateGroups;
+    };
+
+    // All StateListeners (objects listening for state changes), in registration order.
+    std::vector<ListenerInfo> mListeners;
 
     // Reset all state values in map to the given state.
     void handleReset(const int64_t eventTimeNs, const FieldValue& newState);
@@ -77,14 +114,21 @@ private:
     // Clears the state value mapped to the given primary key by setting it to kStateUnknown.
     void clearStateForPrimaryKey(const int64_t eventTimeNs, const HashableDimensionKey& primaryKey);
 
-    // Update the StateMap based on the received state value.
+    // Update the StateMap based on the received state value. If changes is set, the state change
+    // is added to it instead of being notified to the listeners.
     void updateStateForPrimaryKey(const int64_t eventTimeNs, const HashableDimensionKey& primaryKey,
                                   const FieldValue& newState, const bool nested,
-                                  StateValueInfo& stateValueInfo);
+                                  StateValueInfo& stateValueInfo,
+                                  std::vector<StateChange>* changes = nullptr);
 
     // Notify registered state listeners of state change.
     void notifyListeners(const int64_t eventTimeNs, const HashableDimensionKey& primaryKey,
                          const FieldValue& oldState, const FieldValue& newState);
+
+    // Notify registered state listeners of the state changes of several primary keys.
+    void notifyListeners(const int64_t eventTimeNs, const std::vector<StateChange>& changes);
+
+    FRIEND_TEST(StateTrackerTest, TestUidPrimaryKeyStates);
 };
 
 bool getStateFieldValueFromLogEvent(const LogEvent& event, FieldValue* output);
@@ -19,9 +19,14 @@
 
 #include <aidl/android/os/IStatsCompanionService.h>
 #include <private/android_filesystem_config.h>
+#include <limits.h>
 #include <set>
+#include <sys/uio.h>
+#include <unistd.h>
 #include <utils/SystemClock.h>
 
+#include <algorithm>
+
 #include "statscompanion_util.h"
 
 using android::util::FIELD_COUNT_REPEATED;
@@ -85,6 +90,15 @@ const int FIELD_ID_PULL_TIMEOUT_METADATA = 22;
 const int FIELD_ID_PULL_TIMEOUT_METADATA_UPTIME_MILLIS = 1;
 const int FIELD_ID_PULL_TIMEOUT_METADATA_ELAPSED_MILLIS = 2;
 const int FIELD_ID_SUBSCRIPTION_PULL_COUNT = 23;
+const int FIELD_ID_PULL_RATE_LIMITED = 24;
+const int FIELD_ID_PULL_TIME_NANOS_HISTOGRAM = 25;
+const int FIELD_ID_PULL_DATA_SIZE_HISTOGRAM = 26;
+const int FIELD_ID_RECEIVER_TIME_NANOS_HISTOGRAM = 27;
+const int FIELD_ID_PULL_NOT_NEEDED = 28;
+const int FIELD_ID_HISTOGRAM_COUNT = 1;
+const int FIELD_ID_HISTOGRAM_P50 = 2;
+const int FIELD_ID_HISTOGRAM_P95 = 3;
+const int FIELD_ID_HISTOGRAM_P99 = 4;
 
 // for AtomMetricStats proto
 const int FIELD_ID_ATOM_METRIC_STATS = 17;
@@ -100,133 +114,37 @@ const int FIELD_ID_MIN_BUCKET_BOUNDARY_DELAY_NS = 9;
 const int FIELD_ID_MAX_BUCKET_BOUNDARY_DELAY_NS = 10;
 const int FIELD_ID_BUCKET_UNKNOWN_CONDITION = 11;
 const int FIELD_ID_BUCKET_COUNT = 12;
+const int FIELD_ID_HOT_DIMENSION_HITS = 16;
+const int FIELD_ID_HOT_DIMENSION_MISSES = 17;
+const int FIELD_ID_PROCESSING_TIME_NANOS_HISTOGRAM = 18;
 
 namespace {
 
-void writeDimensionToProtoHelper(const std::vector<FieldValue>& dims, size_t* index, int depth,
-                                 int prefix, std::set<string>* str_set,
-                                 ProtoOutputStream* protoOutput) {
-    size_t count = dims.size();
-    while (*index < count) {
-        const auto& dim = dims[*index];
-        const int valueDepth = dim.mField.getDepth();
-        const int valuePrefix = dim.mField.getPrefix(depth);
-        const int fieldNum = dim.mField.getPosAtDepth(depth);
-        if (valueDepth > 2) {
-            ALOGE("Depth > 2 not supported");
-            return;
-        }
-
-        // If valueDepth == 1, we're writing a repeated field. Use fieldNum at depth 0 instead
-        // of valueDepth.
-        if ((depth == valueDepth || valueDepth == 1) && valuePrefix == prefix) {
-            uint64_t token = protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
-                                                 DIMENSIONS_VALUE_TUPLE_VALUE);
-            protoOutput->write(FIELD_TYPE_INT32 | DIMENSIONS_VALUE_FIELD, fieldNum);
-            switch (dim.mValue.getType()) {
-                case INT:
-                    protoOutput->write(FIELD_TYPE_INT32 | DIMENSIONS_VALUE_VALUE_INT,
-                                       dim.mValue.int_value);
-                    break;
-                case LONG:
-                    protoOutput->write(FIELD_TYPE_INT64 | DIMENSIONS_VALUE_VALUE_LONG,
-                                       (long long)dim.mValue.long_value);
-                    break;
-                case FLOAT:
-                    protoOutput->write(FIELD_TYPE_FLOAT | DIMENSIONS_VALUE_VALUE_FLOAT,
-                                       dim.mValue.float_value);
-                    break;
-                case STRING:
-                    if (str_set == nullptr) {
-                        protoOutput->write(FIELD_TYPE_STRING | DIMENSIONS_VALUE_VALUE_STR,
-                                           dim.mValue.str_value);
-                    } else {
-                        str_set->insert(dim.mValue.str_value);
-                        protoOutput->write(FIELD_TYPE_UINT64 | DIMENSIONS_VALUE_VALUE_STR_HASH,
-                                           (long long)Hash64(dim.mValue.str_value));
-                    }
-                    break;
-                default:
-                    break;
-            }
-            if (token != 0) {
-                protoOutput->end(token);
-            }
-            (*index)++;
-        } else if (valueDepth == depth + 2 && valuePrefix == prefix) {
-            // Writing the sub tree
-            uint64_t dimensionToken = protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
-                                                         DIMENSIONS_VALUE_TUPLE_VALUE);
-            protoOutput->write(FIELD_TYPE_INT32 | DIMENSIONS_VALUE_FIELD, fieldNum);
-            uint64_t tupleToken =
-                    protoOutput->start(FIELD_TYPE_MESSAGE | DIMENSIONS_VALUE_VALUE_TUPLE);
-            writeDimensionToProtoHelper(dims, index, valueDepth, dim.mField.getPrefix(valueDepth),
-                                        str_set, protoOutput);
-            protoOutput->end(tupleToken);
-            protoOutput->end(dimensionToken);
-        } else {
-            // Done with the prev sub tree
-            return;
-        }
-    }
-}
-
-void writeDimensionLeafToProtoHelper(const std::vector<FieldValue>& dims,
-                                     const int dimensionLeafField, size_t* index, int depth,
-                                     int prefix, std::set<string>* str_set,
-                                     ProtoOutputStream* protoOutput) {
-    size_t count = dims.size();
-    while (*index < count) {
-        const auto& dim = dims[*index];
-        const int valueDepth = dim.mField.getDepth();
-        const int valuePrefix = dim.mField.getPrefix(depth);
-        if (valueDepth > 2) {
-            ALOGE("Depth > 2 not supported");
-            return;
-        }
-
-        // If valueDepth == 1, we're writing a repeated field.
-        if ((depth == valueDepth || valueDepth == 1) && valuePrefix == prefix) {
-            uint64_t token = protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
-                                                dimensionLeafField);
-            switch (dim.mValue.getType()) {
-                case INT:
-                    protoOutput->write(FIELD_TYPE_INT32 | DIMENSIONS_VALUE_VALUE_INT,
-                                       dim.mValue.int_value);
-                    break;
-                case LONG:
-                    protoOutput->write(FIELD_TYPE_INT64 | DIMENSIONS_VALUE_VALUE_LONG,
-                                       (long long)dim.mValue.long_value);
-                    break;
-                case FLOAT:
-                    protoOutput->write(FIELD_TYPE_FLOAT | DIMENSIONS_VALUE_VALUE_FLOAT,
-                                       dim.mValue.float_value);
-                    break;
-                case STRING:
-                    if (str_set == nullptr) {
-                        protoOutput->write(FIELD_TYPE_STRING | DIMENSIONS_VALUE_VALUE_STR,
-                                           dim.mValue.str_value);
-                    } else {
-                        str_set->insert(dim.mValue.str_value);
-                        protoOutput->write(FIELD_TYPE_UINT64 | DIMENSIONS_VALUE_VALUE_STR_HASH,
-                                           (long long)Hash64(dim.mValue.str_value));
-                    }
-                    break;
-                default:
-                    break;
-            }
-            if (token != 0) {
-                protoOutput->end(token);
+// Writes the value of a dimension in the message opened by the caller.
+void writeDimensionValueToProto(const Value& value, ReportStringTable* str_set,
+                                ProtoOutputStream* protoOutput) {
+    switch (value.getType()) {
+        case INT:
+            protoOutput->write(FIELD_TYPE_INT32 | DIMENSIONS_VALUE_VALUE_INT, value.int_value);
+            break;
+        case LONG:
+            protoOutput->write(FIELD_TYPE_INT64 | DIMENSIONS_VALUE_VALUE_LONG,
+                               (long long)value.long_value);
+            break;
+        case FLOAT:
+            protoOutput->write(FIELD_TYPE_FLOAT | DIMENSIONS_VALUE_VALUE_FLOAT, value.float_value);
+            break;
+        case STRING:
+            if (str_set == nullptr) {
+                protoOutput->write(FIELD_TYPE_STRING | DIMENSIONS_VALUE_VALUE_STR,
+                                   value.str_value.str());
+            } else {
+                protoOutput->write(FIELD_TYPE_UINT64 | DIMENSIONS_VALUE_VALUE_STR_HASH,
+                                   (long long)str_set->add(value.str_value));
             }
-            (*index)++;
-        } else if (valueDepth == depth + 2 && valuePrefix == prefix) {
-            writeDimensionLeafToProtoHelper(dims, dimensionLeafField,
-                                            index, valueDepth, dim.mField.getPrefix(valueDepth),
-                                            str_set, protoOutput);
-        } else {
-            // Done with the prev sub tree
-            return;
-        }
+            break;
+        default:
+            break;
     }
 }
 
@@ -272,29 +190,73 @@ void writeDimensionPathToProtoHelper(const std::vector<Matcher>& fieldMatchers,
 
 }  // namespace
 
-void writeDimensionToProto(const HashableDimensionKey& dimension, std::set<string> *str_set,
+void writeDimensionToProto(const HashableDimensionKey& dimension, ReportStringTable* str_set,
                            ProtoOutputStream* protoOutput) {
-    if (dimension.getValues().size() == 0) {
+    const std::vector<FieldValue>& dims = dimension.getValues();
+    if (dims.size() == 0) {
         return;
     }
-    protoOutput->write(FIELD_TYPE_INT32 | DIMENSIONS_VALUE_FIELD,
-                       dimension.getValues()[0].mField.getTag());
+    protoOutput->write(FIELD_TYPE_INT32 | DIMENSIONS_VALUE_FIELD, dims[0].mField.getTag());
     uint64_t topToken = protoOutput->start(FIELD_TYPE_MESSAGE | DIMENSIONS_VALUE_VALUE_TUPLE);
-    size_t index = 0;
-    writeDimensionToProtoHelper(dimension.getValues(), &index, 0, 0, str_set, protoOutput);
+    // The values are sorted by field, so the values of a message in a repeated field, at depth 2,
+    // are consecutive. Their tuple is kept open until a value outside of that message.
+    bool inSubTree = false;
+    int32_t subTreePrefix = 0;
+    uint64_t subTreeToken = 0;
+    uint64_t subTreeTupleToken = 0;
+    for (const FieldValue& dim : dims) {
+        const int valueDepth = dim.mField.getDepth();
+        if (valueDepth > 2) {
+            ALOGE("Depth > 2 not supported");
+            break;
+        }
+        // A value at depth 1 is an element of a repeated field, written like a top level field.
+        const bool isSubTreeValue = valueDepth == 2;
+        const int32_t valuePrefix = isSubTreeValue ? dim.mField.getPrefix(valueDepth) : 0;
+        if (inSubTree && (!isSubTreeValue || valuePrefix != subTreePrefix)) {
+            protoOutput->end(subTreeTupleToken);
+            protoOutput->end(subTreeToken);
+            inSubTree = false;
+        }
+        if (isSubTreeValue && !inSubTree) {
+            subTreeToken = protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
+                                              DIMENSIONS_VALUE_TUPLE_VALUE);
+            protoOutput->write(FIELD_TYPE_INT32 | DIMENSIONS_VALUE_FIELD,
+                               dim.mField.getPosAtDepth(0));
+            subTreeTupleToken =
+                    protoOutput->start(FIELD_TYPE_MESSAGE | DIMENSIONS_VALUE_VALUE_TUPLE);
+            inSubTree = true;
+            subTreePrefix = valuePrefix;
+        }
+        uint64_t token = protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
+                                            DIMENSIONS_VALUE_TUPLE_VALUE);
+        protoOutput->write(FIELD_TYPE_INT32 | DIMENSIONS_VALUE_FIELD,
+                           dim.mField.getPosAtDepth(isSubTreeValue ? valueDepth : 0));
+        writeDimensionValueToProto(dim.mValue, str_set, protoOutput);
+        protoOutput->end(token);
+    }
+    if (inSubTree) {
+        protoOutput->end(subTreeTupleToken);
+        protoOutput->end(subTreeToken);
+    }
     protoOutput->end(topToken);
 }
 
 void writeDimensionLeafNodesToProto(const HashableDimensionKey& dimension,
                                     const int dimensionLeafFieldId,
-                                    std::set<string> *str_set,
+                                    ReportStringTable* str_set,
                                     ProtoOutputStream* protoOutput) {
-    if (dimension.getValues().size() == 0) {
-        return;
+    // The leaves are all the values, in order, whatever the depth of their field.
+    for (const FieldValue& dim : dimension.getValues()) {
+        if (dim.mField.getDepth() > 2) {
+            ALOGE("Depth > 2 not supported");
+            return;
+        }
+        uint64_t token = protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
+                                            dimensionLeafFieldId);
+        writeDimensionValueToProto(dim.mValue, str_set, protoOutput);
+        protoOutput->end(token);
     }
-    size_t index = 0;
-    writeDimensionLeafToProtoHelper(dimension.getValues(), dimensionLeafFieldId,
-                                    &index, 0, 0, str_set, protoOutput);
 }
 
 void writeDimensionPathToProto(const std::vector<Matcher>& fieldMatchers,
@@ -369,7 +331,7 @@ void writeFieldValueTreeToStreamHelper(int tagId, const std::vector<FieldValue>&
                     break;
                 case STRING: {
                     protoOutput->write(FIELD_TYPE_STRING | repeatedFieldMask | fieldNum,
-                                       dim.mValue.str_value);
+                                       dim.mValue.str_value.str());
                     break;
                 }
                 case STORAGE:
@@ -399,13 +361,82 @@ void writeFieldValueTreeToStreamHelper(int tagId, const std::vector<FieldValue>&
     }
 }
 
+namespace {
+
+// Same encoding as writeFieldValueTreeToStreamHelper(), with the size of each sub message counted
+// before it is written.
+void encodeFieldValueTree(const std::vector<FieldValue>& dims, size_t* index, int depth,
+                          int prefix, ProtoBufferWriter* writer) {
+    const size_t count = dims.size();
+    while (*index < count) {
+        const auto& dim = dims[*index];
+        const int valueDepth = dim.mField.getDepth();
+        const int valuePrefix = dim.mField.getPrefix(depth);
+        const int fieldNum = dim.mField.getPosAtDepth(depth);
+        if (valueDepth > 2) {
+            ALOGE("Depth > 2 not supported");
+            return;
+        }
+
+        if ((depth == valueDepth || valueDepth == 1) && valuePrefix == prefix) {
+            switch (dim.mValue.getType()) {
+                case INT:
+                    writer->writeInt32(fieldNum, dim.mValue.int_value);
+                    break;
+                case LONG:
+                    writer->writeInt64(fieldNum, dim.mValue.long_value);
+                    break;
+                case FLOAT:
+                    writer->writeFloat(fieldNum, dim.mValue.float_value);
+                    break;
+                case STRING:
+                    writer->writeBytes(fieldNum, dim.mValue.str_value.c_str(),
+                                       dim.mValue.str_value.size());
+                    break;
+                case STORAGE:
+                    writer->writeBytes(fieldNum, dim.mValue.storage_value.data(),
+                                       dim.mValue.storage_value.size());
+                    break;
+                default:
+                    break;
+            }
+            (*index)++;
+        } else if (valueDepth == depth + 2 && valuePrefix == prefix) {
+            const int subPrefix = dim.mField.getPrefix(valueDepth);
+            size_t subIndex = *index;
+            ProtoBufferWriter subCounter;
+            encodeFieldValueTree(dims, &subIndex, valueDepth, subPrefix, &subCounter);
+            writer->writeMessageHeader(fieldNum, subCounter.size());
+            if (writer->isCounting()) {
+                writer->skip(subCounter.size());
+                *index = subIndex;
+            } else {
+                encodeFieldValueTree(dims, index, valueDepth, subPrefix, writer);
+            }
+        } else {
+            // Done with the prev sub tree
+            return;
+        }
+    }
+}
+
+}  // namespace
+
 void writeFieldValueTreeToStream(int tagId, const std::vector<FieldValue>& values,
                                  util::ProtoOutputStream* protoOutput) {
-    uint64_t atomToken = protoOutput->start(FIELD_TYPE_MESSAGE | tagId);
+    writeEncodedAtomToStream(
+            tagId,
+            [&values](ProtoBufferWriter* writer) {
+                size_t index = 0;
+                encodeFieldValueTree(values, &index, 0, 0, writer);
+            },
+            protoOutput);
+}
 
+void writeFieldValueTreeFieldsToStream(int tagId, const std::vector<FieldValue>& values,
+                                       util::ProtoOutputStream* protoOutput) {
     size_t index = 0;
     writeFieldValueTreeToStreamHelper(tagId, values, &index, 0, 0, protoOutput);
-    protoOutput->end(atomToken);
 }
 
 void writeStateToProto(const FieldValue& state, util::ProtoOutputStream* protoOutput) {
@@ -471,6 +502,23 @@ void writeNonZeroStatToStream(const uint64_t fieldId, const int64_t value,
     }
 }
 
+void writeHistogramToStream(const uint64_t fieldId, const StatsdStats::Histogram& histogram,
+                            ProtoOutputStream* protoOutput) {
+    if (histogram.getCount() == 0) {
+        return;
+    }
+    uint64_t token = protoOutput->start(FIELD_TYPE_MESSAGE | fieldId);
+    protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_HISTOGRAM_COUNT,
+                       (long long)histogram.getCount());
+    protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_HISTOGRAM_P50,
+                       (long long)histogram.getPercentile(50));
+    protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_HISTOGRAM_P95,
+                       (long long)histogram.getPercentile(95));
+    protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_HISTOGRAM_P99,
+                       (long long)histogram.getPercentile(99));
+    protoOutput->end(token);
+}
+
 void writePullerStatsToStream(const std::pair<int, StatsdStats::PulledAtomStats>& pair,
                               util::ProtoOutputStream* protoOutput) {
     uint64_t token = protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_ID_PULLED_ATOM_STATS |
@@ -519,6 +567,16 @@ void writePullerStatsToStream(const std::pair<int, StatsdStats::PulledAtomStats>
     }
     writeNonZeroStatToStream(FIELD_TYPE_INT32 | FIELD_ID_SUBSCRIPTION_PULL_COUNT,
                              pair.second.subscriptionPullCount, protoOutput);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_PULL_RATE_LIMITED,
+                             pair.second.pullRateLimited, protoOutput);
+    writeHistogramToStream(FIELD_ID_PULL_TIME_NANOS_HISTOGRAM, pair.second.pullTimeNsHistogram,
+                           protoOutput);
+    writeHistogramToStream(FIELD_ID_PULL_DATA_SIZE_HISTOGRAM, pair.second.pullDataSizeHistogram,
+                           protoOutput);
+    writeHistogramToStream(FIELD_ID_RECEIVER_TIME_NANOS_HISTOGRAM,
+                           pair.second.receiverTimeNsHistogram, protoOutput);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_PULL_NOT_NEEDED,
+                             pair.second.pullNotNeeded, protoOutput);
     protoOutput->end(token);
 }
 
@@ -551,6 +609,12 @@ void writeAtomMetricStatsToStream(const std::pair<int64_t, StatsdStats::AtomMetr
                              (long long)pair.second.bucketUnknownCondition, protoOutput);
     writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_COUNT,
                              (long long)pair.second.bucketCount, protoOutput);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_HOT_DIMENSION_HITS,
+                             (long long)pair.second.hotDimensionHits, protoOutput);
+    writeNonZeroStatToStream(FIELD_TYPE_INT64 | FIELD_ID_HOT_DIMENSION_MISSES,
+                             (long long)pair.second.hotDimensionMisses, protoOutput);
+    writeHistogramToStream(FIELD_ID_PROCESSING_TIME_NANOS_HISTOGRAM,
+                           pair.second.processingTimeNsHistogram, protoOutput);
     protoOutput->end(token);
 }
 
@@ -570,6 +634,12 @@ int64_t getSystemUptimeMillis() {
     return ::android::uptimeMillis();
 }
 
+int64_t getThreadCpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
 int64_t getWallClockNs() {
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
@@ -622,15 +692,10 @@ bool checkPermissionForIds(const char* permission, pid_t pid, uid_t uid) {
 }
 
 void mapIsolatedUidsToHostUidInLogEvent(const sp<UidMap>& uidMap, LogEvent& event) {
-    uint8_t remainingUidCount = event.getNumUidFields();
     vector<FieldValue>* fieldValues = event.getMutableValues();
-    auto it = fieldValues->begin();
-    while(it != fieldValues->end() && remainingUidCount > 0) {
-        if (isUidField(*it)) {
-            it->mValue.setInt(uidMap->getHostUidOrSelf(it->mValue.int_value));
-            remainingUidCount--;
-        }
-        ++it;
+    for (const size_t index : event.getUidFieldIndices()) {
+        FieldValue& fieldValue = (*fieldValues)[index];
+        fieldValue.mValue.setInt(uidMap->getHostUidOrSelf(fieldValue.mValue.int_value));
     }
 }
 
@@ -644,6 +709,38 @@ std::string toHexString(const string& bytes) {
     return hex;
 }
 
+bool writeProtoToFd(ProtoOutputStream& proto, int fd) {
+    std::vector<iovec> iovecs;
+    sp<android::util::ProtoReader> reader = proto.data();
+    while (reader->readBuffer() != NULL) {
+        const size_t toRead = reader->currentToRead();
+        if (toRead > 0) {
+            iovecs.push_back({const_cast<uint8_t*>(reader->readBuffer()), toRead});
+        }
+        reader->move(toRead);
+    }
+
+    size_t first = 0;
+    while (first < iovecs.size()) {
+        const int count = (int)std::min(iovecs.size() - first, static_cast<size_t>(IOV_MAX));
+        const ssize_t written = TEMP_FAILURE_RETRY(writev(fd, &iovecs[first], count));
+        if (written <= 0) {
+            return false;
+        }
+        // Skips the buffers fully written and resumes a partially written one.
+        size_t remaining = written;
+        while (first < iovecs.size() && remaining >= iovecs[first].iov_len) {
+            remaining -= iovecs[first].iov_len;
+            first++;
+        }
+        if (remaining > 0) {
+            iovecs[first].iov_base = static_cast<uint8_t*>(iovecs[first].iov_base) + remaining;
+            iovecs[first].iov_len -= remaining;
+        }
+    }
+    return true;
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -24,6 +24,8 @@
 #include "guardrail/StatsdStats.h"
 #include "logd/LogEvent.h"
 #include "packages/UidMap.h"
+#include "utils/ProtoBufferWriter.h"
+#include "utils/ReportStringTable.h"
 
 using android::util::ProtoOutputStream;
 
@@ -31,14 +33,41 @@ namespace android {
 namespace os {
 namespace statsd {
 
+// Atoms up to this size are encoded on the stack by writeEncodedAtomToStream().
+inline constexpr size_t kAtomStackBufferSize = 512;
+
+// Writes an atom as a single message field of protoOutput, without message tokens. encodeFields
+// encodes the fields of the atom, it is called once to count their bytes and once to write them.
+template <typename EncodeFields>
+void writeEncodedAtomToStream(int tagId, const EncodeFields& encodeFields,
+                              ProtoOutputStream* protoOutput) {
+    ProtoBufferWriter counter;
+    encodeFields(&counter);
+    uint8_t stackBuffer[kAtomStackBufferSize];
+    std::vector<uint8_t> heapBuffer;
+    uint8_t* buffer = stackBuffer;
+    if (counter.size() > sizeof(stackBuffer)) {
+        heapBuffer.resize(counter.size());
+        buffer = heapBuffer.data();
+    }
+    ProtoBufferWriter writer(buffer);
+    encodeFields(&writer);
+    protoOutput->write(util::FIELD_TYPE_MESSAGE | tagId, reinterpret_cast<const char*>(buffer),
+                       writer.size());
+}
+
+// Encodes the atom with lengths computed from the values, see ProtoBufferWriter.
 void writeFieldValueTreeToStream(int tagId, const std::vector<FieldValue>& values,
                                  ProtoOutputStream* protoOutput);
-void writeDimensionToProto(const HashableDimensionKey& dimension, std::set<string> *str_set,
+// Same as above, without the message of the atom around the fields.
+void writeFieldValueTreeFieldsToStream(int tagId, const std::vector<FieldValue>& values,
+                                       ProtoOutputStream* protoOutput);
+void writeDimensionToProto(const HashableDimensionKey& dimension, ReportStringTable* str_set,
                            ProtoOutputStream* protoOutput);
 
 void writeDimensionLeafNodesToProto(const HashableDimensionKey& dimension,
                                     const int dimensionLeafFieldId,
-                                    std::set<string> *str_set,
+                                    ReportStringTable* str_set,
                                     ProtoOutputStream* protoOutput);
 
 void writeDimensionPathToProto(const std::vector<Matcher>& fieldMatchers,
@@ -65,6 +94,9 @@ int64_t getElapsedRealtimeSec();
 // Gets the system uptime in millis.
 int64_t getSystemUptimeMillis();
 
+// Gets the CPU time consumed by the calling thread in ns.
+int64_t getThreadCpuTimeNs();
+
 // Gets the wall clock timestamp in ns.
 int64_t getWallClockNs();
 
@@ -84,6 +116,11 @@ int64_t MillisToNano(const int64_t millis);
 void writeNonZeroStatToStream(const uint64_t fieldId, int64_t value,
                               ProtoOutputStream* protoOutput);
 
+// Helper function to write the count and percentiles of a histogram to ProtoOutputStream if it
+// isn't empty.
+void writeHistogramToStream(const uint64_t fieldId, const StatsdStats::Histogram& histogram,
+                            ProtoOutputStream* protoOutput);
+
 // Helper function to write PulledAtomStats to ProtoOutputStream
 void writePullerStatsToStream(const std::pair<int, StatsdStats::PulledAtomStats>& pair,
                               ProtoOutputStream* protoOutput);
@@ -123,6 +160,10 @@ void mapIsolatedUidsToHostUidInLogEvent(const sp<UidMap>& uidMap, LogEvent& even
 
 std::string toHexString(const string& bytes);
 
+// Writes the encoded buffers of proto to fd with writev, without copying them into a contiguous
+// buffer first. Returns false if the write failed.
+bool writeProtoToFd(ProtoOutputStream& proto, int fd);
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -21,6 +21,7 @@
 #include <unordered_map>
 
 #include "HashableDimensionKey.h"
+#include "utils/FlatHashMap.h"
 
 namespace android {
 namespace os {
@@ -41,7 +42,7 @@ const MetricDimensionKey DEFAULT_METRIC_DIMENSION_KEY = MetricDimensionKey();
 
 typedef std::map<int64_t, HashableDimensionKey> ConditionKey;
 
-typedef std::unordered_map<MetricDimensionKey, int64_t> DimToValMap;
+typedef FlatHashMap<MetricDimensionKey, int64_t> DimToValMap;
 
 using ConditionLinks = google::protobuf::RepeatedPtrField<MetricConditionLink>;
 
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "storage/AsyncFileWriter.h"
+
+#include "storage/StorageManager.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using android::util::ProtoOutputStream;
+using std::function;
+using std::string;
+using std::unique_ptr;
+
+AsyncFileWriter::AsyncFileWriter(size_t maxPendingWrites)
+    : mMaxPendingWrites(maxPendingWrites), mThread([this] { runWriter(); }) {
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopRequested = true;
+    }
+    mQueuedCv.notify_one();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void AsyncFileWriter::write(const string& file, unique_ptr<ProtoOutputStream> proto,
+                            function<void(bool)> onWritten) {
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCompletedCv.wait(lock, [this] { return mPendingWrites.size() < mMaxPendingWrites; });
+        mPendingWrites.push_back({file, std::move(proto), std::move(onWritten)});
+    }
+    mQueuedCv.notify_one();
+}
+
+void AsyncFileWriter::waitForIdle() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCompletedCv.wait(lock, [this] { return mPendingWrites.empty(); });
+}
+
+void AsyncFileWriter::runWriter() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mQueuedCv.wait(lock, [this] { return mStopRequested || !mPendingWrites.empty(); });
+        if (mPendingWrites.empty()) {
+            // stop requested and all queued writes are done
+            return;
+        }
+        PendingWrite& pendingWrite = mPendingWrites.front();
+        lock.unlock();
+        const bool written =
+                StorageManager::writeFileAtomically(pendingWrite.file.c_str(), *pendingWrite.proto);
+        VLOG("Wrote %s asynchronously: %d", pendingWrite.file.c_str(), written);
+        if (pendingWrite.onWritten) {
+            pendingWrite.onWritten(written);
+        }
+        lock.lock();
+        // The write stays queued while it is written, so waitForIdle returns after its callback.
+        mPendingWrites.pop_front();
+        mCompletedCv.notify_all();
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
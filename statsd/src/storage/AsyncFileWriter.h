@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/util/ProtoOutputStream.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Writes protos to files on a dedicated thread, so that the caller isn't blocked on the disk.
+ *
+ * The files are written in the posting order with StorageManager::writeFileAtomically. At most
+ * maxPendingWrites writes are queued, write blocks until one completes beyond that.
+ */
+class AsyncFileWriter {
+public:
+    explicit AsyncFileWriter(size_t maxPendingWrites);
+
+    // Completes the writes which are already queued and joins the writer thread.
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+    // Queues the proto to be written to file. onWritten is called on the writer thread once the
+    // file is written, with whether the write succeeded.
+    void write(const std::string& file, std::unique_ptr<android::util::ProtoOutputStream> proto,
+               std::function<void(bool)> onWritten);
+
+    // Blocks until all the writes queued before the call are completed.
+    void waitForIdle();
+
+private:
+    struct PendingWrite {
+        std::string file;
+        std::unique_ptr<android::util::ProtoOutputStream> proto;
+        std::function<void(bool)> onWritten;
+    };
+
+    void runWriter();
+
+    const size_t mMaxPendingWrites;
+
+    std::mutex mMutex;
+    // Signaled when a write is queued or when stopping.
+    std::condition_variable mQueuedCv;
+    // Signaled when a write is completed.
+    std::condition_variable mCompletedCv;
+    // The front write is being written by the writer thread.
+    std::deque<PendingWrite> mPendingWrites;
+    bool mStopRequested = false;
+
+    std::thread mThread;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
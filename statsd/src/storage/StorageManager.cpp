@@ -20,15 +20,30 @@
 #include "storage/StorageManager.h"
 
 #include <android-base/file.h>
+#include <android-base/strings.h>
+#include <endian.h>
 #include <private/android_filesystem_config.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <zlib.h>
+#include <zstd.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
 #include <fstream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
 
 #include "android-base/stringprintf.h"
 #include "guardrail/StatsdStats.h"
 #include "stats_log_util.h"
 #include "utils/DbUtils.h"
+#include "utils/ShardWorkerPool.h"
 
 namespace android {
 namespace os {
@@ -53,14 +68,31 @@ std::mutex StorageManager::sTrainInfoMutex;
 using android::base::StringPrintf;
 using std::unique_ptr;
 
+// Maximum number of threads parsing the configs at startup, see readConfigFromDisk.
+const size_t kMaxConfigParsingThreads = 4;
+
+// Level of the zstd compression of the reports, see setCompressReports. A low level keeps the
+// cost of a write close to that of the I/O it saves.
+const int kReportCompressionLevel = 1;
+
+static std::atomic<bool> sCompressReports(false);
+
+static std::atomic<bool> sReportLogs(false);
+
+// A segment of a report log is closed once it reaches this size, see setReportLogs.
+const int64_t kMaxReportLogSegmentBytes = 1024 * 1024;
+
 struct FileName {
     int64_t mTimestampSec;
     int mUid;
     int64_t mConfigId;
     bool mIsHistory;
-    string getFullFileName(const char* path) {
-        return StringPrintf("%s/%lld_%d_%lld%s", path, (long long)mTimestampSec, (int)mUid,
-                            (long long)mConfigId, (mIsHistory ? "_history" : ""));
+    // Whether the file is a segment of a report log, see setReportLogs.
+    bool mIsLog = false;
+    string getFullFileName(const char* path) const {
+        return StringPrintf("%s/%lld_%d_%lld%s%s", path, (long long)mTimestampSec, (int)mUid,
+                            (long long)mConfigId, (mIsLog ? "_log" : ""),
+                            (mIsHistory ? "_history" : ""));
     };
 };
 
@@ -98,7 +130,7 @@ static string findTrainInfoFileNameLocked(const string& trainName) {
 }
 
 // Returns array of int64_t which contains timestamp in seconds, uid,
-// configID and whether the file is a local history file.
+// configID, whether the file is a report log and whether it is a local history file.
 static void parseFileName(char* name, FileName* output) {
     int64_t result[3];
     int index = 0;
@@ -118,11 +150,24 @@ static void parseFileName(char* name, FileName* output) {
     output->mTimestampSec = result[0];
     output->mUid = result[1];
     output->mConfigId = result[2];
-    // check if the file is a local history.
+    // check if the file is a report log, then if it is a local history.
+    output->mIsLog = (substr != nullptr && strcmp("log", substr) == 0);
+    if (output->mIsLog) {
+        substr = strtok(nullptr, "_");
+    }
     output->mIsHistory = (substr != nullptr && strcmp("history", substr) == 0);
 }
 
 // Returns array of int64_t which contains a sqlite db's uid and configId
+// Removes the db file of the config along with its write-ahead log, after closing the connection
+// kept to it.
+static void removeDbFile(const string& dbFile, const ConfigKey& key) {
+    dbutils::closeDbConnection(key);
+    remove(dbFile.c_str());
+    remove((dbFile + "-wal").c_str());
+    remove((dbFile + "-shm").c_str());
+}
+
 static ConfigKey parseDbName(char* name) {
     char* uid = strtok(name, "_");
     char* configId = strtok(nullptr, ".");
@@ -132,6 +177,89 @@ static ConfigKey parseDbName(char* name) {
     return ConfigKey(StrToInt64(uid), StrToInt64(configId));
 }
 
+// Index of the reports in STATS_DATA_DIR, see setDataDirIndex.
+struct DataFileInfo {
+    FileName mName;
+    int64_t mFileSizeBytes;
+};
+
+static std::mutex sDataDirIndexMutex;
+static bool sDataDirIndexEnabled = false;
+// Keyed by the full path of the files.
+static map<string, DataFileInfo> sDataDirIndex;
+
+// Parses the name of a report file directly in STATS_DATA_DIR. Returns false for any other file.
+static bool parseDataFilePath(const string& file, FileName* output) {
+    const string dirPrefix = STATS_DATA_DIR "/";
+    if (file.compare(0, dirPrefix.size(), dirPrefix) != 0) {
+        return false;
+    }
+    string name = file.substr(dirPrefix.size());
+    if (name.empty() || name[0] == '.' || name.find('/') != string::npos) {
+        return false;
+    }
+    parseFileName(name.data(), output);
+    return output->mTimestampSec != -1;
+}
+
+static void noteDataFileWritten(const string& file) {
+    FileName output;
+    if (!parseDataFilePath(file, &output)) {
+        return;
+    }
+    struct stat fileStat;
+    const bool exists = stat(file.c_str(), &fileStat) == 0;
+    std::lock_guard<std::mutex> lock(sDataDirIndexMutex);
+    if (!sDataDirIndexEnabled) {
+        return;
+    }
+    if (exists) {
+        sDataDirIndex[file] = {output, (int64_t)fileStat.st_size};
+    } else {
+        sDataDirIndex.erase(file);
+    }
+}
+
+static void noteDataFileRemoved(const string& file) {
+    std::lock_guard<std::mutex> lock(sDataDirIndexMutex);
+    if (sDataDirIndexEnabled) {
+        sDataDirIndex.erase(file);
+    }
+}
+
+// Copies the index of STATS_DATA_DIR to files, ordered by path. Returns false if it is disabled,
+// then the directory needs to be listed instead.
+static bool getIndexedDataFiles(vector<std::pair<string, DataFileInfo>>* files) {
+    std::lock_guard<std::mutex> lock(sDataDirIndexMutex);
+    if (!sDataDirIndexEnabled) {
+        return false;
+    }
+    files->assign(sDataDirIndex.begin(), sDataDirIndex.end());
+    return true;
+}
+
+void StorageManager::setDataDirIndex(bool enabled) {
+    map<string, DataFileInfo> index;
+    if (enabled) {
+        unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_DATA_DIR), closedir);
+        if (dir != NULL) {
+            dirent* de;
+            while ((de = readdir(dir.get()))) {
+                if (de->d_type == DT_DIR) continue;
+                const string file = StringPrintf("%s/%s", STATS_DATA_DIR, de->d_name);
+                FileName output;
+                struct stat fileStat;
+                if (parseDataFilePath(file, &output) && stat(file.c_str(), &fileStat) == 0) {
+                    index[file] = {output, (int64_t)fileStat.st_size};
+                }
+            }
+        }
+    }
+    std::lock_guard<std::mutex> lock(sDataDirIndexMutex);
+    sDataDirIndexEnabled = enabled;
+    sDataDirIndex = std::move(index);
+}
+
 void StorageManager::writeFile(const char* file, const void* buffer, int numBytes) {
     int fd = open(file, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
     if (fd == -1) {
@@ -153,6 +281,361 @@ void StorageManager::writeFile(const char* file, const void* buffer, int numByte
     }
 
     close(fd);
+    noteDataFileWritten(file);
+}
+
+// Compresses proto as a single zstd frame, streaming its encoded buffers through the compressor
+// and the compressed bytes to write.
+static bool compressProto(ProtoOutputStream& proto,
+                          const std::function<bool(const void*, size_t)>& write) {
+    unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> cctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+    if (cctx == nullptr) {
+        return false;
+    }
+    ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_compressionLevel, kReportCompressionLevel);
+    // The size is then stored in the frame, so the report is decompressed in one allocation.
+    ZSTD_CCtx_setPledgedSrcSize(cctx.get(), proto.size());
+
+    vector<char> outBuffer(ZSTD_CStreamOutSize());
+    sp<android::util::ProtoReader> reader = proto.data();
+    bool done = false;
+    while (!done) {
+        const uint8_t* data = reader->readBuffer();
+        ZSTD_inBuffer input = {data, data != NULL ? reader->currentToRead() : 0, 0};
+        const ZSTD_EndDirective mode = data != NULL ? ZSTD_e_continue : ZSTD_e_end;
+        bool inputConsumed = false;
+        while (!inputConsumed) {
+            ZSTD_outBuffer output = {outBuffer.data(), outBuffer.size(), 0};
+            const size_t remaining = ZSTD_compressStream2(cctx.get(), &output, &input, mode);
+            if (ZSTD_isError(remaining) || !write(outBuffer.data(), output.pos)) {
+                return false;
+            }
+            if (mode == ZSTD_e_end) {
+                inputConsumed = done = remaining == 0;
+            } else {
+                inputConsumed = input.pos == input.size;
+            }
+        }
+        if (data != NULL) {
+            reader->move(input.size);
+        }
+    }
+    return true;
+}
+
+static bool writeCompressedProtoToFd(ProtoOutputStream& proto, int fd) {
+    return compressProto(proto, [fd](const void* data, size_t size) {
+        return android::base::WriteFully(fd, data, size);
+    });
+}
+
+static bool writeReportToFd(ProtoOutputStream& proto, int fd) {
+    return sCompressReports ? writeCompressedProtoToFd(proto, fd) : writeProtoToFd(proto, fd);
+}
+
+// A report starts with the tag of one of its first fields, which is never the first byte of the
+// zstd magic number.
+static bool isCompressedReport(const string& content) {
+    uint32_t magic;
+    if (content.size() < sizeof(magic)) {
+        return false;
+    }
+    memcpy(&magic, content.data(), sizeof(magic));
+    return le32toh(magic) == ZSTD_MAGICNUMBER;
+}
+
+static bool decompressReport(string* content) {
+    const unsigned long long size = ZSTD_getFrameContentSize(content->data(), content->size());
+    if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+        return false;
+    }
+    string decompressed(size, '\0');
+    const size_t result =
+            ZSTD_decompress(decompressed.data(), size, content->data(), content->size());
+    if (ZSTD_isError(result) || result != size) {
+        return false;
+    }
+    *content = std::move(decompressed);
+    return true;
+}
+
+void StorageManager::setCompressReports(bool compressReports) {
+    sCompressReports = compressReports;
+}
+
+// Writes file with write to a hidden file in the same directory first, then syncs it and renames
+// it to file.
+static bool writeFileAtomicallyWith(const char* file, const std::function<bool(int)>& write) {
+    // The files starting with '.' are skipped when listing the directories.
+    const string path(file);
+    const size_t nameStart = path.find_last_of('/') + 1;
+    const string tmpFile = path.substr(0, nameStart) + "." + path.substr(nameStart) + ".tmp";
+    int fd = open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        VLOG("Attempt to access %s but failed", tmpFile.c_str());
+        return false;
+    }
+
+    bool success = write(fd) && fsync(fd) == 0;
+    if (fchown(fd, AID_STATSD, AID_STATSD)) {
+        VLOG("Failed to chown %s to statsd", tmpFile.c_str());
+    }
+    close(fd);
+
+    if (success && rename(tmpFile.c_str(), file) != 0) {
+        success = false;
+    }
+    if (success) {
+        VLOG("Successfully wrote %s", file);
+        noteDataFileWritten(file);
+    } else {
+        ALOGE("Failed to write %s", file);
+        remove(tmpFile.c_str());
+    }
+    return success;
+}
+
+// Guards the report logs, so that a segment isn't appended to while it is read, renamed or
+// compacted.
+static std::mutex sReportLogMutex;
+// The segment each config appends its reports to.
+static map<ConfigKey, string> sActiveReportLogs;
+
+// Each record of a report log is the size of the report, then the CRC-32 of its bytes, both
+// little-endian, followed by the report.
+typedef std::array<uint32_t, 2> ReportLogRecordHeader;
+
+static ReportLogRecordHeader getReportLogRecordHeader(size_t size, uint32_t crc) {
+    return {htole32((uint32_t)size), htole32(crc)};
+}
+
+static uint32_t getReportCrc(const string& report) {
+    return crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(report.data()),
+                 report.size());
+}
+
+static void appendReportLogRecord(const string& report, string* content) {
+    const ReportLogRecordHeader header =
+            getReportLogRecordHeader(report.size(), getReportCrc(report));
+    content->append(reinterpret_cast<const char*>(header.data()), sizeof(header));
+    content->append(report);
+}
+
+static bool writeReportLogRecord(ProtoOutputStream& proto, int fd) {
+    if (sCompressReports) {
+        string compressed;
+        if (!compressProto(proto, [&compressed](const void* data, size_t size) {
+                compressed.append(static_cast<const char*>(data), size);
+                return true;
+            })) {
+            return false;
+        }
+        string record;
+        appendReportLogRecord(compressed, &record);
+        return android::base::WriteFully(fd, record.data(), record.size());
+    }
+    uint32_t crc = crc32(0L, Z_NULL, 0);
+    sp<android::util::ProtoReader> reader = proto.data();
+    while (reader->readBuffer() != NULL) {
+        const size_t toRead = reader->currentToRead();
+        crc = crc32(crc, reader->readBuffer(), toRead);
+        reader->move(toRead);
+    }
+    const ReportLogRecordHeader header = getReportLogRecordHeader(proto.size(), crc);
+    return android::base::WriteFully(fd, header.data(), sizeof(header)) &&
+           writeProtoToFd(proto, fd);
+}
+
+// Reads the records of the report log in fd in order, calling onRecord with each report. Stops
+// at the first record which is truncated or whose CRC doesn't match, since the records following
+// it can't be framed.
+static void readReportLogRecords(int fd, const string& file,
+                                 const std::function<void(const string&)>& onRecord) {
+    string report;
+    ReportLogRecordHeader header;
+    while (android::base::ReadFully(fd, header.data(), sizeof(header))) {
+        const uint32_t size = le32toh(header[0]);
+        if (size > (uint32_t)StatsdStats::kMaxFileSize) {
+            ALOGE("Corrupted record in report log %s", file.c_str());
+            return;
+        }
+        report.resize(size);
+        if (!android::base::ReadFully(fd, report.data(), size) ||
+            getReportCrc(report) != le32toh(header[1])) {
+            ALOGE("Corrupted record in report log %s", file.c_str());
+            return;
+        }
+        onRecord(report);
+    }
+}
+
+// Appends proto as a record to the active segment of the report log of the config of name,
+// starting a new segment named after name when there is none or it is full.
+static bool appendToReportLog(const FileName& name, ProtoOutputStream& proto) {
+    std::lock_guard<std::mutex> lock(sReportLogMutex);
+    const ConfigKey key(name.mUid, name.mConfigId);
+    string file;
+    int fd = -1;
+    auto it = sActiveReportLogs.find(key);
+    if (it != sActiveReportLogs.end()) {
+        // The segment is gone once the reports are read, see appendConfigMetricsReport.
+        file = it->second;
+        fd = open(file.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        struct stat fileStat;
+        if (fd != -1 &&
+            (fstat(fd, &fileStat) != 0 || fileStat.st_size >= kMaxReportLogSegmentBytes)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd == -1) {
+        FileName logName = name;
+        logName.mIsLog = true;
+        logName.mIsHistory = false;
+        file = logName.getFullFileName(STATS_DATA_DIR);
+        fd = open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (fd == -1) {
+            VLOG("Attempt to access %s but failed", file.c_str());
+            sActiveReportLogs.erase(key);
+            return false;
+        }
+        if (fchown(fd, AID_STATSD, AID_STATSD)) {
+            VLOG("Failed to chown %s to statsd", file.c_str());
+        }
+        sActiveReportLogs[key] = file;
+    }
+
+    const off_t offset = lseek(fd, 0, SEEK_END);
+    const bool success = writeReportLogRecord(proto, fd) && fsync(fd) == 0;
+    if (success) {
+        VLOG("Successfully appended to %s", file.c_str());
+    } else {
+        ALOGE("Failed to append to %s", file.c_str());
+        // Drops the partial record, so that the following ones can be read. A new segment is
+        // started if that fails too.
+        if (offset < 0 || ftruncate(fd, offset) != 0) {
+            sActiveReportLogs.erase(key);
+        }
+    }
+    close(fd);
+    noteDataFileWritten(file);
+    return success;
+}
+
+// Returns true if the report file is to be appended to the report log of its config instead.
+static bool isReportLogged(const char* file, FileName* name) {
+    return sReportLogs && parseDataFilePath(file, name) && !name->mIsLog && !name->mIsHistory;
+}
+
+// Merges the closed segments of the report log files of each config which aren't full, the
+// local history ones apart, into the oldest of them. Updates files with the merged segments.
+static void compactReportLogs(vector<std::pair<string, DataFileInfo>>* files) {
+    std::lock_guard<std::mutex> lock(sReportLogMutex);
+    std::set<string> activeLogs;
+    for (const auto& [key, file] : sActiveReportLogs) {
+        activeLogs.insert(file);
+    }
+    // Ordered by timestamp, so that the reports are merged in the order they were written.
+    std::sort(files->begin(), files->end(), [](const auto& a, const auto& b) {
+        return a.second.mName.mTimestampSec < b.second.mName.mTimestampSec;
+    });
+    map<std::tuple<int, int64_t, bool>, vector<size_t>> segments;
+    for (size_t i = 0; i < files->size(); i++) {
+        const auto& [file, info] = (*files)[i];
+        if (activeLogs.find(file) == activeLogs.end() &&
+            info.mFileSizeBytes < kMaxReportLogSegmentBytes) {
+            segments[{info.mName.mUid, info.mName.mConfigId, info.mName.mIsHistory}].push_back(
+                    i);
+        }
+    }
+
+    std::set<size_t> merged;
+    for (const auto& [segmentKey, indexes] : segments) {
+        if (indexes.size() < 2) {
+            continue;
+        }
+        // The records are validated while being copied, so corrupted tails are dropped.
+        string content;
+        for (size_t i : indexes) {
+            const string& file = (*files)[i].first;
+            int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) {
+                continue;
+            }
+            readReportLogRecords(fd, file, [&content](const string& report) {
+                appendReportLogRecord(report, &content);
+            });
+            close(fd);
+        }
+        auto& [target, targetInfo] = (*files)[indexes[0]];
+        if (!writeFileAtomicallyWith(target.c_str(), [&content](int fd) {
+                return android::base::WriteFully(fd, content.data(), content.size());
+            })) {
+            continue;
+        }
+        targetInfo.mFileSizeBytes = content.size();
+        // A crash before the other segments are deleted duplicates their reports, rather than
+        // losing them.
+        for (size_t j = 1; j < indexes.size(); j++) {
+            StorageManager::deleteFile((*files)[indexes[j]].first.c_str());
+            merged.insert(indexes[j]);
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < files->size(); i++) {
+        if (merged.find(i) == merged.end()) {
+            (*files)[kept++] = std::move((*files)[i]);
+        }
+    }
+    files->resize(kept);
+}
+
+void StorageManager::setReportLogs(bool reportLogs) {
+    sReportLogs = reportLogs;
+}
+
+void StorageManager::writeFile(const char* file, ProtoOutputStream& proto) {
+    FileName reportName;
+    if (isReportLogged(file, &reportName)) {
+        trimToFit(STATS_SERVICE_DIR);
+        trimToFit(STATS_DATA_DIR);
+        appendToReportLog(reportName, proto);
+        return;
+    }
+    int fd = open(file, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        VLOG("Attempt to access %s but failed", file);
+        return;
+    }
+    trimToFit(STATS_SERVICE_DIR);
+    trimToFit(STATS_DATA_DIR);
+
+    if (writeReportToFd(proto, fd)) {
+        VLOG("Successfully wrote %s", file);
+    } else {
+        ALOGE("Failed to write %s", file);
+    }
+
+    int result = fchown(fd, AID_STATSD, AID_STATSD);
+    if (result) {
+        VLOG("Failed to chown %s to statsd", file);
+    }
+
+    close(fd);
+    noteDataFileWritten(file);
+}
+
+bool StorageManager::writeFileAtomically(const char* file, ProtoOutputStream& proto) {
+    trimToFit(STATS_SERVICE_DIR);
+    trimToFit(STATS_DATA_DIR);
+
+    FileName reportName;
+    if (isReportLogged(file, &reportName)) {
+        return appendToReportLog(reportName, proto);
+    }
+    return writeFileAtomicallyWith(file,
+                                   [&proto](int fd) { return writeReportToFd(proto, fd); });
 }
 
 bool StorageManager::writeTrainInfo(const InstallTrainInfo& trainInfo) {
@@ -463,6 +946,7 @@ void StorageManager::deleteFile(const char* file) {
         VLOG("Attempt to delete %s but is not found", file);
     } else {
         VLOG("Successfully deleted %s", file);
+        noteDataFileRemoved(file);
     }
 }
 
@@ -524,6 +1008,17 @@ void StorageManager::sendBroadcast(const char* path,
 }
 
 bool StorageManager::hasConfigMetricsReport(const ConfigKey& key) {
+    vector<std::pair<string, DataFileInfo>> indexedFiles;
+    if (getIndexedDataFiles(&indexedFiles)) {
+        for (const auto& [file, info] : indexedFiles) {
+            if (!info.mName.mIsHistory && info.mName.mUid == key.GetUid() &&
+                info.mName.mConfigId == key.GetId()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_DATA_DIR), closedir);
     if (dir == NULL) {
         VLOG("Path %s does not exist", STATS_DATA_DIR);
@@ -553,40 +1048,83 @@ bool StorageManager::hasConfigMetricsReport(const ConfigKey& key) {
 
 void StorageManager::appendConfigMetricsReport(const ConfigKey& key, ProtoOutputStream* proto,
                                                bool erase_data, bool isAdb) {
-    unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_DATA_DIR), closedir);
-    if (dir == NULL) {
-        VLOG("Path %s does not exist", STATS_DATA_DIR);
-        return;
+    // The files are listed first, since they are renamed or removed while being appended.
+    vector<std::pair<string, FileName>> files;
+    vector<std::pair<string, DataFileInfo>> indexedFiles;
+    if (getIndexedDataFiles(&indexedFiles)) {
+        for (const auto& [file, info] : indexedFiles) {
+            files.emplace_back(file, info.mName);
+        }
+    } else {
+        unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_DATA_DIR), closedir);
+        if (dir == NULL) {
+            VLOG("Path %s does not exist", STATS_DATA_DIR);
+            return;
+        }
+
+        dirent* de;
+        while ((de = readdir(dir.get()))) {
+            char* name = de->d_name;
+            string fileName(name);
+            if (name[0] == '.' || de->d_type == DT_DIR) continue;
+            FileName output;
+            parseFileName(name, &output);
+            files.emplace_back(StringPrintf("%s/%s", STATS_DATA_DIR, fileName.c_str()), output);
+        }
     }
 
-    dirent* de;
-    while ((de = readdir(dir.get()))) {
-        char* name = de->d_name;
-        string fileName(name);
-        if (name[0] == '.' || de->d_type == DT_DIR) continue;
-        FileName output;
-        parseFileName(name, &output);
+    // The reports are appended in the order they were written.
+    std::stable_sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+        return a.second.mTimestampSec < b.second.mTimestampSec;
+    });
+    const auto appendReport = [proto](const string& report) {
+        proto->write(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_REPORTS, report.c_str(),
+                     report.size());
+    };
 
+    // The report logs aren't appended to while they are read and renamed.
+    std::lock_guard<std::mutex> lock(sReportLogMutex);
+    for (const auto& file : files) {
+        const string& fullPathName = file.first;
+        const FileName& output = file.second;
         if (output.mTimestampSec == -1 || (output.mIsHistory && !isAdb) ||
             output.mUid != key.GetUid() || output.mConfigId != key.GetId()) {
             continue;
         }
 
-        auto fullPathName = StringPrintf("%s/%s", STATS_DATA_DIR, fileName.c_str());
         int fd = open(fullPathName.c_str(), O_RDONLY | O_CLOEXEC);
-        if (fd != -1) {
+        if (fd != -1 && output.mIsLog) {
+            readReportLogRecords(fd, fullPathName, [&](const string& record) {
+                string report = record;
+                if (isCompressedReport(report) && !decompressReport(&report)) {
+                    ALOGE("Failed to decompress a record of %s", fullPathName.c_str());
+                } else {
+                    appendReport(report);
+                }
+            });
+            close(fd);
+        } else if (fd != -1) {
             string content;
-            if (android::base::ReadFdToString(fd, &content)) {
-                proto->write(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_REPORTS,
-                             content.c_str(), content.size());
+            if (!android::base::ReadFdToString(fd, &content)) {
+                VLOG("Failed to read file %s", fullPathName.c_str());
+            } else if (isCompressedReport(content) && !decompressReport(&content)) {
+                ALOGE("Failed to decompress file %s", fullPathName.c_str());
+            } else {
+                appendReport(content);
             }
             close(fd);
         } else {
             ALOGE("file cannot be opened");
         }
 
+        if (output.mIsLog && !output.mIsHistory && (erase_data || !isAdb)) {
+            // The next reports are appended to a new segment.
+            sActiveReportLogs.erase(key);
+        }
         if (erase_data) {
-            remove(fullPathName.c_str());
+            if (remove(fullPathName.c_str()) == 0) {
+                noteDataFileRemoved(fullPathName);
+            }
         } else if (!output.mIsHistory && !isAdb) {
             // This means a real data owner has called to get this data. But the config says it
             // wants to keep a local history. So now this file must be renamed as a history file.
@@ -594,6 +1132,9 @@ void StorageManager::appendConfigMetricsReport(const ConfigKey& key, ProtoOutput
             // again. rename returns 0 on success
             if (rename(fullPathName.c_str(), (fullPathName + "_history").c_str())) {
                 ALOGE("Failed to rename file %s", fullPathName.c_str());
+            } else {
+                noteDataFileRemoved(fullPathName);
+                noteDataFileWritten(fullPathName + "_history");
             }
         }
     }
@@ -613,6 +1154,35 @@ bool StorageManager::readFileToString(const char* file, string* content) {
     return res;
 }
 
+bool StorageManager::readProtoFromFile(const char* file, google::protobuf::MessageLite* proto) {
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        VLOG("Attempt to read %s but failed", file);
+        return false;
+    }
+    bool success = false;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size > INT_MAX) {
+        ALOGE("Attempt to read %s but failed", file);
+    } else if (fileStat.st_size == 0) {
+        // An empty file can't be mapped, it is an empty proto.
+        success = proto->ParseFromArray(nullptr, 0);
+    } else {
+        void* data = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            ALOGE("Attempt to map %s but failed", file);
+        } else {
+            success = proto->ParseFromArray(data, fileStat.st_size);
+            munmap(data, fileStat.st_size);
+        }
+    }
+    close(fd);
+    if (!success) {
+        ALOGE("Failed to parse %s", file);
+    }
+    return success;
+}
+
 void StorageManager::readConfigFromDisk(map<ConfigKey, StatsdConfig>& configsMap) {
     unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_SERVICE_DIR), closedir);
     if (dir == NULL) {
@@ -621,6 +1191,7 @@ void StorageManager::readConfigFromDisk(map<ConfigKey, StatsdConfig>& configsMap
     }
     trimToFit(STATS_SERVICE_DIR);
 
+    vector<std::pair<ConfigKey, string>> files;
     dirent* de;
     while ((de = readdir(dir.get()))) {
         char* name = de->d_name;
@@ -629,35 +1200,54 @@ void StorageManager::readConfigFromDisk(map<ConfigKey, StatsdConfig>& configsMap
         FileName output;
         parseFileName(name, &output);
         if (output.mTimestampSec == -1) continue;
-        string file_name = output.getFullFileName(STATS_SERVICE_DIR);
-        int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
-        if (fd != -1) {
-            string content;
-            if (android::base::ReadFdToString(fd, &content)) {
-                StatsdConfig config;
-                if (config.ParseFromString(content)) {
-                    configsMap[ConfigKey(output.mUid, output.mConfigId)] = config;
-                    VLOG("map key uid=%lld|configID=%lld", (long long)output.mUid,
-                         (long long)output.mConfigId);
-                }
-            }
-            close(fd);
+        files.emplace_back(ConfigKey(output.mUid, output.mConfigId),
+                           output.getFullFileName(STATS_SERVICE_DIR));
+    }
+
+    // The configs are parsed concurrently, since this delays the startup of statsd.
+    vector<StatsdConfig> configs(files.size());
+    // Not a vector<bool>, which can't be written concurrently.
+    vector<char> parsed(files.size(), false);
+    vector<int64_t> parseLatenciesNs(files.size(), 0);
+    auto parseConfig = [&files, &configs, &parsed, &parseLatenciesNs](size_t i) {
+        const int64_t parseStartNs = getElapsedRealtimeNs();
+        parsed[i] = readProtoFromFile(files[i].second.c_str(), &configs[i]);
+        parseLatenciesNs[i] = getElapsedRealtimeNs() - parseStartNs;
+    };
+    const size_t numThreads =
+            std::min({files.size(), kMaxConfigParsingThreads,
+                      (size_t)std::max(1u, std::thread::hardware_concurrency())});
+    if (numThreads < 2) {
+        for (size_t i = 0; i < files.size(); i++) {
+            parseConfig(i);
         }
+    } else {
+        ShardWorkerPool workerPool(numThreads);
+        for (size_t i = 0; i < files.size(); i++) {
+            workerPool.post(i % numThreads, [&parseConfig, i] { parseConfig(i); });
+        }
+        workerPool.waitForIdle();
     }
-}
 
-bool StorageManager::readConfigFromDisk(const ConfigKey& key, StatsdConfig* config) {
-    string content;
-    return config != nullptr &&
-        StorageManager::readConfigFromDisk(key, &content) && config->ParseFromString(content);
+    for (size_t i = 0; i < files.size(); i++) {
+        if (parsed[i]) {
+            const ConfigKey& key = files[i].first;
+            StatsdStats::getInstance().noteConfigParsed(key, parseLatenciesNs[i]);
+            configsMap[key] = std::move(configs[i]);
+            VLOG("map key uid=%lld|configID=%lld", (long long)key.GetUid(),
+                 (long long)key.GetId());
+        }
+    }
 }
 
-bool StorageManager::readConfigFromDisk(const ConfigKey& key, string* content) {
+// Returns the path of the file of the config in STATS_SERVICE_DIR, or an empty string if there is
+// none.
+static string findConfigFile(const ConfigKey& key) {
     unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_SERVICE_DIR),
                                              closedir);
     if (dir == NULL) {
         VLOG("Directory does not exist: %s", STATS_SERVICE_DIR);
-        return false;
+        return "";
     }
 
     string suffix = StringPrintf("%d_%lld", key.GetUid(), (long long)key.GetId());
@@ -672,28 +1262,32 @@ bool StorageManager::readConfigFromDisk(const ConfigKey& key, string* content) {
         // There can be at most one file that matches this suffix (config key).
         if (suffixLen <= nameLen &&
             strncmp(name + nameLen - suffixLen, suffix.c_str(), suffixLen) == 0) {
-            int fd = open(StringPrintf("%s/%s", STATS_SERVICE_DIR, name).c_str(),
-                                  O_RDONLY | O_CLOEXEC);
-            if (fd != -1) {
-                bool success = android::base::ReadFdToString(fd, content);
-                close(fd);
-                return success;
-            }
+            return StringPrintf("%s/%s", STATS_SERVICE_DIR, name);
         }
     }
-    return false;
+    return "";
 }
 
-bool StorageManager::hasIdenticalConfig(const ConfigKey& key,
-                                        const vector<uint8_t>& config) {
-    string content;
-    if (StorageManager::readConfigFromDisk(key, &content)) {
-        vector<uint8_t> vec(content.begin(), content.end());
-        if (vec == config) {
-            return true;
-        }
+bool StorageManager::readConfigFromDisk(const ConfigKey& key, StatsdConfig* config) {
+    if (config == nullptr) {
+        return false;
     }
-    return false;
+    const string file = findConfigFile(key);
+    return !file.empty() && readProtoFromFile(file.c_str(), config);
+}
+
+bool StorageManager::readConfigFromDisk(const ConfigKey& key, string* content) {
+    const string file = findConfigFile(key);
+    if (file.empty()) {
+        return false;
+    }
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    bool success = android::base::ReadFdToString(fd, content);
+    close(fd);
+    return success;
 }
 
 void StorageManager::sortFiles(vector<FileInfo>* fileNames) {
@@ -721,48 +1315,83 @@ void StorageManager::sortFiles(vector<FileInfo>* fileNames) {
 }
 
 void StorageManager::trimToFit(const char* path, bool parseTimestampOnly) {
-    unique_ptr<DIR, decltype(&closedir)> dir(opendir(path), closedir);
-    if (dir == NULL) {
-        VLOG("Path %s does not exist", path);
-        return;
-    }
-    dirent* de;
     int totalFileSize = 0;
     vector<FileInfo> fileNames;
     auto nowSec = getWallClockSec();
-    while ((de = readdir(dir.get()))) {
-        char* name = de->d_name;
-        if (name[0] == '.' || de->d_type == DT_DIR) continue;
-
-        FileName output;
-        string file_name;
-        if (parseTimestampOnly) {
-            file_name = StringPrintf("%s/%s", path, name);
-            output.mTimestampSec = StrToInt64(strtok(name, "_"));
-            output.mIsHistory = false;
-        } else {
-            parseFileName(name, &output);
-            file_name = output.getFullFileName(path);
+    // The report logs are compacted before the limits are enforced.
+    vector<std::pair<string, DataFileInfo>> reportLogs;
+    vector<std::pair<string, DataFileInfo>> indexedFiles;
+    if (!parseTimestampOnly && strcmp(path, STATS_DATA_DIR) == 0 &&
+        getIndexedDataFiles(&indexedFiles)) {
+        for (const auto& [file_name, info] : indexedFiles) {
+            long fileAge = nowSec - info.mName.mTimestampSec;
+            if (fileAge > StatsdStats::kMaxAgeSecond ||
+                (info.mName.mIsHistory && fileAge > StatsdStats::kMaxLocalHistoryAgeSecond)) {
+                deleteFile(file_name.c_str());
+                continue;
+            }
+            if (info.mName.mIsLog) {
+                reportLogs.emplace_back(file_name, info);
+                continue;
+            }
+            totalFileSize += info.mFileSizeBytes;
+            fileNames.emplace_back(file_name, info.mName.mIsHistory, info.mFileSizeBytes,
+                                   fileAge);
         }
-        if (output.mTimestampSec == -1) continue;
-
-        // Check for timestamp and delete if it's too old.
-        long fileAge = nowSec - output.mTimestampSec;
-        if (fileAge > StatsdStats::kMaxAgeSecond ||
-            (output.mIsHistory && fileAge > StatsdStats::kMaxLocalHistoryAgeSecond)) {
-            deleteFile(file_name.c_str());
-            continue;
+    } else {
+        unique_ptr<DIR, decltype(&closedir)> dir(opendir(path), closedir);
+        if (dir == NULL) {
+            VLOG("Path %s does not exist", path);
+            return;
         }
+        dirent* de;
+        while ((de = readdir(dir.get()))) {
+            char* name = de->d_name;
+            if (name[0] == '.' || de->d_type == DT_DIR) continue;
 
-        ifstream file(file_name.c_str(), ifstream::in | ifstream::binary);
-        int fileSize = 0;
-        if (file.is_open()) {
-            file.seekg(0, ios::end);
-            fileSize = file.tellg();
-            file.close();
+            FileName output;
+            string file_name;
+            if (parseTimestampOnly) {
+                file_name = StringPrintf("%s/%s", path, name);
+                output.mTimestampSec = StrToInt64(strtok(name, "_"));
+                output.mIsHistory = false;
+            } else {
+                parseFileName(name, &output);
+                file_name = output.getFullFileName(path);
+            }
+            if (output.mTimestampSec == -1) continue;
+
+            // Check for timestamp and delete if it's too old.
+            long fileAge = nowSec - output.mTimestampSec;
+            if (fileAge > StatsdStats::kMaxAgeSecond ||
+                (output.mIsHistory && fileAge > StatsdStats::kMaxLocalHistoryAgeSecond)) {
+                deleteFile(file_name.c_str());
+                continue;
+            }
+
+            ifstream file(file_name.c_str(), ifstream::in | ifstream::binary);
+            int fileSize = 0;
+            if (file.is_open()) {
+                file.seekg(0, ios::end);
+                fileSize = file.tellg();
+                file.close();
+            }
+            if (output.mIsLog) {
+                reportLogs.emplace_back(file_name, DataFileInfo{output, fileSize});
+                continue;
+            }
             totalFileSize += fileSize;
+            fileNames.emplace_back(file_name, output.mIsHistory, fileSize, fileAge);
+        }
+    }
+
+    if (!reportLogs.empty()) {
+        compactReportLogs(&reportLogs);
+        for (const auto& [file_name, info] : reportLogs) {
+            totalFileSize += info.mFileSizeBytes;
+            fileNames.emplace_back(file_name, info.mName.mIsHistory, info.mFileSizeBytes,
+                                   nowSec - info.mName.mTimestampSec);
         }
-        fileNames.emplace_back(file_name, output.mIsHistory, fileSize, fileAge);
     }
 
     if (fileNames.size() > StatsdStats::kMaxFileNumber ||
@@ -786,6 +1415,25 @@ void StorageManager::printStats(int outFd) {
 
 void StorageManager::printDirStats(int outFd, const char* path) {
     dprintf(outFd, "Printing stats of %s\n", path);
+    vector<std::pair<string, DataFileInfo>> indexedFiles;
+    if (strcmp(path, STATS_DATA_DIR) == 0 && getIndexedDataFiles(&indexedFiles)) {
+        int fileCount = 0;
+        int64_t totalFileSize = 0;
+        for (const auto& [file, info] : indexedFiles) {
+            fileCount++;
+            dprintf(outFd,
+                    "\t #%d, Last updated: %lld, UID: %d, Config ID: %lld, %s, File Size: %lld "
+                    "bytes\n",
+                    fileCount, (long long)info.mName.mTimestampSec, info.mName.mUid,
+                    (long long)info.mName.mConfigId,
+                    (info.mName.mIsHistory ? "local history" : ""),
+                    (long long)info.mFileSizeBytes);
+            totalFileSize += info.mFileSizeBytes;
+        }
+        dprintf(outFd, "\tTotal number of files: %d, Total size of files: %lld bytes.\n",
+                fileCount, (long long)totalFileSize);
+        return;
+    }
     unique_ptr<DIR, decltype(&closedir)> dir(opendir(path), closedir);
     if (dir == NULL) {
         VLOG("Path %s does not exist", path);
@@ -837,6 +1485,10 @@ void StorageManager::enforceDbGuardrails(const char* path, const int64_t currWal
     while ((de = readdir(dir.get()))) {
         char* name = de->d_name;
         if (name[0] == '.' || de->d_type == DT_DIR) continue;
+        // The write-ahead logs are removed with their db.
+        if (android::base::EndsWith(name, "-wal") || android::base::EndsWith(name, "-shm")) {
+            continue;
+        }
         string fullPathName = StringPrintf("%s/%s", path, name);
         struct stat fileInfo;
         const ConfigKey key = parseDbName(name);
@@ -850,11 +1502,11 @@ void StorageManager::enforceDbGuardrails(const char* path, const int64_t currWal
                                                               fileInfo.st_size);
         if (fileInfo.st_mtime <= deleteThresholdSec) {
             StatsdStats::getInstance().noteDbTooOld(key);
-            remove(fullPathName.c_str());
+            removeDbFile(fullPathName, key);
         }
         if (fileInfo.st_size >= maxBytes) {
             StatsdStats::getInstance().noteDbSizeExceeded(key);
-            remove(fullPathName.c_str());
+            removeDbFile(fullPathName, key);
         }
         if (hasFile(dbutils::getDbName(key).c_str())) {
             dbutils::verifyIntegrityAndDeleteIfNecessary(key);
@@ -18,6 +18,7 @@
 #define STORAGE_MANAGER_H
 
 #include <android/util/ProtoOutputStream.h>
+#include <google/protobuf/message_lite.h>
 #include <utils/Log.h>
 #include <utils/RefBase.h>
 
@@ -59,6 +60,41 @@ public:
      */
     static void writeFile(const char* file, const void* buffer, int numBytes);
 
+    /**
+     * Same as above, but writes the encoded buffers of proto without flattening them first.
+     */
+    static void writeFile(const char* file, ProtoOutputStream& proto);
+
+    /**
+     * Same as above, but writes to a hidden file in the same directory first, then syncs it and
+     * renames it to file, so that a partially written file is never read. Returns false if the
+     * write failed.
+     */
+    static bool writeFileAtomically(const char* file, ProtoOutputStream& proto);
+
+    /**
+     * Enables compressing the files written from a ProtoOutputStream, which are the reports, with
+     * zstd. Both compressed and uncompressed reports are read by appendConfigMetricsReport.
+     */
+    static void setCompressReports(bool compressReports);
+
+    /**
+     * Enables keeping an in-memory index of the reports in the stats-data directory, with their
+     * size, timestamp and config key. It is built from the directory when enabled and kept up to
+     * date by the writes and deletes done here, so the reports of a config are found, trimmed and
+     * printed without listing the directory.
+     */
+    static void setDataDirIndex(bool enabled);
+
+    /**
+     * Enables appending the reports written to data files to an append-only log per config
+     * instead, so that periodic writes don't each create a file. A log is made of segment files,
+     * each a sequence of records framed with the size and CRC-32 of the report. The records are
+     * read back in order by appendConfigMetricsReport, which drops a corrupted tail. trimToFit
+     * merges the segments of a config which aren't full.
+     */
+    static void setReportLogs(bool reportLogs);
+
     /**
      * Writes train info.
      */
@@ -84,6 +120,12 @@ public:
      */
     static bool readFileToString(const char* file, string* content);
 
+    /**
+     * Parses the file into proto straight from a read-only mapping of it, without copying its
+     * content first. Returns false if the file can't be read or parsed.
+     */
+    static bool readProtoFromFile(const char* file, google::protobuf::MessageLite* proto);
+
     /**
      * Deletes a single file given a file name.
      */
@@ -145,12 +187,6 @@ public:
      */
     static void trimToFit(const char* dir, bool parseTimestampOnly = false);
 
-    /**
-     * Returns true if there already exists identical configuration on device.
-     */
-    static bool hasIdenticalConfig(const ConfigKey& key,
-                                   const vector<uint8_t>& config);
-
     /**
      * Prints disk usage statistics related to statsd.
      */
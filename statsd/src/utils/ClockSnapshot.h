@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <optional>
+
+#include "stats_log_util.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * The current time for the processing of an event, or of a batch of events. Each clock is read the
+ * first time it is needed, and the same value is returned afterwards, so that the configs see the
+ * same "now" and the clocks are not read for every config.
+ * Not thread safe, the snapshot is owned by the thread processing the events.
+ */
+class ClockSnapshot {
+public:
+    ClockSnapshot() = default;
+
+    ClockSnapshot(const ClockSnapshot&) = delete;
+    ClockSnapshot& operator=(const ClockSnapshot&) = delete;
+
+    int64_t getElapsedRealtimeNs() {
+        if (!mElapsedRealtimeNs.has_value()) {
+            mElapsedRealtimeNs = ::android::os::statsd::getElapsedRealtimeNs();
+        }
+        return *mElapsedRealtimeNs;
+    }
+
+    int64_t getWallClockNs() {
+        if (!mWallClockNs.has_value()) {
+            mWallClockNs = ::android::os::statsd::getWallClockNs();
+        }
+        return *mWallClockNs;
+    }
+
+private:
+    std::optional<int64_t> mElapsedRealtimeNs;
+    std::optional<int64_t> mWallClockNs;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -22,11 +22,16 @@
 
 #include <android/api-level.h>
 
+#include <map>
+#include <memory>
+#include <mutex>
+
 #include "FieldValue.h"
 #include "android-base/properties.h"
 #include "android-base/stringprintf.h"
 #include "stats_log_util.h"
 #include "storage/StorageManager.h"
+#include "utils/ShardWorkerPool.h"
 
 namespace android {
 namespace os {
@@ -40,6 +45,8 @@ using ::android::os::statsd::StorageManager;
 using ::android::os::statsd::STRING;
 using base::GetProperty;
 using base::StringPrintf;
+using std::map;
+using std::pair;
 
 const string TABLE_NAME_PREFIX = "metric_";
 const string COLUMN_NAME_ATOM_TAG = "atomId";
@@ -57,14 +64,32 @@ const string COLUMN_NAME_BRAND = "brand";
 const string COLUMN_NAME_MANUFACTURER = "manufacturer";
 const string COLUMN_NAME_BOARD = "board";
 
-static std::vector<std::string> getExpectedTableSchema(const LogEvent& logEvent) {
+// A connection to the db of a config, with the insert statements prepared on it.
+struct DbConnection {
+    sqlite3* db = nullptr;
+    // Insert statement of each metric table, with its number of parameters.
+    map<int64_t, pair<sqlite3_stmt*, int>> insertStmts;
+};
+
+// Guards the connections kept open, see setPersistentDbConnections.
+static std::mutex sDbConnectionsMutex;
+static bool sPersistentDbConnections = false;
+static map<ConfigKey, DbConnection> sDbConnections;
+// Read-only connections kept for the queries, not in use by a query.
+static map<ConfigKey, sqlite3*> sQueryConnections;
+// Incremented when connections are closed, so that the connection of a query running meanwhile is
+// closed instead of being kept.
+static uint64_t sDbConnectionsGeneration = 0;
+
+// Guards the db writer thread, see setAsyncDbWrites.
+static std::mutex sDbWriterMutex;
+static std::shared_ptr<ShardWorkerPool> sDbWriter;
+
+static std::vector<std::string> getExpectedTableSchema(
+        const vector<RestrictedEventBuffer::Column>& columns) {
     vector<std::string> result;
-    for (const FieldValue& fieldValue : logEvent.getValues()) {
-        if (fieldValue.mField.getDepth() > 0) {
-            // Repeated fields are not supported.
-            continue;
-        }
-        switch (fieldValue.mValue.getType()) {
+    for (const RestrictedEventBuffer::Column& column : columns) {
+        switch (column.type) {
             case INT:
             case LONG:
                 result.push_back("INTEGER");
@@ -76,7 +101,6 @@ static std::vector<std::string> getExpectedTableSchema(const LogEvent& logEvent)
                 result.push_back("REAL");
                 break;
             default:
-                // Byte array fields are not supported.
                 break;
         }
     }
@@ -96,36 +120,38 @@ string getDbName(const ConfigKey& key) {
                         (long long)key.GetId());
 }
 
-static string getCreateSqlString(const int64_t metricId, const LogEvent& event) {
+static string getCreateSqlString(const int64_t metricId,
+                                 const vector<RestrictedEventBuffer::Column>& columns) {
     string result = StringPrintf("CREATE TABLE IF NOT EXISTS %s%s", TABLE_NAME_PREFIX.c_str(),
                                  reformatMetricId(metricId).c_str());
     result += StringPrintf("(%s INTEGER,%s INTEGER,%s INTEGER,", COLUMN_NAME_ATOM_TAG.c_str(),
                            COLUMN_NAME_EVENT_ELAPSED_CLOCK_NS.c_str(),
                            COLUMN_NAME_EVENT_WALL_CLOCK_NS.c_str());
-    for (size_t fieldId = 1; fieldId <= event.getValues().size(); ++fieldId) {
-        const FieldValue& fieldValue = event.getValues()[fieldId - 1];
-        if (fieldValue.mField.getDepth() > 0) {
-            // Repeated fields are not supported.
-            continue;
-        }
-        switch (fieldValue.mValue.getType()) {
+    for (const RestrictedEventBuffer::Column& column : columns) {
+        switch (column.type) {
             case INT:
             case LONG:
-                result += StringPrintf("field_%d INTEGER,", fieldValue.mField.getPosAtDepth(0));
+                result += StringPrintf("field_%d INTEGER,", column.pos);
                 break;
             case STRING:
-                result += StringPrintf("field_%d TEXT,", fieldValue.mField.getPosAtDepth(0));
+                result += StringPrintf("field_%d TEXT,", column.pos);
                 break;
             case FLOAT:
-                result += StringPrintf("field_%d REAL,", fieldValue.mField.getPosAtDepth(0));
+                result += StringPrintf("field_%d REAL,", column.pos);
                 break;
             default:
-                // Byte array fields are not supported.
                 break;
         }
     }
     result.pop_back();
     result += ") STRICT;";
+    // The TTL enforcement deletes by wall clock timestamp, and avoids a full scan of the table
+    // with this index. Tables created without it get it on their first flush after a restart.
+    result += StringPrintf("CREATE INDEX IF NOT EXISTS %s%s_%s ON %s%s(%s);",
+                           TABLE_NAME_PREFIX.c_str(), reformatMetricId(metricId).c_str(),
+                           COLUMN_NAME_EVENT_WALL_CLOCK_NS.c_str(), TABLE_NAME_PREFIX.c_str(),
+                           reformatMetricId(metricId).c_str(),
+                           COLUMN_NAME_EVENT_WALL_CLOCK_NS.c_str());
     return result;
 }
 
@@ -134,7 +160,8 @@ string reformatMetricId(const int64_t metricId) {
                         : StringPrintf("%lld", (long long)metricId);
 }
 
-bool createTableIfNeeded(const ConfigKey& key, const int64_t metricId, const LogEvent& event) {
+static bool createTableIfNeeded(const ConfigKey& key, const int64_t metricId,
+                                const vector<RestrictedEventBuffer::Column>& columns) {
     const string dbName = getDbName(key);
     sqlite3* db;
     if (sqlite3_open(dbName.c_str(), &db) != SQLITE_OK) {
@@ -143,7 +170,7 @@ bool createTableIfNeeded(const ConfigKey& key, const int64_t metricId, const Log
     }
 
     char* error = nullptr;
-    string zSql = getCreateSqlString(metricId, event);
+    string zSql = getCreateSqlString(metricId, columns);
     sqlite3_exec(db, zSql.c_str(), nullptr, nullptr, &error);
     sqlite3_close(db);
     if (error) {
@@ -153,7 +180,17 @@ bool createTableIfNeeded(const ConfigKey& key, const int64_t metricId, const Log
     return true;
 }
 
-bool isEventCompatible(const ConfigKey& key, const int64_t metricId, const LogEvent& event) {
+bool createTableIfNeeded(const ConfigKey& key, const int64_t metricId, const LogEvent& event) {
+    return createTableIfNeeded(key, metricId, RestrictedEventBuffer::getColumns(event));
+}
+
+bool createTableIfNeeded(const ConfigKey& key, const int64_t metricId,
+                         const RestrictedEventBuffer& events) {
+    return createTableIfNeeded(key, metricId, events.getColumns());
+}
+
+static bool isEventCompatible(const ConfigKey& key, const int64_t metricId,
+                              const vector<RestrictedEventBuffer::Column>& columns) {
     const string dbName = getDbName(key);
     sqlite3* db;
     if (sqlite3_open(dbName.c_str(), &db) != SQLITE_OK) {
@@ -184,7 +221,16 @@ bool isEventCompatible(const ConfigKey& key, const int64_t metricId, const LogEv
     }
     sqlite3_close(db);
     // An empty rows vector implies the table has not yet been created.
-    return rows.size() == 0 || getExpectedTableSchema(event) == tableSchema;
+    return rows.size() == 0 || getExpectedTableSchema(columns) == tableSchema;
+}
+
+bool isEventCompatible(const ConfigKey& key, const int64_t metricId, const LogEvent& event) {
+    return isEventCompatible(key, metricId, RestrictedEventBuffer::getColumns(event));
+}
+
+bool isEventCompatible(const ConfigKey& key, const int64_t metricId,
+                       const RestrictedEventBuffer& events) {
+    return isEventCompatible(key, metricId, events.getColumns());
 }
 
 bool deleteTable(const ConfigKey& key, const int64_t metricId) {
@@ -198,6 +244,18 @@ bool deleteTable(const ConfigKey& key, const int64_t metricId) {
     char* error = nullptr;
     sqlite3_exec(db, zSql.c_str(), nullptr, nullptr, &error);
     sqlite3_close(db);
+    {
+        // The insert statement of the table is prepared again once it is created again.
+        std::lock_guard<std::mutex> lock(sDbConnectionsMutex);
+        auto it = sDbConnections.find(key);
+        if (it != sDbConnections.end()) {
+            auto stmtIt = it->second.insertStmts.find(metricId);
+            if (stmtIt != it->second.insertStmts.end()) {
+                sqlite3_finalize(stmtIt->second.first);
+                it->second.insertStmts.erase(stmtIt);
+            }
+        }
+    }
     if (error) {
         ALOGW("Failed to drop table from db: %s", error);
         return false;
@@ -206,8 +264,11 @@ bool deleteTable(const ConfigKey& key, const int64_t metricId) {
 }
 
 void deleteDb(const ConfigKey& key) {
+    closeDbConnection(key);
     const string dbName = getDbName(key);
     StorageManager::deleteFile(dbName.c_str());
+    StorageManager::deleteFile((dbName + "-wal").c_str());
+    StorageManager::deleteFile((dbName + "-shm").c_str());
 }
 
 sqlite3* getDb(const ConfigKey& key) {
@@ -223,142 +284,426 @@ void closeDb(sqlite3* db) {
     sqlite3_close(db);
 }
 
-static bool getInsertSqlStmt(sqlite3* db, sqlite3_stmt** stmt, const int64_t metricId,
-                             const vector<LogEvent>& events, string& err) {
-    string result =
-            StringPrintf("INSERT INTO metric_%s VALUES", reformatMetricId(metricId).c_str());
-    for (auto& logEvent : events) {
-        result += StringPrintf("(%d, %lld, %lld,", logEvent.GetTagId(),
-                               (long long)logEvent.GetElapsedTimestampNs(),
-                               (long long)logEvent.GetLogdTimestampNs());
-        for (auto& fieldValue : logEvent.getValues()) {
-            if (fieldValue.mField.getDepth() > 0 || fieldValue.mValue.getType() == STORAGE) {
-                // Repeated fields and byte fields are not supported.
-                continue;
-            }
-            result += "?,";
+static void finalizeInsertStmts(DbConnection& connection) {
+    for (auto& stmt : connection.insertStmts) {
+        sqlite3_finalize(stmt.second.first);
+    }
+    connection.insertStmts.clear();
+}
+
+static bool isInsertedField(const FieldValue& fieldValue) {
+    // Repeated fields and byte fields are not supported.
+    return fieldValue.mField.getDepth() == 0 && fieldValue.mValue.getType() != STORAGE;
+}
+
+// Returns the number of the parameters of the insert statement for the event.
+static int getInsertParamCount(const LogEvent& event) {
+    int paramCount = 3;  // Atom id, elapsed and wall clock timestamps.
+    for (const FieldValue& fieldValue : event.getValues()) {
+        if (isInsertedField(fieldValue)) {
+            ++paramCount;
         }
-        result.pop_back();
-        result += "),";
     }
-    result.pop_back();
-    result += ";";
-    if (sqlite3_prepare_v2(db, result.c_str(), -1, stmt, nullptr) != SQLITE_OK) {
+    return paramCount;
+}
+
+static bool prepareInsertStmt(sqlite3* db, const int64_t metricId, int paramCount,
+                              sqlite3_stmt** stmt, string& err) {
+    string zSql = StringPrintf("INSERT INTO metric_%s VALUES(", reformatMetricId(metricId).c_str());
+    for (int i = 0; i < paramCount; ++i) {
+        zSql += "?,";
+    }
+    zSql.back() = ')';
+    if (sqlite3_prepare_v2(db, zSql.c_str(), -1, stmt, nullptr) != SQLITE_OK) {
         err = sqlite3_errmsg(db);
         return false;
     }
-    // ? parameters start with an index of 1 from start of query string to the
-    // end.
+    return true;
+}
+
+static void bindInsertParams(sqlite3_stmt* stmt, const LogEvent& logEvent) {
+    // ? parameters start with an index of 1.
     int32_t index = 1;
-    for (auto& logEvent : events) {
-        for (auto& fieldValue : logEvent.getValues()) {
-            if (fieldValue.mField.getDepth() > 0 || fieldValue.mValue.getType() == STORAGE) {
-                // Repeated fields and byte fields are not supported.
-                continue;
-            }
-            switch (fieldValue.mValue.getType()) {
-                case INT:
-                    sqlite3_bind_int(*stmt, index, fieldValue.mValue.int_value);
-                    break;
-                case LONG:
-                    sqlite3_bind_int64(*stmt, index, fieldValue.mValue.long_value);
-                    break;
-                case STRING:
-                    sqlite3_bind_text(*stmt, index, fieldValue.mValue.str_value.c_str(), -1,
-                                      SQLITE_STATIC);
-                    break;
-                case FLOAT:
-                    sqlite3_bind_double(*stmt, index, fieldValue.mValue.float_value);
-                    break;
-                default:
-                    // Byte array fields are not supported.
-                    break;
-            }
-            ++index;
+    sqlite3_bind_int(stmt, index++, logEvent.GetTagId());
+    sqlite3_bind_int64(stmt, index++, logEvent.GetElapsedTimestampNs());
+    sqlite3_bind_int64(stmt, index++, logEvent.GetLogdTimestampNs());
+    for (const FieldValue& fieldValue : logEvent.getValues()) {
+        if (!isInsertedField(fieldValue)) {
+            continue;
+        }
+        switch (fieldValue.mValue.getType()) {
+            case INT:
+                sqlite3_bind_int(stmt, index, fieldValue.mValue.int_value);
+                break;
+            case LONG:
+                sqlite3_bind_int64(stmt, index, fieldValue.mValue.long_value);
+                break;
+            case STRING:
+                sqlite3_bind_text(stmt, index, fieldValue.mValue.str_value.c_str(), -1,
+                                  SQLITE_STATIC);
+                break;
+            case FLOAT:
+                sqlite3_bind_double(stmt, index, fieldValue.mValue.float_value);
+                break;
+            default:
+                break;
+        }
+        ++index;
+    }
+}
+
+// Returns the cached insert statement of the metric, preparing it if it's missing or has a
+// different number of parameters. Returns nullptr if an error occurs.
+static sqlite3_stmt* getInsertStmt(DbConnection& connection, const int64_t metricId,
+                                   int paramCount, string& error) {
+    pair<sqlite3_stmt*, int>& insertStmt = connection.insertStmts[metricId];
+    if (insertStmt.first == nullptr || insertStmt.second != paramCount) {
+        sqlite3_finalize(insertStmt.first);
+        insertStmt.first = nullptr;
+        if (!prepareInsertStmt(connection.db, metricId, paramCount, &insertStmt.first, error)) {
+            ALOGW("Failed to generate prepared sql insert query %s", error.c_str());
+            sqlite3_finalize(insertStmt.first);
+            connection.insertStmts.erase(metricId);
+            return nullptr;
         }
+        insertStmt.second = paramCount;
+    }
+    return insertStmt.first;
+}
+
+// Steps the bound insert statement and resets it.
+static bool stepInsertStmt(sqlite3* db, sqlite3_stmt* stmt, string& error) {
+    const bool inserted = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!inserted) {
+        error = sqlite3_errmsg(db);
+        ALOGW("Failed to insert data to db: %s", error.c_str());
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return inserted;
+}
+
+// Runs insertRows in a single transaction so that either all or none of the rows are inserted.
+static bool insertInTransaction(sqlite3* db, const std::function<bool()>& insertRows,
+                                string& error) {
+    if (sqlite3_exec(db, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        ALOGW("Failed to begin the insert transaction: %s", error.c_str());
+        return false;
+    }
+    if (!insertRows()) {
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        ALOGW("Failed to commit the insert transaction: %s", error.c_str());
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
     }
     return true;
 }
 
-bool insert(const ConfigKey& key, const int64_t metricId, const vector<LogEvent>& events,
-            string& error) {
+// Inserts the events one at a time with the cached insert statement of the metric.
+static bool insertEvents(DbConnection& connection, const int64_t metricId,
+                         const vector<LogEvent>& events, string& error) {
+    return insertInTransaction(
+            connection.db,
+            [&] {
+                for (const LogEvent& logEvent : events) {
+                    sqlite3_stmt* stmt = getInsertStmt(connection, metricId,
+                                                       getInsertParamCount(logEvent), error);
+                    if (stmt == nullptr) {
+                        return false;
+                    }
+                    bindInsertParams(stmt, logEvent);
+                    if (!stepInsertStmt(connection.db, stmt, error)) {
+                        return false;
+                    }
+                }
+                return true;
+            },
+            error);
+}
+
+static bool insertEvents(DbConnection& connection, const int64_t metricId,
+                         const RestrictedEventBuffer& events, string& error) {
+    return insertInTransaction(
+            connection.db,
+            [&] {
+                // Atom id, elapsed and wall clock timestamps, then the columns.
+                sqlite3_stmt* stmt = getInsertStmt(connection, metricId,
+                                                   3 + events.getColumns().size(), error);
+                if (stmt == nullptr) {
+                    return false;
+                }
+                for (size_t i = 0; i < events.getNumEvents(); ++i) {
+                    events.bind(stmt, i);
+                    if (!stepInsertStmt(connection.db, stmt, error)) {
+                        return false;
+                    }
+                }
+                return true;
+            },
+            error);
+}
+
+// Returns the connection kept to the db of the config, opening it if needed. Returns nullptr if
+// an error occurs.
+static DbConnection* getDbConnectionLocked(const ConfigKey& key, string& error) {
+    auto it = sDbConnections.find(key);
+    if (it != sDbConnections.end()) {
+        return &it->second;
+    }
     const string dbName = getDbName(key);
     sqlite3* db;
     if (sqlite3_open(dbName.c_str(), &db) != SQLITE_OK) {
         error = sqlite3_errmsg(db);
         sqlite3_close(db);
-        return false;
+        return nullptr;
     }
-    bool success = insert(db, metricId, events, error);
-    sqlite3_close(db);
-    return success;
+    // With write-ahead logging, synchronous=NORMAL only syncs on checkpoints and can't corrupt
+    // the db. The last transactions may be lost on a power loss, but not on a crash of statsd.
+    if (sqlite3_exec(db, "PRAGMA journal_mode=WAL;", nullptr, nullptr, nullptr) != SQLITE_OK ||
+        sqlite3_exec(db, "PRAGMA synchronous=NORMAL;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        sqlite3_close(db);
+        return nullptr;
+    }
+    DbConnection& connection = sDbConnections[key];
+    connection.db = db;
+    return &connection;
 }
 
-bool insert(sqlite3* db, const int64_t metricId, const vector<LogEvent>& events, string& error) {
-    sqlite3_stmt* stmt = nullptr;
-    if (!getInsertSqlStmt(db, &stmt, metricId, events, error)) {
-        ALOGW("Failed to generate prepared sql insert query %s", error.c_str());
-        sqlite3_finalize(stmt);
-        return false;
+static void closeDbConnectionLocked(map<ConfigKey, DbConnection>::iterator it) {
+    finalizeInsertStmts(it->second);
+    sqlite3_close(it->second.db);
+    sDbConnections.erase(it);
+}
+
+void setPersistentDbConnections(bool persistentDbConnections) {
+    std::lock_guard<std::mutex> lock(sDbConnectionsMutex);
+    sPersistentDbConnections = persistentDbConnections;
+    if (persistentDbConnections) {
+        return;
     }
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        error = sqlite3_errmsg(db);
-        ALOGW("Failed to insert data to db: %s", error.c_str());
-        sqlite3_finalize(stmt);
-        return false;
+    while (!sDbConnections.empty()) {
+        closeDbConnectionLocked(sDbConnections.begin());
     }
-    sqlite3_finalize(stmt);
-    return true;
+    for (const auto& [key, db] : sQueryConnections) {
+        sqlite3_close(db);
+    }
+    sQueryConnections.clear();
+    ++sDbConnectionsGeneration;
 }
 
-bool query(const ConfigKey& key, const string& zSql, vector<vector<string>>& rows,
-           vector<int32_t>& columnTypes, vector<string>& columnNames, string& err) {
+void closeDbConnection(const ConfigKey& key) {
+    std::lock_guard<std::mutex> lock(sDbConnectionsMutex);
+    auto it = sDbConnections.find(key);
+    if (it != sDbConnections.end()) {
+        closeDbConnectionLocked(it);
+    }
+    auto queryIt = sQueryConnections.find(key);
+    if (queryIt != sQueryConnections.end()) {
+        sqlite3_close(queryIt->second);
+        sQueryConnections.erase(queryIt);
+    }
+    ++sDbConnectionsGeneration;
+}
+
+// Takes the read-only connection kept to the db of the config, or opens one. Returns nullptr if
+// an error occurs. The connection must be passed back to releaseQueryConnection.
+static sqlite3* acquireQueryConnection(const ConfigKey& key, uint64_t* generation, string& err) {
+    {
+        std::lock_guard<std::mutex> lock(sDbConnectionsMutex);
+        *generation = sDbConnectionsGeneration;
+        auto it = sQueryConnections.find(key);
+        if (it != sQueryConnections.end()) {
+            sqlite3* db = it->second;
+            sQueryConnections.erase(it);
+            return db;
+        }
+    }
     const string dbName = getDbName(key);
     sqlite3* db;
     if (sqlite3_open_v2(dbName.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
         err = sqlite3_errmsg(db);
         sqlite3_close(db);
+        return nullptr;
+    }
+    return db;
+}
+
+// Keeps the connection for the next query if connections are persistent and none was closed
+// since it was acquired, closes it otherwise.
+static void releaseQueryConnection(const ConfigKey& key, sqlite3* db, uint64_t generation) {
+    {
+        std::lock_guard<std::mutex> lock(sDbConnectionsMutex);
+        if (sPersistentDbConnections && generation == sDbConnectionsGeneration &&
+            sQueryConnections.emplace(key, db).second) {
+            return;
+        }
+    }
+    sqlite3_close(db);
+}
+
+void setAsyncDbWrites(bool asyncDbWrites) {
+    std::shared_ptr<ShardWorkerPool> oldDbWriter;
+    {
+        std::lock_guard<std::mutex> lock(sDbWriterMutex);
+        if (asyncDbWrites == (sDbWriter != nullptr)) {
+            return;
+        }
+        oldDbWriter = std::move(sDbWriter);
+        if (asyncDbWrites) {
+            sDbWriter = std::make_shared<ShardWorkerPool>(1);
+        }
+    }
+    // The pending writes are run when the old writer is destroyed, outside of the lock since they
+    // may pass more writes.
+    oldDbWriter = nullptr;
+}
+
+void runDbWrite(std::function<void()> write) {
+    {
+        std::lock_guard<std::mutex> lock(sDbWriterMutex);
+        if (sDbWriter != nullptr) {
+            sDbWriter->post(0, std::move(write));
+            return;
+        }
+    }
+    write();
+}
+
+void waitForDbWrites() {
+    std::shared_ptr<ShardWorkerPool> dbWriter;
+    {
+        std::lock_guard<std::mutex> lock(sDbWriterMutex);
+        dbWriter = sDbWriter;
+    }
+    if (dbWriter != nullptr) {
+        dbWriter->waitForIdle();
+    }
+}
+
+// Inserts the events into the db of the config, on the connection kept to it if connections are
+// persistent, on a temporary one otherwise.
+template <typename Events>
+static bool insertIntoDb(const ConfigKey& key, const int64_t metricId, const Events& events,
+                         string& error) {
+    {
+        std::lock_guard<std::mutex> lock(sDbConnectionsMutex);
+        if (sPersistentDbConnections) {
+            DbConnection* connection = getDbConnectionLocked(key, error);
+            return connection != nullptr && insertEvents(*connection, metricId, events, error);
+        }
+    }
+    const string dbName = getDbName(key);
+    DbConnection connection;
+    if (sqlite3_open(dbName.c_str(), &connection.db) != SQLITE_OK) {
+        error = sqlite3_errmsg(connection.db);
+        sqlite3_close(connection.db);
+        return false;
+    }
+    bool success = insertEvents(connection, metricId, events, error);
+    finalizeInsertStmts(connection);
+    sqlite3_close(connection.db);
+    return success;
+}
+
+bool insert(const ConfigKey& key, const int64_t metricId, const vector<LogEvent>& events,
+            string& error) {
+    return insertIntoDb(key, metricId, events, error);
+}
+
+bool insert(const ConfigKey& key, const int64_t metricId, const RestrictedEventBuffer& events,
+            string& error) {
+    return insertIntoDb(key, metricId, events, error);
+}
+
+bool insert(sqlite3* db, const int64_t metricId, const vector<LogEvent>& events, string& error) {
+    DbConnection connection;
+    connection.db = db;
+    bool success = insertEvents(connection, metricId, events, error);
+    finalizeInsertStmts(connection);
+    return success;
+}
+
+// Runs the query and calls onRow for each row of the result, with the statement stepped to it.
+static bool query(const ConfigKey& key, const string& zSql, vector<int32_t>& columnTypes,
+                  vector<string>& columnNames, const std::function<void(sqlite3_stmt*)>& onRow,
+                  string& err) {
+    uint64_t generation;
+    sqlite3* db = acquireQueryConnection(key, &generation, err);
+    if (db == nullptr) {
         return false;
     }
     sqlite3_stmt* stmt;
     if (sqlite3_prepare_v2(db, zSql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
         err = sqlite3_errmsg(db);
         sqlite3_finalize(stmt);
-        sqlite3_close(db);
+        releaseQueryConnection(key, db, generation);
         return false;
     }
     int result = sqlite3_step(stmt);
-    bool firstIter = true;
-    while (result == SQLITE_ROW) {
-        int colCount = sqlite3_column_count(stmt);
-        vector<string> rowData(colCount);
+    if (result == SQLITE_ROW) {
+        const int colCount = sqlite3_column_count(stmt);
         for (int i = 0; i < colCount; ++i) {
-            if (firstIter) {
-                int32_t columnType = sqlite3_column_type(stmt, i);
-                // Needed to convert to java compatible cursor types. See AbstractCursor#getType()
-                if (columnType == 5) {
-                    columnType = 0;  // Remap 5 (null type) to 0 for java cursor
-                }
-                columnTypes.push_back(columnType);
-                columnNames.push_back(reinterpret_cast<const char*>(sqlite3_column_name(stmt, i)));
+            int32_t columnType = sqlite3_column_type(stmt, i);
+            // Needed to convert to java compatible cursor types. See AbstractCursor#getType()
+            if (columnType == 5) {
+                columnType = 0;  // Remap 5 (null type) to 0 for java cursor
             }
-            const unsigned char* textResult = sqlite3_column_text(stmt, i);
-            string colData =
-                    textResult != nullptr ? string(reinterpret_cast<const char*>(textResult)) : "";
-            rowData[i] = std::move(colData);
+            columnTypes.push_back(columnType);
+            columnNames.push_back(reinterpret_cast<const char*>(sqlite3_column_name(stmt, i)));
         }
-        rows.push_back(std::move(rowData));
-        firstIter = false;
+    }
+    while (result == SQLITE_ROW) {
+        onRow(stmt);
         result = sqlite3_step(stmt);
     }
     sqlite3_finalize(stmt);
     if (result != SQLITE_DONE) {
         err = sqlite3_errmsg(db);
-        sqlite3_close(db);
-        return false;
     }
-    sqlite3_close(db);
-    return true;
+    releaseQueryConnection(key, db, generation);
+    return result == SQLITE_DONE;
+}
+
+// Returns the text of the column of the row the statement is stepped to.
+static string getColumnText(sqlite3_stmt* stmt, int column) {
+    const unsigned char* textResult = sqlite3_column_text(stmt, column);
+    return textResult != nullptr ? string(reinterpret_cast<const char*>(textResult)) : "";
+}
+
+bool query(const ConfigKey& key, const string& zSql, vector<vector<string>>& rows,
+           vector<int32_t>& columnTypes, vector<string>& columnNames, string& err) {
+    return query(
+            key, zSql, columnTypes, columnNames,
+            [&rows](sqlite3_stmt* stmt) {
+                const int colCount = sqlite3_column_count(stmt);
+                vector<string> rowData(colCount);
+                for (int i = 0; i < colCount; ++i) {
+                    rowData[i] = getColumnText(stmt, i);
+                }
+                rows.push_back(std::move(rowData));
+            },
+            err);
+}
+
+bool query(const ConfigKey& key, const string& zSql, vector<string>& queryData, int32_t& rowCount,
+           vector<int32_t>& columnTypes, vector<string>& columnNames, string& err) {
+    rowCount = 0;
+    return query(
+            key, zSql, columnTypes, columnNames,
+            [&queryData, &rowCount](sqlite3_stmt* stmt) {
+                const int colCount = sqlite3_column_count(stmt);
+                for (int i = 0; i < colCount; ++i) {
+                    queryData.push_back(getColumnText(stmt, i));
+                }
+                ++rowCount;
+            },
+            err);
 }
 
 bool flushTtl(sqlite3* db, const int64_t metricId, const int64_t ttlWallClockNs) {
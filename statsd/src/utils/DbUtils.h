@@ -17,8 +17,11 @@
 
 #include <sqlite3.h>
 
+#include <functional>
+
 #include "config/ConfigKey.h"
 #include "logd/LogEvent.h"
+#include "utils/RestrictedEventBuffer.h"
 
 using std::string;
 using std::vector;
@@ -41,15 +44,23 @@ string reformatMetricId(const int64_t metricId);
 /* Creates a new data table for a specified metric if one does not yet exist. */
 bool createTableIfNeeded(const ConfigKey& key, int64_t metricId, const LogEvent& event);
 
+/* Same as above, for the columns of the buffered events. */
+bool createTableIfNeeded(const ConfigKey& key, int64_t metricId,
+                         const RestrictedEventBuffer& events);
+
 /* Checks whether the table schema for the given metric matches the event.
  * Returns true if the table has not yet been created.
  */
 bool isEventCompatible(const ConfigKey& key, int64_t metricId, const LogEvent& event);
 
+/* Same as above, for the columns of the buffered events. */
+bool isEventCompatible(const ConfigKey& key, int64_t metricId,
+                       const RestrictedEventBuffer& events);
+
 /* Deletes a data table for the specified metric. */
 bool deleteTable(const ConfigKey& key, int64_t metricId);
 
-/* Deletes the SQLite db data file. */
+/* Deletes the SQLite db data file, and its write-ahead log. */
 void deleteDb(const ConfigKey& key);
 
 /* Gets a handle to the sqlite db. You must call closeDb to free the allocated memory.
@@ -60,20 +71,54 @@ sqlite3* getDb(const ConfigKey& key);
 /* Closes the handle to the sqlite db. */
 void closeDb(sqlite3* db);
 
+/* Enables keeping a connection open to the db of each config for the inserts, instead of opening
+ * one for each insert. The connections use write-ahead logging with synchronous=NORMAL, and cache
+ * the insert statement of each metric. The read-only connections of the queries are kept too.
+ * Disabling closes the connections.
+ */
+void setPersistentDbConnections(bool persistentDbConnections);
+
+/* Closes the connections kept to the db of the config, if any. */
+void closeDbConnection(const ConfigKey& key);
+
+/* Enables running the writes passed to runDbWrite on a dedicated thread, in the order they are
+ * passed. Disabling runs the pending writes and stops the thread.
+ */
+void setAsyncDbWrites(bool asyncDbWrites);
+
+/* Runs the write on the db writer thread if enabled, see setAsyncDbWrites, or on the calling thread
+ * otherwise. Writes that must stay ordered with the inserts, e.g. deleting a db, go through here.
+ */
+void runDbWrite(std::function<void()> write);
+
+/* Blocks until the writes passed to runDbWrite before the call are completed. */
+void waitForDbWrites();
+
 /* Inserts new data into the specified metric data table.
- * A temp sqlite handle is created using the ConfigKey.
+ * A temp sqlite handle is created using the ConfigKey, unless connections are persistent.
+ * The events are inserted one at a time in a single transaction.
  */
 bool insert(const ConfigKey& key, int64_t metricId, const vector<LogEvent>& events, string& error);
 
+/* Same as above, binding the buffered events straight into the insert statement. */
+bool insert(const ConfigKey& key, int64_t metricId, const RestrictedEventBuffer& events,
+            string& error);
+
 /* Inserts new data into the specified sqlite db handle. */
 bool insert(sqlite3* db, int64_t metricId, const vector<LogEvent>& events, string& error);
 
 /* Executes a sql query on the specified SQLite db.
- * A temp sqlite handle is created using the ConfigKey.
+ * A temp sqlite handle is created using the ConfigKey, unless connections are persistent.
  */
 bool query(const ConfigKey& key, const string& zSql, vector<vector<string>>& rows,
            vector<int32_t>& columnTypes, vector<string>& columnNames, string& err);
 
+/* Same as above, but appends the cells of the rows to queryData one row after the other, without
+ * a vector for each row.
+ */
+bool query(const ConfigKey& key, const string& zSql, vector<string>& queryData, int32_t& rowCount,
+           vector<int32_t>& columnTypes, vector<string>& columnNames, string& err);
+
 bool flushTtl(sqlite3* db, int64_t metricId, int64_t ttlWallClockNs);
 
 /* Checks for database corruption and deletes the db if it is corrupted. */
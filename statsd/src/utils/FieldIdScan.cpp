@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "utils/FieldIdScan.h"
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace android {
+namespace os {
+namespace statsd {
+
+uint64_t matchFieldIds(const int32_t* fieldIds, size_t count, int32_t mask, int32_t value) {
+    uint64_t matches = 0;
+    size_t i = 0;
+#if defined(__aarch64__)
+    const int32x4_t maskVec = vdupq_n_s32(mask);
+    const int32x4_t valueVec = vdupq_n_s32(value);
+    const uint32x4_t laneBits = {1, 2, 4, 8};
+    for (; i + 4 <= count; i += 4) {
+        const uint32x4_t eq = vceqq_s32(vandq_s32(vld1q_s32(fieldIds + i), maskVec), valueVec);
+        matches |= (uint64_t)vaddvq_u32(vandq_u32(eq, laneBits)) << i;
+    }
+#elif defined(__SSE2__)
+    const __m128i maskVec = _mm_set1_epi32(mask);
+    const __m128i valueVec = _mm_set1_epi32(value);
+    for (; i + 4 <= count; i += 4) {
+        const __m128i ids = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fieldIds + i));
+        const __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(ids, maskVec), valueVec);
+        matches |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(eq)) << i;
+    }
+#endif
+    for (; i < count; i++) {
+        if ((fieldIds[i] & mask) == value) {
+            matches |= 1ULL << i;
+        }
+    }
+    return matches;
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
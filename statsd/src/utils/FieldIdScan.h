@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+// Maximum number of field ids compared by a single matchFieldIds() call.
+constexpr size_t kFieldIdScanBlockSize = 64;
+
+/**
+ * Compares the encoded fields fieldIds[0, count) with value after applying mask, 4 fields at a time
+ * with NEON on arm64 or SSE2 on x86.
+ *
+ * Returns a bit mask where bit i is set if (fieldIds[i] & mask) == value. count must not exceed
+ * kFieldIdScanBlockSize.
+ */
+uint64_t matchFieldIds(const int32_t* fieldIds, size_t count, int32_t mask, int32_t value);
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
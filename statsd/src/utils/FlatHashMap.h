@@ -0,0 +1,538 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Hash map with open addressing, used for the per dimension state of the metric producers.
+ *
+ * Entries are stored in a single array in insertion order instead of one heap node per entry. An
+ * open addressing table, probed linearly, maps the keys to their entry. Each slot of the table has
+ * a control byte with 7 bits of the hash of the entry key, so a lookup only compares the keys of
+ * entries whose hash bits match, which avoids most comparisons of dimension keys.
+ *
+ * The API is the subset of std::unordered_map used by statsd, with these differences:
+ * - Inserting may move all entries: iterators, pointers and references to entries are invalidated
+ *   by insertions (but not by erasures).
+ * - Iteration goes from the most recently inserted entry to the oldest. This is the order of
+ *   std::unordered_map for keys in different buckets, so reports keep listing the dimensions in the
+ *   same order. Erasing while iterating with it = map.erase(it) is supported.
+ * - Erased entries leave a hole in the entries array until the map is rehashed.
+ */
+template <typename Key, typename T, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class FlatHashMap {
+public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef size_t size_type;
+    typedef Hash hasher;
+    typedef KeyEqual key_equal;
+    typedef value_type& reference;
+    typedef const value_type& const_reference;
+
+    template <bool IsConst>
+    class Iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename FlatHashMap::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef std::conditional_t<IsConst, const value_type*, value_type*> pointer;
+        typedef std::conditional_t<IsConst, const value_type&, value_type&> reference;
+
+        Iterator() = default;
+
+        // Conversion of iterator to const_iterator.
+        template <bool WasConst, typename = std::enable_if_t<IsConst && !WasConst>>
+        Iterator(const Iterator<WasConst>& that) : mMap(that.mMap), mPos(that.mPos) {
+        }
+
+        inline reference operator*() const {
+            return mMap->getEntry(mPos - 1);
+        }
+
+        inline pointer operator->() const {
+            return &mMap->getEntry(mPos - 1);
+        }
+
+        inline Iterator& operator++() {
+            mPos = mMap->previousFull(mPos - 1);
+            return *this;
+        }
+
+        inline Iterator operator++(int) {
+            Iterator it = *this;
+            ++*this;
+            return it;
+        }
+
+        inline bool operator==(const Iterator& that) const {
+            return mPos == that.mPos;
+        }
+
+        inline bool operator!=(const Iterator& that) const {
+            return mPos != that.mPos;
+        }
+
+    private:
+        typedef std::conditional_t<IsConst, const FlatHashMap*, FlatHashMap*> MapPointer;
+
+        Iterator(MapPointer map, size_t pos) : mMap(map), mPos(pos) {
+        }
+
+        MapPointer mMap = nullptr;
+        // Index of the entry + 1, 0 for end().
+        size_t mPos = 0;
+
+        template <bool>
+        friend class Iterator;
+        friend class FlatHashMap;
+    };
+
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    FlatHashMap() = default;
+
+    FlatHashMap(const FlatHashMap& that) {
+        *this = that;
+    }
+
+    FlatHashMap(FlatHashMap&& that) noexcept {
+        swap(that);
+    }
+
+    ~FlatHashMap() {
+        destroyEntries();
+    }
+
+    FlatHashMap& operator=(const FlatHashMap& that) {
+        if (this != &that) {
+            clear();
+            reserve(that.mSize);
+            // Oldest entries first to keep the iteration order.
+            for (size_t i = 0; i < that.mEntriesEnd; i++) {
+                if (that.mEntryFull[i]) {
+                    const value_type& entry = that.getEntry(i);
+                    try_emplace(entry.first, entry.second);
+                }
+            }
+        }
+        return *this;
+    }
+
+    FlatHashMap& operator=(FlatHashMap&& that) noexcept {
+        if (this != &that) {
+            FlatHashMap empty;
+            swap(empty);
+            swap(that);
+        }
+        return *this;
+    }
+
+    inline iterator begin() {
+        return iterator(this, previousFull(mEntriesEnd));
+    }
+
+    inline const_iterator begin() const {
+        return const_iterator(this, previousFull(mEntriesEnd));
+    }
+
+    inline const_iterator cbegin() const {
+        return begin();
+    }
+
+    inline iterator end() {
+        return iterator(this, 0);
+    }
+
+    inline const_iterator end() const {
+        return const_iterator(this, 0);
+    }
+
+    inline const_iterator cend() const {
+        return end();
+    }
+
+    inline size_t size() const {
+        return mSize;
+    }
+
+    inline bool empty() const {
+        return mSize == 0;
+    }
+
+    // Number of entries that can be stored before the map is rehashed.
+    inline size_t capacity() const {
+        return getMaxLoad(mTableSize);
+    }
+
+    // Bytes allocated by the map, not including memory allocated by the entries.
+    inline size_t getAllocatedBytes() const {
+        return mTableSize * (sizeof(uint8_t) + sizeof(uint32_t)) +
+               capacity() * (sizeof(Slot) + sizeof(bool));
+    }
+
+    // Destroys all entries, the allocations are kept for the entries inserted next.
+    void clear() {
+        destroyEntries();
+        if (mTableSize > 0) {
+            memset(mCtrl.get(), kEmpty, mTableSize);
+        }
+        mSize = 0;
+        mEntriesEnd = 0;
+        mDeletedSlots = 0;
+    }
+
+    void reserve(size_t count) {
+        if (count > capacity()) {
+            rehash(getTableSizeFor(count));
+        }
+    }
+
+    inline iterator find(const Key& key) {
+        return iterator(this, findPos(key));
+    }
+
+    inline const_iterator find(const Key& key) const {
+        return const_iterator(this, findPos(key));
+    }
+
+    // Finds the entry of a key borrowed as another type K, without building a Key from it. The
+    // borrowed key is hashed with Hash()(key) and compared with key == entryKey, which must agree
+    // with the hash and the equality of Key.
+    template <typename K>
+    iterator findBorrowed(const K& key) {
+        if (mSize == 0) {
+            return end();
+        }
+        const uint64_t hash = static_cast<uint64_t>(Hash()(key)) * kHashMultiplier;
+        const uint8_t ctrl = getCtrl(hash);
+        const size_t mask = mTableSize - 1;
+        for (size_t slot = getHomeSlot(hash);; slot = (slot + 1) & mask) {
+            const uint8_t slotCtrl = mCtrl[slot];
+            if (slotCtrl == kEmpty) {
+                return end();
+            }
+            if (slotCtrl == ctrl && key == mEntries[mIndex[slot]].entry.first) {
+                return iterator(this, mIndex[slot] + 1);
+            }
+        }
+    }
+
+    inline size_t count(const Key& key) const {
+        return findPos(key) != 0 ? 1 : 0;
+    }
+
+    inline bool contains(const Key& key) const {
+        return findPos(key) != 0;
+    }
+
+    inline T& operator[](const Key& key) {
+        return try_emplace(key).first->second;
+    }
+
+    inline T& operator[](Key&& key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+        const uint64_t hash = getHash(key);
+        const size_t slot = findSlot(key, hash);
+        if (slot != mTableSize) {
+            return {iterator(this, mIndex[slot] + 1), false};
+        }
+        if (mEntriesEnd == capacity() || mSize + mDeletedSlots == capacity()) {
+            // Double the table if the map is mostly full of entries, otherwise only remove the
+            // holes & deleted slots.
+            rehash(mSize >= capacity() / 2 ? getTableSizeFor(mSize * 2) : mTableSize);
+        }
+        const size_t index = mEntriesEnd;
+        new (&mEntries[index].entry)
+                Entry(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                      std::forward_as_tuple(std::forward<Args>(args)...));
+        mEntryFull[index] = true;
+        mEntriesEnd++;
+        mSize++;
+        insertInTable(hash, index);
+        return {iterator(this, index + 1), true};
+    }
+
+    template <typename K, typename V>
+    inline std::pair<iterator, bool> emplace(K&& key, V&& value) {
+        return try_emplace(std::forward<K>(key), std::forward<V>(value));
+    }
+
+    inline std::pair<iterator, bool> insert(const value_type& value) {
+        return try_emplace(value.first, value.second);
+    }
+
+    inline std::pair<iterator, bool> insert(value_type&& value) {
+        return try_emplace(value.first, std::move(value.second));
+    }
+
+    iterator erase(const_iterator it) {
+        const size_t index = it.mPos - 1;
+        Entry& entry = mEntries[index].entry;
+        const uint64_t hash = getHash(entry.first);
+        const size_t mask = mTableSize - 1;
+        size_t slot = getHomeSlot(hash);
+        while (mCtrl[slot] != getCtrl(hash) || mIndex[slot] != index) {
+            slot = (slot + 1) & mask;
+        }
+        // No probe sequence continues past this slot if the next slot is empty.
+        if (mCtrl[(slot + 1) & mask] == kEmpty) {
+            mCtrl[slot] = kEmpty;
+        } else {
+            mCtrl[slot] = kDeleted;
+            mDeletedSlots++;
+        }
+
+        entry.~Entry();
+        mEntryFull[index] = false;
+        mSize--;
+        if (index + 1 == mEntriesEnd) {
+            mEntriesEnd = previousFull(index);
+        }
+        return iterator(this, previousFull(index));
+    }
+
+    inline iterator erase(iterator it) {
+        return erase(const_iterator(it));
+    }
+
+    size_t erase(const Key& key) {
+        const size_t pos = findPos(key);
+        if (pos == 0) {
+            return 0;
+        }
+        erase(const_iterator(this, pos));
+        return 1;
+    }
+
+    void swap(FlatHashMap& that) noexcept {
+        std::swap(mCtrl, that.mCtrl);
+        std::swap(mIndex, that.mIndex);
+        std::swap(mEntries, that.mEntries);
+        std::swap(mEntryFull, that.mEntryFull);
+        std::swap(mTableSize, that.mTableSize);
+        std::swap(mTableShift, that.mTableShift);
+        std::swap(mDeletedSlots, that.mDeletedSlots);
+        std::swap(mSize, that.mSize);
+        std::swap(mEntriesEnd, that.mEntriesEnd);
+    }
+
+    bool operator==(const FlatHashMap& that) const {
+        if (mSize != that.mSize) {
+            return false;
+        }
+        for (const value_type& entry : *this) {
+            const size_t pos = that.findPos(entry.first);
+            if (pos == 0 || !(that.getEntry(pos - 1).second == entry.second)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    inline bool operator!=(const FlatHashMap& that) const {
+        return !(*this == that);
+    }
+
+private:
+    // Entries are stored with a mutable key so that they can be moved when rehashing, and are
+    // accessed through value_type like std::unordered_map nodes.
+    typedef std::pair<Key, T> Entry;
+
+    union Slot {
+        Slot() {
+        }
+        ~Slot() {
+        }
+        Entry entry;
+    };
+
+    // Control byte of a table slot: 7 bits of the key hash for entries, or one of these values.
+    static constexpr uint8_t kEmpty = 0x80;
+    static constexpr uint8_t kDeleted = 0xfe;
+
+    static constexpr size_t kMinTableSize = 8;
+
+    // Multiplicative hashing spreads the bits of weak hashes (such as integers) to the top bits
+    // used for the slot index.
+    static constexpr uint64_t kHashMultiplier = 0x9e3779b97f4a7c15ull;
+
+    // At most 7/8 of the table slots are used by entries and deleted slots.
+    static inline size_t getMaxLoad(size_t tableSize) {
+        return tableSize - tableSize / 8;
+    }
+
+    // Smallest table size with room for count entries.
+    static size_t getTableSizeFor(size_t count) {
+        size_t tableSize = kMinTableSize;
+        while (getMaxLoad(tableSize) < count) {
+            tableSize *= 2;
+        }
+        return tableSize;
+    }
+
+    inline uint64_t getHash(const Key& key) const {
+        return static_cast<uint64_t>(Hash()(key)) * kHashMultiplier;
+    }
+
+    static inline uint8_t getCtrl(uint64_t hash) {
+        return hash & 0x7f;
+    }
+
+    inline size_t getHomeSlot(uint64_t hash) const {
+        return static_cast<size_t>(hash >> mTableShift);
+    }
+
+    inline value_type& getEntry(size_t index) {
+        return reinterpret_cast<value_type&>(mEntries[index].entry);
+    }
+
+    inline const value_type& getEntry(size_t index) const {
+        return reinterpret_cast<const value_type&>(mEntries[index].entry);
+    }
+
+    // Returns the position (index + 1) of the last entry before pos, or 0.
+    inline size_t previousFull(size_t pos) const {
+        while (pos > 0 && !mEntryFull[pos - 1]) {
+            pos--;
+        }
+        return pos;
+    }
+
+    inline size_t findPos(const Key& key) const {
+        if (mSize == 0) {
+            return 0;
+        }
+        const size_t slot = findSlot(key, getHash(key));
+        return slot != mTableSize ? mIndex[slot] + 1 : 0;
+    }
+
+    // Returns the table slot of the entry with key, or mTableSize.
+    size_t findSlot(const Key& key, uint64_t hash) const {
+        if (mTableSize == 0) {
+            return mTableSize;
+        }
+        const uint8_t ctrl = getCtrl(hash);
+        const size_t mask = mTableSize - 1;
+        for (size_t slot = getHomeSlot(hash);; slot = (slot + 1) & mask) {
+            const uint8_t slotCtrl = mCtrl[slot];
+            if (slotCtrl == kEmpty) {
+                return mTableSize;
+            }
+            if (slotCtrl == ctrl && KeyEqual()(mEntries[mIndex[slot]].entry.first, key)) {
+                return slot;
+            }
+        }
+    }
+
+    // Uses the first empty or deleted slot in the probe sequence of hash.
+    void insertInTable(uint64_t hash, size_t index) {
+        const size_t mask = mTableSize - 1;
+        size_t slot = getHomeSlot(hash);
+        while (mCtrl[slot] != kEmpty && mCtrl[slot] != kDeleted) {
+            slot = (slot + 1) & mask;
+        }
+        if (mCtrl[slot] == kDeleted) {
+            mDeletedSlots--;
+        }
+        mCtrl[slot] = getCtrl(hash);
+        mIndex[slot] = static_cast<uint32_t>(index);
+    }
+
+    void rehash(size_t tableSize) {
+        std::unique_ptr<Slot[]> oldEntries = std::move(mEntries);
+        std::unique_ptr<bool[]> oldEntryFull = std::move(mEntryFull);
+        const size_t oldEntriesEnd = mEntriesEnd;
+
+        mTableSize = tableSize;
+        mTableShift = 64;
+        for (size_t i = tableSize; i > 1; i /= 2) {
+            mTableShift--;
+        }
+        mCtrl.reset(new uint8_t[tableSize]);
+        memset(mCtrl.get(), kEmpty, tableSize);
+        mDeletedSlots = 0;
+        mIndex.reset(new uint32_t[tableSize]);
+        mEntries.reset(new Slot[capacity()]);
+        mEntryFull.reset(new bool[capacity()]());
+
+        // Entries are compacted in the same order.
+        mEntriesEnd = 0;
+        for (size_t i = 0; i < oldEntriesEnd; i++) {
+            if (!oldEntryFull[i]) {
+                continue;
+            }
+            Entry& entry = oldEntries[i].entry;
+            new (&mEntries[mEntriesEnd].entry) Entry(std::move(entry));
+            entry.~Entry();
+            mEntryFull[mEntriesEnd] = true;
+            insertInTable(getHash(mEntries[mEntriesEnd].entry.first), mEntriesEnd);
+            mEntriesEnd++;
+        }
+    }
+
+    void destroyEntries() {
+        for (size_t i = 0; i < mEntriesEnd; i++) {
+            if (mEntryFull[i]) {
+                mEntries[i].entry.~Entry();
+                mEntryFull[i] = false;
+            }
+        }
+    }
+
+    // Open addressing table: control byte & index in mEntries of each slot.
+    std::unique_ptr<uint8_t[]> mCtrl;
+    std::unique_ptr<uint32_t[]> mIndex;
+    // Power of 2, or 0 before the first insertion.
+    size_t mTableSize = 0;
+    // 64 - log2(mTableSize): the slot of a key is given by the top bits of its hash.
+    int mTableShift = 64;
+    size_t mDeletedSlots = 0;
+
+    // Entries in insertion order, with capacity() slots.
+    std::unique_ptr<Slot[]> mEntries;
+    std::unique_ptr<bool[]> mEntryFull;
+    // Index after the last inserted entry.
+    size_t mEntriesEnd = 0;
+    size_t mSize = 0;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "utils/HyperLogLog.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+// Output of SplitMix64 seeded with x.
+uint64_t splitMix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+double getAlpha(size_t numRegisters) {
+    switch (numRegisters) {
+        case 16:
+            return 0.673;
+        case 32:
+            return 0.697;
+        case 64:
+            return 0.709;
+        default:
+            return 0.7213 / (1.0 + 1.079 / numRegisters);
+    }
+}
+
+}  // namespace
+
+HyperLogLog::HyperLogLog(const int precision)
+    : mPrecision(std::clamp(precision, kMinPrecision, kMaxPrecision)),
+      mRegisters(1 << mPrecision) {
+}
+
+void HyperLogLog::add(const uint64_t hash) {
+    const size_t index = hash >> (64 - mPrecision);
+    // The guard bit bounds the rank to 64 - mPrecision + 1 when the remaining bits are all 0.
+    const uint64_t remaining = (hash << mPrecision) | (1ULL << (mPrecision - 1));
+    const uint8_t rank = __builtin_clzll(remaining) + 1;
+    mRegisters[index] = std::max(mRegisters[index], rank);
+}
+
+bool HyperLogLog::merge(const HyperLogLog& other) {
+    if (other.mPrecision != mPrecision) {
+        return false;
+    }
+    for (size_t i = 0; i < mRegisters.size(); i++) {
+        mRegisters[i] = std::max(mRegisters[i], other.mRegisters[i]);
+    }
+    return true;
+}
+
+int64_t HyperLogLog::estimate() const {
+    const double numRegisters = mRegisters.size();
+    double sum = 0;
+    size_t numZeroRegisters = 0;
+    for (const uint8_t rank : mRegisters) {
+        sum += ldexp(1.0, -rank);
+        if (rank == 0) {
+            numZeroRegisters++;
+        }
+    }
+    double estimate = getAlpha(mRegisters.size()) * numRegisters * numRegisters / sum;
+    // Linear counting is more accurate for the small cardinalities. The hashes have 64 bits, so
+    // there is no correction for the large cardinalities.
+    if (estimate <= 2.5 * numRegisters && numZeroRegisters > 0) {
+        estimate = numRegisters * log(numRegisters / numZeroRegisters);
+    }
+    return llround(estimate);
+}
+
+uint64_t HyperLogLog::hash(const int64_t value) {
+    return splitMix64(static_cast<uint64_t>(value));
+}
+
+uint64_t HyperLogLog::hash(const std::string_view value) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char c : value) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+    }
+    return splitMix64(hash);
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
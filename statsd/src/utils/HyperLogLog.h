@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+#include <vector>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * HyperLogLog sketch estimating the number of distinct values added to it, in 2^precision one byte
+ * registers. The relative standard error of the estimate is about 1.04 / sqrt(2^precision).
+ *
+ * The values are added as 64 bit hashes from hash(), which do not depend on the device, so that the
+ * sketches of a metric can be merged across buckets, dimensions and devices by taking the maximum
+ * of each register.
+ */
+class HyperLogLog {
+public:
+    static constexpr int kMinPrecision = 4;
+    static constexpr int kMaxPrecision = 16;
+    static constexpr int kDefaultPrecision = 11;
+
+    // The precision is clamped to [kMinPrecision, kMaxPrecision].
+    explicit HyperLogLog(int precision = kDefaultPrecision);
+
+    void add(uint64_t hash);
+
+    // Returns false, and leaves the sketch unchanged, if the precisions differ.
+    bool merge(const HyperLogLog& other);
+
+    int64_t estimate() const;
+
+    inline int getPrecision() const {
+        return mPrecision;
+    }
+
+    inline const std::vector<uint8_t>& getRegisters() const {
+        return mRegisters;
+    }
+
+    inline size_t byteSize() const {
+        return mRegisters.size();
+    }
+
+    // Output of SplitMix64 seeded with the value.
+    static uint64_t hash(int64_t value);
+
+    // FNV-1a of the bytes, then SplitMix64 seeded with it.
+    static uint64_t hash(std::string_view value);
+
+private:
+    const int mPrecision;
+
+    // Highest rank seen for each register, where the rank is the position of the first set bit of
+    // the hash after its top mPrecision bits, which select the register.
+    std::vector<uint8_t> mRegisters;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
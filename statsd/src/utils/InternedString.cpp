@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "utils/InternedString.h"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+#include "hash.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+// Shards of the pool, selected by the top bits of the string hash so that threads interning
+// different strings rarely contend on the same lock.
+constexpr size_t kPoolShardBits = 4;
+constexpr size_t kPoolShardCount = 1 << kPoolShardBits;
+
+// Shards are not swept until they hold at least this many entries.
+constexpr size_t kMinSweepThreshold = 256;
+
+struct PoolKey {
+    size_t hash;
+    std::string_view str;
+
+    inline bool operator==(const PoolKey& that) const {
+        return hash == that.hash && str == that.str;
+    }
+};
+
+struct PoolKeyHash {
+    inline size_t operator()(const PoolKey& key) const {
+        return key.hash;
+    }
+};
+
+inline size_t getShardIndex(size_t hash) {
+    return hash >> (sizeof(size_t) * 8 - kPoolShardBits);
+}
+
+}  // namespace
+
+struct InternedString::PoolShard {
+    std::mutex mutex;
+    // Keys point to the string owned by the entry.
+    std::unordered_map<PoolKey, Entry*, PoolKeyHash> entries;
+    size_t sweepThreshold = kMinSweepThreshold;
+};
+
+InternedString::PoolShard* InternedString::getPoolShards() {
+    // Never destroyed: InternedStrings held by static objects may be released at exit.
+    static PoolShard* shards = new PoolShard[kPoolShardCount];
+    return shards;
+}
+
+const std::string& InternedString::getEmptyString() {
+    static const std::string* emptyString = new std::string();
+    return *emptyString;
+}
+
+size_t InternedString::getEmptyHash() {
+    static const size_t emptyHash = std::hash<std::string_view>()(std::string_view());
+    return emptyHash;
+}
+
+uint64_t InternedString::hash64() const {
+    if (mEntry == nullptr) {
+        static const uint64_t emptyHash64 = Hash64(getEmptyString());
+        return emptyHash64;
+    }
+    uint64_t hash = mEntry->hash64.load(std::memory_order_relaxed);
+    if (hash == 0) {
+        // Threads racing here compute and store the same value.
+        hash = Hash64(mEntry->str);
+        mEntry->hash64.store(hash, std::memory_order_relaxed);
+    }
+    return hash;
+}
+
+InternedString::InternedString(std::string_view str) {
+    if (!str.empty()) {
+        mEntry = intern(str, nullptr);
+    }
+}
+
+InternedString::InternedString(std::string&& str) {
+    if (!str.empty()) {
+        mEntry = intern(str, &str);
+    }
+}
+
+InternedString::Entry* InternedString::intern(std::string_view str, std::string* ownedStr) {
+    // std::hash of a string_view equals std::hash of a std::string with the same contents.
+    const size_t hash = std::hash<std::string_view>()(str);
+    PoolShard& shard = getPoolShards()[getShardIndex(hash)];
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find({hash, str});
+    if (it != shard.entries.end()) {
+        // The entry may be unreferenced but it can't be swept while the shard lock is held.
+        Entry* entry = it->second;
+        entry->refCount.fetch_add(1, std::memory_order_relaxed);
+        return entry;
+    }
+
+    if (shard.entries.size() >= shard.sweepThreshold) {
+        sweepShardLocked(&shard);
+    }
+
+    Entry* entry = new Entry{{1}, hash,
+                             ownedStr != nullptr ? std::move(*ownedStr) : std::string(str)};
+    shard.entries.emplace(PoolKey{hash, entry->str}, entry);
+    return entry;
+}
+
+size_t InternedString::sweepShardLocked(PoolShard* shard) {
+    size_t numFreed = 0;
+    for (auto entryIt = shard->entries.begin(); entryIt != shard->entries.end();) {
+        Entry* entry = entryIt->second;
+        if (entry->refCount.load(std::memory_order_acquire) == 0) {
+            entryIt = shard->entries.erase(entryIt);
+            delete entry;
+            numFreed++;
+        } else {
+            ++entryIt;
+        }
+    }
+    shard->sweepThreshold = std::max(kMinSweepThreshold, shard->entries.size() * 2);
+    return numFreed;
+}
+
+size_t InternedString::sweepPool() {
+    size_t numFreed = 0;
+    PoolShard* shards = getPoolShards();
+    for (size_t i = 0; i < kPoolShardCount; i++) {
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        numFreed += sweepShardLocked(&shards[i]);
+        // Also gives back the buckets of the freed entries.
+        shards[i].entries.rehash(0);
+    }
+    return numFreed;
+}
+
+size_t InternedString::getPoolSize() {
+    size_t size = 0;
+    PoolShard* shards = getPoolShards();
+    for (size_t i = 0; i < kPoolShardCount; i++) {
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        size += shards[i].entries.size();
+    }
+    return size;
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Immutable string stored once in a process wide pool.
+ *
+ * All InternedStrings with the same contents share one refcounted pool entry, so copying one is an
+ * atomic increment, comparing two for equality is a pointer comparison and the hash of the
+ * contents is computed once when the string is interned. The empty string is not stored in the
+ * pool.
+ *
+ * Entries are not removed from the pool when their last reference goes away, which would require
+ * taking the pool lock on every release. Unreferenced entries are swept instead when the number of
+ * entries in a pool shard doubles since the previous sweep, so strings that keep coming back
+ * (wakelock tags, package names...) are found in the pool without allocating again.
+ */
+class InternedString {
+public:
+    InternedString() = default;
+
+    InternedString(std::string_view str);
+
+    InternedString(const std::string& str) : InternedString(std::string_view(str)) {
+    }
+
+    InternedString(const char* str) : InternedString(std::string_view(str)) {
+    }
+
+    InternedString(std::string&& str);
+
+    InternedString(const InternedString& that) : mEntry(that.mEntry) {
+        acquire();
+    }
+
+    InternedString(InternedString&& that) noexcept : mEntry(std::exchange(that.mEntry, nullptr)) {
+    }
+
+    ~InternedString() {
+        release();
+    }
+
+    InternedString& operator=(const InternedString& that) {
+        if (mEntry != that.mEntry) {
+            release();
+            mEntry = that.mEntry;
+            acquire();
+        }
+        return *this;
+    }
+
+    InternedString& operator=(InternedString&& that) noexcept {
+        if (this != &that) {
+            release();
+            mEntry = std::exchange(that.mEntry, nullptr);
+        }
+        return *this;
+    }
+
+    inline const std::string& str() const {
+        return mEntry != nullptr ? mEntry->str : getEmptyString();
+    }
+
+    inline operator const std::string&() const {
+        return str();
+    }
+
+    inline const char* c_str() const {
+        return str().c_str();
+    }
+
+    inline const char* data() const {
+        return str().data();
+    }
+
+    inline size_t size() const {
+        return mEntry != nullptr ? mEntry->str.size() : 0;
+    }
+
+    inline size_t length() const {
+        return size();
+    }
+
+    inline bool empty() const {
+        return mEntry == nullptr;
+    }
+
+    // Same value as std::hash<std::string>() of the contents.
+    inline size_t hash() const {
+        return mEntry != nullptr ? mEntry->hash : getEmptyHash();
+    }
+
+    // Hash64() of the contents, as written in the reports hashing their strings. Computed once
+    // per pool entry, on first use.
+    uint64_t hash64() const;
+
+    inline bool operator==(const InternedString& that) const {
+        return mEntry == that.mEntry;
+    }
+
+    inline bool operator!=(const InternedString& that) const {
+        return mEntry != that.mEntry;
+    }
+
+    inline bool operator<(const InternedString& that) const {
+        return mEntry != that.mEntry && str() < that.str();
+    }
+
+    inline bool operator>(const InternedString& that) const {
+        return that < *this;
+    }
+
+    inline bool operator<=(const InternedString& that) const {
+        return !(that < *this);
+    }
+
+    inline bool operator>=(const InternedString& that) const {
+        return !(*this < that);
+    }
+
+    // Comparisons with strings that are not interned, these don't look up the pool.
+    friend inline bool operator==(const InternedString& lhs, std::string_view rhs) {
+        return std::string_view(lhs.str()) == rhs;
+    }
+
+    friend inline bool operator==(const InternedString& lhs, const std::string& rhs) {
+        return lhs.str() == rhs;
+    }
+
+    friend inline bool operator==(const InternedString& lhs, const char* rhs) {
+        return strcmp(lhs.c_str(), rhs) == 0;
+    }
+
+    friend inline bool operator==(std::string_view lhs, const InternedString& rhs) {
+        return rhs == lhs;
+    }
+
+    friend inline bool operator==(const std::string& lhs, const InternedString& rhs) {
+        return rhs == lhs;
+    }
+
+    friend inline bool operator==(const char* lhs, const InternedString& rhs) {
+        return rhs == lhs;
+    }
+
+    template <typename T>
+    friend inline bool operator!=(const InternedString& lhs, const T& rhs) {
+        return !(lhs == rhs);
+    }
+
+    template <typename T>
+    friend inline bool operator!=(const T& lhs, const InternedString& rhs) {
+        return !(rhs == lhs);
+    }
+
+    friend inline std::ostream& operator<<(std::ostream& os, const InternedString& str) {
+        return os << str.str();
+    }
+
+    // Number of entries in the pool, including unreferenced entries that were not swept yet.
+    static size_t getPoolSize();
+
+    // Frees the unreferenced entries of the pool now, e.g. under memory pressure. Returns the
+    // number of entries freed.
+    static size_t sweepPool();
+
+private:
+    struct Entry {
+        std::atomic<uint32_t> refCount;
+        size_t hash;
+        std::string str;
+        // 0 until hash64() is first called.
+        std::atomic<uint64_t> hash64{0};
+    };
+
+    struct PoolShard;
+
+    static const std::string& getEmptyString();
+
+    static size_t getEmptyHash();
+
+    static PoolShard* getPoolShards();
+
+    // Frees the unreferenced entries of the shard, whose lock must be held.
+    static size_t sweepShardLocked(PoolShard* shard);
+
+    static Entry* intern(std::string_view str, std::string* ownedStr);
+
+    inline void acquire() {
+        if (mEntry != nullptr) {
+            mEntry->refCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    inline void release() {
+        if (mEntry != nullptr) {
+            // Pairs with the acquire load of the sweep, which frees the entry once unreferenced.
+            mEntry->refCount.fetch_sub(1, std::memory_order_release);
+            mEntry = nullptr;
+        }
+    }
+
+    Entry* mEntry = nullptr;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "utils/MemoryPressureMonitor.h"
+
+#include <android-base/stringprintf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include "stats_log_util.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using android::base::StringPrintf;
+using android::base::unique_fd;
+
+MemoryPressureMonitor::MemoryPressureMonitor(const std::function<void()>& onPressure,
+                                             int64_t minIntervalNs)
+    : mOnPressure(onPressure), mMinIntervalNs(minIntervalNs) {
+}
+
+MemoryPressureMonitor::~MemoryPressureMonitor() {
+    stop();
+}
+
+bool MemoryPressureMonitor::start(const std::string& psiPath, int64_t stallUs, int64_t windowUs) {
+    if (mThread.joinable()) {
+        return true;
+    }
+    unique_fd psiFd(TEMP_FAILURE_RETRY(open(psiPath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC)));
+    if (psiFd < 0) {
+        ALOGW("Memory pressure is not available, failed to open %s: %s", psiPath.c_str(),
+              strerror(errno));
+        return false;
+    }
+    const std::string trigger =
+            StringPrintf("some %lld %lld", (long long)stallUs, (long long)windowUs);
+    // The trigger string includes its terminating null.
+    if (TEMP_FAILURE_RETRY(write(psiFd.get(), trigger.c_str(), trigger.size() + 1)) < 0) {
+        ALOGW("Failed to register the memory pressure trigger \"%s\": %s", trigger.c_str(),
+              strerror(errno));
+        return false;
+    }
+    unique_fd controlFd(eventfd(0, EFD_CLOEXEC));
+    if (controlFd < 0) {
+        ALOGE("Failed to create the memory pressure monitor eventfd: %s", strerror(errno));
+        return false;
+    }
+    mPsiFd = std::move(psiFd);
+    mControlFd = std::move(controlFd);
+    mStopped = false;
+    mThread = std::thread(&MemoryPressureMonitor::threadLoop, this);
+    return true;
+}
+
+void MemoryPressureMonitor::stop() {
+    if (mThread.joinable()) {
+        mStopped = true;
+        const uint64_t one = 1;
+        TEMP_FAILURE_RETRY(write(mControlFd.get(), &one, sizeof(one)));
+        mThread.join();
+    }
+    mPsiFd.reset();
+    mControlFd.reset();
+}
+
+void MemoryPressureMonitor::threadLoop() {
+    prctl(PR_SET_NAME, "statsd.mempress");
+    int64_t lastPressureNs = 0;
+    while (!mStopped) {
+        struct pollfd fds[] = {{.fd = mPsiFd.get(), .events = POLLPRI},
+                               {.fd = mControlFd.get(), .events = POLLIN}};
+        if (TEMP_FAILURE_RETRY(poll(fds, 2, -1)) < 0) {
+            ALOGE("Memory pressure monitor poll failed: %s", strerror(errno));
+            return;
+        }
+        if (fds[0].revents & POLLERR) {
+            // The trigger is gone, e.g. the cgroup of the psi file was removed.
+            ALOGE("Memory pressure trigger failed, stopping the monitor");
+            return;
+        }
+        if (mStopped || !(fds[0].revents & POLLPRI)) {
+            continue;
+        }
+        const int64_t nowNs = getElapsedRealtimeNs();
+        if (lastPressureNs != 0 && nowNs - lastPressureNs < mMinIntervalNs) {
+            VLOG("Memory pressure ignored, last handled %lld ns ago",
+                 (long long)(nowNs - lastPressureNs));
+            continue;
+        }
+        lastPressureNs = nowNs;
+        mPressureCount++;
+        ALOGI("Memory pressure, releasing memory");
+        mOnPressure();
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
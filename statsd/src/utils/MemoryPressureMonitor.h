@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Listens to the memory pressure stall information (PSI) of the kernel on a dedicated thread.
+ *
+ * A PSI trigger is registered for the tasks of the system stalling on memory for stallUs within
+ * windowUs. Each time the trigger fires, onPressure is called on the monitor thread, at most once
+ * per minIntervalNs.
+ */
+class MemoryPressureMonitor {
+public:
+    static constexpr const char* kMemoryPressurePath = "/proc/pressure/memory";
+    // Unprivileged triggers need a window multiple of 2s.
+    static constexpr int64_t kDefaultStallUs = 200000;
+    static constexpr int64_t kDefaultWindowUs = 2000000;
+    static constexpr int64_t kDefaultMinIntervalNs = 60 * 1000000000LL;
+
+    MemoryPressureMonitor(const std::function<void()>& onPressure,
+                          int64_t minIntervalNs = kDefaultMinIntervalNs);
+
+    // Stops the monitor thread.
+    ~MemoryPressureMonitor();
+
+    MemoryPressureMonitor(const MemoryPressureMonitor&) = delete;
+    MemoryPressureMonitor& operator=(const MemoryPressureMonitor&) = delete;
+
+    // Registers the trigger and starts the monitor thread. Returns false if PSI is not available,
+    // e.g. the kernel is built without it.
+    bool start(const std::string& psiPath = kMemoryPressurePath,
+               int64_t stallUs = kDefaultStallUs, int64_t windowUs = kDefaultWindowUs);
+
+    void stop();
+
+    // Number of times onPressure was called.
+    inline int getPressureCount() const {
+        return mPressureCount;
+    }
+
+private:
+    void threadLoop();
+
+    const std::function<void()> mOnPressure;
+
+    const int64_t mMinIntervalNs;
+
+    android::base::unique_fd mPsiFd;
+
+    // wakes up the monitor thread on stop
+    android::base::unique_fd mControlFd;
+
+    std::thread mThread;
+
+    std::atomic<bool> mStopped = false;
+
+    std::atomic<int> mPressureCount = 0;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Encodes proto fields into a contiguous buffer, with the lengths of the embedded messages written
+ * directly instead of being patched afterwards like ProtoOutputStream does.
+ *
+ * Encoding takes two passes with the same calls: a writer without buffer only counts the bytes,
+ * then a writer over a buffer of that size writes them. The sizes of embedded messages must be
+ * known before their fields are written, see sizeOfInt32Field() and the like.
+ */
+class ProtoBufferWriter {
+public:
+    // Counts the bytes only.
+    ProtoBufferWriter() = default;
+
+    explicit ProtoBufferWriter(uint8_t* buffer) : mBuffer(buffer) {
+    }
+
+    static constexpr int kWireTypeVarint = 0;
+    static constexpr int kWireTypeLengthDelimited = 2;
+    static constexpr int kWireTypeFixed32 = 5;
+
+    static size_t sizeOfVarint(uint64_t value) {
+        size_t size = 1;
+        while (value >= 0x80) {
+            value >>= 7;
+            size++;
+        }
+        return size;
+    }
+
+    static size_t sizeOfTag(int fieldNum) {
+        return sizeOfVarint(static_cast<uint32_t>(fieldNum) << 3);
+    }
+
+    static size_t sizeOfInt32Field(int fieldNum, int32_t value) {
+        // Negative values are sign extended to 64 bits.
+        return sizeOfTag(fieldNum) + sizeOfVarint(static_cast<int64_t>(value));
+    }
+
+    static size_t sizeOfBytesField(int fieldNum, size_t size) {
+        return sizeOfTag(fieldNum) + sizeOfVarint(size) + size;
+    }
+
+    bool isCounting() const {
+        return mBuffer == nullptr;
+    }
+
+    // Number of bytes written or counted.
+    size_t size() const {
+        return mSize;
+    }
+
+    void writeInt32(int fieldNum, int32_t value) {
+        writeTag(fieldNum, kWireTypeVarint);
+        writeVarint(static_cast<int64_t>(value));
+    }
+
+    void writeInt64(int fieldNum, int64_t value) {
+        writeTag(fieldNum, kWireTypeVarint);
+        writeVarint(static_cast<uint64_t>(value));
+    }
+
+    void writeFloat(int fieldNum, float value) {
+        writeTag(fieldNum, kWireTypeFixed32);
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        for (int i = 0; i < 4; i++) {
+            writeByte(static_cast<uint8_t>(bits >> (8 * i)));
+        }
+    }
+
+    // Writes a string, bytes, or an encoded message.
+    void writeBytes(int fieldNum, const void* data, size_t size) {
+        writeMessageHeader(fieldNum, size);
+        if (mBuffer != nullptr && size > 0) {
+            memcpy(mBuffer + mSize, data, size);
+        }
+        mSize += size;
+    }
+
+    // Writes the tag and the length of an embedded message, whose fields follow.
+    void writeMessageHeader(int fieldNum, size_t size) {
+        writeTag(fieldNum, kWireTypeLengthDelimited);
+        writeVarint(size);
+    }
+
+    // Counts the bytes of an embedded message whose size was counted separately.
+    void skip(size_t size) {
+        mSize += size;
+    }
+
+private:
+    void writeTag(int fieldNum, int wireType) {
+        writeVarint((static_cast<uint32_t>(fieldNum) << 3) | wireType);
+    }
+
+    void writeVarint(uint64_t value) {
+        if (mBuffer == nullptr) {
+            mSize += sizeOfVarint(value);
+            return;
+        }
+        while (value >= 0x80) {
+            mBuffer[mSize++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        mBuffer[mSize++] = static_cast<uint8_t>(value);
+    }
+
+    void writeByte(uint8_t value) {
+        if (mBuffer != nullptr) {
+            mBuffer[mSize] = value;
+        }
+        mSize++;
+    }
+
+    uint8_t* const mBuffer = nullptr;
+    size_t mSize = 0;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
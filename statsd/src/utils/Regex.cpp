@@ -57,13 +57,24 @@ unique_ptr<Regex> Regex::create(const string& pattern) {
 }
 
 bool Regex::replace(string& str, const string& replacement) {
+    size_t matchStart;
+    size_t matchEnd;
+    if (!search(str, &matchStart, &matchEnd)) {
+        return false;
+    }
+    str.replace(matchStart, matchEnd - matchStart, replacement);
+    return true;
+}
+
+bool Regex::search(const string& str, size_t* matchStart, size_t* matchEnd) const {
     regmatch_t match;
     int status = regexec(&mImpl, str.c_str(), 1 /* nmatch */, &match /* pmatch */, 0 /* flags */);
 
     if (status != 0 || match.rm_so == -1) {  // No match.
         return false;
     }
-    str.replace(match.rm_so, match.rm_eo - match.rm_so, replacement);
+    *matchStart = match.rm_so;
+    *matchEnd = match.rm_eo;
     return true;
 }
 
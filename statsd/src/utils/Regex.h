@@ -39,6 +39,10 @@ public:
     // Returns true if there was a match, false otherwise.
     bool replace(std::string& str, const std::string& replacement);
 
+    // Looks for a regex match in str without modifying it.
+    // Returns true and sets the [matchStart, matchEnd) range of the match if there was a match.
+    bool search(const std::string& str, size_t* matchStart, size_t* matchEnd) const;
+
 private:
     regex_t mImpl;
 };
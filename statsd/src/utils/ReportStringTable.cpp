@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "utils/ReportStringTable.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using android::util::FIELD_COUNT_REPEATED;
+using android::util::FIELD_TYPE_STRING;
+using android::util::ProtoOutputStream;
+using std::set;
+using std::string;
+
+uint64_t ReportStringTable::add(const InternedString& str) {
+    mStrings.insert(str);
+    return str.hash64();
+}
+
+void ReportStringTable::add(const set<string>& strs) {
+    for (const string& str : strs) {
+        mStrings.insert(InternedString(str));
+    }
+}
+
+void ReportStringTable::writeToProto(uint64_t fieldId, ProtoOutputStream* proto) const {
+    for (const InternedString& str : mStrings) {
+        proto->write(FIELD_TYPE_STRING | FIELD_COUNT_REPEATED | fieldId, str.str());
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
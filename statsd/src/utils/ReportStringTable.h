@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/util/ProtoOutputStream.h>
+
+#include <set>
+#include <string>
+#include <unordered_set>
+
+#include "utils/InternedString.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Strings of a report which hashes its strings, see hash_strings_in_metric_report. The
+ * dimensions of the report write the Hash64 of their strings and the strings themselves are
+ * written once at the end of the report.
+ *
+ * The dimension strings are already interned, so each one is deduped by its pool entry with its
+ * precomputed hash, without copying or comparing the contents.
+ */
+class ReportStringTable {
+public:
+    // Adds the string to the table and returns the hash written in its place.
+    uint64_t add(const InternedString& str);
+
+    // Adds strings which are not interned, such as the ones of the uid map.
+    void add(const std::set<std::string>& strs);
+
+    bool contains(const InternedString& str) const {
+        return mStrings.find(str) != mStrings.end();
+    }
+
+    size_t size() const {
+        return mStrings.size();
+    }
+
+    // Writes each string as a repeated string field.
+    void writeToProto(uint64_t fieldId, android::util::ProtoOutputStream* proto) const;
+
+private:
+    struct InternedStringHash {
+        size_t operator()(const InternedString& str) const {
+            return str.hash();
+        }
+    };
+
+    std::unordered_set<InternedString, InternedStringHash> mStrings;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
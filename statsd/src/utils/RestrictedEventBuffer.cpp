@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "utils/RestrictedEventBuffer.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using std::pair;
+using std::vector;
+
+// Repeated fields and byte arrays are not stored.
+static bool isStoredField(const FieldValue& fieldValue) {
+    switch (fieldValue.mValue.getType()) {
+        case INT:
+        case LONG:
+        case FLOAT:
+        case STRING:
+            return fieldValue.mField.getDepth() == 0;
+        default:
+            return false;
+    }
+}
+
+vector<RestrictedEventBuffer::Column> RestrictedEventBuffer::getColumns(const LogEvent& event) {
+    vector<Column> columns;
+    for (const FieldValue& fieldValue : event.getValues()) {
+        if (isStoredField(fieldValue)) {
+            columns.push_back({fieldValue.mField.getPosAtDepth(0), fieldValue.mValue.getType()});
+        }
+    }
+    return columns;
+}
+
+bool RestrictedEventBuffer::append(const LogEvent& event) {
+    const vector<FieldValue>& values = event.getValues();
+    if (empty()) {
+        mColumns = getColumns(event);
+        mIntValues.assign(mColumns.size(), {});
+        mFloatValues.assign(mColumns.size(), {});
+        mStringValues.assign(mColumns.size(), {});
+    } else {
+        // Checked before anything is appended, so that a mismatch leaves the buffer unchanged.
+        size_t column = 0;
+        for (const FieldValue& fieldValue : values) {
+            if (!isStoredField(fieldValue)) {
+                continue;
+            }
+            if (column == mColumns.size() ||
+                mColumns[column].pos != fieldValue.mField.getPosAtDepth(0) ||
+                mColumns[column].type != fieldValue.mValue.getType()) {
+                return false;
+            }
+            ++column;
+        }
+        if (column != mColumns.size()) {
+            return false;
+        }
+    }
+    mAtomIds.push_back(event.GetTagId());
+    mElapsedTimestampsNs.push_back(event.GetElapsedTimestampNs());
+    mWallTimestampsNs.push_back(event.GetLogdTimestampNs());
+    size_t column = 0;
+    for (const FieldValue& fieldValue : values) {
+        if (!isStoredField(fieldValue)) {
+            continue;
+        }
+        switch (fieldValue.mValue.getType()) {
+            case INT:
+                mIntValues[column].push_back(fieldValue.mValue.int_value);
+                break;
+            case LONG:
+                mIntValues[column].push_back(fieldValue.mValue.long_value);
+                break;
+            case FLOAT:
+                mFloatValues[column].push_back(fieldValue.mValue.float_value);
+                break;
+            case STRING: {
+                const std::string& str = fieldValue.mValue.str_value;
+                mStringValues[column].emplace_back(mStringArena.size(), str.size());
+                mStringArena += str;
+                break;
+            }
+            default:
+                break;
+        }
+        ++column;
+    }
+    return true;
+}
+
+void RestrictedEventBuffer::clear() {
+    mColumns.clear();
+    mAtomIds.clear();
+    mElapsedTimestampsNs.clear();
+    mWallTimestampsNs.clear();
+    mIntValues.clear();
+    mFloatValues.clear();
+    mStringValues.clear();
+    mStringArena.clear();
+}
+
+size_t RestrictedEventBuffer::getByteSize() const {
+    size_t byteSize = mAtomIds.size() * (sizeof(int32_t) + 2 * sizeof(int64_t));
+    for (size_t column = 0; column < mColumns.size(); ++column) {
+        byteSize += mIntValues[column].size() * sizeof(int64_t) +
+                    mFloatValues[column].size() * sizeof(float) +
+                    mStringValues[column].size() * sizeof(pair<uint32_t, uint32_t>);
+    }
+    return byteSize + mStringArena.size();
+}
+
+void RestrictedEventBuffer::bind(sqlite3_stmt* stmt, const size_t index) const {
+    // ? parameters start with an index of 1.
+    int32_t param = 1;
+    sqlite3_bind_int(stmt, param++, mAtomIds[index]);
+    sqlite3_bind_int64(stmt, param++, mElapsedTimestampsNs[index]);
+    sqlite3_bind_int64(stmt, param++, mWallTimestampsNs[index]);
+    for (size_t column = 0; column < mColumns.size(); ++column, ++param) {
+        switch (mColumns[column].type) {
+            case INT:
+            case LONG:
+                sqlite3_bind_int64(stmt, param, mIntValues[column][index]);
+                break;
+            case FLOAT:
+                sqlite3_bind_double(stmt, param, mFloatValues[column][index]);
+                break;
+            case STRING: {
+                const pair<uint32_t, uint32_t>& str = mStringValues[column][index];
+                sqlite3_bind_text(stmt, param, mStringArena.data() + str.first, str.second,
+                                  SQLITE_STATIC);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sqlite3.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "FieldValue.h"
+#include "logd/LogEvent.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Restricted events waiting to be inserted into the table of a metric, holding only the columns
+ * of the table.
+ *
+ * The fields are stored per column in typed vectors, and the strings in a single arena. All the
+ * events must have the same columns, i.e. the same top level fields of the same types.
+ */
+class RestrictedEventBuffer {
+public:
+    // A top level field stored in a column of the table.
+    struct Column {
+        // Position of the field in the atom.
+        int32_t pos;
+        // INT, LONG, FLOAT or STRING.
+        Type type;
+    };
+
+    // Returns the columns stored for the fields of the event. Repeated fields and byte arrays
+    // are not stored.
+    static std::vector<Column> getColumns(const LogEvent& event);
+
+    // Appends the event. Returns false, without appending it, if its columns differ from the ones
+    // of the events already appended.
+    bool append(const LogEvent& event);
+
+    void clear();
+
+    inline bool empty() const {
+        return mAtomIds.empty();
+    }
+
+    inline size_t getNumEvents() const {
+        return mAtomIds.size();
+    }
+
+    // Bytes used by the events appended, excluding the allocated capacity.
+    size_t getByteSize() const;
+
+    inline const std::vector<Column>& getColumns() const {
+        return mColumns;
+    }
+
+    // Binds the event to the parameters of an insert statement: the atom id, elapsed and wall
+    // clock timestamps, then the columns. The strings are bound without a copy, so the buffer
+    // must not be modified until the statement is stepped.
+    void bind(sqlite3_stmt* stmt, size_t index) const;
+
+private:
+    std::vector<Column> mColumns;
+
+    std::vector<int32_t> mAtomIds;
+    std::vector<int64_t> mElapsedTimestampsNs;
+    std::vector<int64_t> mWallTimestampsNs;
+
+    // Values of each column, indexed by event. Only the vector of the column type is used.
+    std::vector<std::vector<int64_t>> mIntValues;
+    std::vector<std::vector<float>> mFloatValues;
+    // Offset and size in mStringArena.
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> mStringValues;
+
+    std::string mStringArena;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
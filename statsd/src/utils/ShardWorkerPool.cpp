@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "ShardWorkerPool.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+ShardWorkerPool::ShardWorkerPool(size_t numShards) {
+    mShards.reserve(numShards);
+    for (size_t i = 0; i < numShards; i++) {
+        mShards.push_back(std::make_unique<Shard>());
+    }
+    for (const auto& shard : mShards) {
+        shard->thread = std::thread([this, shard = shard.get()] { runWorker(shard); });
+    }
+}
+
+ShardWorkerPool::~ShardWorkerPool() {
+    for (const auto& shard : mShards) {
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->stopRequested = true;
+        }
+        shard->cv.notify_one();
+    }
+    for (const auto& shard : mShards) {
+        if (shard->thread.joinable()) {
+            shard->thread.join();
+        }
+    }
+}
+
+void ShardWorkerPool::post(size_t shard, std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mPendingMutex);
+        mPendingTasks++;
+    }
+    Shard& target = *mShards[shard];
+    {
+        std::lock_guard<std::mutex> lock(target.mutex);
+        target.tasks.push_back(std::move(task));
+    }
+    target.cv.notify_one();
+}
+
+void ShardWorkerPool::waitForIdle() {
+    std::unique_lock<std::mutex> lock(mPendingMutex);
+    mPendingCv.wait(lock, [this] { return mPendingTasks == 0; });
+}
+
+void ShardWorkerPool::runWorker(Shard* shard) {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(shard->mutex);
+            shard->cv.wait(lock, [shard] { return shard->stopRequested || !shard->tasks.empty(); });
+            if (shard->tasks.empty()) {
+                // stop requested and all queued tasks are done
+                return;
+            }
+            task = std::move(shard->tasks.front());
+            shard->tasks.pop_front();
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(mPendingMutex);
+            mPendingTasks--;
+        }
+        mPendingCv.notify_all();
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
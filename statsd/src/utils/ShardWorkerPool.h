@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * A fixed pool of worker threads, each with its own ordered task queue.
+ *
+ * Tasks posted to the same shard run sequentially in the posting order, tasks posted to
+ * different shards run concurrently. Used to process the same events for independent sets of
+ * metrics managers in parallel while keeping per-config ordering.
+ */
+class ShardWorkerPool {
+public:
+    explicit ShardWorkerPool(size_t numShards);
+
+    // Runs the tasks which are already queued and joins the worker threads.
+    ~ShardWorkerPool();
+
+    ShardWorkerPool(const ShardWorkerPool&) = delete;
+    ShardWorkerPool& operator=(const ShardWorkerPool&) = delete;
+
+    inline size_t getNumShards() const {
+        return mShards.size();
+    }
+
+    // Appends the task to the queue of the shard. shard must be lower than getNumShards().
+    void post(size_t shard, std::function<void()> task);
+
+    // Blocks until all the tasks posted before the call are completed.
+    void waitForIdle();
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::function<void()>> tasks;
+        bool stopRequested = false;
+        std::thread thread;
+    };
+
+    void runWorker(Shard* shard);
+
+    std::vector<std::unique_ptr<Shard>> mShards;
+
+    std::mutex mPendingMutex;
+    std::condition_variable mPendingCv;
+    size_t mPendingTasks = 0;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
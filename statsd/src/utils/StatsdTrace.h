@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// Trace slices and counters around the hot paths of statsd, recorded by atrace so they show up in
+// perfetto traces next to the rest of the system. They are only compiled in when STATSD_TRACING
+// is defined, and only cost a check of the enabled trace categories at runtime when tracing is
+// off.
+
+#ifdef STATSD_TRACING
+
+#include <cutils/trace.h>
+
+#include <cstdarg>
+#include <cstdio>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+// statsd has no trace category of its own, its slices are enabled along with the system services
+// ones ("ss").
+constexpr uint64_t kStatsdTraceTag = ATRACE_TAG_SYSTEM_SERVER;
+
+// Traces a slice for the lifetime of the object.
+class ScopedTrace {
+public:
+    explicit ScopedTrace(const char* name) : mStarted(atrace_is_tag_enabled(kStatsdTraceTag)) {
+        if (mStarted) {
+            atrace_begin(kStatsdTraceTag, name);
+        }
+    }
+
+    struct FormattedName {};
+
+    // The name is only formatted when tracing is on.
+    __attribute__((format(printf, 3, 4))) ScopedTrace(FormattedName, const char* format, ...)
+        : mStarted(atrace_is_tag_enabled(kStatsdTraceTag)) {
+        if (mStarted) {
+            char name[kMaxNameSize];
+            va_list args;
+            va_start(args, format);
+            vsnprintf(name, sizeof(name), format, args);
+            va_end(args);
+            atrace_begin(kStatsdTraceTag, name);
+        }
+    }
+
+    ~ScopedTrace() {
+        if (mStarted) {
+            atrace_end(kStatsdTraceTag);
+        }
+    }
+
+    ScopedTrace(const ScopedTrace&) = delete;
+    ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+private:
+    static constexpr size_t kMaxNameSize = 128;
+
+    // Whether the slice was started, tracing may be turned on or off before it ends.
+    const bool mStarted;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+
+#define STATSD_TRACE_CONCAT_INNER(a, b) a##b
+#define STATSD_TRACE_CONCAT(a, b) STATSD_TRACE_CONCAT_INNER(a, b)
+
+// Traces a slice named name until the end of the scope.
+#define STATSD_TRACE_SCOPE(name) \
+    ::android::os::statsd::ScopedTrace STATSD_TRACE_CONCAT(statsdTrace, __LINE__)(name)
+
+// Same as STATSD_TRACE_SCOPE, with the name formatted with printf, e.g.
+// STATSD_TRACE_SCOPE_FMT("onDumpReport %d_%lld", key.GetUid(), (long long)key.GetId()).
+#define STATSD_TRACE_SCOPE_FMT(format, ...)                                            \
+    ::android::os::statsd::ScopedTrace STATSD_TRACE_CONCAT(statsdTrace, __LINE__)(      \
+            ::android::os::statsd::ScopedTrace::FormattedName(), format, __VA_ARGS__)
+
+// Sets the value of the counter track named name.
+#define STATSD_TRACE_COUNTER(name, value) \
+    atrace_int64(::android::os::statsd::kStatsdTraceTag, name, value)
+
+#else
+
+#define STATSD_TRACE_SCOPE(name)
+#define STATSD_TRACE_SCOPE_FMT(format, ...)
+#define STATSD_TRACE_COUNTER(name, value)
+
+#endif
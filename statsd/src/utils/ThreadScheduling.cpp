@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define STATSD_DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "utils/ThreadScheduling.h"
+
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <array>
+#include <mutex>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using android::base::ParseInt;
+using android::base::Split;
+using android::base::StringPrintf;
+using std::optional;
+using std::string;
+using std::vector;
+
+namespace {
+
+struct ThreadSchedulingState {
+    string value;
+    optional<ThreadScheduling> scheduling;
+    // Empty until the thread applied its scheduling, then "applied" or the failures.
+    string result;
+};
+
+const char* const kThreadNames[] = {"logs_reader", "socket_listener", "ring_listener"};
+static_assert(std::size(kThreadNames) == (size_t)StatsdThread::kCount);
+
+std::mutex gThreadSchedulingMutex;
+std::array<ThreadSchedulingState, (size_t)StatsdThread::kCount> gThreadSchedulingStates;
+
+bool parseCpus(const string& value, vector<int>* cpus) {
+    for (const string& range : Split(value, ",")) {
+        const vector<string> bounds = Split(range, "-");
+        int first;
+        int last;
+        if (bounds.size() > 2 || !ParseInt(bounds[0], &first, 0, CPU_SETSIZE - 1) ||
+            !ParseInt(bounds.back(), &last, first, CPU_SETSIZE - 1)) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus->push_back(cpu);
+        }
+    }
+    return !cpus->empty();
+}
+
+}  // namespace
+
+string ThreadScheduling::toString() const {
+    vector<string> entries;
+    if (niceValue.has_value()) {
+        entries.push_back(StringPrintf("nice=%d", *niceValue));
+    }
+    if (!cpus.empty()) {
+        vector<string> cpuStrings;
+        for (const int cpu : cpus) {
+            cpuStrings.push_back(std::to_string(cpu));
+        }
+        entries.push_back("cpus=" + android::base::Join(cpuStrings, ","));
+    }
+    if (fifoPriority > 0) {
+        entries.push_back(StringPrintf("fifo=%d", fifoPriority));
+    }
+    return android::base::Join(entries, ";");
+}
+
+optional<ThreadScheduling> parseThreadScheduling(const string& value) {
+    ThreadScheduling scheduling;
+    for (const string& entry : Split(value, ";")) {
+        if (entry.empty()) {
+            continue;
+        }
+        const size_t separator = entry.find('=');
+        if (separator == string::npos) {
+            return std::nullopt;
+        }
+        const string key = entry.substr(0, separator);
+        const string entryValue = entry.substr(separator + 1);
+        if (key == "nice") {
+            int niceValue;
+            if (!ParseInt(entryValue, &niceValue, -20, 19)) {
+                return std::nullopt;
+            }
+            scheduling.niceValue = niceValue;
+        } else if (key == "cpus") {
+            scheduling.cpus.clear();
+            if (!parseCpus(entryValue, &scheduling.cpus)) {
+                return std::nullopt;
+            }
+        } else if (key == "fifo") {
+            if (!ParseInt(entryValue, &scheduling.fifoPriority, 1, 99)) {
+                return std::nullopt;
+            }
+        } else {
+            return std::nullopt;
+        }
+    }
+    return scheduling;
+}
+
+void setThreadScheduling(StatsdThread thread, const string& value) {
+    std::lock_guard<std::mutex> lock(gThreadSchedulingMutex);
+    ThreadSchedulingState& state = gThreadSchedulingStates[(size_t)thread];
+    state = {.value = value};
+    if (value.empty()) {
+        return;
+    }
+    state.scheduling = parseThreadScheduling(value);
+    if (!state.scheduling.has_value()) {
+        ALOGE("Invalid scheduling \"%s\" for thread %s", value.c_str(),
+              kThreadNames[(size_t)thread]);
+        state.result = "invalid";
+    }
+}
+
+void applyThreadScheduling(StatsdThread thread) {
+    std::lock_guard<std::mutex> lock(gThreadSchedulingMutex);
+    ThreadSchedulingState& state = gThreadSchedulingStates[(size_t)thread];
+    if (!state.scheduling.has_value()) {
+        return;
+    }
+    const ThreadScheduling& scheduling = *state.scheduling;
+    vector<string> failures;
+    if (scheduling.niceValue.has_value() &&
+        setpriority(PRIO_PROCESS, gettid(), *scheduling.niceValue) != 0) {
+        failures.push_back(StringPrintf("nice: %s", strerror(errno)));
+    }
+    if (!scheduling.cpus.empty()) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (const int cpu : scheduling.cpus) {
+            CPU_SET(cpu, &cpuSet);
+        }
+        if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0) {
+            failures.push_back(StringPrintf("cpus: %s", strerror(errno)));
+        }
+    }
+    if (scheduling.fifoPriority > 0) {
+        const sched_param param = {.sched_priority = scheduling.fifoPriority};
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+            failures.push_back(StringPrintf("fifo: %s", strerror(errno)));
+        }
+    }
+    if (failures.empty()) {
+        state.result = "applied";
+    } else {
+        state.result = android::base::Join(failures, ", ");
+        ALOGW("Failed to apply the scheduling of thread %s: %s", kThreadNames[(size_t)thread],
+              state.result.c_str());
+    }
+}
+
+void dumpThreadScheduling(int out) {
+    std::lock_guard<std::mutex> lock(gThreadSchedulingMutex);
+    dprintf(out, "Thread scheduling:\n");
+    for (size_t i = 0; i < gThreadSchedulingStates.size(); i++) {
+        const ThreadSchedulingState& state = gThreadSchedulingStates[i];
+        if (state.value.empty()) {
+            dprintf(out, "  %s: default\n", kThreadNames[i]);
+        } else {
+            dprintf(out, "  %s: %s (%s)\n", kThreadNames[i], state.value.c_str(),
+                    state.result.empty() ? "not started" : state.result.c_str());
+        }
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
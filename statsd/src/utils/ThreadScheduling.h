@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+// Threads of statsd whose scheduling can be set through flags.
+enum class StatsdThread {
+    // StatsService::readLogs(), processes the pushed events.
+    kLogsReader = 0,
+    // Reads the events from the statsdw sockets, the scheduling applies to each listener.
+    kSocketListener,
+    // Reads the events from the shared memory rings.
+    kRingListener,
+    kCount,
+};
+
+/**
+ * Scheduling of a thread, parsed from entries separated by ';':
+ *   nice=<value>       nice value of the thread, -20 to 19
+ *   cpus=<list>        cpus the thread can run on, e.g. "4-7" or "0,6-7"
+ *   fifo=<priority>    runs the thread with SCHED_FIFO at the priority, 1 to 99
+ * Entries that are not set leave the default scheduling.
+ */
+struct ThreadScheduling {
+    std::optional<int> niceValue;
+    std::vector<int> cpus;
+    int fifoPriority = 0;
+
+    std::string toString() const;
+};
+
+// Returns nullopt if the scheduling is malformed.
+std::optional<ThreadScheduling> parseThreadScheduling(const std::string& value);
+
+// Sets the scheduling of the thread from the flag value, before the thread starts. An empty value
+// keeps the default scheduling.
+void setThreadScheduling(StatsdThread thread, const std::string& value);
+
+// Applies the scheduling set for the thread to the calling thread. Failures, such as a missing
+// capability for SCHED_FIFO, are logged and shown by dumpThreadScheduling().
+void applyThreadScheduling(StatsdThread thread);
+
+// Writes the scheduling set for each thread and whether it was applied, for dumpsys stats.
+void dumpThreadScheduling(int out);
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
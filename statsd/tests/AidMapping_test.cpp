@@ -0,0 +1,59 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "packages/AidMapping.h"
+
+#include <gtest/gtest.h>
+#include <private/android_filesystem_config.h>
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+TEST(AidMappingTest, TestGetUid) {
+    EXPECT_EQ(AID_ROOT, AidMapping::getUid("AID_ROOT"));
+    EXPECT_EQ(AID_SYSTEM, AidMapping::getUid("AID_SYSTEM"));
+    EXPECT_EQ(AID_STATSD, AidMapping::getUid("AID_STATSD"));
+    EXPECT_EQ(AID_NOBODY, AidMapping::getUid("AID_NOBODY"));
+    EXPECT_FALSE(AidMapping::getUid("AID_UNUSED1").has_value());
+    EXPECT_FALSE(AidMapping::getUid("AID_").has_value());
+    EXPECT_FALSE(AidMapping::getUid("aid_system").has_value());
+    EXPECT_FALSE(AidMapping::getUid("com.android.app").has_value());
+}
+
+TEST(AidMappingTest, TestGetName) {
+    EXPECT_EQ("AID_ROOT", AidMapping::getName(AID_ROOT));
+    EXPECT_EQ("AID_SHELL", AidMapping::getName(AID_SHELL));
+    EXPECT_EQ("AID_NOBODY", AidMapping::getName(AID_NOBODY));
+    EXPECT_TRUE(AidMapping::getName(1022).empty());
+    EXPECT_TRUE(AidMapping::getName(-1).empty());
+    EXPECT_TRUE(AidMapping::getName(AID_APP_START).empty());
+}
+
+TEST(AidMappingTest, TestAidsAreBidirectional) {
+    ASSERT_FALSE(AidMapping::getAids().empty());
+    for (const AidEntry& aid : AidMapping::getAids()) {
+        EXPECT_EQ(aid.uid, AidMapping::getUid(aid.name));
+        EXPECT_EQ(aid.name, AidMapping::getName(aid.uid));
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
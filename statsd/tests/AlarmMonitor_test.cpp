@@ -64,6 +64,118 @@ TEST(AlarmMonitor, popSoonerThan) {
     ASSERT_EQ(0u, set.size());
 }
 
+TEST(AlarmMonitor, batch) {
+    int updateCount = 0;
+    int cancelCount = 0;
+    int64_t registeredMs = 0;
+    sp<AlarmMonitor> am = new AlarmMonitor(
+            2,
+            [&](const shared_ptr<IStatsCompanionService>&, int64_t timeMs) {
+                updateCount++;
+                registeredMs = timeMs;
+            },
+            [&](const shared_ptr<IStatsCompanionService>&) { cancelCount++; });
+
+    sp<const InternalAlarm> a = new InternalAlarm{10};
+    sp<const InternalAlarm> b = new InternalAlarm{20};
+    sp<const InternalAlarm> c = new InternalAlarm{30};
+
+    // Alarms set and cancelled within a batch don't reach the registered alarm.
+    {
+        AlarmMonitor::Batch batch(am);
+        am->add(a);
+        am->remove(a);
+    }
+    EXPECT_EQ(0, updateCount);
+    EXPECT_EQ(0, cancelCount);
+    EXPECT_EQ(0u, am->getRegisteredAlarmTimeSec());
+
+    // Only the soonest alarm is registered, once, when the outermost batch ends.
+    {
+        AlarmMonitor::Batch batch(am);
+        am->add(c);
+        {
+            AlarmMonitor::Batch nestedBatch(am);
+            am->add(b);
+        }
+        am->add(a);
+        EXPECT_EQ(0, updateCount);
+    }
+    EXPECT_EQ(1, updateCount);
+    EXPECT_EQ(10000, registeredMs);
+    EXPECT_EQ(10u, am->getRegisteredAlarmTimeSec());
+
+    // Popped alarms always update the registered alarm.
+    {
+        AlarmMonitor::Batch batch(am);
+        EXPECT_EQ(1u, am->popSoonerThan(10).size());
+    }
+    EXPECT_EQ(2, updateCount);
+    EXPECT_EQ(20u, am->getRegisteredAlarmTimeSec());
+
+    {
+        AlarmMonitor::Batch batch(am);
+        am->remove(b);
+        am->remove(c);
+    }
+    EXPECT_EQ(2, updateCount);
+    EXPECT_EQ(1, cancelCount);
+    EXPECT_EQ(0u, am->getRegisteredAlarmTimeSec());
+}
+
+TEST(AlarmMonitor, minIntervalToDelayRegisteredAlarm) {
+    int updateCount = 0;
+    int cancelCount = 0;
+    uint32_t currentTimeSec = 100;
+    sp<AlarmMonitor> am = new AlarmMonitor(
+            2, [&](const shared_ptr<IStatsCompanionService>&, int64_t) { updateCount++; },
+            [&](const shared_ptr<IStatsCompanionService>&) { cancelCount++; },
+            /*minIntervalToDelayRegisteredAlarmSec=*/60, [&]() { return currentTimeSec; });
+
+    sp<const InternalAlarm> a = new InternalAlarm{200};
+    sp<const InternalAlarm> b = new InternalAlarm{300};
+    sp<const InternalAlarm> c = new InternalAlarm{150};
+    am->add(b);
+    am->add(a);
+    EXPECT_EQ(2, updateCount);
+    EXPECT_EQ(200u, am->getRegisteredAlarmTimeSec());
+
+    // Moving the registered alarm later waits for the interval.
+    currentTimeSec = 110;
+    am->remove(a);
+    EXPECT_EQ(2, updateCount);
+    EXPECT_EQ(200u, am->getRegisteredAlarmTimeSec());
+
+    // Moving it sooner doesn't.
+    am->add(c);
+    EXPECT_EQ(3, updateCount);
+    EXPECT_EQ(150u, am->getRegisteredAlarmTimeSec());
+
+    currentTimeSec = 170;
+    am->remove(c);
+    EXPECT_EQ(4, updateCount);
+    EXPECT_EQ(300u, am->getRegisteredAlarmTimeSec());
+
+    // The registered alarm fires before the soonest alarm, which gets registered.
+    am->add(a);
+    currentTimeSec = 180;
+    am->remove(a);
+    EXPECT_EQ(5, updateCount);
+    EXPECT_EQ(200u, am->getRegisteredAlarmTimeSec());
+    currentTimeSec = 200;
+    EXPECT_TRUE(am->popSoonerThan(200).empty());
+    EXPECT_EQ(6, updateCount);
+    EXPECT_EQ(300u, am->getRegisteredAlarmTimeSec());
+
+    // Cancelling the registered alarm also waits for the interval.
+    currentTimeSec = 210;
+    am->remove(b);
+    EXPECT_EQ(0, cancelCount);
+    EXPECT_TRUE(am->popSoonerThan(300).empty());
+    EXPECT_EQ(1, cancelCount);
+    EXPECT_EQ(0u, am->getRegisteredAlarmTimeSec());
+}
+
 #else
 GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
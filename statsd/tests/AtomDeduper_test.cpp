@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "socket/AtomDeduper.h"
+
+#include <gtest/gtest.h>
+
+#include "tests/statsd_test_util.h"
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+constexpr int kAtomId = 1000;
+constexpr int32_t kUid = 1001;
+constexpr int64_t kWindowNs = 100;
+
+// Atom buffer along with the event parsed from it.
+struct TestAtom {
+    vector<uint8_t> buffer;
+    unique_ptr<LogEvent> event;
+};
+
+TestAtom makeAtom(int32_t uid, int64_t timestampNs, int32_t value) {
+    AStatsEvent* statsEvent = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(statsEvent, kAtomId);
+    AStatsEvent_overwriteTimestamp(statsEvent, timestampNs);
+    AStatsEvent_writeInt32(statsEvent, value);
+    AStatsEvent_build(statsEvent);
+    size_t size;
+    const uint8_t* buf = AStatsEvent_getBuffer(statsEvent, &size);
+
+    TestAtom atom;
+    atom.buffer.assign(buf, buf + size);
+    atom.event = std::make_unique<LogEvent>(uid, /*pid=*/0);
+    atom.event->parseBuffer(atom.buffer.data(), atom.buffer.size());
+    AStatsEvent_release(statsEvent);
+    return atom;
+}
+
+bool dedupe(AtomDeduper& deduper, TestAtom& atom, vector<unique_ptr<LogEvent>>* released) {
+    return deduper.dedupe(atom.event, atom.buffer.data(), atom.buffer.size(), released);
+}
+
+}  // namespace
+
+TEST(AtomDeduperTest, TestRepeatsHeldUntilWindowCloses) {
+    AtomDeduper deduper({{kAtomId, kWindowNs}});
+    vector<unique_ptr<LogEvent>> released;
+
+    TestAtom first = makeAtom(kUid, 1000, 1);
+    EXPECT_FALSE(dedupe(deduper, first, &released));
+
+    // the first repeat is moved in, the others are left to be recycled
+    TestAtom repeat1 = makeAtom(kUid, 1010, 1);
+    EXPECT_TRUE(dedupe(deduper, repeat1, &released));
+    EXPECT_EQ(nullptr, repeat1.event);
+    TestAtom repeat2 = makeAtom(kUid, 1020, 1);
+    EXPECT_TRUE(dedupe(deduper, repeat2, &released));
+    EXPECT_NE(nullptr, repeat2.event);
+    EXPECT_TRUE(released.empty());
+
+    deduper.releaseExpired(/*nowNs=*/1099, &released);
+    EXPECT_TRUE(released.empty());
+    deduper.releaseExpired(/*nowNs=*/1100, &released);
+    ASSERT_EQ(1, released.size());
+    EXPECT_EQ(1010, released[0]->GetElapsedTimestampNs());
+    EXPECT_EQ(2, released[0]->getRepeatCount());
+
+    // the atom is no longer tracked and opens a new window
+    released.clear();
+    TestAtom next = makeAtom(kUid, 1110, 1);
+    EXPECT_FALSE(dedupe(deduper, next, &released));
+}
+
+TEST(AtomDeduperTest, TestDifferentAtomsNotDeduped) {
+    AtomDeduper deduper({{kAtomId, kWindowNs}});
+    vector<unique_ptr<LogEvent>> released;
+
+    TestAtom first = makeAtom(kUid, 1000, 1);
+    EXPECT_FALSE(dedupe(deduper, first, &released));
+    TestAtom repeat = makeAtom(kUid, 1010, 1);
+    EXPECT_TRUE(dedupe(deduper, repeat, &released));
+
+    // same value from another uid
+    TestAtom otherUid = makeAtom(kUid + 1, 1020, 1);
+    EXPECT_FALSE(dedupe(deduper, otherUid, &released));
+    EXPECT_TRUE(released.empty());
+
+    // a new value releases the held repeat ahead of it
+    TestAtom otherValue = makeAtom(kUid, 1030, 2);
+    EXPECT_FALSE(dedupe(deduper, otherValue, &released));
+    ASSERT_EQ(1, released.size());
+    EXPECT_EQ(1010, released[0]->GetElapsedTimestampNs());
+    EXPECT_EQ(1, released[0]->getRepeatCount());
+
+    // atoms without window
+    AtomDeduper otherDeduper({{kAtomId + 1, kWindowNs}});
+    TestAtom atom1 = makeAtom(kUid, 1000, 1);
+    TestAtom atom2 = makeAtom(kUid, 1010, 1);
+    EXPECT_FALSE(dedupe(otherDeduper, atom1, &released));
+    EXPECT_FALSE(dedupe(otherDeduper, atom2, &released));
+}
+
+TEST(AtomDeduperTest, TestTrackedAtomsLimit) {
+    AtomDeduper deduper({{kAtomId, kWindowNs}});
+    vector<unique_ptr<LogEvent>> released;
+
+    for (size_t i = 0; i < AtomDeduper::kMaxTrackedAtoms; i++) {
+        TestAtom atom = makeAtom(kUid + i, 1000, 1);
+        EXPECT_FALSE(dedupe(deduper, atom, &released));
+    }
+    EXPECT_EQ(AtomDeduper::kMaxTrackedAtoms, deduper.mEntries.size());
+
+    TestAtom first = makeAtom(kUid - 1, 1000, 1);
+    TestAtom repeat = makeAtom(kUid - 1, 1010, 1);
+    EXPECT_FALSE(dedupe(deduper, first, &released));
+    EXPECT_FALSE(dedupe(deduper, repeat, &released));
+    EXPECT_EQ(AtomDeduper::kMaxTrackedAtoms, deduper.mEntries.size());
+}
+
+TEST(AtomDeduperTest, TestParseDedupeWindows) {
+    std::optional<AtomDeduper::Windows> windows = parseDedupeWindows("");
+    ASSERT_TRUE(windows.has_value());
+    EXPECT_TRUE(windows->empty());
+
+    windows = parseDedupeWindows("10=50;27=1000");
+    ASSERT_TRUE(windows.has_value());
+    EXPECT_EQ((AtomDeduper::Windows{{10, 50 * 1000000LL}, {27, 1000 * 1000000LL}}), *windows);
+
+    EXPECT_FALSE(parseDedupeWindows("10").has_value());
+    EXPECT_FALSE(parseDedupeWindows("10=").has_value());
+    EXPECT_FALSE(parseDedupeWindows("a=50").has_value());
+    EXPECT_FALSE(parseDedupeWindows("10=0").has_value());
+    EXPECT_FALSE(parseDedupeWindows("10=600000").has_value());
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
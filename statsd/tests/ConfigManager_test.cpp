@@ -132,6 +132,53 @@ TEST(ConfigManagerTest, TestAddUpdateRemove) {
     }
 }
 
+/**
+ * Test that pushing the same config again is ignored, until the config is removed.
+ */
+TEST(ConfigManagerTest, TestDuplicateConfig) {
+    sp<MockListener> listener = new StrictMock<MockListener>();
+
+    sp<ConfigManager> manager = new ConfigManager();
+    manager->AddListener(listener);
+    manager->StartupForTest();
+
+    StatsdConfig config91;
+    config91.set_id(91);
+    StatsdConfig config92;
+    config92.set_id(92);
+    const ConfigKey key(1, StringToId("zzz"));
+
+    {
+        InSequence s;
+
+        EXPECT_CALL(*(listener.get()),
+                    OnConfigUpdated(_, ConfigKeyEq(1, StringToId("zzz")), StatsdConfigEq(91), true))
+                .RetiresOnSaturation();
+        manager->UpdateConfig(key, config91);
+        // Duplicate, no callback.
+        manager->UpdateConfig(key, config91);
+
+        EXPECT_CALL(*(listener.get()),
+                    OnConfigUpdated(_, ConfigKeyEq(1, StringToId("zzz")), StatsdConfigEq(92), true))
+                .RetiresOnSaturation();
+        manager->UpdateConfig(key, config92);
+
+        EXPECT_CALL(*(listener.get()), OnConfigRemoved(ConfigKeyEq(1, StringToId("zzz"))))
+                .RetiresOnSaturation();
+        manager->RemoveConfig(key);
+
+        // Not a duplicate once the config was removed.
+        EXPECT_CALL(*(listener.get()),
+                    OnConfigUpdated(_, ConfigKeyEq(1, StringToId("zzz")), StatsdConfigEq(92), true))
+                .RetiresOnSaturation();
+        manager->UpdateConfig(key, config92);
+
+        EXPECT_CALL(*(listener.get()), OnConfigRemoved(ConfigKeyEq(1, StringToId("zzz"))))
+                .RetiresOnSaturation();
+        manager->RemoveConfig(key);
+    }
+}
+
 /**
  * Test removing all of the configs for a uid.
  */
@@ -0,0 +1,138 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/matchers/EventMatcherCache.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "src/matchers/SimpleAtomMatchingTracker.h"
+#include "tests/statsd_test_util.h"
+
+using std::shared_ptr;
+using std::vector;
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+const int32_t TAG_ID = 123;
+
+SimpleAtomMatcher createUidMatcher(int uid) {
+    SimpleAtomMatcher matcher;
+    matcher.set_atom_id(TAG_ID);
+    FieldValueMatcher* uidMatcher = matcher.add_field_value_matcher();
+    uidMatcher->set_field(1);
+    uidMatcher->set_eq_int(uid);
+    return matcher;
+}
+
+}  // anonymous namespace
+
+TEST(EventMatcherCacheTest, TestRegisterMatcher) {
+    sp<UidMap> uidMap = new UidMap();
+    sp<UidMap> otherUidMap = new UidMap();
+
+    const int id = EventMatcherCache::registerMatcher(uidMap, createUidMatcher(1111));
+    EXPECT_EQ(id, EventMatcherCache::registerMatcher(uidMap, createUidMatcher(1111)));
+    const int otherMatcherId = EventMatcherCache::registerMatcher(uidMap, createUidMatcher(2222));
+    const int otherUidMapId =
+            EventMatcherCache::registerMatcher(otherUidMap, createUidMatcher(1111));
+    EXPECT_NE(id, otherMatcherId);
+    EXPECT_NE(id, otherUidMapId);
+    EXPECT_NE(otherMatcherId, otherUidMapId);
+
+    EventMatcherCache::unregisterMatcher(id);
+    EventMatcherCache::unregisterMatcher(id);
+    EventMatcherCache::unregisterMatcher(otherMatcherId);
+    EventMatcherCache::unregisterMatcher(otherUidMapId);
+}
+
+TEST(EventMatcherCacheTest, TestScope) {
+    shared_ptr<LogEvent> event = makeUidLogEvent(TAG_ID, 0, 1111, 1, 2);
+    shared_ptr<LogEvent> otherEvent = makeUidLogEvent(TAG_ID, 0, 1111, 1, 2);
+    EXPECT_EQ(nullptr, EventMatcherCache::get(*event));
+
+    {
+        EventMatcherCache::Scope scope(*event);
+        EventMatcherCache* cache = EventMatcherCache::get(*event);
+        ASSERT_NE(nullptr, cache);
+        EXPECT_EQ(nullptr, EventMatcherCache::get(*otherEvent));
+
+        EXPECT_EQ(nullptr, cache->find(3));
+        cache->insert(3, MatchingState::kMatched, nullptr);
+        const EventMatcherCache::Entry* entry = cache->find(3);
+        ASSERT_NE(nullptr, entry);
+        EXPECT_EQ(MatchingState::kMatched, entry->state);
+
+        // A nested scope doesn't replace the event of the outer one.
+        {
+            EventMatcherCache::Scope nestedScope(*otherEvent);
+            EXPECT_EQ(nullptr, EventMatcherCache::get(*otherEvent));
+            EXPECT_EQ(cache, EventMatcherCache::get(*event));
+        }
+        EXPECT_EQ(cache, EventMatcherCache::get(*event));
+    }
+    EXPECT_EQ(nullptr, EventMatcherCache::get(*event));
+
+    // Results don't outlive their scope.
+    EventMatcherCache::Scope scope(*otherEvent);
+    EXPECT_EQ(nullptr, EventMatcherCache::get(*otherEvent)->find(3));
+}
+
+TEST(EventMatcherCacheTest, TestTrackersShareResult) {
+    sp<UidMap> uidMap = new UidMap();
+    const SimpleAtomMatcher matcher = createUidMatcher(1111);
+    vector<sp<AtomMatchingTracker>> trackers1 = {
+            new SimpleAtomMatchingTracker(/*id=*/1, /*protoHash=*/0, matcher, uidMap)};
+    vector<sp<AtomMatchingTracker>> trackers2 = {
+            new SimpleAtomMatchingTracker(/*id=*/2, /*protoHash=*/0, matcher, uidMap)};
+    const int sharedId = EventMatcherCache::registerMatcher(uidMap, matcher);
+
+    shared_ptr<LogEvent> event = makeUidLogEvent(TAG_ID, 0, 1111, 1, 2);
+    vector<MatchingState> results1 = {MatchingState::kNotComputed};
+    vector<MatchingState> results2 = {MatchingState::kNotComputed};
+    vector<shared_ptr<LogEvent>> transformations = {nullptr};
+    {
+        EventMatcherCache::Scope scope(*event);
+        trackers1[0]->onLogEvent(*event, 0, trackers1, results1, transformations);
+        EXPECT_EQ(MatchingState::kMatched, results1[0]);
+
+        // The second tracker takes the stored result instead of matching the event.
+        EventMatcherCache* cache = EventMatcherCache::get(*event);
+        ASSERT_NE(nullptr, cache->find(sharedId));
+        cache->insert(sharedId, MatchingState::kNotMatched, nullptr);
+        trackers2[0]->onLogEvent(*event, 0, trackers2, results2, transformations);
+        EXPECT_EQ(MatchingState::kNotMatched, results2[0]);
+    }
+
+    // Without a scope, the event is matched.
+    results2[0] = MatchingState::kNotComputed;
+    trackers2[0]->onLogEvent(*event, 0, trackers2, results2, transformations);
+    EXPECT_EQ(MatchingState::kMatched, results2[0]);
+
+    EventMatcherCache::unregisterMatcher(sharedId);
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
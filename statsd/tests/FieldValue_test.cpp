@@ -158,6 +158,69 @@ TEST(AtomMatcherTest, TestFilter_ALL) {
     EXPECT_EQ("some value", output.getValues()[6].mValue.str_value);
 }
 
+TEST(AtomMatcherTest, TestFilterWithFieldIds) {
+    vector<FieldMatcher> fieldMatchers(4);
+    fieldMatchers[0].set_field(10);
+    FieldMatcher* child = fieldMatchers[0].add_child();
+    child->set_field(1);
+    child->set_position(Position::ALL);
+    child->add_child()->set_field(1);
+    child->add_child()->set_field(2);
+    fieldMatchers[0].add_child()->set_field(2);
+
+    fieldMatchers[1].set_field(10);
+    child = fieldMatchers[1].add_child();
+    child->set_field(1);
+    child->set_position(Position::LAST);
+    child->add_child()->set_field(1);
+    fieldMatchers[1].add_child()->set_field(2);
+
+    // Other atom
+    fieldMatchers[2].set_field(11);
+    fieldMatchers[2].add_child()->set_field(2);
+
+    // Field not in the event
+    fieldMatchers[3].set_field(10);
+    fieldMatchers[3].add_child()->set_field(3);
+
+    std::vector<int> attributionUids = {1111, 2222, 3333};
+    std::vector<string> attributionTags = {"location1", "location2", "location3"};
+
+    LogEvent event(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event, 10 /*atomId*/, /*timestamp=*/1012345, attributionUids, attributionTags,
+                 "some value");
+    ASSERT_EQ(event.getValues().size(), event.getFieldIds().size());
+    for (size_t i = 0; i < event.getValues().size(); i++) {
+        EXPECT_EQ(event.getValues()[i].mField.getField(), event.getFieldIds()[i]);
+    }
+
+    for (const FieldMatcher& fieldMatcher : fieldMatchers) {
+        vector<Matcher> matchers;
+        translateFieldMatcher(fieldMatcher, &matchers);
+
+        HashableDimensionKey expected;
+        HashableDimensionKey output;
+        EXPECT_EQ(filterValues(matchers, event.getValues(), &expected),
+                  filterValues(matchers, event, &output));
+        EXPECT_EQ(expected, output);
+
+        // The view borrowing the values is equal to the key and has the same hash.
+        MetricDimensionKeyView view(DEFAULT_DIMENSION_KEY);
+        EXPECT_TRUE(filterValues(matchers, event, &view));
+        const MetricDimensionKey metricKey(expected, DEFAULT_DIMENSION_KEY);
+        EXPECT_TRUE(view == metricKey);
+        EXPECT_EQ(std::hash<MetricDimensionKey>{}(metricKey), view.getHash());
+
+        for (const Matcher& matcher : matchers) {
+            FieldValue expectedValue;
+            FieldValue value;
+            EXPECT_EQ(filterValues(matcher, event.getValues(), &expectedValue),
+                      filterValues(matcher, event, &value));
+            EXPECT_EQ(expectedValue, value);
+        }
+    }
+}
+
 TEST(AtomMatcherTest, TestFilter_FIRST) {
     FieldMatcher matcher1;
     matcher1.set_field(10);
@@ -479,6 +542,68 @@ TEST(AtomMatcherTest, TestMetric2ConditionLink) {
     EXPECT_EQ((int32_t)27, link.conditionFields[0].mMatcher.getTag());
 }
 
+TEST(AtomMatcherTest, TestMetric2ConditionLinkValueIndices) {
+    FieldMatcher whatMatcher;
+    whatMatcher.set_field(10);
+    FieldMatcher* child = whatMatcher.add_child();
+    child->set_field(1);
+    child->set_position(Position::FIRST);
+    child->add_child()->set_field(1);
+    whatMatcher.add_child()->set_field(2);
+
+    FieldMatcher conditionMatcher;
+    conditionMatcher.set_field(27);
+    child = conditionMatcher.add_child();
+    child->set_field(1);
+    child->set_position(Position::FIRST);
+    child->add_child()->set_field(1);
+    conditionMatcher.add_child()->set_field(3);
+
+    Metric2Condition link;
+    translateFieldMatcher(whatMatcher, &link.metricFields);
+    translateFieldMatcher(conditionMatcher, &link.conditionFields);
+
+    LogEvent event1(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event1, 10 /*atomId*/, 12345, {1111, 2222}, {"tag1", "tag2"}, "name1");
+    LogEvent event2(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event2, 10 /*atomId*/, 12345, {3333}, {"tag3"}, "name2");
+
+    for (const LogEvent* event : {&event1, &event1, &event2, &event1}) {
+        HashableDimensionKey expected;
+        getDimensionForCondition(event->getValues(), link, &expected);
+        HashableDimensionKey conditionKey;
+        getDimensionForCondition(*event, link, &conditionKey);
+        EXPECT_EQ(expected, conditionKey);
+        ASSERT_EQ(2UL, conditionKey.getValues().size());
+        EXPECT_EQ(27, conditionKey.getValues()[1].mField.getTag());
+        EXPECT_FALSE(link.valueIndices.disabled);
+        EXPECT_EQ(2UL, link.valueIndices.matches.size());
+    }
+    // The name moved to another index twice.
+    EXPECT_EQ(2, link.valueIndices.misses);
+
+    // Increments the misses again and stops recording the indices.
+    for (int i = 0; i < LinkValueIndices::kMaxMisses; i++) {
+        HashableDimensionKey conditionKey;
+        getDimensionForCondition(i % 2 == 0 ? event2 : event1, link, &conditionKey);
+        ASSERT_EQ(2UL, conditionKey.getValues().size());
+    }
+    EXPECT_TRUE(link.valueIndices.disabled);
+    EXPECT_TRUE(link.valueIndices.matches.empty());
+
+    // Position ANY can match several values.
+    whatMatcher.mutable_child(0)->set_position(Position::ANY);
+    Metric2Condition anyLink;
+    translateFieldMatcher(whatMatcher, &anyLink.metricFields);
+    translateFieldMatcher(conditionMatcher, &anyLink.conditionFields);
+    HashableDimensionKey expected;
+    getDimensionForCondition(event1.getValues(), anyLink, &expected);
+    HashableDimensionKey conditionKey;
+    getDimensionForCondition(event1, anyLink, &conditionKey);
+    EXPECT_EQ(expected, conditionKey);
+    EXPECT_TRUE(anyLink.valueIndices.disabled);
+}
+
 TEST(AtomMatcherTest, TestWriteDimensionPath) {
     for (auto position : {Position::ALL, Position::FIRST, Position::LAST}) {
         FieldMatcher matcher1;
@@ -675,6 +800,41 @@ TEST(AtomMatcherTest, TestWriteDimensionToProto) {
     EXPECT_EQ(99999, dim2.value_int());
 }
 
+TEST(AtomMatcherTest, TestWriteDimensionToProtoMultipleNodes) {
+    HashableDimensionKey dim;
+    int pos1[] = {1, 1, 1};
+    int pos2[] = {1, 1, 2};
+    int pos3[] = {1, 2, 1};
+    int pos4[] = {1, 2, 2};
+    int pos5[] = {2, 0, 0};
+    dim.addValue(FieldValue(Field(10, pos1, 2), Value((int32_t)10025)));
+    dim.addValue(FieldValue(Field(10, pos2, 2), Value("tag1")));
+    dim.addValue(FieldValue(Field(10, pos3, 2), Value((int32_t)10026)));
+    dim.addValue(FieldValue(Field(10, pos4, 2), Value("tag2")));
+    dim.addValue(FieldValue(Field(10, pos5, 0), Value((int32_t)99999)));
+
+    android::util::ProtoOutputStream protoOut;
+    writeDimensionToProto(dim, nullptr /* include strings */, &protoOut);
+    DimensionsValue result;
+    outputStreamToProto(&protoOut, &result);
+
+    EXPECT_EQ(10, result.field());
+    ASSERT_EQ(3, result.value_tuple().dimensions_value_size());
+    for (int node = 0; node < 2; node++) {
+        const auto& nodeDim = result.value_tuple().dimensions_value(node);
+        EXPECT_EQ(1, nodeDim.field());
+        ASSERT_EQ(2, nodeDim.value_tuple().dimensions_value_size());
+        EXPECT_EQ(1, nodeDim.value_tuple().dimensions_value(0).field());
+        EXPECT_EQ(10025 + node, nodeDim.value_tuple().dimensions_value(0).value_int());
+        EXPECT_EQ(2, nodeDim.value_tuple().dimensions_value(1).field());
+        EXPECT_EQ("tag" + std::to_string(node + 1),
+                  nodeDim.value_tuple().dimensions_value(1).value_str());
+    }
+    const auto& dim2 = result.value_tuple().dimensions_value(2);
+    EXPECT_EQ(2, dim2.field());
+    EXPECT_EQ(99999, dim2.value_int());
+}
+
 TEST(AtomMatcherTest, TestWriteDimensionLeafNodesToProto) {
     HashableDimensionKey dim;
     int pos1[] = {1, 1, 1};
@@ -1200,6 +1360,47 @@ TEST(FieldValueTest, TestShouldKeepSampleByteArray) {
     EXPECT_TRUE(shouldKeepSample(fieldValue2, shardOffset, shardCount));
 }
 
+TEST(FieldValueTest, TestValueMove) {
+    const string str(100, 'a');
+    Value value(str);
+    const char* const strData = value.str_value.data();
+
+    Value movedValue(std::move(value));
+    EXPECT_EQ(STRING, movedValue.getType());
+    EXPECT_EQ(str, movedValue.str_value);
+    // The string buffer was moved, not copied.
+    EXPECT_EQ(strData, movedValue.str_value.data());
+
+    Value assignedValue((int32_t)1);
+    assignedValue = std::move(movedValue);
+    EXPECT_EQ(STRING, assignedValue.getType());
+    EXPECT_EQ(strData, assignedValue.str_value.data());
+
+    const vector<uint8_t> storage = {1, 2, 3};
+    Value storageValue(storage);
+    Value movedStorageValue(std::move(storageValue));
+    EXPECT_EQ(STORAGE, movedStorageValue.getType());
+    EXPECT_EQ(storage, movedStorageValue.storage_value);
+
+    Value longValue((int64_t)123456789012);
+    Value movedLongValue(std::move(longValue));
+    EXPECT_EQ(LONG, movedLongValue.getType());
+    EXPECT_EQ(123456789012, movedLongValue.long_value);
+}
+
+TEST(FieldValueTest, TestFieldValuesMovedOnGrowth) {
+    vector<FieldValue> values;
+    vector<const char*> strData;
+    for (int i = 1; i <= 20; i++) {
+        int pos[] = {i, 1, 1};
+        values.emplace_back(Field(1, pos, 0), Value(string(100, 'a' + i)));
+        strData.push_back(values.back().mValue.str_value.data());
+    }
+    for (size_t i = 0; i < values.size(); i++) {
+        EXPECT_EQ(strData[i], values[i].mValue.str_value.data());
+    }
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -164,6 +164,105 @@ TEST(HashableDimensionKeyTest, TestHashDimensionDouble) {
               std::hash<HashableDimensionKey>{}(dimKey2));
 }
 
+/**
+ * Test that the fields, the types and the order of the values are part of the hash.
+ */
+TEST(HashableDimensionKeyTest, TestHashDimensionFieldsAndTypes) {
+    int pos1[] = {1, 1, 1};
+    int pos2[] = {2, 1, 1};
+    const Field field1(1, pos1, 0);
+    const Field field2(1, pos2, 0);
+    HashableDimensionKey key;
+    key.addValue(FieldValue(field1, Value((int32_t)10)));
+    key.addValue(FieldValue(field2, Value((int32_t)20)));
+    HashableDimensionKey swappedValuesKey;
+    swappedValuesKey.addValue(FieldValue(field1, Value((int32_t)20)));
+    swappedValuesKey.addValue(FieldValue(field2, Value((int32_t)10)));
+    HashableDimensionKey otherTagKey;
+    otherTagKey.addValue(FieldValue(Field(2, pos1, 0), Value((int32_t)10)));
+    otherTagKey.addValue(FieldValue(Field(2, pos2, 0), Value((int32_t)20)));
+    HashableDimensionKey longKey;
+    longKey.addValue(FieldValue(field1, Value((int64_t)10)));
+    longKey.addValue(FieldValue(field2, Value((int64_t)20)));
+
+    const size_t hash = std::hash<HashableDimensionKey>{}(key);
+    EXPECT_NE(hash, std::hash<HashableDimensionKey>{}(swappedValuesKey));
+    EXPECT_NE(hash, std::hash<HashableDimensionKey>{}(otherTagKey));
+    EXPECT_NE(hash, std::hash<HashableDimensionKey>{}(longKey));
+}
+
+/**
+ * Test that keys compare the same whether their hashes are cached or not.
+ */
+TEST(HashableDimensionKeyTest, TestEqualityWithCachedHashes) {
+    int pos[] = {1, 1, 1};
+    Field field(1, pos, 0);
+    HashableDimensionKey key1;
+    key1.addValue(FieldValue(field, Value((int32_t)100)));
+    HashableDimensionKey key2;
+    key2.addValue(FieldValue(field, Value((int32_t)100)));
+    HashableDimensionKey key3;
+    key3.addValue(FieldValue(field, Value((int32_t)200)));
+
+    EXPECT_EQ(key1, key2);
+    EXPECT_NE(key1, key3);
+
+    std::hash<HashableDimensionKey>{}(key1);
+    EXPECT_EQ(key1, key2);
+    EXPECT_NE(key1, key3);
+
+    std::hash<HashableDimensionKey>{}(key2);
+    std::hash<HashableDimensionKey>{}(key3);
+    EXPECT_EQ(key1, key2);
+    EXPECT_NE(key1, key3);
+}
+
+/**
+ * Test that the cached hash is updated when the key values are modified.
+ */
+TEST(HashableDimensionKeyTest, TestCachedHashInvalidated) {
+    int pos[] = {1, 1, 1};
+    Field field(1, pos, 1);
+    HashableDimensionKey dimKey;
+    dimKey.addValue(FieldValue(field, Value((int32_t)100)));
+    const size_t hash = std::hash<HashableDimensionKey>{}(dimKey);
+    EXPECT_EQ(hash, std::hash<HashableDimensionKey>{}(HashableDimensionKey(dimKey.getValues())));
+
+    dimKey.mutableValue(0)->mValue.setInt(200);
+    const size_t modifiedHash = std::hash<HashableDimensionKey>{}(dimKey);
+    EXPECT_NE(hash, modifiedHash);
+    EXPECT_EQ(modifiedHash,
+              std::hash<HashableDimensionKey>{}(HashableDimensionKey(dimKey.getValues())));
+
+    dimKey.addValue(FieldValue(field, Value((int32_t)100)));
+    EXPECT_NE(modifiedHash, std::hash<HashableDimensionKey>{}(dimKey));
+
+    dimKey.mutableValues()->pop_back();
+    EXPECT_EQ(modifiedHash, std::hash<HashableDimensionKey>{}(dimKey));
+
+    // Copies keep the hash, moved from keys are empty.
+    HashableDimensionKey copy(dimKey);
+    EXPECT_EQ(modifiedHash, std::hash<HashableDimensionKey>{}(copy));
+    HashableDimensionKey moved(std::move(dimKey));
+    EXPECT_EQ(modifiedHash, std::hash<HashableDimensionKey>{}(moved));
+    EXPECT_EQ(std::hash<HashableDimensionKey>{}(HashableDimensionKey()),
+              std::hash<HashableDimensionKey>{}(dimKey));
+}
+
+TEST(HashableDimensionKeyTest, TestContainsUid) {
+    int pos[] = {1, 1, 1};
+    HashableDimensionKey dimKey;
+    dimKey.addValue(FieldValue(Field(1, pos, 0), Value((int32_t)1001)));
+    FieldValue uidValue(Field(1, pos, 0), Value((int32_t)1002));
+    uidValue.mAnnotations.setUidField(true);
+    dimKey.addValue(uidValue);
+
+    // Only the values of the uid fields are uids.
+    EXPECT_FALSE(containsUid(dimKey, 1001));
+    EXPECT_TRUE(containsUid(dimKey, 1002));
+    EXPECT_FALSE(containsUid(DEFAULT_DIMENSION_KEY, 1002));
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
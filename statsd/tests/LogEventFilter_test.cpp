@@ -18,6 +18,10 @@
 #include <gtest/gtest.h>
 
 #include <algorithm>
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
 
 #ifdef __ANDROID__
 
@@ -61,10 +65,10 @@ TEST(LogEventFilterTest, TestRemoveNonExistingEmptyFilter) {
     EXPECT_FALSE(filter.isAtomInUse(1));
     LogEventFilter::AtomIdSet emptyAtomIdsSet;
     EXPECT_EQ(0, filter.mTagIdsPerConsumer.size());
-    EXPECT_EQ(0, filter.mLocalTagIds.size());
+    EXPECT_EQ(0, filter.mLocalSnapshot->tagIds.size());
     filter.setAtomIds(std::move(emptyAtomIdsSet), reinterpret_cast<LogEventFilter::ConsumerId>(0));
     EXPECT_FALSE(filter.isAtomInUse(1));
-    EXPECT_EQ(0, filter.mLocalTagIds.size());
+    EXPECT_EQ(0, filter.mLocalSnapshot->tagIds.size());
     EXPECT_EQ(0, filter.mTagIdsPerConsumer.size());
 }
 
@@ -84,12 +88,12 @@ TEST(LogEventFilterTest, TestNonEmptyFilterFullOverlap) {
     EXPECT_EQ(1, filter.mTagIdsPerConsumer.size());
 
     // inner copy updated only during fetch if required
-    EXPECT_EQ(0, filter.mLocalTagIds.size());
+    EXPECT_EQ(0, filter.mLocalSnapshot->tagIds.size());
     const auto sampleIds = generateAtomIds(1, kAtomIdsCount);
     for (const auto& atomId : sampleIds) {
         EXPECT_TRUE(filter.isAtomInUse(atomId));
     }
-    EXPECT_EQ(kAtomIdsCount, filter.mLocalTagIds.size());
+    EXPECT_EQ(kAtomIdsCount, filter.mLocalSnapshot->tagIds.size());
 }
 
 TEST(LogEventFilterTest, TestNonEmptyFilterPartialOverlap) {
@@ -124,23 +128,23 @@ TEST(LogEventFilterTest, TestMultipleConsumerOverlapIdsRemoved) {
     filter.setAtomIds(std::move(filterIds1), reinterpret_cast<LogEventFilter::ConsumerId>(0));
     filter.setAtomIds(std::move(filterIds2), reinterpret_cast<LogEventFilter::ConsumerId>(1));
     // inner copy updated only during fetch if required
-    EXPECT_EQ(0, filter.mLocalTagIds.size());
+    EXPECT_EQ(0, filter.mLocalSnapshot->tagIds.size());
     const auto sampleIds = generateAtomIds(1, kAtomIdsCount * 2);
     for (const auto& atomId : sampleIds) {
         EXPECT_TRUE(filter.isAtomInUse(atomId));
     }
-    EXPECT_EQ(kAtomIdsCount * 2, filter.mLocalTagIds.size());
+    EXPECT_EQ(kAtomIdsCount * 2, filter.mLocalSnapshot->tagIds.size());
     EXPECT_TRUE(testGuaranteedUnusedAtomsNotInUse(filter));
 
     // set empty filter for second consumer
     LogEventFilter::AtomIdSet emptyAtomIdsSet;
     filter.setAtomIds(std::move(emptyAtomIdsSet), reinterpret_cast<LogEventFilter::ConsumerId>(1));
-    EXPECT_EQ(kAtomIdsCount * 2, filter.mLocalTagIds.size());
+    EXPECT_EQ(kAtomIdsCount * 2, filter.mLocalSnapshot->tagIds.size());
     for (const auto& atomId : sampleIds) {
         bool const atomInUse = atomId <= kAtomIdsCount;
         EXPECT_EQ(atomInUse, filter.isAtomInUse(atomId));
     }
-    EXPECT_EQ(kAtomIdsCount, filter.mLocalTagIds.size());
+    EXPECT_EQ(kAtomIdsCount, filter.mLocalSnapshot->tagIds.size());
     EXPECT_TRUE(testGuaranteedUnusedAtomsNotInUse(filter));
 }
 
@@ -152,37 +156,201 @@ TEST(LogEventFilterTest, TestMultipleConsumerEmptyFilter) {
     filter.setAtomIds(std::move(filterIds2), reinterpret_cast<LogEventFilter::ConsumerId>(1));
     EXPECT_EQ(2, filter.mTagIdsPerConsumer.size());
     // inner copy updated only during fetch if required
-    EXPECT_EQ(0, filter.mLocalTagIds.size());
+    EXPECT_EQ(0, filter.mLocalSnapshot->tagIds.size());
     const auto sampleIds = generateAtomIds(1, kAtomIdsCount * 2);
     for (const auto& atomId : sampleIds) {
         EXPECT_TRUE(filter.isAtomInUse(atomId));
     }
-    EXPECT_EQ(kAtomIdsCount * 2, filter.mLocalTagIds.size());
+    EXPECT_EQ(kAtomIdsCount * 2, filter.mLocalSnapshot->tagIds.size());
     EXPECT_TRUE(testGuaranteedUnusedAtomsNotInUse(filter));
 
     // set empty filter for first consumer
     LogEventFilter::AtomIdSet emptyAtomIdsSet;
     filter.setAtomIds(emptyAtomIdsSet, reinterpret_cast<LogEventFilter::ConsumerId>(0));
     EXPECT_EQ(1, filter.mTagIdsPerConsumer.size());
-    EXPECT_EQ(kAtomIdsCount * 2, filter.mLocalTagIds.size());
+    EXPECT_EQ(kAtomIdsCount * 2, filter.mLocalSnapshot->tagIds.size());
     for (const auto& atomId : sampleIds) {
         bool const atomInUse = atomId > kAtomIdsCount;
         EXPECT_EQ(atomInUse, filter.isAtomInUse(atomId));
     }
-    EXPECT_EQ(kAtomIdsCount, filter.mLocalTagIds.size());
+    EXPECT_EQ(kAtomIdsCount, filter.mLocalSnapshot->tagIds.size());
     EXPECT_TRUE(testGuaranteedUnusedAtomsNotInUse(filter));
 
     // set empty filter for second consumer
     filter.setAtomIds(emptyAtomIdsSet, reinterpret_cast<LogEventFilter::ConsumerId>(1));
     EXPECT_EQ(0, filter.mTagIdsPerConsumer.size());
-    EXPECT_EQ(kAtomIdsCount, filter.mLocalTagIds.size());
+    EXPECT_EQ(kAtomIdsCount, filter.mLocalSnapshot->tagIds.size());
     for (const auto& atomId : sampleIds) {
         EXPECT_FALSE(filter.isAtomInUse(atomId));
     }
-    EXPECT_EQ(0, filter.mLocalTagIds.size());
+    EXPECT_EQ(0, filter.mLocalSnapshot->tagIds.size());
     EXPECT_TRUE(testGuaranteedUnusedAtomsNotInUse(filter));
 }
 
+TEST(AtomIdBitmapSetTest, TestDenseAndSparseIds) {
+    const int sparseAtomId = AtomIdBitmapSet::kMaxDenseAtomId + 1;
+    AtomIdBitmapSet atomIds{5, 100000, 3, 5, sparseAtomId};
+    EXPECT_EQ(4, atomIds.size());
+    EXPECT_EQ(1, atomIds.count(3));
+    EXPECT_EQ(1, atomIds.count(5));
+    EXPECT_EQ(1, atomIds.count(sparseAtomId));
+    EXPECT_EQ(1, atomIds.count(100000));
+    EXPECT_EQ(0, atomIds.count(4));
+    EXPECT_EQ(0, atomIds.count(AtomIdBitmapSet::kMaxDenseAtomId));
+    EXPECT_EQ(0, atomIds.count(100001));
+    EXPECT_EQ(0, atomIds.count(-1));
+
+    // iteration is in ascending order
+    EXPECT_EQ(std::vector<int>({3, 5, sparseAtomId, 100000}),
+              std::vector<int>(atomIds.begin(), atomIds.end()));
+
+    const std::set<int> moreAtomIds = {3, 7, 200000};
+    atomIds.insert(moreAtomIds.begin(), moreAtomIds.end());
+    EXPECT_EQ(6, atomIds.size());
+    EXPECT_EQ(1, atomIds.count(7));
+    EXPECT_EQ(1, atomIds.count(200000));
+    EXPECT_EQ(AtomIdBitmapSet({3, 5, 7, sparseAtomId, 100000, 200000}), atomIds);
+
+    atomIds.erase(5);
+    atomIds.erase(200000);
+    atomIds.erase(4);
+    EXPECT_EQ(AtomIdBitmapSet({3, 7, sparseAtomId, 100000}), atomIds);
+    EXPECT_EQ(0, atomIds.count(5));
+    EXPECT_EQ(0, atomIds.count(200000));
+
+    AtomIdBitmapSet otherAtomIds;
+    otherAtomIds.swap(atomIds);
+    EXPECT_TRUE(atomIds.empty());
+    EXPECT_EQ(0, atomIds.count(7));
+    EXPECT_EQ(1, otherAtomIds.count(7));
+
+    otherAtomIds.clear();
+    EXPECT_TRUE(otherAtomIds.empty());
+    EXPECT_EQ(0, otherAtomIds.count(3));
+    EXPECT_EQ(0, otherAtomIds.count(100000));
+}
+
+TEST(LogEventFilterTest, TestFieldMasks) {
+    LogEventFilter filter;
+    const auto consumer = reinterpret_cast<LogEventFilter::ConsumerId>(0);
+    AtomFieldMaskMap fieldMasks;
+    fieldMasks[1].set(2);
+    filter.setAtomFieldMasks(std::move(fieldMasks), consumer);
+    filter.setAtomIds(generateAtomIds(1, 2), consumer);
+    EXPECT_EQ(1, filter.mFieldMasksPerConsumer.size());
+
+    EXPECT_TRUE(filter.isAtomInUse(1));
+    const AtomFieldMask* fieldMask = filter.getAtomFieldMask(1);
+    ASSERT_NE(nullptr, fieldMask);
+    EXPECT_EQ(1, fieldMask->count());
+    EXPECT_TRUE(fieldMask->test(2));
+
+    // atom without mask is decoded entirely
+    EXPECT_TRUE(filter.isAtomInUse(2));
+    EXPECT_EQ(nullptr, filter.getAtomFieldMask(2));
+
+    filter.setFilteringEnabled(false);
+    EXPECT_EQ(nullptr, filter.getAtomFieldMask(1));
+    filter.setFilteringEnabled(true);
+
+    // removing masks of the consumer restores decoding atoms entirely
+    filter.setAtomFieldMasks(AtomFieldMaskMap(), consumer);
+    EXPECT_EQ(0, filter.mFieldMasksPerConsumer.size());
+    EXPECT_TRUE(filter.isAtomInUse(1));
+    EXPECT_EQ(nullptr, filter.getAtomFieldMask(1));
+}
+
+TEST(LogEventFilterTest, TestMultipleConsumerFieldMasks) {
+    LogEventFilter filter;
+    const auto consumer1 = reinterpret_cast<LogEventFilter::ConsumerId>(0);
+    const auto consumer2 = reinterpret_cast<LogEventFilter::ConsumerId>(1);
+    AtomFieldMaskMap fieldMasks1;
+    fieldMasks1[1].set(1);
+    fieldMasks1[2].set(1);
+    AtomFieldMaskMap fieldMasks2;
+    fieldMasks2[1].set(3);
+    filter.setAtomFieldMasks(std::move(fieldMasks1), consumer1);
+    filter.setAtomIds(generateAtomIds(1, 2), consumer1);
+    filter.setAtomFieldMasks(std::move(fieldMasks2), consumer2);
+    filter.setAtomIds(generateAtomIds(1, 3), consumer2);
+
+    // masks of consumers are combined
+    EXPECT_TRUE(filter.isAtomInUse(1));
+    const AtomFieldMask* fieldMask = filter.getAtomFieldMask(1);
+    ASSERT_NE(nullptr, fieldMask);
+    EXPECT_EQ(2, fieldMask->count());
+    EXPECT_TRUE(fieldMask->test(1));
+    EXPECT_TRUE(fieldMask->test(3));
+
+    // second consumer uses atom 2 entirely
+    EXPECT_TRUE(filter.isAtomInUse(2));
+    EXPECT_EQ(nullptr, filter.getAtomFieldMask(2));
+    EXPECT_TRUE(filter.isAtomInUse(3));
+    EXPECT_EQ(nullptr, filter.getAtomFieldMask(3));
+
+    // mask applies again once the second consumer does not use atom 2
+    filter.setAtomIds(LogEventFilter::AtomIdSet(), consumer2);
+    EXPECT_TRUE(filter.isAtomInUse(2));
+    fieldMask = filter.getAtomFieldMask(2);
+    ASSERT_NE(nullptr, fieldMask);
+    EXPECT_TRUE(fieldMask->test(1));
+    fieldMask = filter.getAtomFieldMask(1);
+    ASSERT_NE(nullptr, fieldMask);
+    EXPECT_EQ(1, fieldMask->count());
+}
+
+TEST(LogEventFilterTest, TestPriorityAtomIds) {
+    LogEventFilter filter;
+    const auto consumer1 = reinterpret_cast<LogEventFilter::ConsumerId>(0);
+    const auto consumer2 = reinterpret_cast<LogEventFilter::ConsumerId>(1);
+    filter.setAtomIds(generateAtomIds(1, 3), consumer1);
+    filter.setPriorityAtomIds(generateAtomIds(1, 1), consumer1);
+    filter.setPriorityAtomIds(generateAtomIds(3, 4), consumer2);
+
+    EXPECT_TRUE(filter.isPriorityAtom(1));
+    EXPECT_FALSE(filter.isPriorityAtom(2));
+    EXPECT_TRUE(filter.isPriorityAtom(3));
+    EXPECT_TRUE(filter.isPriorityAtom(4));
+    EXPECT_EQ(3, filter.mLocalSnapshot->priorityTagIds.size());
+
+    // priority atoms do not depend on filtering
+    filter.setFilteringEnabled(false);
+    EXPECT_TRUE(filter.isPriorityAtom(1));
+    EXPECT_FALSE(filter.isPriorityAtom(2));
+
+    filter.setPriorityAtomIds(LogEventFilter::AtomIdSet(), consumer2);
+    EXPECT_TRUE(filter.isPriorityAtom(1));
+    EXPECT_FALSE(filter.isPriorityAtom(3));
+    EXPECT_FALSE(filter.isPriorityAtom(4));
+}
+
+TEST(LogEventFilterTest, TestConcurrentUpdatesPublishWholeSnapshot) {
+    LogEventFilter filter;
+    const auto consumer = reinterpret_cast<LogEventFilter::ConsumerId>(0);
+    std::atomic_bool stopReader = false;
+    std::atomic_int inconsistentSnapshots = 0;
+
+    // reader should always observe either none or all of the atom ids of a single update
+    std::thread reader([&] {
+        while (!stopReader) {
+            const bool firstInUse = filter.isAtomInUse(1);
+            const int snapshotSize = (int)filter.mLocalSnapshot->tagIds.size();
+            if (snapshotSize != (firstInUse ? kAtomIdsCount : 0)) {
+                inconsistentSnapshots++;
+            }
+        }
+    });
+
+    for (int i = 0; i < 1000; ++i) {
+        filter.setAtomIds(i % 2 ? generateAtomIds(1, kAtomIdsCount) : LogEventFilter::AtomIdSet(),
+                          consumer);
+    }
+    stopReader = true;
+    reader.join();
+
+    EXPECT_EQ(0, inconsistentSnapshots);
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
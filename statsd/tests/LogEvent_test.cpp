@@ -14,6 +14,7 @@
 
 #include "src/logd/LogEvent.h"
 
+#include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
 #include "flags/FlagProvider.h"
@@ -32,6 +33,7 @@ namespace statsd {
 
 using std::string;
 using std::vector;
+using testing::ElementsAre;
 using ::util::ProtoOutputStream;
 using ::util::ProtoReader;
 
@@ -248,6 +250,40 @@ TEST_P(LogEventTest, TestPrimitiveParsing) {
     AStatsEvent_release(event);
 }
 
+TEST_P(LogEventTest, TestPrimitiveParsingWithAnnotations) {
+    AStatsEvent* event = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(event, 100);
+    AStatsEvent_writeInt32(event, 1001);
+    AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_IS_UID, true);
+    AStatsEvent_writeInt64(event, 0x123456789);
+    AStatsEvent_writeBool(event, false);
+    AStatsEvent_build(event);
+
+    size_t size;
+    const uint8_t* buf = AStatsEvent_getBuffer(event, &size);
+
+    LogEvent logEvent(/*uid=*/1000, /*pid=*/1001);
+    EXPECT_TRUE(ParseBuffer(logEvent, buf, size));
+    EXPECT_EQ(logEvent.getNumUidFields(), 1);
+
+    const vector<FieldValue>& values = logEvent.getValues();
+    ASSERT_EQ(3, values.size());
+    EXPECT_EQ(getField(100, {1, 1, 1}, 0, {false, false, false}), values[0].mField);
+    EXPECT_EQ(1001, values[0].mValue.int_value);
+    EXPECT_TRUE(isUidField(values[0]));
+    EXPECT_EQ(getField(100, {2, 1, 1}, 0, {false, false, false}), values[1].mField);
+    EXPECT_EQ(0x123456789, values[1].mValue.long_value);
+    EXPECT_EQ(getField(100, {3, 1, 1}, 0, {false, false, false}), values[2].mField);
+    EXPECT_EQ(Type::INT, values[2].mValue.getType());
+    EXPECT_EQ(0, values[2].mValue.int_value);
+
+    // A truncated body is not decoded without bounds checks.
+    LogEvent truncatedLogEvent(/*uid=*/1000, /*pid=*/1001);
+    EXPECT_FALSE(ParseBuffer(truncatedLogEvent, buf, size - 1));
+
+    AStatsEvent_release(event);
+}
+
 TEST_P(LogEventTest, TestEventWithInvalidHeaderParsing) {
     AStatsEvent* event = AStatsEvent_obtain();
     AStatsEvent_setAtomId(event, 100);
@@ -300,6 +336,123 @@ TEST(LogEventTestParsing, TestFetchHeaderOnly) {
     ASSERT_EQ(0, logEvent.getValues().size());
 }
 
+TEST(LogEventTestParsing, TestParseBodyWithFieldMask) {
+    AStatsEvent* event = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(event, 100);
+    uint32_t uids[] = {1001, 1002};
+    const char* tags[] = {"tag1", "tag2"};
+    AStatsEvent_writeAttributionChain(event, uids, tags, 2);
+    AStatsEvent_writeInt32(event, 10);
+    AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_IS_UID, true);
+    AStatsEvent_writeString(event, "test");
+    int32_t int32Array[] = {3, 6};
+    AStatsEvent_writeInt32Array(event, int32Array, 2);
+    AStatsEvent_writeInt64(event, 0x123456789);
+    AStatsEvent_build(event);
+
+    size_t size;
+    const uint8_t* buf = AStatsEvent_getBuffer(event, &size);
+
+    AtomFieldMask fieldMask;
+    fieldMask.set(2);
+    fieldMask.set(5);
+
+    LogEvent logEvent(/*uid=*/1000, /*pid=*/1001);
+    const LogEvent::BodyBufferInfo bodyInfo = logEvent.parseHeader(buf, size);
+    EXPECT_TRUE(logEvent.parseBody(bodyInfo, &fieldMask));
+    EXPECT_FALSE(logEvent.isParsedHeaderOnly());
+
+    EXPECT_EQ(100, logEvent.GetTagId());
+    EXPECT_FALSE(logEvent.hasAttributionChain());
+    EXPECT_EQ(1, logEvent.getNumUidFields());
+    EXPECT_THAT(logEvent.getUidFieldIndices(), ElementsAre(0));
+
+    const vector<FieldValue>& values = logEvent.getValues();
+    ASSERT_EQ(2, values.size());
+    EXPECT_EQ(getField(100, {2, 1, 1}, 0, {false, false, false}), values[0].mField);
+    EXPECT_EQ(10, values[0].mValue.int_value);
+    EXPECT_TRUE(isUidField(values[0]));
+    EXPECT_EQ(getField(100, {5, 1, 1}, 0, {true, false, false}), values[1].mField);
+    EXPECT_EQ(0x123456789, values[1].mValue.long_value);
+
+    // Decoding all fields through the mask should match the regular parsing.
+    fieldMask.set();
+    LogEvent maskedLogEvent(/*uid=*/1000, /*pid=*/1001);
+    EXPECT_TRUE(maskedLogEvent.parseBody(maskedLogEvent.parseHeader(buf, size), &fieldMask));
+    LogEvent fullLogEvent(/*uid=*/1000, /*pid=*/1001);
+    EXPECT_TRUE(fullLogEvent.parseBuffer(buf, size));
+    EXPECT_EQ(fullLogEvent.getValues(), maskedLogEvent.getValues());
+    EXPECT_TRUE(maskedLogEvent.hasAttributionChain());
+
+    // Skipped fields are still validated against the buffer size.
+    fieldMask.reset();
+    LogEvent truncatedLogEvent(/*uid=*/1000, /*pid=*/1001);
+    EXPECT_FALSE(truncatedLogEvent.parseBody(truncatedLogEvent.parseHeader(buf, size - 1),
+                                             &fieldMask));
+    EXPECT_EQ(0, truncatedLogEvent.getValues().size());
+
+    AStatsEvent_release(event);
+}
+
+TEST_P(LogEventTest, TestToProtoFromRawBody) {
+    AStatsEvent* event = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(event, 100);
+    uint32_t uids[] = {1001, 1002};
+    const char* tags[] = {"tag1", "tag2"};
+    AStatsEvent_writeAttributionChain(event, uids, tags, 2);
+    AStatsEvent_writeInt32(event, -10);
+    AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_IS_UID, true);
+    AStatsEvent_writeInt64(event, 0x123456789);
+    AStatsEvent_writeFloat(event, 2.0);
+    AStatsEvent_writeBool(event, true);
+    AStatsEvent_writeString(event, "test");
+    const uint8_t bytes[] = {'b', '\0', 'c'};
+    AStatsEvent_writeByteArray(event, bytes, 3);
+    int32_t int32Array[] = {3, 6};
+    AStatsEvent_writeInt32Array(event, int32Array, 2);
+    bool boolArray[] = {true, false};
+    AStatsEvent_writeBoolArray(event, boolArray, 2);
+    const char* stringArray[] = {"a", ""};
+    AStatsEvent_writeStringArray(event, stringArray, 2);
+    AStatsEvent_build(event);
+
+    size_t size;
+    const uint8_t* buf = AStatsEvent_getBuffer(event, &size);
+
+    LogEvent logEvent(/*uid=*/1000, /*pid=*/1001);
+    EXPECT_TRUE(ParseBuffer(logEvent, buf, size));
+    EXPECT_TRUE(logEvent.hasRawBody());
+
+    // The transcoded body is encoded as the values.
+    ProtoOutputStream rawProto;
+    logEvent.ToProto(rawProto);
+    vector<uint8_t> rawBytes;
+    rawProto.serializeToVector(&rawBytes);
+    ProtoOutputStream valuesProto;
+    writeFieldValueTreeToStream(logEvent.GetTagId(), logEvent.getValues(), &valuesProto);
+    vector<uint8_t> valuesBytes;
+    valuesProto.serializeToVector(&valuesBytes);
+    EXPECT_EQ(valuesBytes, rawBytes);
+
+    // Modified values are encoded instead of the body.
+    (*logEvent.getMutableValues())[4].mValue.int_value = 5;
+    EXPECT_FALSE(logEvent.hasRawBody());
+    ProtoOutputStream modifiedProto;
+    logEvent.ToProto(modifiedProto);
+    vector<uint8_t> modifiedBytes;
+    modifiedProto.serializeToVector(&modifiedBytes);
+    EXPECT_NE(rawBytes, modifiedBytes);
+
+    // The body is not kept when some fields were skipped.
+    AtomFieldMask fieldMask;
+    fieldMask.set(2);
+    LogEvent maskedLogEvent(/*uid=*/1000, /*pid=*/1001);
+    EXPECT_TRUE(maskedLogEvent.parseBody(maskedLogEvent.parseHeader(buf, size), &fieldMask));
+    EXPECT_FALSE(maskedLogEvent.hasRawBody());
+
+    AStatsEvent_release(event);
+}
+
 TEST_P(LogEventTest, TestStringAndByteArrayParsing) {
     AStatsEvent* event = AStatsEvent_obtain();
     AStatsEvent_setAtomId(event, 100);
@@ -368,6 +521,93 @@ TEST_P(LogEventTest, TestEmptyString) {
     AStatsEvent_release(event);
 }
 
+TEST_P(LogEventTest, TestStringsWithAnnotationsParsing) {
+    AStatsEvent* event = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(event, 100);
+    AStatsEvent_writeInt32(event, 1001);
+    AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_IS_UID, true);
+    AStatsEvent_writeString(event, "package");
+    AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_PRIMARY_FIELD, true);
+    AStatsEvent_writeInt64(event, 0x123456789);
+    AStatsEvent_writeString(event, "");
+    AStatsEvent_build(event);
+
+    size_t size;
+    const uint8_t* buf = AStatsEvent_getBuffer(event, &size);
+
+    LogEvent logEvent(/*uid=*/1000, /*pid=*/1001);
+    EXPECT_TRUE(ParseBuffer(logEvent, buf, size));
+    EXPECT_THAT(logEvent.getUidFieldIndices(), ElementsAre(0));
+
+    const vector<FieldValue>& values = logEvent.getValues();
+    ASSERT_EQ(4, values.size());
+    EXPECT_EQ(getField(100, {1, 1, 1}, 0, {false, false, false}), values[0].mField);
+    EXPECT_EQ(1001, values[0].mValue.int_value);
+    EXPECT_TRUE(isUidField(values[0]));
+    EXPECT_EQ(getField(100, {2, 1, 1}, 0, {false, false, false}), values[1].mField);
+    EXPECT_EQ("package", values[1].mValue.str_value);
+    EXPECT_TRUE(values[1].mAnnotations.isPrimaryField());
+    EXPECT_EQ(0x123456789, values[2].mValue.long_value);
+    EXPECT_EQ(getField(100, {4, 1, 1}, 0, {true, false, false}), values[3].mField);
+    EXPECT_EQ(Type::STRING, values[3].mValue.getType());
+    EXPECT_EQ("", values[3].mValue.str_value);
+
+    AStatsEvent_release(event);
+}
+
+TEST_P(LogEventTest, TestStringLengthPastEnd) {
+    AStatsEvent* event = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(event, 100);
+    AStatsEvent_writeInt32(event, 10);
+    AStatsEvent_writeString(event, "abc");
+    AStatsEvent_build(event);
+
+    size_t size;
+    const uint8_t* buf = AStatsEvent_getBuffer(event, &size);
+    // the string is the last value, its length precedes it
+    vector<uint8_t> buffer(buf, buf + size);
+    const int32_t numBytes = 1000;
+    memcpy(buffer.data() + size - 3 - sizeof(numBytes), &numBytes, sizeof(numBytes));
+
+    LogEvent logEvent(/*uid=*/1000, /*pid=*/1001);
+    EXPECT_FALSE(ParseBuffer(logEvent, buffer.data(), buffer.size()));
+
+    AStatsEvent_release(event);
+}
+
+TEST_P(LogEventTest, TestFlatFieldsFollowedByList) {
+    AStatsEvent* event = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(event, 100);
+    AStatsEvent_writeInt32(event, 10);
+    AStatsEvent_writeString(event, "abc");
+    int32_t int32Array[] = {3, 6};
+    AStatsEvent_writeInt32Array(event, int32Array, 2);
+    AStatsEvent_writeInt64(event, 20);
+    AStatsEvent_build(event);
+
+    size_t size;
+    const uint8_t* buf = AStatsEvent_getBuffer(event, &size);
+
+    LogEvent logEvent(/*uid=*/1000, /*pid=*/1001);
+    EXPECT_TRUE(ParseBuffer(logEvent, buf, size));
+
+    // the generic parsing picks up at the list, after the leading flat fields
+    const vector<FieldValue>& values = logEvent.getValues();
+    ASSERT_EQ(5, values.size());
+    EXPECT_EQ(getField(100, {1, 1, 1}, 0, {false, false, false}), values[0].mField);
+    EXPECT_EQ(10, values[0].mValue.int_value);
+    EXPECT_EQ(getField(100, {2, 1, 1}, 0, {false, false, false}), values[1].mField);
+    EXPECT_EQ("abc", values[1].mValue.str_value);
+    EXPECT_EQ(getField(100, {3, 1, 1}, 1, {false, false, false}), values[2].mField);
+    EXPECT_EQ(3, values[2].mValue.int_value);
+    EXPECT_EQ(getField(100, {3, 2, 1}, 1, {false, true, false}), values[3].mField);
+    EXPECT_EQ(6, values[3].mValue.int_value);
+    EXPECT_EQ(getField(100, {4, 1, 1}, 0, {true, false, false}), values[4].mField);
+    EXPECT_EQ(20, values[4].mValue.long_value);
+
+    AStatsEvent_release(event);
+}
+
 TEST_P(LogEventTest, TestByteArrayWithNullCharacter) {
     AStatsEvent* event = AStatsEvent_obtain();
     AStatsEvent_setAtomId(event, 100);
@@ -738,6 +978,7 @@ TEST_P(LogEventTest, TestAnnotationIdIsUid_RepeatedIntAndOtherFields) {
     LogEvent logEvent(/*uid=*/1000, /*pid=*/1001);
     EXPECT_TRUE(ParseBuffer(logEvent, buf, size));
     EXPECT_EQ(2, logEvent.getNumUidFields());
+    EXPECT_THAT(logEvent.getUidFieldIndices(), ElementsAre(1, 2));
 
     const vector<FieldValue>& values = logEvent.getValues();
     ASSERT_EQ(values.size(), 5);
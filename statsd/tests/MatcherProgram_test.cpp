@@ -0,0 +1,235 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/matchers/MatcherProgram.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "src/matchers/matcher_util.h"
+#include "tests/statsd_test_util.h"
+
+using std::optional;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+const int32_t TAG_ID = 123;
+
+sp<UidMap> createUidMap() {
+    sp<UidMap> uidMap = new UidMap();
+    UidData uidData;
+    *uidData.add_app_info() = createApplicationInfo(/*uid*/ 1111, /*version*/ 1, "v1", "pkg0");
+    *uidData.add_app_info() = createApplicationInfo(/*uid*/ 2222, /*version*/ 1, "v1", "pkg1");
+    uidMap->updateMap(1, uidData);
+    return uidMap;
+}
+
+vector<shared_ptr<LogEvent>> createEvents() {
+    vector<shared_ptr<LogEvent>> events;
+    events.push_back(makeAttributionLogEvent(TAG_ID, 0, {1111, 2222, 1066},
+                                             {"tag1", "tag2", "tag3"}, 1, 2));
+    events.push_back(makeAttributionLogEvent(TAG_ID, 0, {2222}, {"tag2"}, -5, 100));
+    events.push_back(makeAttributionLogEvent(TAG_ID, 0, {1066}, {""}, 0, 0));
+    events.push_back(makeUidLogEvent(TAG_ID, 0, 1111, 3, 4));
+    events.push_back(makeRepeatedUidLogEvent(TAG_ID, 0, {1111, 2222}, 1, 2));
+    events.push_back(makeUidLogEvent(TAG_ID + 1, 0, 1111, 3, 4));
+    return events;
+}
+
+SimpleAtomMatcher createAttributionMatcher(Position position, int uid, const string& tag) {
+    SimpleAtomMatcher matcher;
+    matcher.set_atom_id(TAG_ID);
+    FieldValueMatcher* attributionMatcher = matcher.add_field_value_matcher();
+    attributionMatcher->set_field(1);
+    attributionMatcher->set_position(position);
+    FieldValueMatcher* uidMatcher = attributionMatcher->mutable_matches_tuple()
+                                            ->add_field_value_matcher();
+    uidMatcher->set_field(1);
+    uidMatcher->set_eq_int(uid);
+    FieldValueMatcher* tagMatcher = attributionMatcher->mutable_matches_tuple()
+                                            ->add_field_value_matcher();
+    tagMatcher->set_field(2);
+    tagMatcher->set_eq_string(tag);
+    return matcher;
+}
+
+vector<SimpleAtomMatcher> createMatchers() {
+    vector<SimpleAtomMatcher> matchers;
+
+    SimpleAtomMatcher matcher;
+    matcher.set_atom_id(TAG_ID);
+    matchers.push_back(matcher);
+
+    for (const Position position : {Position::FIRST, Position::LAST, Position::ANY}) {
+        matchers.push_back(createAttributionMatcher(position, 2222, "tag2"));
+        matchers.push_back(createAttributionMatcher(position, 1111, "tag2"));
+
+        matcher.clear_field_value_matcher();
+        FieldValueMatcher* fvm = matcher.add_field_value_matcher();
+        fvm->set_field(1);
+        fvm->set_position(position);
+        FieldValueMatcher* uidMatcher = fvm->mutable_matches_tuple()->add_field_value_matcher();
+        uidMatcher->set_field(1);
+        uidMatcher->mutable_eq_any_string()->add_str_value("pkg1");
+        uidMatcher->mutable_eq_any_string()->add_str_value("AID_STATSD");
+        matchers.push_back(matcher);
+
+        matcher.clear_field_value_matcher();
+        fvm = matcher.add_field_value_matcher();
+        fvm->set_field(1);
+        fvm->set_position(position);
+        fvm->mutable_neq_any_int()->add_int_value(1111);
+        matchers.push_back(matcher);
+    }
+
+    matcher.clear_field_value_matcher();
+    matcher.add_field_value_matcher()->set_field(2);
+    matcher.mutable_field_value_matcher(0)->set_lt_int(0);
+    matchers.push_back(matcher);
+
+    matcher.clear_field_value_matcher();
+    matcher.add_field_value_matcher()->set_field(2);
+    matcher.mutable_field_value_matcher(0)->set_gte_int(1);
+    matcher.add_field_value_matcher()->set_field(3);
+    matcher.mutable_field_value_matcher(1)->mutable_eq_any_int()->add_int_value(2);
+    matcher.mutable_field_value_matcher(1)->mutable_eq_any_int()->add_int_value(4);
+    matchers.push_back(matcher);
+
+    matcher.clear_field_value_matcher();
+    matcher.add_field_value_matcher()->set_field(1);
+    matcher.mutable_field_value_matcher(0)->set_eq_wildcard_string("pkg*");
+    matchers.push_back(matcher);
+
+    matcher.clear_field_value_matcher();
+    matcher.add_field_value_matcher()->set_field(1);
+    matcher.mutable_field_value_matcher(0)->set_eq_bool(true);
+    matchers.push_back(matcher);
+
+    matcher.clear_field_value_matcher();
+    matcher.add_field_value_matcher()->set_field(4);
+    matcher.mutable_field_value_matcher(0)->set_eq_int(1);
+    matchers.push_back(matcher);
+
+    return matchers;
+}
+
+}  // anonymous namespace
+
+TEST(MatcherProgramTest, TestMatchesSameAsProto) {
+    const sp<UidMap> uidMap = createUidMap();
+    const vector<shared_ptr<LogEvent>> events = createEvents();
+    const vector<SimpleAtomMatcher> matchers = createMatchers();
+    for (int i = 0; i < matchers.size(); i++) {
+        const optional<MatcherProgram> program = MatcherProgram::compile(matchers[i]);
+        ASSERT_TRUE(program.has_value()) << "matcher " << i;
+        for (int j = 0; j < events.size(); j++) {
+            EXPECT_EQ(matchesSimple(uidMap, matchers[i], *events[j]).matched,
+                      program->matches(uidMap, *events[j]))
+                    << "matcher " << i << " event " << j;
+        }
+    }
+}
+
+TEST(MatcherProgramTest, TestAttributionChain) {
+    const sp<UidMap> uidMap = createUidMap();
+    shared_ptr<LogEvent> event =
+            makeAttributionLogEvent(TAG_ID, 0, {1111, 2222, 3333}, {"tag1", "tag2", "tag3"}, 1, 2);
+
+    optional<MatcherProgram> program =
+            MatcherProgram::compile(createAttributionMatcher(Position::ANY, 2222, "tag2"));
+    ASSERT_TRUE(program.has_value());
+    EXPECT_TRUE(program->matches(uidMap, *event));
+
+    // Uid & tag of different attribution nodes.
+    program = MatcherProgram::compile(createAttributionMatcher(Position::ANY, 1111, "tag2"));
+    ASSERT_TRUE(program.has_value());
+    EXPECT_FALSE(program->matches(uidMap, *event));
+
+    program = MatcherProgram::compile(createAttributionMatcher(Position::FIRST, 1111, "tag1"));
+    ASSERT_TRUE(program.has_value());
+    EXPECT_TRUE(program->matches(uidMap, *event));
+
+    program = MatcherProgram::compile(createAttributionMatcher(Position::LAST, 1111, "tag1"));
+    ASSERT_TRUE(program.has_value());
+    EXPECT_FALSE(program->matches(uidMap, *event));
+
+    program = MatcherProgram::compile(createAttributionMatcher(Position::LAST, 3333, "tag3"));
+    ASSERT_TRUE(program.has_value());
+    EXPECT_TRUE(program->matches(uidMap, *event));
+}
+
+TEST(MatcherProgramTest, TestUidMatchSetUpdatedWithUidMap) {
+    const sp<UidMap> uidMap = createUidMap();
+    const shared_ptr<LogEvent> event = makeUidLogEvent(TAG_ID, 0, 3333, 3, 4);
+
+    SimpleAtomMatcher matcher;
+    matcher.set_atom_id(TAG_ID);
+    matcher.add_field_value_matcher()->set_field(1);
+    matcher.mutable_field_value_matcher(0)->set_eq_string("pkg3");
+    const optional<MatcherProgram> program = MatcherProgram::compile(matcher);
+    ASSERT_TRUE(program.has_value());
+
+    matcher.mutable_field_value_matcher(0)->set_eq_wildcard_string("pkg*");
+    const optional<MatcherProgram> wildcardProgram = MatcherProgram::compile(matcher);
+    ASSERT_TRUE(wildcardProgram.has_value());
+
+    EXPECT_FALSE(program->matches(uidMap, *event));
+    EXPECT_FALSE(wildcardProgram->matches(uidMap, *event));
+
+    uidMap->updateApp(2, "pkg3", 3333, 1, "v1", "", /* certificateHash */ {});
+    EXPECT_TRUE(program->matches(uidMap, *event));
+    EXPECT_TRUE(wildcardProgram->matches(uidMap, *event));
+
+    uidMap->removeApp(3, "pkg3", 3333);
+    EXPECT_FALSE(program->matches(uidMap, *event));
+    EXPECT_FALSE(wildcardProgram->matches(uidMap, *event));
+
+    // Other apps of the uid are matched by the wildcard only.
+    uidMap->updateApp(4, "pkg4", 3333, 1, "v1", "", /* certificateHash */ {});
+    EXPECT_FALSE(program->matches(uidMap, *event));
+    EXPECT_TRUE(wildcardProgram->matches(uidMap, *event));
+
+    // The sets are rebuilt for a different UidMap.
+    EXPECT_FALSE(wildcardProgram->matches(createUidMap(), *event));
+}
+
+TEST(MatcherProgramTest, TestStringTransformationNotCompiled) {
+    SimpleAtomMatcher matcher = createAttributionMatcher(Position::ANY, 1111, "tag");
+    EXPECT_TRUE(MatcherProgram::compile(matcher).has_value());
+
+    FieldValueMatcher* tagMatcher =
+            matcher.mutable_field_value_matcher(0)
+                    ->mutable_matches_tuple()
+                    ->mutable_field_value_matcher(1);
+    tagMatcher->mutable_replace_string()->set_regex(R"([\d]+$)");
+    tagMatcher->mutable_replace_string()->set_replacement("");
+    EXPECT_FALSE(MatcherProgram::compile(matcher).has_value());
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
@@ -299,6 +299,154 @@ TEST(MetricsManagerTest, TestCheckLogCredentialsWhitelistedAtom) {
     EXPECT_TRUE(metricsManager.checkLogCredentials(event));
 }
 
+TEST(MetricsManagerTest, TestLogEventScratchBuffersReset) {
+    sp<UidMap> uidMap;
+    sp<StatsPullerManager> pullerManager = new StatsPullerManager();
+    sp<AlarmMonitor> anomalyAlarmMonitor;
+    sp<AlarmMonitor> periodicAlarmMonitor;
+
+    StatsdConfig config;
+    AtomMatcher screenOnMatcher = CreateScreenTurnedOnAtomMatcher();
+    *config.add_atom_matcher() = screenOnMatcher;
+    AtomMatcher screenOffMatcher = CreateScreenTurnedOffAtomMatcher();
+    *config.add_atom_matcher() = screenOffMatcher;
+    *config.add_atom_matcher() = CreateBatteryStateNoneMatcher();
+    *config.add_atom_matcher() = CreateBatteryStateUsbMatcher();
+
+    AtomMatcher* screenChangedMatcher = config.add_atom_matcher();
+    screenChangedMatcher->set_id(StringToId("ScreenChanged"));
+    screenChangedMatcher->mutable_combination()->set_operation(LogicalOperation::OR);
+    addMatcherToMatcherCombination(screenOnMatcher, screenChangedMatcher);
+    addMatcherToMatcherCombination(screenOffMatcher, screenChangedMatcher);
+
+    Predicate screenOnPredicate = CreateScreenIsOnPredicate();
+    *config.add_predicate() = screenOnPredicate;
+    Predicate unpluggedPredicate = CreateDeviceUnpluggedPredicate();
+    *config.add_predicate() = unpluggedPredicate;
+
+    Predicate* screenOnOrUnpluggedPredicate = config.add_predicate();
+    screenOnOrUnpluggedPredicate->set_id(StringToId("ScreenOnOrUnplugged"));
+    screenOnOrUnpluggedPredicate->mutable_combination()->set_operation(LogicalOperation::OR);
+    addPredicateToPredicateCombination(screenOnPredicate, screenOnOrUnpluggedPredicate);
+    addPredicateToPredicateCombination(unpluggedPredicate, screenOnOrUnpluggedPredicate);
+
+    *config.add_count_metric() = createCountMetric("ScreenChangedWhileScreenOnOrUnplugged",
+                                                   screenChangedMatcher->id(),
+                                                   screenOnOrUnpluggedPredicate->id(), {});
+
+    MetricsManager metricsManager(kConfigKey, config, timeBaseSec, timeBaseSec, uidMap,
+                                  pullerManager, anomalyAlarmMonitor, periodicAlarmMonitor);
+    ASSERT_TRUE(metricsManager.isConfigValid());
+
+    const auto assertScratchBuffersReset = [&metricsManager] {
+        ASSERT_THAT(metricsManager.mMatcherCache, SizeIs(5));
+        EXPECT_THAT(metricsManager.mMatcherCache, Each(MatchingState::kNotComputed));
+        EXPECT_THAT(metricsManager.mMatcherTransformations, Each(IsNull()));
+        ASSERT_THAT(metricsManager.mConditionCache, SizeIs(3));
+        EXPECT_THAT(metricsManager.mConditionCache, Each(ConditionState::kNotEvaluated));
+        EXPECT_THAT(metricsManager.mChangedCache, Each(false));
+        EXPECT_THAT(metricsManager.mConditionToBeEvaluated, Each(false));
+        EXPECT_THAT(metricsManager.mConditionToTransformedLogEvents, Each(IsNull()));
+        EXPECT_THAT(metricsManager.mConditionsToBeEvaluated, IsEmpty());
+    };
+
+    const int64_t eventTimeNs = timeBaseSec * NS_PER_SEC;
+    metricsManager.onLogEvent(*CreateScreenStateChangedEvent(
+            eventTimeNs + 1, android::view::DisplayStateEnum::DISPLAY_STATE_ON));
+    assertScratchBuffersReset();
+
+    metricsManager.onLogEvent(*CreateBatteryStateChangedEvent(
+            eventTimeNs + 2, BatteryPluggedStateEnum::BATTERY_PLUGGED_NONE));
+    assertScratchBuffersReset();
+
+    metricsManager.onLogEvent(*CreateScreenStateChangedEvent(
+            eventTimeNs + 3, android::view::DisplayStateEnum::DISPLAY_STATE_OFF));
+    assertScratchBuffersReset();
+}
+
+TEST(MetricsManagerTest, TestActivationExpiryQueue) {
+    sp<UidMap> uidMap;
+    sp<StatsPullerManager> pullerManager = new StatsPullerManager();
+    sp<AlarmMonitor> anomalyAlarmMonitor;
+    sp<AlarmMonitor> periodicAlarmMonitor;
+
+    StatsdConfig config;
+    AtomMatcher saverModeMatcher = CreateBatterySaverModeStartAtomMatcher();
+    *config.add_atom_matcher() = saverModeMatcher;
+    AtomMatcher screenOnMatcher = CreateScreenTurnedOnAtomMatcher();
+    *config.add_atom_matcher() = screenOnMatcher;
+    AtomMatcher brightnessChangedMatcher = CreateScreenBrightnessChangedAtomMatcher();
+    *config.add_atom_matcher() = brightnessChangedMatcher;
+    AtomMatcher screenOffMatcher = CreateScreenTurnedOffAtomMatcher();
+    *config.add_atom_matcher() = screenOffMatcher;
+
+    CountMetric saverMetric = createCountMetric("CountScreenOnAfterSaver", screenOnMatcher.id(),
+                                                nullopt, {});
+    *config.add_count_metric() = saverMetric;
+    CountMetric brightnessMetric = createCountMetric(
+            "CountScreenOnAfterBrightness", screenOnMatcher.id(), nullopt, {});
+    *config.add_count_metric() = brightnessMetric;
+
+    MetricActivation* saverActivation = config.add_metric_activation();
+    saverActivation->set_metric_id(saverMetric.id());
+    EventActivation* saverEventActivation = saverActivation->add_event_activation();
+    saverEventActivation->set_atom_matcher_id(saverModeMatcher.id());
+    saverEventActivation->set_ttl_seconds(60);
+    saverEventActivation->set_deactivation_atom_matcher_id(screenOffMatcher.id());
+    MetricActivation* brightnessActivation = config.add_metric_activation();
+    brightnessActivation->set_metric_id(brightnessMetric.id());
+    EventActivation* brightnessEventActivation = brightnessActivation->add_event_activation();
+    brightnessEventActivation->set_atom_matcher_id(brightnessChangedMatcher.id());
+    brightnessEventActivation->set_ttl_seconds(120);
+
+    MetricsManager metricsManager(kConfigKey, config, timeBaseSec, timeBaseSec, uidMap,
+                                  pullerManager, anomalyAlarmMonitor, periodicAlarmMonitor);
+    ASSERT_TRUE(metricsManager.isConfigValid());
+    const sp<MetricProducer>& saverProducer = metricsManager.mAllMetricProducers[0];
+    const sp<MetricProducer>& brightnessProducer = metricsManager.mAllMetricProducers[1];
+    EXPECT_TRUE(metricsManager.mActivationExpiryQueue.empty());
+    EXPECT_FALSE(metricsManager.isActive());
+
+    const int64_t startTimeNs = timeBaseSec * NS_PER_SEC;
+    metricsManager.onLogEvent(*CreateBatterySaverOnEvent(startTimeNs + 1));
+    ASSERT_EQ(metricsManager.mActivationExpiryQueue.size(), 1);
+    EXPECT_EQ(metricsManager.mActivationExpiryQueue.top()->metricIndex, 0);
+    EXPECT_EQ(metricsManager.mActivationExpiryQueue.top()->expiryNs,
+              startTimeNs + 1 + 60 * NS_PER_SEC);
+
+    metricsManager.onLogEvent(*CreateScreenBrightnessChangedEvent(startTimeNs + 2, 64));
+    ASSERT_EQ(metricsManager.mActivationExpiryQueue.size(), 2);
+    EXPECT_EQ(metricsManager.mActivationExpiryQueue.top()->metricIndex, 0);
+
+    // The cancelled activation is removed from the queue.
+    metricsManager.onLogEvent(*CreateScreenStateChangedEvent(
+            startTimeNs + 3, android::view::DisplayStateEnum::DISPLAY_STATE_OFF));
+    EXPECT_FALSE(saverProducer->isActive());
+    ASSERT_EQ(metricsManager.mActivationExpiryQueue.size(), 1);
+    EXPECT_EQ(metricsManager.mActivationExpiryQueue.top()->metricIndex, 1);
+    EXPECT_EQ(metricsManager.mActivationExpiryQueue.top()->expiryNs,
+              startTimeNs + 2 + 120 * NS_PER_SEC);
+
+    metricsManager.onLogEvent(*CreateBatterySaverOnEvent(startTimeNs + 4));
+    ASSERT_EQ(metricsManager.mActivationExpiryQueue.size(), 2);
+    EXPECT_EQ(metricsManager.mActivationExpiryQueue.top()->metricIndex, 0);
+
+    // Only the saver activation expired.
+    metricsManager.onLogEvent(*CreateScreenStateChangedEvent(
+            startTimeNs + 61 * NS_PER_SEC, android::view::DisplayStateEnum::DISPLAY_STATE_ON));
+    EXPECT_FALSE(saverProducer->isActive());
+    EXPECT_TRUE(brightnessProducer->isActive());
+    ASSERT_EQ(metricsManager.mActivationExpiryQueue.size(), 1);
+    EXPECT_EQ(metricsManager.mActivationExpiryQueue.top()->metricIndex, 1);
+    EXPECT_TRUE(metricsManager.isActive());
+
+    metricsManager.onLogEvent(*CreateScreenStateChangedEvent(
+            startTimeNs + 200 * NS_PER_SEC, android::view::DisplayStateEnum::DISPLAY_STATE_ON));
+    EXPECT_FALSE(brightnessProducer->isActive());
+    EXPECT_TRUE(metricsManager.mActivationExpiryQueue.empty());
+    EXPECT_FALSE(metricsManager.isActive());
+}
+
 TEST(MetricsManagerTest, TestWhitelistedAtomStateTracker) {
     sp<UidMap> uidMap;
     sp<StatsPullerManager> pullerManager = new StatsPullerManager();
@@ -15,6 +15,9 @@
  */
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <thread>
+
 #include "socket/StatsSocketListener.h"
 #include "tests/statsd_test_util.h"
 
@@ -48,6 +51,14 @@ public:
         return std::make_pair(buf, size);
     }
 
+    AStatsEventWrapper(int atomId, int64_t timestampNs, int32_t value) {
+        statsEvent = AStatsEvent_obtain();
+        AStatsEvent_setAtomId(statsEvent, atomId);
+        AStatsEvent_overwriteTimestamp(statsEvent, timestampNs);
+        AStatsEvent_writeInt32(statsEvent, value);
+        AStatsEvent_build(statsEvent);
+    }
+
     ~AStatsEventWrapper() {
         AStatsEvent_release(statsEvent);
     }
@@ -121,6 +132,151 @@ TEST_P(SocketParseMessageTest, TestProcessMessageEmptySetExplicitSet) {
     }
 }
 
+TEST_P(SocketParseMessageTest, TestProcessMessageBatch) {
+    StatsdStats::getInstance().reset();
+
+    // keep the events alive until the batch is processed since messages point to their buffers
+    std::vector<std::unique_ptr<AStatsEventWrapper>> events;
+    std::vector<StatsSocketListener::Message> messages;
+    for (int i = 0; i < kEventCount; i++) {
+        events.push_back(std::make_unique<AStatsEventWrapper>(kAtomId + i));
+        auto [buf, size] = events.back()->getBuffer();
+        messages.push_back({buf, static_cast<uint32_t>(size), kTestUid, kTestPid});
+    }
+    StatsSocketListener::processMessageBatch(messages.data(), messages.size(), mEventQueue,
+                                             mLogEventFilter);
+
+    int64_t lastEventTs = 0;
+    // check content of the queue
+    EXPECT_EQ(kEventCount, mEventQueue->mQueue.size());
+    for (int i = 0; i < kEventCount; i++) {
+        auto logEvent = mEventQueue->waitPop();
+        EXPECT_TRUE(logEvent->isValid());
+        EXPECT_EQ(kAtomId + i, logEvent->GetTagId());
+        EXPECT_EQ(kTestUid, logEvent->GetUid());
+        EXPECT_EQ(kTestPid, logEvent->GetPid());
+        EXPECT_EQ(logEvent->isParsedHeaderOnly(), GetParam());
+        lastEventTs = logEvent->GetElapsedTimestampNs();
+    }
+
+    EXPECT_EQ(StatsdStats::getInstance().mEventQueueMaxSizeObserved, kEventCount);
+    EXPECT_EQ(StatsdStats::getInstance().mEventQueueMaxSizeObservedElapsedNanos, lastEventTs);
+}
+
+TEST(SocketParseMessageTest, TestUnpackAtomList) {
+    constexpr int kListEventCount = 3;
+    std::vector<std::unique_ptr<AStatsEventWrapper>> events;
+    std::vector<uint8_t> list;
+    for (int i = 0; i < kListEventCount; i++) {
+        events.push_back(std::make_unique<AStatsEventWrapper>(kAtomId + i));
+        auto [buf, size] = events.back()->getBuffer();
+        const uint32_t size32 = size;
+        const uint8_t* sizePtr = reinterpret_cast<const uint8_t*>(&size32);
+        list.insert(list.end(), sizePtr, sizePtr + sizeof(size32));
+        list.insert(list.end(), buf, buf + size);
+    }
+
+    StatsSocketListener::Message listMessage{list.data(), static_cast<uint32_t>(list.size()),
+                                             kTestUid, kTestPid, /*isAtomList=*/true};
+    std::vector<StatsSocketListener::Message> messages;
+    EXPECT_TRUE(StatsSocketListener::unpackAtomList(listMessage, messages));
+    ASSERT_EQ(kListEventCount, messages.size());
+
+    auto queue = std::make_shared<LogEventQueue>(kEventCount);
+    auto filter = std::make_shared<LogEventFilter>();
+    filter->setFilteringEnabled(false);
+    StatsSocketListener::processMessageBatch(messages.data(), messages.size(), queue, filter);
+    for (int i = 0; i < kListEventCount; i++) {
+        auto logEvent = queue->waitPop();
+        EXPECT_TRUE(logEvent->isValid());
+        EXPECT_EQ(kAtomId + i, logEvent->GetTagId());
+        EXPECT_EQ(kTestUid, logEvent->GetUid());
+        EXPECT_EQ(kTestPid, logEvent->GetPid());
+    }
+
+    // a truncated list keeps the atoms preceding the malformed record
+    listMessage.len -= 1;
+    messages.clear();
+    EXPECT_FALSE(StatsSocketListener::unpackAtomList(listMessage, messages));
+    EXPECT_EQ(kListEventCount - 1, messages.size());
+}
+
+TEST(SocketParseMessageTest, TestProcessMessageBatchDedupe) {
+    StatsdStats::getInstance().reset();
+    constexpr int64_t kWindowNs = 100;
+    // in the future so that the windows are not closed by the current time
+    const int64_t baseNs = getElapsedRealtimeNs() + 3600 * NS_PER_SEC;
+
+    // 3 repeats of the same value, a new value and a repeat past the window
+    std::vector<std::unique_ptr<AStatsEventWrapper>> events;
+    events.push_back(std::make_unique<AStatsEventWrapper>(kAtomId, baseNs, 1));
+    events.push_back(std::make_unique<AStatsEventWrapper>(kAtomId, baseNs + 10, 1));
+    events.push_back(std::make_unique<AStatsEventWrapper>(kAtomId, baseNs + 20, 1));
+    events.push_back(std::make_unique<AStatsEventWrapper>(kAtomId, baseNs + 30, 2));
+    events.push_back(std::make_unique<AStatsEventWrapper>(kAtomId, baseNs + 200, 2));
+    std::vector<StatsSocketListener::Message> messages;
+    for (const auto& event : events) {
+        auto [buf, size] = event->getBuffer();
+        messages.push_back({buf, static_cast<uint32_t>(size), kTestUid, kTestPid});
+    }
+
+    auto queue = std::make_shared<LogEventQueue>(kEventCount);
+    auto filter = std::make_shared<LogEventFilter>();
+    filter->setFilteringEnabled(false);
+    AtomDeduper deduper({{kAtomId, kWindowNs}});
+    StatsSocketListener::processMessageBatch(messages.data(), messages.size(), queue, filter,
+                                             &deduper);
+
+    // the repeats of 1 are held back until 2 is logged
+    ASSERT_EQ(4, queue->mQueue.size());
+    const std::vector<std::pair<int64_t, int32_t>> expected = {
+            {baseNs, 1}, {baseNs + 10, 2}, {baseNs + 30, 1}, {baseNs + 200, 1}};
+    for (const auto& [timestampNs, repeatCount] : expected) {
+        auto logEvent = queue->waitPop();
+        EXPECT_EQ(kAtomId, logEvent->GetTagId());
+        EXPECT_EQ(timestampNs, logEvent->GetElapsedTimestampNs());
+        EXPECT_EQ(repeatCount, logEvent->getRepeatCount());
+    }
+    EXPECT_EQ(1, StatsdStats::getInstance().mPushedAtomDedupeStats[kAtomId]);
+}
+
+TEST(SocketParseMessageTest, TestDedupeReleasedWhenSocketQuiet) {
+    StatsdStats::getInstance().reset();
+    constexpr int64_t kWindowNs = 100LL * 1000 * 1000;  // 100ms
+    const int64_t baseNs = getElapsedRealtimeNs();
+
+    // 3 repeats of the same value, then the socket goes quiet
+    std::vector<std::unique_ptr<AStatsEventWrapper>> events;
+    events.push_back(std::make_unique<AStatsEventWrapper>(kAtomId, baseNs, 1));
+    events.push_back(std::make_unique<AStatsEventWrapper>(kAtomId, baseNs + 1, 1));
+    events.push_back(std::make_unique<AStatsEventWrapper>(kAtomId, baseNs + 2, 1));
+    std::vector<StatsSocketListener::Message> messages;
+    for (const auto& event : events) {
+        auto [buf, size] = event->getBuffer();
+        messages.push_back({buf, static_cast<uint32_t>(size), kTestUid, kTestPid});
+    }
+
+    auto queue = std::make_shared<LogEventQueue>(kEventCount);
+    auto filter = std::make_shared<LogEventFilter>();
+    filter->setFilteringEnabled(false);
+    sp<StatsSocketListener> listener = new StatsSocketListener(
+            queue, filter, StatsSocketListener::kDefaultMaxBatchSize, "statsdw_test");
+    listener->setDedupeWindows({{kAtomId, kWindowNs}});
+    listener->processDedupedMessages(messages.data(), messages.size());
+
+    auto logEvent = queue->waitPop();
+    EXPECT_EQ(baseNs, logEvent->GetElapsedTimestampNs());
+    EXPECT_EQ(1, logEvent->getRepeatCount());
+
+    // no other atom is logged, the timer releases the held repeats once the window is closed
+    std::this_thread::sleep_for(std::chrono::nanoseconds(5 * kWindowNs));
+    ASSERT_EQ(1, queue->mQueue.size());
+    logEvent = queue->waitPop();
+    EXPECT_EQ(baseNs + 1, logEvent->GetElapsedTimestampNs());
+    EXPECT_EQ(2, logEvent->getRepeatCount());
+    EXPECT_EQ(1, StatsdStats::getInstance().mPushedAtomDedupeStats[kAtomId]);
+}
+
 TEST(SocketParseMessageTest, TestProcessMessageFilterCompleteSet) {
     std::shared_ptr<LogEventQueue> eventQueue =
             std::make_shared<LogEventQueue>(kEventCount /*buffer limit*/);
@@ -19,6 +19,9 @@
 #include <gtest/gtest.h>
 #include <stdio.h>
 
+#include <chrono>
+#include <thread>
+
 #include "StatsService.h"
 #include "config/ConfigKey.h"
 #include "guardrail/StatsdStats.h"
@@ -79,7 +82,7 @@ public:
                 (override));
 };
 
-TEST(StatsLogProcessorTest, TestRateLimitByteSize) {
+TEST(StatsLogProcessorTest, TestByteSizeCheckedOnEveryFlush) {
     sp<UidMap> m = new UidMap();
     sp<StatsPullerManager> pullerManager = new StatsPullerManager();
     sp<AlarmMonitor> anomalyAlarmMonitor;
@@ -95,9 +98,8 @@ TEST(StatsLogProcessorTest, TestRateLimitByteSize) {
     MockMetricsManager mockMetricsManager;
 
     ConfigKey key(100, 12345);
-    // Expect only the first flush to trigger a check for byte size since the last two are
-    // rate-limited.
-    EXPECT_CALL(mockMetricsManager, byteSize()).Times(1);
+    // Expect every flush to check the byte size.
+    EXPECT_CALL(mockMetricsManager, byteSize()).Times(3);
     p.flushIfNecessaryLocked(key, mockMetricsManager);
     p.flushIfNecessaryLocked(key, mockMetricsManager);
     p.flushIfNecessaryLocked(key, mockMetricsManager);
@@ -123,7 +125,7 @@ TEST(StatsLogProcessorTest, TestRateLimitBroadcast) {
 
     ConfigKey key(100, 12345);
     EXPECT_CALL(mockMetricsManager, byteSize())
-            .Times(1)
+            .Times(2)
             .WillRepeatedly(
                     ::testing::Return(int(StatsdStats::kDefaultMaxMetricsBytesPerConfig * .95)));
 
@@ -131,11 +133,9 @@ TEST(StatsLogProcessorTest, TestRateLimitBroadcast) {
     p.flushIfNecessaryLocked(key, mockMetricsManager);
     EXPECT_EQ(1, broadcastCount);
 
-    // b/73089712
     // This next call to flush should not trigger a broadcast.
-    // p.mLastByteSizeTimes.clear();  // Force another check for byte size.
-    // p.flushIfNecessaryLocked(2, key, mockMetricsManager);
-    // EXPECT_EQ(1, broadcastCount);
+    p.flushIfNecessaryLocked(key, mockMetricsManager);
+    EXPECT_EQ(1, broadcastCount);
 }
 
 TEST(StatsLogProcessorTest, TestDropWhenByteSizeTooLarge) {
@@ -394,6 +394,677 @@ TEST(StatsLogProcessorTest, TestOnDumpReportEraseData) {
     EXPECT_TRUE(noData);
 }
 
+TEST(StatsLogProcessorTest, TestOnLogEventBatch) {
+    // Setup a simple config.
+    StatsdConfig config;
+    auto wakelockAcquireMatcher = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = wakelockAcquireMatcher;
+
+    auto countMetric = config.add_count_metric();
+    countMetric->set_id(123456);
+    countMetric->set_what(wakelockAcquireMatcher.id());
+    countMetric->set_bucket(FIVE_MINUTES);
+
+    ConfigKey cfgKey;
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey);
+
+    std::vector<int> attributionUids = {111};
+    std::vector<string> attributionTags = {"App1"};
+    std::vector<std::unique_ptr<LogEvent>> events;
+    events.push_back(
+            CreateAcquireWakelockEvent(2 /*timestamp*/, attributionUids, attributionTags, "wl1"));
+    events.push_back(CreateScreenStateChangedEvent(3 /*timestamp*/,
+                                                   android::view::DISPLAY_STATE_ON));
+    events.push_back(
+            CreateAcquireWakelockEvent(4 /*timestamp*/, attributionUids, attributionTags, "wl2"));
+    processor->OnLogEventBatch(events);
+
+    vector<uint8_t> bytes;
+    ConfigMetricsReportList output;
+    processor->onDumpReport(cfgKey, 5, true, true /* DO erase data. */, ADB_DUMP, FAST, &bytes);
+    output.ParseFromArray(bytes.data(), bytes.size());
+    ASSERT_EQ(output.reports_size(), 1);
+    ASSERT_EQ(output.reports(0).metrics_size(), 1);
+    ASSERT_EQ(output.reports(0).metrics(0).count_metrics().data_size(), 1);
+    const CountMetricData& data = output.reports(0).metrics(0).count_metrics().data(0);
+    ASSERT_EQ(data.bucket_info_size(), 1);
+    EXPECT_EQ(data.bucket_info(0).count(), 2);
+}
+
+TEST(StatsLogProcessorTest, TestProfileConfig) {
+    StatsdConfig config;
+    auto wakelockAcquireMatcher = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = wakelockAcquireMatcher;
+    auto countMetric = config.add_count_metric();
+    countMetric->set_id(123456);
+    countMetric->set_what(wakelockAcquireMatcher.id());
+    countMetric->set_bucket(FIVE_MINUTES);
+
+    ConfigKey cfgKey;
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey);
+    processor->setProfilingEventCapacity(2);
+
+    std::vector<int> attributionUids = {111};
+    std::vector<string> attributionTags = {"App1"};
+    std::vector<std::unique_ptr<LogEvent>> events;
+    events.push_back(
+            CreateAcquireWakelockEvent(2 /*timestamp*/, attributionUids, attributionTags, "wl1"));
+    events.push_back(CreateScreenStateChangedEvent(3 /*timestamp*/,
+                                                   android::view::DISPLAY_STATE_ON));
+    events.push_back(
+            CreateAcquireWakelockEvent(4 /*timestamp*/, attributionUids, attributionTags, "wl2"));
+    processor->OnLogEventBatch(events);
+    // Only the last 2 events are kept.
+    ASSERT_EQ(2UL, processor->mProfilingEvents.size());
+
+    countMetric->set_id(654321);
+    *countMetric->mutable_dimensions_in_what() =
+            CreateAttributionUidDimensions(util::WAKELOCK_STATE_CHANGED, {Position::FIRST});
+    const StatsLogProcessor::ConfigProfile profile =
+            processor->profileConfig(ConfigKey(0, 98765), config);
+    ASSERT_TRUE(profile.isConfigValid);
+    EXPECT_EQ(2UL, profile.eventCount);
+    EXPECT_EQ(1, profile.memoryUsage.dimensionCount);
+    ASSERT_EQ(1UL, profile.metrics.size());
+    EXPECT_EQ(654321, profile.metrics[0].metricId);
+    EXPECT_EQ(1, profile.metrics[0].matchedEventCount);
+    EXPECT_EQ(1, profile.metrics[0].dimensionCount);
+
+    // The profiled config is not added.
+    EXPECT_EQ(1UL, processor->mMetricsManagers.size());
+
+    processor->setProfilingEventCapacity(0);
+    EXPECT_TRUE(processor->mProfilingEvents.empty());
+}
+
+TEST(StatsLogProcessorTest, TestOnLogEventBatchSharded) {
+    StatsdConfig config;
+    auto wakelockAcquireMatcher = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = wakelockAcquireMatcher;
+
+    auto countMetric = config.add_count_metric();
+    countMetric->set_id(123456);
+    countMetric->set_what(wakelockAcquireMatcher.id());
+    countMetric->set_bucket(FIVE_MINUTES);
+
+    ConfigKey cfgKey1;
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey1);
+    ConfigKey cfgKey2(2, 12345);
+    processor->OnConfigUpdated(1, cfgKey2, config);
+    processor->setEventProcessingShards(2);
+
+    std::vector<int> attributionUids = {111};
+    std::vector<string> attributionTags = {"App1"};
+    std::vector<std::unique_ptr<LogEvent>> events;
+    for (int i = 0; i < 10; i++) {
+        events.push_back(CreateAcquireWakelockEvent(2 + i /*timestamp*/, attributionUids,
+                                                    attributionTags, "wl1"));
+    }
+    events.push_back(CreateScreenStateChangedEvent(20 /*timestamp*/,
+                                                   android::view::DISPLAY_STATE_ON));
+    processor->OnLogEventBatch(events);
+
+    for (const ConfigKey& key : {cfgKey1, cfgKey2}) {
+        vector<uint8_t> bytes;
+        ConfigMetricsReportList output;
+        processor->onDumpReport(key, 30, true, true /* DO erase data. */, ADB_DUMP, FAST, &bytes);
+        output.ParseFromArray(bytes.data(), bytes.size());
+        ASSERT_EQ(output.reports_size(), 1);
+        ASSERT_EQ(output.reports(0).metrics_size(), 1);
+        ASSERT_EQ(output.reports(0).metrics(0).count_metrics().data_size(), 1);
+        const CountMetricData& data = output.reports(0).metrics(0).count_metrics().data(0);
+        ASSERT_EQ(data.bucket_info_size(), 1);
+        EXPECT_EQ(data.bucket_info(0).count(), 10);
+    }
+}
+
+TEST(StatsLogProcessorTest, TestParallelMatching) {
+    StatsdConfig config;
+    AtomMatcher anyWakelockMatcher;
+    anyWakelockMatcher.set_id(StringToId("AnyWakelock"));
+    anyWakelockMatcher.mutable_combination()->set_operation(LogicalOperation::OR);
+    const int numWakelocks = 8;
+    for (int i = 0; i < numWakelocks; i++) {
+        AtomMatcher* matcher = config.add_atom_matcher();
+        *matcher = CreateWakelockStateChangedAtomMatcher("Acquire" + std::to_string(i),
+                                                         WakelockStateChanged::ACQUIRE);
+        auto fieldValueMatcher = matcher->mutable_simple_atom_matcher()->add_field_value_matcher();
+        fieldValueMatcher->set_field(3);  // Tag field.
+        fieldValueMatcher->set_eq_string("wl" + std::to_string(i));
+        anyWakelockMatcher.mutable_combination()->add_matcher(matcher->id());
+
+        auto countMetric = config.add_count_metric();
+        countMetric->set_id(i);
+        countMetric->set_what(matcher->id());
+        countMetric->set_bucket(FIVE_MINUTES);
+    }
+    *config.add_atom_matcher() = anyWakelockMatcher;
+    auto anyCountMetric = config.add_count_metric();
+    anyCountMetric->set_id(numWakelocks);
+    anyCountMetric->set_what(anyWakelockMatcher.id());
+    anyCountMetric->set_bucket(FIVE_MINUTES);
+
+    ConfigKey cfgKey;
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey);
+    MetricsManager::setParallelMatching(/*numThreads=*/2, /*minMatchers=*/4);
+
+    std::vector<int> attributionUids = {111};
+    std::vector<string> attributionTags = {"App1"};
+    std::vector<std::unique_ptr<LogEvent>> events;
+    for (int i = 0; i < numWakelocks; i++) {
+        events.push_back(CreateAcquireWakelockEvent(2 + i /*timestamp*/, attributionUids,
+                                                    attributionTags, "wl" + std::to_string(i)));
+    }
+    events.push_back(CreateAcquireWakelockEvent(20 /*timestamp*/, attributionUids,
+                                                attributionTags, "wl0"));
+    events.push_back(CreateAcquireWakelockEvent(21 /*timestamp*/, attributionUids,
+                                                attributionTags, "other"));
+    processor->OnLogEventBatch(events);
+    MetricsManager::setParallelMatching(/*numThreads=*/0, /*minMatchers=*/0);
+
+    vector<uint8_t> bytes;
+    ConfigMetricsReportList output;
+    processor->onDumpReport(cfgKey, 30, true, true /* DO erase data. */, ADB_DUMP, FAST, &bytes);
+    output.ParseFromArray(bytes.data(), bytes.size());
+    ASSERT_EQ(output.reports_size(), 1);
+    ASSERT_EQ(output.reports(0).metrics_size(), numWakelocks + 1);
+    for (const StatsLogReport& metric : output.reports(0).metrics()) {
+        ASSERT_EQ(metric.count_metrics().data_size(), 1);
+        const CountMetricData& data = metric.count_metrics().data(0);
+        ASSERT_EQ(data.bucket_info_size(), 1);
+        int64_t expectedCount = 1;
+        if (metric.metric_id() == 0) {
+            expectedCount = 2;
+        } else if (metric.metric_id() == numWakelocks) {
+            expectedCount = numWakelocks + 1;
+        }
+        EXPECT_EQ(data.bucket_info(0).count(), expectedCount) << metric.metric_id();
+    }
+}
+
+TEST(StatsLogProcessorTest, TestOffLockConfigBuilds) {
+    StatsdConfig config;
+    auto wakelockAcquireMatcher = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = wakelockAcquireMatcher;
+    auto countMetric = config.add_count_metric();
+    countMetric->set_id(123456);
+    countMetric->set_what(wakelockAcquireMatcher.id());
+    countMetric->set_bucket(FIVE_MINUTES);
+
+    ConfigKey cfgKey;
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey);
+    processor->setOffLockConfigBuilds(true);
+
+    // Modular updates and metrics sliced by state need the lock.
+    EXPECT_FALSE(processor->canBuildConfigOffLock(cfgKey, config, /*modularUpdate=*/true));
+    EXPECT_TRUE(processor->canBuildConfigOffLock(cfgKey, config, /*modularUpdate=*/false));
+    StatsdConfig slicedConfig = config;
+    *slicedConfig.add_state() = CreateScreenState();
+    slicedConfig.mutable_count_metric(0)->add_slice_by_state(slicedConfig.state(0).id());
+    EXPECT_FALSE(processor->canBuildConfigOffLock(cfgKey, slicedConfig, /*modularUpdate=*/false));
+
+    std::vector<int> attributionUids = {111};
+    std::vector<string> attributionTags = {"App1"};
+    processor->OnLogEvent(
+            CreateAcquireWakelockEvent(2 /*timestamp*/, attributionUids, attributionTags, "wl1")
+                    .get());
+
+    const sp<MetricsManager> oldMetricsManager = processor->mMetricsManagers[cfgKey];
+    config.mutable_count_metric(0)->set_id(654321);
+    processor->OnConfigUpdated(10, cfgKey, config, /*modularUpdate=*/false);
+    ASSERT_EQ(processor->mMetricsManagers.size(), 1);
+    EXPECT_NE(processor->mMetricsManagers[cfgKey], oldMetricsManager);
+    EXPECT_TRUE(processor->mMetricsManagers[cfgKey]->isConfigValid());
+
+    processor->OnLogEvent(
+            CreateAcquireWakelockEvent(20 /*timestamp*/, attributionUids, attributionTags, "wl1")
+                    .get());
+    processor->OnLogEvent(
+            CreateAcquireWakelockEvent(21 /*timestamp*/, attributionUids, attributionTags, "wl2")
+                    .get());
+
+    vector<uint8_t> bytes;
+    ConfigMetricsReportList output;
+    processor->onDumpReport(cfgKey, 30, true, true /* DO erase data. */, ADB_DUMP, FAST, &bytes);
+    output.ParseFromArray(bytes.data(), bytes.size());
+    ASSERT_GE(output.reports_size(), 1);
+    const ConfigMetricsReport& report = output.reports(output.reports_size() - 1);
+    ASSERT_EQ(report.metrics_size(), 1);
+    EXPECT_EQ(report.metrics(0).metric_id(), 654321);
+    ASSERT_EQ(report.metrics(0).count_metrics().data_size(), 1);
+    ASSERT_EQ(report.metrics(0).count_metrics().data(0).bucket_info_size(), 1);
+    EXPECT_EQ(report.metrics(0).count_metrics().data(0).bucket_info(0).count(), 2);
+}
+
+TEST(StatsLogProcessorTest, TestDeferredHousekeeping) {
+    StatsdConfig config;
+    auto wakelockAcquireMatcher = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = wakelockAcquireMatcher;
+    auto countMetric = config.add_count_metric();
+    countMetric->set_id(123456);
+    countMetric->set_what(wakelockAcquireMatcher.id());
+    countMetric->set_bucket(FIVE_MINUTES);
+
+    ConfigKey cfgKey;
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey);
+    std::vector<int> attributionUids = {111};
+    std::vector<string> attributionTags = {"App1"};
+
+    // Nothing is deferred until enabled.
+    processor->runDeferredHousekeeping(2 * NS_PER_SEC);
+    EXPECT_EQ(processor->mLastHousekeepingTimeNs, 0);
+
+    processor->setDeferredHousekeeping(true);
+    processor->OnLogEvent(CreateAcquireWakelockEvent(3 * NS_PER_SEC, attributionUids,
+                                                     attributionTags, "wl1")
+                                  .get(),
+                          3 * NS_PER_SEC);
+    EXPECT_EQ(processor->mLastHousekeepingTimeNs, 0);
+    EXPECT_EQ(processor->mLastPullerCacheClearTimeSec, 0);
+
+    processor->runDeferredHousekeeping(4 * NS_PER_SEC);
+    EXPECT_EQ(processor->mLastHousekeepingTimeNs, 4 * NS_PER_SEC);
+    EXPECT_EQ(processor->mLastPullerCacheClearTimeSec, 4);
+
+    processor->OnLogEvent(CreateAcquireWakelockEvent(5 * NS_PER_SEC, attributionUids,
+                                                     attributionTags, "wl1")
+                                  .get(),
+                          5 * NS_PER_SEC);
+    EXPECT_EQ(processor->mLastHousekeepingTimeNs, 4 * NS_PER_SEC);
+
+    // An event runs the housekeeping once it was deferred for too long.
+    const int64_t lateTimeNs = 4 * NS_PER_SEC + StatsLogProcessor::kMaxHousekeepingDelayNs;
+    processor->OnLogEvent(
+            CreateAcquireWakelockEvent(lateTimeNs, attributionUids, attributionTags, "wl1").get(),
+            lateTimeNs);
+    EXPECT_EQ(processor->mLastHousekeepingTimeNs, lateTimeNs);
+}
+
+TEST(StatsLogProcessorTest, TestOnMemoryPressureWritesDataToDisk) {
+    StatsdConfig config;
+    auto wakelockAcquireMatcher = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = wakelockAcquireMatcher;
+    auto countMetric = config.add_count_metric();
+    countMetric->set_id(123456);
+    countMetric->set_what(wakelockAcquireMatcher.id());
+    countMetric->set_bucket(FIVE_MINUTES);
+
+    ConfigKey cfgKey(1, 45678);
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey);
+    std::vector<int> attributionUids = {111};
+    std::vector<string> attributionTags = {"App1"};
+    processor->OnLogEvent(
+            CreateAcquireWakelockEvent(2 * NS_PER_SEC, attributionUids, attributionTags, "wl1")
+                    .get(),
+            2 * NS_PER_SEC);
+    EXPECT_GT(processor->GetMetricsSize(cfgKey), 0u);
+
+    // Past WRITE_DATA_COOL_DOWN_SEC.
+    const int64_t pressureTimeNs = 20 * NS_PER_SEC;
+    processor->onMemoryPressure(pressureTimeNs, getWallClockNs());
+    EXPECT_EQ(processor->GetMetricsSize(cfgKey), 0u);
+
+    // The data written to disk comes back in the next report.
+    vector<uint8_t> buffer;
+    processor->onDumpReport(cfgKey, 30 * NS_PER_SEC, /*include_current_partial_bucket=*/true,
+                            /*erase_data=*/true, ADB_DUMP, FAST, &buffer);
+    ConfigMetricsReportList reports;
+    ASSERT_TRUE(reports.ParseFromArray(buffer.data(), buffer.size()));
+    sortReportsByElapsedTime(&reports);
+    ASSERT_EQ(reports.reports_size(), 2);
+    EXPECT_EQ(reports.reports(0).dump_report_reason(), MEMORY_PRESSURE);
+    EXPECT_EQ(reports.reports(0).current_report_elapsed_nanos(), pressureTimeNs);
+    ASSERT_EQ(reports.reports(0).metrics_size(), 1);
+    EXPECT_TRUE(reports.reports(0).metrics(0).has_count_metrics());
+}
+
+TEST(StatsLogProcessorTest, TestOnDumpReportPage) {
+    StatsdConfig config;
+    auto wakelockAcquireMatcher = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = wakelockAcquireMatcher;
+    for (int64_t metricId : {1, 2, 3}) {
+        auto countMetric = config.add_count_metric();
+        countMetric->set_id(metricId);
+        countMetric->set_what(wakelockAcquireMatcher.id());
+        countMetric->set_bucket(FIVE_MINUTES);
+    }
+
+    ConfigKey cfgKey(1, 34567);
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey);
+    // Each page holds a single metric.
+    processor->mMaxDataPageBytes = 1;
+
+    std::vector<int> attributionUids = {111};
+    std::vector<string> attributionTags = {"App1"};
+    std::unique_ptr<LogEvent> event =
+            CreateAcquireWakelockEvent(2 /*timestamp*/, attributionUids, attributionTags, "wl1");
+    processor->OnLogEvent(event.get());
+
+    const int64_t dumpTimeNs = 10 * 60 * NS_PER_SEC;
+    // A paged dump can't be continued before it is started.
+    vector<uint8_t> bytes;
+    EXPECT_FALSE(processor->onDumpReportPage(cfgKey, 1, dumpTimeNs, dumpTimeNs, GET_DATA_CALLED,
+                                             &bytes));
+
+    int64_t cursor = 0;
+    vector<int64_t> metricIds;
+    vector<ConfigMetricsReportList> pages;
+    do {
+        ASSERT_TRUE(processor->onDumpReportPage(cfgKey, cursor, dumpTimeNs + cursor,
+                                                dumpTimeNs + cursor, GET_DATA_CALLED, &bytes));
+        ConfigMetricsReportList output;
+        ASSERT_TRUE(output.ParseFromArray(bytes.data(), bytes.size()));
+        ASSERT_EQ(output.reports_size(), 1);
+        ASSERT_EQ(output.reports(0).metrics_size(), 1);
+        metricIds.push_back(output.reports(0).metrics(0).metric_id());
+        ASSERT_EQ(output.reports(0).metrics(0).count_metrics().data_size(), 1);
+        // All the pages are dumped at the time of the first one.
+        EXPECT_EQ(output.reports(0).current_report_elapsed_nanos(), dumpTimeNs);
+        EXPECT_EQ(output.report_number(), 1);
+        cursor = output.next_page_cursor();
+        pages.push_back(output);
+    } while (cursor != 0);
+    EXPECT_THAT(metricIds, ElementsAre(1, 2, 3));
+    // The uid map is only on the last page.
+    ASSERT_EQ(pages.size(), 3);
+    EXPECT_FALSE(pages[0].reports(0).has_uid_map());
+    EXPECT_TRUE(pages[2].reports(0).has_uid_map());
+
+    // The data was erased.
+    ASSERT_TRUE(processor->onDumpReportPage(cfgKey, 0, 2 * dumpTimeNs, 2 * dumpTimeNs,
+                                            GET_DATA_CALLED, &bytes));
+    ConfigMetricsReportList output;
+    ASSERT_TRUE(output.ParseFromArray(bytes.data(), bytes.size()));
+    ASSERT_EQ(output.reports_size(), 1);
+    ASSERT_EQ(output.reports(0).metrics_size(), 1);
+    EXPECT_EQ(output.reports(0).metrics(0).count_metrics().data_size(), 0);
+    EXPECT_EQ(output.reports(0).last_report_elapsed_nanos(), dumpTimeNs);
+
+    // A config update abandons the paged dump.
+    processor->OnConfigUpdated(2 * dumpTimeNs, cfgKey, config);
+    EXPECT_FALSE(processor->onDumpReportPage(cfgKey, output.next_page_cursor(), 2 * dumpTimeNs,
+                                             2 * dumpTimeNs, GET_DATA_CALLED, &bytes));
+}
+
+namespace {
+
+// Config with a count metric of the wakelock acquires for each of the metric ids.
+StatsdConfig createYieldingDumpConfig(const vector<int64_t>& metricIds) {
+    StatsdConfig config;
+    auto wakelockAcquireMatcher = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = wakelockAcquireMatcher;
+    for (int64_t metricId : metricIds) {
+        auto countMetric = config.add_count_metric();
+        countMetric->set_id(metricId);
+        countMetric->set_what(wakelockAcquireMatcher.id());
+        countMetric->set_bucket(FIVE_MINUTES);
+    }
+    return config;
+}
+
+void logWakelockAcquire(const sp<StatsLogProcessor>& processor, int64_t timestampNs) {
+    std::unique_ptr<LogEvent> event =
+            CreateAcquireWakelockEvent(timestampNs, {111} /*attributionUids*/,
+                                       {"App1"} /*attributionTags*/, "wl1");
+    processor->OnLogEvent(event.get());
+}
+
+ConfigMetricsReportList dumpReport(const sp<StatsLogProcessor>& processor,
+                                   const ConfigKey& cfgKey, int64_t dumpTimeNs) {
+    vector<uint8_t> bytes;
+    processor->onDumpReport(cfgKey, dumpTimeNs, false /* include_current_partial_bucket */,
+                            true /* erase_data */, GET_DATA_CALLED, FAST, &bytes);
+    ConfigMetricsReportList output;
+    output.ParseFromArray(bytes.data(), bytes.size());
+    return output;
+}
+
+// Returns the wakelock counts of the buckets of the count metrics of the report, by metric id.
+std::map<int64_t, vector<int64_t>> getBucketCounts(const ConfigMetricsReport& report) {
+    std::map<int64_t, vector<int64_t>> counts;
+    for (const StatsLogReport& metric : report.metrics()) {
+        vector<int64_t>& metricCounts = counts[metric.metric_id()];
+        for (const CountMetricData& data : metric.count_metrics().data()) {
+            for (const CountBucketInfo& bucket : data.bucket_info()) {
+                metricCounts.push_back(bucket.count());
+            }
+        }
+    }
+    return counts;
+}
+
+// Buckets of five minutes from 1ns on, the current bucket ends at 10min + 1ns once the dump cuts
+// them.
+const int64_t kYieldingDumpTimeNs = 10 * 60 * NS_PER_SEC;
+
+}  // namespace
+
+TEST(StatsLogProcessorTest, TestYieldingDumpLetsEventsThrough) {
+    ConfigKey cfgKey(1, 34567);
+    sp<StatsLogProcessor> processor =
+            CreateStatsLogProcessor(1, 1, createYieldingDumpConfig({1, 2, 3}), cfgKey);
+    logWakelockAcquire(processor, 2);
+
+    // The events of the current bucket are processed between two metrics.
+    int numYields = 0;
+    processor->mOnDumpYieldForTest = [&] {
+        numYields++;
+        logWakelockAcquire(processor, kYieldingDumpTimeNs);
+    };
+    ConfigMetricsReportList output = dumpReport(processor, cfgKey, kYieldingDumpTimeNs);
+    processor->mOnDumpYieldForTest = nullptr;
+    EXPECT_EQ(numYields, 2);
+    ASSERT_EQ(output.reports_size(), 1);
+    EXPECT_EQ(output.reports(0).current_report_elapsed_nanos(), kYieldingDumpTimeNs);
+    EXPECT_THAT(getBucketCounts(output.reports(0)),
+                ElementsAre(Pair(1, ElementsAre(1)), Pair(2, ElementsAre(1)),
+                            Pair(3, ElementsAre(1))));
+
+    // The events of both yields are in the next report.
+    output = dumpReport(processor, cfgKey, 2 * kYieldingDumpTimeNs);
+    ASSERT_EQ(output.reports_size(), 1);
+    EXPECT_EQ(output.reports(0).last_report_elapsed_nanos(), kYieldingDumpTimeNs);
+    EXPECT_THAT(getBucketCounts(output.reports(0)),
+                ElementsAre(Pair(1, ElementsAre(2)), Pair(2, ElementsAre(2)),
+                            Pair(3, ElementsAre(2))));
+}
+
+TEST(StatsLogProcessorTest, TestYieldingDumpHoldsEventsAfterCut) {
+    ConfigKey cfgKey(1, 34567);
+    sp<StatsLogProcessor> processor =
+            CreateStatsLogProcessor(1, 1, createYieldingDumpConfig({1, 2, 3}), cfgKey);
+    // In the bucket that is current at the dump.
+    logWakelockAcquire(processor, kYieldingDumpTimeNs - NS_PER_SEC);
+
+    // An event after the current bucket would close it for the metrics not dumped yet, so it is
+    // held back until the end of the dump.
+    std::thread eventThread;
+    std::atomic<bool> eventProcessed = false;
+    processor->mOnDumpYieldForTest = [&] {
+        if (!eventThread.joinable()) {
+            eventThread = std::thread([&] {
+                logWakelockAcquire(processor, kYieldingDumpTimeNs + 2 * 60 * NS_PER_SEC);
+                eventProcessed = true;
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        EXPECT_FALSE(eventProcessed);
+    };
+    ConfigMetricsReportList output = dumpReport(processor, cfgKey, kYieldingDumpTimeNs);
+    processor->mOnDumpYieldForTest = nullptr;
+    eventThread.join();
+    EXPECT_TRUE(eventProcessed);
+    ASSERT_EQ(output.reports_size(), 1);
+    EXPECT_THAT(getBucketCounts(output.reports(0)),
+                ElementsAre(Pair(1, IsEmpty()), Pair(2, IsEmpty()), Pair(3, IsEmpty())));
+
+    // The bucket closed by the event held back is in the next report.
+    output = dumpReport(processor, cfgKey, 2 * kYieldingDumpTimeNs);
+    ASSERT_EQ(output.reports_size(), 1);
+    EXPECT_THAT(getBucketCounts(output.reports(0)),
+                ElementsAre(Pair(1, ElementsAre(1, 1)), Pair(2, ElementsAre(1, 1)),
+                            Pair(3, ElementsAre(1, 1))));
+}
+
+TEST(StatsLogProcessorTest, TestYieldingDumpStopsOnModularUpdate) {
+    ConfigKey cfgKey(1, 34567);
+    sp<StatsLogProcessor> processor =
+            CreateStatsLogProcessor(1, 1, createYieldingDumpConfig({1, 2, 3}), cfgKey);
+    logWakelockAcquire(processor, 2);
+
+    // The update keeps the MetricsManager but adds a metric before the ones not dumped yet.
+    processor->mOnDumpYieldForTest = [&] {
+        processor->OnConfigUpdated(kYieldingDumpTimeNs, cfgKey,
+                                   createYieldingDumpConfig({1, 4, 2, 3}),
+                                   /*modularUpdate=*/true);
+    };
+    ConfigMetricsReportList output = dumpReport(processor, cfgKey, kYieldingDumpTimeNs);
+    processor->mOnDumpYieldForTest = nullptr;
+    ASSERT_EQ(output.reports_size(), 1);
+    EXPECT_THAT(getBucketCounts(output.reports(0)), ElementsAre(Pair(1, ElementsAre(1))));
+    EXPECT_THAT(output.reports(0).data_corrupted_reason(),
+                Contains(DATA_CORRUPTED_DUMP_INCOMPLETE));
+
+    // The data of the metrics left is in the next report.
+    output = dumpReport(processor, cfgKey, 2 * kYieldingDumpTimeNs);
+    ASSERT_EQ(output.reports_size(), 1);
+    EXPECT_THAT(getBucketCounts(output.reports(0)),
+                ElementsAre(Pair(1, IsEmpty()), Pair(2, ElementsAre(1)), Pair(3, ElementsAre(1)),
+                            Pair(4, IsEmpty())));
+}
+
+TEST(StatsLogProcessorTest, TestYieldingDumpStopsOnConfigRemoved) {
+    ConfigKey cfgKey(1, 34567);
+    const StatsdConfig config = createYieldingDumpConfig({1, 2, 3});
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey);
+    logWakelockAcquire(processor, 2);
+
+    processor->mOnDumpYieldForTest = [&] { processor->OnConfigRemoved(cfgKey); };
+    ConfigMetricsReportList output = dumpReport(processor, cfgKey, kYieldingDumpTimeNs);
+    processor->mOnDumpYieldForTest = nullptr;
+    ASSERT_EQ(output.reports_size(), 1);
+    EXPECT_THAT(getBucketCounts(output.reports(0)), ElementsAre(Pair(1, ElementsAre(1))));
+    EXPECT_THAT(output.reports(0).data_corrupted_reason(),
+                Contains(DATA_CORRUPTED_DUMP_INCOMPLETE));
+    EXPECT_EQ(processor->GetMetricsSize(cfgKey), 0u);
+
+    // The data of the metrics left was written to disk with the removed config.
+    processor->OnConfigUpdated(kYieldingDumpTimeNs, cfgKey, config);
+    output = dumpReport(processor, cfgKey, 2 * kYieldingDumpTimeNs);
+    ASSERT_EQ(output.reports_size(), 2);
+    EXPECT_EQ(output.reports(0).dump_report_reason(), CONFIG_REMOVED);
+    EXPECT_THAT(getBucketCounts(output.reports(0)),
+                ElementsAre(Pair(1, IsEmpty()), Pair(2, ElementsAre(1)), Pair(3, ElementsAre(1))));
+}
+
+TEST(StatsLogProcessorTest, TestYieldingDumpIgnoresOtherConfigUpdate) {
+    ConfigKey cfgKey(1, 34567);
+    ConfigKey otherCfgKey(2, 34567);
+    sp<StatsLogProcessor> processor =
+            CreateStatsLogProcessor(1, 1, createYieldingDumpConfig({1, 2, 3}), cfgKey);
+    logWakelockAcquire(processor, 2);
+
+    // Adding and updating another config doesn't stop the dump.
+    processor->mOnDumpYieldForTest = [&] {
+        processor->OnConfigUpdated(kYieldingDumpTimeNs, otherCfgKey,
+                                   createYieldingDumpConfig({4}));
+    };
+    ConfigMetricsReportList output = dumpReport(processor, cfgKey, kYieldingDumpTimeNs);
+    processor->mOnDumpYieldForTest = nullptr;
+    ASSERT_EQ(output.reports_size(), 1);
+    EXPECT_THAT(getBucketCounts(output.reports(0)),
+                ElementsAre(Pair(1, ElementsAre(1)), Pair(2, ElementsAre(1)),
+                            Pair(3, ElementsAre(1))));
+    EXPECT_THAT(output.reports(0).data_corrupted_reason(),
+                Not(Contains(DATA_CORRUPTED_DUMP_INCOMPLETE)));
+}
+
+TEST(StatsLogProcessorTest, TestYieldingDumpHoldsDiskWrite) {
+    ConfigKey cfgKey(1, 34567);
+    sp<StatsLogProcessor> processor =
+            CreateStatsLogProcessor(1, 1, createYieldingDumpConfig({1, 2, 3}), cfgKey);
+    logWakelockAcquire(processor, 2);
+
+    // Writing to disk erases the data of the metrics not dumped yet, so it waits for the dump.
+    std::thread writeThread;
+    std::atomic<bool> dataWritten = false;
+    processor->mOnDumpYieldForTest = [&] {
+        if (!writeThread.joinable()) {
+            writeThread = std::thread([&] {
+                processor->WriteDataToDisk(DEVICE_SHUTDOWN, FAST, kYieldingDumpTimeNs,
+                                           kYieldingDumpTimeNs);
+                dataWritten = true;
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        EXPECT_FALSE(dataWritten);
+    };
+    ConfigMetricsReportList output = dumpReport(processor, cfgKey, kYieldingDumpTimeNs);
+    processor->mOnDumpYieldForTest = nullptr;
+    writeThread.join();
+    EXPECT_TRUE(dataWritten);
+    ASSERT_EQ(output.reports_size(), 1);
+    EXPECT_THAT(getBucketCounts(output.reports(0)),
+                ElementsAre(Pair(1, ElementsAre(1)), Pair(2, ElementsAre(1)),
+                            Pair(3, ElementsAre(1))));
+
+    // The report written after the dump has no data left.
+    output = dumpReport(processor, cfgKey, 2 * kYieldingDumpTimeNs);
+    ASSERT_EQ(output.reports_size(), 2);
+    EXPECT_EQ(output.reports(0).dump_report_reason(), DEVICE_SHUTDOWN);
+    EXPECT_THAT(getBucketCounts(output.reports(0)),
+                ElementsAre(Pair(1, IsEmpty()), Pair(2, IsEmpty()), Pair(3, IsEmpty())));
+}
+
+TEST(StatsLogProcessorTest, TestWriteDataToDiskSharded) {
+    StatsdConfig config;
+    auto wakelockAcquireMatcher = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = wakelockAcquireMatcher;
+
+    auto countMetric = config.add_count_metric();
+    countMetric->set_id(123456);
+    countMetric->set_what(wakelockAcquireMatcher.id());
+    countMetric->set_bucket(FIVE_MINUTES);
+
+    ConfigKey cfgKey1(1, 23456);
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey1);
+    ConfigKey cfgKey2(2, 23456);
+    processor->OnConfigUpdated(1, cfgKey2, config);
+    processor->setEventProcessingShards(2);
+
+    std::vector<int> attributionUids = {111};
+    std::vector<string> attributionTags = {"App1"};
+    std::vector<std::unique_ptr<LogEvent>> events;
+    for (int i = 0; i < 10; i++) {
+        events.push_back(CreateAcquireWakelockEvent(2 + i /*timestamp*/, attributionUids,
+                                                    attributionTags, "wl1"));
+    }
+    processor->OnLogEventBatch(events);
+
+    {
+        std::lock_guard<std::mutex> lock(processor->mMetricsMutex);
+        processor->WriteDataToDiskLocked(DEVICE_SHUTDOWN, FAST, 20 * NS_PER_SEC,
+                                         20 * NS_PER_SEC);
+    }
+
+    // The report written to disk comes first, then the current one.
+    for (const ConfigKey& key : {cfgKey1, cfgKey2}) {
+        vector<uint8_t> bytes;
+        ConfigMetricsReportList output;
+        processor->onDumpReport(key, 30 * NS_PER_SEC, true, true /* DO erase data. */,
+                                GET_DATA_CALLED, FAST, &bytes);
+        output.ParseFromArray(bytes.data(), bytes.size());
+        ASSERT_EQ(output.reports_size(), 2);
+        EXPECT_EQ(output.reports(0).dump_report_reason(), DEVICE_SHUTDOWN);
+        ASSERT_EQ(output.reports(0).metrics_size(), 1);
+        ASSERT_EQ(output.reports(0).metrics(0).count_metrics().data_size(), 1);
+        const CountMetricData& data = output.reports(0).metrics(0).count_metrics().data(0);
+        ASSERT_EQ(data.bucket_info_size(), 1);
+        EXPECT_EQ(data.bucket_info(0).count(), 10);
+        EXPECT_EQ(output.reports(1).dump_report_reason(), GET_DATA_CALLED);
+    }
+}
+
 TEST(StatsLogProcessorTest, TestPullUidProviderSetOnConfigUpdate) {
     // Setup simple config key corresponding to empty config.
     ConfigKey key(3, 4);
@@ -479,6 +1150,44 @@ TEST(StatsLogProcessorTest, InvalidConfigRemoved) {
     StorageManager::deleteSuffixedFiles(STATS_DATA_DIR, suffix.c_str());
 }
 
+TEST(StatsLogProcessorTest, TestActiveConfigsNotWrittenWithoutActivation) {
+    StatsdConfig config;
+    config.set_id(12345);
+    auto wakelockAcquireMatcher = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = wakelockAcquireMatcher;
+    auto countMetric = config.add_count_metric();
+    countMetric->set_id(123456);
+    countMetric->set_what(wakelockAcquireMatcher.id());
+    countMetric->set_bucket(FIVE_MINUTES);
+    auto metricActivation = config.add_metric_activation();
+    metricActivation->set_metric_id(countMetric->id());
+    metricActivation->set_activation_type(ACTIVATE_IMMEDIATELY);
+    auto activationTrigger = metricActivation->add_event_activation();
+    activationTrigger->set_atom_matcher_id(wakelockAcquireMatcher.id());
+    activationTrigger->set_ttl_seconds(100);
+
+    const char* activeMetricsFile = "/data/misc/stats-active-metric/active_metrics";
+    ConfigKey cfgKey(1111, config.id());
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey);
+    ActiveConfigList activeConfigList;
+
+    processor->SaveActiveConfigsToDisk(/*currentTimeNs=*/10);
+    EXPECT_FALSE(StorageManager::readProtoFromFile(activeMetricsFile, &activeConfigList));
+
+    std::vector<int> attributionUids = {111};
+    std::vector<string> attributionTags = {"App1"};
+    processor->OnLogEvent(
+            CreateAcquireWakelockEvent(20, attributionUids, attributionTags, "wl1").get());
+    // Skip the cool down between the writes.
+    processor->mLastActiveMetricsWriteNs = 0;
+    processor->SaveActiveConfigsToDisk(/*currentTimeNs=*/30);
+    ASSERT_TRUE(StorageManager::readProtoFromFile(activeMetricsFile, &activeConfigList));
+    ASSERT_EQ(activeConfigList.config_size(), 1);
+    ASSERT_EQ(activeConfigList.config(0).metric_size(), 1);
+    EXPECT_EQ(activeConfigList.config(0).metric(0).activation_size(), 1);
+    StorageManager::deleteFile(activeMetricsFile);
+}
+
 TEST(StatsLogProcessorTest, TestActiveConfigMetricDiskWriteRead) {
     int uid = 1111;
 
@@ -2261,11 +2970,10 @@ TEST_F(StatsLogProcessorTestRestricted, RestrictedMetricsManagerOnDumpReportNotC
     processor->mMetricsManagers[mConfigKey] = metricsManager;
     EXPECT_TRUE(processor->mMetricsManagers[mConfigKey]->hasRestrictedMetricsDelegate());
 
-    vector<uint8_t> buffer;
+    ProtoOutputStream proto;
     processor->onConfigMetricsReportLocked(mConfigKey, /*dumpTimeStampNs=*/1, /*wallClockNs=*/0,
                                            /*include_current_partial_bucket=*/true,
-                                           /*erase_data=*/true, GET_DATA_CALLED, FAST,
-                                           /*dataSavedToDisk=*/true, &buffer);
+                                           /*erase_data=*/true, GET_DATA_CALLED, FAST, &proto);
 }
 
 TEST_F(StatsLogProcessorTestRestricted, RestrictedMetricFlushIfReachMemoryLimit) {
@@ -2309,11 +3017,10 @@ TEST_F(StatsLogProcessorTestRestricted, NonRestrictedMetricsManagerOnDumpReportC
     processor->mMetricsManagers[mConfigKey] = metricsManager;
     EXPECT_FALSE(processor->mMetricsManagers[mConfigKey]->hasRestrictedMetricsDelegate());
 
-    vector<uint8_t> buffer;
+    ProtoOutputStream proto;
     processor->onConfigMetricsReportLocked(mConfigKey, /*dumpTimeStampNs=*/1, /*wallClockNs=*/0,
                                            /*include_current_partial_bucket=*/true,
-                                           /*erase_data=*/true, GET_DATA_CALLED, FAST,
-                                           /*dataSavedToDisk=*/true, &buffer);
+                                           /*erase_data=*/true, GET_DATA_CALLED, FAST, &proto);
 }
 
 TEST_F(StatsLogProcessorTestRestricted, RestrictedMetricOnDumpReportEmpty) {
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "socket/StatsRingListener.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "tests/statsd_test_util.h"
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using android::base::unique_fd;
+
+namespace {
+
+constexpr uint32_t kTestUid = 1000;
+constexpr uint32_t kTestPid = 1002;
+constexpr int kAtomId = 1000;
+constexpr uint32_t kTestCapacity = 4096;
+
+/**
+ * Producer side of a ring mimicking libstatssocket StatsRingWriter
+ */
+class TestRing {
+public:
+    TestRing(bool sealed = true) {
+        const size_t size = sizeof(StatsRingListener::RingHeader) + kTestCapacity;
+        mMemFd.reset(memfd_create("test_stats_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+        ftruncate(mMemFd.get(), size);
+        if (sealed) {
+            fcntl(mMemFd.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+        }
+        mHeader = (StatsRingListener::RingHeader*)mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                                       MAP_SHARED, mMemFd.get(), 0);
+        mHeader->magic = StatsRingListener::kRingMagic;
+        mHeader->capacity = kTestCapacity;
+        mData = (uint8_t*)mHeader + sizeof(StatsRingListener::RingHeader);
+        mEventFd.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    }
+
+    ~TestRing() {
+        munmap(mHeader, sizeof(StatsRingListener::RingHeader) + kTestCapacity);
+    }
+
+    void writeAtom(int atomId) {
+        AStatsEvent* event = AStatsEvent_obtain();
+        createStatsEvent(event, INT64_TYPE, atomId);
+        AStatsEvent_build(event);
+        size_t size;
+        const uint8_t* buf = AStatsEvent_getBuffer(event, &size);
+        writeRecord(buf, size);
+        AStatsEvent_release(event);
+    }
+
+    void writeRecord(const uint8_t* buf, uint32_t size) {
+        const uint32_t writePos = mHeader->writePos.load();
+        const uint32_t offset = writePos % kTestCapacity;
+        memcpy(mData + offset, &size, sizeof(size));
+        memcpy(mData + offset + sizeof(size), buf, size);
+        mHeader->writePos.store(writePos + ((sizeof(size) + size + 3) & ~3u));
+    }
+
+    bool registerWith(StatsRingListener& listener) {
+        return listener.registerRing(unique_fd(dup(mMemFd.get())),
+                                     unique_fd(dup(mEventFd.get())), kTestUid, kTestPid);
+    }
+
+    StatsRingListener::RingHeader* mHeader;
+
+private:
+    unique_fd mMemFd;
+    unique_fd mEventFd;
+    uint8_t* mData;
+};
+
+}  // namespace
+
+TEST(StatsRingListenerTest, TestDrainRing) {
+    std::shared_ptr<LogEventQueue> queue = std::make_shared<LogEventQueue>(100);
+    std::shared_ptr<LogEventFilter> filter = std::make_shared<LogEventFilter>();
+    filter->setFilteringEnabled(false);
+    StatsRingListener listener(queue, filter);
+
+    TestRing ring;
+    ASSERT_TRUE(ring.registerWith(listener));
+    listener.adoptPendingRings();
+    ASSERT_EQ(1, listener.getRingsCount());
+
+    constexpr int kEventCount = 40;
+    for (int i = 0; i < kEventCount; i++) {
+        ring.writeAtom(kAtomId + i);
+    }
+    bool drained = false;
+    EXPECT_TRUE(listener.drainRing(*listener.mRings[0], &drained));
+    EXPECT_TRUE(drained);
+    // all records are released back to the producer
+    EXPECT_EQ(ring.mHeader->writePos.load(), ring.mHeader->readPos.load());
+
+    for (int i = 0; i < kEventCount; i++) {
+        auto logEvent = queue->waitPop();
+        EXPECT_TRUE(logEvent->isValid());
+        EXPECT_EQ(kAtomId + i, logEvent->GetTagId());
+        EXPECT_EQ(kTestUid, logEvent->GetUid());
+        EXPECT_EQ(kTestPid, logEvent->GetPid());
+    }
+
+    drained = true;
+    EXPECT_TRUE(listener.drainRing(*listener.mRings[0], &drained));
+    EXPECT_FALSE(drained);
+
+    // a new ring from the same process replaces the previous one
+    TestRing newRing;
+    ASSERT_TRUE(newRing.registerWith(listener));
+    listener.adoptPendingRings();
+    EXPECT_EQ(1, listener.getRingsCount());
+}
+
+TEST(StatsRingListenerTest, TestMalformedRing) {
+    std::shared_ptr<LogEventQueue> queue = std::make_shared<LogEventQueue>(100);
+    std::shared_ptr<LogEventFilter> filter = std::make_shared<LogEventFilter>();
+    StatsRingListener listener(queue, filter);
+
+    TestRing unsealedRing(/*sealed=*/false);
+    EXPECT_FALSE(unsealedRing.registerWith(listener));
+
+    TestRing invalidMagicRing;
+    invalidMagicRing.mHeader->magic = 0;
+    EXPECT_FALSE(invalidMagicRing.registerWith(listener));
+
+    TestRing ring;
+    ASSERT_TRUE(ring.registerWith(listener));
+    listener.adoptPendingRings();
+    ASSERT_EQ(1, listener.getRingsCount());
+
+    // record larger than the data available
+    const uint32_t size = 64;
+    ring.writeRecord((const uint8_t*)&size, sizeof(size));
+    ring.mHeader->writePos.store(ring.mHeader->writePos.load() - sizeof(uint32_t));
+    bool drained = false;
+    EXPECT_FALSE(listener.drainRing(*listener.mRings[0], &drained));
+    // nothing is released to the producer
+    EXPECT_EQ(0, ring.mHeader->readPos.load());
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
@@ -19,6 +19,8 @@
 #include <src/uid_data.pb.h>
 #include <stdio.h>
 
+#include <thread>
+
 #include "StatsLogProcessor.h"
 #include "StatsService.h"
 #include "config/ConfigKey.h"
@@ -115,13 +117,50 @@ TEST(UidMapTest, TestIsolatedUID) {
     std::unique_ptr<LogEvent> addEvent = CreateIsolatedUidChangedEvent(
             1 /*timestamp*/, 100 /*hostUid*/, 101 /*isolatedUid*/, 1 /*is_create*/);
     EXPECT_EQ(101, m->getHostUidOrSelf(101));
+    EXPECT_FALSE(m->hasIsolatedUids());
     p.OnLogEvent(addEvent.get());
     EXPECT_EQ(100, m->getHostUidOrSelf(101));
+    EXPECT_TRUE(m->hasIsolatedUids());
 
     std::unique_ptr<LogEvent> removeEvent = CreateIsolatedUidChangedEvent(
             1 /*timestamp*/, 100 /*hostUid*/, 101 /*isolatedUid*/, 0 /*is_create*/);
     p.OnLogEvent(removeEvent.get());
     EXPECT_EQ(101, m->getHostUidOrSelf(101));
+    EXPECT_FALSE(m->hasIsolatedUids());
+}
+
+TEST(UidMapTest, TestLookupsDuringUpdates) {
+    UidMap m;
+    const string kApp = "app";
+    m.updateApp(1, kApp, 1000, 4, "v4", "", /* certificateHash */ {});
+    m.assignIsolatedUid(101, 100);
+
+    // The readers see either the previous or the updated maps, never a partial update.
+    std::atomic<bool> done = false;
+    std::thread reader([&] {
+        while (!done) {
+            const int hostUid = m.getHostUidOrSelf(101);
+            EXPECT_TRUE(hostUid == 100 || hostUid == 200) << hostUid;
+            EXPECT_TRUE(m.hasApp(1000, kApp));
+            const int64_t version = m.getAppVersion(1000, kApp);
+            EXPECT_TRUE(version == 4 || version == 5) << version;
+        }
+    });
+    for (int i = 0; i < 100; ++i) {
+        m.assignIsolatedUid(101, i % 2 == 0 ? 200 : 100);
+        m.assignIsolatedUid(1000 + i, 100);
+        m.updateApp(2 + i, kApp, 1000, i % 2 == 0 ? 5 : 4, "v", "", /* certificateHash */ {});
+    }
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(100, m.getHostUidOrSelf(101));
+    EXPECT_EQ(100, m.getHostUidOrSelf(1099));
+    EXPECT_EQ(4, m.getAppVersion(1000, kApp));
+    m.removeApp(200, kApp, 1000);
+    EXPECT_FALSE(m.hasApp(1000, kApp));
+    EXPECT_EQ(0, m.getAppVersion(1000, kApp));
+    EXPECT_THAT(m.getAppNamesFromUid(1000, true), IsEmpty());
 }
 
 TEST(UidMapTest, TestUpdateMap) {
@@ -200,6 +239,35 @@ TEST(UidMapTest, TestUpdateMapMultiple) {
                 UnorderedPointwise(EqPackageInfo(), expectedPackageInfos));
 }
 
+TEST(UidMapTest, TestUpdateMapUnchanged) {
+    const sp<UidMap> uidMap = new UidMap();
+    const shared_ptr<StatsService> service = SharedRefBase::make<StatsService>(
+            uidMap, /* queue */ nullptr, std::make_shared<LogEventFilter>());
+    sendPackagesToStatsd(service, kUids, kVersions, kVersionStrings, kApps, kInstallers,
+                         kCertificateHashes);
+    const uint64_t appsGeneration = uidMap->getAppsGeneration();
+
+    // The same apps don't update the map.
+    sendPackagesToStatsd(service, kUids, kVersions, kVersionStrings, kApps, kInstallers,
+                         kCertificateHashes);
+    EXPECT_EQ(appsGeneration, uidMap->getAppsGeneration());
+
+    // A new installer does.
+    vector<string> installers(kInstallers);
+    installers.front() = "NewInstaller";
+    sendPackagesToStatsd(service, kUids, kVersions, kVersionStrings, kApps, installers,
+                         kCertificateHashes);
+    EXPECT_NE(appsGeneration, uidMap->getAppsGeneration());
+
+    vector<PackageInfo> expectedPackageInfos =
+            buildPackageInfos(kApps, kUids, kVersions, kVersionStrings, installers,
+                              kCertificateHashes, kDeleted, /* installerIndices */ {},
+                              /* hashStrings */ false);
+    PackageInfoSnapshot packageInfoSnapshot = getPackageInfoSnapshot(uidMap);
+    EXPECT_THAT(packageInfoSnapshot.package_info(),
+                UnorderedPointwise(EqPackageInfo(), expectedPackageInfos));
+}
+
 TEST(UidMapTest, TestRemoveApp) {
     const sp<UidMap> uidMap = new UidMap();
     const shared_ptr<StatsService> service = SharedRefBase::make<StatsService>(
@@ -257,6 +325,30 @@ TEST(UidMapTest, TestRemoveApp) {
                 UnorderedPointwise(EqPackageInfo(), expectedPackageInfos));
 }
 
+TEST(UidMapTest, TestGetUidsWithApp) {
+    UidMap m;
+    const uint64_t initialGeneration = m.getAppsGeneration();
+    m.updateApp(1, kApp1, 1500, 4, "v1", "", /* certificateHash */ {});
+    m.updateApp(1, kApp1, 1000, 4, "v1", "", /* certificateHash */ {});
+    m.updateApp(1, kApp2, 1000, 5, "v1", "", /* certificateHash */ {});
+    m.updateApp(1, kApp3, 2000, 6, "v2", "", /* certificateHash */ {});
+    EXPECT_EQ(initialGeneration + 4, m.getAppsGeneration());
+
+    EXPECT_THAT(m.getUidsWithApp(kApp1, /* isWildcard */ false), ElementsAre(1000, 1500));
+    EXPECT_THAT(m.getUidsWithApp(kApp3, /* isWildcard */ false), ElementsAre(2000));
+    EXPECT_THAT(m.getUidsWithApp("app*", /* isWildcard */ false), IsEmpty());
+    EXPECT_THAT(m.getUidsWithApp("app*", /* isWildcard */ true), ElementsAre(1000, 1500, 2000));
+    EXPECT_THAT(m.getUidsWithApp("*.sharing.*", /* isWildcard */ true), ElementsAre(1000, 1500));
+
+    m.removeApp(2, kApp1, 1000);
+    EXPECT_EQ(initialGeneration + 5, m.getAppsGeneration());
+    EXPECT_THAT(m.getUidsWithApp(kApp1, /* isWildcard */ false), ElementsAre(1500));
+    EXPECT_THAT(m.getUidsWithApp("*.sharing.*", /* isWildcard */ true), ElementsAre(1000, 1500));
+
+    m.removeApp(3, kApp2, 1000);
+    EXPECT_THAT(m.getUidsWithApp("*.sharing.*", /* isWildcard */ true), ElementsAre(1500));
+}
+
 TEST(UidMapTest, TestUpdateApp) {
     const sp<UidMap> uidMap = new UidMap();
     const shared_ptr<StatsService> service = SharedRefBase::make<StatsService>(
@@ -277,6 +369,11 @@ TEST(UidMapTest, TestUpdateApp) {
                               /* certificateHash */ {'a'});
     name_set = uidMap->getAppNamesFromUid(1000, true /* returnNormalized */);
     EXPECT_THAT(name_set, UnorderedElementsAre(kApp1, kApp2, "new_app1_name"));
+    name_set = uidMap->getAppNamesFromUid(1000, false /* returnNormalized */);
+    EXPECT_THAT(name_set, UnorderedElementsAre(kApp1, kApp2, "NeW_aPP1_NAmE"));
+    EXPECT_TRUE(uidMap->hasAppMatching(1000, "NeW_*"));
+    EXPECT_FALSE(uidMap->hasAppMatching(1000, "new_*"));
+    EXPECT_FALSE(uidMap->hasAppMatching(12345, "*"));
 
     // Re-add the same name for another uid 2000
     service->informOnePackage("NeW_aPP1_NAmE", 2000, /* version */ 1,
@@ -311,6 +408,44 @@ TEST(UidMapTest, TestUpdateApp) {
                 UnorderedPointwise(EqPackageInfo(), expectedPackageInfos));
 }
 
+TEST(UidMapTest, TestInternedStringsCompacted) {
+    UidMap m;
+    ConfigKey config1(1, StringToId("config1"));
+    m.OnConfigUpdated(config1);
+
+    const int numUpdates = UidMap::kMinStringsToCompact * 4;
+    for (int i = 0; i < numUpdates; i++) {
+        m.updateApp(1 + i, kApp1, 1000, i, "v" + std::to_string(i), "installer",
+                    /* certificateHash */ {});
+        // Only the change records keep the previous version strings.
+        m.clearOutput();
+    }
+    EXPECT_LT(m.mStrings.size(), UidMap::kMinStringsToCompact * 2);
+    EXPECT_EQ(m.mStrings.size(), m.mStringIds.size());
+
+    const string lastVersionString = "v" + std::to_string(numUpdates - 1);
+    m.updateApp(numUpdates + 1, kApp2, 1000, 1, lastVersionString, "installer",
+                /* certificateHash */ {});
+    EXPECT_EQ(numUpdates - 1, m.getAppVersion(1000, kApp1));
+    EXPECT_THAT(m.getAppUid(kApp2), UnorderedElementsAre(1000));
+
+    ProtoOutputStream proto;
+    m.appendUidMap(/* timestamp */ numUpdates + 2, config1, /* includeVersionStrings */ true,
+                   /* includeInstaller */ true, /* truncatedCertificateHashSize */ 0,
+                   /* str_set */ nullptr, &proto);
+    UidMapping results;
+    outputStreamToProto(&proto, &results);
+    ASSERT_EQ(1, results.changes_size());
+    EXPECT_EQ(kApp2, results.changes(0).app());
+    EXPECT_EQ(lastVersionString, results.changes(0).new_version_string());
+    ASSERT_EQ(1, results.snapshots_size());
+    ASSERT_EQ(2, results.snapshots(0).package_info_size());
+    for (const auto& packageInfo : results.snapshots(0).package_info()) {
+        EXPECT_EQ(lastVersionString, packageInfo.version_string());
+        EXPECT_EQ("installer", results.installer_name(packageInfo.installer_index()));
+    }
+}
+
 // Test that uid map returns at least one snapshot even if we already obtained
 // this snapshot from a previous call to getData.
 TEST(UidMapTest, TestOutputIncludesAtLeastOneSnapshot) {
@@ -363,6 +498,54 @@ TEST(UidMapTest, TestRemovedAppRetained) {
     EXPECT_EQ(true, results.snapshots(0).package_info(0).deleted());
 }
 
+TEST(UidMapTest, TestDeltaReportsBetweenFullSnapshots) {
+    UidMap m;
+    ConfigKey config1(1, StringToId("config1"));
+    m.OnConfigUpdated(config1);
+
+    UidData uidData;
+    *uidData.add_app_info() = createApplicationInfo(/*uid*/ 1000, /*version*/ 4, "v4", kApp1);
+    m.updateMap(1 /* timestamp */, uidData);
+
+    auto appendUidMap = [&m, &config1](int64_t timestamp) {
+        ProtoOutputStream proto;
+        m.appendUidMap(timestamp, config1, /* includeVersionStrings */ true,
+                       /* includeInstaller */ true, /* truncatedCertificateHashSize */ 0,
+                       /* str_set */ nullptr, &proto, /* fullSnapshotPeriod */ 3);
+        UidMapping results;
+        outputStreamToProto(&proto, &results);
+        return results;
+    };
+
+    // The first report has the full snapshot.
+    UidMapping results = appendUidMap(2);
+    ASSERT_EQ(1, results.snapshots_size());
+
+    // The next reports only have the changes.
+    m.updateApp(3, kApp1, 1000, 5, "v5", "", /* certificateHash */ {});
+    results = appendUidMap(4);
+    EXPECT_EQ(0, results.snapshots_size());
+    ASSERT_EQ(1, results.changes_size());
+    EXPECT_EQ(5, results.changes(0).new_version());
+
+    results = appendUidMap(5);
+    EXPECT_EQ(0, results.snapshots_size());
+    EXPECT_EQ(0, results.changes_size());
+
+    // Full snapshot once the period is reached.
+    results = appendUidMap(6);
+    ASSERT_EQ(1, results.snapshots_size());
+    EXPECT_EQ("v5", results.snapshots(0).package_info(0).version_string());
+
+    // Replacing the whole map isn't recorded as changes, so it needs a full snapshot.
+    results = appendUidMap(7);
+    EXPECT_EQ(0, results.snapshots_size());
+    m.updateMap(8 /* timestamp */, uidData);
+    results = appendUidMap(9);
+    ASSERT_EQ(1, results.snapshots_size());
+    EXPECT_EQ("v4", results.snapshots(0).package_info(0).version_string());
+}
+
 TEST(UidMapTest, TestRemovedAppOverGuardrail) {
     UidMap m;
     // Initialize single config key.
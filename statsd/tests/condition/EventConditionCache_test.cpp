@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "src/condition/EventConditionCache.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#ifdef __ANDROID__
+
+using std::vector;
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+vector<Metric2Condition> createLinks(int32_t conditionAtomField) {
+    FieldMatcher whatMatcher;
+    whatMatcher.set_field(10);
+    whatMatcher.add_child()->set_field(1);
+
+    FieldMatcher conditionMatcher;
+    conditionMatcher.set_field(27);
+    conditionMatcher.add_child()->set_field(conditionAtomField);
+
+    Metric2Condition link;
+    link.conditionId = 123;
+    translateFieldMatcher(whatMatcher, &link.metricFields);
+    translateFieldMatcher(conditionMatcher, &link.conditionFields);
+    return {link};
+}
+
+ConditionKey createConditionKey(int32_t uid) {
+    int pos[] = {1, 0, 0};
+    HashableDimensionKey key;
+    key.addValue(FieldValue(Field(27, pos, 0), Value(uid)));
+    return {{123, key}};
+}
+
+}  // anonymous namespace
+
+TEST(EventConditionCacheTest, TestNoCacheOutsideScope) {
+    EXPECT_EQ(nullptr, EventConditionCache::get());
+    {
+        EventConditionCache::Scope scope;
+        EventConditionCache* cache = EventConditionCache::get();
+        ASSERT_NE(nullptr, cache);
+
+        // Other threads don't see the cache.
+        std::thread([] { EXPECT_EQ(nullptr, EventConditionCache::get()); }).join();
+
+        {
+            EventConditionCache::Scope nestedScope;
+            EXPECT_NE(cache, EventConditionCache::get());
+        }
+        EXPECT_EQ(cache, EventConditionCache::get());
+
+        {
+            EventConditionCache::Scope disabledScope(/*enabled=*/false);
+            EXPECT_EQ(nullptr, EventConditionCache::get());
+        }
+        EXPECT_EQ(cache, EventConditionCache::get());
+    }
+    EXPECT_EQ(nullptr, EventConditionCache::get());
+}
+
+TEST(EventConditionCacheTest, TestSharedBySameLinks) {
+    EventConditionCache::Scope scope;
+    EventConditionCache* cache = EventConditionCache::get();
+    ASSERT_NE(nullptr, cache);
+
+    LogEvent event(/*uid=*/0, /*pid=*/0);
+    LogEvent otherEvent(/*uid=*/0, /*pid=*/0);
+    const vector<Metric2Condition> links = createLinks(/*conditionAtomField=*/1);
+    const vector<Metric2Condition> sameLinks = createLinks(/*conditionAtomField=*/1);
+    const vector<Metric2Condition> otherLinks = createLinks(/*conditionAtomField=*/2);
+
+    EXPECT_EQ(nullptr, cache->find(event, /*conditionIndex=*/0, /*isPartialLink=*/false, links));
+    const EventConditionCache::Entry& entry =
+            cache->insert(event, /*conditionIndex=*/0, /*isPartialLink=*/false, links,
+                          createConditionKey(1000), ConditionState::kTrue);
+    EXPECT_EQ(createConditionKey(1000), entry.conditionKey);
+
+    // Same links of another metric.
+    EXPECT_EQ(&entry, cache->find(event, 0, false, links));
+    EXPECT_EQ(&entry, cache->find(event, 0, false, sameLinks));
+
+    EXPECT_EQ(nullptr, cache->find(event, 0, false, otherLinks));
+    EXPECT_EQ(nullptr, cache->find(event, 1, false, links));
+    EXPECT_EQ(nullptr, cache->find(event, 0, true, links));
+    EXPECT_EQ(nullptr, cache->find(otherEvent, 0, false, links));
+
+    // Entries stay valid when more are inserted.
+    for (int i = 1; i < 100; i++) {
+        cache->insert(event, i, false, links, createConditionKey(1000 + i),
+                      ConditionState::kFalse);
+    }
+    EXPECT_EQ(&entry, cache->find(event, 0, false, links));
+    EXPECT_EQ(ConditionState::kTrue, entry.conditionState);
+    EXPECT_EQ(createConditionKey(1000), entry.conditionKey);
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
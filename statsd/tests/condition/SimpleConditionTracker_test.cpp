@@ -22,6 +22,7 @@
 #include <vector>
 
 #include "src/guardrail/StatsdStats.h"
+#include "src/matchers/EventMatcherCache.h"
 #include "stats_event.h"
 #include "tests/statsd_test_util.h"
 
@@ -424,7 +425,7 @@ TEST_P(SimpleConditionTrackerTest, TestSlicedCondition) {
         conditionTracker.evaluateCondition(event1, matcherState, allPredicates, conditionCache,
                                            changedCache);
 
-        ASSERT_EQ(1UL, conditionTracker.mSlicedConditionState.size());
+        ASSERT_EQ(1UL, conditionTracker.mState->slicedConditionState.size());
         EXPECT_TRUE(changedCache[0]);
         ASSERT_EQ(conditionTracker.getChangedToTrueDimensions(allConditions)->size(), 1u);
         EXPECT_TRUE(conditionTracker.getChangedToFalseDimensions(allConditions)->empty());
@@ -447,7 +448,7 @@ TEST_P(SimpleConditionTrackerTest, TestSlicedCondition) {
         conditionTracker.evaluateCondition(event2, matcherState, allPredicates, conditionCache,
                                            changedCache);
         EXPECT_FALSE(changedCache[0]);
-        ASSERT_EQ(1UL, conditionTracker.mSlicedConditionState.size());
+        ASSERT_EQ(1UL, conditionTracker.mState->slicedConditionState.size());
         EXPECT_TRUE(conditionTracker.getChangedToTrueDimensions(allConditions)->empty());
         EXPECT_TRUE(conditionTracker.getChangedToFalseDimensions(allConditions)->empty());
 
@@ -463,7 +464,7 @@ TEST_P(SimpleConditionTrackerTest, TestSlicedCondition) {
                                            changedCache);
         // nothing changes, because wake lock 2 is still held for this uid
         EXPECT_FALSE(changedCache[0]);
-        ASSERT_EQ(1UL, conditionTracker.mSlicedConditionState.size());
+        ASSERT_EQ(1UL, conditionTracker.mState->slicedConditionState.size());
         EXPECT_TRUE(conditionTracker.getChangedToTrueDimensions(allConditions)->empty());
         EXPECT_TRUE(conditionTracker.getChangedToFalseDimensions(allConditions)->empty());
 
@@ -477,7 +478,7 @@ TEST_P(SimpleConditionTrackerTest, TestSlicedCondition) {
         conditionTracker.evaluateCondition(event4, matcherState, allPredicates, conditionCache,
                                            changedCache);
 
-        ASSERT_EQ(conditionTracker.mSlicedConditionState.size(),
+        ASSERT_EQ(conditionTracker.mState->slicedConditionState.size(),
                   GetParam() == SimplePredicate_InitialValue_FALSE ? 0 : 1);
         EXPECT_TRUE(changedCache[0]);
         ASSERT_EQ(conditionTracker.getChangedToFalseDimensions(allConditions)->size(), 1u);
@@ -529,7 +530,7 @@ TEST(SimpleConditionTrackerTest, TestSlicedWithNoOutputDim) {
     conditionTracker.evaluateCondition(event1, matcherState, allPredicates, conditionCache,
                                        changedCache);
 
-    ASSERT_EQ(1UL, conditionTracker.mSlicedConditionState.size());
+    ASSERT_EQ(1UL, conditionTracker.mState->slicedConditionState.size());
     EXPECT_TRUE(changedCache[0]);
 
     // Now test query
@@ -577,7 +578,7 @@ TEST(SimpleConditionTrackerTest, TestSlicedWithNoOutputDim) {
     changedCache[0] = false;
     conditionTracker.evaluateCondition(event4, matcherState, allPredicates, conditionCache,
                                        changedCache);
-    ASSERT_EQ(0UL, conditionTracker.mSlicedConditionState.size());
+    ASSERT_EQ(0UL, conditionTracker.mState->slicedConditionState.size());
     EXPECT_TRUE(changedCache[0]);
 
     // query again
@@ -620,7 +621,7 @@ TEST_P(SimpleConditionTrackerTest, TestStopAll) {
 
         conditionTracker.evaluateCondition(event1, matcherState, allPredicates, conditionCache,
                                            changedCache);
-        ASSERT_EQ(1UL, conditionTracker.mSlicedConditionState.size());
+        ASSERT_EQ(1UL, conditionTracker.mState->slicedConditionState.size());
         EXPECT_TRUE(changedCache[0]);
         ASSERT_EQ(1UL, conditionTracker.getChangedToTrueDimensions(allConditions)->size());
         EXPECT_TRUE(conditionTracker.getChangedToFalseDimensions(allConditions)->empty());
@@ -644,7 +645,7 @@ TEST_P(SimpleConditionTrackerTest, TestStopAll) {
         changedCache[0] = false;
         conditionTracker.evaluateCondition(event2, matcherState, allPredicates, conditionCache,
                                            changedCache);
-        ASSERT_EQ(2UL, conditionTracker.mSlicedConditionState.size());
+        ASSERT_EQ(2UL, conditionTracker.mState->slicedConditionState.size());
 
         EXPECT_TRUE(changedCache[0]);
         ASSERT_EQ(1UL, conditionTracker.getChangedToTrueDimensions(allConditions)->size());
@@ -671,7 +672,7 @@ TEST_P(SimpleConditionTrackerTest, TestStopAll) {
         conditionTracker.evaluateCondition(event3, matcherState, allPredicates, conditionCache,
                                            changedCache);
         EXPECT_TRUE(changedCache[0]);
-        ASSERT_EQ(0UL, conditionTracker.mSlicedConditionState.size());
+        ASSERT_EQ(0UL, conditionTracker.mState->slicedConditionState.size());
         ASSERT_EQ(2UL, conditionTracker.getChangedToFalseDimensions(allConditions)->size());
         EXPECT_TRUE(conditionTracker.getChangedToTrueDimensions(allConditions)->empty());
 
@@ -719,7 +720,7 @@ TEST(SimpleConditionTrackerTest, TestGuardrailNotHitWhenDefaultFalse) {
         conditionTracker.evaluateCondition(event, matcherState, allPredicates, conditionCache,
                                            changedCache);
 
-        ASSERT_EQ(1UL, conditionTracker.mSlicedConditionState.size());
+        ASSERT_EQ(1UL, conditionTracker.mState->slicedConditionState.size());
 
         LogEvent event2(/*uid=*/0, /*pid=*/0);
         makeWakeLockEvent(&event2, /*uids=*/{i}, "wl", /*acquire=*/0);
@@ -731,7 +732,7 @@ TEST(SimpleConditionTrackerTest, TestGuardrailNotHitWhenDefaultFalse) {
         conditionTracker.evaluateCondition(event2, matcherState, allPredicates, conditionCache,
                                            changedCache);
         // wakelock is now released, key is cleared from map since the default value is false.
-        ASSERT_EQ(0UL, conditionTracker.mSlicedConditionState.size());
+        ASSERT_EQ(0UL, conditionTracker.mState->slicedConditionState.size());
     }
 }
 
@@ -766,7 +767,7 @@ TEST(SimpleConditionTrackerTest, TestGuardrailHitWhenDefaultUnknown) {
         conditionTracker.evaluateCondition(event, matcherState, allPredicates, conditionCache,
                                            changedCache);
 
-        ASSERT_EQ(i + 1, conditionTracker.mSlicedConditionState.size());
+        ASSERT_EQ(i + 1, conditionTracker.mState->slicedConditionState.size());
 
         LogEvent event2(/*uid=*/0, /*pid=*/0);
         makeWakeLockEvent(&event2, /*uids=*/{i}, "wl", /*acquire=*/0);
@@ -778,11 +779,11 @@ TEST(SimpleConditionTrackerTest, TestGuardrailHitWhenDefaultUnknown) {
         conditionTracker.evaluateCondition(event2, matcherState, allPredicates, conditionCache,
                                            changedCache);
         // wakelock is now released, key is not cleared from map since the default value is unknown.
-        ASSERT_EQ(i + 1, conditionTracker.mSlicedConditionState.size());
+        ASSERT_EQ(i + 1, conditionTracker.mState->slicedConditionState.size());
     }
 
     ASSERT_EQ(StatsdStats::kDimensionKeySizeHardLimit,
-              conditionTracker.mSlicedConditionState.size());
+              conditionTracker.mState->slicedConditionState.size());
     // one more acquire after the guardrail is hit.
     LogEvent event3(/*uid=*/0, /*pid=*/0);
     makeWakeLockEvent(&event3, /*uids=*/{i}, "wl", /*acquire=*/1);
@@ -797,9 +798,123 @@ TEST(SimpleConditionTrackerTest, TestGuardrailHitWhenDefaultUnknown) {
                                        changedCache);
 
     ASSERT_EQ(StatsdStats::kDimensionKeySizeHardLimit,
-              conditionTracker.mSlicedConditionState.size());
+              conditionTracker.mState->slicedConditionState.size());
     EXPECT_EQ(conditionCache[0], ConditionState::kUnknown);
 }
+
+namespace {
+
+SimplePredicate getScreenIsOnCondition() {
+    SimplePredicate simplePredicate;
+    simplePredicate.set_start(StringToId("SCREEN_TURNED_ON"));
+    simplePredicate.set_stop(StringToId("SCREEN_TURNED_OFF"));
+    simplePredicate.set_count_nesting(true);
+    simplePredicate.set_initial_value(SimplePredicate_InitialValue_UNKNOWN);
+    return simplePredicate;
+}
+
+sp<SimpleConditionTracker> createScreenIsOnTracker(const ConfigKey& key) {
+    unordered_map<int64_t, int> trackerNameIndexMap;
+    trackerNameIndexMap[StringToId("SCREEN_TURNED_ON")] = 0;
+    trackerNameIndexMap[StringToId("SCREEN_TURNED_OFF")] = 1;
+    return new SimpleConditionTracker(key, StringToId("SCREEN_IS_ON"), protoHash,
+                                      0 /*tracker index*/, getScreenIsOnCondition(),
+                                      trackerNameIndexMap);
+}
+
+}  // anonymous namespace
+
+TEST(SimpleConditionTrackerTest, TestSharedState) {
+    sp<SharedConditionStates> sharedStates = new SharedConditionStates();
+    sp<SimpleConditionTracker> tracker1 = createScreenIsOnTracker(ConfigKey(0, 1));
+    sp<SimpleConditionTracker> tracker2 = createScreenIsOnTracker(ConfigKey(0, 2));
+    sp<SimpleConditionTracker> sameConfigTracker = createScreenIsOnTracker(ConfigKey(0, 1));
+    sp<SimpleConditionTracker> otherOwnerTracker = createScreenIsOnTracker(ConfigKey(1, 1));
+    tracker1->shareState(sharedStates, "screen");
+    tracker2->shareState(sharedStates, "screen");
+    sameConfigTracker->shareState(sharedStates, "screen");
+    otherOwnerTracker->shareState(sharedStates, "screen");
+    EXPECT_EQ(tracker1->mState, tracker2->mState);
+    EXPECT_EQ(nullptr, sameConfigTracker->mSharedStates);
+    EXPECT_NE(tracker1->mState, sameConfigTracker->mState);
+    EXPECT_NE(tracker1->mState, otherOwnerTracker->mState);
+    EXPECT_EQ(2UL, sharedStates->getGroupCount());
+
+    vector<sp<ConditionTracker>> allPredicates;
+    vector<MatchingState> matcherState = {MatchingState::kMatched, MatchingState::kNotMatched};
+    unique_ptr<LogEvent> screenOnEvent =
+            CreateScreenStateChangedEvent(/*timestamp=*/100, android::view::DISPLAY_STATE_ON);
+    {
+        EventMatcherCache::Scope matcherCacheScope(*screenOnEvent);
+        for (const sp<SimpleConditionTracker>& tracker : {tracker1, tracker2}) {
+            vector<ConditionState> conditionCache(1, ConditionState::kNotEvaluated);
+            vector<uint8_t> changedCache(1, false);
+            tracker->evaluateCondition(*screenOnEvent, matcherState, allPredicates,
+                                       conditionCache, changedCache);
+            EXPECT_EQ(ConditionState::kTrue, conditionCache[0]);
+            EXPECT_TRUE(changedCache[0]);
+        }
+    }
+    // The start is only counted once.
+    EXPECT_EQ(1, tracker1->mState->slicedConditionState.at(DEFAULT_DIMENSION_KEY));
+
+    matcherState = {MatchingState::kNotMatched, MatchingState::kMatched};
+    unique_ptr<LogEvent> screenOffEvent =
+            CreateScreenStateChangedEvent(/*timestamp=*/200, android::view::DISPLAY_STATE_OFF);
+    {
+        EventMatcherCache::Scope matcherCacheScope(*screenOffEvent);
+        for (const sp<SimpleConditionTracker>& tracker : {tracker2, tracker1}) {
+            vector<ConditionState> conditionCache(1, ConditionState::kNotEvaluated);
+            vector<uint8_t> changedCache(1, false);
+            tracker->evaluateCondition(*screenOffEvent, matcherState, allPredicates,
+                                       conditionCache, changedCache);
+            EXPECT_EQ(ConditionState::kFalse, conditionCache[0]);
+            EXPECT_TRUE(changedCache[0]);
+        }
+    }
+
+    // A tracker joining the group takes the current state over.
+    sp<SimpleConditionTracker> tracker3 = createScreenIsOnTracker(ConfigKey(0, 3));
+    tracker3->shareState(sharedStates, "screen");
+    ConditionKey queryKey;
+    vector<ConditionState> conditionCache(1, ConditionState::kNotEvaluated);
+    tracker3->isConditionMet(queryKey, allPredicates, false, conditionCache);
+    EXPECT_EQ(ConditionState::kFalse, conditionCache[0]);
+
+    tracker1 = nullptr;
+    tracker2 = nullptr;
+    EXPECT_EQ(2UL, sharedStates->getGroupCount());
+    tracker3 = nullptr;
+    EXPECT_EQ(1UL, sharedStates->getGroupCount());
+}
+
+TEST(SimpleConditionTrackerTest, TestSharedStateWithoutDispatchScope) {
+    sp<SharedConditionStates> sharedStates = new SharedConditionStates();
+    sp<SimpleConditionTracker> tracker1 = createScreenIsOnTracker(ConfigKey(0, 1));
+    sp<SimpleConditionTracker> tracker2 = createScreenIsOnTracker(ConfigKey(0, 2));
+    tracker1->shareState(sharedStates, "screen");
+    tracker2->shareState(sharedStates, "screen");
+
+    vector<sp<ConditionTracker>> allPredicates;
+    vector<MatchingState> matcherState = {MatchingState::kMatched, MatchingState::kNotMatched};
+    vector<ConditionState> conditionCache(1, ConditionState::kNotEvaluated);
+    vector<uint8_t> changedCache(1, false);
+    unique_ptr<LogEvent> screenOnEvent =
+            CreateScreenStateChangedEvent(/*timestamp=*/100, android::view::DISPLAY_STATE_ON);
+    tracker1->evaluateCondition(*screenOnEvent, matcherState, allPredicates, conditionCache,
+                                changedCache);
+    EXPECT_EQ(ConditionState::kTrue, conditionCache[0]);
+
+    // The tracker stopped sharing before evaluating the event, the other one didn't see it.
+    EXPECT_EQ(nullptr, tracker1->mSharedStates);
+    EXPECT_NE(tracker1->mState, tracker2->mState);
+    conditionCache[0] = ConditionState::kNotEvaluated;
+    ConditionKey queryKey;
+    tracker2->isConditionMet(queryKey, allPredicates, false, conditionCache);
+    EXPECT_EQ(ConditionState::kUnknown, conditionCache[0]);
+    EXPECT_EQ(1UL, sharedStates->getGroupCount());
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
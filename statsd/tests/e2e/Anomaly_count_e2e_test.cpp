@@ -17,6 +17,7 @@
 #include "src/statsd_metadata.pb.h"
 #include "src/StatsLogProcessor.h"
 #include "src/stats_log_util.h"
+#include "src/storage/StorageManager.h"
 #include "tests/statsd_test_util.h"
 
 #include <vector>
@@ -380,6 +381,48 @@ TEST(AnomalyCountDetectionE2eTest, TestCountMetric_load_refractory_from_disk) {
               mockElapsedTimeNs / NS_PER_SEC);
 }
 
+TEST(AnomalyCountDetectionE2eTest, TestCountMetric_skip_unchanged_refractory_write) {
+    const int num_buckets = 1;
+    const int threshold = 0;
+    const int refractory_period_sec = 86400 * 365; // 1 year
+    auto config = CreateStatsdConfig(num_buckets, threshold, refractory_period_sec);
+    const char* metadataFile = "/data/misc/stats-metadata/metadata";
+
+    int64_t bucketStartTimeNs = 10000000000;
+    ConfigKey cfgKey(2000, 1000);
+    auto processor = CreateStatsLogProcessor(bucketStartTimeNs, bucketStartTimeNs, config, cfgKey);
+    ASSERT_EQ(processor->mMetricsManagers.size(), 1u);
+    ASSERT_EQ(1u, processor->mMetricsManagers.begin()->second->mAllAnomalyTrackers.size());
+
+    std::vector<string> attributionTags = {"App1"};
+    auto event = CreateAcquireWakelockEvent(bucketStartTimeNs + 2, {111}, attributionTags, "wl1");
+    processor->OnLogEvent(event.get());
+
+    int64_t mockWallClockNs = 1584991200 * NS_PER_SEC;
+    int64_t mockElapsedTimeNs = bucketStartTimeNs + 5000 * NS_PER_SEC;
+    processor->SaveMetadataToDisk(mockWallClockNs, mockElapsedTimeNs);
+    metadata::StatsMetadataList metadataList;
+    EXPECT_TRUE(StorageManager::readProtoFromFile(metadataFile, &metadataList));
+
+    // No refractory period started since the last write, so the metadata is not written again.
+    StorageManager::deleteFile(metadataFile);
+    mockWallClockNs += 100 * NS_PER_SEC;
+    mockElapsedTimeNs += 100 * NS_PER_SEC;
+    processor->SaveMetadataToDisk(mockWallClockNs, mockElapsedTimeNs);
+    EXPECT_FALSE(StorageManager::readProtoFromFile(metadataFile, &metadataList));
+
+    event = CreateAcquireWakelockEvent(bucketStartTimeNs + 3, {222}, attributionTags, "wl1");
+    processor->OnLogEvent(event.get());
+    mockWallClockNs += 100 * NS_PER_SEC;
+    mockElapsedTimeNs += 100 * NS_PER_SEC;
+    processor->SaveMetadataToDisk(mockWallClockNs, mockElapsedTimeNs);
+    EXPECT_TRUE(StorageManager::readProtoFromFile(metadataFile, &metadataList));
+    ASSERT_EQ(metadataList.stats_metadata_size(), 1);
+    ASSERT_EQ(metadataList.stats_metadata(0).alert_metadata_size(), 1);
+    EXPECT_EQ(metadataList.stats_metadata(0).alert_metadata(0).alert_dim_keyed_data_size(), 2);
+    StorageManager::deleteFile(metadataFile);
+}
+
 #else
 GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
@@ -104,6 +104,125 @@ TEST(ConfigTtlE2eTest, TestCountMetric) {
                             ADB_DUMP, FAST, &buffer);
 }
 
+TEST(ConfigTtlE2eTest, TestResetInPlace) {
+    auto config = CreateStatsdConfig(/*num_buckets=*/1, /*threshold=*/3);
+    int64_t bucketStartTimeNs = 10000000000;
+    int64_t ttlNs = config.ttl_in_seconds() * NS_PER_SEC;
+
+    ConfigKey cfgKey;
+    auto processor = CreateStatsLogProcessor(bucketStartTimeNs, bucketStartTimeNs, config, cfgKey);
+    ASSERT_EQ(processor->mMetricsManagers.size(), 1u);
+    sp<MetricsManager> metricsManager = processor->mMetricsManagers.begin()->second;
+
+    std::vector<int> attributionUids1 = {111};
+    std::vector<string> attributionTags1 = {"App1"};
+    auto event = CreateAcquireWakelockEvent(bucketStartTimeNs + 2, attributionUids1,
+                                            attributionTags1, "wl1");
+    processor->OnLogEvent(event.get());
+
+    // The ttl expires, the data is written to disk and the metrics are reset in place.
+    const int64_t resetTimeNs = bucketStartTimeNs + ttlNs + 2;
+    event = CreateAcquireWakelockEvent(resetTimeNs, attributionUids1, attributionTags1, "wl2");
+    processor->OnLogEvent(event.get());
+    ASSERT_EQ(processor->mMetricsManagers.size(), 1u);
+    EXPECT_EQ(metricsManager, processor->mMetricsManagers.begin()->second);
+    EXPECT_EQ(resetTimeNs + ttlNs, metricsManager->getTtlEndNs());
+
+    const int64_t dumpTimeNs = resetTimeNs + NS_PER_SEC;
+    ConfigMetricsReportList reports;
+    vector<uint8_t> buffer;
+    processor->onDumpReport(cfgKey, dumpTimeNs, true, true, ADB_DUMP, FAST, &buffer);
+    ASSERT_TRUE(reports.ParseFromArray(&buffer[0], buffer.size()));
+    backfillDimensionPath(&reports);
+    backfillStringInReport(&reports);
+    backfillStartEndTimestamp(&reports);
+    ASSERT_EQ(reports.reports_size(), 2);
+
+    // Only the event logged at the reset is in the report after it, in a bucket starting then.
+    ConfigMetricsReport report = reports.reports(1);
+    ASSERT_EQ(report.metrics_size(), 1);
+    ASSERT_EQ(report.metrics(0).count_metrics().data_size(), 1);
+    CountMetricData data = report.metrics(0).count_metrics().data(0);
+    ASSERT_EQ(data.bucket_info_size(), 1);
+    ValidateCountBucket(data.bucket_info(0), MillisToNano(NanoToMillis(resetTimeNs)),
+                        MillisToNano(NanoToMillis(dumpTimeNs)), 1);
+}
+
+TEST(ConfigTtlE2eTest, TestResetInPlaceKeepsStartedDuration) {
+    StatsdConfig config;
+    *config.add_atom_matcher() = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = CreateReleaseWakelockAtomMatcher();
+    *config.add_atom_matcher() = CreateScreenTurnedOnAtomMatcher();
+    auto holdingWakelockPredicate = CreateHoldingWakelockPredicate();
+    *config.add_predicate() = holdingWakelockPredicate;
+    auto durationMetric = config.add_duration_metric();
+    durationMetric->set_id(StringToId("WakelockDuration"));
+    durationMetric->set_what(holdingWakelockPredicate.id());
+    durationMetric->set_aggregation_type(DurationMetric::SUM);
+    *durationMetric->mutable_dimensions_in_what() =
+            CreateAttributionUidDimensions(util::WAKELOCK_STATE_CHANGED, {Position::FIRST});
+    durationMetric->set_bucket(FIVE_MINUTES);
+    config.set_ttl_in_seconds(2 * 3600);
+    int64_t bucketStartTimeNs = 10000000000;
+    int64_t ttlNs = config.ttl_in_seconds() * NS_PER_SEC;
+
+    ConfigKey cfgKey;
+    auto processor = CreateStatsLogProcessor(bucketStartTimeNs, bucketStartTimeNs, config, cfgKey);
+    ASSERT_EQ(processor->mMetricsManagers.size(), 1u);
+    sp<MetricsManager> metricsManager = processor->mMetricsManagers.begin()->second;
+
+    std::vector<int> attributionUids1 = {111};
+    std::vector<string> attributionTags1 = {"App1"};
+    const int64_t acquireTimeNs = bucketStartTimeNs + 2;
+    auto event = CreateAcquireWakelockEvent(acquireTimeNs, attributionUids1, attributionTags1,
+                                            "wl1");
+    processor->OnLogEvent(event.get());
+
+    // The wakelock is still held when the ttl expires and the metrics are reset in place.
+    const int64_t resetTimeNs = bucketStartTimeNs + ttlNs + 2;
+    event = CreateScreenStateChangedEvent(resetTimeNs, android::view::DISPLAY_STATE_ON);
+    processor->OnLogEvent(event.get());
+    EXPECT_EQ(metricsManager, processor->mMetricsManagers.begin()->second);
+
+    const int64_t releaseTimeNs = resetTimeNs + NS_PER_SEC;
+    event = CreateReleaseWakelockEvent(releaseTimeNs, attributionUids1, attributionTags1, "wl1");
+    processor->OnLogEvent(event.get());
+
+    const int64_t dumpTimeNs = releaseTimeNs + NS_PER_SEC;
+    ConfigMetricsReportList reports;
+    vector<uint8_t> buffer;
+    processor->onDumpReport(cfgKey, dumpTimeNs, true, true, ADB_DUMP, FAST, &buffer);
+    ASSERT_TRUE(reports.ParseFromArray(&buffer[0], buffer.size()));
+    backfillDimensionPath(&reports);
+    backfillStringInReport(&reports);
+    backfillStartEndTimestamp(&reports);
+    ASSERT_EQ(reports.reports_size(), 2);
+
+    // The report written at the reset has the duration until then.
+    ConfigMetricsReport report = reports.reports(0);
+    EXPECT_EQ(report.dump_report_reason(), CONFIG_RESET);
+    EXPECT_EQ(report.current_report_elapsed_nanos(), resetTimeNs);
+    ASSERT_EQ(report.metrics_size(), 1);
+    ASSERT_EQ(report.metrics(0).duration_metrics().data_size(), 1);
+    DurationMetricData data = report.metrics(0).duration_metrics().data(0);
+    ValidateAttributionUidDimension(data.dimensions_in_what(), util::WAKELOCK_STATE_CHANGED, 111);
+    int64_t totalDurationNs = 0;
+    for (const DurationBucketInfo& bucket : data.bucket_info()) {
+        totalDurationNs += bucket.duration_nanos();
+    }
+    EXPECT_EQ(totalDurationNs, resetTimeNs - acquireTimeNs);
+
+    // The duration started before the reset goes on in the bucket restarted then.
+    report = reports.reports(1);
+    ASSERT_EQ(report.metrics_size(), 1);
+    ASSERT_EQ(report.metrics(0).duration_metrics().data_size(), 1);
+    data = report.metrics(0).duration_metrics().data(0);
+    ValidateAttributionUidDimension(data.dimensions_in_what(), util::WAKELOCK_STATE_CHANGED, 111);
+    ASSERT_EQ(data.bucket_info_size(), 1);
+    ValidateDurationBucket(data.bucket_info(0), MillisToNano(NanoToMillis(resetTimeNs)),
+                           MillisToNano(NanoToMillis(dumpTimeNs)), releaseTimeNs - resetTimeNs);
+}
+
 #else
 GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
@@ -17,6 +17,7 @@
 #include <vector>
 
 #include "src/StatsLogProcessor.h"
+#include "src/metrics/DurationMetricProducer.h"
 #include "src/state/StateTracker.h"
 #include "src/stats_log_util.h"
 #include "tests/statsd_test_util.h"
@@ -816,6 +817,11 @@ TEST(DurationMetricE2eTest, TestWithSlicedState) {
         processor->OnLogEvent(event.get());
     }
 
+    // The durations of all the screen states are held by the tracker of the one dimension in what.
+    DurationMetricProducer* durationProducer =
+            static_cast<DurationMetricProducer*>(metricProducer.get());
+    EXPECT_EQ(1UL, durationProducer->mCurrentSlicedDurationTrackerMap.size());
+
     // Check dump report.
     vector<uint8_t> buffer;
     ConfigMetricsReportList reports;
@@ -171,6 +171,38 @@ TEST_F(RestrictedEventMetricE2eTest, TestQueryThreeEvents) {
                 ElementsAre(SQLITE_INTEGER, SQLITE_INTEGER, SQLITE_INTEGER, SQLITE_INTEGER));
 }
 
+TEST_F(RestrictedEventMetricE2eTest, TestQueryOnWorkerThreads) {
+    processor->setQueryThreads(/*numThreads=*/2);
+    dbutils::setPersistentDbConnections(true);
+    std::vector<std::unique_ptr<LogEvent>> events;
+    events.push_back(CreateRestrictedLogEvent(atomTag, configAddedTimeNs + 100));
+    events.push_back(CreateRestrictedLogEvent(atomTag, configAddedTimeNs + 200));
+
+    std::stringstream query;
+    query << "SELECT * FROM metric_" << dbutils::reformatMetricId(restrictedMetricId);
+    // The second query reuses the connection of the first one and sees the event logged after it.
+    for (auto& event : events) {
+        processor->OnLogEvent(event.get());
+        processor->querySql(query.str(), /*minSqlClientVersion=*/0,
+                            /*policyConfig=*/{}, mockStatsQueryCallback,
+                            /*configKey=*/configId, /*configPackage=*/config_package_name,
+                            /*callingUid=*/delegate_uid);
+        processor->mQueryWorkerPool->waitForIdle();
+    }
+    dbutils::setPersistentDbConnections(false);
+
+    EXPECT_EQ(rowCountResult, 2);
+    EXPECT_THAT(queryDataResult, ElementsAre(to_string(atomTag), to_string(configAddedTimeNs + 100),
+                                             _,  // wallClockNs
+                                             _,  // field_1
+                                             to_string(atomTag), to_string(configAddedTimeNs + 200),
+                                             _,  // wallClockNs
+                                             _   // field_1
+                                             ));
+    EXPECT_THAT(columnNamesResult,
+                ElementsAre("atomId", "elapsedTimestampNs", "wallTimestampNs", "field_1"));
+}
+
 TEST_F(RestrictedEventMetricE2eTest, TestInvalidSchemaIncreasingFieldCount) {
     std::vector<std::unique_ptr<LogEvent>> events;
 
@@ -0,0 +1,127 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/external/NativePuller.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "src/external/CpuTimePerUidPuller.h"
+#include "src/external/StatsPullerManager.h"
+#include "src/external/SysfsValuePuller.h"
+#include "statslog_statsd.h"
+#include "tests/statsd_test_util.h"
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using android::base::WriteStringToFile;
+using std::shared_ptr;
+using std::vector;
+
+TEST(NativePullerTest, CpuTimePerUid) {
+    TemporaryFile file;
+    ASSERT_TRUE(WriteStringToFile("1000: 123 45\n10001: 6789 0\n", file.path));
+    sp<CpuTimePerUidPuller> puller = new CpuTimePerUidPuller(file.path);
+
+    vector<shared_ptr<LogEvent>> data;
+    EXPECT_EQ(PULL_SUCCESS, puller->Pull(getElapsedRealtimeNs(), &data));
+    ASSERT_EQ(2, data.size());
+    EXPECT_EQ(util::CPU_TIME_PER_UID, data[0]->GetTagId());
+    EXPECT_EQ(1, data[0]->getNumUidFields());
+    ASSERT_EQ(3, data[0]->size());
+    EXPECT_EQ(1000, data[0]->getValues()[0].mValue.int_value);
+    EXPECT_EQ(123, data[0]->getValues()[1].mValue.long_value);
+    EXPECT_EQ(45, data[0]->getValues()[2].mValue.long_value);
+    ASSERT_EQ(3, data[1]->size());
+    EXPECT_EQ(10001, data[1]->getValues()[0].mValue.int_value);
+    EXPECT_EQ(6789, data[1]->getValues()[1].mValue.long_value);
+    EXPECT_EQ(0, data[1]->getValues()[2].mValue.long_value);
+}
+
+TEST(NativePullerTest, SysfsValue) {
+    TemporaryFile file;
+    ASSERT_TRUE(WriteStringToFile("4012345\n", file.path));
+    sp<SysfsValuePuller> puller =
+            new SysfsValuePuller(util::BATTERY_VOLTAGE, file.path, /*divisor=*/1000);
+
+    vector<shared_ptr<LogEvent>> data;
+    EXPECT_EQ(PULL_SUCCESS, puller->Pull(getElapsedRealtimeNs(), &data));
+    ASSERT_EQ(1, data.size());
+    EXPECT_EQ(util::BATTERY_VOLTAGE, data[0]->GetTagId());
+    ASSERT_EQ(1, data[0]->size());
+    EXPECT_EQ(INT, data[0]->getValues()[0].mValue.getType());
+    EXPECT_EQ(4012, data[0]->getValues()[0].mValue.int_value);
+}
+
+TEST(NativePullerTest, SysfsValueInt64) {
+    TemporaryFile file;
+    ASSERT_TRUE(WriteStringToFile("3000000", file.path));
+    sp<SysfsValuePuller> puller =
+            new SysfsValuePuller(util::SYSTEM_ION_HEAP_SIZE, file.path, /*divisor=*/1,
+                                 /*multiplier=*/1024, /*int64Value=*/true);
+
+    vector<shared_ptr<LogEvent>> data;
+    EXPECT_EQ(PULL_SUCCESS, puller->Pull(getElapsedRealtimeNs(), &data));
+    ASSERT_EQ(1, data.size());
+    ASSERT_EQ(1, data[0]->size());
+    EXPECT_EQ(LONG, data[0]->getValues()[0].mValue.getType());
+    EXPECT_EQ(3072000000LL, data[0]->getValues()[0].mValue.long_value);
+}
+
+TEST(NativePullerTest, SysfsValueInvalid) {
+    TemporaryFile file;
+    ASSERT_TRUE(WriteStringToFile("unknown\n", file.path));
+    sp<SysfsValuePuller> puller = new SysfsValuePuller(util::BATTERY_LEVEL, file.path);
+
+    vector<shared_ptr<LogEvent>> data;
+    EXPECT_EQ(PULL_FAIL, puller->Pull(getElapsedRealtimeNs(), &data));
+    EXPECT_EQ(0, data.size());
+
+    sp<SysfsValuePuller> missingPuller =
+            new SysfsValuePuller(util::BATTERY_LEVEL, "/nonexistent/capacity");
+    EXPECT_EQ(PULL_FAIL, missingPuller->Pull(getElapsedRealtimeNs(), &data));
+}
+
+TEST(NativePullerTest, NativePullersReplaceRegisteredPullers) {
+    sp<StatsPullerManager> pullerManager = new StatsPullerManager();
+    pullerManager->setNativePullers(true);
+    const PullerKey key = {.uid = AID_SYSTEM, .atomTag = util::BATTERY_LEVEL};
+    ASSERT_NE(pullerManager->kAllPullAtomInfo.end(), pullerManager->kAllPullAtomInfo.find(key));
+    const sp<StatsPuller> nativePuller = pullerManager->kAllPullAtomInfo[key];
+
+    // The callbacks registered for the atoms of the native pullers are ignored.
+    shared_ptr<IPullAtomCallback> callback =
+            ndk::SharedRefBase::make<FakeSubsystemSleepCallback>();
+    pullerManager->RegisterPullAtomCallback(AID_SYSTEM, util::BATTERY_LEVEL, NS_PER_SEC,
+                                            NS_PER_SEC, {}, callback);
+    EXPECT_EQ(nativePuller, pullerManager->kAllPullAtomInfo[key]);
+    pullerManager->UnregisterPullAtomCallback(AID_SYSTEM, util::BATTERY_LEVEL);
+    EXPECT_EQ(nativePuller, pullerManager->kAllPullAtomInfo[key]);
+
+    pullerManager->setNativePullers(false);
+    EXPECT_EQ(pullerManager->kAllPullAtomInfo.end(), pullerManager->kAllPullAtomInfo.find(key));
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
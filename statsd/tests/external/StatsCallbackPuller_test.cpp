@@ -20,13 +20,17 @@
 #include <android/binder_interface_utils.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <chrono>
 #include <thread>
 #include <vector>
 
 #include "../metrics/metrics_test_helper.h"
+#include "src/external/PullResultReceiver.h"
 #include "src/stats_log_util.h"
 #include "stats_event.h"
 #include "tests/statsd_test_util.h"
@@ -42,6 +46,7 @@ using Status = ::ndk::ScopedAStatus;
 using aidl::android::os::BnPullAtomCallback;
 using aidl::android::os::IPullAtomResultReceiver;
 using aidl::android::util::StatsEventParcel;
+using ::ndk::ScopedFileDescriptor;
 using ::ndk::SharedRefBase;
 using std::make_shared;
 using std::shared_ptr;
@@ -56,6 +61,9 @@ vector<int64_t> values;
 int64_t pullDelayNs;
 int64_t pullTimeoutNs;
 int64_t pullCoolDownNs;
+bool pullSharedMemory;
+bool sealSharedMemory;
+bool truncateSharedMemory;
 std::thread pullThread;
 
 AStatsEvent* createSimpleEvent(int64_t value) {
@@ -66,7 +74,38 @@ AStatsEvent* createSimpleEvent(int64_t value) {
     return event;
 }
 
+// Sends the events the way libstatspull does for large pulls.
+void executeSharedMemoryPull(const shared_ptr<IPullAtomResultReceiver>& resultReceiver) {
+    vector<uint8_t> blob;
+    for (int i = 0; i < values.size(); i++) {
+        AStatsEvent* event = createSimpleEvent(values[i]);
+        size_t size;
+        uint8_t* buffer = AStatsEvent_getBuffer(event, &size);
+        const uint32_t eventSize = size;
+        blob.insert(blob.end(), (uint8_t*)&eventSize, (uint8_t*)&eventSize + sizeof(eventSize));
+        blob.insert(blob.end(), buffer, buffer + size);
+        AStatsEvent_release(event);
+    }
+    if (truncateSharedMemory) {
+        blob.pop_back();
+    }
+
+    ScopedFileDescriptor fd(memfd_create("pull", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    ASSERT_EQ((ssize_t)blob.size(), write(fd.get(), blob.data(), blob.size()));
+    if (sealSharedMemory) {
+        ASSERT_EQ(0, fcntl(fd.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE));
+    }
+
+    sleep_for(std::chrono::nanoseconds(pullDelayNs));
+    resultReceiver->pullFinishedShared(pullTagId, pullSuccess, fd, blob.size());
+}
+
 void executePull(const shared_ptr<IPullAtomResultReceiver>& resultReceiver) {
+    if (pullSharedMemory) {
+        executeSharedMemoryPull(resultReceiver);
+        return;
+    }
+
     // Convert stats_events into StatsEventParcels.
     vector<StatsEventParcel> parcels;
     for (int i = 0; i < values.size(); i++) {
@@ -107,6 +146,9 @@ public:
         values.clear();
         pullTimeoutNs = 10000000000LL;  // 10 seconds.
         pullCoolDownNs = 1000000000;    // 1 second.
+        pullSharedMemory = false;
+        sealSharedMemory = true;
+        truncateSharedMemory = false;
     }
 
     void TearDown() override {
@@ -139,6 +181,21 @@ TEST_F(StatsCallbackPullerTest, PullSuccess) {
     EXPECT_EQ(value, dataHolder[0]->getValues()[0].mValue.int_value);
 }
 
+TEST_F(StatsCallbackPullerTest, PullSuccessWithPullResultPriority) {
+    shared_ptr<FakePullAtomCallback> cb = SharedRefBase::make<FakePullAtomCallback>();
+    pullSuccess = true;
+    values.push_back(43);
+    StatsCallbackPuller::SetPullResultPriority(true);
+
+    StatsCallbackPuller puller(pullTagId, cb, pullCoolDownNs, pullTimeoutNs, {});
+
+    vector<std::shared_ptr<LogEvent>> dataHolder;
+    EXPECT_EQ(puller.PullInternal(&dataHolder), PULL_SUCCESS);
+    StatsCallbackPuller::SetPullResultPriority(false);
+    ASSERT_EQ(1, dataHolder.size());
+    EXPECT_EQ(43, dataHolder[0]->getValues()[0].mValue.int_value);
+}
+
 TEST_F(StatsCallbackPullerTest, PullFail) {
     shared_ptr<FakePullAtomCallback> cb = SharedRefBase::make<FakePullAtomCallback>();
     pullSuccess = false;
@@ -152,6 +209,72 @@ TEST_F(StatsCallbackPullerTest, PullFail) {
     ASSERT_EQ(0, dataHolder.size());
 }
 
+TEST_F(StatsCallbackPullerTest, PullSuccessSharedMemory) {
+    shared_ptr<FakePullAtomCallback> cb = SharedRefBase::make<FakePullAtomCallback>();
+    pullSuccess = true;
+    pullSharedMemory = true;
+    values = {43, 44, 45};
+
+    StatsCallbackPuller puller(pullTagId, cb, pullCoolDownNs, pullTimeoutNs, {});
+
+    vector<std::shared_ptr<LogEvent>> dataHolder;
+    EXPECT_EQ(puller.PullInternal(&dataHolder), PULL_SUCCESS);
+
+    ASSERT_EQ(3, dataHolder.size());
+    for (int i = 0; i < values.size(); i++) {
+        EXPECT_EQ(pullTagId, dataHolder[i]->GetTagId());
+        ASSERT_EQ(1, dataHolder[i]->size());
+        EXPECT_EQ(values[i], dataHolder[i]->getValues()[0].mValue.int_value);
+    }
+}
+
+TEST_F(StatsCallbackPullerTest, PullSuccessMultipleChunks) {
+    shared_ptr<FakePullAtomCallback> cb = SharedRefBase::make<FakePullAtomCallback>();
+    pullSuccess = true;
+    for (int i = 0; i < 2 * PullResultReceiver::kPulledEventsChunkSize + 1; i++) {
+        values.push_back(i);
+    }
+
+    StatsCallbackPuller puller(pullTagId, cb, pullCoolDownNs, pullTimeoutNs, {});
+
+    vector<std::shared_ptr<LogEvent>> dataHolder;
+    EXPECT_EQ(puller.PullInternal(&dataHolder), PULL_SUCCESS);
+
+    ASSERT_EQ(values.size(), dataHolder.size());
+    for (int i = 0; i < values.size(); i++) {
+        ASSERT_EQ(1, dataHolder[i]->size());
+        EXPECT_EQ(values[i], dataHolder[i]->getValues()[0].mValue.int_value);
+    }
+}
+
+TEST_F(StatsCallbackPullerTest, PullSharedMemoryNotSealed) {
+    shared_ptr<FakePullAtomCallback> cb = SharedRefBase::make<FakePullAtomCallback>();
+    pullSuccess = true;
+    pullSharedMemory = true;
+    sealSharedMemory = false;
+    values.push_back(43);
+
+    StatsCallbackPuller puller(pullTagId, cb, pullCoolDownNs, pullTimeoutNs, {});
+
+    vector<shared_ptr<LogEvent>> dataHolder;
+    EXPECT_EQ(puller.PullInternal(&dataHolder), PULL_FAIL);
+    ASSERT_EQ(0, dataHolder.size());
+}
+
+TEST_F(StatsCallbackPullerTest, PullSharedMemoryMalformed) {
+    shared_ptr<FakePullAtomCallback> cb = SharedRefBase::make<FakePullAtomCallback>();
+    pullSuccess = true;
+    pullSharedMemory = true;
+    truncateSharedMemory = true;
+    values = {43, 44};
+
+    StatsCallbackPuller puller(pullTagId, cb, pullCoolDownNs, pullTimeoutNs, {});
+
+    vector<shared_ptr<LogEvent>> dataHolder;
+    EXPECT_EQ(puller.PullInternal(&dataHolder), PULL_FAIL);
+    ASSERT_EQ(0, dataHolder.size());
+}
+
 TEST_F(StatsCallbackPullerTest, PullTimeout) {
     shared_ptr<FakePullAtomCallback> cb = SharedRefBase::make<FakePullAtomCallback>();
     pullSuccess = true;
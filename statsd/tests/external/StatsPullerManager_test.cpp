@@ -19,6 +19,8 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <thread>
+
 #include "stats_event.h"
 #include "tests/statsd_test_util.h"
 
@@ -54,9 +56,11 @@ AStatsEvent* createSimpleEvent(int32_t atomId, int32_t value) {
 
 class FakePullAtomCallback : public BnPullAtomCallback {
 public:
-    FakePullAtomCallback(int32_t uid) : mUid(uid){};
+    FakePullAtomCallback(int32_t uid, int64_t pullDelayNs = 0)
+        : mUid(uid), mPullDelayNs(pullDelayNs){};
     Status onPullAtom(int atomTag,
                       const shared_ptr<IPullAtomResultReceiver>& resultReceiver) override {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(mPullDelayNs));
         vector<StatsEventParcel> parcels;
         AStatsEvent* event = createSimpleEvent(atomTag, mUid);
         size_t size;
@@ -72,6 +76,7 @@ public:
         return Status::ok();
     }
     int32_t mUid;
+    int64_t mPullDelayNs;
 };
 
 class FakePullUidProvider : public PullUidProvider {
@@ -86,6 +91,27 @@ public:
     }
 };
 
+class FakePullDataReceiver : public PullDataReceiver {
+public:
+    void onDataPulled(const vector<shared_ptr<LogEvent>>& data, PullResult pullResult,
+                      int64_t originalPullTimeNs) override {
+        mData = data;
+        mPullResult = pullResult;
+        mOriginalPullTimeNs = originalPullTimeNs;
+        mThreadId = std::this_thread::get_id();
+    }
+
+    bool isPullNeeded() const override {
+        return mPullNeeded;
+    }
+
+    bool mPullNeeded = true;
+    vector<shared_ptr<LogEvent>> mData;
+    PullResult mPullResult = PullResult::PULL_NOT_NEEDED;
+    int64_t mOriginalPullTimeNs = 0;
+    std::thread::id mThreadId;
+};
+
 sp<StatsPullerManager> createPullerManagerAndRegister() {
     sp<StatsPullerManager> pullerManager = new StatsPullerManager();
     shared_ptr<FakePullAtomCallback> cb1 = SharedRefBase::make<FakePullAtomCallback>(uid1);
@@ -145,6 +171,254 @@ TEST(StatsPullerManagerTest, TestPullConfigKeyNoPullerWithUid) {
     EXPECT_FALSE(pullerManager->Pull(pullTagId2, configKey, /*timestamp =*/1, &data));
 }
 
+TEST(StatsPullerManagerTest, TestPullDataProcessingThreads) {
+    sp<StatsPullerManager> pullerManager = createPullerManagerAndRegister();
+    pullerManager->setPullDataProcessingThreads(2);
+    sp<FakePullUidProvider> uidProvider = new FakePullUidProvider();
+    ConfigKey otherConfigKey(51, 12345);
+    pullerManager->RegisterPullUidProvider(configKey, uidProvider);
+    pullerManager->RegisterPullUidProvider(otherConfigKey, uidProvider);
+
+    const int64_t intervalNs = 60 * NS_PER_SEC;
+    sp<FakePullDataReceiver> receiver1 = new FakePullDataReceiver();
+    sp<FakePullDataReceiver> receiver2 = new FakePullDataReceiver();
+    sp<FakePullDataReceiver> otherReceiver = new FakePullDataReceiver();
+    pullerManager->RegisterReceiver(pullTagId1, configKey, receiver1, /*nextPullTimeNs=*/1,
+                                    intervalNs);
+    pullerManager->RegisterReceiver(pullTagId1, configKey, receiver2, /*nextPullTimeNs=*/1,
+                                    intervalNs);
+    pullerManager->RegisterReceiver(pullTagId1, otherConfigKey, otherReceiver,
+                                    /*nextPullTimeNs=*/1, intervalNs);
+
+    pullerManager->OnAlarmFired(/*elapsedTimeNs=*/10);
+
+    for (const sp<FakePullDataReceiver>& receiver : {receiver1, receiver2, otherReceiver}) {
+        EXPECT_EQ(PullResult::PULL_RESULT_SUCCESS, receiver->mPullResult);
+        ASSERT_EQ(1, receiver->mData.size());
+        EXPECT_EQ(10, receiver->mData[0]->GetElapsedTimestampNs());
+        EXPECT_NE(std::this_thread::get_id(), receiver->mThreadId);
+    }
+    // The receivers of a config are called on the same thread.
+    EXPECT_EQ(receiver1->mThreadId, receiver2->mThreadId);
+    EXPECT_EQ(1 + intervalNs, pullerManager->mNextPullTimeNs);
+}
+
+TEST(StatsPullerManagerTest, TestConcurrentPullThreads) {
+    sp<StatsPullerManager> pullerManager = createPullerManagerAndRegister();
+    pullerManager->setConcurrentPullThreads(2);
+    sp<FakePullUidProvider> uidProvider = new FakePullUidProvider();
+    ConfigKey otherConfigKey(51, 12345);
+    pullerManager->RegisterPullUidProvider(configKey, uidProvider);
+    pullerManager->RegisterPullUidProvider(otherConfigKey, uidProvider);
+
+    const int64_t intervalNs = 60 * NS_PER_SEC;
+    sp<FakePullDataReceiver> receiver = new FakePullDataReceiver();
+    sp<FakePullDataReceiver> otherReceiver = new FakePullDataReceiver();
+    // pullTagId2 has no puller for the uid of the provider.
+    sp<FakePullDataReceiver> failedReceiver = new FakePullDataReceiver();
+    pullerManager->RegisterReceiver(pullTagId1, configKey, receiver, /*nextPullTimeNs=*/1,
+                                    intervalNs);
+    pullerManager->RegisterReceiver(pullTagId1, otherConfigKey, otherReceiver,
+                                    /*nextPullTimeNs=*/1, intervalNs);
+    pullerManager->RegisterReceiver(pullTagId2, configKey, failedReceiver, /*nextPullTimeNs=*/1,
+                                    intervalNs);
+
+    pullerManager->OnAlarmFired(/*elapsedTimeNs=*/10);
+
+    for (const sp<FakePullDataReceiver>& pulledReceiver : {receiver, otherReceiver}) {
+        EXPECT_EQ(PullResult::PULL_RESULT_SUCCESS, pulledReceiver->mPullResult);
+        ASSERT_EQ(1, pulledReceiver->mData.size());
+        EXPECT_EQ(10, pulledReceiver->mData[0]->GetElapsedTimestampNs());
+        EXPECT_EQ(uid2, pulledReceiver->mData[0]->getValues()[0].mValue.int_value);
+        // Without receiver worker threads, the receivers are called on the alarm thread.
+        EXPECT_EQ(std::this_thread::get_id(), pulledReceiver->mThreadId);
+    }
+    // The configs resolve to the same puller, whose events are shared.
+    EXPECT_EQ(receiver->mData[0], otherReceiver->mData[0]);
+    EXPECT_EQ(PullResult::PULL_RESULT_FAIL, failedReceiver->mPullResult);
+    EXPECT_TRUE(failedReceiver->mData.empty());
+    EXPECT_EQ(1 + intervalNs, pullerManager->mNextPullTimeNs);
+
+    // With receiver worker threads, the receivers are notified on them.
+    pullerManager->setPullDataProcessingThreads(2);
+    pullerManager->OnAlarmFired(/*elapsedTimeNs=*/intervalNs + 10);
+    EXPECT_EQ(PullResult::PULL_RESULT_SUCCESS, receiver->mPullResult);
+    ASSERT_EQ(1, receiver->mData.size());
+    EXPECT_EQ(intervalNs + 10, receiver->mData[0]->GetElapsedTimestampNs());
+    EXPECT_NE(std::this_thread::get_id(), receiver->mThreadId);
+    EXPECT_EQ(1 + 2 * intervalNs, pullerManager->mNextPullTimeNs);
+}
+
+TEST(StatsPullerManagerTest, TestPrefetchPulls) {
+    sp<StatsPullerManager> pullerManager = new StatsPullerManager();
+    shared_ptr<FakePullAtomCallback> cb = SharedRefBase::make<FakePullAtomCallback>(uid2);
+    pullerManager->RegisterPullAtomCallback(uid2, pullTagId1, coolDownNs, timeoutNs, {}, cb);
+    pullerManager->RegisterPullAtomCallback(uid2, pullTagId2, coolDownNs, timeoutNs, {}, cb);
+    sp<FakePullUidProvider> uidProvider = new FakePullUidProvider();
+    pullerManager->RegisterPullUidProvider(configKey, uidProvider);
+    StatsdStats::PulledAtomStats& stats1 = StatsdStats::getInstance().mPulledAtomStats[pullTagId1];
+    StatsdStats::PulledAtomStats& stats2 = StatsdStats::getInstance().mPulledAtomStats[pullTagId2];
+
+    // Without concurrent pulls, the atoms are left to Pull().
+    long totalPull1 = stats1.totalPull;
+    pullerManager->prefetchPulls({pullTagId1, pullTagId2}, configKey, /*eventTimeNs=*/10);
+    EXPECT_EQ(totalPull1, stats1.totalPull);
+
+    pullerManager->setConcurrentPullThreads(2);
+    totalPull1 = stats1.totalPull;
+    const long totalPull2 = stats2.totalPull;
+    pullerManager->prefetchPulls({pullTagId1, pullTagId2}, configKey, /*eventTimeNs=*/20);
+    EXPECT_EQ(totalPull1 + 1, stats1.totalPull);
+    EXPECT_EQ(totalPull2 + 1, stats2.totalPull);
+
+    // The pulls of the same event are served from the caches.
+    const long totalPullFromCache1 = stats1.totalPullFromCache;
+    const long totalPullFromCache2 = stats2.totalPullFromCache;
+    for (const int tagId : {pullTagId1, pullTagId2}) {
+        vector<shared_ptr<LogEvent>> data;
+        EXPECT_TRUE(pullerManager->Pull(tagId, configKey, /*eventTimeNs=*/20, &data));
+        ASSERT_EQ(1, data.size());
+        EXPECT_EQ(uid2, data[0]->getValues()[0].mValue.int_value);
+    }
+    EXPECT_EQ(totalPullFromCache1 + 1, stats1.totalPullFromCache);
+    EXPECT_EQ(totalPullFromCache2 + 1, stats2.totalPullFromCache);
+}
+
+TEST(StatsPullerManagerTest, TestPullersSharedByConfigs) {
+    sp<StatsPullerManager> pullerManager = createPullerManagerAndRegister();
+    sp<FakePullUidProvider> uidProvider = new FakePullUidProvider();
+    ConfigKey otherConfigKey(51, 12345);
+    pullerManager->RegisterPullUidProvider(configKey, uidProvider);
+    pullerManager->RegisterPullUidProvider(otherConfigKey, uidProvider);
+
+    const int64_t intervalNs = 60 * NS_PER_SEC;
+    sp<FakePullDataReceiver> receiver = new FakePullDataReceiver();
+    sp<FakePullDataReceiver> otherReceiver = new FakePullDataReceiver();
+    pullerManager->RegisterReceiver(pullTagId1, configKey, receiver, /*nextPullTimeNs=*/1,
+                                    intervalNs);
+    pullerManager->RegisterReceiver(pullTagId1, otherConfigKey, otherReceiver,
+                                    /*nextPullTimeNs=*/1, intervalNs);
+    const long totalPull = StatsdStats::getInstance().mPulledAtomStats[pullTagId1].totalPull;
+
+    pullerManager->OnAlarmFired(/*elapsedTimeNs=*/10);
+
+    // Both configs resolve to the puller of uid2, which is pulled once for both.
+    EXPECT_EQ(totalPull + 1, StatsdStats::getInstance().mPulledAtomStats[pullTagId1].totalPull);
+    for (const sp<FakePullDataReceiver>& r : {receiver, otherReceiver}) {
+        EXPECT_EQ(PullResult::PULL_RESULT_SUCCESS, r->mPullResult);
+        ASSERT_EQ(1, r->mData.size());
+        EXPECT_EQ(uid2, r->mData[0]->getValues()[0].mValue.int_value);
+    }
+    EXPECT_EQ(receiver->mData[0], otherReceiver->mData[0]);
+}
+
+TEST(StatsPullerManagerTest, TestEarlyScheduledPulls) {
+    const int64_t pullDelayNs = 10 * 1000000LL;
+    const int64_t bucketSizeNs = 60 * NS_PER_SEC;
+    const int64_t bucketEndNs = 2 * bucketSizeNs;
+    sp<StatsPullerManager> pullerManager = new StatsPullerManager();
+    shared_ptr<FakePullAtomCallback> cb =
+            SharedRefBase::make<FakePullAtomCallback>(uid2, pullDelayNs);
+    pullerManager->RegisterPullAtomCallback(uid2, pullTagId1, coolDownNs, timeoutNs, {}, cb);
+    sp<FakePullUidProvider> uidProvider = new FakePullUidProvider();
+    pullerManager->RegisterPullUidProvider(configKey, uidProvider);
+    pullerManager->setEarlyScheduledPulls(true);
+
+    vector<shared_ptr<LogEvent>> data;
+    EXPECT_TRUE(pullerManager->Pull(pullTagId1, configKey, /*timestamp =*/1, &data));
+
+    sp<FakePullDataReceiver> receiver = new FakePullDataReceiver();
+    pullerManager->RegisterReceiver(pullTagId1, configKey, receiver, bucketEndNs, bucketSizeNs);
+    const auto& receiverInfo = pullerManager->mReceivers.begin()->second.front();
+    EXPECT_EQ(bucketEndNs, pullerManager->mNextPullTimeNs);
+
+    // The lead is learned when the receiver is first pulled.
+    pullerManager->OnAlarmFired(bucketEndNs);
+    EXPECT_EQ(PullResult::PULL_RESULT_SUCCESS, receiver->mPullResult);
+    EXPECT_EQ(bucketEndNs, receiver->mOriginalPullTimeNs);
+    EXPECT_EQ(bucketEndNs + bucketSizeNs, receiverInfo.nextPullTimeNs);
+    EXPECT_GE(receiverInfo.pullLeadNs, pullDelayNs);
+    EXPECT_LE(receiverInfo.pullLeadNs, 5 * NS_PER_SEC);
+    EXPECT_EQ(receiverInfo.nextPullTimeNs - receiverInfo.pullLeadNs,
+              pullerManager->mNextPullTimeNs);
+
+    // The next pull is done ahead of the bucket boundary and attributed to it.
+    receiver->mPullResult = PullResult::PULL_NOT_NEEDED;
+    pullerManager->OnAlarmFired(pullerManager->mNextPullTimeNs);
+    EXPECT_EQ(PullResult::PULL_RESULT_SUCCESS, receiver->mPullResult);
+    EXPECT_EQ(bucketEndNs + bucketSizeNs, receiver->mOriginalPullTimeNs);
+    ASSERT_EQ(1, receiver->mData.size());
+    EXPECT_EQ(bucketEndNs + bucketSizeNs, receiver->mData[0]->GetElapsedTimestampNs());
+    EXPECT_EQ(bucketEndNs + 2 * bucketSizeNs, receiverInfo.nextPullTimeNs);
+}
+
+TEST(StatsPullerManagerTest, TestPullNotNeeded) {
+    const int64_t bucketSizeNs = 60 * NS_PER_SEC;
+    sp<StatsPullerManager> pullerManager = createPullerManagerAndRegister();
+    sp<FakePullUidProvider> uidProvider = new FakePullUidProvider();
+    pullerManager->RegisterPullUidProvider(configKey, uidProvider);
+    sp<FakePullDataReceiver> receiver = new FakePullDataReceiver();
+    receiver->mPullNeeded = false;
+    pullerManager->RegisterReceiver(pullTagId1, configKey, receiver, bucketSizeNs, bucketSizeNs);
+
+    StatsdStats::PulledAtomStats& stats = StatsdStats::getInstance().mPulledAtomStats[pullTagId1];
+    const long totalPull = stats.totalPull;
+    const long pullNotNeeded = stats.pullNotNeeded;
+
+    // The receiver is told about the skipped bucket without pulling.
+    receiver->mPullResult = PullResult::PULL_RESULT_SUCCESS;
+    pullerManager->OnAlarmFired(bucketSizeNs);
+    EXPECT_EQ(PullResult::PULL_NOT_NEEDED, receiver->mPullResult);
+    EXPECT_EQ(bucketSizeNs, receiver->mOriginalPullTimeNs);
+    EXPECT_EQ(totalPull, stats.totalPull);
+    EXPECT_EQ(pullNotNeeded + 1, stats.pullNotNeeded);
+    EXPECT_EQ(2 * bucketSizeNs, pullerManager->mNextPullTimeNs);
+
+    receiver->mPullNeeded = true;
+    pullerManager->OnAlarmFired(2 * bucketSizeNs);
+    EXPECT_EQ(PullResult::PULL_RESULT_SUCCESS, receiver->mPullResult);
+    EXPECT_EQ(totalPull + 1, stats.totalPull);
+    EXPECT_EQ(pullNotNeeded + 1, stats.pullNotNeeded);
+}
+
+TEST(StatsPullerManagerTest, TestPullAlarmGrid) {
+    const int64_t gridNs = 10 * NS_PER_SEC;
+    sp<StatsPullerManager> pullerManager = createPullerManagerAndRegister();
+    sp<FakePullUidProvider> uidProvider = new FakePullUidProvider();
+    pullerManager->RegisterPullUidProvider(configKey, uidProvider);
+    pullerManager->RegisterPullUidProvider(badConfigKey, uidProvider);
+    pullerManager->setPullAlarmGrid(gridNs);
+
+    // Receivers of configs with different bucket sizes and phases.
+    sp<FakePullDataReceiver> receiver1 = new FakePullDataReceiver();
+    pullerManager->RegisterReceiver(pullTagId1, configKey, receiver1, 62 * NS_PER_SEC,
+                                    60 * NS_PER_SEC);
+    sp<FakePullDataReceiver> receiver2 = new FakePullDataReceiver();
+    pullerManager->RegisterReceiver(pullTagId1, badConfigKey, receiver2, 67 * NS_PER_SEC,
+                                    300 * NS_PER_SEC);
+    EXPECT_EQ(70 * NS_PER_SEC, pullerManager->mNextPullTimeNs);
+
+    // Both are pulled on the same alarm.
+    pullerManager->OnAlarmFired(70 * NS_PER_SEC);
+    EXPECT_EQ(PullResult::PULL_RESULT_SUCCESS, receiver1->mPullResult);
+    EXPECT_EQ(70 * NS_PER_SEC, receiver1->mOriginalPullTimeNs);
+    EXPECT_EQ(PullResult::PULL_RESULT_SUCCESS, receiver2->mPullResult);
+    EXPECT_EQ(70 * NS_PER_SEC, receiver2->mOriginalPullTimeNs);
+    EXPECT_EQ(receiver1->mData, receiver2->mData);
+
+    // The receivers keep their own phase.
+    const auto receiverKey = pullerManager->mReceivers.begin()->first;
+    EXPECT_EQ(122 * NS_PER_SEC, pullerManager->mReceivers[receiverKey].front().nextPullTimeNs);
+    EXPECT_EQ(130 * NS_PER_SEC, pullerManager->mNextPullTimeNs);
+
+    // Receivers whose interval isn't a multiple of the grid aren't aligned.
+    pullerManager->setPullAlarmGrid(120 * NS_PER_SEC);
+    sp<FakePullDataReceiver> receiver3 = new FakePullDataReceiver();
+    pullerManager->RegisterReceiver(pullTagId2, configKey, receiver3, 125 * NS_PER_SEC,
+                                    60 * NS_PER_SEC);
+    EXPECT_EQ(125 * NS_PER_SEC, pullerManager->mNextPullTimeNs);
+}
+
 }  // namespace statsd
 }  // namespace os
-}  // namespace android
\ No newline at end of file
+}  // namespace android
@@ -308,6 +308,71 @@ TEST_F(StatsPullerTest, PullFailsAndPullSameEventTime) {
     ASSERT_EQ(0, dataHolder.size());
 }
 
+TEST_F(StatsPullerTest, PullSnapshotSharedFromCache) {
+    pullData.push_back(createSimpleEvent(1111L, 33));
+
+    pullSuccess = true;
+    int64_t eventTimeNs = getElapsedRealtimeNs();
+
+    PullSnapshot snapshot;
+    EXPECT_EQ(puller.Pull(eventTimeNs, &snapshot), PULL_SUCCESS);
+    ASSERT_NE(nullptr, snapshot);
+    ASSERT_EQ(1, snapshot->size());
+    EXPECT_EQ(33, (*snapshot)[0]->getValues()[0].mValue.int_value);
+
+    // Cache hits share the snapshot of the pull.
+    PullSnapshot cachedSnapshot;
+    EXPECT_EQ(puller.Pull(eventTimeNs, &cachedSnapshot), PULL_SUCCESS);
+    EXPECT_EQ(snapshot, cachedSnapshot);
+
+    // A new pull doesn't modify the previous snapshot.
+    sleep_for(std::chrono::milliseconds(11));
+    pullData.clear();
+    pullData.push_back(createSimpleEvent(2222L, 44));
+    PullSnapshot newSnapshot;
+    EXPECT_EQ(puller.Pull(getElapsedRealtimeNs(), &newSnapshot), PULL_SUCCESS);
+    EXPECT_NE(snapshot, newSnapshot);
+    ASSERT_EQ(1, snapshot->size());
+    EXPECT_EQ(33, (*snapshot)[0]->getValues()[0].mValue.int_value);
+    ASSERT_EQ(1, newSnapshot->size());
+    EXPECT_EQ(44, (*newSnapshot)[0]->getValues()[0].mValue.int_value);
+}
+
+TEST_F(StatsPullerTest, PullRateLimitedToCache) {
+    StatsPuller::SetPullRateLimiting(true);
+    puller.mPullTokens = StatsPuller::kMaxPullTokens;
+    puller.mNumPullLatencies = 0;
+    pullSuccess = true;
+    // The pulls cost at least 2ms each, so a token is refilled every 200ms or more.
+    pullDelayNs = MillisToNano(2);
+    const long rateLimitedBefore =
+            StatsdStats::getInstance().mPulledAtomStats[pullTagId].pullRateLimited;
+
+    vector<std::shared_ptr<LogEvent>> dataHolder;
+    for (int i = 0; i < StatsPuller::kMaxPullTokens; i++) {
+        pullData.clear();
+        pullData.push_back(createSimpleEvent(1111L, i));
+        EXPECT_EQ(puller.Pull(getElapsedRealtimeNs(), &dataHolder), PULL_SUCCESS);
+        ASSERT_EQ(1, dataHolder.size());
+        EXPECT_EQ(i, dataHolder[0]->getValues()[0].mValue.int_value);
+        sleep_for(std::chrono::milliseconds(11));
+    }
+
+    // Past the cooldown, but out of tokens: folded into the last pull.
+    pullData.clear();
+    pullData.push_back(createSimpleEvent(2222L, 44));
+    EXPECT_EQ(puller.Pull(getElapsedRealtimeNs(), &dataHolder), PULL_SUCCESS);
+    ASSERT_EQ(1, dataHolder.size());
+    EXPECT_EQ(StatsPuller::kMaxPullTokens - 1, dataHolder[0]->getValues()[0].mValue.int_value);
+    EXPECT_EQ(rateLimitedBefore + 1,
+              StatsdStats::getInstance().mPulledAtomStats[pullTagId].pullRateLimited);
+
+    // The cache is kept for the adaptive cooldown.
+    EXPECT_EQ(0, puller.ClearCacheIfNecessary(getElapsedRealtimeNs()));
+
+    StatsPuller::SetPullRateLimiting(false);
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
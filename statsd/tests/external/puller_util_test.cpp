@@ -640,6 +640,49 @@ TEST(PullerUtilTest, MultipleRepeatedFields) {
     EXPECT_EQ(3, actualFieldValues->at(5).mValue.int_value);
 }
 
+TEST(PullerUtilTest, MergeIsolatedUidsOfLargePull) {
+    vector<shared_ptr<LogEvent>> data;
+    // Host events in reverse order of uid, which a sort would change.
+    for (int i = 0; i < 200; i++) {
+        if (i == 50) {
+            // 20->22->21
+            data.push_back(makeUidLogEvent(uidAtomTagId, timestamp, hostUid, hostNonAdditiveData,
+                                           hostAdditiveData));
+        }
+        data.push_back(makeUidLogEvent(uidAtomTagId, timestamp, 10199 - i, hostNonAdditiveData,
+                                       hostAdditiveData));
+    }
+    // 30->22->31, merged into the host event.
+    data.push_back(makeUidLogEvent(uidAtomTagId, timestamp, isolatedUid1, hostNonAdditiveData,
+                                   isolatedAdditiveData));
+    // 40->32->31, no host event to merge into.
+    data.push_back(makeUidLogEvent(uidAtomTagId, timestamp, isolatedUid2, isolatedNonAdditiveData,
+                                   isolatedAdditiveData));
+    // 30->32->21, merged into the previous isolated uid event.
+    data.push_back(makeUidLogEvent(uidAtomTagId, timestamp, isolatedUid1, isolatedNonAdditiveData,
+                                   hostAdditiveData));
+
+    sp<MockUidMap> uidMap = makeMockUidMap();
+    mapAndMergeIsolatedUidsToHostUid(data, uidMap, uidAtomTagId, additiveFields);
+
+    ASSERT_EQ(202, (int)data.size());
+    EXPECT_EQ(10199, data[0]->getValues()[0].mValue.int_value);
+    EXPECT_EQ(10150, data[49]->getValues()[0].mValue.int_value);
+    EXPECT_EQ(10000, data[200]->getValues()[0].mValue.int_value);
+
+    const vector<FieldValue>* actualFieldValues = &data[50]->getValues();
+    ASSERT_EQ(3, actualFieldValues->size());
+    EXPECT_EQ(hostUid, actualFieldValues->at(0).mValue.int_value);
+    EXPECT_EQ(hostNonAdditiveData, actualFieldValues->at(1).mValue.int_value);
+    EXPECT_EQ(hostAdditiveData + isolatedAdditiveData, actualFieldValues->at(2).mValue.int_value);
+
+    actualFieldValues = &data[201]->getValues();
+    ASSERT_EQ(3, actualFieldValues->size());
+    EXPECT_EQ(hostUid, actualFieldValues->at(0).mValue.int_value);
+    EXPECT_EQ(isolatedNonAdditiveData, actualFieldValues->at(1).mValue.int_value);
+    EXPECT_EQ(isolatedAdditiveData + hostAdditiveData, actualFieldValues->at(2).mValue.int_value);
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -16,6 +16,7 @@
 
 #include <gtest/gtest.h>
 
+#include <thread>
 #include <vector>
 
 #include "gtest_matchers.h"
@@ -88,6 +89,39 @@ TEST(StatsdStatsTest, TestValidConfigAdd) {
     EXPECT_FALSE(configReport.has_deletion_time_sec());
 }
 
+TEST(StatsdStatsTest, TestConfigInitLatencies) {
+    StatsdStats stats;
+    ConfigKey key(0, 12345);
+    ConfigInitLatencies initLatencies;
+    initLatencies.parseNs = 100;  // Ignored, the parse latency comes from noteConfigParsed.
+    initLatencies.matchersNs = 2;
+    initLatencies.conditionsNs = 3;
+    initLatencies.statesNs = 4;
+    initLatencies.metricsNs = 5;
+    initLatencies.alertsNs = 6;
+    stats.noteConfigParsed(key, 1);
+    stats.noteConfigReceived(key, 2, 3, 4, 5, {}, nullopt, initLatencies);
+
+    StatsdStatsReport report = getStatsdStatsReport(stats, /* reset stats */ false);
+    ASSERT_EQ(1, report.config_stats_size());
+    const auto& configReport = report.config_stats(0);
+    EXPECT_EQ(1, configReport.init_parse_latency_ns());
+    EXPECT_EQ(2, configReport.init_matchers_latency_ns());
+    EXPECT_EQ(3, configReport.init_conditions_latency_ns());
+    EXPECT_EQ(4, configReport.init_states_latency_ns());
+    EXPECT_EQ(5, configReport.init_metrics_latency_ns());
+    EXPECT_EQ(6, configReport.init_alerts_latency_ns());
+
+    // The parse latency is only attributed to the first config received after the parse.
+    stats.noteConfigReceived(key, 2, 3, 4, 5, {}, nullopt);
+    report = getStatsdStatsReport(stats, /* reset stats */ false);
+    // The first config is in the icebox, which is reported first.
+    ASSERT_EQ(2, report.config_stats_size());
+    EXPECT_EQ(1, report.config_stats(0).init_parse_latency_ns());
+    EXPECT_FALSE(report.config_stats(1).has_init_parse_latency_ns());
+    EXPECT_FALSE(report.config_stats(1).has_init_metrics_latency_ns());
+}
+
 TEST(StatsdStatsTest, TestInvalidConfigAdd) {
     StatsdStats stats;
     ConfigKey key(0, 12345);
@@ -221,6 +255,38 @@ TEST(StatsdStatsTest, TestConfigRemove) {
     EXPECT_TRUE(configReport2.has_deletion_time_sec());
 }
 
+TEST(StatsdStatsTest, TestDumpStatsSnapshot) {
+    StatsdStats stats;
+    ConfigKey key(0, 12345);
+    ConfigKey removedKey(0, 54321);
+    stats.noteConfigReceived(key, 1, 1, 1, 1, {}, nullopt);
+    stats.noteConfigReceived(removedKey, 1, 1, 1, 1, {}, nullopt);
+    stats.noteConfigRemoved(removedKey);
+    stats.noteBroadcastSent(key);
+    const time_t now = time(nullptr);
+    stats.noteAtomLogged(util::SENSOR_STATE_CHANGED, now + 1, false);
+    stats.noteSystemServerRestart(now);
+
+    // the dump without reset keeps the stats
+    StatsdStatsReport report = getStatsdStatsReport(stats, /* reset stats */ false);
+    EXPECT_EQ(2, report.config_stats_size());
+    EXPECT_EQ(1, report.atom_stats_size());
+    EXPECT_EQ(1, report.system_restart_sec_size());
+    report = getStatsdStatsReport(stats, /* reset stats */ true);
+    ASSERT_EQ(2, report.config_stats_size());
+    EXPECT_EQ(1, report.config_stats(1).broadcast_sent_time_sec_size());
+    EXPECT_EQ(1, report.atom_stats_size());
+    EXPECT_EQ(1, report.system_restart_sec_size());
+
+    // the reset keeps the active config only
+    report = getStatsdStatsReport(stats, /* reset stats */ false);
+    ASSERT_EQ(1, report.config_stats_size());
+    EXPECT_EQ(key.GetId(), report.config_stats(0).id());
+    EXPECT_EQ(0, report.config_stats(0).broadcast_sent_time_sec_size());
+    EXPECT_EQ(0, report.atom_stats_size());
+    EXPECT_EQ(0, report.system_restart_sec_size());
+}
+
 TEST(StatsdStatsTest, TestSubStats) {
     StatsdStats stats;
     ConfigKey key(0, 12345);
@@ -395,6 +461,33 @@ TEST(StatsdStatsTest, TestNonPlatformAtomLog) {
     EXPECT_TRUE(newAtom2Good);
 }
 
+TEST(StatsdStatsTest, TestAtomLogFromMultipleThreads) {
+    StatsdStats stats;
+    const int numThreads = 4;
+    const int numLogsPerThread = 1000;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < numThreads; i++) {
+        threads.emplace_back([&stats, i] {
+            for (int j = 0; j < numLogsPerThread; j++) {
+                stats.noteAtomLogged(util::SENSOR_STATE_CHANGED, /*timeSec=*/0,
+                                     /*isSkipped=*/j % 2 == 0);
+                stats.noteEventQueueSize(i * numLogsPerThread + j, /*eventTimestampNs=*/j);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    StatsdStatsReport report = getStatsdStatsReport(stats, /* reset stats */ false);
+    ASSERT_EQ(1, report.atom_stats_size());
+    EXPECT_EQ(util::SENSOR_STATE_CHANGED, report.atom_stats(0).tag());
+    EXPECT_EQ(numThreads * numLogsPerThread, report.atom_stats(0).count());
+    EXPECT_EQ(numThreads * numLogsPerThread / 2, report.atom_stats(0).skip_count());
+    EXPECT_EQ(numThreads * numLogsPerThread - 1, report.event_queue_stats().max_size_observed());
+}
+
 TEST(StatsdStatsTest, TestPullAtomStats) {
     StatsdStats stats;
 
@@ -419,6 +512,7 @@ TEST(StatsdStatsTest, TestPullAtomStats) {
     stats.notePullerNotFound(util::DISK_SPACE);
     stats.notePullTimeout(util::DISK_SPACE, 3000L, 6000L);
     stats.notePullTimeout(util::DISK_SPACE, 4000L, 7000L);
+    stats.notePullNotNeeded(util::DISK_SPACE);
 
     StatsdStatsReport report = getStatsdStatsReport(stats, /* reset stats */ false);
     ASSERT_EQ(1, report.pulled_atom_stats_size());
@@ -436,6 +530,7 @@ TEST(StatsdStatsTest, TestPullAtomStats) {
     EXPECT_EQ(1L, report.pulled_atom_stats(0).binder_call_failed());
     EXPECT_EQ(1L, report.pulled_atom_stats(0).failed_uid_provider_not_found());
     EXPECT_EQ(2L, report.pulled_atom_stats(0).puller_not_found());
+    EXPECT_EQ(1L, report.pulled_atom_stats(0).pull_not_needed());
     ASSERT_EQ(2, report.pulled_atom_stats(0).pull_atom_metadata_size());
     EXPECT_EQ(3000L, report.pulled_atom_stats(0).pull_atom_metadata(0).pull_timeout_uptime_millis());
     EXPECT_EQ(4000L, report.pulled_atom_stats(0).pull_atom_metadata(1).pull_timeout_uptime_millis());
@@ -445,6 +540,155 @@ TEST(StatsdStatsTest, TestPullAtomStats) {
             .pull_timeout_elapsed_millis());
 }
 
+TEST(StatsdStatsTest, TestHistogram) {
+    StatsdStats::Histogram histogram;
+    EXPECT_EQ(0, histogram.getCount());
+    EXPECT_EQ(0, histogram.getPercentile(50));
+
+    // Small values are exact.
+    for (int64_t value = 0; value < 8; value++) {
+        histogram.add(value);
+    }
+    EXPECT_EQ(8, histogram.getCount());
+    EXPECT_EQ(0, histogram.getPercentile(0));
+    EXPECT_EQ(3, histogram.getPercentile(50));
+    EXPECT_EQ(7, histogram.getPercentile(100));
+
+    // Larger values are rounded up to the end of their bin, a quarter of their power of 2.
+    histogram.reset();
+    histogram.add(1000);
+    EXPECT_EQ(1023, histogram.getPercentile(50));
+    histogram.add(3);
+    histogram.add(INT64_MAX);
+    EXPECT_EQ(3, histogram.getPercentile(0));
+    EXPECT_EQ(1023, histogram.getPercentile(50));
+    EXPECT_EQ(INT64_MAX, histogram.getPercentile(99));
+
+    histogram.reset();
+    for (int64_t value = 1; value <= 100; value++) {
+        histogram.add(value * 1000);
+    }
+    EXPECT_EQ(100, histogram.getCount());
+    EXPECT_EQ(57343, histogram.getPercentile(50));
+    EXPECT_EQ(98303, histogram.getPercentile(95));
+    EXPECT_EQ(114687, histogram.getPercentile(99));
+}
+
+TEST(StatsdStatsTest, TestPullAtomHistograms) {
+    StatsdStats stats;
+
+    stats.notePullTime(util::DISK_SPACE, 1000L);
+    stats.notePullTime(util::DISK_SPACE, 2000L);
+    stats.notePullDataSize(util::DISK_SPACE, 5);
+    stats.notePullReceiverTime(util::DISK_SPACE, 7L);
+    stats.notePullReceiverTime(util::DISK_SPACE, 5L);
+
+    StatsdStatsReport report = getStatsdStatsReport(stats, /* reset stats */ false);
+    ASSERT_EQ(1, report.pulled_atom_stats_size());
+    const auto& pulledAtomStats = report.pulled_atom_stats(0);
+    EXPECT_EQ(2, pulledAtomStats.pull_time_nanos_histogram().count());
+    EXPECT_EQ(1023, pulledAtomStats.pull_time_nanos_histogram().p50());
+    EXPECT_EQ(2047, pulledAtomStats.pull_time_nanos_histogram().p99());
+    EXPECT_EQ(1, pulledAtomStats.pull_data_size_histogram().count());
+    EXPECT_EQ(5, pulledAtomStats.pull_data_size_histogram().p95());
+    EXPECT_EQ(2, pulledAtomStats.receiver_time_nanos_histogram().count());
+    EXPECT_EQ(5, pulledAtomStats.receiver_time_nanos_histogram().p50());
+    EXPECT_EQ(7, pulledAtomStats.receiver_time_nanos_histogram().p99());
+
+    report = getStatsdStatsReport(stats, /* reset stats */ true);
+    report = getStatsdStatsReport(stats, /* reset stats */ false);
+    ASSERT_EQ(1, report.pulled_atom_stats_size());
+    EXPECT_FALSE(report.pulled_atom_stats(0).has_pull_time_nanos_histogram());
+}
+
+TEST(StatsdStatsTest, TestLogEventLatencyStats) {
+    StatsdStats stats;
+    ConfigKey key(0, 12345);
+    ConfigKey removedKey(0, 23456);
+    stats.noteConfigReceived(key, 1, 0, 1, 0, {}, nullopt /*valid config*/);
+    stats.noteConfigReceived(removedKey, 1, 0, 1, 0, {}, nullopt /*valid config*/);
+
+    const int atomId = util::SCREEN_STATE_CHANGED;
+    const int64_t metricId = 1;
+    stats.noteLogEventLatency(atomId, /*queueTimeNs=*/1000, /*processingTimeNs=*/200);
+    stats.noteLogEventLatency(atomId, /*queueTimeNs=*/3000, /*processingTimeNs=*/400);
+    stats.noteConfigLogEventProcessed(key, 200, 100, {});
+    stats.noteConfigLogEventProcessed(removedKey, 400, 100, {});
+    stats.noteConfigRemoved(removedKey);
+    stats.noteConfigLogEventProcessed(removedKey, 400, 100, {});
+    stats.noteMetricLogEventProcessed(metricId, 100);
+
+    // Only kMaxAtomLatencyStatsSize atoms are tracked.
+    for (int i = 0; i < StatsdStats::kMaxAtomLatencyStatsSize; i++) {
+        stats.noteLogEventLatency(StatsdStats::kMaxPushedAtomId + i, 1000, 200);
+    }
+
+    StatsdStatsReport report = getStatsdStatsReport(stats, /* reset stats */ true);
+    ASSERT_EQ(StatsdStats::kMaxAtomLatencyStatsSize, report.atom_latency_stats_size());
+    const auto& atomLatencyStats = report.atom_latency_stats(0);
+    EXPECT_EQ(atomId, atomLatencyStats.tag());
+    EXPECT_EQ(2, atomLatencyStats.queue_time_nanos_histogram().count());
+    EXPECT_LE(3000, atomLatencyStats.queue_time_nanos_histogram().p99());
+    EXPECT_EQ(2, atomLatencyStats.processing_time_nanos_histogram().count());
+    EXPECT_LE(200, atomLatencyStats.processing_time_nanos_histogram().p50());
+
+    ASSERT_EQ(2, report.config_stats_size());
+    for (const auto& configStats : report.config_stats()) {
+        if (configStats.id() == key.GetId()) {
+            EXPECT_EQ(1, configStats.processing_time_nanos_histogram().count());
+        } else {
+            EXPECT_FALSE(configStats.has_processing_time_nanos_histogram());
+        }
+    }
+
+    ASSERT_EQ(1, report.atom_metric_stats_size());
+    EXPECT_EQ(metricId, report.atom_metric_stats(0).metric_id());
+    EXPECT_EQ(1, report.atom_metric_stats(0).processing_time_nanos_histogram().count());
+
+    report = getStatsdStatsReport(stats, /* reset stats */ false);
+    EXPECT_EQ(0, report.atom_latency_stats_size());
+    for (const auto& configStats : report.config_stats()) {
+        EXPECT_FALSE(configStats.has_processing_time_nanos_histogram());
+    }
+}
+
+TEST(StatsdStatsTest, TestConfigCpuTimeAndMemoryUsage) {
+    StatsdStats stats;
+    ConfigKey key(0, 12345);
+    stats.noteConfigReceived(key, 1, 0, 1, 0, {}, nullopt /*valid config*/);
+
+    stats.noteConfigLogEventProcessed(
+            key, 200, /*cpuTimeNs=*/100,
+            {.bucketBytes = 1000, .dimensionCount = 10, .gaugeAtomCount = 5});
+    stats.noteConfigLogEventProcessed(
+            key, 200, /*cpuTimeNs=*/300,
+            {.bucketBytes = 2000, .dimensionCount = 20, .gaugeAtomCount = 0});
+    stats.noteConfigPullCpuTime(key, 50);
+    stats.noteConfigPullCpuTime(key, 70);
+    stats.noteConfigDumpReportCpuTime(key, 80);
+    // Unknown configs are ignored.
+    stats.noteConfigPullCpuTime(ConfigKey(0, 23456), 50);
+
+    StatsdStatsReport report = getStatsdStatsReport(stats, /* reset stats */ true);
+    ASSERT_EQ(1, report.config_stats_size());
+    const auto& configStats = report.config_stats(0);
+    // The log event CPU time is extrapolated from the sampled events.
+    EXPECT_EQ(400 * StatsdStats::kLogEventLatencySampleRate, configStats.log_event_cpu_time_ns());
+    EXPECT_EQ(120, configStats.pull_cpu_time_ns());
+    EXPECT_EQ(80, configStats.dump_report_cpu_time_ns());
+    EXPECT_EQ(2000, configStats.bucket_bytes());
+    EXPECT_EQ(20, configStats.dimension_count());
+    EXPECT_FALSE(configStats.has_gauge_atom_count());
+
+    // The CPU times are reset, the memory usage is kept.
+    report = getStatsdStatsReport(stats, /* reset stats */ false);
+    ASSERT_EQ(1, report.config_stats_size());
+    EXPECT_FALSE(report.config_stats(0).has_log_event_cpu_time_ns());
+    EXPECT_FALSE(report.config_stats(0).has_pull_cpu_time_ns());
+    EXPECT_FALSE(report.config_stats(0).has_dump_report_cpu_time_ns());
+    EXPECT_EQ(2000, report.config_stats(0).bucket_bytes());
+}
+
 TEST(StatsdStatsTest, TestAtomMetricsStats) {
     StatsdStats stats;
     time_t now = time(nullptr);
@@ -760,6 +1004,24 @@ TEST(StatsdStatsTest, TestQueueStats) {
     ASSERT_EQ(1000, report.event_queue_stats().max_size_observed_elapsed_nanos());
 }
 
+TEST(StatsdStatsTest, TestSocketDrainStats) {
+    StatsdStats stats;
+
+    stats.noteSocketDrain(/*datagramCount=*/10, /*batchSize=*/64, /*timestampNs=*/1000);
+    stats.noteSocketDrain(64, 64, 2000);
+    stats.noteSocketDrain(30, 64, 3000);
+    stats.noteSocketDrain(64, 64, 4000);
+    StatsdStatsReport report = getStatsdStatsReport(stats, /* reset stats */ true);
+
+    EXPECT_EQ(64, report.event_queue_stats().socket_max_depth_observed());
+    EXPECT_EQ(2000, report.event_queue_stats().socket_max_depth_observed_elapsed_nanos());
+    EXPECT_EQ(2, report.event_queue_stats().socket_full_drain_count());
+
+    report = getStatsdStatsReport(stats, /* reset stats */ false);
+    EXPECT_FALSE(report.event_queue_stats().has_socket_max_depth_observed());
+    EXPECT_FALSE(report.event_queue_stats().has_socket_full_drain_count());
+}
+
 TEST(StatsdStatsTest, TestAtomLoggedAndDroppedStats) {
     StatsdStats stats;
 
@@ -1100,6 +1362,63 @@ TEST(StatsdStatsTest, TestSocketLossStatsOverflowCounter) {
     }
 }
 
+TEST(StatsdStatsTest, TestSocketQueueHighWaterMark) {
+    StatsdStats stats;
+
+    // the writer queue high-water mark entry is taken out of the loss entries
+    AStatsEvent* statsEvent = AStatsEvent_obtain();
+    // toSocketLossInfo() only looks at the values, any atom id parses the same way
+    AStatsEvent_setAtomId(statsEvent, /*atomId=*/100);
+    AStatsEvent_writeInt32(statsEvent, 1000);
+    AStatsEvent_writeInt64(statsEvent, 10);
+    AStatsEvent_writeInt64(statsEvent, 20);
+    AStatsEvent_writeInt32(statsEvent, 0);
+    int32_t errors[] = {-EAGAIN, kSocketLossQueueHighWaterMarkError};
+    int32_t atomIds[] = {100, 0};
+    int32_t counts[] = {3, 7};
+    AStatsEvent_writeInt32Array(statsEvent, errors, 2);
+    AStatsEvent_writeInt32Array(statsEvent, atomIds, 2);
+    AStatsEvent_writeInt32Array(statsEvent, counts, 2);
+    LogEvent logEvent(/*uid=*/1000, /*pid=*/1001);
+    parseStatsEventToLogEvent(statsEvent, &logEvent);
+
+    const std::optional<SocketLossInfo> lossInfo = toSocketLossInfo(logEvent);
+    ASSERT_TRUE(lossInfo);
+    EXPECT_THAT(lossInfo->errors, ElementsAre(-EAGAIN));
+    EXPECT_THAT(lossInfo->atomIds, ElementsAre(100));
+    EXPECT_THAT(lossInfo->counts, ElementsAre(3));
+    EXPECT_EQ(lossInfo->queueHighWaterMark, 7);
+    stats.noteAtomSocketLoss(*lossInfo);
+
+    // a report with only the high-water mark is not a loss, the max is kept per uid
+    SocketLossInfo highWaterMarkOnly;
+    highWaterMarkOnly.uid = 1000;
+    highWaterMarkOnly.firstLossTsNanos = 0;
+    highWaterMarkOnly.lastLossTsNanos = 0;
+    highWaterMarkOnly.overflowCounter = 0;
+    highWaterMarkOnly.queueHighWaterMark = 5;
+    stats.noteAtomSocketLoss(highWaterMarkOnly);
+    highWaterMarkOnly.uid = 1001;
+    stats.noteAtomSocketLoss(highWaterMarkOnly);
+
+    StatsdStatsReport report = getStatsdStatsReport(stats, /* reset stats */ true);
+
+    const auto& socketLossStats = report.socket_loss_stats();
+    ASSERT_EQ(socketLossStats.loss_stats_per_uid().size(), 1);
+    EXPECT_EQ(socketLossStats.loss_stats_per_uid(0).uid(), 1000);
+    ASSERT_EQ(socketLossStats.loss_stats_per_uid(0).atom_id_loss_stats().size(), 1);
+    EXPECT_EQ(socketLossStats.loss_stats_per_uid(0).atom_id_loss_stats(0).count(), 3);
+
+    ASSERT_EQ(socketLossStats.queue_high_water_marks().size(), 2);
+    EXPECT_EQ(socketLossStats.queue_high_water_marks(0).uid(), 1000);
+    EXPECT_EQ(socketLossStats.queue_high_water_marks(0).max_size(), 7);
+    EXPECT_EQ(socketLossStats.queue_high_water_marks(1).uid(), 1001);
+    EXPECT_EQ(socketLossStats.queue_high_water_marks(1).max_size(), 5);
+
+    report = getStatsdStatsReport(stats, /* reset stats */ false);
+    EXPECT_EQ(report.socket_loss_stats().queue_high_water_marks().size(), 0);
+}
+
 TEST_P(StatsdStatsTest_GetAtomDimensionKeySizeLimit_InMap, TestGetAtomDimensionKeySizeLimits) {
     const auto& [atomId, defaultHardLimit] = GetParam();
     EXPECT_EQ(StatsdStats::getAtomDimensionKeySizeLimits(atomId, defaultHardLimit),
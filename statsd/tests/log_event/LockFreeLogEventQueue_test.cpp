@@ -0,0 +1,133 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "logd/LockFreeLogEventQueue.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "stats_event.h"
+#include "tests/statsd_test_util.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using std::unique_ptr;
+
+namespace {
+
+std::unique_ptr<LogEvent> makeLogEvent(uint64_t timestampNs) {
+    AStatsEvent* statsEvent = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(statsEvent, 10);
+    AStatsEvent_overwriteTimestamp(statsEvent, timestampNs);
+    std::unique_ptr<LogEvent> logEvent = std::make_unique<LogEvent>(/*uid=*/0, /*pid=*/0);
+    parseStatsEventToLogEvent(statsEvent, logEvent.get());
+    EXPECT_EQ(logEvent->GetElapsedTimestampNs(), timestampNs);
+    return logEvent;
+}
+
+}  // anonymous namespace
+
+#ifdef __ANDROID__
+TEST(LockFreeLogEventQueueTest, TestCapacity) {
+    EXPECT_EQ(64, LockFreeLogEventQueue(50).capacity());
+    EXPECT_EQ(64, LockFreeLogEventQueue(64).capacity());
+    EXPECT_EQ(65536, LockFreeLogEventQueue(50000).capacity());
+}
+
+TEST(LockFreeLogEventQueueTest, TestOverflow) {
+    LockFreeLogEventQueue queue(4);
+    int64_t eventTimeNs = 100;
+    for (int i = 0; i < 4; i++) {
+        LockFreeLogEventQueue::Result result = queue.push(makeLogEvent(eventTimeNs + i));
+        EXPECT_TRUE(result.success);
+        EXPECT_EQ(i + 1, result.size);
+    }
+
+    LockFreeLogEventQueue::Result result = queue.push(makeLogEvent(eventTimeNs + 4));
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(eventTimeNs, result.oldestTimestampNs);
+    EXPECT_EQ(4, result.size);
+
+    // after consuming one event the oldest one is updated and there is room for one more event
+    EXPECT_EQ(eventTimeNs, queue.waitPop()->GetElapsedTimestampNs());
+    EXPECT_TRUE(queue.push(makeLogEvent(eventTimeNs + 5)).success);
+    result = queue.push(makeLogEvent(eventTimeNs + 6));
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(eventTimeNs + 1, result.oldestTimestampNs);
+}
+
+TEST(LockFreeLogEventQueueTest, TestGoodConsumer) {
+    LockFreeLogEventQueue queue(50);
+    int64_t eventTimeNs = 100;
+    std::thread writer([&queue, eventTimeNs] {
+        for (int i = 0; i < 100; i++) {
+            EXPECT_TRUE(queue.push(makeLogEvent(eventTimeNs + i * 1000)).success);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    std::thread reader([&queue, eventTimeNs] {
+        for (int i = 0; i < 100; i++) {
+            auto event = queue.waitPop();
+            EXPECT_TRUE(event != nullptr);
+            // All events are in right order.
+            EXPECT_EQ(eventTimeNs + i * 1000, event->GetElapsedTimestampNs());
+        }
+    });
+
+    reader.join();
+    writer.join();
+}
+
+TEST(LockFreeLogEventQueueTest, TestMultipleProducers) {
+    constexpr int kProducersCount = 4;
+    constexpr int kEventsPerProducer = 1000;
+    constexpr int64_t kProducerTimeBase = 1000000;
+    LockFreeLogEventQueue queue(kProducersCount * kEventsPerProducer);
+
+    std::vector<std::thread> writers;
+    for (int p = 0; p < kProducersCount; p++) {
+        writers.emplace_back([&queue, p] {
+            for (int i = 0; i < kEventsPerProducer; i++) {
+                EXPECT_TRUE(queue.push(makeLogEvent(p * kProducerTimeBase + i)).success);
+            }
+        });
+    }
+
+    // events of each producer are consumed in the order they were pushed
+    std::vector<int64_t> lastEventIndex(kProducersCount, -1);
+    for (int i = 0; i < kProducersCount * kEventsPerProducer; i++) {
+        auto event = queue.waitPop();
+        ASSERT_TRUE(event != nullptr);
+        const int producer = event->GetElapsedTimestampNs() / kProducerTimeBase;
+        const int64_t index = event->GetElapsedTimestampNs() % kProducerTimeBase;
+        EXPECT_EQ(lastEventIndex[producer] + 1, index);
+        lastEventIndex[producer] = index;
+    }
+
+    for (auto& writer : writers) {
+        writer.join();
+    }
+}
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -115,6 +115,154 @@ TEST(LogEventQueue_test, TestSlowConsumer) {
     writer.join();
 }
 
+TEST(LogEventQueue_test, TestPushBatch) {
+    LogEventQueue queue(50);
+    int64_t eventTimeNs = 100;
+    std::vector<unique_ptr<LogEvent>> events;
+    for (int i = 0; i < 60; i++) {
+        events.push_back(makeLogEvent(eventTimeNs + i * 1000));
+    }
+
+    const std::vector<LogEventQueue::Result> results = queue.pushBatch(events);
+    ASSERT_EQ(60, results.size());
+    for (int i = 0; i < 50; i++) {
+        EXPECT_TRUE(results[i].success);
+        EXPECT_EQ(i + 1, results[i].size);
+        EXPECT_EQ(nullptr, events[i]);
+    }
+    // events exceeding the limit are not queued and report the oldest event in the queue
+    for (int i = 50; i < 60; i++) {
+        EXPECT_FALSE(results[i].success);
+        EXPECT_EQ(eventTimeNs, results[i].oldestTimestampNs);
+        EXPECT_EQ(50, results[i].size);
+        EXPECT_NE(nullptr, events[i]);
+    }
+
+    for (int i = 0; i < 50; i++) {
+        auto event = queue.waitPop();
+        EXPECT_TRUE(event != nullptr);
+        // All events are in right order.
+        EXPECT_EQ(eventTimeNs + i * 1000, event->GetElapsedTimestampNs());
+    }
+}
+
+TEST(LogEventQueue_test, TestWaitPopBatch) {
+    LogEventQueue queue(50);
+    int64_t eventTimeNs = 100;
+    for (int i = 0; i < 10; i++) {
+        EXPECT_TRUE(queue.push(makeLogEvent(eventTimeNs + i * 1000)).success);
+    }
+
+    std::vector<unique_ptr<LogEvent>> events;
+    queue.waitPopBatch(/*maxEvents=*/4, std::chrono::nanoseconds(0), events);
+    ASSERT_EQ(4, events.size());
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(eventTimeNs + i * 1000, events[i]->GetElapsedTimestampNs());
+    }
+
+    // remaining events are returned without waiting for the batch to fill up
+    queue.waitPopBatch(/*maxEvents=*/64, std::chrono::nanoseconds(0), events);
+    ASSERT_EQ(6, events.size());
+    for (int i = 0; i < 6; i++) {
+        EXPECT_EQ(eventTimeNs + (i + 4) * 1000, events[i]->GetElapsedTimestampNs());
+    }
+}
+
+TEST(LogEventQueue_test, TestWaitPopBatchMaxLatency) {
+    LogEventQueue queue(50);
+    int64_t eventTimeNs = 100;
+    std::thread writer([&queue, eventTimeNs] {
+        for (int i = 0; i < 3; i++) {
+            EXPECT_TRUE(queue.push(makeLogEvent(eventTimeNs + i * 1000)).success);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    // the reader waits for the batch to fill up within the latency
+    std::vector<unique_ptr<LogEvent>> events;
+    queue.waitPopBatch(/*maxEvents=*/3, std::chrono::seconds(5), events);
+    writer.join();
+    ASSERT_EQ(3, events.size());
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(eventTimeNs + i * 1000, events[i]->GetElapsedTimestampNs());
+    }
+}
+
+TEST(LogEventQueue_test, TestPriorityHeadroom) {
+    LogEventQueue queue(/*maxSize=*/2, /*maxPrioritySize=*/1);
+
+    EXPECT_TRUE(queue.push(makeLogEvent(100)).success);
+    EXPECT_TRUE(queue.push(makeLogEvent(200)).success);
+    // the queue is full, but priority events still fit in the headroom
+    LogEventQueue::Result result = queue.push(makeLogEvent(300));
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(100, result.oldestTimestampNs);
+    result = queue.push(makeLogEvent(400), /*isPriority=*/true);
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(3, result.size);
+    // the headroom is full too
+    EXPECT_FALSE(queue.push(makeLogEvent(500), /*isPriority=*/true).success);
+
+    // priority events are not read before the events pushed earlier
+    EXPECT_EQ(100, queue.waitPop()->GetElapsedTimestampNs());
+    EXPECT_EQ(200, queue.waitPop()->GetElapsedTimestampNs());
+
+    EXPECT_TRUE(queue.push(makeLogEvent(600)).success);
+    EXPECT_TRUE(queue.push(makeLogEvent(700), /*isPriority=*/true).success);
+
+    std::vector<unique_ptr<LogEvent>> events;
+    events.push_back(makeLogEvent(800));
+    events.push_back(makeLogEvent(900));
+    std::vector<LogEventQueue::Result> results =
+            queue.pushBatch(events, /*isPriority=*/{false, true});
+    ASSERT_EQ(2, results.size());
+    EXPECT_FALSE(results[0].success);
+    EXPECT_FALSE(results[1].success);
+    EXPECT_EQ(400, results[1].oldestTimestampNs);
+
+    queue.waitPopBatch(/*maxEvents=*/10, std::chrono::nanoseconds(0), events);
+    ASSERT_EQ(3, events.size());
+    EXPECT_EQ(400, events[0]->GetElapsedTimestampNs());
+    EXPECT_EQ(600, events[1]->GetElapsedTimestampNs());
+    EXPECT_EQ(700, events[2]->GetElapsedTimestampNs());
+}
+
+TEST(LogEventQueue_test, TestEventPool) {
+    LogEventQueue queue(50);
+
+    unique_ptr<LogEvent> event = queue.obtainEvent(/*uid=*/1001, /*pid=*/1002);
+    EXPECT_EQ(1001, event->GetUid());
+    EXPECT_EQ(1002, event->GetPid());
+
+    AStatsEvent* statsEvent = AStatsEvent_obtain();
+    AStatsEvent_setAtomId(statsEvent, 10);
+    AStatsEvent_overwriteTimestamp(statsEvent, 1000);
+    AStatsEvent_writeInt32(statsEvent, 1);
+    AStatsEvent_writeString(statsEvent, "value");
+    parseStatsEventToLogEvent(statsEvent, event.get());
+    EXPECT_EQ(2, event->size());
+
+    const LogEvent* recycled = event.get();
+    const size_t capacity = event->valuesCapacity();
+    queue.recycleEvent(std::move(event));
+
+    // the recycled event is reused, its values are cleared but the storage is kept
+    event = queue.obtainEvent(/*uid=*/2001, /*pid=*/2002);
+    EXPECT_EQ(recycled, event.get());
+    EXPECT_EQ(2001, event->GetUid());
+    EXPECT_EQ(2002, event->GetPid());
+    EXPECT_EQ(0, event->GetTagId());
+    EXPECT_EQ(0, event->GetElapsedTimestampNs());
+    EXPECT_EQ(0, event->size());
+    EXPECT_EQ(capacity, event->valuesCapacity());
+    EXPECT_TRUE(event->isValid());
+    EXPECT_FALSE(event->isParsedHeaderOnly());
+
+    // pool is empty, a new event is allocated
+    unique_ptr<LogEvent> event2 = queue.obtainEvent(/*uid=*/0, /*pid=*/0);
+    EXPECT_NE(recycled, event2.get());
+}
+
 TEST(LogEventQueue_test, TestQueueMaxSize) {
     StatsdStats::getInstance().reset();
 
@@ -22,6 +22,7 @@
 #include <vector>
 
 #include "metrics_test_helper.h"
+#include "src/condition/EventConditionCache.h"
 #include "src/stats_log_util.h"
 #include "stats_event.h"
 #include "tests/statsd_test_util.h"
@@ -145,6 +146,216 @@ TEST(CountMetricProducerTest, TestNonDimensionalEvents) {
                 countProducer.mPastBuckets.end());
     const auto& buckets3 = countProducer.mPastBuckets[DEFAULT_METRIC_DIMENSION_KEY];
     ASSERT_EQ(2UL, buckets3.size());
+    EXPECT_EQ(2 * countProducer.kBucketSize, countProducer.byteSize());
+
+    countProducer.dropDataLocked(bucketStartTimeNs + 3 * bucketSizeNs + 2);
+    EXPECT_EQ(0UL, countProducer.byteSize());
+}
+
+TEST(CountMetricProducerTest, TestEncodePastBuckets) {
+    int64_t bucketStartTimeNs = 10000000000;
+    int64_t bucketSizeNs = TimeUnitToBucketSizeInMillis(ONE_MINUTE) * 1000000LL;
+    int tagId = 1;
+
+    CountMetric metric;
+    metric.set_id(1);
+    metric.set_bucket(ONE_MINUTE);
+    *metric.mutable_dimensions_in_what() = CreateDimensions(tagId, {1});
+    CountMetric encodingMetric = metric;
+    encodingMetric.set_encode_past_buckets(true);
+
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    CountMetricProducer countProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, {},
+                                      wizard, protoHash, bucketStartTimeNs, bucketStartTimeNs);
+    CountMetricProducer encodingProducer(kConfigKey, encodingMetric,
+                                         -1 /*-1 meaning no condition*/, {}, wizard, protoHash,
+                                         bucketStartTimeNs, bucketStartTimeNs);
+
+    // "222" has no event in the second bucket.
+    for (int64_t eventTimeNs : {bucketStartTimeNs + 1, bucketStartTimeNs + bucketSizeNs + 1,
+                                bucketStartTimeNs + 2 * bucketSizeNs + 1}) {
+        for (const string& uid : {"111", "222"}) {
+            if (uid == "222" && eventTimeNs == bucketStartTimeNs + bucketSizeNs + 1) {
+                continue;
+            }
+            LogEvent event(/*uid=*/0, /*pid=*/0);
+            makeLogEvent(&event, eventTimeNs, tagId, uid);
+            countProducer.onMatchedLogEvent(1 /*log matcher index*/, event);
+            encodingProducer.onMatchedLogEvent(1 /*log matcher index*/, event);
+        }
+    }
+    LogEvent event(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event, bucketStartTimeNs + 2 * bucketSizeNs + 2, tagId, "111");
+    countProducer.onMatchedLogEvent(1 /*log matcher index*/, event);
+    encodingProducer.onMatchedLogEvent(1 /*log matcher index*/, event);
+
+    encodingProducer.flushIfNeededLocked(bucketStartTimeNs + 2 * bucketSizeNs + 1);
+    EXPECT_TRUE(encodingProducer.mPastBuckets.empty());
+    const EncodedPastBuckets& encodedBuckets = encodingProducer.mEncodedPastBuckets;
+    ASSERT_EQ(2UL, encodedBuckets.getDimensions().size());
+    ASSERT_EQ(2UL, encodedBuckets.getNumWindows());
+    size_t encodedBytes = 2 * sizeof(std::pair<int64_t, int64_t>);
+    for (const auto& [_, dimension] : encodedBuckets.getDimensions()) {
+        encodedBytes += dimension.data.size();
+    }
+    EXPECT_EQ(encodedBytes, encodingProducer.byteSize());
+
+    // The reports are the same.
+    const int64_t dumpTimeNs = bucketStartTimeNs + 2 * bucketSizeNs + 10;
+    vector<StatsLogReport> reports;
+    for (CountMetricProducer* producer : {&countProducer, &encodingProducer}) {
+        ProtoOutputStream output;
+        ReportStringTable strSet;
+        producer->onDumpReport(dumpTimeNs, true /* include current partial bucket*/,
+                               true /* erase data */, FAST, &strSet, &output);
+        reports.push_back(outputStreamToProto(&output));
+    }
+    ASSERT_EQ(2, reports[0].count_metrics().data_size());
+    EXPECT_EQ(reports[0].SerializeAsString(), reports[1].SerializeAsString());
+    EXPECT_TRUE(encodingProducer.mEncodedPastBuckets.empty());
+    EXPECT_EQ(0UL, encodingProducer.mEncodedPastBuckets.getNumWindows());
+    EXPECT_EQ(0UL, encodingProducer.byteSize());
+}
+
+TEST(CountMetricProducerTest, TestDimensionGuardrailHeavyHitters) {
+    int64_t bucketStartTimeNs = 10000000000;
+    int64_t bucketSizeNs = TimeUnitToBucketSizeInMillis(ONE_MINUTE) * 1000000LL;
+    int tagId = 1;
+
+    CountMetric metric;
+    metric.set_id(1);
+    metric.set_bucket(ONE_MINUTE);
+    *metric.mutable_dimensions_in_what() = CreateDimensions(tagId, {1});
+    metric.set_dimension_guardrail_heavy_hitters(true);
+
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    CountMetricProducer countProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, {},
+                                      wizard, protoHash, bucketStartTimeNs, bucketStartTimeNs);
+    const size_t limit = countProducer.mDimensionHardLimit;
+
+    int64_t eventTimeNs = bucketStartTimeNs + 1;
+    const auto logEvent = [&](const string& uid) {
+        LogEvent event(/*uid=*/0, /*pid=*/0);
+        makeLogEvent(&event, eventTimeNs++, tagId, uid);
+        countProducer.onMatchedLogEvent(1 /*log matcher index*/, event);
+    };
+    for (size_t i = 0; i < limit; i++) {
+        logEvent(std::to_string(i));
+    }
+    ASSERT_EQ(limit, countProducer.mCurrentSlicedCounter->size());
+
+    // The first event of "heavy" only ties the smallest count, the second one replaces it.
+    logEvent("heavy");
+    EXPECT_EQ(1, countProducer.mOtherCount);
+    logEvent("heavy");
+    logEvent("heavy");
+    ASSERT_EQ(limit, countProducer.mCurrentSlicedCounter->size());
+    EXPECT_EQ(1, countProducer.mOtherCount);
+
+    // Dimensions with a single event stay in the tail.
+    for (int i = 0; i < 5; i++) {
+        logEvent("tail" + std::to_string(i));
+    }
+    EXPECT_EQ(6, countProducer.mOtherCount);
+
+    ProtoOutputStream output;
+    countProducer.onDumpReport(bucketStartTimeNs + bucketSizeNs + 1,
+                               true /* include current partial bucket*/, true /* erase data */,
+                               FAST, /*strSet=*/nullptr, &output);
+    StatsLogReport report = outputStreamToProto(&output);
+    EXPECT_TRUE(report.dimension_guardrail_hit());
+    ASSERT_EQ(limit, report.count_metrics().data_size());
+    int64_t heavyCount = 0;
+    int64_t total = 0;
+    for (const auto& data : report.count_metrics().data()) {
+        ASSERT_EQ(1, data.bucket_info_size());
+        total += data.bucket_info(0).count();
+        if (data.dimension_leaf_values_in_what(0).value_str() == "heavy") {
+            heavyCount = data.bucket_info(0).count();
+        }
+    }
+    EXPECT_EQ(3, heavyCount);
+    ASSERT_EQ(1, report.count_metrics().other_dimensions_size());
+    EXPECT_EQ(6, report.count_metrics().other_dimensions(0).count());
+    EXPECT_EQ((int64_t)limit + 8, total + report.count_metrics().other_dimensions(0).count());
+
+    // The tail is reset with the bucket.
+    EXPECT_EQ(0, countProducer.mOtherCount);
+    EXPECT_EQ(0, countProducer.mMinCountLowerBound);
+}
+
+TEST(CountMetricProducerTest, TestCurrentSlicedCounterReusedAcrossBuckets) {
+    int64_t bucketStartTimeNs = 10000000000;
+    int64_t bucketSizeNs = TimeUnitToBucketSizeInMillis(ONE_MINUTE) * 1000000LL;
+    int tagId = 1;
+
+    CountMetric metric;
+    metric.set_id(1);
+    metric.set_bucket(ONE_MINUTE);
+
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+
+    CountMetricProducer countProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, {},
+                                      wizard, protoHash, bucketStartTimeNs, bucketStartTimeNs);
+
+    LogEvent event1(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event1, bucketStartTimeNs + 1, tagId);
+    countProducer.onMatchedLogEvent(1 /*log matcher index*/, event1);
+    const DimToValMap* counter = countProducer.mCurrentSlicedCounter.get();
+
+    // Without anomaly trackers referencing it, the map is cleared and kept for the next bucket.
+    countProducer.flushIfNeededLocked(bucketStartTimeNs + bucketSizeNs + 1);
+    EXPECT_EQ(counter, countProducer.mCurrentSlicedCounter.get());
+    EXPECT_TRUE(countProducer.mCurrentSlicedCounter->empty());
+    ASSERT_EQ(1UL, countProducer.mPastBuckets.size());
+    EXPECT_EQ(1LL, countProducer.mPastBuckets[DEFAULT_METRIC_DIMENSION_KEY][0].mCount);
+
+    LogEvent event2(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event2, bucketStartTimeNs + bucketSizeNs + 2, tagId);
+    countProducer.onMatchedLogEvent(1 /*log matcher index*/, event2);
+    ASSERT_EQ(1UL, countProducer.mCurrentSlicedCounter->size());
+    EXPECT_EQ(1L, countProducer.mCurrentSlicedCounter->begin()->second);
+}
+
+TEST(CountMetricProducerTest, TestDimensionlessFastPath) {
+    int64_t bucketStartTimeNs = 10000000000;
+    int64_t bucketSizeNs = TimeUnitToBucketSizeInMillis(ONE_MINUTE) * 1000000LL;
+    int tagId = 1;
+
+    CountMetric metric;
+    metric.set_id(1);
+    metric.set_bucket(ONE_MINUTE);
+
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+
+    CountMetricProducer countProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, {},
+                                      wizard, protoHash, bucketStartTimeNs, bucketStartTimeNs);
+    EXPECT_TRUE(countProducer.mIsDimensionless);
+    EXPECT_EQ(nullptr, countProducer.mDimensionlessCount);
+
+    for (int i = 1; i <= 3; i++) {
+        LogEvent event(/*uid=*/0, /*pid=*/0);
+        makeLogEvent(&event, bucketStartTimeNs + i, tagId);
+        countProducer.onMatchedLogEvent(1 /*log matcher index*/, event);
+    }
+    EXPECT_EQ(&(*countProducer.mCurrentSlicedCounter)[DEFAULT_METRIC_DIMENSION_KEY],
+              countProducer.mDimensionlessCount);
+    EXPECT_EQ(3L, *countProducer.mDimensionlessCount);
+
+    // The count is looked up again after the flush.
+    LogEvent event4(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event4, bucketStartTimeNs + bucketSizeNs + 1, tagId);
+    countProducer.onMatchedLogEvent(1 /*log matcher index*/, event4);
+    ASSERT_EQ(1UL, countProducer.mPastBuckets.size());
+    EXPECT_EQ(3LL, countProducer.mPastBuckets[DEFAULT_METRIC_DIMENSION_KEY][0].mCount);
+    ASSERT_EQ(1UL, countProducer.mCurrentSlicedCounter->size());
+    EXPECT_EQ(1L, (*countProducer.mCurrentSlicedCounter)[DEFAULT_METRIC_DIMENSION_KEY]);
+
+    // The metrics with dimensions go through the general path.
+    *metric.mutable_dimensions_in_what() = CreateDimensions(tagId, {1 /*uid field*/});
+    CountMetricProducer dimensionalProducer(kConfigKey, metric, -1 /*no condition*/, {}, wizard,
+                                            protoHash, bucketStartTimeNs, bucketStartTimeNs);
+    EXPECT_FALSE(dimensionalProducer.mIsDimensionless);
 }
 
 TEST(CountMetricProducerTest, TestEventsWithNonSlicedCondition) {
@@ -250,6 +461,66 @@ TEST(CountMetricProducerTest, TestEventsWithSlicedCondition) {
     EXPECT_EQ(1LL, bucketInfo.mCount);
 }
 
+TEST(CountMetricProducerTest, TestSlicedConditionQuerySharedForEvent) {
+    int64_t bucketStartTimeNs = 10000000000;
+
+    int tagId = 1;
+    int conditionTagId = 2;
+
+    CountMetric metric;
+    metric.set_id(1);
+    metric.set_bucket(ONE_MINUTE);
+    metric.set_condition(StringToId("APP_IN_BACKGROUND_PER_UID"));
+    MetricConditionLink* link = metric.add_links();
+    link->set_condition(StringToId("APP_IN_BACKGROUND_PER_UID"));
+    buildSimpleAtomFieldMatcher(tagId, 1, link->mutable_fields_in_what());
+    buildSimpleAtomFieldMatcher(conditionTagId, 2, link->mutable_fields_in_condition());
+
+    CountMetric otherMetric = metric;
+    otherMetric.set_id(2);
+
+    LogEvent event1(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event1, bucketStartTimeNs + 1, tagId, /*uid=*/"111");
+
+    LogEvent event2(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event2, bucketStartTimeNs + 10, tagId, /*uid=*/"222");
+
+    ConditionKey key1;
+    key1[StringToId("APP_IN_BACKGROUND_PER_UID")] = {
+            getMockedDimensionKey(conditionTagId, 2, "111")};
+
+    ConditionKey key2;
+    key2[StringToId("APP_IN_BACKGROUND_PER_UID")] = {
+            getMockedDimensionKey(conditionTagId, 2, "222")};
+
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    // Queried once per event within a scope, and by each metric outside of one.
+    EXPECT_CALL(*wizard, query(_, key1, _)).WillOnce(Return(ConditionState::kTrue));
+    EXPECT_CALL(*wizard, query(_, key2, _))
+            .Times(2)
+            .WillRepeatedly(Return(ConditionState::kFalse));
+
+    CountMetricProducer countProducer(kConfigKey, metric, 0 /*condition tracker index*/,
+                                      {ConditionState::kUnknown}, wizard, protoHash,
+                                      bucketStartTimeNs, bucketStartTimeNs);
+    CountMetricProducer otherCountProducer(kConfigKey, otherMetric, 0 /*condition tracker index*/,
+                                           {ConditionState::kUnknown}, wizard, protoHash,
+                                           bucketStartTimeNs, bucketStartTimeNs);
+
+    {
+        EventConditionCache::Scope conditionCacheScope;
+        countProducer.onMatchedLogEvent(1 /*log matcher index*/, event1);
+        otherCountProducer.onMatchedLogEvent(1 /*log matcher index*/, event1);
+    }
+    countProducer.onMatchedLogEvent(1 /*log matcher index*/, event2);
+    otherCountProducer.onMatchedLogEvent(1 /*log matcher index*/, event2);
+
+    ASSERT_EQ(1UL, countProducer.mCurrentSlicedCounter->size());
+    EXPECT_EQ(1, countProducer.mCurrentSlicedCounter->begin()->second);
+    ASSERT_EQ(1UL, otherCountProducer.mCurrentSlicedCounter->size());
+    EXPECT_EQ(1, otherCountProducer.mCurrentSlicedCounter->begin()->second);
+}
+
 TEST_P(CountMetricProducerTest_PartialBucket, TestSplitInCurrentBucket) {
     sp<AlarmMonitor> alarmMonitor;
     int64_t bucketStartTimeNs = 10000000000;
@@ -382,6 +653,35 @@ TEST_P(CountMetricProducerTest_PartialBucket, TestSplitInNextBucket) {
               countProducer.mPastBuckets[DEFAULT_METRIC_DIMENSION_KEY][1].mBucketEndNs);
 }
 
+TEST(CountMetricProducerTest, TestSplitOnUnrelatedAppUpgrade) {
+    int64_t bucketStartTimeNs = 10000000000;
+    int tagId = 1;
+    CountMetric metric;
+    metric.set_id(1);
+    metric.set_bucket(ONE_MINUTE);
+    metric.set_split_bucket_for_app_upgrade(true);
+    *metric.mutable_dimensions_in_what() = CreateDimensions(tagId, {1 /* uid */});
+
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    CountMetricProducer countProducer(kConfigKey, metric, -1 /* no condition */, {}, wizard,
+                                      protoHash, bucketStartTimeNs, bucketStartTimeNs);
+
+    shared_ptr<LogEvent> event = makeUidLogEvent(tagId, bucketStartTimeNs + 1, 1001, 5, 10);
+    countProducer.onMatchedLogEvent(1 /*log matcher index*/, *event);
+
+    // The uid isn't in the dimensions, the bucket is kept.
+    countProducer.notifyUnrelatedAppUpgrade(bucketStartTimeNs + 10, 1002);
+    EXPECT_EQ(bucketStartTimeNs, countProducer.mCurrentBucketStartTimeNs);
+    EXPECT_EQ(1UL, countProducer.mCurrentSlicedCounter->size());
+
+    countProducer.notifyUnrelatedAppUpgrade(bucketStartTimeNs + 20, 1001);
+    EXPECT_EQ(bucketStartTimeNs + 20, countProducer.mCurrentBucketStartTimeNs);
+    EXPECT_EQ(0UL, countProducer.mCurrentSlicedCounter->size());
+    ASSERT_EQ(1UL, countProducer.mPastBuckets.size());
+    EXPECT_EQ(bucketStartTimeNs + 20,
+              countProducer.mPastBuckets.begin()->second[0].mBucketEndNs);
+}
+
 TEST(CountMetricProducerTest, TestSplitOnAppUpgradeDisabled) {
     sp<AlarmMonitor> alarmMonitor;
     int64_t bucketStartTimeNs = 10000000000;
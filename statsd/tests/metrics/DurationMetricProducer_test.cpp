@@ -614,6 +614,125 @@ TEST(DurationMetricProducerTest, TestClearCurrentSlicedTrackerMapWhenStop) {
     EXPECT_EQ(1, durationProducer.getCurrentBucketNum());
 }
 
+TEST(DurationMetricProducerTest, TestLinkedConditionKeyIndex) {
+    int64_t bucketStartTimeNs = 10000000000;
+    int64_t bucketSizeNs = TimeUnitToBucketSizeInMillis(ONE_MINUTE) * 1000000LL;
+    int tagId = 1;
+    int conditionTagId = 2;
+
+    DurationMetric metric;
+    metric.set_id(1);
+    metric.set_bucket(ONE_MINUTE);
+    metric.set_aggregation_type(DurationMetric_AggregationType_SUM);
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    FieldMatcher dimensions;
+    buildSimpleAtomFieldMatcher(tagId, 1, &dimensions);
+
+    DurationMetricProducer durationProducer(
+            kConfigKey, metric, 0 /* condition index */, {ConditionState::kUnknown},
+            -1 /*what index not needed*/, 1 /* start index */, 2 /* stop index */,
+            3 /* stop_all index */, false /*nesting*/, wizard, protoHash, dimensions,
+            bucketStartTimeNs, bucketStartTimeNs);
+
+    // Link the uid of the start events to the uid of a condition covering all its dimensions.
+    Metric2Condition link;
+    link.conditionId = 123;
+    FieldMatcher conditionMatcher;
+    buildSimpleAtomFieldMatcher(conditionTagId, 1, &conditionMatcher);
+    translateFieldMatcher(dimensions, &link.metricFields);
+    translateFieldMatcher(conditionMatcher, &link.conditionFields);
+    durationProducer.mMetric2ConditionLinks = {link};
+    durationProducer.mHasLinksToAllConditionDimensionsInTracker = true;
+    auto linkedConditionKey = [conditionTagId](int uid) {
+        int pos[] = {1, 0, 0};
+        HashableDimensionKey key;
+        key.addValue(FieldValue(Field(conditionTagId, pos, 0), Value(uid)));
+        return key;
+    };
+
+    durationProducer.onConditionChanged(true /* condition */, bucketStartTimeNs + 5);
+    durationProducer.onMatchedLogEvent(
+            1 /* start index*/, *makeUidLogEvent(tagId, bucketStartTimeNs + 10, 1001, 0, 0));
+    durationProducer.onMatchedLogEvent(
+            1 /* start index*/, *makeUidLogEvent(tagId, bucketStartTimeNs + 20, 1002, 0, 0));
+    ASSERT_EQ(2UL, durationProducer.mCurrentSlicedDurationTrackerMap.size());
+    ASSERT_EQ(2UL, durationProducer.mWhatKeysByLinkedConditionKey.size());
+    EXPECT_EQ(1UL, durationProducer.mWhatKeysByLinkedConditionKey[linkedConditionKey(1001)].size());
+    EXPECT_EQ(1UL, durationProducer.mWhatKeysByLinkedConditionKey[linkedConditionKey(1002)].size());
+
+    // The stopped trackers are dropped once their durations are flushed.
+    durationProducer.onMatchedLogEvent(
+            2 /* stop index*/, *makeUidLogEvent(tagId, bucketStartTimeNs + 40, 1001, 0, 0));
+    EXPECT_EQ(2UL, durationProducer.mWhatKeysByLinkedConditionKey.size());
+    durationProducer.onMatchedLogEvent(
+            2 /* stop index*/, *makeUidLogEvent(tagId, bucketStartTimeNs + 50, 1002, 0, 0));
+    durationProducer.flushIfNeededLocked(bucketStartTimeNs + bucketSizeNs + 1);
+    EXPECT_TRUE(durationProducer.mCurrentSlicedDurationTrackerMap.empty());
+    EXPECT_TRUE(durationProducer.mWhatKeysByLinkedConditionKey.empty());
+}
+
+TEST(DurationMetricProducerTest, TestEncodePastBuckets) {
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    int64_t bucketStartTimeNs = 10000000000;
+    int64_t bucketSizeNs = TimeUnitToBucketSizeInMillis(ONE_MINUTE) * 1000000LL;
+    int tagId = 1;
+
+    DurationMetric metric;
+    metric.set_id(1);
+    metric.set_bucket(ONE_MINUTE);
+    metric.set_aggregation_type(DurationMetric_AggregationType_SUM);
+    DurationMetric encodingMetric = metric;
+    encodingMetric.set_encode_past_buckets(true);
+
+    FieldMatcher dimensions;
+    DurationMetricProducer durationProducer(
+            kConfigKey, metric, -1 /*no condition*/, {}, -1 /*what index not needed*/,
+            1 /* start index */, 2 /* stop index */, 3 /* stop_all index */, false /*nesting*/,
+            wizard, protoHash, dimensions, bucketStartTimeNs, bucketStartTimeNs);
+    DurationMetricProducer encodingProducer(
+            kConfigKey, encodingMetric, -1 /*no condition*/, {}, -1 /*what index not needed*/,
+            1 /* start index */, 2 /* stop index */, 3 /* stop_all index */, false /*nesting*/,
+            wizard, protoHash, dimensions, bucketStartTimeNs, bucketStartTimeNs);
+
+    // The duration spans three buckets, then a partial one is started.
+    for (DurationMetricProducer* producer : {&durationProducer, &encodingProducer}) {
+        LogEvent startEvent(/*uid=*/0, /*pid=*/0);
+        makeLogEvent(&startEvent, bucketStartTimeNs + 1, tagId);
+        producer->onMatchedLogEvent(1 /* start index*/, startEvent);
+        LogEvent stopEvent(/*uid=*/0, /*pid=*/0);
+        makeLogEvent(&stopEvent, bucketStartTimeNs + 2 * bucketSizeNs + 2, tagId);
+        producer->onMatchedLogEvent(2 /* stop index*/, stopEvent);
+        producer->flushIfNeededLocked(bucketStartTimeNs + 3 * bucketSizeNs + 1);
+    }
+
+    EXPECT_TRUE(encodingProducer.mPastBuckets.empty());
+    ASSERT_EQ(1UL, encodingProducer.mEncodedPastBuckets.getDimensions().size());
+    EXPECT_EQ(3UL, encodingProducer.mEncodedPastBuckets.getNumWindows());
+    vector<int64_t> durations;
+    encodingProducer.mEncodedPastBuckets.forEachBucket(
+            encodingProducer.mEncodedPastBuckets.getDimensions().begin()->second,
+            /*numValues=*/2, [&](int64_t, int64_t, const int64_t* values) {
+                durations.push_back(values[0]);
+            });
+    EXPECT_THAT(durations, ElementsAre(bucketSizeNs - 1, bucketSizeNs, 2));
+    EXPECT_LT(encodingProducer.byteSize(), durationProducer.byteSize());
+
+    // The reports are the same.
+    const int64_t dumpTimeNs = bucketStartTimeNs + 3 * bucketSizeNs + 10;
+    vector<StatsLogReport> reports;
+    for (DurationMetricProducer* producer : {&durationProducer, &encodingProducer}) {
+        ProtoOutputStream output;
+        ReportStringTable strSet;
+        producer->onDumpReport(dumpTimeNs, true /* include current partial bucket*/,
+                               true /* erase data */, FAST, &strSet, &output);
+        reports.push_back(outputStreamToProto(&output));
+    }
+    ASSERT_EQ(1, reports[0].duration_metrics().data_size());
+    EXPECT_EQ(reports[0].SerializeAsString(), reports[1].SerializeAsString());
+    EXPECT_TRUE(encodingProducer.mEncodedPastBuckets.empty());
+    EXPECT_EQ(0UL, encodingProducer.byteSize());
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -89,7 +89,7 @@ TEST_F(EventMetricProducerTest, TestNoCondition) {
 
     // Check dump report content.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     eventProducer.onDumpReport(bucketStartTimeNs + 20, true /*include current partial bucket*/,
                                true /*erase data*/, FAST, &strSet, &output);
 
@@ -131,7 +131,7 @@ TEST_F(EventMetricProducerTest, TestEventsWithNonSlicedCondition) {
 
     // Check dump report content.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     eventProducer.onDumpReport(bucketStartTimeNs + 20, true /*include current partial bucket*/,
                                true /*erase data*/, FAST, &strSet, &output);
 
@@ -184,7 +184,7 @@ TEST_F(EventMetricProducerTest, TestEventsWithSlicedCondition) {
 
     // Check dump report content.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     eventProducer.onDumpReport(bucketStartTimeNs + 20, true /*include current partial bucket*/,
                                true /*erase data*/, FAST, &strSet, &output);
 
@@ -223,7 +223,7 @@ TEST_F(EventMetricProducerTest, TestOneAtomTagAggregatedEvents) {
 
     // Check dump report content.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     eventProducer.onDumpReport(bucketStartTimeNs + 50, true /*include current partial bucket*/,
                                true /*erase data*/, FAST, &strSet, &output);
 
@@ -275,7 +275,7 @@ TEST_F(EventMetricProducerTest, TestBytesFieldAggregatedEvents) {
 
     // Check dump report content.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     eventProducer.onDumpReport(bucketStartTimeNs + 50, true /*include current partial bucket*/,
                                true /*erase data*/, FAST, &strSet, &output);
 
@@ -323,7 +323,7 @@ TEST_F(EventMetricProducerTest, TestTwoAtomTagAggregatedEvents) {
 
     // Check dump report content.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     eventProducer.onDumpReport(bucketStartTimeNs + 50, true /*include current partial bucket*/,
                                true /*erase data*/, FAST, &strSet, &output);
 
@@ -343,6 +343,71 @@ TEST_F(EventMetricProducerTest, TestTwoAtomTagAggregatedEvents) {
         }
     }
 }
+
+TEST_F(EventMetricProducerTest, TestMaxBytesEvictsOldestAtoms) {
+    int64_t bucketStartTimeNs = 10000000000;
+    int tagId = 1;
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+
+    // Size of one distinct atom with one timestamp.
+    EventMetric metric;
+    metric.set_id(1);
+    metric.set_max_bytes(1000000);
+    LogEvent sizeEvent(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&sizeEvent, tagId, bucketStartTimeNs, "000");
+    EventMetricProducer sizeProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, {},
+                                     wizard, protoHash, bucketStartTimeNs);
+    sizeProducer.onMatchedLogEvent(1 /*matcher index*/, sizeEvent);
+    const size_t atomSize = sizeProducer.byteSize();
+
+    metric.set_max_bytes(2 * atomSize);
+    EventMetricProducer eventProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, {},
+                                      wizard, protoHash, bucketStartTimeNs);
+
+    LogEvent event1(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event1, tagId, bucketStartTimeNs + 10, "111");
+    LogEvent event2(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event2, tagId, bucketStartTimeNs + 20, "222");
+    LogEvent event3(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event3, tagId, bucketStartTimeNs + 30, "333");
+    LogEvent event4(/*uid=*/0, /*pid=*/0);
+    makeLogEvent(&event4, tagId, bucketStartTimeNs + 40, "333");
+
+    eventProducer.onMatchedLogEvent(1 /*matcher index*/, event1);
+    eventProducer.onMatchedLogEvent(1 /*matcher index*/, event2);
+    EXPECT_EQ(2 * atomSize, eventProducer.byteSize());
+
+    // "111" is the oldest atom.
+    eventProducer.onMatchedLogEvent(1 /*matcher index*/, event3);
+    EXPECT_EQ(2 * atomSize, eventProducer.byteSize());
+
+    // Another timestamp of "333" does not fit with "222".
+    eventProducer.onMatchedLogEvent(1 /*matcher index*/, event4);
+    EXPECT_LE(eventProducer.byteSize(), 2 * atomSize);
+
+    ProtoOutputStream output;
+    ReportStringTable strSet;
+    eventProducer.onDumpReport(bucketStartTimeNs + 50, true /*include current partial bucket*/,
+                               true /*erase data*/, FAST, &strSet, &output);
+
+    StatsLogReport report = outputStreamToProto(&output);
+    EXPECT_TRUE(report.has_event_metrics());
+    EXPECT_EQ(2, report.event_metrics().evicted_atom_count());
+    ASSERT_EQ(1, report.event_metrics().data_size());
+    const AggregatedAtomInfo& atomInfo = report.event_metrics().data(0).aggregated_atom_info();
+    ASSERT_EQ(2, atomInfo.elapsed_timestamp_nanos_size());
+    EXPECT_EQ(bucketStartTimeNs + 30, atomInfo.elapsed_timestamp_nanos(0));
+    EXPECT_EQ(bucketStartTimeNs + 40, atomInfo.elapsed_timestamp_nanos(1));
+
+    // The evicted atoms are only reported once.
+    EXPECT_EQ(0, eventProducer.byteSize());
+    ProtoOutputStream output2;
+    eventProducer.onDumpReport(bucketStartTimeNs + 60, true /*include current partial bucket*/,
+                               true /*erase data*/, FAST, &strSet, &output2);
+    report = outputStreamToProto(&output2);
+    EXPECT_FALSE(report.event_metrics().has_evicted_atom_count());
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -890,7 +890,7 @@ TEST(GaugeMetricProducerTest_BucketDrop, TestBucketDropWhenBucketTooSmall) {
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     gaugeProducer.onDumpReport(bucketStartTimeNs + 9000000, true /* include recent buckets */, true,
                                FAST /* dump_latency */, &strSet, &output);
 
@@ -910,6 +910,141 @@ TEST(GaugeMetricProducerTest_BucketDrop, TestBucketDropWhenBucketTooSmall) {
     EXPECT_EQ(NanoToMillis(bucketStartTimeNs + 9000000), dropEvent.drop_time_millis());
 }
 
+TEST(GaugeMetricProducerTest, TestReservoirSampling) {
+    GaugeMetric metric;
+    metric.set_id(metricId);
+    metric.set_bucket(ONE_MINUTE);
+    metric.set_sampling_type(GaugeMetric::FIRST_N_SAMPLES);
+    metric.set_max_num_gauge_atoms_per_bucket(2);
+    metric.set_use_reservoir_sampling(true);
+    metric.mutable_gauge_fields_filter()->set_include_all(true);
+
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    sp<EventMatcherWizard> eventMatcherWizard =
+            createEventMatcherWizard(tagId, logEventMatcherIndex);
+    sp<MockStatsPullerManager> pullerManager = new StrictMock<MockStatsPullerManager>();
+
+    GaugeMetricProducer gaugeProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, {},
+                                      wizard, protoHash, logEventMatcherIndex, eventMatcherWizard,
+                                      -1 /* -1 means no pulling */, -1, tagId, bucketStartTimeNs,
+                                      bucketStartTimeNs, pullerManager);
+    gaugeProducer.prepareFirstBucket();
+
+    for (int i = 0; i < 20; i++) {
+        LogEvent event(/*uid=*/0, /*pid=*/0);
+        CreateRepeatedValueLogEvent(&event, tagId, bucketStartTimeNs + 10 + i, i);
+        gaugeProducer.onMatchedLogEvent(1 /*log matcher index*/, event);
+    }
+
+    // The dimension keeps its 2 atoms while all of them are counted.
+    ASSERT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
+    EXPECT_EQ(2UL, gaugeProducer.mCurrentSlicedBucket->begin()->second.size());
+    ASSERT_EQ(1UL, gaugeProducer.mCurrentSampledAtomCounts.size());
+    EXPECT_EQ(20, gaugeProducer.mCurrentSampledAtomCounts.begin()->second);
+
+    gaugeProducer.flushIfNeededLocked(bucket2StartTimeNs + 1);
+    ASSERT_EQ(1UL, gaugeProducer.mPastBuckets.size());
+    const vector<GaugeBucket>& buckets = gaugeProducer.mPastBuckets.begin()->second;
+    ASSERT_EQ(1UL, buckets.size());
+    EXPECT_EQ(20, buckets[0].mSampledAtomCount);
+    int64_t atomCount = 0;
+    for (const auto& [_, elapsedTimestampsNs] : buckets[0].mAggregatedAtoms) {
+        atomCount += elapsedTimestampsNs.size();
+    }
+    EXPECT_EQ(2, atomCount);
+    EXPECT_EQ(0UL, gaugeProducer.mCurrentSampledAtomCounts.size());
+}
+
+TEST(GaugeMetricProducerTest, TestAtomValuesSharedAcrossDimensions) {
+    GaugeMetric metric;
+    metric.set_id(metricId);
+    metric.set_bucket(ONE_MINUTE);
+    metric.set_sampling_type(GaugeMetric::FIRST_N_SAMPLES);
+    *metric.mutable_dimensions_in_what() = CreateDimensions(tagId, {1 /* uid */});
+    auto gaugeFieldMatcher = metric.mutable_gauge_fields_filter()->mutable_fields();
+    gaugeFieldMatcher->set_field(tagId);
+    gaugeFieldMatcher->add_child()->set_field(2);
+
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    sp<EventMatcherWizard> eventMatcherWizard =
+            createEventMatcherWizard(tagId, logEventMatcherIndex);
+    sp<MockStatsPullerManager> pullerManager = new StrictMock<MockStatsPullerManager>();
+
+    GaugeMetricProducer gaugeProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, {},
+                                      wizard, protoHash, logEventMatcherIndex, eventMatcherWizard,
+                                      -1 /* -1 means no pulling */, -1, tagId, bucketStartTimeNs,
+                                      bucketStartTimeNs, pullerManager);
+    gaugeProducer.prepareFirstBucket();
+
+    for (int64_t bucketStartNs : {bucketStartTimeNs, bucket2StartTimeNs}) {
+        for (int uid : {1001, 1002}) {
+            shared_ptr<LogEvent> event = makeUidLogEvent(tagId, bucketStartNs + 10, uid, 5, 10);
+            gaugeProducer.onMatchedLogEvent(1 /*log matcher index*/, *event);
+        }
+    }
+    gaugeProducer.flushIfNeededLocked(bucket3StartTimeNs + 1);
+
+    // The 4 atoms are identical once the uid is filtered out, so they share their values.
+    ASSERT_EQ(2UL, gaugeProducer.mPastBuckets.size());
+    const HashableDimensionKey* atomValues = nullptr;
+    for (const auto& [_, buckets] : gaugeProducer.mPastBuckets) {
+        ASSERT_EQ(2UL, buckets.size());
+        for (const GaugeBucket& bucket : buckets) {
+            ASSERT_EQ(1UL, bucket.mAggregatedAtoms.size());
+            const HashableDimensionKey& values =
+                    bucket.mAggregatedAtoms.begin()->first.getAtomFieldValues();
+            if (atomValues == nullptr) {
+                atomValues = &values;
+            }
+            EXPECT_EQ(atomValues, &values);
+        }
+    }
+    EXPECT_EQ(1UL, gaugeProducer.mInternedAtomValues.size());
+
+    gaugeProducer.clearPastBucketsLocked(bucket3StartTimeNs + 2);
+    EXPECT_EQ(0UL, gaugeProducer.mInternedAtomValues.size());
+}
+
+TEST(GaugeMetricProducerTest, TestConditionTrueNs) {
+    GaugeMetric metric;
+    metric.set_id(metricId);
+    metric.set_bucket(ONE_MINUTE);
+    metric.set_sampling_type(GaugeMetric::FIRST_N_SAMPLES);
+    metric.mutable_gauge_fields_filter()->set_include_all(true);
+    metric.set_condition(StringToId("SCREEN_ON"));
+
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    sp<EventMatcherWizard> eventMatcherWizard =
+            createEventMatcherWizard(tagId, logEventMatcherIndex);
+    sp<MockStatsPullerManager> pullerManager = new StrictMock<MockStatsPullerManager>();
+
+    GaugeMetricProducer gaugeProducer(kConfigKey, metric, 0 /*condition index*/,
+                                      {ConditionState::kUnknown}, wizard, protoHash,
+                                      logEventMatcherIndex, eventMatcherWizard,
+                                      -1 /* -1 means no pulling */, -1, tagId, bucketStartTimeNs,
+                                      bucketStartTimeNs, pullerManager);
+    gaugeProducer.prepareFirstBucket();
+
+    gaugeProducer.onConditionChanged(true, bucketStartTimeNs + 10);
+    LogEvent event(/*uid=*/0, /*pid=*/0);
+    CreateRepeatedValueLogEvent(&event, tagId, bucketStartTimeNs + 20, 1);
+    gaugeProducer.onMatchedLogEvent(1 /*log matcher index*/, event);
+    gaugeProducer.onConditionChanged(false, bucketStartTimeNs + 50);
+    gaugeProducer.flushIfNeededLocked(bucket2StartTimeNs + 1);
+
+    ASSERT_EQ(1UL, gaugeProducer.mPastBuckets.size());
+    ASSERT_EQ(1UL, gaugeProducer.mPastBuckets.begin()->second.size());
+    EXPECT_EQ(40, gaugeProducer.mPastBuckets.begin()->second[0].mConditionTrueNs);
+
+    ProtoOutputStream output;
+    gaugeProducer.onDumpReport(bucket2StartTimeNs + 10, false /* include recent buckets */, true,
+                               FAST /* dump_latency */, /*str_set=*/nullptr, &output);
+    StatsLogReport report = outputStreamToProto(&output);
+    ASSERT_EQ(1, report.gauge_metrics().data_size());
+    ASSERT_EQ(1, report.gauge_metrics().data(0).bucket_info_size());
+    EXPECT_EQ(40, report.gauge_metrics().data(0).bucket_info(0).condition_true_nanos());
+}
+
 TEST(GaugeMetricProducerTest, TestPullDimensionalSampling) {
     ShardOffsetProvider::getInstance().setShardOffset(5);
 
@@ -971,7 +1106,7 @@ TEST(GaugeMetricProducerTest, TestPullDimensionalSampling) {
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 10000000000;
     gaugeProducer.onDumpReport(dumpReportTimeNs, true /* include current buckets */, true,
                                NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
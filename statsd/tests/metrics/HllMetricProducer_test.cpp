@@ -0,0 +1,139 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/metrics/HllMetricProducer.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "metrics_test_helper.h"
+#include "src/FieldValue.h"
+#include "src/metrics/MetricProducer.h"
+#include "src/stats_log_util.h"
+#include "tests/statsd_test_util.h"
+
+using namespace testing;
+using android::sp;
+using std::optional;
+using std::vector;
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+const ConfigKey kConfigKey(0, 12345);
+const int atomId = 1;
+const int64_t metricId = 123;
+const uint64_t protoHash = 0x1234567890;
+const int logEventMatcherIndex = 0;
+const int64_t bucketStartTimeNs = 10000000000;
+const int64_t bucketSizeNs = TimeUnitToBucketSizeInMillis(ONE_MINUTE) * 1000000LL;
+const int64_t bucket2StartTimeNs = bucketStartTimeNs + bucketSizeNs;
+
+HllMetric createMetric() {
+    HllMetric metric;
+    metric.set_id(metricId);
+    metric.set_bucket(ONE_MINUTE);
+    metric.mutable_hll_field()->set_field(atomId);
+    metric.mutable_hll_field()->add_child()->set_field(2);
+    return metric;
+}
+
+sp<HllMetricProducer> createHllProducer(const HllMetric& metric) {
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    const int64_t bucketSizeNs = MillisToNano(
+            TimeUnitToBucketSizeInMillisGuardrailed(kConfigKey.GetUid(), metric.bucket()));
+    vector<Matcher> fieldMatchers;
+    translateFieldMatcher(metric.hll_field(), &fieldMatchers);
+    const auto [dimensionSoftLimit, dimensionHardLimit] =
+            StatsdStats::getAtomDimensionKeySizeLimits(atomId,
+                                                       StatsdStats::kDimensionKeySizeHardLimitMin);
+    return new HllMetricProducer(
+            kConfigKey, metric, protoHash, {/*pullAtomId=*/-1, /*pullerManager=*/nullptr},
+            {bucketStartTimeNs, bucketStartTimeNs, bucketSizeNs, metric.min_bucket_size_nanos(),
+             /*conditionCorrectionThresholdNs=*/nullopt, metric.split_bucket_for_app_upgrade()},
+            {HasPositionANY(metric.dimensions_in_what()),
+             ShouldUseNestedDimensions(metric.dimensions_in_what()), logEventMatcherIndex,
+             /*eventMatcherWizard=*/nullptr, metric.dimensions_in_what(), fieldMatchers},
+            {/*conditionIndex=*/-1, metric.links(), /*initialConditionCache=*/{}, wizard},
+            {metric.state_link(), /*slicedStateAtoms=*/{}, /*stateGroupMap=*/{}},
+            {/*eventActivationMap=*/{}, /*eventDeactivationMap=*/{}},
+            {dimensionSoftLimit, dimensionHardLimit});
+}
+
+}  // anonymous namespace
+
+TEST(HllMetricProducerTest, TestPushedEventsWithoutCondition) {
+    HllMetric metric = createMetric();
+    metric.set_precision(10);
+    sp<HllMetricProducer> hllProducer = createHllProducer(metric);
+
+    int64_t eventTimeNs = bucketStartTimeNs + 10;
+    for (int value : {10, 20, 10, 30, 20}) {
+        LogEvent event(/*uid=*/0, /*pid=*/0);
+        CreateRepeatedValueLogEvent(&event, atomId, eventTimeNs++, value);
+        hllProducer->onMatchedLogEvent(1 /*log matcher index*/, event);
+    }
+    ASSERT_EQ(1UL, hllProducer->mCurrentSlicedBucket.size());
+    const HllMetricProducer::Interval& curInterval =
+            hllProducer->mCurrentSlicedBucket.begin()->second.intervals[0];
+    EXPECT_EQ(5, curInterval.sampleSize);
+    EXPECT_EQ(3, curInterval.aggregate->estimate());
+
+    ProtoOutputStream output;
+    hllProducer->onDumpReport(bucket2StartTimeNs + 10, /*include current partial bucket*/ false,
+                              /*erase data*/ true, FAST, /*strSet=*/nullptr, &output);
+    StatsLogReport report = outputStreamToProto(&output);
+    ASSERT_TRUE(report.has_hll_metrics());
+    ASSERT_EQ(1, report.hll_metrics().data_size());
+    ASSERT_EQ(1, report.hll_metrics().data(0).bucket_info_size());
+    const HllBucketInfo& bucketInfo = report.hll_metrics().data(0).bucket_info(0);
+    EXPECT_EQ(0, bucketInfo.bucket_num());
+    ASSERT_EQ(1, bucketInfo.sketches_size());
+    EXPECT_EQ(0, bucketInfo.sketches(0).index());
+    EXPECT_EQ(10, bucketInfo.sketches(0).precision());
+    EXPECT_EQ(1024UL, bucketInfo.sketches(0).registers().size());
+    EXPECT_EQ(3, bucketInfo.sketches(0).estimate());
+}
+
+TEST(HllMetricProducerTest, TestByteSize) {
+    sp<HllMetricProducer> hllProducer = createHllProducer(createMetric());
+
+    LogEvent event1(/*uid=*/0, /*pid=*/0);
+    CreateRepeatedValueLogEvent(&event1, atomId, bucketStartTimeNs + 10, 10);
+    LogEvent event2(/*uid=*/0, /*pid=*/0);
+    CreateRepeatedValueLogEvent(&event2, atomId, bucketStartTimeNs + 20, 20);
+
+    hllProducer->onMatchedLogEvent(1 /*log matcher index*/, event1);
+    hllProducer->onMatchedLogEvent(1 /*log matcher index*/, event2);
+    hllProducer->flushIfNeededLocked(bucket2StartTimeNs);
+
+    // The registers of the sketch do not depend on the number of values.
+    const size_t expectedSize = hllProducer->kBucketSize + 4 /* one int aggIndex entry */ +
+                                (1 << HyperLogLog::kDefaultPrecision);
+    EXPECT_EQ(expectedSize, hllProducer->byteSize());
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
@@ -61,8 +61,8 @@ const int64_t bucket5StartTimeNs = bucketStartTimeNs + 4 * bucketSizeNs;
 const int64_t bucket6StartTimeNs = bucketStartTimeNs + 5 * bucketSizeNs;
 
 static void assertPastBucketsSingleKey(
-        const std::unordered_map<MetricDimensionKey,
-                                 std::vector<PastBucket<unique_ptr<KllQuantile>>>>& mPastBuckets,
+        const FlatHashMap<MetricDimensionKey, std::vector<PastBucket<unique_ptr<KllQuantile>>>>&
+                mPastBuckets,
         const std::initializer_list<int>& expectedKllCountsList,
         const std::initializer_list<int64_t>& expectedDurationNsList,
         const std::initializer_list<int64_t>& expectedStartTimeNsList,
@@ -312,7 +312,7 @@ TEST(KllMetricProducerTest_BucketDrop, TestInvalidBucketWhenConditionUnknown) {
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 10000;
     kllProducer->onDumpReport(dumpReportTimeNs, true /* include recent buckets */, true,
                               NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -350,7 +350,7 @@ TEST(KllMetricProducerTest_BucketDrop, TestBucketDropWhenBucketTooSmall) {
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 9000000;
     kllProducer->onDumpReport(dumpReportTimeNs, true /* include recent buckets */, true,
                               NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -382,7 +382,7 @@ TEST(KllMetricProducerTest_BucketDrop, TestBucketDropWhenDataUnavailable) {
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 10000000000;  // 10 seconds
     kllProducer->onDumpReport(dumpReportTimeNs, true /* include current bucket */, true,
                               NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -418,7 +418,7 @@ TEST(KllMetricProducerTest, TestForcedBucketSplitWhenConditionUnknownSkipsBucket
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 10000000000;  // 10 seconds
     kllProducer->onDumpReport(dumpReportTimeNs, false /* include current buckets */, true,
                               NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -460,6 +460,79 @@ TEST(KllMetricProducerTest, TestByteSize) {
     EXPECT_EQ(expectedSize, kllProducer->byteSize());
 }
 
+TEST(KllMetricProducerTest, TestDimensionsRollup) {
+    KllMetric metric = KllMetricProducerTestHelper::createMetric();
+    *metric.mutable_dimensions_in_what() = CreateDimensions(atomId, {1});
+    metric.set_emit_dimensions_rollup(true);
+    sp<KllMetricProducer> kllProducer =
+            KllMetricProducerTestHelper::createKllProducerNoConditions(metric);
+    EXPECT_TRUE(kllProducer->mEmitDimensionsRollup);
+
+    LogEvent event1(/*uid=*/0, /*pid=*/0);
+    CreateRepeatedValueLogEvent(&event1, atomId, bucketStartTimeNs + 10, 10);
+    LogEvent event2(/*uid=*/0, /*pid=*/0);
+    CreateRepeatedValueLogEvent(&event2, atomId, bucketStartTimeNs + 20, 20);
+    LogEvent event3(/*uid=*/0, /*pid=*/0);
+    CreateRepeatedValueLogEvent(&event3, atomId, bucketStartTimeNs + 30, 10);
+    LogEvent event4(/*uid=*/0, /*pid=*/0);
+    CreateRepeatedValueLogEvent(&event4, atomId, bucket2StartTimeNs + 10, 20);
+    kllProducer->onMatchedLogEvent(1 /*log matcher index*/, event1);
+    kllProducer->onMatchedLogEvent(1 /*log matcher index*/, event2);
+    kllProducer->onMatchedLogEvent(1 /*log matcher index*/, event3);
+    kllProducer->onMatchedLogEvent(1 /*log matcher index*/, event4);
+
+    ProtoOutputStream output;
+    ReportStringTable strSet;
+    kllProducer->onDumpReport(bucket3StartTimeNs + 10, /*include current partial bucket*/ false,
+                              /*erase data*/ true, FAST, &strSet, &output);
+    StatsLogReport report = outputStreamToProto(&output);
+    ASSERT_TRUE(report.has_kll_metrics());
+    ASSERT_EQ(2, report.kll_metrics().data_size());
+
+    // One rolled up sketch per bucket, holding the values of all dimensions.
+    ASSERT_EQ(2, report.kll_metrics().dimensions_rollup_size());
+    const std::vector<int64_t> expectedNumValues = {3, 1};
+    for (int i = 0; i < 2; i++) {
+        const KllBucketInfo& rollup = report.kll_metrics().dimensions_rollup(i);
+        EXPECT_EQ(i, rollup.bucket_num());
+        ASSERT_EQ(1, rollup.sketches_size());
+        EXPECT_EQ(0, rollup.sketches(0).index());
+        zetasketch::android::AggregatorStateProto aggProto;
+        ASSERT_TRUE(aggProto.ParseFromString(rollup.sketches(0).kll_sketch()));
+        EXPECT_EQ(expectedNumValues[i], aggProto.num_values());
+    }
+}
+
+TEST(KllMetricProducerTest, TestSketchesRecycled) {
+    const KllMetric& metric = KllMetricProducerTestHelper::createMetric();
+    sp<KllMetricProducer> kllProducer =
+            KllMetricProducerTestHelper::createKllProducerNoConditions(metric);
+
+    LogEvent event1(/*uid=*/0, /*pid=*/0);
+    CreateRepeatedValueLogEvent(&event1, atomId, bucketStartTimeNs + 10, 10);
+    kllProducer->onMatchedLogEvent(1 /*log matcher index*/, event1);
+    const KllQuantile* sketch =
+            kllProducer->mCurrentSlicedBucket.begin()->second.intervals[0].aggregate.get();
+
+    ProtoOutputStream output;
+    kllProducer->onDumpReport(bucket2StartTimeNs + 10, /*include current partial bucket*/ false,
+                              /*erase data*/ true, FAST, /*strSet=*/nullptr, &output);
+    EXPECT_EQ(0UL, kllProducer->mPastBuckets.size());
+    ASSERT_EQ(1UL, kllProducer->mFreeSketches.size());
+    EXPECT_EQ(sketch, kllProducer->mFreeSketches[0].get());
+    EXPECT_EQ(0, kllProducer->mFreeSketches[0]->num_values());
+
+    // The next bucket reuses the reset sketch.
+    LogEvent event2(/*uid=*/0, /*pid=*/0);
+    CreateRepeatedValueLogEvent(&event2, atomId, bucket2StartTimeNs + 20, 20);
+    kllProducer->onMatchedLogEvent(1 /*log matcher index*/, event2);
+    EXPECT_EQ(0UL, kllProducer->mFreeSketches.size());
+    const KllQuantile* reused =
+            kllProducer->mCurrentSlicedBucket.begin()->second.intervals[0].aggregate.get();
+    EXPECT_EQ(sketch, reused);
+    EXPECT_EQ(1, reused->num_values());
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -61,7 +61,7 @@ const int64_t bucket6StartTimeNs = bucketStartTimeNs + 5 * bucketSizeNs;
 double epsilon = 0.001;
 
 static void assertPastBucketValuesSingleKey(
-        const std::unordered_map<MetricDimensionKey, std::vector<PastBucket<Value>>>& mPastBuckets,
+        const FlatHashMap<MetricDimensionKey, std::vector<PastBucket<Value>>>& mPastBuckets,
         const std::initializer_list<int>& expectedValuesList,
         const std::initializer_list<int64_t>& expectedDurationNsList,
         const std::initializer_list<int64_t>& expectedCorrectionNsList,
@@ -401,6 +401,40 @@ TEST(NumericValueMetricProducerTest, TestPulledEventsNoCondition) {
                                     {bucket2StartTimeNs, bucket3StartTimeNs, bucket4StartTimeNs});
 }
 
+TEST(NumericValueMetricProducerTest, TestPulledEventsSameDimensionSummed) {
+    ValueMetric metric = NumericValueMetricProducerTestHelper::createMetric();
+    sp<MockStatsPullerManager> pullerManager = new StrictMock<MockStatsPullerManager>();
+    EXPECT_CALL(*pullerManager, Pull(tagId, kConfigKey, bucketStartTimeNs, _))
+            .WillOnce(Invoke([](int tagId, const ConfigKey&, const int64_t,
+                                vector<std::shared_ptr<LogEvent>>* data) {
+                data->clear();
+                data->push_back(CreateRepeatedValueLogEvent(tagId, bucketStartTimeNs, 3));
+                data->push_back(CreateRepeatedValueLogEvent(tagId, bucketStartTimeNs, 4));
+                return true;
+            }));
+
+    sp<NumericValueMetricProducer> valueProducer =
+            NumericValueMetricProducerTestHelper::createValueProducerNoConditions(pullerManager,
+                                                                                  metric);
+    ASSERT_EQ(1UL, valueProducer->mDimInfos.size());
+    optional<Value> curBase = valueProducer->mDimInfos.begin()->second.dimExtras[0];
+    EXPECT_EQ(true, curBase.has_value());
+    EXPECT_EQ(7, curBase.value().long_value);
+
+    vector<shared_ptr<LogEvent>> allData;
+    allData.push_back(CreateRepeatedValueLogEvent(tagId, bucket2StartTimeNs + 1, 11));
+    allData.push_back(CreateRepeatedValueLogEvent(tagId, bucket2StartTimeNs + 1, 5));
+    valueProducer->onDataPulled(allData, PullResult::PULL_RESULT_SUCCESS, bucket2StartTimeNs);
+
+    // The rows of the dimension are summed before taking the diff.
+    ASSERT_EQ(1UL, valueProducer->mDimInfos.size());
+    curBase = valueProducer->mDimInfos.begin()->second.dimExtras[0];
+    EXPECT_EQ(true, curBase.has_value());
+    EXPECT_EQ(16, curBase.value().long_value);
+    assertPastBucketValuesSingleKey(valueProducer->mPastBuckets, {9}, {bucketSizeNs}, {0},
+                                    {bucketStartTimeNs}, {bucket2StartTimeNs});
+}
+
 TEST_P(NumericValueMetricProducerTest_PartialBucket, TestPartialBucketCreated) {
     ValueMetric metric = NumericValueMetricProducerTestHelper::createMetric();
     sp<MockStatsPullerManager> pullerManager = new StrictMock<MockStatsPullerManager>();
@@ -943,6 +977,83 @@ TEST(NumericValueMetricProducerTest, TestPushedEventsWithoutCondition) {
     ASSERT_EQ(0UL, valueProducer->mCurrentSlicedBucket.size());
 }
 
+TEST(NumericValueMetricProducerTest, TestIntervalsRecycledAcrossBuckets) {
+    ValueMetric metric = NumericValueMetricProducerTestHelper::createMetric();
+
+    sp<EventMatcherWizard> eventMatcherWizard =
+            createEventMatcherWizard(tagId, logEventMatcherIndex);
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    sp<MockStatsPullerManager> pullerManager = new StrictMock<MockStatsPullerManager>();
+
+    sp<NumericValueMetricProducer> valueProducer =
+            NumericValueMetricProducerTestHelper::createValueProducerNoConditions(
+                    pullerManager, metric, /*pullAtomId=*/-1);
+
+    LogEvent event1(/*uid=*/0, /*pid=*/0);
+    CreateRepeatedValueLogEvent(&event1, tagId, bucketStartTimeNs + 10, 10);
+    valueProducer->onMatchedLogEvent(1 /*log matcher index*/, event1);
+    ASSERT_EQ(1UL, valueProducer->mCurrentSlicedBucket.size());
+    const NumericValueMetricProducer::Interval* intervals =
+            valueProducer->mCurrentSlicedBucket.begin()->second.intervals.data();
+
+    valueProducer->flushIfNeededLocked(bucket2StartTimeNs + 10);
+    ASSERT_EQ(0UL, valueProducer->mCurrentSlicedBucket.size());
+    ASSERT_EQ(1UL, valueProducer->mRecycledIntervals.size());
+
+    // The new dimension of the next bucket reuses the intervals, without the previous values.
+    LogEvent event2(/*uid=*/0, /*pid=*/0);
+    CreateRepeatedValueLogEvent(&event2, tagId, bucket2StartTimeNs + 20, 20);
+    valueProducer->onMatchedLogEvent(1 /*log matcher index*/, event2);
+    ASSERT_EQ(1UL, valueProducer->mCurrentSlicedBucket.size());
+    EXPECT_EQ(0UL, valueProducer->mRecycledIntervals.size());
+    const auto& curIntervals = valueProducer->mCurrentSlicedBucket.begin()->second.intervals;
+    EXPECT_EQ(intervals, curIntervals.data());
+    ASSERT_EQ(1UL, curIntervals.size());
+    EXPECT_EQ(20, curIntervals[0].aggregate.long_value);
+    EXPECT_EQ(1, curIntervals[0].sampleSize);
+
+    ASSERT_EQ(1UL, valueProducer->mPastBuckets.size());
+    ASSERT_EQ(1UL, valueProducer->mPastBuckets.begin()->second.size());
+    EXPECT_EQ(10, valueProducer->mPastBuckets.begin()->second[0].aggregates[0].long_value);
+}
+
+TEST(NumericValueMetricProducerTest, TestHotDimensions) {
+    StatsdStats::getInstance().reset();
+    ValueMetric metric = NumericValueMetricProducerTestHelper::createMetric();
+
+    sp<MockStatsPullerManager> pullerManager = new StrictMock<MockStatsPullerManager>();
+    sp<NumericValueMetricProducer> valueProducer =
+            NumericValueMetricProducerTestHelper::createValueProducerNoConditions(
+                    pullerManager, metric, /*pullAtomId=*/-1);
+
+    // The dimension is added to the hot dimensions by its second event, once it has a state.
+    for (int i = 1; i <= 3; i++) {
+        LogEvent event(/*uid=*/0, /*pid=*/0);
+        CreateRepeatedValueLogEvent(&event, tagId, bucketStartTimeNs + 10 * i, 10 * i);
+        valueProducer->onMatchedLogEvent(1 /*log matcher index*/, event);
+    }
+    EXPECT_EQ(1UL, valueProducer->mNumHotDimensions);
+    EXPECT_EQ(1, valueProducer->mHotDimensionHits);
+    EXPECT_EQ(2, valueProducer->mHotDimensionMisses);
+    ASSERT_EQ(1UL, valueProducer->mCurrentSlicedBucket.size());
+    const auto& intervals = valueProducer->mCurrentSlicedBucket.begin()->second.intervals;
+    EXPECT_EQ(60, intervals[0].aggregate.long_value);
+    EXPECT_EQ(3, intervals[0].sampleSize);
+
+    // The hot dimensions are invalidated by the flush, and the lookups are reported.
+    valueProducer->flushIfNeededLocked(bucket2StartTimeNs + 10);
+    EXPECT_EQ(0UL, valueProducer->mNumHotDimensions);
+    EXPECT_EQ(0, valueProducer->mHotDimensionHits);
+    EXPECT_EQ(0, valueProducer->mHotDimensionMisses);
+    ASSERT_EQ(1UL, valueProducer->mPastBuckets.size());
+    EXPECT_EQ(60, valueProducer->mPastBuckets.begin()->second[0].aggregates[0].long_value);
+
+    StatsdStatsReport report = getStatsdStatsReport();
+    ASSERT_EQ(1, report.atom_metric_stats_size());
+    EXPECT_EQ(1, report.atom_metric_stats(0).hot_dimension_hits());
+    EXPECT_EQ(2, report.atom_metric_stats(0).hot_dimension_misses());
+}
+
 TEST(NumericValueMetricProducerTest, TestPushedEventsWithCondition) {
     ValueMetric metric = NumericValueMetricProducerTestHelper::createMetric();
 
@@ -1803,7 +1914,7 @@ TEST(NumericValueMetricProducerTest, TestUseZeroDefaultBaseWithPullFailures) {
     ASSERT_EQ(1UL, valueProducer->mDimInfos.size());
     const auto& it = valueProducer->mCurrentSlicedBucket.begin();
     NumericValueMetricProducer::Interval& interval1 = it->second.intervals[0];
-    optional<Value>& base1 =
+    DiffBase& base1 =
             valueProducer->mDimInfos.find(it->first.getDimensionKeyInWhat())->second.dimExtras[0];
     EXPECT_EQ(1, it->first.getDimensionKeyInWhat().getValues()[0].mValue.int_value);
     EXPECT_EQ(true, base1.has_value());
@@ -1829,7 +1940,7 @@ TEST(NumericValueMetricProducerTest, TestUseZeroDefaultBaseWithPullFailures) {
             break;
         }
     }
-    optional<Value>& base2 = itBase2->second.dimExtras[0];
+    DiffBase& base2 = itBase2->second.dimExtras[0];
     EXPECT_TRUE(base2 != base1);
     EXPECT_EQ(2, itBase2->first.getValues()[0].mValue.int_value);
     EXPECT_EQ(true, base2.has_value());
@@ -1845,7 +1956,7 @@ TEST(NumericValueMetricProducerTest, TestUseZeroDefaultBaseWithPullFailures) {
     ASSERT_EQ(0UL, valueProducer->mCurrentSlicedBucket.size());
     ASSERT_EQ(1UL, valueProducer->mDimInfos.size());
     EXPECT_EQ(2, valueProducer->mDimInfos.begin()->first.getValues()[0].mValue.int_value);
-    optional<Value>& base3 = valueProducer->mDimInfos.begin()->second.dimExtras[0];
+    DiffBase& base3 = valueProducer->mDimInfos.begin()->second.dimExtras[0];
     EXPECT_EQ(true, base3.has_value());
     EXPECT_EQ(5, base3.value().long_value);
     EXPECT_EQ(true, valueProducer->mHasGlobalBase);
@@ -1858,8 +1969,8 @@ TEST(NumericValueMetricProducerTest, TestUseZeroDefaultBaseWithPullFailures) {
 
     ASSERT_EQ(0UL, valueProducer->mCurrentSlicedBucket.size());
     ASSERT_EQ(2UL, valueProducer->mDimInfos.size());
-    optional<Value>& base4 = valueProducer->mDimInfos.begin()->second.dimExtras[0];
-    optional<Value>& base5 = std::next(valueProducer->mDimInfos.begin())->second.dimExtras[0];
+    DiffBase& base4 = valueProducer->mDimInfos.begin()->second.dimExtras[0];
+    DiffBase& base5 = std::next(valueProducer->mDimInfos.begin())->second.dimExtras[0];
 
     EXPECT_EQ(true, base4.has_value());
     EXPECT_EQ(5, base4.value().long_value);
@@ -2012,7 +2123,7 @@ TEST(NumericValueMetricProducerTest, TestResetBaseOnPullFailAfterConditionChange
     ASSERT_EQ(1UL, valueProducer->mCurrentSlicedBucket.size());
     NumericValueMetricProducer::Interval& curInterval =
             valueProducer->mCurrentSlicedBucket.begin()->second.intervals[0];
-    optional<Value>& curBase = valueProducer->mDimInfos.begin()->second.dimExtras[0];
+    DiffBase& curBase = valueProducer->mDimInfos.begin()->second.dimExtras[0];
     EXPECT_EQ(true, curBase.has_value());
     EXPECT_EQ(100, curBase.value().long_value);
     EXPECT_EQ(0, curInterval.sampleSize);
@@ -2052,7 +2163,7 @@ TEST(NumericValueMetricProducerTest, TestResetBaseOnPullFailAfterConditionChange
     ASSERT_EQ(1UL, valueProducer->mDimInfos.size());
     NumericValueMetricProducer::Interval& curInterval =
             valueProducer->mCurrentSlicedBucket.begin()->second.intervals[0];
-    optional<Value>& curBase = valueProducer->mDimInfos.begin()->second.dimExtras[0];
+    DiffBase& curBase = valueProducer->mDimInfos.begin()->second.dimExtras[0];
     EXPECT_EQ(true, curBase.has_value());
     EXPECT_EQ(100, curBase.value().long_value);
     EXPECT_EQ(0, curInterval.sampleSize);
@@ -2231,7 +2342,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestInvalidBucketWhenOneConditio
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket2StartTimeNs + 10, false /* include partial bucket */, true,
                                 FAST /* dumpLatency */, &strSet, &output);
 
@@ -2293,7 +2404,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestInvalidBucketWhenGuardRailHi
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket2StartTimeNs + 10000, false /* include recent buckets */,
                                 true, FAST /* dumpLatency */, &strSet, &output);
     ASSERT_EQ(true, StatsdStats::getInstance().hasHitDimensionGuardrail(metricId));
@@ -2371,7 +2482,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestInvalidBucketWhenInitialPull
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket2StartTimeNs + 10000, false /* include recent buckets */,
                                 true, FAST /* dumpLatency */, &strSet, &output);
 
@@ -2447,7 +2558,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestInvalidBucketWhenLastPullFai
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket2StartTimeNs + 10000, false /* include recent buckets */,
                                 true, FAST /* dumpLatency */, &strSet, &output);
 
@@ -3034,7 +3145,7 @@ TEST(NumericValueMetricProducerTest, TestFastDumpWithoutCurrentBucket) {
     valueProducer->onDataPulled(allData, PullResult::PULL_RESULT_SUCCESS, bucket2StartTimeNs);
 
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket4StartTimeNs, false /* include recent buckets */, true, FAST,
                                 &strSet, &output);
 
@@ -3075,7 +3186,7 @@ TEST(NumericValueMetricProducerTest, TestPullNeededNoTimeConstraints) {
                                                                                   metric);
 
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucketStartTimeNs + 10, true /* include recent buckets */, true,
                                 NO_TIME_CONSTRAINTS, &strSet, &output);
 
@@ -3275,7 +3386,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestInvalidBucketWhenDumpReportR
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucketStartTimeNs + 40, true /* include recent buckets */, true,
                                 FAST /* dumpLatency */, &strSet, &output);
     ASSERT_EQ(0UL, valueProducer->mCurrentSlicedBucket.size());
@@ -3331,7 +3442,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestInvalidBucketWhenConditionEv
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket2StartTimeNs + 100, true /* include recent buckets */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
 
@@ -3397,7 +3508,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestInvalidBucketWhenAccumulateE
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket2StartTimeNs + 100, true /* include recent buckets */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
 
@@ -3452,7 +3563,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestInvalidBucketWhenConditionUn
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 10000;
     valueProducer->onDumpReport(dumpReportTimeNs, true /* include recent buckets */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -3502,7 +3613,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestInvalidBucketWhenPullFailed)
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 10000;
     valueProducer->onDumpReport(dumpReportTimeNs, true /* include recent buckets */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -3566,7 +3677,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestInvalidBucketWhenMultipleBuc
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(dumpTimeNs, true /* include current buckets */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
 
@@ -3636,7 +3747,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestBucketDropWhenBucketTooSmall
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 9000000;
     valueProducer->onDumpReport(dumpReportTimeNs, true /* include recent buckets */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -3671,7 +3782,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestBucketDropWhenDataUnavailabl
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 10000000000;  // 10 seconds
     valueProducer->onDumpReport(dumpReportTimeNs, true /* include current bucket */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -3739,7 +3850,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestConditionUnknownMultipleBuck
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucket2StartTimeNs + 15 * NS_PER_SEC;  // 15 seconds
     valueProducer->onDumpReport(dumpReportTimeNs, true /* include current bucket */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -3821,7 +3932,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop,
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucket2StartTimeNs + 10000000000;  // 10 seconds
     valueProducer->onDumpReport(dumpReportTimeNs, false /* include current buckets */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -3872,7 +3983,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestMultipleBucketDropEvents) {
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 1000;
     valueProducer->onDumpReport(dumpReportTimeNs, true /* include recent buckets */, true,
                                 FAST /* dumpLatency */, &strSet, &output);
@@ -3955,7 +4066,7 @@ TEST(NumericValueMetricProducerTest_BucketDrop, TestMaxBucketDropEvents) {
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 1000;
     // Because we already have 10 dump events in the current bucket,
     // this case should not be added to the list of dump events.
@@ -4224,7 +4335,7 @@ TEST(NumericValueMetricProducerTest, TestSlicedState) {
 
     // Start dump report and check output.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucketStartTimeNs + 50 * NS_PER_SEC,
                                 true /* include recent buckets */, true, NO_TIME_CONSTRAINTS,
                                 &strSet, &output);
@@ -4518,7 +4629,7 @@ TEST(NumericValueMetricProducerTest, TestSlicedStateWithMap) {
 
     // Start dump report and check output.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucketStartTimeNs + 50 * NS_PER_SEC,
                                 true /* include recent buckets */, true, NO_TIME_CONSTRAINTS,
                                 &strSet, &output);
@@ -4765,7 +4876,7 @@ TEST(NumericValueMetricProducerTest, TestSlicedStateWithPrimaryField_WithDimensi
 
     // Start dump report and check output.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucket2StartTimeNs + 50 * NS_PER_SEC;
     valueProducer->onDumpReport(dumpReportTimeNs, true /* include recent buckets */, true,
                                 NO_TIME_CONSTRAINTS, &strSet, &output);
@@ -5019,7 +5130,7 @@ TEST(NumericValueMetricProducerTest, TestSlicedStateWithMissingDataInStateChange
 
     // Start dump report and check output.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucketStartTimeNs + 50 * NS_PER_SEC,
                                 true /* include recent buckets */, true, NO_TIME_CONSTRAINTS,
                                 &strSet, &output);
@@ -5124,7 +5235,7 @@ TEST(NumericValueMetricProducerTest, TestSlicedStateWithMissingDataThenFlushBuck
 
     // Start dump report and check output.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucketStartTimeNs + 50 * NS_PER_SEC,
                                 true /* include recent buckets */, true, NO_TIME_CONSTRAINTS,
                                 &strSet, &output);
@@ -5317,7 +5428,7 @@ TEST(NumericValueMetricProducerTest, TestSlicedStateWithNoPullOnBucketBoundary)
 
     // Start dump report and check output.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket2StartTimeNs + 50 * NS_PER_SEC,
                                 true /* include recent buckets */, true, NO_TIME_CONSTRAINTS,
                                 &strSet, &output);
@@ -5535,7 +5646,7 @@ TEST(NumericValueMetricProducerTest, TestSlicedStateWithDataMissingInConditionCh
 
     // Start dump report and check output.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucketStartTimeNs + 50 * NS_PER_SEC,
                                 true /* include recent buckets */, true, NO_TIME_CONSTRAINTS,
                                 &strSet, &output);
@@ -5781,7 +5892,7 @@ TEST(NumericValueMetricProducerTest, TestSlicedStateWithMultipleDimensions) {
 
     // Start dump report and check output.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket2StartTimeNs + 50 * NS_PER_SEC,
                                 true /* include recent buckets */, true, NO_TIME_CONSTRAINTS,
                                 &strSet, &output);
@@ -5909,8 +6020,8 @@ TEST(NumericValueMetricProducerTest, TestSlicedStateWithCondition) {
     valueProducer->onConditionChanged(true, bucketStartTimeNs + 20 * NS_PER_SEC);
     // Base for dimension key {}
     ASSERT_EQ(1UL, valueProducer->mDimInfos.size());
-    std::unordered_map<HashableDimensionKey,
-                       NumericValueMetricProducer::DimensionsInWhatInfo>::iterator itBase =
+    FlatHashMap<HashableDimensionKey, NumericValueMetricProducer::DimensionsInWhatInfo>::iterator
+            itBase =
             valueProducer->mDimInfos.find(DEFAULT_DIMENSION_KEY);
     EXPECT_TRUE(itBase->second.dimExtras[0].has_value());
     EXPECT_EQ(3, itBase->second.dimExtras[0].value().long_value);
@@ -5920,7 +6031,7 @@ TEST(NumericValueMetricProducerTest, TestSlicedStateWithCondition) {
               itBase->second.currentState.getValues()[0].mValue.int_value);
     // Value for key {{}, ON}
     ASSERT_EQ(2UL, valueProducer->mCurrentSlicedBucket.size());
-    std::unordered_map<MetricDimensionKey, NumericValueMetricProducer::CurrentBucket>::iterator it =
+    FlatHashMap<MetricDimensionKey, NumericValueMetricProducer::CurrentBucket>::iterator it =
             valueProducer->mCurrentSlicedBucket.begin();
     EXPECT_EQ(0, it->first.getDimensionKeyInWhat().getValues().size());
     ASSERT_EQ(1, it->first.getStateValuesKey().getValues().size());
@@ -6017,7 +6128,7 @@ TEST(NumericValueMetricProducerTest, TestSlicedStateWithCondition) {
 
     // Start dump report and check output.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket2StartTimeNs + 50 * NS_PER_SEC,
                                 true /* include recent buckets */, true, NO_TIME_CONSTRAINTS,
                                 &strSet, &output);
@@ -6165,7 +6276,7 @@ TEST(NumericValueMetricProducerTest, TestSlicedStateWithConditionFalseMultipleBu
 
     // Start dump report and check output.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket3StartTimeNs + 30 * NS_PER_SEC,
                                 true /* include recent buckets */, true, NO_TIME_CONSTRAINTS,
                                 &strSet, &output);
@@ -6365,7 +6476,7 @@ TEST(NumericValueMetricProducerTest, TestSlicedStateWithMultipleDimensionsMissin
 
     // Start dump report and check output.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket2StartTimeNs + 50 * NS_PER_SEC,
                                 true /* include recent buckets */, true, NO_TIME_CONSTRAINTS,
                                 &strSet, &output);
@@ -6474,7 +6585,7 @@ TEST(NumericValueMetricProducerTest, TestForcedBucketSplitWhenConditionUnknownSk
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 10000000000;  // 10 seconds
     valueProducer->onDumpReport(dumpReportTimeNs, false /* include current buckets */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -6540,7 +6651,7 @@ TEST(NumericValueMetricProducerTest, TestUploadThreshold) {
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucket2StartTimeNs + 10000000000;
     valueProducer->onDumpReport(dumpReportTimeNs, true /* include current buckets */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -7022,7 +7133,7 @@ TEST(NumericValueMetricProducerTest_ConditionCorrection, TestThresholdNotDefined
 
     // generate dump report and validate correction value in the reported buckets
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket3StartTimeNs, false /* include partial bucket */, true,
                                 FAST /* dumpLatency */, &strSet, &output);
 
@@ -7078,7 +7189,7 @@ TEST(NumericValueMetricProducerTest_ConditionCorrection, TestThresholdDefinedZer
 
     // generate dump report and validate correction value in the reported buckets
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket3StartTimeNs, false /* include partial bucket */, true,
                                 FAST /* dumpLatency */, &strSet, &output);
 
@@ -7147,7 +7258,7 @@ TEST(NumericValueMetricProducerTest_ConditionCorrection, TestThresholdUploadPass
 
     // generate dump report and validate correction value in the reported buckets
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket3StartTimeNs, false /* include partial bucket */, true,
                                 FAST /* dumpLatency */, &strSet, &output);
 
@@ -7207,7 +7318,7 @@ TEST(NumericValueMetricProducerTest_ConditionCorrection, TestThresholdUploadPass
 
     // generate dump report and validate correction value in the reported buckets
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket3StartTimeNs, false /* include partial bucket */, true,
                                 FAST /* dumpLatency */, &strSet, &output);
 
@@ -7265,7 +7376,7 @@ TEST(NumericValueMetricProducerTest_ConditionCorrection, TestThresholdUploadSkip
 
     // generate dump report and validate correction value in the reported buckets
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket3StartTimeNs, false /* include partial bucket */, true,
                                 FAST /* dumpLatency */, &strSet, &output);
 
@@ -7360,7 +7471,7 @@ TEST(NumericValueMetricProducerTest_ConditionCorrection, TestLateStateChangeSlic
 
     // Start dump report and check output.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     valueProducer->onDumpReport(bucket4StartTimeNs + 10, false /* do not include partial buckets */,
                                 true, NO_TIME_CONSTRAINTS, &strSet, &output);
 
@@ -7446,7 +7557,7 @@ TEST(NumericValueMetricProducerTest, TestSubsetDimensions) {
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucket2StartTimeNs + 10000000000;
     valueProducer->onDumpReport(dumpReportTimeNs, true /* include current buckets */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -7523,7 +7634,7 @@ TEST(NumericValueMetricProducerTest, TestRepeatedValueFieldAndDimensions) {
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucket2StartTimeNs + 10000000000;
     valueProducer->onDumpReport(dumpReportTimeNs, true /* include current buckets */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -7614,7 +7725,7 @@ TEST(NumericValueMetricProducerTest, TestSampleSize) {
 
     // Start dump report and check output.
     ProtoOutputStream outputAvg;
-    std::set<string> strSetAvg;
+    ReportStringTable strSetAvg;
     valueProducerAvg->onDumpReport(bucket2StartTimeNs + 50 * NS_PER_SEC,
                                    true /* include recent buckets */, true, NO_TIME_CONSTRAINTS,
                                    &strSetAvg, &outputAvg);
@@ -7630,7 +7741,7 @@ TEST(NumericValueMetricProducerTest, TestSampleSize) {
 
     // Start dump report and check output.
     ProtoOutputStream outputSum;
-    std::set<string> strSetSum;
+    ReportStringTable strSetSum;
     valueProducerSum->onDumpReport(bucket2StartTimeNs + 50 * NS_PER_SEC,
                                    true /* include recent buckets */, true, NO_TIME_CONSTRAINTS,
                                    &strSetSum, &outputSum);
@@ -7646,7 +7757,7 @@ TEST(NumericValueMetricProducerTest, TestSampleSize) {
 
     // Start dump report and check output.
     ProtoOutputStream outputSumWithSampleSize;
-    std::set<string> strSetSumWithSampleSize;
+    ReportStringTable strSetSumWithSampleSize;
     valueProducerSumWithSampleSize->onDumpReport(
             bucket2StartTimeNs + 50 * NS_PER_SEC, true /* include recent buckets */, true,
             NO_TIME_CONSTRAINTS, &strSetSumWithSampleSize, &outputSumWithSampleSize);
@@ -7704,7 +7815,7 @@ TEST(NumericValueMetricProducerTest, TestDimensionalSampling) {
 
     // Check dump report.
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     int64_t dumpReportTimeNs = bucketStartTimeNs + 10000000000;
     valueProducer->onDumpReport(dumpReportTimeNs, true /* include current buckets */, true,
                                 NO_TIME_CONSTRAINTS /* dumpLatency */, &strSet, &output);
@@ -708,6 +708,71 @@ TEST(OringDurationTrackerTest, TestClearStateKeyMapWhenNoTrackers) {
     EXPECT_FALSE(tracker.hasAccumulatedDuration());
 }
 
+TEST(OringDurationTrackerTest, TestSlicedConditionChangeByConditionKey) {
+    const MetricDimensionKey eventKey = getMockedMetricDimensionKey(TagId, 0, "event");
+
+    const HashableDimensionKey kConditionKey2 = getMockedDimensionKey(TagId, 4, "maps");
+    const HashableDimensionKey kEventKey3 = getMockedDimensionKey(TagId, 5, "maps");
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+
+    ConditionKey key1;
+    key1[StringToId("APP_BACKGROUND")] = kConditionKey1;
+    ConditionKey key2;
+    key2[StringToId("APP_BACKGROUND")] = kConditionKey2;
+
+    // Each condition key is queried once per change, however many keys share it.
+    EXPECT_CALL(*wizard, query(_, key1, _))
+            .Times(2)
+            .WillOnce(Return(ConditionState::kFalse))
+            .WillOnce(Return(ConditionState::kTrue));
+    EXPECT_CALL(*wizard, query(_, key2, _)).WillOnce(Return(ConditionState::kTrue));
+
+    unordered_map<MetricDimensionKey, vector<DurationBucket>> buckets;
+
+    int64_t bucketStartTimeNs = 10000000000;
+    int64_t bucketNum = 0;
+    int64_t eventStartTimeNs = bucketStartTimeNs + 1;
+
+    OringDurationTracker tracker(kConfigKey, metricId, eventKey, wizard, 1, false,
+                                 bucketStartTimeNs, bucketNum, bucketStartTimeNs, bucketSizeNs,
+                                 true, false, {});
+
+    tracker.noteStart(kEventKey1, true, eventStartTimeNs, key1,
+                      StatsdStats::kDimensionKeySizeHardLimitMin);
+    tracker.noteStart(kEventKey2, true, eventStartTimeNs, key1,
+                      StatsdStats::kDimensionKeySizeHardLimitMin);
+    tracker.noteStart(kEventKey3, true, eventStartTimeNs, key2,
+                      StatsdStats::kDimensionKeySizeHardLimitMin);
+    ASSERT_EQ(2u, tracker.mKeysByConditionKey.size());
+    EXPECT_EQ(2u, tracker.mKeysByConditionKey[key1].started.size());
+    EXPECT_EQ(1u, tracker.mKeysByConditionKey[key2].started.size());
+
+    tracker.onSlicedConditionMayChange(eventStartTimeNs + 10);
+    ASSERT_EQ(1u, tracker.mStarted.size());
+    EXPECT_EQ(1u, tracker.mStarted.count(kEventKey3));
+    ASSERT_EQ(2u, tracker.mPaused.size());
+    EXPECT_TRUE(tracker.mKeysByConditionKey[key1].started.empty());
+    EXPECT_EQ(2u, tracker.mKeysByConditionKey[key1].paused.size());
+
+    // key2 has no keys left, so it isn't queried anymore.
+    tracker.noteStop(kEventKey3, eventStartTimeNs + 20, false);
+    ASSERT_EQ(1u, tracker.mKeysByConditionKey.size());
+
+    tracker.onSlicedConditionMayChange(eventStartTimeNs + 30);
+    EXPECT_EQ(2u, tracker.mStarted.size());
+    EXPECT_TRUE(tracker.mPaused.empty());
+    EXPECT_EQ(2u, tracker.mKeysByConditionKey[key1].started.size());
+
+    tracker.noteStop(kEventKey1, eventStartTimeNs + 40, false);
+    tracker.noteStop(kEventKey2, eventStartTimeNs + 40, false);
+    EXPECT_TRUE(tracker.mKeysByConditionKey.empty());
+    EXPECT_TRUE(tracker.mConditionKeyMap.empty());
+
+    tracker.flushIfNeeded(bucketStartTimeNs + bucketSizeNs + 1, emptyThreshold, &buckets);
+    ASSERT_EQ(1u, buckets[eventKey].size());
+    EXPECT_EQ(29LL, buckets[eventKey][0].mDuration);
+}
+
 class OringDurationTrackerTest_DimLimit : public Test {
 protected:
     ~OringDurationTrackerTest_DimLimit() {
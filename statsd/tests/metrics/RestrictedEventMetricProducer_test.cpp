@@ -170,7 +170,7 @@ TEST_F(RestrictedEventMetricProducerTest, TestOnDumpReportNoOp) {
     std::unique_ptr<LogEvent> event1 = CreateRestrictedLogEvent(/*timestampNs=*/1);
     producer.onMatchedLogEvent(/*matcherIndex=*/1, *event1);
     ProtoOutputStream output;
-    std::set<string> strSet;
+    ReportStringTable strSet;
     producer.onDumpReport(/*dumpTimeNs=*/10,
                           /*include_current_partial_bucket=*/true,
                           /*erase_data=*/true, FAST, &strSet, &output);
@@ -198,6 +198,43 @@ TEST_F(RestrictedEventMetricProducerTest, TestOnMetricRemove) {
     EXPECT_FALSE(metricTableExist(metricId1));
 }
 
+TEST_F(RestrictedEventMetricProducerTest, TestAsyncDbWrites) {
+    dbutils::setAsyncDbWrites(true);
+    EventMetric metric;
+    metric.set_id(metricId1);
+    RestrictedEventMetricProducer producer(configKey, metric,
+                                           /*conditionIndex=*/-1,
+                                           /*initialConditionCache=*/{}, new ConditionWizard(),
+                                           /*protoHash=*/0x1234567890,
+                                           /*startTimeNs=*/0);
+    std::unique_ptr<LogEvent> event1 = CreateRestrictedLogEvent(/*timestampNs=*/1);
+    std::unique_ptr<LogEvent> event2 = CreateRestrictedLogEvent(/*timestampNs=*/3);
+    producer.onMatchedLogEvent(/*matcherIndex=*/1, *event1);
+    producer.flushRestrictedData();
+    producer.onMatchedLogEvent(/*matcherIndex=*/1, *event2);
+    producer.flushRestrictedData();
+    dbutils::waitForDbWrites();
+
+    std::stringstream query;
+    query << "SELECT * FROM metric_" << metricId1;
+    string err;
+    std::vector<int32_t> columnTypes;
+    std::vector<string> columnNames;
+    std::vector<std::vector<std::string>> rows;
+    dbutils::query(configKey, query.str(), rows, columnTypes, columnNames, err);
+    ASSERT_EQ(rows.size(), 2);
+    EXPECT_EQ(/*elapsedTimestampNs=*/rows[0][1], to_string(event1->GetElapsedTimestampNs()));
+    EXPECT_EQ(/*elapsedTimestampNs=*/rows[1][1], to_string(event2->GetElapsedTimestampNs()));
+
+    // The table is deleted after the pending inserts.
+    std::unique_ptr<LogEvent> event3 = CreateRestrictedLogEvent(/*timestampNs=*/5);
+    producer.onMatchedLogEvent(/*matcherIndex=*/1, *event3);
+    producer.flushRestrictedData();
+    producer.onMetricRemove();
+    dbutils::setAsyncDbWrites(false);
+    EXPECT_FALSE(metricTableExist(metricId1));
+}
+
 TEST_F(RestrictedEventMetricProducerTest, TestRestrictedEventMetricTtlDeletesFirstEvent) {
     EventMetric metric;
     metric.set_id(metricId1);
@@ -1207,7 +1207,8 @@ TEST_F(ConfigUpdateTest, TestEventMetricActivationDepsChange) {
                       /*replacedMatchers*/ {startMatcher.id()}, /*replacedConditions=*/{},
                       /*replacedStates=*/{}, metricsToUpdate),
               nullopt);
-    EXPECT_EQ(metricsToUpdate[0], UPDATE_REPLACE);
+    // Only the activations are reset, in updateMetrics.
+    EXPECT_EQ(metricsToUpdate[0], UPDATE_PRESERVE);
 }
 
 TEST_F(ConfigUpdateTest, TestCountMetricPreserve) {
@@ -3449,6 +3450,83 @@ TEST_F(ConfigUpdateTest, TestUpdateMetricActivations) {
                 UnorderedElementsAre(matcher4Activation));
 }
 
+TEST_F(ConfigUpdateTest, TestUpdateMetricActivationMatcherReplaced) {
+    StatsdConfig config;
+    AtomMatcher matcher1 = CreateScreenTurnedOnAtomMatcher();
+    int64_t matcher1Id = matcher1.id();
+    *config.add_atom_matcher() = matcher1;
+
+    AtomMatcher matcher2 = CreateScreenTurnedOffAtomMatcher();
+    int64_t matcher2Id = matcher2.id();
+    *config.add_atom_matcher() = matcher2;
+
+    AtomMatcher matcher3 = CreateStartScheduledJobAtomMatcher();
+    int64_t matcher3Id = matcher3.id();
+    *config.add_atom_matcher() = matcher3;
+
+    CountMetric count1 = createCountMetric("COUNT1", matcher1Id, nullopt, {});
+    int64_t count1Id = count1.id();
+    *config.add_count_metric() = count1;
+
+    MetricActivation metricActivation;
+    metricActivation.set_metric_id(count1Id);
+    EventActivation* activation = metricActivation.add_event_activation();
+    activation->set_atom_matcher_id(matcher2Id);
+    activation->set_ttl_seconds(10);
+    activation = metricActivation.add_event_activation();
+    activation->set_atom_matcher_id(matcher3Id);
+    activation->set_ttl_seconds(10);
+    *config.add_metric_activation() = metricActivation;
+
+    EXPECT_TRUE(initConfig(config));
+
+    // Only the activation by matcher2 is active.
+    ASSERT_EQ(oldMetricProducers[0]->getMetricId(), count1Id);
+    oldMetricProducers[0]->activate(oldAtomMatchingTrackerMap[matcher2Id], /*time=*/100);
+    EXPECT_TRUE(oldMetricProducers[0]->isActive());
+
+    set<int64_t> replacedMatchers = {matcher2Id};
+    unordered_map<int64_t, int> newConditionTrackerMap;
+    vector<sp<ConditionTracker>> newConditionTrackers;
+    vector<ConditionState> conditionCache;
+    unordered_map<int64_t, int> newMetricProducerMap;
+    vector<sp<MetricProducer>> newMetricProducers;
+    unordered_map<int, vector<int>> conditionToMetricMap;
+    unordered_map<int, vector<int>> trackerToMetricMap;
+    set<int64_t> noReportMetricIds;
+    unordered_map<int, vector<int>> activationAtomTrackerToMetricMap;
+    unordered_map<int, vector<int>> deactivationAtomTrackerToMetricMap;
+    vector<int> metricsWithActivation;
+    set<int64_t> replacedMetrics;
+    EXPECT_EQ(updateMetrics(key, config, /*timeBaseNs=*/123, /*currentTimeNs=*/200,
+                            new StatsPullerManager(), oldAtomMatchingTrackerMap,
+                            oldAtomMatchingTrackerMap, replacedMatchers, oldAtomMatchingTrackers,
+                            newConditionTrackerMap, /*replacedConditions=*/{}, newConditionTrackers,
+                            conditionCache, /*stateAtomIdMap=*/{}, /*allStateGroupMaps=*/{},
+                            /*replacedStates=*/{}, oldMetricProducerMap, oldMetricProducers,
+                            newMetricProducerMap, newMetricProducers, conditionToMetricMap,
+                            trackerToMetricMap, noReportMetricIds, activationAtomTrackerToMetricMap,
+                            deactivationAtomTrackerToMetricMap, metricsWithActivation,
+                            replacedMetrics),
+              nullopt);
+
+    // The metric is kept, without the activation by the replaced matcher.
+    EXPECT_TRUE(replacedMetrics.empty());
+    ASSERT_EQ(newMetricProducers.size(), 1);
+    EXPECT_EQ(newMetricProducers[0], oldMetricProducers[0]);
+    sp<MetricProducer> producer = newMetricProducers[0];
+    EXPECT_FALSE(producer->isActive());
+    ASSERT_EQ(producer->mEventActivationMap.size(), 2);
+    EXPECT_EQ(producer->mEventActivationMap[oldAtomMatchingTrackerMap[matcher2Id]]->state,
+              kNotActive);
+    EXPECT_EQ(producer->mEventActivationMap[oldAtomMatchingTrackerMap[matcher3Id]]->state,
+              kNotActive);
+
+    // The activation by the other matcher still works.
+    producer->activate(oldAtomMatchingTrackerMap[matcher3Id], /*time=*/300);
+    EXPECT_TRUE(producer->isActive());
+}
+
 TEST_F(ConfigUpdateTest, TestUpdateMetricsMultipleTypes) {
     StatsdConfig config;
     // Add atom matchers/predicates/states. These are mostly needed for initStatsdConfig
@@ -25,6 +25,7 @@
 
 #include "src/condition/ConditionTracker.h"
 #include "src/matchers/AtomMatchingTracker.h"
+#include "src/matchers/CombinationAtomMatchingTracker.h"
 #include "src/metrics/CountMetricProducer.h"
 #include "src/metrics/DurationMetricProducer.h"
 #include "src/metrics/GaugeMetricProducer.h"
@@ -641,6 +642,19 @@ TEST_F(MetricsManagerUtilTest, TestEventMetricInvalidSamplingPercentageZero) {
                                   StringToId("Event")));
 }
 
+TEST_F(MetricsManagerUtilTest, TestEventMetricInvalidMaxBytes) {
+    StatsdConfig config;
+    EventMetric* metric = config.add_event_metric();
+    *metric = createEventMetric(/*name=*/"Event", /*what=*/StringToId("ScreenTurnedOn"),
+                                /*condition=*/nullopt);
+    metric->set_max_bytes(0);
+    *config.add_atom_matcher() = CreateScreenTurnedOnAtomMatcher();
+
+    EXPECT_EQ(initConfig(config),
+              InvalidConfigReason(INVALID_CONFIG_REASON_METRIC_INCORRECT_MAX_BYTES,
+                                  StringToId("Event")));
+}
+
 TEST_F(MetricsManagerUtilTest, TestEventMetricValidSamplingPercentage) {
     StatsdConfig config;
     EventMetric* metric = config.add_event_metric();
@@ -1027,6 +1041,31 @@ TEST_F(MetricsManagerUtilTest, TestKllMetricHasIncorrectKllField) {
                                   metricId));
 }
 
+TEST_F(MetricsManagerUtilTest, TestHllMetricMissingHllField) {
+    StatsdConfig config;
+    int64_t metricId = 1;
+    HllMetric* metric = config.add_hll_metric();
+    metric->set_id(metricId);
+    metric->set_what(1);
+
+    EXPECT_EQ(initConfig(config),
+              InvalidConfigReason(INVALID_CONFIG_REASON_HLL_METRIC_MISSING_HLL_FIELD, metricId));
+}
+
+TEST_F(MetricsManagerUtilTest, TestHllMetricHllFieldHasPositionAll) {
+    StatsdConfig config;
+    int64_t metricId = 1;
+    HllMetric* metric = config.add_hll_metric();
+    metric->set_id(metricId);
+    metric->set_what(1);
+
+    metric->mutable_hll_field()->set_position(ALL);
+
+    EXPECT_EQ(initConfig(config),
+              InvalidConfigReason(INVALID_CONFIG_REASON_HLL_METRIC_HLL_FIELD_HAS_POSITION_ALL,
+                                  metricId));
+}
+
 TEST_F(MetricsManagerUtilTest, TestGaugeMetricIncorrectFieldFilter) {
     StatsdConfig config;
     int64_t metricId = 1;
@@ -2292,6 +2331,336 @@ TEST_F(MetricsManagerUtilTest, TestCombinationMatcherWithStringReplace) {
     EXPECT_THAT(actualInvalidConfigReason->matcherIds, ElementsAre(222));
 }
 
+TEST_F(MetricsManagerUtilTest, TestComputeAtomFieldMasks) {
+    StatsdConfig config;
+    *config.add_atom_matcher() = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = CreateScreenTurnedOnAtomMatcher();
+    *config.add_atom_matcher() = CreateSimpleAtomMatcher("Battery", util::BATTERY_LEVEL_CHANGED);
+
+    CountMetric* countMetric = config.add_count_metric();
+    countMetric->set_id(StringToId("WakelockCount"));
+    countMetric->set_what(StringToId("AcquireWakelock"));
+    *countMetric->mutable_dimensions_in_what() =
+            CreateAttributionUidDimensions(util::WAKELOCK_STATE_CHANGED, {Position::FIRST});
+
+    EventMetric* eventMetric = config.add_event_metric();
+    eventMetric->set_id(StringToId("ScreenEvent"));
+    eventMetric->set_what(StringToId("ScreenTurnedOn"));
+
+    CountMetric* batteryMetric = config.add_count_metric();
+    batteryMetric->set_id(StringToId("BatteryCount"));
+    batteryMetric->set_what(StringToId("Battery"));
+
+    sp<UidMap> uidMap = new UidMap();
+    vector<sp<AtomMatchingTracker>> allAtomMatchingTrackers;
+    unordered_map<int64_t, int> atomMatchingTrackerMap;
+    for (const AtomMatcher& matcher : config.atom_matcher()) {
+        optional<InvalidConfigReason> invalidConfigReason;
+        atomMatchingTrackerMap[matcher.id()] = allAtomMatchingTrackers.size();
+        allAtomMatchingTrackers.push_back(
+                createAtomMatchingTracker(matcher, uidMap, invalidConfigReason));
+        ASSERT_EQ(invalidConfigReason, nullopt);
+    }
+
+    AtomFieldMaskMap atomFieldMasks;
+    computeAtomFieldMasks(config, atomMatchingTrackerMap, allAtomMatchingTrackers,
+                          atomFieldMasks);
+
+    // Event metric atom is used entirely.
+    ASSERT_EQ(atomFieldMasks.size(), 2);
+    EXPECT_EQ(atomFieldMasks.count(util::SCREEN_STATE_CHANGED), 0);
+
+    // Attribution chain from dimensions and state field from matcher.
+    AtomFieldMask expectedMask;
+    expectedMask.set(1);
+    expectedMask.set(4);
+    EXPECT_EQ(atomFieldMasks[util::WAKELOCK_STATE_CHANGED], expectedMask);
+
+    // No fields are used.
+    EXPECT_TRUE(atomFieldMasks[util::BATTERY_LEVEL_CHANGED].none());
+
+    // Restricted metrics use all atoms entirely.
+    config.set_restricted_metrics_delegate_package_name("delegate");
+    computeAtomFieldMasks(config, atomMatchingTrackerMap, allAtomMatchingTrackers,
+                          atomFieldMasks);
+    EXPECT_TRUE(atomFieldMasks.empty());
+}
+
+TEST_F(MetricsManagerUtilTest, TestComputePriorityAtomIds) {
+    StatsdConfig config;
+    *config.add_atom_matcher() = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = CreateScreenTurnedOnAtomMatcher();
+    *config.add_atom_matcher() = CreateScreenTurnedOffAtomMatcher();
+    *config.add_atom_matcher() = CreateSimpleAtomMatcher("Battery", util::BATTERY_LEVEL_CHANGED);
+    *config.add_predicate() = CreateScreenIsOnPredicate();
+
+    CountMetric* countMetric = config.add_count_metric();
+    countMetric->set_id(StringToId("WakelockCount"));
+    countMetric->set_what(StringToId("AcquireWakelock"));
+
+    DurationMetric* durationMetric = config.add_duration_metric();
+    durationMetric->set_id(StringToId("ScreenOnDuration"));
+    durationMetric->set_what(StringToId("ScreenIsOn"));
+
+    CountMetric* batteryMetric = config.add_count_metric();
+    batteryMetric->set_id(StringToId("BatteryCount"));
+    batteryMetric->set_what(StringToId("Battery"));
+
+    sp<UidMap> uidMap = new UidMap();
+    vector<sp<AtomMatchingTracker>> allAtomMatchingTrackers;
+    unordered_map<int64_t, int> atomMatchingTrackerMap;
+    for (const AtomMatcher& matcher : config.atom_matcher()) {
+        optional<InvalidConfigReason> invalidConfigReason;
+        atomMatchingTrackerMap[matcher.id()] = allAtomMatchingTrackers.size();
+        allAtomMatchingTrackers.push_back(
+                createAtomMatchingTracker(matcher, uidMap, invalidConfigReason));
+        ASSERT_EQ(invalidConfigReason, nullopt);
+    }
+
+    // No alerts.
+    set<int> priorityAtomIds;
+    computePriorityAtomIds(config, atomMatchingTrackerMap, allAtomMatchingTrackers,
+                           priorityAtomIds);
+    EXPECT_TRUE(priorityAtomIds.empty());
+
+    *config.add_alert() = createAlert("WakelockAlert", countMetric->id(), /*buckets=*/1,
+                                      /*triggerSumGt=*/1);
+    *config.add_alert() = createAlert("ScreenOnAlert", durationMetric->id(), /*buckets=*/1,
+                                      /*triggerSumGt=*/1);
+    computePriorityAtomIds(config, atomMatchingTrackerMap, allAtomMatchingTrackers,
+                           priorityAtomIds);
+    EXPECT_THAT(priorityAtomIds,
+                UnorderedElementsAre(util::WAKELOCK_STATE_CHANGED, util::SCREEN_STATE_CHANGED));
+}
+
+TEST_F(MetricsManagerUtilTest, TestComputeConditionEvaluationOrder) {
+    StatsdConfig config;
+    *config.add_atom_matcher() = CreateScreenTurnedOnAtomMatcher();
+    *config.add_atom_matcher() = CreateScreenTurnedOffAtomMatcher();
+
+    // Combinations come before their children in the config.
+    Predicate screenIsOnPredicate = CreateScreenIsOnPredicate();
+    Predicate screenIsOffPredicate = CreateScreenIsOffPredicate();
+    Predicate notScreenIsOffPredicate;
+    notScreenIsOffPredicate.set_id(StringToId("NotScreenIsOff"));
+    notScreenIsOffPredicate.mutable_combination()->set_operation(LogicalOperation::NOT);
+    addPredicateToPredicateCombination(screenIsOffPredicate, &notScreenIsOffPredicate);
+    Predicate* bothPredicate = config.add_predicate();
+    bothPredicate->set_id(StringToId("ScreenIsOnAndNotScreenIsOff"));
+    bothPredicate->mutable_combination()->set_operation(LogicalOperation::AND);
+    addPredicateToPredicateCombination(notScreenIsOffPredicate, bothPredicate);
+    addPredicateToPredicateCombination(screenIsOnPredicate, bothPredicate);
+    *config.add_predicate() = notScreenIsOffPredicate;
+    *config.add_predicate() = screenIsOnPredicate;
+    *config.add_predicate() = screenIsOffPredicate;
+
+    sp<UidMap> uidMap = new UidMap();
+    vector<sp<AtomMatchingTracker>> allAtomMatchingTrackers;
+    unordered_map<int64_t, int> atomMatchingTrackerMap;
+    for (const AtomMatcher& matcher : config.atom_matcher()) {
+        optional<InvalidConfigReason> invalidConfigReason;
+        atomMatchingTrackerMap[matcher.id()] = allAtomMatchingTrackers.size();
+        allAtomMatchingTrackers.push_back(
+                createAtomMatchingTracker(matcher, uidMap, invalidConfigReason));
+        ASSERT_EQ(invalidConfigReason, nullopt);
+    }
+    unordered_map<int64_t, int> conditionTrackerMap;
+    vector<sp<ConditionTracker>> allConditionTrackers;
+    unordered_map<int, vector<int>> trackerToConditionMap;
+    vector<ConditionState> initialConditionCache;
+    ASSERT_EQ(initConditions(kConfigKey, config, atomMatchingTrackerMap, conditionTrackerMap,
+                             allConditionTrackers, trackerToConditionMap, initialConditionCache),
+              nullopt);
+
+    vector<int> conditionEvaluationOrder;
+    computeConditionEvaluationOrder(allConditionTrackers, conditionEvaluationOrder);
+    EXPECT_THAT(conditionEvaluationOrder, ElementsAre(3, 1, 2, 0));
+}
+
+TEST_F(MetricsManagerUtilTest, TestComputeEquivalentMatchers) {
+    StatsdConfig config;
+    AtomMatcher screenOnMatcher = CreateScreenTurnedOnAtomMatcher();
+    *config.add_atom_matcher() = screenOnMatcher;                                   // 0
+    AtomMatcher screenOnMatcher2 = screenOnMatcher;
+    screenOnMatcher2.set_id(StringToId("ScreenTurnedOn2"));
+    *config.add_atom_matcher() = screenOnMatcher2;                                  // 1
+    AtomMatcher screenOffMatcher = CreateScreenTurnedOffAtomMatcher();
+    *config.add_atom_matcher() = screenOffMatcher;                                  // 2
+    const auto addCombination = [&config](const string& name, LogicalOperation operation,
+                                          const vector<int64_t>& children) {
+        AtomMatcher* matcher = config.add_atom_matcher();
+        matcher->set_id(StringToId(name));
+        matcher->mutable_combination()->set_operation(operation);
+        for (const int64_t child : children) {
+            matcher->mutable_combination()->add_matcher(child);
+        }
+        return matcher->id();
+    };
+    const int64_t onOrOffId = addCombination("OnOrOff", LogicalOperation::OR,
+                                             {screenOnMatcher.id(), screenOffMatcher.id()});  // 3
+    const int64_t onOrOffId2 = addCombination(
+            "OnOrOff2", LogicalOperation::OR,
+            {screenOffMatcher.id(), screenOnMatcher2.id(), screenOnMatcher.id()});  // 4
+    addCombination("OnAndOff", LogicalOperation::AND,
+                   {screenOnMatcher.id(), screenOffMatcher.id()});  // 5
+    addCombination("NotOn", LogicalOperation::NOT, {screenOnMatcher.id()});   // 6
+    addCombination("NotOn2", LogicalOperation::NOT, {screenOnMatcher2.id()});  // 7
+    addCombination("Nested", LogicalOperation::OR, {onOrOffId, screenOffMatcher.id()});   // 8
+    addCombination("Nested2", LogicalOperation::OR, {screenOffMatcher.id(), onOrOffId2});  // 9
+
+    ASSERT_EQ(initConfig(config), nullopt);
+    computeEquivalentMatchers(config, allAtomMatchingTrackers);
+
+    const auto getEquivalentMatcherIndex = [](const sp<AtomMatchingTracker>& tracker) {
+        return static_cast<CombinationAtomMatchingTracker*>(tracker.get())->mEquivalentMatcherIndex;
+    };
+    EXPECT_EQ(getEquivalentMatcherIndex(allAtomMatchingTrackers[3]), -1);
+    EXPECT_EQ(getEquivalentMatcherIndex(allAtomMatchingTrackers[4]), 3);
+    EXPECT_EQ(getEquivalentMatcherIndex(allAtomMatchingTrackers[5]), -1);
+    EXPECT_EQ(getEquivalentMatcherIndex(allAtomMatchingTrackers[6]), -1);
+    EXPECT_EQ(getEquivalentMatcherIndex(allAtomMatchingTrackers[7]), 6);
+    EXPECT_EQ(getEquivalentMatcherIndex(allAtomMatchingTrackers[8]), -1);
+    EXPECT_EQ(getEquivalentMatcherIndex(allAtomMatchingTrackers[9]), 8);
+
+    // The equivalent matchers have the same results.
+    unique_ptr<LogEvent> event =
+            CreateScreenStateChangedEvent(timeBaseSec, android::view::DISPLAY_STATE_ON);
+    vector<MatchingState> matcherResults(allAtomMatchingTrackers.size(),
+                                         MatchingState::kNotComputed);
+    vector<shared_ptr<LogEvent>> matcherTransformations(allAtomMatchingTrackers.size());
+    for (int i = allAtomMatchingTrackers.size() - 1; i >= 0; i--) {
+        allAtomMatchingTrackers[i]->onLogEvent(*event, i, allAtomMatchingTrackers,
+                                               matcherResults, matcherTransformations);
+    }
+    EXPECT_THAT(matcherResults,
+                ElementsAre(MatchingState::kMatched, MatchingState::kMatched,
+                            MatchingState::kNotMatched, MatchingState::kMatched,
+                            MatchingState::kMatched, MatchingState::kNotMatched,
+                            MatchingState::kNotMatched, MatchingState::kNotMatched,
+                            MatchingState::kMatched, MatchingState::kMatched));
+}
+
+TEST_F(MetricsManagerUtilTest, TestComputeMetricSamplingGroups) {
+    StatsdConfig config;
+    AtomMatcher appCrashMatcher =
+            CreateSimpleAtomMatcher("APP_CRASH_OCCURRED", util::APP_CRASH_OCCURRED);
+    *config.add_atom_matcher() = appCrashMatcher;
+    *config.add_atom_matcher() = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = CreateReleaseWakelockAtomMatcher();
+    Predicate holdingWakelockPredicate = CreateHoldingWakelockPredicate();
+    *holdingWakelockPredicate.mutable_simple_predicate()->mutable_dimensions() =
+            CreateAttributionUidDimensions(util::WAKELOCK_STATE_CHANGED, {Position::FIRST});
+    *config.add_predicate() = holdingWakelockPredicate;
+
+    const auto addCountMetric = [&config, &appCrashMatcher](const string& name, int shardCount) {
+        CountMetric metric = createCountMetric(name, appCrashMatcher.id(), nullopt, {});
+        *metric.mutable_dimensions_in_what() =
+                CreateDimensions(util::APP_CRASH_OCCURRED, {1 /*uid*/});
+        if (shardCount > 0) {
+            *metric.mutable_dimensional_sampling_info()->mutable_sampled_what_field() =
+                    CreateDimensions(util::APP_CRASH_OCCURRED, {1 /*uid*/});
+            metric.mutable_dimensional_sampling_info()->set_shard_count(shardCount);
+        }
+        *config.add_count_metric() = metric;
+    };
+    addCountMetric("SampledCount1", /*shardCount=*/2);
+    addCountMetric("UnsampledCount", /*shardCount=*/0);
+    addCountMetric("SampledCount2", /*shardCount=*/2);
+    addCountMetric("SampledCount3", /*shardCount=*/4);
+
+    DurationMetric sampledDurationMetric = createDurationMetric(
+            "DurationSampledWakelockPerUid", holdingWakelockPredicate.id(), nullopt, {});
+    *sampledDurationMetric.mutable_dimensions_in_what() =
+            CreateAttributionUidDimensions(util::WAKELOCK_STATE_CHANGED, {Position::FIRST});
+    *sampledDurationMetric.mutable_dimensional_sampling_info()->mutable_sampled_what_field() =
+            CreateAttributionUidDimensions(util::WAKELOCK_STATE_CHANGED, {Position::FIRST});
+    sampledDurationMetric.mutable_dimensional_sampling_info()->set_shard_count(2);
+    *config.add_duration_metric() = sampledDurationMetric;
+
+    ASSERT_EQ(initConfig(config), nullopt);
+    vector<int> metricSamplingGroups;
+    vector<SamplingInfo> samplingGroups;
+    computeMetricSamplingGroups(allMetricProducers, metricSamplingGroups, samplingGroups);
+
+    // Duration metrics are not grouped.
+    EXPECT_THAT(metricSamplingGroups, ElementsAre(0, -1, 0, 1, -1));
+    ASSERT_EQ(samplingGroups.size(), 2);
+    EXPECT_EQ(samplingGroups[0].shardCount, 2);
+    EXPECT_EQ(samplingGroups[1].shardCount, 4);
+    EXPECT_EQ(samplingGroups[0].sampledWhatFields, samplingGroups[1].sampledWhatFields);
+}
+
+TEST_F(MetricsManagerUtilTest, TestComputeAtomDispatchPlans) {
+    StatsdConfig config;
+    *config.add_atom_matcher() = CreateScreenTurnedOnAtomMatcher();
+    *config.add_atom_matcher() = CreateScreenTurnedOffAtomMatcher();
+    *config.add_atom_matcher() = CreateBatteryStateNoneMatcher();
+    *config.add_atom_matcher() = CreateBatteryStateUsbMatcher();
+
+    Predicate screenIsOnPredicate = CreateScreenIsOnPredicate();
+    Predicate screenIsOffPredicate = CreateScreenIsOffPredicate();
+    Predicate notScreenIsOffPredicate;
+    notScreenIsOffPredicate.set_id(StringToId("NotScreenIsOff"));
+    notScreenIsOffPredicate.mutable_combination()->set_operation(LogicalOperation::NOT);
+    addPredicateToPredicateCombination(screenIsOffPredicate, &notScreenIsOffPredicate);
+    Predicate* bothPredicate = config.add_predicate();
+    bothPredicate->set_id(StringToId("ScreenIsOnAndNotScreenIsOff"));
+    bothPredicate->mutable_combination()->set_operation(LogicalOperation::AND);
+    addPredicateToPredicateCombination(notScreenIsOffPredicate, bothPredicate);
+    addPredicateToPredicateCombination(screenIsOnPredicate, bothPredicate);
+    *config.add_predicate() = notScreenIsOffPredicate;
+    *config.add_predicate() = screenIsOnPredicate;
+    *config.add_predicate() = screenIsOffPredicate;
+    *config.add_predicate() = CreateDeviceUnpluggedPredicate();
+
+    sp<UidMap> uidMap = new UidMap();
+    vector<sp<AtomMatchingTracker>> allAtomMatchingTrackers;
+    unordered_map<int64_t, int> atomMatchingTrackerMap;
+    for (const AtomMatcher& matcher : config.atom_matcher()) {
+        optional<InvalidConfigReason> invalidConfigReason;
+        atomMatchingTrackerMap[matcher.id()] = allAtomMatchingTrackers.size();
+        allAtomMatchingTrackers.push_back(
+                createAtomMatchingTracker(matcher, uidMap, invalidConfigReason));
+        ASSERT_EQ(invalidConfigReason, nullopt);
+    }
+    unordered_map<int64_t, int> conditionTrackerMap;
+    vector<sp<ConditionTracker>> allConditionTrackers;
+    unordered_map<int, vector<int>> trackerToConditionMap;
+    vector<ConditionState> initialConditionCache;
+    ASSERT_EQ(initConditions(kConfigKey, config, atomMatchingTrackerMap, conditionTrackerMap,
+                             allConditionTrackers, trackerToConditionMap, initialConditionCache),
+              nullopt);
+    vector<int> conditionEvaluationOrder;
+    computeConditionEvaluationOrder(allConditionTrackers, conditionEvaluationOrder);
+
+    unordered_map<int, vector<int>> tagIdsToMatchersMap = {
+            {util::SCREEN_STATE_CHANGED, {1, 0}}, {util::PLUGGED_STATE_CHANGED, {2, 3}}};
+    unordered_map<int, vector<int>> activationAtomTrackerToMetricMap = {{0, {5}}};
+    unordered_map<int, vector<int>> deactivationAtomTrackerToMetricMap = {{3, {5}}};
+
+    unordered_map<int, AtomDispatchPlan> atomDispatchPlans;
+    computeAtomDispatchPlans(tagIdsToMatchersMap, allAtomMatchingTrackers, allConditionTrackers,
+                             conditionEvaluationOrder, trackerToConditionMap,
+                             activationAtomTrackerToMetricMap, deactivationAtomTrackerToMetricMap,
+                             atomDispatchPlans);
+    ASSERT_EQ(atomDispatchPlans.size(), 2);
+
+    const AtomDispatchPlan& screenPlan = atomDispatchPlans[util::SCREEN_STATE_CHANGED];
+    EXPECT_THAT(screenPlan.matchers, ElementsAre(0, 1));
+    EXPECT_THAT(screenPlan.simpleMatchers, ElementsAre(0, 1));
+    EXPECT_THAT(screenPlan.activationMatchers, ElementsAre(0));
+    EXPECT_THAT(screenPlan.deactivationMatchers, IsEmpty());
+    EXPECT_THAT(screenPlan.conditionMatchers, ElementsAre(0, 1));
+    EXPECT_THAT(screenPlan.conditions, ElementsAre(3, 1, 2, 0));
+
+    const AtomDispatchPlan& batteryPlan = atomDispatchPlans[util::PLUGGED_STATE_CHANGED];
+    EXPECT_THAT(batteryPlan.matchers, ElementsAre(2, 3));
+    EXPECT_THAT(batteryPlan.activationMatchers, IsEmpty());
+    EXPECT_THAT(batteryPlan.deactivationMatchers, ElementsAre(3));
+    EXPECT_THAT(batteryPlan.conditionMatchers, ElementsAre(2, 3));
+    EXPECT_THAT(batteryPlan.conditions, ElementsAre(4));
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -19,12 +19,15 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#include <condition_variable>
+#include <mutex>
 #include <optional>
 #include <vector>
 
 #include "frameworks/proto_logging/stats/atoms.pb.h"
 #include "gtest_matchers.h"
 #include "src/guardrail/StatsdStats.h"
+#include "src/shell/CompactShellDataDecoder.h"
 #include "src/shell/shell_config.pb.h"
 #include "src/shell/shell_data.pb.h"
 #include "src/stats_log.pb.h"
@@ -46,6 +49,7 @@ using android::os::statsd::util::TEST_ATOM_REPORTED;
 using std::vector;
 using testing::_;
 using testing::A;
+using testing::AtLeast;
 using testing::AtMost;
 using testing::ByMove;
 using testing::DoAll;
@@ -147,7 +151,7 @@ static ShellData readData(int fd) {
     }
     // Read that much data in proto binary format.
     vector<uint8_t> dataBuffer(dataSize);
-    EXPECT_EQ((int)dataSize, read(fd, dataBuffer.data(), dataSize));
+    EXPECT_TRUE(android::base::ReadFully(fd, dataBuffer.data(), dataSize));
 
     // Make sure the received bytes can be parsed to an atom.
     ShellData receivedAtom;
@@ -155,6 +159,22 @@ static ShellData readData(int fd) {
     return receivedAtom;
 }
 
+// Reads ShellData protos until numAtoms atoms are received and returns one ShellData per atom,
+// since which atoms are written together depends on timing.
+static vector<ShellData> readAtoms(int fd, int numAtoms) {
+    vector<ShellData> atoms;
+    while (atoms.size() < numAtoms) {
+        const ShellData shellData = readData(fd);
+        for (int i = 0; i < shellData.atom_size(); i++) {
+            ShellData atom;
+            *atom.add_atom() = shellData.atom(i);
+            atom.add_elapsed_timestamp_nanos(shellData.elapsed_timestamp_nanos(i));
+            atoms.push_back(atom);
+        }
+    }
+    return atoms;
+}
+
 void runShellTest(ShellSubscription config, sp<MockUidMap> uidMap,
                   sp<MockStatsPullerManager> pullerManager,
                   const vector<std::shared_ptr<LogEvent>>& pushedEvents,
@@ -189,13 +209,18 @@ void runShellTest(ShellSubscription config, sp<MockUidMap> uidMap,
         shellManager->onLogEvent(*event);
     }
 
-    for (int i = 0; i < numClients; i++) {
-        vector<ShellData> actualData;
-        for (int j = 1; j <= expectedData.size(); j++) {
-            actualData.push_back(readData(fds_datas[i][0]));
+    vector<ShellData> expectedAtoms;
+    for (const ShellData& shellData : expectedData) {
+        for (int i = 0; i < shellData.atom_size(); i++) {
+            ShellData atom;
+            *atom.add_atom() = shellData.atom(i);
+            atom.add_elapsed_timestamp_nanos(shellData.elapsed_timestamp_nanos(i));
+            expectedAtoms.push_back(atom);
         }
-
-        EXPECT_THAT(expectedData, UnorderedPointwise(EqShellData(), actualData));
+    }
+    for (int i = 0; i < numClients; i++) {
+        const vector<ShellData> actualAtoms = readAtoms(fds_datas[i][0], expectedAtoms.size());
+        EXPECT_THAT(expectedAtoms, UnorderedPointwise(EqShellData(), actualAtoms));
     }
 
     // Not closing fds_datas[i][0] because this causes writes within ShellSubscriberClient to hang
@@ -247,8 +272,12 @@ protected:
     void SetUp() override {
         // Save callback arguments when it is invoked.
         ON_CALL(*callback, onSubscriptionData(_, _))
-                .WillByDefault(DoAll(SaveArg<0>(&reason), SaveArg<1>(&payload),
-                                     [] { return Status::ok(); }));
+                .WillByDefault(DoAll(SaveArg<0>(&reason), SaveArg<1>(&payload), [this] {
+                    std::lock_guard<std::mutex> lock(callbackMutex);
+                    callbackCount++;
+                    callbackCv.notify_all();
+                    return Status::ok();
+                }));
 
         ShellSubscription config;
         config.add_pushed()->set_atom_id(TEST_ATOM_REPORTED);
@@ -289,9 +318,20 @@ protected:
     std::shared_ptr<MockStatsSubscriptionCallback> callback;
     vector<uint8_t> configBytes;
 
+    // Waits for the callback invocations made on the ShellSubscriber thread.
+    void waitForCallbacks(int count) {
+        std::unique_lock<std::mutex> lock(callbackMutex);
+        callbackCv.wait_for(lock, std::chrono::seconds(5),
+                            [this, count] { return callbackCount >= count; });
+    }
+
     // Capture callback arguments.
     std::optional<StatsSubscriptionCallbackReason> reason;
     vector<uint8_t> payload;
+
+    std::mutex callbackMutex;
+    std::condition_variable callbackCv;
+    int callbackCount = 0;
 };
 
 class ShellSubscriberCallbackPulledTest : public ShellSubscriberCallbackTest {
@@ -438,6 +478,9 @@ TEST_F(ShellSubscriberCallbackTest, testOverflowCacheIsFlushed) {
     shellSubscriber.onLogEvent(*createTestAtomReportedEvent(/*timestampNs=*/1100,
                                                             /*intFieldValue=*/1, expIds));
 
+    // The flushed data is delivered on the ShellSubscriber thread.
+    waitForCallbacks(1);
+
     EXPECT_THAT(reason, Eq(StatsSubscriptionCallbackReason::STATSD_INITIATED));
 
     // Get ShellData proto from the bytes payload of the callback.
@@ -629,6 +672,178 @@ TEST_F(ShellSubscriberCallbackTest, testTruncateTimestampAtom) {
     EXPECT_THAT(actualShellData, EqShellData(expectedShellData));
 }
 
+TEST_F(ShellSubscriberCallbackTest, testPushedEventSharedByClients) {
+    EXPECT_CALL(*callback, onSubscriptionData(_, _)).Times(Exactly(1)).RetiresOnSaturation();
+    EXPECT_CALL(
+            *mockLogEventFilter,
+            setAtomIds(CreateAtomIdSetFromShellSubscriptionBytes(configBytes), &shellSubscriber))
+            .Times(AtLeast(2));
+
+    std::optional<StatsSubscriptionCallbackReason> reason2;
+    vector<uint8_t> payload2;
+    std::shared_ptr<MockStatsSubscriptionCallback> callback2 =
+            SharedRefBase::make<NiceMock<MockStatsSubscriptionCallback>>();
+    ON_CALL(*callback2, onSubscriptionData(_, _))
+            .WillByDefault(DoAll(SaveArg<0>(&reason2), SaveArg<1>(&payload2),
+                                 [] { return Status::ok(); }));
+
+    shellSubscriber.startNewSubscription(configBytes, callback);
+    shellSubscriber.startNewSubscription(configBytes, callback2);
+
+    shellSubscriber.onLogEvent(*CreateScreenStateChangedEvent(
+            1000 /*timestamp*/, ::android::view::DisplayStateEnum::DISPLAY_STATE_ON));
+
+    shellSubscriber.flushSubscription(callback);
+    shellSubscriber.flushSubscription(callback2);
+
+    EXPECT_THAT(reason, Eq(StatsSubscriptionCallbackReason::FLUSH_REQUESTED));
+    EXPECT_THAT(reason2, Eq(StatsSubscriptionCallbackReason::FLUSH_REQUESTED));
+
+    ShellData expectedShellData;
+    expectedShellData.add_atom()->mutable_screen_state_changed()->set_state(
+            ::android::view::DisplayStateEnum::DISPLAY_STATE_ON);
+    expectedShellData.add_elapsed_timestamp_nanos(1000);
+
+    // Both clients get the same data from the shared encoding of the event.
+    ShellData actualShellData;
+    ASSERT_TRUE(actualShellData.ParseFromArray(payload.data(), payload.size()));
+    EXPECT_THAT(actualShellData, EqShellData(expectedShellData));
+
+    ShellData actualShellData2;
+    ASSERT_TRUE(actualShellData2.ParseFromArray(payload2.data(), payload2.size()));
+    EXPECT_THAT(actualShellData2, EqShellData(expectedShellData));
+
+    shellSubscriber.unsubscribe(callback2);
+}
+
+TEST_F(ShellSubscriberCallbackTest, testPushedEventOnlyGoesToSubscribedClients) {
+    EXPECT_CALL(*callback, onSubscriptionData(_, _)).Times(Exactly(1)).RetiresOnSaturation();
+    EXPECT_CALL(*mockLogEventFilter, setAtomIds(_, &shellSubscriber)).Times(AtLeast(2));
+
+    std::optional<StatsSubscriptionCallbackReason> reason2;
+    vector<uint8_t> payload2;
+    std::shared_ptr<MockStatsSubscriptionCallback> callback2 =
+            SharedRefBase::make<NiceMock<MockStatsSubscriptionCallback>>();
+    ON_CALL(*callback2, onSubscriptionData(_, _))
+            .WillByDefault(DoAll(SaveArg<0>(&reason2), SaveArg<1>(&payload2),
+                                 [] { return Status::ok(); }));
+    ShellSubscription config2;
+    config2.add_pushed()->set_atom_id(PLUGGED_STATE_CHANGED);
+
+    shellSubscriber.startNewSubscription(configBytes, callback);
+    shellSubscriber.startNewSubscription(protoToBytes(config2), callback2);
+
+    shellSubscriber.onLogEvent(*CreateScreenStateChangedEvent(
+            1000 /*timestamp*/, ::android::view::DisplayStateEnum::DISPLAY_STATE_ON));
+    shellSubscriber.onLogEvent(*CreateBatteryStateChangedEvent(
+            2000 /*timestamp*/, BatteryPluggedStateEnum::BATTERY_PLUGGED_USB));
+
+    shellSubscriber.flushSubscription(callback);
+    shellSubscriber.flushSubscription(callback2);
+
+    ShellData expectedShellData;
+    expectedShellData.add_atom()->mutable_screen_state_changed()->set_state(
+            ::android::view::DisplayStateEnum::DISPLAY_STATE_ON);
+    expectedShellData.add_elapsed_timestamp_nanos(1000);
+    ShellData actualShellData;
+    ASSERT_TRUE(actualShellData.ParseFromArray(payload.data(), payload.size()));
+    EXPECT_THAT(actualShellData, EqShellData(expectedShellData));
+
+    ShellData expectedShellData2;
+    expectedShellData2.add_atom()->mutable_plugged_state_changed()->set_state(
+            BatteryPluggedStateEnum::BATTERY_PLUGGED_USB);
+    expectedShellData2.add_elapsed_timestamp_nanos(2000);
+    ShellData actualShellData2;
+    ASSERT_TRUE(actualShellData2.ParseFromArray(payload2.data(), payload2.size()));
+    EXPECT_THAT(actualShellData2, EqShellData(expectedShellData2));
+
+    shellSubscriber.unsubscribe(callback2);
+}
+
+TEST_F(ShellSubscriberCallbackTest, testPushedFieldsAreProjected) {
+    EXPECT_CALL(*callback, onSubscriptionData(_, _)).Times(Exactly(1)).RetiresOnSaturation();
+    EXPECT_CALL(*mockLogEventFilter, setAtomIds(_, &shellSubscriber)).Times(AtLeast(1));
+
+    ShellSubscription config;
+    config.add_pushed()->set_atom_id(TEST_ATOM_REPORTED);
+    FieldMatcher* fields = config.add_pushed_fields();
+    fields->set_field(TEST_ATOM_REPORTED);
+    fields->add_child()->set_field(2);  // int_field
+    fields->add_child()->set_field(5);  // string_field
+    ASSERT_TRUE(shellSubscriber.startNewSubscription(protoToBytes(config), callback));
+
+    shellSubscriber.onLogEvent(*createTestAtomReportedEvent(/*timestampNs=*/1000,
+                                                            /*intFieldValue=*/7, {1, 2}));
+    shellSubscriber.flushSubscription(callback);
+
+    ShellData expectedShellData;
+    TestAtomReported* testAtom = expectedShellData.add_atom()->mutable_test_atom_reported();
+    testAtom->set_int_field(7);
+    testAtom->set_string_field("abc");
+    expectedShellData.add_elapsed_timestamp_nanos(1000);
+
+    ShellData actualShellData;
+    ASSERT_TRUE(actualShellData.ParseFromArray(payload.data(), payload.size()));
+    EXPECT_THAT(actualShellData, EqShellData(expectedShellData));
+}
+
+TEST_F(ShellSubscriberCallbackTest, testPushedFieldsOfAnotherAtomAreRejected) {
+    ShellSubscription config;
+    config.add_pushed()->set_atom_id(TEST_ATOM_REPORTED);
+    FieldMatcher* fields = config.add_pushed_fields();
+    fields->set_field(SCREEN_STATE_CHANGED);
+    fields->add_child()->set_field(1);
+
+    EXPECT_FALSE(shellSubscriber.startNewSubscription(protoToBytes(config), callback));
+}
+
+TEST_F(ShellSubscriberCallbackTest, testCompactEncoding) {
+    EXPECT_CALL(*callback, onSubscriptionData(_, _)).Times(Exactly(1)).RetiresOnSaturation();
+    EXPECT_CALL(*mockLogEventFilter, setAtomIds(_, &shellSubscriber)).Times(AtLeast(1));
+
+    ShellSubscription config;
+    config.add_pushed()->set_atom_id(SCREEN_STATE_CHANGED);
+    config.add_pushed()->set_atom_id(PLUGGED_STATE_CHANGED);
+    config.set_compact_encoding(true);
+    ASSERT_TRUE(shellSubscriber.startNewSubscription(protoToBytes(config), callback));
+
+    shellSubscriber.onLogEvent(*CreateScreenStateChangedEvent(
+            1000 /*timestamp*/, ::android::view::DisplayStateEnum::DISPLAY_STATE_ON));
+    shellSubscriber.onLogEvent(*CreateBatteryStateChangedEvent(
+            2000 /*timestamp*/, BatteryPluggedStateEnum::BATTERY_PLUGGED_USB));
+    shellSubscriber.onLogEvent(*CreateScreenStateChangedEvent(
+            1500 /*timestamp*/, ::android::view::DisplayStateEnum::DISPLAY_STATE_OFF));
+    shellSubscriber.flushSubscription(callback);
+
+    vector<CompactShellEvent> events;
+    ASSERT_TRUE(decodeCompactShellData(payload.data(), payload.size(), &events));
+    ASSERT_EQ(events.size(), 3);
+    EXPECT_EQ(events[0].atomId, SCREEN_STATE_CHANGED);
+    EXPECT_EQ(events[0].elapsedTimestampNs, 1000);
+    EXPECT_EQ(events[1].atomId, PLUGGED_STATE_CHANGED);
+    EXPECT_EQ(events[1].elapsedTimestampNs, 2000);
+    EXPECT_EQ(events[2].atomId, SCREEN_STATE_CHANGED);
+    EXPECT_EQ(events[2].elapsedTimestampNs, 1500);
+
+    // The events decode to the atoms of the regular encoding.
+    ShellData actualShellData;
+    for (const CompactShellEvent& event : events) {
+        ASSERT_TRUE(actualShellData.add_atom()->ParseFromString(event.toAtomBytes()));
+        actualShellData.add_elapsed_timestamp_nanos(event.elapsedTimestampNs);
+    }
+    ShellData expectedShellData;
+    expectedShellData.add_atom()->mutable_screen_state_changed()->set_state(
+            ::android::view::DisplayStateEnum::DISPLAY_STATE_ON);
+    expectedShellData.add_atom()->mutable_plugged_state_changed()->set_state(
+            BatteryPluggedStateEnum::BATTERY_PLUGGED_USB);
+    expectedShellData.add_atom()->mutable_screen_state_changed()->set_state(
+            ::android::view::DisplayStateEnum::DISPLAY_STATE_OFF);
+    expectedShellData.add_elapsed_timestamp_nanos(1000);
+    expectedShellData.add_elapsed_timestamp_nanos(2000);
+    expectedShellData.add_elapsed_timestamp_nanos(1500);
+    EXPECT_THAT(actualShellData, EqShellData(expectedShellData));
+}
+
 TEST_F(ShellSubscriberCallbackPulledTest, testPullIfNeededBeforeInterval) {
     // Pull should not happen
     EXPECT_CALL(*pullerManager, Pull(_, A<const vector<int32_t>&>(), _, _)).Times(Exactly(0));
@@ -665,6 +880,7 @@ TEST_F(ShellSubscriberCallbackPulledTest, testCachedPullIsFlushed) {
 
     // This should flush out data cached from the pull.
     shellSubscriberClient->flush();
+    shellSubscriberClient->deliverPayloads();
 
     EXPECT_THAT(reason, Eq(StatsSubscriptionCallbackReason::FLUSH_REQUESTED));
 
@@ -685,6 +901,7 @@ TEST_F(ShellSubscriberCallbackPulledTest, testPullAtCacheTimeout) {
     // This pull should trigger a cache flush.
     shellSubscriberClient->pullAndSendHeartbeatsIfNeeded(/* nowSecs= */ 70, /* nowMillis= */ 70'000,
                                                          /* nowNanos= */ 70'000'000'000);
+    shellSubscriberClient->deliverPayloads();
 
     EXPECT_THAT(reason, Eq(StatsSubscriptionCallbackReason::STATSD_INITIATED));
 
@@ -717,6 +934,49 @@ TEST_F(ShellSubscriberCallbackPulledTest, testMinSleep) {
     EXPECT_THAT(sleepTimeMs, Eq(ShellSubscriberClient::kMinCallbackSleepIntervalMs));
 }
 
+TEST_F(ShellSubscriberCallbackPulledTest, testPullIsSharedByClients) {
+    // Pull should happen once for both clients.
+    EXPECT_CALL(*pullerManager, Pull(_, A<const vector<int32_t>&>(), _, _)).Times(Exactly(1));
+
+    unique_ptr<ShellSubscriberClient> shellSubscriberClient2 = ShellSubscriberClient::create(
+            configBytes, callback, /* startTimeSec= */ 0, uidMap, pullerManager);
+    SharedPulls sharedPulls;
+    shellSubscriberClient->pullAndSendHeartbeatsIfNeeded(/* nowSecs= */ 61, /* nowMillis= */ 61'000,
+                                                         /* nowNanos= */ 61'000'000'000,
+                                                         &sharedPulls);
+    shellSubscriberClient2->pullAndSendHeartbeatsIfNeeded(
+            /* nowSecs= */ 61, /* nowMillis= */ 61'000, /* nowNanos= */ 61'000'000'000,
+            &sharedPulls);
+
+    // Both clients got the pulled data.
+    EXPECT_CALL(*callback, onSubscriptionData(_, _)).Times(Exactly(2));
+    shellSubscriberClient->flush();
+    shellSubscriberClient->deliverPayloads();
+    ShellData actualShellData;
+    ASSERT_TRUE(actualShellData.ParseFromArray(payload.data(), payload.size()));
+    EXPECT_THAT(actualShellData, EqShellData(getExpectedPulledData()));
+
+    shellSubscriberClient2->flush();
+    shellSubscriberClient2->deliverPayloads();
+    ASSERT_TRUE(actualShellData.ParseFromArray(payload.data(), payload.size()));
+    EXPECT_THAT(actualShellData, EqShellData(getExpectedPulledData()));
+}
+
+TEST_F(ShellSubscriberCallbackPulledTest, testPullIsAlignedToInterval) {
+    // The client subscribing at 30 seconds pulls at 60 seconds, along with the clients which
+    // subscribed earlier.
+    EXPECT_CALL(*pullerManager, Pull(_, A<const vector<int32_t>&>(), _, _)).Times(Exactly(1));
+
+    unique_ptr<ShellSubscriberClient> lateClient = ShellSubscriberClient::create(
+            configBytes, callback, /* startTimeSec= */ 30, uidMap, pullerManager);
+    const int64_t sleepTimeMs = lateClient->pullAndSendHeartbeatsIfNeeded(
+            /* nowSecs= */ 30, /* nowMillis= */ 30'000, /* nowNanos= */ 30'000'000'000);
+    EXPECT_THAT(sleepTimeMs, Eq(30'000));
+
+    lateClient->pullAndSendHeartbeatsIfNeeded(/* nowSecs= */ 60, /* nowMillis= */ 60'000,
+                                              /* nowNanos= */ 60'000'000'000);
+}
+
 TEST(ShellSubscriberTest, testPushedSubscription) {
     sp<MockUidMap> uidMap = new NaggyMock<MockUidMap>();
     sp<MockStatsPullerManager> pullerManager = new StrictMock<MockStatsPullerManager>();
@@ -934,14 +1194,15 @@ TEST(ShellSubscriberTest, testDifferentConfigs) {
     }
 
     // Validate Config 1
-    ShellData actual1 = readData(fds_datas[0][0]);
+    const vector<ShellData> actualAtoms1 = readAtoms(fds_datas[0][0], /*numAtoms=*/2);
+    const ShellData& actual1 = actualAtoms1[0];
     ShellData expected1;
     expected1.add_atom()->mutable_screen_state_changed()->set_state(
             ::android::view::DisplayStateEnum::DISPLAY_STATE_ON);
     expected1.add_elapsed_timestamp_nanos(pushedList[0]->GetElapsedTimestampNs());
     EXPECT_THAT(expected1, EqShellData(actual1));
 
-    ShellData actual2 = readData(fds_datas[0][0]);
+    const ShellData& actual2 = actualAtoms1[1];
     ShellData expected2;
     expected2.add_atom()->mutable_screen_state_changed()->set_state(
             ::android::view::DisplayStateEnum::DISPLAY_STATE_OFF);
@@ -949,14 +1210,15 @@ TEST(ShellSubscriberTest, testDifferentConfigs) {
     EXPECT_THAT(expected2, EqShellData(actual2));
 
     // Validate Config 2, repeating the process
-    ShellData actual3 = readData(fds_datas[1][0]);
+    const vector<ShellData> actualAtoms2 = readAtoms(fds_datas[1][0], /*numAtoms=*/2);
+    const ShellData& actual3 = actualAtoms2[0];
     ShellData expected3;
     expected3.add_atom()->mutable_plugged_state_changed()->set_state(
             BatteryPluggedStateEnum::BATTERY_PLUGGED_USB);
     expected3.add_elapsed_timestamp_nanos(pushedList[2]->GetElapsedTimestampNs());
     EXPECT_THAT(expected3, EqShellData(actual3));
 
-    ShellData actual4 = readData(fds_datas[1][0]);
+    const ShellData& actual4 = actualAtoms2[1];
     ShellData expected4;
     expected4.add_atom()->mutable_plugged_state_changed()->set_state(
             BatteryPluggedStateEnum::BATTERY_PLUGGED_NONE);
@@ -966,6 +1228,51 @@ TEST(ShellSubscriberTest, testDifferentConfigs) {
     // Not closing fds_datas[i][0] because this causes writes within ShellSubscriberClient to hang
 }
 
+TEST(ShellSubscriberTest, testSlowReaderDoesNotBlock) {
+    sp<MockUidMap> uidMap = new NaggyMock<MockUidMap>();
+    sp<MockStatsPullerManager> pullerManager = new StrictMock<MockStatsPullerManager>();
+
+    ShellSubscription config;
+    config.add_pushed()->set_atom_id(SCREEN_STATE_CHANGED);
+    const vector<uint8_t> configBytes = protoToBytes(config);
+
+    int fds_config[2];
+    ASSERT_EQ(0, pipe2(fds_config, O_CLOEXEC));
+    int fds_data[2];
+    ASSERT_EQ(0, pipe2(fds_data, O_CLOEXEC));
+    const size_t configSize = configBytes.size();
+    write(fds_config[1], &configSize, sizeof(configSize));
+    write(fds_config[1], configBytes.data(), configSize);
+    close(fds_config[1]);
+
+    unique_ptr<ShellSubscriberClient> client =
+            ShellSubscriberClient::create(fds_config[0], fds_data[1], /*timeoutSec=*/-1,
+                                          /*startTimeSec=*/0, uidMap, pullerManager);
+    close(fds_config[0]);
+    close(fds_data[1]);
+    ASSERT_NE(client, nullptr);
+
+    // Nothing is read while far more than the pipe and the pending bytes hold is written.
+    unique_ptr<LogEvent> event = CreateScreenStateChangedEvent(
+            1000, ::android::view::DisplayStateEnum::DISPLAY_STATE_ON);
+    for (int i = 0; i < 100'000; i++) {
+        if (client->onLogEvent(*event)) {
+            client->deliverPayloads();
+        }
+    }
+    EXPECT_TRUE(client->isAlive());
+    EXPECT_GT(client->mNumDroppedWrites, 0);
+    EXPECT_LE(client->mPendingOut.size(), ShellSubscriberClient::kMaxPendingOutBytes);
+
+    // The payloads which were not dropped are written whole.
+    const ShellData shellData = readData(fds_data[0]);
+    ASSERT_GT(shellData.atom_size(), 0);
+    EXPECT_EQ(::android::view::DisplayStateEnum::DISPLAY_STATE_ON,
+              shellData.atom(0).screen_state_changed().state());
+    EXPECT_EQ(shellData.atom_size(), shellData.elapsed_timestamp_nanos_size());
+    close(fds_data[0]);
+}
+
 TEST(ShellSubscriberTest, testPushedSubscriptionRestrictedEvent) {
     sp<MockUidMap> uidMap = new NaggyMock<MockUidMap>();
     sp<MockStatsPullerManager> pullerManager = new StrictMock<MockStatsPullerManager>();
@@ -56,6 +56,30 @@ public:
                         const FieldValue& newState) {
         updates.emplace_back(primaryKey, newState.mValue.int_value);
     }
+
+    // Number of onStatesChanged calls.
+    int batches = 0;
+
+    void onStatesChanged(const int64_t eventTimeNs, const int32_t atomId,
+                         std::span<const StateChange> changes) override {
+        batches++;
+        StateListener::onStatesChanged(eventTimeNs, atomId, changes);
+    }
+};
+
+// Ignores the changes between the values of the same state group.
+class TestStateGroupListener : public TestStateListener {
+public:
+    explicit TestStateGroupListener(const std::unordered_map<int, int64_t>& stateGroups)
+        : mStateGroups(stateGroups){};
+
+    std::optional<std::unordered_map<int, int64_t>> getIgnoredStateGroups(
+            const int32_t atomId) const override {
+        return mStateGroups;
+    }
+
+private:
+    const std::unordered_map<int, int64_t> mStateGroups;
 };
 
 int getStateInt(StateManager& mgr, int atomId, const HashableDimensionKey& queryKey) {
@@ -239,6 +263,37 @@ TEST(StateTrackerTest, TestUnregisterListener) {
     EXPECT_EQ(-1, mgr.getListenersCount(util::SCREEN_STATE_CHANGED));
 }
 
+/**
+ * Test that listeners ignoring the changes within state groups are only notified when the state
+ * group changes.
+ */
+TEST(StateTrackerTest, TestIgnoredStateGroups) {
+    sp<TestStateListener> listener = new TestStateListener();
+    sp<TestStateGroupListener> groupListener = new TestStateGroupListener(
+            {{android::view::DisplayStateEnum::DISPLAY_STATE_OFF, 0},
+             {android::view::DisplayStateEnum::DISPLAY_STATE_DOZE, 0},
+             {android::view::DisplayStateEnum::DISPLAY_STATE_ON, 1}});
+    StateManager mgr;
+    mgr.registerListener(util::SCREEN_STATE_CHANGED, listener);
+    mgr.registerListener(util::SCREEN_STATE_CHANGED, groupListener);
+
+    std::unique_ptr<LogEvent> event = CreateScreenStateChangedEvent(
+            timestampNs, android::view::DisplayStateEnum::DISPLAY_STATE_ON);
+    mgr.onLogEvent(*event);
+    event = CreateScreenStateChangedEvent(timestampNs + 1000,
+                                          android::view::DisplayStateEnum::DISPLAY_STATE_OFF);
+    mgr.onLogEvent(*event);
+    event = CreateScreenStateChangedEvent(timestampNs + 2000,
+                                          android::view::DisplayStateEnum::DISPLAY_STATE_DOZE);
+    mgr.onLogEvent(*event);
+
+    ASSERT_EQ(3, listener->updates.size());
+    ASSERT_EQ(2, groupListener->updates.size());
+    EXPECT_EQ(android::view::DisplayStateEnum::DISPLAY_STATE_ON, groupListener->updates[0].mState);
+    EXPECT_EQ(android::view::DisplayStateEnum::DISPLAY_STATE_OFF,
+              groupListener->updates[1].mState);
+}
+
 /**
  * Test a binary state atom with nested counting.
  *
@@ -323,6 +378,8 @@ TEST(StateTrackerTest, TestStateChangeReset) {
             CreateBleScanStateChangedEvent(timestampNs + 2000, attributionUids2, attributionTags1,
                                            BleScanStateChanged::RESET, false, false, false);
     mgr.onLogEvent(*event3);
+    // The states of both primary keys are reset in a single batch.
+    EXPECT_EQ(1, listener->batches);
     ASSERT_EQ(2, listener->updates.size());
     for (const TestStateListener::Update& update : listener->updates) {
         EXPECT_EQ(BleScanStateChanged::OFF, update.mState);
@@ -383,6 +440,44 @@ TEST(StateTrackerTest, TestStateChangeOnePrimaryField) {
               getStateInt(mgr, util::UID_PROCESS_STATE_CHANGED, queryKey));
 }
 
+TEST(StateTrackerTest, TestUidPrimaryKeyStates) {
+    sp<StateTracker> tracker = new StateTracker(util::UID_PROCESS_STATE_CHANGED);
+    sp<TestStateListener> listener = new TestStateListener();
+    tracker->registerListener(listener);
+
+    // App uids of the system and secondary users are stored densely, others in the map.
+    const int32_t secondaryUserUid = 10 * 100000 + 10123;
+    const int32_t isolatedUid = 99123;
+    for (int32_t uid : {1000, 10123, secondaryUserUid, isolatedUid}) {
+        std::unique_ptr<LogEvent> event = CreateUidProcessStateChangedEvent(
+                timestampNs, uid, android::app::ProcessStateEnum::PROCESS_STATE_TOP);
+        tracker->onLogEvent(*event);
+    }
+    ASSERT_EQ(4, listener->updates.size());
+    EXPECT_EQ(1, tracker->mStateMap.size());
+    EXPECT_EQ(2, tracker->mUidStates.size());
+
+    FieldValue output;
+    HashableDimensionKey queryKey;
+    getUidProcessKey(secondaryUserUid, &queryKey);
+    EXPECT_TRUE(tracker->getStateValue(queryKey, &output));
+    EXPECT_EQ(android::app::ProcessStateEnum::PROCESS_STATE_TOP, output.mValue.int_value);
+
+    getUidProcessKey(10124, &queryKey);
+    EXPECT_FALSE(tracker->getStateValue(queryKey, &output));
+    EXPECT_EQ(StateTracker::kStateUnknown, output.mValue.int_value);
+
+    // Changing the state of a dense uid.
+    std::unique_ptr<LogEvent> event = CreateUidProcessStateChangedEvent(
+            timestampNs + 1000, 10123, android::app::ProcessStateEnum::PROCESS_STATE_CACHED_EMPTY);
+    tracker->onLogEvent(*event);
+    getUidProcessKey(10123, &queryKey);
+    EXPECT_TRUE(tracker->getStateValue(queryKey, &output));
+    EXPECT_EQ(android::app::ProcessStateEnum::PROCESS_STATE_CACHED_EMPTY, output.mValue.int_value);
+    ASSERT_EQ(5, listener->updates.size());
+    EXPECT_EQ(10123, listener->updates[4].mKey.getValues()[0].mValue.int_value);
+}
+
 TEST(StateTrackerTest, TestStateChangePrimaryFieldAttrChain) {
     sp<TestStateListener> listener1 = new TestStateListener();
     StateManager mgr;
@@ -19,6 +19,8 @@
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 
+#include <fstream>
+
 #include "matchers/SimpleAtomMatchingTracker.h"
 #include "stats_event.h"
 #include "stats_util.h"
@@ -1490,6 +1492,21 @@ void sortLogEventsByTimestamp(std::vector<std::unique_ptr<LogEvent>> *events) {
             });
 }
 
+vector<SocketMessage> readSocketMessageTrace(const string& path) {
+    vector<SocketMessage> trace;
+    std::ifstream file(path, std::ios::binary);
+    uint32_t header[3];
+    while (file.read(reinterpret_cast<char*>(header), sizeof(header))) {
+        SocketMessage message{
+                .uid = header[0], .pid = header[1], .buffer = vector<uint8_t>(header[2])};
+        if (!file.read(reinterpret_cast<char*>(message.buffer.data()), header[2])) {
+            break;
+        }
+        trace.push_back(std::move(message));
+    }
+    return trace;
+}
+
 int64_t StringToId(const string& str) {
     return static_cast<int64_t>(std::hash<std::string>()(str));
 }
@@ -84,6 +84,11 @@ class MockUidMap : public UidMap {
 public:
     MOCK_METHOD(int, getHostUidOrSelf, (int uid), (const));
     MOCK_METHOD(std::set<int32_t>, getAppUid, (const string& package), (const));
+
+    // The mocked getHostUidOrSelf may map any uid.
+    bool hasIsolatedUids() const override {
+        return true;
+    }
 };
 
 class BasicMockLogEventFilter : public LogEventFilter {
@@ -582,6 +587,18 @@ LogEventFilter::AtomIdSet CreateAtomIdSetFromConfig(const StatsdConfig& config);
 // Util function to sort the log events by timestamp.
 void sortLogEventsByTimestamp(std::vector<std::unique_ptr<LogEvent>> *events);
 
+// A message as received on the statsd socket: a serialized AStatsEvent and its logging process.
+struct SocketMessage {
+    uint32_t uid;
+    uint32_t pid;
+    vector<uint8_t> buffer;
+};
+
+// Reads a capture of socket messages, each a native endian uint32 uid, pid and size followed by
+// the size bytes of the message. Stops at the first truncated message, returns an empty vector if
+// the file can't be read.
+vector<SocketMessage> readSocketMessageTrace(const string& path);
+
 int64_t StringToId(const string& str);
 
 sp<EventMatcherWizard> createEventMatcherWizard(
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "storage/AsyncFileWriter.h"
+
+#include <android-base/file.h>
+#include <dirent.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using android::util::FIELD_COUNT_REPEATED;
+using android::util::FIELD_TYPE_INT32;
+using android::util::ProtoOutputStream;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+unique_ptr<ProtoOutputStream> makeProto(int value) {
+    auto proto = std::make_unique<ProtoOutputStream>();
+    proto->write(FIELD_TYPE_INT32 | FIELD_COUNT_REPEATED | 1, value);
+    return proto;
+}
+
+string getProtoBytes(ProtoOutputStream& proto) {
+    string bytes;
+    sp<android::util::ProtoReader> reader = proto.data();
+    while (reader->readBuffer() != NULL) {
+        bytes.append(reinterpret_cast<const char*>(reader->readBuffer()),
+                     reader->currentToRead());
+        reader->move(reader->currentToRead());
+    }
+    return bytes;
+}
+
+}  // anonymous namespace
+
+TEST(AsyncFileWriterTest, TestWritesCompleteInOrder) {
+    constexpr int kNumWrites = 20;
+    TemporaryDir dir;
+    vector<string> written;
+    {
+        // Fewer pending writes than writes, so write has to wait for some to complete.
+        AsyncFileWriter writer(/*maxPendingWrites=*/2);
+        for (int i = 0; i < kNumWrites; i++) {
+            const string file = string(dir.path) + "/" + std::to_string(i);
+            writer.write(file, makeProto(i), [&written, file](bool success) {
+                EXPECT_TRUE(success);
+                written.push_back(file);
+            });
+        }
+        writer.waitForIdle();
+        ASSERT_EQ(kNumWrites, (int)written.size());
+    }
+
+    for (int i = 0; i < kNumWrites; i++) {
+        const string file = string(dir.path) + "/" + std::to_string(i);
+        EXPECT_EQ(file, written[i]);
+        string content;
+        ASSERT_TRUE(android::base::ReadFileToString(file, &content));
+        EXPECT_EQ(getProtoBytes(*makeProto(i)), content);
+    }
+
+    // The temporary files are renamed.
+    unique_ptr<DIR, decltype(&closedir)> openedDir(opendir(dir.path), closedir);
+    ASSERT_NE(nullptr, openedDir);
+    int numFiles = 0;
+    while (dirent* de = readdir(openedDir.get())) {
+        if (de->d_type != DT_DIR) {
+            EXPECT_NE('.', de->d_name[0]) << de->d_name;
+            numFiles++;
+        }
+    }
+    EXPECT_EQ(kNumWrites, numFiles);
+}
+
+TEST(AsyncFileWriterTest, TestQueuedWritesCompleteOnDestruction) {
+    TemporaryDir dir;
+    const string file = string(dir.path) + "/report";
+    bool success = false;
+    {
+        AsyncFileWriter writer(/*maxPendingWrites=*/4);
+        writer.write(file, makeProto(1), [&success](bool written) { success = written; });
+    }
+    EXPECT_TRUE(success);
+    string content;
+    EXPECT_TRUE(android::base::ReadFileToString(file, &content));
+}
+
+TEST(AsyncFileWriterTest, TestFailedWrite) {
+    TemporaryDir dir;
+    const string file = string(dir.path) + "/missing_dir/report";
+    bool called = false;
+    bool success = true;
+    AsyncFileWriter writer(/*maxPendingWrites=*/1);
+    writer.write(file, makeProto(1), [&called, &success](bool written) {
+        called = true;
+        success = written;
+    });
+    writer.waitForIdle();
+    EXPECT_TRUE(called);
+    EXPECT_FALSE(success);
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
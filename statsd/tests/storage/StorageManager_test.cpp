@@ -14,10 +14,12 @@
 
 #include "src/storage/StorageManager.h"
 
+#include <android-base/file.h>
 #include <android-base/unique_fd.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <stdio.h>
+#include <sys/stat.h>
 
 #include "android-base/stringprintf.h"
 #include "stats_log_util.h"
@@ -32,6 +34,10 @@ namespace statsd {
 
 using namespace testing;
 
+using android::util::FIELD_COUNT_REPEATED;
+using android::util::FIELD_TYPE_INT64;
+using android::util::FIELD_TYPE_MESSAGE;
+using android::util::FIELD_TYPE_STRING;
 using std::make_shared;
 using std::shared_ptr;
 using std::vector;
@@ -141,6 +147,17 @@ bool fileExist(string name) {
     return fd != -1;
 }
 
+string protoToString(ProtoOutputStream& proto) {
+    string bytes;
+    sp<android::util::ProtoReader> reader = proto.data();
+    while (reader->readBuffer() != NULL) {
+        bytes.append(reinterpret_cast<const char*>(reader->readBuffer()),
+                     reader->currentToRead());
+        reader->move(reader->currentToRead());
+    }
+    return bytes;
+}
+
 /* The following AppendConfigReportTests test the 4 combinations of [whether erase data] [whether
  * the caller is adb] */
 TEST(StorageManagerTest, AppendConfigReportTest1) {
@@ -203,6 +220,194 @@ TEST(StorageManagerTest, AppendConfigReportTest4) {
     clearLocalHistoryTestFiles();
 }
 
+TEST(StorageManagerTest, AppendCompressedConfigReportTest) {
+    // Repeated strings, like the dimensions and uid map of a report.
+    ProtoOutputStream report;
+    for (int i = 0; i < 1000; i++) {
+        report.write(FIELD_TYPE_STRING | FIELD_COUNT_REPEATED | 9, "com.android.package" +
+                                                                       std::to_string(i % 10));
+    }
+    const string reportBytes = protoToString(report);
+    ProtoOutputStream expected;
+    for (int i = 0; i < 2; i++) {
+        expected.write(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | 2, reportBytes.c_str(),
+                       reportBytes.size());
+    }
+
+    const ConfigKey key(1066, 2);
+    // Timestamps in the future, so the files aren't trimmed as too old by the writes.
+    const string compressedFile =
+            StorageManager::getDataFileName(2557169400, key.GetUid(), key.GetId());
+    const string rawFile = StorageManager::getDataFileName(2557169401, key.GetUid(), key.GetId());
+    StorageManager::setCompressReports(true);
+    StorageManager::writeFile(compressedFile.c_str(), report);
+    StorageManager::setCompressReports(false);
+    StorageManager::writeFile(rawFile.c_str(), report);
+
+    struct stat compressedStat;
+    ASSERT_EQ(0, stat(compressedFile.c_str(), &compressedStat));
+    EXPECT_LT(compressedStat.st_size * 5, (off_t)report.size());
+
+    // Both reports are read back the same.
+    ProtoOutputStream out;
+    StorageManager::appendConfigMetricsReport(key, &out, true /*erase?*/, false /*isAdb?*/);
+    EXPECT_EQ(protoToString(expected), protoToString(out));
+    EXPECT_FALSE(fileExist(compressedFile));
+    EXPECT_FALSE(fileExist(rawFile));
+}
+
+TEST(StorageManagerTest, DataDirIndexTest) {
+    ProtoOutputStream report;
+    report.write(FIELD_TYPE_INT64 | 1, (long long)10);
+    const string reportBytes = protoToString(report);
+    ProtoOutputStream expected;
+    for (int i = 0; i < 2; i++) {
+        expected.write(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | 2, reportBytes.c_str(),
+                       reportBytes.size());
+    }
+
+    const ConfigKey key(1066, 3);
+    const string reportFile1 =
+            StorageManager::getDataFileName(2557169400, key.GetUid(), key.GetId());
+    const string reportFile2 =
+            StorageManager::getDataFileName(2557169401, key.GetUid(), key.GetId());
+    const string reportFile3 =
+            StorageManager::getDataFileName(2557169402, key.GetUid(), key.GetId());
+
+    // Files written before the index is enabled are found by its initial scan.
+    StorageManager::writeFile(reportFile1.c_str(), report);
+    StorageManager::setDataDirIndex(true);
+    EXPECT_TRUE(StorageManager::hasConfigMetricsReport(key));
+
+    StorageManager::writeFileAtomically(reportFile2.c_str(), report);
+    StorageManager::writeFile(reportFile3.c_str(), report);
+    StorageManager::deleteFile(reportFile3.c_str());
+
+    // The reports are renamed to history files, which the index follows.
+    ProtoOutputStream out;
+    StorageManager::appendConfigMetricsReport(key, &out, false /*erase?*/, false /*isAdb?*/);
+    EXPECT_EQ(protoToString(expected), protoToString(out));
+    EXPECT_FALSE(StorageManager::hasConfigMetricsReport(key));
+    EXPECT_TRUE(fileExist(reportFile1 + "_history"));
+    EXPECT_TRUE(fileExist(reportFile2 + "_history"));
+
+    ProtoOutputStream adbOut;
+    StorageManager::appendConfigMetricsReport(key, &adbOut, true /*erase?*/, true /*isAdb?*/);
+    EXPECT_EQ(protoToString(expected), protoToString(adbOut));
+    EXPECT_FALSE(fileExist(reportFile1 + "_history"));
+    EXPECT_FALSE(fileExist(reportFile2 + "_history"));
+
+    ProtoOutputStream emptyOut;
+    StorageManager::appendConfigMetricsReport(key, &emptyOut, true /*erase?*/, true /*isAdb?*/);
+    EXPECT_EQ(0u, emptyOut.size());
+    StorageManager::setDataDirIndex(false);
+}
+
+void writeTestReport(int64_t value, ProtoOutputStream* report) {
+    report->write(FIELD_TYPE_INT64 | 1, (long long)value);
+}
+
+string makeReportList(const vector<int64_t>& values) {
+    ProtoOutputStream reportList;
+    for (int64_t value : values) {
+        ProtoOutputStream report;
+        writeTestReport(value, &report);
+        const string reportBytes = protoToString(report);
+        reportList.write(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | 2, reportBytes.c_str(),
+                         reportBytes.size());
+    }
+    return protoToString(reportList);
+}
+
+TEST(StorageManagerTest, ReportLogTest) {
+    const ConfigKey key(1066, 4);
+    StorageManager::setReportLogs(true);
+    for (int64_t i = 0; i < 3; i++) {
+        ProtoOutputStream report;
+        writeTestReport(i, &report);
+        const string file =
+                StorageManager::getDataFileName(2557169400 + i, key.GetUid(), key.GetId());
+        if (i == 1) {
+            StorageManager::writeFileAtomically(file.c_str(), report);
+        } else {
+            StorageManager::writeFile(file.c_str(), report);
+        }
+        EXPECT_FALSE(fileExist(file));
+    }
+    StorageManager::setReportLogs(false);
+
+    // All the reports are in the segment started by the first one.
+    const string log =
+            StorageManager::getDataFileName(2557169400, key.GetUid(), key.GetId()) + "_log";
+    EXPECT_TRUE(fileExist(log));
+    EXPECT_TRUE(StorageManager::hasConfigMetricsReport(key));
+
+    ProtoOutputStream out;
+    StorageManager::appendConfigMetricsReport(key, &out, true /*erase?*/, false /*isAdb?*/);
+    EXPECT_EQ(makeReportList({0, 1, 2}), protoToString(out));
+    EXPECT_FALSE(fileExist(log));
+}
+
+TEST(StorageManagerTest, ReportLogCorruptedTailTest) {
+    const ConfigKey key(1066, 5);
+    const string file = StorageManager::getDataFileName(2557169400, key.GetUid(), key.GetId());
+    StorageManager::setReportLogs(true);
+    for (int64_t i = 0; i < 2; i++) {
+        ProtoOutputStream report;
+        writeTestReport(i, &report);
+        StorageManager::writeFile(file.c_str(), report);
+    }
+    StorageManager::setReportLogs(false);
+
+    // A record whose write was interrupted.
+    const string log = file + "_log";
+    android::base::unique_fd fd(
+            TEMP_FAILURE_RETRY(open(log.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC)));
+    ASSERT_NE(-1, fd);
+    const uint32_t header[2] = {100, 0};
+    ASSERT_TRUE(android::base::WriteFully(fd, header, sizeof(header)));
+    ASSERT_TRUE(android::base::WriteStringToFd("truncated", fd));
+
+    ProtoOutputStream out;
+    StorageManager::appendConfigMetricsReport(key, &out, true /*erase?*/, false /*isAdb?*/);
+    EXPECT_EQ(makeReportList({0, 1}), protoToString(out));
+    EXPECT_FALSE(fileExist(log));
+}
+
+TEST(StorageManagerTest, ReportLogCompactionTest) {
+    const ConfigKey key(1066, 6);
+    StorageManager::setReportLogs(true);
+    // Each upload renames the segment to a local history one, then a new segment is started.
+    for (int64_t i = 0; i < 3; i++) {
+        ProtoOutputStream report;
+        writeTestReport(i, &report);
+        const string file =
+                StorageManager::getDataFileName(2557169400 + i, key.GetUid(), key.GetId());
+        StorageManager::writeFile(file.c_str(), report);
+        ProtoOutputStream out;
+        StorageManager::appendConfigMetricsReport(key, &out, false /*erase?*/, false /*isAdb?*/);
+        EXPECT_EQ(makeReportList({i}), protoToString(out));
+        EXPECT_TRUE(fileExist(file + "_log_history"));
+    }
+    StorageManager::setReportLogs(false);
+
+    StorageManager::trimToFit("/data/misc/stats-data");
+    const string history =
+            StorageManager::getDataFileName(2557169400, key.GetUid(), key.GetId()) +
+            "_log_history";
+    EXPECT_TRUE(fileExist(history));
+    for (int64_t i = 1; i < 3; i++) {
+        EXPECT_FALSE(fileExist(
+                StorageManager::getDataFileName(2557169400 + i, key.GetUid(), key.GetId()) +
+                "_log_history"));
+    }
+
+    ProtoOutputStream out;
+    StorageManager::appendConfigMetricsReport(key, &out, true /*erase?*/, true /*isAdb?*/);
+    EXPECT_EQ(makeReportList({0, 1, 2}), protoToString(out));
+    EXPECT_FALSE(fileExist(history));
+}
+
 TEST(StorageManagerTest, TrainInfoReadWrite32To64BitTest) {
     InstallTrainInfo trainInfo;
     trainInfo.trainVersionCode = 12345;
@@ -317,6 +522,51 @@ TEST(StorageManagerTest, DeleteLargeDbFiles) {
             base::StringPrintf("%s/%s", STATS_RESTRICTED_DATA_DIR, "123_12345.db").c_str()));
 }
 
+TEST(StorageManagerTest, ReadProtoFromFileTest) {
+    StatsdConfig config;
+    config.set_id(12345);
+    for (int i = 0; i < 100; i++) {
+        config.add_allowed_log_source("com.android.package" + std::to_string(i));
+    }
+    TemporaryFile file;
+    ASSERT_TRUE(android::base::WriteStringToFile(config.SerializeAsString(), file.path));
+
+    StatsdConfig readConfig;
+    ASSERT_TRUE(StorageManager::readProtoFromFile(file.path, &readConfig));
+    EXPECT_EQ(config.SerializeAsString(), readConfig.SerializeAsString());
+
+    // An empty file is an empty proto.
+    TemporaryFile emptyFile;
+    StatsdConfig emptyConfig;
+    ASSERT_TRUE(StorageManager::readProtoFromFile(emptyFile.path, &emptyConfig));
+    EXPECT_FALSE(emptyConfig.has_id());
+
+    TemporaryFile corruptedFile;
+    ASSERT_TRUE(android::base::WriteStringToFile("\xff\xff\xff", corruptedFile.path));
+    EXPECT_FALSE(StorageManager::readProtoFromFile(corruptedFile.path, &readConfig));
+
+    EXPECT_FALSE(
+            StorageManager::readProtoFromFile("/data/misc/stats-service/missing", &readConfig));
+}
+
+TEST(StorageManagerTest, WriteProtoFileTest) {
+    // Large enough for the proto to span several encoded buffers.
+    ProtoOutputStream proto;
+    for (int i = 0; i < 10000; i++) {
+        proto.write(FIELD_TYPE_INT64 | FIELD_COUNT_REPEATED | 1, (long long)i);
+        proto.write(FIELD_TYPE_STRING | FIELD_COUNT_REPEATED | 2, std::to_string(i));
+    }
+    const string expected = protoToString(proto);
+    ASSERT_EQ(proto.size(), expected.size());
+
+    TemporaryFile file;
+    StorageManager::writeFile(file.path, proto);
+
+    string content;
+    ASSERT_TRUE(android::base::ReadFileToString(file.path, &content));
+    EXPECT_EQ(expected, content);
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
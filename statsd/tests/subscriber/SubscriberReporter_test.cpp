@@ -18,6 +18,9 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <future>
+
+#include "anomaly/subscriber_util.h"
 #include "tests/statsd_test_util.h"
 
 using namespace testing;
@@ -99,6 +102,39 @@ TEST_F(SubscriberReporterTest, TestBroadcastSubscriberDeathKeepsReplacedPir) {
                                  {configKey2, {{subscriptionId1, pir3}}}};
     EXPECT_THAT(SubscriberReporter::getInstance().mIntentMap, ContainerEq(expectedIntentMap));
 }
+
+TEST_F(SubscriberReporterTest, TestAsyncSubscribersDropAlertsWhileBusy) {
+    Subscription subscription;
+    subscription.set_id(subscriptionId1);
+    subscription.set_rule_id(100);
+    subscription.mutable_broadcast_subscriber_details()->set_subscriber_id(subscriptionId1);
+    const vector<Subscription> subscriptions = {subscription};
+
+    std::promise<void> broadcastStarted;
+    std::promise<void> releaseBroadcast;
+    std::shared_future<void> released = releaseBroadcast.get_future().share();
+    EXPECT_CALL(*pir1, sendSubscriberBroadcast(configKey1.GetUid(), configKey1.GetId(),
+                                               subscriptionId1, 100, _, _))
+            .WillOnce(Invoke([&](int64_t, int64_t, int64_t, int64_t, const vector<string>&,
+                                 const StatsDimensionsValueParcel&) {
+                broadcastStarted.set_value();
+                released.wait();
+                return Status::ok();
+            }))
+            .WillOnce(Return(Status::ok()));
+
+    setAsyncSubscribers(true);
+    triggerSubscribers(100, 0, DEFAULT_METRIC_DIMENSION_KEY, 1, configKey1, subscriptions);
+    broadcastStarted.get_future().wait();
+
+    // The subscriber is still busy with the first broadcast.
+    triggerSubscribers(100, 0, DEFAULT_METRIC_DIMENSION_KEY, 2, configKey1, subscriptions);
+    releaseBroadcast.set_value();
+    waitForSubscribers();
+
+    triggerSubscribers(100, 0, DEFAULT_METRIC_DIMENSION_KEY, 3, configKey1, subscriptions);
+    setAsyncSubscribers(false);
+}
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "utils/ClockSnapshot.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+TEST(ClockSnapshotTest, TestClocksReadOnce) {
+    const int64_t elapsedBeforeNs = getElapsedRealtimeNs();
+    const int64_t wallBeforeNs = getWallClockNs();
+    ClockSnapshot clock;
+    const int64_t elapsedNs = clock.getElapsedRealtimeNs();
+    const int64_t wallNs = clock.getWallClockNs();
+    EXPECT_GE(elapsedNs, elapsedBeforeNs);
+    EXPECT_GE(wallNs, wallBeforeNs);
+
+    usleep(2000);
+    EXPECT_EQ(clock.getElapsedRealtimeNs(), elapsedNs);
+    EXPECT_EQ(clock.getWallClockNs(), wallNs);
+    EXPECT_GT(getElapsedRealtimeNs(), elapsedNs);
+}
+
+TEST(ClockSnapshotTest, TestClocksReadWhenFirstNeeded) {
+    ClockSnapshot clock;
+    usleep(2000);
+    const int64_t afterSleepNs = getElapsedRealtimeNs();
+    EXPECT_GE(clock.getElapsedRealtimeNs(), afterSleepNs);
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
@@ -233,6 +233,144 @@ TEST_F(DbUtilsTest, TestInsertTwoEvents) {
                 ElementsAre("atomId", "elapsedTimestampNs", "wallTimestampNs", "field_1"));
 }
 
+TEST_F(DbUtilsTest, TestInsertIsAtomic) {
+    int64_t eventElapsedTimeNs = 10000000000;
+
+    AStatsEvent* statsEvent1 = makeAStatsEvent(tagId, eventElapsedTimeNs + 10);
+    AStatsEvent_writeString(statsEvent1, "111");
+    LogEvent logEvent1 = makeLogEvent(statsEvent1);
+
+    // Doesn't match the STRICT text column.
+    AStatsEvent* statsEvent2 = makeAStatsEvent(tagId, eventElapsedTimeNs + 20);
+    AStatsEvent_writeFloat(statsEvent2, 2.5);
+    LogEvent logEvent2 = makeLogEvent(statsEvent2);
+
+    vector<LogEvent> events{logEvent1, logEvent2};
+
+    EXPECT_TRUE(createTableIfNeeded(key, metricId, logEvent1));
+    string err;
+    EXPECT_FALSE(insert(key, metricId, events, err));
+
+    std::vector<int32_t> columnTypes;
+    std::vector<string> columnNames;
+    std::vector<std::vector<std::string>> rows;
+    string zSql = "SELECT * FROM metric_111 ORDER BY elapsedTimestampNs";
+    EXPECT_TRUE(query(key, zSql, rows, columnTypes, columnNames, err));
+    EXPECT_EQ(rows.size(), 0);
+}
+
+TEST_F(DbUtilsTest, TestInsertEventBuffer) {
+    int64_t eventElapsedTimeNs = 10000000000;
+
+    AStatsEvent* statsEvent1 = makeAStatsEvent(tagId, eventElapsedTimeNs + 10);
+    AStatsEvent_writeString(statsEvent1, "111");
+    AStatsEvent_writeInt64(statsEvent1, 11);
+    AStatsEvent_writeFloat(statsEvent1, 1.5);
+    LogEvent logEvent1 = makeLogEvent(statsEvent1);
+
+    AStatsEvent* statsEvent2 = makeAStatsEvent(tagId, eventElapsedTimeNs + 20);
+    AStatsEvent_writeString(statsEvent2, "");
+    AStatsEvent_writeInt64(statsEvent2, 22);
+    AStatsEvent_writeFloat(statsEvent2, 2.5);
+    LogEvent logEvent2 = makeLogEvent(statsEvent2);
+
+    RestrictedEventBuffer events;
+    EXPECT_TRUE(events.append(logEvent1));
+    EXPECT_TRUE(events.append(logEvent2));
+    EXPECT_EQ(events.getNumEvents(), 2);
+
+    EXPECT_TRUE(isEventCompatible(key, metricId, events));
+    EXPECT_TRUE(createTableIfNeeded(key, metricId, events));
+    EXPECT_TRUE(isEventCompatible(key, metricId, logEvent1));
+    string err;
+    EXPECT_TRUE(insert(key, metricId, events, err));
+
+    std::vector<int32_t> columnTypes;
+    std::vector<string> columnNames;
+    std::vector<std::vector<std::string>> rows;
+    string zSql = "SELECT * FROM metric_111 ORDER BY elapsedTimestampNs";
+    EXPECT_TRUE(query(key, zSql, rows, columnTypes, columnNames, err));
+
+    ASSERT_EQ(rows.size(), 2);
+    EXPECT_THAT(rows[0], ElementsAre("1", to_string(eventElapsedTimeNs + 10), _, "111", "11", _));
+    EXPECT_FLOAT_EQ(std::stof(rows[0][5]), 1.5);
+    EXPECT_THAT(rows[1], ElementsAre("1", to_string(eventElapsedTimeNs + 20), _, "", "22", _));
+    EXPECT_FLOAT_EQ(std::stof(rows[1][5]), 2.5);
+    EXPECT_THAT(columnNames, ElementsAre("atomId", "elapsedTimestampNs", "wallTimestampNs",
+                                         "field_1", "field_2", "field_3"));
+}
+
+TEST_F(DbUtilsTest, TestEventBufferRejectsDifferentColumns) {
+    AStatsEvent* statsEvent1 = makeAStatsEvent(tagId, 10);
+    AStatsEvent_writeString(statsEvent1, "111");
+    LogEvent logEvent1 = makeLogEvent(statsEvent1);
+
+    AStatsEvent* statsEvent2 = makeAStatsEvent(tagId, 20);
+    AStatsEvent_writeInt32(statsEvent2, 222);
+    LogEvent logEvent2 = makeLogEvent(statsEvent2);
+
+    RestrictedEventBuffer events;
+    EXPECT_TRUE(events.append(logEvent1));
+    const size_t byteSize = events.getByteSize();
+    EXPECT_FALSE(events.append(logEvent2));
+    EXPECT_EQ(events.getNumEvents(), 1);
+    EXPECT_EQ(events.getByteSize(), byteSize);
+
+    events.clear();
+    EXPECT_TRUE(events.append(logEvent2));
+    EXPECT_EQ(events.getNumEvents(), 1);
+}
+
+TEST_F(DbUtilsTest, TestInsertPersistentDbConnection) {
+    setPersistentDbConnections(true);
+    int64_t eventElapsedTimeNs = 10000000000;
+
+    AStatsEvent* statsEvent1 = makeAStatsEvent(tagId, eventElapsedTimeNs + 10);
+    AStatsEvent_writeString(statsEvent1, "111");
+    LogEvent logEvent1 = makeLogEvent(statsEvent1);
+
+    AStatsEvent* statsEvent2 = makeAStatsEvent(tagId, eventElapsedTimeNs + 20);
+    AStatsEvent_writeString(statsEvent2, "222");
+    LogEvent logEvent2 = makeLogEvent(statsEvent2);
+
+    EXPECT_TRUE(createTableIfNeeded(key, metricId, logEvent1));
+    string err;
+    // The second insert uses the statement cached by the first one.
+    EXPECT_TRUE(insert(key, metricId, {logEvent1}, err));
+    EXPECT_TRUE(insert(key, metricId, {logEvent2}, err));
+
+    std::vector<int32_t> columnTypes;
+    std::vector<string> columnNames;
+    std::vector<std::vector<std::string>> rows;
+    string zSql = "SELECT * FROM metric_111 ORDER BY elapsedTimestampNs";
+    EXPECT_TRUE(query(key, zSql, rows, columnTypes, columnNames, err));
+    ASSERT_EQ(rows.size(), 2);
+    EXPECT_THAT(rows[0], ElementsAre("1", to_string(eventElapsedTimeNs + 10), _, "111"));
+    EXPECT_THAT(rows[1], ElementsAre("1", to_string(eventElapsedTimeNs + 20), _, "222"));
+
+    // The table is created again with another schema.
+    AStatsEvent* statsEvent3 = makeAStatsEvent(tagId, eventElapsedTimeNs + 30);
+    AStatsEvent_writeInt32(statsEvent3, 333);
+    AStatsEvent_writeInt64(statsEvent3, 444);
+    LogEvent logEvent3 = makeLogEvent(statsEvent3);
+    EXPECT_TRUE(deleteTable(key, metricId));
+    EXPECT_TRUE(createTableIfNeeded(key, metricId, logEvent3));
+    EXPECT_TRUE(insert(key, metricId, {logEvent3}, err));
+
+    rows.clear();
+    columnTypes.clear();
+    columnNames.clear();
+    EXPECT_TRUE(query(key, zSql, rows, columnTypes, columnNames, err));
+    ASSERT_EQ(rows.size(), 1);
+    EXPECT_THAT(rows[0], ElementsAre("1", to_string(eventElapsedTimeNs + 30), _, "333", "444"));
+
+    // The write-ahead log is deleted with the db.
+    deleteDb(key);
+    EXPECT_FALSE(StorageManager::hasFile(getDbName(key).c_str()));
+    EXPECT_FALSE(StorageManager::hasFile((getDbName(key) + "-wal").c_str()));
+    setPersistentDbConnections(false);
+}
+
 TEST_F(DbUtilsTest, TestInsertTwoEventsEnforceTtl) {
     int64_t eventElapsedTimeNs = 10000000000;
     int64_t eventWallClockNs = 50000000000;
@@ -270,6 +408,30 @@ TEST_F(DbUtilsTest, TestInsertTwoEventsEnforceTtl) {
                 ElementsAre("atomId", "elapsedTimestampNs", "wallTimestampNs", "field_1"));
 }
 
+TEST_F(DbUtilsTest, TestCreateTableCreatesTtlIndex) {
+    AStatsEvent* statsEvent = makeAStatsEvent(tagId, 10);
+    AStatsEvent_writeString(statsEvent, "111");
+    LogEvent logEvent = makeLogEvent(statsEvent);
+    EXPECT_TRUE(createTableIfNeeded(key, metricId, logEvent));
+    // Doesn't fail if the index already exists.
+    EXPECT_TRUE(createTableIfNeeded(key, metricId, logEvent));
+
+    string err;
+    std::vector<int32_t> columnTypes;
+    std::vector<string> columnNames;
+    std::vector<std::vector<std::string>> rows;
+    string zSql = "SELECT name FROM sqlite_master WHERE type = 'index' AND tbl_name = 'metric_111'";
+    EXPECT_TRUE(query(key, zSql, rows, columnTypes, columnNames, err));
+    ASSERT_EQ(rows.size(), 1);
+    EXPECT_THAT(rows[0], ElementsAre("metric_111_wallTimestampNs"));
+
+    zSql = "EXPLAIN QUERY PLAN DELETE FROM metric_111 WHERE wallTimestampNs <= 100";
+    rows.clear();
+    EXPECT_TRUE(query(key, zSql, rows, columnTypes, columnNames, err));
+    ASSERT_FALSE(rows.empty());
+    EXPECT_THAT(rows[0].back(), HasSubstr("metric_111_wallTimestampNs"));
+}
+
 TEST_F(DbUtilsTest, TestMaliciousQuery) {
     int64_t eventElapsedTimeNs = 10000000000;
 
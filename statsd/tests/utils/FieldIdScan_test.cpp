@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "utils/FieldIdScan.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#ifdef __ANDROID__
+
+using std::vector;
+
+namespace android {
+namespace os {
+namespace statsd {
+
+TEST(FieldIdScanTest, TestMatchFieldIds) {
+    const vector<int32_t> fieldIds = {0x00010000, 0x02020101, 0x02020102, 0x02028201,
+                                      0x02028202, 0x00030000, 0x00040000};
+
+    EXPECT_EQ(0b0000001u, matchFieldIds(fieldIds.data(), fieldIds.size(), 0xff7f0000, 0x00010000));
+    EXPECT_EQ(0b1000000u, matchFieldIds(fieldIds.data(), fieldIds.size(), 0xff7f0000, 0x00040000));
+    // First, last & all uids of the attribution chain.
+    EXPECT_EQ(0b0000010u, matchFieldIds(fieldIds.data(), fieldIds.size(), 0xff7f7f7f, 0x02020101));
+    EXPECT_EQ(0b0001000u, matchFieldIds(fieldIds.data(), fieldIds.size(), 0xff7f807f, 0x02028001));
+    EXPECT_EQ(0b0001010u, matchFieldIds(fieldIds.data(), fieldIds.size(), 0xff7f007f, 0x02020001));
+    EXPECT_EQ(0u, matchFieldIds(fieldIds.data(), fieldIds.size(), 0xff7f0000, 0x00020000));
+    EXPECT_EQ(0u, matchFieldIds(fieldIds.data(), 0, 0xff7f0000, 0x00010000));
+}
+
+TEST(FieldIdScanTest, TestMatchFieldIdsFullBlock) {
+    vector<int32_t> fieldIds;
+    uint64_t expected = 0;
+    for (size_t i = 0; i < kFieldIdScanBlockSize; i++) {
+        fieldIds.push_back((i % 3 + 1) << 16);
+        if (i % 3 == 1) {
+            expected |= 1ULL << i;
+        }
+    }
+    EXPECT_EQ(expected,
+              matchFieldIds(fieldIds.data(), fieldIds.size(), 0xff7f0000, 0x00020000));
+
+    // Every count exercises a different split between the vectorized and the scalar loops.
+    for (size_t count = 0; count <= kFieldIdScanBlockSize; count++) {
+        const uint64_t countMask = count == 64 ? ~0ULL : (1ULL << count) - 1;
+        EXPECT_EQ(expected & countMask,
+                  matchFieldIds(fieldIds.data(), count, 0xff7f0000, 0x00020000))
+                << "count " << count;
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "utils/FlatHashMap.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "HashableDimensionKey.h"
+
+#ifdef __ANDROID__
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+MetricDimensionKey createKey(int32_t uid, const string& tag) {
+    int pos[] = {1, 0, 0};
+    HashableDimensionKey whatKey;
+    whatKey.addValue(FieldValue(Field(10, pos, 0), Value(uid)));
+    pos[0] = 2;
+    whatKey.addValue(FieldValue(Field(10, pos, 0), Value(tag)));
+    return MetricDimensionKey(whatKey, HashableDimensionKey());
+}
+
+vector<int> getKeys(const FlatHashMap<int, int>& map) {
+    vector<int> keys;
+    for (const auto& [key, value] : map) {
+        keys.push_back(key);
+    }
+    return keys;
+}
+
+}  // anonymous namespace
+
+TEST(FlatHashMapTest, TestInsertFindErase) {
+    FlatHashMap<MetricDimensionKey, int64_t> map;
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.end(), map.find(createKey(1000, "tag")));
+
+    map[createKey(1000, "tag")] = 1;
+    map[createKey(1000, "tag")] += 2;
+    EXPECT_TRUE(map.insert({createKey(1001, "tag"), 5}).second);
+    EXPECT_FALSE(map.insert({createKey(1001, "tag"), 6}).second);
+    EXPECT_TRUE(map.emplace(createKey(1000, "tag2"), 7).second);
+    ASSERT_EQ(3, map.size());
+
+    auto it = map.find(createKey(1000, "tag"));
+    ASSERT_NE(map.end(), it);
+    EXPECT_EQ(3, it->second);
+    EXPECT_EQ(5, map.find(createKey(1001, "tag"))->second);
+    EXPECT_EQ(7, map.find(createKey(1000, "tag2"))->second);
+    EXPECT_EQ(0, map.count(createKey(1002, "tag")));
+
+    EXPECT_EQ(1, map.erase(createKey(1000, "tag")));
+    EXPECT_EQ(0, map.erase(createKey(1000, "tag")));
+    ASSERT_EQ(2, map.size());
+    EXPECT_EQ(map.end(), map.find(createKey(1000, "tag")));
+    EXPECT_EQ(5, map.find(createKey(1001, "tag"))->second);
+
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.begin(), map.end());
+}
+
+TEST(FlatHashMapTest, TestIterationOrder) {
+    FlatHashMap<int, int> map;
+    for (int key : {7, 3, 11, 5, 2}) {
+        map[key] = key;
+    }
+    // Most recently inserted first.
+    EXPECT_EQ(vector<int>({2, 5, 11, 3, 7}), getKeys(map));
+
+    map.erase(3);
+    map[40] = 40;
+    EXPECT_EQ(vector<int>({40, 2, 5, 11, 7}), getKeys(map));
+
+    // Order is kept when rehashing.
+    for (int i = 100; i < 200; i++) {
+        map[i] = i;
+    }
+    for (int i = 100; i < 200; i++) {
+        map.erase(i);
+    }
+    EXPECT_EQ(vector<int>({40, 2, 5, 11, 7}), getKeys(map));
+}
+
+TEST(FlatHashMapTest, TestEraseWhileIterating) {
+    FlatHashMap<int, int> map;
+    for (int i = 0; i < 100; i++) {
+        map[i] = i;
+    }
+    for (auto it = map.begin(); it != map.end();) {
+        if (it->first % 2 == 0) {
+            it = map.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    ASSERT_EQ(50, map.size());
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(i % 2, map.count(i));
+    }
+}
+
+TEST(FlatHashMapTest, TestSameAsUnorderedMap) {
+    FlatHashMap<int, string> map;
+    std::unordered_map<int, string> expected;
+    srand(1);
+    for (int i = 0; i < 100000; i++) {
+        const int key = rand() % 1000;
+        if (rand() % 3 == 0) {
+            EXPECT_EQ(expected.erase(key), map.erase(key));
+        } else {
+            map[key] = std::to_string(i);
+            expected[key] = std::to_string(i);
+        }
+        ASSERT_EQ(expected.size(), map.size());
+    }
+    for (const auto& [key, value] : map) {
+        EXPECT_EQ(expected[key], value);
+    }
+}
+
+TEST(FlatHashMapTest, TestCopyAndMove) {
+    FlatHashMap<MetricDimensionKey, vector<int>> map;
+    map[createKey(1000, "tag")].push_back(1);
+    map[createKey(1001, "tag")].push_back(2);
+
+    FlatHashMap<MetricDimensionKey, vector<int>> copy(map);
+    EXPECT_EQ(map, copy);
+
+    FlatHashMap<MetricDimensionKey, vector<int>> moved(std::move(copy));
+    EXPECT_EQ(map, moved);
+    EXPECT_TRUE(copy.empty());
+
+    moved[createKey(1000, "tag")].push_back(3);
+    EXPECT_NE(map, moved);
+}
+
+TEST(FlatHashMapTest, TestFindBorrowed) {
+    FlatHashMap<MetricDimensionKey, int64_t> map;
+    for (int i = 0; i < 100; i++) {
+        map[createKey(1000 + i, "tag")] = i;
+    }
+    for (int i = 0; i < 101; i++) {
+        // The view borrows the values of another key with the same values.
+        const MetricDimensionKey key = createKey(1000 + i, "tag");
+        MetricDimensionKeyView view(key.getStateValuesKey());
+        for (const FieldValue& value : key.getDimensionKeyInWhat().getValues()) {
+            ASSERT_TRUE(view.addValue(value, value.mField.getField()));
+        }
+        auto it = map.findBorrowed(view);
+        if (i < 100) {
+            ASSERT_NE(map.end(), it);
+            EXPECT_EQ(i, it->second);
+        } else {
+            EXPECT_EQ(map.end(), it);
+        }
+    }
+}
+
+TEST(FlatHashMapTest, TestMoveOnlyValues) {
+    FlatHashMap<int, unique_ptr<int>> map;
+    for (int i = 0; i < 100; i++) {
+        map[i] = std::make_unique<int>(i);
+    }
+    for (int i = 0; i < 100; i++) {
+        ASSERT_NE(nullptr, map[i]);
+        EXPECT_EQ(i, *map[i]);
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
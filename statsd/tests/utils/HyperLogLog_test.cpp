@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "utils/HyperLogLog.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+TEST(HyperLogLogTest, TestPrecisionClamped) {
+    EXPECT_EQ(HyperLogLog::kMinPrecision, HyperLogLog(0).getPrecision());
+    EXPECT_EQ(HyperLogLog::kMaxPrecision, HyperLogLog(30).getPrecision());
+    EXPECT_EQ(1024UL, HyperLogLog(10).byteSize());
+}
+
+TEST(HyperLogLogTest, TestSmallCardinalitiesExact) {
+    HyperLogLog hll;
+    EXPECT_EQ(0, hll.estimate());
+    for (int i = 0; i < 3; i++) {
+        for (int64_t value = 0; value < 10; value++) {
+            hll.add(HyperLogLog::hash(value));
+        }
+    }
+    EXPECT_EQ(10, hll.estimate());
+}
+
+TEST(HyperLogLogTest, TestEstimateError) {
+    for (const int64_t numValues : {1000, 100000}) {
+        HyperLogLog hll;
+        for (int64_t value = 0; value < numValues; value++) {
+            hll.add(HyperLogLog::hash("package" + std::to_string(value)));
+        }
+        // About 4 standard errors at the default precision.
+        EXPECT_NEAR(numValues, hll.estimate(), numValues * 0.1) << numValues;
+    }
+}
+
+TEST(HyperLogLogTest, TestMerge) {
+    HyperLogLog first;
+    HyperLogLog second;
+    HyperLogLog both;
+    for (int64_t value = 0; value < 1000; value++) {
+        (value < 600 ? first : second).add(HyperLogLog::hash(value));
+        both.add(HyperLogLog::hash(value));
+    }
+    for (int64_t value = 400; value < 600; value++) {
+        second.add(HyperLogLog::hash(value));
+    }
+    ASSERT_TRUE(first.merge(second));
+    EXPECT_EQ(both.getRegisters(), first.getRegisters());
+
+    HyperLogLog otherPrecision(HyperLogLog::kDefaultPrecision + 1);
+    otherPrecision.add(HyperLogLog::hash(1000));
+    EXPECT_FALSE(first.merge(otherPrecision));
+    EXPECT_EQ(both.getRegisters(), first.getRegisters());
+}
+
+TEST(HyperLogLogTest, TestHashIsStable) {
+    // The hashes are part of the report format, sketches from all devices must match.
+    EXPECT_EQ(0x910a2dec89025cc1ULL, HyperLogLog::hash(int64_t{1}));
+    EXPECT_EQ(HyperLogLog::hash(std::string("com.android.shell")),
+              HyperLogLog::hash(std::string_view("com.android.shell")));
+    EXPECT_NE(HyperLogLog::hash(std::string("a")), HyperLogLog::hash(std::string("b")));
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "utils/InternedString.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __ANDROID__
+
+using std::string;
+using std::vector;
+
+namespace android {
+namespace os {
+namespace statsd {
+
+TEST(InternedStringTest, TestSameContentsShared) {
+    const string str = "com.android.app";
+    const InternedString a(str);
+    const InternedString b("com.android.app");
+    const InternedString c(string("com.android.app"));
+
+    EXPECT_EQ(a.data(), b.data());
+    EXPECT_EQ(a.data(), c.data());
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(str, a.str());
+    EXPECT_EQ(std::hash<string>()(str), a.hash());
+
+    const InternedString other("com.android.other");
+    EXPECT_NE(a.data(), other.data());
+    EXPECT_NE(a, other);
+    EXPECT_LT(a, other);
+    EXPECT_GT(other, a);
+}
+
+TEST(InternedStringTest, TestEmpty) {
+    const InternedString empty;
+    const InternedString emptyStr("");
+
+    EXPECT_TRUE(empty.empty());
+    EXPECT_TRUE(emptyStr.empty());
+    EXPECT_EQ(empty, emptyStr);
+    EXPECT_EQ(0u, empty.size());
+    EXPECT_EQ("", empty);
+    EXPECT_STREQ("", empty.c_str());
+    EXPECT_EQ(std::hash<string>()(""), empty.hash());
+    EXPECT_LT(empty, InternedString("a"));
+}
+
+TEST(InternedStringTest, TestCompareWithString) {
+    const InternedString str("wakelock");
+
+    EXPECT_EQ("wakelock", str);
+    EXPECT_EQ(str, string("wakelock"));
+    EXPECT_NE("wakelock2", str);
+    EXPECT_NE(str, string("wake"));
+}
+
+TEST(InternedStringTest, TestCopyAndMove) {
+    InternedString a("str");
+    const char* const data = a.data();
+
+    InternedString copy(a);
+    EXPECT_EQ(data, copy.data());
+
+    InternedString moved(std::move(a));
+    EXPECT_EQ(data, moved.data());
+    EXPECT_TRUE(a.empty());
+
+    a = moved;
+    EXPECT_EQ(data, a.data());
+    a = "other";
+    EXPECT_EQ("other", a);
+    EXPECT_EQ("str", moved);
+}
+
+TEST(InternedStringTest, TestUnreferencedEntriesSwept) {
+    const InternedString kept("kept string");
+    const size_t initialSize = InternedString::getPoolSize();
+    for (int i = 0; i < 100000; i++) {
+        InternedString str("string" + std::to_string(i));
+    }
+
+    // Unreferenced entries are swept once a shard doubles in size.
+    EXPECT_LT(InternedString::getPoolSize(), initialSize + 16 * 2 * 256 + 1);
+    EXPECT_EQ("kept string", kept);
+    EXPECT_EQ(kept.data(), InternedString("kept string").data());
+}
+
+TEST(InternedStringTest, TestSweepPool) {
+    const InternedString kept("kept by sweep");
+    for (int i = 0; i < 100; i++) {
+        InternedString str("swept" + std::to_string(i));
+    }
+
+    // Some of the entries may have been swept already when their shard doubled in size.
+    const size_t sizeBeforeSweep = InternedString::getPoolSize();
+    const size_t numFreed = InternedString::sweepPool();
+    EXPECT_GT(numFreed, 0u);
+    EXPECT_EQ(sizeBeforeSweep - numFreed, InternedString::getPoolSize());
+    EXPECT_EQ(0u, InternedString::sweepPool());
+    EXPECT_EQ(kept.data(), InternedString("kept by sweep").data());
+}
+
+TEST(InternedStringTest, TestConcurrentInterning) {
+    vector<std::thread> threads;
+    vector<vector<InternedString>> strings(4);
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([t, &strings] {
+            for (int i = 0; i < 10000; i++) {
+                InternedString str("tag" + std::to_string(i % 100));
+                if (i < 100) {
+                    strings[t].push_back(str);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (int t = 1; t < 4; t++) {
+        ASSERT_EQ(strings[0].size(), strings[t].size());
+        for (int i = 0; i < strings[0].size(); i++) {
+            EXPECT_EQ(strings[0][i].data(), strings[t][i].data());
+        }
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "utils/MemoryPressureMonitor.h"
+
+#include <gtest/gtest.h>
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+TEST(MemoryPressureMonitorTest, TestStartFailsWithoutPsi) {
+    int pressureCount = 0;
+    MemoryPressureMonitor monitor([&pressureCount] { pressureCount++; });
+    EXPECT_FALSE(monitor.start("/proc/pressure/does_not_exist"));
+    monitor.stop();
+    EXPECT_EQ(0, pressureCount);
+    EXPECT_EQ(0, monitor.getPressureCount());
+}
+
+TEST(MemoryPressureMonitorTest, TestStartAndStop) {
+    MemoryPressureMonitor monitor([] {});
+    if (!monitor.start()) {
+        GTEST_SKIP() << "PSI is not available";
+    }
+    // Starting again is a no-op.
+    EXPECT_TRUE(monitor.start());
+    monitor.stop();
+    monitor.stop();
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
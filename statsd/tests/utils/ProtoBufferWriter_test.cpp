@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "utils/ProtoBufferWriter.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+// Encodes the fields twice, to count their bytes and then to write them.
+template <typename EncodeFields>
+std::vector<uint8_t> encode(const EncodeFields& encodeFields) {
+    ProtoBufferWriter counter;
+    encodeFields(&counter);
+    std::vector<uint8_t> buffer(counter.size());
+    ProtoBufferWriter writer(buffer.data());
+    encodeFields(&writer);
+    EXPECT_EQ(counter.size(), writer.size());
+    return buffer;
+}
+
+}  // anonymous namespace
+
+TEST(ProtoBufferWriterTest, TestPrimitiveFields) {
+    const std::vector<uint8_t> bytes = encode([](ProtoBufferWriter* writer) {
+        writer->writeInt32(1, 150);
+        writer->writeInt32(2, -1);
+        writer->writeInt64(3, 0);
+        writer->writeFloat(4, 1.0f);
+        writer->writeBytes(16, "ab", 2);
+    });
+    const std::vector<uint8_t> expected = {
+            0x08, 0x96, 0x01,                                                  // 1: 150
+            0x10, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01,  // 2: -1
+            0x18, 0x00,                                                        // 3: 0
+            0x25, 0x00, 0x00, 0x80, 0x3f,                                      // 4: 1.0f
+            0x82, 0x01, 0x02, 'a', 'b'};                                       // 16: "ab"
+    EXPECT_EQ(expected, bytes);
+}
+
+TEST(ProtoBufferWriterTest, TestEmbeddedMessage) {
+    const std::vector<uint8_t> bytes = encode([](ProtoBufferWriter* writer) {
+        writer->writeMessageHeader(1, ProtoBufferWriter::sizeOfInt32Field(1, 1000) +
+                                              ProtoBufferWriter::sizeOfBytesField(2, 0));
+        writer->writeInt32(1, 1000);
+        writer->writeBytes(2, nullptr, 0);
+    });
+    const std::vector<uint8_t> expected = {0x0a, 0x05, 0x08, 0xe8, 0x07, 0x12, 0x00};
+    EXPECT_EQ(expected, bytes);
+}
+
+TEST(ProtoBufferWriterTest, TestVarintSizes) {
+    EXPECT_EQ(1UL, ProtoBufferWriter::sizeOfVarint(0));
+    EXPECT_EQ(1UL, ProtoBufferWriter::sizeOfVarint(127));
+    EXPECT_EQ(2UL, ProtoBufferWriter::sizeOfVarint(128));
+    EXPECT_EQ(10UL, ProtoBufferWriter::sizeOfVarint(UINT64_MAX));
+    EXPECT_EQ(1UL, ProtoBufferWriter::sizeOfTag(15));
+    EXPECT_EQ(2UL, ProtoBufferWriter::sizeOfTag(16));
+    EXPECT_EQ(11UL, ProtoBufferWriter::sizeOfInt32Field(1, -1));
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "utils/ReportStringTable.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "hash.h"
+#include "src/stats_log.pb.h"
+#include "tests/statsd_test_util.h"
+
+#ifdef __ANDROID__
+
+using android::util::ProtoOutputStream;
+using std::set;
+using std::string;
+using testing::UnorderedElementsAre;
+
+namespace android {
+namespace os {
+namespace statsd {
+
+TEST(ReportStringTableTest, TestAddReturnsHash64) {
+    ReportStringTable table;
+    EXPECT_EQ(table.add(InternedString("wakelock")), Hash64(string("wakelock")));
+    EXPECT_EQ(table.add(InternedString("wakelock")), Hash64(string("wakelock")));
+    EXPECT_EQ(table.add(InternedString()), Hash64(string()));
+    EXPECT_EQ(table.size(), 2);
+}
+
+TEST(ReportStringTableTest, TestDedupeWithUidMapStrings) {
+    ReportStringTable table;
+    table.add(InternedString("com.android.app"));
+    table.add(set<string>{"com.android.app", "1.0"});
+
+    EXPECT_EQ(table.size(), 2);
+    EXPECT_TRUE(table.contains(InternedString("com.android.app")));
+    EXPECT_TRUE(table.contains(InternedString("1.0")));
+    EXPECT_FALSE(table.contains(InternedString("2.0")));
+}
+
+TEST(ReportStringTableTest, TestWriteToProto) {
+    ReportStringTable table;
+    table.add(InternedString("a"));
+    table.add(InternedString("b"));
+    table.add(InternedString("a"));
+
+    ProtoOutputStream proto;
+    table.writeToProto(/*fieldId=*/9, &proto);
+    ConfigMetricsReport report;
+    outputStreamToProto(&proto, &report);
+    EXPECT_THAT(report.strings(), UnorderedElementsAre("a", "b"));
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
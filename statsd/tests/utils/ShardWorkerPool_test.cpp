@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "utils/ShardWorkerPool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+TEST(ShardWorkerPoolTest, TestTasksRunInOrderPerShard) {
+    constexpr size_t kNumShards = 3;
+    constexpr int kTasksPerShard = 1000;
+    ShardWorkerPool pool(kNumShards);
+    ASSERT_EQ(kNumShards, pool.getNumShards());
+
+    // each shard vector is only accessed by the worker of the shard
+    std::vector<std::vector<int>> results(kNumShards);
+    for (int i = 0; i < kTasksPerShard; i++) {
+        for (size_t shard = 0; shard < kNumShards; shard++) {
+            pool.post(shard, [&results, shard, i] { results[shard].push_back(i); });
+        }
+    }
+    pool.waitForIdle();
+
+    for (size_t shard = 0; shard < kNumShards; shard++) {
+        ASSERT_EQ(kTasksPerShard, results[shard].size());
+        for (int i = 0; i < kTasksPerShard; i++) {
+            EXPECT_EQ(i, results[shard][i]);
+        }
+    }
+}
+
+TEST(ShardWorkerPoolTest, TestShardsRunOnDifferentThreads) {
+    ShardWorkerPool pool(2);
+    std::thread::id ids[2];
+    pool.post(0, [&ids] { ids[0] = std::this_thread::get_id(); });
+    pool.post(1, [&ids] { ids[1] = std::this_thread::get_id(); });
+    pool.waitForIdle();
+
+    EXPECT_NE(ids[0], ids[1]);
+    EXPECT_NE(std::this_thread::get_id(), ids[0]);
+    EXPECT_NE(std::this_thread::get_id(), ids[1]);
+}
+
+TEST(ShardWorkerPoolTest, TestDestructorRunsQueuedTasks) {
+    std::atomic_int completedTasks = 0;
+    {
+        ShardWorkerPool pool(2);
+        for (int i = 0; i < 100; i++) {
+            pool.post(i % 2, [&completedTasks] { completedTasks++; });
+        }
+    }
+    EXPECT_EQ(100, completedTasks);
+}
+
+TEST(ShardWorkerPoolTest, TestWaitForIdleWithoutTasks) {
+    ShardWorkerPool pool(2);
+    pool.waitForIdle();
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
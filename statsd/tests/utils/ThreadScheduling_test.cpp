@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "utils/ThreadScheduling.h"
+
+#include <gtest/gtest.h>
+
+#ifdef __ANDROID__
+
+using std::optional;
+using std::vector;
+
+namespace android {
+namespace os {
+namespace statsd {
+
+TEST(ThreadSchedulingTest, TestParseEmpty) {
+    const optional<ThreadScheduling> scheduling = parseThreadScheduling("");
+    ASSERT_TRUE(scheduling.has_value());
+    EXPECT_FALSE(scheduling->niceValue.has_value());
+    EXPECT_TRUE(scheduling->cpus.empty());
+    EXPECT_EQ(scheduling->fifoPriority, 0);
+}
+
+TEST(ThreadSchedulingTest, TestParseAllEntries) {
+    const optional<ThreadScheduling> scheduling =
+            parseThreadScheduling("nice=-10;cpus=0,6-7;fifo=2");
+    ASSERT_TRUE(scheduling.has_value());
+    EXPECT_EQ(scheduling->niceValue, -10);
+    EXPECT_EQ(scheduling->cpus, vector<int>({0, 6, 7}));
+    EXPECT_EQ(scheduling->fifoPriority, 2);
+    EXPECT_EQ(scheduling->toString(), "nice=-10;cpus=0,6,7;fifo=2");
+}
+
+TEST(ThreadSchedulingTest, TestParseCpuRange) {
+    const optional<ThreadScheduling> scheduling = parseThreadScheduling("cpus=4-7;");
+    ASSERT_TRUE(scheduling.has_value());
+    EXPECT_FALSE(scheduling->niceValue.has_value());
+    EXPECT_EQ(scheduling->cpus, vector<int>({4, 5, 6, 7}));
+    EXPECT_EQ(scheduling->toString(), "cpus=4,5,6,7");
+}
+
+TEST(ThreadSchedulingTest, TestParseInvalid) {
+    EXPECT_FALSE(parseThreadScheduling("nice").has_value());
+    EXPECT_FALSE(parseThreadScheduling("nice=20").has_value());
+    EXPECT_FALSE(parseThreadScheduling("nice=-21").has_value());
+    EXPECT_FALSE(parseThreadScheduling("nice=abc").has_value());
+    EXPECT_FALSE(parseThreadScheduling("cpus=").has_value());
+    EXPECT_FALSE(parseThreadScheduling("cpus=7-4").has_value());
+    EXPECT_FALSE(parseThreadScheduling("cpus=1-2-3").has_value());
+    EXPECT_FALSE(parseThreadScheduling("cpus=1,,2").has_value());
+    EXPECT_FALSE(parseThreadScheduling("fifo=0").has_value());
+    EXPECT_FALSE(parseThreadScheduling("fifo=100").has_value());
+    EXPECT_FALSE(parseThreadScheduling("priority=1").has_value());
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
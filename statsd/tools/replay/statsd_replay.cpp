@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a capture of the atoms received by statsd through StatsLogProcessor with a given config,
+ * without the statsd service, to measure what the config costs:
+ *
+ *   statsd_replay <config> <trace> [iterations]
+ *
+ * <config> is a serialized StatsdConfig, as given to "cmd stats config update". <trace> is a
+ * capture of socket messages, see readSocketMessageTrace. Each replay is repeated iterations times
+ * (1 by default) and the fastest one is reported, so the tool also works as a benchmark.
+ *
+ * The processing time, the bytes of the past buckets and the bytes of the report are printed for
+ * the whole config, then for each of its metrics replayed alone in a copy of the config without
+ * the other metrics. The cost of a metric alone includes the matchers and conditions it shares
+ * with other metrics. Pulled atoms are not available, their pulls fail.
+ */
+
+#include <android-base/file.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+#include "tests/statsd_test_util.h"
+
+using namespace std;
+using namespace android::os::statsd;
+
+namespace {
+
+const int64_t kConfigId = 12345;
+
+struct ReplayResult {
+    int64_t processingTimeNs = 0;
+    size_t metricsBytes = 0;
+    size_t reportBytes = 0;
+};
+
+vector<unique_ptr<LogEvent>> parseTrace(const vector<SocketMessage>& trace) {
+    vector<unique_ptr<LogEvent>> events;
+    events.reserve(trace.size());
+    for (const SocketMessage& message : trace) {
+        auto event = make_unique<LogEvent>(message.uid, message.pid);
+        if (event->parseBuffer(message.buffer.data(), message.buffer.size())) {
+            events.push_back(std::move(event));
+        }
+    }
+    sortLogEventsByTimestamp(&events);
+    return events;
+}
+
+// Replays the trace with the config and dumps its report at the end of the trace.
+ReplayResult replay(const StatsdConfig& config, const vector<SocketMessage>& trace) {
+    // The events may be modified by the processor, e.g. for isolated uids, so each replay parses
+    // them again.
+    const vector<unique_ptr<LogEvent>> events = parseTrace(trace);
+    ReplayResult result;
+    if (events.empty()) {
+        return result;
+    }
+    const ConfigKey key(0, kConfigId);
+    const int64_t startTimeNs = events.front()->GetElapsedTimestampNs();
+    const int64_t endTimeNs = events.back()->GetElapsedTimestampNs() + 1;
+    sp<StatsLogProcessor> processor =
+            CreateStatsLogProcessor(startTimeNs, startTimeNs, config, key);
+
+    const int64_t replayStartNs = getElapsedRealtimeNs();
+    for (const auto& event : events) {
+        processor->OnLogEvent(event.get());
+    }
+    result.processingTimeNs = getElapsedRealtimeNs() - replayStartNs;
+    result.metricsBytes = processor->GetMetricsSize(key);
+
+    vector<uint8_t> output;
+    processor->onDumpReport(key, endTimeNs, /*include_current_partial_bucket=*/true,
+                            /*erase_data=*/true, ADB_DUMP, FAST, &output);
+    result.reportBytes = output.size();
+    return result;
+}
+
+ReplayResult replayFastest(const StatsdConfig& config, const vector<SocketMessage>& trace,
+                           int iterations) {
+    ReplayResult fastest{.processingTimeNs = numeric_limits<int64_t>::max()};
+    for (int i = 0; i < iterations; i++) {
+        const ReplayResult result = replay(config, trace);
+        if (result.processingTimeNs < fastest.processingTimeNs) {
+            fastest = result;
+        }
+    }
+    return fastest;
+}
+
+vector<int64_t> getMetricIds(const StatsdConfig& config) {
+    vector<int64_t> metricIds;
+    for (const auto& metric : config.count_metric()) metricIds.push_back(metric.id());
+    for (const auto& metric : config.duration_metric()) metricIds.push_back(metric.id());
+    for (const auto& metric : config.event_metric()) metricIds.push_back(metric.id());
+    for (const auto& metric : config.gauge_metric()) metricIds.push_back(metric.id());
+    for (const auto& metric : config.value_metric()) metricIds.push_back(metric.id());
+    for (const auto& metric : config.kll_metric()) metricIds.push_back(metric.id());
+    return metricIds;
+}
+
+template <typename T>
+void keepMetric(google::protobuf::RepeatedPtrField<T>* metrics, int64_t metricId) {
+    metrics->erase(std::remove_if(metrics->begin(), metrics->end(),
+                                  [metricId](const T& metric) { return metric.id() != metricId; }),
+                   metrics->end());
+}
+
+// Returns a copy of the config with only the metric and none of the alerts.
+StatsdConfig getSingleMetricConfig(const StatsdConfig& config, int64_t metricId) {
+    StatsdConfig singleMetricConfig = config;
+    keepMetric(singleMetricConfig.mutable_count_metric(), metricId);
+    keepMetric(singleMetricConfig.mutable_duration_metric(), metricId);
+    keepMetric(singleMetricConfig.mutable_event_metric(), metricId);
+    keepMetric(singleMetricConfig.mutable_gauge_metric(), metricId);
+    keepMetric(singleMetricConfig.mutable_value_metric(), metricId);
+    keepMetric(singleMetricConfig.mutable_kll_metric(), metricId);
+    auto* activations = singleMetricConfig.mutable_metric_activation();
+    activations->erase(std::remove_if(activations->begin(), activations->end(),
+                                      [metricId](const MetricActivation& activation) {
+                                          return activation.metric_id() != metricId;
+                                      }),
+                       activations->end());
+    auto* noReportMetrics = singleMetricConfig.mutable_no_report_metric();
+    noReportMetrics->erase(std::remove_if(noReportMetrics->begin(), noReportMetrics->end(),
+                                          [metricId](int64_t id) { return id != metricId; }),
+                           noReportMetrics->end());
+    singleMetricConfig.clear_alert();
+    singleMetricConfig.clear_subscription();
+    return singleMetricConfig;
+}
+
+void printResult(const string& name, const ReplayResult& result, size_t numEvents) {
+    printf("%-24s %14lld %10lld %14zu %14zu\n", name.c_str(), (long long)result.processingTimeNs,
+           (long long)(numEvents > 0 ? result.processingTimeNs / (int64_t)numEvents : 0),
+           result.metricsBytes, result.reportBytes);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <config> <trace> [iterations]\n", argv[0]);
+        return 1;
+    }
+    string configBytes;
+    StatsdConfig config;
+    if (!android::base::ReadFileToString(argv[1], &configBytes) ||
+        !config.ParseFromString(configBytes)) {
+        fprintf(stderr, "Failed to read the config from %s\n", argv[1]);
+        return 1;
+    }
+    const vector<SocketMessage> trace = readSocketMessageTrace(argv[2]);
+    if (trace.empty()) {
+        fprintf(stderr, "Failed to read the trace from %s\n", argv[2]);
+        return 1;
+    }
+    const int iterations = argc > 3 ? max(atoi(argv[3]), 1) : 1;
+
+    printf("%zu messages, %d iterations\n", trace.size(), iterations);
+    printf("%-24s %14s %10s %14s %14s\n", "metric", "total_ns", "ns/event", "bucket_bytes",
+           "report_bytes");
+    printResult("config", replayFastest(config, trace, iterations), trace.size());
+    for (const int64_t metricId : getMetricIds(config)) {
+        printResult(to_string(metricId),
+                    replayFastest(getSingleMetricConfig(config, metricId), trace, iterations),
+                    trace.size());
+    }
+    return 0;
+}